@@ -116,10 +116,11 @@ class RnnlmModel(object):
 
     self.initial = tf.reshape(tf.stack(axis=0, values=self._initial_state_single), [config.num_layers, 1, size], name="test_initial_state")
 
-    # first implement the less efficient version
-    test_word_in = tf.placeholder(tf.int32, [1, 1], name="test_word_in")
+    # the test-time placeholders have a batch dimension of variable size, so
+    # that the rescoring code can evaluate many histories in one Session.Run().
+    test_word_in = tf.placeholder(tf.int32, [None, 1], name="test_word_in")
 
-    state_placeholder = tf.placeholder(tf.float32, [config.num_layers, 1, size], name="test_state_in")
+    state_placeholder = tf.placeholder(tf.float32, [config.num_layers, None, size], name="test_state_in")
     # unpacking the input state context 
     l = tf.unstack(state_placeholder, axis=0)
     test_input_state = tuple(
@@ -137,8 +138,8 @@ class RnnlmModel(object):
     with tf.variable_scope("RNN"):
       (test_cell_output, test_output_state) = self.cell(test_inputs[:, 0, :], test_input_state)
 
-    test_state_out = tf.reshape(tf.stack(axis=0, values=test_output_state), [config.num_layers, 1, size], name="test_state_out")
-    test_cell_out = tf.reshape(test_cell_output, [1, size], name="test_cell_out")
+    test_state_out = tf.reshape(tf.stack(axis=0, values=test_output_state), [config.num_layers, -1, size], name="test_state_out")
+    test_cell_out = tf.reshape(test_cell_output, [-1, size], name="test_cell_out")
     # above is the first part of the graph for test
     # test-word-in
     #               > ---- > test-state-out
@@ -150,8 +151,8 @@ class RnnlmModel(object):
     #               > prob(word | test-word-out)
     # test-cell-in
 
-    test_word_out = tf.placeholder(tf.int32, [1, 1], name="test_word_out")
-    cellout_placeholder = tf.placeholder(tf.float32, [1, size], name="test_cell_in")
+    test_word_out = tf.placeholder(tf.int32, [None, 1], name="test_word_out")
+    cellout_placeholder = tf.placeholder(tf.float32, [None, size], name="test_cell_in")
 
     softmax_w = tf.get_variable(
         "softmax_w", [size, vocab_size], dtype=data_type())
@@ -160,7 +161,8 @@ class RnnlmModel(object):
     test_logits = tf.matmul(cellout_placeholder, softmax_w) + softmax_b
     test_softmaxed = tf.nn.log_softmax(test_logits)
 
-    p_word = test_softmaxed[0, test_word_out[0,0]]
+    p_word = tf.gather_nd(test_softmaxed, tf.stack(
+        [tf.range(tf.shape(test_word_out)[0]), test_word_out[:, 0]], axis=1))
     test_out = tf.identity(p_word, name="test_out")
 
     if is_training and config.keep_prob < 1:
@@ -30,6 +30,53 @@
 
 namespace kaldi {
 
+// Declared in io-funcs.h, which includes this file first.
+size_t ReadNumberChars(std::istream &is, char *buf, size_t capacity);
+void WriteToken(std::ostream &os, bool binary, const char *token);
+void ExpectToken(std::istream &is, bool binary, const char *token);
+
+template<class Int>
+const char *ParseInteger(const char *begin, const char *end, Int *value) {
+  KALDI_ASSERT_IS_INTEGER_TYPE(Int);
+  const char *p = begin;
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+  if (p == end || *p < '0' || *p > '9')
+    return NULL;
+  // The largest magnitude we can represent with this sign.
+  uint64 max_magnitude = static_cast<uint64>(std::numeric_limits<Int>::max());
+  if (negative)
+    max_magnitude = (std::numeric_limits<Int>::is_signed ?
+                     max_magnitude + 1 : 0);
+  uint64 magnitude = 0;
+  for (; p != end && *p >= '0' && *p <= '9'; p++) {
+    uint64 digit = *p - '0';
+    if (magnitude > (max_magnitude - digit) / 10 || digit > max_magnitude)
+      return NULL;
+    magnitude = magnitude * 10 + digit;
+  }
+  if (negative && magnitude != 0)
+    *value = static_cast<Int>(-static_cast<int64>(magnitude - 1) - 1);
+  else
+    *value = static_cast<Int>(magnitude);
+  return p;
+}
+
+template<class Int> bool ReadIntegerText(std::istream &is, Int *value) {
+  char buf[32];
+  size_t len = ReadNumberChars(is, buf, sizeof(buf));
+  if (len == 0)
+    return false;
+  if (ParseInteger(buf, buf + len, value) != buf + len) {
+    is.setstate(std::ios_base::failbit);
+    return false;
+  }
+  return true;
+}
+
 // Template that covers integers.
 template<class T>  void WriteBasicType(std::ostream &os,
                                        bool binary, T t) {
@@ -74,13 +121,7 @@ template<class T> inline void ReadBasicType(std::istream &is,
     }
     is.read(reinterpret_cast<char *>(t), sizeof(*t));
   } else {
-    if (sizeof(*t) == 1) {
-      int16 i;
-      is >> i;
-      *t = i;
-    } else {
-      is >> *t;
-    }
+    ReadIntegerText(is, t);
   }
   if (is.fail()) {
     KALDI_ERR << "Read failure in ReadBasicType, file position is "
@@ -229,6 +270,93 @@ template<class T> inline void WriteIntegerVector(std::ostream &os, bool binary,
 }
 
 
+// The compressed form of integer vectors is the token "CI", then a byte with
+// sizeof(T), the dimension and the number of bytes of the code as int32's, and
+// the code.  Each element is coded as the difference from the previous one
+// (modulo 2^64), zigzag-coded so that small negative differences are small
+// numbers, in the 'varint' code: seven bits per byte, least significant
+// first, with the top bit set on all bytes but the last.
+template<class T>
+inline void WriteIntegerVectorCompressed(std::ostream &os, bool binary,
+                                         const std::vector<T> &v) {
+  KALDI_ASSERT_IS_INTEGER_TYPE(T);
+  if (!binary) {
+    WriteIntegerVector(os, binary, v);
+    return;
+  }
+  std::string code;
+  code.reserve(v.size() + 16);
+  uint64 prev = 0;
+  for (typename std::vector<T>::const_iterator iter = v.begin();
+       iter != v.end(); ++iter) {
+    uint64 cur = static_cast<uint64>(*iter),
+        diff = cur - prev,
+        zigzag = (diff << 1) ^ static_cast<uint64>(static_cast<int64>(diff) >> 63);
+    while (zigzag >= 128) {
+      code.push_back(static_cast<char>((zigzag & 127) | 128));
+      zigzag >>= 7;
+    }
+    code.push_back(static_cast<char>(zigzag));
+    prev = cur;
+  }
+  WriteToken(os, binary, "CI");
+  char sz = sizeof(T);
+  os.write(&sz, 1);
+  int32 vecsz = static_cast<int32>(v.size()),
+      codesz = static_cast<int32>(code.size());
+  KALDI_ASSERT((size_t)vecsz == v.size() && (size_t)codesz == code.size());
+  os.write(reinterpret_cast<const char *>(&vecsz), sizeof(vecsz));
+  os.write(reinterpret_cast<const char *>(&codesz), sizeof(codesz));
+  os.write(code.data(), codesz);
+  if (os.fail()) {
+    KALDI_ERR << "Write failure in WriteIntegerVectorCompressed.";
+  }
+}
+
+// Reads the compressed form written by WriteIntegerVectorCompressed(), after
+// the token "CI"; called from ReadIntegerVector().
+template<class T>
+inline void ReadIntegerVectorCompressed(std::istream &is, std::vector<T> *v) {
+  int sz = is.get();
+  int32 vecsz, codesz;
+  is.read(reinterpret_cast<char *>(&vecsz), sizeof(vecsz));
+  is.read(reinterpret_cast<char *>(&codesz), sizeof(codesz));
+  if (is.fail() || sz != sizeof(T) || vecsz < 0 || codesz < vecsz)
+    KALDI_ERR << "ReadIntegerVector: bad header of compressed vector, at "
+              << "file position " << is.tellg();
+  std::string code(codesz, '\0');
+  if (codesz > 0)
+    is.read(&(code[0]), codesz);
+  if (is.fail())
+    KALDI_ERR << "ReadIntegerVector: read failure at file position "
+              << is.tellg();
+  v->resize(vecsz);
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(code.data()),
+      *end = p + codesz;
+  uint64 prev = 0;
+  for (int32 i = 0; i < vecsz; i++) {
+    uint64 zigzag = 0;
+    int32 shift = 0;
+    while (p != end && (*p & 128) && shift < 63) {
+      zigzag |= static_cast<uint64>(*p & 127) << shift;
+      p++;
+      shift += 7;
+    }
+    if (p == end)
+      KALDI_ERR << "ReadIntegerVector: compressed vector is truncated.";
+    zigzag |= static_cast<uint64>(*p++) << shift;
+    uint64 cur = prev + ((zigzag >> 1) ^ (0 - (zigzag & 1)));
+    T t = static_cast<T>(cur);
+    if (static_cast<uint64>(t) != cur)
+      KALDI_ERR << "ReadIntegerVector: value out of range in compressed "
+                << "vector.";
+    (*v)[i] = t;
+    prev = cur;
+  }
+  if (p != end)
+    KALDI_ERR << "ReadIntegerVector: compressed vector has extra data.";
+}
+
 template<class T> inline void ReadIntegerVector(std::istream &is,
                                                 bool binary,
                                                 std::vector<T> *v) {
@@ -236,7 +364,11 @@ template<class T> inline void ReadIntegerVector(std::istream &is,
   KALDI_ASSERT(v != NULL);
   if (binary) {
     int sz = is.peek();
-    if (sz == sizeof(T)) {
+    if (sz == 'C') {
+      ExpectToken(is, binary, "CI");
+      ReadIntegerVectorCompressed(is, v);
+      return;
+    } else if (sz == sizeof(T)) {
       is.get();
     } else {  // this is currently just a check.
       KALDI_ERR << "ReadIntegerVector: expected to see type of size "
@@ -261,19 +393,10 @@ template<class T> inline void ReadIntegerVector(std::istream &is,
     is.get();  // consume the '['.
     is >> std::ws;  // consume whitespace.
     while (is.peek() != static_cast<int>(']')) {
-      if (sizeof(T) == 1) {  // read/write chars as numbers.
-        int16 next_t;
-        is >> next_t >> std::ws;
-        if (is.fail()) goto bad;
-        else
-            tmp_v.push_back((T)next_t);
-      } else {
-        T next_t;
-        is >> next_t >> std::ws;
-        if (is.fail()) goto bad;
-        else
-            tmp_v.push_back(next_t);
-      }
+      T next_t;  // chars are read and written as numbers.
+      if (!ReadIntegerText(is, &next_t)) goto bad;
+      is >> std::ws;
+      tmp_v.push_back(next_t);
     }
     is.get();  // get the final ']'.
     *v = tmp_v;  // could use std::swap to use less temporary memory, but this
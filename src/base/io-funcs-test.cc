@@ -144,7 +144,86 @@ void UnitTestIo(bool binary) {
   }
 }
 
+template<class T>
+void UnitTestIntegerVectorCompressed() {
+  std::vector<T> v;
+  int32 sz = RandInt(0, 50);
+  T cur = 0;
+  for (int32 i = 0; i < sz; i++) {
+    if (RandInt(0, 2) == 0)
+      cur = static_cast<T>(Rand());
+    if (RandInt(0, 10) == 0)
+      cur = (RandInt(0, 1) == 0 ? std::numeric_limits<T>::max() :
+             std::numeric_limits<T>::min());
+    v.push_back(cur);
+  }
+  bool binary = (RandInt(0, 1) == 0);
+  std::ostringstream os;
+  WriteIntegerVectorCompressed(os, binary, v);
+  WriteIntegerVector(os, binary, v);
+  std::istringstream is(os.str());
+  std::vector<T> v2, v3;
+  ReadIntegerVector(is, binary, &v2);
+  ReadIntegerVector(is, binary, &v3);
+  KALDI_ASSERT(v2 == v && v3 == v);
+}
 
+void UnitTestParseReal() {
+  for (int32 i = 0; i < 1000; i++) {
+    double x = RandGauss() * Exp(RandInt(-60, 60) * RandUniform());
+    std::ostringstream os;
+    os.precision(RandInt(1, 20));
+    if (RandInt(0, 1) == 0) os << std::scientific;
+    os << x;
+    // ParseReal() must give the same answer as strtod() and strtof().
+    std::string str = os.str();
+    const char *begin = str.c_str(), *end = begin + str.size();
+    double d;
+    float f;
+    KALDI_ASSERT(ParseReal(begin, end, &d) == end &&
+                 d == strtod(begin, NULL));
+    KALDI_ASSERT(ParseReal(begin, end, &f) == end &&
+                 f == strtof(begin, NULL));
+  }
+  const char *str = "-1.5e3x";
+  double d;
+  KALDI_ASSERT(ParseReal(str, str + 7, &d) == str + 6 && d == -1500.0);
+  str = "2e+";  // the 'e' is not part of the number.
+  KALDI_ASSERT(ParseReal(str, str + 3, &d) == str + 1 && d == 2.0);
+  str = "-Infinity";
+  KALDI_ASSERT(ParseReal(str, str + 9, &d) == str + 9 && d < 0 && d - d != 0);
+  str = "nan";
+  KALDI_ASSERT(ParseReal(str, str + 3, &d) == str + 3 && d != d);
+  str = "-.";
+  KALDI_ASSERT(ParseReal(str, str + 2, &d) == NULL);
+
+  int32 i;
+  str = "-2147483648";
+  KALDI_ASSERT(ParseInteger(str, str + 11, &i) == str + 11 &&
+               i == std::numeric_limits<int32>::min());
+  str = "2147483648";
+  KALDI_ASSERT(ParseInteger(str, str + 10, &i) == NULL);
+  uint8 u;
+  str = "255,";
+  KALDI_ASSERT(ParseInteger(str, str + 4, &u) == str + 3 && u == 255);
+  str = "-1";
+  KALDI_ASSERT(ParseInteger(str, str + 2, &u) == NULL);
+}
+
+void UnitTestReadRealText() {
+  std::istringstream is(" 1.25\t-3e-2]7 inf x");
+  float f;
+  int32 i;
+  KALDI_ASSERT(ReadRealText(is, &f) && f == 1.25f);
+  KALDI_ASSERT(ReadRealText(is, &f) && f == -3e-2f && is.peek() == ']');
+  is.get();
+  KALDI_ASSERT(ReadIntegerText(is, &i) && i == 7);
+  KALDI_ASSERT(ReadRealText(is, &f) && f > 0 && f - f != 0);
+  KALDI_ASSERT(!ReadRealText(is, &f) && is.fail());
+  std::istringstream is2("12");
+  KALDI_ASSERT(ReadIntegerText(is2, &i) && i == 12 && is2.eof() &&
+               !is2.fail());
+}
 
 }  // end namespace kaldi.
 
@@ -154,6 +233,14 @@ int main() {
     UnitTestIo(false);
     UnitTestIo(true);
   }
+  for (size_t i = 0; i < 10; i++) {
+    UnitTestIntegerVectorCompressed<int32>();
+    UnitTestIntegerVectorCompressed<uint16>();
+    UnitTestIntegerVectorCompressed<int64>();
+    UnitTestIntegerVectorCompressed<uint64>();
+  }
+  UnitTestParseReal();
+  UnitTestReadRealText();
   KALDI_ASSERT(1);  // just to check that KALDI_ASSERT does not fail for 1.
   return 0;
 }
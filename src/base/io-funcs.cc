@@ -17,11 +17,194 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdlib>
+
 #include "base/io-funcs.h"
 #include "base/kaldi-math.h"
 
 namespace kaldi {
 
+namespace {
+
+// Powers of ten that are exactly representable as doubles.
+const double kExactPowersOfTen[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+  1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+// Returns the length of the case-insensitive match of 'lower' (which must be
+// in lower case) at the start of [begin, end), or zero if it does not match.
+size_t MatchLowerCase(const char *begin, const char *end, const char *lower) {
+  size_t len = 0;
+  for (; lower[len] != '\0'; len++)
+    if (begin + len == end || ::tolower(begin[len]) != lower[len])
+      return 0;
+  return len;
+}
+
+inline double StrToReal(const char *str, char **end, double) {
+  return strtod(str, end);
+}
+
+inline float StrToReal(const char *str, char **end, float) {
+  return strtof(str, end);
+}
+
+template<class Real>
+const char *ParseRealInternal(const char *begin, const char *end,
+                              Real *value) {
+  const char *p = begin;
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+  // We accumulate up to 19 significant digits, which fit in a uint64, in
+  // 'mantissa'; the value is mantissa * 10^exponent.
+  uint64 mantissa = 0;
+  int32 num_digits = 0, exponent = 0;
+  bool any_digits = false, truncated = false;
+  for (; p != end && *p >= '0' && *p <= '9'; p++) {
+    any_digits = true;
+    if (num_digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa != 0) num_digits++;
+    } else {
+      exponent++;
+      if (*p != '0') truncated = true;
+    }
+  }
+  if (p != end && *p == '.') {
+    p++;
+    for (; p != end && *p >= '0' && *p <= '9'; p++) {
+      any_digits = true;
+      if (num_digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa != 0) num_digits++;
+        exponent--;
+      } else if (*p != '0') {
+        truncated = true;
+      }
+    }
+  }
+  if (!any_digits) {
+    size_t len;
+    if ((len = MatchLowerCase(p, end, "infinity")) != 0 ||
+        (len = MatchLowerCase(p, end, "inf")) != 0) {
+      *value = (negative ? -std::numeric_limits<Real>::infinity() :
+                std::numeric_limits<Real>::infinity());
+      return p + len;
+    } else if ((len = MatchLowerCase(p, end, "nan")) != 0) {
+      *value = (negative ? -std::numeric_limits<Real>::quiet_NaN() :
+                std::numeric_limits<Real>::quiet_NaN());
+      return p + len;
+    }
+    return NULL;
+  }
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    // As for strtod(), an 'e' that is not followed by digits is not part of
+    // the number.
+    const char *q = p + 1;
+    bool exponent_negative = false;
+    if (q != end && (*q == '-' || *q == '+')) {
+      exponent_negative = (*q == '-');
+      q++;
+    }
+    if (q != end && *q >= '0' && *q <= '9') {
+      int32 e = 0;
+      for (; q != end && *q >= '0' && *q <= '9'; q++)
+        if (e < 100000) e = e * 10 + (*q - '0');
+      exponent += (exponent_negative ? -e : e);
+      p = q;
+    }
+  }
+  if (mantissa == 0) {
+    *value = (negative ? -0.0 : 0.0);
+    return p;
+  }
+  if (!truncated && mantissa <= (static_cast<uint64>(1) << 53) &&
+      exponent >= -22 && exponent <= 22) {
+    // The mantissa and the power of ten are exact, so the single
+    // multiplication or division is correctly rounded.  Rounding the double
+    // to float after this is also correctly rounded, because double has more
+    // than twice the precision of float.
+    double d = static_cast<double>(mantissa);
+    if (exponent < 0) d /= kExactPowersOfTen[-exponent];
+    else d *= kExactPowersOfTen[exponent];
+    *value = static_cast<Real>(negative ? -d : d);
+    return p;
+  }
+  // The slow path.
+  std::string str(begin, p);
+  char *str_end;
+  *value = StrToReal(str.c_str(), &str_end, Real());
+  if (str_end != str.c_str() + str.size())
+    return NULL;
+  return p;
+}
+
+// Returns true if c may be part of a number, in the sense of ReadNumberChars.
+inline bool IsNumberChar(int c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+      (c >= 'A' && c <= 'Z') || c == '-' || c == '+' || c == '.' || c == '#';
+}
+
+template<class Real>
+bool ReadRealTextInternal(std::istream &is, Real *value) {
+  char buf[128];
+  size_t len = ReadNumberChars(is, buf, sizeof(buf));
+  if (len == 0)
+    return false;
+  if (ParseReal(buf, buf + len, value) != buf + len) {
+    is.setstate(std::ios_base::failbit);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+const char *ParseReal(const char *begin, const char *end, float *value) {
+  return ParseRealInternal(begin, end, value);
+}
+
+const char *ParseReal(const char *begin, const char *end, double *value) {
+  return ParseRealInternal(begin, end, value);
+}
+
+size_t ReadNumberChars(std::istream &is, char *buf, size_t capacity) {
+  std::istream::sentry sentry(is, true);  // true == don't skip whitespace.
+  if (!sentry)
+    return 0;
+  std::streambuf *sb = is.rdbuf();
+  int c = sb->sgetc();
+  while (c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f' ||
+         c == '\v')
+    c = sb->snextc();
+  size_t len = 0;
+  while (IsNumberChar(c) && len + 1 < capacity) {
+    buf[len++] = static_cast<char>(c);
+    c = sb->snextc();
+  }
+  buf[len] = '\0';
+  std::ios_base::iostate state = std::ios_base::goodbit;
+  if (c == std::char_traits<char>::eof())
+    state |= std::ios_base::eofbit;
+  if (len == 0 || IsNumberChar(c)) {
+    state |= std::ios_base::failbit;
+    len = 0;
+  }
+  is.setstate(state);
+  return len;
+}
+
+bool ReadRealText(std::istream &is, float *value) {
+  return ReadRealTextInternal(is, value);
+}
+
+bool ReadRealText(std::istream &is, double *value) {
+  return ReadRealTextInternal(is, value);
+}
+
 template<>
 void WriteBasicType<bool>(std::ostream &os, bool binary, bool b) {
   os << (b ? "T":"F");
@@ -86,7 +269,7 @@ void ReadBasicType<float>(std::istream &is, bool binary, float *f) {
                 << ", at file position " << is.tellg();
     }
   } else {
-    is >> *f;
+    ReadRealText(is, f);
   }
   if (is.fail()) {
     KALDI_ERR << "ReadBasicType: failed to read, at file position "
@@ -111,7 +294,7 @@ void ReadBasicType<double>(std::istream &is, bool binary, double *d) {
                 << ", at file position " << is.tellg();
     }
   } else {
-    is >> *d;
+    ReadRealText(is, d);
   }
   if (is.fail()) {
     KALDI_ERR << "ReadBasicType: failed to read, at file position "
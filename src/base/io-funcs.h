@@ -176,6 +176,42 @@ inline void ReadBasicType(std::istream &is, bool binary, T *t, bool add) {
   }
 }
 
+/// ParseReal converts the number at the start of the characters [begin, end)
+/// to float or double, and returns a pointer to the character after it, or
+/// NULL if there is no number there.  It accepts what operator << writes (an
+/// optional sign, digits with an optional fraction and exponent), and "inf",
+/// "infinity" and "nan" in any case.  It is much faster than operator >> and
+/// does not depend on the locale; the result is the same as that of strtod()
+/// (or strtof()), which it calls for numbers with more than 19 significant
+/// digits or large exponents.
+const char *ParseReal(const char *begin, const char *end, float *value);
+const char *ParseReal(const char *begin, const char *end, double *value);
+
+/// ParseInteger is as ParseReal, for integer types; it returns NULL if the
+/// integer does not fit into the type.  It is defined in io-funcs-inl.h.
+template<class Int>
+const char *ParseInteger(const char *begin, const char *end, Int *value);
+
+/// ReadNumberChars skips whitespace and then copies the characters that may
+/// form a number or "inf"/"nan" (letters, digits, '+', '-', '.' and '#') to
+/// 'buf', reading directly from the stream buffer.  It returns the number of
+/// characters read, or zero (and sets the failbit of the stream) if there were
+/// none, or more than capacity - 1.  It sets the eofbit if it reached the end
+/// of the stream, as operator >> does.  It is the tokenizer used by
+/// ReadRealText and ReadIntegerText.
+size_t ReadNumberChars(std::istream &is, char *buf, size_t capacity);
+
+/// ReadRealText reads a number in text form from the stream, as 'is >> *value'
+/// would but several times faster: see ParseReal and ReadNumberChars.
+/// Returns false and sets the failbit on error.  ReadBasicType and the text
+/// Vector and Matrix readers use this.
+bool ReadRealText(std::istream &is, float *value);
+bool ReadRealText(std::istream &is, double *value);
+
+/// ReadIntegerText is as ReadRealText, for integer types; it fails if the
+/// integer does not fit into the type.  It is defined in io-funcs-inl.h.
+template<class Int> bool ReadIntegerText(std::istream &is, Int *value);
+
 /// Function for writing STL vectors of integer types.
 template<class T> inline void WriteIntegerVector(std::ostream &os, bool binary,
                                                  const std::vector<T> &v);
@@ -184,6 +220,17 @@ template<class T> inline void WriteIntegerVector(std::ostream &os, bool binary,
 template<class T> inline void ReadIntegerVector(std::istream &is, bool binary,
                                                 std::vector<T> *v);
 
+/// Function for writing STL vectors of integer types in a compressed binary
+/// form, in which each element is stored as the difference from the previous
+/// one, in a variable-length code (one byte for differences of magnitude
+/// below 64).  This is typically 4 to 5 times smaller than the form of
+/// WriteIntegerVector for alignments, in which most differences are zero.
+/// ReadIntegerVector reads either form.  In text mode this is the same as
+/// WriteIntegerVector.
+template<class T>
+inline void WriteIntegerVectorCompressed(std::ostream &os, bool binary,
+                                         const std::vector<T> &v);
+
 /// Function for writing STL vectors of pairs of integer types.
 template<class T>
 inline void WriteIntegerPairVector(std::ostream &os, bool binary,
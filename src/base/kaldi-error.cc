@@ -31,6 +31,8 @@
 #endif // HAVE_CXXABI_H
 #endif // HAVE_EXECINFO_H
 
+#include <atomic>
+
 #include "base/kaldi-common.h"
 #include "base/kaldi-error.h"
 #include "base/version.h"
@@ -41,7 +43,7 @@ namespace kaldi {
 
 int32 g_kaldi_verbose_level = 0;
 static std::string program_name;
-static LogHandler log_handler = NULL;
+static std::atomic<LogHandler> log_handler(NULL);
 
 void SetProgramName(const char *basename) {
   // Using the 'static std::string' for the program name is mostly harmless,
@@ -51,6 +53,10 @@ void SetProgramName(const char *basename) {
   program_name = basename;
 }
 
+const char *GetProgramName() {
+  return program_name.c_str();
+}
+
 /***** HELPER FUNCTIONS *****/
 
 // Trim filename to at most 1 trailing directory long. Given a filename like
@@ -176,20 +182,14 @@ MessageLogger::MessageLogger(LogMessageEnvelope::Severity severity,
   envelope_.line = line;
 }
 
-void MessageLogger::LogMessage() const {
-  // Send to the logging handler if provided.
-  if (log_handler != NULL) {
-    log_handler(envelope_, GetMessage().c_str());
-    return;
-  }
-
-  // Otherwise, use the default Kaldi logging.
+std::string FormatLogMessage(const LogMessageEnvelope &envelope,
+                             const char *message) {
   // Build the log-message header.
   std::stringstream full_message;
-  if (envelope_.severity > LogMessageEnvelope::kInfo) {
-    full_message << "VLOG[" << envelope_.severity << "] (";
+  if (envelope.severity > LogMessageEnvelope::kInfo) {
+    full_message << "VLOG[" << envelope.severity << "] (";
   } else {
-    switch (envelope_.severity) {
+    switch (envelope.severity) {
     case LogMessageEnvelope::kInfo:
       full_message << "LOG (";
       break;
@@ -207,20 +207,31 @@ void MessageLogger::LogMessage() const {
   }
   // Add other info from the envelope and the message text.
   full_message << program_name.c_str() << "[" KALDI_VERSION "]" << ':'
-               << envelope_.func << "():" << envelope_.file << ':'
-               << envelope_.line << ") " << GetMessage().c_str();
+               << envelope.func << "():" << envelope.file << ':'
+               << envelope.line << ") " << message;
 
   // Add stack trace for errors and assertion failures, if available.
-  if (envelope_.severity < LogMessageEnvelope::kWarning) {
+  if (envelope.severity < LogMessageEnvelope::kWarning) {
     const std::string &stack_trace = KaldiGetStackTrace();
     if (!stack_trace.empty()) {
       full_message << "\n\n" << stack_trace;
     }
   }
-
-  // Print the complete message to stderr.
   full_message << "\n";
-  std::cerr << full_message.str();
+  return full_message.str();
+}
+
+void MessageLogger::LogMessage() const {
+  // Send to the logging handler if provided.
+  LogHandler handler = log_handler.load();
+  if (handler != NULL) {
+    handler(envelope_, GetMessage().c_str());
+    return;
+  }
+
+  // Otherwise, use the default Kaldi logging: print the complete message to
+  // stderr.
+  std::cerr << FormatLogMessage(envelope_, GetMessage().c_str());
 }
 
 /***** KALDI ASSERTS *****/
@@ -237,9 +248,7 @@ void KaldiAssertFailure_(const char *func, const char *file, int32 line,
 /***** THIRD-PARTY LOG-HANDLER *****/
 
 LogHandler SetLogHandler(LogHandler handler) {
-  LogHandler old_handler = log_handler;
-  log_handler = handler;
-  return old_handler;
+  return log_handler.exchange(handler);
 }
 
 } // namespace kaldi
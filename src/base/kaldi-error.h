@@ -52,6 +52,9 @@ namespace kaldi {
 /// This function is very thread-unsafe.
 void SetProgramName(const char *basename);
 
+/// Returns the name set by SetProgramName(), or "" if it was not called.
+const char *GetProgramName();
+
 /// This is set by util/parse-options.{h,cc} if you set --verbose=? option.
 /// Do not use directly, prefer {Get,Set}VerboseLevel().
 extern int32 g_kaldi_verbose_level;
@@ -215,10 +218,19 @@ typedef void (*LogHandler)(const LogMessageEnvelope &envelope,
 /// Set logging handler. If called with a non-NULL function pointer, the
 /// function pointed by it is called to send messages to a caller-provided log.
 /// If called with a NULL pointer, restores default Kaldi error logging to
-/// stderr. This function is obviously not thread safe; the log handler must be.
+/// stderr. It may be called while other threads are logging (each message goes
+/// to either the old or the new handler); the log handler must be thread safe.
 /// Returns a previously set logging handler pointer, or NULL.
 LogHandler SetLogHandler(LogHandler);
 
+/// Returns the message formatted the way the default Kaldi logging writes it
+/// to stderr, e.g. "LOG (program[version]:func():file.cc:123) message\n",
+/// including the stack trace for errors and failed assertions (which is taken
+/// in the calling thread).  This is for log handlers that want to write
+/// Kaldi-style messages somewhere else, or at a later time.
+std::string FormatLogMessage(const LogMessageEnvelope &envelope,
+                             const char *message);
+
 /// @} end "addtogroup error_group"
 
 // Functions within internal is exported for testing only, do not use.
@@ -18,6 +18,7 @@
 // limitations under the License.
 #include "base/kaldi-math.h"
 #include <limits>
+#include <thread>
 #include "base/timer.h"
 
 namespace kaldi {
@@ -168,6 +169,57 @@ void UnitTestRand() {
   }
 }
 
+void UnitTestRandomGenerator() {
+  RandomGenerator gen(RandInt(0, 1000)), gen2;
+  // The sequence depends only on the seed.
+  gen2 = gen;
+  for (int32 i = 0; i < 10; i++)
+    KALDI_ASSERT(gen.Next() == gen2.Next());
+  gen2.Seed(1);
+  gen.Seed(1);
+  KALDI_ASSERT(gen.Uniform() == gen2.Uniform());
+
+  int32 n = 100000;
+  std::vector<float> data(n);
+  std::vector<double> data2(n + 1);
+  gen.FillUniform(&(data[0]), n);
+  double sum = 0.0, sumsq = 0.0;
+  for (int32 i = 0; i < n; i++) {
+    KALDI_ASSERT(data[i] > 0.0 && data[i] < 1.0);
+    sum += data[i];
+  }
+  KALDI_ASSERT(std::abs(sum / n - 0.5) < 0.01);
+
+  // An odd dimension tests the last, unpaired element.
+  gen.FillGauss(&(data2[0]), n + 1);
+  sum = 0.0;
+  for (int32 i = 0; i <= n; i++) {
+    KALDI_ASSERT(data2[i] - data2[i] == 0.0);  // not inf or nan.
+    sum += data2[i];
+    sumsq += data2[i] * data2[i];
+  }
+  KALDI_ASSERT(std::abs(sum / n) < 0.02 && std::abs(sumsq / n - 1.0) < 0.02);
+
+  int32 first = RandInt(-10, 10), last = first + RandInt(0, 5);
+  std::vector<int32> counts(last - first + 1, 0);
+  for (int32 i = 0; i < 10000; i++) {
+    int32 k = gen.Int(first, last);
+    KALDI_ASSERT(k >= first && k <= last);
+    counts[k - first]++;
+  }
+  for (size_t k = 0; k < counts.size(); k++)
+    KALDI_ASSERT(counts[k] > 0.8 * 10000 / counts.size());
+
+  // The generator of another thread is a different object.
+  RandomGenerator *this_thread = &ThreadRandomGenerator(), *other_thread;
+  std::thread t([&other_thread]() {
+      other_thread = &ThreadRandomGenerator();
+    });
+  t.join();
+  KALDI_ASSERT(this_thread != other_thread &&
+               this_thread == &ThreadRandomGenerator());
+}
+
 void UnitTestLogAddSub() {
   for (int i = 0; i < 100; i++) {
     double f1 = Rand() % 10000, f2 = Rand() % 20;
@@ -323,6 +375,7 @@ int main() {
   UnitTestDefines();
   UnitTestLogAddSub();
   UnitTestRand();
+  UnitTestRandomGenerator();
   UnitTestAssertFunc();
   UnitTestRoundUpToNearestPowerOfTwo();
   UnitTestDivideRoundingDown();
@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #endif
+#include <algorithm>
 #include <string>
 #include <mutex>
 
@@ -158,5 +159,78 @@ void RandGauss2(double *a, double *b, RandomState *state) {
   *b = b_float;
 }
 
+RandomGenerator::RandomGenerator() {
+  // As for RandomState, we add a constant so that two generators constructed
+  // in a row don't give the same sequence offset by one.
+  Seed(static_cast<uint64>(Rand()) * (RAND_MAX + static_cast<uint64>(1)) +
+       Rand() + 27437);
+}
+
+void RandomGenerator::Seed(uint64 seed) {
+  // We expand the seed with splitmix64, as recommended by the authors of
+  // xoshiro; this also makes sure that the state is not all zeros.
+  for (int32 i = 0; i < 2; i++) {
+    uint64 z = (seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = z ^ (z >> 31);
+    s_[2 * i] = static_cast<uint32>(z);
+    s_[2 * i + 1] = static_cast<uint32>(z >> 32);
+  }
+}
+
+float RandomGenerator::Gauss() {
+  float u1 = Uniform(), u2 = Uniform();
+  return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * M_PI * u2);
+}
+
+int32 RandomGenerator::Int(int32 first, int32 last) {
+  KALDI_ASSERT(last >= first);
+  uint64 range = static_cast<uint64>(static_cast<int64>(last) - first) + 1;
+  // Scaling rather than taking the modulus avoids the bias towards small
+  // numbers, to within 2^-32.
+  return first + static_cast<int32>((Next() * range) >> 32);
+}
+
+template<typename Real>
+void RandomGenerator::FillUniform(Real *data, int32 dim) {
+  for (int32 i = 0; i < dim; i++)
+    data[i] = Uniform();
+}
+
+template<typename Real>
+void RandomGenerator::FillGauss(Real *data, int32 dim) {
+  // Box-Muller, in blocks: we first fill a block with uniform numbers, and
+  // then transform it in a separate loop, which the compiler can vectorize
+  // better than code that alternates between the two.
+  const int32 block_size = 256;
+  float u[block_size];
+  for (int32 offset = 0; offset < dim; offset += block_size) {
+    int32 this_size = std::min(block_size, dim - offset),
+        num_pairs = (this_size + 1) / 2;
+    for (int32 i = 0; i < 2 * num_pairs; i++)
+      u[i] = Uniform();
+    Real *this_data = data + offset;
+    for (int32 i = 0; i < this_size / 2; i++) {
+      float r = sqrtf(-2.0f * logf(u[2 * i])),
+          theta = 2.0f * M_PI * u[2 * i + 1];
+      this_data[2 * i] = r * cosf(theta);
+      this_data[2 * i + 1] = r * sinf(theta);
+    }
+    if (this_size % 2 == 1)
+      this_data[this_size - 1] = sqrtf(-2.0f * logf(u[this_size - 1])) *
+          cosf(2.0f * M_PI * u[this_size]);
+  }
+}
+
+template void RandomGenerator::FillUniform(float *data, int32 dim);
+template void RandomGenerator::FillUniform(double *data, int32 dim);
+template void RandomGenerator::FillGauss(float *data, int32 dim);
+template void RandomGenerator::FillGauss(double *data, int32 dim);
+
+RandomGenerator &ThreadRandomGenerator() {
+  static thread_local RandomGenerator generator;
+  return generator;
+}
 
 }  // end namespace kaldi
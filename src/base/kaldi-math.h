@@ -168,6 +168,67 @@ void RandGauss2(double *a, double *b, RandomState *state = NULL);
 
 // Also see Vector<float,double>::RandCategorical().
 
+/// RandomGenerator is a fast pseudo-random number generator (xoshiro128+) for
+/// code that needs a lot of random numbers, e.g. to fill matrices.  Unlike
+/// Rand() it never locks a mutex, and it is several times faster than
+/// rand_r().  An object must not be used by two threads at once; use
+/// ThreadRandomGenerator() for one that belongs to the calling thread.  The
+/// sequence depends only on the seed, so with e.g. Seed(base_seed + thread
+/// index) in each thread the results are reproducible.
+class RandomGenerator {
+ public:
+  /// Seeds from Rand(), so that srand() determines the sequence, as for
+  /// RandomState.
+  RandomGenerator();
+
+  explicit RandomGenerator(uint64 seed) { Seed(seed); }
+
+  void Seed(uint64 seed);
+
+  /// Returns 32 random bits.
+  inline uint32 Next() {
+    uint32 ans = s_[0] + s_[3], t = s_[1] << 9;
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = (s_[3] << 11) | (s_[3] >> 21);
+    return ans;
+  }
+
+  /// Returns a random number strictly between 0 and 1, like RandUniform().
+  inline float Uniform() {
+    // We use the top 23 bits, which are the best ones of xoshiro128+; with
+    // more, the sum could round up to 2^24 and the answer to exactly 1.
+    return ((Next() >> 9) + 0.5f) * (1.0f / 8388608.0f);
+  }
+
+  /// Returns a random number from the standard normal distribution.
+  float Gauss();
+
+  /// Returns a random integer between first and last inclusive, like
+  /// RandInt().
+  int32 Int(int32 first, int32 last);
+
+  /// Sets data[0] ... data[dim-1] to random numbers strictly between 0 and 1.
+  template<typename Real>
+  void FillUniform(Real *data, int32 dim);
+
+  /// Sets data[0] ... data[dim-1] to random numbers from the standard normal
+  /// distribution.
+  template<typename Real>
+  void FillGauss(Real *data, int32 dim);
+
+ private:
+  uint32 s_[4];
+};
+
+/// Returns the RandomGenerator of the calling thread, which is seeded from
+/// Rand() when the thread first calls this function.  Call Seed() on it for
+/// a reproducible sequence in that thread.
+RandomGenerator &ThreadRandomGenerator();
+
 // This is a randomized pruning mechanism that preserves expectations,
 // that we typically use to prune posteriors.
 template<class Float>
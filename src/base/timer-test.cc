@@ -18,6 +18,8 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <thread>
+
 #include "base/timer.h"
 #include "base/kaldi-common.h"
 #include "base/kaldi-utils.h"
@@ -36,10 +38,44 @@ void TimerTest() {
     KALDI_ERR << "Timer fail: waited " << f << " seconds instead of "
               <<  time_secs << " secs.";
 }
+
+void TraceTest() {
+  {
+    KALDI_TRACE_SPAN("disabled");
+  }
+  std::ostringstream os;
+  WriteChromeTrace(os);
+  KALDI_ASSERT(os.str().find("disabled") == std::string::npos);
+
+  SetTracingEnabled(true);
+  std::thread thread([]() {
+    KALDI_TRACE_SPAN("outer");
+    {
+      KALDI_TRACE_SPAN("inner");
+      Sleep(0.01);
+    }
+  });
+  thread.join();
+  {
+    KALDI_TRACE_SPAN("main");
+  }
+  SetTracingEnabled(false);
+  os.str("");
+  WriteChromeTrace(os);
+  std::string trace = os.str();
+  std::cout << trace;
+  KALDI_ASSERT(trace.find("\"name\": \"outer\"") != std::string::npos &&
+               trace.find("\"name\": \"inner\"") != std::string::npos &&
+               trace.find("\"name\": \"main\"") != std::string::npos &&
+               trace.find("\"tid\": 1") != std::string::npos);
+  // 'inner' finishes first.
+  KALDI_ASSERT(trace.find("inner") < trace.find("outer"));
+}
 }
 
 
 int main() {
   for (int i = 0; i < 4; i++)
     kaldi::TimerTest();
+  kaldi::TraceTest();
 }
@@ -22,7 +22,9 @@
 #include <algorithm>
 #include <iomanip>
 #include <map>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 namespace kaldi {
 
@@ -82,4 +84,102 @@ Profiler::~Profiler() {
   g_profile_stats.AccStats(name_, tim_.Elapsed());
 }
 
+
+std::atomic<bool> g_kaldi_tracing_enabled(false);
+
+namespace {
+
+const size_t kTraceBufferSize = 65536;
+
+struct TraceEvent {
+  const char *name;
+  double start;
+  double end;
+};
+
+// The ring buffer of spans of one thread.  The mutex is only contended while
+// WriteChromeTrace() is reading the buffer.
+struct TraceBuffer {
+  std::mutex mutex;
+  std::vector<TraceEvent> events;
+  size_t next;  // index in 'events' of the next span, once it is full.
+  int32 thread_index;
+  TraceBuffer(int32 thread_index): next(0), thread_index(thread_index) { }
+};
+
+// The buffers of all the threads that have recorded spans.  They are never
+// deleted, so that the spans of threads that have finished can be written,
+// and so that threads still running at exit can use them.
+std::mutex g_trace_buffers_mutex;
+std::vector<TraceBuffer*> *g_trace_buffers = NULL;
+
+TraceBuffer *GetTraceBuffer() {
+  static thread_local TraceBuffer *buffer = NULL;
+  if (buffer == NULL) {
+    std::lock_guard<std::mutex> lock(g_trace_buffers_mutex);
+    if (g_trace_buffers == NULL)
+      g_trace_buffers = new std::vector<TraceBuffer*>();
+    buffer = new TraceBuffer(g_trace_buffers->size());
+    g_trace_buffers->push_back(buffer);
+  }
+  return buffer;
+}
+
+}  // namespace
+
+void SetTracingEnabled(bool enabled) {
+  TraceTime();  // sets the origin of the times.
+  g_kaldi_tracing_enabled = enabled;
+}
+
+double TraceTime() {
+  static Timer timer;
+  return timer.Elapsed();
+}
+
+void RecordTraceSpan(const char *name, double start, double end) {
+  TraceBuffer *buffer = GetTraceBuffer();
+  TraceEvent event = { name, start, end };
+  std::lock_guard<std::mutex> lock(buffer->mutex);
+  if (buffer->events.size() < kTraceBufferSize) {
+    buffer->events.push_back(event);
+  } else {
+    buffer->events[buffer->next] = event;
+    buffer->next = (buffer->next + 1) % kTraceBufferSize;
+  }
+}
+
+void WriteChromeTrace(std::ostream &os) {
+  std::vector<TraceBuffer*> buffers;
+  {
+    std::lock_guard<std::mutex> lock(g_trace_buffers_mutex);
+    if (g_trace_buffers != NULL)
+      buffers = *g_trace_buffers;
+  }
+  bool first = true;
+  os << "[";
+  for (size_t b = 0; b < buffers.size(); b++) {
+    TraceBuffer *buffer = buffers[b];
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    size_t size = buffer->events.size();
+    if (size == kTraceBufferSize)
+      KALDI_WARN << "Only the most recent " << size << " spans of thread "
+                 << buffer->thread_index << " were kept.";
+    for (size_t i = 0; i < size; i++) {
+      // the oldest span is at buffer->next.
+      const TraceEvent &event = buffer->events[(buffer->next + i) % size];
+      // times are in microseconds.  The names are string constants, so we
+      // don't escape them.
+      os << (first ? "\n" : ",\n") << "{\"name\": \"" << event.name
+         << "\", \"cat\": \"kaldi\", \"ph\": \"X\", \"ts\": "
+         << std::fixed << std::setprecision(3) << (event.start * 1.0e+06)
+         << ", \"dur\": " << ((event.end - event.start) * 1.0e+06)
+         << std::defaultfloat << ", \"pid\": 0, \"tid\": "
+         << buffer->thread_index << "}";
+      first = false;
+    }
+  }
+  os << "\n]\n";
+}
+
 }  // namespace kaldi
@@ -19,6 +19,9 @@
 #ifndef KALDI_BASE_TIMER_H_
 #define KALDI_BASE_TIMER_H_
 
+#include <atomic>
+#include <ostream>
+
 #include "base/kaldi-utils.h"
 #include "base/kaldi-error.h"
 
@@ -108,6 +111,56 @@ class Profiler {
 #define KALDI_PROFILE Profiler _profiler(__func__)
 
 
+/// Tracing records the start and end times of named spans of code, per
+/// thread, so that they can be viewed on a timeline (e.g. to see which stage
+/// of an online pipeline the latency comes from).  It is off by default, and
+/// while it is off a span costs one atomic load.  Each thread keeps the most
+/// recent kTraceBufferSize spans in a ring buffer.
+extern std::atomic<bool> g_kaldi_tracing_enabled;
+
+inline bool TracingEnabled() {
+  return g_kaldi_tracing_enabled.load(std::memory_order_relaxed);
+}
+void SetTracingEnabled(bool enabled);
+
+/// Returns the time in seconds since tracing was first enabled (or since the
+/// start of the program); the times of the spans are relative to this.
+double TraceTime();
+
+/// Records a span for the calling thread; normally you would use
+/// KALDI_TRACE_SPAN instead.  'name' must be a string constant.
+void RecordTraceSpan(const char *name, double start, double end);
+
+/// Writes the recorded spans of all threads in the Chrome trace event format,
+/// which can be loaded in chrome://tracing or Perfetto.
+void WriteChromeTrace(std::ostream &os);
+
+class TraceSpan {
+ public:
+  // Caution: as for class Profiler, 'name' should always be a string
+  // constant, as only the pointer is stored.
+  explicit TraceSpan(const char *name):
+      name_(name), start_(TracingEnabled() ? TraceTime() : -1.0) { }
+  ~TraceSpan() {
+    if (start_ >= 0.0)
+      RecordTraceSpan(name_, start_, TraceTime());
+  }
+ private:
+  const char *name_;
+  double start_;
+};
+
+//  To trace a block of code, put
+//  KALDI_TRACE_SPAN("name");
+//  at the beginning of the block.  If KALDI_NO_TRACE is defined, this does
+//  nothing.
+#ifdef KALDI_NO_TRACE
+#define KALDI_TRACE_SPAN(name)
+#else
+#define KALDI_TRACE_SPAN(name) TraceSpan _trace_span(name)
+#endif
+
+
 
 }  // namespace kaldi
 
@@ -0,0 +1,4 @@
+// This file was automatically created by ./get_version.sh.
+// It is only included by ./kaldi-error.cc.
+#define KALDI_VERSION "5.5.5~4-30fe"
+#define KALDI_GIT_HEAD "30fe8d1235452817fe255ef034021454e26849a9"
@@ -99,16 +99,14 @@ int main(int argc, char *argv[]) {
 
       Posterior pdf_post;
       ConvertPosteriorToPdfs(trans_model, post, &pdf_post);
-      for (int32 i = 0; i < feats.NumRows(); i++) {
-        SubVector<BaseFloat> feat(feats, i);
-        for (size_t j = 0; j < pdf_post[i].size(); j++) {
-          int32 pdf_id = pdf_post[i][j].first;
-          BaseFloat weight = RandPrune(pdf_post[i][j].second, rand_prune);
-          if (weight != 0.0) {
-            lda.Accumulate(feat, pdf_id, weight);
-          }
-        }
+      if (rand_prune > 0.0) {
+        for (int32 i = 0; i < feats.NumRows(); i++)
+          for (size_t j = 0; j < pdf_post[i].size(); j++)
+            pdf_post[i][j].second = RandPrune(pdf_post[i][j].second,
+                                              rand_prune);
       }
+      // Accumulates the whole utterance at once.
+      lda.Accumulate(feats, pdf_post);
       num_done++;
       if (num_done % 100 == 0)
         KALDI_LOG << "Done " << num_done << " utterances.";
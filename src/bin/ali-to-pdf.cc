@@ -24,6 +24,7 @@
 #include "hmm/transition-model.h"
 #include "hmm/hmm-utils.h"
 #include "util/common-utils.h"
+#include "util/table-map.h"
 #include "fst/fstlib.h"
 
 int main(int argc, char *argv[]) {
@@ -36,6 +37,8 @@ int main(int argc, char *argv[]) {
         "e.g.: \n"
         " ali-to-pdf 1.mdl ark:1.ali ark,t:-\n";
     ParseOptions po(usage);
+    TableMapOptions map_opts;
+    map_opts.Register(&po);
 
     po.Read(argc, argv);
 
@@ -51,20 +54,17 @@ int main(int argc, char *argv[]) {
     TransitionModel trans_model;
     ReadKaldiObject(model_filename, &trans_model);
 
-    SequentialInt32VectorReader reader(alignments_rspecifier);
-
-    Int32VectorWriter writer(pdfs_wspecifier);
-    int32 num_done = 0;
-    for (; !reader.Done(); reader.Next()) {
-      std::string key = reader.Key();
-      std::vector<int32> alignment = reader.Value();
-
-      for (size_t i = 0; i < alignment.size(); i++)
-        alignment[i] = trans_model.TransitionIdToPdf(alignment[i]);
-
-      writer.Write(key, alignment);
-      num_done++;
-    }
+    int64 num_done = MapTable<BasicVectorHolder<int32>,
+                              BasicVectorHolder<int32> >(
+        alignments_rspecifier, pdfs_wspecifier, map_opts,
+        [&trans_model](const std::string &key,
+                       const std::vector<int32> &alignment,
+                       std::vector<int32> *pdfs) {
+          pdfs->resize(alignment.size());
+          for (size_t i = 0; i < alignment.size(); i++)
+            (*pdfs)[i] = trans_model.TransitionIdToPdf(alignment[i]);
+          return true;
+        });
     KALDI_LOG << "Converted " << num_done << " alignments to pdf sequences.";
   } catch(const std::exception &e) {
     std::cerr << e.what();
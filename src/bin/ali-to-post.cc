@@ -25,6 +25,7 @@
 #include "hmm/transition-model.h"
 #include "hmm/hmm-utils.h"
 #include "hmm/posterior.h"
+#include "util/table-map.h"
 
 /** @brief Convert alignments to viterbi style posteriors. The aligned
     symbol gets a weight of 1.0 */
@@ -47,6 +48,8 @@ int main(int argc, char *argv[]) {
         "See also: ali-to-pdf, ali-to-phones, show-alignments, post-to-weights\n";
 
     ParseOptions po(usage);
+    TableMapOptions map_opts;
+    map_opts.Register(&po);
 
     po.Read(argc, argv);
 
@@ -58,18 +61,21 @@ int main(int argc, char *argv[]) {
     std::string alignments_rspecifier = po.GetArg(1);
     std::string posteriors_wspecifier = po.GetArg(2);
 
-    int32 num_done = 0;
-    SequentialInt32VectorReader alignment_reader(alignments_rspecifier);
-    PosteriorWriter posterior_writer(posteriors_wspecifier);
-
-    for (; !alignment_reader.Done(); alignment_reader.Next()) {
-      num_done++;
-      const std::vector<int32> &alignment = alignment_reader.Value();
-      // Posterior is vector<vector<pair<int32, BaseFloat> > >
-      Posterior post;
-      AlignmentToPosterior(alignment, &post);
-      posterior_writer.Write(alignment_reader.Key(), post);
-    }
+    // CompactPosterior is written in the same format as Posterior, and
+    // avoids an allocation per frame.
+    int64 num_done = MapTable<BasicVectorHolder<int32>,
+                              CompactPosteriorHolder>(
+        alignments_rspecifier, posteriors_wspecifier, map_opts,
+        [](const std::string &key, const std::vector<int32> &alignment,
+           CompactPosterior *post) {
+          post->Clear();
+          post->Reserve(alignment.size(), alignment.size());
+          for (size_t i = 0; i < alignment.size(); i++) {
+            post->AddFrame();
+            post->AddElement(alignment[i], 1.0);
+          }
+          return true;
+        });
     KALDI_LOG << "Converted " << num_done << " alignments.";
     return (num_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
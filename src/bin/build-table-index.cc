@@ -0,0 +1,111 @@
+// bin/build-table-index.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "util/kaldi-table-index.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+
+    const char *usage =
+        "Build a binary index (sorted keys, file-id, byte offset) from an scp\n"
+        "file, for faster opening of random-access readers.  By default the\n"
+        "index is written to <scp-rxfilename>.idx, which is where random-access\n"
+        "readers of \"scp:<scp-rxfilename>\" look for it.  With --archive=foo.ark,\n"
+        "only the entries of the scp file that point into foo.ark are indexed\n"
+        "and the index is written to foo.ark.idx, for use by the \"mmap\"\n"
+        "rspecifier option (e.g. \"mmap:foo.ark\").  Indexes that are older than\n"
+        "the file they index are ignored, so re-run this program after\n"
+        "rewriting the scp file or archive.\n"
+        "Usage: build-table-index [options] <scp-rxfilename> [<index-wxfilename>]\n"
+        "e.g.: build-table-index data/train/feats.scp\n"
+        "      build-table-index --archive=raw_mfcc.1.ark raw_mfcc.1.scp\n";
+
+    ParseOptions po(usage);
+    bool binary = true;
+    std::string archive;
+    po.Register("binary", &binary, "Write index in binary mode");
+    po.Register("archive", &archive, "If set, index only entries pointing "
+                "into this archive (which must be given exactly as in the scp "
+                "file), and write the index to <archive>.idx");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 1 || po.NumArgs() > 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string scp_rxfilename = po.GetArg(1),
+        index_wxfilename = po.GetOptArg(2);
+    if (index_wxfilename.empty())
+      index_wxfilename = TableIndexFilename(archive.empty() ? scp_rxfilename :
+                                            archive);
+
+    std::vector<std::pair<std::string, std::string> > script;
+    if (!ReadScriptFile(scp_rxfilename, true, &script))
+      KALDI_ERR << "Error reading script file "
+                << PrintableRxfilename(scp_rxfilename);
+
+    TableIndex index;
+    int32 num_skipped = 0;
+    for (size_t i = 0; i < script.size(); i++) {
+      std::string file;
+      int64 offset;
+      SplitScriptEntry(script[i].second, &file, &offset);
+      if (!archive.empty()) {
+        if (file != archive || offset < 0) {
+          num_skipped++;
+          continue;
+        }
+        index.AddEntry(script[i].first, index.AddFile(file), offset);
+      } else {
+        if (!IsToken(file))
+          KALDI_ERR << "Cannot index scp entry with whitespace (e.g. a pipe): "
+                    << script[i].first << " " << script[i].second;
+        index.AddEntry(script[i].first, index.AddFile(file), offset);
+      }
+    }
+    if (!index.Finalize())
+      KALDI_ERR << "Script file " << PrintableRxfilename(scp_rxfilename)
+                << " contains duplicate keys.";
+
+    Output ko(index_wxfilename, binary);
+    index.Write(ko.Stream(), binary);
+
+    if (num_skipped > 0)
+      KALDI_LOG << "Skipped " << num_skipped << " entries that do not point "
+                << "into " << archive;
+    if (index.NumEntries() == 0)
+      KALDI_WARN << "Wrote an empty index to "
+                 << PrintableWxfilename(index_wxfilename)
+                 << " (no entries to index).";
+    else
+      KALDI_LOG << "Wrote index with " << index.NumEntries() << " entries and "
+                << index.NumFiles() << " distinct files to "
+                << PrintableWxfilename(index_wxfilename);
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -46,6 +46,7 @@ int main(int argc, char *argv[]) {
     BaseFloat cluster_thresh = -1.0;  // negative means use smallest split in splitting phase as thresh.
     int32 max_leaves = 0;
     bool round_num_leaves = true;
+    int32 num_threads = 1;
     std::string occs_out_filename;
 
     ParseOptions po(usage);
@@ -65,6 +66,9 @@ int main(int argc, char *argv[]) {
     po.Register("round-num-leaves", &round_num_leaves, 
                 "If true, then the number of leaves will be reduced to a "
                 "multiple of 8 by clustering.");
+    po.Register("num-threads", &num_threads, "Number of threads used to "
+                "search for the best splits during tree-building (does not "
+                "affect the result).");
 
     po.Read(argc, argv);
 
@@ -132,7 +136,8 @@ int main(int argc, char *argv[]) {
                        max_leaves,
                        cluster_thresh,
                        P,
-                       round_num_leaves);
+                       round_num_leaves,
+                       num_threads);
 
     { // This block is to warn about low counts.
       std::vector<BuildTreeStatsType> split_stats;
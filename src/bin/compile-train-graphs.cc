@@ -145,7 +145,9 @@ int main(int argc, char *argv[]) {
       }
     }
     KALDI_LOG << "compile-train-graphs: succeeded for " << num_succeed
-              << " graphs, failed for " << num_fail;
+              << " graphs, failed for " << num_fail << "; "
+              << gc.NumCacheHits() << " graphs were repeated transcripts "
+              << "taken from the cache.";
     return (num_succeed != 0 ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what();
@@ -26,24 +26,78 @@
 #include "tree/context-dep.h"
 #include "util/edit-distance.h"
 #include "base/kaldi-math.h"
+#include "util/kaldi-thread.h"
 
 namespace kaldi {
 
+// Number of sentences whose edit distances are computed in each task.
+static const size_t kEditCountBatchSize = 100;
+
+/// Computes the (word errors, number of words) of a batch of sentences for one
+/// or two hypotheses in operator(), which may be run in a separate thread;
+/// the destructor appends them to the per-sentence lists, in order.
+class EditCountTask {
+ public:
+  EditCountTask(std::vector<std::pair<int32, int32> > *edit_word_per_hyp,
+                std::vector<std::pair<int32, int32> > *edit_word_per_hyp2):
+      edit_word_per_hyp_(edit_word_per_hyp),
+      edit_word_per_hyp2_(edit_word_per_hyp2) { }
+
+  // A NULL hypothesis means it was absent; it is counted as all errors.
+  void AddSentence(const std::vector<std::string> &ref,
+                   const std::vector<std::string> *hyp,
+                   const std::vector<std::string> *hyp2) {
+    refs_.push_back(ref);
+    hyps_.push_back(hyp != NULL ? *hyp : std::vector<std::string>());
+    hyps2_.push_back(hyp2 != NULL ? *hyp2 : std::vector<std::string>());
+  }
+  size_t NumSentences() const { return refs_.size(); }
+
+  void operator () () {
+    for (size_t i = 0; i < refs_.size(); i++) {
+      int32 num_words = refs_[i].size(), num_ins, num_del, num_sub;
+      edits_.push_back(std::pair<int32, int32>(
+          LevenshteinEditDistance(refs_[i], hyps_[i],
+                                  &num_ins, &num_del, &num_sub), num_words));
+      if (edit_word_per_hyp2_ != NULL)
+        edits2_.push_back(std::pair<int32, int32>(
+            LevenshteinEditDistance(refs_[i], hyps2_[i],
+                                    &num_ins, &num_del, &num_sub), num_words));
+    }
+  }
+
+  ~EditCountTask() {
+    edit_word_per_hyp_->insert(edit_word_per_hyp_->end(),
+                               edits_.begin(), edits_.end());
+    if (edit_word_per_hyp2_ != NULL)
+      edit_word_per_hyp2_->insert(edit_word_per_hyp2_->end(),
+                                  edits2_.begin(), edits2_.end());
+  }
+
+ private:
+  std::vector<std::pair<int32, int32> > *edit_word_per_hyp_;
+  std::vector<std::pair<int32, int32> > *edit_word_per_hyp2_;
+  std::vector<std::vector<std::string> > refs_, hyps_, hyps2_;
+  std::vector<std::pair<int32, int32> > edits_, edits2_;
+};
+
 void GetEditsSingleHyp( const std::string &hyp_rspecifier,
       const std::string &ref_rspecifier,
       const std::string &mode,
+      const TaskSequencerConfig &sequencer_config,
       std::vector<std::pair<int32, int32> > & edit_word_per_hyp) {
 
     // Both text and integers are loaded as vector of strings,
     SequentialTokenVectorReader ref_reader(ref_rspecifier);
     RandomAccessTokenVectorReader hyp_reader(hyp_rspecifier);
-    int32 num_words = 0, word_errs = 0, num_ins = 0, num_del = 0, num_sub = 0;
+    TaskSequencer<EditCountTask> sequencer(sequencer_config);
+    EditCountTask *task = new EditCountTask(&edit_word_per_hyp, NULL);
 
     // Main loop, store WER stats per hyp,
     for (; !ref_reader.Done(); ref_reader.Next()) {
       std::string key = ref_reader.Key();
       const std::vector<std::string> &ref_sent = ref_reader.Value();
-      std::vector<std::string> hyp_sent;
+      const std::vector<std::string> *hyp_sent = NULL;
       if (!hyp_reader.HasKey(key)) {
         if (mode == "strict")
           KALDI_ERR << "No hypothesis for key " << key << " and strict "
@@ -51,19 +105,22 @@ void GetEditsSingleHyp( const std::string &hyp_rspecifier,
         if (mode == "present")  // do not score this one.
           continue;
       } else {
-        hyp_sent = hyp_reader.Value(key);
+        hyp_sent = &(hyp_reader.Value(key));
+      }
+      task->AddSentence(ref_sent, hyp_sent, NULL);
+      if (task->NumSentences() >= kEditCountBatchSize) {
+        sequencer.Run(task);
+        task = new EditCountTask(&edit_word_per_hyp, NULL);
       }
-      num_words = ref_sent.size();
-      word_errs = LevenshteinEditDistance(ref_sent, hyp_sent,
-                                            &num_ins, &num_del, &num_sub);
-      edit_word_per_hyp.push_back(std::pair<int32, int32>(word_errs, num_words));
     }
+    sequencer.Run(task);
 }
 
 void GetEditsDualHyp(const std::string &hyp_rspecifier,
       const std::string &hyp_rspecifier2,
       const std::string &ref_rspecifier,
       const std::string &mode,
+      const TaskSequencerConfig &sequencer_config,
       std::vector<std::pair<int32, int32> > & edit_word_per_hyp,
       std::vector<std::pair<int32, int32> > & edit_word_per_hyp2) {
 
@@ -71,14 +128,14 @@ void GetEditsDualHyp(const std::string &hyp_rspecifier,
     SequentialTokenVectorReader ref_reader(ref_rspecifier);
     RandomAccessTokenVectorReader hyp_reader(hyp_rspecifier);
     RandomAccessTokenVectorReader hyp_reader2(hyp_rspecifier2);
-    int32 num_words = 0, word_errs = 0,
-            num_ins = 0, num_del = 0, num_sub = 0;
+    TaskSequencer<EditCountTask> sequencer(sequencer_config);
+    EditCountTask *task = new EditCountTask(&edit_word_per_hyp,
+                                            &edit_word_per_hyp2);
 
     // Main loop, store WER stats per hyp,
     for (; !ref_reader.Done(); ref_reader.Next()) {
       std::string key = ref_reader.Key();
       const std::vector<std::string> &ref_sent = ref_reader.Value();
-      std::vector<std::string> hyp_sent, hyp_sent2;
       if (mode == "strict" &&
               (!hyp_reader.HasKey(key) || !hyp_reader2.HasKey(key))) {
           KALDI_ERR << "No hypothesis for key " << key << " in both transcripts "
@@ -87,27 +144,16 @@ void GetEditsDualHyp(const std::string &hyp_rspecifier,
               (!hyp_reader.HasKey(key) || !hyp_reader2.HasKey(key)))
           continue;
 
-      num_words = ref_sent.size();
-
       //all mode, if a hypothesis is not present, consider as an error
-      if(hyp_reader.HasKey(key)){
-        hyp_sent = hyp_reader.Value(key);
-        word_errs = LevenshteinEditDistance(ref_sent, hyp_sent,
-                                            &num_ins, &num_del, &num_sub);
+      task->AddSentence(ref_sent,
+                        hyp_reader.HasKey(key) ? &(hyp_reader.Value(key)) : NULL,
+                        hyp_reader2.HasKey(key) ? &(hyp_reader2.Value(key)) : NULL);
+      if (task->NumSentences() >= kEditCountBatchSize) {
+        sequencer.Run(task);
+        task = new EditCountTask(&edit_word_per_hyp, &edit_word_per_hyp2);
       }
-      else
-        word_errs = num_words;
-      edit_word_per_hyp.push_back(std::pair<int32, int32>(word_errs, num_words));
-
-      if(hyp_reader2.HasKey(key)){
-        hyp_sent2 = hyp_reader2.Value(key);
-        word_errs = LevenshteinEditDistance(ref_sent, hyp_sent2,
-                                            &num_ins, &num_del, &num_sub);
-      }
-      else
-        word_errs = num_words;
-      edit_word_per_hyp2.push_back(std::pair<int32, int32>(word_errs, num_words));
     }
+    sequencer.Run(task);
 }
 
 void GetBootstrapWERInterval(
@@ -188,6 +234,9 @@ int main(int argc, char *argv[]) {
     po.Register("replications", &replications,
             "Number of replications to compute the intervals");
 
+    TaskSequencerConfig sequencer_config;
+    sequencer_config.Register(&po);
+
     po.Read(argc, argv);
 
     if (po.NumArgs() < 2 || po.NumArgs() > 3) {
@@ -208,10 +257,11 @@ int main(int argc, char *argv[]) {
     //Get editions per each utterance
     std::vector<std::pair<int32, int32> > edit_word_per_hyp, edit_word_per_hyp2;
     if(hyp2_rspecifier.empty())
-      GetEditsSingleHyp(hyp_rspecifier, ref_rspecifier, mode, edit_word_per_hyp);
+      GetEditsSingleHyp(hyp_rspecifier, ref_rspecifier, mode,
+                        sequencer_config, edit_word_per_hyp);
     else
       GetEditsDualHyp(hyp_rspecifier, hyp2_rspecifier, ref_rspecifier, mode,
-              edit_word_per_hyp, edit_word_per_hyp2);
+              sequencer_config, edit_word_per_hyp, edit_word_per_hyp2);
 
     //Extract WER for a number of replications of the same size
     //as the hypothesis extracted
@@ -24,6 +24,61 @@
 #include "util/parse-options.h"
 #include "tree/context-dep.h"
 #include "util/edit-distance.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+struct WerStats {
+  int64 num_words, word_errs, num_sent, sent_errs, num_ins, num_del, num_sub;
+  WerStats(): num_words(0), word_errs(0), num_sent(0), sent_errs(0),
+              num_ins(0), num_del(0), num_sub(0) { }
+};
+
+/// Computes the errors of a batch of sentences in operator(), which may be
+/// run in a separate thread; the destructor adds them to the totals.
+class WerBatchTask {
+ public:
+  explicit WerBatchTask(WerStats *tot_stats): tot_stats_(tot_stats) { }
+
+  void AddSentence(const std::vector<std::string> &ref,
+                   const std::vector<std::string> &hyp) {
+    refs_.push_back(ref);
+    hyps_.push_back(hyp);
+  }
+  size_t NumSentences() const { return refs_.size(); }
+
+  void operator () () {
+    for (size_t i = 0; i < refs_.size(); i++) {
+      int32 ins, del, sub;
+      stats_.num_words += refs_[i].size();
+      stats_.word_errs += LevenshteinEditDistance(refs_[i], hyps_[i],
+                                                  &ins, &del, &sub);
+      stats_.num_ins += ins;
+      stats_.num_del += del;
+      stats_.num_sub += sub;
+      stats_.num_sent++;
+      stats_.sent_errs += (refs_[i] != hyps_[i]);
+    }
+  }
+
+  ~WerBatchTask() {
+    tot_stats_->num_words += stats_.num_words;
+    tot_stats_->word_errs += stats_.word_errs;
+    tot_stats_->num_sent += stats_.num_sent;
+    tot_stats_->sent_errs += stats_.sent_errs;
+    tot_stats_->num_ins += stats_.num_ins;
+    tot_stats_->num_del += stats_.num_del;
+    tot_stats_->num_sub += stats_.num_sub;
+  }
+
+ private:
+  WerStats *tot_stats_;
+  WerStats stats_;
+  std::vector<std::vector<std::string> > refs_;
+  std::vector<std::vector<std::string> > hyps_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   using namespace kaldi;
@@ -52,6 +107,12 @@ int main(int argc, char *argv[]) {
     bool dummy = false;
     po.Register("text", &dummy, "Deprecated option! Keeping for compatibility reasons.");
 
+    TaskSequencerConfig sequencer_config;
+    sequencer_config.Register(&po);
+    int32 batch_size = 100;
+    po.Register("batch-size", &batch_size, "Number of sentences scored "
+                "together in each task (relevant with --num-threads > 1).");
+
     po.Read(argc, argv);
 
     if (po.NumArgs() != 2) {
@@ -67,38 +128,45 @@ int main(int argc, char *argv[]) {
                 << mode;
     }
 
-    int32 num_words = 0, word_errs = 0, num_sent = 0, sent_errs = 0,
-        num_ins = 0, num_del = 0, num_sub = 0, num_absent_sents = 0;
+    WerStats stats;
+    int32 num_absent_sents = 0;
 
     // Both text and integers are loaded as vector of strings,
     SequentialTokenVectorReader ref_reader(ref_rspecifier);
     RandomAccessTokenVectorReader hyp_reader(hyp_rspecifier);
-    
-    // Main loop, accumulate WER stats,
-    for (; !ref_reader.Done(); ref_reader.Next()) {
-      std::string key = ref_reader.Key();
-      const std::vector<std::string> &ref_sent = ref_reader.Value();
-      std::vector<std::string> hyp_sent;
-      if (!hyp_reader.HasKey(key)) {
-        if (mode == "strict")
-          KALDI_ERR << "No hypothesis for key " << key << " and strict "
-              "mode specifier.";
-        num_absent_sents++;
-        if (mode == "present")  // do not score this one.
-          continue;
-      } else {
-        hyp_sent = hyp_reader.Value(key);
-      }
-      num_words += ref_sent.size();
-      int32 ins, del, sub;
-      word_errs += LevenshteinEditDistance(ref_sent, hyp_sent, &ins, &del, &sub);
-      num_ins += ins;
-      num_del += del;
-      num_sub += sub;
 
-      num_sent++;
-      sent_errs += (ref_sent != hyp_sent);
+    {
+      // The sentences are scored in batches, in parallel if --num-threads >
+      // 1; the sequencer's destructor waits for the last batch.
+      TaskSequencer<WerBatchTask> sequencer(sequencer_config);
+      WerBatchTask *task = new WerBatchTask(&stats);
+      // Main loop, accumulate WER stats,
+      for (; !ref_reader.Done(); ref_reader.Next()) {
+        std::string key = ref_reader.Key();
+        const std::vector<std::string> &ref_sent = ref_reader.Value();
+        std::vector<std::string> hyp_sent;
+        if (!hyp_reader.HasKey(key)) {
+          if (mode == "strict")
+            KALDI_ERR << "No hypothesis for key " << key << " and strict "
+                "mode specifier.";
+          num_absent_sents++;
+          if (mode == "present")  // do not score this one.
+            continue;
+        } else {
+          hyp_sent = hyp_reader.Value(key);
+        }
+        task->AddSentence(ref_sent, hyp_sent);
+        if (task->NumSentences() >= static_cast<size_t>(batch_size)) {
+          sequencer.Run(task);
+          task = new WerBatchTask(&stats);
+        }
+      }
+      sequencer.Run(task);
     }
+    int64 num_words = stats.num_words, word_errs = stats.word_errs,
+        num_sent = stats.num_sent, sent_errs = stats.sent_errs,
+        num_ins = stats.num_ins, num_del = stats.num_del,
+        num_sub = stats.num_sub;
 
     // Compute WER, SER,
     BaseFloat percent_wer = 100.0 * static_cast<BaseFloat>(word_errs)
@@ -25,6 +25,7 @@
 #include "hmm/transition-model.h"
 #include "hmm/hmm-utils.h"
 #include "hmm/tree-accu.h" // for ReadPhoneMap
+#include "util/table-map.h"
 
 int main(int argc, char *argv[]) {
   using namespace kaldi;
@@ -43,6 +44,8 @@ int main(int argc, char *argv[]) {
 
     std::string phone_map_rxfilename;
     ParseOptions po(usage);
+    TableMapOptions map_opts;
+    map_opts.Register(&po);
     po.Register("phone-map", &phone_map_rxfilename,
                 "File name containing old->new phone mapping (each line is: "
                 "old-integer-id new-integer-id)");
@@ -76,9 +79,6 @@ int main(int argc, char *argv[]) {
                    &phone_map);
     }
 
-    SequentialInt32VectorReader alignment_reader(old_alignments_rspecifier);
-    Int32VectorWriter alignment_writer(new_alignments_wspecifier);
-
     TransitionModel old_trans_model;
     ReadKaldiObject(old_model_filename, &old_trans_model);
 
@@ -93,29 +93,28 @@ int main(int argc, char *argv[]) {
     ContextDependency new_ctx_dep;  // the tree.
     ReadKaldiObject(new_tree_filename, &new_ctx_dep);
 
-    int num_success = 0, num_fail = 0;
-
-    for (; !alignment_reader.Done(); alignment_reader.Next()) {
-      std::string key = alignment_reader.Key();
-      const std::vector<int32> &old_alignment = alignment_reader.Value();
-      std::vector<int32> new_alignment;
-      if (ConvertAlignment(old_trans_model,
-                           new_trans_model,
-                           new_ctx_dep,
-                           old_alignment,
-                           frame_subsampling_factor,
-                           repeat_frames,
-                           reorder,
-                           (phone_map_rxfilename != "" ? &phone_map : NULL),
-                           &new_alignment)) {
-        alignment_writer.Write(key, new_alignment);
-        num_success++;
-      } else {
-        KALDI_WARN << "Could not convert alignment for key " << key
-                   <<" (possibly truncated alignment?)";
-        num_fail++;
-      }
-    }
+    const std::vector<int32> *phone_map_ptr =
+        (phone_map_rxfilename != "" ? &phone_map : NULL);
+    int64 num_fail = 0;
+    int64 num_success = MapTable<BasicVectorHolder<int32>,
+                                 BasicVectorHolder<int32> >(
+        old_alignments_rspecifier, new_alignments_wspecifier, map_opts,
+        [&](const std::string &key, const std::vector<int32> &old_alignment,
+            std::vector<int32> *new_alignment) {
+          if (ConvertAlignment(old_trans_model,
+                               new_trans_model,
+                               new_ctx_dep,
+                               old_alignment,
+                               frame_subsampling_factor,
+                               repeat_frames,
+                               reorder,
+                               phone_map_ptr,
+                               new_alignment))
+            return true;
+          KALDI_WARN << "Could not convert alignment for key " << key
+                     <<" (possibly truncated alignment?)";
+          return false;
+        }, &num_fail);
 
     KALDI_LOG << "Succeeded converting alignments for " << num_success
               << " files, failed for " << num_fail;
@@ -33,12 +33,18 @@ int main(int argc, char *argv[]) {
         "\n"
         "Usage: copy-int-vector [options] (vector-in-rspecifier|vector-in-rxfilename) (vector-out-wspecifier|vector-out-wxfilename)\n"
         " e.g.: copy-int-vector --binary=false foo -\n"
-        "   copy-int-vector ark:1.ali ark,t:-\n";
+        "   copy-int-vector ark:1.ali ark,t:-\n"
+        "   copy-int-vector --compress=true ark:1.ali ark:1c.ali\n";
     
     bool binary = true;
+    bool compress = false;
     ParseOptions po(usage);
 
     po.Register("binary", &binary, "Write in binary mode (only relevant if output is a wxfilename)");
+    po.Register("compress", &compress, "If true, write the vectors in a "
+                "compressed (delta-coded) binary form, which is typically "
+                "4 to 5 times smaller for alignments.  All programs can read "
+                "it.");
 
     po.Read(argc, argv);
 
@@ -71,15 +77,23 @@ int main(int argc, char *argv[]) {
         ReadIntegerVector(ki.Stream(), binary_in, &vec);
       }
       Output ko(vector_out_fn, binary);
-      WriteIntegerVector(ko.Stream(), binary, vec);
+      if (compress)
+        WriteIntegerVectorCompressed(ko.Stream(), binary, vec);
+      else
+        WriteIntegerVector(ko.Stream(), binary, vec);
       KALDI_LOG << "Copied vector to " << vector_out_fn;
       return 0;
     } else {
       int num_done = 0;
-      Int32VectorWriter writer(vector_out_fn);
+      Int32VectorWriter writer;
+      CompressedInt32VectorWriter compressed_writer;
+      if (compress) compressed_writer.Open(vector_out_fn);
+      else writer.Open(vector_out_fn);
       SequentialInt32VectorReader reader(vector_in_fn);
-      for (; !reader.Done(); reader.Next(), num_done++)
-        writer.Write(reader.Key(), reader.Value());
+      for (; !reader.Done(); reader.Next(), num_done++) {
+        if (compress) compressed_writer.Write(reader.Key(), reader.Value());
+        else writer.Write(reader.Key(), reader.Value());
+      }
       KALDI_LOG << "Copied " << num_done << " vectors of int32.";
       return (num_done != 0 ? 0 : 1);
     }
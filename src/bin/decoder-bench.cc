@@ -0,0 +1,384 @@
+// bin/decoder-bench.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <random>
+#include <sys/resource.h>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/common-utils.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/faster-decoder.h"
+#include "decoder/lattice-faster-decoder.h"
+#include "decoder/lattice-faster-online-decoder.h"
+
+namespace kaldi {
+
+// Makes a random graph that has roughly the structure of an HCLG: every state
+// has a self-loop and 'arcs_per_state' other arcs with pdf labels (in
+// 1..num_pdfs) to random states, some of them with a word label, and with
+// probability 'epsilon_prob' an input-epsilon arc to a later state (so there
+// are no epsilon cycles); 5% of the states are final.
+void MakeSyntheticGraph(int32 num_states, int32 num_pdfs,
+                        int32 arcs_per_state, BaseFloat epsilon_prob,
+                        int32 num_words, std::mt19937 *rng,
+                        fst::VectorFst<fst::StdArc> *fst) {
+  typedef fst::StdArc Arc;
+  std::uniform_int_distribution<int32> state_dist(0, num_states - 1),
+      pdf_dist(1, num_pdfs), word_dist(1, num_words);
+  std::uniform_real_distribution<float> uniform(0.0, 1.0);
+  fst->DeleteStates();
+  for (int32 s = 0; s < num_states; s++)
+    fst->AddState();
+  fst->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    int32 pdf = pdf_dist(*rng);
+    fst->AddArc(s, Arc(pdf, 0, 0.5 + uniform(*rng), s));
+    for (int32 a = 0; a < arcs_per_state; a++) {
+      int32 word = (uniform(*rng) < 0.2 ? word_dist(*rng) : 0);
+      fst->AddArc(s, Arc(pdf_dist(*rng), word, 1.0 + 4.0 * uniform(*rng),
+                         state_dist(*rng)));
+    }
+    if (s + 1 < num_states && uniform(*rng) < epsilon_prob) {
+      std::uniform_int_distribution<int32> later(s + 1, num_states - 1);
+      fst->AddArc(s, Arc(0, 0, 2.0 * uniform(*rng), later(*rng)));
+    }
+    if (uniform(*rng) < 0.05)
+      fst->SetFinal(s, fst::TropicalWeight(uniform(*rng)));
+  }
+}
+
+// Makes log-likelihoods for a random path of emitting arcs through 'fst': the
+// pdfs on the path get log-likelihood zero and the others Gaussian noise
+// around 'floor', so the search has a "correct" answer as with real data.
+void MakeSyntheticLoglikes(const fst::VectorFst<fst::StdArc> &fst,
+                           int32 num_frames, int32 num_pdfs, BaseFloat floor,
+                           std::mt19937 *rng, Matrix<BaseFloat> *loglikes) {
+  std::normal_distribution<float> gauss(0.0, 1.0);
+  loglikes->Resize(num_frames, num_pdfs, kUndefined);
+  for (int32 t = 0; t < num_frames; t++)
+    for (int32 p = 0; p < num_pdfs; p++)
+      (*loglikes)(t, p) = floor + 2.0 * gauss(*rng);
+  int32 state = fst.Start();
+  for (int32 t = 0; t < num_frames; t++) {
+    std::vector<fst::StdArc> arcs;
+    for (fst::ArcIterator<fst::VectorFst<fst::StdArc> > aiter(fst, state);
+         !aiter.Done(); aiter.Next())
+      if (aiter.Value().ilabel != 0)
+        arcs.push_back(aiter.Value());
+    KALDI_ASSERT(!arcs.empty());
+    std::uniform_int_distribution<size_t> arc_dist(0, arcs.size() - 1);
+    const fst::StdArc &arc = arcs[arc_dist(*rng)];
+    (*loglikes)(t, arc.ilabel - 1) = 0.0;
+    state = arc.nextstate;
+  }
+}
+
+// Returns the peak resident memory of the process so far, in megabytes.
+double PeakMemoryMb() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return -1.0;
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1.0e+06;  // bytes.
+#else
+  return usage.ru_maxrss / 1.0e+03;  // kilobytes.
+#endif
+}
+
+// Results of decoding all the utterances with one decoder and beam.
+struct BenchResult {
+  std::string decoder;
+  BaseFloat beam;
+  int64 num_frames;
+  double seconds;
+  double total_tokens;  // -1 if the decoder does not report them.
+  double total_arcs;
+  std::vector<int32> lattice_states;  // per utterance.
+  std::vector<int32> lattice_arcs;
+  BenchResult(): beam(0.0), num_frames(0), seconds(0.0), total_tokens(0.0),
+                 total_arcs(0.0) { }
+};
+
+void AddLatticeSize(const Lattice &lat, BenchResult *result,
+                    bool accumulate = false) {
+  int32 num_arcs = 0;
+  for (int32 s = 0; s < lat.NumStates(); s++)
+    num_arcs += lat.NumArcs(s);
+  if (accumulate && !result->lattice_states.empty()) {
+    result->lattice_states.back() += lat.NumStates();
+    result->lattice_arcs.back() += num_arcs;
+  } else {
+    result->lattice_states.push_back(lat.NumStates());
+    result->lattice_arcs.push_back(num_arcs);
+  }
+}
+
+void AddFrameStats(const std::vector<DecoderFrameStats> &frame_stats,
+                   BenchResult *result) {
+  for (size_t i = 0; i < frame_stats.size(); i++) {
+    result->total_tokens += frame_stats[i].num_active_tokens;
+    result->total_arcs += frame_stats[i].num_emitting_arcs +
+        frame_stats[i].num_nonemitting_arcs;
+  }
+}
+
+// Decodes 'loglikes' with the decoder named 'name'.  The decoding time is added
+// to result->seconds; getting the lattices is not timed.
+void DecodeOne(const std::string &name, const fst::Fst<fst::StdArc> &fst,
+               const LatticeFasterDecoderConfig &config,
+               const Matrix<BaseFloat> &loglikes, BaseFloat acoustic_scale,
+               int32 chunk_frames, BenchResult *result) {
+  DecodableMatrixScaled decodable(loglikes, acoustic_scale);
+  std::vector<DecoderFrameStats> frame_stats;
+  Timer timer;
+  if (name == "faster") {
+    FasterDecoderOptions faster_config;
+    faster_config.beam = config.beam;
+    faster_config.max_active = config.max_active;
+    faster_config.min_active = config.min_active;
+    FasterDecoder decoder(fst, faster_config);
+    decoder.Decode(&decodable);
+    result->seconds += timer.Elapsed();
+    result->total_tokens = -1.0;
+    Lattice best_path;
+    decoder.GetBestPath(&best_path);
+    AddLatticeSize(best_path, result);
+  } else if (name == "lattice-faster") {
+    LatticeFasterDecoder decoder(fst, config);
+    decoder.SetFrameStats(&frame_stats);
+    decoder.Decode(&decodable);
+    result->seconds += timer.Elapsed();
+    Lattice lat;
+    decoder.GetRawLattice(&lat);
+    AddLatticeSize(lat, result);
+  } else if (name == "lattice-faster-online") {
+    // as used in online decoding, getting the best path after every chunk.
+    LatticeFasterOnlineDecoder decoder(fst, config);
+    decoder.SetFrameStats(&frame_stats);
+    decoder.InitDecoding();
+    Lattice best_path;
+    while (decoder.NumFramesDecoded() < loglikes.NumRows()) {
+      decoder.AdvanceDecoding(&decodable, chunk_frames);
+      decoder.GetBestPath(&best_path, false);
+    }
+    decoder.FinalizeDecoding();
+    result->seconds += timer.Elapsed();
+    Lattice lat;
+    decoder.GetRawLattice(&lat);
+    AddLatticeSize(lat, result);
+  } else if (name == "lattice-faster-incremental") {
+    // committing the lattice after every chunk with CommitRawLattice(), as
+    // for long streams; the lattice size is that of all the pieces.
+    LatticeFasterDecoder decoder(fst, config);
+    decoder.SetFrameStats(&frame_stats);
+    decoder.InitDecoding();
+    Lattice lat;
+    result->lattice_states.push_back(0);
+    result->lattice_arcs.push_back(0);
+    while (decoder.NumFramesDecoded() < loglikes.NumRows()) {
+      decoder.AdvanceDecoding(&decodable, chunk_frames);
+      if (decoder.CommitRawLattice(&lat))
+        AddLatticeSize(lat, result, true);
+    }
+    decoder.FinalizeDecoding();
+    decoder.GetRawLattice(&lat);
+    result->seconds += timer.Elapsed();
+    AddLatticeSize(lat, result, true);
+  } else {
+    KALDI_ERR << "Unknown decoder " << name;
+  }
+  result->num_frames += loglikes.NumRows();
+  AddFrameStats(frame_stats, result);
+}
+
+// Writes the minimum, median, 90th percentile and maximum of 'v' as a JSON
+// object.
+std::string Distribution(std::vector<int32> v) {
+  std::ostringstream os;
+  if (v.empty()) return "null";
+  std::sort(v.begin(), v.end());
+  os << "{\"min\": " << v[0] << ", \"median\": " << v[v.size() / 2]
+     << ", \"p90\": " << v[(v.size() * 9) / 10] << ", \"max\": " << v.back()
+     << "}";
+  return os.str();
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Benchmarks the decoders (FasterDecoder, LatticeFasterDecoder, and\n"
+        "LatticeFasterDecoder as used for online and incremental decoding)\n"
+        "for a range of beams, on a synthetic HCLG-like graph and synthetic\n"
+        "log-likelihoods (made reproducibly from --seed), or on a graph and\n"
+        "log-likelihoods given with --fst and --loglikes-rspecifier (the\n"
+        "columns of the log-likelihoods are indexed by input label minus one,\n"
+        "as in DecodableMatrixScaled).  Reports frames per second, tokens and\n"
+        "arcs per frame, peak memory and the distribution of raw lattice\n"
+        "sizes (for FasterDecoder, of the best path); with --output, writes one JSON object per line for each\n"
+        "decoder and beam, for tracking regressions.  'make decoderbench' in\n"
+        "src/ runs it with the default options.\n"
+        "\n"
+        "Usage: decoder-bench [options]\n"
+        "e.g.: decoder-bench --beams=10,13,16 --output=bench.jsonl\n";
+
+    ParseOptions po(usage);
+    LatticeFasterDecoderConfig config;
+    config.Register(&po);
+
+    std::string beams_str = "10,13,16",
+        decoders_str = "faster,lattice-faster,lattice-faster-online,"
+        "lattice-faster-incremental",
+        fst_rxfilename, loglikes_rspecifier, output_wxfilename;
+    int32 seed = 0, num_states = 20000, num_pdfs = 2000, arcs_per_state = 8,
+        num_words = 10000, num_utts = 10, num_frames = 500, chunk_frames = 20;
+    BaseFloat epsilon_prob = 0.3, loglike_floor = -10.0, acoustic_scale = 0.1;
+
+    po.Register("beams", &beams_str, "Comma-separated list of the beams to "
+                "benchmark (overrides --beam).");
+    po.Register("decoders", &decoders_str, "Comma-separated list of the "
+                "decoders to benchmark, from faster, lattice-faster, "
+                "lattice-faster-online, lattice-faster-incremental.");
+    po.Register("fst", &fst_rxfilename, "The graph to decode with; if empty, "
+                "a synthetic graph is made.");
+    po.Register("loglikes-rspecifier", &loglikes_rspecifier,
+                "Log-likelihoods to decode; if empty, synthetic ones are "
+                "made.");
+    po.Register("output", &output_wxfilename, "If set, write the results "
+                "here as JSON lines.");
+    po.Register("seed", &seed, "Seed for the synthetic graph and data.");
+    po.Register("num-states", &num_states, "Number of states of the "
+                "synthetic graph.");
+    po.Register("num-pdfs", &num_pdfs, "Number of pdfs of the synthetic "
+                "graph and data.");
+    po.Register("arcs-per-state", &arcs_per_state, "Number of emitting arcs "
+                "per state of the synthetic graph, besides the self-loop.");
+    po.Register("epsilon-prob", &epsilon_prob, "Probability that a state of "
+                "the synthetic graph has an input-epsilon arc.");
+    po.Register("num-words", &num_words, "Number of words of the synthetic "
+                "graph.");
+    po.Register("num-utts", &num_utts, "Number of synthetic utterances.");
+    po.Register("num-frames", &num_frames, "Number of frames per synthetic "
+                "utterance.");
+    po.Register("loglike-floor", &loglike_floor, "Mean log-likelihood of the "
+                "pdfs not on the reference path in the synthetic data.");
+    po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for the "
+                "log-likelihoods.");
+    po.Register("chunk-frames", &chunk_frames, "Frames per chunk for the "
+                "online and incremental decoders.");
+
+    po.Read(argc, argv);
+    if (po.NumArgs() != 0) {
+      po.PrintUsage();
+      return 1;
+    }
+
+    std::vector<BaseFloat> beams;
+    std::vector<std::string> decoders;
+    if (!SplitStringToFloats(beams_str, ",", true, &beams) || beams.empty())
+      KALDI_ERR << "Invalid --beams option: " << beams_str;
+    SplitStringToVector(decoders_str, ",", true, &decoders);
+
+    std::mt19937 rng(seed);
+    fst::Fst<fst::StdArc> *fst;
+    if (!fst_rxfilename.empty()) {
+      fst = fst::ReadFstKaldiGeneric(fst_rxfilename);
+    } else {
+      fst::VectorFst<fst::StdArc> *synthetic = new fst::VectorFst<fst::StdArc>;
+      MakeSyntheticGraph(num_states, num_pdfs, arcs_per_state, epsilon_prob,
+                         num_words, &rng, synthetic);
+      fst = synthetic;
+    }
+
+    std::vector<Matrix<BaseFloat> > utterances;
+    if (!loglikes_rspecifier.empty()) {
+      SequentialBaseFloatMatrixReader loglikes_reader(loglikes_rspecifier);
+      for (; !loglikes_reader.Done(); loglikes_reader.Next())
+        utterances.push_back(loglikes_reader.Value());
+    } else {
+      const fst::VectorFst<fst::StdArc> *synthetic =
+          dynamic_cast<const fst::VectorFst<fst::StdArc>*>(fst);
+      if (synthetic == NULL)
+        KALDI_ERR << "Synthetic log-likelihoods need a synthetic graph (or "
+                  << "a graph that is a VectorFst).";
+      utterances.resize(num_utts);
+      for (int32 i = 0; i < num_utts; i++)
+        MakeSyntheticLoglikes(*synthetic, num_frames, num_pdfs, loglike_floor,
+                              &rng, &(utterances[i]));
+    }
+    if (utterances.empty())
+      KALDI_ERR << "No utterances to decode.";
+
+    Output *output = NULL;
+    if (!output_wxfilename.empty())
+      output = new Output(output_wxfilename, false);
+
+    for (size_t d = 0; d < decoders.size(); d++) {
+      for (size_t b = 0; b < beams.size(); b++) {
+        LatticeFasterDecoderConfig this_config(config);
+        this_config.beam = beams[b];
+        BenchResult result;
+        result.decoder = decoders[d];
+        result.beam = beams[b];
+        for (size_t i = 0; i < utterances.size(); i++)
+          DecodeOne(decoders[d], *fst, this_config, utterances[i],
+                    acoustic_scale, chunk_frames, &result);
+        double frames_per_second = result.num_frames / result.seconds,
+            tokens_per_frame = (result.total_tokens < 0.0 ? -1.0 :
+                                result.total_tokens / result.num_frames),
+            arcs_per_frame = (result.total_tokens < 0.0 ? -1.0 :
+                              result.total_arcs / result.num_frames);
+        KALDI_LOG << result.decoder << " beam=" << result.beam << ": "
+                  << frames_per_second << " frames/sec, "
+                  << tokens_per_frame << " tokens/frame, " << arcs_per_frame
+                  << " arcs/frame, peak memory " << PeakMemoryMb()
+                  << " MB, raw lattice states "
+                  << Distribution(result.lattice_states);
+        if (output != NULL) {
+          std::ostream &os = output->Stream();
+          os << "{\"decoder\": \"" << result.decoder << "\", \"beam\": "
+             << result.beam << ", \"max_active\": " << config.max_active
+             << ", \"lattice_beam\": " << config.lattice_beam
+             << ", \"num_utts\": " << utterances.size()
+             << ", \"num_frames\": " << result.num_frames
+             << ", \"seconds\": " << result.seconds
+             << ", \"frames_per_second\": " << frames_per_second
+             << ", \"tokens_per_frame\": " << tokens_per_frame
+             << ", \"arcs_per_frame\": " << arcs_per_frame
+             << ", \"peak_memory_mb\": " << PeakMemoryMb()
+             << ", \"lattice_states\": "
+             << Distribution(result.lattice_states)
+             << ", \"lattice_arcs\": " << Distribution(result.lattice_arcs)
+             << "}\n";
+        }
+      }
+    }
+    delete output;
+    delete fst;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -107,6 +107,11 @@ int main(int argc, char *argv[]) {
     } else {
       // read in vectors, not matrices
       SequentialBaseFloatVectorReader vec_reader(rspecifier);
+      // The vectors are put into the rows of "buffer" so that the scatter can
+      // be accumulated with a matrix multiplication.
+      const int32 buffer_size = 1000;
+      Matrix<double> buffer;
+      int32 buffer_rows = 0;
     
       for (; !vec_reader.Done(); vec_reader.Next()) {
         Vector<double> vec(vec_reader.Value());
@@ -118,6 +123,7 @@ int main(int argc, char *argv[]) {
         if (sum.Dim() == 0) {
           sum.Resize(vec.Dim());
           sumsq.Resize(vec.Dim());
+          buffer.Resize(buffer_size, vec.Dim());
         }
         if (sum.Dim() != vec.Dim()) {
           KALDI_WARN << "Feature dimension mismatch " << sum.Dim() << " vs. "
@@ -126,10 +132,16 @@ int main(int argc, char *argv[]) {
           continue;
         }
         sum.AddVec(1.0, vec);
-        sumsq.AddVec2(1.0, vec);
+        buffer.Row(buffer_rows++).CopyFromVec(vec);
+        if (buffer_rows == buffer_size) {
+          sumsq.AddMat2(1.0, buffer, kTrans, 1.0);
+          buffer_rows = 0;
+        }
         count += 1.0;
         num_done++;
       }
+      if (buffer_rows > 0)
+        sumsq.AddMat2(1.0, buffer.RowRange(0, buffer_rows), kTrans, 1.0);
       KALDI_LOG << "Accumulated stats from " << num_done << " vectors, "
                 << num_err << " with errors.";
     }
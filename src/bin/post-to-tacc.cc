@@ -55,7 +55,7 @@ int main(int argc, char *argv[]) {
         post_rspecifier = po.GetArg(2),
         accs_wxfilename = po.GetArg(3);
 
-    kaldi::SequentialPosteriorReader posterior_reader(post_rspecifier);
+    kaldi::SequentialCompactPosteriorReader posterior_reader(post_rspecifier);
 
     int32 num_transition_ids;
 
@@ -70,17 +70,17 @@ int main(int argc, char *argv[]) {
     int32 num_done = 0;
 
     for (; !posterior_reader.Done(); posterior_reader.Next()) {
-      const kaldi::Posterior &posterior = posterior_reader.Value();
-      int32 num_frames = static_cast<int32>(posterior.size());
-      for (int32 i = 0; i < num_frames; i++) {
-        for (int32 j = 0; j < static_cast<int32>(posterior[i].size()); j++) {
-          int32 tid = posterior[i][j].first;
-          if (tid <= 0 || tid > num_transition_ids)
-            KALDI_ERR << "Invalid transition-id " << tid
-                      << " encountered for utterance "
-                      << posterior_reader.Key();
-          transition_accs(tid) += posterior[i][j].second;
-        }
+      const kaldi::CompactPosterior &posterior = posterior_reader.Value();
+      // The frames don't matter here, so we go through all the elements.
+      const std::vector<int32> &tids = posterior.Ids();
+      const std::vector<BaseFloat> &weights = posterior.Weights();
+      for (size_t i = 0; i < tids.size(); i++) {
+        int32 tid = tids[i];
+        if (tid <= 0 || tid > num_transition_ids)
+          KALDI_ERR << "Invalid transition-id " << tid
+                    << " encountered for utterance "
+                    << posterior_reader.Key();
+        transition_accs(tid) += weights[i];
       }
       num_done++;
     }
@@ -75,21 +75,14 @@ int main(int argc, char *argv[]) {
     ReadKaldiObject(model_rxfilename, &trans_model);
 
     int32 num_posteriors = 0;
-    SequentialPosteriorReader posterior_reader(posteriors_rspecifier);
-    PosteriorWriter posterior_writer(posteriors_wspecifier);
+    SequentialCompactPosteriorReader posterior_reader(posteriors_rspecifier);
+    CompactPosteriorWriter posterior_writer(posteriors_wspecifier);
 
     for (; !posterior_reader.Done(); posterior_reader.Next()) {
       num_posteriors++;
-      // Posterior is vector<vector<pair<int32, BaseFloat> > >
-      Posterior post = posterior_reader.Value();
-      // Posterior is vector<vector<pair<int32, BaseFloat> > >
-      if (distribute)
-        WeightSilencePostDistributed(trans_model, silence_set,
-                                     silence_weight, &post);
-      else
-        WeightSilencePost(trans_model, silence_set,
-                          silence_weight, &post);
-
+      // We modify the posterior in place, rather than copying it.
+      CompactPosterior &post = posterior_reader.Value();
+      post.WeightSilence(trans_model, silence_set, silence_weight, distribute);
       posterior_writer.Write(posterior_reader.Key(), post);
     }
     KALDI_LOG << "Done " << num_posteriors << " posteriors.";
@@ -24,6 +24,18 @@
 namespace kaldi {
 namespace chain {
 
+#if HAVE_CUDA == 1
+// Returns the number of lanes of each warp that the warp-per-HMM-state kernels
+// (see cuda_chain_hmm_forward_warp()) assign to different sequences: the
+// smallest power of two >= num_sequences, but no more than 32.  The remaining
+// factor of the 32 lanes is spread over the transitions of the HMM state.
+static int32 WarpSequenceLanes(int32 num_sequences) {
+  int32 seq_lanes = 1;
+  while (seq_lanes < num_sequences && seq_lanes < 32)
+    seq_lanes *= 2;
+  return seq_lanes;
+}
+#endif
 
 DenominatorComputation::DenominatorComputation(
     const ChainTrainingOptions &opts,
@@ -123,7 +135,19 @@ void DenominatorComputation::AlphaGeneralFrame(int32 t) {
   const BaseFloat *prob_data = probs.Data();
 
 #if HAVE_CUDA == 1
-  if (CuDevice::Instantiate().Enabled()) {
+  if (CuDevice::Instantiate().Enabled() && opts_.den_warp_kernels) {
+    CuTimer tim;
+    int32 seq_lanes = WarpSequenceLanes(num_sequences);
+    dim3 dimBlock(32, 4, 1);
+    dim3 dimGrid(n_blocks(num_hmm_states, dimBlock.y), 1, 1);
+    cuda_chain_hmm_forward_warp(dimGrid, dimBlock,
+                                backward_transitions, transitions,
+                                num_sequences, num_hmm_states,
+                                prob_data, probs.Stride(), prev_alpha_dash,
+                                this_alpha, seq_lanes);
+    CU_SAFE_CALL(cudaGetLastError());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else if (CuDevice::Instantiate().Enabled()) {
     CuTimer tim;
     dim3 dimBlock(std::min<int32>(CU1DBLOCK, num_sequences), 1, 1);
     dim3 dimGrid(n_blocks(num_sequences, dimBlock.x), num_hmm_states, 1);
@@ -354,7 +378,20 @@ void DenominatorComputation::BetaDashGeneralFrame(int32 t) {
       num_sequences = num_sequences_;
 
 #if HAVE_CUDA == 1
-  if (CuDevice::Instantiate().Enabled()) {
+  if (CuDevice::Instantiate().Enabled() && opts_.den_warp_kernels) {
+    CuTimer tim;
+    int32 seq_lanes = WarpSequenceLanes(num_sequences);
+    dim3 dimBlock(32, 4, 1);
+    dim3 dimGrid(n_blocks(num_hmm_states, dimBlock.y), 1, 1);
+    cuda_chain_hmm_backward_warp(dimGrid, dimBlock, forward_transitions,
+                                 transitions, num_sequences, num_hmm_states,
+                                 probs.Data(), probs.Stride(),
+                                 this_alpha_dash, next_beta, this_beta_dash,
+                                 log_prob_deriv.Data(), log_prob_deriv.Stride(),
+                                 seq_lanes);
+    CU_SAFE_CALL(cudaGetLastError());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else if (CuDevice::Instantiate().Enabled()) {
     CuTimer tim;
     dim3 dimBlock(std::min<int32>(CU1DBLOCK, num_sequences), 1, 1);
     dim3 dimGrid(n_blocks(num_sequences, dimBlock.x), num_hmm_states, 1);
@@ -114,6 +114,47 @@ GenericNumeratorComputation::GenericNumeratorComputation(
       }
     }
   }
+  total_states_ = 0;
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    InitDeviceTransitions();
+#endif
+}
+
+
+void GenericNumeratorComputation::InitDeviceTransitions() {
+  int32 num_sequences = supervision_.num_sequences;
+  std::vector<Int32Pair> seq_states(num_sequences);
+  std::vector<Int32Pair> in_transitions, out_transitions;
+  std::vector<DenominatorGraphTransition> transitions;
+  std::vector<BaseFloat> final_probs;
+  for (int32 seq = 0; seq < num_sequences; seq++) {
+    int32 num_states = supervision_.e2e_fsts[seq].NumStates();
+    seq_states[seq].first = in_transitions.size();
+    seq_states[seq].second = num_states;
+    for (int32 s = 0; s < num_states; s++) {
+      Int32Pair range;
+      range.first = transitions.size();
+      transitions.insert(transitions.end(), in_transitions_[seq][s].begin(),
+                         in_transitions_[seq][s].end());
+      range.second = transitions.size();
+      in_transitions.push_back(range);
+      range.first = transitions.size();
+      transitions.insert(transitions.end(), out_transitions_[seq][s].begin(),
+                         out_transitions_[seq][s].end());
+      range.second = transitions.size();
+      out_transitions.push_back(range);
+      final_probs.push_back(final_probs_(seq, s));
+    }
+  }
+  total_states_ = in_transitions.size();
+  cu_seq_states_ = seq_states;
+  cu_in_transitions_ = in_transitions;
+  cu_out_transitions_ = out_transitions;
+  cu_transitions_ = transitions;
+  Vector<BaseFloat> final_probs_vec(total_states_, kUndefined);
+  std::copy(final_probs.begin(), final_probs.end(), final_probs_vec.Data());
+  cu_final_probs_ = final_probs_vec;
 }
 
 
@@ -131,7 +172,7 @@ void GenericNumeratorComputation::AlphaFirstFrame(int seq,
 void GenericNumeratorComputation::CopySpecificPdfsIndirect(
                                     const CuMatrixBase<BaseFloat> &nnet_output,
                                     const std::vector<MatrixIndexT> &indices,
-                                    Matrix<BaseFloat> *out) {
+                                    CuMatrix<BaseFloat> *out) {
   KALDI_ASSERT(nnet_output_stride_ == nnet_output_.Stride());
   const int32 num_sequences = supervision_.num_sequences,
               frames_per_sequence = supervision_.frames_per_sequence;
@@ -145,11 +186,8 @@ void GenericNumeratorComputation::CopySpecificPdfsIndirect(
                                              view_stride);
 
   CuArray<MatrixIndexT> indices_gpu(indices);
-  CuMatrix<BaseFloat> required_pdfs(frames_per_sequence,
-                                        indices.size());
-
-  required_pdfs.CopyCols(sequence_view, indices_gpu);
-  out->Swap(&required_pdfs);
+  out->Resize(frames_per_sequence, indices.size(), kUndefined);
+  out->CopyCols(sequence_view, indices_gpu);
 }
 
 // The alpha computation for some 0 < t <= num_time_steps_.
@@ -221,13 +259,33 @@ bool GenericNumeratorComputation::ForwardBackward(
   const int32 num_sequences = supervision_.num_sequences;
 
   bool ok = true;
+  CuMatrix<BaseFloat> cu_probs, cu_derivs;
+
+  // We selectively copy only those pdfs we need
+  CopySpecificPdfsIndirect(nnet_output_, index_to_pdf_, &cu_probs);
+
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuMatrix<BaseFloat> cu_alpha;
+    *total_loglike = AlphaDevice(cu_probs, &cu_alpha);
+    BetaDevice(cu_probs, cu_alpha, &cu_derivs);
+    if (GetVerboseLevel() >= 1) {
+      // CheckValues() expects the derivatives in log space; it does not look
+      // at alpha and beta.
+      Matrix<BaseFloat> probs(cu_probs), derivs(cu_derivs), unused;
+      derivs.ApplyLog();
+      for (int seq = 0; seq < num_sequences; ++seq)
+        ok = ok && CheckValues(seq, probs, unused, unused, derivs);
+    }
+    AddSpecificPdfsIndirect(&cu_derivs, index_to_pdf_, nnet_output_deriv);
+    return ok;
+  }
+#endif
   Matrix<BaseFloat> alpha;
   Matrix<BaseFloat> beta;
   Matrix<BaseFloat> probs;
   Matrix<BaseFloat> derivs;
-
-  // We selectively copy only those pdfs we need
-  CopySpecificPdfsIndirect(nnet_output_, index_to_pdf_, &probs);
+  probs.Swap(&cu_probs);
 
   derivs.Resize(probs.NumRows(), probs.NumCols());
   derivs.Set(-std::numeric_limits<BaseFloat>::infinity());
@@ -244,7 +302,9 @@ bool GenericNumeratorComputation::ForwardBackward(
       ok = ok && CheckValues(seq, probs, alpha, beta, derivs);
   }
   // Transfer and add the derivatives to the values in the matrix
-  AddSpecificPdfsIndirect(&derivs, index_to_pdf_, nnet_output_deriv);
+  cu_derivs.Swap(&derivs);
+  cu_derivs.ApplyExp();
+  AddSpecificPdfsIndirect(&cu_derivs, index_to_pdf_, nnet_output_deriv);
   *total_loglike = partial_loglike;
   return ok;
 }
@@ -253,11 +313,20 @@ BaseFloat GenericNumeratorComputation::ComputeObjf() {
   BaseFloat partial_loglike = 0;
   const int32 num_sequences = supervision_.num_sequences;
 
-  Matrix<BaseFloat> alpha;
-  Matrix<BaseFloat> probs;
+  CuMatrix<BaseFloat> cu_probs;
 
   // We selectively copy only those pdfs we need
-  CopySpecificPdfsIndirect(nnet_output_, index_to_pdf_, &probs);
+  CopySpecificPdfsIndirect(nnet_output_, index_to_pdf_, &cu_probs);
+
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuMatrix<BaseFloat> cu_alpha;
+    return AlphaDevice(cu_probs, &cu_alpha);
+  }
+#endif
+  Matrix<BaseFloat> alpha;
+  Matrix<BaseFloat> probs;
+  probs.Swap(&cu_probs);
 
   for (int seq = 0; seq < num_sequences; ++seq) {
     // Forward part
@@ -336,8 +405,56 @@ void GenericNumeratorComputation::BetaRemainingFrames(int seq,
 }
 
 
+BaseFloat GenericNumeratorComputation::AlphaDevice(
+    const CuMatrixBase<BaseFloat> &probs, CuMatrix<BaseFloat> *alpha) {
+  const int32 num_sequences = supervision_.num_sequences,
+      num_frames = supervision_.frames_per_sequence;
+  // Row t of 'alpha' is the alphas of all the states on frame t, followed by
+  // the log of the normalizer of each sequence (see AlphaRemainingFrames()).
+  alpha->Resize(num_frames + 1, total_states_ + num_sequences, kUndefined);
+  CuVector<BaseFloat> tot_loglike(num_sequences, kUndefined);
+#if HAVE_CUDA == 1
+  CuTimer tim;
+  dim3 dimBlock(CU1DBLOCK, 1, 1);
+  dim3 dimGrid(num_sequences, 1, 1);
+  cuda_chain_generic_numerator_forward(
+      dimGrid, dimBlock, cu_seq_states_.Data(), cu_in_transitions_.Data(),
+      cu_transitions_.Data(), cu_final_probs_.Data(), num_frames,
+      total_states_, probs.Data(), probs.Stride(), alpha->Data(),
+      alpha->Stride(), tot_loglike.Data());
+  CU_SAFE_CALL(cudaGetLastError());
+  CuDevice::Instantiate().AccuProfile(__func__, tim);
+#endif
+  Vector<BaseFloat> tot_loglike_cpu(tot_loglike);
+  tot_loglike_cpu.AddVec(-1.0, offsets_);
+  return tot_loglike_cpu.Sum();
+}
+
+void GenericNumeratorComputation::BetaDevice(
+    const CuMatrixBase<BaseFloat> &probs,
+    const CuMatrixBase<BaseFloat> &alpha,
+    CuMatrix<BaseFloat> *derivs) {
+  derivs->Resize(probs.NumRows(), probs.NumCols());
+#if HAVE_CUDA == 1
+  const int32 num_sequences = supervision_.num_sequences,
+      num_frames = supervision_.frames_per_sequence;
+  CuMatrix<BaseFloat> beta(2, total_states_, kUndefined);
+  CuTimer tim;
+  dim3 dimBlock(CU1DBLOCK, 1, 1);
+  dim3 dimGrid(num_sequences, 1, 1);
+  cuda_chain_generic_numerator_backward(
+      dimGrid, dimBlock, cu_seq_states_.Data(), cu_out_transitions_.Data(),
+      cu_transitions_.Data(), cu_final_probs_.Data(), num_frames,
+      total_states_, probs.Data(), probs.Stride(), alpha.Data(),
+      alpha.Stride(), beta.Data(), beta.Stride(), derivs->Data(),
+      derivs->Stride());
+  CU_SAFE_CALL(cudaGetLastError());
+  CuDevice::Instantiate().AccuProfile(__func__, tim);
+#endif
+}
+
 void GenericNumeratorComputation::AddSpecificPdfsIndirect(
-                                 Matrix<BaseFloat> *logprobs,
+                                 CuMatrix<BaseFloat> *probs,
                                  const std::vector<MatrixIndexT> &indices,
                                  CuMatrixBase<BaseFloat> *output) {
   const int32 num_sequences = supervision_.num_sequences,
@@ -348,8 +465,7 @@ void GenericNumeratorComputation::AddSpecificPdfsIndirect(
   KALDI_ASSERT(frames_per_sequence * num_sequences == output->NumRows());
 
   CuMatrix<BaseFloat> specific_pdfs;
-  specific_pdfs.Swap(logprobs);
-  specific_pdfs.ApplyExp();
+  specific_pdfs.Swap(probs);
   specific_pdfs.Scale(supervision_.weight);
 
   std::vector<MatrixIndexT> indices_expanded(view_stride, -1);
@@ -36,6 +36,7 @@
 #include "chain/chain-supervision.h"
 #include "cudamatrix/cu-matrix.h"
 #include "cudamatrix/cu-array.h"
+#include "cudamatrix/cu-vector.h"
 #include "chain/chain-datastruct.h"
 
 namespace kaldi {
@@ -65,9 +66,12 @@ namespace chain {
    class GenericNumeratorComputation is responsible for doing Forward-Backward
    on a generic FST (i.e. the kind of FST we use in end-to-end chain
    training). It is the same as DenominatorComputation with 2 differences:
-   [1] it runs on CPU
+   [1] the F-B computation is done in log-domain
    [2] it does not use leakyHMM
-   The F-B computation is done in log-domain.
+   If a GPU is in use, the F-B for all the sequences of the minibatch is done
+   on the GPU by one kernel launch for each direction (one CUDA block per
+   sequence); otherwise it is done on the CPU, one sequence at a time.  The
+   two implementations give the same results up to roundoff.
 
    When the 'e2e' flag of a supervision is set, the ComputeChainObjfAndDeriv
    function in chain-training.cc uses GenericNumeratorComputation (instead
@@ -125,23 +129,42 @@ class GenericNumeratorComputation {
 
   BaseFloat ComputeObjf();
  private:
-  // For the remapped FSTs, copy the appropriate activations to CPU memory.
+  // For the remapped FSTs, copy the appropriate activations into 'output'
+  // (which is on the GPU if one is in use).
   // For explanation of what remapped FST is, see the large comment in the
   // beginning of the file
   void CopySpecificPdfsIndirect(
                              const CuMatrixBase<BaseFloat> &nnet_output,
                              const std::vector<MatrixIndexT> &indices,
-                             Matrix<BaseFloat> *output);
+                             CuMatrix<BaseFloat> *output);
 
-  // For the remapped FSTs, copy the computed values back to gpu,
-  // expand to the original shape and add to the output matrix.
+  // For the remapped FSTs, expand the computed occupation probabilities
+  // 'probs' (not in log space) to the original shape, scale them by
+  // supervision_.weight and add them to the output matrix.  'probs' is
+  // destroyed.
   // For explanation of what remapped FST is, see the large comment in the
   // beginning of the file.
   void AddSpecificPdfsIndirect(
-                             Matrix<BaseFloat> *logprobs,
+                             CuMatrix<BaseFloat> *probs,
                              const std::vector<MatrixIndexT> &indices,
                              CuMatrixBase<BaseFloat> *output);
 
+  // Sets up the cu_* members below, for the GPU version of the computation.
+  void InitDeviceTransitions();
+
+  // Does the forward computation of all the sequences on the GPU, given the
+  // remapped log-likelihoods 'probs'; sets 'alpha' and returns the total
+  // log-prob (as from AlphaRemainingFrames(), summed over sequences).
+  BaseFloat AlphaDevice(const CuMatrixBase<BaseFloat> &probs,
+                        CuMatrix<BaseFloat> *alpha);
+
+  // Does the backward computation of all the sequences on the GPU, after
+  // AlphaDevice(); sets 'derivs' to the occupation probabilities (not in log
+  // space) of the remapped pdfs.
+  void BetaDevice(const CuMatrixBase<BaseFloat> &probs,
+                  const CuMatrixBase<BaseFloat> &alpha,
+                  CuMatrix<BaseFloat> *derivs);
+
   // sets up the alpha for frame t = 0.
   void AlphaFirstFrame(int seq, Matrix<BaseFloat> *alpha);
 
@@ -198,6 +221,21 @@ class GenericNumeratorComputation {
   // an offset subtracted from the logprobs of transitions out of the first
   // state of each graph to help reduce numerical problems.
   Vector<BaseFloat> offsets_;
+
+  // The following are only set up if a GPU is in use.  The states of all the
+  // numerator graphs are numbered consecutively in one space of dimension
+  // total_states_.
+  int32 total_states_;
+  // Indexed by sequence: the offset of its first state, and its number of
+  // states.
+  CuArray<Int32Pair> cu_seq_states_;
+  // Indexed by state (in the concatenated space): the [begin, end) of its
+  // incoming (resp. outgoing) transitions in cu_transitions_.  The hmm_state
+  // of the transitions is the state index within the sequence's graph.
+  CuArray<Int32Pair> cu_in_transitions_, cu_out_transitions_;
+  CuArray<DenominatorGraphTransition> cu_transitions_;
+  // The final probs, indexed by state in the concatenated space.
+  CuVector<BaseFloat> cu_final_probs_;
 };
 
 }  // namespace chain
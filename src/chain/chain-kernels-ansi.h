@@ -48,6 +48,55 @@ extern "C" {
                               const BaseFloat *prev_alpha,
                               BaseFloat *this_alpha);
 
+  // The following two are alternatives to cuda_chain_hmm_forward and
+  // cuda_chain_hmm_backward that use one warp per HMM state; blockDim.x must
+  // be 32, and 'seq_lanes' (a power of two, <= 32) is the number of lanes of
+  // each warp that are assigned to different sequences.
+  void cuda_chain_hmm_forward_warp(dim3 Gr, dim3 Bl,
+                                   const Int32Pair *backward_transitions,
+                                   const DenominatorGraphTransition *transitions,
+                                   int32_cuda num_sequences,
+                                   int32_cuda num_hmm_states,
+                                   const BaseFloat *probs,
+                                   int32_cuda prob_stride,
+                                   const BaseFloat *prev_alpha,
+                                   BaseFloat *this_alpha,
+                                   int32_cuda seq_lanes);
+
+  void cuda_chain_hmm_backward_warp(dim3 Gr, dim3 Bl,
+                                    const Int32Pair *forward_transitions,
+                                    const DenominatorGraphTransition *transitions,
+                                    int32_cuda num_sequences,
+                                    int32_cuda num_hmm_states,
+                                    const BaseFloat *probs,
+                                    int32_cuda prob_stride,
+                                    const BaseFloat *this_alpha,
+                                    const BaseFloat *next_beta,
+                                    BaseFloat *this_beta,
+                                    BaseFloat *log_prob_deriv,
+                                    int32_cuda log_prob_deriv_stride,
+                                    int32_cuda seq_lanes);
+
+  // Forward and backward passes of GenericNumeratorComputation for the whole
+  // minibatch (one block per sequence); see chain-kernels.cu.
+  void cuda_chain_generic_numerator_forward(
+      dim3 Gr, dim3 Bl, const Int32Pair *seq_states,
+      const Int32Pair *in_transitions,
+      const DenominatorGraphTransition *transitions,
+      const BaseFloat *final_probs, int32_cuda num_frames,
+      int32_cuda total_states, const BaseFloat *probs, int32_cuda prob_stride,
+      BaseFloat *alpha, int32_cuda alpha_stride, BaseFloat *tot_loglike);
+
+  void cuda_chain_generic_numerator_backward(
+      dim3 Gr, dim3 Bl, const Int32Pair *seq_states,
+      const Int32Pair *out_transitions,
+      const DenominatorGraphTransition *transitions,
+      const BaseFloat *final_probs, int32_cuda num_frames,
+      int32_cuda total_states, const BaseFloat *probs, int32_cuda prob_stride,
+      const BaseFloat *alpha, int32_cuda alpha_stride,
+      BaseFloat *beta, int32_cuda beta_stride,
+      BaseFloat *derivs, int32_cuda deriv_stride);
+
   void cuda_penalize_out_of_range(dim3 Gr, dim3 Bl, BaseFloat limit,
                                   BaseFloat scale, const BaseFloat *in_data,
                                   MatrixDim dim, int out_stride,
@@ -18,6 +18,7 @@
 
 
 #include <cfloat>
+#include <math_constants.h>
 #include "chain/chain-kernels-ansi.h"
 
 #if defined(__CUDA_ARCH__) && __CUDA_ARCH__ < 200
@@ -256,6 +257,128 @@ static void _cuda_chain_hmm_backward(const Int32Pair *forward_transitions,
 }
 
 
+// Sums 'value' over the lanes of a warp whose lane-indexes differ only in bits
+// at or above 'first_offset' (which must be a power of two); every lane gets
+// the result.  All 32 lanes of the warp must call this.
+__device__ inline double warp_sum_from(double value, int32_cuda first_offset) {
+  for (int32_cuda offset = first_offset; offset < 32; offset <<= 1) {
+#if __CUDACC_VER_MAJOR__ >= 9
+    value += __shfl_xor_sync(0xffffffff, value, offset);
+#else
+    value += __shfl_xor(value, offset);
+#endif
+  }
+  return value;
+}
+
+// This is an alternative to _cuda_chain_hmm_forward, with a different
+// assignment of work to threads: each warp (threadIdx.y, blockIdx.x) handles
+// one HMM state, and its 32 lanes are split into 'seq_lanes' lanes over the
+// sequences times (32 / seq_lanes) lanes over the incoming transitions, whose
+// contributions are summed with warp shuffles.  'seq_lanes' must be a power of
+// two no greater than 32, and blockDim.x must be 32.  This keeps all lanes busy
+// when the minibatch has few sequences, and spreads out the work for states
+// with a large number of incoming transitions; the results are the same as
+// _cuda_chain_hmm_forward up to roundoff.
+__global__
+static void _cuda_chain_hmm_forward_warp(const Int32Pair *backward_transitions,
+                                         const DenominatorGraphTransition *transitions,
+                                         int32_cuda num_sequences,
+                                         int32_cuda num_hmm_states,
+                                         const BaseFloat *probs,
+                                         int32_cuda prob_stride,
+                                         const BaseFloat *prev_alpha,
+                                         BaseFloat *this_alpha,
+                                         int32_cuda seq_lanes) {
+  // h is the same for all lanes of the warp, so whole warps return together.
+  int32_cuda h = blockIdx.x * blockDim.y + threadIdx.y;
+  if (h >= num_hmm_states)
+    return;
+  int32_cuda seq_lane = threadIdx.x & (seq_lanes - 1),
+      arc_lane = threadIdx.x / seq_lanes,
+      num_arc_lanes = 32 / seq_lanes,
+      trans_begin = backward_transitions[h].first,
+      trans_end = backward_transitions[h].second;
+
+  // the loop condition depends only on s0, so all lanes take part in the
+  // shuffles in warp_sum_from().
+  for (int32_cuda s0 = 0; s0 < num_sequences; s0 += seq_lanes) {
+    int32_cuda s = s0 + seq_lane;
+    double this_tot_alpha = 0.0;
+    if (s < num_sequences) {
+      for (int32_cuda k = trans_begin + arc_lane; k < trans_end;
+           k += num_arc_lanes) {
+        BaseFloat transition_prob = transitions[k].transition_prob;
+        int32_cuda pdf_id = transitions[k].pdf_id,
+            prev_hmm_state = transitions[k].hmm_state;
+        this_tot_alpha += prev_alpha[prev_hmm_state * num_sequences + s] *
+            transition_prob * probs[pdf_id * prob_stride + s];
+      }
+    }
+    this_tot_alpha = warp_sum_from(this_tot_alpha, seq_lanes);
+    if (arc_lane == 0 && s < num_sequences) {
+      // see _cuda_chain_hmm_forward for an explanation of arbitrary_scale.
+      BaseFloat arbitrary_scale =
+          1.0 / prev_alpha[num_hmm_states * num_sequences + s];
+      this_alpha[h * num_sequences + s] = this_tot_alpha * arbitrary_scale;
+    }
+  }
+}
+
+// This is the backward-pass counterpart of _cuda_chain_hmm_forward_warp; see
+// the documentation there and in _cuda_chain_hmm_backward.  Each lane does the
+// derivative accumulation for its own transitions.
+__global__
+static void _cuda_chain_hmm_backward_warp(const Int32Pair *forward_transitions,
+                                          const DenominatorGraphTransition *transitions,
+                                          int32_cuda num_sequences,
+                                          int32_cuda num_hmm_states,
+                                          const BaseFloat *probs,
+                                          int32_cuda prob_stride,
+                                          const BaseFloat *this_alpha,
+                                          const BaseFloat *next_beta,
+                                          BaseFloat *this_beta,
+                                          BaseFloat *log_prob_deriv,
+                                          int32_cuda log_prob_deriv_stride,
+                                          int32_cuda seq_lanes) {
+  int32_cuda h = blockIdx.x * blockDim.y + threadIdx.y;
+  if (h >= num_hmm_states)
+    return;
+  int32_cuda seq_lane = threadIdx.x & (seq_lanes - 1),
+      arc_lane = threadIdx.x / seq_lanes,
+      num_arc_lanes = 32 / seq_lanes,
+      trans_begin = forward_transitions[h].first,
+      trans_end = forward_transitions[h].second;
+
+  for (int32_cuda s0 = 0; s0 < num_sequences; s0 += seq_lanes) {
+    int32_cuda s = s0 + seq_lane;
+    double tot_variable_factor = 0.0;
+    BaseFloat inv_arbitrary_scale = 1.0;
+    if (s < num_sequences) {
+      inv_arbitrary_scale = this_alpha[num_hmm_states * num_sequences + s];
+      BaseFloat occupation_factor =
+          this_alpha[h * num_sequences + s] / inv_arbitrary_scale;
+      for (int32_cuda k = trans_begin + arc_lane; k < trans_end;
+           k += num_arc_lanes) {
+        BaseFloat transition_prob = transitions[k].transition_prob;
+        int32_cuda pdf_id = transitions[k].pdf_id,
+            next_hmm_state = transitions[k].hmm_state;
+        BaseFloat variable_factor = transition_prob *
+            next_beta[next_hmm_state * num_sequences + s] *
+            probs[pdf_id * prob_stride + s];
+        tot_variable_factor += variable_factor;
+        atomic_add_thresholded(log_prob_deriv + (pdf_id * log_prob_deriv_stride + s),
+                               variable_factor * occupation_factor);
+      }
+    }
+    tot_variable_factor = warp_sum_from(tot_variable_factor, seq_lanes);
+    if (arc_lane == 0 && s < num_sequences)
+      this_beta[h * num_sequences + s] =
+          tot_variable_factor / inv_arbitrary_scale;
+  }
+}
+
+
 void cuda_chain_hmm_forward(dim3 Gr, dim3 Bl,
                             const Int32Pair *backward_transitions,
                             const DenominatorGraphTransition *transitions,
@@ -289,6 +412,243 @@ void cuda_chain_hmm_backward(dim3 Gr, dim3 Bl,
 }
 
 
+void cuda_chain_hmm_forward_warp(dim3 Gr, dim3 Bl,
+                                 const Int32Pair *backward_transitions,
+                                 const DenominatorGraphTransition *transitions,
+                                 int32_cuda num_sequences,
+                                 int32_cuda num_hmm_states,
+                                 const BaseFloat *probs, int32_cuda prob_stride,
+                                 const BaseFloat *prev_alpha,
+                                 BaseFloat *this_alpha,
+                                 int32_cuda seq_lanes) {
+  _cuda_chain_hmm_forward_warp<<<Gr,Bl>>>(backward_transitions, transitions,
+                                          num_sequences, num_hmm_states,
+                                          probs, prob_stride,
+                                          prev_alpha, this_alpha, seq_lanes);
+}
+
+void cuda_chain_hmm_backward_warp(dim3 Gr, dim3 Bl,
+                                  const Int32Pair *forward_transitions,
+                                  const DenominatorGraphTransition *transitions,
+                                  int32_cuda num_sequences,
+                                  int32_cuda num_hmm_states,
+                                  const BaseFloat *probs, int32_cuda prob_stride,
+                                  const BaseFloat *this_alpha,
+                                  const BaseFloat *next_beta,
+                                  BaseFloat *this_beta,
+                                  BaseFloat *log_prob_deriv,
+                                  int32_cuda log_prob_deriv_stride,
+                                  int32_cuda seq_lanes) {
+  _cuda_chain_hmm_backward_warp<<<Gr,Bl>>>(forward_transitions, transitions,
+                                           num_sequences, num_hmm_states,
+                                           probs, prob_stride,
+                                           this_alpha, next_beta,
+                                           this_beta, log_prob_deriv,
+                                           log_prob_deriv_stride, seq_lanes);
+}
+
+
+// Returns log(exp(x) + exp(y)), as LogAdd() in base/kaldi-math.h.
+__device__ inline BaseFloat log_add(BaseFloat x, BaseFloat y) {
+  if (x < y) {
+    BaseFloat tmp = x;
+    x = y;
+    y = tmp;
+  }
+  // now x >= y.
+  if (y == -CUDART_INF_F)  // also covers the case where both are -inf.
+    return x;
+  return x + log1p(exp(y - x));
+}
+
+// Returns log(sum_i exp(values[i])) for 0 <= i < dim; it must be called by
+// all threads of the block, and every thread gets the result.  blockDim.x
+// must be a power of two no greater than CU1DBLOCK.
+__device__ static BaseFloat block_log_sum_exp(const BaseFloat *values,
+                                              int32_cuda dim) {
+  __shared__ BaseFloat temp[CU1DBLOCK];
+  int32_cuda tid = threadIdx.x;
+  BaseFloat max_value = -CUDART_INF_F;
+  for (int32_cuda i = tid; i < dim; i += blockDim.x)
+    max_value = fmax(max_value, values[i]);
+  temp[tid] = max_value;
+  __syncthreads();
+  for (int32_cuda shift = blockDim.x / 2; shift > 0; shift >>= 1) {
+    if (tid < shift)
+      temp[tid] = fmax(temp[tid], temp[tid + shift]);
+    __syncthreads();
+  }
+  max_value = temp[0];
+  __syncthreads();
+  if (max_value == -CUDART_INF_F)
+    return max_value;
+  BaseFloat sum = 0.0;
+  for (int32_cuda i = tid; i < dim; i += blockDim.x)
+    sum += exp(values[i] - max_value);
+  temp[tid] = sum;
+  __syncthreads();
+  for (int32_cuda shift = blockDim.x / 2; shift > 0; shift >>= 1) {
+    if (tid < shift)
+      temp[tid] += temp[tid + shift];
+    __syncthreads();
+  }
+  sum = temp[0];
+  __syncthreads();
+  return max_value + log(sum);
+}
+
+// The forward pass of GenericNumeratorComputation (the e2e numerator), for all
+// frames of all sequences in one launch: the block index is the sequence, and
+// the threads of the block handle the HMM states of that sequence's FST, with
+// a barrier between frames.  It is done in log space, and the arithmetic
+// follows GenericNumeratorComputation::AlphaRemainingFrames() exactly.
+// 'seq_states', indexed by sequence, is the (offset, num-states) of its states
+// in the concatenated state space of size 'total_states'; 'in_transitions' is
+// indexed by that state space, and the hmm_state and pdf_id in 'transitions'
+// are the local state index and the column of 'probs'.  Row t of 'probs' has
+// the log-likelihoods for frame t.  'alpha' has num_frames + 1 rows and
+// total_states + num_sequences columns; the last num_sequences columns store
+// the log of the per-frame normalizer of each sequence.  On exit,
+// alpha(num_frames, total_states + s) is the total log-prob of sequence s in
+// the normalized space (as used in the backward pass), and tot_loglike[s] is
+// its total log-likelihood without the offset.
+__global__
+static void _cuda_chain_generic_numerator_forward(
+    const Int32Pair *seq_states, const Int32Pair *in_transitions,
+    const DenominatorGraphTransition *transitions,
+    const BaseFloat *final_probs, int32_cuda num_frames,
+    int32_cuda total_states, const BaseFloat *probs, int32_cuda prob_stride,
+    BaseFloat *alpha, int32_cuda alpha_stride, BaseFloat *tot_loglike) {
+  int32_cuda seq = blockIdx.x, tid = threadIdx.x,
+      state_offset = seq_states[seq].first,
+      num_states = seq_states[seq].second,
+      sum_index = total_states + seq;
+  for (int32_cuda h = tid; h < num_states; h += blockDim.x)
+    alpha[state_offset + h] = (h == 0 ? 0.0 : -CUDART_INF_F);
+  if (tid == 0)
+    alpha[sum_index] = 0.0;
+  __syncthreads();
+
+  double log_scale_product = 0.0;
+  for (int32_cuda t = 1; t <= num_frames; t++) {
+    const BaseFloat *prev_alpha = alpha + (t - 1) * alpha_stride,
+        *this_probs = probs + (t - 1) * prob_stride;
+    BaseFloat *this_alpha = alpha + t * alpha_stride;
+    BaseFloat prev_sum = prev_alpha[sum_index];
+    for (int32_cuda h = tid; h < num_states; h += blockDim.x) {
+      BaseFloat tot = -CUDART_INF_F;
+      for (int32_cuda k = in_transitions[state_offset + h].first;
+           k < in_transitions[state_offset + h].second; k++) {
+        const DenominatorGraphTransition &tr = transitions[k];
+        tot = log_add(tot, prev_alpha[state_offset + tr.hmm_state] +
+                      tr.transition_prob + this_probs[tr.pdf_id]);
+      }
+      this_alpha[state_offset + h] = tot - prev_sum;
+    }
+    __syncthreads();
+    BaseFloat this_sum = block_log_sum_exp(this_alpha + state_offset,
+                                           num_states);
+    if (tid == 0)
+      this_alpha[sum_index] = this_sum;
+    log_scale_product += this_sum;
+    __syncthreads();
+  }
+
+  // The total prob, including the final-probs.  As in the CPU code, the
+  // normalizer of the last frame is not part of the scale product.
+  BaseFloat *last_alpha = alpha + num_frames * alpha_stride;
+  log_scale_product -= last_alpha[sum_index];
+  for (int32_cuda h = tid; h < num_states; h += blockDim.x)
+    last_alpha[state_offset + h] += final_probs[state_offset + h];
+  __syncthreads();
+  BaseFloat tot_prob = block_log_sum_exp(last_alpha + state_offset,
+                                         num_states);
+  if (tid == 0) {
+    last_alpha[sum_index] = tot_prob;
+    tot_loglike[seq] = tot_prob + log_scale_product;
+  }
+}
+
+// The backward pass of GenericNumeratorComputation, to be called after
+// _cuda_chain_generic_numerator_forward with the same arguments; it follows
+// GenericNumeratorComputation::BetaRemainingFrames(), except that the
+// occupation probabilities are added to 'derivs' (num_frames by num-columns of
+// 'probs') as probabilities, not in log space.  'beta' has 2 rows of dimension
+// total_states.
+__global__
+static void _cuda_chain_generic_numerator_backward(
+    const Int32Pair *seq_states, const Int32Pair *out_transitions,
+    const DenominatorGraphTransition *transitions,
+    const BaseFloat *final_probs, int32_cuda num_frames,
+    int32_cuda total_states, const BaseFloat *probs, int32_cuda prob_stride,
+    const BaseFloat *alpha, int32_cuda alpha_stride,
+    BaseFloat *beta, int32_cuda beta_stride,
+    BaseFloat *derivs, int32_cuda deriv_stride) {
+  int32_cuda seq = blockIdx.x, tid = threadIdx.x,
+      state_offset = seq_states[seq].first,
+      num_states = seq_states[seq].second,
+      sum_index = total_states + seq;
+  BaseFloat tot_prob = alpha[num_frames * alpha_stride + sum_index];
+  BaseFloat *last_beta = beta + (num_frames % 2) * beta_stride;
+  for (int32_cuda h = tid; h < num_states; h += blockDim.x)
+    last_beta[state_offset + h] = -tot_prob + final_probs[state_offset + h];
+  __syncthreads();
+
+  for (int32_cuda t = num_frames - 1; t >= 0; t--) {
+    const BaseFloat *this_alpha = alpha + t * alpha_stride,
+        *next_beta = beta + ((t + 1) % 2) * beta_stride,
+        *this_probs = probs + t * prob_stride;
+    BaseFloat *this_beta = beta + (t % 2) * beta_stride,
+        *this_derivs = derivs + t * deriv_stride;
+    BaseFloat inv_arbitrary_scale = this_alpha[sum_index];
+    for (int32_cuda h = tid; h < num_states; h += blockDim.x) {
+      BaseFloat tot_variable_factor = -CUDART_INF_F,
+          this_alpha_prob = this_alpha[state_offset + h];
+      for (int32_cuda k = out_transitions[state_offset + h].first;
+           k < out_transitions[state_offset + h].second; k++) {
+        const DenominatorGraphTransition &tr = transitions[k];
+        BaseFloat variable_factor = tr.transition_prob +
+            next_beta[state_offset + tr.hmm_state] + this_probs[tr.pdf_id] -
+            inv_arbitrary_scale;
+        tot_variable_factor = log_add(tot_variable_factor, variable_factor);
+        BaseFloat occupation_prob = exp(variable_factor + this_alpha_prob);
+        if (occupation_prob > 0.0)
+          atomic_add(this_derivs + tr.pdf_id, occupation_prob);
+      }
+      this_beta[state_offset + h] = tot_variable_factor;
+    }
+    __syncthreads();
+  }
+}
+
+void cuda_chain_generic_numerator_forward(
+    dim3 Gr, dim3 Bl, const Int32Pair *seq_states,
+    const Int32Pair *in_transitions,
+    const DenominatorGraphTransition *transitions,
+    const BaseFloat *final_probs, int32_cuda num_frames,
+    int32_cuda total_states, const BaseFloat *probs, int32_cuda prob_stride,
+    BaseFloat *alpha, int32_cuda alpha_stride, BaseFloat *tot_loglike) {
+  _cuda_chain_generic_numerator_forward<<<Gr,Bl>>>(
+      seq_states, in_transitions, transitions, final_probs, num_frames,
+      total_states, probs, prob_stride, alpha, alpha_stride, tot_loglike);
+}
+
+void cuda_chain_generic_numerator_backward(
+    dim3 Gr, dim3 Bl, const Int32Pair *seq_states,
+    const Int32Pair *out_transitions,
+    const DenominatorGraphTransition *transitions,
+    const BaseFloat *final_probs, int32_cuda num_frames,
+    int32_cuda total_states, const BaseFloat *probs, int32_cuda prob_stride,
+    const BaseFloat *alpha, int32_cuda alpha_stride,
+    BaseFloat *beta, int32_cuda beta_stride,
+    BaseFloat *derivs, int32_cuda deriv_stride) {
+  _cuda_chain_generic_numerator_backward<<<Gr,Bl>>>(
+      seq_states, out_transitions, transitions, final_probs, num_frames,
+      total_states, probs, prob_stride, alpha, alpha_stride,
+      beta, beta_stride, derivs, deriv_stride);
+}
+
+
 // See documentation for PenalizeOutOfRange() in chain-training.cc to see what
 // this is about.
 __global__
@@ -19,6 +19,7 @@
 
 #include "chain/chain-supervision.h"
 #include "chain/chain-numerator.h"
+#include "chain/chain-generic-numerator.h"
 #include "fstext/fstext-lib.h"
 #include "cudamatrix/cu-device.h"
 #include "cudamatrix/cu-vector.h"
@@ -175,6 +176,18 @@ void TestSupervisionAppend(const TransitionModel &trans_model,
   KALDI_ASSERT(tot_sequences_out == tot_sequences_in &&
                tot_frames_out == tot_frames_in);
 
+  // Check that the FST is the same as what the generic concatenation and
+  // epsilon removal would give.
+  fst::StdVectorFst ref_fst(input[num_append - 1]->fst);
+  for (int32 i = num_append - 2; i >= 0; i--)
+    fst::Concat(input[i]->fst, &ref_fst);
+  fst::RmEpsilon(&ref_fst);
+  SortBreadthFirstSearch(&ref_fst);
+  KALDI_ASSERT(ref_fst.NumStates() == output.fst.NumStates());
+  for (int32 s = 0; s < ref_fst.NumStates(); s++)
+    KALDI_ASSERT(ref_fst.NumArcs(s) == output.fst.NumArcs(s) &&
+                 fst::ApproxEqual(ref_fst.Final(s), output.fst.Final(s)));
+
   TestSupervisionIo(output);
   TestSupervisionNumerator(output);
   output.Check(trans_model);
@@ -332,6 +345,42 @@ void ChainTrainingTest(const DenominatorGraph &den_graph,
   }
 }
 
+// Checks that GenericNumeratorComputation, given the numerator FST of
+// 'supervision' (which must have one sequence) as an 'e2e' FST, gives the same
+// log-prob and derivatives as NumeratorComputation.  When a GPU is in use this
+// tests the GPU version of GenericNumeratorComputation.
+void ChainGenericNumeratorTest(const Supervision &supervision) {
+  KALDI_ASSERT(supervision.num_sequences == 1);
+  Supervision num_supervision(supervision);
+  num_supervision.weight = 1.0;
+  Supervision e2e_supervision(num_supervision);
+  e2e_supervision.e2e_fsts.resize(1, supervision.fst);
+  e2e_supervision.fst.DeleteStates();
+
+  CuMatrix<BaseFloat> nnet_output(supervision.frames_per_sequence,
+                                  supervision.label_dim);
+  nnet_output.SetRandn();
+
+  NumeratorComputation numerator(num_supervision, nnet_output);
+  BaseFloat num_logprob = numerator.Forward();
+  CuMatrix<BaseFloat> num_deriv(nnet_output.NumRows(), nnet_output.NumCols());
+  numerator.Backward(&num_deriv);
+
+  GenericNumeratorComputation generic_numerator(e2e_supervision, nnet_output);
+  BaseFloat generic_logprob;
+  CuMatrix<BaseFloat> generic_deriv(nnet_output.NumRows(),
+                                    nnet_output.NumCols());
+  bool ok = generic_numerator.ForwardBackward(&generic_logprob,
+                                              &generic_deriv);
+  KALDI_LOG << "Numerator log-prob is " << num_logprob
+            << ", generic numerator log-prob is " << generic_logprob;
+  KALDI_ASSERT(ok);
+  KALDI_ASSERT(std::abs(num_logprob - generic_logprob) <
+               0.001 * (1.0 + std::abs(num_logprob)));
+  KALDI_ASSERT(generic_deriv.ApproxEqual(num_deriv, 0.01));
+  KALDI_ASSERT(ApproxEqual(generic_numerator.ComputeObjf(), generic_logprob));
+}
+
 void TestSupervisionSplitting(const ContextDependency &ctx_dep,
                               const TransitionModel &trans_model,
                               const Supervision &supervision) {
@@ -412,6 +461,23 @@ void ChainDenominatorTest(const DenominatorGraph &den_graph) {
                  10.0);
   }
 
+  { // check that the warp-per-HMM-state kernels give the same answer (on
+    // CPU this just checks the option is harmless).  The derivatives are
+    // randomly pruned on GPU, so we only compare their sums.
+    ChainTrainingOptions warp_opts(opts);
+    warp_opts.den_warp_kernels = true;
+    DenominatorComputation warp_computation(warp_opts, den_graph,
+                                            num_sequences, nnet_output);
+    BaseFloat warp_forward_prob = warp_computation.Forward();
+    CuMatrix<BaseFloat> warp_deriv(nnet_output.NumRows(),
+                                   nnet_output.NumCols());
+    warp_computation.Backward(1.0, &warp_deriv);
+    KALDI_LOG << "Forward prob with warp kernels is " << warp_forward_prob;
+    KALDI_ASSERT(ApproxEqual(forward_prob, warp_forward_prob, 0.001));
+    KALDI_ASSERT(std::abs(warp_deriv.Sum() - nnet_output_deriv.Sum()) <
+                 0.01 * num_sequences * frames_per_sequence + 1.0);
+  }
+
   int32 num_tries = 5;
   BaseFloat epsilon = 1.0e-04;
   Vector<BaseFloat> predicted_objf_changes(num_tries),
@@ -519,6 +585,7 @@ void ChainSupervisionTest() {
     KALDI_ASSERT(ans);
     // TODO: still have to test for appended sequences.
     ChainTrainingTest(den_graph, supervision);
+    ChainGenericNumeratorTest(supervision);
   }
 
   // Test IO for supervisions which have transition id's as labels
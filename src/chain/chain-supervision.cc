@@ -737,6 +737,74 @@ void MergeSupervisionE2e(const std::vector<const Supervision*> &input,
   // and there is no need to support merging of 'alignment_pdfs'
 }
 
+// This static function is called by MergeSupervision.  It sets 'out' to the
+// concatenation of the FSTs in 'input', in order, without the epsilons that
+// fst::Concat() would introduce: the arcs leaving the start state of each FST
+// are copied to the final states of the FST before it.  It takes time linear
+// in the total size of the FSTs, whereas repeated calls to fst::Concat() take
+// time quadratic in the number of FSTs, and the general-purpose RmEpsilon()
+// that would be needed afterwards is much slower still.  The result is
+// equivalent to what fst::Concat() followed by RmEpsilon() gives; it has not
+// yet been sorted by SortBreadthFirstSearch().
+static void ConcatSupervisionFsts(const std::vector<const Supervision*> &input,
+                                  fst::StdVectorFst *out) {
+  typedef fst::StdArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Weight Weight;
+  int32 num_inputs = input.size(), tot_states = 0;
+  for (int32 i = 0; i < num_inputs; i++)
+    tot_states += input[i]->fst.NumStates();
+  out->DeleteStates();
+  out->ReserveStates(tot_states);
+  // The final states (numbered as in 'out') of the previous FST, with their
+  // final-probs.
+  std::vector<std::pair<StateId, Weight> > prev_final_states;
+  for (int32 i = 0; i < num_inputs; i++) {
+    const fst::StdVectorFst &fst = input[i]->fst;
+    // Supervision FSTs are epsilon-free with at least one frame, so the start
+    // state is state 0 and cannot be final.
+    KALDI_ASSERT(fst.Start() == 0 && fst.Final(0) == Weight::Zero());
+    StateId num_states = fst.NumStates(),
+        offset = out->NumStates();
+    for (StateId s = 0; s < num_states; s++) {
+      StateId out_s = out->AddState();
+      out->ReserveArcs(out_s, fst.NumArcs(s));
+      for (fst::ArcIterator<fst::StdVectorFst> aiter(fst, s); !aiter.Done();
+           aiter.Next()) {
+        Arc arc = aiter.Value();
+        arc.nextstate += offset;
+        out->AddArc(out_s, arc);
+      }
+    }
+    if (i == 0)
+      out->SetStart(0);
+    for (size_t j = 0; j < prev_final_states.size(); j++) {
+      StateId out_s = prev_final_states[j].first;
+      Weight final_weight = prev_final_states[j].second;
+      for (fst::ArcIterator<fst::StdVectorFst> aiter(fst, 0); !aiter.Done();
+           aiter.Next()) {
+        Arc arc = aiter.Value();
+        arc.weight = fst::Times(final_weight, arc.weight);
+        arc.nextstate += offset;
+        out->AddArc(out_s, arc);
+      }
+    }
+    prev_final_states.clear();
+    for (StateId s = 0; s < num_states; s++) {
+      Weight final_weight = fst.Final(s);
+      if (final_weight == Weight::Zero())
+        continue;
+      if (i + 1 == num_inputs)
+        out->SetFinal(s + offset, final_weight);
+      else
+        prev_final_states.push_back(std::pair<StateId, Weight>(s + offset,
+                                                               final_weight));
+    }
+  }
+  // The start states of all but the first FST are now unreachable.
+  fst::Connect(out);
+}
+
 void MergeSupervision(const std::vector<const Supervision*> &input,
                       Supervision *output_supervision) {
   KALDI_ASSERT(!input.empty());
@@ -755,27 +823,21 @@ void MergeSupervision(const std::vector<const Supervision*> &input,
     KALDI_ASSERT(input[i]->label_dim == label_dim &&
                  "Trying to append incompatible Supervision objects");
     KALDI_ASSERT(input[i]->alignment_pdfs.empty());
-  }
-  *output_supervision = *(input[num_inputs-1]);
-  for (int32 i = num_inputs - 2; i >= 0; i--) {
-    const Supervision &src = *(input[i]);
-    if (output_supervision->weight == src.weight &&
-        output_supervision->frames_per_sequence ==
-        src.frames_per_sequence) {
-      // Combine with current output
-      // append src.fst to output_supervision->fst.
-      // the complexity here is O(V1 + E1)
-      fst::Concat(src.fst, &output_supervision->fst);
-      output_supervision->num_sequences++;
-    } else {
+    if (input[i]->weight != input[0]->weight ||
+        input[i]->frames_per_sequence != input[0]->frames_per_sequence)
       KALDI_ERR << "Mismatch weight or frames_per_sequence  between inputs";
-    }
-
   }
-  fst::StdVectorFst &out_fst = output_supervision->fst;
-  // The process of concatenation will have introduced epsilons.
-  fst::RmEpsilon(&out_fst);
-  SortBreadthFirstSearch(&out_fst);
+  output_supervision->weight = input[0]->weight;
+  output_supervision->frames_per_sequence = input[0]->frames_per_sequence;
+  output_supervision->label_dim = label_dim;
+  output_supervision->e2e_fsts.clear();
+  output_supervision->alignment_pdfs.clear();
+  int32 num_sequences = 0;
+  for (int32 i = 0; i < num_inputs; i++)
+    num_sequences += input[i]->num_sequences;
+  output_supervision->num_sequences = num_sequences;
+  ConcatSupervisionFsts(input, &(output_supervision->fst));
+  SortBreadthFirstSearch(&(output_supervision->fst));
 }
 
 // This static function is called by AddWeightToSupervisionFst if the supervision
@@ -70,9 +70,16 @@ struct ChainTrainingOptions {
   // should have a softmax as its final nonlinearity.
   BaseFloat xent_regularize;
 
+  // If true, the denominator forward-backward on GPU uses kernels that assign
+  // one warp to each HMM state, splitting its lanes between sequences and
+  // transitions (see cuda_chain_hmm_forward_warp()), instead of one thread per
+  // (HMM state, sequence).  This may be faster for small minibatches or graphs
+  // with high fan-in; it makes no difference on CPU.
+  bool den_warp_kernels;
+
   ChainTrainingOptions(): l2_regularize(0.0), out_of_range_regularize(0.01),
                           leaky_hmm_coefficient(1.0e-05),
-                          xent_regularize(0.0) { }
+                          xent_regularize(0.0), den_warp_kernels(false) { }
 
   void Register(OptionsItf *opts) {
     opts->Register("l2-regularize", &l2_regularize, "l2 regularization "
@@ -93,6 +100,10 @@ struct ChainTrainingOptions {
                    "nonzero, the network is expected to have an output "
                    "named 'output-xent', which should have a softmax as "
                    "its final nonlinearity.");
+    opts->Register("den-warp-kernels", &den_warp_kernels, "If true, use the "
+                   "warp-per-HMM-state CUDA kernels for the denominator "
+                   "forward-backward (may be faster for small minibatches); "
+                   "see chain-den-benchmark.");
   }
 };
 
@@ -0,0 +1,125 @@
+// chainbin/chain-den-benchmark.cc
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/common-utils.h"
+#include "chain/chain-denominator.h"
+#include "cudamatrix/cu-device.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::chain;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Times the denominator forward-backward computation of 'chain' training\n"
+        "on random neural-net output, with the default CUDA kernels and with\n"
+        "the warp-per-HMM-state kernels (see --den-warp-kernels in\n"
+        "nnet3-chain-train), and checks that they give the same objective.\n"
+        "This is for choosing the kernels for a given denominator graph and\n"
+        "minibatch shape.\n"
+        "\n"
+        "Usage:  chain-den-benchmark [options] <den-fst>\n"
+        "e.g.:\n"
+        " chain-den-benchmark --num-sequences=32 --frames-per-sequence=50 "
+        "den.fst\n";
+
+    std::string use_gpu = "yes";
+    int32 num_sequences = 128,
+        frames_per_sequence = 50,
+        num_iters = 10;
+    ChainTrainingOptions chain_opts;
+
+    ParseOptions po(usage);
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("num-sequences", &num_sequences, "Number of sequences in "
+                "the simulated minibatch.");
+    po.Register("frames-per-sequence", &frames_per_sequence, "Number of "
+                "output frames per sequence.");
+    po.Register("num-iters", &num_iters, "Number of times to run each "
+                "computation.");
+    chain_opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 1) {
+      po.PrintUsage();
+      exit(1);
+    }
+    KALDI_ASSERT(num_sequences > 0 && frames_per_sequence > 0 &&
+                 num_iters > 0);
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
+    fst::StdVectorFst den_fst;
+    ReadFstKaldi(po.GetArg(1), &den_fst);
+    // The pdf-ids are the ilabels minus one.
+    int32 num_pdfs = 0;
+    for (int32 s = 0; s < den_fst.NumStates(); s++)
+      for (fst::ArcIterator<fst::StdVectorFst> aiter(den_fst, s);
+           !aiter.Done(); aiter.Next())
+        num_pdfs = std::max<int32>(num_pdfs, aiter.Value().ilabel);
+    DenominatorGraph den_graph(den_fst, num_pdfs);
+
+    CuMatrix<BaseFloat> nnet_output(num_sequences * frames_per_sequence,
+                                    num_pdfs),
+        nnet_output_deriv(num_sequences * frames_per_sequence, num_pdfs);
+    nnet_output.SetRandn();
+
+    BaseFloat objf[2], seconds[2];
+    for (int32 i = 0; i < 2; i++) {
+      ChainTrainingOptions opts(chain_opts);
+      opts.den_warp_kernels = (i == 1);
+      Timer timer;
+      for (int32 iter = 0; iter < num_iters; iter++) {
+        DenominatorComputation computation(opts, den_graph, num_sequences,
+                                           nnet_output);
+        objf[i] = computation.Forward();
+        nnet_output_deriv.SetZero();
+        computation.Backward(1.0, &nnet_output_deriv);
+      }
+      SynchronizeGpu();
+      seconds[i] = timer.Elapsed() / num_iters;
+      KALDI_LOG << (i == 0 ? "Default" : "Warp-per-state")
+                << " kernels: objf per frame is "
+                << (objf[i] / (num_sequences * frames_per_sequence))
+                << ", time per forward-backward is " << seconds[i]
+                << " seconds.";
+    }
+    KALDI_LOG << "Den graph has " << den_graph.NumStates() << " states and "
+              << num_pdfs << " pdfs; speedup of warp-per-state kernels is "
+              << (seconds[0] / seconds[1]);
+    if (!ApproxEqual(objf[0], objf[1], 0.001))
+      KALDI_WARN << "Objective functions differ: " << objf[0] << " vs. "
+                 << objf[1];
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -50,10 +50,13 @@ double ComputeObjf(bool batchnorm_test_mode, bool dropout_test_mode,
                        chain_config, den_fst, &prob_computer_test);
   } else {
     prob_computer->Reset();
-    std::vector<NnetChainExample>::const_iterator iter = egs.begin(),
-                                                   end = egs.end();
-    for (; iter != end; ++iter)
-      prob_computer->Compute(*iter);
+    // The inputs of each minibatch are copied to the GPU while the previous
+    // one is being computed.
+    for (size_t i = 0; i < egs.size(); i++) {
+      if (i + 1 < egs.size())
+        prob_computer->Prefetch(egs[i + 1]);
+      prob_computer->Compute(egs[i]);
+    }
 
     double tot_weight = 0.0;
     double tot_objf = prob_computer->GetTotalObjective(&tot_weight);
@@ -68,12 +71,15 @@ double ComputeObjf(bool batchnorm_test_mode, bool dropout_test_mode,
 }
 
 // Updates moving average over num_models nnets, given the average over
-// previous (num_models - 1) nnets, and the new nnet.
+// previous (num_models - 1) nnets, and the new nnet.  The new nnet is read
+// one component at a time, so that we don't need another copy of it in memory.
 void UpdateNnetMovingAverage(int32 num_models,
-    const Nnet &nnet, Nnet *moving_average_nnet) {
-  KALDI_ASSERT(NumParameters(nnet) == NumParameters(*moving_average_nnet));
+    const std::string &nnet_rxfilename, Nnet *moving_average_nnet) {
   ScaleNnet((num_models - 1.0) / num_models, moving_average_nnet);
-  AddNnet(nnet, 1.0 / num_models, moving_average_nnet);
+  bool binary_in;
+  Input ki(nnet_rxfilename, &binary_in);
+  AddNnetFromStream(ki.Stream(), binary_in, 1.0 / num_models,
+                    moving_average_nnet);
 }
 
 }
@@ -146,9 +152,9 @@ int main(int argc, char *argv[]) {
     fst::StdVectorFst den_fst;
     ReadFstKaldi(den_fst_rxfilename, &den_fst);
 
-    Nnet nnet;
-    ReadKaldiObject(raw_nnet_rxfilename, &nnet);
-    Nnet moving_average_nnet(nnet), best_nnet(nnet);
+    Nnet moving_average_nnet;
+    ReadKaldiObject(raw_nnet_rxfilename, &moving_average_nnet);
+    Nnet best_nnet(moving_average_nnet);
     NnetComputeProbOptions compute_prob_opts;
     NnetChainComputeProb prob_computer(compute_prob_opts, chain_config,
         den_fst, moving_average_nnet);
@@ -180,10 +186,8 @@ int main(int argc, char *argv[]) {
     int32 num_to_add = (num_nnets + max_objective_evaluations - 1) /
                        max_objective_evaluations;
     for (int32 n = 1; n < num_nnets; n++) {
-      std::string this_nnet_rxfilename = po.GetArg(n + 2);
-      ReadKaldiObject(this_nnet_rxfilename, &nnet);
       // updates the moving average
-      UpdateNnetMovingAverage(n + 1, nnet, &moving_average_nnet);
+      UpdateNnetMovingAverage(n + 1, po.GetArg(n + 2), &moving_average_nnet);
       // evaluates the objective everytime after adding num_to_add model or
       // all the models to the moving average.
       if ((n - 1) % num_to_add == num_to_add - 1 || n == num_nnets - 1) {
@@ -202,7 +206,7 @@ int main(int argc, char *argv[]) {
               << " nnets, objective function changed from " << init_objf
               << " to " << best_objf;
 
-    if (HasBatchnorm(nnet))
+    if (HasBatchnorm(best_nnet))
       RecomputeStats(egs, chain_config, den_fst, &best_nnet);
 
 #if HAVE_CUDA==1
@@ -110,7 +110,8 @@ int main(int argc, char *argv[]) {
     RandomAccessBaseFloatVectorReaderMapped ivector_reader(
         ivector_rspecifier, utt2spk_rspecifier);
 
-    CachingOptimizingCompiler compiler(nnet, opts.optimize_config);
+    CachingOptimizingCompiler compiler(nnet, opts.optimize_config,
+                                       opts.compiler_config);
 
     chain::ChainTrainingOptions chain_opts;
     // the only option that actually gets used here is
@@ -35,15 +35,18 @@ int main(int argc, char *argv[]) {
         "the given data with an nnet3+chain neural net.  The input of this is the output of\n"
         "e.g. nnet3-chain-get-egs | nnet3-chain-merge-egs.\n"
         "\n"
+        "With --use-gpu=yes, the input features of each minibatch are copied to\n"
+        "the GPU while the previous one is being computed; reading the examples\n"
+        "with the 'bg' option (e.g. ark,bg:valid.cegs) overlaps the reading too.\n"
+        "\n"
         "Usage:  nnet3-chain-compute-prob [options] <raw-nnet3-model-in> <denominator-fst> <training-examples-in>\n"
         "e.g.: nnet3-chain-compute-prob 0.mdl den.fst ark:valid.egs\n";
 
     bool batchnorm_test_mode = true, dropout_test_mode = true;
-
-    // This program doesn't support using a GPU, because these probabilities are
-    // used for diagnostics, and you can just compute them with a small enough
+    // The GPU is off by default because these probabilities are used for
+    // diagnostics, and you can normally compute them with a small enough
     // amount of data that a CPU can do it within reasonable time.
-    // It wouldn't be hard to make it support GPU, though.
+    std::string use_gpu = "no";
 
     NnetComputeProbOptions nnet_opts;
     chain::ChainTrainingOptions chain_opts;
@@ -55,6 +58,8 @@ int main(int argc, char *argv[]) {
     po.Register("dropout-test-mode", &dropout_test_mode,
                 "If true, set test-mode to true on any DropoutComponents and "
                 "DropoutMaskComponents.");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
 
     nnet_opts.Register(&po);
     chain_opts.Register(&po);
@@ -66,6 +71,10 @@ int main(int argc, char *argv[]) {
       exit(1);
     }
 
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
     std::string nnet_rxfilename = po.GetArg(1),
         den_fst_rxfilename = po.GetArg(2),
         examples_rspecifier = po.GetArg(3);
@@ -87,11 +96,33 @@ int main(int argc, char *argv[]) {
 
     SequentialNnetChainExampleReader example_reader(examples_rspecifier);
 
-    for (; !example_reader.Done(); example_reader.Next())
-      chain_prob_computer.Compute(example_reader.Value());
+    // We keep two minibatches, so that the inputs of the next one can be
+    // copied to the GPU while we compute the current one.
+    NnetChainExample egs[2];
+    int32 cur = 0;
+    if (!example_reader.Done()) {
+      egs[cur].Swap(&(example_reader.Value()));
+      example_reader.Next();
+      while (true) {
+        bool have_next = !example_reader.Done();
+        if (have_next) {
+          egs[1 - cur].Swap(&(example_reader.Value()));
+          example_reader.Next();
+          chain_prob_computer.Prefetch(egs[1 - cur]);
+        }
+        chain_prob_computer.Compute(egs[cur]);
+        if (!have_next)
+          break;
+        cur = 1 - cur;
+      }
+    }
 
     bool ok = chain_prob_computer.PrintTotalStats();
 
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
+
     return (ok ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what() << '\n';
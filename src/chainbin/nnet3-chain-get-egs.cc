@@ -26,81 +26,53 @@
 #include "nnet3/nnet-example.h"
 #include "nnet3/nnet-chain-example.h"
 #include "nnet3/nnet-example-utils.h"
+#include "util/kaldi-thread.h"
 
 namespace kaldi {
 namespace nnet3 {
 
 
 /**
-   This function does all the processing for one utterance, and outputs the
-   supervision objects to 'example_writer'.
+   This function does the part of the processing for one utterance that has to
+   be done sequentially: it checks the lengths and decides how to split the
+   utterance into chunks.  It returns false if the utterance is to be skipped.
 
-     @param [in]  trans_mdl           The transition-model for the tree for which we
-                                      are dumping egs.  This is expected to be
-                                      NULL if the input examples already contain
-                                      pdfs-ids+1 in their FSTs, and non-NULL if the
-                                      input examples contain transition-ids in
-                                      their FSTs and need to be converted to
-                                      unconstrained 'e2e' (end-to-end) style FSTs
-                                      which contain pdf-ids+1 but which won't enforce any
-                                      alignment constraints interior to the
-                                      utterance.
-     @param [in]  normalization_fst   A version of denominator FST used to add weights
-                                      to the created supervision. It is
-                                      actually an FST expected to have the
-                                      labels as (pdf-id+1).  If this has no states,
-                                      we skip the final stage of egs preparation
-                                      in which we compose with the normalization
-                                      FST, and you should do it later with
-                                      nnet3-chain-normalize-egs.
-     @param [in]  feats               Input feature matrix
-     @param [in]  ivector_feats       Online iVector matrix sub-sampled at a
-                                      rate of "ivector_period".
-                                      If NULL, iVector will not be added
-                                      as in input to the egs.
-     @param [in]  ivector_period      Number of frames between iVectors in
-                                      "ivector_feats" matrix.
+     @param [in]  num_input_frames    Number of frames of the input features
      @param [in]  supervision         Supervision for 'chain' training created
                                       from the binary chain-get-supervision.
                                       This is expected to be at a
                                       sub-sampled rate if
                                       --frame-subsampling-factor > 1.
      @param [in]  deriv_weights       Vector of per-frame weights that scale
-                                      a frame's gradient during backpropagation.
-                                      If NULL, this is equivalent to specifying
-                                      a vector of all 1s.
-                                      The dimension of the vector is expected
-                                      to be the supervision size, which is
-                                      at a sub-sampled rate if
-                                      --frame-subsampling-factor > 1.
+                                      a frame's gradient during backpropagation,
+                                      or NULL.  The dimension of the vector is
+                                      expected to be the supervision size.
      @param [in]  supervision_length_tolerance
                                       Tolerance for difference in num-frames-subsampled between
                                       supervision and deriv weights, and also between supervision
                                       and input frames.
      @param [in]  utt_id              Utterance-id
-     @param [in]  compress            If true, compresses the feature matrices.
+     @param [in]  have_ivectors       True if iVectors are to be added to the
+                                      egs.
      @param [out]  utt_splitter       Pointer to UtteranceSplitter object,
                                       which helps to split an utterance into
                                       chunks. This also stores some stats.
-     @param [out]  example_writer     Pointer to egs writer.
-
+     @param [out]  chunks             The chunks to create egs for.
+     @param [out]  ivector_frames     If have_ivectors, for each chunk the
+                                      (randomly chosen) input frame whose
+                                      iVector is to be used; else empty.
 **/
-
-static bool ProcessFile(const TransitionModel *trans_mdl,
-                        const fst::StdVectorFst &normalization_fst,
-                        const GeneralMatrix &feats,
-                        const MatrixBase<BaseFloat> *ivector_feats,
-                        int32 ivector_period,
-                        const chain::Supervision &supervision,
-                        const VectorBase<BaseFloat> *deriv_weights,
-                        int32 supervision_length_tolerance,
-                        const std::string &utt_id,
-                        bool compress,
-                        UtteranceSplitter *utt_splitter,
-                        NnetChainExampleWriter *example_writer) {
+static bool GetChunks(int32 num_input_frames,
+                      const chain::Supervision &supervision,
+                      const VectorBase<BaseFloat> *deriv_weights,
+                      int32 supervision_length_tolerance,
+                      const std::string &utt_id,
+                      bool have_ivectors,
+                      UtteranceSplitter *utt_splitter,
+                      std::vector<ChunkTimeInfo> *chunks,
+                      std::vector<int32> *ivector_frames) {
   KALDI_ASSERT(supervision.num_sequences == 1);
-  int32 num_input_frames = feats.NumRows(),
-      num_output_frames = supervision.frames_per_sequence;
+  int32 num_output_frames = supervision.frames_per_sequence;
 
   int32 frame_subsampling_factor = utt_splitter->Config().frame_subsampling_factor;
 
@@ -126,21 +98,95 @@ static bool ProcessFile(const TransitionModel *trans_mdl,
   if (num_input_frames > num_output_frames * frame_subsampling_factor)
     num_input_frames = num_output_frames * frame_subsampling_factor;
 
-  std::vector<ChunkTimeInfo> chunks;
+  utt_splitter->GetChunksForUtterance(num_input_frames, chunks);
 
-  utt_splitter->GetChunksForUtterance(num_input_frames, &chunks);
-
-  if (chunks.empty()) {
+  if (chunks->empty()) {
     KALDI_WARN << "Not producing egs for utterance " << utt_id
                << " because it is too short: "
                << num_input_frames << " frames.";
     return false;
   }
 
+  // The iVector frames are chosen here rather than when creating the egs, so
+  // that the random numbers are drawn in the same order regardless of
+  // --num-threads.
+  ivector_frames->clear();
+  if (have_ivectors) {
+    for (size_t c = 0; c < chunks->size(); c++) {
+      // choose iVector from a random frame in the chunk
+      int32 start_frame = (*chunks)[c].first_frame - (*chunks)[c].left_context;
+      ivector_frames->push_back(RandInt(start_frame,
+                                        start_frame + num_input_frames - 1));
+    }
+  }
+  return true;
+}
+
+
+/**
+   This function creates the egs for the chunks of one utterance that were
+   chosen by GetChunks(); it may be called from multiple threads at once.
+
+     @param [in]  trans_mdl           The transition-model for the tree for which we
+                                      are dumping egs.  This is expected to be
+                                      NULL if the input examples already contain
+                                      pdfs-ids+1 in their FSTs, and non-NULL if the
+                                      input examples contain transition-ids in
+                                      their FSTs and need to be converted to
+                                      unconstrained 'e2e' (end-to-end) style FSTs
+                                      which contain pdf-ids+1 but which won't enforce any
+                                      alignment constraints interior to the
+                                      utterance.
+     @param [in]  normalization_fst   A version of denominator FST used to add weights
+                                      to the created supervision. It is
+                                      actually an FST expected to have the
+                                      labels as (pdf-id+1).  If this has no states,
+                                      we skip the final stage of egs preparation
+                                      in which we compose with the normalization
+                                      FST, and you should do it later with
+                                      nnet3-chain-normalize-egs.
+     @param [in]  feats               Input feature matrix
+     @param [in]  ivector_feats       Online iVector matrix sub-sampled at a
+                                      rate of "ivector_period".
+                                      If NULL, iVector will not be added
+                                      as in input to the egs.
+     @param [in]  ivector_period      Number of frames between iVectors in
+                                      "ivector_feats" matrix.
+     @param [in]  supervision         Supervision for 'chain' training, as
+                                      for GetChunks().
+     @param [in]  deriv_weights       Vector of per-frame weights that scale
+                                      a frame's gradient during backpropagation.
+                                      If NULL, this is equivalent to specifying
+                                      a vector of all 1s.
+     @param [in]  utt_id              Utterance-id
+     @param [in]  compress            If true, compresses the feature matrices.
+     @param [in]  frame_subsampling_factor
+                                      The frame subsampling factor.
+     @param [in]  chunks              The chunks, from GetChunks().
+     @param [in]  ivector_frames      The iVector frames, from GetChunks().
+     @param [out]  egs                The egs, with their keys.
+
+**/
+
+static void GetChainExamples(
+    const TransitionModel *trans_mdl,
+    const fst::StdVectorFst &normalization_fst,
+    const GeneralMatrix &feats,
+    const MatrixBase<BaseFloat> *ivector_feats,
+    int32 ivector_period,
+    const chain::Supervision &supervision,
+    const VectorBase<BaseFloat> *deriv_weights,
+    const std::string &utt_id,
+    bool compress,
+    int32 frame_subsampling_factor,
+    const std::vector<ChunkTimeInfo> &chunks,
+    const std::vector<int32> &ivector_frames,
+    std::vector<std::pair<std::string, NnetChainExample> > *egs) {
   chain::SupervisionSplitter sup_splitter(supervision);
 
+  egs->resize(chunks.size());
   for (size_t c = 0; c < chunks.size(); c++) {
-    ChunkTimeInfo &chunk = chunks[c];
+    const ChunkTimeInfo &chunk = chunks[c];
 
     int32 start_frame_subsampled = chunk.first_frame / frame_subsampling_factor,
         num_frames_subsampled = chunk.num_frames / frame_subsampling_factor;
@@ -166,12 +212,13 @@ static bool ProcessFile(const TransitionModel *trans_mdl,
     int32 first_frame = 0;  // we shift the time-indexes of all these parts so
                             // that the supervised part starts from frame 0.
 
-    NnetChainExample nnet_chain_eg;
+    NnetChainExample &nnet_chain_eg = (*egs)[c].second;
     nnet_chain_eg.outputs.resize(1);
 
-    SubVector<BaseFloat> output_weights(
-        &(chunk.output_weights[0]),
-        static_cast<int32>(chunk.output_weights.size()));
+    Vector<BaseFloat> output_weights(
+        static_cast<int32>(chunk.output_weights.size()), kUndefined);
+    std::copy(chunk.output_weights.begin(), chunk.output_weights.end(),
+              output_weights.Data());
 
     if (!deriv_weights) {
       NnetChainSupervision nnet_supervision("output", supervision_part,
@@ -210,10 +257,7 @@ static bool ProcessFile(const TransitionModel *trans_mdl,
 
     if (ivector_feats != NULL) {
       // if applicable, add the iVector feature.
-      // choose iVector from a random frame in the chunk
-      int32 ivector_frame = RandInt(start_frame,
-                                    start_frame + num_input_frames - 1),
-          ivector_frame_subsampled = ivector_frame / ivector_period;
+      int32 ivector_frame_subsampled = ivector_frames[c] / ivector_period;
       if (ivector_frame_subsampled < 0)
         ivector_frame_subsampled = 0;
       if (ivector_frame_subsampled >= ivector_feats->NumRows())
@@ -230,13 +274,80 @@ static bool ProcessFile(const TransitionModel *trans_mdl,
     std::ostringstream os;
     os << utt_id << "-" << chunk.first_frame;
 
-    std::string key = os.str(); // key is <utt_id>-<frame_id>
-
-    example_writer->Write(key, nnet_chain_eg);
+    (*egs)[c].first = os.str(); // key is <utt_id>-<frame_id>
   }
-  return true;
 }
 
+
+/**
+   This class wraps GetChainExamples() for use with class TaskSequencer: it
+   creates the egs for one utterance in operator (), which may run in parallel
+   with other utterances, and writes them in its destructor, which is called
+   in the order the utterances were read.  It keeps copies of its per-utterance
+   inputs, as the table readers will have moved on by the time it runs.
+ */
+class ChainExampleTask {
+ public:
+  ChainExampleTask(const TransitionModel *trans_mdl,
+                   const fst::StdVectorFst &normalization_fst,
+                   const GeneralMatrix &feats,
+                   const Matrix<BaseFloat> *ivector_feats,
+                   int32 ivector_period,
+                   const chain::Supervision &supervision,
+                   const Vector<BaseFloat> *deriv_weights,
+                   const std::string &utt_id,
+                   bool compress,
+                   int32 frame_subsampling_factor,
+                   std::vector<ChunkTimeInfo> *chunks,
+                   std::vector<int32> *ivector_frames,
+                   NnetChainExampleWriter *example_writer):
+      trans_mdl_(trans_mdl), normalization_fst_(normalization_fst),
+      feats_(feats), have_ivectors_(ivector_feats != NULL),
+      ivector_period_(ivector_period), supervision_(supervision),
+      have_deriv_weights_(deriv_weights != NULL), utt_id_(utt_id),
+      compress_(compress), frame_subsampling_factor_(frame_subsampling_factor),
+      example_writer_(example_writer) {
+    if (have_ivectors_)
+      ivector_feats_ = *ivector_feats;
+    if (have_deriv_weights_)
+      deriv_weights_ = *deriv_weights;
+    chunks_.swap(*chunks);
+    ivector_frames_.swap(*ivector_frames);
+  }
+
+  void operator () () {
+    GetChainExamples(trans_mdl_, normalization_fst_, feats_,
+                     (have_ivectors_ ? &ivector_feats_ : NULL),
+                     ivector_period_, supervision_,
+                     (have_deriv_weights_ ? &deriv_weights_ : NULL),
+                     utt_id_, compress_, frame_subsampling_factor_,
+                     chunks_, ivector_frames_, &egs_);
+  }
+
+  ~ChainExampleTask() {
+    for (size_t i = 0; i < egs_.size(); i++)
+      example_writer_->Write(egs_[i].first, egs_[i].second);
+  }
+
+ private:
+  const TransitionModel *trans_mdl_;
+  const fst::StdVectorFst &normalization_fst_;
+  GeneralMatrix feats_;
+  bool have_ivectors_;
+  Matrix<BaseFloat> ivector_feats_;
+  int32 ivector_period_;
+  chain::Supervision supervision_;
+  bool have_deriv_weights_;
+  Vector<BaseFloat> deriv_weights_;
+  std::string utt_id_;
+  bool compress_;
+  int32 frame_subsampling_factor_;
+  std::vector<ChunkTimeInfo> chunks_;
+  std::vector<int32> ivector_frames_;
+  std::vector<std::pair<std::string, NnetChainExample> > egs_;
+  NnetChainExampleWriter *example_writer_;
+};
+
 } // namespace nnet2
 } // namespace kaldi
 
@@ -271,6 +382,9 @@ int main(int argc, char *argv[]) {
 
     ExampleGenerationConfig eg_config;  // controls num-frames,
                                         // left/right-context, etc.
+    TaskSequencerConfig sequencer_config;  // has --num-threads option; the
+                                           // egs are created in parallel but
+                                           // written in order.
 
     BaseFloat normalization_fst_scale = 1.0;
     int32 srand_seed = 0;
@@ -313,6 +427,7 @@ int main(int argc, char *argv[]) {
                 "--convert-to-pdfs=false to chain-get-supervision.");
 
     eg_config.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -378,6 +493,7 @@ int main(int argc, char *argv[]) {
         deriv_weights_rspecifier);
 
     int32 num_err = 0;
+    TaskSequencer<ChainExampleTask> sequencer(sequencer_config);
 
     for (; !feat_reader.Done(); feat_reader.Next()) {
       std::string key = feat_reader.Key();
@@ -423,14 +539,23 @@ int main(int argc, char *argv[]) {
           }
         }
 
-        if (!ProcessFile(trans_mdl_ptr, normalization_fst, feats,
-                         online_ivector_feats, online_ivector_period,
-                         supervision, deriv_weights, supervision_length_tolerance,
-                         key, compress,
-                         &utt_splitter, &example_writer))
+        std::vector<ChunkTimeInfo> chunks;
+        std::vector<int32> ivector_frames;
+        if (!GetChunks(feats.NumRows(), supervision, deriv_weights,
+                       supervision_length_tolerance, key,
+                       online_ivector_feats != NULL, &utt_splitter,
+                       &chunks, &ivector_frames)) {
           num_err++;
+          continue;
+        }
+        sequencer.Run(new ChainExampleTask(
+            trans_mdl_ptr, normalization_fst, feats, online_ivector_feats,
+            online_ivector_period, supervision, deriv_weights, key, compress,
+            eg_config.frame_subsampling_factor, &chunks, &ivector_frames,
+            &example_writer));
       }
     }
+    sequencer.Wait();
     if (num_err > 0)
       KALDI_WARN << num_err << " utterances had errors and could "
           "not be processed.";
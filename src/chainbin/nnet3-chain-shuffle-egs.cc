@@ -22,6 +22,7 @@
 #include "util/common-utils.h"
 #include "hmm/transition-model.h"
 #include "nnet3/nnet-chain-example.h"
+#include "util/table-shuffle.h"
 
 int main(int argc, char *argv[]) {
   try {
@@ -33,7 +34,8 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Copy nnet3+chain examples for neural network training, from the input to output,\n"
         "while randomly shuffling the order.  This program will keep all of the examples\n"
-        "in memory at once, unless you use the --buffer-size option\n"
+        "in memory at once, unless you use the --buffer-size option,\n"
+        "or do full randomization with bounded memory using --shuffle-dir.\n"
         "\n"
         "Usage:  nnet3-chain-shuffle-egs [options] <egs-rspecifier> <egs-wspecifier>\n"
         "\n"
@@ -46,6 +48,8 @@ int main(int argc, char *argv[]) {
     po.Register("buffer-size", &buffer_size, "If >0, size of a buffer we use "
                 "to do limited-memory partial randomization.  Otherwise, do "
                 "full randomization.");
+    TableShuffleOptions shuffle_opts;
+    shuffle_opts.Register(&po);
 
     po.Read(argc, argv);
 
@@ -55,6 +59,8 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       exit(1);
     }
+    if (buffer_size != 0 && !shuffle_opts.dir.empty())
+      KALDI_ERR << "--buffer-size and --shuffle-dir cannot both be set.";
 
     std::string examples_rspecifier = po.GetArg(1),
         examples_wspecifier = po.GetArg(2);
@@ -65,7 +71,13 @@ int main(int argc, char *argv[]) {
 
     SequentialNnetChainExampleReader example_reader(examples_rspecifier);
     NnetChainExampleWriter example_writer(examples_wspecifier);
-    if (buffer_size == 0) { // Do full randomization
+    if (!shuffle_opts.dir.empty()) {
+      // Full randomization via temporary files in --shuffle-dir.
+      TableShuffler<KaldiObjectHolder<NnetChainExample> > shuffler(shuffle_opts);
+      for (; !example_reader.Done(); example_reader.Next())
+        shuffler.Accept(example_reader.Key(), example_reader.Value());
+      num_done = shuffler.Output(&example_writer);
+    } else if (buffer_size == 0) { // Do full randomization
       // Putting in an extra level of indirection here to avoid excessive
       // computation and memory demands when we have to resize the vector.
 
@@ -0,0 +1,231 @@
+// chainbin/nnet3-chain-train-parallel.cc
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "nnet3/nnet-chain-training.h"
+#include "nnet3/nnet-model-averager.h"
+#include "cudamatrix/cu-allocator.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// The state shared between the training threads.
+struct ParallelTrainingState {
+  const NnetChainTrainingOptions *opts;
+  const fst::StdVectorFst *den_fst;
+  // The initial model, in binary form; each thread reads its own copy, so
+  // that it is allocated on that thread's GPU.
+  std::string nnet_str;
+  SequentialNnetChainExampleReader *example_reader;
+  std::mutex reader_mutex;
+  NnetModelAverager *averager;
+  int32 average_period;
+  // The final model, in binary form, written by thread 0.
+  std::string final_nnet_str;
+  std::mutex ok_mutex;
+  bool ok;
+};
+
+// Gets the next minibatch from the shared reader; returns false when there
+// are no more.
+static bool GetNextExample(ParallelTrainingState *state,
+                           NnetChainExample *eg) {
+  std::lock_guard<std::mutex> lock(state->reader_mutex);
+  if (state->example_reader->Done())
+    return false;
+  *eg = state->example_reader->Value();
+  state->example_reader->Next();
+  return true;
+}
+
+static void TrainingThread(int32 thread_index, int32 gpu_id,
+                           ParallelTrainingState *state) {
+  bool ok = false;
+  try {
+#if HAVE_CUDA==1
+    if (gpu_id >= 0)
+      CuDevice::SetThreadDeviceId(gpu_id);
+#endif
+    Nnet nnet;
+    {
+      std::istringstream is(state->nnet_str);
+      nnet.Read(is, true);
+    }
+    {
+      NnetChainTrainer trainer(*(state->opts), *(state->den_fst), &nnet);
+      NnetChainExample eg;
+      int64 num_minibatches = 0;
+      while (GetNextExample(state, &eg)) {
+        trainer.Train(eg);
+        if (++num_minibatches % state->average_period == 0)
+          state->averager->Average(false, &nnet);
+      }
+      while (!state->averager->Average(true, &nnet));
+      KALDI_LOG << "Thread " << thread_index << " trained on "
+                << num_minibatches << " minibatches.";
+      ok = trainer.PrintTotalStats();
+    }
+    if (thread_index == 0) {
+      std::ostringstream os;
+      nnet.Write(os, true);
+      state->final_nnet_str = os.str();
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    state->averager->Abort();
+    ok = false;
+  }
+  std::lock_guard<std::mutex> lock(state->ok_mutex);
+  state->ok = state->ok && ok;
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    using namespace kaldi::chain;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Train nnet3+chain neural network parameters with backprop and\n"
+        "stochastic gradient descent on several GPUs of the same machine.\n"
+        "Like nnet3-chain-train, except that there is one training thread\n"
+        "per GPU, each with its own copy of the model, and the minibatches are\n"
+        "shared out between them as they ask for them.  Every\n"
+        "--average-period minibatches (per thread) the threads wait for each\n"
+        "other and their parameters are averaged, as nnet3-average would do\n"
+        "between separate jobs; the output is the final average.\n"
+        "\n"
+        "Usage:  nnet3-chain-train-parallel [options] <raw-nnet-in> "
+        "<denominator-fst-in> <chain-training-examples-in> <raw-nnet-out>\n"
+        "\n"
+        "nnet3-chain-train-parallel --gpu-ids=0,1,2,3 1.raw den.fst \\\n"
+        "  'ark:nnet3-chain-merge-egs ark:1.cegs ark:-|' 2.raw\n";
+
+    int32 srand_seed = 0;
+    bool binary_write = true;
+    std::string use_gpu = "yes",
+        gpu_ids_str;
+    int32 average_period = 50;
+    NnetChainTrainingOptions opts;
+
+    ParseOptions po(usage);
+    po.Register("srand", &srand_seed, "Seed for random number generator ");
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("gpu-ids", &gpu_ids_str, "Comma-separated list of the CUDA "
+                "device-ids of the GPUs to train on, one thread per GPU.  If "
+                "empty, a single thread uses the GPU chosen by --use-gpu.");
+    po.Register("average-period", &average_period, "The number of "
+                "minibatches each thread trains on between model averagings.");
+
+    opts.Register(&po);
+    RegisterCuAllocatorOptions(&po);
+#if HAVE_CUDA==1
+    CuDevice::RegisterDeviceOptions(&po);
+#endif
+
+    po.Read(argc, argv);
+
+    srand(srand_seed);
+
+    if (po.NumArgs() != 4 || average_period <= 0) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::vector<int32> gpu_ids;
+    if (!SplitStringToIntegers(gpu_ids_str, ",", false, &gpu_ids))
+      KALDI_ERR << "Invalid --gpu-ids option: " << gpu_ids_str;
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+    if (!gpu_ids.empty() && !CuDevice::Instantiate().Enabled())
+      KALDI_ERR << "--gpu-ids was given but no GPU is being used.";
+    // Training on multiple GPUs from one process requires the
+    // multithreading support in CuDevice.
+    CuDevice::Instantiate().AllowMultithreading();
+#else
+    if (!gpu_ids.empty())
+      KALDI_ERR << "--gpu-ids was given but Kaldi was compiled without CUDA.";
+#endif
+
+    std::string nnet_rxfilename = po.GetArg(1),
+        den_fst_rxfilename = po.GetArg(2),
+        examples_rspecifier = po.GetArg(3),
+        nnet_wxfilename = po.GetArg(4);
+
+    fst::StdVectorFst den_fst;
+    ReadFstKaldi(den_fst_rxfilename, &den_fst);
+
+    int32 num_threads = std::max<int32>(1, gpu_ids.size());
+    NnetModelAverager averager(num_threads);
+    SequentialNnetChainExampleReader example_reader(examples_rspecifier);
+
+    ParallelTrainingState state;
+    state.opts = &opts;
+    state.den_fst = &den_fst;
+    {
+      Nnet nnet;
+      ReadKaldiObject(nnet_rxfilename, &nnet);
+      std::ostringstream os;
+      nnet.Write(os, true);
+      state.nnet_str = os.str();
+    }
+    state.example_reader = &example_reader;
+    state.averager = &averager;
+    state.average_period = average_period;
+    state.ok = true;
+
+    std::vector<std::thread> threads;
+    for (int32 i = 0; i < num_threads; i++)
+      threads.push_back(std::thread(TrainingThread, i,
+                                    (gpu_ids.empty() ? -1 : gpu_ids[i]),
+                                    &state));
+    for (int32 i = 0; i < num_threads; i++)
+      threads[i].join();
+
+    if (state.final_nnet_str.empty())
+      KALDI_ERR << "Training failed.";
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
+    {
+      Nnet nnet;
+      std::istringstream is(state.final_nnet_str);
+      nnet.Read(is, true);
+      WriteKaldiObject(nnet, nnet_wxfilename, binary_write);
+    }
+    KALDI_LOG << "Wrote raw model to " << nnet_wxfilename;
+    return (state.ok ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -20,6 +20,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "nnet3/nnet-chain-training.h"
+#include "nnet3/nnet-chain-example-loader.h"
 #include "cudamatrix/cu-allocator.h"
 
 
@@ -38,13 +39,22 @@ int main(int argc, char *argv[]) {
         "use it with a GPU).\n"
         "\n"
         "Usage:  nnet3-chain-train [options] <raw-nnet-in> <denominator-fst-in> <chain-training-examples-in> <raw-nnet-out>\n"
+        " or:  nnet3-chain-train --use-loader=true [options] <raw-nnet-in> <denominator-fst-in> <unmerged-egs-in1> [<unmerged-egs-in2> ...] <raw-nnet-out>\n"
+        "With --use-loader=true, the examples are read from one or more archives\n"
+        "of unmerged examples, in parallel, and shuffled and merged inside this\n"
+        "program (see the --loader.* options) instead of by\n"
+        "nnet3-chain-shuffle-egs and nnet3-chain-merge-egs.\n"
         "\n"
-        "nnet3-chain-train 1.raw den.fst 'ark:nnet3-merge-egs 1.cegs ark:-|' 2.raw\n";
+        "nnet3-chain-train 1.raw den.fst 'ark:nnet3-merge-egs 1.cegs ark:-|' 2.raw\n"
+        "nnet3-chain-train --use-loader=true --loader.minibatch-size=128 1.raw den.fst \\\n"
+        "   ark:cegs.1.ark ark:cegs.2.ark 2.raw\n";
 
     int32 srand_seed = 0;
-    bool binary_write = true;
+    bool binary_write = true,
+        use_loader = false;
     std::string use_gpu = "yes";
     NnetChainTrainingOptions opts;
+    NnetChainExampleLoaderOptions loader_opts;
 
     ParseOptions po(usage);
     po.Register("srand", &srand_seed, "Seed for random number generator ");
@@ -52,14 +62,21 @@ int main(int argc, char *argv[]) {
     po.Register("use-gpu", &use_gpu,
                 "yes|no|optional|wait, only has effect if compiled with CUDA");
 
+    po.Register("use-loader", &use_loader, "If true, shuffle and merge the "
+                "examples inside this program; see the usage message.");
     opts.Register(&po);
+    ParseOptions loader_po("loader", &po);
+    loader_opts.Register(&loader_po);
     RegisterCuAllocatorOptions(&po);
+#if HAVE_CUDA==1
+    CuDevice::RegisterDeviceOptions(&po);
+#endif
 
     po.Read(argc, argv);
 
     srand(srand_seed);
 
-    if (po.NumArgs() != 4) {
+    if (po.NumArgs() < 4 || (po.NumArgs() > 4 && !use_loader)) {
       po.PrintUsage();
       exit(1);
     }
@@ -70,8 +87,10 @@ int main(int argc, char *argv[]) {
 
     std::string nnet_rxfilename = po.GetArg(1),
         den_fst_rxfilename = po.GetArg(2),
-        examples_rspecifier = po.GetArg(3),
-        nnet_wxfilename = po.GetArg(4);
+        nnet_wxfilename = po.GetArg(po.NumArgs());
+    std::vector<std::string> examples_rspecifiers;
+    for (int32 i = 3; i < po.NumArgs(); i++)
+      examples_rspecifiers.push_back(po.GetArg(i));
 
     Nnet nnet;
     ReadKaldiObject(nnet_rxfilename, &nnet);
@@ -84,10 +103,42 @@ int main(int argc, char *argv[]) {
 
       NnetChainTrainer trainer(opts, den_fst, &nnet);
 
-      SequentialNnetChainExampleReader example_reader(examples_rspecifier);
-
-      for (; !example_reader.Done(); example_reader.Next())
-        trainer.Train(example_reader.Value());
+      // We keep two minibatches, so that the inputs of the next one can be
+      // copied to the GPU while we train on the current one.
+      NnetChainExample egs[2];
+      int32 cur = 0;
+      if (use_loader) {
+        NnetChainExampleLoader loader(loader_opts, examples_rspecifiers,
+                                      srand_seed);
+        bool have_eg = loader.GetMinibatch(&(egs[cur]));
+        while (have_eg) {
+          bool have_next = loader.GetMinibatch(&(egs[1 - cur]));
+          if (have_next)
+            trainer.Prefetch(egs[1 - cur]);
+          trainer.Train(egs[cur]);
+          cur = 1 - cur;
+          have_eg = have_next;
+        }
+      } else {
+        SequentialNnetChainExampleReader example_reader(
+            examples_rspecifiers[0]);
+        if (!example_reader.Done()) {
+          egs[cur].Swap(&(example_reader.Value()));
+          example_reader.Next();
+          while (true) {
+            bool have_next = !example_reader.Done();
+            if (have_next) {
+              egs[1 - cur].Swap(&(example_reader.Value()));
+              example_reader.Next();
+              trainer.Prefetch(egs[1 - cur]);
+            }
+            trainer.Train(egs[cur]);
+            if (!have_next)
+              break;
+            cur = 1 - cur;
+          }
+        }
+      }
 
       ok = trainer.PrintTotalStats();
     }
@@ -0,0 +1,252 @@
+// cudadecoder/batched-threaded-nnet3-cuda-multi-gpu-pipeline.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#if HAVE_CUDA == 1
+
+#include "cudadecoder/batched-threaded-nnet3-cuda-multi-gpu-pipeline.h"
+#include <thread>
+
+namespace kaldi {
+namespace cuda_decoder {
+
+BatchedThreadedNnet3CudaMultiGpuPipeline::
+BatchedThreadedNnet3CudaMultiGpuPipeline(
+    const BatchedThreadedNnet3CudaPipelineConfig &config,
+    const std::vector<int32> &gpu_ids):
+    gpu_ids_(gpu_ids), all_group_tasks_not_done_(0) {
+  if (!CuDevice::Instantiate().Enabled())
+    KALDI_ERR << "No GPU selected (call CuDevice::Instantiate().SelectGpuId() "
+              << "first).";
+  if (gpu_ids_.empty()) {
+    int32 device_id;
+    cudaGetDevice(&device_id);
+    gpu_ids_.push_back(device_id);
+  }
+  for (size_t i = 0; i < gpu_ids_.size(); i++) {
+    for (size_t j = 0; j < i; j++)
+      if (gpu_ids_[i] == gpu_ids_[j])
+        KALDI_ERR << "GPU " << gpu_ids_[i] << " is listed more than once.";
+    pipelines_.emplace_back(new BatchedThreadedNnet3CudaPipeline(config));
+  }
+  pending_samples_.resize(gpu_ids_.size(), 0);
+}
+
+void BatchedThreadedNnet3CudaMultiGpuPipeline::RunOnEachGpu(
+    const std::function<void(int32)> &f) {
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < pipelines_.size(); i++) {
+    threads.push_back(std::thread([this, &f, i]() {
+      CuDevice::SetThreadDeviceId(gpu_ids_[i]);
+      f(i);
+    }));
+  }
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+}
+
+void BatchedThreadedNnet3CudaMultiGpuPipeline::Initialize(
+    const fst::Fst<fst::StdArc> &decode_fst, const nnet3::AmNnetSimple &nnet,
+    const TransitionModel &trans_model) {
+  KALDI_LOG << "Initializing BatchedThreadedNnet3CudaPipeline on "
+            << gpu_ids_.size() << " GPU(s).";
+  // The pipelines are initialized in parallel: on each GPU this copies the
+  // graph and starts that pipeline's threads, which use the GPU of the thread
+  // that called Initialize().
+  RunOnEachGpu([&](int32 i) {
+    pipelines_[i]->Initialize(decode_fst, nnet, trans_model);
+  });
+}
+
+void BatchedThreadedNnet3CudaMultiGpuPipeline::Finalize() {
+  // Memory must be freed from a thread using the GPU it is in.
+  RunOnEachGpu([this](int32 i) { pipelines_[i]->Finalize(); });
+}
+
+int32 BatchedThreadedNnet3CudaMultiGpuPipeline::AddTask(
+    const std::string &key, const std::string &group, int64 num_samples) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (key_to_pipeline_.count(key) != 0)
+    KALDI_ERR << "Decode handle " << key << " is already open.";
+  int32 best = 0;
+  for (size_t i = 1; i < pending_samples_.size(); i++)
+    if (pending_samples_[i] < pending_samples_[best])
+      best = i;
+  pending_samples_[best] += num_samples;
+  key_to_pipeline_[key] = best;
+  group_keys_.insert({group, key});
+  group_pipelines_[group].insert(best);
+  ++group_tasks_not_done_[group];
+  ++all_group_tasks_not_done_;
+  return best;
+}
+
+std::function<void(CompactLattice &clat)>
+BatchedThreadedNnet3CudaMultiGpuPipeline::WrapCallback(
+    int32 pipeline, const std::string &group, int64 num_samples,
+    const std::function<void(CompactLattice &clat)> &callback) {
+  return [this, pipeline, group, num_samples, callback](CompactLattice &clat) {
+    if (callback)
+      callback(clat);
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_samples_[pipeline] -= num_samples;
+    --all_group_tasks_not_done_;
+    --group_tasks_not_done_[group];
+    done_cv_.notify_all();
+  };
+}
+
+void BatchedThreadedNnet3CudaMultiGpuPipeline::OpenDecodeHandle(
+    const std::string &key, const WaveData &wave_data, const std::string &group,
+    const std::function<void(CompactLattice &clat)> &callback,
+    int32 priority) {
+  int64 num_samples = wave_data.Data().NumCols();
+  int32 i = AddTask(key, group, num_samples);
+  pipelines_[i]->OpenDecodeHandle(key, wave_data, group,
+                                  WrapCallback(i, group, num_samples,
+                                               callback), priority);
+}
+
+void BatchedThreadedNnet3CudaMultiGpuPipeline::OpenDecodeHandle(
+    const std::string &key, const VectorBase<BaseFloat> &wave_data,
+    float sample_rate, const std::string &group,
+    const std::function<void(CompactLattice &clat)> &callback,
+    int32 priority) {
+  int64 num_samples = wave_data.Dim();
+  int32 i = AddTask(key, group, num_samples);
+  pipelines_[i]->OpenDecodeHandle(key, wave_data, sample_rate, group,
+                                  WrapCallback(i, group, num_samples,
+                                               callback), priority);
+}
+
+BatchedThreadedNnet3CudaPipeline *
+BatchedThreadedNnet3CudaMultiGpuPipeline::GetPipeline(const std::string &key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = key_to_pipeline_.find(key);
+  KALDI_ASSERT(it != key_to_pipeline_.end());
+  return pipelines_[it->second].get();
+}
+
+bool BatchedThreadedNnet3CudaMultiGpuPipeline::isFinished(
+    const std::string &key) {
+  return GetPipeline(key)->isFinished(key);
+}
+
+bool BatchedThreadedNnet3CudaMultiGpuPipeline::GetRawLattice(
+    const std::string &key, Lattice *lat) {
+  return GetPipeline(key)->GetRawLattice(key, lat);
+}
+
+bool BatchedThreadedNnet3CudaMultiGpuPipeline::GetLattice(
+    const std::string &key, CompactLattice *lat) {
+  return GetPipeline(key)->GetLattice(key, lat);
+}
+
+void BatchedThreadedNnet3CudaMultiGpuPipeline::CloseDecodeHandle(
+    const std::string &key) {
+  GetPipeline(key)->CloseDecodeHandle(key);
+  std::lock_guard<std::mutex> lock(mutex_);
+  key_to_pipeline_.erase(key);
+}
+
+void BatchedThreadedNnet3CudaMultiGpuPipeline::CloseAllDecodeHandlesForGroup(
+    const std::string &group) {
+  WaitForGroup(group);
+  std::set<int32> pipelines;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pipelines.swap(group_pipelines_[group]);
+    group_pipelines_.erase(group);
+    auto p = group_keys_.equal_range(group);
+    for (auto it = p.first; it != p.second; ++it)
+      key_to_pipeline_.erase(it->second);
+    group_keys_.erase(p.first, p.second);
+  }
+  for (int32 i : pipelines)
+    pipelines_[i]->CloseAllDecodeHandlesForGroup(group);
+}
+
+void BatchedThreadedNnet3CudaMultiGpuPipeline::CloseAllDecodeHandles() {
+  WaitForAllTasks();
+  for (size_t i = 0; i < pipelines_.size(); i++)
+    pipelines_[i]->CloseAllDecodeHandles();
+  std::lock_guard<std::mutex> lock(mutex_);
+  key_to_pipeline_.clear();
+  group_keys_.clear();
+  group_pipelines_.clear();
+  group_tasks_not_done_.clear();
+}
+
+int32 BatchedThreadedNnet3CudaMultiGpuPipeline::GetNumberOfTasksPending() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return all_group_tasks_not_done_;
+}
+
+void BatchedThreadedNnet3CudaMultiGpuPipeline::WaitForAllTasks() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return all_group_tasks_not_done_ == 0; });
+}
+
+void BatchedThreadedNnet3CudaMultiGpuPipeline::WaitForGroup(
+    const std::string &group) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this, &group] {
+    auto it = group_tasks_not_done_.find(group);
+    return it == group_tasks_not_done_.end() || it->second == 0;
+  });
+  group_tasks_not_done_.erase(group);
+}
+
+bool BatchedThreadedNnet3CudaMultiGpuPipeline::IsGroupCompleted(
+    const std::string &group) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = group_tasks_not_done_.find(group);
+  return it == group_tasks_not_done_.end() || it->second == 0;
+}
+
+std::string BatchedThreadedNnet3CudaMultiGpuPipeline::WaitForAnyGroup() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::string group_done;
+  done_cv_.wait(lock, [this, &group_done] {
+    for (auto &p : group_tasks_not_done_) {
+      if (p.second == 0) {
+        group_done = p.first;
+        return true;
+      }
+    }
+    return false;
+  });
+  return group_done;
+}
+
+bool BatchedThreadedNnet3CudaMultiGpuPipeline::IsAnyGroupCompleted(
+    std::string *group) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &p : group_tasks_not_done_) {
+    if (p.second == 0) {
+      *group = p.first;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // end namespace cuda_decoder
+}  // end namespace kaldi
+
+#endif  // HAVE_CUDA == 1
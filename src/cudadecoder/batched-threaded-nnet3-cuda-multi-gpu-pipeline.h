@@ -0,0 +1,138 @@
+// cudadecoder/batched-threaded-nnet3-cuda-multi-gpu-pipeline.h
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_CUDA_DECODER_BATCHED_THREADED_NNET3_CUDA_MULTI_GPU_PIPELINE_H_
+#define KALDI_CUDA_DECODER_BATCHED_THREADED_NNET3_CUDA_MULTI_GPU_PIPELINE_H_
+
+#if HAVE_CUDA == 1
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "cudadecoder/batched-threaded-nnet3-cuda-pipeline.h"
+
+namespace kaldi {
+namespace cuda_decoder {
+
+/*
+ * BatchedThreadedNnet3CudaMultiGpuPipeline owns one
+ * BatchedThreadedNnet3CudaPipeline per GPU, all with the same configuration,
+ * and has the same interface for decoding.  Each utterance given to
+ * OpenDecodeHandle() goes to the pipeline with the least audio waiting to be
+ * decoded (counting the utterances not yet done), so that the GPUs stay
+ * equally loaded when the utterances have very different lengths.
+ *
+ * Each GPU has its own copy of the decoding graph and its own cuda-control
+ * and cuda-worker threads, so these options are per GPU.  The program must
+ * call CuDevice::Instantiate().SelectGpuId() and AllowMultithreading()
+ * (from the main thread) before Initialize().
+ */
+class BatchedThreadedNnet3CudaMultiGpuPipeline {
+ public:
+  // 'gpu_ids' are the CUDA device-ids of the GPUs to use; if empty, only the
+  // GPU chosen by SelectGpuId() is used.
+  BatchedThreadedNnet3CudaMultiGpuPipeline(
+      const BatchedThreadedNnet3CudaPipelineConfig &config,
+      const std::vector<int32> &gpu_ids);
+
+  // Initializes the pipeline of each GPU (see
+  // BatchedThreadedNnet3CudaPipeline::Initialize()).
+  void Initialize(const fst::Fst<fst::StdArc> &decode_fst,
+                  const nnet3::AmNnetSimple &nnet,
+                  const TransitionModel &trans_model);
+  void Finalize();
+
+  // The following are as for BatchedThreadedNnet3CudaPipeline.  The
+  // callbacks run in the worker threads of the pipeline the utterance went to,
+  // and must be thread-safe.
+  void OpenDecodeHandle(
+      const std::string &key, const WaveData &wave_data,
+      const std::string &group = std::string(),
+      const std::function<void(CompactLattice &clat)> &callback =
+          std::function<void(CompactLattice &clat)>(),
+      int32 priority = 0);
+  void OpenDecodeHandle(
+      const std::string &key, const VectorBase<BaseFloat> &wave_data,
+      float sample_rate, const std::string &group = std::string(),
+      const std::function<void(CompactLattice &clat)> &callback =
+          std::function<void(CompactLattice &clat)>(),
+      int32 priority = 0);
+  bool isFinished(const std::string &key);
+  bool GetRawLattice(const std::string &key, Lattice *lat);
+  bool GetLattice(const std::string &key, CompactLattice *lat);
+  void CloseDecodeHandle(const std::string &key);
+  void CloseAllDecodeHandlesForGroup(const std::string &group);
+  void CloseAllDecodeHandles();
+  int32 GetNumberOfTasksPending();
+  void WaitForAllTasks();
+  void WaitForGroup(const std::string &group);
+  bool IsGroupCompleted(const std::string &group);
+  std::string WaitForAnyGroup();
+  bool IsAnyGroupCompleted(std::string *group);
+
+  int32 NumGpus() const { return gpu_ids_.size(); }
+
+ private:
+  // Chooses the pipeline for an utterance of 'num_samples' samples, and
+  // records it as pending there and in its group.
+  int32 AddTask(const std::string &key, const std::string &group,
+                int64 num_samples);
+
+  // Returns the callback to give to the pipeline: it calls 'callback' and
+  // then records the utterance as done.
+  std::function<void(CompactLattice &clat)> WrapCallback(
+      int32 pipeline, const std::string &group, int64 num_samples,
+      const std::function<void(CompactLattice &clat)> &callback);
+
+  // Returns the pipeline that 'key' went to.
+  BatchedThreadedNnet3CudaPipeline *GetPipeline(const std::string &key);
+
+  // Runs f(i) for each pipeline i, each in a thread that uses its GPU, and
+  // waits for them.
+  void RunOnEachGpu(const std::function<void(int32)> &f);
+
+  std::vector<int32> gpu_ids_;
+  std::vector<std::unique_ptr<BatchedThreadedNnet3CudaPipeline> > pipelines_;
+
+  // 'mutex_' guards all the members below.
+  std::mutex mutex_;
+  std::condition_variable done_cv_;
+  // The samples of the utterances not yet done in each pipeline.
+  std::vector<int64> pending_samples_;
+  std::unordered_map<std::string, int32> key_to_pipeline_;
+  std::unordered_multimap<std::string, std::string> group_keys_;
+  // The pipelines that got utterances of each group not yet closed.
+  std::map<std::string, std::set<int32> > group_pipelines_;
+  std::map<std::string, int32> group_tasks_not_done_;
+  int32 all_group_tasks_not_done_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BatchedThreadedNnet3CudaMultiGpuPipeline);
+};
+
+}  // end namespace cuda_decoder
+}  // end namespace kaldi.
+
+#endif  // HAVE_CUDA == 1
+
+#endif  // KALDI_CUDA_DECODER_BATCHED_THREADED_NNET3_CUDA_MULTI_GPU_PIPELINE_H_
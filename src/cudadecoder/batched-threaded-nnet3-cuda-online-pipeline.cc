@@ -0,0 +1,367 @@
+// cudadecoder/batched-threaded-nnet3-cuda-online-pipeline.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#if HAVE_CUDA == 1
+
+#include "cudadecoder/batched-threaded-nnet3-cuda-online-pipeline.h"
+#include <nvToolsExt.h>
+#include <future>
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace cuda_decoder {
+
+BatchedThreadedNnet3CudaOnlinePipeline::BatchedThreadedNnet3CudaOnlinePipeline(
+    const BatchedThreadedNnet3CudaOnlinePipelineConfig &config,
+    const fst::Fst<fst::StdArc> &decode_fst,
+    const nnet3::AmNnetSimple &am_nnet, const TransitionModel &trans_model)
+    : config_(config), trans_model_(trans_model),
+      feature_info_(config.feature_opts), n_lattice_callbacks_not_done_(0) {
+  config_.Check();
+  // As in BatchedThreadedNnet3CudaPipeline.
+  feature_info_.ivector_extractor_info.use_most_recent_ivector = true;
+  feature_info_.ivector_extractor_info.greedy_ivector_extractor = true;
+
+  // This is the control thread, which does all the GPU work.
+  CuDevice::Instantiate();
+  cuda_fst_.Initialize(decode_fst, &trans_model_);
+  work_pool_.reset(new ThreadPool(config_.num_worker_threads));
+  cuda_decoder_.reset(new CudaDecoder(cuda_fst_, config_.decoder_opts,
+                                      config_.max_batch_size,
+                                      config_.num_channels));
+  if (config_.num_decoder_copy_threads > 0)
+    cuda_decoder_->SetThreadPoolAndStartCPUWorkers(
+        work_pool_.get(), config_.num_decoder_copy_threads);
+  computer_.reset(new nnet3::NnetBatchComputer(
+      config_.compute_opts, am_nnet.GetNnet(), am_nnet.Priors()));
+
+  // NnetBatchComputer may have changed frames_per_chunk, so we take the
+  // options from it.
+  const nnet3::NnetBatchComputerOptions &opts = computer_->GetOptions();
+  frames_per_chunk_ = opts.frames_per_chunk;
+  frame_subsampling_factor_ = opts.frame_subsampling_factor;
+  int32 nnet_left_context, nnet_right_context;
+  nnet3::ComputeSimpleNnetContext(am_nnet.GetNnet(), &nnet_left_context,
+                                  &nnet_right_context);
+  // As in OnlineNnet3BatchDecoder, all the chunks have the same context so
+  // that they can go in the same minibatches.
+  left_context_ = nnet_left_context + opts.extra_left_context;
+  right_context_ = nnet_right_context + opts.extra_right_context;
+
+  available_channels_.reserve(config_.num_channels);
+  for (int32 i = config_.num_channels - 1; i >= 0; i--)
+    available_channels_.push_back(i);
+
+  // Ensure all the initialization work on the GPU is done.
+  cudaStreamSynchronize(cudaStreamPerThread);
+}
+
+BatchedThreadedNnet3CudaOnlinePipeline::
+~BatchedThreadedNnet3CudaOnlinePipeline() {
+  WaitForLatticeCallbacks();
+  for (auto &p : corr_id_to_state_)
+    delete p.second;
+  // The decoder uses work_pool_, so it goes first.
+  cuda_decoder_.reset();
+  work_pool_.reset();
+  computer_.reset();
+  cuda_fst_.Finalize();
+}
+
+BatchedThreadedNnet3CudaOnlinePipeline::ChannelState *
+BatchedThreadedNnet3CudaOnlinePipeline::GetChannelState(
+    CorrelationID corr_id) {
+  auto it = corr_id_to_state_.find(corr_id);
+  if (it == corr_id_to_state_.end())
+    KALDI_ERR << "Unknown correlation ID " << corr_id
+              << " (was TryInitCorrID() called?)";
+  return it->second;
+}
+
+bool BatchedThreadedNnet3CudaOnlinePipeline::TryInitCorrID(
+    CorrelationID corr_id, BaseFloat sample_frequency) {
+  if (corr_id_to_state_.count(corr_id) != 0)
+    KALDI_ERR << "Correlation ID " << corr_id << " is already in use.";
+  ChannelId channel;
+  {
+    std::lock_guard<std::mutex> lk(available_channels_mutex_);
+    if (available_channels_.empty())
+      return false;
+    channel = available_channels_.back();
+    available_channels_.pop_back();
+  }
+  corr_id_to_state_[corr_id] =
+      new ChannelState(channel, sample_frequency, feature_info_);
+  return true;
+}
+
+void BatchedThreadedNnet3CudaOnlinePipeline::SetLatticeCallback(
+    CorrelationID corr_id, const LatticeCallback &callback) {
+  GetChannelState(corr_id)->callback = callback;
+}
+
+void BatchedThreadedNnet3CudaOnlinePipeline::ComputeFeaturesAndCreateTasks(
+    const SubVector<BaseFloat> &wave_samples, bool is_last_chunk,
+    ChannelState *state) {
+  OnlineNnet2FeaturePipeline &features = state->features;
+  if (wave_samples.Dim() > 0)
+    features.AcceptWaveform(state->sample_frequency, wave_samples);
+  if (is_last_chunk)
+    features.InputFinished();
+
+  // This is as OnlineNnet3BatchDecoder::CreateChunks(), except that the
+  // inputs stay on CPU here: DecodeBatch() moves them to the GPU.
+  OnlineFeatureInterface *input_feature = features.InputFeature(),
+      *ivector_feature = features.IvectorFeature();
+  int32 f = frame_subsampling_factor_,
+      num_output_frames_per_chunk = frames_per_chunk_ / f,
+      num_frames_ready = input_feature->NumFramesReady(),
+      batch_output_frames = 0;
+  state->tasks.clear();
+  while (true) {
+    int32 begin_input_t = state->num_output_frames * f,
+        end_input_t = begin_input_t + frames_per_chunk_,
+        num_used_output_frames;
+    if (num_frames_ready >= end_input_t + right_context_) {
+      num_used_output_frames = num_output_frames_per_chunk;
+    } else if (is_last_chunk && num_frames_ready > begin_input_t) {
+      num_used_output_frames = std::min(
+          num_output_frames_per_chunk,
+          (num_frames_ready - begin_input_t + f - 1) / f);
+    } else {
+      break;
+    }
+    state->tasks.resize(state->tasks.size() + 1);
+    nnet3::NnetInferenceTask &task = state->tasks.back();
+    task.first_input_t = -left_context_;
+    task.output_t_stride = f;
+    task.num_output_frames = num_output_frames_per_chunk;
+    task.num_initial_unused_output_frames = 0;
+    task.num_used_output_frames = num_used_output_frames;
+    // MergeTaskOutput() wants this relative to the first task it is given.
+    task.first_used_output_frame_index = batch_output_frames;
+    task.is_edge = false;
+    task.is_irregular = false;
+    task.output_to_cpu = false;
+    task.priority = 0.0;
+
+    int32 begin_input_t_padded = begin_input_t - left_context_,
+        end_input_t_padded = end_input_t + right_context_;
+    std::vector<int32> frames(end_input_t_padded - begin_input_t_padded);
+    for (size_t i = 0; i < frames.size(); i++)
+      frames[i] = std::max<int32>(0, std::min<int32>(
+          begin_input_t_padded + static_cast<int32>(i),
+          num_frames_ready - 1));
+    state->task_inputs.resize(state->tasks.size());
+    Matrix<BaseFloat> &input = state->task_inputs.back();
+    input.Resize(frames.size(), input_feature->Dim(), kUndefined);
+    input_feature->GetFrames(frames, &input);
+    state->task_ivectors.resize(state->tasks.size());
+    if (ivector_feature != NULL) {
+      int32 ivector_frame = std::min(end_input_t_padded,
+                                     ivector_feature->NumFramesReady()) - 1;
+      KALDI_ASSERT(ivector_frame >= 0);
+      Vector<BaseFloat> &ivector = state->task_ivectors.back();
+      ivector.Resize(ivector_feature->Dim(), kUndefined);
+      ivector_feature->GetFrame(ivector_frame, &ivector);
+    }
+    state->num_output_frames += num_used_output_frames;
+    batch_output_frames += num_used_output_frames;
+  }
+}
+
+void BatchedThreadedNnet3CudaOnlinePipeline::DecodeBatch(
+    const std::vector<CorrelationID> &corr_ids,
+    const std::vector<SubVector<BaseFloat> > &wave_samples,
+    const std::vector<bool> &is_last_chunk) {
+  nvtxRangePushA("DecodeBatch");
+  KALDI_ASSERT(corr_ids.size() == wave_samples.size() &&
+               corr_ids.size() == is_last_chunk.size() &&
+               corr_ids.size() <=
+               static_cast<size_t>(config_.max_batch_size));
+  int32 batch_size = corr_ids.size();
+  std::vector<ChannelState*> states(batch_size);
+  for (int32 i = 0; i < batch_size; i++)
+    states[i] = GetChannelState(corr_ids[i]);
+
+  // 1) Compute the features and create the nnet tasks in the worker threads.
+  {
+    std::vector<std::future<void> > futures;
+    futures.reserve(batch_size);
+    for (int32 i = 0; i < batch_size; i++) {
+      const SubVector<BaseFloat> *samples = &wave_samples[i];
+      bool last = is_last_chunk[i];
+      ChannelState *state = states[i];
+      futures.push_back(work_pool_->enqueue(
+          THREAD_POOL_HIGH_PRIORITY, [this, samples, last, state]() {
+            ComputeFeaturesAndCreateTasks(*samples, last, state);
+          }));
+    }
+    for (size_t i = 0; i < futures.size(); i++)
+      futures[i].get();  // rethrows any exception from the worker.
+  }
+
+  // 2) Compute the nnet for all the streams at once.
+  nvtxRangePushA("ComputeBatchNnet");
+  for (int32 i = 0; i < batch_size; i++) {
+    ChannelState *state = states[i];
+    for (size_t j = 0; j < state->tasks.size(); j++) {
+      nnet3::NnetInferenceTask &task = state->tasks[j];
+      task.input.Swap(&(state->task_inputs[j]));
+      if (state->task_ivectors[j].Dim() > 0) {
+        task.ivector.Resize(state->task_ivectors[j].Dim(), kUndefined);
+        task.ivector.CopyFromVec(state->task_ivectors[j]);
+      }
+      computer_->AcceptTask(&task, 0);
+    }
+    state->task_inputs.clear();
+    state->task_ivectors.clear();
+  }
+  while (computer_->Compute(true))
+    ;
+  nvtxRangePop();
+
+  // 3) Advance the search on all the streams.  The decodables give the
+  // decoder the new frames only, so their offset is the number of frames it
+  // has already decoded.
+  std::vector<ChannelId> channels, new_channels, completed_channels;
+  std::vector<CudaDecodableInterface*> decodables;
+  std::vector<ChannelState*> completed_states;
+  for (int32 i = 0; i < batch_size; i++) {
+    ChannelState *state = states[i];
+    if (!state->decoding_started) {
+      new_channels.push_back(state->channel);
+      state->decoding_started = true;
+    }
+  }
+  if (!new_channels.empty())
+    cuda_decoder_->InitDecoding(new_channels);
+  for (int32 i = 0; i < batch_size; i++) {
+    ChannelState *state = states[i];
+    if (!state->tasks.empty()) {
+      MergeTaskOutput(state->tasks, &(state->loglikes));
+      state->tasks.clear();
+      channels.push_back(state->channel);
+      decodables.push_back(new DecodableCuMatrixMapped(
+          trans_model_, state->loglikes,
+          cuda_decoder_->NumFramesDecoded(state->channel)));
+    }
+  }
+  // AdvanceDecoding() stops when one of the channels has no frames left, so
+  // we remove those and go on until all are done.
+  while (!channels.empty()) {
+    cuda_decoder_->AdvanceDecoding(channels, decodables);
+    size_t cur = 0;
+    for (size_t i = 0; i < channels.size(); i++) {
+      if (cuda_decoder_->NumFramesDecoded(channels[i]) <
+          decodables[i]->NumFramesReady()) {
+        channels[cur] = channels[i];
+        decodables[cur] = decodables[i];
+        cur++;
+      } else {
+        delete decodables[i];
+      }
+    }
+    channels.resize(cur);
+    decodables.resize(cur);
+  }
+  for (int32 i = 0; i < batch_size; i++)
+    states[i]->loglikes.Resize(0, 0);
+
+  // 4) Finish the streams that ended.
+  for (int32 i = 0; i < batch_size; i++) {
+    if (is_last_chunk[i]) {
+      completed_channels.push_back(states[i]->channel);
+      completed_states.push_back(states[i]);
+      corr_id_to_state_.erase(corr_ids[i]);
+    }
+  }
+  if (!completed_channels.empty()) {
+    cuda_decoder_->PrepareForGetRawLattice(completed_channels, true);
+    {
+      std::lock_guard<std::mutex> lk(n_lattice_callbacks_not_done_mutex_);
+      n_lattice_callbacks_not_done_ += completed_states.size();
+    }
+    for (size_t i = 0; i < completed_states.size(); i++) {
+      ChannelState *state = completed_states[i];
+      // We don't wait for these; WaitForLatticeCallbacks() does.
+      work_pool_->enqueue(THREAD_POOL_NORMAL_PRIORITY,
+                          [this, state]() { CompleteStream(state); });
+    }
+  }
+  nvtxRangePop();
+}
+
+void BatchedThreadedNnet3CudaOnlinePipeline::CompleteStream(
+    ChannelState *state) {
+  nvtxRangePushA("CompleteStream");
+  Lattice lat;
+  cuda_decoder_->ConcurrentGetRawLatticeSingleChannel(state->channel, &lat);
+  // We are done with the channel.
+  {
+    std::lock_guard<std::mutex> lk(available_channels_mutex_);
+    available_channels_.push_back(state->channel);
+  }
+  CompactLattice clat;
+  if (config_.determinize_lattice)
+    DeterminizeLatticePhonePrunedWrapper(trans_model_, &lat,
+                                         config_.decoder_opts.lattice_beam,
+                                         &clat, config_.det_opts);
+  else
+    ConvertLattice(lat, &clat);
+  if (state->callback)
+    state->callback(clat);
+  delete state;
+  {
+    std::lock_guard<std::mutex> lk(n_lattice_callbacks_not_done_mutex_);
+    if (--n_lattice_callbacks_not_done_ == 0)
+      n_lattice_callbacks_not_done_cv_.notify_all();
+  }
+  nvtxRangePop();
+}
+
+void BatchedThreadedNnet3CudaOnlinePipeline::GetBestPath(
+    const std::vector<CorrelationID> &corr_ids,
+    const std::vector<Lattice*> &lats) {
+  KALDI_ASSERT(corr_ids.size() == lats.size());
+  std::vector<ChannelId> channels;
+  std::vector<Lattice*> fst_out_vec;
+  for (size_t i = 0; i < corr_ids.size(); i++) {
+    ChannelState *state = GetChannelState(corr_ids[i]);
+    if (state->decoding_started) {
+      channels.push_back(state->channel);
+      fst_out_vec.push_back(lats[i]);
+    } else {
+      lats[i]->DeleteStates();
+    }
+  }
+  if (!channels.empty())
+    cuda_decoder_->GetBestPath(channels, fst_out_vec, false);
+}
+
+void BatchedThreadedNnet3CudaOnlinePipeline::WaitForLatticeCallbacks() {
+  std::unique_lock<std::mutex> lk(n_lattice_callbacks_not_done_mutex_);
+  n_lattice_callbacks_not_done_cv_.wait(
+      lk, [this]() { return n_lattice_callbacks_not_done_ == 0; });
+}
+
+}  // end namespace cuda_decoder
+}  // end namespace kaldi
+
+#endif  // HAVE_CUDA == 1
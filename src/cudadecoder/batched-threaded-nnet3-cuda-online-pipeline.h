@@ -0,0 +1,228 @@
+// cudadecoder/batched-threaded-nnet3-cuda-online-pipeline.h
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_CUDA_DECODER_BATCHED_THREADED_NNET3_CUDA_ONLINE_PIPELINE_H_
+#define KALDI_CUDA_DECODER_BATCHED_THREADED_NNET3_CUDA_ONLINE_PIPELINE_H_
+
+#if HAVE_CUDA == 1
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "cudadecoder/cuda-decoder.h"
+#include "cudadecoder/decodable-cumatrix.h"
+#include "cudadecoder/thread-pool.h"
+#include "lat/determinize-lattice-pruned.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-batch-compute.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+
+namespace kaldi {
+namespace cuda_decoder {
+
+// Identifies one audio stream ("correlation ID", as in inference servers).
+typedef uint64 CorrelationID;
+
+struct BatchedThreadedNnet3CudaOnlinePipelineConfig {
+  BatchedThreadedNnet3CudaOnlinePipelineConfig()
+      : max_batch_size(400),
+        num_channels(600),
+        num_worker_threads(20),
+        determinize_lattice(true),
+        num_decoder_copy_threads(2) {}
+  void Register(OptionsItf *po) {
+    po->Register("max-batch-size", &max_batch_size,
+                 "The maximum number of streams in a call to DecodeBatch(). "
+                 "This is also the number of lanes in the CudaDecoder.");
+    po->Register("num-channels", &num_channels,
+                 "The maximum number of streams that can be open at any time. "
+                 "Each channel keeps the decoding state of one stream on the "
+                 "GPU between chunks; it must be at least max-batch-size.");
+    po->Register("cuda-worker-threads", &num_worker_threads,
+                 "The total number of CPU threads launched to process CPU "
+                 "tasks (features, lattice generation and determinization).");
+    po->Register("determinize-lattice", &determinize_lattice,
+                 "Determinize the lattice before output.");
+    po->Register("cuda-decoder-copy-threads", &num_decoder_copy_threads,
+                 "Advanced - Number of worker threads used in the decoder for "
+                 "the host to host copies.");
+    feature_opts.Register(po);
+    decoder_opts.Register(po);
+    det_opts.Register(po);
+    compute_opts.Register(po);
+  }
+  void Check() const {
+    KALDI_ASSERT(max_batch_size > 0 && num_channels >= max_batch_size &&
+                 num_worker_threads > 0 && num_decoder_copy_threads >= 0 &&
+                 num_decoder_copy_threads < num_worker_threads);
+  }
+  int max_batch_size;
+  int num_channels;
+  int num_worker_threads;
+  bool determinize_lattice;
+  int num_decoder_copy_threads;
+
+  OnlineNnet2FeaturePipelineConfig feature_opts;       // constant readonly
+  CudaDecoderConfig decoder_opts;                      // constant readonly
+  fst::DeterminizeLatticePhonePrunedOptions det_opts;  // constant readonly
+  nnet3::NnetBatchComputerOptions compute_opts;        // constant readonly
+};
+
+/*
+ * BatchedThreadedNnet3CudaOnlinePipeline is the streaming counterpart of
+ * BatchedThreadedNnet3CudaPipeline: instead of whole utterances, it is given
+ * the audio of many streams chunk by chunk, as it arrives, and keeps the
+ * decoding state of each stream in a CudaDecoder channel between chunks.  The
+ * features are computed on CPU in the worker threads, the neural net for all
+ * the chunks of a batch is computed together on the GPU (with left and right
+ * context, as in nnet3-latgen-faster), and then the search is advanced for all
+ * the streams of the batch.  When a stream ends, its lattice is generated
+ * (and optionally determinized) in a worker thread and given to its callback.
+ *
+ * All the functions except the lattice callbacks run on the thread that calls
+ * them, which must be the same for all the calls (the "control thread", as
+ * for CudaDecoder); typically it is a loop that gathers the chunks that
+ * arrived from all the connections into batches (see
+ * cudadecoderbin/batched-tcp-nnet3-cuda-online.cc).
+ */
+class BatchedThreadedNnet3CudaOnlinePipeline {
+ public:
+  typedef std::function<void(CompactLattice &clat)> LatticeCallback;
+
+  // The constructor stores references to trans_model and am_nnet, so they
+  // must outlive this object.
+  BatchedThreadedNnet3CudaOnlinePipeline(
+      const BatchedThreadedNnet3CudaOnlinePipelineConfig &config,
+      const fst::Fst<fst::StdArc> &decode_fst,
+      const nnet3::AmNnetSimple &am_nnet, const TransitionModel &trans_model);
+
+  // Waits for the lattice callbacks to finish.
+  ~BatchedThreadedNnet3CudaOnlinePipeline();
+
+  // Starts a new stream, whose audio has the given sampling frequency.
+  // Returns false if all the channels are in use; the caller should then try
+  // again after some streams have ended.  corr_id must not be in use.
+  bool TryInitCorrID(CorrelationID corr_id, BaseFloat sample_frequency);
+
+  // Sets the function that will be called, in a worker thread, with the
+  // lattice of the stream once its last chunk has been decoded.  It must be
+  // thread-safe.
+  void SetLatticeCallback(CorrelationID corr_id,
+                          const LatticeCallback &callback);
+
+  // Decodes the next chunk of audio of each stream in corr_ids (at most
+  // max-batch-size streams, with no repetitions); the chunks may have
+  // different sizes, including zero.  For the streams whose is_last_chunk is
+  // true, decoding is finalized, their lattice callbacks are scheduled and
+  // their corr_ids become free.  The samples are not used after this
+  // returns.  The last frames before the end of a stream can only be decoded
+  // once the right context of the neural net is available, so the output of a
+  // stream lags its input by about --frames-per-chunk plus the right context.
+  void DecodeBatch(const std::vector<CorrelationID> &corr_ids,
+                   const std::vector<SubVector<BaseFloat> > &wave_samples,
+                   const std::vector<bool> &is_last_chunk);
+
+  // Outputs the best path through what has been decoded so far of each of the
+  // streams (without final-probs), for partial results.
+  void GetBestPath(const std::vector<CorrelationID> &corr_ids,
+                   const std::vector<Lattice*> &lats);
+
+  // Waits until all the lattice callbacks that were scheduled are done.
+  void WaitForLatticeCallbacks();
+
+  int32 MaxBatchSize() const { return config_.max_batch_size; }
+
+ private:
+  // The state of one stream between calls to DecodeBatch().
+  struct ChannelState {
+    ChannelId channel;
+    BaseFloat sample_frequency;
+    OnlineNnet2FeaturePipeline features;
+    // The number of subsampled output frames covered by the nnet tasks
+    // created so far.
+    int32 num_output_frames;
+    // False until InitDecoding() is called for the channel.
+    bool decoding_started;
+    LatticeCallback callback;
+
+    // The following are only used during DecodeBatch().  The inputs of the
+    // tasks are created on CPU by the worker threads.
+    std::vector<nnet3::NnetInferenceTask> tasks;
+    std::vector<Matrix<BaseFloat> > task_inputs;
+    std::vector<Vector<BaseFloat> > task_ivectors;
+    CuMatrix<BaseFloat> loglikes;
+
+    ChannelState(ChannelId channel, BaseFloat sample_frequency,
+                 const OnlineNnet2FeaturePipelineInfo &feature_info):
+        channel(channel), sample_frequency(sample_frequency),
+        features(feature_info), num_output_frames(0),
+        decoding_started(false) { }
+  };
+
+  ChannelState *GetChannelState(CorrelationID corr_id);
+
+  // Runs in a worker thread: gives the samples to the feature pipeline and
+  // creates the nnet tasks for the frames that are ready (all of them if
+  // is_last_chunk).
+  void ComputeFeaturesAndCreateTasks(const SubVector<BaseFloat> &wave_samples,
+                                     bool is_last_chunk,
+                                     ChannelState *state);
+
+  // Runs in a worker thread once a stream has ended: gets its lattice from
+  // the decoder (PrepareForGetRawLattice() has been called), frees its
+  // channel, and determinizes the lattice and calls the callback.
+  void CompleteStream(ChannelState *state);
+
+  BatchedThreadedNnet3CudaOnlinePipelineConfig config_;
+  const TransitionModel &trans_model_;
+  OnlineNnet2FeaturePipelineInfo feature_info_;
+  CudaFst cuda_fst_;
+
+  std::unique_ptr<ThreadPool> work_pool_;
+  std::unique_ptr<CudaDecoder> cuda_decoder_;
+  std::unique_ptr<nnet3::NnetBatchComputer> computer_;
+  int32 frames_per_chunk_;  // after NnetBatchComputer has fixed it.
+  int32 frame_subsampling_factor_;
+  int32 left_context_;  // includes --extra-left-context
+  int32 right_context_;  // includes --extra-right-context
+
+  std::unordered_map<CorrelationID, ChannelState*> corr_id_to_state_;
+  // available_channels_mutex_ guards available_channels_, which is also
+  // added to by CompleteStream().
+  std::mutex available_channels_mutex_;
+  std::vector<ChannelId> available_channels_;
+
+  // The number of lattice callbacks scheduled and not yet done.
+  std::mutex n_lattice_callbacks_not_done_mutex_;
+  std::condition_variable n_lattice_callbacks_not_done_cv_;
+  int32 n_lattice_callbacks_not_done_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BatchedThreadedNnet3CudaOnlinePipeline);
+};
+
+}  // end namespace cuda_decoder
+}  // end namespace kaldi.
+
+#endif  // HAVE_CUDA == 1
+
+#endif  // KALDI_CUDA_DECODER_BATCHED_THREADED_NNET3_CUDA_ONLINE_PIPELINE_H_
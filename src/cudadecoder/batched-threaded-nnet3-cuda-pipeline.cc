@@ -21,7 +21,9 @@
 
 #include "cudadecoder/batched-threaded-nnet3-cuda-pipeline.h"
 #include <nvToolsExt.h>
+#include <sstream>
 #include "base/kaldi-utils.h"
+#include "cudamatrix/cu-allocator.h"
 
 namespace kaldi {
 namespace cuda_decoder {
@@ -36,6 +38,9 @@ void BatchedThreadedNnet3CudaPipeline::Initialize(
 
   am_nnet_ = &am_nnet;
   trans_model_ = &trans_model;
+  // Everything runs on the GPU of the calling thread.
+  CuDevice::Instantiate();
+  cudaGetDevice(&gpu_id_);
   cuda_fst_.Initialize(decode_fst, trans_model_);
 
   feature_info_ = new OnlineNnet2FeaturePipelineInfo(config_.feature_opts);
@@ -45,11 +50,8 @@ void BatchedThreadedNnet3CudaPipeline::Initialize(
   // initialize threads and save their contexts so we can join them later
   thread_contexts_.resize(config_.num_control_threads);
 
-  // create work queue, padding by 10 so that we can better detect if this
-  // overflows. this should not happen and is just there as a sanity check
-  pending_task_queue_ = new TaskState *[config_.max_pending_tasks + 10];
-  tasks_front_ = 0;
-  tasks_back_ = 0;
+  num_pending_tasks_ = 0;
+  highest_pending_priority_ = std::numeric_limits<int32>::min();
 
   // ensure all allocations/kernels above are complete before launching threads
   // in different streams.
@@ -58,6 +60,22 @@ void BatchedThreadedNnet3CudaPipeline::Initialize(
   // Create threadpool for CPU work
   work_pool_ = new ThreadPool(config_.num_worker_threads);
 
+  // With several GPUs (see BatchedThreadedNnet3CudaMultiGpuPipeline), the
+  // counters are shared and the gauges are labeled with the GPU.
+  std::ostringstream gpu_label;
+  gpu_label << "gpu=\"" << gpu_id_ << "\"";
+  MetricsRegistry &metrics = MetricsRegistry::Global();
+  pending_tasks_metric_ = metrics.GetGauge(
+      "kaldi_cuda_pending_tasks", "Decoding tasks waiting for a channel.",
+      gpu_label.str());
+  audio_seconds_metric_ = metrics.GetCounter(
+      "kaldi_cuda_audio_seconds_total", "Seconds of audio decoded.");
+  tasks_done_metric_ = metrics.GetCounter(
+      "kaldi_cuda_tasks_total", "Decoding tasks completed.");
+  task_latency_metric_ = metrics.GetHistogram(
+      "kaldi_cuda_task_latency_seconds", "Time from the submission of a task "
+      "to its completion.", MetricHistogram::LatencyBuckets());
+
   exit_ = false;
   numStarted_ = 0;
 
@@ -83,7 +101,6 @@ void BatchedThreadedNnet3CudaPipeline::Finalize() {
 
   delete feature_info_;
   delete work_pool_;
-  delete[] pending_task_queue_;
 }
 
 // query a specific key to see if compute on it is complete
@@ -246,10 +263,15 @@ BatchedThreadedNnet3CudaPipeline::AddTask(const std::string &key,
 // Adds a decoding task to the decoder
 void BatchedThreadedNnet3CudaPipeline::OpenDecodeHandle(
     const std::string &key, const WaveData &wave_data, const std::string &group,
-    const std::function<void(CompactLattice &clat)> &callback) {
+    const std::function<void(CompactLattice &clat)> &callback,
+    int32 priority) {
   TaskState *task = AddTask(key, group);
+  task->priority = priority;
   task->callback = std::move(callback);
   task->Init(key, wave_data);
+  task->start_time = timer_.Elapsed();
+  task->audio_seconds = task->task_data->wave_samples->Dim() /
+      task->task_data->sample_frequency;
 
   if (config_.gpu_feature_extract) {
     // Feature extraction done on device
@@ -265,9 +287,14 @@ void BatchedThreadedNnet3CudaPipeline::OpenDecodeHandle(
 void BatchedThreadedNnet3CudaPipeline::OpenDecodeHandle(
     const std::string &key, const VectorBase<BaseFloat> &wave_data,
     float sample_rate, const std::string &group,
-    const std::function<void(CompactLattice &clat)> &callback) {
+    const std::function<void(CompactLattice &clat)> &callback,
+    int32 priority) {
   TaskState *task = AddTask(key, group);
+  task->priority = priority;
   task->Init(key, wave_data, sample_rate);
+  task->start_time = timer_.Elapsed();
+  task->audio_seconds = task->task_data->wave_samples->Dim() /
+      task->task_data->sample_frequency;
   task->callback = std::move(callback);
 
   if (config_.gpu_feature_extract) {
@@ -297,7 +324,7 @@ bool BatchedThreadedNnet3CudaPipeline::GetRawLattice(const std::string &key,
   while (task->finished == false) kaldi::Sleep(SLEEP_BACKOFF_S);
 
   // GetRawLattice on a determinized lattice is not supported (Per email from
-  // DanP)
+  // DanP).  With --output-type=1best the raw lattice is not kept either.
   KALDI_ASSERT(task->determinized == false);
 
   if (task->error) {
@@ -346,29 +373,145 @@ bool BatchedThreadedNnet3CudaPipeline::GetLattice(const std::string &key,
 // Adds task to the PendingTaskQueue
 void BatchedThreadedNnet3CudaPipeline::AddTaskToPendingTaskQueue(
     TaskState *task) {
-  std::lock_guard<std::mutex> lk(tasks_add_mutex_);
+  std::lock_guard<std::mutex> lk(tasks_mutex_);
   if (NumPendingTasks() == config_.max_pending_tasks) {
     // task queue is full launch a new thread to add this task and exit to make
     // room for other work
     work_pool_->enqueue(
+        task->priority > 0 ? THREAD_POOL_HIGH_PRIORITY :
         THREAD_POOL_LOW_PRIORITY,
         &BatchedThreadedNnet3CudaPipeline::AddTaskToPendingTaskQueue, this,
         task);
   } else {
-    // there is room so let's add it
-    // insert into pending task queue
-    pending_task_queue_[tasks_back_] = task;
-    // (int)tasks_back_);
-    tasks_back_ = (tasks_back_ + 1) % (config_.max_pending_tasks + 10);
+    // there is room so let's add it to the lane of its priority
+    pending_lanes_[task->priority].push_back(task);
+    ++num_pending_tasks_;
+    highest_pending_priority_ = pending_lanes_.begin()->first;
     KALDI_ASSERT(NumPendingTasks() <= config_.max_pending_tasks);
+    pending_tasks_metric_->Set(NumPendingTasks());
+  }
+}
+
+bool BatchedThreadedNnet3CudaPipeline::WaitForFullerBatch() {
+  if (config_.batch_max_wait_ms <= 0 || highest_pending_priority_ > 0 ||
+      NumPendingTasks() >= config_.max_batch_size)
+    return false;
+  double oldest_start_time;
+  {
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    if (pending_lanes_.empty()) return false;
+    oldest_start_time = pending_lanes_.begin()->second.front()->start_time;
+    for (auto &lane : pending_lanes_)
+      oldest_start_time = std::min(oldest_start_time,
+                                   lane.second.front()->start_time);
+  }
+  return timer_.Elapsed() - oldest_start_time <
+      config_.batch_max_wait_ms / 1000.0;
+}
+
+bool BatchedThreadedNnet3CudaPipeline::HigherPriorityPending(
+    const std::vector<TaskState *> &tasks, int32 num_tasks) const {
+  int32 highest = highest_pending_priority_;
+  for (int32 i = 0; i < num_tasks; i++)
+    if (tasks[i]->priority < highest) return true;
+  return false;
+}
+
+void BatchedThreadedNnet3CudaPipeline::ResumeParkedTasks(
+    int32 min_priority, ChannelState &channel_state,
+    std::vector<CudaDecodableInterface *> &decodables,
+    std::vector<TaskState *> &tasks) {
+  std::vector<ChannelId> &channels = channel_state.channels;
+  auto &parked = channel_state.parked;
+  size_t num_resumed = 0;
+  // The channels still hold the decoding state, so there is nothing to
+  // initialize.
+  while (num_resumed < parked.size() &&
+         channels.size() < config_.max_batch_size &&
+         parked[num_resumed].first->priority >= min_priority) {
+    TaskState *task = parked[num_resumed].first;
+    tasks.push_back(task);
+    decodables.push_back(parked[num_resumed].second);
+    channels.push_back(task->ichannel);
+    num_resumed++;
+  }
+  parked.erase(parked.begin(), parked.begin() + num_resumed);
+}
+
+void BatchedThreadedNnet3CudaPipeline::PreemptTasks(
+    CudaDecoder &cuda_decoder, ChannelState &channel_state,
+    std::vector<CudaDecodableInterface *> &decodables,
+    std::vector<TaskState *> &tasks) {
+  std::vector<ChannelId> &channels = channel_state.channels;
+  KALDI_ASSERT(tasks.size() == channels.size() &&
+               decodables.size() == channels.size());
+  if (config_.preempt_chunk_frames <= 0 ||
+      !HigherPriorityPending(tasks, tasks.size()))
+    return;
+
+  int32 lowest = std::numeric_limits<int32>::max();
+  for (size_t i = 0; i < tasks.size(); i++)
+    lowest = std::min(lowest, tasks[i]->priority);
+  // The number of pending tasks that may displace one of ours, limited by the
+  // channels they would need.
+  int32 num_wanted = 0;
+  {
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    for (auto &lane : pending_lanes_) {
+      if (lane.first <= lowest) break;
+      num_wanted += lane.second.size();
+    }
   }
+  {
+    std::lock_guard<std::mutex> lk(channel_state.free_channels_mutex);
+    num_wanted = std::min<int32>(num_wanted,
+                                 channel_state.free_channels.size());
+  }
+  num_wanted -= config_.max_batch_size - static_cast<int32>(channels.size());
+  if (num_wanted <= 0) return;
+
+  // Candidates: lowest priority first, then the most frames left.
+  int32 highest = highest_pending_priority_;
+  std::vector<std::pair<std::pair<int32, int32>, int32>> candidates;
+  for (size_t i = 0; i < tasks.size(); i++) {
+    if (tasks[i]->priority >= highest) continue;
+    int32 frames_left = decodables[i]->NumFramesReady() -
+        cuda_decoder.NumFramesDecoded(channels[i]);
+    candidates.push_back({{tasks[i]->priority, -frames_left}, i});
+  }
+  std::sort(candidates.begin(), candidates.end());
+  if (candidates.size() > static_cast<size_t>(num_wanted))
+    candidates.resize(num_wanted);
+
+  std::vector<bool> park(tasks.size(), false);
+  for (size_t i = 0; i < candidates.size(); i++)
+    park[candidates[i].second] = true;
+  auto &parked = channel_state.parked;
+  size_t num_kept = 0;
+  for (size_t i = 0; i < tasks.size(); i++) {
+    if (park[i]) {
+      // Keep 'parked' sorted by decreasing priority, FIFO within a priority.
+      auto it = parked.begin();
+      while (it != parked.end() && it->first->priority >= tasks[i]->priority)
+        ++it;
+      parked.insert(it, {tasks[i], decodables[i]});
+    } else {
+      tasks[num_kept] = tasks[i];
+      decodables[num_kept] = decodables[i];
+      channels[num_kept] = channels[i];
+      num_kept++;
+    }
+  }
+  tasks.resize(num_kept);
+  decodables.resize(num_kept);
+  channels.resize(num_kept);
 }
 
 // Attempts to fill the batch from the task queue.  May not fully fill the
 // batch.
 void BatchedThreadedNnet3CudaPipeline::AquireAdditionalTasks(
     CudaDecoder &cuda_decoder, ChannelState &channel_state,
-    std::vector<TaskState *> &tasks) {
+    std::vector<TaskState *> &tasks, int32 min_priority) {
   std::vector<ChannelId> &channels = channel_state.channels;
   std::vector<ChannelId> &free_channels = channel_state.free_channels;
 
@@ -381,19 +524,19 @@ void BatchedThreadedNnet3CudaPipeline::AquireAdditionalTasks(
     // lock required because front might change from other
     // workers
     std::lock_guard<std::mutex> lock(tasks_mutex_);
-    {
-      // compute number of tasks to grab
-      int tasksAvailable = NumPendingTasks();
-      tasksAssigned = std::min(tasksAvailable, tasksRequested);
-
-      // grab tasks
-      for (int i = 0; i < tasksAssigned; i++) {
-        // pending_task_queue_[tasks_front_]);
-        KALDI_ASSERT(NumPendingTasks() > 0);
-        tasks.push_back(pending_task_queue_[tasks_front_]);
-        tasks_front_ = (tasks_front_ + 1) % (config_.max_pending_tasks + 10);
-      }
+    // grab tasks, highest priority first
+    while (tasksAssigned < tasksRequested && !pending_lanes_.empty() &&
+           pending_lanes_.begin()->first >= min_priority) {
+      auto lane = pending_lanes_.begin();
+      tasks.push_back(lane->second.front());
+      lane->second.pop_front();
+      if (lane->second.empty()) pending_lanes_.erase(lane);
+      tasksAssigned++;
     }
+    num_pending_tasks_ -= tasksAssigned;
+    highest_pending_priority_ = (pending_lanes_.empty() ?
+                                 std::numeric_limits<int32>::min() :
+                                 pending_lanes_.begin()->first);
   }
 
   if (tasksAssigned > 0) {
@@ -619,7 +762,10 @@ void BatchedThreadedNnet3CudaPipeline::ComputeBatchFeatures(
   nvtxRangePop();
 
   nvtxRangePushA("ComputeBatchFeatures");
-  // extract features for each wave
+  // extract features for each wave; the ivectors are computed for all the
+  // waves at once afterwards.
+  std::vector<const CuMatrixBase<BaseFloat>*> batch_features;
+  std::vector<CuVector<BaseFloat>*> batch_ivectors;
   count = 0;
   for (int i = first; i < tasks.size(); i++) {
     TaskState &task = *tasks[i];
@@ -629,8 +775,9 @@ void BatchedThreadedNnet3CudaPipeline::ComputeBatchFeatures(
                                    task_data->wave_samples->Dim());
     count += task_data->wave_samples->Dim();
     feature_pipeline.ComputeFeatures(cu_wave, task_data->sample_frequency,
-                                     &task_data->input_features,
-                                     &task_data->ivector_features);
+                                     &task_data->input_features, NULL);
+    batch_features.push_back(&task_data->input_features);
+    batch_ivectors.push_back(&task_data->ivector_features);
 
     int32 numFrames = task_data->input_features.NumRows();
 
@@ -639,6 +786,7 @@ void BatchedThreadedNnet3CudaPipeline::ComputeBatchFeatures(
       KALDI_WARN << "Warning empty audio file";
     }
   }
+  feature_pipeline.ComputeIvectors(batch_features, batch_ivectors);
   nvtxRangePop();
 }
 
@@ -762,16 +910,35 @@ void BatchedThreadedNnet3CudaPipeline::CompleteTask(CudaDecoder *cuda_decoder,
     channel_state->free_channels.push_back(task->ichannel);
   }
 
-  // If necessary, determinize the lattice
-  if (config_.determinize_lattice) DeterminizeOneLattice(task);
-
-  if (!config_.determinize_lattice) {
+  if (config_.output_type == "1best") {
+    // The best path of the raw lattice is the same as that of the
+    // determinized lattice, so there is no need to determinize.
+    Lattice best_path;
+    fst::ShortestPath(task->lat, &best_path);
+    ConvertLattice(best_path, &task->dlat);
+    task->lat.DeleteStates();
+    task->determinized = true;
+  } else if (config_.determinize_lattice || config_.output_type == "nbest") {
+    // The n-best paths have to be taken from the determinized lattice, or
+    // they would not have distinct word sequences.
+    DeterminizeOneLattice(task);
+  } else {
     ConvertLattice(task->lat, &task->dlat);
   }
 
+  if (config_.output_type == "nbest") {
+    Lattice lat, nbest_lat;
+    ConvertLattice(task->dlat, &lat);
+    fst::ShortestPath(lat, &nbest_lat, config_.num_nbest);
+    ConvertLattice(nbest_lat, &task->dlat);
+  }
+
   if (task->callback)  // if callable
     task->callback(task->dlat);
 
+  audio_seconds_metric_->Increment(task->audio_seconds);
+  tasks_done_metric_->Increment();
+  task_latency_metric_->Observe(timer_.Elapsed() - task->start_time);
   task->finished = true;
 
   {
@@ -796,6 +963,7 @@ void BatchedThreadedNnet3CudaPipeline::DeterminizeOneLattice(TaskState *task) {
 
 void BatchedThreadedNnet3CudaPipeline::ExecuteWorker(int threadId) {
   // Initialize this threads device
+  CuDevice::SetThreadDeviceId(gpu_id_);
   CuDevice::Instantiate();
 
   KALDI_LOG << "CudaDecoder batch_size=" << config_.max_batch_size
@@ -832,6 +1000,20 @@ void BatchedThreadedNnet3CudaPipeline::ExecuteWorker(int threadId) {
     }
   }
 
+  std::ostringstream worker_label;
+  worker_label << "gpu=\"" << gpu_id_ << "\",worker=\"" << threadId
+               << "\"";
+  MetricsRegistry &metrics = MetricsRegistry::Global();
+  MetricGauge *channels_metric = metrics.GetGauge(
+      "kaldi_cuda_channels_in_use", "Decoder channels in use, out of "
+      "--num-channels per worker.", worker_label.str()),
+      *batch_metric = metrics.GetGauge(
+          "kaldi_cuda_batch_size", "Channels decoded in the current batch.",
+          worker_label.str()),
+      *allocator_metric = metrics.GetGauge(
+          "kaldi_cuda_allocated_bytes", "GPU memory allocated by the CUDA "
+          "allocator.", "gpu=\"" + std::to_string(gpu_id_) + "\"");
+
   numStarted_++;  // Tell master I have started
 
   // main control loop.  At each iteration a thread will see if it has been
@@ -849,12 +1031,32 @@ void BatchedThreadedNnet3CudaPipeline::ExecuteWorker(int threadId) {
     // while(free lanes < drain_count)
     // 4) Postprocess any completed work
     do {
+      // With --batch-max-wait-ms, an idle thread may wait for more work so
+      // that it starts with a fuller batch.
+      if (tasks.empty() && channel_state.parked.empty() &&
+          WaitForFullerBatch()) {
+        kaldi::Sleep(SLEEP_BACKOFF_S);
+        break;
+      }
+
       // 1) attempt to fill the batch
-      if (tasks_front_ != tasks_back_) {  // if work is available grab more work
+      if (NumPendingTasks() > 0 || !channel_state.parked.empty()) {
+        // Make room for higher-priority work, then resume the parked tasks
+        // that are not outranked by pending ones.
+        PreemptTasks(cuda_decoder, channel_state, decodables, tasks);
+        ResumeParkedTasks(highest_pending_priority_, channel_state,
+                          decodables, tasks);
 
         int start = tasks.size();  // Save the current assigned tasks size
 
-        AquireAdditionalTasks(cuda_decoder, channel_state, tasks);
+        // Pending tasks go ahead of parked ones only if their priority is
+        // higher.
+        int32 min_priority = (channel_state.parked.empty() ?
+                              std::numeric_limits<int32>::min() :
+                              channel_state.parked.front().first->priority + 1);
+        AquireAdditionalTasks(cuda_decoder, channel_state, tasks,
+                              min_priority);
+        pending_tasks_metric_->Set(NumPendingTasks());
         // New tasks are now in the in tasks[start,tasks.size())
         if (start != tasks.size()) {  // if there are new tasks
           if (config_.gpu_feature_extract)
@@ -862,7 +1064,9 @@ void BatchedThreadedNnet3CudaPipeline::ExecuteWorker(int threadId) {
           ComputeBatchNnet(computer, start, tasks);
           AllocateDecodables(start, tasks, decodables);
         }
-      }  // end if (tasks_front_!=tasks_back_)
+        ResumeParkedTasks(std::numeric_limits<int32>::min(), channel_state,
+                          decodables, tasks);
+      }
 
       // check if there is no active work on this thread.
       // This can happen if another thread was assigned the work.
@@ -881,14 +1085,23 @@ void BatchedThreadedNnet3CudaPipeline::ExecuteWorker(int threadId) {
       try {
         // This is in a loop in case we want to drain the batch a little.
         // Draining the batch will cause initialization tasks to be batched.
+        // With --preempt-chunk-frames we decode a chunk at a time, and go
+        // back to step 1) at a chunk boundary if higher-priority work is
+        // waiting.
+        int32 max_num_frames = (config_.preempt_chunk_frames > 0 ?
+                                config_.preempt_chunk_frames : -1);
         do {
           // 3) Process outstanding work in a batch
           // Advance decoding on all open channels
-          cuda_decoder.AdvanceDecoding(channel_state.channels, decodables);
+          cuda_decoder.AdvanceDecoding(channel_state.channels, decodables,
+                                       max_num_frames);
 
           // Adjust channel state for all completed decodes
           RemoveCompletedChannels(cuda_decoder, channel_state, decodables,
                                   tasks);
+          if (max_num_frames > 0 &&
+              HigherPriorityPending(tasks, channel_state.channels.size()))
+            break;
           // do loop repeates until we meet drain size or run out of work
         } while (config_.max_batch_size - channel_state.channels.size() <
                      config_.batch_drain_size &&
@@ -897,6 +1110,14 @@ void BatchedThreadedNnet3CudaPipeline::ExecuteWorker(int threadId) {
         // copies results outs, and cleans up data structures
         PostDecodeProcessing(cuda_decoder, channel_state, decodables, tasks);
 
+        {
+          std::lock_guard<std::mutex> lk(channel_state.free_channels_mutex);
+          channels_metric->Set(config_.num_channels -
+                               channel_state.free_channels.size());
+        }
+        batch_metric->Set(channel_state.channels.size());
+        allocator_metric->Set(g_cuda_allocator.GetAllocatedMemory());
+
       } catch (CudaDecoderException e) {
         // Code to catch errors.  Most errors are unrecoverable but a user can
         // mark them
@@ -937,7 +1158,9 @@ void BatchedThreadedNnet3CudaPipeline::ExecuteWorker(int threadId) {
           decodables.resize(0);
         }
       }
-    } while (tasks.size() > 0);  // more work don't check exit condition
+    } while (tasks.size() > 0 ||
+             !channel_state.parked.empty());  // more work don't check exit
+                                              // condition
   }                              // end while(!exit_)
 }  // end ExecuteWorker
 
@@ -19,8 +19,12 @@
 #define KALDI_CUDA_DECODER_BATCHED_THREADED_CUDA_DECODER_H_
 
 #include <atomic>
+#include <deque>
+#include <limits>
+#include <map>
 #include <thread>
 
+#include "base/timer.h"
 #include "cudadecoder/cuda-decoder.h"
 #include "decodable-cumatrix.h"
 #include "feat/wave-reader.h"
@@ -29,6 +33,7 @@
 #include "online2/online-nnet2-feature-pipeline.h"
 #include "cudafeat/online-cuda-feature-pipeline.h"
 #include "thread-pool.h"
+#include "util/kaldi-metrics.h"
 
 // If num_channels sets to automatic,
 // num_channels = [this define] * max_batch_size
@@ -53,9 +58,13 @@ struct BatchedThreadedNnet3CudaPipelineConfig {
         num_control_threads(2),
         num_worker_threads(20),
         determinize_lattice(true),
+        output_type("lattice"),
+        num_nbest(10),
         max_pending_tasks(4000),
         num_decoder_copy_threads(2),
-        gpu_feature_extract(true) {};
+        gpu_feature_extract(true),
+        batch_max_wait_ms(0),
+        preempt_chunk_frames(0) {};
   void Register(OptionsItf *po) {
     po->Register("max-batch-size", &max_batch_size,
                  "The maximum batch size to be used by the decoder. "
@@ -83,6 +92,13 @@ struct BatchedThreadedNnet3CudaPipelineConfig {
         "The total number of CPU threads launched to process CPU tasks.");
     po->Register("determinize-lattice", &determinize_lattice,
                  "Determinize the lattice before output.");
+    po->Register("output-type", &output_type,
+                 "What the worker threads return for each utterance: "
+                 "'lattice' (the pruned lattice), 'nbest' (the --num-nbest "
+                 "best paths of the determinized lattice) or '1best' (the "
+                 "best path of the raw lattice; this skips determinization).");
+    po->Register("num-nbest", &num_nbest,
+                 "Number of paths returned if --output-type=nbest.");
     po->Register("max-outstanding-queue-length", &max_pending_tasks,
                  "Number of files to allow to be outstanding at a time. When "
                  "the number of files is larger than this handles will be "
@@ -94,6 +110,20 @@ struct BatchedThreadedNnet3CudaPipelineConfig {
                  "Extract features on the GPU.  This reduces CPU overhead "
                  "leading to better scalability but may reduce overall "
                  "performance for a single GPU.");
+    po->Register("batch-max-wait-ms", &batch_max_wait_ms,
+                 "If >0, an idle control thread waits up to this many "
+                 "milliseconds (measured from the submission of the oldest "
+                 "pending task) for --max-batch-size tasks to be pending "
+                 "before it starts a batch, so that features and the nnet are "
+                 "computed in larger batches.  Tasks with priority > 0 are "
+                 "never held back.");
+    po->Register("preempt-chunk-frames", &preempt_chunk_frames,
+                 "If >0, decode in chunks of this many frames and, when tasks "
+                 "of higher priority are waiting and the batch is full, set "
+                 "aside the lower-priority tasks with the most frames left "
+                 "at a chunk boundary to make room for them; they resume "
+                 "when there is room again.  Needs --num-channels > "
+                 "--max-batch-size.");
 
     feature_opts.Register(po);
     decoder_opts.Register(po);
@@ -106,14 +136,29 @@ struct BatchedThreadedNnet3CudaPipelineConfig {
   int num_control_threads;
   int num_worker_threads;
   bool determinize_lattice;
+  std::string output_type;
+  int num_nbest;
   int max_pending_tasks;
   int num_decoder_copy_threads;
   bool gpu_feature_extract;
+  int batch_max_wait_ms;
+  int preempt_chunk_frames;
 
   void ComputeConfig() {
     if (num_channels == -1)
       num_channels =
           max_batch_size * KALDI_CUDA_DECODER_CHANNELS_BATCH_SIZE_RATIO;
+    if (output_type != "lattice" && output_type != "nbest" &&
+        output_type != "1best")
+      KALDI_ERR << "Invalid --output-type '" << output_type
+                << "', expected lattice, nbest or 1best.";
+    if (output_type == "nbest" && num_nbest <= 0)
+      KALDI_ERR << "Invalid --num-nbest=" << num_nbest;
+    if (batch_max_wait_ms < 0 || preempt_chunk_frames < 0)
+      KALDI_ERR << "Invalid --batch-max-wait-ms or --preempt-chunk-frames";
+    if (preempt_chunk_frames > 0 && num_channels <= max_batch_size)
+      KALDI_WARN << "--preempt-chunk-frames has no effect unless "
+                 << "--num-channels > --max-batch-size.";
   }
 
   OnlineNnet2FeaturePipelineConfig feature_opts;      // constant readonly
@@ -167,18 +212,23 @@ public:
  // 	// write lattice to disk
  //    // lock is released in the destructor of lock_guard<>
  // }
+ // Tasks are started in order of decreasing priority, and in FIFO order
+ // within a priority; e.g. interactive requests may be given priority 1 and
+ // bulk jobs the default of 0.  See also --preempt-chunk-frames.
  void OpenDecodeHandle(
      const std::string &key, const WaveData &wave_data,
      const std::string &group = std::string(),
      const std::function<void(CompactLattice &clat)> &callback =
-         std::function<void(CompactLattice &clat)>());
+         std::function<void(CompactLattice &clat)>(),
+     int32 priority = 0);
  // When passing in a vector of data, the caller must ensure the data exists
  // until the CloseDecodeHandle is called
  void OpenDecodeHandle(
      const std::string &key, const VectorBase<BaseFloat> &wave_data,
      float sample_rate, const std::string &group = std::string(),
      const std::function<void(CompactLattice &clat)> &callback =
-         std::function<void(CompactLattice &clat)>());
+         std::function<void(CompactLattice &clat)>(),
+     int32 priority = 0);
 
  // Copies the raw lattice for decoded handle "key" into lat
  bool GetRawLattice(const std::string &key, Lattice *lat);
@@ -197,10 +247,7 @@ public:
  std::string WaitForAnyGroup();
  // Check if any group is available. If one is available, set its name in *group
  bool IsAnyGroupCompleted(std::string *group);
- inline int NumPendingTasks() {
-   return (tasks_back_ - tasks_front_ + config_.max_pending_tasks + 1) %
-          (config_.max_pending_tasks + 1);
-  };
+ inline int NumPendingTasks() { return num_pending_tasks_; }
 
 private:
  // Task data used during computation
@@ -255,6 +302,7 @@ private:
  struct TaskState {
    std::string key;
    std::string group;  // group for that task. "" is default
+   int32 priority;     // see OpenDecodeHandle()
    bool error;
    std::string error_string;
 
@@ -263,19 +311,26 @@ private:
    int32 ichannel;              // associated CudaDecoder channel
    Lattice lat;                 // Raw Lattice output
    CompactLattice dlat;         // Determinized lattice output.  Only set if
-                                // determinize-lattice=true
+                                // determinize-lattice=true, or if
+                                // output-type is nbest or 1best, in which
+                                // case it contains just those paths.
    std::atomic<bool> finished;  // Tells master thread if task has finished
                                 // execution
 
    bool determinized;
 
+   double start_time;     // when OpenDecodeHandle() was called, for metrics.
+   double audio_seconds;  // the length of the audio.
+
    // (optional) callback is called task is finished and we have a lattice
    // ready
    // that way we can compute all CPU tasks in the threadpool (lattice
    // rescoring, find best path in lattice, etc.)
    std::function<void(CompactLattice &clat)> callback;
 
-   TaskState() : error(false), finished(false), determinized(false) {}
+   TaskState() : priority(0), error(false), finished(false),
+                 determinized(false),
+                 start_time(0.0), audio_seconds(0.0) {}
 
    // Init when wave data is passed directly in.  This data is deep copied.
    void Init(const std::string &key_in, const WaveData &wave_data_in) {
@@ -299,16 +354,44 @@ private:
     std::vector<ChannelId> free_channels;
     std::vector<ChannelId> completed_channels;
     std::mutex free_channels_mutex;
+    // Tasks set aside by PreemptTasks(), with their decodables; they keep
+    // their channels.  Sorted by decreasing priority.
+    std::vector<std::pair<TaskState *, CudaDecodableInterface *>> parked;
   };
 
   // Adds task to the PendingTaskQueue
   void AddTaskToPendingTaskQueue(TaskState *task);
 
-  // Attempts to fill the batch from the task queue.  May not fully fill the
-  // batch.
+  // Attempts to fill the batch from the task queue, highest priority first.
+  // May not fully fill the batch.
+  // Only tasks of priority at least 'min_priority' are taken.
   void AquireAdditionalTasks(CudaDecoder &cuda_decoder,
                              ChannelState &channel_state,
-                             std::vector<TaskState *> &tasks);
+                             std::vector<TaskState *> &tasks,
+                             int32 min_priority);
+
+  // Returns true if an idle control thread should wait for more tasks before
+  // starting a batch (see --batch-max-wait-ms).
+  bool WaitForFullerBatch();
+
+  // Puts parked tasks (see PreemptTasks()) whose priority is at least
+  // 'min_priority' back into the batch, while there is room.
+  void ResumeParkedTasks(int32 min_priority, ChannelState &channel_state,
+                         std::vector<CudaDecodableInterface *> &decodables,
+                         std::vector<TaskState *> &tasks);
+
+  // If the batch is full and tasks of higher priority than some of those in
+  // it are pending, parks enough of the lower-priority tasks (those with the
+  // most frames left first) to make room for them.  Only called between
+  // chunks of --preempt-chunk-frames frames.
+  void PreemptTasks(CudaDecoder &cuda_decoder, ChannelState &channel_state,
+                    std::vector<CudaDecodableInterface *> &decodables,
+                    std::vector<TaskState *> &tasks);
+
+  // True if a pending task has a higher priority than one of the first
+  // 'num_tasks' of 'tasks'.
+  bool HigherPriorityPending(const std::vector<TaskState *> &tasks,
+                             int32 num_tasks) const;
 
   // Computes Features for a single decode instance.
   void ComputeOneFeatureCPU(TaskState *task);
@@ -360,17 +443,30 @@ private:
   nnet3::DecodableNnetSimpleLoopedInfo *decodable_info_;
   OnlineNnet2FeaturePipelineInfo *feature_info_;
 
-  std::mutex tasks_mutex_; // protects tasks_front_ and pending_task_queue_ for
-                           // workers
-  std::mutex tasks_add_mutex_; // protect OpenDecodeHandle if multiple threads
-                               // access
+  std::mutex tasks_mutex_; // protects pending_lanes_
   std::mutex tasks_lookup_mutex_; // protext tasks_lookup map
   std::condition_variable tasks_lookup_cv_;
-  std::atomic<int> tasks_front_, tasks_back_;
-  TaskState **pending_task_queue_;
+  // The tasks waiting for a channel: one FIFO lane per priority, highest
+  // priority first.  Empty lanes are erased.
+  std::map<int32, std::deque<TaskState *>, std::greater<int32>> pending_lanes_;
+  std::atomic<int> num_pending_tasks_;
+  // The priority of the first lane of pending_lanes_, or
+  // std::numeric_limits<int32>::min() if there are no pending tasks.
+  std::atomic<int32> highest_pending_priority_;
+
+  // Runtime metrics, in MetricsRegistry::Global(); the programs may serve
+  // them with a MetricsHttpServer.  The per-worker ones are in
+  // ExecuteWorker().
+  Timer timer_;  // for the start times of the tasks.
+  MetricGauge *pending_tasks_metric_;
+  MetricCounter *audio_seconds_metric_;
+  MetricCounter *tasks_done_metric_;
+  MetricHistogram *task_latency_metric_;
 
   std::atomic<bool> exit_;      // signals threads to exit
   std::atomic<int> numStarted_; // signals master how many threads have started
+  int32 gpu_id_;  // the GPU of the thread that called Initialize(), used by
+                 // the control threads (see CuDevice::SetThreadDeviceId())
 
   ThreadPool *work_pool_; // thread pool for CPU work
   std::map<std::string, int32> group_tasks_not_done_;
@@ -36,6 +36,10 @@
 #define KALDI_CUDA_DECODER_MAX_ACTIVE_MAIN_Q_CAPACITY_FACTOR 4
 #define KALDI_CUDA_DECODER_AUX_Q_MAIN_Q_CAPACITIES_FACTOR 3
 
+// The main_q of a channel is saved in a pool shared by all channels, in pages
+// of that many tokens. A channel only uses the pages it needs
+#define KALDI_CUDA_DECODER_POOL_PAGE_SIZE 1024
+
 // If we're at risk of filling the tokens queue,
 // the beam is reduced to keep only the best candidates in the
 // remaining space
@@ -240,6 +244,36 @@ class DeviceMatrix {
     KALDI_ASSERT(data_);
     return data_;
   }
+
+  int32 NumRows() const { return nrows_; }
+
+  // Grows the matrix to at least nrows rows, at least doubling its size to
+  // amortize the reallocations. If keep_content, the old content is copied
+  // asynchronously on st. Kernels queued on st may still use the old buffer,
+  // so it is not freed here but appended to *retired: the caller frees it
+  // (CuDevice::Instantiate().Free()) once st has been synchronized
+  void Grow(int32 nrows, bool keep_content, cudaStream_t st,
+            std::vector<void *> *retired) {
+    if (nrows <= nrows_) return;
+    T *old_data = data_;
+    const size_t old_size = (size_t)nrows_ * ncols_ * sizeof(*data_);
+    data_ = NULL;
+    nrows_ = std::max(nrows, 2 * nrows_);
+    ncols_ = std::max(ncols_, 1);
+    Allocate();
+    if (old_data) {
+      if (keep_content)
+        KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpyAsync(
+            data_, old_data, old_size, cudaMemcpyDeviceToDevice, st));
+      retired->push_back(old_data);
+    }
+  }
+
+  void Swap(DeviceMatrix<T> *other) {
+    std::swap(data_, other->data_);
+    std::swap(nrows_, other->nrows_);
+    std::swap(ncols_, other->ncols_);
+  }
   // abstract getInterface...
 };
 
@@ -345,6 +379,19 @@ class DeviceChannelMatrix : public DeviceMatrix<T> {
   }
 };
 
+struct InfoToken;
+
+// Used with --gpu-lattice. Points to the tokens of all the frames of a channel,
+// stored on device. Same content as the h_all_tokens_* vectors in CudaDecoder,
+// indexed by global token index (cf main_q_global_offset) and global extra prev
+// tokens index (cf main_q_extra_prev_tokens_global_offset)
+struct DeviceTokensStorageView {
+  InfoToken *info;
+  CostType *acoustic_cost;
+  InfoToken *extra_prev_tokens;
+  float2 *extra_and_acoustic_cost;
+};
+
 // LaneCounters/ChannelCounters
 // The counters are all the singular values associated to a lane/channel
 // For instance  the main queue size. Or the min_cost of all tokens in that
@@ -422,6 +469,8 @@ struct LaneCounters {
   int32 main_q_end_lane_offset;
   int32 main_q_n_emitting_tokens_lane_offset;
   int32 main_q_n_extra_prev_tokens_lane_offset;
+  // Where to store the main_q at the end of each frame, with --gpu-lattice
+  DeviceTokensStorageView tokens_storage;
 
   // --- Only valid after calling GetBestCost
   // min_cost and its arg. Can be different than min_cost, because we may
@@ -511,6 +560,58 @@ __device__ __inline__ void SetSameFSTStateTokensList(int32 offset, int32 size,
   *info_token = {offset, -size};
 }
 
+// Raw lattice built on device with --gpu-lattice (cf output_lattice_kernel)
+// An arc of the raw lattice. Its weight is
+// (fst.arc_weights[arc_idx], acoustic_cost)
+struct __align__(16) DeviceLatticeArc {
+  int32 src_state;
+  int32 dst_state;
+  int32 arc_idx;
+  CostType acoustic_cost;
+};
+
+// A final state of the raw lattice, with weight (final_cost, 0)
+struct __align__(8) DeviceLatticeFinal {
+  int32 state;
+  CostType final_cost;
+};
+
+// Data used by the lattice kernels for a lane, set by
+// CudaDecoder::SetLanesLatticeParams. The kernels write the outputs (counts)
+// into the device copy.
+// A lattice state is identified internally as in
+// CudaDecoder::GetLatticeStateInternalId: token_idx if the token is the only
+// one for its (frame, fst state), ntokens + offset of its extra prev tokens
+// list otherwise. The internal id 0 is the start state (token 0)
+struct LaneLatticeParams {
+  DeviceTokensStorageView tokens;
+  int32 ntokens;
+  int32 n_extra_prev_tokens;
+  int32 nframes;
+  // The tokens of frame f (f = -1..nframes-1) are
+  // [frame_offsets[f+1], frame_offsets[f+2][
+  int32 *frame_offsets;
+  // ntokens + n_extra_prev_tokens elements, indexed by internal state id.
+  // state_int_extra_cost is the min extra cost of a path from that state to
+  // the end (as an ordered int), INT_MAX if the state is not in the lattice.
+  // state_id is the state in the output lattice.
+  int32 *state_int_extra_cost;
+  int32 *state_id;
+  // n_extra_prev_tokens elements. list_owner[offset] is the first token
+  // using the extra prev tokens list starting at offset. That token is the
+  // one processing the list
+  int32 *list_owner;
+  // Outputs
+  DeviceLatticeArc *arcs;
+  DeviceLatticeFinal *finals;
+  // Arcs indexes of the best path, from the last frame to the first
+  int32 *best_path;
+  int32 nstates;
+  int32 narcs;
+  int32 nfinals;
+  int32 best_path_length;
+};
+
 // Used to store the index in the GPU hashmap of that FST state
 // The hashmap is only generated with the final main queue (post max_active_) of
 // each frame
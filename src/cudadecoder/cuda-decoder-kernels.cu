@@ -87,39 +87,66 @@ __global__ void initialize_initial_lane_kernel(DeviceParams cst_dev_params) {
 // Called when some channels will start decoding a new utterance
 // do everything that's needed to do on the device to start decoding a new
 // utterance with those channels
-// It clones the initial channel (created in initialize_initial_lane_kernel)
-// into the channels we want to InitDecoding on
+// The main_q of the initial channel (created in initialize_initial_lane_kernel)
+// is shared through the pool pages (see CudaDecoder::InitDecoding),
+// we only have to clone its counters
+// THREADS : (1, 1, 1)
+// BLOCKS : (1, nlanes_used, 1)
 __global__ void init_decoding_on_device_kernel(DeviceParams cst_dev_params,
                                                KernelParams params) {
   const int init_ichannel = cst_dev_params.init_channel_id;
-
   const ChannelCounters *init_channel_counters =
       cst_dev_params.d_channels_counters.channel(init_ichannel);
-  const int32 init_main_q_end =
-      init_channel_counters->prev_main_q_narcs_and_end.y;
   const int32 nlanes = params.nlanes_used;
   KALDI_CUDA_DECODER_BATCH_KERNEL_LOOP(ilane, nlanes) {
-    KALDI_CUDA_DECODER_1D_KERNEL_LOOP(idx, init_main_q_end) {
-      const LaneCounters *lane_counters =
-          cst_dev_params.d_lanes_counters.lane(ilane);
-      const int32 ichannel = lane_counters->channel_to_compute;
-      cst_dev_params.d_main_q_state_and_cost.channel(ichannel)[idx] =
-          cst_dev_params.d_main_q_state_and_cost.channel(init_ichannel)[idx];
-      cst_dev_params.d_main_q_degrees_prefix_sum.channel(ichannel)[idx] =
-          cst_dev_params.d_main_q_degrees_prefix_sum.channel(
-              init_ichannel)[idx];
-      cst_dev_params.d_main_q_arc_offsets.channel(ichannel)[idx] =
-          cst_dev_params.d_main_q_arc_offsets.channel(init_ichannel)[idx];
-      if (idx == 0) {
-        ChannelCounters *channel_counters =
-            cst_dev_params.d_channels_counters.channel(ichannel);
-        channel_counters->prev_main_q_narcs_and_end =
-            init_channel_counters->prev_main_q_narcs_and_end;
-        channel_counters->prev_main_q_n_extra_prev_tokens =
-            init_channel_counters->prev_main_q_n_extra_prev_tokens;
-        channel_counters->prev_main_q_global_offset = 0;
-        channel_counters->prev_main_q_extra_prev_tokens_global_offset = 0;
-        channel_counters->prev_beam = cst_dev_params.default_beam;
+    const LaneCounters *lane_counters =
+        cst_dev_params.d_lanes_counters.lane(ilane);
+    const int32 ichannel = lane_counters->channel_to_compute;
+    ChannelCounters *channel_counters =
+        cst_dev_params.d_channels_counters.channel(ichannel);
+    channel_counters->prev_main_q_narcs_and_end =
+        init_channel_counters->prev_main_q_narcs_and_end;
+    channel_counters->prev_main_q_n_extra_prev_tokens =
+        init_channel_counters->prev_main_q_n_extra_prev_tokens;
+    channel_counters->prev_main_q_global_offset = 0;
+    channel_counters->prev_main_q_extra_prev_tokens_global_offset = 0;
+    channel_counters->prev_beam = cst_dev_params.default_beam;
+  }
+}
+
+// Context switch : moving a main_q between a lane and the pool
+// Called by LoadChannelsStateToLanes (LOAD == true, pool -> lane)
+// and SaveChannelsStateFromLanes (LOAD == false, lane -> pool)
+// d_main_q_pages.lane(ilane) contains the number of tokens to move, followed by
+// the list of the pool pages of the channel. Token idx is stored in page
+// pages[idx / KALDI_CUDA_DECODER_POOL_PAGE_SIZE], at offset
+// idx % KALDI_CUDA_DECODER_POOL_PAGE_SIZE
+template <bool LOAD>
+__global__ void copy_main_q_pages_kernel(DeviceParams cst_dev_params,
+                                         KernelParams params) {
+  const int nlanes = params.nlanes_used;
+  KALDI_CUDA_DECODER_BATCH_KERNEL_LOOP(ilane, nlanes) {
+    const int32 *pages = cst_dev_params.d_main_q_pages.lane(ilane);
+    const int32 ntokens = pages[0];
+    KALDI_CUDA_DECODER_1D_KERNEL_LOOP(idx, ntokens) {
+      const int32 page = pages[1 + idx / KALDI_CUDA_DECODER_POOL_PAGE_SIZE];
+      const size_t pool_idx =
+          (size_t)page * KALDI_CUDA_DECODER_POOL_PAGE_SIZE +
+          idx % KALDI_CUDA_DECODER_POOL_PAGE_SIZE;
+      int2 *state_and_cost = cst_dev_params.d_main_q_state_and_cost.lane(ilane);
+      int32 *degrees_prefix_sum =
+          cst_dev_params.d_main_q_degrees_prefix_sum.lane(ilane);
+      int32 *arc_offsets = cst_dev_params.d_main_q_arc_offsets.lane(ilane);
+      if (LOAD) {
+        state_and_cost[idx] = cst_dev_params.d_pool_state_and_cost[pool_idx];
+        degrees_prefix_sum[idx] =
+            cst_dev_params.d_pool_degrees_prefix_sum[pool_idx];
+        arc_offsets[idx] = cst_dev_params.d_pool_arc_offsets[pool_idx];
+      } else {
+        cst_dev_params.d_pool_state_and_cost[pool_idx] = state_and_cost[idx];
+        cst_dev_params.d_pool_degrees_prefix_sum[pool_idx] =
+            degrees_prefix_sum[idx];
+        cst_dev_params.d_pool_arc_offsets[pool_idx] = arc_offsets[idx];
       }
     }
   }
@@ -400,19 +427,19 @@ __global__ void nonemitting_preprocess_and_contract_kernel(
         cst_dev_params.d_main_q_info.lane(ilane)[main_q_idx] = tok_info;
 
         // Moving the token to the main q
-        cst_dev_params.d_main_q_state_and_cost.channel(ichannel)[main_q_idx] = {
+        cst_dev_params.d_main_q_state_and_cost.lane(ilane)[main_q_idx] = {
             token_state, token_int_cost};
         cst_dev_params.d_main_q_acoustic_cost.lane(ilane)[main_q_idx] =
             acoustic_cost;
         // Saving the global prefix sum
         const int32 prefix_sum_narcs =
             sh_main_q_global_block_offset.x + block_prefix_sum_narcs_and_end.x;
-        cst_dev_params.d_main_q_degrees_prefix_sum.channel(
-            ichannel)[main_q_idx] = prefix_sum_narcs;
+        cst_dev_params.d_main_q_degrees_prefix_sum.lane(
+            ilane)[main_q_idx] = prefix_sum_narcs;
         // Saving the CSR arc offset for that token's state
         // it will be used by the expand kernel, and avoid doing a new random
         // memory access in the expand kernel
-        cst_dev_params.d_main_q_arc_offsets.channel(ichannel)[main_q_idx] =
+        cst_dev_params.d_main_q_arc_offsets.lane(ilane)[main_q_idx] =
             arc_start;
       }
     }
@@ -519,7 +546,7 @@ __global__ void reset_for_frame_and_estimate_cutoff_kernel(
     }
     const int32 prev_arg_min = lane_counters->prev_arg_min_int_cost;
     int2 both =
-        cst_dev_params.d_main_q_state_and_cost.channel(ichannel)[prev_arg_min];
+        cst_dev_params.d_main_q_state_and_cost.lane(ilane)[prev_arg_min];
     int32 int_cost = both.y;
     CostType previous_cost = orderedIntToFloat(int_cost);
     const int32 prev_arg_min_state = both.x;
@@ -681,7 +708,7 @@ __global__ void expand_arcs_kernel(DeviceParams cst_dev_params,
         // we could preprocess the search in the preprocess kernels - for now
         // this kernel is fast enough
         const int32 *degrees_prefix_sum =
-            cst_dev_params.d_main_q_degrees_prefix_sum.channel(ichannel);
+            cst_dev_params.d_main_q_degrees_prefix_sum.lane(ilane);
         main_q_idx = binsearch_maxle(degrees_prefix_sum, main_q_arc_index,
                                      main_q_offset, main_q_end - 1);
 
@@ -697,7 +724,7 @@ __global__ void expand_arcs_kernel(DeviceParams cst_dev_params,
         // related to the state main_q_state_[main_q_idx]
         // it was set by the preprocess kernel
         const int32 arc_offset_start =
-            cst_dev_params.d_main_q_arc_offsets.channel(ichannel)[main_q_idx];
+            cst_dev_params.d_main_q_arc_offsets.lane(ilane)[main_q_idx];
 
         // local_arc_index is the arc index for that state
         // if local_arc_index == 2, we will process the second arc
@@ -715,11 +742,11 @@ __global__ void expand_arcs_kernel(DeviceParams cst_dev_params,
         // we'll add the acoustic cost and the old token's cost
         const CostType arc_fixed_cost = cst_dev_params.d_arc_weights[arc_idx];
         const CostType prev_token_cost = orderedIntToFloat(
-            cst_dev_params.d_main_q_state_and_cost.channel(ichannel)[main_q_idx]
+            cst_dev_params.d_main_q_state_and_cost.lane(ilane)[main_q_idx]
                 .y);
         CostType total_cost = prev_token_cost + arc_fixed_cost;
         const int32 prev_state =
-            cst_dev_params.d_main_q_state_and_cost.channel(ichannel)[main_q_idx]
+            cst_dev_params.d_main_q_state_and_cost.lane(ilane)[main_q_idx]
                 .x;
         if (IS_EMITTING) {
           const int32 arc_ilabel = cst_dev_params.d_arc_pdf_ilabels[arc_idx];
@@ -987,14 +1014,14 @@ __launch_bounds__(KALDI_CUDA_DECODER_LARGEST_1D_BLOCK, 1) __global__
         int32 main_q_idx;
         if (main_q_arc_idx < main_q_narcs) {
           main_q_idx = binsearch_maxle(
-              cst_dev_params.d_main_q_degrees_prefix_sum.channel(ichannel),
+              cst_dev_params.d_main_q_degrees_prefix_sum.lane(ilane),
               main_q_arc_idx, main_q_local_offset, main_q_end - 1);
 
           const int32 state_first_arc_idx_in_main_q =
-              cst_dev_params.d_main_q_degrees_prefix_sum.channel(
-                  ichannel)[main_q_idx];
+              cst_dev_params.d_main_q_degrees_prefix_sum.lane(
+                  ilane)[main_q_idx];
           const int32 arc_offset_start =
-              cst_dev_params.d_main_q_arc_offsets.channel(ichannel)[main_q_idx];
+              cst_dev_params.d_main_q_arc_offsets.lane(ilane)[main_q_idx];
           arc_idx = arc_offset_start +
                     (main_q_arc_idx - state_first_arc_idx_in_main_q);
 
@@ -1002,7 +1029,7 @@ __launch_bounds__(KALDI_CUDA_DECODER_LARGEST_1D_BLOCK, 1) __global__
           CostType arc_weight = cst_dev_params.d_arc_weights[arc_idx];
           CostType prev_token_cost =
               orderedIntToFloat(cst_dev_params.d_main_q_state_and_cost
-                                    .channel(ichannel)[main_q_idx]
+                                    .lane(ilane)[main_q_idx]
                                     .y);
           total_int_cost = floatToOrderedInt(arc_weight + prev_token_cost);
 	  if(total_int_cost < lane_counters->min_int_cost)
@@ -1082,12 +1109,12 @@ __launch_bounds__(KALDI_CUDA_DECODER_LARGEST_1D_BLOCK, 1) __global__
           const int32 local_main_q_idx = narcs_and_ntokens_prefix_sum.y;
           const int32 main_q_idx = main_q_end + local_main_q_idx;
 
-          cst_dev_params.d_main_q_arc_offsets.channel(ichannel)[main_q_idx] =
+          cst_dev_params.d_main_q_arc_offsets.lane(ilane)[main_q_idx] =
               start;
-          cst_dev_params.d_main_q_degrees_prefix_sum.channel(
-              ichannel)[main_q_idx] = degree_prefix_sum;
-          cst_dev_params.d_main_q_state_and_cost.channel(
-              ichannel)[main_q_idx] = {token_state, token_int_cost};
+          cst_dev_params.d_main_q_degrees_prefix_sum.lane(
+              ilane)[main_q_idx] = degree_prefix_sum;
+          cst_dev_params.d_main_q_state_and_cost.lane(
+              ilane)[main_q_idx] = {token_state, token_int_cost};
           cst_dev_params.d_main_q_info.lane(ilane)[main_q_idx] =
               cst_dev_params.d_aux_q_info.lane(ilane)[aux_q_idx];
           cst_dev_params.d_main_q_acoustic_cost.lane(ilane)[main_q_idx] =
@@ -1137,7 +1164,7 @@ __global__ void get_best_cost_step1_kernel(DeviceParams cst_dev_params,
         lane_counters->n_within_lattice_beam =
             0;  // will be used in the next kernel
       const int2 both =
-          cst_dev_params.d_main_q_state_and_cost.channel(ichannel)[idx];
+          cst_dev_params.d_main_q_state_and_cost.lane(ilane)[idx];
       const int token_state = both.x;
       const int token_int_cost = both.y;
       CostType cost = orderedIntToFloat(token_int_cost);
@@ -1210,7 +1237,7 @@ __global__ void get_best_cost_step2_kernel(DeviceParams cst_dev_params,
       }
       // Looking for a token with its int_cost < lattice_int_cutoff
       const int2 both =
-          cst_dev_params.d_main_q_state_and_cost.channel(ichannel)[idx];
+          cst_dev_params.d_main_q_state_and_cost.lane(ilane)[idx];
       const int32 token_state = both.x;
       int32 token_int_cost = both.y;
       if (compute_final) {
@@ -1292,7 +1319,7 @@ __global__ void compute_costs_histogram_kernel(DeviceParams cst_dev_params,
             use_aux_q
                 ? cst_dev_params.d_aux_q_state_and_cost.lane(ilane)[q_idx].y
                 : cst_dev_params.d_main_q_state_and_cost
-                      .channel(ichannel)[q_idx]
+                      .lane(ilane)[q_idx]
                       .y;
         CostType cost = orderedIntToFloat(int_cost);
         CostType extra = cost - min_histo_cost;
@@ -1405,8 +1432,8 @@ __global__ void fill_hashmap_with_main_q_kernel(DeviceParams cst_dev_params,
     KALDI_CUDA_DECODER_1D_KERNEL_LOOP(main_q_idx, main_q_end) {
       // Position of considered token in the main_q
       if (main_q_idx < main_q_end) {
-        int2 both = cst_dev_params.d_main_q_state_and_cost.channel(
-            ichannel)[main_q_idx];
+        int2 both = cst_dev_params.d_main_q_state_and_cost.lane(
+            ilane)[main_q_idx];
         StateId token_state = both.x;
         IntegerCostType token_int_cost = both.y;
         if (min_int_cost == token_int_cost) {
@@ -1427,7 +1454,7 @@ __global__ void fill_hashmap_with_main_q_kernel(DeviceParams cst_dev_params,
                                     &hash_idx);
         cst_dev_params.d_main_q_n_extra_prev_tokens_local_idx.lane(
             ilane)[main_q_idx] = local_idx;
-        cst_dev_params.d_main_q_state_and_cost.channel(ichannel)[main_q_idx].y =
+        cst_dev_params.d_main_q_state_and_cost.lane(ilane)[main_q_idx].y =
             token_int_cost;
         // If we have the min, saving its index for get best cost and the min
         // cost estimate of the next frame
@@ -1521,8 +1548,8 @@ __global__ void emitting_preprocess_and_list_extra_prev_tokens_step1_kernel(
       // then n_extra_prev_token will contain their count
       int32 n_extra_prev_token = 0;
       if (main_q_idx < main_q_end) {
-        int2 both = cst_dev_params.d_main_q_state_and_cost.channel(
-            ichannel)[main_q_idx];
+        int2 both = cst_dev_params.d_main_q_state_and_cost.lane(
+            ilane)[main_q_idx];
         StateId token_state = both.x;
         IntegerCostType token_int_cost = both.y;
         // Loading info about token.next_state. Is there multiple tokens for
@@ -1559,7 +1586,7 @@ __global__ void emitting_preprocess_and_list_extra_prev_tokens_step1_kernel(
             degree = end - start;
             // Saving the start offset for the expand kernel
             // avoid a new random memory access
-            cst_dev_params.d_main_q_arc_offsets.channel(ichannel)[main_q_idx] =
+            cst_dev_params.d_main_q_arc_offsets.lane(ilane)[main_q_idx] =
                 start;
           }
           // If that FST state has only one token associated to it, we store
@@ -1585,8 +1612,8 @@ __global__ void emitting_preprocess_and_list_extra_prev_tokens_step1_kernel(
       if (main_q_idx < main_q_end) {
         // This is not the final global prefix sum
         // Other kernels will add the necessary offset
-        cst_dev_params.d_main_q_degrees_prefix_sum.channel(
-            ichannel)[main_q_idx] = degree_local_prefix_sum;
+        cst_dev_params.d_main_q_degrees_prefix_sum.lane(
+            ilane)[main_q_idx] = degree_local_prefix_sum;
         cst_dev_params.d_main_q_extra_prev_tokens_prefix_sum.lane(
             ilane)[main_q_idx] = n_extra_prev_token_prefix_sum;
       }
@@ -1681,8 +1708,8 @@ __global__ void emitting_preprocess_and_list_extra_prev_tokens_step3_kernel(
 			const int2 local_sum_offset =
 				cst_dev_params.d_main_q_block_sums_prefix_sum.lane(
 						ilane)[local_sum_idx];
-			cst_dev_params.d_main_q_degrees_prefix_sum.channel(
-					ichannel)[main_q_idx] += local_sum_offset.x;
+			cst_dev_params.d_main_q_degrees_prefix_sum.lane(
+					ilane)[main_q_idx] += local_sum_offset.x;
 			int extra_prev_tokens_offset =
 				cst_dev_params.d_main_q_extra_prev_tokens_prefix_sum.lane(
 						ilane)[main_q_idx] +
@@ -1758,7 +1785,7 @@ __global__ void emitting_preprocess_and_list_extra_prev_tokens_step4_kernel(
         // Generating and saving that extra cost. We will use it when generating
         // the lattice.
         CostType token_cost = orderedIntToFloat(
-            cst_dev_params.d_main_q_state_and_cost.channel(ichannel)[main_q_idx]
+            cst_dev_params.d_main_q_state_and_cost.lane(ilane)[main_q_idx]
                 .y);
 	uint32_t best_int_cost;
         // Where to write this state list in d_main_q_extra_prev_tokens
@@ -1828,6 +1855,384 @@ __global__ void clear_hashmap_kernel(DeviceParams cst_dev_params,
   }
 }
 
+// Used with --gpu-lattice, instead of the concatenate + D2H copies.
+// Called at the end of each frame (after PostProcessingMainQueue)
+// Appends the main_q data needed by GetRawLattice/GetBestPath to the device
+// storage of the channel. Same data than what is moved to the
+// h_all_tokens_* vectors otherwise (acoustic costs are 0 for non emitting
+// tokens)
+__global__ void copy_main_q_to_tokens_storage_kernel(
+    DeviceParams cst_dev_params, KernelParams params) {
+  const int nlanes = params.nlanes_used;
+  KALDI_CUDA_DECODER_BATCH_KERNEL_LOOP(ilane, nlanes) {
+    const LaneCounters *lane_counters =
+        cst_dev_params.d_lanes_counters.lane(ilane);
+    const DeviceTokensStorageView storage = lane_counters->tokens_storage;
+    const int32 main_q_end = lane_counters->main_q_narcs_and_end.y;
+    const int32 n_emitting_tokens = lane_counters->main_q_n_emitting_tokens;
+    const int32 global_offset = lane_counters->main_q_global_offset;
+    KALDI_CUDA_DECODER_1D_KERNEL_LOOP(main_q_idx, main_q_end) {
+      storage.info[global_offset + main_q_idx] =
+          cst_dev_params.d_main_q_info.lane(ilane)[main_q_idx];
+      storage.acoustic_cost[global_offset + main_q_idx] =
+          (main_q_idx < n_emitting_tokens)
+              ? cst_dev_params.d_main_q_acoustic_cost.lane(ilane)[main_q_idx]
+              : 0.0f;
+    }
+    const int32 n_extra_prev_tokens = lane_counters->main_q_n_extra_prev_tokens;
+    const int32 extra_prev_tokens_global_offset =
+        lane_counters->main_q_extra_prev_tokens_global_offset;
+    KALDI_CUDA_DECODER_1D_KERNEL_LOOP(list_idx, n_extra_prev_tokens) {
+      storage.extra_prev_tokens[extra_prev_tokens_global_offset + list_idx] =
+          cst_dev_params.d_main_q_extra_prev_tokens.lane(ilane)[list_idx];
+      storage.extra_and_acoustic_cost[extra_prev_tokens_global_offset +
+                                      list_idx] =
+          cst_dev_params.d_main_q_extra_and_acoustic_cost.lane(
+              ilane)[list_idx];
+    }
+  }
+}
+
+// Device version of CudaDecoder::GetLatticeStateInternalId. The start token
+// (token 0) is the start state, internal id 0
+__device__ __inline__ int32 GetLatticeStateInternalIdOnDevice(
+    const LaneLatticeParams &lat, int32 token_idx) {
+  if (token_idx == 0) return 0;
+  const InfoToken token = lat.tokens.info[token_idx];
+  return (token.arc_idx >= 0) ? token_idx : (lat.ntokens + token.prev_token);
+}
+
+// Resets the lattice data before prune_lattice_kernel
+// No lattice state is in the lattice yet, and no list has an owner
+__global__ void init_lattice_kernel(DeviceParams cst_dev_params,
+                                    KernelParams params) {
+  const int nlanes = params.nlanes_used;
+  KALDI_CUDA_DECODER_BATCH_KERNEL_LOOP(ilane, nlanes) {
+    const LaneLatticeParams lat =
+        *cst_dev_params.d_lanes_lattice_params.lane(ilane);
+    const int32 nstates_internal = lat.ntokens + lat.n_extra_prev_tokens;
+    KALDI_CUDA_DECODER_1D_KERNEL_LOOP(idx, nstates_internal) {
+      lat.state_int_extra_cost[idx] = INT_MAX;
+      if (idx < lat.n_extra_prev_tokens) lat.list_owner[idx] = INT_MAX;
+    }
+  }
+}
+
+// Returns true if the arc ilist of the token (the only arc if the token is
+// unique for its (frame, fst state), the arc ilist of its extra prev tokens
+// list otherwise) is kept in the lattice, i.e. if using that arc we can reach
+// the end with a cost < best + lattice_beam.
+// An arc_idx is only added once per lattice state (as in AddArcToLattice,
+// duplicates can only be found in the same list)
+__device__ __inline__ bool IsLatticeArcKept(const LaneLatticeParams &lat,
+                                            const InfoToken &token,
+                                            CostType token_extra_cost,
+                                            int32 ilist,
+                                            CostType lattice_beam) {
+  if (token.arc_idx >= 0) return (token_extra_cost < lattice_beam);
+  const int32 offset = token.prev_token;
+  const CostType arc_extra_cost =
+      lat.tokens.extra_and_acoustic_cost[offset + ilist].x;
+  if (token_extra_cost + arc_extra_cost >= lattice_beam) return false;
+  const int32 arc_idx = lat.tokens.extra_prev_tokens[offset + ilist].arc_idx;
+  for (int32 i = 0; i < ilist; ++i) {
+    if (lat.tokens.extra_prev_tokens[offset + i].arc_idx == arc_idx &&
+        token_extra_cost + lat.tokens.extra_and_acoustic_cost[offset + i].x <
+            lattice_beam)
+      return false;
+  }
+  return true;
+}
+
+// Device version of the lattice pruning done in
+// CudaDecoder::ConcurrentGetRawLatticeSingleChannel
+// Computes the extra cost of each lattice state (the min extra cost of a path
+// going from that state to the end, compared to the best path), going
+// backward from the final tokens listed by GetBestCost.
+// For an arc a->b, extra_cost(a) = min(extra_cost(a), extra_cost(b) +
+// arc_extra_cost(a->b)), and we only use arcs where that value is <
+// lattice_beam. A state is in the lattice if its extra cost was set.
+// Frames are processed from last to first (emitting arcs go to the previous
+// frame). Non emitting arcs stay in the same frame, and are not in
+// topological order: if we update the extra cost of a state of the current
+// frame, we process the frame again (cf must_replay_frame on host). Arc
+// extra costs are >= 0, so this terminates.
+// One CTA per lane
+// THREADS : (KALDI_CUDA_DECODER_LARGEST_1D_BLOCK, 1, 1)
+// BLOCKS : (1, nlanes_used, 1)
+__launch_bounds__(KALDI_CUDA_DECODER_LARGEST_1D_BLOCK, 1) __global__
+    void prune_lattice_kernel(DeviceParams cst_dev_params,
+                              KernelParams params) {
+  __shared__ int32 sh_must_replay_frame;
+  const int nlanes = params.nlanes_used;
+  KALDI_CUDA_DECODER_BATCH_KERNEL_LOOP(ilane, nlanes) {
+    const LaneCounters *lane_counters =
+        cst_dev_params.d_lanes_counters.lane(ilane);
+    const LaneLatticeParams lat =
+        *cst_dev_params.d_lanes_lattice_params.lane(ilane);
+    const CostType lattice_beam = cst_dev_params.lattice_beam;
+    // Best cost in the last frame, set by GetBestCost
+    const CostType best_cost =
+        orderedIntToFloat(lane_counters->min_int_cost_and_arg.x);
+    // Final tokens (listed by GetBestCost) are the starting points
+    const int32 n_final_tokens = lane_counters->n_within_lattice_beam;
+    for (int32 i = threadIdx.x; i < n_final_tokens; i += blockDim.x) {
+      const int2 token_and_int_cost =
+          cst_dev_params.h_list_final_tokens_in_main_q.lane(ilane)[i];
+      const CostType extra_cost =
+          orderedIntToFloat(token_and_int_cost.y) - best_cost;
+      if (extra_cost > lattice_beam) continue;
+      atomicMin(&lat.state_int_extra_cost[GetLatticeStateInternalIdOnDevice(
+                    lat, token_and_int_cost.x)],
+                floatToOrderedInt(extra_cost));
+    }
+    __syncthreads();
+
+    for (int32 iframe = lat.nframes - 1; iframe >= -1; --iframe) {
+      const int32 beg = lat.frame_offsets[iframe + 1];
+      const int32 end = lat.frame_offsets[iframe + 2];
+      // All tokens of a lattice state share the same list. Only the first one
+      // will process it
+      for (int32 token_idx = beg + threadIdx.x; token_idx < end;
+           token_idx += blockDim.x) {
+        if (token_idx == 0) continue;  // start token
+        const InfoToken token = lat.tokens.info[token_idx];
+        if (token.arc_idx < 0)
+          atomicMin(&lat.list_owner[token.prev_token], token_idx);
+      }
+      do {
+        __syncthreads();  // everyone has read sh_must_replay_frame
+        if (threadIdx.x == 0) sh_must_replay_frame = 0;
+        __syncthreads();
+        for (int32 token_idx = beg + threadIdx.x; token_idx < end;
+             token_idx += blockDim.x) {
+          if (token_idx == 0) continue;
+          const InfoToken token = lat.tokens.info[token_idx];
+          const bool is_unique = (token.arc_idx >= 0);
+          if (!is_unique && lat.list_owner[token.prev_token] != token_idx)
+            continue;
+          const int32 state =
+              is_unique ? token_idx : (lat.ntokens + token.prev_token);
+          const int32 token_int_extra_cost = lat.state_int_extra_cost[state];
+          if (token_int_extra_cost == INT_MAX) continue;  // not in the lattice
+          const CostType token_extra_cost =
+              orderedIntToFloat(token_int_extra_cost);
+          const int32 nsame = is_unique ? 1 : -token.arc_idx;
+          for (int32 ilist = 0; ilist < nsame; ++ilist) {
+            InfoToken list_token = token;
+            CostType arc_extra_cost = 0.0f;
+            if (!is_unique) {
+              list_token = lat.tokens.extra_prev_tokens[token.prev_token + ilist];
+              arc_extra_cost =
+                  lat.tokens.extra_and_acoustic_cost[token.prev_token + ilist]
+                      .x;
+            }
+            const int32 prev_token_idx = list_token.prev_token;
+            const CostType prev_extra_cost = token_extra_cost + arc_extra_cost;
+            // The start state is always in the lattice
+            if (prev_token_idx == 0 || prev_extra_cost >= lattice_beam)
+              continue;
+            const int32 prev_int_extra_cost =
+                floatToOrderedInt(prev_extra_cost);
+            int32 *prev_state_int_extra_cost =
+                &lat.state_int_extra_cost[GetLatticeStateInternalIdOnDevice(
+                    lat, prev_token_idx)];
+            if (prev_int_extra_cost < *prev_state_int_extra_cost) {
+              const int32 old_int_extra_cost =
+                  atomicMin(prev_state_int_extra_cost, prev_int_extra_cost);
+              // Non emitting arc: that state may have already been read in
+              // this frame
+              if (prev_int_extra_cost < old_int_extra_cost &&
+                  prev_token_idx >= beg)
+                sh_must_replay_frame = 1;
+            }
+          }
+        }
+        __syncthreads();
+      } while (sh_must_replay_frame);
+    }
+  }
+}
+
+// Called after prune_lattice_kernel. Writes the pruned lattice:
+// - numbers the states in the lattice. The start state is 0
+// - lists the arcs kept in the lattice (cf IsLatticeArcKept), in token order
+// - lists the final states, with their final cost if the last frame has
+// reached a final state
+// One CTA per lane
+// THREADS : (KALDI_CUDA_DECODER_LARGEST_1D_BLOCK, 1, 1)
+// BLOCKS : (1, nlanes_used, 1)
+__launch_bounds__(KALDI_CUDA_DECODER_LARGEST_1D_BLOCK, 1) __global__
+    void output_lattice_kernel(DeviceParams cst_dev_params,
+                               KernelParams params) {
+  typedef cub::BlockScan<int, KALDI_CUDA_DECODER_LARGEST_1D_BLOCK> IntBlockScan;
+  __shared__ typename IntBlockScan::TempStorage sh_temp_storage_int_scan;
+  __shared__ int32 sh_nfinals;
+  const int nlanes = params.nlanes_used;
+  KALDI_CUDA_DECODER_BATCH_KERNEL_LOOP(ilane, nlanes) {
+    const LaneCounters *lane_counters =
+        cst_dev_params.d_lanes_counters.lane(ilane);
+    LaneLatticeParams *lane_lattice_params =
+        cst_dev_params.d_lanes_lattice_params.lane(ilane);
+    const LaneLatticeParams lat = *lane_lattice_params;
+    const CostType lattice_beam = cst_dev_params.lattice_beam;
+
+    // Step 1: numbering the states
+    const int32 nstates_internal = lat.ntokens + lat.n_extra_prev_tokens;
+    int32 nstates = 0;
+    KALDI_CUDA_DECODER_1D_BLOCK_OFFSET_KERNEL_LOOP(offset, thread_idx,
+                                                   nstates_internal) {
+      const int32 state = offset + thread_idx;
+      const int32 is_in_lattice =
+          (state < nstates_internal &&
+           (state == 0 || lat.state_int_extra_cost[state] != INT_MAX))
+              ? 1
+              : 0;
+      int32 state_id, aggregate;
+      IntBlockScan(sh_temp_storage_int_scan)
+          .ExclusiveSum(is_in_lattice, state_id, aggregate);
+      if (is_in_lattice) lat.state_id[state] = nstates + state_id;
+      nstates += aggregate;
+      __syncthreads();  // reusing sh_temp_storage_int_scan
+    }
+
+    // Step 2: listing the arcs. The token owning a lattice state (cf
+    // prune_lattice_kernel) writes its arcs
+    int32 narcs = 0;
+    KALDI_CUDA_DECODER_1D_BLOCK_OFFSET_KERNEL_LOOP(offset, thread_idx,
+                                                   lat.ntokens) {
+      const int32 token_idx = offset + thread_idx;
+      InfoToken token;
+      int32 state, nsame = 0, nkept = 0;
+      CostType token_extra_cost;
+      if (token_idx > 0 && token_idx < lat.ntokens) {
+        token = lat.tokens.info[token_idx];
+        const bool is_unique = (token.arc_idx >= 0);
+        state = is_unique ? token_idx : (lat.ntokens + token.prev_token);
+        const int32 token_int_extra_cost = lat.state_int_extra_cost[state];
+        if ((is_unique || lat.list_owner[token.prev_token] == token_idx) &&
+            token_int_extra_cost != INT_MAX) {
+          token_extra_cost = orderedIntToFloat(token_int_extra_cost);
+          nsame = is_unique ? 1 : -token.arc_idx;
+          for (int32 ilist = 0; ilist < nsame; ++ilist)
+            nkept += IsLatticeArcKept(lat, token, token_extra_cost, ilist,
+                                      lattice_beam);
+        }
+      }
+      int32 arc_offset, aggregate;
+      IntBlockScan(sh_temp_storage_int_scan)
+          .ExclusiveSum(nkept, arc_offset, aggregate);
+      if (nkept > 0) {
+        const int32 dst_state = lat.state_id[state];
+        for (int32 ilist = 0; ilist < nsame; ++ilist) {
+          if (!IsLatticeArcKept(lat, token, token_extra_cost, ilist,
+                                lattice_beam))
+            continue;
+          InfoToken list_token = token;
+          CostType acoustic_cost;
+          if (token.arc_idx >= 0) {
+            acoustic_cost = lat.tokens.acoustic_cost[token_idx];
+          } else {
+            list_token = lat.tokens.extra_prev_tokens[token.prev_token + ilist];
+            acoustic_cost =
+                lat.tokens.extra_and_acoustic_cost[token.prev_token + ilist].y;
+          }
+          const int32 prev_token_idx = list_token.prev_token;
+          const int32 src_state =
+              lat.state_id[GetLatticeStateInternalIdOnDevice(lat,
+                                                             prev_token_idx)];
+          lat.arcs[narcs + arc_offset] = {src_state, dst_state,
+                                          list_token.arc_idx, acoustic_cost};
+          ++arc_offset;
+        }
+      }
+      narcs += aggregate;
+      __syncthreads();  // reusing sh_temp_storage_int_scan
+    }
+
+    // Step 3: final states. The extra costs are not used anymore, we use them
+    // to mark the final states already written
+    if (threadIdx.x == 0) sh_nfinals = 0;
+    __syncthreads();
+    const CostType best_cost =
+        orderedIntToFloat(lane_counters->min_int_cost_and_arg.x);
+    const bool has_reached_final = lane_counters->has_reached_final;
+    const int32 n_final_tokens = lane_counters->n_within_lattice_beam;
+    for (int32 i = threadIdx.x; i < n_final_tokens; i += blockDim.x) {
+      const int2 token_and_int_cost =
+          cst_dev_params.h_list_final_tokens_in_main_q.lane(ilane)[i];
+      const CostType extra_cost =
+          orderedIntToFloat(token_and_int_cost.y) - best_cost;
+      if (extra_cost > lattice_beam) continue;
+      const int32 token_idx = token_and_int_cost.x;
+      const int32 state = GetLatticeStateInternalIdOnDevice(lat, token_idx);
+      if (atomicExch(&lat.state_int_extra_cost[state], INT_MIN) == INT_MIN)
+        continue;  // already written
+      CostType final_cost = 0.0f;
+      if (has_reached_final) {
+        // We need an arc going to that state to know its FST state
+        const InfoToken token = lat.tokens.info[token_idx];
+        const int32 arc_idx =
+            (token.arc_idx >= 0)
+                ? token.arc_idx
+                : lat.tokens.extra_prev_tokens[token.prev_token].arc_idx;
+        final_cost = cst_dev_params
+                         .d_fst_final_costs[cst_dev_params
+                                                .d_arc_nextstates[arc_idx]];
+      }
+      const int32 ifinal = atomicAdd(&sh_nfinals, 1);
+      lat.finals[ifinal] = {lat.state_id[state], final_cost};
+    }
+    __syncthreads();
+    if (threadIdx.x == 0) {
+      lane_lattice_params->nstates = nstates;
+      lane_lattice_params->narcs = narcs;
+      lane_lattice_params->nfinals = sh_nfinals;
+    }
+    __syncthreads();  // sh_nfinals is reset for the next lane
+  }
+}
+
+// Device version of the backtracking done in GetBestPath
+// Starting from the best token found by GetBestCost, we follow the arcs with
+// an extra cost of 0 down to the start token, writing the arcs indexes in
+// best_path
+// THREADS : (1, 1, 1)
+// BLOCKS : (1, nlanes_used, 1)
+__global__ void backtrack_best_path_kernel(DeviceParams cst_dev_params,
+                                           KernelParams params) {
+  const int nlanes = params.nlanes_used;
+  KALDI_CUDA_DECODER_BATCH_KERNEL_LOOP(ilane, nlanes) {
+    const LaneCounters *lane_counters =
+        cst_dev_params.d_lanes_counters.lane(ilane);
+    LaneLatticeParams *lane_lattice_params =
+        cst_dev_params.d_lanes_lattice_params.lane(ilane);
+    const LaneLatticeParams lat = *lane_lattice_params;
+    int32 token_idx = lane_counters->min_int_cost_and_arg.y;
+    int32 path_length = 0;
+    while (token_idx != 0) {
+      const InfoToken token = lat.tokens.info[token_idx];
+      InfoToken best_token = token;
+      if (token.arc_idx < 0) {
+        // Using the first arc with extra_cost == 0
+        const int32 offset = token.prev_token;
+        const int32 size = -token.arc_idx;
+        for (int32 i = 0; i < size; ++i) {
+          if (lat.tokens.extra_and_acoustic_cost[offset + i].x == 0.0f) {
+            best_token = lat.tokens.extra_prev_tokens[offset + i];
+            break;
+          }
+        }
+      }
+      assert(best_token.arc_idx >= 0);
+      if (best_token.arc_idx < 0) break;
+      lat.best_path[path_length++] = best_token.arc_idx;
+      token_idx = best_token.prev_token;
+    }
+    lane_lattice_params->best_path_length = path_length;
+  }
+}
+
 // Kernels wrappers
 
 void SaveChannelsStateFromLanesKernel(const dim3 &grid, const dim3 &block,
@@ -1857,6 +2262,16 @@ void InitDecodingOnDeviceKernel(const dim3 &grid, const dim3 &block,
   KALDI_DECODER_CUDA_CHECK_ERROR();
 }
 
+template <bool LOAD>
+void CopyMainQPagesKernel(const dim3 &grid, const dim3 &block,
+                          const cudaStream_t &st,
+                          const DeviceParams &cst_dev_params,
+                          const KernelParams &kernel_params) {
+  copy_main_q_pages_kernel<LOAD><<<grid, block, 0, st>>>(cst_dev_params,
+                                                         kernel_params);
+  KALDI_DECODER_CUDA_CHECK_ERROR();
+}
+
 void InitializeInitialLaneKernel(const dim3 &grid, const dim3 &block,
                                  const cudaStream_t &st,
                                  const DeviceParams &cst_dev_params) {
@@ -2049,6 +2464,48 @@ void GetBestCostStep3Kernel(const dim3 &grid, const dim3 &block,
   KALDI_DECODER_CUDA_CHECK_ERROR();
 }
 
+void CopyMainQueueToTokensStorageKernel(const dim3 &grid, const dim3 &block,
+                                        const cudaStream_t &st,
+                                        const DeviceParams &cst_dev_params,
+                                        const KernelParams &kernel_params) {
+  copy_main_q_to_tokens_storage_kernel<<<grid, block, 0, st>>>(cst_dev_params,
+                                                               kernel_params);
+  KALDI_DECODER_CUDA_CHECK_ERROR();
+}
+
+void InitLatticeKernel(const dim3 &grid, const dim3 &block,
+                       const cudaStream_t &st,
+                       const DeviceParams &cst_dev_params,
+                       const KernelParams &kernel_params) {
+  init_lattice_kernel<<<grid, block, 0, st>>>(cst_dev_params, kernel_params);
+  KALDI_DECODER_CUDA_CHECK_ERROR();
+}
+
+void PruneLatticeKernel(const dim3 &grid, const dim3 &block,
+                        const cudaStream_t &st,
+                        const DeviceParams &cst_dev_params,
+                        const KernelParams &kernel_params) {
+  prune_lattice_kernel<<<grid, block, 0, st>>>(cst_dev_params, kernel_params);
+  KALDI_DECODER_CUDA_CHECK_ERROR();
+}
+
+void OutputLatticeKernel(const dim3 &grid, const dim3 &block,
+                         const cudaStream_t &st,
+                         const DeviceParams &cst_dev_params,
+                         const KernelParams &kernel_params) {
+  output_lattice_kernel<<<grid, block, 0, st>>>(cst_dev_params, kernel_params);
+  KALDI_DECODER_CUDA_CHECK_ERROR();
+}
+
+void BacktrackBestPathKernel(const dim3 &grid, const dim3 &block,
+                             const cudaStream_t &st,
+                             const DeviceParams &cst_dev_params,
+                             const KernelParams &kernel_params) {
+  backtrack_best_path_kernel<<<grid, block, 0, st>>>(cst_dev_params,
+                                                     kernel_params);
+  KALDI_DECODER_CUDA_CHECK_ERROR();
+}
+
 template void ExpandArcsKernel<true>(const dim3 &grid, const dim3 &block,
                                      const cudaStream_t &st,
                                      const DeviceParams &cst_dev_params,
@@ -2066,6 +2523,15 @@ template void PostExpandKernel<false>(const dim3 &grid, const dim3 &block,
                                       const DeviceParams &cst_dev_params,
                                       const KernelParams &params);
 
+template void CopyMainQPagesKernel<true>(const dim3 &grid, const dim3 &block,
+                                         const cudaStream_t &st,
+                                         const DeviceParams &cst_dev_params,
+                                         const KernelParams &params);
+template void CopyMainQPagesKernel<false>(const dim3 &grid, const dim3 &block,
+                                          const cudaStream_t &st,
+                                          const DeviceParams &cst_dev_params,
+                                          const KernelParams &params);
+
 template void ConcatenateLanesDataKernel<InfoToken>(
     const dim3 &grid, const dim3 &block, const cudaStream_t &st,
     const DeviceParams &cst_dev_params, const KernelParams &params,
@@ -31,9 +31,16 @@ struct DeviceParams {
   LaneMatrixView<LaneCounters> d_lanes_counters;
   LaneMatrixView<LaneCounters> h_lanes_counters;
 
-  ChannelMatrixView<int2> d_main_q_state_and_cost;
-  ChannelMatrixView<int32> d_main_q_degrees_prefix_sum;
-  ChannelMatrixView<int32> d_main_q_arc_offsets;
+  LaneMatrixView<int2> d_main_q_state_and_cost;
+  LaneMatrixView<int32> d_main_q_degrees_prefix_sum;
+  LaneMatrixView<int32> d_main_q_arc_offsets;
+  // Pool storing the main_q of the channels between two calls to
+  // AdvanceDecoding, split in pages of KALDI_CUDA_DECODER_POOL_PAGE_SIZE tokens
+  int2 *d_pool_state_and_cost;
+  int32 *d_pool_degrees_prefix_sum;
+  int32 *d_pool_arc_offsets;
+  // Pages of the channel loaded in each lane (cf copy_main_q_pages_kernel)
+  LaneMatrixView<int32> d_main_q_pages;
   LaneMatrixView<CostType> d_main_q_acoustic_cost;
   LaneMatrixView<InfoToken> d_main_q_info;
   LaneMatrixView<int2> d_aux_q_state_and_cost;
@@ -47,6 +54,8 @@ struct DeviceParams {
   LaneMatrixView<int32> d_main_q_extra_prev_tokens_prefix_sum;
   LaneMatrixView<int32> d_main_q_n_extra_prev_tokens_local_idx;
   LaneMatrixView<InfoToken> d_main_q_extra_prev_tokens;
+  // Only used with --gpu-lattice
+  LaneMatrixView<LaneLatticeParams> d_lanes_lattice_params;
 
   int32 max_nlanes;
   int32 main_q_capacity, aux_q_capacity;
@@ -90,6 +99,12 @@ void InitDecodingOnDeviceKernel(const dim3 &grid, const dim3 &block,
                                 const DeviceParams &cst_dev_params,
                                 const KernelParams &kernel_params);
 
+template <bool LOAD>
+void CopyMainQPagesKernel(const dim3 &grid, const dim3 &block,
+                          const cudaStream_t &st,
+                          const DeviceParams &cst_dev_params,
+                          const KernelParams &kernel_params);
+
 void InitializeInitialLaneKernel(const dim3 &grid, const dim3 &block,
                                  const cudaStream_t &st,
                                  const DeviceParams &cst_dev_params);
@@ -198,6 +213,31 @@ void GetBestCostStep3Kernel(const dim3 &grid, const dim3 &block,
                             const DeviceParams &cst_dev_params,
                             const KernelParams &kernel_params);
 
+void CopyMainQueueToTokensStorageKernel(const dim3 &grid, const dim3 &block,
+                                        const cudaStream_t &st,
+                                        const DeviceParams &cst_dev_params,
+                                        const KernelParams &kernel_params);
+
+void InitLatticeKernel(const dim3 &grid, const dim3 &block,
+                       const cudaStream_t &st,
+                       const DeviceParams &cst_dev_params,
+                       const KernelParams &kernel_params);
+
+void PruneLatticeKernel(const dim3 &grid, const dim3 &block,
+                        const cudaStream_t &st,
+                        const DeviceParams &cst_dev_params,
+                        const KernelParams &kernel_params);
+
+void OutputLatticeKernel(const dim3 &grid, const dim3 &block,
+                         const cudaStream_t &st,
+                         const DeviceParams &cst_dev_params,
+                         const KernelParams &kernel_params);
+
+void BacktrackBestPathKernel(const dim3 &grid, const dim3 &block,
+                             const cudaStream_t &st,
+                             const DeviceParams &cst_dev_params,
+                             const KernelParams &kernel_params);
+
 typedef unsigned char BinId;
 
 }  // namespace kaldi
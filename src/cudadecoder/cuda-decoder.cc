@@ -78,12 +78,15 @@ CudaDecoder::CudaDecoder(const CudaFst &fst, const CudaDecoderConfig &config,
   KALDI_DECODER_CUDA_API_CHECK_ERROR(
       cudaEventCreate(&concatenated_data_ready_evt_));
   KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaEventCreate(&lane_offsets_ready_evt_));
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(
+      cudaEventCreate(&main_q_pages_copied_evt_));
 
   ComputeInitialChannel();
   --nchannels_;  // removing the special initial channel from the count
 
   // Making sure that everything is ready to use
   cudaStreamSynchronize(compute_st_);
+  FreeRetiredDeviceBuffers();
   KALDI_DECODER_CUDA_CHECK_ERROR();
 }
 
@@ -97,6 +100,7 @@ void CudaDecoder::ReadConfig(const CudaDecoderConfig &cst_config) {
   max_active_ = config.max_active;
   aux_q_capacity_ = config.aux_q_capacity;
   main_q_capacity_ = config.main_q_capacity;
+  gpu_lattice_ = config.gpu_lattice;
 
   KALDI_ASSERT(default_beam_ >= 0.0f);
   KALDI_ASSERT(lattice_beam_ >= 0.0f);
@@ -113,11 +117,11 @@ void CudaDecoder::AllocateDeviceData() {
   d_lanes_counters_.Resize(
       nlanes_ + 1,
       1);  // +1 because we sometimes need last+1 value (for offsets)
-  d_main_q_state_and_cost_.Resize(nchannels_, main_q_capacity_);
+  d_main_q_state_and_cost_.Resize(nlanes_, main_q_capacity_);
   d_main_q_info_.Resize(nlanes_, main_q_capacity_);
   d_aux_q_state_and_cost_.Resize(nlanes_, aux_q_capacity_);
   d_aux_q_info_.Resize(nlanes_, aux_q_capacity_);
-  d_main_q_degrees_prefix_sum_.Resize(nchannels_, main_q_capacity_);
+  d_main_q_degrees_prefix_sum_.Resize(nlanes_, main_q_capacity_);
   d_histograms_.Resize(nlanes_, KALDI_CUDA_DECODER_HISTO_NBINS);
   d_main_q_extra_prev_tokens_prefix_sum_.Resize(nlanes_, main_q_capacity_);
   d_main_q_n_extra_prev_tokens_local_idx_.Resize(nlanes_, main_q_capacity_);
@@ -129,7 +133,7 @@ void CudaDecoder::AllocateDeviceData() {
       nlanes_, KALDI_CUDA_DECODER_DIV_ROUND_UP(main_q_capacity_,
                                                KALDI_CUDA_DECODER_1D_BLOCK) +
                    1);
-  d_main_q_arc_offsets_.Resize(nchannels_, main_q_capacity_);
+  d_main_q_arc_offsets_.Resize(nlanes_, main_q_capacity_);
   d_hashmap_values_.Resize(nlanes_, hashmap_capacity_);
   d_main_q_acoustic_cost_.Resize(nlanes_, main_q_capacity_);
   d_extra_and_acoustic_cost_concat_matrix_.Resize(nlanes_, main_q_capacity_);
@@ -145,6 +149,40 @@ void CudaDecoder::AllocateDeviceData() {
       d_extra_and_acoustic_cost_concat_matrix_.lane(0);
   d_acoustic_cost_concat_ = d_acoustic_cost_concat_matrix_.lane(0);
   d_infotoken_concat_ = d_infotoken_concat_matrix_.lane(0);
+
+  // Main_q pool. The main_q of a channel is usually around max_active_ tokens,
+  // the pool will grow if that's not enough
+  const int32 npages_per_channel = std::max(
+      1, KALDI_CUDA_DECODER_DIV_ROUND_UP(max_active_,
+                                         KALDI_CUDA_DECODER_POOL_PAGE_SIZE));
+  const int32 npages = nchannels_ * npages_per_channel;
+  d_pool_state_and_cost_.Resize(npages, KALDI_CUDA_DECODER_POOL_PAGE_SIZE);
+  d_pool_degrees_prefix_sum_.Resize(npages, KALDI_CUDA_DECODER_POOL_PAGE_SIZE);
+  d_pool_arc_offsets_.Resize(npages, KALDI_CUDA_DECODER_POOL_PAGE_SIZE);
+  free_pool_pages_.reserve(npages);
+  // Reversed so that the first pages are used first
+  for (int32 ipage = npages - 1; ipage >= 0; --ipage)
+    free_pool_pages_.push_back(ipage);
+  channel_pages_.resize(nchannels_);
+  channel_owns_pages_.resize(nchannels_, true);
+  // First column is the number of tokens, then the list of pages
+  const int32 max_npages_per_main_q = KALDI_CUDA_DECODER_DIV_ROUND_UP(
+      main_q_capacity_, KALDI_CUDA_DECODER_POOL_PAGE_SIZE);
+  h_main_q_pages_.Resize(nlanes_, max_npages_per_main_q + 1);
+  d_main_q_pages_.Resize(nlanes_, max_npages_per_main_q + 1);
+
+  if (gpu_lattice_) {
+    // The tokens storage of a channel is allocated by
+    // GrowChannelTokensStorage, the lattice buffers by SetLanesLatticeParams
+    d_all_tokens_info_.resize(nchannels_);
+    d_all_tokens_acoustic_cost_.resize(nchannels_);
+    d_all_tokens_extra_prev_tokens_.resize(nchannels_);
+    d_all_tokens_extra_prev_tokens_extra_and_acoustic_cost_.resize(nchannels_);
+    h_lanes_lattice_params_.Resize(nlanes_, 1);
+    d_lanes_lattice_params_.Resize(nlanes_, 1);
+    // The final tokens are listed by GetBestCost in the main_q
+    d_lattice_finals_.Resize(nlanes_, main_q_capacity_);
+  }
 }
 
 void CudaDecoder::AllocateHostData() {
@@ -200,6 +238,9 @@ void CudaDecoder::AllocateHostData() {
   h_all_argmin_cost_.resize(nchannels_, {-1, 0.0f});
   h_all_final_tokens_list_.resize(nchannels_);
   h_all_has_reached_final_.resize(nchannels_);
+  h_all_lattice_nstates_.resize(nchannels_, 0);
+  h_all_lattice_arcs_.resize(nchannels_);
+  h_all_lattice_finals_.resize(nchannels_);
 }
 
 void CudaDecoder::InitDeviceData() {
@@ -253,6 +294,12 @@ void CudaDecoder::InitDeviceParams() {
   h_device_params_->d_main_q_extra_prev_tokens =
       d_main_q_extra_prev_tokens_.GetView();
   h_device_params_->d_main_q_arc_offsets = d_main_q_arc_offsets_.GetView();
+  h_device_params_->d_pool_state_and_cost =
+      d_pool_state_and_cost_.MutableData();
+  h_device_params_->d_pool_degrees_prefix_sum =
+      d_pool_degrees_prefix_sum_.MutableData();
+  h_device_params_->d_pool_arc_offsets = d_pool_arc_offsets_.MutableData();
+  h_device_params_->d_main_q_pages = d_main_q_pages_.GetView();
   h_device_params_->d_hashmap_values = d_hashmap_values_.GetView();
   h_device_params_->d_histograms = d_histograms_.GetView();
   h_device_params_->d_arc_e_offsets = fst_.d_e_offsets_;
@@ -293,6 +340,9 @@ void CudaDecoder::InitDeviceParams() {
   // Those cannot be used at the same time
   h_device_params_->h_list_final_tokens_in_main_q =
       h_list_final_tokens_in_main_q_.GetView();
+  if (gpu_lattice_)
+    h_device_params_->d_lanes_lattice_params =
+        d_lanes_lattice_params_.GetView();
 }
 
 CudaDecoder::~CudaDecoder() {
@@ -300,6 +350,8 @@ CudaDecoder::~CudaDecoder() {
   h2h_threads_running_ = false;
   n_h2h_main_task_todo_cv_.notify_all();
   for (std::thread &thread : cpu_dedicated_threads_) thread.join();
+  cudaStreamSynchronize(compute_st_);
+  FreeRetiredDeviceBuffers();
   cudaStreamDestroy(compute_st_);
   cudaStreamDestroy(copy_st_);
 
@@ -324,6 +376,8 @@ CudaDecoder::~CudaDecoder() {
   KALDI_DECODER_CUDA_API_CHECK_ERROR(
       cudaEventDestroy(concatenated_data_ready_evt_));
   KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaEventDestroy(lane_offsets_ready_evt_));
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(
+      cudaEventDestroy(main_q_pages_copied_evt_));
 
   delete h_kernel_params_;
   delete h_device_params_;
@@ -338,6 +392,12 @@ void CudaDecoder::ComputeInitialChannel() {
   SetChannelsInKernelParams(channels);  // not calling LoadChannelsStateToLanes,
                                         // init_channel_id_ is a special case
   h_lanes_counters_.lane(ilane)->channel_to_compute = init_channel_id_;
+  if (gpu_lattice_) {
+    GrowChannelTokensStorage(init_channel_id_, main_q_capacity_,
+                             main_q_capacity_);
+    h_lanes_counters_.lane(ilane)->tokens_storage =
+        GetChannelTokensStorageView(init_channel_id_);
+  }
 
   cudaMemcpyAsync(d_lanes_counters_.MutableData(), h_lanes_counters_.lane(0),
                   1 * sizeof(*h_lanes_counters_.lane(0)),
@@ -364,9 +424,13 @@ void CudaDecoder::ComputeInitialChannel() {
       h_lanes_counters_.lane(ilane)->main_q_narcs_and_end.y;
   KALDI_ASSERT(main_q_end > 0);
 
-  // Moving all data linked to init_channel_id_ to host
+  // Moving all data linked to init_channel_id_ to host (or to its device
+  // storage with --gpu-lattice)
   // that data will be cloned to other channels when calling InitDecoding
-  CopyMainQueueDataToHost();
+  if (gpu_lattice_)
+    CopyMainQueueDataToTokensStorage();
+  else
+    CopyMainQueueDataToHost();
   SaveChannelsStateFromLanes();
 
   KALDI_ASSERT(
@@ -379,7 +443,8 @@ void CudaDecoder::InitDecoding(const std::vector<ChannelId> &channels) {
   // Cloning the init_channel_id_ channel into all channels in the channels vec
   const int nlanes_used = channels.size();
   // Getting *h_kernel_params ready to use
-  LoadChannelsStateToLanes(channels);
+  // The main_q of the channels is not needed, it will be the initial one
+  LoadChannelsStateToLanes(channels, false);
   cudaMemcpyAsync(d_lanes_counters_.MutableData(), h_lanes_counters_.lane(0),
                   nlanes_used_ * sizeof(*h_lanes_counters_.lane(0)),
                   cudaMemcpyHostToDevice, compute_st_);
@@ -391,13 +456,19 @@ void CudaDecoder::InitDecoding(const std::vector<ChannelId> &channels) {
       init_channel_counters.prev_main_q_narcs_and_end.y;
 
   KALDI_ASSERT(init_main_q_size > 0);
+  // The initial main_q is never modified: the channels share its pages until
+  // they are saved for the first time
+  for (ChannelId ichannel : channels) {
+    FreeChannelPages(ichannel);
+    channel_pages_[ichannel] = channel_pages_[init_channel_id_];
+    channel_owns_pages_[ichannel] = false;
+  }
   // Getting the channels ready to compute new utterances
-  InitDecodingOnDeviceKernel(
-      KaldiCudaDecoderNumBlocks(init_main_q_size, nlanes_used),
-      KALDI_CUDA_DECODER_1D_BLOCK, compute_st_, *h_device_params_,
-      *h_kernel_params_);
+  InitDecodingOnDeviceKernel(KaldiCudaDecoderNumBlocks(1, nlanes_used),
+                             KALDI_CUDA_DECODER_ONE_THREAD_BLOCK, compute_st_,
+                             *h_device_params_, *h_kernel_params_);
 
-  {
+  if (!gpu_lattice_) {
     std::lock_guard<std::mutex> n_h2h_not_done_lk(
         n_init_decoding_h2h_task_not_done_mutex_);
     n_init_decoding_h2h_task_not_done_ += channels.size();
@@ -412,13 +483,16 @@ void CudaDecoder::InitDecoding(const std::vector<ChannelId> &channels) {
     channel_counters.prev_main_q_extra_prev_tokens_global_offset = 0;
     channel_counters.prev_beam = default_beam_;
 
-    int32 n_initial_tokens = h_all_tokens_info_[init_channel_id_].size();
+    // The initial main_q has a global offset of 0
+    int32 n_initial_tokens = init_main_q_size;
     num_frames_decoded_[ichannel] = 0;
     h_channels_counters_[ichannel] = h_channels_counters_[init_channel_id_];
     h_all_argmin_cost_[ichannel] = {-1, 0.0f};
     frame_offsets_[ichannel].clear();
     frame_offsets_[ichannel].push_back(n_initial_tokens);
-    if (thread_pool_)
+    if (gpu_lattice_)
+      InitDecodingTokensStorage(ichannel);
+    else if (thread_pool_)
       thread_pool_->enqueue(THREAD_POOL_HIGH_PRIORITY,
                             &CudaDecoder::InitDecodingH2HCopies, this,
                             ichannel);
@@ -450,8 +524,42 @@ void CudaDecoder::InitDecodingH2HCopies(ChannelId ichannel) {
   }
 }
 
+void CudaDecoder::InitDecodingTokensStorage(ChannelId ichannel) {
+  // Tokens from the initial main_q, already in the device storage of
+  // init_channel_id_ (cf ComputeInitialChannel)
+  const ChannelCounters &init_channel_counters =
+      h_channels_counters_[init_channel_id_];
+  const int32 ntokens = init_channel_counters.prev_main_q_narcs_and_end.y;
+  const int32 n_extra_prev_tokens =
+      init_channel_counters.prev_main_q_n_extra_prev_tokens;
+  GrowChannelTokensStorage(ichannel, ntokens, n_extra_prev_tokens);
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpyAsync(
+      d_all_tokens_info_[ichannel].MutableData(),
+      d_all_tokens_info_[init_channel_id_].MutableData(),
+      ntokens * sizeof(InfoToken), cudaMemcpyDeviceToDevice, compute_st_));
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpyAsync(
+      d_all_tokens_acoustic_cost_[ichannel].MutableData(),
+      d_all_tokens_acoustic_cost_[init_channel_id_].MutableData(),
+      ntokens * sizeof(CostType), cudaMemcpyDeviceToDevice, compute_st_));
+  if (n_extra_prev_tokens > 0) {
+    KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpyAsync(
+        d_all_tokens_extra_prev_tokens_[ichannel].MutableData(),
+        d_all_tokens_extra_prev_tokens_[init_channel_id_].MutableData(),
+        n_extra_prev_tokens * sizeof(InfoToken), cudaMemcpyDeviceToDevice,
+        compute_st_));
+    KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpyAsync(
+        d_all_tokens_extra_prev_tokens_extra_and_acoustic_cost_[ichannel]
+            .MutableData(),
+        d_all_tokens_extra_prev_tokens_extra_and_acoustic_cost_
+            [init_channel_id_]
+                .MutableData(),
+        n_extra_prev_tokens * sizeof(float2), cudaMemcpyDeviceToDevice,
+        compute_st_));
+  }
+}
+
 void CudaDecoder::LoadChannelsStateToLanes(
-    const std::vector<ChannelId> &channels) {
+    const std::vector<ChannelId> &channels, bool load_main_q) {
   // Setting that channels configuration in kernel_params
   SetChannelsInKernelParams(channels);
   KALDI_ASSERT(nlanes_used_ > 0);
@@ -479,6 +587,7 @@ void CudaDecoder::LoadChannelsStateToLanes(
     lane_counters.prev_arg_min_int_cost =
         channel_counters.min_int_cost_and_arg_without_final.y;
   }
+  if (load_main_q) CopyMainQPages(true);
 }
 
 void CudaDecoder::SaveChannelsStateFromLanes() {
@@ -498,7 +607,9 @@ void CudaDecoder::SaveChannelsStateFromLanes() {
     channel_counters.prev_beam = orderedIntToFloatHost(lane_counters.int_beam);
     channel_counters.min_int_cost_and_arg_without_final = {
         lane_counters.min_int_cost, lane_counters.prev_arg_min_int_cost};
+    AllocateChannelPages(ichannel, lane_counters.main_q_narcs_and_end.y);
   }
+  CopyMainQPages(false);
   SaveChannelsStateFromLanesKernel(KaldiCudaDecoderNumBlocks(1, nlanes_used_),
                                    KALDI_CUDA_DECODER_ONE_THREAD_BLOCK,
                                    compute_st_, *h_device_params_,
@@ -507,6 +618,135 @@ void CudaDecoder::SaveChannelsStateFromLanes() {
   ResetChannelsInKernelParams();
 }
 
+void CudaDecoder::FreeChannelPages(ChannelId ichannel) {
+  std::vector<int32> &pages = channel_pages_[ichannel];
+  if (channel_owns_pages_[ichannel])
+    free_pool_pages_.insert(free_pool_pages_.end(), pages.begin(), pages.end());
+  pages.clear();
+  channel_owns_pages_[ichannel] = true;
+}
+
+void CudaDecoder::AllocateChannelPages(ChannelId ichannel, int32 ntokens) {
+  FreeChannelPages(ichannel);
+  const int32 npages =
+      KALDI_CUDA_DECODER_DIV_ROUND_UP(ntokens, KALDI_CUDA_DECODER_POOL_PAGE_SIZE);
+  const int32 nfree = free_pool_pages_.size();
+  if (nfree < npages) {
+    const int32 pool_npages = d_pool_state_and_cost_.NumRows();
+    GrowPool(std::max(2 * pool_npages, pool_npages + npages - nfree));
+  }
+  std::vector<int32> &pages = channel_pages_[ichannel];
+  for (int32 i = 0; i < npages; ++i) {
+    pages.push_back(free_pool_pages_.back());
+    free_pool_pages_.pop_back();
+  }
+}
+
+void CudaDecoder::GrowPool(int32 npages) {
+  const int32 old_npages = d_pool_state_and_cost_.NumRows();
+  KALDI_ASSERT(npages > old_npages);
+  KALDI_VLOG(1) << "Growing the main_q pool from " << old_npages << " to "
+                << npages << " pages";
+  const size_t old_size =
+      static_cast<size_t>(old_npages) * KALDI_CUDA_DECODER_POOL_PAGE_SIZE;
+  DeviceMatrix<int2> state_and_cost;
+  DeviceMatrix<int32> degrees_prefix_sum, arc_offsets;
+  state_and_cost.Resize(npages, KALDI_CUDA_DECODER_POOL_PAGE_SIZE);
+  degrees_prefix_sum.Resize(npages, KALDI_CUDA_DECODER_POOL_PAGE_SIZE);
+  arc_offsets.Resize(npages, KALDI_CUDA_DECODER_POOL_PAGE_SIZE);
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpyAsync(
+      state_and_cost.MutableData(), d_pool_state_and_cost_.MutableData(),
+      old_size * sizeof(int2), cudaMemcpyDeviceToDevice, compute_st_));
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpyAsync(
+      degrees_prefix_sum.MutableData(),
+      d_pool_degrees_prefix_sum_.MutableData(), old_size * sizeof(int32),
+      cudaMemcpyDeviceToDevice, compute_st_));
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpyAsync(
+      arc_offsets.MutableData(), d_pool_arc_offsets_.MutableData(),
+      old_size * sizeof(int32), cudaMemcpyDeviceToDevice, compute_st_));
+  // The old pool is freed when leaving this function. Kernels using it may
+  // still be queued
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaStreamSynchronize(compute_st_));
+  d_pool_state_and_cost_.Swap(&state_and_cost);
+  d_pool_degrees_prefix_sum_.Swap(&degrees_prefix_sum);
+  d_pool_arc_offsets_.Swap(&arc_offsets);
+  h_device_params_->d_pool_state_and_cost =
+      d_pool_state_and_cost_.MutableData();
+  h_device_params_->d_pool_degrees_prefix_sum =
+      d_pool_degrees_prefix_sum_.MutableData();
+  h_device_params_->d_pool_arc_offsets = d_pool_arc_offsets_.MutableData();
+  // Pages are used from the back
+  for (int32 ipage = npages - 1; ipage >= old_npages; --ipage)
+    free_pool_pages_.push_back(ipage);
+}
+
+void CudaDecoder::FreeRetiredDeviceBuffers() {
+  for (void *ptr : retired_device_buffers_) CuDevice::Instantiate().Free(ptr);
+  retired_device_buffers_.clear();
+}
+
+void CudaDecoder::GrowChannelTokensStorage(ChannelId ichannel, int32 ntokens,
+                                           int32 n_extra_prev_tokens) {
+  // Never empty, GetChannelTokensStorageView needs valid pointers
+  ntokens = std::max(ntokens, 1);
+  n_extra_prev_tokens = std::max(n_extra_prev_tokens, 1);
+  d_all_tokens_info_[ichannel].Grow(ntokens, true, compute_st_,
+                                    &retired_device_buffers_);
+  d_all_tokens_acoustic_cost_[ichannel].Grow(ntokens, true, compute_st_,
+                                             &retired_device_buffers_);
+  d_all_tokens_extra_prev_tokens_[ichannel].Grow(
+      n_extra_prev_tokens, true, compute_st_, &retired_device_buffers_);
+  d_all_tokens_extra_prev_tokens_extra_and_acoustic_cost_[ichannel].Grow(
+      n_extra_prev_tokens, true, compute_st_, &retired_device_buffers_);
+}
+
+DeviceTokensStorageView CudaDecoder::GetChannelTokensStorageView(
+    ChannelId ichannel) {
+  return {d_all_tokens_info_[ichannel].MutableData(),
+          d_all_tokens_acoustic_cost_[ichannel].MutableData(),
+          d_all_tokens_extra_prev_tokens_[ichannel].MutableData(),
+          d_all_tokens_extra_prev_tokens_extra_and_acoustic_cost_[ichannel]
+              .MutableData()};
+}
+
+void CudaDecoder::CopyMainQPages(bool load) {
+  KALDI_ASSERT(nlanes_used_ > 0);
+  const int32 ncols = KALDI_CUDA_DECODER_DIV_ROUND_UP(
+                          main_q_capacity_, KALDI_CUDA_DECODER_POOL_PAGE_SIZE) +
+                      1;
+  // The previous copy of h_main_q_pages_ must be done before we modify it
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(
+      cudaEventSynchronize(main_q_pages_copied_evt_));
+  int32 max_ntokens = 0;
+  for (LaneId ilane = 0; ilane < nlanes_used_; ++ilane) {
+    const ChannelId ichannel = channel_to_compute_[ilane];
+    const int32 ntokens =
+        h_channels_counters_[ichannel].prev_main_q_narcs_and_end.y;
+    const std::vector<int32> &pages = channel_pages_[ichannel];
+    KALDI_ASSERT(static_cast<int32>(pages.size()) *
+                     KALDI_CUDA_DECODER_POOL_PAGE_SIZE >=
+                 ntokens);
+    int32 *row = h_main_q_pages_.lane(ilane);
+    row[0] = ntokens;
+    std::copy(pages.begin(), pages.end(), row + 1);
+    max_ntokens = std::max(max_ntokens, ntokens);
+  }
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpyAsync(
+      d_main_q_pages_.MutableData(), h_main_q_pages_.MutableData(),
+      nlanes_used_ * ncols * sizeof(int32), cudaMemcpyHostToDevice,
+      compute_st_));
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(
+      cudaEventRecord(main_q_pages_copied_evt_, compute_st_));
+  if (max_ntokens == 0) return;
+  const dim3 grid = KaldiCudaDecoderNumBlocks(max_ntokens, nlanes_used_);
+  if (load)
+    CopyMainQPagesKernel<true>(grid, KALDI_CUDA_DECODER_1D_BLOCK, compute_st_,
+                               *h_device_params_, *h_kernel_params_);
+  else
+    CopyMainQPagesKernel<false>(grid, KALDI_CUDA_DECODER_1D_BLOCK, compute_st_,
+                                *h_device_params_, *h_kernel_params_);
+}
+
 int32 CudaDecoder::GetMaxForAllLanes(
     std::function<int32(const LaneCounters &)> func) {
   int32 max_val = 0;
@@ -526,6 +766,7 @@ void CudaDecoder::CopyLaneCountersToHostAsync() {
 void CudaDecoder::CopyLaneCountersToHostSync() {
   CopyLaneCountersToHostAsync();
   cudaStreamSynchronize(compute_st_);
+  FreeRetiredDeviceBuffers();
 }
 
 // One sync has to happen between PerformConcatenatedCopy and
@@ -686,6 +927,14 @@ void CudaDecoder::CopyMainQueueDataToHost() {
   LaunchH2HCopies();
 }
 
+void CudaDecoder::CopyMainQueueDataToTokensStorage() {
+  // The tokens storage of each lane was set in the lane counters (cf
+  // AdvanceDecoding), and is large enough for that frame
+  CopyMainQueueToTokensStorageKernel(
+      KaldiCudaDecoderNumBlocks(nlanes_used_), KALDI_CUDA_DECODER_1D_BLOCK,
+      compute_st_, *h_device_params_, *h_kernel_params_);
+}
+
 void CudaDecoder::LaunchD2HCopies() {
   // Last offset = total
   int32 nelements_acoustic_costs = h_lanes_counters_.lane(nlanes_used_)
@@ -773,6 +1022,18 @@ void CudaDecoder::AdvanceDecoding(
       int32 frame = num_frames_decoded_[ichannel];
       h_lanes_counters_.lane(ilane)->loglikelihoods =
           decodables[ilane]->GetLogLikelihoodsCudaPointer(frame);
+      if (gpu_lattice_) {
+        // Making sure the tokens of that frame will fit in the device storage
+        // of the channel. They will be written after the current main_q
+        LaneCounters *lane_counters = h_lanes_counters_.lane(ilane);
+        GrowChannelTokensStorage(
+            ichannel,
+            lane_counters->main_q_global_offset +
+                lane_counters->main_q_narcs_and_end.y + main_q_capacity_,
+            lane_counters->main_q_extra_prev_tokens_global_offset +
+                lane_counters->main_q_n_extra_prev_tokens + main_q_capacity_);
+        lane_counters->tokens_storage = GetChannelTokensStorageView(ichannel);
+      }
     }
     cudaMemcpyAsync(d_lanes_counters_.MutableData(), h_lanes_counters_.lane(0),
                     nlanes_used_ * sizeof(*h_lanes_counters_.lane(0)),
@@ -831,17 +1092,24 @@ void CudaDecoder::AdvanceDecoding(
     // - compute the extra costs
     PostProcessingMainQueue();
 
-    // Waiting on previous d2h before writing on same device memory
-    cudaStreamWaitEvent(compute_st_, d2h_copy_extra_prev_tokens_evt_, 0);
-    // Concatenating the data that will be moved to host into large arrays
-    ConcatenateData();
-    // Copying the final lane counters for that frame
-    CopyLaneCountersToHostSync();
-    CheckOverflow();
-
-    // Moving the data necessary for GetRawLattice/GetBestPath back to host for
-    // storage
-    CopyMainQueueDataToHost();
+    if (gpu_lattice_) {
+      // The data necessary for GetRawLattice/GetBestPath stays on device
+      CopyMainQueueDataToTokensStorage();
+      CopyLaneCountersToHostSync();
+      CheckOverflow();
+    } else {
+      // Waiting on previous d2h before writing on same device memory
+      cudaStreamWaitEvent(compute_st_, d2h_copy_extra_prev_tokens_evt_, 0);
+      // Concatenating the data that will be moved to host into large arrays
+      ConcatenateData();
+      // Copying the final lane counters for that frame
+      CopyLaneCountersToHostSync();
+      CheckOverflow();
+
+      // Moving the data necessary for GetRawLattice/GetBestPath back to host
+      // for storage
+      CopyMainQueueDataToHost();
+    }
 
     for (LaneId ilane = 0; ilane < nlanes_used_; ++ilane) {
       const ChannelId ichannel = channel_to_compute_[ilane];
@@ -992,15 +1260,14 @@ void CudaDecoder::GetBestPath(const std::vector<ChannelId> &channels,
   nvtxRangePushA("GetBestPath");
   GetBestCost(channels, use_final_probs, &argmins_,
               &list_finals_token_idx_and_cost_, &has_reached_final_);
+  // With --gpu-lattice, the tokens are on device. Backtracking there
+  if (gpu_lattice_ && !channels.empty()) BacktrackBestPathsOnDevice();
 
   std::vector<int32> reversed_path;
   for (int32 ilane = 0; ilane < channels.size(); ++ilane) {
     const ChannelId ichannel = channels[ilane];
     const int32 token_with_best_cost = argmins_[ilane].first;
     std::unique_lock<std::mutex> channel_lk(channel_lock_[ichannel]);
-    // If that token in that frame f is available, then all tokens in that frame
-    // f are available
-    WaitForH2HCopies();
     const bool isfinal = has_reached_final_[ilane];
     TokenId token_idx = token_with_best_cost;
 
@@ -1008,6 +1275,14 @@ void CudaDecoder::GetBestPath(const std::vector<ChannelId> &channels,
     // Going all the way from the token with best cost
     // to the beginning (StartState)
     reversed_path.clear();
+    if (gpu_lattice_) {
+      reversed_path.swap(h_best_paths_[ilane]);
+      token_idx = 0;  // already done
+    } else {
+      // If that token in that frame f is available, then all tokens in that
+      // frame f are available
+      WaitForH2HCopies();
+    }
 
     // The first token was inserted at the beginning of the queue
     // it always has index 0
@@ -1465,10 +1740,193 @@ void CudaDecoder::PrepareForGetRawLattice(
         list_finals_token_idx_and_cost_[ilane]);
     h_all_has_reached_final_[ichannel] = has_reached_final_[ilane];
   }
+  // With --gpu-lattice, the lattices are built and pruned now, on device
+  if (gpu_lattice_ && !channels.empty()) BuildRawLatticesOnDevice();
+}
+
+void CudaDecoder::SetLanesLatticeParams(bool build_lattice) {
+  // Each lane uses a segment of the shared buffers. Computing the sizes first
+  int32 nframe_offsets = 0, nstates_internal = 0, n_extra_prev_tokens = 0,
+        ntokens = 0;
+  for (LaneId ilane = 0; ilane < nlanes_used_; ++ilane) {
+    const ChannelId ichannel = channel_to_compute_[ilane];
+    const ChannelCounters &channel_counters = h_channels_counters_[ichannel];
+    LaneLatticeParams *lat = h_lanes_lattice_params_.lane(ilane);
+    lat->tokens = GetChannelTokensStorageView(ichannel);
+    lat->ntokens = frame_offsets_[ichannel].back();
+    lat->n_extra_prev_tokens =
+        channel_counters.prev_main_q_extra_prev_tokens_global_offset +
+        channel_counters.prev_main_q_n_extra_prev_tokens;
+    lat->nframes = num_frames_decoded_[ichannel];
+    // Frame -1 (initial tokens) starts at 0
+    nframe_offsets += lat->nframes + 2;
+    nstates_internal += lat->ntokens + lat->n_extra_prev_tokens;
+    n_extra_prev_tokens += lat->n_extra_prev_tokens;
+    ntokens += lat->ntokens;
+  }
+  // Scratch buffers, their content is not kept
+  d_best_path_.Grow(ntokens, false, compute_st_, &retired_device_buffers_);
+  if (build_lattice) {
+    d_lattice_frame_offsets_.Grow(nframe_offsets, false, compute_st_,
+                                  &retired_device_buffers_);
+    d_lattice_state_int_extra_cost_.Grow(nstates_internal, false, compute_st_,
+                                         &retired_device_buffers_);
+    d_lattice_state_id_.Grow(nstates_internal, false, compute_st_,
+                             &retired_device_buffers_);
+    d_lattice_list_owner_.Grow(std::max(n_extra_prev_tokens, 1), false,
+                               compute_st_, &retired_device_buffers_);
+    // A lattice state has at most one arc per token or extra prev token
+    d_lattice_arcs_.Grow(nstates_internal, false, compute_st_,
+                         &retired_device_buffers_);
+  }
+
+  // Now setting the segments
+  h_lattice_frame_offsets_.clear();
+  nstates_internal = n_extra_prev_tokens = ntokens = 0;
+  for (LaneId ilane = 0; ilane < nlanes_used_; ++ilane) {
+    const ChannelId ichannel = channel_to_compute_[ilane];
+    LaneLatticeParams *lat = h_lanes_lattice_params_.lane(ilane);
+    lat->best_path = d_best_path_.MutableData() + ntokens;
+    if (build_lattice) {
+      lat->frame_offsets = d_lattice_frame_offsets_.MutableData() +
+                           h_lattice_frame_offsets_.size();
+      h_lattice_frame_offsets_.push_back(0);
+      h_lattice_frame_offsets_.insert(h_lattice_frame_offsets_.end(),
+                                      frame_offsets_[ichannel].begin(),
+                                      frame_offsets_[ichannel].end());
+      lat->state_int_extra_cost =
+          d_lattice_state_int_extra_cost_.MutableData() + nstates_internal;
+      lat->state_id = d_lattice_state_id_.MutableData() + nstates_internal;
+      lat->list_owner =
+          d_lattice_list_owner_.MutableData() + n_extra_prev_tokens;
+      lat->arcs = d_lattice_arcs_.MutableData() + nstates_internal;
+      lat->finals = d_lattice_finals_.lane(ilane);
+    }
+    nstates_internal += lat->ntokens + lat->n_extra_prev_tokens;
+    n_extra_prev_tokens += lat->n_extra_prev_tokens;
+    ntokens += lat->ntokens;
+  }
+  if (build_lattice) {
+    KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpyAsync(
+        d_lattice_frame_offsets_.MutableData(), h_lattice_frame_offsets_.data(),
+        h_lattice_frame_offsets_.size() * sizeof(int32),
+        cudaMemcpyHostToDevice, compute_st_));
+  }
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpyAsync(
+      d_lanes_lattice_params_.MutableData(), h_lanes_lattice_params_.lane(0),
+      nlanes_used_ * sizeof(*h_lanes_lattice_params_.lane(0)),
+      cudaMemcpyHostToDevice, compute_st_));
+}
+
+void CudaDecoder::BuildRawLatticesOnDevice() {
+  // The channels were loaded in the lanes by GetBestCost
+  KALDI_ASSERT(nlanes_used_ > 0);
+  nvtxRangePushA("BuildRawLatticesOnDevice");
+  SetLanesLatticeParams(true);
+  int32 max_nstates_internal = 0;
+  for (LaneId ilane = 0; ilane < nlanes_used_; ++ilane) {
+    const LaneLatticeParams *lat = h_lanes_lattice_params_.lane(ilane);
+    max_nstates_internal = std::max(
+        max_nstates_internal, lat->ntokens + lat->n_extra_prev_tokens);
+  }
+  InitLatticeKernel(
+      KaldiCudaDecoderNumBlocks(max_nstates_internal, nlanes_used_),
+      KALDI_CUDA_DECODER_1D_BLOCK, compute_st_, *h_device_params_,
+      *h_kernel_params_);
+  // One CTA per lane. The frames have to be processed in order
+  PruneLatticeKernel(KaldiCudaDecoderNumBlocks(1, nlanes_used_),
+                     KALDI_CUDA_DECODER_LARGEST_1D_BLOCK, compute_st_,
+                     *h_device_params_, *h_kernel_params_);
+  OutputLatticeKernel(KaldiCudaDecoderNumBlocks(1, nlanes_used_),
+                      KALDI_CUDA_DECODER_LARGEST_1D_BLOCK, compute_st_,
+                      *h_device_params_, *h_kernel_params_);
+  // Reading the number of states, arcs and finals of each lattice
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpyAsync(
+      h_lanes_lattice_params_.lane(0), d_lanes_lattice_params_.MutableData(),
+      nlanes_used_ * sizeof(*h_lanes_lattice_params_.lane(0)),
+      cudaMemcpyDeviceToHost, compute_st_));
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaStreamSynchronize(compute_st_));
+  FreeRetiredDeviceBuffers();
+  // Only the pruned lattices are moved to host
+  for (LaneId ilane = 0; ilane < nlanes_used_; ++ilane) {
+    const ChannelId ichannel = channel_to_compute_[ilane];
+    const LaneLatticeParams *lat = h_lanes_lattice_params_.lane(ilane);
+    std::lock_guard<std::mutex> channel_lk(channel_lock_[ichannel]);
+    h_all_lattice_nstates_[ichannel] = lat->nstates;
+    h_all_lattice_arcs_[ichannel].resize(lat->narcs);
+    h_all_lattice_finals_[ichannel].resize(lat->nfinals);
+    if (lat->narcs > 0) {
+      KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpy(
+          h_all_lattice_arcs_[ichannel].data(), lat->arcs,
+          lat->narcs * sizeof(DeviceLatticeArc), cudaMemcpyDeviceToHost));
+    }
+    if (lat->nfinals > 0) {
+      KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpy(
+          h_all_lattice_finals_[ichannel].data(), lat->finals,
+          lat->nfinals * sizeof(DeviceLatticeFinal), cudaMemcpyDeviceToHost));
+    }
+  }
+  nvtxRangePop();
+}
+
+void CudaDecoder::BacktrackBestPathsOnDevice() {
+  // The channels were loaded in the lanes by GetBestCost
+  KALDI_ASSERT(nlanes_used_ > 0);
+  SetLanesLatticeParams(false);
+  BacktrackBestPathKernel(KaldiCudaDecoderNumBlocks(1, nlanes_used_),
+                          KALDI_CUDA_DECODER_ONE_THREAD_BLOCK, compute_st_,
+                          *h_device_params_, *h_kernel_params_);
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpyAsync(
+      h_lanes_lattice_params_.lane(0), d_lanes_lattice_params_.MutableData(),
+      nlanes_used_ * sizeof(*h_lanes_lattice_params_.lane(0)),
+      cudaMemcpyDeviceToHost, compute_st_));
+  KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaStreamSynchronize(compute_st_));
+  FreeRetiredDeviceBuffers();
+  h_best_paths_.resize(nlanes_used_);
+  for (LaneId ilane = 0; ilane < nlanes_used_; ++ilane) {
+    const LaneLatticeParams *lat = h_lanes_lattice_params_.lane(ilane);
+    h_best_paths_[ilane].resize(lat->best_path_length);
+    if (lat->best_path_length > 0) {
+      KALDI_DECODER_CUDA_API_CHECK_ERROR(cudaMemcpy(
+          h_best_paths_[ilane].data(), lat->best_path,
+          lat->best_path_length * sizeof(int32), cudaMemcpyDeviceToHost));
+    }
+  }
+}
+
+void CudaDecoder::GetRawLatticeFromDeviceOutput(ChannelId ichannel,
+                                                Lattice *fst_out) {
+  std::lock_guard<std::mutex> channel_lk(channel_lock_[ichannel]);
+  KALDI_ASSERT(
+      "You need to call PrepareForGetRawLattice before "
+      "ConcurrentGetRawLatticeSingleChannel" &&
+      h_all_argmin_cost_[ichannel].first >= 0);
+  // The lattice states were numbered on device. The start state is 0
+  fst_out->DeleteStates();
+  const int32 nstates = h_all_lattice_nstates_[ichannel];
+  fst_out->ReserveStates(nstates);
+  for (int32 i = 0; i < nstates; ++i) fst_out->AddState();
+  fst_out->SetStart(0);
+  // final_cost is 0 if we haven't reached a final state
+  for (const DeviceLatticeFinal &final : h_all_lattice_finals_[ichannel])
+    fst_out->SetFinal(final.state, LatticeWeight(final.final_cost, 0.0));
+  for (const DeviceLatticeArc &device_arc : h_all_lattice_arcs_[ichannel]) {
+    const int32 arc_idx = device_arc.arc_idx;
+    LatticeArc arc(fst_.h_arc_id_ilabels_[arc_idx], fst_.h_arc_olabels_[arc_idx],
+                   LatticeWeight(fst_.h_arc_weights_[arc_idx],
+                                 device_arc.acoustic_cost),
+                   device_arc.dst_state);
+    fst_out->AddArc(device_arc.src_state, arc);
+  }
 }
 
 void CudaDecoder::ConcurrentGetRawLatticeSingleChannel(const ChannelId ichannel,
                                                        Lattice *fst_out) {
+  if (gpu_lattice_) {
+    // Already built and pruned by PrepareForGetRawLattice
+    GetRawLatticeFromDeviceOutput(ichannel, fst_out);
+    return;
+  }
   nvtxRangePushA("GetRawLatticeOneChannel");
   // Allocating the datastructures that we need
 
@@ -37,6 +37,7 @@ struct CudaDecoderConfig {
   int32 ntokens_pre_allocated;
   int32 main_q_capacity, aux_q_capacity;
   int32 max_active;
+  bool gpu_lattice;
 
   CudaDecoderConfig()
       : default_beam(15.0),
@@ -44,7 +45,8 @@ struct CudaDecoderConfig {
         ntokens_pre_allocated(2000000),
         main_q_capacity(-1),
         aux_q_capacity(-1),
-        max_active(10000) {}
+        max_active(10000),
+        gpu_lattice(false) {}
 
   void Register(OptionsItf *opts) {
     opts->Register("beam", &default_beam,
@@ -100,6 +102,12 @@ struct CudaDecoderConfig {
         << "*main-q-capacity).";
     opts->Register("aux-q-capacity", &aux_q_capacity,
                    aux_q_capacity_desc.str());
+    opts->Register("gpu-lattice", &gpu_lattice,
+                   "Keep the tokens of every frame on the device, and build "
+                   "and prune the raw lattice there: only the pruned lattice "
+                   "is copied to host, instead of all the tokens of each "
+                   "frame. Uses more device memory (the tokens of all the "
+                   "utterances being decoded).");
   }
 
   void Check() const {
@@ -295,8 +303,22 @@ class CudaDecoder {
   // into a lane. When a channel will be executed on a lane, we load that
   // channel into that lane (same idea than when we load a software threads into
   // the registers of a CPU)
-  void LoadChannelsStateToLanes(const std::vector<ChannelId> &channels);
+  // If load_main_q is false, the main_q of the channels is not copied into the
+  // lanes (used by InitDecoding, the main_q is not used)
+  void LoadChannelsStateToLanes(const std::vector<ChannelId> &channels,
+                                bool load_main_q = true);
   void SaveChannelsStateFromLanes();
+  // Main_q pool management, used by the context-switch functions.
+  // Frees the pages owned by ichannel
+  void FreeChannelPages(ChannelId ichannel);
+  // Gives to ichannel enough pages to store ntokens tokens, growing the pool
+  // if necessary
+  void AllocateChannelPages(ChannelId ichannel, int32 ntokens);
+  // Resizes the pool to npages pages, keeping its content
+  void GrowPool(int32 npages);
+  // Copies the main_q of the lanes from (load == true) or to the pool, using
+  // the pages of channel_to_compute_
+  void CopyMainQPages(bool load);
   // We compute the decodes by batch. Each decodable in the batch has a
   // different number of frames ready
   // We compute the min number of frames ready (so that the full batch is
@@ -341,6 +363,35 @@ class CudaDecoder {
   // GetBestPath/GetRawLattice.
   // Happens when PostProcessingMainQueue is done generating that data
   void CopyMainQueueDataToHost();
+  // With --gpu-lattice, that data stays on device: we append the main_q to the
+  // device storage of the channel (d_all_tokens_*) instead
+  void CopyMainQueueDataToTokensStorage();
+  // Makes sure that the device storage of ichannel can hold ntokens tokens and
+  // n_extra_prev_tokens extra prev tokens, keeping its content
+  void GrowChannelTokensStorage(ChannelId ichannel, int32 ntokens,
+                                int32 n_extra_prev_tokens);
+  DeviceTokensStorageView GetChannelTokensStorageView(ChannelId ichannel);
+  // Frees the buffers left by DeviceMatrix::Grow. compute_st_ must have been
+  // synchronized since they were retired
+  void FreeRetiredDeviceBuffers();
+  // Clones the device storage of init_channel_id_ into ichannel. Replaces
+  // InitDecodingH2HCopies with --gpu-lattice
+  void InitDecodingTokensStorage(ChannelId ichannel);
+  // Sets h_lanes_lattice_params_ for the channels loaded in the lanes (by
+  // GetBestCost) and copies it to device. The buffers used to build the
+  // lattice are only set if build_lattice is true (otherwise we only
+  // backtrack the best path)
+  void SetLanesLatticeParams(bool build_lattice);
+  // With --gpu-lattice, builds and prunes the raw lattices of the channels
+  // loaded in the lanes on device, and moves them to h_all_lattice_*.
+  // Called by PrepareForGetRawLattice
+  void BuildRawLatticesOnDevice();
+  // With --gpu-lattice, backtracks the best paths on device, and moves them to
+  // h_best_paths_. Called by GetBestPath
+  void BacktrackBestPathsOnDevice();
+  // ConcurrentGetRawLatticeSingleChannel with --gpu-lattice. Creates fst_out
+  // using h_all_lattice_*[ichannel]
+  void GetRawLatticeFromDeviceOutput(ChannelId ichannel, Lattice *fst_out);
   // CheckOverflow
   // If a kernel sets the flag h_q_overflow, we send a warning to stderr
   // Overflows are detected and prevented on the device. It only means
@@ -488,15 +539,15 @@ class CudaDecoder {
   //
   // The data is eiher linked to a channel, or to a lane.
   //
-  // Channel data (DeviceChannelMatrix):
+  // Channel data (DeviceChannelMatrix and the main_q pool):
   //
   // The data linked with a channel contains the data of frame i we need to
   // remember
   // to compute frame i+1. It is the list of tokens from frame i, with some
   // additional info
   // (ie the prefix sum of the emitting arcs degrees from those tokens).
-  // We are only storing d_main_q_state_and_cost_ as channel data because that's
-  // all we need in a token to compute
+  // We are only storing the state and cost of the tokens as channel data
+  // because that's all we need in a token to compute
   // frame i+1. We don't need token.arc_idx or token.prev_token.
   // The reason why we also store that prefix sum is because we do the emitting
   // preprocessing
@@ -506,6 +557,12 @@ class CudaDecoder {
   // preprocessing at the end of frame i,
   // and then save d_main_q_degrees_prefix_sum_. d_main_q_arc_offsets is
   // generated also during preprocessing.
+  // While a channel is computed on a lane, those three arrays are lane data.
+  // Between two calls to AdvanceDecoding, they are saved in the pool
+  // (d_pool_*), which is split into pages of KALDI_CUDA_DECODER_POOL_PAGE_SIZE
+  // tokens. A channel only owns the pages needed by its current main_q
+  // (usually far less than main_q_capacity_), and the pool grows if needed,
+  // so a channel never has to drop tokens when it is saved.
   //
   // Lane data (DeviceLaneMatrix):
   //
@@ -538,21 +595,40 @@ class CudaDecoder {
   // Channel data members:
   //
 
-  DeviceChannelMatrix<int2> d_main_q_state_and_cost_;
+  // Pool of pages, one page per row. Same content as d_main_q_state_and_cost_,
+  // d_main_q_degrees_prefix_sum_ and d_main_q_arc_offsets_
+  DeviceMatrix<int2> d_pool_state_and_cost_;
+  DeviceMatrix<int32> d_pool_degrees_prefix_sum_;
+  DeviceMatrix<int32> d_pool_arc_offsets_;
+  // Pages of the pool which are not used by any channel
+  std::vector<int32> free_pool_pages_;
+  // Pages used by each channel to store its main_q, in order
+  std::vector<std::vector<int32>> channel_pages_;
+  // False if the channel uses the pages of the initial channel (after
+  // InitDecoding): those are shared and must not be freed
+  std::vector<bool> channel_owns_pages_;
+  // Number of tokens and pages of the channel loaded/saved in each lane
+  // (cf copy_main_q_pages_kernel). The host buffer is pinned, we wait on
+  // main_q_pages_copied_evt_ before modifying it
+  HostLaneMatrix<int32> h_main_q_pages_;
+  DeviceLaneMatrix<int32> d_main_q_pages_;
+  cudaEvent_t main_q_pages_copied_evt_;
+
+  //
+  // Lane data members:
+  //
+
+  DeviceLaneMatrix<int2> d_main_q_state_and_cost_;
   // Prefix sum of the arc's degrees in the main_q. Used by ExpandArcs,
   // set in the preprocess stages (either PruneAndPreprocess or
   // preprocess_in_place in PostProcessingMainQueue)
-  DeviceChannelMatrix<int32> d_main_q_degrees_prefix_sum_;
+  DeviceLaneMatrix<int32> d_main_q_degrees_prefix_sum_;
   // d_main_q_arc_offsets[i] = fst_.arc_offsets[d_main_q_state[i]]
   // we pay the price for the random memory accesses of fst_.arc_offsets in the
   // preprocess kernel
   // we cache the results in d_main_q_arc_offsets which will be read in a
   // coalesced fashion in expand
-  DeviceChannelMatrix<int32> d_main_q_arc_offsets_;
-
-  //
-  // Lane data members:
-  //
+  DeviceLaneMatrix<int32> d_main_q_arc_offsets_;
 
   // InfoToken
   // Usually contains {prev_token, arc_idx}
@@ -651,6 +727,7 @@ class CudaDecoder {
   int32 hashmap_capacity_;
   // Static segment of the adaptive beam. Cf InitDeviceParams
   int32 adaptive_beam_static_segment_;
+  bool gpu_lattice_;
   // The first index of all the following vectors (or vector<vector>)
   // is the ChannelId. e.g., to get the number of frames decoded in channel 2,
   // look into num_frames_decoded_[2].
@@ -666,6 +743,36 @@ class CudaDecoder {
   std::vector<std::vector<InfoToken>> h_all_tokens_extra_prev_tokens_;
   std::vector<std::vector<float2>>
       h_all_tokens_extra_prev_tokens_extra_and_acoustic_cost_;
+  // Used instead of the h_all_tokens_* vectors with --gpu-lattice: the tokens
+  // of all frames stay on device. One matrix (of one column) per channel,
+  // grown when needed (cf GrowChannelTokensStorage)
+  std::vector<DeviceMatrix<InfoToken>> d_all_tokens_info_;
+  std::vector<DeviceMatrix<CostType>> d_all_tokens_acoustic_cost_;
+  std::vector<DeviceMatrix<InfoToken>> d_all_tokens_extra_prev_tokens_;
+  std::vector<DeviceMatrix<float2>>
+      d_all_tokens_extra_prev_tokens_extra_and_acoustic_cost_;
+  // Data used by the lattice kernels (--gpu-lattice). The buffers are shared
+  // by the lanes, each lane uses a segment of them (cf SetLanesLatticeParams)
+  HostLaneMatrix<LaneLatticeParams> h_lanes_lattice_params_;
+  DeviceLaneMatrix<LaneLatticeParams> d_lanes_lattice_params_;
+  std::vector<int32> h_lattice_frame_offsets_;
+  DeviceMatrix<int32> d_lattice_frame_offsets_;
+  DeviceMatrix<int32> d_lattice_state_int_extra_cost_;
+  DeviceMatrix<int32> d_lattice_state_id_;
+  DeviceMatrix<int32> d_lattice_list_owner_;
+  DeviceMatrix<DeviceLatticeArc> d_lattice_arcs_;
+  DeviceLaneMatrix<DeviceLatticeFinal> d_lattice_finals_;
+  DeviceMatrix<int32> d_best_path_;
+  // Old buffers of the growable matrices above, freed at the next
+  // synchronization of compute_st_ (cf FreeRetiredDeviceBuffers)
+  std::vector<void *> retired_device_buffers_;
+  // Pruned raw lattice of each channel, set by PrepareForGetRawLattice with
+  // --gpu-lattice
+  std::vector<int32> h_all_lattice_nstates_;
+  std::vector<std::vector<DeviceLatticeArc>> h_all_lattice_arcs_;
+  std::vector<std::vector<DeviceLatticeFinal>> h_all_lattice_finals_;
+  // Set by BacktrackBestPathsOnDevice, one per lane
+  std::vector<std::vector<int32>> h_best_paths_;
   std::vector<std::mutex> channel_lock_;  // at some point we should switch to a
                                           // shared_lock (to be able to compute
                                           // partial lattices while still
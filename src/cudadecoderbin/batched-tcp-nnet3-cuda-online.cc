@@ -0,0 +1,396 @@
+// cudadecoderbin/batched-tcp-nnet3-cuda-online.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#if HAVE_CUDA == 1
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "cudadecoder/batched-threaded-nnet3-cuda-online-pipeline.h"
+#include "cudamatrix/cu-allocator.h"
+#include "fstext/fstext-lib.h"
+#include "lat/lattice-functions.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+
+std::string LatticeToString(const Lattice &lat,
+                            const fst::SymbolTable &word_syms) {
+  LatticeWeight weight;
+  std::vector<int32> alignment;
+  std::vector<int32> words;
+  GetLinearSymbolSequence(lat, &alignment, &words, &weight);
+
+  std::ostringstream msg;
+  for (size_t i = 0; i < words.size(); i++) {
+    std::string s = word_syms.Find(words[i]);
+    if (s.empty()) {
+      KALDI_WARN << "Word-id " << words[i] << " not in symbol table.";
+      msg << "<#" << std::to_string(i) << "> ";
+    } else
+      msg << s << " ";
+  }
+  return msg.str();
+}
+
+std::string LatticeToString(const CompactLattice &clat,
+                            const fst::SymbolTable &word_syms) {
+  if (clat.NumStates() == 0) {
+    KALDI_WARN << "Empty lattice.";
+    return "";
+  }
+  CompactLattice best_path_clat;
+  CompactLatticeShortestPath(clat, &best_path_clat);
+
+  Lattice best_path_lat;
+  ConvertLattice(best_path_clat, &best_path_lat);
+  return LatticeToString(best_path_lat, word_syms);
+}
+
+// Writes all of 'msg' to the socket; returns false on error.
+bool WriteToSocket(int32 desc, const std::string &msg) {
+  const char *p = msg.c_str();
+  size_t to_write = msg.size();
+  while (to_write > 0) {
+    ssize_t ret = write(desc, p, to_write);
+    if (ret <= 0)
+      return false;
+    to_write -= ret;
+    p += ret;
+  }
+  return true;
+}
+
+// The state of one client connection.  The reader thread appends the audio
+// to 'samples'; the control loop in main() takes it from there.
+struct Connection {
+  int32 desc;
+  cuda_decoder::CorrelationID corr_id;
+  // True once TryInitCorrID() succeeded for corr_id.
+  bool initialized;
+  // The number of samples given to the pipeline, and when the next partial
+  // result is due.
+  int64 samp_count, check_count;
+
+  // 'mutex' guards the members below it.
+  std::mutex mutex;
+  std::vector<BaseFloat> samples;
+  bool input_finished;
+
+  Connection(int32 desc, cuda_decoder::CorrelationID corr_id,
+             int64 check_period):
+      desc(desc), corr_id(corr_id), initialized(false), samp_count(0),
+      check_count(check_period), input_finished(false) { }
+};
+
+// Reads the audio (16-bit signed linear PCM) of a connection until it is
+// closed by the client or times out.
+void ReadClient(int32 read_timeout, std::shared_ptr<Connection> conn) {
+  std::vector<char> buf(16384);
+  size_t num_bytes = 0;  // bytes in 'buf'.
+  pollfd client_set[1];
+  client_set[0].fd = conn->desc;
+  client_set[0].events = POLLIN;
+  while (true) {
+    int poll_ret = poll(client_set, 1, 1000 * read_timeout);
+    if (poll_ret <= 0) {
+      KALDI_WARN << (poll_ret == 0 ? "Socket timeout!" : "Socket error!")
+                 << " Disconnecting...";
+      break;
+    }
+    ssize_t ret = read(conn->desc, &(buf[num_bytes]), buf.size() - num_bytes);
+    if (ret <= 0)
+      break;  // the stream is over.
+    num_bytes += ret;
+    size_t num_samples = num_bytes / sizeof(int16);
+    const int16 *samples = reinterpret_cast<const int16*>(buf.data());
+    {
+      std::lock_guard<std::mutex> lock(conn->mutex);
+      conn->samples.insert(conn->samples.end(), samples,
+                           samples + num_samples);
+    }
+    // Keep any odd byte for the next read.
+    if (num_bytes % sizeof(int16) != 0)
+      buf[0] = buf[num_bytes - 1];
+    num_bytes %= sizeof(int16);
+  }
+  std::lock_guard<std::mutex> lock(conn->mutex);
+  conn->input_finished = true;
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace cuda_decoder;
+    using namespace fst;
+
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Reads in audio from many network connections at once and decodes\n"
+        "them on a GPU with BatchedThreadedNnet3CudaOnlinePipeline (nnet3\n"
+        "setup, with iVector-based speaker adaptation).  The audio that has\n"
+        "arrived from all the connections is decoded in batches of up to\n"
+        "--max-batch-size streams, at least --chunk-length seconds of audio\n"
+        "per stream (or the end of it), by one control thread.  Each\n"
+        "connection is decoded as one stream until it is closed (there is\n"
+        "no endpointing), with partial results (ending with \"\\r\") sent\n"
+        "every --output-period seconds of audio and the final result\n"
+        "(ending with \"\\n\") at the end.  The protocol is the same as for\n"
+        "online2-tcp-nnet3-decode-faster.  As in\n"
+        "online2-tcp-nnet3-decode-faster-batched, the neural net is evaluated\n"
+        "in chunks with left and right context.\n"
+        "\n"
+        "Usage: batched-tcp-nnet3-cuda-online [options] <nnet3-in> "
+        "<fst-in> <word-symbol-table>\n";
+
+    ParseOptions po(usage);
+
+    BatchedThreadedNnet3CudaOnlinePipelineConfig batched_decoder_config;
+    BaseFloat samp_freq = 16000.0, chunk_length_secs = 0.5,
+        output_period = 1.0;
+    int32 read_timeout = 3;
+    int port_num = 5050;
+
+    po.Register("samp-freq", &samp_freq,
+                "Sampling frequency of the input signal (coded as 16-bit slinear).");
+    po.Register("chunk-length", &chunk_length_secs,
+                "Minimum length in seconds of the audio of a stream that is "
+                "decoded at a time (longer means larger, more efficient batches "
+                "but more latency).");
+    po.Register("output-period", &output_period,
+                "How often in seconds, do we send partial results.");
+    po.Register("num-threads-startup", &g_num_threads,
+                "Number of threads used when initializing iVector extractor.");
+    po.Register("read-timeout", &read_timeout,
+                "Number of seconds of timout for TCP audio data to appear on the stream.");
+    po.Register("port-num", &port_num,
+                "Port number the server will listen on.");
+    CuDevice::RegisterDeviceOptions(&po);
+    RegisterCuAllocatorOptions(&po);
+    batched_decoder_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      return 1;
+    }
+
+    std::string nnet3_rxfilename = po.GetArg(1),
+        fst_rxfilename = po.GetArg(2),
+        word_syms_filename = po.GetArg(3);
+
+    g_cuda_allocator.SetOptions(g_allocator_options);
+    CuDevice::Instantiate().SelectGpuId("yes");
+    CuDevice::Instantiate().AllowMultithreading();
+
+    TransitionModel trans_model;
+    nnet3::AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(nnet3_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      nnet3::CollapseModel(nnet3::CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    fst::Fst<fst::StdArc> *decode_fst = ReadFstKaldiGeneric(fst_rxfilename);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+      KALDI_ERR << "Could not read symbol table from file "
+                << word_syms_filename;
+
+    BatchedThreadedNnet3CudaOnlinePipeline pipeline(
+        batched_decoder_config, *decode_fst, am_nnet, trans_model);
+    delete decode_fst;
+
+    signal(SIGPIPE, SIG_IGN); // ignore SIGPIPE to avoid crashing when socket forcefully disconnected
+
+    struct ::sockaddr_in h_addr;
+    h_addr.sin_addr.s_addr = INADDR_ANY;
+    h_addr.sin_port = htons(port_num);
+    h_addr.sin_family = AF_INET;
+    int32 server_desc = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_desc == -1)
+      KALDI_ERR << "Cannot create TCP socket!";
+    int32 flag = 1;
+    if (setsockopt(server_desc, SOL_SOCKET, SO_REUSEADDR, &flag,
+                   sizeof(flag)) == -1)
+      KALDI_ERR << "Cannot set socket options!";
+    if (bind(server_desc, (struct sockaddr *) &h_addr, sizeof(h_addr)) == -1)
+      KALDI_ERR << "Cannot bind to port: " << port_num << " (is it taken?)";
+    if (listen(server_desc, SOMAXCONN) == -1)
+      KALDI_ERR << "Cannot listen on port!";
+    KALDI_LOG << "Listening on port: " << port_num;
+
+    int64 chunk_len = static_cast<int64>(chunk_length_secs * samp_freq),
+        check_period = static_cast<int64>(output_period * samp_freq);
+
+    // New connections are added to 'new_connections' by the accept thread.
+    std::mutex new_connections_mutex;
+    std::vector<std::shared_ptr<Connection> > new_connections;
+    std::thread accept_thread([&]() {
+      CorrelationID next_corr_id = 0;
+      while (true) {
+        struct sockaddr_in client_addr;
+        socklen_t len = sizeof(client_addr);
+        int32 client_desc = accept(server_desc,
+                                   (struct sockaddr *) &client_addr, &len);
+        if (client_desc == -1) {
+          KALDI_WARN << "Error accepting connection";
+          continue;
+        }
+        char ipstr[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &client_addr.sin_addr, ipstr, sizeof(ipstr));
+        KALDI_LOG << "Accepted connection from: " << ipstr;
+        std::shared_ptr<Connection> conn(
+            new Connection(client_desc, next_corr_id++, check_period));
+        std::thread(ReadClient, read_timeout, conn).detach();
+        std::lock_guard<std::mutex> lock(new_connections_mutex);
+        new_connections.push_back(conn);
+      }
+    });
+    accept_thread.detach();
+
+    // The control loop; all the calls to 'pipeline' are made from here.
+    std::list<std::shared_ptr<Connection> > connections;
+    std::vector<CorrelationID> corr_ids;
+    std::vector<Vector<BaseFloat> > batch_samples;
+    std::vector<SubVector<BaseFloat> > wave_samples;
+    std::vector<bool> is_last_chunk;
+    std::vector<std::shared_ptr<Connection> > batch_connections;
+    while (true) {
+      {
+        std::lock_guard<std::mutex> lock(new_connections_mutex);
+        connections.insert(connections.end(), new_connections.begin(),
+                           new_connections.end());
+        new_connections.clear();
+      }
+      corr_ids.clear();
+      batch_samples.clear();
+      wave_samples.clear();
+      is_last_chunk.clear();
+      batch_connections.clear();
+      // Connections that waited are at the front; those in the batch go to
+      // the back, so that no connection starves when there are more than
+      // --max-batch-size.
+      std::list<std::shared_ptr<Connection> > requeued;
+      for (auto it = connections.begin(); it != connections.end() &&
+               static_cast<int32>(corr_ids.size()) < pipeline.MaxBatchSize();) {
+        std::shared_ptr<Connection> conn = *it;
+        bool last;
+        {
+          std::lock_guard<std::mutex> lock(conn->mutex);
+          last = conn->input_finished;
+          if (!last && static_cast<int64>(conn->samples.size()) < chunk_len) {
+            ++it;
+            continue;
+          }
+          if (!conn->initialized) {
+            if (!pipeline.TryInitCorrID(conn->corr_id, samp_freq)) {
+              ++it;
+              continue;  // all the channels are in use; try again later.
+            }
+            conn->initialized = true;
+            int32 desc = conn->desc;
+            const fst::SymbolTable *syms = word_syms;
+            pipeline.SetLatticeCallback(
+                conn->corr_id, [desc, syms](CompactLattice &clat) {
+                  std::string msg = LatticeToString(clat, *syms);
+                  KALDI_VLOG(1) << "EndOfAudio, sending message: " << msg;
+                  WriteToSocket(desc, msg + "\n");
+                  close(desc);
+                });
+          }
+          batch_samples.push_back(Vector<BaseFloat>(conn->samples.size(),
+                                                    kUndefined));
+          std::copy(conn->samples.begin(), conn->samples.end(),
+                    batch_samples.back().Data());
+          conn->samples.clear();
+        }
+        conn->samp_count += batch_samples.back().Dim();
+        corr_ids.push_back(conn->corr_id);
+        is_last_chunk.push_back(last);
+        batch_connections.push_back(conn);
+        it = connections.erase(it);
+        if (!last)
+          requeued.push_back(conn);
+      }
+      connections.splice(connections.end(), requeued);
+      if (corr_ids.empty()) {
+        kaldi::Sleep(0.01);
+        continue;
+      }
+      for (size_t i = 0; i < batch_samples.size(); i++)
+        wave_samples.push_back(SubVector<BaseFloat>(batch_samples[i], 0,
+                                                    batch_samples[i].Dim()));
+      pipeline.DecodeBatch(corr_ids, wave_samples, is_last_chunk);
+
+      // Send the partial results that are due.
+      std::vector<CorrelationID> partial_ids;
+      std::vector<std::shared_ptr<Connection> > partial_connections;
+      for (size_t i = 0; i < batch_connections.size(); i++) {
+        Connection *conn = batch_connections[i].get();
+        if (!is_last_chunk[i] && conn->samp_count > conn->check_count) {
+          partial_ids.push_back(conn->corr_id);
+          partial_connections.push_back(batch_connections[i]);
+          while (conn->check_count < conn->samp_count)
+            conn->check_count += check_period;
+        }
+      }
+      if (!partial_ids.empty()) {
+        std::vector<Lattice> lats(partial_ids.size());
+        std::vector<Lattice*> lat_ptrs(partial_ids.size());
+        for (size_t i = 0; i < lats.size(); i++)
+          lat_ptrs[i] = &(lats[i]);
+        pipeline.GetBestPath(partial_ids, lat_ptrs);
+        for (size_t i = 0; i < lats.size(); i++) {
+          if (lats[i].NumStates() == 0)
+            continue;
+          std::string msg = LatticeToString(lats[i], *word_syms);
+          KALDI_VLOG(1) << "Temporary transcript: " << msg;
+          // If this fails, the reader thread will see the connection close.
+          WriteToSocket(partial_connections[i]->desc, msg + "\r");
+        }
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+} // main()
+
+#endif  // HAVE_CUDA == 1
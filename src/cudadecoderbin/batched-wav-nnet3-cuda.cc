@@ -21,12 +21,13 @@
 #include <cuda_profiler_api.h>
 #include <nvToolsExt.h>
 #include <sstream>
-#include "cudadecoder/batched-threaded-nnet3-cuda-pipeline.h"
+#include "cudadecoder/batched-threaded-nnet3-cuda-multi-gpu-pipeline.h"
 #include "cudamatrix/cu-allocator.h"
 #include "fstext/fstext-lib.h"
 #include "lat/lattice-functions.h"
 #include "nnet3/am-nnet-simple.h"
 #include "nnet3/nnet-utils.h"
+#include "util/kaldi-metrics.h"
 #include "util/kaldi-thread.h"
 using namespace kaldi;
 using namespace cuda_decoder;
@@ -142,6 +143,23 @@ int main(int argc, char *argv[]) {
                 "Useful for profiling");
     po.Register("iterations", &iterations,
                 "Number of times to decode the corpus.");
+    int32 metrics_port = 0;
+    po.Register("metrics-port", &metrics_port,
+                "If nonzero, serve runtime metrics (queue length, channels in "
+                "use, latency, etc.) in the Prometheus format over HTTP on "
+                "this port, at /metrics.");
+    std::string metrics_bind_address = "127.0.0.1";
+    po.Register("metrics-bind-address", &metrics_bind_address,
+                "IPv4 address the metrics server listens on; the default only "
+                "accepts local connections.  Use 0.0.0.0 to allow scraping "
+                "from other hosts (the endpoint has no authentication).");
+    std::string gpu_ids_str;
+    po.Register("gpu-ids", &gpu_ids_str,
+                "Comma-separated list of the CUDA device-ids of the GPUs to "
+                "decode on, e.g. 0,1,2,3; each runs its own pipeline, with "
+                "the options below, and the utterances are shared between "
+                "them according to their load.  If empty, one GPU is used, "
+                "chosen as for other programs.");
 
     // Multi-threaded CPU and batched GPU decoder
     BatchedThreadedNnet3CudaPipelineConfig batched_decoder_config;
@@ -157,11 +175,20 @@ int main(int argc, char *argv[]) {
       return 1;
     }
 
+    MetricsHttpServer metrics_server;
+    if (metrics_port != 0 &&
+        !metrics_server.Start(metrics_port, metrics_bind_address))
+      KALDI_ERR << "Could not serve metrics on port " << metrics_port;
+
     g_cuda_allocator.SetOptions(g_allocator_options);
     CuDevice::Instantiate().SelectGpuId("yes");
     CuDevice::Instantiate().AllowMultithreading();
 
-    BatchedThreadedNnet3CudaPipeline cuda_pipeline(batched_decoder_config);
+    std::vector<int32> gpu_ids;
+    if (!SplitStringToIntegers(gpu_ids_str, ",", false, &gpu_ids))
+      KALDI_ERR << "Invalid --gpu-ids option: " << gpu_ids_str;
+    BatchedThreadedNnet3CudaMultiGpuPipeline cuda_pipeline(
+        batched_decoder_config, gpu_ids);
 
     std::string nnet3_rxfilename = po.GetArg(1), fst_rxfilename = po.GetArg(2),
                 wav_rspecifier = po.GetArg(3), clat_wspecifier = po.GetArg(4);
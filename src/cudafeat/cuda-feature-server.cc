@@ -0,0 +1,232 @@
+// cudafeat/cuda-feature-server.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cudafeat/cuda-feature-server.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+
+CudaFeatureServer::CudaFeatureServer(
+    const CudaFeatureServerConfig &config,
+    const OnlineNnet2FeaturePipelineInfo &info):
+    config_(config), info_(info), spectral_feat_(NULL), dim_(0),
+    num_streams_(0), stop_(false), num_batches_(0), num_chunks_(0) {
+  KALDI_ASSERT(config_.max_batch_size > 0);
+  // spectral_feat_ is created on this thread and used on thread_.
+  CuDevice::Instantiate().AllowMultithreading();
+  if (info_.feature_type == "mfcc") {
+    spectral_feat_ = new CudaSpectralFeatures(info_.mfcc_opts);
+    frame_opts_ = info_.mfcc_opts.frame_opts;
+  } else if (info_.feature_type == "fbank") {
+    spectral_feat_ = new CudaSpectralFeatures(info_.fbank_opts);
+    frame_opts_ = info_.fbank_opts.frame_opts;
+  } else {
+    KALDI_ERR << "The GPU feature server does not support feature type "
+              << info_.feature_type;
+  }
+  if (!frame_opts_.snip_edges)
+    KALDI_ERR << "The GPU feature server requires --snip-edges=true.";
+  dim_ = spectral_feat_->Dim();
+  thread_ = std::thread(&CudaFeatureServer::ServerLoop, this);
+}
+
+CudaFeatureServer::~CudaFeatureServer() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (num_streams_ != 0)
+      KALDI_ERR << "CudaFeatureServer destroyed while " << num_streams_
+                << " clients still exist.";
+    stop_ = true;
+  }
+  queue_cond_.notify_all();
+  thread_.join();
+  delete spectral_feat_;
+  KALDI_LOG << "GPU feature server processed " << num_chunks_
+            << " chunks of audio in " << num_batches_ << " batches.";
+}
+
+BaseFloat CudaFeatureServer::FrameShiftInSeconds() const {
+  return frame_opts_.frame_shift_ms / 1000.0;
+}
+
+CudaFeatureServer::Stream *CudaFeatureServer::NewStream() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  num_streams_++;
+  return new Stream();
+}
+
+void CudaFeatureServer::DeleteStream(Stream *stream) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // the server thread may still be processing it.
+  while (stream->queued)
+    done_cond_.wait(lock);
+  num_streams_--;
+  delete stream;
+}
+
+void CudaFeatureServer::EnqueueStream(Stream *stream) {
+  if (!stream->queued) {
+    stream->queued = true;
+    queue_.push_back(stream);
+    queue_cond_.notify_one();
+  }
+}
+
+void CudaFeatureServer::AcceptWaveform(Stream *stream,
+                                       BaseFloat sampling_rate,
+                                       const VectorBase<BaseFloat> &waveform) {
+  if (sampling_rate != frame_opts_.samp_freq)
+    KALDI_ERR << "Sampling frequency mismatch, expected "
+              << frame_opts_.samp_freq << ", got " << sampling_rate;
+  if (waveform.Dim() == 0)
+    return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (stream->input_finished)
+    KALDI_ERR << "AcceptWaveform called after InputFinished.";
+  stream->pending_audio.insert(stream->pending_audio.end(), waveform.Data(),
+                               waveform.Data() + waveform.Dim());
+  EnqueueStream(stream);
+}
+
+void CudaFeatureServer::InputFinished(Stream *stream) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  stream->input_finished = true;
+}
+
+void CudaFeatureServer::WaitForFrames(Stream *stream,
+                                      std::vector<Vector<BaseFloat> > *frames) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (stream->queued)
+    done_cond_.wait(lock);
+  for (size_t i = 0; i < stream->frames.size(); i++) {
+    frames->push_back(Vector<BaseFloat>());
+    frames->back().Swap(&(stream->frames[i]));
+  }
+  stream->frames.clear();
+}
+
+void CudaFeatureServer::ComputeChunk(const Vector<BaseFloat> &wave,
+                                     Matrix<BaseFloat> *feats,
+                                     Vector<BaseFloat> *remainder) {
+  int32 num_frames = NumFrames(wave.Dim(), frame_opts_, false);
+  if (num_frames == 0) {
+    feats->Resize(0, dim_);
+    *remainder = wave;
+    return;
+  }
+  CuVector<BaseFloat> cu_wave(wave);
+  CuMatrix<BaseFloat> cu_feats;
+  BaseFloat vtln_warp = 1.0;
+  spectral_feat_->ComputeFeatures(cu_wave, frame_opts_.samp_freq, vtln_warp,
+                                  &cu_feats);
+  KALDI_ASSERT(cu_feats.NumRows() == num_frames);
+  feats->Resize(num_frames, dim_, kUndefined);
+  cu_feats.CopyToMat(feats);
+  // With snip-edges=true the next frame starts at num_frames * shift.
+  int32 next_frame_start = num_frames * frame_opts_.WindowShift();
+  remainder->Resize(wave.Dim() - next_frame_start, kUndefined);
+  remainder->CopyFromVec(wave.Range(next_frame_start, remainder->Dim()));
+}
+
+void CudaFeatureServer::ServerLoop() {
+  std::vector<Stream*> batch;
+  std::vector<Vector<BaseFloat> > waves;
+  std::vector<Matrix<BaseFloat> > feats;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (queue_.empty() && !stop_)
+        queue_cond_.wait(lock);
+      if (queue_.empty())  // stop_ is true.
+        return;
+      batch.clear();
+      while (!queue_.empty() &&
+             static_cast<int32>(batch.size()) < config_.max_batch_size) {
+        batch.push_back(queue_.front());
+        queue_.pop_front();
+      }
+      // Take the pending audio of the batch; the clients may add more while
+      // we are computing, which will go in the next batch.
+      waves.resize(batch.size());
+      for (size_t i = 0; i < batch.size(); i++) {
+        Stream *stream = batch[i];
+        int32 remainder_dim = stream->remainder.Dim();
+        waves[i].Resize(remainder_dim + stream->pending_audio.size(),
+                        kUndefined);
+        waves[i].Range(0, remainder_dim).CopyFromVec(stream->remainder);
+        std::copy(stream->pending_audio.begin(), stream->pending_audio.end(),
+                  waves[i].Data() + remainder_dim);
+        stream->pending_audio.clear();
+      }
+    }
+    feats.resize(batch.size());
+    // stream->remainder is only accessed by this thread, so we can write it
+    // without the lock.
+    for (size_t i = 0; i < batch.size(); i++)
+      ComputeChunk(waves[i], &(feats[i]), &(batch[i]->remainder));
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      for (size_t i = 0; i < batch.size(); i++) {
+        Stream *stream = batch[i];
+        for (int32 t = 0; t < feats[i].NumRows(); t++)
+          stream->frames.push_back(Vector<BaseFloat>(feats[i].Row(t)));
+        if (stream->pending_audio.empty())
+          stream->queued = false;
+        else  // more audio arrived while we were computing.
+          queue_.push_back(stream);
+      }
+      num_batches_++;
+      num_chunks_ += batch.size();
+    }
+    done_cond_.notify_all();
+  }
+}
+
+
+OnlineCudaFeatureClient::OnlineCudaFeatureClient(CudaFeatureServer *server):
+    server_(server), stream_(server->NewStream()), input_finished_(false) { }
+
+OnlineCudaFeatureClient::~OnlineCudaFeatureClient() {
+  server_->DeleteStream(stream_);
+}
+
+void OnlineCudaFeatureClient::AcceptWaveform(
+    BaseFloat sampling_rate, const VectorBase<BaseFloat> &waveform) {
+  server_->AcceptWaveform(stream_, sampling_rate, waveform);
+}
+
+void OnlineCudaFeatureClient::InputFinished() {
+  server_->InputFinished(stream_);
+  input_finished_ = true;
+}
+
+int32 OnlineCudaFeatureClient::NumFramesReady() const {
+  server_->WaitForFrames(stream_, &frames_);
+  return frames_.size();
+}
+
+bool OnlineCudaFeatureClient::IsLastFrame(int32 frame) const {
+  return input_finished_ && frame == NumFramesReady() - 1;
+}
+
+void OnlineCudaFeatureClient::GetFrame(int32 frame,
+                                       VectorBase<BaseFloat> *feat) {
+  KALDI_ASSERT(static_cast<size_t>(frame) < frames_.size());
+  feat->CopyFromVec(frames_[frame]);
+}
+
+}  // namespace kaldi
@@ -0,0 +1,195 @@
+// cudafeat/cuda-feature-server.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_CUDAFEAT_CUDA_FEATURE_SERVER_H_
+#define KALDI_CUDAFEAT_CUDA_FEATURE_SERVER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "base/kaldi-error.h"
+#include "cudafeat/feature-spectral-cuda.h"
+#include "itf/online-feature-itf.h"
+#include "matrix/matrix-lib.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+
+namespace kaldi {
+
+struct CudaFeatureServerConfig {
+  int32 max_batch_size;
+
+  CudaFeatureServerConfig(): max_batch_size(64) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("feature-server.max-batch-size", &max_batch_size,
+                   "The maximum number of streams whose pending audio the GPU "
+                   "feature server processes in one batch.");
+  }
+};
+
+class OnlineCudaFeatureClient;
+
+/**
+   CudaFeatureServer computes MFCC or filterbank features on the GPU for many
+   streams of audio at once, for programs where the decoding is done on the
+   CPU (e.g. by many threads each running a SingleUtteranceNnet3Decoder): one
+   thread owns the GPU and processes, in batches, the audio that the streams
+   have received since they were last processed, so the decoding threads
+   don't need a CUDA context of their own.
+
+   Each stream is an OnlineCudaFeatureClient, which is an OnlineBaseFeature
+   and so can be given to OnlineNnet2FeaturePipeline in place of OnlineMfcc or
+   OnlineFbank; the online CMVN, pitch and iVector parts of that pipeline
+   stay on the CPU.  (The GPU versions of those in this directory, used by
+   OnlineCudaFeaturePipeline, process a whole utterance at a time and can't
+   be continued from chunk to chunk.)  Usage is something like:
+   \code
+     CudaFeatureServer server(server_config, feature_info);
+     // ... in each decoding thread, for each utterance:
+     OnlineNnet2FeaturePipeline feature_pipeline(
+         feature_info, new OnlineCudaFeatureClient(&server));
+   \endcode
+   Features are computed with snip-edges=true framing, so that each chunk's
+   frames start at a fixed offset; the features are the same as computing them
+   from the whole utterance at once.
+*/
+class CudaFeatureServer {
+ public:
+  /// Only info.feature_type ("mfcc" or "fbank") and the corresponding options
+  /// are used; the server must not outlive 'info'.
+  CudaFeatureServer(const CudaFeatureServerConfig &config,
+                    const OnlineNnet2FeaturePipelineInfo &info);
+
+  int32 Dim() const { return dim_; }
+
+  BaseFloat FrameShiftInSeconds() const;
+
+  /// Returns the number of batches and of stream chunks processed so far.
+  int64 NumBatches() const { return num_batches_; }
+  int64 NumChunks() const { return num_chunks_; }
+
+  /// Waits for the clients' pending audio to be processed, and stops the
+  /// GPU thread.  All the clients must be destroyed before this.
+  ~CudaFeatureServer();
+
+ private:
+  friend class OnlineCudaFeatureClient;
+
+  // The state of one client's stream; it is protected by mutex_.
+  struct Stream {
+    // audio received by AcceptWaveform() that has not been processed yet.
+    std::vector<BaseFloat> pending_audio;
+    // the samples at the end of the audio processed so far that are needed
+    // for the next frame.
+    Vector<BaseFloat> remainder;
+    // the features computed and not yet collected by WaitForFrames().
+    std::vector<Vector<BaseFloat> > frames;
+    bool input_finished;
+    // true while the stream is in queue_ or is being processed.
+    bool queued;
+    Stream(): input_finished(false), queued(false) { }
+  };
+
+  // These are called by OnlineCudaFeatureClient.
+  Stream *NewStream();
+  void DeleteStream(Stream *stream);
+  void AcceptWaveform(Stream *stream, BaseFloat sampling_rate,
+                      const VectorBase<BaseFloat> &waveform);
+  void InputFinished(Stream *stream);
+  // Waits until all the audio given to the stream has been processed, and
+  // appends the features computed since the last call to 'frames'.
+  void WaitForFrames(Stream *stream, std::vector<Vector<BaseFloat> > *frames);
+
+  // Must be called with mutex_ held.
+  void EnqueueStream(Stream *stream);
+
+  // The loop of thread_.
+  void ServerLoop();
+
+  // Computes the features of 'wave' (the stream's remainder followed by its
+  // pending audio) into 'feats', and sets 'remainder' to the samples needed
+  // for the next frame.  Called by thread_ without mutex_ held.
+  void ComputeChunk(const Vector<BaseFloat> &wave, Matrix<BaseFloat> *feats,
+                    Vector<BaseFloat> *remainder);
+
+  CudaFeatureServerConfig config_;
+  const OnlineNnet2FeaturePipelineInfo &info_;
+  FrameExtractionOptions frame_opts_;
+  CudaSpectralFeatures *spectral_feat_;
+  int32 dim_;
+
+  std::mutex mutex_;
+  // notified when streams are queued, and when stop_ is set.
+  std::condition_variable queue_cond_;
+  // notified when a batch has been processed.
+  std::condition_variable done_cond_;
+  std::deque<Stream*> queue_;
+  int32 num_streams_;
+  bool stop_;
+  int64 num_batches_;
+  int64 num_chunks_;
+  std::thread thread_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CudaFeatureServer);
+};
+
+
+/// The client side of CudaFeatureServer, for one stream of audio; see the
+/// documentation of CudaFeatureServer.  AcceptWaveform() hands the audio to
+/// the server without waiting; NumFramesReady() waits until the server has
+/// processed all the audio accepted so far, so as for OnlineMfcc, all the
+/// frames the audio allows for are ready once decoding asks for them.
+/// Different clients may be used from different threads; each client is used
+/// by one thread.
+class OnlineCudaFeatureClient: public OnlineBaseFeature {
+ public:
+  explicit OnlineCudaFeatureClient(CudaFeatureServer *server);
+
+  virtual int32 Dim() const { return server_->Dim(); }
+
+  virtual bool IsLastFrame(int32 frame) const;
+
+  virtual BaseFloat FrameShiftInSeconds() const {
+    return server_->FrameShiftInSeconds();
+  }
+
+  virtual int32 NumFramesReady() const;
+
+  virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+
+  virtual void AcceptWaveform(BaseFloat sampling_rate,
+                              const VectorBase<BaseFloat> &waveform);
+
+  virtual void InputFinished();
+
+  virtual ~OnlineCudaFeatureClient();
+
+ private:
+  CudaFeatureServer *server_;
+  CudaFeatureServer::Stream *stream_;
+  // The features collected from the server by NumFramesReady(), so
+  // GetFrame() doesn't need to lock.
+  mutable std::vector<Vector<BaseFloat> > frames_;
+  bool input_finished_;
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_CUDAFEAT_CUDA_FEATURE_SERVER_H_
@@ -0,0 +1,383 @@
+// cudafeat/feature-pitch-cuda.cu
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#if HAVE_CUDA == 1
+#include <cub/cub.cuh>
+#include <math_constants.h>
+#endif
+
+#include "cudafeat/feature-pitch-cuda.h"
+#include "cudamatrix/cu-array.h"
+#include "feat/resample.h"
+
+// Each thread computes one output sample of the low-pass filtered and
+// resampled signal, computing the filter weights as in
+// LinearResample::SetIndexesAndWeights() and LinearResample::FilterFunc().
+// The output is as from LinearResample::Resample() with flush == true.
+__global__ void pitch_downsample_kernel(const float *wave, int32_t num_samples,
+                                        double samp_rate_in,
+                                        double samp_rate_out,
+                                        double filter_cutoff,
+                                        int32_t num_zeros, float *out,
+                                        int32_t num_out) {
+  int32_t n = blockIdx.x * blockDim.x + threadIdx.x;
+  if (n >= num_out) return;
+  double window_width = num_zeros / (2.0 * filter_cutoff),
+      output_t = n / samp_rate_out;
+  int32_t min_index = ceil((output_t - window_width) * samp_rate_in),
+      max_index = floor((output_t + window_width) * samp_rate_in);
+  if (min_index < 0) min_index = 0;
+  if (max_index >= num_samples) max_index = num_samples - 1;
+  float sum = 0.0;
+  for (int32_t i = min_index; i <= max_index; i++) {
+    float t = i / samp_rate_in - output_t, window, filter;
+    if (fabsf(t) < window_width)
+      window = 0.5 * (1 + cos(2.0 * M_PI * filter_cutoff / num_zeros * t));
+    else
+      window = 0.0;
+    if (t != 0)
+      filter = sin(2.0 * M_PI * filter_cutoff * t) / (M_PI * t);
+    else
+      filter = 2 * filter_cutoff;
+    sum += wave[i] * (filter * window / samp_rate_in);
+  }
+  out[n] = sum;
+}
+
+// Each thread block processes one frame: it extracts the window of the
+// downsampled signal (zero-padded at the edges, as in
+// OnlinePitchFeatureImpl::ExtractFrame()), and computes the NCCF for the
+// pitch computation (with the ballast term) and for the probability of voicing
+// (without it), at the lags first_lag, first_lag + 1, ...  as in
+// ComputeCorrelation() and ComputeNccf().  The window is held in dynamically
+// allocated shared memory of size full_frame_length.
+__global__ void pitch_nccf_kernel(const float *wave, int32_t num_samples,
+                                  int32_t frame_shift,
+                                  int32_t basic_frame_length,
+                                  int32_t full_frame_length, bool snip_edges,
+                                  int32_t first_lag, int32_t num_lags,
+                                  float nccf_ballast, float *nccf_pitch,
+                                  int32_t pitch_stride, float *nccf_pov,
+                                  int32_t pov_stride) {
+  typedef cub::BlockReduce<float, CU1DBLOCK> BlockReduce;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  __shared__ float mean, e1;
+  extern __shared__ float window[];
+
+  int32_t frame = blockIdx.x, tid = threadIdx.x;
+  int64_t start_sample;
+  if (snip_edges)
+    start_sample = static_cast<int64_t>(frame) * frame_shift;
+  else
+    start_sample = static_cast<int64_t>((frame + 0.5) * frame_shift) -
+        full_frame_length / 2;
+
+  float sum = 0.0;
+  for (int32_t i = tid; i < full_frame_length; i += blockDim.x) {
+    int64_t s = start_sample + i;
+    float value = (s >= 0 && s < num_samples ? wave[s] : 0.0f);
+    window[i] = value;
+    if (i < basic_frame_length) sum += value;
+  }
+  sum = BlockReduce(temp_storage).Sum(sum);
+  if (tid == 0) mean = sum / basic_frame_length;
+  __syncthreads();
+
+  // As in ComputeCorrelation(), subtract the mean of the first
+  // basic_frame_length samples from the whole window.
+  float sumsq = 0.0;
+  for (int32_t i = tid; i < full_frame_length; i += blockDim.x) {
+    float value = window[i] - mean;
+    window[i] = value;
+    if (i < basic_frame_length) sumsq += value * value;
+  }
+  sumsq = BlockReduce(temp_storage).Sum(sumsq);
+  if (tid == 0) e1 = sumsq;
+  __syncthreads();
+
+  for (int32_t l = tid; l < num_lags; l += blockDim.x) {
+    const float *shifted = window + first_lag + l;
+    float e2 = 0.0, inner_prod = 0.0;
+    for (int32_t i = 0; i < basic_frame_length; i++) {
+      e2 += shifted[i] * shifted[i];
+      inner_prod += window[i] * shifted[i];
+    }
+    float norm_prod = e1 * e2,
+        pitch_denominator = sqrtf(norm_prod + nccf_ballast),
+        pov_denominator = sqrtf(norm_prod);
+    nccf_pitch[frame * pitch_stride + l] =
+        (pitch_denominator != 0.0 ? inner_prod / pitch_denominator : 0.0);
+    nccf_pov[frame * pov_stride + l] =
+        (pov_denominator != 0.0 ? inner_prod / pov_denominator : 0.0);
+  }
+}
+
+// This kernel, which is launched with a single thread block, does the Viterbi
+// search of the pitch tracker (see PitchFrameInfo::ComputeBacktraces()) over
+// all frames and the traceback from the best final state, which it writes to
+// best_states.  The states are the lags; each thread handles a subset of the
+// states, and finds the best predecessor of each by exhaustive search, which
+// gives the same result as the bounded search of the CPU code.  As on the CPU,
+// the forward costs are renormalized on each frame so that the smallest is
+// zero.  forward_cost must have space for 2 * num_states elements, and
+// backpointers for num_frames * num_states elements.
+__global__ void pitch_viterbi_kernel(const float *nccf_pitch,
+                                     int32_t nccf_stride, const float *lags,
+                                     int32_t num_frames, int32_t num_states,
+                                     float soft_min_f0,
+                                     float inter_frame_factor,
+                                     float *forward_cost,
+                                     int32_t *backpointers,
+                                     int32_t *best_states) {
+  typedef cub::BlockReduce<float, CU1DBLOCK> BlockReduce;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  __shared__ float min_cost;
+
+  int32_t tid = threadIdx.x;
+  float *prev_cost = forward_cost, *cur_cost = forward_cost + num_states;
+  // The forward cost of the fake frame -1 is zero.
+  for (int32_t i = tid; i < num_states; i += blockDim.x)
+    prev_cost[i] = 0.0;
+  __syncthreads();
+
+  for (int32_t t = 0; t < num_frames; t++) {
+    const float *nccf = nccf_pitch + t * nccf_stride;
+    float this_min = CUDART_INF_F;
+    for (int32_t i = tid; i < num_states; i += blockDim.x) {
+      float best_cost = CUDART_INF_F;
+      int32_t best_j = -1;
+      for (int32_t j = 0; j < num_states; j++) {
+        float this_cost = (j - i) * (j - i) * inter_frame_factor +
+            prev_cost[j];
+        if (this_cost < best_cost) {
+          best_cost = this_cost;
+          best_j = j;
+        }
+      }
+      // The local cost, as in ComputeLocalCost().
+      float local_cost = 1.0 - nccf[i] + soft_min_f0 * lags[i] * nccf[i];
+      cur_cost[i] = best_cost + local_cost;
+      backpointers[t * num_states + i] = best_j;
+      this_min = fminf(this_min, cur_cost[i]);
+    }
+    this_min = BlockReduce(temp_storage).Reduce(this_min, cub::Min());
+    if (tid == 0) min_cost = this_min;
+    __syncthreads();
+    for (int32_t i = tid; i < num_states; i += blockDim.x)
+      cur_cost[i] -= min_cost;
+    float *tmp = prev_cost;
+    prev_cost = cur_cost;
+    cur_cost = tmp;
+    __syncthreads();
+  }
+
+  if (tid == 0) {
+    int32_t best_state = 0;
+    for (int32_t i = 1; i < num_states; i++)
+      if (prev_cost[i] < prev_cost[best_state]) best_state = i;
+    for (int32_t t = num_frames - 1; t >= 0; t--) {
+      best_states[t] = best_state;
+      best_state = backpointers[t * num_states + best_state];
+    }
+  }
+}
+
+// Writes the raw pitch features (NCCF for the probability of voicing, pitch in
+// Hz) for the best state of each frame, as OnlinePitchFeatureImpl::GetFrame().
+__global__ void pitch_output_kernel(const int32_t *best_states,
+                                    const float *nccf_pov, int32_t pov_stride,
+                                    const float *lags, int32_t num_frames,
+                                    float *out, int32_t out_stride) {
+  int32_t t = blockIdx.x * blockDim.x + threadIdx.x;
+  if (t >= num_frames) return;
+  int32_t state = best_states[t];
+  out[t * out_stride] = nccf_pov[t * pov_stride + state];
+  out[t * out_stride + 1] = 1.0 / lags[state];
+}
+
+namespace kaldi {
+
+CudaPitchFeatures::CudaPitchFeatures(const PitchExtractionOptions &pitch_opts,
+                                     const ProcessPitchOptions &process_opts)
+    : pitch_opts_(pitch_opts), process_opts_(process_opts) {
+  if (pitch_opts_.preemph_coeff != 0.0)
+    KALDI_ERR << "The CUDA pitch extractor does not support --preemphasis-"
+              << "coefficient";
+  // The rest of this is as in the constructor of OnlinePitchFeatureImpl.
+  double outer_min_lag = 1.0 / pitch_opts_.max_f0 -
+      (pitch_opts_.upsample_filter_width / (2.0 * pitch_opts_.resample_freq));
+  double outer_max_lag = 1.0 / pitch_opts_.min_f0 +
+      (pitch_opts_.upsample_filter_width / (2.0 * pitch_opts_.resample_freq));
+  nccf_first_lag_ = ceil(pitch_opts_.resample_freq * outer_min_lag);
+  nccf_last_lag_ = floor(pitch_opts_.resample_freq * outer_max_lag);
+
+  // Choose the lags as SelectLags() does.
+  std::vector<BaseFloat> lags;
+  BaseFloat min_lag = 1.0 / pitch_opts_.max_f0,
+      max_lag = 1.0 / pitch_opts_.min_f0;
+  for (BaseFloat lag = min_lag; lag <= max_lag;
+       lag *= 1.0 + pitch_opts_.delta_pitch)
+    lags.push_back(lag);
+  Vector<BaseFloat> lags_vec(lags.size());
+  std::copy(lags.begin(), lags.end(), lags_vec.Data());
+  lags_ = lags_vec;
+
+  // The NCCF resampling is linear, so we get its matrix by resampling the
+  // unit matrix.
+  Vector<BaseFloat> lags_offset(lags_vec);
+  lags_offset.Add(-nccf_first_lag_ / pitch_opts_.resample_freq);
+  int32 num_measured_lags = nccf_last_lag_ + 1 - nccf_first_lag_;
+  ArbitraryResample nccf_resampler(num_measured_lags,
+                                   pitch_opts_.resample_freq,
+                                   pitch_opts_.resample_freq * 0.5,
+                                   lags_offset,
+                                   pitch_opts_.upsample_filter_width);
+  Matrix<BaseFloat> unit(num_measured_lags, num_measured_lags),
+      weights(num_measured_lags, lags_vec.Dim());
+  unit.AddToDiag(1.0);
+  nccf_resampler.Resample(unit, &weights);
+  nccf_resample_weights_ = weights;
+}
+
+int32 CudaPitchFeatures::Dim() const {
+  return (process_opts_.add_pov_feature ? 1 : 0) +
+      (process_opts_.add_normalized_log_pitch ? 1 : 0) +
+      (process_opts_.add_delta_pitch ? 1 : 0) +
+      (process_opts_.add_raw_log_pitch ? 1 : 0);
+}
+
+int32 CudaPitchFeatures::NumFrames(int64 num_downsampled_samples) const {
+  int32 frame_shift = pitch_opts_.NccfWindowShift(),
+      frame_length = pitch_opts_.NccfWindowSize();
+  if (num_downsampled_samples < frame_length)
+    return 0;
+  if (!pitch_opts_.snip_edges)
+    return static_cast<int32>(num_downsampled_samples * 1.0f /
+                              frame_shift + 0.5f);
+  return static_cast<int32>((num_downsampled_samples - frame_length) /
+                            frame_shift + 1);
+}
+
+void CudaPitchFeatures::Downsample(const CuVectorBase<BaseFloat> &wave,
+                                   CuVector<BaseFloat> *downsampled) const {
+  // The number of output samples is as LinearResample::GetNumOutputSamples()
+  // with flush == true: the number of output sample times in the interval
+  // [0, wave.Dim() / samp_freq).
+  int32 samp_rate_in = pitch_opts_.samp_freq,
+      samp_rate_out = pitch_opts_.resample_freq,
+      tick_freq = Lcm(samp_rate_in, samp_rate_out),
+      ticks_per_input_period = tick_freq / samp_rate_in,
+      ticks_per_output_period = tick_freq / samp_rate_out;
+  int64 interval_length_in_ticks =
+      static_cast<int64>(wave.Dim()) * ticks_per_input_period;
+  int32 num_out = static_cast<int32>(
+      (interval_length_in_ticks + ticks_per_output_period - 1) /
+      ticks_per_output_period);
+  downsampled->Resize(num_out, kUndefined);
+  if (num_out == 0) return;
+  pitch_downsample_kernel<<<n_blocks(num_out, CU1DBLOCK), CU1DBLOCK>>>(
+      wave.Data(), wave.Dim(), samp_rate_in, samp_rate_out,
+      pitch_opts_.lowpass_cutoff, pitch_opts_.lowpass_filter_width,
+      downsampled->Data(), num_out);
+  CU_SAFE_CALL(cudaGetLastError());
+}
+
+void CudaPitchFeatures::ComputeRawFeatures(
+    const CuVectorBase<BaseFloat> &cu_wave, BaseFloat sample_freq,
+    CuMatrix<BaseFloat> *raw_pitch) {
+  if (sample_freq != pitch_opts_.samp_freq)
+    KALDI_ERR << "Sample frequency mismatch: expected "
+              << pitch_opts_.samp_freq << ", got " << sample_freq;
+  CuVector<BaseFloat> downsampled;
+  Downsample(cu_wave, &downsampled);
+
+  int32 num_frames = NumFrames(downsampled.Dim());
+  if (num_frames == 0) {
+    KALDI_WARN << "No frames output in pitch extraction";
+    raw_pitch->Resize(0, 0);
+    return;
+  }
+
+  // The NCCF ballast term uses the energy of the whole signal.
+  double num_samp = downsampled.Dim(), sum = downsampled.Sum(),
+      sumsq = VecVec(downsampled, downsampled),
+      mean_square = sumsq / num_samp - (sum / num_samp) * (sum / num_samp);
+  int32 basic_frame_length = pitch_opts_.NccfWindowSize(),
+      full_frame_length = basic_frame_length + nccf_last_lag_,
+      num_measured_lags = nccf_last_lag_ + 1 - nccf_first_lag_,
+      num_states = lags_.Dim();
+  BaseFloat nccf_ballast = pow(mean_square * basic_frame_length, 2) *
+      pitch_opts_.nccf_ballast;
+
+  CuMatrix<BaseFloat> nccf_pitch(num_frames, num_measured_lags, kUndefined),
+      nccf_pov(num_frames, num_measured_lags, kUndefined);
+  pitch_nccf_kernel<<<num_frames, CU1DBLOCK,
+                      full_frame_length * sizeof(float)>>>(
+      downsampled.Data(), downsampled.Dim(), pitch_opts_.NccfWindowShift(),
+      basic_frame_length, full_frame_length, pitch_opts_.snip_edges,
+      nccf_first_lag_, num_measured_lags, nccf_ballast, nccf_pitch.Data(),
+      nccf_pitch.Stride(), nccf_pov.Data(), nccf_pov.Stride());
+  CU_SAFE_CALL(cudaGetLastError());
+
+  CuMatrix<BaseFloat> nccf_pitch_resampled(num_frames, num_states, kUndefined),
+      nccf_pov_resampled(num_frames, num_states, kUndefined);
+  nccf_pitch_resampled.AddMatMat(1.0, nccf_pitch, kNoTrans,
+                                 nccf_resample_weights_, kNoTrans, 0.0);
+  nccf_pov_resampled.AddMatMat(1.0, nccf_pov, kNoTrans,
+                               nccf_resample_weights_, kNoTrans, 0.0);
+
+  const BaseFloat delta_pitch_sq = pow(Log(1.0 + pitch_opts_.delta_pitch), 2.0),
+      inter_frame_factor = delta_pitch_sq * pitch_opts_.penalty_factor;
+  CuVector<BaseFloat> forward_cost(2 * num_states, kUndefined);
+  CuArray<int32> backpointers(num_frames * num_states),
+      best_states(num_frames);
+  pitch_viterbi_kernel<<<1, CU1DBLOCK>>>(
+      nccf_pitch_resampled.Data(), nccf_pitch_resampled.Stride(),
+      lags_.Data(), num_frames, num_states, pitch_opts_.soft_min_f0,
+      inter_frame_factor, forward_cost.Data(), backpointers.Data(),
+      best_states.Data());
+  CU_SAFE_CALL(cudaGetLastError());
+
+  raw_pitch->Resize(num_frames, 2, kUndefined);
+  pitch_output_kernel<<<n_blocks(num_frames, CU1DBLOCK), CU1DBLOCK>>>(
+      best_states.Data(), nccf_pov_resampled.Data(),
+      nccf_pov_resampled.Stride(), lags_.Data(), num_frames,
+      raw_pitch->Data(), raw_pitch->Stride());
+  CU_SAFE_CALL(cudaGetLastError());
+}
+
+void CudaPitchFeatures::ComputeFeatures(
+    const CuVectorBase<BaseFloat> &cu_wave, BaseFloat sample_freq,
+    CuMatrix<BaseFloat> *cu_features) {
+  CuMatrix<BaseFloat> cu_raw_pitch;
+  ComputeRawFeatures(cu_wave, sample_freq, &cu_raw_pitch);
+  if (cu_raw_pitch.NumRows() == 0) {
+    cu_features->Resize(0, 0);
+    return;
+  }
+  // The post-processing involves a moving-window normalization and is
+  // sequential, but there are only a few numbers per frame, so we do it on
+  // the CPU.
+  Matrix<BaseFloat> raw_pitch(cu_raw_pitch), features;
+  ProcessPitch(process_opts_, raw_pitch, &features);
+  cu_features->Resize(features.NumRows(), features.NumCols(), kUndefined);
+  cu_features->CopyFromMat(features);
+}
+
+}  // namespace kaldi
@@ -0,0 +1,94 @@
+// cudafeat/feature-pitch-cuda.h
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_CUDAFEAT_FEATURE_PITCH_CUDA_H_
+#define KALDI_CUDAFEAT_FEATURE_PITCH_CUDA_H_
+
+#include "cudamatrix/cu-matrix.h"
+#include "cudamatrix/cu-vector.h"
+#include "feat/pitch-functions.h"
+
+namespace kaldi {
+
+// This class implements the Kaldi pitch extractor (see class
+// OnlinePitchFeature in feat/pitch-functions.h) in CUDA, for whole utterances.
+// The downsampling of the signal, the NCCF, its resampling to the log-spaced
+// lags and the Viterbi search are done on the GPU.  The post-processing
+// (ProcessPitch()), which is sequential but cheap, is done on the CPU.
+//
+// The output is the same, up to roundoff, as that of
+// ComputeAndProcessKaldiPitch() with frames_per_chunk == 0 and
+// nccf_ballast_online == false, i.e. as for offline processing or for the
+// final (not first-pass) online features: the NCCF ballast term uses the
+// energy of the whole signal, and the traceback is from the best final state.
+// preemph_coeff (which is deprecated) is not supported.  Like
+// CudaSpectralFeatures, it takes input from device memory and outputs to
+// device memory.
+class CudaPitchFeatures {
+ public:
+  CudaPitchFeatures(const PitchExtractionOptions &pitch_opts,
+                    const ProcessPitchOptions &process_opts);
+
+  // Computes the raw pitch features (NCCF, pitch in Hz) as output by
+  // ComputeKaldiPitch(); *raw_pitch is resized to (num-frames, 2).
+  void ComputeRawFeatures(const CuVectorBase<BaseFloat> &cu_wave,
+                          BaseFloat sample_freq,
+                          CuMatrix<BaseFloat> *raw_pitch);
+
+  // Computes the processed pitch features, as output by
+  // ComputeAndProcessKaldiPitch(); *cu_features is resized to
+  // (num-frames, Dim()).
+  void ComputeFeatures(const CuVectorBase<BaseFloat> &cu_wave,
+                       BaseFloat sample_freq,
+                       CuMatrix<BaseFloat> *cu_features);
+
+  // The dimension of the processed features (e.g. 3).
+  int32 Dim() const;
+
+ private:
+  // Resamples the wave from pitch_opts_.samp_freq to
+  // pitch_opts_.resample_freq, like LinearResample.
+  void Downsample(const CuVectorBase<BaseFloat> &wave,
+                  CuVector<BaseFloat> *downsampled) const;
+
+  // The number of frames for a downsampled signal of this length, as in
+  // OnlinePitchFeatureImpl::NumFramesAvailable() after InputFinished().
+  int32 NumFrames(int64 num_downsampled_samples) const;
+
+  PitchExtractionOptions pitch_opts_;
+  ProcessPitchOptions process_opts_;
+
+  // The first and last lag (in downsampled samples) at which we measure the
+  // NCCF.
+  int32 nccf_first_lag_;
+  int32 nccf_last_lag_;
+
+  // The log-spaced lags (in seconds) at which we resample the NCCF; these
+  // are the states of the Viterbi search.
+  CuVector<BaseFloat> lags_;
+
+  // The linear map from the NCCF measured at the lags nccf_first_lag_ ..
+  // nccf_last_lag_ to the NCCF at lags_, of dimension (num-measured-lags,
+  // lags_.Dim()); it is obtained from ArbitraryResample.
+  CuMatrix<BaseFloat> nccf_resample_weights_;
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_CUDAFEAT_FEATURE_PITCH_CUDA_H_
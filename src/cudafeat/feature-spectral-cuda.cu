@@ -273,12 +273,13 @@ __device__ inline int32 FirstSampleOfFrame(int32 frame, int32 frame_shift,
   }
 }
 
-__global__ void extract_window_kernel(
-    int32 frame_shift, int32 frame_length, int32 frame_length_padded,
-    int32 window_size, bool snip_edges, int32_t sample_offset,
-    const BaseFloat __restrict__ *wave, int32 wave_dim,
-    BaseFloat *__restrict__ windows, int32_t wlda) {
-  int frame = blockIdx.x;
+// Extracts frame 'frame' of 'wave' into 'window'; the threads of the block
+// share the work.
+__device__ inline void extract_window(
+    int32 frame, int32 frame_shift, int32 frame_length,
+    int32 frame_length_padded, int32 window_size, bool snip_edges,
+    int32_t sample_offset, const BaseFloat *__restrict__ wave, int32 wave_dim,
+    BaseFloat *__restrict__ window) {
   int tidx = threadIdx.x;
 
   int32 start_sample =
@@ -289,7 +290,6 @@ __global__ void extract_window_kernel(
   int32 wave_start = int32(start_sample - sample_offset),
         wave_end = wave_start + frame_length;
 
-  BaseFloat *window = windows + frame * wlda;
   if (wave_start >= 0 && wave_end <= wave_dim) {
     // the normal case-- no edge effects to consider.
     for (int i = tidx; i < frame_length; i += blockDim.x) {
@@ -324,6 +324,46 @@ __global__ void extract_window_kernel(
   }
 }
 
+__global__ void extract_window_kernel(
+    int32 frame_shift, int32 frame_length, int32 frame_length_padded,
+    int32 window_size, bool snip_edges, int32_t sample_offset,
+    const BaseFloat __restrict__ *wave, int32 wave_dim,
+    BaseFloat *__restrict__ windows, int32_t wlda) {
+  int frame = blockIdx.x;
+  extract_window(frame, frame_shift, frame_length, frame_length_padded,
+                 window_size, snip_edges, sample_offset, wave, wave_dim,
+                 windows + frame * wlda);
+}
+
+// The batched version of extract_window_kernel: the frames of 'num_utts'
+// utterances are numbered consecutively, utterance u having frames
+// frame_offsets[u] ... frame_offsets[u+1] - 1 and samples wave_offsets[u] ...
+// wave_offsets[u+1] - 1 of 'waves'.
+__global__ void extract_window_batched_kernel(
+    int32 frame_shift, int32 frame_length, int32 frame_length_padded,
+    int32 window_size, bool snip_edges, int32 num_utts,
+    const int32 *__restrict__ frame_offsets,
+    const int32 *__restrict__ wave_offsets,
+    const BaseFloat *__restrict__ waves, BaseFloat *__restrict__ windows,
+    int32_t wlda) {
+  int frame = blockIdx.x;
+  // Find the utterance u with frame_offsets[u] <= frame <
+  // frame_offsets[u+1].
+  int32 lo = 0, hi = num_utts;
+  while (hi - lo > 1) {
+    int32 mid = (lo + hi) / 2;
+    if (frame_offsets[mid] <= frame)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  int32 wave_start = wave_offsets[lo];
+  extract_window(frame - frame_offsets[lo], frame_shift, frame_length,
+                 frame_length_padded, window_size, snip_edges, 0,
+                 waves + wave_start, wave_offsets[lo + 1] - wave_start,
+                 windows + frame * wlda);
+}
+
 // For each frame
 //   compute logf(dot(signal_frame, signal_frame))
 __global__ void dot_log_kernel(int32_t num_frames, int32_t frame_length,
@@ -521,13 +561,73 @@ void CudaSpectralFeatures::ComputeFeatures(const CuVectorBase<BaseFloat> &cu_wav
   nvtxRangePushA("CudaSpectralFeatures::ComputeFeatures");
   const FrameExtractionOptions &frame_opts = GetFrameOptions();
   int num_frames = NumFrames(cu_wave.Dim(), frame_opts, true);
+
+  CuVector<BaseFloat> raw_log_energies;
+  InitBuffers(num_frames, &raw_log_energies, cu_features);
+
+  // Extract Windows
+  ExtractWindows(num_frames, 0, cu_wave, frame_opts);
+
+  // Process Windows
+  ProcessWindows(num_frames, frame_opts, &raw_log_energies);
+
+  // Compute Features
+  ComputeFinalFeatures(num_frames, 1.0, &raw_log_energies, cu_features);
+
+  nvtxRangePop();
+}
+
+void CudaSpectralFeatures::ComputeFeaturesBatched(
+    const CuVectorBase<BaseFloat> &cu_waves,
+    const std::vector<int32> &wave_offsets, BaseFloat sample_freq,
+    CuMatrix<BaseFloat> *cu_features, std::vector<int32> *frame_offsets) {
+  nvtxRangePushA("CudaSpectralFeatures::ComputeFeaturesBatched");
+  const FrameExtractionOptions &frame_opts = GetFrameOptions();
+  int32 num_utts = static_cast<int32>(wave_offsets.size()) - 1;
+  KALDI_ASSERT(num_utts >= 1 && wave_offsets[0] == 0 &&
+               wave_offsets[num_utts] == cu_waves.Dim());
+  frame_offsets->resize(num_utts + 1);
+  (*frame_offsets)[0] = 0;
+  for (int32 u = 0; u < num_utts; u++) {
+    int32 wave_dim = wave_offsets[u + 1] - wave_offsets[u];
+    KALDI_ASSERT(wave_dim >= 0);
+    (*frame_offsets)[u + 1] = (*frame_offsets)[u] +
+        NumFrames(wave_dim, frame_opts, true);
+  }
+  int32 num_frames = frame_offsets->back();
+
+  if (num_frames == 0) {
+    cu_features->Resize(0, 0);
+  } else {
+    CuVector<BaseFloat> raw_log_energies;
+    InitBuffers(num_frames, &raw_log_energies, cu_features);
+    // Everything after the extraction of the windows works frame by frame,
+    // so it does not need to know about the utterances.
+    CuArray<int32> cu_frame_offsets(*frame_offsets),
+        cu_wave_offsets(wave_offsets);
+    extract_window_batched_kernel<<<num_frames, CU1DBLOCK>>>(
+        frame_opts.WindowShift(), frame_opts.WindowSize(),
+        frame_opts.PaddedWindowSize(), frame_opts.WindowSize(),
+        frame_opts.snip_edges, num_utts, cu_frame_offsets.Data(),
+        cu_wave_offsets.Data(), cu_waves.Data(), cu_windows_.Data(),
+        cu_windows_.Stride());
+    CU_SAFE_CALL(cudaGetLastError());
+
+    ProcessWindows(num_frames, frame_opts, &raw_log_energies);
+    ComputeFinalFeatures(num_frames, 1.0, &raw_log_energies, cu_features);
+  }
+  nvtxRangePop();
+}
+
+void CudaSpectralFeatures::InitBuffers(int32 num_frames,
+                                       CuVector<BaseFloat> *raw_log_energies,
+                                       CuMatrix<BaseFloat> *cu_features) {
+  const FrameExtractionOptions &frame_opts = GetFrameOptions();
   // compute fft frames by rounding up to a multiple of fft_size_
   int fft_num_frames = num_frames + (fft_size_ - num_frames % fft_size_);
   int feature_dim = Dim();
-  bool use_raw_log_energy = NeedRawLogEnergy();
 
-  CuVector<BaseFloat> raw_log_energies;
-  raw_log_energies.Resize(num_frames, kUndefined);
+  raw_log_energies->Resize(num_frames, kUndefined);
 
   cu_windows_.Resize(fft_num_frames, padded_length_, kUndefined,
                      kStrideEqualNumCols);
@@ -546,18 +646,8 @@ void CudaSpectralFeatures::ComputeFeatures(const CuVectorBase<BaseFloat> &cu_wav
                              tmp_window_.NumRows() * tmp_window_.Stride(),
                              0.0 /*mean*/, 1.0 /*stddev*/));
   }
-
-  // Extract Windows
-  ExtractWindows(num_frames, 0, cu_wave, frame_opts);
-
-  // Process Windows
-  ProcessWindows(num_frames, frame_opts, &raw_log_energies);
-
-  // Compute Features
-  ComputeFinalFeatures(num_frames, 1.0, &raw_log_energies, cu_features);
-
-  nvtxRangePop();
 }
+
 CudaSpectralFeatures::~CudaSpectralFeatures() {
   delete[] cu_vecs_;
   CuDevice::Instantiate().Free(vecs_);
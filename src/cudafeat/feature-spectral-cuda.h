@@ -71,6 +71,20 @@ class CudaSpectralFeatures : public MfccComputer {
                        BaseFloat sample_freq, BaseFloat vtln_warp,
                        CuMatrix<BaseFloat> *cu_features);
 
+  // Computes the features of several utterances in one set of kernel
+  // launches, which keeps the GPU much busier than calling ComputeFeatures()
+  // on each when the utterances are short.  'cu_waves' is the utterances'
+  // waveforms concatenated; utterance i is samples wave_offsets[i] to
+  // wave_offsets[i+1] - 1 of it (so wave_offsets.size() is the number of
+  // utterances plus one).  On exit its features are rows (*frame_offsets)[i]
+  // to (*frame_offsets)[i+1] - 1 of *cu_features.  Apart from the dither,
+  // the results are the same as from ComputeFeatures().
+  void ComputeFeaturesBatched(const CuVectorBase<BaseFloat> &cu_waves,
+                              const std::vector<int32> &wave_offsets,
+                              BaseFloat sample_freq,
+                              CuMatrix<BaseFloat> *cu_features,
+                              std::vector<int32> *frame_offsets);
+
   CudaSpectralFeatures(const CudaSpectralFeatureOptions &opts);
   ~CudaSpectralFeatures();
   CudaSpectralFeatureOptions cumfcc_opts_;
@@ -86,6 +100,11 @@ class CudaSpectralFeatures : public MfccComputer {
   }
 
  private:
+  // Sizes the buffers and the outputs for 'num_frames' frames, and
+  // generates the dither noise.
+  void InitBuffers(int32 num_frames, CuVector<BaseFloat> *raw_log_energies,
+                   CuMatrix<BaseFloat> *cu_features);
+
   void ExtractWindows(int32 num_frames, int64 sample_offset,
                       const CuVectorBase<BaseFloat> &wave,
                       const FrameExtractionOptions &opts);
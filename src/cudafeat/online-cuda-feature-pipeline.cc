@@ -25,6 +25,7 @@ OnlineCudaFeaturePipeline::OnlineCudaFeaturePipeline(
     const OnlineNnet2FeaturePipelineConfig &config)
     : info_(config), spectral_feat(NULL), ivector(NULL) {
   spectral_feat = NULL;
+  pitch_feat = NULL;
   cmvn = NULL;
   ivector = NULL;
   if (info_.feature_type == "mfcc") {
@@ -34,6 +35,11 @@ OnlineCudaFeaturePipeline::OnlineCudaFeaturePipeline(
     spectral_feat = new CudaSpectralFeatures(info_.fbank_opts);
   }
 
+  if (info_.add_pitch) {
+    pitch_feat = new CudaPitchFeatures(info_.pitch_opts,
+                                       info_.pitch_process_opts);
+  }
+
   if (info_.use_cmvn) {
     KALDI_ASSERT(info_.global_cmvn_stats_rxfilename != "");
     ReadKaldiObject(info_.global_cmvn_stats_rxfilename, &global_cmvn_stats);
@@ -58,6 +64,7 @@ OnlineCudaFeaturePipeline::OnlineCudaFeaturePipeline(
 
 OnlineCudaFeaturePipeline::~OnlineCudaFeaturePipeline() {
   if (spectral_feat != NULL) delete spectral_feat;
+  if (pitch_feat != NULL) delete pitch_feat;
   if (cmvn != NULL) delete cmvn;
   if (ivector != NULL) delete ivector;
 }
@@ -75,14 +82,71 @@ void OnlineCudaFeaturePipeline::ComputeFeatures(
     KALDI_ASSERT(false);
   }
 
+  // As in OnlineNnet2FeaturePipeline, the CMVN is applied to the spectral
+  // features and pitch together, but the ivector extractor only sees the
+  // spectral features.
+  int32 spectral_dim = input_features->NumCols();
+  if (info_.add_pitch) {
+    CuMatrix<BaseFloat> pitch_features;
+    pitch_feat->ComputeFeatures(cu_wave, sample_freq, &pitch_features);
+    // The frame counts may differ by a frame or so depending on the
+    // framing options; keep the frames that both have.
+    int32 num_frames = std::min(input_features->NumRows(),
+                                pitch_features.NumRows());
+    CuMatrix<BaseFloat> appended(num_frames,
+                                 spectral_dim + pitch_feat->Dim(),
+                                 kUndefined);
+    if (num_frames > 0) {
+      appended.ColRange(0, spectral_dim).CopyFromMat(
+          input_features->RowRange(0, num_frames));
+      appended.ColRange(spectral_dim, pitch_feat->Dim()).CopyFromMat(
+          pitch_features.RowRange(0, num_frames));
+    }
+    input_features->Swap(&appended);
+  }
+
   if (info_.use_cmvn) {
     cmvn->ComputeFeatures(*input_features, input_features);
   }
 
   // Ivector
   if (info_.use_ivectors && ivector_features != NULL) {
-    ivector->GetIvector(*input_features, ivector_features);
+    ivector->GetIvector(input_features->ColRange(0, spectral_dim),
+                        ivector_features);
+  }
+}
+
+void OnlineCudaFeaturePipeline::ComputeIvectors(
+    const std::vector<const CuMatrixBase<BaseFloat>*> &input_features,
+    const std::vector<CuVector<BaseFloat>*> &ivector_features) {
+  KALDI_ASSERT(input_features.size() == ivector_features.size());
+  if (!info_.use_ivectors || input_features.empty())
+    return;
+  // Stack the spectral features of the utterances, which are what the
+  // ivector extractor sees (see ComputeFeatures()), with one kernel.
+  int32 spectral_dim = spectral_feat->Dim(),
+      num_utts = input_features.size();
+  std::vector<int32> frame_offsets(num_utts + 1, 0);
+  std::vector<const BaseFloat*> src_rows;
+  for (int32 i = 0; i < num_utts; i++) {
+    const CuMatrixBase<BaseFloat> &feats = *(input_features[i]);
+    frame_offsets[i + 1] = frame_offsets[i] + feats.NumRows();
+    for (int32 r = 0; r < feats.NumRows(); r++)
+      src_rows.push_back(feats.RowData(r));
+  }
+  CuMatrix<BaseFloat> feats, ivectors;
+  if (!src_rows.empty()) {
+    feats.Resize(src_rows.size(), spectral_dim, kUndefined);
+    feats.CopyRows(CuArray<const BaseFloat*>(src_rows));
+  }
+  ivector->GetIvectors(feats, frame_offsets, &ivectors);
+
+  std::vector<BaseFloat*> dst_rows(num_utts);
+  for (int32 i = 0; i < num_utts; i++) {
+    ivector_features[i]->Resize(ivectors.NumCols(), kUndefined);
+    dst_rows[i] = ivector_features[i]->Data();
   }
+  ivectors.CopyToRows(CuArray<BaseFloat*>(dst_rows));
 }
 
 }  // namespace kaldi
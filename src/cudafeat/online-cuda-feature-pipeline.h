@@ -25,6 +25,7 @@
 #include <vector>
 
 #include "base/kaldi-error.h"
+#include "cudafeat/feature-pitch-cuda.h"
 #include "cudafeat/feature-spectral-cuda.h"
 #include "cudafeat/online-ivector-feature-cuda.h"
 #include "matrix/matrix-lib.h"
@@ -43,11 +44,21 @@ class OnlineCudaFeaturePipeline {
                        CuMatrix<BaseFloat> *input_features,
                        CuVector<BaseFloat> *ivector_features);
 
+  // Computes the ivectors of several utterances whose features were computed
+  // by ComputeFeatures() (with ivector_features == NULL), in one batch: this
+  // is much faster than computing them one utterance at a time.  Sets
+  // *ivector_features[i] to the ivector of input_features[i].  Does nothing
+  // if we are not using ivectors.
+  void ComputeIvectors(
+      const std::vector<const CuMatrixBase<BaseFloat>*> &input_features,
+      const std::vector<CuVector<BaseFloat>*> &ivector_features);
+
   ~OnlineCudaFeaturePipeline();
 
  private:
   OnlineNnet2FeaturePipelineInfo info_;
   CudaSpectralFeatures *spectral_feat;
+  CudaPitchFeatures *pitch_feat;
   CudaOnlineCmvn *cmvn;
   IvectorExtractorFastCuda *ivector;
   Matrix<double> global_cmvn_stats;
@@ -20,11 +20,13 @@
 #include "cudamatrix/cu-common.h"
 namespace kaldi {
 
-// Meant to be called with blockDim= 32x32
+// Meant to be called with blockDim= 32x32.  blockIdx.y is the set; for
+// batched_gemv_reduce() there is only one.
 __global__ void batched_gemv_reduce_kernel(int rows, int cols,
                                            const float* __restrict__ A, int lda,
                                            const float* __restrict__ X, int ldx,
-                                           float* C) {
+                                           int x_set_stride, float* C,
+                                           int c_set_stride) {
   // Specialize WarpReduce for type float
   typedef cub::WarpReduce<float> WarpReduce;
   // Allocate WarpReduce shared memory for 32 warps
@@ -39,7 +41,8 @@ __global__ void batched_gemv_reduce_kernel(int rows, int cols,
   // Offset to input matrix to starting row for batch
   const float* __restrict__ A_in = A + bid * rows * lda;
   // Offset to input vector to starting column for batch
-  const float* __restrict__ X_in = X + bid * ldx;
+  const float* __restrict__ X_in = X + blockIdx.y * x_set_stride + bid * ldx;
+  C += blockIdx.y * c_set_stride;
 
   for (int i = 0; i < cols; i += 32) {  // threadIdx.x, keep all threads present
     int c = i + tid;
@@ -123,6 +126,129 @@ __global__ void splice_features_kernel(int32_t num_frames, int32_t feat_dim,
   }
 }
 
+// Finds the utterance ("set") that 'frame' belongs to, i.e. the s with
+// frame_offsets[s] <= frame < frame_offsets[s+1].
+__device__ inline int32_t find_set(int32_t num_sets,
+                                   const int32_t* __restrict__ frame_offsets,
+                                   int32_t frame) {
+  int32_t lo = 0, hi = num_sets;
+  while (hi - lo > 1) {
+    int32_t mid = (lo + hi) / 2;
+    if (frame_offsets[mid] <= frame)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// As splice_features_kernel, but clamping to the frames of the utterance.
+__global__ void splice_features_sets_kernel(
+    int32_t num_sets, const int32_t* __restrict__ frame_offsets,
+    int32_t feat_dim, int32_t left, int32_t size,
+    const float* __restrict__ feats, int32_t ldf, float* __restrict__ sfeats,
+    int32_t lds) {
+  int32_t frame = blockIdx.x;
+  int32_t tid = threadIdx.x;
+  int32_t set = find_set(num_sets, frame_offsets, frame),
+      first = frame_offsets[set], last = frame_offsets[set + 1] - 1;
+
+  float* feat_out = sfeats + lds * frame;
+  for (int i = 0; i < size; i++) {
+    int r = frame + i + left;
+    if (r < first) r = first;
+    if (r > last) r = last;
+    for (int c = tid; c < feat_dim; c += blockDim.x)
+      feat_out[i * feat_dim + c] = feats[r * ldf + c];
+  }
+}
+
+// Meant to be called with blockDim = 32x32 and gridDim = (ceil((feat_dim + 1)
+// / 32), ceil(num_gauss / 32), num_sets).  Each block computes a 32x32 tile of
+// the stats of utterance blockIdx.z, going through its frames 32 at a time.
+// Column feat_dim of the features is taken to be 1, which gives gamma.
+__global__ void ivector_stats_sets_kernel(
+    const int32_t* __restrict__ frame_offsets, int32_t num_gauss,
+    int32_t feat_dim, const float* __restrict__ post, int32_t ldp,
+    const float* __restrict__ feats, int32_t ldf, float scale,
+    float* __restrict__ gamma, int32_t ldg, float* __restrict__ X,
+    int32_t ldx) {
+  __shared__ float s_post[32][32 + 1], s_feats[32][32 + 1];
+  int32_t set = blockIdx.z, tx = threadIdx.x, ty = threadIdx.y;
+  int32_t d = blockIdx.x * 32 + tx, g = blockIdx.y * 32 + ty;
+  int32_t begin = frame_offsets[set], end = frame_offsets[set + 1];
+  float sum = 0.0f;
+  for (int32_t t0 = begin; t0 < end; t0 += 32) {
+    // Row ty of the tiles is frame t0 + ty.
+    int32_t t = t0 + ty, load_g = blockIdx.y * 32 + tx;
+    s_post[ty][tx] =
+        (t < end && load_g < num_gauss ? post[t * ldp + load_g] : 0.0f);
+    s_feats[ty][tx] =
+        (t < end ? (d < feat_dim ? feats[t * ldf + d] : 1.0f) : 0.0f);
+    __syncthreads();
+    for (int32_t i = 0; i < 32; i++)
+      sum += s_post[i][ty] * s_feats[i][tx];
+    __syncthreads();
+  }
+  if (g < num_gauss) {
+    if (d < feat_dim)
+      X[(set * num_gauss + g) * ldx + d] = scale * sum;
+    else if (d == feat_dim)
+      gamma[set * ldg + g] = scale * sum;
+  }
+}
+
+// One block per utterance; the arithmetic is that of
+// update_linear_and_quadratic_terms_kernel.
+__global__ void update_linear_and_quadratic_terms_sets_kernel(
+    int32_t n, float old_num_frames, float prior_offset,
+    const float* __restrict__ gamma, int32_t ldg, int32_t num_gauss,
+    int32_t max_count, float* quadratic, int32_t ldq, float* linear,
+    int32_t ldl) {
+  typedef cub::BlockReduce<float, 1024> BlockReduce;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  __shared__ float s_tot_weight;
+  int32_t set = blockIdx.x;
+
+  float sum = 0.0f;
+  for (int32_t g = threadIdx.x; g < num_gauss; g += blockDim.x)
+    sum += gamma[set * ldg + g];
+  sum = BlockReduce(temp_storage).Sum(sum);
+  if (threadIdx.x == 0) s_tot_weight = sum;
+  __syncthreads();
+
+  float new_num_frames = old_num_frames + s_tot_weight;
+  float prior_scale_change = 1.0f;
+  if (max_count != 0.0f) {
+    float old_prior_scale = max(old_num_frames, (float)max_count) / max_count;
+    float new_prior_scale = max(new_num_frames, (float)max_count) / max_count;
+    prior_scale_change += new_prior_scale - old_prior_scale;
+  }
+
+  float* q = quadratic + set * ldq;
+  for (int32_t i = threadIdx.x; i < n; i += blockDim.x) {
+    int32_t diag_idx = ((i + 1) * (i + 2) / 2) - 1;
+    q[diag_idx] += prior_scale_change;
+  }
+  if (threadIdx.x == 0) linear[set * ldl] += prior_offset * prior_scale_change;
+}
+
+// gridDim = (n, num_sets): block (i, u) writes row i (and so, by symmetry,
+// column i) of matrix u.
+__global__ void unpack_symmetric_sets_kernel(int32_t n,
+                                             const float* __restrict__ packed,
+                                             int32_t ldp, float* A,
+                                             int32_t lda) {
+  int32_t i = blockIdx.x, set = blockIdx.y;
+  const float* p = packed + set * ldp + (i * (i + 1)) / 2;
+  float* a = A + set * n * lda;
+  for (int32_t j = threadIdx.x; j <= i; j += blockDim.x) {
+    float val = p[j];
+    a[i * lda + j] = val;
+    a[j * lda + i] = val;
+  }
+}
+
 // Computes the sum of all terms in a matrix.
 // The kernel double buffers the output such that the
 // output is written to retval[b] where b is 0 or 1.
@@ -202,7 +328,58 @@ void batched_gemv_reduce(int batch_size, int rows, int cols, int A_stride,
                          const float* AT, int B_stride, const float* B,
                          float* C) {
   batched_gemv_reduce_kernel<<<batch_size, dim3(32, 32)>>>(
-      rows, cols, AT, A_stride, B, B_stride, C);
+      rows, cols, AT, A_stride, B, B_stride, 0, C, 0);
+  CU_SAFE_CALL(cudaGetLastError());
+}
+
+void batched_gemv_reduce_sets(int num_sets, int batch_size, int rows, int cols,
+                              int A_stride, const float* AT, int B_stride,
+                              int B_set_stride, const float* B,
+                              int C_set_stride, float* C) {
+  batched_gemv_reduce_kernel<<<dim3(batch_size, num_sets), dim3(32, 32)>>>(
+      rows, cols, AT, A_stride, B, B_stride, B_set_stride, C, C_set_stride);
+  CU_SAFE_CALL(cudaGetLastError());
+}
+
+void splice_features_sets(int32_t num_sets, const int32_t* frame_offsets,
+                          int32_t num_frames, int32_t feat_dim, int32_t left,
+                          int32_t size, const float* feats, int32_t ldf,
+                          float* sfeats, int32_t lds) {
+  int threads = (feat_dim + 31) / 32 * 32;  // round up to the nearest warp size
+  if (threads > 1024) threads = 1024;       // Max block size is 1024 threads
+
+  splice_features_sets_kernel<<<num_frames, threads>>>(
+      num_sets, frame_offsets, feat_dim, left, size, feats, ldf, sfeats, lds);
+  CU_SAFE_CALL(cudaGetLastError());
+}
+
+void ivector_stats_sets(int32_t num_sets, const int32_t* frame_offsets,
+                        int32_t num_gauss, int32_t feat_dim, const float* post,
+                        int32_t ldp, const float* feats, int32_t ldf,
+                        float scale, float* gamma, int32_t ldg, float* X,
+                        int32_t ldx) {
+  dim3 threads(32, 32);
+  dim3 blocks((feat_dim + 1 + 31) / 32, (num_gauss + 31) / 32, num_sets);
+  ivector_stats_sets_kernel<<<blocks, threads>>>(
+      frame_offsets, num_gauss, feat_dim, post, ldp, feats, ldf, scale, gamma,
+      ldg, X, ldx);
+  CU_SAFE_CALL(cudaGetLastError());
+}
+
+void update_linear_and_quadratic_terms_sets(
+    int32_t num_sets, int32_t n, float old_num_frames, float prior_offset,
+    const float* gamma, int32_t ldg, int32_t num_gauss, int32_t max_count,
+    float* quadratic, int32_t ldq, float* linear, int32_t ldl) {
+  update_linear_and_quadratic_terms_sets_kernel<<<num_sets, 1024>>>(
+      n, old_num_frames, prior_offset, gamma, ldg, num_gauss, max_count,
+      quadratic, ldq, linear, ldl);
+  CU_SAFE_CALL(cudaGetLastError());
+}
+
+void unpack_symmetric_sets(int32_t num_sets, int32_t n, const float* packed,
+                           int32_t ldp, float* A, int32_t lda) {
+  unpack_symmetric_sets_kernel<<<dim3(n, num_sets), 32>>>(n, packed, ldp, A,
+                                                          lda);
   CU_SAFE_CALL(cudaGetLastError());
 }
 
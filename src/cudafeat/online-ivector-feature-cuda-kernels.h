@@ -37,5 +37,48 @@ void get_matrix_sum_double_buffer(int32_t b, int32_t num_rows, int32_t num_cols,
 
 void square_matrix(int32_t num_rows, int32_t num_cols, const float *feats,
                    int32_t ldf, float *feats_sq, int32_t lds);
+
+// The following are versions of the above for several utterances at once
+// ("sets"), as used by IvectorExtractorFastCuda::GetIvectors().  The frames
+// of the utterances are stacked, utterance u having frames frame_offsets[u]
+// to frame_offsets[u+1] - 1 (frame_offsets is in device memory).
+
+// As batched_gemv_reduce(), for num_sets sets: set s uses B + s * B_set_stride
+// and adds to C + s * C_set_stride.
+void batched_gemv_reduce_sets(int num_sets, int batch_size, int rows, int cols,
+                              int A_stride, const float *AT, int B_stride,
+                              int B_set_stride, const float *B,
+                              int C_set_stride, float *C);
+
+// As splice_features(), but the context does not cross the boundaries of
+// the utterances.
+void splice_features_sets(int32_t num_sets, const int32_t *frame_offsets,
+                          int32_t num_frames, int32_t feat_dim, int32_t left,
+                          int32_t size, const float *feats, int32_t ldf,
+                          float *sfeats, int32_t lds);
+
+// Computes the zeroth and first order stats of each utterance:
+//   gamma(u, g) = scale * sum_t post(t, g),
+//   X(u * num_gauss + g, d) = scale * sum_t post(t, g) feats(t, d),
+// the sums being over the frames t of utterance u.
+void ivector_stats_sets(int32_t num_sets, const int32_t *frame_offsets,
+                        int32_t num_gauss, int32_t feat_dim, const float *post,
+                        int32_t ldp, const float *feats, int32_t ldf,
+                        float scale, float *gamma, int32_t ldg, float *X,
+                        int32_t ldx);
+
+// As update_linear_and_quadratic_terms(), for row u of 'quadratic' and
+// 'linear' (packed and vector respectively), with the total weight of
+// utterance u taken to be the sum of row u of 'gamma'.
+void update_linear_and_quadratic_terms_sets(
+    int32_t num_sets, int32_t n, float old_num_frames, float prior_offset,
+    const float *gamma, int32_t ldg, int32_t num_gauss, int32_t max_count,
+    float *quadratic, int32_t ldq, float *linear, int32_t ldl);
+
+// Unpacks the symmetric matrices stored (in packed lower-triangular form) in
+// the rows of 'packed' into full n by n matrices, matrix u being at
+// A + u * n * lda.
+void unpack_symmetric_sets(int32_t num_sets, int32_t n, const float *packed,
+                           int32_t ldp, float *A, int32_t lda);
 }
 #endif
@@ -74,6 +74,14 @@ void IvectorExtractorFastCuda::GetIvector(const CuMatrixBase<BaseFloat> &feats,
   // based on normalized feats
   ComputePosteriors(lda_feats_normalized, &posteriors);
 
+  if (info_.max_count > 0) {
+    // when max count > 0 we need to know the total posterior sum to adjust
+    // the prior offset.  So calculate that here.
+    get_matrix_sum_double_buffer(
+        b_, posteriors.NumRows(), posteriors.NumCols(), posteriors.Data(),
+        posteriors.Stride(), info_.posterior_scale, tot_post_.Data());
+  }
+
   // based on non-normalized feats
   ComputeIvectorStats(lda_feats, posteriors, &gamma, &X);
 
@@ -82,6 +90,78 @@ void IvectorExtractorFastCuda::GetIvector(const CuMatrixBase<BaseFloat> &feats,
   nvtxRangePop();
 }
 
+void IvectorExtractorFastCuda::GetIvectors(
+    const CuMatrixBase<BaseFloat> &feats, const std::vector<int32> &frame_offsets,
+    CuMatrix<BaseFloat> *ivectors) {
+  nvtxRangePushA("GetIvectors");
+  int32 num_utts = static_cast<int32>(frame_offsets.size()) - 1,
+      num_frames = feats.NumRows();
+  KALDI_ASSERT(num_utts >= 0 && frame_offsets[0] == 0 &&
+               frame_offsets[num_utts] == num_frames);
+  if (num_utts == 0) {
+    ivectors->Resize(0, 0);
+    nvtxRangePop();
+    return;
+  }
+
+  CuMatrix<BaseFloat> gamma, X;
+  if (num_frames == 0) {
+    gamma.Resize(num_utts, num_gauss_);
+    X.Resize(num_utts * num_gauss_, feat_dim_);
+    ComputeIvectorsFromStats(gamma, X, ivectors);
+    nvtxRangePop();
+    return;
+  }
+
+  CuArray<int32> cu_frame_offsets(frame_offsets);
+  CuMatrix<BaseFloat> posteriors;
+
+  // normalized pipeline.  Online CMVN is sequential in time, so it is done
+  // per utterance; everything after it is done for all the frames at once.
+  CuMatrix<BaseFloat> lda_feats_normalized(num_frames, feats.NumCols(),
+                                           kUndefined);
+  {
+    CuMatrix<BaseFloat> cmvn_feats(num_frames, feats.NumCols(), kUndefined),
+        cmvn_utt;
+    for (int32 u = 0; u < num_utts; u++) {
+      int32 utt_frames = frame_offsets[u + 1] - frame_offsets[u];
+      if (utt_frames == 0) continue;
+      CudaOnlineCmvn cmvn(info_.cmvn_opts, naive_cmvn_state_);
+      cmvn.ComputeFeatures(feats.RowRange(frame_offsets[u], utt_frames),
+                           &cmvn_utt);
+      cmvn_feats.RowRange(frame_offsets[u], utt_frames).CopyFromMat(cmvn_utt);
+    }
+    CuMatrix<BaseFloat> spliced_feats_normalized;
+    SpliceFeatsSets(cmvn_feats, cu_frame_offsets, &spliced_feats_normalized);
+    lda_feats_normalized.AddMatMat(1.0, spliced_feats_normalized, kNoTrans,
+                                   cu_lda_, kTrans, 0.0);
+  }
+
+  // non-normalized pipeline
+  CuMatrix<BaseFloat> lda_feats(num_frames, feats.NumCols(), kUndefined);
+  {
+    CuMatrix<BaseFloat> spliced_feats;
+    SpliceFeatsSets(feats, cu_frame_offsets, &spliced_feats);
+    lda_feats.AddMatMat(1.0, spliced_feats, kNoTrans, cu_lda_, kTrans, 0.0);
+  }
+
+  // based on normalized feats
+  ComputePosteriors(lda_feats_normalized, &posteriors);
+
+  // based on non-normalized feats; gamma has a row, and X a block of
+  // num_gauss_ rows, per utterance.
+  gamma.Resize(num_utts, num_gauss_, kUndefined);
+  X.Resize(num_utts * num_gauss_, feat_dim_, kUndefined);
+  ivector_stats_sets(num_utts, cu_frame_offsets.Data(), num_gauss_, feat_dim_,
+                     posteriors.Data(), posteriors.Stride(), lda_feats.Data(),
+                     lda_feats.Stride(), info_.posterior_scale, gamma.Data(),
+                     gamma.Stride(), X.Data(), X.Stride());
+
+  ComputeIvectorsFromStats(gamma, X, ivectors);
+
+  nvtxRangePop();
+}
+
 void IvectorExtractorFastCuda::Read(
     const kaldi::OnlineIvectorExtractionConfig &config) {
   // read ubm
@@ -163,6 +243,21 @@ void IvectorExtractorFastCuda::SpliceFeats(const CuMatrixBase<BaseFloat> &feats,
                   spliced_feats->Stride());
 }
 
+void IvectorExtractorFastCuda::SpliceFeatsSets(
+    const CuMatrixBase<BaseFloat> &feats, const CuArray<int32> &frame_offsets,
+    CuMatrix<BaseFloat> *spliced_feats) {
+  int left = -info_.splice_opts.left_context;
+  int right = info_.splice_opts.right_context;
+  int size = right - left + 1;
+  spliced_feats->Resize(feats.NumRows(), feats.NumCols() * size, kUndefined);
+  if (feats.NumRows() == 0) return;
+
+  splice_features_sets(frame_offsets.Dim() - 1, frame_offsets.Data(),
+                       feats.NumRows(), feats.NumCols(), left, size,
+                       feats.Data(), feats.Stride(), spliced_feats->Data(),
+                       spliced_feats->Stride());
+}
+
 void IvectorExtractorFastCuda::ComputePosteriors(
     const CuMatrixBase<float> &feats, CuMatrix<float> *posteriors) {
   int num_frames = feats.NumRows();
@@ -183,14 +278,6 @@ void IvectorExtractorFastCuda::ComputePosteriors(
 
   // apply scaling factor
   posteriors->ApplySoftMaxPerRow();
-
-  if (info_.max_count > 0) {
-    // when max count > 0 we need to know the total posterior sum to adjust
-    // the prior offset.  So calculate that here.
-    get_matrix_sum_double_buffer(
-        b_, posteriors->NumRows(), posteriors->NumCols(), posteriors->Data(),
-        posteriors->Stride(), info_.posterior_scale, tot_post_.Data());
-  }
 }
 
 void IvectorExtractorFastCuda::ComputeIvectorStats(
@@ -312,4 +399,69 @@ void IvectorExtractorFastCuda::ComputeIvectorFromStats(
   ivector0.Add(-prior_offset_);
 }
 
+void IvectorExtractorFastCuda::ComputeIvectorsFromStats(
+    const CuMatrix<float> &gamma, const CuMatrix<float> &X,
+    CuMatrix<float> *ivectors) {
+  int32 num_utts = gamma.NumRows(), n = ivector_dim_,
+      packed_dim = n * (n + 1) / 2;
+  CuMatrix<float> &linear = *ivectors;
+  // Initialize to zero as batched kernel is +=
+  linear.Resize(num_utts, n, kSetZero);
+
+  batched_gemv_reduce_sets(num_utts, num_gauss_, feat_dim_, n,
+                           ie_Sigma_inv_M_f_.Stride(), ie_Sigma_inv_M_f_.Data(),
+                           X.Stride(), num_gauss_ * X.Stride(), X.Data(),
+                           linear.Stride(), linear.Data());
+
+  // Row u is the packed quadratic term of utterance u.
+  CuMatrix<float> quadratic(num_utts, packed_dim, kUndefined);
+  quadratic.AddMatMat(1.0f, gamma, kNoTrans, ie_U_, kNoTrans, 0.0f);
+
+  // As in ComputeIvectorFromStats(), for offline this is always zero.
+  float old_num_frames = 0.0f;
+  update_linear_and_quadratic_terms_sets(
+      num_utts, n, old_num_frames, prior_offset_, gamma.Data(), gamma.Stride(),
+      num_gauss_, info_.max_count, quadratic.Data(), quadratic.Stride(),
+      linear.Data(), linear.Stride());
+
+  // Solve quadratic * ivector = linear for each utterance; the matrices are
+  // unpacked into consecutive n by n blocks of A.
+  CuMatrix<float> A(num_utts * n, n, kUndefined);
+  unpack_symmetric_sets(num_utts, n, quadratic.Data(), quadratic.Stride(),
+                        A.Data(), A.Stride());
+
+#if CUDA_VERSION >= 9010
+  std::vector<float *> A_ptrs(num_utts), b_ptrs(num_utts);
+  for (int32 u = 0; u < num_utts; u++) {
+    A_ptrs[u] = A.RowData(u * n);
+    b_ptrs[u] = linear.RowData(u);
+  }
+  CuArray<float *> cu_A_ptrs(A_ptrs), cu_b_ptrs(b_ptrs);
+  CuArray<int> cu_info(num_utts);
+
+  CUSOLVER_SAFE_CALL(cusolverDnSpotrfBatched(
+      GetCusolverDnHandle(), CUBLAS_FILL_MODE_LOWER, n, cu_A_ptrs.Data(),
+      A.Stride(), cu_info.Data(), num_utts));
+  // cusolverDnSpotrsBatched() only supports a single right-hand side, which
+  // is all we have.
+  CUSOLVER_SAFE_CALL(cusolverDnSpotrsBatched(
+      GetCusolverDnHandle(), CUBLAS_FILL_MODE_LOWER, n, 1, cu_A_ptrs.Data(),
+      A.Stride(), cu_b_ptrs.Data(), n, d_info_, num_utts));
+#else
+  // Cuda version is too old for batched cu-solver.
+  // Use Kaldi built-in inversion routine, one utterance at a time.
+  for (int32 u = 0; u < num_utts; u++) {
+    CuSpMatrix<float> quadratic_u(n, kUndefined);
+    CuSubVector<float> q_vec(quadratic_u.Data(), packed_dim);
+    q_vec.CopyFromVec(quadratic.Row(u));
+    quadratic_u.Invert();
+    CuVector<float> linear_tmp(linear.Row(u));
+    linear.Row(u).AddSpVec(1.0, quadratic_u, linear_tmp, 0.0);
+  }
+#endif
+
+  // remove prior from ivectors
+  linear.ColRange(0, 1).Add(-prior_offset_);
+}
+
 };  // namespace kaldi
@@ -22,6 +22,7 @@
 
 #include "base/kaldi-error.h"
 #include "cudafeat/feature-online-cmvn-cuda.h"
+#include "cudamatrix/cu-array.h"
 #include "cudamatrix/cu-matrix.h"
 #include "online2/online-ivector-feature.h"
 
@@ -73,6 +74,17 @@ class IvectorExtractorFastCuda {
   //
   void GetIvector(const CuMatrixBase<float> &feats, CuVector<float> *ivector);
 
+  // As GetIvector(), for several utterances at once, which is much faster
+  // for short utterances than a GetIvector() call per utterance.  'feats'
+  // holds the features of the utterances one after another, utterance i
+  // being rows frame_offsets[i] to frame_offsets[i+1] - 1 (so frame_offsets
+  // starts with 0 and ends with feats.NumRows()).  Row i of 'ivectors' is set
+  // to the i-vector of utterance i.  Only the online CMVN is still done per
+  // utterance.
+  void GetIvectors(const CuMatrixBase<float> &feats,
+                   const std::vector<int32> &frame_offsets,
+                   CuMatrix<float> *ivectors);
+
   int32 FeatDim() const { return feat_dim_; }
   int32 IvectorDim() const { return ivector_dim_; }
   int32 NumGauss() const { return num_gauss_; }
@@ -88,6 +100,12 @@ class IvectorExtractorFastCuda {
   void SpliceFeats(const CuMatrixBase<BaseFloat> &feats,
                    CuMatrix<BaseFloat> *spliced_feats);
 
+  // As SpliceFeats(), without splicing across the utterance boundaries
+  // given by 'frame_offsets' (see GetIvectors()).
+  void SpliceFeatsSets(const CuMatrixBase<BaseFloat> &feats,
+                       const CuArray<int32> &frame_offsets,
+                       CuMatrix<BaseFloat> *spliced_feats);
+
   void ComputePosteriors(const CuMatrixBase<float> &feats,
                          CuMatrix<float> *posteriors);
 
@@ -99,6 +117,12 @@ class IvectorExtractorFastCuda {
                                const CuMatrix<float> &X,
                                CuVector<float> *ivector);
 
+  // Row u of 'gamma', and rows u * num_gauss_ to (u + 1) * num_gauss_ - 1 of
+  // 'X', are the stats of utterance u; sets row u of 'ivectors'.
+  void ComputeIvectorsFromStats(const CuMatrix<float> &gamma,
+                                const CuMatrix<float> &X,
+                                CuMatrix<float> *ivectors);
+
   CudaOnlineCmvnState naive_cmvn_state_;
 
   int32 feat_dim_;
@@ -22,6 +22,33 @@
 #include "feat/wave-reader.h"
 #include "cudamatrix/cu-matrix.h"
 #include "cudamatrix/cu-vector.h"
+#include "cudamatrix/cu-pinned-matrix.h"
+#include "cudamatrix/cu-stream.h"
+
+namespace kaldi {
+
+// The utterances whose features are computed together, with the buffers
+// for their features.  There are two of these, so that the features of one
+// batch can be copied to the CPU and written while the next one is computed.
+struct FeatureBatch {
+  std::vector<std::string> utts;
+  std::vector<BaseFloat> samples;  // the waveforms, concatenated.
+  std::vector<int32> wave_offsets, frame_offsets;
+  CuMatrix<BaseFloat> cu_features;
+  PinnedMatrix<BaseFloat> features;
+  CuEvent copied;
+
+  FeatureBatch(): wave_offsets(1, 0) { }
+  int32 NumUtts() const { return utts.size(); }
+  void Clear() {
+    utts.clear();
+    samples.clear();
+    wave_offsets.resize(1);
+  }
+};
+
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
@@ -38,6 +65,7 @@ int main(int argc, char *argv[]) {
     std::string utt2spk_rspecifier;
     int32 channel = -1;
     BaseFloat min_duration = 0.0;
+    int32 batch_size = 32;
     // Define defaults for gobal options
     std::string output_format = "kaldi";
 
@@ -59,8 +87,11 @@ int main(int argc, char *argv[]) {
                 "0 -> left, 1 -> right)");
     po.Register("min-duration", &min_duration, "Minimum duration of segments "
                 "to process (in seconds).");
+    po.Register("batch-size", &batch_size, "Number of utterances whose "
+                "features are computed together on the GPU.");
 
     po.Read(argc, argv);
+    KALDI_ASSERT(batch_size > 0);
 
     if (po.NumArgs() != 2) {
       po.PrintUsage();
@@ -101,9 +132,78 @@ int main(int argc, char *argv[]) {
       KALDI_ERR << "Invalid output_format string " << output_format;
     }
 
-    int32 num_utts = 0, num_success = 0;
+    int32 num_utts = 0, num_success = 0, num_batches = 0;
+    FeatureBatch batches[2];
+    // The batch whose features are being computed or copied, and have not
+    // been written yet.
+    FeatureBatch *pending = NULL;
+    bool warned_vtln = false;
+
+    // Starts computing the features of 'batch' and copying them to the CPU.
+    auto ComputeBatch = [&](FeatureBatch *batch) {
+      try {
+        CuVector<BaseFloat> cu_waves(batch->samples.size(), kUndefined);
+        cu_waves.CopyFromVec(SubVector<BaseFloat>(batch->samples.data(),
+                                                  batch->samples.size()));
+        fbank.ComputeFeaturesBatched(
+            cu_waves, batch->wave_offsets, fbank_opts.frame_opts.samp_freq,
+            &(batch->cu_features), &(batch->frame_offsets));
+        batch->features.Resize(batch->cu_features.NumRows(),
+                               batch->cu_features.NumCols(), kUndefined);
+        batch->cu_features.CopyToMatAsync(&(batch->features));
+        batch->copied.Record();
+      } catch (...) {
+        KALDI_WARN << "Failed to compute features for the "
+                   << batch->NumUtts() << " utterances starting with "
+                   << batch->utts[0];
+        batch->Clear();
+      }
+    };
+
+    // Waits for the features of 'batch', writes them and clears it.
+    auto WriteBatch = [&](FeatureBatch *batch) {
+      batch->copied.Synchronize();
+      for (int32 u = 0; u < batch->NumUtts(); u++) {
+        const std::string &utt = batch->utts[u];
+        int32 first_frame = batch->frame_offsets[u],
+            num_frames = batch->frame_offsets[u + 1] - first_frame;
+        Matrix<BaseFloat> features(num_frames, fbank.Dim(), kUndefined);
+        if (num_frames != 0)
+          features.CopyFromMat(batch->features.RowRange(first_frame,
+                                                        num_frames));
+        if (subtract_mean) {
+          Vector<BaseFloat> mean(features.NumCols());
+          mean.AddRowSumMat(1.0, features);
+          mean.Scale(1.0 / features.NumRows());
+          for (int32 i = 0; i < features.NumRows(); i++)
+            features.Row(i).AddVec(-1.0, mean);
+        }
+        if (output_format == "kaldi") {
+          kaldi_writer.Write(utt, features);
+        } else {
+          std::pair<Matrix<BaseFloat>, HtkHeader> p;
+          p.first.Resize(features.NumRows(), features.NumCols());
+          p.first.CopyFromMat(features);
+          HtkHeader header = {
+            features.NumRows(),
+            100000,  // 10ms shift
+            static_cast<int16>(sizeof(float)*(features.NumCols())),
+            static_cast<uint16>( 006 | // MFCC
+            (fbank_opts.use_energy ? 0100 : 020000)) // energy; otherwise c0
+          };
+          p.second = header;
+          htk_writer.Write(utt, p);
+        }
+        KALDI_VLOG(2) << "Processed features for key " << utt;
+        num_success++;
+      }
+      batch->Clear();
+    };
+
     for (; !reader.Done(); reader.Next()) {
       num_utts++;
+      if (num_utts % 10 == 0)
+        KALDI_LOG << "Processed " << num_utts << " utterances";
       std::string utt = reader.Key();
       const WaveData &wave_data = reader.Value();
       if (wave_data.Duration() < min_duration) {
@@ -140,49 +240,33 @@ int main(int argc, char *argv[]) {
       } else {
         vtln_warp_local = vtln_warp;
       }
+      if (vtln_warp_local != 1.0 && !warned_vtln) {
+        KALDI_WARN << "VTLN is not supported by the GPU feature code; "
+                   << "the warp factors are ignored.";
+        warned_vtln = true;
+      }
 
       SubVector<BaseFloat> waveform(wave_data.Data(), this_chan);
-      Matrix<BaseFloat> features;
-      try {
-        CuVector<BaseFloat> cu_waveform(waveform);
-        CuMatrix<BaseFloat> cu_features;
-        fbank.ComputeFeatures(cu_waveform, wave_data.SampFreq(),
-                              vtln_warp_local, &cu_features);
-        features.Resize(cu_features.NumRows(), cu_features.NumCols());
-        features.CopyFromMat(cu_features);
-      } catch (...) {
-        KALDI_WARN << "Failed to compute features for utterance "
-                   << utt;
-        continue;
-      }
-      if (subtract_mean) {
-        Vector<BaseFloat> mean(features.NumCols());
-        mean.AddRowSumMat(1.0, features);
-        mean.Scale(1.0 / features.NumRows());
-        for (int32 i = 0; i < features.NumRows(); i++)
-          features.Row(i).AddVec(-1.0, mean);
-      }
-      if (output_format == "kaldi") {
-        kaldi_writer.Write(utt, features);
-      } else {
-        std::pair<Matrix<BaseFloat>, HtkHeader> p;
-        p.first.Resize(features.NumRows(), features.NumCols());
-        p.first.CopyFromMat(features);
-        HtkHeader header = {
-          features.NumRows(),
-          100000,  // 10ms shift
-          static_cast<int16>(sizeof(float)*(features.NumCols())),
-          static_cast<uint16>( 006 | // MFCC
-          (fbank_opts.use_energy ? 0100 : 020000)) // energy; otherwise c0
-        };
-        p.second = header;
-        htk_writer.Write(utt, p);
+      FeatureBatch *batch = &(batches[num_batches % 2]);
+      batch->utts.push_back(utt);
+      batch->samples.insert(batch->samples.end(), waveform.Data(),
+                            waveform.Data() + waveform.Dim());
+      batch->wave_offsets.push_back(batch->samples.size());
+      if (batch->NumUtts() == batch_size) {
+        ComputeBatch(batch);
+        // While the GPU works on this batch, write the previous one.
+        if (pending != NULL)
+          WriteBatch(pending);
+        pending = batch;
+        num_batches++;
       }
-      if (num_utts % 10 == 0)
-        KALDI_LOG << "Processed " << num_utts << " utterances";
-      KALDI_VLOG(2) << "Processed features for key " << utt;
-      num_success++;
     }
+    FeatureBatch *last = &(batches[num_batches % 2]);
+    if (last->NumUtts() != 0)
+      ComputeBatch(last);
+    if (pending != NULL)
+      WriteBatch(pending);
+    WriteBatch(last);  // does nothing if it is empty.
     KALDI_LOG << " Done " << num_success << " out of " << num_utts
               << " utterances.";
     return (num_success != 0 ? 0 : 1);
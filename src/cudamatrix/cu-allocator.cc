@@ -40,6 +40,7 @@
 #include "base/kaldi-error.h"
 #include "base/kaldi-utils.h"
 #include "util/common-utils.h"
+#include "util/memory-budget.h"
 
 namespace kaldi {
 
@@ -237,6 +238,7 @@ void* CuMemoryAllocator::MallocFromSubregion(SubRegion *subregion,
   block->t = t_;
   allocated_block_map_[block->begin] = block;
   allocated_memory_ += (block->end - block->begin);
+  MemoryBudget::Global().Add(kMemoryGpuAllocator, block->end - block->begin);
   if (allocated_memory_ > max_allocated_memory_) 
     max_allocated_memory_ = allocated_memory_;
   return block->begin;
@@ -378,6 +380,11 @@ void CuMemoryAllocator::PrintMemoryUsage() const {
             << "device memory info: " << GetFreeGpuMemory(NULL, NULL)
             << "maximum allocated: " << max_allocated_memory_  
             << "current allocated: " << allocated_memory_; 
+  if (num_thread_cache_allocs_ > 0) {
+    int64 allocs = num_thread_cache_allocs_, hits = num_thread_cache_hits_;
+    KALDI_LOG << "Per-thread caches served " << hits << " out of " << allocs
+              << " stream-ordered allocations without locking.";
+  }
 }
 
 // Note: we just initialize with the default options, but we can change it later
@@ -390,7 +397,9 @@ CuMemoryAllocator::CuMemoryAllocator():
     tot_time_taken_(0.0),
     malloc_time_taken_(0.0),
     max_allocated_memory_(0),
-    allocated_memory_(0) {
+    allocated_memory_(0),
+    num_thread_cache_allocs_(0),
+    num_thread_cache_hits_(0) {
   // Note: we don't allocate any memory regions at the start; we wait for the user
   // to call Malloc() or MallocPitch(), and then allocate one when needed.
 }
@@ -434,6 +443,8 @@ void CuMemoryAllocator::Free(void *ptr) {
   }
   MemoryBlock *block = iter->second;
   allocated_memory_ -= (block->end - block->begin);
+  MemoryBudget::Global().Add(kMemoryGpuAllocator,
+                             -(block->end - block->begin));
   allocated_block_map_.erase(iter);
   block->t = t_;
   block->thread_id = std::this_thread::get_id();
@@ -626,9 +637,211 @@ CuMemoryAllocator::~CuMemoryAllocator() {
 }
 
 
+
+struct CuMemoryAllocator::ThreadCache {
+  CuMemoryAllocator *allocator;
+  cudaStream_t stream;
+  // Free blocks, indexed by their size (a multiple of 256).
+  std::unordered_map<size_t, std::vector<void*> > free_blocks;
+  size_t bytes_cached;
+};
+
+// The caches of one thread; its destructor, called when the thread exits,
+// returns their memory to the allocators.
+struct CuMemoryAllocator::ThreadCacheList {
+  std::vector<ThreadCache*> caches;
+  ~ThreadCacheList() {
+    for (size_t i = 0; i < caches.size(); i++) {
+      caches[i]->allocator->FlushThreadCache(caches[i]);
+      delete caches[i];
+    }
+  }
+};
+
+CuMemoryAllocator::ThreadCache* CuMemoryAllocator::GetThreadCache(
+    cudaStream_t stream) {
+  static thread_local ThreadCacheList list;
+  // There will normally be only one or two caches per thread.
+  for (size_t i = 0; i < list.caches.size(); i++)
+    if (list.caches[i]->allocator == this && list.caches[i]->stream == stream)
+      return list.caches[i];
+  ThreadCache *cache = new ThreadCache();
+  cache->allocator = this;
+  cache->stream = stream;
+  cache->bytes_cached = 0;
+  list.caches.push_back(cache);
+  return cache;
+}
+
+void CuMemoryAllocator::FlushThreadCache(ThreadCache *cache) {
+  if (cache->bytes_cached == 0)
+    return;
+  // For the per-thread default stream, the mechanism in NOTE ON
+  // SYNCHRONIZATION takes care of reuse by other threads.
+  if (cache->stream != cudaStreamPerThread)
+    CU_SAFE_CALL(cudaStreamSynchronize(cache->stream));
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (auto iter = cache->free_blocks.begin();
+       iter != cache->free_blocks.end(); ++iter) {
+    for (size_t i = 0; i < iter->second.size(); i++) {
+      EraseSizeOfBlock(iter->second[i]);
+      Free(iter->second[i]);
+    }
+  }
+  cache->free_blocks.clear();
+  cache->bytes_cached = 0;
+}
+
+void CuMemoryAllocator::SetSizeOfBlock(void *ptr, size_t size) {
+  SizeShard &shard = GetSizeShard(ptr);
+  std::unique_lock<std::mutex> lock(shard.mutex);
+  shard.sizes[ptr] = size;
+}
+
+size_t CuMemoryAllocator::SizeOfBlock(void *ptr) {
+  SizeShard &shard = GetSizeShard(ptr);
+  std::unique_lock<std::mutex> lock(shard.mutex);
+  std::unordered_map<void*, size_t>::const_iterator iter =
+      shard.sizes.find(ptr);
+  return (iter == shard.sizes.end() ? 0 : iter->second);
+}
+
+void CuMemoryAllocator::EraseSizeOfBlock(void *ptr) {
+  SizeShard &shard = GetSizeShard(ptr);
+  std::unique_lock<std::mutex> lock(shard.mutex);
+  shard.sizes.erase(ptr);
+}
+
+void* CuMemoryAllocator::MallocAsync(size_t size, cudaStream_t stream) {
+  if (!opts_.cache_memory || opts_.thread_cache_mb == 0)
+    return MallocLocking(size);
+  KALDI_ASSERT(size != 0);
+  size = (size + 255) & ~((size_t)255);
+  ThreadCache *cache = GetThreadCache(stream);
+  num_thread_cache_allocs_++;
+  std::unordered_map<size_t, std::vector<void*> >::iterator iter =
+      cache->free_blocks.find(size);
+  if (iter != cache->free_blocks.end() && !iter->second.empty()) {
+    void *ans = iter->second.back();
+    iter->second.pop_back();
+    cache->bytes_cached -= size;
+    num_thread_cache_hits_++;
+    return ans;
+  }
+  void *ans = MallocLocking(size);
+  SetSizeOfBlock(ans, size);
+  return ans;
+}
+
+void* CuMemoryAllocator::MallocPitchAsync(size_t row_bytes, size_t num_rows,
+                                          size_t *pitch,
+                                          cudaStream_t stream) {
+  if (!opts_.cache_memory || opts_.thread_cache_mb == 0)
+    return MallocPitchLocking(row_bytes, num_rows, pitch);
+  // As in MallocPitch().
+  row_bytes = (row_bytes + 255) & ~((size_t)255);
+  *pitch = row_bytes;
+  return MallocAsync(row_bytes * num_rows, stream);
+}
+
+void CuMemoryAllocator::FreeAsync(void *ptr, cudaStream_t stream) {
+  size_t size;
+  if (!opts_.cache_memory || opts_.thread_cache_mb == 0 ||
+      (size = SizeOfBlock(ptr)) == 0) {
+    FreeLocking(ptr);
+    return;
+  }
+  ThreadCache *cache = GetThreadCache(stream);
+  if (cache->bytes_cached + size >
+      (static_cast<size_t>(opts_.thread_cache_mb) << 20)) {
+    // The cache is full: return the block to the shared pool.
+    if (stream != cudaStreamPerThread)
+      CU_SAFE_CALL(cudaStreamSynchronize(stream));
+    EraseSizeOfBlock(ptr);
+    FreeLocking(ptr);
+    return;
+  }
+  cache->free_blocks[size].push_back(ptr);
+  cache->bytes_cached += size;
+}
+
+
 CuMemoryAllocator g_cuda_allocator;
 
 
+size_t CuPinnedAllocator::RoundUpSize(size_t size) {
+  size_t power = 4096;  // a page.
+  while (power < size) {
+    if (power + power / 2 >= size)
+      return power + power / 2;
+    power *= 2;
+  }
+  return power;
+}
+
+void* CuPinnedAllocator::Malloc(size_t size) {
+  KALDI_ASSERT(size > 0);
+  size = RoundUpSize(size);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::multimap<size_t, void*>::iterator iter = cached_.find(size);
+    if (iter != cached_.end()) {
+      void *ans = iter->second;
+      cached_.erase(iter);
+      cached_bytes_ -= size;
+      allocated_[ans] = size;
+      return ans;
+    }
+  }
+  void *ans;
+  cudaError_t e = cudaHostAlloc(&ans, size, cudaHostAllocPortable);
+  if (e != cudaSuccess) {
+    // Release the cached blocks, and try again.
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::multimap<size_t, void*>::iterator iter = cached_.begin();
+         iter != cached_.end(); ++iter)
+      CU_SAFE_CALL(cudaFreeHost(iter->second));
+    cached_.clear();
+    cached_bytes_ = 0;
+    e = cudaHostAlloc(&ans, size, cudaHostAllocPortable);
+    if (e != cudaSuccess)
+      KALDI_ERR << "Failed to allocate " << size << " bytes of pinned host "
+                << "memory: " << cudaGetErrorString(e);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  allocated_[ans] = size;
+  return ans;
+}
+
+void CuPinnedAllocator::Free(void *ptr) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::unordered_map<void*, size_t>::iterator iter = allocated_.find(ptr);
+  if (iter == allocated_.end())
+    KALDI_ERR << "Attempt to free pinned memory that was not allocated: "
+              << ptr;
+  size_t size = iter->second;
+  allocated_.erase(iter);
+  if (cached_bytes_ + size <=
+      static_cast<size_t>(g_allocator_options.pinned_cache_mb) << 20) {
+    cached_.insert(std::make_pair(size, ptr));
+    cached_bytes_ += size;
+  } else {
+    lock.unlock();
+    CU_SAFE_CALL(cudaFreeHost(ptr));
+  }
+}
+
+CuPinnedAllocator::~CuPinnedAllocator() {
+  // We don't check for errors, as the CUDA runtime may already have been
+  // shut down at this point.
+  for (std::multimap<size_t, void*>::iterator iter = cached_.begin();
+       iter != cached_.end(); ++iter)
+    cudaFreeHost(iter->second);
+}
+
+CuPinnedAllocator g_cuda_pinned_allocator;
+
+
 }  // namespace kaldi
 
 
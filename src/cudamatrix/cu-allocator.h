@@ -28,7 +28,9 @@
 #include <cuda_runtime_api.h>
 #endif
 
+#include <atomic>
 #include <map>
+#include <unordered_map>
 #include <set>
 #include <mutex>
 #include <list>
@@ -64,8 +66,19 @@ struct CuAllocatorOptions {
   // memory low addresses.
   int32 num_subregions;
 
+  // The most memory, in megabytes, that each CPU thread keeps in its own
+  // caches (one per CUDA stream) in multi-threaded programs; see
+  // CuMemoryAllocator::MallocAsync().  0 disables these caches, so all
+  // allocations go through the shared pool, under its mutex.
+  int32 thread_cache_mb;
+
+  // The most pinned host memory, in megabytes, that CuPinnedAllocator keeps
+  // cached for reuse after it has been freed.
+  int32 pinned_cache_mb;
+
   CuAllocatorOptions():
-      cache_memory(true), memory_proportion(0.5), num_subregions(20) { }
+      cache_memory(true), memory_proportion(0.5), num_subregions(20),
+      thread_cache_mb(64), pinned_cache_mb(256) { }
 
   void Register(OptionsItf *po) {
     po->Register("cuda-cache-memory", &cache_memory, "True if you want "
@@ -74,11 +87,19 @@ struct CuAllocatorOptions {
     po->Register("cuda-memory-proportion", &memory_proportion,
                  "Proportion of the GPU device memory that the allocator "
                  "should allocate at the start");
+    po->Register("cuda-thread-cache-mb", &thread_cache_mb,
+                 "Memory (in MB) that each CPU thread can cache for reuse "
+                 "without locking, in multi-threaded programs; 0 disables "
+                 "the per-thread caches.");
+    po->Register("cuda-pinned-cache-mb", &pinned_cache_mb,
+                 "Pinned (page-locked) host memory, in MB, that is kept for "
+                 "reuse after it is freed, as allocating it is slow.");
   }
 
   void Check() {
     // don't let it get too close to 1;
     KALDI_ASSERT(memory_proportion >= 0.05 && memory_proportion < 0.99);
+    KALDI_ASSERT(thread_cache_mb >= 0 && pinned_cache_mb >= 0);
   }
 };
 
@@ -129,8 +150,20 @@ namespace kaldi {
    Note that this is based on the assumption that the user is using the
    per-thread default stream (indeed this is how we compile).  If the
    user were to make explicit use of CUDA streams, this mechanism would
-   not necessarily be sufficient to prevent data-race conditions and the
-   user might have to take further precautions.
+   not necessarily be sufficient to prevent data-race conditions; such code
+   should use MallocAsync() and FreeAsync() with its streams.
+
+   NOTE ON THREAD CACHES: in multi-threaded programs, every allocation through
+   the locking functions contends for one mutex.  So CuDevice uses
+   MallocAsync() and FreeAsync() with the per-thread default stream instead:
+   each CPU thread keeps freed blocks in a cache of its own, per stream, and
+   reuses them for allocations of the same size on the same stream without
+   locking.  This is safe without synchronization, as with cudaMallocAsync():
+   work queued on a stream after the allocation cannot start before the work
+   queued before the free has finished.  Blocks go back to the shared pool
+   (after synchronizing the stream, if it is an explicit one) when a thread's
+   cache would exceed CuAllocatorOptions::thread_cache_mb and when the thread
+   exits.  While in a cache, blocks count as allocated.
 
    NOTE ON FRAGMENTATION: Memory fragmentation is one of the main problems that
    you'll run into with allocators like this.  This allocator will allocate a
@@ -178,6 +211,21 @@ class CuMemoryAllocator {
     Free(ptr);
   }
 
+  /// Stream-ordered allocation, for multi-threaded programs, with the
+  /// semantics of cudaMallocAsync(): the memory may be used by work queued on
+  /// 'stream' from now on.  It comes from the calling thread's cache for
+  /// 'stream' if possible (see NOTE ON THREAD CACHES), otherwise from the
+  /// shared pool.
+  void* MallocAsync(size_t size, cudaStream_t stream);
+  /// Stream-ordered version of MallocPitch().
+  void* MallocPitchAsync(size_t row_bytes, size_t num_rows, size_t *pitch,
+                         cudaStream_t stream);
+  /// Stream-ordered free, with the semantics of cudaFreeAsync(): the memory
+  /// may still be in use by work queued on 'stream' before this call.  It
+  /// may be called for memory from any of the allocation functions, and from
+  /// a different thread than allocated it.
+  void FreeAsync(void *ptr, cudaStream_t stream);
+
   void PrintMemoryUsage() const;
 
   // returns the current memory allocated within the cache
@@ -198,6 +246,8 @@ class CuMemoryAllocator {
  private:
 
   struct SubRegion;
+  struct ThreadCache;
+  struct ThreadCacheList;
 
   struct MemoryBlock {
     char *begin;  // The beginning of the block (in CUDA memory)
@@ -312,6 +362,29 @@ class CuMemoryAllocator {
   // the code), and it also recomputes the largest_free_block_ array.
   void SortSubregions();
 
+  // Returns the cache of the calling thread for 'stream', creating it if
+  // needed.
+  ThreadCache *GetThreadCache(cudaStream_t stream);
+
+  // Returns all the blocks in 'cache' to the shared pool.
+  void FlushThreadCache(ThreadCache *cache);
+
+  // Record the sizes of the blocks given out by MallocAsync(), which FreeAsync()
+  // needs without locking mutex_; they are sharded by address, each with its
+  // own mutex, so that threads rarely contend for them.  SizeOfBlock() returns
+  // 0 if 'ptr' was not allocated by MallocAsync().
+  void SetSizeOfBlock(void *ptr, size_t size);
+  size_t SizeOfBlock(void *ptr);
+  void EraseSizeOfBlock(void *ptr);
+  static const int32 kNumSizeShards = 64;
+  struct SizeShard {
+    std::mutex mutex;
+    std::unordered_map<void*, size_t> sizes;
+  };
+  inline SizeShard &GetSizeShard(void *ptr) {
+    return size_shards_[(reinterpret_cast<size_t>(ptr) >> 8) % kNumSizeShards];
+  }
+
 
 
   CuAllocatorOptions opts_;
@@ -346,6 +419,12 @@ class CuMemoryAllocator {
   //   the application
   size_t max_allocated_memory_;
   size_t allocated_memory_;
+
+  SizeShard size_shards_[kNumSizeShards];
+  // The number of calls of MallocAsync() that used the thread caches, and of
+  // those that were served from them.
+  std::atomic<int64> num_thread_cache_allocs_;
+  std::atomic<int64> num_thread_cache_hits_;
 };
 
 
@@ -358,6 +437,46 @@ std::string GetFreeGpuMemory(int64* free, int64* total);
 
 extern CuMemoryAllocator g_cuda_allocator;
 
+
+/**
+   This class allocates page-locked ("pinned") host memory with
+   cudaHostAlloc().  Copies between the GPU and pinned memory are faster than
+   copies from and to ordinary (pageable) memory, and only they can be
+   asynchronous with respect to the CPU; see PinnedMatrix, and
+   CuMatrixBase::CopyFromMatAsync().  Because cudaHostAlloc() and
+   cudaFreeHost() are very slow (they synchronize the device), freed blocks are
+   cached, up to CuAllocatorOptions::pinned_cache_mb, and reused for later
+   requests of the same size; for this, sizes are rounded up to a power of two
+   or 1.5 times a power of two.  Unlike CuMemoryAllocator, this class is
+   thread safe.
+*/
+class CuPinnedAllocator {
+ public:
+  /// Allocates pinned host memory of at least 'size' bytes; size == 0 is not
+  /// allowed.
+  void* Malloc(size_t size);
+
+  /// Frees memory allocated by Malloc().  The caller must make sure that no
+  /// asynchronous copies to or from it are still pending.
+  void Free(void *ptr);
+
+  CuPinnedAllocator(): cached_bytes_(0) { }
+
+  ~CuPinnedAllocator();
+
+ private:
+  static size_t RoundUpSize(size_t size);
+
+  std::mutex mutex_;
+  // The (rounded) sizes of the blocks given to the user.
+  std::unordered_map<void*, size_t> allocated_;
+  // The blocks that are cached, indexed by size.
+  std::multimap<size_t, void*> cached_;
+  size_t cached_bytes_;
+};
+
+extern CuPinnedAllocator g_cuda_pinned_allocator;
+
 }  // namespace kaldi
 
 #endif // HAVE_CUDA
@@ -106,8 +106,8 @@ void CuArrayBase<T>::CopyFromVec(const std::vector<T> &src) {
     CuTimer tim;
     CU_SAFE_CALL(
         cudaMemcpyAsync(data_, &src.front(), src.size() * sizeof(T),
-                   cudaMemcpyHostToDevice, cudaStreamPerThread));
-    CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+                   cudaMemcpyHostToDevice, GetCudaStream()));
+    CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
     CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
@@ -124,8 +124,8 @@ void CuArray<T>::CopyFromVec(const std::vector<T> &src) {
   if (CuDevice::Instantiate().Enabled()) {
     CuTimer tim;
     CU_SAFE_CALL(cudaMemcpyAsync(this->data_, &src.front(), 
-          src.size()*sizeof(T), cudaMemcpyHostToDevice, cudaStreamPerThread));
-    CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+          src.size()*sizeof(T), cudaMemcpyHostToDevice, GetCudaStream()));
+    CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
     CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
@@ -144,7 +144,7 @@ void CuArray<T>::CopyFromArray(const CuArrayBase<T> &src) {
     CuTimer tim;
     CU_SAFE_CALL(cudaMemcpyAsync(this->data_, src.data_, this->dim_ * sizeof(T),
                                  cudaMemcpyDeviceToDevice,
-                                 cudaStreamPerThread));
+                                 GetCudaStream()));
     CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
@@ -163,7 +163,7 @@ void CuArrayBase<T>::CopyFromArray(const CuArrayBase<T> &src) {
     CuTimer tim;
     CU_SAFE_CALL(
       cudaMemcpyAsync(this->data_, src.data_, dim_ * sizeof(T),
-                      cudaMemcpyDeviceToDevice, cudaStreamPerThread));
+                      cudaMemcpyDeviceToDevice, GetCudaStream()));
     CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
@@ -183,8 +183,8 @@ void CuArrayBase<T>::CopyToVec(std::vector<T> *dst) const {
   if (CuDevice::Instantiate().Enabled()) {
     CuTimer tim;
     CU_SAFE_CALL(cudaMemcpyAsync(&dst->front(), Data(), this->dim_ * sizeof(T),
-          cudaMemcpyDeviceToHost, cudaStreamPerThread));
-    CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+          cudaMemcpyDeviceToHost, GetCudaStream()));
+    CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
     CuDevice::Instantiate().AccuProfile("CuArray::CopyToVecD2H", tim);
   } else
 #endif
@@ -202,8 +202,8 @@ void CuArrayBase<T>::CopyToHost(T *dst) const {
   if (CuDevice::Instantiate().Enabled()) {
     CuTimer tim;
     CU_SAFE_CALL(cudaMemcpyAsync(dst, Data(), this->dim_ * sizeof(T),
-          cudaMemcpyDeviceToHost, cudaStreamPerThread));
-    CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+          cudaMemcpyDeviceToHost, GetCudaStream()));
+    CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
     CuDevice::Instantiate().AccuProfile("CuArray::CopyToVecD2H", tim);
   } else
 #endif
@@ -220,7 +220,7 @@ void CuArrayBase<T>::SetZero() {
   if (CuDevice::Instantiate().Enabled()) {
     CuTimer tim;
     CU_SAFE_CALL(cudaMemsetAsync(this->data_, 0, this->dim_ * sizeof(T),
-          cudaStreamPerThread));
+          GetCudaStream()));
     CuDevice::Instantiate().AccuProfile("CuArray::SetZero", tim);
   } else
 #endif
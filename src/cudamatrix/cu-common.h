@@ -143,6 +143,7 @@ template<typename Real> class CuTpMatrix;
 template<typename Real> class CuSparseMatrix;
 
 template<typename Real> class CuBlockMatrix; // this has no non-CU counterpart.
+class CuStream;
 
 
 }
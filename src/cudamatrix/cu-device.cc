@@ -105,8 +105,13 @@ void CuDevice::Initialize() {
           "CuDevice::Instantiate().AllowMultithreading() at the start of "
           "the program.";
     }
-    device_id_copy_ = device_id_;
-    cudaSetDevice(device_id_);
+    if (thread_device_id_ >= 0 && thread_device_id_ != device_id_) {
+      device_id_copy_ = thread_device_id_;
+      allocator_ = GetDeviceAllocator(thread_device_id_);
+    } else {
+      device_id_copy_ = device_id_;
+    }
+    cudaSetDevice(device_id_copy_);
     // Initialize CUBLAS.
     CUBLAS_SAFE_CALL(cublasCreate(&cublas_handle_));
     CUBLAS_SAFE_CALL(cublasSetStream(cublas_handle_, cudaStreamPerThread));
@@ -117,14 +122,7 @@ void CuDevice::Initialize() {
             cudaStreamPerThread));
 #endif
     
-#if CUDA_VERSION >= 9000 
-    if (device_options_.use_tensor_cores) {
-      // Enable tensor cores in CUBLAS
-      // Note if the device does not support tensor cores this will fall back to normal math mode
-      CUBLAS_SAFE_CALL(cublasSetMathMode(cublas_handle_, 
-            CUBLAS_TENSOR_OP_MATH));
-    }
-#endif
+    SetCublasMathMode();
 
     // Initialize the cuSPARSE library
     CUSPARSE_SAFE_CALL(cusparseCreate(&cusparse_handle_));
@@ -252,6 +250,46 @@ void CuDevice::SelectGpuId(std::string use_gpu) {
 }
 
 
+void CuDevice::SetCublasMathMode() {
+#if CUDA_VERSION >= 9000
+  if (device_options_.use_tensor_cores) {
+    // Enable tensor cores in CUBLAS
+    // Note if the device does not support tensor cores this will fall back to
+    // normal math mode
+    CUBLAS_SAFE_CALL(cublasSetMathMode(cublas_handle_, CUBLAS_TENSOR_OP_MATH));
+    return;
+  }
+#endif
+#if CUDA_VERSION >= 11000
+  if (device_options_.allow_tf32) {
+    // Let single-precision GEMMs use TF32 tensor cores (on Ampere and later);
+    // storage and accumulation stay in single precision.
+    CUBLAS_SAFE_CALL(cublasSetMathMode(cublas_handle_,
+                                       CUBLAS_TF32_TENSOR_OP_MATH));
+  }
+#endif
+  const std::string &precision = device_options_.gemm_precision;
+  if (precision == "float")
+    SetGemmPrecision(kGemmFloat);
+  else if (precision == "fp16")
+    SetGemmPrecision(kGemmFp16);
+  else if (precision == "bf16")
+    SetGemmPrecision(kGemmBf16);
+  else
+    KALDI_ERR << "Invalid --cuda-gemm-precision option: " << precision;
+}
+
+CuDevice::GemmPrecision CuDevice::SetGemmPrecision(GemmPrecision precision) {
+#if CUDA_VERSION < 11000
+  if (precision != kGemmFloat)
+    KALDI_ERR << "Half-precision matrix multiplication "
+              << "(--cuda-gemm-precision) needs CUDA 11 or later.";
+#endif
+  GemmPrecision old_precision = gemm_precision_;
+  gemm_precision_ = precision;
+  return old_precision;
+}
+
 void CuDevice::FinalizeActiveGpu() {
   // The device at this point should have an active GPU, so we can query its
   // name and memory stats and notify user which GPU is being used.
@@ -277,14 +315,7 @@ void CuDevice::FinalizeActiveGpu() {
             cudaStreamPerThread));
 #endif
 
-#if CUDA_VERSION >= 9000 
-    if (device_options_.use_tensor_cores) {
-      // Enable tensor cores in CUBLAS
-      // Note if the device does not support tensor cores this will fall back to normal math mode
-      CUBLAS_SAFE_CALL(cublasSetMathMode(cublas_handle_, 
-            CUBLAS_TENSOR_OP_MATH));
-    }
-#endif
+    SetCublasMathMode();
 
     
     // Initialize the cuSPARSE library
@@ -463,11 +494,9 @@ void CuDevice::AccuProfile(const char *function_name,
     if (multi_threaded_)
       lock.lock();
     std::string key(function_name);
-    // by passing 0 as the stream to cudaStreamSynchronize, we are using the
-    // per-thread default stream.  Since we compile with
-    // -DCUDA_API_PER_THREAD_DEFAULT_STREAM, this equates to a per-thread
-    // stream.
-    CU_SAFE_CALL(cudaStreamSynchronize(0));
+    // This is the per-thread default stream unless SetCudaStream() was
+    // called.
+    CU_SAFE_CALL(cudaStreamSynchronize(cuda_stream_));
     double elapsed = timer.Elapsed();
     if (profile_map_.find(key) == profile_map_.end())
       profile_map_[key] = elapsed;
@@ -476,9 +505,52 @@ void CuDevice::AccuProfile(const char *function_name,
   }
 }
 
+void CuDevice::SetCudaStream(cudaStream_t stream) {
+  if (stream == cuda_stream_)
+    return;
+  if (Enabled()) {
+    CU_SAFE_CALL(cudaStreamSynchronize(cuda_stream_));
+    CUBLAS_SAFE_CALL(cublasSetStream(cublas_handle_, stream));
+    CUSPARSE_SAFE_CALL(cusparseSetStream(cusparse_handle_, stream));
+    CURAND_SAFE_CALL(curandSetStream(curand_handle_, stream));
+#if CUDA_VERSION >= 9010
+    CUSOLVER_SAFE_CALL(cusolverDnSetStream(cusolverdn_handle_, stream));
+#endif
+  }
+  cuda_stream_ = stream;
+  cuda_set_stream(stream);
+}
+
 void CuDevice::PrintMemoryUsage() const {
   if (Enabled())
-    g_cuda_allocator.PrintMemoryUsage();
+    allocator_->PrintMemoryUsage();
+}
+
+void CuDevice::SetThreadDeviceId(int32 device_id) {
+  if (device_id_ == -1)
+    KALDI_ERR << "SetThreadDeviceId() called but no GPU was selected "
+              << "(call SelectGpuId() first).";
+  if (this_thread_device_.initialized_)
+    KALDI_ERR << "SetThreadDeviceId() must be called before "
+              << "CuDevice::Instantiate() is first called in the thread.";
+  int32 num_gpus = 0;
+  cudaError_t e = cudaGetDeviceCount(&num_gpus);
+  if (e != cudaSuccess)
+    KALDI_CUDA_ERR(e, "cudaGetDeviceCount() failed");
+  if (device_id < 0 || device_id >= num_gpus)
+    KALDI_ERR << "Invalid GPU device-id " << device_id << " (there are "
+              << num_gpus << " GPUs)";
+  this_thread_device_.thread_device_id_ = device_id;
+}
+
+CuMemoryAllocator *CuDevice::GetDeviceAllocator(int32 device_id) {
+  std::lock_guard<std::mutex> lock(device_allocators_mutex_);
+  CuMemoryAllocator *&allocator = device_allocators_[device_id];
+  if (allocator == NULL) {
+    allocator = new CuMemoryAllocator();
+    allocator->SetOptions(g_allocator_options);
+  }
+  return allocator;
 }
 
 void CuDevice::PrintProfile() {
@@ -560,6 +632,10 @@ void CuDevice::CheckGpuHealth() {
 CuDevice::CuDevice():
     initialized_(false),
     device_id_copy_(-1),
+    thread_device_id_(-1),
+    allocator_(&g_cuda_allocator),
+    deferred_frees_(NULL),
+    cuda_stream_(cudaStreamPerThread),
     cublas_handle_(NULL),
     cusparse_handle_(NULL),
     cusolverdn_handle_(NULL) {
@@ -595,6 +671,9 @@ std::mutex CuDevice::profile_mutex_;
 int64 CuDevice::free_memory_at_startup_;
 cudaDeviceProp CuDevice::properties_;
 bool CuDevice::debug_stride_mode_ = false;
+CuDevice::GemmPrecision CuDevice::gemm_precision_ = CuDevice::kGemmFloat;
+unordered_map<int32, CuMemoryAllocator*> CuDevice::device_allocators_;
+std::mutex CuDevice::device_allocators_mutex_;
 
 
 void SynchronizeGpu() {
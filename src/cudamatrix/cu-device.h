@@ -64,6 +64,10 @@ class CuTimer;
    multiple CUDA streams.  The expected programming model here is that you will
    have multiple CPU threads, and each CPU thread automatically gets its own
    CUDA stream because we compile with -DCUDA_API_PER_THREAD_DEFAULT_STREAM.
+   A thread can also run several computations concurrently, each on a stream
+   of its own, by switching streams with SetCudaStream() between them; the
+   kernels, the cuBLAS/cuSparse/cuRAND/cuSolver calls and the copies done
+   by CuMatrix etc. all go to the stream that is current in the calling thread.
 
    In terms of synchronizing the activities of multiple threads: The CuDevice
    object (with help from the underlying CuAllocator object) ensures that the
@@ -112,33 +116,84 @@ class CuDevice {
   // We provide functions Malloc(), MallocPitch() and Free() which replace
   // cudaMalloc(), cudaMallocPitch() and cudaFree().  Their function is to cache
   // the results of previous allocations to avoid the very large overhead that
-  // CUDA's allocation seems to give for some setups.
+  // CUDA's allocation seems to give for some setups.  In multi-threaded mode,
+  // or if SetCudaStream() was called, the allocations are ordered on this
+  // thread's stream, so they can be served from per-thread caches without
+  // locking.
   inline void* Malloc(size_t size) {
-    return multi_threaded_ ? g_cuda_allocator.MallocLocking(size) :
-        g_cuda_allocator.Malloc(size);
+    return (multi_threaded_ || cuda_stream_ != cudaStreamPerThread) ?
+        allocator_->MallocAsync(size, cuda_stream_) :
+        allocator_->Malloc(size);
   }
 
   inline void* MallocPitch(size_t row_bytes, size_t num_rows, size_t *pitch) {
-    if (multi_threaded_) {
-      return g_cuda_allocator.MallocPitchLocking(row_bytes, num_rows, pitch);
+    if (multi_threaded_ || cuda_stream_ != cudaStreamPerThread) {
+      return allocator_->MallocPitchAsync(row_bytes, num_rows, pitch,
+                                          cuda_stream_);
     } else if (debug_stride_mode_) {
       // The pitch bucket size is hardware dependent.
       // It is 512 on K40c with CUDA 7.5
       // "% 8" ensures that any 8 adjacent allocations have different pitches
       // if their original pitches are same in the normal mode.
-      return g_cuda_allocator.MallocPitch(
+      return allocator_->MallocPitch(
           row_bytes + 512 * RandInt(0, 4), num_rows,
           pitch);
     } else {
-      return g_cuda_allocator.MallocPitch(row_bytes, num_rows, pitch);
+      return allocator_->MallocPitch(row_bytes, num_rows, pitch);
     }
   }
 
   inline void Free(void *ptr) {
-    if (multi_threaded_) g_cuda_allocator.FreeLocking(ptr);
-    else g_cuda_allocator.Free(ptr);
+    if (deferred_frees_ != NULL) {
+      deferred_frees_->push_back(ptr);
+      return;
+    }
+    if (multi_threaded_ || cuda_stream_ != cudaStreamPerThread)
+      allocator_->FreeAsync(ptr, cuda_stream_);
+    else allocator_->Free(ptr);
   }
 
+  /// While 'frees' is non-NULL, Free() called from this thread does not
+  /// free anything but appends the pointer to 'frees', and the caller becomes
+  /// responsible for freeing it later.  This is used while capturing a CUDA
+  /// graph: the replays of the graph will go on using the memory of any
+  /// temporaries that were freed during the capture, so it must not be given
+  /// to anyone else (see class NnetCudaGraphComputer).
+  void SetDeferredFrees(std::vector<void*> *frees) { deferred_frees_ = frees; }
+
+  /// Returns the CUDA stream on which this thread's work is done: the kernels
+  /// of CuMatrix, CuVector etc., the calls through GetCublasHandle() and the
+  /// other handles, and the copies to and from the GPU.  This is
+  /// cudaStreamPerThread unless SetCudaStream() was called.
+  inline cudaStream_t GetCudaStream() const { return cuda_stream_; }
+
+  /// Makes this thread do its GPU work on 'stream' (which may be
+  /// cudaStreamPerThread, to go back to the default) from now on; this lets
+  /// a thread run more than one computation concurrently on the GPU, e.g.
+  /// one NnetComputer per stream, switching streams between calls.  The
+  /// previous stream is synchronized first, so that memory freed while it
+  /// was current can safely be reused on the new one.  Memory allocated
+  /// while one stream is current should be freed only after synchronizing
+  /// that stream, if it is freed while another stream is current.
+  void SetCudaStream(cudaStream_t stream);
+
+  /// For programs that use more than one GPU (e.g. one decoding pipeline per
+  /// GPU): makes the calling thread use the GPU with CUDA device-id
+  /// 'device_id' instead of the one chosen by SelectGpuId(), which must
+  /// already have been called (from the main thread) and have selected a GPU.
+  /// It must be called before the first call to Instantiate() in the thread.
+  /// Each GPU other than the one chosen by SelectGpuId() has its own
+  /// allocator, with the same options as g_cuda_allocator, so memory must be
+  /// freed by a thread using the same GPU as the thread that allocated it.
+  /// The properties of the GPU chosen by SelectGpuId() (e.g. its matrix
+  /// alignment) are assumed to apply to all of them.
+  static void SetThreadDeviceId(int32 device_id);
+
+  /// Returns the CUDA device-id of the GPU that the calling thread uses
+  /// (see SetThreadDeviceId()), or -1 if no GPU is being used.  This is
+  /// useful when starting helper threads that should use the same GPU.
+  int32 ThreadDeviceId() const { return (Enabled() ? device_id_copy_ : -1); }
+
   /// Select a GPU for computation.  You are supposed to call this function just
   /// once, at the beginning of the program (from the main thread), or not at
   /// all.
@@ -205,6 +260,20 @@ class CuDevice {
     return old_mode;
   }
 
+  /// The precision of the inputs of the single-precision matrix
+  /// multiplications done by CuMatrixBase<float>::AddMatMat(), set by the
+  /// --cuda-gemm-precision option.  With kGemmFp16 or kGemmBf16, both inputs
+  /// are rounded to that type and multiplied on tensor cores, with
+  /// single-precision accumulation and output.
+  enum GemmPrecision { kGemmFloat, kGemmFp16, kGemmBf16 };
+
+  GemmPrecision GetGemmPrecision() const { return gemm_precision_; }
+
+  /// Sets the GEMM precision, overriding --cuda-gemm-precision, and returns
+  /// the previous one.  Reduced precisions need CUDA 11 or later.  This is
+  /// mainly useful for testing.
+  GemmPrecision SetGemmPrecision(GemmPrecision precision);
+
   /// Check if the GPU is set to compute exclusive mode (you can set this mode,
   /// if you are root, by doing: `nvidia-smi -c 3`).  Returns true if we have a
   /// GPU and it is running in compute exclusive mode.  Returns false otherwise.
@@ -226,12 +295,32 @@ class CuDevice {
 
   struct CuDeviceOptions {
     bool use_tensor_cores; // Enable tensor cores
-    CuDeviceOptions () : use_tensor_cores(false) {};
+    bool allow_tf32; // Enable TF32 tensor cores for single-precision GEMMs
+    std::string gemm_precision; // "float", "fp16" or "bf16"
+    CuDeviceOptions () : use_tensor_cores(false), allow_tf32(false),
+                         gemm_precision("float") {};
     void Register(OptionsItf *po) {
       po->Register("cuda-use-tensor-cores", &use_tensor_cores, 
           "Enable FP16 tensor math. "
           "This is higher performance but less accuracy. "
           "This is only recommended for inference.");
+      po->Register("cuda-allow-tf32", &allow_tf32,
+          "Allow single-precision matrix multiplications to use TF32 "
+          "tensor cores (Ampere or later GPUs, CUDA 11 or later).  The "
+          "inputs are rounded to a 10-bit mantissa inside the "
+          "multiplication only, with single-precision accumulation and "
+          "storage, which is generally accurate enough for training.  "
+          "Ignored if --cuda-use-tensor-cores=true.");
+      po->Register("cuda-gemm-precision", &gemm_precision,
+          "Precision of the inputs of single-precision matrix "
+          "multiplications (CuMatrix::AddMatMat()): \"float\", \"fp16\" "
+          "or \"bf16\".  With fp16 or bf16 both inputs are rounded to half "
+          "precision and multiplied on tensor cores, with single-precision "
+          "accumulation and output, so activations, derivatives and "
+          "parameters are still stored in single precision.  bf16 has the "
+          "range of float, so small derivatives don't underflow, and is the "
+          "one to use for training; fp16 is more precise but flushes values "
+          "below about 6e-8 to zero.  Needs CUDA 11 or later.");
     }
   };
 
@@ -264,6 +353,12 @@ class CuDevice {
   /// that would try to create the handles again.
   void FinalizeActiveGpu();
 
+  /// Sets the math mode of cublas_handle_ according to the
+  /// --cuda-use-tensor-cores and --cuda-allow-tf32 options, and the GEMM
+  /// precision according to --cuda-gemm-precision; called from Initialize()
+  /// and FinalizeActiveGpu() after creating the handle.
+  void SetCublasMathMode();
+
   /// Should only be called if Enabled() == true.
   int32 MajorDeviceVersion();
 
@@ -276,6 +371,18 @@ class CuDevice {
   // recommended by NVidia).
   static thread_local CuDevice this_thread_device_;
 
+  // Returns the allocator for the GPU with this device-id, creating it if
+  // needed; used for GPUs other than the one chosen by SelectGpuId() (see
+  // SetThreadDeviceId()).
+  static CuMemoryAllocator *GetDeviceAllocator(int32 device_id);
+
+  // The allocators for the GPUs other than device_id_, indexed by device-id.
+  // They are never deleted, as at program exit we can't tell which GPU is
+  // current in the thread that would delete them.
+  static unordered_map<int32, CuMemoryAllocator*> device_allocators_;
+  // device_allocators_mutex_ guards device_allocators_.
+  static std::mutex device_allocators_mutex_;
+
   // The GPU device-id that we are using.  This will be initialized to -1, and will
   // be set when the user calls
   //  CuDevice::Instantiate::SelectGpuId(...)
@@ -307,6 +414,10 @@ class CuDevice {
   // otherwise would be rare).
   static bool debug_stride_mode_;
 
+  // Set from --cuda-gemm-precision by SetCublasMathMode(), or by
+  // SetGemmPrecision().
+  static GemmPrecision gemm_precision_;
+
 
   // The following member variable is initialized to false; if the user calls
   // Instantiate() in a thread where it is still false, Initialize() will be
@@ -318,6 +429,20 @@ class CuDevice {
   // to detect when this code is called in the wrong way.
   int32 device_id_copy_;
 
+  // The device-id set by SetThreadDeviceId(), or -1 if this thread uses
+  // device_id_.
+  int32 thread_device_id_;
+
+  // The allocator used by Malloc(), MallocPitch() and Free(): &g_cuda_allocator
+  // unless SetThreadDeviceId() selected another GPU.
+  CuMemoryAllocator *allocator_;
+
+  // Set by SetDeferredFrees(); normally NULL.
+  std::vector<void*> *deferred_frees_;
+
+  // The stream set by SetCudaStream(); cudaStreamPerThread by default.
+  cudaStream_t cuda_stream_;
+
   cublasHandle_t cublas_handle_;
   cusparseHandle_t cusparse_handle_;
   curandGenerator_t curand_handle_;
@@ -353,6 +478,12 @@ inline curandGenerator_t GetCurandHandle() {
   return CuDevice::Instantiate().GetCurandHandle(); 
 }
 
+// A more convenient way to get the stream on which this thread's GPU work
+// should be done (see CuDevice::SetCudaStream()).
+inline cudaStream_t GetCudaStream() {
+  return CuDevice::Instantiate().GetCudaStream();
+}
+
 
 }  // namespace kaldi
 
@@ -198,6 +198,12 @@ void cudaD_add_vec_to_rows(dim3 Gr, dim3 Bl, double alpha, const double *row,
                            double beta, double *dst, MatrixDim d);
 void cudaF_add_vec_to_rows(dim3 Gr, dim3 Bl, float alpha, const float *row,
                            float beta, float *dst, MatrixDim d);
+void cudaD_add_vec_to_rows_floor(dim3 Gr, dim3 Bl, double alpha,
+                                 const double *row, double floor_val,
+                                 double *dst, MatrixDim d);
+void cudaF_add_vec_to_rows_floor(dim3 Gr, dim3 Bl, float alpha,
+                                 const float *row, float floor_val, float *dst,
+                                 MatrixDim d);
 void cudaD_add_vec_vec(int Gr, int Bl, double alpha, double* v, const double* x,
                        const double* y, double beta, int dim);
 void cudaF_add_vec_vec(int Gr, int Bl, float alpha, float* v, const float* x,
@@ -255,6 +261,15 @@ void cuda_copy_from_mat_dd_trans(dim3 Gr, dim3 Bl, double *mat_out,
 void cuda_copy_from_mat_df(dim3 Gr, dim3 Bl, double* mat_out,
                            const float* mat_in, MatrixDim d_out,
                            MatrixDim d_in);
+// These convert to __half and (with CUDA 11 or later) __nv_bfloat16, for
+// CuMatrixBase<float>::AddMatMat() with --cuda-gemm-precision; mat_out is
+// void* so that this header need not include cuda_fp16.h and cuda_bf16.h.
+void cuda_copy_from_mat_hf(dim3 Gr, dim3 Bl, void* mat_out,
+                           const float* mat_in, MatrixDim d_out,
+                           MatrixDim d_in);
+void cuda_copy_from_mat_bf(dim3 Gr, dim3 Bl, void* mat_out,
+                           const float* mat_in, MatrixDim d_out,
+                           MatrixDim d_in);
 void cuda_copy_from_mat_df_trans(dim3 Gr, dim3 Bl, double* mat_out,
                                  const float* mat_in, MatrixDim d_out,
                                  MatrixDim d_in);
@@ -360,6 +375,46 @@ void cudaF_diff_log_softmax(dim3 Gr, dim3 Bl, const MatrixDim in_deriv_dim,
                             const float* out_value, const int out_value_stride,
                             const float* out_deriv, const int out_deriv_stride,
                             float* in_deriv);
+void cudaD_restricted_attention_forward(
+    dim3 Gr, dim3 Bl, const double *keys, int keys_stride, const double *queries,
+    int queries_stride, const double *values, int values_stride,
+    int num_output_rows, int key_dim, int value_dim, int context_dim,
+    int row_shift, double key_scale, double *c, int c_stride, double *output,
+    int output_stride, int output_has_c);
+void cudaD_restricted_attention_backward_rows(
+    dim3 Gr, dim3 Bl, const double *keys, int keys_stride, const double *values,
+    int values_stride, const double *c, int c_stride, const double *output_deriv,
+    int output_deriv_stride, int output_deriv_has_c, int num_output_rows,
+    int key_dim, int value_dim, int context_dim, int row_shift,
+    double key_scale, double *b_deriv, int b_deriv_stride, double *queries_deriv,
+    int queries_deriv_stride);
+void cudaD_restricted_attention_backward_inputs(
+    dim3 Gr, dim3 Bl, const double *queries, int queries_stride, const double *c,
+    int c_stride, const double *b_deriv, int b_deriv_stride,
+    const double *output_deriv, int output_deriv_stride, int num_input_rows,
+    int num_output_rows, int key_dim, int value_dim, int context_dim,
+    int row_shift, double key_scale, double *keys_deriv, int keys_deriv_stride,
+    double *values_deriv, int values_deriv_stride);
+void cudaF_restricted_attention_forward(
+    dim3 Gr, dim3 Bl, const float *keys, int keys_stride, const float *queries,
+    int queries_stride, const float *values, int values_stride,
+    int num_output_rows, int key_dim, int value_dim, int context_dim,
+    int row_shift, float key_scale, float *c, int c_stride, float *output,
+    int output_stride, int output_has_c);
+void cudaF_restricted_attention_backward_rows(
+    dim3 Gr, dim3 Bl, const float *keys, int keys_stride, const float *values,
+    int values_stride, const float *c, int c_stride, const float *output_deriv,
+    int output_deriv_stride, int output_deriv_has_c, int num_output_rows,
+    int key_dim, int value_dim, int context_dim, int row_shift,
+    float key_scale, float *b_deriv, int b_deriv_stride, float *queries_deriv,
+    int queries_deriv_stride);
+void cudaF_restricted_attention_backward_inputs(
+    dim3 Gr, dim3 Bl, const float *queries, int queries_stride, const float *c,
+    int c_stride, const float *b_deriv, int b_deriv_stride,
+    const float *output_deriv, int output_deriv_stride, int num_input_rows,
+    int num_output_rows, int key_dim, int value_dim, int context_dim,
+    int row_shift, float key_scale, float *keys_deriv, int keys_deriv_stride,
+    float *values_deriv, int values_deriv_stride);
 void cudaD_diff_lstm_nonlinearity(dim3 Gr, dim3 Bl, const int cell_dim,
                                   const int have_dropout_mask,
                                   const int num_rows, const double* input,
@@ -515,6 +570,24 @@ void cuda_int32_set_const(dim3 Gr, dim3 Bl, int32_cuda *mat, int32_cuda value,
                           MatrixDim d);
 void cuda_int32_sequence(dim3 Gr, dim3 Bl, int32_cuda* data, int length,
                          int32_cuda base);
+void cuda_dag_forward(dim3 Gr, dim3 Bl, const int32_cuda *level_states,
+                      int32_cuda num_level_states,
+                      const int32_cuda *in_arc_offsets,
+                      const int32_cuda *in_arcs, const int32_cuda *arc_src,
+                      const BaseFloat *arc_cost, double *alpha);
+void cuda_dag_backward(dim3 Gr, dim3 Bl, const int32_cuda *level_states,
+                       int32_cuda num_level_states,
+                       const int32_cuda *out_arc_offsets,
+                       const int32_cuda *arc_dst, const BaseFloat *arc_cost,
+                       const BaseFloat *final_cost, double *beta);
+void cuda_dag_arc_posteriors(dim3 Gr, dim3 Bl, int32_cuda num_arcs,
+                             const int32_cuda *arc_src,
+                             const int32_cuda *arc_dst,
+                             const BaseFloat *arc_cost,
+                             const int32_cuda *state_graph,
+                             const int32_cuda *graph_start,
+                             const double *alpha, const double *beta,
+                             BaseFloat *post);
 void cudaD_invert_elements(dim3 Gr, dim3 Bl, double *data, MatrixDim d);
 void cudaF_invert_elements(dim3 Gr, dim3 Bl, float *data, MatrixDim d);
 void cudaD_log_softmax_reduce(size_t Gr, size_t Bl, double *y, const double *x,
@@ -799,6 +872,31 @@ void cuda_uncompress_uint8(dim3 Gr, dim3 Bl, BaseFloat *dest,
                           MatrixDim dim, const uint8_t *src,
                           int src_stride, float scale);
 
+// The following decompress the formats of class CompressedMatrix (see
+// ../matrix/compressed-matrix.h), with the same arithmetic as the CPU code.
+// 'src' is the data after the GlobalHeader.  For the formats with one global
+// range the data is row-major with stride dim.cols, and an element i becomes
+// min_value + i * increment.  For the format with per-column headers, 'src'
+// is the num-cols PerColHeaders followed by the column-major byte data.
+void cudaF_mat_uncompress_uint8(dim3 Gr, dim3 Bl, float *dest, MatrixDim dim,
+                                const uint8_t *src, float min_value,
+                                float increment);
+void cudaD_mat_uncompress_uint8(dim3 Gr, dim3 Bl, double *dest, MatrixDim dim,
+                                const uint8_t *src, float min_value,
+                                float increment);
+void cudaF_mat_uncompress_uint16(dim3 Gr, dim3 Bl, float *dest, MatrixDim dim,
+                                 const uint16_t *src, float min_value,
+                                 float increment);
+void cudaD_mat_uncompress_uint16(dim3 Gr, dim3 Bl, double *dest, MatrixDim dim,
+                                 const uint16_t *src, float min_value,
+                                 float increment);
+void cudaF_mat_uncompress_col_headers(dim3 Gr, dim3 Bl, float *dest,
+                                      MatrixDim dim, const void *src,
+                                      float min_value, float range);
+void cudaD_mat_uncompress_col_headers(dim3 Gr, dim3 Bl, double *dest,
+                                      MatrixDim dim, const void *src,
+                                      float min_value, float range);
+
 // copies the sub matrix in src[range_start, range_end] to the matrix in dst
 // if src row is outside of the clamped range it will clamp to the specified
 // rows. src and dst cannot overlap.
@@ -828,6 +926,11 @@ void cudaD_batched_copy_mats(int32_t num_mats, int32_t *num_rows,
 // device.
 void cuda_legacy_noop();
 
+// Sets the stream on which the kernels above are launched by the calling
+// thread; it is cudaStreamPerThread by default.  Called by
+// CuDevice::SetCudaStream().
+void cuda_set_stream(cudaStream_t stream);
+
 
 } // extern "C"
 
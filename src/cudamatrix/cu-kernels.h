@@ -336,6 +336,16 @@ inline void cuda_add_vec_to_rows(dim3 Gr, dim3 Bl, float alpha,
                                  MatrixDim d) {
   cudaF_add_vec_to_rows(Gr, Bl, alpha, row, beta, dst, d);
 }
+inline void cuda_add_vec_to_rows_floor(dim3 Gr, dim3 Bl, double alpha,
+                                       const double *row, double floor_val,
+                                       double *dst, MatrixDim d) {
+  cudaD_add_vec_to_rows_floor(Gr, Bl, alpha, row, floor_val, dst, d);
+}
+inline void cuda_add_vec_to_rows_floor(dim3 Gr, dim3 Bl, float alpha,
+                                       const float *row, float floor_val,
+                                       float *dst, MatrixDim d) {
+  cudaF_add_vec_to_rows_floor(Gr, Bl, alpha, row, floor_val, dst, d);
+}
 inline void cuda_add_vec_vec(int Gr, int Bl, double alpha, double* v,
                              const double* x, const double* y, double beta,
                              int dim) {
@@ -963,6 +973,80 @@ inline void cuda_log_softmax_reduce(size_t Gr, size_t Bl, float *y,
                                     int x_stride) {
   cudaF_log_softmax_reduce(Gr, Bl, y, x, y_dim, x_stride);
 }
+inline void cuda_restricted_attention_forward(
+    dim3 Gr, dim3 Bl, const double *keys, int keys_stride, const double *queries,
+    int queries_stride, const double *values, int values_stride,
+    int num_output_rows, int key_dim, int value_dim, int context_dim,
+    int row_shift, double key_scale, double *c, int c_stride, double *output,
+    int output_stride, int output_has_c) {
+  cudaD_restricted_attention_forward(
+      Gr, Bl, keys, keys_stride, queries, queries_stride, values,
+      values_stride, num_output_rows, key_dim, value_dim, context_dim,
+      row_shift, key_scale, c, c_stride, output, output_stride, output_has_c);
+}
+inline void cuda_restricted_attention_backward_rows(
+    dim3 Gr, dim3 Bl, const double *keys, int keys_stride, const double *values,
+    int values_stride, const double *c, int c_stride, const double *output_deriv,
+    int output_deriv_stride, int output_deriv_has_c, int num_output_rows,
+    int key_dim, int value_dim, int context_dim, int row_shift,
+    double key_scale, double *b_deriv, int b_deriv_stride, double *queries_deriv,
+    int queries_deriv_stride) {
+  cudaD_restricted_attention_backward_rows(
+      Gr, Bl, keys, keys_stride, values, values_stride, c, c_stride,
+      output_deriv, output_deriv_stride, output_deriv_has_c, num_output_rows,
+      key_dim, value_dim, context_dim, row_shift, key_scale, b_deriv,
+      b_deriv_stride, queries_deriv, queries_deriv_stride);
+}
+inline void cuda_restricted_attention_backward_inputs(
+    dim3 Gr, dim3 Bl, const double *queries, int queries_stride, const double *c,
+    int c_stride, const double *b_deriv, int b_deriv_stride,
+    const double *output_deriv, int output_deriv_stride, int num_input_rows,
+    int num_output_rows, int key_dim, int value_dim, int context_dim,
+    int row_shift, double key_scale, double *keys_deriv, int keys_deriv_stride,
+    double *values_deriv, int values_deriv_stride) {
+  cudaD_restricted_attention_backward_inputs(
+      Gr, Bl, queries, queries_stride, c, c_stride, b_deriv, b_deriv_stride,
+      output_deriv, output_deriv_stride, num_input_rows, num_output_rows,
+      key_dim, value_dim, context_dim, row_shift, key_scale, keys_deriv,
+      keys_deriv_stride, values_deriv, values_deriv_stride);
+}
+inline void cuda_restricted_attention_forward(
+    dim3 Gr, dim3 Bl, const float *keys, int keys_stride, const float *queries,
+    int queries_stride, const float *values, int values_stride,
+    int num_output_rows, int key_dim, int value_dim, int context_dim,
+    int row_shift, float key_scale, float *c, int c_stride, float *output,
+    int output_stride, int output_has_c) {
+  cudaF_restricted_attention_forward(
+      Gr, Bl, keys, keys_stride, queries, queries_stride, values,
+      values_stride, num_output_rows, key_dim, value_dim, context_dim,
+      row_shift, key_scale, c, c_stride, output, output_stride, output_has_c);
+}
+inline void cuda_restricted_attention_backward_rows(
+    dim3 Gr, dim3 Bl, const float *keys, int keys_stride, const float *values,
+    int values_stride, const float *c, int c_stride, const float *output_deriv,
+    int output_deriv_stride, int output_deriv_has_c, int num_output_rows,
+    int key_dim, int value_dim, int context_dim, int row_shift,
+    float key_scale, float *b_deriv, int b_deriv_stride, float *queries_deriv,
+    int queries_deriv_stride) {
+  cudaF_restricted_attention_backward_rows(
+      Gr, Bl, keys, keys_stride, values, values_stride, c, c_stride,
+      output_deriv, output_deriv_stride, output_deriv_has_c, num_output_rows,
+      key_dim, value_dim, context_dim, row_shift, key_scale, b_deriv,
+      b_deriv_stride, queries_deriv, queries_deriv_stride);
+}
+inline void cuda_restricted_attention_backward_inputs(
+    dim3 Gr, dim3 Bl, const float *queries, int queries_stride, const float *c,
+    int c_stride, const float *b_deriv, int b_deriv_stride,
+    const float *output_deriv, int output_deriv_stride, int num_input_rows,
+    int num_output_rows, int key_dim, int value_dim, int context_dim,
+    int row_shift, float key_scale, float *keys_deriv, int keys_deriv_stride,
+    float *values_deriv, int values_deriv_stride) {
+  cudaF_restricted_attention_backward_inputs(
+      Gr, Bl, queries, queries_stride, c, c_stride, b_deriv, b_deriv_stride,
+      output_deriv, output_deriv_stride, num_input_rows, num_output_rows,
+      key_dim, value_dim, context_dim, row_shift, key_scale, keys_deriv,
+      keys_deriv_stride, values_deriv, values_deriv_stride);
+}
 inline void cuda_lstm_nonlinearity(dim3 Gr, dim3 Bl, const double* in,
                                    const int in_stride, const double* params,
                                    const int params_stride,
@@ -1556,6 +1640,37 @@ inline void cuda_mat_uncompress(dim3 Gr, dim3 Bl, BaseFloat *dest,
   cuda_uncompress_uint16(Gr, Bl, dest, dim, src, src_stride, scale);
 }
 
+inline void cuda_mat_uncompress(dim3 Gr, dim3 Bl, float *dest, MatrixDim dim,
+                                const uint8_t *src, float min_value,
+                                float increment) {
+  cudaF_mat_uncompress_uint8(Gr, Bl, dest, dim, src, min_value, increment);
+}
+inline void cuda_mat_uncompress(dim3 Gr, dim3 Bl, double *dest, MatrixDim dim,
+                                const uint8_t *src, float min_value,
+                                float increment) {
+  cudaD_mat_uncompress_uint8(Gr, Bl, dest, dim, src, min_value, increment);
+}
+inline void cuda_mat_uncompress(dim3 Gr, dim3 Bl, float *dest, MatrixDim dim,
+                                const uint16_t *src, float min_value,
+                                float increment) {
+  cudaF_mat_uncompress_uint16(Gr, Bl, dest, dim, src, min_value, increment);
+}
+inline void cuda_mat_uncompress(dim3 Gr, dim3 Bl, double *dest, MatrixDim dim,
+                                const uint16_t *src, float min_value,
+                                float increment) {
+  cudaD_mat_uncompress_uint16(Gr, Bl, dest, dim, src, min_value, increment);
+}
+inline void cuda_mat_uncompress_col_headers(dim3 Gr, dim3 Bl, float *dest,
+                                            MatrixDim dim, const void *src,
+                                            float min_value, float range) {
+  cudaF_mat_uncompress_col_headers(Gr, Bl, dest, dim, src, min_value, range);
+}
+inline void cuda_mat_uncompress_col_headers(dim3 Gr, dim3 Bl, double *dest,
+                                            MatrixDim dim, const void *src,
+                                            float min_value, float range) {
+  cudaD_mat_uncompress_col_headers(Gr, Bl, dest, dim, src, min_value, range);
+}
+
 inline void cuda_mat_copy_range_clamped(
    int32_t row_start, int32_t row_end, int32_t num_cols,
    const double *src, int32_t lds, 
@@ -92,6 +92,38 @@ static void UnitTestEnsureNonzero() {
   }
 }
 
+template<typename Real>
+static void UnitTestSymEigBatched() {
+  // test sizes on both sides of the limit (32) of the batched GPU solver.
+  int32 batch_size = RandInt(1, 5),
+      n = (RandInt(0, 1) == 0 ? RandInt(1, 32) : RandInt(33, 80));
+  Matrix<Real> A(batch_size * n, n);
+  for (int32 b = 0; b < batch_size; b++) {
+    Matrix<Real> M(n, n);
+    M.SetRandn();
+    SubMatrix<Real> A_b(A, b * n, n, 0, n);
+    A_b.AddMat(1.0, M);
+    A_b.AddMat(1.0, M, kTrans);
+  }
+  CuMatrix<Real> P(A), s(batch_size, n);
+  cu::SymEigBatched(&P, &s);
+  Matrix<Real> P_cpu(P), s_cpu(s);
+  for (int32 b = 0; b < batch_size; b++) {
+    SubMatrix<Real> A_b(A, b * n, n, 0, n), Pt_b(P_cpu, b * n, n, 0, n);
+    for (int32 i = 0; i + 1 < n; i++)
+      KALDI_ASSERT(s_cpu(b, i) <= s_cpu(b, i + 1));
+    // the eigenvectors are orthonormal...
+    Matrix<Real> unit(n, n);
+    unit.AddMatMat(1.0, Pt_b, kNoTrans, Pt_b, kTrans, 0.0);
+    KALDI_ASSERT(unit.IsUnit(0.01));
+    // ... and A_b = P_b diag(s_b) P_b^T.
+    Matrix<Real> P_s(Pt_b, kTrans), A_b_rebuilt(n, n);
+    P_s.MulColsVec(s_cpu.Row(b));
+    A_b_rebuilt.AddMatMat(1.0, P_s, kNoTrans, Pt_b, kNoTrans, 0.0);
+    AssertEqual(A_b, A_b_rebuilt, 0.01);
+  }
+}
+
 
 template<typename Real>
 static void UnitTestCuMathCopy() {
@@ -183,6 +215,13 @@ static void UnitTestCuMathComputeLstmNonlinearity() {
 
     Matrix<Real> HDoutput(Doutput);
     AssertEqual(Houtput, HDoutput);
+
+    // the CPU version with and without the SIMD kernels.
+    Matrix<Real> Houtput2(num_rows, 2 * cell_dim);
+    SimdMathSetUseSimd(false);
+    cu::CpuComputeLstmNonlinearity(Hinput, Hparams, &Houtput2);
+    SimdMathSetUseSimd(true);
+    AssertEqual(Houtput, Houtput2);
   }
 
   for (int i = 16; i <= 1024; i *= 2) {
@@ -702,6 +741,7 @@ template<typename Real> void CudaMathUnitTest() {
   UnitTestCuMathCopy<Real>();
   UnitTestLstmNonlinearity();
   UnitTestEnsureNonzero<Real>();
+  UnitTestSymEigBatched<Real>();
   UnitTestBackpropLstmNonlinearity<Real>();
   UnitTestCuMathNormalizePerRow<Real>();
   UnitTestCuMathNormalizePerRow_v2<Real>();
@@ -18,11 +18,17 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+
 #include "base/timer.h"
 #include "cudamatrix/cu-common.h"
 #include "cudamatrix/cu-matrix.h"
 #include "cudamatrix/cu-device.h"
 #include "cudamatrix/cu-kernels.h"
+#include "cudamatrix/cu-vector.h"
+#include "cudamatrix/cublas-wrappers.h"
+#include "matrix/simd-math.h"
+#include "matrix/sp-matrix.h"
 
 namespace kaldi {
 
@@ -457,6 +463,15 @@ void CpuComputeLstmNonlinearity(const MatrixBase<Real> &input_mat,
   MatrixBase<Real> &output_mat = *output;
   const Real *params_data = params_mat.Data();
   int32 params_stride = params_mat.Stride();
+  const Real *w_ic = params_data, *w_fc = params_data + params_stride,
+      *w_oc = params_data + 2 * params_stride;
+  // The columns are done in blocks of up to kBlockSize, so that the sigmoid
+  // and tanh can be done on whole arrays with the SIMD kernels of
+  // matrix/simd-math.h; this matters for looped decoding on CPU, where this
+  // is called for very few rows at a time.
+  const int32 kBlockSize = 64;
+  Real i_t[kBlockSize], f_t[kBlockSize], g_t[kBlockSize], o_t[kBlockSize],
+      tanh_c_t[kBlockSize];
   for (int32 r = 0; r < num_rows; r++) {
     const Real *input_row = input_mat.RowData(r);
     // i_scale and f_scale relate to dropout, they will normally be 1.0.
@@ -465,22 +480,29 @@ void CpuComputeLstmNonlinearity(const MatrixBase<Real> &input_mat,
          o_scale = (input_cols == cell_dim*5 ? 1.0:input_row[cell_dim*5 + 2]);
 
     Real *output_row = output_mat.RowData(r);
-    for (int32 c = 0; c < cell_dim; c++) {
-      Real i_part = input_row[c];
-      Real f_part = input_row[c + cell_dim];
-      Real c_part = input_row[c + 2 * cell_dim];
-      Real o_part = input_row[c + 3 * cell_dim];
-      Real c_prev = input_row[c + 4 * cell_dim];
-      Real w_ic = params_data[c];
-      Real w_fc = params_data[c + params_stride];
-      Real w_oc = params_data[c + params_stride * 2];
-      Real i_t = ScalarSigmoid(i_part + w_ic * c_prev);
-      Real f_t = ScalarSigmoid(f_part + w_fc * c_prev);
-      Real c_t = f_t * f_scale * c_prev + i_t * i_scale * ScalarTanh(c_part);
-      Real o_t = ScalarSigmoid(o_part + w_oc * c_t);
-      Real m_t = o_t * o_scale * ScalarTanh(c_t);
-      output_row[c] = c_t;
-      output_row[c + cell_dim] = m_t;
+    for (int32 b = 0; b < cell_dim; b += kBlockSize) {
+      int32 n = std::min(kBlockSize, cell_dim - b);
+      const Real *i_part = input_row + b,
+          *f_part = input_row + cell_dim + b,
+          *c_part = input_row + 2 * cell_dim + b,
+          *o_part = input_row + 3 * cell_dim + b,
+          *c_prev = input_row + 4 * cell_dim + b;
+      Real *c_t = output_row + b, *m_t = output_row + cell_dim + b;
+      for (int32 c = 0; c < n; c++) {
+        i_t[c] = i_part[c] + w_ic[b + c] * c_prev[c];
+        f_t[c] = f_part[c] + w_fc[b + c] * c_prev[c];
+      }
+      SimdSigmoid(i_t, i_t, n);
+      SimdSigmoid(f_t, f_t, n);
+      SimdTanh(c_part, g_t, n);
+      for (int32 c = 0; c < n; c++) {
+        c_t[c] = f_t[c] * f_scale * c_prev[c] + i_t[c] * i_scale * g_t[c];
+        o_t[c] = o_part[c] + w_oc[b + c] * c_t[c];
+      }
+      SimdSigmoid(o_t, o_t, n);
+      SimdTanh(c_t, tanh_c_t, n);
+      for (int32 c = 0; c < n; c++)
+        m_t[c] = o_t[c] * o_scale * tanh_c_t[c];
     }
   }
 }
@@ -923,6 +945,73 @@ void EnsureNonzero(const CuVectorBase<Real> &src,
   EnsureNonzero(src_mat, epsilon, &dest_mat);
 }
 
+template <typename Real>
+void SymEigBatched(CuMatrixBase<Real> *A, CuMatrixBase<Real> *s) {
+  int32 batch_size = s->NumRows(), n = s->NumCols();
+  KALDI_ASSERT(n > 0 && A->NumRows() == batch_size * n && A->NumCols() == n);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+#if CUDA_VERSION >= 9010
+    CuTimer tim;
+    cusolverDnHandle_t handle = GetCusolverDnHandle();
+    // cuSOLVER sees each (row-major) block as its transpose, which is the same
+    // symmetric matrix with its upper triangle where our lower triangle is;
+    // the eigenvectors it writes to the columns are our rows.
+    const cusolverEigMode_t jobz = CUSOLVER_EIG_MODE_VECTOR;
+    const cublasFillMode_t uplo = CUBLAS_FILL_MODE_UPPER;
+    int32 lda = A->Stride(), lwork = 0;
+    // the eigenvalues of all the blocks, contiguous as cuSOLVER writes them.
+    CuVector<Real> w(batch_size * n, kUndefined);
+    // The convergence status of each matrix.  We don't check it, as that would
+    // need a sync; if the Jacobi sweeps have not converged the result is still
+    // a close approximation.
+    CuArray<int32> info(batch_size);
+    syevjInfo_t params;
+    CUSOLVER_SAFE_CALL(cusolverDnCreateSyevjInfo(&params));
+    if (n <= 32) {  // the limit of the batched solver.
+      CUSOLVER_SAFE_CALL(cusolver_syevjBatched_bufferSize(
+          handle, jobz, uplo, n, A->Data(), lda, w.Data(), &lwork, params,
+          batch_size));
+      CuVector<Real> work(lwork, kUndefined);
+      CUSOLVER_SAFE_CALL(cusolver_syevjBatched(
+          handle, jobz, uplo, n, A->Data(), lda, w.Data(), work.Data(), lwork,
+          info.Data(), params, batch_size));
+    } else {
+      CUSOLVER_SAFE_CALL(cusolver_syevj_bufferSize(
+          handle, jobz, uplo, n, A->Data(), lda, w.Data(), &lwork, params));
+      CuVector<Real> work(lwork, kUndefined);
+      for (int32 b = 0; b < batch_size; b++)
+        CUSOLVER_SAFE_CALL(cusolver_syevj(
+            handle, jobz, uplo, n, A->Data() + b * n * lda, lda,
+            w.Data() + b * n, work.Data(), lwork, info.Data() + b, params));
+    }
+    CUSOLVER_SAFE_CALL(cusolverDnDestroySyevjInfo(params));
+    s->CopyRowsFromVec(w);
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+#else
+    KALDI_ERR << "SymEigBatched() needs CUDA 9.1 or later.";
+#endif
+  } else
+#endif
+  {
+    Matrix<Real> P(n, n);
+    std::vector<std::pair<Real, int32> > order(n);
+    for (int32 b = 0; b < batch_size; b++) {
+      SubMatrix<Real> A_b(A->Mat(), b * n, n, 0, n);
+      SubVector<Real> s_b(s->Mat(), b);
+      SpMatrix<Real> A_b_sp(A_b, kTakeLower);
+      A_b_sp.Eig(&s_b, &P);
+      for (int32 i = 0; i < n; i++)
+        order[i] = std::make_pair(s_b(i), i);
+      std::sort(order.begin(), order.end());
+      for (int32 i = 0; i < n; i++) {
+        s_b(i) = order[i].first;
+        A_b.Row(i).CopyColFromMat(P, order[i].second);
+      }
+    }
+  }
+}
+
 // Instantiate the templates we defined above.
 
 template
@@ -943,6 +1032,11 @@ void EnsureNonzero(const CuVectorBase<double> &src,
                    double epsilon,
                    CuVectorBase<double> *dest);
 
+template
+void SymEigBatched(CuMatrixBase<float> *A, CuMatrixBase<float> *s);
+template
+void SymEigBatched(CuMatrixBase<double> *A, CuMatrixBase<double> *s);
+
 template
 void CpuBackpropLstmNonlinearity(const MatrixBase<float> &input,
                                  const MatrixBase<float> &params,
@@ -994,6 +1088,271 @@ void BackpropLstmNonlinearity(const CuMatrixBase<double> &input,
 
 
 
+// Checks the dimensions of the arguments of RestrictedAttentionForward() and
+// RestrictedAttentionBackward(), and works out context_dim and row_shift.
+template<typename Real>
+static void CheckRestrictedAttentionDims(const MatrixBase<Real> &keys,
+                                         const MatrixBase<Real> &queries,
+                                         const MatrixBase<Real> &values,
+                                         const MatrixBase<Real> &c,
+                                         const MatrixBase<Real> &output,
+                                         int32 *context_dim,
+                                         int32 *row_shift) {
+  int32 num_input_rows = keys.NumRows(),
+      key_dim = keys.NumCols(),
+      num_output_rows = queries.NumRows(),
+      value_dim = values.NumCols();
+  *context_dim = queries.NumCols() - key_dim;
+  KALDI_ASSERT(num_input_rows > 0 && key_dim > 0 &&
+               num_input_rows > num_output_rows &&
+               *context_dim > 1 &&
+               (num_input_rows - num_output_rows) % (*context_dim - 1) == 0 &&
+               values.NumRows() == num_input_rows);
+  KALDI_ASSERT(c.NumRows() == num_output_rows &&
+               c.NumCols() == *context_dim);
+  KALDI_ASSERT(output.NumRows() == num_output_rows &&
+               (output.NumCols() == value_dim ||
+                output.NumCols() == value_dim + *context_dim));
+  *row_shift = (num_input_rows - num_output_rows) / (*context_dim - 1);
+}
+
+template<typename Real>
+void CpuRestrictedAttentionForward(Real key_scale,
+                                   const MatrixBase<Real> &keys,
+                                   const MatrixBase<Real> &queries,
+                                   const MatrixBase<Real> &values,
+                                   MatrixBase<Real> *c,
+                                   MatrixBase<Real> *output) {
+  int32 context_dim, row_shift;
+  CheckRestrictedAttentionDims(keys, queries, values, *c, *output,
+                               &context_dim, &row_shift);
+  int32 num_output_rows = queries.NumRows(), key_dim = keys.NumCols(),
+      value_dim = values.NumCols();
+  bool output_has_c = (output->NumCols() != value_dim);
+  for (int32 t = 0; t < num_output_rows; t++) {
+    const Real *q_row = queries.RowData(t);
+    Real *c_row = c->RowData(t);
+    for (int32 o = 0; o < context_dim; o++) {
+      const Real *k_row = keys.RowData(t + o * row_shift);
+      Real sum = 0.0;
+      for (int32 j = 0; j < key_dim; j++)
+        sum += q_row[j] * k_row[j];
+      c_row[o] = key_scale * sum + q_row[key_dim + o];
+    }
+    SubVector<Real> c_vec(c_row, context_dim);
+    c_vec.ApplySoftMax();
+    Real *out_row = output->RowData(t);
+    for (int32 j = 0; j < value_dim; j++)
+      out_row[j] = 0.0;
+    for (int32 o = 0; o < context_dim; o++) {
+      const Real *v_row = values.RowData(t + o * row_shift);
+      Real scale = c_row[o];
+      for (int32 j = 0; j < value_dim; j++)
+        out_row[j] += scale * v_row[j];
+    }
+    if (output_has_c)
+      for (int32 o = 0; o < context_dim; o++)
+        out_row[value_dim + o] = c_row[o];
+  }
+}
+
+template<typename Real>
+void RestrictedAttentionForward(Real key_scale,
+                                const CuMatrixBase<Real> &keys,
+                                const CuMatrixBase<Real> &queries,
+                                const CuMatrixBase<Real> &values,
+                                CuMatrixBase<Real> *c,
+                                CuMatrixBase<Real> *output) {
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    int32 context_dim, row_shift;
+    CheckRestrictedAttentionDims(keys.Mat(), queries.Mat(), values.Mat(),
+                                 c->Mat(), output->Mat(),
+                                 &context_dim, &row_shift);
+    CuTimer tim;
+    int32 num_output_rows = queries.NumRows(), value_dim = values.NumCols();
+    dim3 dimBlock(CU1DBLOCK);
+    dim3 dimGrid(num_output_rows);
+    cuda_restricted_attention_forward(
+        dimGrid, dimBlock, keys.Data(), keys.Stride(), queries.Data(),
+        queries.Stride(), values.Data(), values.Stride(), num_output_rows,
+        keys.NumCols(), value_dim, context_dim, row_shift, key_scale,
+        c->Data(), c->Stride(), output->Data(), output->Stride(),
+        output->NumCols() != value_dim);
+    CU_SAFE_CALL(cudaGetLastError());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    CpuRestrictedAttentionForward(key_scale, keys.Mat(), queries.Mat(),
+                                  values.Mat(), &c->Mat(), &output->Mat());
+  }
+}
+
+template<typename Real>
+void CpuRestrictedAttentionBackward(Real key_scale,
+                                    const MatrixBase<Real> &keys,
+                                    const MatrixBase<Real> &queries,
+                                    const MatrixBase<Real> &values,
+                                    const MatrixBase<Real> &c,
+                                    const MatrixBase<Real> &output_deriv,
+                                    MatrixBase<Real> *keys_deriv,
+                                    MatrixBase<Real> *queries_deriv,
+                                    MatrixBase<Real> *values_deriv) {
+  int32 context_dim, row_shift;
+  CheckRestrictedAttentionDims(keys, queries, values, c, output_deriv,
+                               &context_dim, &row_shift);
+  KALDI_ASSERT(SameDim(keys, *keys_deriv) &&
+               SameDim(queries, *queries_deriv) &&
+               SameDim(values, *values_deriv));
+  int32 num_output_rows = queries.NumRows(), key_dim = keys.NumCols(),
+      value_dim = values.NumCols();
+  bool output_deriv_has_c = (output_deriv.NumCols() != value_dim);
+  Vector<Real> b_deriv(context_dim, kUndefined);
+  for (int32 t = 0; t < num_output_rows; t++) {
+    const Real *od_row = output_deriv.RowData(t), *c_row = c.RowData(t),
+        *q_row = queries.RowData(t);
+    Real *qd_row = queries_deriv->RowData(t);
+    // the derivative w.r.t. c(t, o).
+    for (int32 o = 0; o < context_dim; o++) {
+      const Real *v_row = values.RowData(t + o * row_shift);
+      Real sum = (output_deriv_has_c ? od_row[value_dim + o] : 0.0);
+      for (int32 j = 0; j < value_dim; j++)
+        sum += od_row[j] * v_row[j];
+      b_deriv(o) = sum;
+    }
+    // backprop through the softmax.
+    Real dot = 0.0;
+    for (int32 o = 0; o < context_dim; o++)
+      dot += c_row[o] * b_deriv(o);
+    for (int32 o = 0; o < context_dim; o++) {
+      b_deriv(o) = c_row[o] * (b_deriv(o) - dot);
+      qd_row[key_dim + o] += b_deriv(o);
+    }
+    for (int32 o = 0; o < context_dim; o++) {
+      int32 i = t + o * row_shift;
+      const Real *k_row = keys.RowData(i);
+      Real *kd_row = keys_deriv->RowData(i), *vd_row = values_deriv->RowData(i);
+      Real key_coeff = key_scale * b_deriv(o), value_coeff = c_row[o];
+      for (int32 j = 0; j < key_dim; j++) {
+        qd_row[j] += key_coeff * k_row[j];
+        kd_row[j] += key_coeff * q_row[j];
+      }
+      for (int32 j = 0; j < value_dim; j++)
+        vd_row[j] += value_coeff * od_row[j];
+    }
+  }
+}
+
+template<typename Real>
+void RestrictedAttentionBackward(Real key_scale,
+                                 const CuMatrixBase<Real> &keys,
+                                 const CuMatrixBase<Real> &queries,
+                                 const CuMatrixBase<Real> &values,
+                                 const CuMatrixBase<Real> &c,
+                                 const CuMatrixBase<Real> &output_deriv,
+                                 CuMatrixBase<Real> *keys_deriv,
+                                 CuMatrixBase<Real> *queries_deriv,
+                                 CuMatrixBase<Real> *values_deriv) {
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    int32 context_dim, row_shift;
+    CheckRestrictedAttentionDims(keys.Mat(), queries.Mat(), values.Mat(),
+                                 c.Mat(), output_deriv.Mat(),
+                                 &context_dim, &row_shift);
+    KALDI_ASSERT(SameDim(keys, *keys_deriv) &&
+                 SameDim(queries, *queries_deriv) &&
+                 SameDim(values, *values_deriv));
+    CuTimer tim;
+    int32 num_input_rows = keys.NumRows(),
+        num_output_rows = queries.NumRows(), key_dim = keys.NumCols(),
+        value_dim = values.NumCols();
+    // the derivative w.r.t. the pre-softmax scores b.
+    CuMatrix<Real> b_deriv(num_output_rows, context_dim, kUndefined);
+    {
+      dim3 dimBlock(CU1DBLOCK);
+      dim3 dimGrid(num_output_rows);
+      cuda_restricted_attention_backward_rows(
+          dimGrid, dimBlock, keys.Data(), keys.Stride(), values.Data(),
+          values.Stride(), c.Data(), c.Stride(), output_deriv.Data(),
+          output_deriv.Stride(), output_deriv.NumCols() != value_dim,
+          num_output_rows, key_dim, value_dim, context_dim, row_shift,
+          key_scale, b_deriv.Data(), b_deriv.Stride(), queries_deriv->Data(),
+          queries_deriv->Stride());
+      CU_SAFE_CALL(cudaGetLastError());
+    }
+    {
+      dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
+      dim3 dimGrid(n_blocks(std::max(key_dim, value_dim), CU2DBLOCK),
+                   n_blocks(num_input_rows, CU2DBLOCK));
+      cuda_restricted_attention_backward_inputs(
+          dimGrid, dimBlock, queries.Data(), queries.Stride(), c.Data(),
+          c.Stride(), b_deriv.Data(), b_deriv.Stride(), output_deriv.Data(),
+          output_deriv.Stride(), num_input_rows, num_output_rows, key_dim,
+          value_dim, context_dim, row_shift, key_scale, keys_deriv->Data(),
+          keys_deriv->Stride(), values_deriv->Data(), values_deriv->Stride());
+      CU_SAFE_CALL(cudaGetLastError());
+    }
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    CpuRestrictedAttentionBackward(key_scale, keys.Mat(), queries.Mat(),
+                                   values.Mat(), c.Mat(), output_deriv.Mat(),
+                                   &keys_deriv->Mat(), &queries_deriv->Mat(),
+                                   &values_deriv->Mat());
+  }
+}
+
+template
+void CpuRestrictedAttentionForward(
+    float key_scale, const MatrixBase<float> &keys,
+    const MatrixBase<float> &queries, const MatrixBase<float> &values,
+    MatrixBase<float> *c, MatrixBase<float> *output);
+template
+void RestrictedAttentionForward(
+    float key_scale, const CuMatrixBase<float> &keys,
+    const CuMatrixBase<float> &queries, const CuMatrixBase<float> &values,
+    CuMatrixBase<float> *c, CuMatrixBase<float> *output);
+template
+void CpuRestrictedAttentionBackward(
+    float key_scale, const MatrixBase<float> &keys,
+    const MatrixBase<float> &queries, const MatrixBase<float> &values,
+    const MatrixBase<float> &c, const MatrixBase<float> &output_deriv,
+    MatrixBase<float> *keys_deriv, MatrixBase<float> *queries_deriv,
+    MatrixBase<float> *values_deriv);
+template
+void RestrictedAttentionBackward(
+    float key_scale, const CuMatrixBase<float> &keys,
+    const CuMatrixBase<float> &queries, const CuMatrixBase<float> &values,
+    const CuMatrixBase<float> &c, const CuMatrixBase<float> &output_deriv,
+    CuMatrixBase<float> *keys_deriv, CuMatrixBase<float> *queries_deriv,
+    CuMatrixBase<float> *values_deriv);
+template
+void CpuRestrictedAttentionForward(
+    double key_scale, const MatrixBase<double> &keys,
+    const MatrixBase<double> &queries, const MatrixBase<double> &values,
+    MatrixBase<double> *c, MatrixBase<double> *output);
+template
+void RestrictedAttentionForward(
+    double key_scale, const CuMatrixBase<double> &keys,
+    const CuMatrixBase<double> &queries, const CuMatrixBase<double> &values,
+    CuMatrixBase<double> *c, CuMatrixBase<double> *output);
+template
+void CpuRestrictedAttentionBackward(
+    double key_scale, const MatrixBase<double> &keys,
+    const MatrixBase<double> &queries, const MatrixBase<double> &values,
+    const MatrixBase<double> &c, const MatrixBase<double> &output_deriv,
+    MatrixBase<double> *keys_deriv, MatrixBase<double> *queries_deriv,
+    MatrixBase<double> *values_deriv);
+template
+void RestrictedAttentionBackward(
+    double key_scale, const CuMatrixBase<double> &keys,
+    const CuMatrixBase<double> &queries, const CuMatrixBase<double> &values,
+    const CuMatrixBase<double> &c, const CuMatrixBase<double> &output_deriv,
+    CuMatrixBase<double> *keys_deriv, CuMatrixBase<double> *queries_deriv,
+    CuMatrixBase<double> *values_deriv);
+
 } //namespace cu
 
 } //namespace kaldi
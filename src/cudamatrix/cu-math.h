@@ -93,6 +93,17 @@ void EnsureNonzero(const CuVectorBase<Real> &src,
                    Real epsilon,
                    CuVectorBase<Real> *dest);
 
+/// Does the symmetric eigenvalue decomposition A_b = P_b diag(s_b) P_b^T of
+/// each of a batch of n x n matrices, without copying them to the CPU.  The
+/// matrices are stacked vertically in "A", which is (batch_size * n) by n, so
+/// that A_b is A->RowRange(b * n, n); only their lower triangles are read.  On
+/// exit that block contains P_b^T, i.e. its rows are the eigenvectors of A_b,
+/// and row b of "s" (which is batch_size by n) contains the eigenvalues, in
+/// increasing order.  On a GPU this uses cuSOLVER's Jacobi solver, all the
+/// matrices in one call if n <= 32; it requires CUDA 9.1 or later.
+template <typename Real>
+void SymEigBatched(CuMatrixBase<Real> *A, CuMatrixBase<Real> *s);
+
 /**
  this is a special-purpose function used by class LstmNonlinearityComponent,
  to do its forward propagation.  It computes the core part of the LSTM nonlinearity.
@@ -298,6 +309,74 @@ void DiffNormalizePerRow(const CuMatrixBase<Real> &in_value,
                          const Real target_rms, const bool add_log_stddev,
                          CuMatrixBase<Real>* in_deriv);
 
+/**
+   Fused forward computation of the restricted self-attention used by nnet3's
+   RestrictedAttentionComponent; it computes the same thing as
+   nnet3::attention::AttentionForward() (see nnet3/attention.h for the
+   notation), but on a GPU it does it in a single kernel, with one thread
+   block per output row, instead of a sequence of matrix operations with a
+   temporary for the transposed scores.  With
+   context_dim = queries.NumCols() - keys.NumCols() and
+   row_shift = (keys.NumRows() - queries.NumRows()) / (context_dim - 1),
+   for each output row t and 0 <= o < context_dim it computes
+     b(t, o) = key_scale * q(t) . k(t + o * row_shift) + queries(t, key_dim + o)
+     c(t, :) = softmax(b(t, :))
+     output(t, 0:value_dim) = sum_o c(t, o) * values(t + o * row_shift, :)
+   where q(t) is the first key_dim elements of row t of 'queries' and k(i)
+   is row i of 'keys'; if output has value_dim + context_dim columns, c is
+   also copied to its last context_dim columns.  'c' is needed by
+   RestrictedAttentionBackward().
+*/
+template<typename Real>
+void RestrictedAttentionForward(Real key_scale,
+                                const CuMatrixBase<Real> &keys,
+                                const CuMatrixBase<Real> &queries,
+                                const CuMatrixBase<Real> &values,
+                                CuMatrixBase<Real> *c,
+                                CuMatrixBase<Real> *output);
+// This is a version of RestrictedAttentionForward that only uses the CPU
+// even if a GPU is available. It's made available for testing purposes.
+template<typename Real>
+void CpuRestrictedAttentionForward(Real key_scale,
+                                   const MatrixBase<Real> &keys,
+                                   const MatrixBase<Real> &queries,
+                                   const MatrixBase<Real> &values,
+                                   MatrixBase<Real> *c,
+                                   MatrixBase<Real> *output);
+
+/**
+   The backward pass of RestrictedAttentionForward(), as
+   nnet3::attention::AttentionBackward(): it *adds* the derivatives w.r.t.
+   keys, queries and values to 'keys_deriv', 'queries_deriv' and
+   'values_deriv'.  On a GPU it uses two kernels: one per output row, for
+   the derivatives w.r.t. the scores and the queries, and one per input row,
+   which gathers the derivatives w.r.t. the keys and values from the output
+   rows that used that input row (so no atomic additions are needed and the
+   results are deterministic).
+*/
+template<typename Real>
+void RestrictedAttentionBackward(Real key_scale,
+                                 const CuMatrixBase<Real> &keys,
+                                 const CuMatrixBase<Real> &queries,
+                                 const CuMatrixBase<Real> &values,
+                                 const CuMatrixBase<Real> &c,
+                                 const CuMatrixBase<Real> &output_deriv,
+                                 CuMatrixBase<Real> *keys_deriv,
+                                 CuMatrixBase<Real> *queries_deriv,
+                                 CuMatrixBase<Real> *values_deriv);
+// This is a version of RestrictedAttentionBackward that only uses the CPU
+// even if a GPU is available. It's made available for testing purposes.
+template<typename Real>
+void CpuRestrictedAttentionBackward(Real key_scale,
+                                    const MatrixBase<Real> &keys,
+                                    const MatrixBase<Real> &queries,
+                                    const MatrixBase<Real> &values,
+                                    const MatrixBase<Real> &c,
+                                    const MatrixBase<Real> &output_deriv,
+                                    MatrixBase<Real> *keys_deriv,
+                                    MatrixBase<Real> *queries_deriv,
+                                    MatrixBase<Real> *values_deriv);
+
 
 } // namespace cu
 } // namespace kaldi
@@ -30,5 +30,7 @@
 #include "cudamatrix/cu-block-matrix.h"
 #include "cudamatrix/cu-rand.h"
 #include "cudamatrix/cu-compressed-matrix.h"
+#include "cudamatrix/cu-pinned-matrix.h"
+#include "cudamatrix/cu-stream.h"
 
 #endif
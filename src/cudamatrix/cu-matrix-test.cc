@@ -1579,6 +1579,29 @@ static void UnitTestCuMatrixAddVecToRows() {
 }
 
 
+template<typename Real>
+static void UnitTestCuMatrixAddVecToRowsAndApplyFloor() {
+  Matrix<Real> Hm(100,99);
+  Vector<Real> Hv(99);
+  Hm.SetRandn();
+  InitRand(&Hv);
+
+  CuMatrix<Real> Dm(100,99);
+  CuVector<Real> Dv(99);
+  Dm.CopyFromMat(Hm);
+  Dv.CopyFromVec(Hv);
+
+  Dm.AddVecToRowsAndApplyFloor(0.5, Dv, 0.1);
+  Hm.AddVecToRows(0.5, Hv);
+  Hm.ApplyFloor(0.1);
+
+  Matrix<Real> Hm2(100,99);
+  Dm.CopyToMat(&Hm2);
+
+  KALDI_ASSERT(ApproxEqual(Hm,Hm2));
+}
+
+
 template<typename Real>
 static void UnitTestCuMatrixSymAddMat2() {
   for (int32 i = 0; i < 2; i++) {
@@ -1686,6 +1709,30 @@ static void UnitTestCuMatrixAddMatMat() {
   KALDI_ASSERT(ApproxEqual(Hc2,Hc2a));
 }
 
+// Tests AddMatMat() with the inputs rounded to half precision (see
+// --cuda-gemm-precision), against the single-precision result.
+template<typename Real>
+static void UnitTestCuMatrixAddMatMatHalf() {
+#if HAVE_CUDA == 1 && CUDA_VERSION >= 11000
+  if (!CuDevice::Instantiate().Enabled())
+    return;
+  int32 M = RandInt(1, 300), N = RandInt(1, 300), K = RandInt(1, 300);
+  CuMatrix<Real> A(M, K), B(N, K), C(M, N);
+  A.SetRandn();
+  B.SetRandn();
+  C.SetRandn();
+  CuMatrix<Real> C_half(C);
+  C.AddMatMat(0.5, A, kNoTrans, B, kTrans, 0.25);
+  CuDevice::GemmPrecision old_precision =
+      CuDevice::Instantiate().SetGemmPrecision(
+          RandInt(0, 1) == 0 ? CuDevice::kGemmFp16 : CuDevice::kGemmBf16);
+  C_half.AddMatMat(0.5, A, kNoTrans, B, kTrans, 0.25);
+  CuDevice::Instantiate().SetGemmPrecision(old_precision);
+  // bfloat16 has an 8-bit mantissa, so the error is about 2^-9 relative.
+  KALDI_ASSERT(ApproxEqual(C, C_half, 0.02));
+#endif
+}
+
 
 template<typename Real>
 static void UnitTestCuMatrixAddVecVec() {
@@ -1784,6 +1831,85 @@ static void UnitTestCuMatrixAddMatMatBatched() {
 #endif
 }
 
+template<typename Real>
+static void UnitTestCuMatrixAddMatMatStridedBatched() {
+  for (int32 p = 0; p < 4; p++) {
+    // a block-diagonal product, as in BlockAffineComponent: column block i of
+    // 'out' gets the product of column block i of 'in' with row block i of
+    // 'params' (transposed).
+    int32 num_blocks = 1 + Rand() % 5, num_rows = 10 + Rand() % 20,
+        in_dim = 1 + Rand() % 10, out_dim = 1 + Rand() % 10;
+    CuMatrix<Real> in(num_rows, num_blocks * in_dim),
+        params(num_blocks * out_dim, in_dim),
+        out(num_rows, num_blocks * out_dim);
+    in.SetRandn();
+    params.SetRandn();
+    out.SetRandn();
+    CuMatrix<Real> out2(out);
+    Real alpha = 0.5, beta = (p % 2 == 0 ? 0.0 : 1.0);
+    CuSubMatrix<Real> out_block(out.ColRange(0, out_dim));
+    AddMatMatStridedBatched(alpha, &out_block, out_dim,
+                            in.ColRange(0, in_dim), in_dim, kNoTrans,
+                            params.RowRange(0, out_dim),
+                            out_dim * params.Stride(), kTrans,
+                            beta, num_blocks);
+    for (int32 i = 0; i < num_blocks; i++)
+      out2.ColRange(i * out_dim, out_dim).AddMatMat(
+          alpha, in.ColRange(i * in_dim, in_dim), kNoTrans,
+          params.RowRange(i * out_dim, out_dim), kTrans, beta);
+    AssertEqual(out, out2);
+
+    // with a batch stride of zero for B.
+    CuMatrix<Real> out3(num_rows, num_blocks * in_dim),
+        out4(num_rows, num_blocks * in_dim);
+    CuSubMatrix<Real> out3_block(out3.ColRange(0, in_dim));
+    CuSubMatrix<Real> shared_params(params.RowRange(0, out_dim));
+    AddMatMatStridedBatched(alpha, &out3_block, in_dim,
+                            out.ColRange(0, out_dim), out_dim, kNoTrans,
+                            shared_params, 0, kNoTrans,
+                            static_cast<Real>(0.0), num_blocks);
+    for (int32 i = 0; i < num_blocks; i++)
+      out4.ColRange(i * in_dim, in_dim).AddMatMat(
+          alpha, out.ColRange(i * out_dim, out_dim), kNoTrans,
+          shared_params, kNoTrans, 0.0);
+    AssertEqual(out3, out4);
+  }
+}
+
+template<typename Real>
+static void UnitTestCuMatrixAddMatMatGrouped() {
+  int32 num_products = 12;
+  std::vector<CuMatrix<Real>* > a(num_products), b(num_products),
+      c(num_products);
+  std::vector<CuSubMatrix<Real>* > A, B, C;
+  std::vector<Matrix<Real> > c_ref(num_products);
+  for (int32 i = 0; i < num_products; i++) {
+    // three different shapes.
+    int32 rows = 5 + 3 * (i % 3), cols = 7 + (i % 3), inner = 4 + 2 * (i % 3);
+    a[i] = new CuMatrix<Real>(rows, inner);
+    b[i] = new CuMatrix<Real>(cols, inner);
+    c[i] = new CuMatrix<Real>(rows, cols);
+    a[i]->SetRandn();
+    b[i]->SetRandn();
+    c[i]->SetRandn();
+    c_ref[i].Resize(rows, cols);
+    c_ref[i].CopyFromMat(*c[i]);
+    c_ref[i].AddMatMat(2.0, Matrix<Real>(*a[i]), kNoTrans,
+                       Matrix<Real>(*b[i]), kTrans, 0.5);
+    A.push_back(new CuSubMatrix<Real>(*a[i], 0, rows, 0, inner));
+    B.push_back(new CuSubMatrix<Real>(*b[i], 0, cols, 0, inner));
+    C.push_back(new CuSubMatrix<Real>(*c[i], 0, rows, 0, cols));
+  }
+  AddMatMatGrouped(static_cast<Real>(2.0), C, A, kNoTrans, B, kTrans,
+                   static_cast<Real>(0.5));
+  for (int32 i = 0; i < num_products; i++) {
+    Matrix<Real> c_out(*c[i]);
+    KALDI_ASSERT(ApproxEqual(c_out, c_ref[i]));
+    delete a[i]; delete b[i]; delete c[i];
+    delete A[i]; delete B[i]; delete C[i];
+  }
+}
+
 
 template<typename Real>
 static void UnitTestCuMatrixAddToDiag() {
@@ -1829,6 +1955,73 @@ static void UnitTestCuMatrixCopyFromMat() {
   }
 }
 
+template<typename Real>
+static void UnitTestCuMatrixCopyAsync() {
+  CuStream stream;
+  CuEvent event;
+  for (int32 i = 0; i < 10; i++) {
+    MatrixIndexT num_rows = Rand() % 20, num_cols = Rand() % 20;
+    if (num_rows == 0 || num_cols == 0) num_rows = num_cols = 0;
+    PinnedMatrix<Real> A(num_rows, num_cols, kUndefined), C(num_rows, num_cols);
+    A.SetRandn();
+    CuMatrix<Real> B(num_rows, num_cols, kUndefined);
+    B.CopyFromMatAsync(A, (i % 2 == 0 ? &stream : NULL));
+    event.Record(i % 2 == 0 ? &stream : NULL);
+    event.StreamWait();
+    B.Scale(2.0);
+    B.CopyToMatAsync(&C);
+    event.Record();
+    event.Synchronize();
+    KALDI_ASSERT(event.Done());
+    A.Scale(2.0);
+    AssertEqual(A, C);
+
+    PinnedVector<Real> v(num_cols, kUndefined), w(num_cols);
+    v.SetRandn();
+    CuVector<Real> cv(num_cols, kUndefined);
+    cv.CopyFromVecAsync(v, &stream);
+    stream.Synchronize();
+    cv.CopyToVecAsync(&w);
+    event.Record();
+    event.Synchronize();
+    AssertEqual(v, w);
+  }
+}
+
+template<typename Real>
+static void UnitTestCuMatrixCopyFromCompressedMat() {
+  for (int32 i = 0; i < 14; i++) {
+    MatrixIndexT num_rows = RandInt(1, 30), num_cols = RandInt(1, 20);
+    Matrix<BaseFloat> M(num_rows, num_cols);
+    M.SetRandn();
+    M.Scale(RandInt(1, 10));
+    CompressionMethod method =
+        static_cast<CompressionMethod>(kSpeechFeature + i % 6);
+    CompressedMatrix cmat(M, method);
+    MatrixTransposeType trans = (i % 2 == 0 ? kNoTrans : kTrans);
+
+    Matrix<Real> expected(num_rows, num_cols);
+    cmat.CopyToMat(&expected);
+    if (trans == kTrans)
+      expected.Transpose();
+
+    CuMatrix<Real> cu_mat(expected.NumRows(), expected.NumCols(), kUndefined);
+    cu_mat.CopyFromCompressedMat(cmat, trans);
+    Matrix<Real> result(cu_mat);
+    // The GPU code uses the same arithmetic, so we expect equality.
+    for (MatrixIndexT r = 0; r < result.NumRows(); r++)
+      for (MatrixIndexT c = 0; c < result.NumCols(); c++)
+        KALDI_ASSERT(result(r, c) == expected(r, c));
+
+    GeneralMatrix gmat;
+    CompressedMatrix cmat2(cmat);
+    gmat.SwapCompressedMatrix(&cmat2);
+    cu_mat.SetZero();
+    cu_mat.CopyFromGeneralMat(gmat, trans);
+    AssertEqual(Matrix<Real>(cu_mat), result);
+  }
+}
+
 template<typename Real>
 static void UnitTestCuMatrixCopyFromTp() {
   for (int32 i = 1; i < 10; i++) {
@@ -2980,12 +3173,18 @@ template<typename Real> void CudaMatrixUnitTest() {
   UnitTestCuMatrixReduceMin<Real>();
   UnitTestCuMatrixAddVecToCols<Real>();
   UnitTestCuMatrixAddVecToRows<Real>();
+  UnitTestCuMatrixAddVecToRowsAndApplyFloor<Real>();
   UnitTestCuMatrixAddMatMat<Real>();
+  UnitTestCuMatrixAddMatMatHalf<Real>();
   UnitTestCuMatrixAddVecVec<Real>();
   UnitTestCuMatrixSymAddMat2<Real>();
   UnitTestCuMatrixAddMatMatBatched<Real>();
+  UnitTestCuMatrixAddMatMatStridedBatched<Real>();
+  UnitTestCuMatrixAddMatMatGrouped<Real>();
   UnitTestCuMatrixSymInvertPosDef<Real>();
   UnitTestCuMatrixCopyFromMat<Real>();
+  UnitTestCuMatrixCopyAsync<Real>();
+  UnitTestCuMatrixCopyFromCompressedMat<Real>();
   UnitTestCuMatrixCopyFromTp<Real>();
   UnitTestCuMatrixAddMatTp<Real>();
   UnitTestCuMatrixCopyCols<Real>();
@@ -31,6 +31,9 @@
 #include <cublas_v2.h>
 #endif
 
+#include <algorithm>
+#include <map>
+
 #include "base/timer.h"
 #include "cudamatrix/cu-common.h"
 #include "cudamatrix/cu-vector.h"
@@ -42,7 +45,9 @@
 #include "cudamatrix/cu-tp-matrix.h"
 #include "cudamatrix/cu-block-matrix.h"
 #include "cudamatrix/cu-sparse-matrix.h"
+#include "cudamatrix/cu-stream.h"
 #include "cudamatrix/cublas-wrappers.h"
+#include "matrix/cpu-allocator.h"
 
 namespace kaldi {
 
@@ -102,7 +107,7 @@ void CuMatrix<Real>::Destroy() {
   } else
 #endif
   {
-    if (this->data_ != NULL) KALDI_MEMALIGN_FREE(this->data_);
+    if (this->data_ != NULL) CpuFree(this->data_);
   }
   this->data_ = NULL;
   this->num_rows_ = 0;
@@ -233,7 +238,7 @@ void CuMatrixBase<Real>::CopyFromMat(const CuMatrixBase<OtherReal> &M,
       CU_SAFE_CALL(
         cudaMemcpy2DAsync(data_, dst_pitch, M.data_, src_pitch,
                           width, M.num_rows_, cudaMemcpyDeviceToDevice,
-                          cudaStreamPerThread));
+                          GetCudaStream()));
     } else {
       if (trans == kNoTrans) {
         dim3 dimGrid, dimBlock;
@@ -324,8 +329,8 @@ void CuMatrixBase<Real>::CopyFromMat(const MatrixBase<Real> &src,
       MatrixIndexT width = src.NumCols()*sizeof(Real);
       CU_SAFE_CALL(cudaMemcpy2DAsync(data_, dst_pitch, src.Data(), src_pitch,
                                 width, src.NumRows(), cudaMemcpyHostToDevice,
-                                cudaStreamPerThread));
-      CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+                                GetCudaStream()));
+      CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
 
       CuDevice::Instantiate().AccuProfile("CuMatrixBase::CopyFromMat(from CPU)", tim);
     } else {
@@ -339,6 +344,52 @@ void CuMatrixBase<Real>::CopyFromMat(const MatrixBase<Real> &src,
   }
 }
 
+template<typename Real>
+void CuMatrixBase<Real>::CopyFromMatAsync(const MatrixBase<Real> &src,
+                                          const CuStream *stream) {
+  KALDI_ASSERT(src.NumRows() == num_rows_ && src.NumCols() == num_cols_);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    if (num_rows_ == 0) return;
+    CuTimer tim;
+    MatrixIndexT dst_pitch = stride_ * sizeof(Real),
+        src_pitch = src.Stride() * sizeof(Real),
+        width = num_cols_ * sizeof(Real);
+    CU_SAFE_CALL(cudaMemcpy2DAsync(data_, dst_pitch, src.Data(), src_pitch,
+                                   width, num_rows_, cudaMemcpyHostToDevice,
+                                   stream != NULL ? stream->Stream() :
+                                   GetCudaStream()));
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    Mat().CopyFromMat(src);
+  }
+}
+
+template<typename Real>
+void CuMatrixBase<Real>::CopyToMatAsync(MatrixBase<Real> *dst,
+                                        const CuStream *stream) const {
+  KALDI_ASSERT(dst->NumRows() == num_rows_ && dst->NumCols() == num_cols_);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    if (num_rows_ == 0) return;
+    CuTimer tim;
+    MatrixIndexT src_pitch = stride_ * sizeof(Real),
+        dst_pitch = dst->Stride() * sizeof(Real),
+        width = num_cols_ * sizeof(Real);
+    CU_SAFE_CALL(cudaMemcpy2DAsync(dst->Data(), dst_pitch, data_, src_pitch,
+                                   width, num_rows_, cudaMemcpyDeviceToHost,
+                                   stream != NULL ? stream->Stream() :
+                                   GetCudaStream()));
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    dst->CopyFromMat(Mat());
+  }
+}
+
 template<typename Real>
 template<typename OtherReal>
 void CuMatrixBase<Real>::CopyFromMat(const MatrixBase<OtherReal> &src,
@@ -461,8 +512,8 @@ void CuMatrixBase<Real>::CopyToMat(MatrixBase<OtherReal> *dst,
       MatrixIndexT width = NumCols()*sizeof(Real);
       CU_SAFE_CALL(cudaMemcpy2DAsync(dst->Data(), dst_pitch, this->data_,
                                      src_pitch, width, this->num_rows_,
-                                     cudaMemcpyDeviceToHost, cudaStreamPerThread));
-      CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+                                     cudaMemcpyDeviceToHost, GetCudaStream()));
+      CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
       CuDevice::Instantiate().AccuProfile("CuMatrix::CopyToMatD2H", tim);
     }
   } else
@@ -512,7 +563,7 @@ void CuMatrixBase<Real>::SetZero() {
     CuTimer tim;
     CU_SAFE_CALL(cudaMemset2DAsync(data_, stride_ * sizeof(Real), 0,
                               num_cols_ * sizeof(Real), num_rows_ ,
-                              cudaStreamPerThread));
+                              GetCudaStream()));
     CuDevice::Instantiate().AccuProfile("CuMatrix::SetZero", tim);
   } else
 #endif
@@ -1282,11 +1333,104 @@ void CuMatrixBase<Real>::AddVecToRows(Real alpha,
   }
 }
 
+template<typename Real>
+void CuMatrixBase<Real>::AddVecToRowsAndApplyFloor(
+    Real alpha, const CuVectorBase<Real> &row, Real floor_val) {
+  if (row.Dim() != NumCols()) {
+    KALDI_ERR << "Non matching dimensions: Cols:" << NumCols() << " VectorDim:" << row.Dim();
+  }
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+    dim3 dimGrid, dimBlock;
+    GetBlockSizesForSimpleMatrixOperation(NumRows(), NumCols(),
+                                          &dimGrid, &dimBlock);
+    cuda_add_vec_to_rows_floor(dimGrid, dimBlock, alpha, row.data_, floor_val,
+                               data_, Dim());
+    CU_SAFE_CALL(cudaGetLastError());
+
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    MatrixBase<Real> &mat = Mat();
+    const Real *row_data = row.Vec().Data();
+    MatrixIndexT num_rows = NumRows(), num_cols = NumCols();
+    for (MatrixIndexT r = 0; r < num_rows; r++) {
+      Real *data = mat.RowData(r);
+      for (MatrixIndexT c = 0; c < num_cols; c++)
+        data[c] = std::max(data[c] + alpha * row_data[c], floor_val);
+    }
+  }
+}
+
 
 
 /*
  * Method wrapping the CUBLAS function GEMM
  */
+#if HAVE_CUDA == 1
+// Called from AddMatMat() to do the multiplication with the inputs rounded to
+// half precision, if that was requested with --cuda-gemm-precision; returns
+// false if it wasn't.  The arguments are as for cublas_gemm().
+static bool AddMatMatHalf(cublasOperation_t transa, cublasOperation_t transb,
+                          int m, int n, int k, double alpha,
+                          const CuMatrixBase<double> &A,
+                          const CuMatrixBase<double> &B, double beta,
+                          CuMatrixBase<double> *C) {
+  return false;  // only single-precision multiplications are affected.
+}
+
+static bool AddMatMatHalf(cublasOperation_t transa, cublasOperation_t transb,
+                          int m, int n, int k, float alpha,
+                          const CuMatrixBase<float> &A,
+                          const CuMatrixBase<float> &B, float beta,
+                          CuMatrixBase<float> *C) {
+  CuDevice &device = CuDevice::Instantiate();
+  CuDevice::GemmPrecision precision = device.GetGemmPrecision();
+  if (precision == CuDevice::kGemmFloat)
+    return false;
+#if CUDA_VERSION >= 11000
+  // The rounded copies of A and B, without padding, in one allocation; B's is
+  // aligned to 256 bytes, as the tensor-core kernels prefer.
+  size_t A_bytes = sizeof(uint16) * A.NumRows() * A.NumCols(),
+      B_offset = (A_bytes + 255) / 256 * 256,
+      B_bytes = sizeof(uint16) * B.NumRows() * B.NumCols();
+  char *buffer = static_cast<char*>(device.Malloc(B_offset + B_bytes));
+  void *A_half = buffer, *B_half = buffer + B_offset;
+  MatrixDim A_dim = { A.NumRows(), A.NumCols(), A.NumCols() },
+      B_dim = { B.NumRows(), B.NumCols(), B.NumCols() };
+  dim3 dimGrid, dimBlock;
+  GetBlockSizesForSimpleMatrixOperation(A.NumRows(), A.NumCols(),
+                                        &dimGrid, &dimBlock);
+  if (precision == CuDevice::kGemmFp16)
+    cuda_copy_from_mat_hf(dimGrid, dimBlock, A_half, A.Data(), A_dim, A.Dim());
+  else
+    cuda_copy_from_mat_bf(dimGrid, dimBlock, A_half, A.Data(), A_dim, A.Dim());
+  GetBlockSizesForSimpleMatrixOperation(B.NumRows(), B.NumCols(),
+                                        &dimGrid, &dimBlock);
+  if (precision == CuDevice::kGemmFp16)
+    cuda_copy_from_mat_hf(dimGrid, dimBlock, B_half, B.Data(), B_dim, B.Dim());
+  else
+    cuda_copy_from_mat_bf(dimGrid, dimBlock, B_half, B.Data(), B_dim, B.Dim());
+  CU_SAFE_CALL(cudaGetLastError());
+  CUBLAS_SAFE_CALL(cublas_gemm_half(
+      GetCublasHandle(), transa, transb, m, n, k, alpha, A_half, A.NumCols(),
+      B_half, B.NumCols(),
+      (precision == CuDevice::kGemmFp16 ? CUDA_R_16F : CUDA_R_16BF), beta,
+      C->Data(), C->Stride()));
+  // The multiplication is ordered on the stream before any later use of the
+  // buffer, so it can be freed now.
+  device.Free(buffer);
+  return true;
+#else
+  // SetGemmPrecision() doesn't allow this.
+  KALDI_ERR << "Half-precision matrix multiplication needs CUDA 11.";
+  return false;
+#endif
+}
+#endif
+
 template<typename Real>
 void CuMatrixBase<Real>::AddMatMat(
     Real alpha, const CuMatrixBase<Real> &A, MatrixTransposeType transA,
@@ -1310,11 +1454,14 @@ void CuMatrixBase<Real>::AddMatMat(
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
     CuTimer tim;
-    CUBLAS_SAFE_CALL(cublas_gemm(GetCublasHandle(),
-                             (transB==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
-                             (transA==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
-                             m, n, k, alpha, B.data_, B.Stride(),
-                             A.data_, A.Stride(), beta, data_, Stride()));
+    if (!AddMatMatHalf((transB==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
+                       (transA==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
+                       m, n, k, alpha, B, A, beta, this))
+      CUBLAS_SAFE_CALL(cublas_gemm(GetCublasHandle(),
+                               (transB==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
+                               (transA==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
+                               m, n, k, alpha, B.data_, B.Stride(),
+                               A.data_, A.Stride(), beta, data_, Stride()));
 
     CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
@@ -1415,7 +1562,7 @@ template<typename Real>
 void CuMatrixBase<Real>::AddMatDiagVec(
     const Real alpha,
     const CuMatrixBase<Real> &M, MatrixTransposeType transM,
-    CuVectorBase<Real> &v,
+    const CuVectorBase<Real> &v,
     Real beta) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
@@ -1682,7 +1829,7 @@ void CuMatrix<Real>::CompObjfAndDeriv(const std::vector<MatrixElement<Real> >& s
     CU_SAFE_CALL(cudaMemcpyAsync(addr, sv_labels.data(), sv_labels.size() *
                                  sizeof(MatrixElement<Real>),
                                  cudaMemcpyHostToDevice,
-                                 cudaStreamPerThread));
+                                 GetCudaStream()));
     CuTimer tim;
     CuVector<Real> tmp(2, kUndefined);
     int dimBlock(CU1DBLOCK);
@@ -2260,7 +2407,7 @@ void AddMatMatBatched(const Real alpha, std::vector<CuSubMatrix<Real>* > &C,
 
     CU_SAFE_CALL(cudaMemcpyAsync(device_abc_array, host_abc_array,
                                  3*size*sizeof(Real*), cudaMemcpyHostToDevice,
-                                 cudaStreamPerThread));
+                                 GetCudaStream()));
 
     CUBLAS_SAFE_CALL(cublas_gemmBatched(GetCublasHandle(),
                                         (transB==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
@@ -2297,6 +2444,147 @@ void AddMatMatBatched(const double alpha, std::vector<CuSubMatrix<double>* > &C,
                       const std::vector<CuSubMatrix<double>* > &B,
                       MatrixTransposeType transB, const double beta);
 
+template<typename Real>
+void AddMatMatStridedBatched(const Real alpha,
+                             CuMatrixBase<Real> *C, int64 c_batch_stride,
+                             const CuMatrixBase<Real> &A, int64 a_batch_stride,
+                             MatrixTransposeType transA,
+                             const CuMatrixBase<Real> &B, int64 b_batch_stride,
+                             MatrixTransposeType transB,
+                             const Real beta, int32 batch_count) {
+  KALDI_ASSERT(batch_count >= 0 && a_batch_stride >= 0 &&
+               b_batch_stride >= 0 &&
+               (c_batch_stride > 0 || batch_count <= 1));
+  // the same mapping to column-major as in AddMatMatBatched().
+  MatrixIndexT m = ((transB==kTrans)? B.NumRows() : B.NumCols());
+  MatrixIndexT n = ((transA==kTrans)? A.NumCols() : A.NumRows());
+  MatrixIndexT k = ((transB==kTrans)? B.NumCols() : B.NumRows());
+  MatrixIndexT k1 = ((transA==kTrans)? A.NumRows() : A.NumCols());
+
+  KALDI_ASSERT(m == C->NumCols());
+  KALDI_ASSERT(n == C->NumRows());
+  KALDI_ASSERT(k == k1);
+
+  if (m == 0 || n == 0 || batch_count == 0) return;
+
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+    CUBLAS_SAFE_CALL(cublas_gemmStridedBatched(
+        GetCublasHandle(),
+        (transB==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
+        (transA==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
+        m, n, k, alpha, B.Data(), B.Stride(), b_batch_stride,
+        A.Data(), A.Stride(), a_batch_stride, beta,
+        C->Data(), C->Stride(), c_batch_stride, batch_count));
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    for (int32 i = 0; i < batch_count; i++) {
+      CuSubMatrix<Real> A_i(A.Data() + i * a_batch_stride, A.NumRows(),
+                            A.NumCols(), A.Stride()),
+          B_i(B.Data() + i * b_batch_stride, B.NumRows(), B.NumCols(),
+              B.Stride()),
+          C_i(C->Data() + i * c_batch_stride, C->NumRows(), C->NumCols(),
+              C->Stride());
+      C_i.Mat().AddMatMat(alpha, A_i.Mat(), transA, B_i.Mat(), transB, beta);
+    }
+  }
+}
+
+template
+void AddMatMatStridedBatched(const float alpha,
+                             CuMatrixBase<float> *C, int64 c_batch_stride,
+                             const CuMatrixBase<float> &A, int64 a_batch_stride,
+                             MatrixTransposeType transA,
+                             const CuMatrixBase<float> &B, int64 b_batch_stride,
+                             MatrixTransposeType transB,
+                             const float beta, int32 batch_count);
+
+template
+void AddMatMatStridedBatched(const double alpha,
+                             CuMatrixBase<double> *C, int64 c_batch_stride,
+                             const CuMatrixBase<double> &A,
+                             int64 a_batch_stride,
+                             MatrixTransposeType transA,
+                             const CuMatrixBase<double> &B,
+                             int64 b_batch_stride,
+                             MatrixTransposeType transB,
+                             const double beta, int32 batch_count);
+
+namespace {
+// The shape of the products done by AddMatMatGrouped(): the dimensions and
+// strides of A, B and C.
+struct MatMatShape {
+  MatrixIndexT dims[9];
+  template<typename Real>
+  MatMatShape(const CuMatrixBase<Real> &A, const CuMatrixBase<Real> &B,
+              const CuMatrixBase<Real> &C) {
+    dims[0] = A.NumRows(); dims[1] = A.NumCols(); dims[2] = A.Stride();
+    dims[3] = B.NumRows(); dims[4] = B.NumCols(); dims[5] = B.Stride();
+    dims[6] = C.NumRows(); dims[7] = C.NumCols(); dims[8] = C.Stride();
+  }
+  bool operator < (const MatMatShape &other) const {
+    return std::lexicographical_compare(dims, dims + 9,
+                                        other.dims, other.dims + 9);
+  }
+};
+}  // namespace
+
+template<typename Real>
+void AddMatMatGrouped(const Real alpha,
+                      const std::vector<CuSubMatrix<Real>* > &C,
+                      const std::vector<CuSubMatrix<Real>* > &A,
+                      MatrixTransposeType transA,
+                      const std::vector<CuSubMatrix<Real>* > &B,
+                      MatrixTransposeType transB,
+                      const Real beta) {
+  KALDI_ASSERT(A.size() == B.size() && B.size() == C.size());
+  std::map<MatMatShape, std::vector<int32> > groups;
+  for (size_t i = 0; i < A.size(); i++)
+    groups[MatMatShape(*A[i], *B[i], *C[i])].push_back(i);
+
+  std::vector<CuSubMatrix<Real>* > A_group, B_group, C_group;
+  typename std::map<MatMatShape, std::vector<int32> >::const_iterator
+      iter = groups.begin(), end = groups.end();
+  for (; iter != end; ++iter) {
+    const std::vector<int32> &indexes = iter->second;
+    if (indexes.size() == 1) {
+      int32 i = indexes[0];
+      C[i]->AddMatMat(alpha, *A[i], transA, *B[i], transB, beta);
+      continue;
+    }
+    A_group.clear();
+    B_group.clear();
+    C_group.clear();
+    for (size_t j = 0; j < indexes.size(); j++) {
+      A_group.push_back(A[indexes[j]]);
+      B_group.push_back(B[indexes[j]]);
+      C_group.push_back(C[indexes[j]]);
+    }
+    AddMatMatBatched(alpha, C_group, A_group, transA, B_group, transB, beta);
+  }
+}
+
+template
+void AddMatMatGrouped(const float alpha,
+                      const std::vector<CuSubMatrix<float>* > &C,
+                      const std::vector<CuSubMatrix<float>* > &A,
+                      MatrixTransposeType transA,
+                      const std::vector<CuSubMatrix<float>* > &B,
+                      MatrixTransposeType transB,
+                      const float beta);
+
+template
+void AddMatMatGrouped(const double alpha,
+                      const std::vector<CuSubMatrix<double>* > &C,
+                      const std::vector<CuSubMatrix<double>* > &A,
+                      MatrixTransposeType transA,
+                      const std::vector<CuSubMatrix<double>* > &B,
+                      MatrixTransposeType transB,
+                      const double beta);
+
 template<typename Real>
 void CuMatrixBase<Real>::CopyRowsFromVec(const CuVectorBase<Real> &v) {
 #if HAVE_CUDA == 1
@@ -2307,13 +2595,13 @@ void CuMatrixBase<Real>::CopyRowsFromVec(const CuVectorBase<Real> &v) {
         const Real* v_data = v.Data();
         CU_SAFE_CALL(
           cudaMemcpyAsync(data_, v_data, sizeof(Real)*num_rows_*num_cols_,
-                          cudaMemcpyDeviceToDevice, cudaStreamPerThread));
+                          cudaMemcpyDeviceToDevice, GetCudaStream()));
       } else {
         CU_SAFE_CALL(
           cudaMemcpy2DAsync(data_, stride_ * sizeof(Real), v.Data(),
                             num_cols_*sizeof(Real), num_cols_*sizeof(Real),
                             num_rows_, cudaMemcpyDeviceToDevice,
-                            cudaStreamPerThread));
+                            GetCudaStream()));
       }
     } else if (v.Dim() == num_cols_) {
       dim3 dimGrid, dimBlock;
@@ -2343,18 +2631,18 @@ void CuMatrixBase<Real>::CopyRowsFromVec(const VectorBase<Real> &v) {
         CU_SAFE_CALL(cudaMemcpyAsync(data_, v_data,
                                      sizeof(Real)*num_rows_*num_cols_,
                                      cudaMemcpyHostToDevice,
-                                     cudaStreamPerThread));
+                                     GetCudaStream()));
       } else {
         const Real *v_data = v.Data();
         for (MatrixIndexT r = 0; r < num_rows_; r++) {
           Real *row_data = RowData(r);
           CU_SAFE_CALL(cudaMemcpyAsync(row_data, v_data, sizeof(Real)*num_cols_,
                                        cudaMemcpyHostToDevice,
-                                       cudaStreamPerThread));
+                                       GetCudaStream()));
           v_data += num_cols_;
         }
       }
-      CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+      CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
     } else if (v.Dim() == num_cols_) {
       dim3 dimGrid, dimBlock;
       GetBlockSizesForSimpleMatrixOperation(NumRows(), NumCols(),
@@ -2625,18 +2913,18 @@ void VectorBase<Real>::CopyRowsFromMat(const CuMatrixBase<Real> &mat) {
     CuTimer tim;
     if (mat.Stride() == mat.NumCols()) {
       CU_SAFE_CALL(cudaMemcpyAsync(data_, mat.Data(), sizeof(Real)*dim_,
-                   cudaMemcpyDeviceToHost, cudaStreamPerThread));
+                   cudaMemcpyDeviceToHost, GetCudaStream()));
     } else {
       // we could definitely do better than the following.
       Real* vec_data = data_;
       for (MatrixIndexT r = 0; r < mat.NumRows(); r++) {
         CU_SAFE_CALL(cudaMemcpyAsync(vec_data, mat.RowData(r),
                      sizeof(Real) * mat.NumCols(), cudaMemcpyDeviceToHost,
-                     cudaStreamPerThread));
+                     GetCudaStream()));
         vec_data += mat.NumCols();
       }
     }
-    CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+    CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
     CuDevice::Instantiate().AccuProfile("CuVectorBase::CopyRowsFromMat", tim);
   } else
 #endif
@@ -3102,9 +3390,7 @@ void CuMatrixBase<Real>::CopyFromGeneralMat(const GeneralMatrix &src,
       return;
     }
     case kCompressedMatrix: {
-      Matrix<BaseFloat> mat;
-      src.GetMatrix(&mat);
-      this->CopyFromMat(mat, trans);
+      this->CopyFromCompressedMat(src.GetCompressedMatrix(), trans);
       return;
     }
     case kSparseMatrix: {
@@ -3127,6 +3413,61 @@ void CuMatrixBase<Real>::CopyFromGeneralMat(const GeneralMatrix &src,
 }
 
 
+template<typename Real>
+void CuMatrixBase<Real>::CopyFromCompressedMat(const CompressedMatrix &src,
+                                               MatrixTransposeType trans) {
+  if (trans == kTrans) {
+    CuMatrix<Real> temp(num_cols_, num_rows_, kUndefined);
+    temp.CopyFromCompressedMat(src);
+    this->CopyFromMat(temp, kTrans);
+    return;
+  }
+  KALDI_ASSERT(src.NumRows() == num_rows_ && src.NumCols() == num_cols_);
+  if (num_rows_ == 0) return;
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+    typedef CompressedMatrix::GlobalHeader GlobalHeader;
+    const GlobalHeader *h = reinterpret_cast<const GlobalHeader*>(src.Data());
+    // We copy everything after the global header, whose contents we pass to
+    // the kernels as arguments.
+    size_t num_bytes = CompressedMatrix::DataSize(*h) - sizeof(GlobalHeader);
+    void *data = CuDevice::Instantiate().Malloc(num_bytes);
+    CU_SAFE_CALL(cudaMemcpyAsync(data, h + 1, num_bytes,
+                                 cudaMemcpyHostToDevice, GetCudaStream()));
+    dim3 dimGrid, dimBlock;
+    GetBlockSizesForSimpleMatrixOperation(num_rows_, num_cols_,
+                                          &dimGrid, &dimBlock);
+    switch (static_cast<CompressedMatrix::DataFormat>(h->format)) {
+      case CompressedMatrix::kOneByteWithColHeaders:
+        cuda_mat_uncompress_col_headers(dimGrid, dimBlock, data_, Dim(), data,
+                                        h->min_value, h->range);
+        break;
+      case CompressedMatrix::kTwoByte:
+        cuda_mat_uncompress(dimGrid, dimBlock, data_, Dim(),
+                            static_cast<const uint16_t*>(data), h->min_value,
+                            float(h->range * (1.0 / 65535.0)));
+        break;
+      case CompressedMatrix::kOneByte:
+        cuda_mat_uncompress(dimGrid, dimBlock, data_, Dim(),
+                            static_cast<const uint8_t*>(data), h->min_value,
+                            float(h->range * (1.0 / 255.0)));
+        break;
+      default:
+        KALDI_ERR << "Invalid CompressedMatrix format " << h->format;
+    }
+    CU_SAFE_CALL(cudaGetLastError());
+    // The allocator is stream-ordered, so this is safe before the kernel has
+    // run.
+    CuDevice::Instantiate().Free(data);
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    src.CopyToMat(&(Mat()));
+  }
+}
+
 
 template<typename Real>
 void CuMatrixBase<Real>::SetRandn() {
@@ -3287,7 +3628,7 @@ void CuMatrixBase<Real>::AddElements(Real alpha,
     void *addr = CuDevice::Instantiate().Malloc(input.size() * sizeof(MatrixElement<Real>));
     CU_SAFE_CALL(cudaMemcpyAsync(addr, input.data(),
                                  input.size() * sizeof(MatrixElement<Real>),
-                                 cudaMemcpyHostToDevice, cudaStreamPerThread));
+                                 cudaMemcpyHostToDevice, GetCudaStream()));
 
     CuTimer tim;
     int dimBlock(CU1DBLOCK);
@@ -3319,7 +3660,7 @@ void CuMatrixBase<Real>::AddElements(Real alpha, const CuArrayBase<Int32Pair> &i
     CuVector<Real> tmp_vec(indexes.Dim(), kUndefined);
     CU_SAFE_CALL(cudaMemcpyAsync(tmp_vec.Data(), input,
                                  indexes.Dim() * sizeof(Real),
-                                 cudaMemcpyHostToDevice, cudaStreamPerThread));
+                                 cudaMemcpyHostToDevice, GetCudaStream()));
 
     int dimBlock(CU1DBLOCK);
     int dimGrid = n_blocks(indexes.Dim(), CU1DBLOCK);
@@ -59,6 +59,42 @@ void AddMatMatBatched(const Real alpha, std::vector<CuSubMatrix<Real>* > &C,
                       MatrixTransposeType transB,
                       const Real beta);
 
+/// Does multiple matrix multiplications of matrices that are evenly spaced in
+/// memory, using cuBLAS's gemmStridedBatched if we are using a GPU; unlike
+/// AddMatMatBatched(), this does not need arrays of pointers to be copied to
+/// the GPU.  A, B and C are the first matrices of their batches: for
+/// i = 0 ... batch_count - 1 it does
+///    C_i = alpha * A_i(^T) * B_i(^T) + beta * C_i,
+/// where A_i is the matrix with the dimensions and stride of A that starts at
+/// A.Data() + i * a_batch_stride, and likewise for B_i and C_i.  E.g. the i'th
+/// block of columns of width w of a matrix M has batch stride w, starting
+/// from M.ColRange(0, w).  The batch strides of A and B may be zero (to use
+/// the same matrix in every product).  The caller must make sure that all the
+/// matrices lie within allocated memory and that the C_i do not overlap.
+template<typename Real>
+void AddMatMatStridedBatched(const Real alpha,
+                             CuMatrixBase<Real> *C, int64 c_batch_stride,
+                             const CuMatrixBase<Real> &A, int64 a_batch_stride,
+                             MatrixTransposeType transA,
+                             const CuMatrixBase<Real> &B, int64 b_batch_stride,
+                             MatrixTransposeType transB,
+                             const Real beta, int32 batch_count);
+
+/// Like AddMatMatBatched(), but the products may have different shapes: it
+/// groups them by the dimensions and strides of their matrices and does one
+/// call to AddMatMatBatched() for each group (or an ordinary AddMatMat() for
+/// a group with just one product).  This is convenient for code that has a
+/// loop of small, independent products, e.g. one per utterance.  The C[i]
+/// must not overlap.
+template<typename Real>
+void AddMatMatGrouped(const Real alpha,
+                      const std::vector<CuSubMatrix<Real>* > &C,
+                      const std::vector<CuSubMatrix<Real>* > &A,
+                      MatrixTransposeType transA,
+                      const std::vector<CuSubMatrix<Real>* > &B,
+                      MatrixTransposeType transB,
+                      const Real beta);
+
 /**
  * Matrix for CUDA computing.
  * Does the computation on the CUDA card when CUDA is compiled in and
@@ -242,6 +278,13 @@ class CuMatrixBase {
   void CopyFromGeneralMat(const GeneralMatrix &src,
                           MatrixTransposeType trans = kNoTrans);
 
+  /// Copies from a CompressedMatrix of the same size (any of its formats).
+  /// When using a GPU, the compressed data is copied to the GPU and
+  /// decompressed there, which moves between a quarter and a half as much data
+  /// as decompressing on the CPU would; the result is the same.
+  void CopyFromCompressedMat(const CompressedMatrix &src,
+                             MatrixTransposeType trans = kNoTrans);
+
   void CopyFromMat(const MatrixBase<Real> &src,
                    MatrixTransposeType trans = kNoTrans);
 
@@ -266,6 +309,20 @@ class CuMatrixBase {
   void CopyToMat(MatrixBase<OtherReal> *dst,
                  MatrixTransposeType trans = kNoTrans) const;
 
+  /// Asynchronous versions of CopyFromMat() and CopyToMat(), for matrices of
+  /// the same size and type: the copy is queued on 'stream' (see
+  /// cu-stream.h), or on the calling thread's stream if it is NULL, and the
+  /// function returns without waiting for it.  The CPU matrix must not be
+  /// changed (or, for CopyToMatAsync(), read) or freed until the copy has
+  /// finished, e.g. until a CuEvent recorded after it completes.  The copy can
+  /// only overlap with other work if the CPU memory is pinned (see
+  /// PinnedMatrix); otherwise CUDA does at least part of it synchronously.
+  /// If the GPU is not enabled these are the same as the synchronous versions.
+  void CopyFromMatAsync(const MatrixBase<Real> &src,
+                        const CuStream *stream = NULL);
+  void CopyToMatAsync(MatrixBase<Real> *dst,
+                      const CuStream *stream = NULL) const;
+
   /// This function has two modes of operation.  If v.Dim() == NumRows() *
   /// NumCols(), then treats the vector as a row-by-row concatenation of a
   /// matrix and copies to *this.
@@ -570,6 +627,10 @@ class CuMatrixBase {
   void AddVecToCols(Real alpha, const CuVectorBase<Real> &col, Real beta = 1.0);
   /// (for each row r of *this), r = alpha * row + beta * r
   void AddVecToRows(Real alpha, const CuVectorBase<Real> &row, Real beta = 1.0);
+  /// (for each row r of *this), r = max(r + alpha * row, floor_val); this is
+  /// e.g. a bias followed by a rectifier, done in one pass.
+  void AddVecToRowsAndApplyFloor(Real alpha, const CuVectorBase<Real> &row,
+                                 Real floor_val);
   /// C = alpha * A(^T)*B(^T) + beta * C
   void AddMatMat(Real alpha, const CuMatrixBase<Real> &A, MatrixTransposeType transA,
                  const CuMatrixBase<Real> &B, MatrixTransposeType transB, Real beta);
@@ -601,7 +662,7 @@ class CuMatrixBase {
   // The same as adding M but scaling each column M_j by v(j).
   void AddMatDiagVec(const Real alpha,
                      const CuMatrixBase<Real> &M, MatrixTransposeType transM,
-                     CuVectorBase<Real> &v,
+                     const CuVectorBase<Real> &v,
                      Real beta = 1.0);
 
   /// *this = beta * *this + alpha * A .* B (.* element by element multiplication)
@@ -32,6 +32,7 @@
 #include "cudamatrix/cu-kernels.h"
 #include "cudamatrix/cu-math.h"
 #include "cudamatrix/cu-packed-matrix.h"
+#include "matrix/cpu-allocator.h"
 #include "cudamatrix/cublas-wrappers.h"
 
 namespace kaldi {
@@ -91,7 +92,7 @@ void CuPackedMatrix<Real>::Destroy() {
   } else
 #endif
   {
-    if (this->data_ != NULL) KALDI_MEMALIGN_FREE(this->data_);
+    if (this->data_ != NULL) CpuFree(this->data_);
   }
   this->data_ = NULL;
   this->num_rows_ = 0;
@@ -145,7 +146,7 @@ void CuPackedMatrix<Real>::CopyFromPacked(const CuPackedMatrix<Real> &src) {
 
     CU_SAFE_CALL(
       cudaMemcpyAsync(data_, src.data_, num_bytes, cudaMemcpyDeviceToDevice,
-                      cudaStreamPerThread));
+                      GetCudaStream()));
     CuDevice::Instantiate().AccuProfile("CuPackedMatrix::CopyFromPacked1",
                                         tim);
   } else
@@ -163,8 +164,8 @@ void CuPackedMatrix<Real>::CopyFromPacked(const PackedMatrix<Real> &src) {
     if (num_rows_ == 0) return; // Nothing to do.
     CuTimer tim;
     CU_SAFE_CALL(cudaMemcpyAsync(data_, src.data_, src.SizeInBytes(),
-                                 cudaMemcpyHostToDevice, cudaStreamPerThread));
-    CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+                                 cudaMemcpyHostToDevice, GetCudaStream()));
+    CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
     CuDevice::Instantiate().AccuProfile("CuPackedMatrix::CopyFromPacked2", tim);
   } else
 #endif
@@ -186,8 +187,8 @@ void CuPackedMatrix<Real>::CopyToPacked(PackedMatrix<Real> *dst) const {
       num_bytes = ((nr * (nr+1)) / 2) * sizeof(Real);
 
     CU_SAFE_CALL(cudaMemcpyAsync(dst->data_, data_, num_bytes,
-                                 cudaMemcpyDeviceToHost, cudaStreamPerThread));
-    CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+                                 cudaMemcpyDeviceToHost, GetCudaStream()));
+    CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
     CuDevice::Instantiate().AccuProfile("CuPackedMatrix::CopyToPackedD2H", tim);
   } else
 #endif
@@ -251,7 +252,7 @@ void CuPackedMatrix<Real>::SetZero() {
       num_bytes = ((nr * (nr+1)) / 2) * sizeof(Real);
 
     CU_SAFE_CALL(cudaMemsetAsync(reinterpret_cast<void*>(this->data_), 0, 
-          num_bytes, cudaStreamPerThread));
+          num_bytes, GetCudaStream()));
     CuDevice::Instantiate().AccuProfile("CuPackedMatrix::SetZero", tim);
   } else
   #endif
@@ -0,0 +1,131 @@
+// cudamatrix/cu-pinned-matrix.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cudamatrix/cu-pinned-matrix.h"
+#include "cudamatrix/cu-allocator.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+
+namespace {
+
+// Allocates 'bytes' bytes, from the pinned allocator if the GPU is enabled;
+// sets *pinned to say which.
+void *AllocatePossiblyPinned(size_t bytes, bool *pinned) {
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    *pinned = true;
+    return g_cuda_pinned_allocator.Malloc(bytes);
+  }
+#endif
+  *pinned = false;
+  void *data, *free_data;
+  if ((data = KALDI_MEMALIGN(16, bytes, &free_data)) == NULL)
+    throw std::bad_alloc();
+  return data;
+}
+
+void FreePossiblyPinned(void *data, bool pinned) {
+#if HAVE_CUDA == 1
+  if (pinned) {
+    g_cuda_pinned_allocator.Free(data);
+    return;
+  }
+#endif
+  KALDI_MEMALIGN_FREE(data);
+}
+
+}  // namespace
+
+template<typename Real>
+void PinnedMatrix<Real>::Resize(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                                MatrixResizeType resize_type) {
+  KALDI_ASSERT(resize_type == kSetZero || resize_type == kUndefined);
+  KALDI_ASSERT(num_rows >= 0 && num_cols >= 0);
+  if (num_rows != this->num_rows_ || num_cols != this->num_cols_) {
+    Destroy();
+    if (num_rows != 0 && num_cols != 0) {
+      // As in Matrix: the rows are 16-byte aligned.
+      MatrixIndexT skip = ((16 / sizeof(Real)) - num_cols %
+                           (16 / sizeof(Real))) % (16 / sizeof(Real)),
+          stride = num_cols + skip;
+      this->data_ = static_cast<Real*>(AllocatePossiblyPinned(
+          sizeof(Real) * static_cast<size_t>(num_rows) * stride, &pinned_));
+      this->num_rows_ = num_rows;
+      this->num_cols_ = num_cols;
+      this->stride_ = stride;
+    }
+  }
+  if (resize_type == kSetZero)
+    this->SetZero();
+}
+
+template<typename Real>
+void PinnedMatrix<Real>::Swap(PinnedMatrix<Real> *other) {
+  std::swap(this->data_, other->data_);
+  std::swap(this->num_rows_, other->num_rows_);
+  std::swap(this->num_cols_, other->num_cols_);
+  std::swap(this->stride_, other->stride_);
+  std::swap(pinned_, other->pinned_);
+}
+
+template<typename Real>
+void PinnedMatrix<Real>::Destroy() {
+  if (this->data_ != NULL)
+    FreePossiblyPinned(this->data_, pinned_);
+  this->data_ = NULL;
+  this->num_rows_ = this->num_cols_ = this->stride_ = 0;
+}
+
+template<typename Real>
+void PinnedVector<Real>::Resize(MatrixIndexT dim,
+                                MatrixResizeType resize_type) {
+  KALDI_ASSERT(resize_type == kSetZero || resize_type == kUndefined);
+  KALDI_ASSERT(dim >= 0);
+  if (dim != this->dim_) {
+    Destroy();
+    if (dim != 0) {
+      this->data_ = static_cast<Real*>(AllocatePossiblyPinned(
+          sizeof(Real) * static_cast<size_t>(dim), &pinned_));
+      this->dim_ = dim;
+    }
+  }
+  if (resize_type == kSetZero)
+    this->SetZero();
+}
+
+template<typename Real>
+void PinnedVector<Real>::Swap(PinnedVector<Real> *other) {
+  std::swap(this->data_, other->data_);
+  std::swap(this->dim_, other->dim_);
+  std::swap(pinned_, other->pinned_);
+}
+
+template<typename Real>
+void PinnedVector<Real>::Destroy() {
+  if (this->data_ != NULL)
+    FreePossiblyPinned(this->data_, pinned_);
+  this->data_ = NULL;
+  this->dim_ = 0;
+}
+
+template class PinnedMatrix<float>;
+template class PinnedMatrix<double>;
+template class PinnedVector<float>;
+template class PinnedVector<double>;
+
+}  // namespace kaldi
@@ -0,0 +1,103 @@
+// cudamatrix/cu-pinned-matrix.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_CUDAMATRIX_CU_PINNED_MATRIX_H_
+#define KALDI_CUDAMATRIX_CU_PINNED_MATRIX_H_
+
+#include "matrix/kaldi-matrix.h"
+#include "matrix/kaldi-vector.h"
+
+namespace kaldi {
+
+/**
+   PinnedMatrix is a CPU matrix whose memory is page-locked ("pinned", see
+   CuPinnedAllocator), so that copies between it and the GPU are faster than
+   for Matrix, and can be asynchronous (see CuMatrixBase::CopyFromMatAsync()).
+   It is a MatrixBase, so it can be used like any other CPU matrix, but it
+   cannot be resized in the ways Matrix can, and pinned memory is a scarce
+   resource: use it for buffers that are reused, for staging copies between
+   the CPU and the GPU.  If we did not compile for CUDA or the GPU is not
+   enabled when the memory is allocated, ordinary memory is used.
+*/
+template<typename Real>
+class PinnedMatrix: public MatrixBase<Real> {
+ public:
+  PinnedMatrix(): MatrixBase<Real>(NULL, 0, 0, 0), pinned_(false) { }
+
+  PinnedMatrix(MatrixIndexT num_rows, MatrixIndexT num_cols,
+               MatrixResizeType resize_type = kSetZero):
+      MatrixBase<Real>(NULL, 0, 0, 0), pinned_(false) {
+    Resize(num_rows, num_cols, resize_type);
+  }
+
+  explicit PinnedMatrix(const MatrixBase<Real> &M):
+      MatrixBase<Real>(NULL, 0, 0, 0), pinned_(false) {
+    Resize(M.NumRows(), M.NumCols(), kUndefined);
+    this->CopyFromMat(M);
+  }
+
+  /// Sets the size; resize_type may be kSetZero or kUndefined (the data is
+  /// not preserved).  The memory is only reallocated if the size changes.
+  void Resize(MatrixIndexT num_rows, MatrixIndexT num_cols,
+              MatrixResizeType resize_type = kSetZero);
+
+  void Swap(PinnedMatrix<Real> *other);
+
+  ~PinnedMatrix() { Destroy(); }
+
+ private:
+  void Destroy();
+
+  bool pinned_;  // true if the memory came from g_cuda_pinned_allocator.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(PinnedMatrix);
+};
+
+
+/// PinnedVector is the vector version of PinnedMatrix.
+template<typename Real>
+class PinnedVector: public VectorBase<Real> {
+ public:
+  PinnedVector(): pinned_(false) { }
+
+  explicit PinnedVector(MatrixIndexT dim,
+                        MatrixResizeType resize_type = kSetZero):
+      pinned_(false) {
+    Resize(dim, resize_type);
+  }
+
+  explicit PinnedVector(const VectorBase<Real> &v): pinned_(false) {
+    Resize(v.Dim(), kUndefined);
+    this->CopyFromVec(v);
+  }
+
+  /// As PinnedMatrix::Resize().
+  void Resize(MatrixIndexT dim, MatrixResizeType resize_type = kSetZero);
+
+  void Swap(PinnedVector<Real> *other);
+
+  ~PinnedVector() { Destroy(); }
+
+ private:
+  void Destroy();
+
+  bool pinned_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(PinnedVector);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_CUDAMATRIX_CU_PINNED_MATRIX_H_
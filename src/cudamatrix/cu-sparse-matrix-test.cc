@@ -267,6 +267,36 @@ static void UnitTestCuSparseMatrixSwap() {
   }
 }
 
+template <typename Real>
+static void UnitTestCuSparseMatrixCopyFromCsr() {
+  for (int32 i = 0; i < 2; i++) {
+    MatrixIndexT row = 10 + Rand() % 40;
+    MatrixIndexT col = 10 + Rand() % 50;
+
+    SparseMatrix<Real> smat(row, col);
+    smat.SetRandn(0.8);
+    std::vector<int32> row_offsets(1, 0), col_indexes;
+    std::vector<Real> values;
+    for (int32 r = 0; r < row; r++) {
+      const SparseVector<Real> &vec = smat.Row(r);
+      for (int32 j = 0; j < vec.NumElements(); j++) {
+        col_indexes.push_back(vec.GetElement(j).first);
+        values.push_back(vec.GetElement(j).second);
+      }
+      row_offsets.push_back(col_indexes.size());
+    }
+    CuSparseMatrix<Real> cu_smat1(smat), cu_smat2;
+    cu_smat2.CopyFromCsr(row, col, row_offsets, col_indexes, values);
+
+    CuMatrix<Real> mat1(row, col);
+    CuMatrix<Real> mat2(row, col);
+    cu_smat1.CopyToMat(&mat1);
+    cu_smat2.CopyToMat(&mat2);
+
+    AssertEqual(mat1, mat2, 0.00001);
+  }
+}
+
 template <typename Real>
 void CudaSparseMatrixUnitTest() {
   UnitTestCuSparseMatrixConstructFromIndexes<Real>();
@@ -276,6 +306,7 @@ void CudaSparseMatrixUnitTest() {
   UnitTestCuSparseMatrixFrobeniusNorm<Real>();
   UnitTestCuSparseMatrixCopyToSmat<Real>();
   UnitTestCuSparseMatrixSwap<Real>();
+  UnitTestCuSparseMatrixCopyFromCsr<Real>();
 }
 
 
@@ -403,6 +403,40 @@ void CuSparseMatrix<Real>::CopyFromSmat(const CuSparseMatrix<Real>& smat,
   }
 }
 
+template<typename Real>
+void CuSparseMatrix<Real>::CopyFromCsr(int32 num_rows, int32 num_cols,
+                                       const std::vector<int32> &row_offsets,
+                                       const std::vector<int32> &col_indexes,
+                                       const std::vector<Real> &values) {
+  KALDI_ASSERT(row_offsets.size() == num_rows + 1 && row_offsets[0] == 0 &&
+               row_offsets[num_rows] == col_indexes.size() &&
+               col_indexes.size() == values.size());
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    int32 nnz = values.size();
+    Resize(num_rows, num_cols, nnz, kUndefined);
+    if (nnz == 0)
+      return;
+    CuSubArray<int> cu_row_ptr(CsrRowPtr(), NumRows() + 1);
+    cu_row_ptr.CopyFromVec(row_offsets);
+    CuSubArray<int> cu_col_idx(CsrColIdx(), NumElements());
+    cu_col_idx.CopyFromVec(col_indexes);
+    CuSubVector<Real> cu_val(CsrVal(), NumElements());
+    cu_val.CopyFromVec(SubVector<Real>(values.data(), nnz));
+  } else
+#endif
+  {
+    Smat().Resize(num_rows, num_cols);
+    std::vector<std::pair<MatrixIndexT, Real> > pairs;
+    for (int32 r = 0; r < num_rows; r++) {
+      pairs.clear();
+      for (int32 i = row_offsets[r]; i < row_offsets[r + 1]; i++)
+        pairs.push_back(std::make_pair(col_indexes[i], values[i]));
+      Smat().SetRow(r, SparseVector<Real>(num_cols, pairs));
+    }
+  }
+}
+
 template<typename Real>
 template<typename OtherReal>
 void CuSparseMatrix<Real>::CopyToSmat(SparseMatrix<OtherReal> *smat) const {
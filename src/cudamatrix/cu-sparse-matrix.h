@@ -88,6 +88,17 @@ public:
   void CopyFromSmat(const CuSparseMatrix<Real> &smat,
                     MatrixTransposeType trans = kNoTrans);
 
+  /// Copy from arrays in the CSR format: the elements of row r have column
+  /// indexes col_indexes[row_offsets[r] ... row_offsets[r+1] - 1] and values
+  /// from the same positions of 'values'.  'row_offsets' must have dimension
+  /// num_rows + 1 and start with zero, and within each row the column indexes
+  /// must be sorted and unique (e.g. see CompactPosterior::SortFrames()).  On
+  /// a GPU the arrays are copied as they are, without any reformatting.
+  void CopyFromCsr(int32 num_rows, int32 num_cols,
+                   const std::vector<int32> &row_offsets,
+                   const std::vector<int32> &col_indexes,
+                   const std::vector<Real> &values);
+
   /// Select a subset of the rows of a CuSparseMatrix.
   /// Sets *this to only the rows of 'smat_other' that are listed
   /// in 'row_indexes'.
@@ -0,0 +1,100 @@
+// cudamatrix/cu-stream.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cudamatrix/cu-stream.h"
+#include "cudamatrix/cu-common.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+
+#if HAVE_CUDA == 1
+
+CuStream::CuStream(): stream_(0), created_(false) { }
+
+cudaStream_t CuStream::Stream() const {
+  if (!created_) {
+    CU_SAFE_CALL(cudaStreamCreateWithFlags(&stream_, cudaStreamNonBlocking));
+    created_ = true;
+  }
+  return stream_;
+}
+
+void CuStream::Synchronize() const {
+  if (created_)
+    CU_SAFE_CALL(cudaStreamSynchronize(stream_));
+}
+
+CuStream::~CuStream() {
+  if (created_)
+    cudaStreamDestroy(stream_);  // waits for the work queued on it.
+}
+
+CuEvent::CuEvent(): event_(0), created_(false) { }
+
+void CuEvent::Record(const CuStream *stream) {
+  if (!CuDevice::Instantiate().Enabled())
+    return;
+  if (!created_) {
+    CU_SAFE_CALL(cudaEventCreateWithFlags(&event_, cudaEventDisableTiming));
+    created_ = true;
+  }
+  CU_SAFE_CALL(cudaEventRecord(event_, stream != NULL ? stream->Stream() :
+                               GetCudaStream()));
+}
+
+void CuEvent::StreamWait(const CuStream *stream) const {
+  if (created_)
+    CU_SAFE_CALL(cudaStreamWaitEvent(stream != NULL ? stream->Stream() :
+                                     GetCudaStream(), event_, 0));
+}
+
+void CuEvent::Synchronize() const {
+  if (created_)
+    CU_SAFE_CALL(cudaEventSynchronize(event_));
+}
+
+bool CuEvent::Done() const {
+  if (!created_)
+    return true;
+  cudaError_t e = cudaEventQuery(event_);
+  if (e == cudaErrorNotReady)
+    return false;
+  CU_SAFE_CALL(e);
+  return true;
+}
+
+CuEvent::~CuEvent() {
+  if (created_)
+    cudaEventDestroy(event_);
+}
+
+#else  // HAVE_CUDA
+
+CuStream::CuStream() { }
+void CuStream::Synchronize() const { }
+CuStream::~CuStream() { }
+
+CuEvent::CuEvent() { }
+void CuEvent::Record(const CuStream *stream) { }
+void CuEvent::StreamWait(const CuStream *stream) const { }
+void CuEvent::Synchronize() const { }
+bool CuEvent::Done() const { return true; }
+CuEvent::~CuEvent() { }
+
+#endif  // HAVE_CUDA
+
+}  // namespace kaldi
@@ -0,0 +1,112 @@
+// cudamatrix/cu-stream.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_CUDAMATRIX_CU_STREAM_H_
+#define KALDI_CUDAMATRIX_CU_STREAM_H_
+
+#if HAVE_CUDA == 1
+#include <cuda_runtime_api.h>
+#endif
+
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/**
+   This file provides explicit CUDA streams and events, for use with the
+   asynchronous copy functions such as CuMatrixBase::CopyFromMatAsync() and
+   CuMatrixBase::CopyToMatAsync().  Normally all the GPU work of a thread is
+   queued on one stream (see GetCudaStream()), so a copy between the CPU and
+   the GPU cannot overlap with kernels of the same thread; queuing the copy on
+   a CuStream of its own lets it overlap, and a CuEvent makes the kernels that
+   need the data wait for it:
+
+   \code
+     CuStream copy_stream;
+     CuEvent copied;
+     PinnedMatrix<BaseFloat> staging(...);  // filled on the CPU.
+     next_input.CopyFromMatAsync(staging, &copy_stream);
+     copied.Record(&copy_stream);
+     ... kernels on this thread's stream, which run during the copy ...
+     copied.StreamWait();  // later kernels of this thread wait for the copy.
+     ... kernels that use next_input ...
+     copied.Synchronize();  // before 'staging' may be changed.
+   \endcode
+
+   Streams and events are created when first used, so they may be constructed
+   before the GPU is selected.  If we did not compile for CUDA, or the GPU is
+   not enabled, the asynchronous functions are synchronous and the functions of
+   these classes do nothing.
+*/
+
+class CuStream {
+ public:
+  CuStream();
+
+  /// Waits on the CPU until all the work queued on this stream has finished.
+  void Synchronize() const;
+
+  ~CuStream();
+
+#if HAVE_CUDA == 1
+  /// Returns the CUDA stream, creating it if needed; it is a non-blocking
+  /// stream, i.e. it does not synchronize with the legacy default stream.
+  cudaStream_t Stream() const;
+#endif
+
+ private:
+#if HAVE_CUDA == 1
+  mutable cudaStream_t stream_;
+  mutable bool created_;
+#endif
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CuStream);
+};
+
+
+class CuEvent {
+ public:
+  CuEvent();
+
+  /// Records the event on 'stream', or on the calling thread's stream (see
+  /// GetCudaStream()) if it is NULL: it completes when the work queued on that
+  /// stream so far has finished.
+  void Record(const CuStream *stream = NULL);
+
+  /// Makes the work queued on 'stream' (or the calling thread's stream, if it
+  /// is NULL) from now on wait until the event has completed, without waiting
+  /// on the CPU.
+  void StreamWait(const CuStream *stream = NULL) const;
+
+  /// Waits on the CPU until the event has completed.
+  void Synchronize() const;
+
+  /// Returns true if the event has completed, or was never recorded.
+  bool Done() const;
+
+  ~CuEvent();
+
+ private:
+#if HAVE_CUDA == 1
+  cudaEvent_t event_;
+  bool created_;
+#endif
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CuEvent);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_CUDAMATRIX_CU_STREAM_H_
@@ -41,7 +41,7 @@ class CuValue {
     if (CuDevice::Instantiate().Enabled()) {
       CU_SAFE_CALL(
         cudaMemcpyAsync(data_, other.data_, sizeof(Real), 
-                        cudaMemcpyDeviceToDevice, cudaStreamPerThread));
+                        cudaMemcpyDeviceToDevice, GetCudaStream()));
       return *this;
     } else
 #endif
@@ -55,8 +55,8 @@ class CuValue {
 #if HAVE_CUDA == 1
     if (CuDevice::Instantiate().Enabled()) {
       CU_SAFE_CALL(cudaMemcpyAsync(data_, &r, sizeof(Real), 
-            cudaMemcpyHostToDevice, cudaStreamPerThread));
-      CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+            cudaMemcpyHostToDevice, GetCudaStream()));
+      CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
       return r;
     } else
 #endif
@@ -75,8 +75,8 @@ class CuValue {
   if (CuDevice::Instantiate().Enabled()) {
     Real value;
     CU_SAFE_CALL(cudaMemcpyAsync(&value, data_, sizeof(Real), 
-                 cudaMemcpyDeviceToHost, cudaStreamPerThread));
-    CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+                 cudaMemcpyDeviceToHost, GetCudaStream()));
+    CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
     return value;
   } else
 #endif
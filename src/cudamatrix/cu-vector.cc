@@ -38,7 +38,9 @@
 #include "cudamatrix/cu-tp-matrix.h"
 #include "cudamatrix/cu-sp-matrix.h"
 #include "cudamatrix/cu-sparse-matrix.h"
+#include "cudamatrix/cu-stream.h"
 #include "cudamatrix/cublas-wrappers.h"
+#include "matrix/cpu-allocator.h"
 
 namespace kaldi {
 
@@ -170,14 +172,14 @@ void CuVectorBase<Real>::CopyRowsFromMat(const CuMatrixBase<Real> &mat) {
     if (mat.Stride() == mat.NumCols() && mat.NumRows() != 0) {
       CU_SAFE_CALL(
         cudaMemcpyAsync(data_, mat.Data(), sizeof(Real)*dim_,
-                        cudaMemcpyDeviceToDevice, cudaStreamPerThread));
+                        cudaMemcpyDeviceToDevice, GetCudaStream()));
     } else {
       Real* vec_data = data_;
       for (MatrixIndexT r = 0; r < mat.NumRows(); r++) {
         CU_SAFE_CALL(cudaMemcpyAsync(vec_data, mat.RowData(r),
                                      sizeof(Real) * mat.NumCols(),
                                      cudaMemcpyDeviceToDevice,
-                                     cudaStreamPerThread));
+                                     GetCudaStream()));
         vec_data += mat.NumCols();
       }
     }
@@ -223,17 +225,17 @@ void CuVectorBase<Real>::CopyRowsFromMat(const MatrixBase<Real> &mat) {
     CuTimer tim;
     if (mat.Stride() == mat.NumCols()) {
       CU_SAFE_CALL(cudaMemcpyAsync(data_, mat.Data(), sizeof(Real)*dim_,
-                              cudaMemcpyHostToDevice, cudaStreamPerThread));
+                              cudaMemcpyHostToDevice, GetCudaStream()));
     } else {
       Real* vec_data = data_;
       for (MatrixIndexT r = 0; r < mat.NumRows(); r++) {
         CU_SAFE_CALL(cudaMemcpyAsync(vec_data, mat.RowData(r),
                                 sizeof(Real) * mat.NumCols(),
-                                cudaMemcpyHostToDevice, cudaStreamPerThread));
+                                cudaMemcpyHostToDevice, GetCudaStream()));
         vec_data += mat.NumCols();
       }
     }
-    CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+    CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
     CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
@@ -253,18 +255,18 @@ void MatrixBase<Real>::CopyRowsFromVec(const CuVectorBase<Real> &v) {
       CU_SAFE_CALL(cudaMemcpyAsync(data_, v.Data(),
                               sizeof(Real)*v.Dim(),
                               cudaMemcpyDeviceToHost,
-                              cudaStreamPerThread));
+                              GetCudaStream()));
     } else {
       const Real* vec_data = v.Data();
       for (MatrixIndexT r = 0; r < NumRows(); r++) {
         CU_SAFE_CALL(cudaMemcpyAsync(RowData(r), vec_data,
                                 sizeof(Real) * NumCols(),
                                 cudaMemcpyDeviceToHost,
-                                cudaStreamPerThread));
+                                GetCudaStream()));
         vec_data += NumCols();
       }
     }
-    CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+    CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
     CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
@@ -913,8 +915,8 @@ void CuVectorBase<Real>::CopyFromVec(const VectorBase<OtherReal> &src) {
       if (dim_ == 0) return;
       CuTimer tim;
       CU_SAFE_CALL(cudaMemcpyAsync(data_, src.Data(), src.Dim()*sizeof(Real), 
-                                   cudaMemcpyHostToDevice, cudaStreamPerThread));
-      CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+                                   cudaMemcpyHostToDevice, GetCudaStream()));
+      CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
       CuDevice::Instantiate().AccuProfile("CuVector::CopyFromVecH2D", tim);
     }
   } else
@@ -947,8 +949,8 @@ void CuVectorBase<Real>::CopyToVec(VectorBase<OtherReal> *dst) const {
       CuTimer tim;
       CU_SAFE_CALL(cudaMemcpyAsync(dst->Data(), this->data_,
                               sizeof(Real) * dim_, cudaMemcpyDeviceToHost,
-                              cudaStreamPerThread));
-      CU_SAFE_CALL(cudaStreamSynchronize(cudaStreamPerThread));
+                              GetCudaStream()));
+      CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
       CuDevice::Instantiate().AccuProfile(__func__, tim);
     }
   } else
@@ -959,6 +961,47 @@ void CuVectorBase<Real>::CopyToVec(VectorBase<OtherReal> *dst) const {
 }
 
 
+template<typename Real>
+void CuVectorBase<Real>::CopyFromVecAsync(const VectorBase<Real> &src,
+                                          const CuStream *stream) {
+  KALDI_ASSERT(src.Dim() == dim_);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    if (dim_ == 0) return;
+    CuTimer tim;
+    CU_SAFE_CALL(cudaMemcpyAsync(data_, src.Data(), dim_ * sizeof(Real),
+                                 cudaMemcpyHostToDevice,
+                                 stream != NULL ? stream->Stream() :
+                                 GetCudaStream()));
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    Vec().CopyFromVec(src);
+  }
+}
+
+template<typename Real>
+void CuVectorBase<Real>::CopyToVecAsync(VectorBase<Real> *dst,
+                                        const CuStream *stream) const {
+  KALDI_ASSERT(dst->Dim() == dim_);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    if (dim_ == 0) return;
+    CuTimer tim;
+    CU_SAFE_CALL(cudaMemcpyAsync(dst->Data(), data_, dim_ * sizeof(Real),
+                                 cudaMemcpyDeviceToHost,
+                                 stream != NULL ? stream->Stream() :
+                                 GetCudaStream()));
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    dst->CopyFromVec(Vec());
+  }
+}
+
+
 template<typename Real>
 void CuVector<Real>::Read(std::istream &is, bool binary) {
   Vector<Real> temp;
@@ -1067,7 +1110,7 @@ void CuVector<Real>::Destroy() {
   } else
 #endif
   {
-    if (this->data_ != NULL) KALDI_MEMALIGN_FREE(this->data_);
+    if (this->data_ != NULL) CpuFree(this->data_);
   }
   this->data_ = NULL;
   this->dim_ = 0;
@@ -1083,7 +1126,7 @@ void CuVectorBase<Real>::CopyFromVec(const CuVectorBase<Real> &src) {
     CuTimer tim;
     CU_SAFE_CALL(
       cudaMemcpyAsync(data_, src.data_, src.dim_ * sizeof(Real), 
-                      cudaMemcpyDeviceToDevice, cudaStreamPerThread));
+                      cudaMemcpyDeviceToDevice, GetCudaStream()));
     CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
@@ -1103,7 +1146,7 @@ void CuVectorBase<Real>::SetZero() {
     KALDI_ASSERT(data_!=NULL);
     CuTimer tim;
     CU_SAFE_CALL(cudaMemsetAsync(data_, 0, dim_*sizeof(Real),
-          cudaStreamPerThread));
+          GetCudaStream()));
     CuDevice::Instantiate().AccuProfile("CuVector::SetZero", tim);
   } else
 #endif
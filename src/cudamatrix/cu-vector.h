@@ -87,6 +87,13 @@ class CuVectorBase {
   template<typename OtherReal>
   void CopyToVec(VectorBase<OtherReal> *dst) const;
 
+  /// Asynchronous versions of CopyFromVec() and CopyToVec(); see
+  /// CuMatrixBase::CopyFromMatAsync() for what this means.
+  void CopyFromVecAsync(const VectorBase<Real> &src,
+                        const CuStream *stream = NULL);
+  void CopyToVecAsync(VectorBase<Real> *dst,
+                      const CuStream *stream = NULL) const;
+
   void CopyRowsFromMat(const CuMatrixBase<Real> &M);
 
   void CopyRowsFromMat(const MatrixBase<Real> &M);
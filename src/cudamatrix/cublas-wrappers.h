@@ -63,6 +63,26 @@ inline cublasStatus_t cublas_gemmBatched(
     double *C[], int ldc, int batchCount) {
   return cublasDgemmBatched(handle, transa, transb, m, n, k, &alpha, A, lda, B, ldb, &beta, C, ldc, batchCount);
 }
+inline cublasStatus_t cublas_gemmStridedBatched(
+    cublasHandle_t handle, cublasOperation_t transa,
+    cublasOperation_t transb, int m, int n, int k, float alpha,
+    const float *A, int lda, long long int strideA, const float *B, int ldb,
+    long long int strideB, float beta, float *C, int ldc,
+    long long int strideC, int batchCount) {
+  return cublasSgemmStridedBatched(handle, transa, transb, m, n, k, &alpha,
+                                   A, lda, strideA, B, ldb, strideB, &beta,
+                                   C, ldc, strideC, batchCount);
+}
+inline cublasStatus_t cublas_gemmStridedBatched(
+    cublasHandle_t handle, cublasOperation_t transa,
+    cublasOperation_t transb, int m, int n, int k, double alpha,
+    const double *A, int lda, long long int strideA, const double *B, int ldb,
+    long long int strideB, double beta, double *C, int ldc,
+    long long int strideC, int batchCount) {
+  return cublasDgemmStridedBatched(handle, transa, transb, m, n, k, &alpha,
+                                   A, lda, strideA, B, ldb, strideB, &beta,
+                                   C, ldc, strideC, batchCount);
+}
 inline cublasStatus_t cublas_trsm(cublasHandle_t handle, int m, int n,
                                   float alpha, const float* A, int lda,
                                   float* B, int ldb) {
@@ -280,6 +300,99 @@ inline cusparseStatus_t cusparse_csrmm2(cusparseHandle_t handle,
                          csrValA, csrRowPtrA, csrColIndA, B, ldb, beta, C, ldc);
 }
 
+#if CUDA_VERSION >= 11000
+// cublas_gemm_half: like cublas_gemm, but A and B are stored in half precision
+// (data_type CUDA_R_16F or CUDA_R_16BF) and C in single precision; the products
+// are accumulated in single precision, on tensor cores if there are any.
+inline cublasStatus_t cublas_gemm_half(cublasHandle_t handle,
+                                       cublasOperation_t transa,
+                                       cublasOperation_t transb, int m, int n,
+                                       int k, float alpha, const void *A,
+                                       int lda, const void *B, int ldb,
+                                       cudaDataType_t data_type, float beta,
+                                       float *C, int ldc) {
+  return cublasGemmEx(handle, transa, transb, m, n, k, &alpha, A, data_type,
+                      lda, B, data_type, ldb, &beta, C, CUDA_R_32F, ldc,
+                      CUBLAS_COMPUTE_32F, CUBLAS_GEMM_DEFAULT_TENSOR_OP);
+}
+#endif  // CUDA_VERSION >= 11000
+
+#if CUDA_VERSION >= 9010
+// cusolver_syevj: symmetric eigenvalue decomposition (Jacobi method).
+inline cusolverStatus_t cusolver_syevj_bufferSize(cusolverDnHandle_t handle,
+                                                  cusolverEigMode_t jobz,
+                                                  cublasFillMode_t uplo, int n,
+                                                  const float *A, int lda,
+                                                  const float *W, int *lwork,
+                                                  syevjInfo_t params) {
+  return cusolverDnSsyevj_bufferSize(handle, jobz, uplo, n, A, lda, W, lwork,
+                                     params);
+}
+inline cusolverStatus_t cusolver_syevj_bufferSize(cusolverDnHandle_t handle,
+                                                  cusolverEigMode_t jobz,
+                                                  cublasFillMode_t uplo, int n,
+                                                  const double *A, int lda,
+                                                  const double *W, int *lwork,
+                                                  syevjInfo_t params) {
+  return cusolverDnDsyevj_bufferSize(handle, jobz, uplo, n, A, lda, W, lwork,
+                                     params);
+}
+inline cusolverStatus_t cusolver_syevj(cusolverDnHandle_t handle,
+                                       cusolverEigMode_t jobz,
+                                       cublasFillMode_t uplo, int n, float *A,
+                                       int lda, float *W, float *work,
+                                       int lwork, int *info,
+                                       syevjInfo_t params) {
+  return cusolverDnSsyevj(handle, jobz, uplo, n, A, lda, W, work, lwork, info,
+                          params);
+}
+inline cusolverStatus_t cusolver_syevj(cusolverDnHandle_t handle,
+                                       cusolverEigMode_t jobz,
+                                       cublasFillMode_t uplo, int n, double *A,
+                                       int lda, double *W, double *work,
+                                       int lwork, int *info,
+                                       syevjInfo_t params) {
+  return cusolverDnDsyevj(handle, jobz, uplo, n, A, lda, W, work, lwork, info,
+                          params);
+}
+// cusolver_syevjBatched: as cusolver_syevj, for a batch of n x n matrices
+// stored lda * n elements apart; n must be at most 32.
+inline cusolverStatus_t cusolver_syevjBatched_bufferSize(
+    cusolverDnHandle_t handle, cusolverEigMode_t jobz, cublasFillMode_t uplo,
+    int n, const float *A, int lda, const float *W, int *lwork,
+    syevjInfo_t params, int batchSize) {
+  return cusolverDnSsyevjBatched_bufferSize(handle, jobz, uplo, n, A, lda, W,
+                                            lwork, params, batchSize);
+}
+inline cusolverStatus_t cusolver_syevjBatched_bufferSize(
+    cusolverDnHandle_t handle, cusolverEigMode_t jobz, cublasFillMode_t uplo,
+    int n, const double *A, int lda, const double *W, int *lwork,
+    syevjInfo_t params, int batchSize) {
+  return cusolverDnDsyevjBatched_bufferSize(handle, jobz, uplo, n, A, lda, W,
+                                            lwork, params, batchSize);
+}
+inline cusolverStatus_t cusolver_syevjBatched(cusolverDnHandle_t handle,
+                                              cusolverEigMode_t jobz,
+                                              cublasFillMode_t uplo, int n,
+                                              float *A, int lda, float *W,
+                                              float *work, int lwork,
+                                              int *info, syevjInfo_t params,
+                                              int batchSize) {
+  return cusolverDnSsyevjBatched(handle, jobz, uplo, n, A, lda, W, work, lwork,
+                                 info, params, batchSize);
+}
+inline cusolverStatus_t cusolver_syevjBatched(cusolverDnHandle_t handle,
+                                              cusolverEigMode_t jobz,
+                                              cublasFillMode_t uplo, int n,
+                                              double *A, int lda, double *W,
+                                              double *work, int lwork,
+                                              int *info, syevjInfo_t params,
+                                              int batchSize) {
+  return cusolverDnDsyevjBatched(handle, jobz, uplo, n, A, lda, W, work, lwork,
+                                 info, params, batchSize);
+}
+#endif  // CUDA_VERSION >= 9010
+
 
 #endif
 }
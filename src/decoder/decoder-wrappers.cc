@@ -20,6 +20,7 @@
 #include "decoder/decoder-wrappers.h"
 #include "decoder/faster-decoder.h"
 #include "decoder/lattice-faster-decoder.h"
+#include "decoder/linear-graph-aligner.h"
 #include "decoder/grammar-fst.h"
 #include "lat/lattice-functions.h"
 
@@ -295,7 +296,7 @@ bool DecodeUtteranceLatticeFaster(
   return true;
 }
 
-// Instantiate the template above for the two required FST types.
+// Instantiate the template above for the required FST types.
 template bool DecodeUtteranceLatticeFaster(
     LatticeFasterDecoderTpl<fst::Fst<fst::StdArc> > &decoder,
     DecodableInterface &decodable,
@@ -326,6 +327,51 @@ template bool DecodeUtteranceLatticeFaster(
     LatticeWriter *lattice_writer,
     double *like_ptr);
 
+template bool DecodeUtteranceLatticeFaster(
+    LatticeFasterDecoderTpl<fst::CsrFst> &decoder,
+    DecodableInterface &decodable,
+    const TransitionModel &trans_model,
+    const fst::SymbolTable *word_syms,
+    std::string utt,
+    double acoustic_scale,
+    bool determinize,
+    bool allow_partial,
+    Int32VectorWriter *alignment_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *like_ptr);
+
+template bool DecodeUtteranceLatticeFaster(
+    LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>> &decoder,
+    DecodableInterface &decodable,
+    const TransitionModel &trans_model,
+    const fst::SymbolTable *word_syms,
+    std::string utt,
+    double acoustic_scale,
+    bool determinize,
+    bool allow_partial,
+    Int32VectorWriter *alignment_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *like_ptr);
+
+template bool DecodeUtteranceLatticeFaster(
+    LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>> &decoder,
+    DecodableInterface &decodable,
+    const TransitionModel &trans_model,
+    const fst::SymbolTable *word_syms,
+    std::string utt,
+    double acoustic_scale,
+    bool determinize,
+    bool allow_partial,
+    Int32VectorWriter *alignment_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *like_ptr);
+
 
 // Takes care of output.  Returns true on success.
 bool DecodeUtteranceLatticeSimple(
@@ -456,37 +502,46 @@ void ModifyGraphForCarefulAlignment(
 }
 
 
-void AlignUtteranceWrapper(
-    const AlignConfig &config,
-    const std::string &utt,
-    BaseFloat acoustic_scale,  // affects scores written to scores_writer, if
-                               // present
-    fst::VectorFst<fst::StdArc> *fst,  // non-const in case config.careful ==
-                                       // true.
-    DecodableInterface *decodable,  // not const but is really an input.
-    Int32VectorWriter *alignment_writer,
-    BaseFloatWriter *scores_writer,
-    int32 *num_done,
-    int32 *num_error,
-    int32 *num_retried,
-    double *tot_like,
-    int64 *frame_count,
-    BaseFloatVectorWriter *per_frame_acwt_writer) {
-
+bool AlignUtterance(const AlignConfig &config,
+                    const std::string &utt,
+                    fst::VectorFst<fst::StdArc> *fst,
+                    DecodableInterface *decodable,
+                    std::vector<int32> *alignment,
+                    BaseFloat *cost,
+                    Vector<BaseFloat> *per_frame_acoustic_costs,
+                    bool *retried) {
   if ((config.retry_beam != 0 && config.retry_beam <= config.beam) ||
       config.beam <= 0.0) {
     KALDI_ERR << "Beams do not make sense: beam " << config.beam
               << ", retry-beam " << config.retry_beam;
   }
+  *retried = false;
 
   if (fst->Start() == fst::kNoStateId) {
     KALDI_WARN << "Empty decoding graph for " << utt;
-    if (num_error != NULL) (*num_error)++;
-    return;
+    return false;
   }
 
-  if (config.careful)
+  if (config.careful) {
     ModifyGraphForCarefulAlignment(fst);
+  } else if (config.linear_aligner) {
+    LinearGraphAligner aligner;
+    if (aligner.Init(*fst)) {
+      bool ans = aligner.Align(decodable, config.beam, alignment, cost,
+                               per_frame_acoustic_costs);
+      if (!ans && config.retry_beam != 0.0) {
+        *retried = true;
+        KALDI_WARN << "Retrying utterance " << utt << " with beam "
+                   << config.retry_beam;
+        ans = aligner.Align(decodable, config.retry_beam, alignment, cost,
+                            per_frame_acoustic_costs);
+      }
+      if (!ans)
+        KALDI_WARN << "Did not successfully decode file " << utt << ", len = "
+                   << decodable->NumFramesReady();
+      return ans;
+    }
+  }
 
   FasterDecoderOptions decode_opts;
   decode_opts.beam = config.beam;
@@ -497,7 +552,7 @@ void AlignUtteranceWrapper(
   bool ans = decoder.ReachedFinal();  // consider only final states.
 
   if (!ans && config.retry_beam != 0.0) {
-    if (num_retried != NULL) (*num_retried)++;
+    *retried = true;
     KALDI_WARN << "Retrying utterance " << utt << " with beam "
                << config.retry_beam;
     decode_opts.beam = config.retry_beam;
@@ -509,24 +564,57 @@ void AlignUtteranceWrapper(
   if (!ans) {  // Still did not reach final state.
     KALDI_WARN << "Did not successfully decode file " << utt << ", len = "
                << decodable->NumFramesReady();
-    if (num_error != NULL) (*num_error)++;
-    return;
+    return false;
   }
 
   fst::VectorFst<LatticeArc> decoded;  // linear FST.
   decoder.GetBestPath(&decoded);
   if (decoded.NumStates() == 0) {
     KALDI_WARN << "Error getting best path from decoder (likely a bug)";
-    if (num_error != NULL) (*num_error)++;
-    return;
+    return false;
   }
 
-  std::vector<int32> alignment;
   std::vector<int32> words;
   LatticeWeight weight;
+  GetLinearSymbolSequence(decoded, alignment, &words, &weight);
+  *cost = weight.Value1() + weight.Value2();
+
+  if (per_frame_acoustic_costs != NULL)
+    GetPerFrameAcousticCosts(decoded, per_frame_acoustic_costs);
+  return true;
+}
 
-  GetLinearSymbolSequence(decoded, &alignment, &words, &weight);
-  BaseFloat like = -(weight.Value1()+weight.Value2()) / acoustic_scale;
+void AlignUtteranceWrapper(
+    const AlignConfig &config,
+    const std::string &utt,
+    BaseFloat acoustic_scale,  // affects scores written to scores_writer, if
+                               // present
+    fst::VectorFst<fst::StdArc> *fst,  // non-const in case config.careful ==
+                                       // true.
+    DecodableInterface *decodable,  // not const but is really an input.
+    Int32VectorWriter *alignment_writer,
+    BaseFloatWriter *scores_writer,
+    int32 *num_done,
+    int32 *num_error,
+    int32 *num_retried,
+    double *tot_like,
+    int64 *frame_count,
+    BaseFloatVectorWriter *per_frame_acwt_writer) {
+  std::vector<int32> alignment;
+  BaseFloat cost;
+  Vector<BaseFloat> per_frame_loglikes;
+  bool want_per_frame = (per_frame_acwt_writer != NULL &&
+                         per_frame_acwt_writer->IsOpen()),
+      retried;
+  bool ans = AlignUtterance(config, utt, fst, decodable, &alignment, &cost,
+                            want_per_frame ? &per_frame_loglikes : NULL,
+                            &retried);
+  if (retried && num_retried != NULL) (*num_retried)++;
+  if (!ans) {
+    if (num_error != NULL) (*num_error)++;
+    return;
+  }
+  BaseFloat like = -cost / acoustic_scale;
 
   if (num_done != NULL) (*num_done)++;
   if (tot_like != NULL) (*tot_like) += like;
@@ -536,11 +624,9 @@ void AlignUtteranceWrapper(
     alignment_writer->Write(utt, alignment);
 
   if (scores_writer != NULL && scores_writer->IsOpen())
-    scores_writer->Write(utt, -(weight.Value1()+weight.Value2()));
+    scores_writer->Write(utt, -cost);
 
-  Vector<BaseFloat> per_frame_loglikes;
-  if (per_frame_acwt_writer != NULL && per_frame_acwt_writer->IsOpen()) {
-    GetPerFrameAcousticCosts(decoded, &per_frame_loglikes);
+  if (want_per_frame) {
     per_frame_loglikes.Scale(-1 / acoustic_scale);
     per_frame_acwt_writer->Write(utt, per_frame_loglikes);
   }
@@ -35,8 +35,10 @@ struct AlignConfig {
   BaseFloat beam;
   BaseFloat retry_beam;
   bool careful;
+  bool linear_aligner;
 
-  AlignConfig(): beam(200.0), retry_beam(0.0), careful(false) { }
+  AlignConfig(): beam(200.0), retry_beam(0.0), careful(false),
+                 linear_aligner(true) { }
 
   void Register(OptionsItf *opts) {
     opts->Register("beam", &beam, "Decoding beam used in alignment");
@@ -45,10 +47,32 @@ struct AlignConfig {
     opts->Register("careful", &careful,
                    "If true, do 'careful' alignment, which is better at detecting "
                    "alignment failure (involves loop to start of decoding graph).");
+    opts->Register("linear-aligner", &linear_aligner,
+                   "If true, align graphs that are a simple chain (no "
+                   "alternative pronunciations or optional silence) with "
+                   "LinearGraphAligner, which is much faster than the general "
+                   "decoder and gives the same result.  Not used with "
+                   "--careful.");
   }
 };
 
 
+/// AlignUtterance is the core of AlignUtteranceWrapper(), for programs that
+/// write the output themselves (e.g. because they align in several threads).
+/// It returns false (after printing a warning) if the alignment failed.  On
+/// success it outputs the alignment and the total cost of the best path
+/// (graph plus scaled acoustic cost) to 'alignment' and 'cost', and if
+/// 'per_frame_acoustic_costs' is non-NULL, the scaled acoustic cost of each
+/// frame.  '*retried' is set to whether the retry-beam was used.
+bool AlignUtterance(const AlignConfig &config,
+                    const std::string &utt,
+                    fst::VectorFst<fst::StdArc> *fst,
+                    DecodableInterface *decodable,
+                    std::vector<int32> *alignment,
+                    BaseFloat *cost,
+                    Vector<BaseFloat> *per_frame_acoustic_costs,
+                    bool *retried);
+
 /// AlignUtteranceWapper is a wrapper for alignment code used in training, that
 /// is called from many different binaries, e.g. gmm-align, gmm-align-compiled,
 /// sgmm-align, etc.  The writers for alignments and words will only be written
@@ -96,9 +120,14 @@ void ModifyGraphForCarefulAlignment(
 /// lattice_writer, else to compact_lattice_writer.  The writers for
 /// alignments and words will only be written to if they are open.
 ///
-/// Caution: this will only link correctly if FST is either fst::Fst<fst::StdArc>,
-/// or fst::GrammarFst, as the template function is defined in the .cc file and
-/// only instantiated for those two types.
+/// Caution: this will only link correctly if FST is fst::Fst<fst::StdArc>,
+/// fst::ConstFst<fst::StdArc>, fst::VectorFst<fst::StdArc>, fst::GrammarFst or
+/// fst::CsrFst, as the template function is defined in the .cc file and only
+/// instantiated for those types.  Note: a decoder for fst::Fst<fst::StdArc>
+/// already decodes with the code for ConstFst or VectorFst if the FST is
+/// actually of one of those types (see
+/// LatticeFasterDecoderTpl::AdvanceDecoding()), so there is normally no need
+/// to use those types explicitly.
 template <typename FST>
 bool DecodeUtteranceLatticeFaster(
     LatticeFasterDecoderTpl<FST> &decoder, // not const but is really an input.
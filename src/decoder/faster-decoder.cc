@@ -25,7 +25,10 @@ namespace kaldi {
 
 FasterDecoder::FasterDecoder(const fst::Fst<fst::StdArc> &fst,
                              const FasterDecoderOptions &opts):
-    fst_(fst), config_(opts), num_frames_decoded_(-1) {
+    fst_(fst),
+    const_fst_(dynamic_cast<const fst::ConstFst<fst::StdArc>*>(&fst)),
+    vector_fst_(dynamic_cast<const fst::VectorFst<fst::StdArc>*>(&fst)),
+    config_(opts), num_frames_decoded_(-1) {
   KALDI_ASSERT(config_.hash_ratio >= 1.0);  // less doesn't make much sense.
   KALDI_ASSERT(config_.max_active > 1);
   KALDI_ASSERT(config_.min_active >= 0 && config_.min_active < config_.max_active);
@@ -219,6 +222,17 @@ void FasterDecoder::PossiblyResizeHash(size_t num_toks) {
 
 // ProcessEmitting returns the likelihood cutoff used.
 double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
+  if (const_fst_ != NULL)
+    return ProcessEmittingTpl(*const_fst_, decodable);
+  else if (vector_fst_ != NULL)
+    return ProcessEmittingTpl(*vector_fst_, decodable);
+  else
+    return ProcessEmittingTpl(fst_, decodable);
+}
+
+template <typename FST>
+double FasterDecoder::ProcessEmittingTpl(const FST &fst,
+                                         DecodableInterface *decodable) {
   int32 frame = num_frames_decoded_;
   Elem *last_toks = toks_.Clear();
   size_t tok_cnt;
@@ -239,7 +253,7 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
   if (best_elem) {
     StateId state = best_elem->key;
     Token *tok = best_elem->val;
-    for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
+    for (fst::ArcIterator<FST> aiter(fst, state);
          !aiter.Done();
          aiter.Next()) {
       const Arc &arc = aiter.Value();
@@ -265,7 +279,7 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
     if (tok->cost_ < weight_cutoff) {  // not pruned.
       // np++;
       KALDI_ASSERT(state == tok->arc_.nextstate);
-      for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
+      for (fst::ArcIterator<FST> aiter(fst, state);
            !aiter.Done();
            aiter.Next()) {
         Arc arc = aiter.Value();
@@ -297,8 +311,18 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
   return next_weight_cutoff;
 }
 
-// TODO: first time we go through this, could avoid using the queue.
 void FasterDecoder::ProcessNonemitting(double cutoff) {
+  if (const_fst_ != NULL)
+    ProcessNonemittingTpl(*const_fst_, cutoff);
+  else if (vector_fst_ != NULL)
+    ProcessNonemittingTpl(*vector_fst_, cutoff);
+  else
+    ProcessNonemittingTpl(fst_, cutoff);
+}
+
+// TODO: first time we go through this, could avoid using the queue.
+template <typename FST>
+void FasterDecoder::ProcessNonemittingTpl(const FST &fst, double cutoff) {
   // Processes nonemitting arcs for one frame.
   KALDI_ASSERT(queue_.empty());
   for (const Elem *e = toks_.GetList(); e != NULL;  e = e->tail)
@@ -313,7 +337,7 @@ void FasterDecoder::ProcessNonemitting(double cutoff) {
       continue;
     }
     KALDI_ASSERT(tok != NULL && state == tok->arc_.nextstate);
-    for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
+    for (fst::ArcIterator<FST> aiter(fst, state);
          !aiter.Done();
          aiter.Next()) {
       const Arc &arc = aiter.Value();
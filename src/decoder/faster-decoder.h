@@ -164,11 +164,22 @@ class FasterDecoder {
   // TODO: first time we go through this, could avoid using the queue.
   void ProcessNonemitting(double cutoff);
 
+  // The implementations of ProcessEmitting() and ProcessNonemitting(), with
+  // 'fst' being fst_ cast to its actual type FST if that is ConstFst or
+  // VectorFst, so that the arc iterators are not virtual and get inlined.
+  template <typename FST>
+  double ProcessEmittingTpl(const FST &fst, DecodableInterface *decodable);
+  template <typename FST>
+  void ProcessNonemittingTpl(const FST &fst, double cutoff);
+
   // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
   // more than one list (e.g. for current and previous frames), but only one of
   // them at a time can be indexed by StateId.
   HashList<StateId, Token*> toks_;
   const fst::Fst<fst::StdArc> &fst_;
+  // fst_ cast to ConstFst or VectorFst if it is one of those, else NULL.
+  const fst::ConstFst<fst::StdArc> *const_fst_;
+  const fst::VectorFst<fst::StdArc> *vector_fst_;
   FasterDecoderOptions config_;
   std::vector<const Elem* > queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
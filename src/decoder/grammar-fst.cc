@@ -17,12 +17,324 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <atomic>
+#include <mutex>
 #include "decoder/grammar-fst.h"
 #include "fstext/grammar-context-fst.h"
 
 namespace fst {
 
 
+/**
+   GrammarFst::ExpansionCache stores, for states that have arcs entering
+   user-defined nonterminals, the arcs of the expanded state.  These arcs only
+   depend on which FST the state is in (the top-level FST or one of ifsts_),
+   not on the FST instance: only the destination FST instance does, and that
+   is worked out separately by each GrammarFst.  So they can be shared between
+   all the instances of an FST, and all copies of the GrammarFst.
+
+   Find() is lock-free.  Expand() and Read(), which add entries, hold a mutex
+   and publish the entries with release semantics.  Entries are never removed
+   while the cache exists.
+ */
+class GrammarFst::ExpansionCache {
+ public:
+  struct Entry {
+    // The user-defined nonterminal (as numbered in phones.txt) and the
+    // return-state, i.e. the key into 'child_instances' of the instance
+    // that the state is in.
+    int32 nonterminal;
+    int32 return_state;
+    // The arcs of the expanded state (see ExpandedState::arcs).
+    std::shared_ptr<const std::vector<StdArc> > arcs;
+  };
+
+  // Note: 'fst' is only used to get the FSTs' sizes (and for a sanity check);
+  // no reference to it is kept.
+  explicit ExpansionCache(const GrammarFst &fst);
+
+  ~ExpansionCache();
+
+  // 'fst_index' is 0 for the top-level FST and i + 1 for ifsts_[i].  Returns
+  // the entry for state 'state_id' of that FST, or NULL if it has not been
+  // expanded yet.
+  inline const Entry *Find(int32 fst_index, BaseStateId state_id) const {
+    const std::atomic<const Entry*> *entries =
+        entries_[fst_index].load(std::memory_order_acquire);
+    if (entries == NULL)
+      return NULL;
+    return entries[state_id].load(std::memory_order_acquire);
+  }
+
+  // Returns the entry for state 'state_id' of the FST numbered 'fst_index',
+  // creating it first if needed.  'fst' is the GrammarFst on whose behalf we
+  // expand the state (any of the copies sharing this cache will do).
+  const Entry *Expand(const GrammarFst &fst, int32 fst_index,
+                      BaseStateId state_id);
+
+  void Write(std::ostream &os) const;
+
+  // Adds the entries written by Write() to this cache.
+  void Read(std::istream &is);
+
+ private:
+  // Returns the array of entries for this fst_index, allocating it first if
+  // needed.  Must be called with mutex_ held.
+  std::atomic<const Entry*> *GetEntries(int32 fst_index);
+
+  // Returns the map from left-context phone to the arc-index leaving the
+  // start state of ifsts_[ifst_index], which is set up on demand.  Will be
+  // empty if that FST is empty.  Must be called with mutex_ held (or from the
+  // constructor).
+  const std::unordered_map<int32, int32> &GetEntryArcs(const GrammarFst &fst,
+                                                       int32 ifst_index);
+
+  // num_states_[fst_index] is the number of states of the FST numbered
+  // fst_index.
+  std::vector<int32> num_states_;
+
+  // entries_[fst_index], if non-NULL, is an array of dimension
+  // num_states_[fst_index], containing the entries for the expanded states
+  // (NULL for states not expanded yet).
+  std::atomic<std::atomic<const Entry*>*> *entries_;
+
+  // entry_arcs_ has the same dimension as ifsts_; see GetEntryArcs().  We
+  // populate each entry_arcs_[i] only when it is first needed, so that
+  // initialization is cheap when there are a lot of nonterminals.
+  std::vector<std::unordered_map<int32, int32> > entry_arcs_;
+
+  mutable std::mutex mutex_;
+};
+
+
+GrammarFst::ExpansionCache::ExpansionCache(const GrammarFst &fst) {
+  int32 num_fsts = 1 + fst.ifsts_.size();
+  num_states_.resize(num_fsts);
+  num_states_[0] = fst.top_fst_->NumStates();
+  for (int32 i = 1; i < num_fsts; i++)
+    num_states_[i] = fst.ifsts_[i - 1].second->NumStates();
+  entries_ = new std::atomic<std::atomic<const Entry*>*>[num_fsts];
+  for (int32 i = 0; i < num_fsts; i++)
+    entries_[i].store(NULL, std::memory_order_relaxed);
+  entry_arcs_.resize(fst.ifsts_.size());
+  if (!fst.ifsts_.empty()) {
+    // We call this mostly so that if something is wrong with the input FSTs, the
+    // problem will be detected sooner rather than later.
+    // There would be no problem if we were to call GetEntryArcs(i)
+    // for all 0 <= i < ifsts_size(), but we choose to call it
+    // lazily on demand, to save startup time if the number of nonterminals
+    // is large.
+    GetEntryArcs(fst, 0);
+  }
+}
+
+GrammarFst::ExpansionCache::~ExpansionCache() {
+  for (size_t i = 0; i < num_states_.size(); i++) {
+    std::atomic<const Entry*> *entries =
+        entries_[i].load(std::memory_order_relaxed);
+    if (entries == NULL)
+      continue;
+    for (int32 s = 0; s < num_states_[i]; s++)
+      delete entries[s].load(std::memory_order_relaxed);
+    delete [] entries;
+  }
+  delete [] entries_;
+}
+
+std::atomic<const GrammarFst::ExpansionCache::Entry*>*
+GrammarFst::ExpansionCache::GetEntries(int32 fst_index) {
+  std::atomic<const Entry*> *entries =
+      entries_[fst_index].load(std::memory_order_relaxed);
+  if (entries == NULL) {
+    int32 num_states = num_states_[fst_index];
+    entries = new std::atomic<const Entry*>[num_states];
+    for (int32 s = 0; s < num_states; s++)
+      entries[s].store(NULL, std::memory_order_relaxed);
+    entries_[fst_index].store(entries, std::memory_order_release);
+  }
+  return entries;
+}
+
+const std::unordered_map<int32, int32>&
+GrammarFst::ExpansionCache::GetEntryArcs(const GrammarFst &fst,
+                                         int32 ifst_index) {
+  KALDI_ASSERT(static_cast<size_t>(ifst_index) < entry_arcs_.size());
+  std::unordered_map<int32, int32> &entry_arcs = entry_arcs_[ifst_index];
+  if (entry_arcs.empty()) {
+    const ConstFst<StdArc> &child_fst = *(fst.ifsts_[ifst_index].second);
+    if (child_fst.NumStates() != 0)  // else it's the empty FST.
+      fst.InitEntryOrReentryArcs(child_fst, child_fst.Start(),
+                                 fst.GetPhoneSymbolFor(kNontermBegin),
+                                 &entry_arcs);
+  }
+  return entry_arcs;
+}
+
+const GrammarFst::ExpansionCache::Entry*
+GrammarFst::ExpansionCache::Expand(const GrammarFst &fst, int32 fst_index,
+                                   BaseStateId state_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::atomic<const Entry*> *entries = GetEntries(fst_index);
+  const Entry *existing = entries[state_id].load(std::memory_order_relaxed);
+  if (existing != NULL)  // Another thread expanded it while we were waiting.
+    return existing;
+
+  const ConstFst<StdArc> &this_fst = (fst_index == 0 ? *(fst.top_fst_) :
+                                      *(fst.ifsts_[fst_index - 1].second));
+  ArcIterator<ConstFst<StdArc> > aiter(this_fst, state_id);
+
+  Entry *entry = new Entry;
+  entry->nonterminal = -1;  // We'll set it in the loop.
+  entry->return_state = -1;
+  std::vector<StdArc> *arcs = new std::vector<StdArc>();
+  entry->arcs.reset(arcs);
+
+  for (; !aiter.Done(); aiter.Next()) {
+    const StdArc &leaving_arc = aiter.Value();
+    int32 nonterminal, left_context_phone;
+    fst.DecodeSymbol(leaving_arc.ilabel, &nonterminal,
+                     &left_context_phone);
+    if (entry->nonterminal < 0) {
+      entry->nonterminal = nonterminal;
+      entry->return_state = leaving_arc.nextstate;
+    } else if (nonterminal != entry->nonterminal ||
+               leaving_arc.nextstate != entry->return_state) {
+      KALDI_ERR << "Same state leaves to different FST instances "
+          "(Did you use PrepareForGrammarFst()?)";
+    }
+    // Work out the ifst_index for this nonterminal.
+    std::unordered_map<int32, int32>::const_iterator iter =
+        fst.nonterminal_map_.find(nonterminal);
+    if (iter == fst.nonterminal_map_.end()) {
+      KALDI_ERR << "Nonterminal " << nonterminal << " was requested, but "
+          "there is no FST for it.";
+    }
+    int32 child_ifst_index = iter->second;
+    const ConstFst<StdArc> &child_fst = *(fst.ifsts_[child_ifst_index].second);
+    const std::unordered_map<int32, int32> &entry_arcs =
+        GetEntryArcs(fst, child_ifst_index);
+    if (entry_arcs.empty()) {
+      // This child-FST was the empty FST.  There are no arcs to expand.
+      continue;
+    }
+    // for explanation of cost_correction, see documentation for CombineArcs().
+    float num_entry_arcs = entry_arcs.size(),
+        cost_correction = -log(num_entry_arcs);
+
+    // Get the arc-index for the arc leaving the start-state of child FST that
+    // corresponds to this phonetic context.
+    std::unordered_map<int32, int32>::const_iterator entry_iter =
+        entry_arcs.find(left_context_phone);
+    if (entry_iter == entry_arcs.end()) {
+      KALDI_ERR << "FST for nonterminal " << nonterminal
+                << " does not have an entry point for left-context-phone "
+                << left_context_phone;
+    }
+    int32 arc_index = entry_iter->second;
+    ArcIterator<ConstFst<StdArc> > child_aiter(child_fst, child_fst.Start());
+    child_aiter.Seek(arc_index);
+    const StdArc &arriving_arc = child_aiter.Value();
+    StdArc arc;
+    CombineArcs(leaving_arc, arriving_arc, cost_correction, &arc);
+    arcs->push_back(arc);
+  }
+  entries[state_id].store(entry, std::memory_order_release);
+  return entry;
+}
+
+void GrammarFst::ExpansionCache::Write(std::ostream &os) const {
+  using namespace kaldi;
+  bool binary = true;
+  std::lock_guard<std::mutex> lock(mutex_);
+  int32 num_fsts = num_states_.size();
+  WriteToken(os, binary, "<GrammarFstExpansions>");
+  WriteBasicType(os, binary, num_fsts);
+  for (int32 i = 0; i < num_fsts; i++) {
+    int32 num_states = num_states_[i], num_entries = 0;
+    WriteBasicType(os, binary, num_states);
+    const std::atomic<const Entry*> *entries =
+        entries_[i].load(std::memory_order_relaxed);
+    if (entries != NULL)
+      for (int32 s = 0; s < num_states; s++)
+        if (entries[s].load(std::memory_order_relaxed) != NULL)
+          num_entries++;
+    WriteBasicType(os, binary, num_entries);
+    if (num_entries == 0)
+      continue;
+    for (int32 s = 0; s < num_states; s++) {
+      const Entry *entry = entries[s].load(std::memory_order_relaxed);
+      if (entry == NULL)
+        continue;
+      int32 num_arcs = entry->arcs->size();
+      WriteBasicType(os, binary, s);
+      WriteBasicType(os, binary, entry->nonterminal);
+      WriteBasicType(os, binary, entry->return_state);
+      WriteBasicType(os, binary, num_arcs);
+      for (int32 a = 0; a < num_arcs; a++) {
+        const StdArc &arc = (*(entry->arcs))[a];
+        WriteBasicType(os, binary, arc.ilabel);
+        WriteBasicType(os, binary, arc.olabel);
+        WriteBasicType(os, binary, arc.weight.Value());
+        WriteBasicType(os, binary, arc.nextstate);
+      }
+    }
+  }
+  WriteToken(os, binary, "</GrammarFstExpansions>");
+}
+
+void GrammarFst::ExpansionCache::Read(std::istream &is) {
+  using namespace kaldi;
+  bool binary = true;
+  std::lock_guard<std::mutex> lock(mutex_);
+  int32 num_fsts;
+  ExpectToken(is, binary, "<GrammarFstExpansions>");
+  ReadBasicType(is, binary, &num_fsts);
+  if (num_fsts != static_cast<int32>(num_states_.size()))
+    KALDI_ERR << "Expansions were computed for a GrammarFst with "
+              << num_fsts << " FSTs, but this one has " << num_states_.size();
+  for (int32 i = 0; i < num_fsts; i++) {
+    int32 num_states, num_entries;
+    ReadBasicType(is, binary, &num_states);
+    if (num_states != num_states_[i])
+      KALDI_ERR << "Expansions were computed for a different GrammarFst "
+                << "(number of states of FST " << i << " differs: "
+                << num_states << " vs. " << num_states_[i] << ")";
+    ReadBasicType(is, binary, &num_entries);
+    if (num_entries == 0)
+      continue;
+    std::atomic<const Entry*> *entries = GetEntries(i);
+    for (int32 e = 0; e < num_entries; e++) {
+      int32 s, num_arcs;
+      Entry *entry = new Entry;
+      ReadBasicType(is, binary, &s);
+      ReadBasicType(is, binary, &(entry->nonterminal));
+      ReadBasicType(is, binary, &(entry->return_state));
+      ReadBasicType(is, binary, &num_arcs);
+      if (s < 0 || s >= num_states || num_arcs < 0)
+        KALDI_ERR << "Invalid data in GrammarFst expansions.";
+      std::vector<StdArc> *arcs = new std::vector<StdArc>(num_arcs);
+      entry->arcs.reset(arcs);
+      for (int32 a = 0; a < num_arcs; a++) {
+        StdArc &arc = (*arcs)[a];
+        float weight;
+        ReadBasicType(is, binary, &arc.ilabel);
+        ReadBasicType(is, binary, &arc.olabel);
+        ReadBasicType(is, binary, &weight);
+        ReadBasicType(is, binary, &arc.nextstate);
+        arc.weight = TropicalWeight(weight);
+      }
+      if (entries[s].load(std::memory_order_relaxed) != NULL) {
+        // Already expanded; the entry would be the same.
+        delete entry;
+      } else {
+        entries[s].store(entry, std::memory_order_release);
+      }
+    }
+  }
+  ExpectToken(is, binary, "</GrammarFstExpansions>");
+}
+
+
 GrammarFst::GrammarFst(
     int32 nonterm_phones_offset,
     std::shared_ptr<const ConstFst<StdArc> > top_fst,
@@ -33,19 +345,23 @@ GrammarFst::GrammarFst(
   Init();
 }
 
+GrammarFst::GrammarFst(const GrammarFst &other):
+    nonterm_phones_offset_(other.nonterm_phones_offset_),
+    top_fst_(other.top_fst_),
+    ifsts_(other.ifsts_),
+    nonterminal_map_(other.nonterminal_map_),
+    cache_(other.cache_) {
+  // We don't copy other.instances_: the ExpandedState pointers in it are owned
+  // by 'other', and instances are cheap to recreate (the expensive part of
+  // expanding states is shared via cache_).
+  if (top_fst_ != NULL)
+    InitInstances();
+}
+
 void GrammarFst::Init() {
   KALDI_ASSERT(nonterm_phones_offset_ > 1);
   InitNonterminalMap();
-  entry_arcs_.resize(ifsts_.size());
-  if (!ifsts_.empty()) {
-    // We call this mostly so that if something is wrong with the input FSTs, the
-    // problem will be detected sooner rather than later.
-    // There would be no problem if we were to call InitEntryArcs(i)
-    // for all 0 <= i < ifsts_size(), but we choose to call it
-    // lazily on demand, to save startup time if the number of nonterminals
-    // is large.
-    InitEntryArcs(0);
-  }
+  cache_ = std::make_shared<ExpansionCache>(*this);
   InitInstances();
 }
 
@@ -54,6 +370,14 @@ GrammarFst::~GrammarFst() {
 }
 
 void GrammarFst::Destroy() {
+  DestroyInstances();
+  top_fst_ = NULL;
+  ifsts_.clear();
+  nonterminal_map_.clear();
+  cache_.reset();
+}
+
+void GrammarFst::DestroyInstances() {
   for (size_t i = 0; i < instances_.size(); i++) {
     FstInstance &instance = instances_[i];
     std::unordered_map<BaseStateId, ExpandedState*>::const_iterator
@@ -64,17 +388,44 @@ void GrammarFst::Destroy() {
       delete e;
     }
   }
-  top_fst_ = NULL;
-  ifsts_.clear();
-  nonterminal_map_.clear();
-  entry_arcs_.clear();
   instances_.clear();
 }
 
+void GrammarFst::SetNonterminalFst(
+    int32 nonterminal, std::shared_ptr<const ConstFst<StdArc> > fst) {
+  if (top_fst_ == NULL || fst == NULL)
+    KALDI_ERR << "SetNonterminalFst() called on uninitialized GrammarFst "
+        "or with NULL FST.";
+  if (nonterminal < GetPhoneSymbolFor(kNontermUserDefined))
+    KALDI_ERR << "Nonterminal symbol " << nonterminal
+              << " was expected to be >= "
+              << GetPhoneSymbolFor(kNontermUserDefined);
+  if (fst->NumStates() != 0) {
+    // Check now that the start state is as expected, rather than when we
+    // first enter this FST while decoding.
+    std::unordered_map<int32, int32> entry_arcs;
+    InitEntryOrReentryArcs(*fst, fst->Start(),
+                           GetPhoneSymbolFor(kNontermBegin), &entry_arcs);
+  }
+  // The FST instances may refer to the FST we are replacing.
+  DestroyInstances();
+  std::unordered_map<int32, int32>::const_iterator iter =
+      nonterminal_map_.find(nonterminal);
+  if (iter != nonterminal_map_.end()) {
+    ifsts_[iter->second].second = fst;
+  } else {
+    ifsts_.push_back(std::pair<int32, std::shared_ptr<const ConstFst<StdArc> > >(
+        nonterminal, fst));
+  }
+  // This sets up nonterminal_map_ again (checking 'nonterminal'), gives us a
+  // new cache_ and sets up instances_ again.
+  Init();
+}
+
 
 void GrammarFst::DecodeSymbol(Label label,
                               int32 *nonterminal_symbol,
-                              int32 *left_context_phone) {
+                              int32 *left_context_phone) const {
   // encoding_multiple will normally equal 1000 (but may be a multiple of 1000
   // if there are a lot of phones); kNontermBigNumber is 10000000.
   int32 big_number = static_cast<int32>(kNontermBigNumber),
@@ -110,17 +461,6 @@ void GrammarFst::InitNonterminalMap() {
 }
 
 
-bool GrammarFst::InitEntryArcs(int32 i) {
-  KALDI_ASSERT(static_cast<size_t>(i) < ifsts_.size());
-  const ConstFst<StdArc> &fst = *(ifsts_[i].second);
-  if (fst.NumStates() == 0)
-    return false;  /* this was the empty FST. */
-  InitEntryOrReentryArcs(fst, fst.Start(),
-                         GetPhoneSymbolFor(kNontermBegin),
-                         &(entry_arcs_[i]));
-  return true;
-}
-
 void GrammarFst::InitInstances() {
   KALDI_ASSERT(instances_.empty());
   instances_.resize(1);
@@ -134,7 +474,7 @@ void GrammarFst::InitEntryOrReentryArcs(
     const ConstFst<StdArc> &fst,
     int32 entry_state,
     int32 expected_nonterminal_symbol,
-    std::unordered_map<int32, int32> *phone_to_arc) {
+    std::unordered_map<int32, int32> *phone_to_arc) const {
   phone_to_arc->clear();
   ArcIterator<ConstFst<StdArc> > aiter(fst, entry_state);
   int32 arc_index = 0;
@@ -229,6 +569,8 @@ GrammarFst::ExpandedState *GrammarFst::ExpandStateEnd(
 
   ExpandedState *ans = new ExpandedState;
   ans->dest_fst_instance = parent_instance_id;
+  std::vector<StdArc> *arcs = new std::vector<StdArc>();
+  ans->arcs.reset(arcs);
 
   // parent_aiter is the arc-iterator in the state we return to.  We'll Seek()
   // to a different position 'parent_aiter' for each arc leaving this state.
@@ -273,7 +615,7 @@ GrammarFst::ExpandedState *GrammarFst::ExpandStateEnd(
     }
     StdArc arc;
     CombineArcs(leaving_arc, arriving_arc, cost_correction, &arc);
-    ans->arcs.push_back(arc);
+    arcs->push_back(arc);
   }
   return ans;
 }
@@ -323,60 +665,58 @@ int32 GrammarFst::GetChildInstanceId(int32 instance_id, int32 nonterminal,
 
 GrammarFst::ExpandedState *GrammarFst::ExpandStateUserDefined(
     int32 instance_id, BaseStateId state_id) {
-  const ConstFst<StdArc> &fst = *(instances_[instance_id].fst);
-  ArcIterator<ConstFst<StdArc> > aiter(fst, state_id);
+  int32 fst_index = instances_[instance_id].ifst_index + 1;
+  const ExpansionCache::Entry *entry = cache_->Find(fst_index, state_id);
+  if (entry == NULL)
+    entry = cache_->Expand(*this, fst_index, state_id);
 
   ExpandedState *ans = new ExpandedState;
-  int32 dest_fst_instance = -1;  // We'll set it in the loop.
-                                 // and->dest_fst_instance will be set to this.
+  ans->dest_fst_instance = GetChildInstanceId(instance_id,
+                                              entry->nonterminal,
+                                              entry->return_state);
+  ans->arcs = entry->arcs;
+  return ans;
+}
 
-  for (; !aiter.Done(); aiter.Next()) {
-    const StdArc &leaving_arc = aiter.Value();
-    int32 nonterminal, left_context_phone;
-    DecodeSymbol(leaving_arc.ilabel, &nonterminal,
-                 &left_context_phone);
-    int32 child_instance_id = GetChildInstanceId(instance_id,
-                                                 nonterminal,
-                                                 leaving_arc.nextstate);
-    if (dest_fst_instance < 0) {
-      dest_fst_instance = child_instance_id;
-    } else if (dest_fst_instance != child_instance_id) {
-      KALDI_ERR << "Same state leaves to different FST instances "
-          "(Did you use PrepareForGrammarFst()?)";
-    }
-    const FstInstance &child_instance = instances_[child_instance_id];
-    const ConstFst<StdArc> &child_fst = *(child_instance.fst);
-    int32 child_ifst_index = child_instance.ifst_index;
-    std::unordered_map<int32, int32> &entry_arcs = entry_arcs_[child_ifst_index];
-    if (entry_arcs.empty()) {
-      if (!InitEntryArcs(child_ifst_index)) {
-        // This child-FST was the empty FST.  There are no arcs to expand.
+int32 GrammarFst::PrecomputeExpansions(bool top_level_only) {
+  KALDI_ASSERT(cache_ != NULL);
+  int32 num_fsts = (top_level_only ? 1 : 1 + ifsts_.size()),
+      num_expanded = 0;
+  for (int32 fst_index = 0; fst_index < num_fsts; fst_index++) {
+    const ConstFst<StdArc> &fst = (fst_index == 0 ? *top_fst_ :
+                                   *(ifsts_[fst_index - 1].second));
+    for (StateIterator<ConstFst<StdArc> > siter(fst); !siter.Done();
+         siter.Next()) {
+      BaseStateId s = siter.Value();
+      if (fst.Final(s).Value() != KALDI_GRAMMAR_FST_SPECIAL_WEIGHT)
         continue;
+      ArcIterator<ConstFst<StdArc> > aiter(fst, s);
+      if (aiter.Done())
+        continue;
+      int32 nonterminal, left_context_phone;
+      DecodeSymbol(aiter.Value().ilabel, &nonterminal, &left_context_phone);
+      if (nonterminal >= GetPhoneSymbolFor(kNontermUserDefined)) {
+        cache_->Expand(*this, fst_index, s);
+        num_expanded++;
       }
     }
-    // for explanation of cost_correction, see documentation for CombineArcs().
-    float num_entry_arcs = entry_arcs.size(),
-        cost_correction = -log(num_entry_arcs);
-
-    // Get the arc-index for the arc leaving the start-state of child FST that
-    // corresponds to this phonetic context.
-    std::unordered_map<int32, int32>::const_iterator entry_iter =
-        entry_arcs.find(left_context_phone);
-    if (entry_iter == entry_arcs.end()) {
-      KALDI_ERR << "FST for nonterminal " << nonterminal
-                << " does not have an entry point for left-context-phone "
-                << left_context_phone;
-    }
-    int32 arc_index = entry_iter->second;
-    ArcIterator<ConstFst<StdArc> > child_aiter(child_fst, child_fst.Start());
-    child_aiter.Seek(arc_index);
-    const StdArc &arriving_arc = child_aiter.Value();
-    StdArc arc;
-    CombineArcs(leaving_arc, arriving_arc, cost_correction, &arc);
-    ans->arcs.push_back(arc);
   }
-  ans->dest_fst_instance = dest_fst_instance;
-  return ans;
+  return num_expanded;
+}
+
+void GrammarFst::WriteExpansions(std::ostream &os, bool binary) const {
+  if (!binary)
+    KALDI_ERR << "GrammarFst::WriteExpansions only supports binary mode.";
+  KALDI_ASSERT(cache_ != NULL);
+  cache_->Write(os);
+}
+
+void GrammarFst::ReadExpansions(std::istream &is, bool binary) {
+  if (!binary)
+    KALDI_ERR << "GrammarFst::ReadExpansions only supports binary mode.";
+  if (cache_ == NULL)
+    KALDI_ERR << "GrammarFst::ReadExpansions called before Read().";
+  cache_->Read(is);
 }
 
 
@@ -91,7 +91,11 @@ template<> class ArcIterator<GrammarFst>;
    THREAD SAFETY: you can't use this object from multiple threads; you should
    create lightweight copies of this object using the copy constructor,
    e.g. `new GrammarFst(this_grammar_fst)`, if you want to decode from multiple
-   threads using the same GrammarFst.
+   threads using the same GrammarFst.  The copies share a thread-safe cache of
+   the expansions of states that enter nonterminals (see ExpansionCache), so
+   the work of expanding those is only done once; that cache can also be
+   precomputed and written to disk, see PrecomputeExpansions() and
+   make-grammar-fst-expansions.
 */
 class GrammarFst {
  public:
@@ -147,8 +151,10 @@ class GrammarFst {
 
   /// Copy constructor.  Useful because this object is not thread safe so cannot
   /// be used by multiple parallel decoder threads, but it is lightweight and
-  /// can copy it without causing the stored FSTs to be copied.
-  GrammarFst(const GrammarFst &other) = default;
+  /// can copy it without causing the stored FSTs to be copied.  The copy
+  /// starts with no FST instances other than the top-level one, but it shares
+  /// the expansion cache with 'other'.
+  GrammarFst(const GrammarFst &other);
 
   ///  This constructor should only be used prior to calling Read().
   GrammarFst() { }
@@ -162,6 +168,43 @@ class GrammarFst {
   // Reads the format that Write() outputs.  Will crash if binary == false.
   void Read(std::istream &os, bool binary);
 
+  /**
+     Attaches 'fst' as the FST for the user-defined nonterminal 'nonterminal'
+     (e.g. the id of #nonterm:contact_list in phones.txt), replacing the FST
+     previously used for it if there was one.  'fst' must have been prepared
+     the same way as the FSTs given to the constructor.  This is intended for
+     personalizing the grammar per decoding request without rebuilding or
+     reloading it: you would make a copy of a shared GrammarFst with the copy
+     constructor (which does not copy any of the FSTs; the top-level FST and
+     the other sub-grammars remain shared, via their shared_ptrs), and call
+     this on the copy.
+
+     The other copies of this GrammarFst are not affected.  After this call,
+     this object no longer shares its expansion cache with them (it gets a new,
+     empty one), since the cached expansions of states entering 'nonterminal'
+     would be wrong for it.
+
+     It is an error to call this while a decoder is using this object.
+   */
+  void SetNonterminalFst(int32 nonterminal,
+                         std::shared_ptr<const ConstFst<StdArc> > fst);
+
+  /// Expands, and adds to the shared expansion cache, all states that have
+  /// arcs entering user-defined nonterminals, in the top-level FST and (if
+  /// top_level_only == false) in the FSTs in 'ifsts'.  Returns the number of
+  /// such states.  This can be used prior to WriteExpansions(), or just to
+  /// avoid the first decoder threads having to do the work.
+  int32 PrecomputeExpansions(bool top_level_only);
+
+  /// Writes the contents of the expansion cache, as a 'companion file' to
+  /// the GrammarFst.  Like Write(), only supports binary mode.
+  void WriteExpansions(std::ostream &os, bool binary) const;
+
+  /// Reads the output of WriteExpansions() into the expansion cache.  The
+  /// file must have been produced from the same FSTs (we check the number of
+  /// states of each).  Must be called after Read() or the constructor.
+  void ReadExpansions(std::istream &is, bool binary);
+
   StateId Start() const {
     // the top 32 bits of the 64-bit state-id will be zero, because the
     // top FST instance has instance-id = 0.
@@ -206,32 +249,26 @@ class GrammarFst {
  private:
 
   struct ExpandedState;
+  class ExpansionCache;
 
   friend class ArcIterator<GrammarFst>;
 
   // sets up nonterminal_map_.
   void InitNonterminalMap();
 
-  // sets up entry_arcs_[i].  We do this only on demand, as each one is
-  // accessed, so that if there are a lot of nonterminals, this object doesn't
-  // too much work when it is initialized.  Each call to this function only
-  // takes time O(number of left-context phones), which is quite small, but we'd
-  // like to avoid that if possible.
-  //
-  // This function returns true if it successfully initialized the
-  // entry_arcs_[i]; and false if it left it empty because
-  bool InitEntryArcs(int32 i);
-
   // sets up instances_ with the top-level instance.
   void InitInstances();
 
   // Does the initialization tasks after nonterm_phones_offset_,
-  // top_fsts_ and ifsts_ have been set up
+  // top_fsts_ and ifsts_ have been set up; this includes creating cache_.
   void Init();
 
   // clears everything.
   void Destroy();
 
+  // deletes the expanded states and clears instances_.
+  void DestroyInstances();
+
   /*
     This utility function sets up a map from "left-context phone", meaning
     either a phone index or the index of the symbol #nonterm_bos, to
@@ -259,10 +296,10 @@ class GrammarFst {
       const ConstFst<StdArc> &fst,
       int32 entry_state,
       int32 nonterminal_symbol,
-      std::unordered_map<int32, int32> *phone_to_arc);
+      std::unordered_map<int32, int32> *phone_to_arc) const;
 
 
-  inline int32 GetPhoneSymbolFor(enum NonterminalValues n) {
+  inline int32 GetPhoneSymbolFor(enum NonterminalValues n) const {
     return nonterm_phones_offset_ + static_cast<int32>(n);
   }
   /**
@@ -280,7 +317,7 @@ class GrammarFst {
    */
   void DecodeSymbol(Label label,
                     int32 *nonterminal_symbol,
-                    int32 *left_context_phone);
+                    int32 *left_context_phone) const;
 
 
   // This function creates and returns an ExpandedState corresponding to a
@@ -296,6 +333,8 @@ class GrammarFst {
 
   // Called from ExpandState() when the nonterminal type on the arcs is a
   // user-defined nonterminal, this implements ExpandState() for that case.
+  // The arcs are obtained from cache_, so only the destination FST instance
+  // has to be worked out here.
   ExpandedState *ExpandStateUserDefined(int32 instance_id, BaseStateId state_id);
 
   // Called from ExpandStateUserDefined(), this function attempts to look up the
@@ -387,9 +426,10 @@ class GrammarFst {
     // will be given by 'dest_fst_instance'.  We do it this way, instead of
     // constructing a vector<Arc>, in order to simplify the ArcIterator code and
     // avoid unnecessary branches in loops over arcs.
-    // We guarantee that this 'arcs' array will always be nonempty; this
-    // is to avoid certain hassles on Windows with automated bounds-checking.
-    std::vector<StdArc> arcs;
+    // For states entering user-defined nonterminals, this array is owned by
+    // the ExpansionCache and shared between all the instances (and copies of
+    // this GrammarFst) that expand the same state of the same FST.
+    std::shared_ptr<const std::vector<StdArc> > arcs;
   };
 
 
@@ -469,15 +509,11 @@ class GrammarFst {
   // in phones.txt, to the corresponding index into 'ifsts_', i.e. the ifst_index.
   std::unordered_map<int32, int32> nonterminal_map_;
 
-  // entry_arcs_ will have the same dimension as ifsts_.  Each entry_arcs_[i]
-  // is a map from left-context phone (i.e. either a phone-index or
-  // #nonterm_bos) to the corresponding arc-index leaving the start-state in
-  // the FST 'ifsts_[i].second'.
-  // We populate this only on demand as each one is needed (except for the
-  // first one, which we populate immediately as a kind of sanity check).
-  // Doing it on-demand prevents this object's initialization from being
-  // nontrivial in the case where there are a lot of nonterminals.
-  std::vector<std::unordered_map<int32, int32> > entry_arcs_;
+  // The cache of expanded states entering user-defined nonterminals (which
+  // also holds the entry arcs of the FSTs in ifsts_).  It is shared by copies
+  // of this object made with the copy constructor, possibly in different
+  // threads.
+  std::shared_ptr<ExpansionCache> cache_;
 
   // The FST instances.  Initially it is a vector with just one element
   // representing top_fst_, and it will be populated with more elements on
@@ -525,8 +561,8 @@ class ArcIterator<GrammarFst> {
       dest_instance_ = expanded_state->dest_fst_instance;
       // it's ok to leave the other members of data_ uninitialized, as they will
       // never be interrogated.
-      data_.arcs = &(expanded_state->arcs[0]);
-      data_.narcs = expanded_state->arcs.size();
+      data_.arcs = expanded_state->arcs->data();
+      data_.narcs = expanded_state->arcs->size();
       i_ = 0;
     }
     // Ideally we want to call CopyArcToTemp() now, but we rely on the fact that
@@ -64,6 +64,7 @@ class LatticeBiglmFasterDecoder {
     KALDI_ASSERT(fst.Start() != fst::kNoStateId &&
                  lm_diff_fst->Start() != fst::kNoStateId);
     toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
+    lm_arc_cache_.resize(kLmArcCacheSize);
   }
   void SetOptions(const LatticeBiglmFasterDecoderConfig &config) { config_ = config; } 
   LatticeBiglmFasterDecoderConfig GetOptions() { return config_; } 
@@ -75,20 +76,7 @@ class LatticeBiglmFasterDecoder {
   // Returns true if any kind of traceback is available (not necessarily from
   // a final state).
   bool Decode(DecodableInterface *decodable) {
-    // clean up from last time:
-    DeleteElems(toks_.Clear());
-    ClearActiveTokens();
-    warned_ = false;
-    final_active_ = false;
-    final_costs_.clear();
-    num_toks_ = 0;
-    PairId start_pair = ConstructPair(fst_.Start(), lm_diff_fst_->Start());
-    active_toks_.resize(1);
-    Token *start_tok = new Token(0.0, 0.0, NULL, NULL);
-    active_toks_[0].toks = start_tok;
-    toks_.Insert(start_pair, start_tok);
-    num_toks_++;
-    ProcessNonemitting(0);
+    InitDecoding();
     
     // We use 1-based indexing for frames in this decoder (if you view it in
     // terms of features), but note that the decodable object uses zero-based
@@ -110,6 +98,59 @@ class LatticeBiglmFasterDecoder {
     return !final_costs_.empty();
   }
 
+  /// InitDecoding(), AdvanceDecoding() and FinalizeDecoding() are an
+  /// alternative to Decode() for when the frames become available
+  /// incrementally, as in online decoding.  InitDecoding() cleans up from any
+  /// previous utterance and creates the start token.
+  void InitDecoding() {
+    // clean up from last time:
+    DeleteElems(toks_.Clear());
+    ClearActiveTokens();
+    warned_ = false;
+    final_active_ = false;
+    final_costs_.clear();
+    num_toks_ = 0;
+    PairId start_pair = ConstructPair(fst_.Start(), lm_diff_fst_->Start());
+    active_toks_.resize(1);
+    Token *start_tok = new Token(0.0, 0.0, NULL, NULL);
+    active_toks_[0].toks = start_tok;
+    toks_.Insert(start_pair, start_tok);
+    num_toks_++;
+    ProcessNonemitting(0);
+  }
+
+  /// Decodes the frames that are ready in 'decodable' (see
+  /// DecodableInterface::NumFramesReady()) and have not been decoded yet, but
+  /// no more than 'max_num_frames' of them if it is >= 0.
+  void AdvanceDecoding(DecodableInterface *decodable,
+                       int32 max_num_frames = -1) {
+    int32 num_frames_ready = decodable->NumFramesReady(),
+        target_frames_decoded = num_frames_ready;
+    KALDI_ASSERT(num_frames_ready >= NumFramesDecoded());
+    if (max_num_frames >= 0)
+      target_frames_decoded = std::min(target_frames_decoded,
+                                       NumFramesDecoded() + max_num_frames);
+    while (NumFramesDecoded() < target_frames_decoded) {
+      int32 frame = NumFramesDecoded() + 1;
+      active_toks_.resize(frame + 1);
+      ProcessEmitting(decodable, frame);
+      ProcessNonemitting(frame);
+      if (frame % config_.prune_interval == 0)
+        PruneActiveTokens(frame, config_.lattice_beam * 0.1);
+    }
+  }
+
+  /// Prunes the lattice using the final-probs; call this after the last
+  /// AdvanceDecoding() of an utterance, before GetRawLattice().  Until it is
+  /// called, GetRawLattice() treats all the active states as final.  No more
+  /// frames may be decoded after it.
+  void FinalizeDecoding() {
+    PruneActiveTokensFinal(NumFramesDecoded());
+  }
+
+  /// Returns the number of frames decoded so far.
+  int32 NumFramesDecoded() const { return active_toks_.size() - 1; }
+
   /// says whether a final-state was active on the last frame.  If it was not, the
   /// lattice (or traceback) will end with states that are not final-states.
   bool ReachedFinal() const { return final_active_; }
@@ -664,10 +705,24 @@ class LatticeBiglmFasterDecoder {
                              Arc *arc) { // returns new LM state.
     if (arc->olabel == 0) {
       return lm_state; // no change in LM state if no word crossed.
-    } else { // Propagate in the LM-diff FST.
-      Arc lm_arc;
-      bool ans = lm_diff_fst_->GetArc(lm_state, arc->olabel, &lm_arc);
-      if (!ans) { // this case is unexpected for statistical LMs.
+    } else { // Propagate in the LM-diff FST, going via the cache.
+      size_t index = (static_cast<size_t>(lm_state) * 7853 + arc->olabel) &
+          (kLmArcCacheSize - 1);
+      LmArcCacheEntry &entry = lm_arc_cache_[index];
+      if (entry.lm_state != lm_state || entry.word != arc->olabel) {
+        Arc lm_arc;
+        entry.lm_state = lm_state;
+        entry.word = arc->olabel;
+        if (lm_diff_fst_->GetArc(lm_state, arc->olabel, &lm_arc)) {
+          entry.olabel = lm_arc.olabel;
+          entry.next_lm_state = lm_arc.nextstate;
+          entry.cost = lm_arc.weight.Value();
+        } else {
+          entry.next_lm_state = fst::kNoStateId;
+        }
+      }
+      if (entry.next_lm_state == fst::kNoStateId) {
+        // this case is unexpected for statistical LMs.
         if (!warned_noarc_) {
           warned_noarc_ = true;
           KALDI_WARN << "No arc available in LM (unlikely to be correct "
@@ -677,9 +732,9 @@ class LatticeBiglmFasterDecoder {
         return lm_state; // doesn't really matter what we return here; will
         // be pruned.
       } else {
-        arc->weight = Times(arc->weight, lm_arc.weight);
-        arc->olabel = lm_arc.olabel; // probably will be the same.
-        return lm_arc.nextstate; // return the new LM state.
+        arc->weight = Times(arc->weight, Weight(entry.cost));
+        arc->olabel = entry.olabel; // probably will be the same.
+        return entry.next_lm_state; // return the new LM state.
       }      
     }
   }
@@ -849,6 +904,26 @@ class LatticeBiglmFasterDecoder {
   // on the last frame.
   std::map<Token*, BaseFloat> final_costs_; // A cache of final-costs
   // of tokens on the last frame-- it's just convenient to store it this way.
+
+  // lm_arc_cache_ is a direct-mapped cache of the arcs of lm_diff_fst_, indexed
+  // by a hash of the LM state and the word, used in PropagateLm().  The same
+  // few words are looked up from the same LM states over and over, and going
+  // through lm_diff_fst_ (typically a composition of backoff LMs) each time is
+  // what makes this decoder slower than the static ones.  The LM states are
+  // stable across utterances, so the cache is kept for the lifetime of the
+  // decoder.  Failed lookups are cached too, with next_lm_state ==
+  // fst::kNoStateId.
+  struct LmArcCacheEntry {
+    StateId lm_state;  // fst::kNoStateId if the entry is unused.
+    Label word;
+    Label olabel;
+    StateId next_lm_state;
+    BaseFloat cost;
+    LmArcCacheEntry(): lm_state(fst::kNoStateId), word(0), olabel(0),
+                       next_lm_state(fst::kNoStateId), cost(0.0) { }
+  };
+  static const size_t kLmArcCacheSize = 1 << 17;  // must be a power of 2.
+  std::vector<LmArcCacheEntry> lm_arc_cache_;
   
   // It might seem unclear why we call DeleteElems(toks_.Clear()).
   // There are two separate cleanup tasks we need to do at when we start a new file.
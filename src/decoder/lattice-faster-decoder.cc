@@ -21,51 +21,62 @@
 // limitations under the License.
 
 #include "decoder/lattice-faster-decoder.h"
+#include "base/timer.h"
 #include "lat/lattice-functions.h"
 
 namespace kaldi {
 
 // instantiate this class once for each thing you have to decode.
-template <typename FST, typename Token>
-LatticeFasterDecoderTpl<FST, Token>::LatticeFasterDecoderTpl(
+template <typename FST, typename Token, template <class, class> class HashT>
+LatticeFasterDecoderTpl<FST, Token, HashT>::LatticeFasterDecoderTpl(
     const FST &fst,
     const LatticeFasterDecoderConfig &config):
-    fst_(&fst), delete_fst_(false), config_(config), num_toks_(0) {
+    first_frame_(0), token_memory_(kMemoryDecoderTokens),
+    link_memory_(kMemoryDecoderLinks), beam_scale_(1.0),
+    external_beam_scale_(1.0), fst_(&fst),
+    delete_fst_(false), config_(config), num_toks_(0), frame_stats_(NULL) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
 
 
-template <typename FST, typename Token>
-LatticeFasterDecoderTpl<FST, Token>::LatticeFasterDecoderTpl(
+template <typename FST, typename Token, template <class, class> class HashT>
+LatticeFasterDecoderTpl<FST, Token, HashT>::LatticeFasterDecoderTpl(
     const LatticeFasterDecoderConfig &config, FST *fst):
-    fst_(fst), delete_fst_(true), config_(config), num_toks_(0) {
+    first_frame_(0), token_memory_(kMemoryDecoderTokens),
+    link_memory_(kMemoryDecoderLinks), beam_scale_(1.0),
+    external_beam_scale_(1.0), fst_(fst),
+    delete_fst_(true), config_(config), num_toks_(0), frame_stats_(NULL) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
 
 
-template <typename FST, typename Token>
-LatticeFasterDecoderTpl<FST, Token>::~LatticeFasterDecoderTpl() {
+template <typename FST, typename Token, template <class, class> class HashT>
+LatticeFasterDecoderTpl<FST, Token, HashT>::~LatticeFasterDecoderTpl() {
   DeleteElems(toks_.Clear());
   ClearActiveTokens();
   if (delete_fst_) delete fst_;
 }
 
-template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::InitDecoding() {
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::InitDecoding() {
   // clean up from last time:
   DeleteElems(toks_.Clear());
   cost_offsets_.clear();
   ClearActiveTokens();
   warned_ = false;
+  warned_memory_ = false;
   num_toks_ = 0;
   decoding_finalized_ = false;
   final_costs_.clear();
+  first_frame_ = 0;
+  beam_scale_ = 1.0;
   StateId start_state = fst_->Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   active_toks_.resize(1);
-  Token *start_tok = new Token(0.0, 0.0, NULL, NULL, NULL);
+  Token *start_tok = new (token_pool_.Allocate()) Token(0.0, 0.0, NULL,
+                                                        NULL, NULL);
   active_toks_[0].toks = start_tok;
   toks_.Insert(start_state, start_tok);
   num_toks_++;
@@ -75,8 +86,8 @@ void LatticeFasterDecoderTpl<FST, Token>::InitDecoding() {
 // Returns true if any kind of traceback is available (not necessarily from
 // a final state).  It should only very rarely return false; this indicates
 // an unusual search error.
-template <typename FST, typename Token>
-bool LatticeFasterDecoderTpl<FST, Token>::Decode(DecodableInterface *decodable) {
+template <typename FST, typename Token, template <class, class> class HashT>
+bool LatticeFasterDecoderTpl<FST, Token, HashT>::Decode(DecodableInterface *decodable) {
   InitDecoding();
   // We use 1-based indexing for frames in this decoder (if you view it in
   // terms of features), but note that the decodable object uses zero-based
@@ -91,8 +102,8 @@ bool LatticeFasterDecoderTpl<FST, Token>::Decode(DecodableInterface *decodable)
 
 
 // Outputs an FST corresponding to the single best path through the lattice.
-template <typename FST, typename Token>
-bool LatticeFasterDecoderTpl<FST, Token>::GetBestPath(Lattice *olat,
+template <typename FST, typename Token, template <class, class> class HashT>
+bool LatticeFasterDecoderTpl<FST, Token, HashT>::GetBestPath(Lattice *olat,
                                        bool use_final_probs) const {
   Lattice raw_lat;
   GetRawLattice(&raw_lat, use_final_probs);
@@ -102,8 +113,8 @@ bool LatticeFasterDecoderTpl<FST, Token>::GetBestPath(Lattice *olat,
 
 
 // Outputs an FST corresponding to the raw, state-level lattice
-template <typename FST, typename Token>
-bool LatticeFasterDecoderTpl<FST, Token>::GetRawLattice(
+template <typename FST, typename Token, template <class, class> class HashT>
+bool LatticeFasterDecoderTpl<FST, Token, HashT>::GetRawLattice(
     Lattice *ofst,
     bool use_final_probs) const {
   typedef LatticeArc Arc;
@@ -132,9 +143,10 @@ bool LatticeFasterDecoderTpl<FST, Token>::GetRawLattice(
   KALDI_ASSERT(num_frames > 0);
   const int32 bucket_count = num_toks_/2 + 3;
   unordered_map<Token*, StateId> tok_map(bucket_count);
-  // First create all states.
+  // First create all states.  The frames before first_frame_ were freed by
+  // CommitRawLattice(), if it was called.
   std::vector<Token*> token_list;
-  for (int32 f = 0; f <= num_frames; f++) {
+  for (int32 f = first_frame_; f <= num_frames; f++) {
     if (active_toks_[f].toks == NULL) {
       KALDI_WARN << "GetRawLattice: no tokens active on frame " << f
                  << ": not producing lattice.\n";
@@ -153,7 +165,7 @@ bool LatticeFasterDecoderTpl<FST, Token>::GetRawLattice(
                 << tok_map.bucket_count() << " load:" << tok_map.load_factor()
                 << " max:" << tok_map.max_load_factor();
   // Now create all arcs.
-  for (int32 f = 0; f <= num_frames; f++) {
+  for (int32 f = first_frame_; f <= num_frames; f++) {
     for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
       StateId cur_state = tok_map[tok];
       for (ForwardLinkT *l = tok->links;
@@ -189,11 +201,122 @@ bool LatticeFasterDecoderTpl<FST, Token>::GetRawLattice(
 }
 
 
+template <typename FST, typename Token, template <class, class> class HashT>
+bool LatticeFasterDecoderTpl<FST, Token, HashT>::CommitRawLattice(Lattice *ofst,
+                                                           int32 max_frame) {
+  typedef LatticeArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Weight Weight;
+
+  if (decoding_finalized_)
+    KALDI_ERR << "You cannot call CommitRawLattice() after FinalizeDecoding()";
+  ofst->DeleteStates();
+  // Make sure the extra_costs are up to date, so as many tokens as possible are
+  // pruned away.
+  PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+
+  // Find the latest frame with just one token.  We don't consider the current
+  // frame, whose tokens are still in toks_ and have not been pruned.
+  int32 last_frame = NumFramesDecoded() - 1;
+  if (max_frame >= 0 && max_frame < last_frame)
+    last_frame = max_frame;
+  int32 commit_frame = -1;
+  for (int32 f = last_frame; f > first_frame_; f--) {
+    if (active_toks_[f].toks != NULL && active_toks_[f].toks->next == NULL) {
+      commit_frame = f;
+      break;
+    }
+  }
+  if (commit_frame < 0)
+    return false;
+  Token *commit_tok = active_toks_[commit_frame].toks;
+
+  // With --verbose=4 or more we check that the committed lattice, followed by
+  // the lattice that remains after the commit, is equivalent to the lattice
+  // before the commit.  This is slow (it outputs the whole lattice twice).
+  bool check = (GetVerboseLevel() >= 4);
+  Lattice full_lat;
+  if (check)
+    GetRawLattice(&full_lat, false);
+
+  // Output the lattice up to commit_tok, as in GetRawLattice().
+  unordered_map<Token*, StateId> tok_map;
+  std::vector<Token*> token_list;
+  for (int32 f = first_frame_; f < commit_frame; f++) {
+    TopSortTokens(active_toks_[f].toks, &token_list);
+    for (size_t i = 0; i < token_list.size(); i++)
+      if (token_list[i] != NULL)
+        tok_map[token_list[i]] = ofst->AddState();
+  }
+  StateId final_state = ofst->AddState();
+  tok_map[commit_tok] = final_state;
+  ofst->SetFinal(final_state, LatticeWeight::One());
+  ofst->SetStart(0);
+  for (int32 f = first_frame_; f < commit_frame; f++) {
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
+      StateId cur_state = tok_map[tok];
+      for (ForwardLinkT *l = tok->links; l != NULL; l = l->next) {
+        typename unordered_map<Token*, StateId>::const_iterator
+            iter = tok_map.find(l->next_tok);
+        KALDI_ASSERT(iter != tok_map.end());
+        BaseFloat cost_offset = 0.0;
+        if (l->ilabel != 0)  // emitting..
+          cost_offset = cost_offsets_[f];
+        Arc arc(l->ilabel, l->olabel,
+                Weight(l->graph_cost, l->acoustic_cost - cost_offset),
+                iter->second);
+        ofst->AddArc(cur_state, arc);
+      }
+    }
+  }
+
+  // Free the tokens before the commit point.  All the paths go through
+  // commit_tok, so nothing after it refers to them, except for its own
+  // backpointer.
+  for (int32 f = first_frame_; f < commit_frame; f++) {
+    Token *tok = active_toks_[f].toks, *next_tok;
+    for (; tok != NULL; tok = next_tok) {
+      next_tok = tok->next;
+      DeleteForwardLinks(tok);
+      token_pool_.Delete(tok);
+      num_toks_--;
+    }
+    active_toks_[f].toks = NULL;
+    active_toks_[f].must_prune_forward_links = false;
+    active_toks_[f].must_prune_tokens = false;
+  }
+  commit_tok->SetBackpointer(NULL);
+  first_frame_ = commit_frame;
+
+  if (check) {
+    Lattice rest_lat, joined_lat(*ofst);
+    GetRawLattice(&rest_lat, false);
+    // The commit token is the final state of *ofst and the start state of
+    // rest_lat, so it appears in both.
+    if (ofst->NumStates() + rest_lat.NumStates() != full_lat.NumStates() + 1)
+      KALDI_ERR << "CommitRawLattice: committed lattice has "
+                << ofst->NumStates() << " states and remaining lattice has "
+                << rest_lat.NumStates() << ", expected "
+                << (full_lat.NumStates() + 1) << " in total.";
+    fst::Concat(&joined_lat, rest_lat);
+    fst::Connect(&joined_lat);
+    fst::Connect(&full_lat);
+    BaseFloat delta = 0.1;
+    int32 num_paths = 5;
+    if (!fst::RandEquivalent(joined_lat, full_lat, num_paths, delta, Rand()))
+      KALDI_ERR << "CommitRawLattice: committed and remaining lattices do "
+                << "not match the lattice before the commit (frames "
+                << "committed: " << commit_frame << ")";
+  }
+  return true;
+}
+
+
 // This function is now deprecated, since now we do determinization from outside
 // the LatticeFasterDecoder class.  Outputs an FST corresponding to the
 // lattice-determinized lattice (one path per word sequence).
-template <typename FST, typename Token>
-bool LatticeFasterDecoderTpl<FST, Token>::GetLattice(CompactLattice *ofst,
+template <typename FST, typename Token, template <class, class> class HashT>
+bool LatticeFasterDecoderTpl<FST, Token, HashT>::GetLattice(CompactLattice *ofst,
                                            bool use_final_probs) const {
   Lattice raw_fst;
   GetRawLattice(&raw_fst, use_final_probs);
@@ -215,8 +338,8 @@ bool LatticeFasterDecoderTpl<FST, Token>::GetLattice(CompactLattice *ofst,
   return (ofst->NumStates() != 0);
 }
 
-template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::PossiblyResizeHash(size_t num_toks) {
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::PossiblyResizeHash(size_t num_toks) {
   size_t new_sz = static_cast<size_t>(static_cast<BaseFloat>(num_toks)
                                       * config_.hash_ratio);
   if (new_sz > toks_.Size()) {
@@ -255,9 +378,9 @@ void LatticeFasterDecoderTpl<FST, Token>::PossiblyResizeHash(size_t num_toks) {
 // for the current frame.  [note: it's inserted if necessary into hash toks_
 // and also into the singly linked list of tokens active on this frame
 // (whose head is at active_toks_[frame]).
-template <typename FST, typename Token>
-inline typename LatticeFasterDecoderTpl<FST, Token>::Elem*
-LatticeFasterDecoderTpl<FST, Token>::FindOrAddToken(
+template <typename FST, typename Token, template <class, class> class HashT>
+inline typename LatticeFasterDecoderTpl<FST, Token, HashT>::Elem*
+LatticeFasterDecoderTpl<FST, Token, HashT>::FindOrAddToken(
       StateId state, int32 frame_plus_one, BaseFloat tot_cost,
       Token *backpointer, bool *changed) {
   // Returns the Token pointer.  Sets "changed" (if non-NULL) to true
@@ -270,7 +393,8 @@ LatticeFasterDecoderTpl<FST, Token>::FindOrAddToken(
     // tokens on the currently final frame have zero extra_cost
     // as any of them could end up
     // on the winning path.
-    Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks, backpointer);
+    Token *new_tok = new (token_pool_.Allocate())
+        Token(tot_cost, extra_cost, NULL, toks, backpointer);
     // NULL: no forward links yet
     toks = new_tok;
     num_toks_++;
@@ -302,8 +426,8 @@ LatticeFasterDecoderTpl<FST, Token>::FindOrAddToken(
 // prunes outgoing links for all tokens in active_toks_[frame]
 // it's called by PruneActiveTokens
 // all links, that have link_extra_cost > lattice_beam are pruned
-template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinks(
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::PruneForwardLinks(
     int32 frame_plus_one, bool *extra_costs_changed,
     bool *links_pruned, BaseFloat delta) {
   // delta is the amount by which the extra_costs must change
@@ -347,7 +471,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinks(
           ForwardLinkT *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_pool_.Delete(link);
           link = next_link;  // advance link but leave prev_link the same.
           *links_pruned = true;
         } else {   // keep the link and update the tok_extra_cost if needed.
@@ -379,8 +503,8 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinks(
 // PruneForwardLinksFinal is a version of PruneForwardLinks that we call
 // on the final frame.  If there are final tokens active, it uses
 // the final-probs for pruning, otherwise it treats all tokens as final.
-template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinksFinal() {
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::PruneForwardLinksFinal() {
   KALDI_ASSERT(!active_toks_.empty());
   int32 frame_plus_one = active_toks_.size() - 1;
 
@@ -435,7 +559,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinksFinal() {
           ForwardLinkT *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_pool_.Delete(link);
           link = next_link; // advance link but leave prev_link the same.
         } else { // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -464,8 +588,8 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinksFinal() {
   } // while changed
 }
 
-template <typename FST, typename Token>
-BaseFloat LatticeFasterDecoderTpl<FST, Token>::FinalRelativeCost() const {
+template <typename FST, typename Token, template <class, class> class HashT>
+BaseFloat LatticeFasterDecoderTpl<FST, Token, HashT>::FinalRelativeCost() const {
   if (!decoding_finalized_) {
     BaseFloat relative_cost;
     ComputeFinalCosts(NULL, &relative_cost, NULL);
@@ -482,8 +606,8 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::FinalRelativeCost() const {
 // [we don't do this in PruneForwardLinks because it would give us
 // a problem with dangling pointers].
 // It's called by PruneActiveTokens if any forward links have been pruned
-template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::PruneTokensForFrame(int32 frame_plus_one) {
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::PruneTokensForFrame(int32 frame_plus_one) {
   KALDI_ASSERT(frame_plus_one >= 0 && frame_plus_one < active_toks_.size());
   Token *&toks = active_toks_[frame_plus_one].toks;
   if (toks == NULL)
@@ -496,7 +620,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneTokensForFrame(int32 frame_plus_o
       // excise tok from list and delete tok.
       if (prev_tok != NULL) prev_tok->next = tok->next;
       else toks = tok->next;
-      delete tok;
+      token_pool_.Delete(tok);
       num_toks_--;
     } else {  // fetch next Token
       prev_tok = tok;
@@ -509,13 +633,13 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneTokensForFrame(int32 frame_plus_o
 // that.  We go backwards through the frames and stop when we reach a point
 // where the delta-costs are not changing (and the delta controls when we consider
 // a cost to have "not changed").
-template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::PruneActiveTokens(BaseFloat delta) {
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::PruneActiveTokens(BaseFloat delta) {
   int32 cur_frame_plus_one = NumFramesDecoded();
   int32 num_toks_begin = num_toks_;
   // The index "f" below represents a "frame plus one", i.e. you'd have to subtract
   // one to get the corresponding index for the decodable object.
-  for (int32 f = cur_frame_plus_one - 1; f >= 0; f--) {
+  for (int32 f = cur_frame_plus_one - 1; f >= first_frame_; f--) {
     // Reason why we need to prune forward links in this situation:
     // (1) we have never pruned them (new TokenList)
     // (2) we have not yet pruned the forward links to the next f,
@@ -523,7 +647,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneActiveTokens(BaseFloat delta) {
     if (active_toks_[f].must_prune_forward_links) {
       bool extra_costs_changed = false, links_pruned = false;
       PruneForwardLinks(f, &extra_costs_changed, &links_pruned, delta);
-      if (extra_costs_changed && f > 0) // any token has changed extra_cost
+      if (extra_costs_changed && f > first_frame_) // any token has changed extra_cost
         active_toks_[f-1].must_prune_forward_links = true;
       if (links_pruned) // any link was pruned
         active_toks_[f].must_prune_tokens = true;
@@ -539,8 +663,8 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneActiveTokens(BaseFloat delta) {
                 << " to " << num_toks_;
 }
 
-template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::ComputeFinalCosts(
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::ComputeFinalCosts(
     unordered_map<Token*, BaseFloat> *final_costs,
     BaseFloat *final_relative_cost,
     BaseFloat *final_best_cost) const {
@@ -583,21 +707,21 @@ void LatticeFasterDecoderTpl<FST, Token>::ComputeFinalCosts(
   }
 }
 
-template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::AdvanceDecoding(DecodableInterface *decodable,
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::AdvanceDecoding(DecodableInterface *decodable,
                                                 int32 max_num_frames) {
   if (std::is_same<FST, fst::Fst<fst::StdArc> >::value) {
     // if the type 'FST' is the FST base-class, then see if the FST type of fst_
     // is actually VectorFst or ConstFst.  If so, call the AdvanceDecoding()
     // function after casting *this to the more specific type.
     if (fst_->Type() == "const") {
-      LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>, Token> *this_cast =
-          reinterpret_cast<LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>, Token>* >(this);
+      LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>, Token, HashT> *this_cast =
+          reinterpret_cast<LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>, Token, HashT>* >(this);
       this_cast->AdvanceDecoding(decodable, max_num_frames);
       return;
     } else if (fst_->Type() == "vector") {
-      LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>, Token> *this_cast =
-          reinterpret_cast<LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>, Token>* >(this);
+      LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>, Token, HashT> *this_cast =
+          reinterpret_cast<LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>, Token, HashT>* >(this);
       this_cast->AdvanceDecoding(decodable, max_num_frames);
       return;
     }
@@ -616,44 +740,94 @@ void LatticeFasterDecoderTpl<FST, Token>::AdvanceDecoding(DecodableInterface *de
   if (max_num_frames >= 0)
     target_frames_decoded = std::min(target_frames_decoded,
                                      NumFramesDecoded() + max_num_frames);
+  if (KALDI_DECODER_STATS_ENABLED && frame_stats_ != NULL) {
+    // This is the same loop as below, collecting the statistics.
+    Timer timer;
+    while (NumFramesDecoded() < target_frames_decoded) {
+      cur_frame_stats_ = DecoderFrameStats();
+      if (NumFramesDecoded() % config_.prune_interval == 0) {
+        int32 num_toks_begin = num_toks_;
+        PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+        cur_frame_stats_.num_tokens_pruned = num_toks_begin - num_toks_;
+      }
+      double start = timer.Elapsed();
+      BaseFloat cost_cutoff = ProcessEmitting(decodable);
+      double emitting_end = timer.Elapsed();
+      ProcessNonemitting(cost_cutoff);
+      cur_frame_stats_.emitting_seconds = emitting_end - start;
+      cur_frame_stats_.nonemitting_seconds = timer.Elapsed() - emitting_end;
+      cur_frame_stats_.num_lattice_tokens = num_toks_;
+      frame_stats_->push_back(cur_frame_stats_);
+      UpdateMemoryUsage();
+    }
+    return;
+  }
   while (NumFramesDecoded() < target_frames_decoded) {
     if (NumFramesDecoded() % config_.prune_interval == 0) {
       PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
     }
     BaseFloat cost_cutoff = ProcessEmitting(decodable);
     ProcessNonemitting(cost_cutoff);
+    UpdateMemoryUsage();
+  }
+}
+
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::UpdateMemoryUsage() {
+  token_memory_.Set(token_pool_.NumAllocated() * sizeof(Token));
+  link_memory_.Set(link_pool_.NumAllocated() * sizeof(ForwardLinkT));
+  if (config_.memory_min_beam_scale >= 1.0)
+    return;
+  double usage = MemoryBudget::Global().Usage();
+  BaseFloat old_scale = beam_scale_;
+  if (usage > 1.0)
+    beam_scale_ = std::max(config_.memory_min_beam_scale, beam_scale_ * 0.9f);
+  else if (usage < 0.9)
+    beam_scale_ = std::min(1.0f, beam_scale_ / 0.9f);
+  if (beam_scale_ < old_scale && !warned_memory_) {
+    KALDI_WARN << "Over the memory budget on frame " << NumFramesDecoded()
+               << ", reducing the beam. " << MemoryBudget::Global().Summary();
+    warned_memory_ = true;
   }
 }
 
 // FinalizeDecoding() is a version of PruneActiveTokens that we call
 // (optionally) on the final frame.  Takes into account the final-prob of
 // tokens.  This function used to be called PruneActiveTokensFinal().
-template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::FinalizeDecoding() {
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::FinalizeDecoding() {
   int32 final_frame_plus_one = NumFramesDecoded();
   int32 num_toks_begin = num_toks_;
   // PruneForwardLinksFinal() prunes final frame (with final-probs), and
   // sets decoding_finalized_.
   PruneForwardLinksFinal();
-  for (int32 f = final_frame_plus_one - 1; f >= 0; f--) {
+  for (int32 f = final_frame_plus_one - 1; f >= first_frame_; f--) {
     bool b1, b2; // values not used.
     BaseFloat dontcare = 0.0; // delta of zero means we must always update
     PruneForwardLinks(f, &b1, &b2, dontcare);
     PruneTokensForFrame(f + 1);
   }
-  PruneTokensForFrame(0);
+  PruneTokensForFrame(first_frame_);
   KALDI_VLOG(4) << "pruned tokens from " << num_toks_begin
                 << " to " << num_toks_;
 }
 
 /// Gets the weight cutoff.  Also counts the active tokens.
-template <typename FST, typename Token>
-BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t *tok_count,
+template <typename FST, typename Token, template <class, class> class HashT>
+BaseFloat LatticeFasterDecoderTpl<FST, Token, HashT>::GetCutoff(Elem *list_head, size_t *tok_count,
                                           BaseFloat *adaptive_beam, Elem **best_elem) {
   BaseFloat best_weight = std::numeric_limits<BaseFloat>::infinity();
   // positive == high cost == bad.
   size_t count = 0;
-  if (config_.max_active == std::numeric_limits<int32>::max() &&
+  // beam_scale_ is less than one if we are over the memory budget, and
+  // external_beam_scale_ if SetBeamScale() was called.
+  BaseFloat scale = beam_scale_ * external_beam_scale_;
+  BaseFloat beam = config_.beam * scale;
+  int32 max_active = config_.max_active;
+  if (scale < 1.0 && max_active != std::numeric_limits<int32>::max())
+    max_active = std::max(config_.min_active,
+                          static_cast<int32>(max_active * scale));
+  if (max_active == std::numeric_limits<int32>::max() &&
       config_.min_active == 0) {
     for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
       BaseFloat w = static_cast<BaseFloat>(e->val->tot_cost);
@@ -663,8 +837,8 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
       }
     }
     if (tok_count != NULL) *tok_count = count;
-    if (adaptive_beam != NULL) *adaptive_beam = config_.beam;
-    return best_weight + config_.beam;
+    if (adaptive_beam != NULL) *adaptive_beam = beam;
+    return best_weight + beam;
   } else {
     tmp_array_.clear();
     for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
@@ -677,18 +851,18 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
     }
     if (tok_count != NULL) *tok_count = count;
 
-    BaseFloat beam_cutoff = best_weight + config_.beam,
+    BaseFloat beam_cutoff = best_weight + beam,
         min_active_cutoff = std::numeric_limits<BaseFloat>::infinity(),
         max_active_cutoff = std::numeric_limits<BaseFloat>::infinity();
 
     KALDI_VLOG(6) << "Number of tokens active on frame " << NumFramesDecoded()
                   << " is " << tmp_array_.size();
 
-    if (tmp_array_.size() > static_cast<size_t>(config_.max_active)) {
+    if (tmp_array_.size() > static_cast<size_t>(max_active)) {
       std::nth_element(tmp_array_.begin(),
-                       tmp_array_.begin() + config_.max_active,
+                       tmp_array_.begin() + max_active,
                        tmp_array_.end());
-      max_active_cutoff = tmp_array_[config_.max_active];
+      max_active_cutoff = tmp_array_[max_active];
     }
     if (max_active_cutoff < beam_cutoff) { // max_active is tighter than beam.
       if (adaptive_beam)
@@ -700,8 +874,8 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
       else {
         std::nth_element(tmp_array_.begin(),
                          tmp_array_.begin() + config_.min_active,
-                         tmp_array_.size() > static_cast<size_t>(config_.max_active) ?
-                         tmp_array_.begin() + config_.max_active :
+                         tmp_array_.size() > static_cast<size_t>(max_active) ?
+                         tmp_array_.begin() + max_active :
                          tmp_array_.end());
         min_active_cutoff = tmp_array_[config_.min_active];
       }
@@ -711,14 +885,14 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
         *adaptive_beam = min_active_cutoff - best_weight + config_.beam_delta;
       return min_active_cutoff;
     } else {
-      *adaptive_beam = config_.beam;
+      *adaptive_beam = beam;
       return beam_cutoff;
     }
   }
 }
 
-template <typename FST, typename Token>
-BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
+template <typename FST, typename Token, template <class, class> class HashT>
+BaseFloat LatticeFasterDecoderTpl<FST, Token, HashT>::ProcessEmitting(
     DecodableInterface *decodable) {
   KALDI_ASSERT(active_toks_.size() > 0);
   int32 frame = active_toks_.size() - 1; // frame is the frame-index
@@ -737,6 +911,7 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
                 << adaptive_beam;
 
   PossiblyResizeHash(tok_cnt);  // This makes sure the hash is always big enough.
+  cur_frame_stats_.num_active_tokens = tok_cnt;
 
   BaseFloat next_cutoff = std::numeric_limits<BaseFloat>::infinity();
   // pruning "online" before having seen all tokens
@@ -774,6 +949,7 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
   // the tokens are now owned here, in final_toks, and the hash is empty.
   // 'owned' is a complex thing here; the point is we need to call DeleteElem
   // on each elem 'e' to let toks_ know we're done with them.
+  int32 num_arcs = 0;
   for (Elem *e = final_toks, *e_tail; e != NULL; e = e_tail) {
     // loop this way because we delete "e" as we go.
     StateId state = e->key;
@@ -784,6 +960,7 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
            aiter.Next()) {
         const Arc &arc = aiter.Value();
         if (arc.ilabel != 0) {  // propagate..
+          num_arcs++;
           BaseFloat ac_cost = cost_offset -
               decodable->LogLikelihood(frame, arc.ilabel),
               graph_cost = arc.weight.Value(),
@@ -799,32 +976,34 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
           // NULL: no change indicator needed
 
           // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-          tok->links = new ForwardLinkT(e_next->val, arc.ilabel, arc.olabel,
-                                        graph_cost, ac_cost, tok->links);
+          tok->links = new (link_pool_.Allocate())
+              ForwardLinkT(e_next->val, arc.ilabel, arc.olabel,
+                           graph_cost, ac_cost, tok->links);
         }
       } // for all arcs
     }
     e_tail = e->tail;
     toks_.Delete(e); // delete Elem
   }
+  cur_frame_stats_.num_emitting_arcs = num_arcs;
   return next_cutoff;
 }
 
-// static inline
-template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::DeleteForwardLinks(Token *tok) {
+// inline
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::DeleteForwardLinks(Token *tok) {
   ForwardLinkT *l = tok->links, *m;
   while (l != NULL) {
     m = l->next;
-    delete l;
+    link_pool_.Delete(l);
     l = m;
   }
   tok->links = NULL;
 }
 
 
-template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::ProcessNonemitting(BaseFloat cutoff) {
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::ProcessNonemitting(BaseFloat cutoff) {
   KALDI_ASSERT(!active_toks_.empty());
   int32 frame = static_cast<int32>(active_toks_.size()) - 2;
   // Note: "frame" is the time-index we just processed, or -1 if
@@ -872,6 +1051,7 @@ void LatticeFasterDecoderTpl<FST, Token>::ProcessNonemitting(BaseFloat cutoff) {
          aiter.Next()) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel == 0) {  // propagate nonemitting only...
+        cur_frame_stats_.num_nonemitting_arcs++;
         BaseFloat graph_cost = arc.weight.Value(),
             tot_cost = cur_cost + graph_cost;
         if (tot_cost < cutoff) {
@@ -880,8 +1060,9 @@ void LatticeFasterDecoderTpl<FST, Token>::ProcessNonemitting(BaseFloat cutoff) {
           Elem *e_new = FindOrAddToken(arc.nextstate, frame + 1, tot_cost,
                                           tok, &changed);
 
-          tok->links = new ForwardLinkT(e_new->val, 0, arc.olabel,
-                                        graph_cost, 0, tok->links);
+          tok->links = new (link_pool_.Allocate())
+              ForwardLinkT(e_new->val, 0, arc.olabel,
+                           graph_cost, 0, tok->links);
 
           // "changed" tells us whether the new token has a different
           // cost from before, or is new [if so, add into queue].
@@ -894,34 +1075,27 @@ void LatticeFasterDecoderTpl<FST, Token>::ProcessNonemitting(BaseFloat cutoff) {
 }
 
 
-template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::DeleteElems(Elem *list) {
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::DeleteElems(Elem *list) {
   for (Elem *e = list, *e_tail; e != NULL; e = e_tail) {
     e_tail = e->tail;
     toks_.Delete(e);
   }
 }
 
-template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::ClearActiveTokens() { // a cleanup routine, at utt end/begin
-  for (size_t i = 0; i < active_toks_.size(); i++) {
-    // Delete all tokens alive on this frame, and any forward
-    // links they may have.
-    for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
-      DeleteForwardLinks(tok);
-      Token *next_tok = tok->next;
-      delete tok;
-      num_toks_--;
-      tok = next_tok;
-    }
-  }
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::ClearActiveTokens() { // a cleanup routine, at utt end/begin
+  // All the tokens, and their forward links, are in the lists in
+  // active_toks_, so we free them all at once, keeping the memory for reuse.
   active_toks_.clear();
-  KALDI_ASSERT(num_toks_ == 0);
+  token_pool_.Reset();
+  link_pool_.Reset();
+  num_toks_ = 0;
 }
 
 // static
-template <typename FST, typename Token>
-void LatticeFasterDecoderTpl<FST, Token>::TopSortTokens(
+template <typename FST, typename Token, template <class, class> class HashT>
+void LatticeFasterDecoderTpl<FST, Token, HashT>::TopSortTokens(
     Token *tok_list, std::vector<Token*> *topsorted_list) {
   unordered_map<Token*, int32> token2pos;
   typedef typename unordered_map<Token*, int32>::iterator IterType;
@@ -1004,11 +1178,24 @@ template class LatticeFasterDecoderTpl<fst::Fst<fst::StdArc>, decoder::StdToken>
 template class LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>, decoder::StdToken >;
 template class LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>, decoder::StdToken >;
 template class LatticeFasterDecoderTpl<fst::GrammarFst, decoder::StdToken>;
+template class LatticeFasterDecoderTpl<fst::CsrFst, decoder::StdToken>;
 
 template class LatticeFasterDecoderTpl<fst::Fst<fst::StdArc> , decoder::BackpointerToken>;
 template class LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>, decoder::BackpointerToken >;
 template class LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>, decoder::BackpointerToken >;
 template class LatticeFasterDecoderTpl<fst::GrammarFst, decoder::BackpointerToken>;
+template class LatticeFasterDecoderTpl<fst::CsrFst, decoder::BackpointerToken>;
+
+// With OpenHashList as the hash; the VectorFst and ConstFst versions are
+// needed because the StdFst version casts itself to them.
+template class LatticeFasterDecoderTpl<fst::Fst<fst::StdArc>, decoder::StdToken,
+                                       OpenHashList>;
+template class LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>,
+                                       decoder::StdToken, OpenHashList>;
+template class LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>,
+                                       decoder::StdToken, OpenHashList>;
+template class LatticeFasterDecoderTpl<fst::CsrFst, decoder::StdToken,
+                                       OpenHashList>;
 
 
 } // end namespace kaldi.
@@ -26,6 +26,9 @@
 
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
+#include "util/open-hash-list.h"
+#include "util/memory-budget.h"
+#include "util/memory-pool.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
@@ -45,6 +48,7 @@ struct LatticeFasterDecoderConfig {
                             // command-line program.
   BaseFloat beam_delta; // has nothing to do with beam_ratio
   BaseFloat hash_ratio;
+  BaseFloat memory_min_beam_scale;
   BaseFloat prune_scale;   // Note: we don't make this configurable on the command line,
                            // it's not a very important parameter.  It affects the
                            // algorithm that prunes the tokens as we go.
@@ -61,6 +65,7 @@ struct LatticeFasterDecoderConfig {
                                 determinize_lattice(true),
                                 beam_delta(0.5),
                                 hash_ratio(2.0),
+                                memory_min_beam_scale(1.0),
                                 prune_scale(0.1) { }
   void Register(OptionsItf *opts) {
     det_opts.Register(opts);
@@ -80,15 +85,58 @@ struct LatticeFasterDecoderConfig {
                    "max-active constraint is applied.  Larger is more accurate.");
     opts->Register("hash-ratio", &hash_ratio, "Setting used in decoder to "
                    "control hash behavior");
+    opts->Register("memory-min-beam-scale", &memory_min_beam_scale, "If less "
+                   "than 1.0, then while the process is over its memory "
+                   "budget (see MemoryBudget in util/memory-budget.h), the "
+                   "beam and max-active are reduced step by step, down to "
+                   "this factor times their configured values.");
   }
   void Check() const {
     KALDI_ASSERT(beam > 0.0 && max_active > 1 && lattice_beam > 0.0
                  && min_active <= max_active
                  && prune_interval > 0 && beam_delta > 0.0 && hash_ratio >= 1.0
-                 && prune_scale > 0.0 && prune_scale < 1.0);
+                 && prune_scale > 0.0 && prune_scale < 1.0
+                 && memory_min_beam_scale > 0.0 && memory_min_beam_scale <= 1.0);
   }
 };
 
+// Define KALDI_NO_DECODER_STATS to compile out the collection of
+// DecoderFrameStats (see LatticeFasterDecoderTpl::SetFrameStats()).
+#ifdef KALDI_NO_DECODER_STATS
+#define KALDI_DECODER_STATS_ENABLED 0
+#else
+#define KALDI_DECODER_STATS_ENABLED 1
+#endif
+
+/// Statistics of the search on one frame, as collected by
+/// LatticeFasterDecoderTpl if it is given a vector to put them in with
+/// SetFrameStats().  They are intended for tuning --beam, --max-active and
+/// --lattice-beam; see also OnlineTimingStats::AddDecoderStats().
+struct DecoderFrameStats {
+  // The number of tokens on the previous frame, before pruning with the beam
+  // and --max-active.
+  int32 num_active_tokens;
+  // The number of emitting arcs expanded, i.e. leaving the tokens within the
+  // cutoff.
+  int32 num_emitting_arcs;
+  // The number of nonemitting arcs expanded (including those visited more
+  // than once).
+  int32 num_nonemitting_arcs;
+  // The number of tokens freed by PruneActiveTokens() before this frame
+  // (nonzero only every --prune-interval frames).
+  int32 num_tokens_pruned;
+  // The total number of tokens in the lattice after this frame.
+  int32 num_lattice_tokens;
+  // The time taken by ProcessEmitting() (including the computation of the
+  // likelihoods by the decodable object) and ProcessNonemitting().
+  float emitting_seconds;
+  float nonemitting_seconds;
+  DecoderFrameStats(): num_active_tokens(0), num_emitting_arcs(0),
+                       num_nonemitting_arcs(0), num_tokens_pruned(0),
+                       num_lattice_tokens(0), emitting_seconds(0.0),
+                       nonemitting_seconds(0.0) { }
+};
+
 namespace decoder {
 // We will template the decoder on the token type as well as the FST type; this
 // is a mechanism so that we can use the same underlying decoder code for
@@ -217,13 +265,21 @@ struct BackpointerToken {
    quick lookup of the current best path (see lattice-faster-online-decoder.h)
 
    The FST you invoke this decoder which is expected to equal
-   Fst::Fst<fst::StdArc>, a.k.a. StdFst, or GrammarFst.  If you invoke it with
-   FST == StdFst and it notices that the actual FST type is
+   Fst::Fst<fst::StdArc>, a.k.a. StdFst, or GrammarFst, or CsrFst (a compact
+   copy of an FST that is faster to traverse, see fstext/csr-fst.h).  If you
+   invoke it with FST == StdFst and it notices that the actual FST type is
    fst::VectorFst<fst::StdArc> or fst::ConstFst<fst::StdArc>, the decoder object
    will internally cast itself to one that is templated on those more specific
    types; this is an optimization for speed.
+
+   HashT is the type of the hash from state to token for the current frame:
+   HashList (see util/hash-list.h), or OpenHashList (see
+   util/open-hash-list.h), which is faster when there are many active tokens
+   (tens of thousands) but a little slower when there are few; see
+   util/hash-list-speed-test.cc.
  */
-template <typename FST, typename Token = decoder::StdToken>
+template <typename FST, typename Token = decoder::StdToken,
+          template <class, class> class HashT = HashList>
 class LatticeFasterDecoderTpl {
  public:
   using Arc = typename FST::Arc;
@@ -247,10 +303,31 @@ class LatticeFasterDecoderTpl {
     config_ = config;
   }
 
+  /// If 'stats' is non-NULL, AdvanceDecoding() will append the statistics of
+  /// each frame it decodes to it (the caller should clear it between
+  /// utterances).  Collecting them costs a few timer calls per frame; it is
+  /// compiled out if KALDI_NO_DECODER_STATS is defined.  The vector is not
+  /// owned here.
+  void SetFrameStats(std::vector<DecoderFrameStats> *stats) {
+    frame_stats_ = stats;
+  }
+
   const LatticeFasterDecoderConfig &GetOptions() const {
     return config_;
   }
 
+  /// Scales the beam and max-active used from the next frame on by 'scale',
+  /// which must be in (0, 1]; this is for controllers that trade accuracy
+  /// for speed under load (see OnlineBeamController).  It is combined with
+  /// any reduction due to --memory-min-beam-scale.  It persists across calls
+  /// to InitDecoding().
+  void SetBeamScale(BaseFloat scale) {
+    KALDI_ASSERT(scale > 0.0 && scale <= 1.0);
+    external_beam_scale_ = scale;
+  }
+
+  BaseFloat GetBeamScale() const { return external_beam_scale_; }
+
   ~LatticeFasterDecoderTpl();
 
   /// Decodes until there are no more frames left in the "decodable" object..
@@ -288,6 +365,33 @@ class LatticeFasterDecoderTpl {
   /// We could put that here in future needed.
   bool GetRawLattice(Lattice *ofst, bool use_final_probs = true) const;
 
+  /// This is for decoding long streams without keeping the whole lattice in
+  /// memory.  It looks for the latest frame before the current one (and, if
+  /// max_frame >= 0, no later than max_frame, counting frames as in
+  /// NumFramesDecoded()) on which only one token survived lattice pruning, so
+  /// that all paths in the lattice go through that token; this typically
+  /// happens in long silences.  If there is such a frame after
+  /// NumFramesCommitted(), it outputs the raw lattice from NumFramesCommitted()
+  /// up to that frame, with the token on that frame as its only final state
+  /// (with final-prob One()), frees all the tokens before that frame, and
+  /// returns true.  Otherwise it returns false and outputs an empty lattice.
+  ///
+  /// After this, GetRawLattice(), GetBestPath() and so on only cover the
+  /// frames after the commit point, starting from the token it ended on, so
+  /// concatenating the committed lattices and the final lattice gives the
+  /// lattice of the whole stream.  The per-frame bookkeeping (a few bytes
+  /// per frame) is kept, so NumFramesDecoded() is unaffected.  You cannot
+  /// call this after FinalizeDecoding().  With --verbose=4 or more, it checks
+  /// that the committed lattice followed by what GetRawLattice() outputs
+  /// after the commit is equivalent to the lattice before the commit; as
+  /// the second and later commits start from NumFramesCommitted() > 0, this
+  /// exercises the code that handles the freed frames.
+  bool CommitRawLattice(Lattice *ofst, int32 max_frame = -1);
+
+  /// Returns the frame at which the lattice output by GetRawLattice() starts,
+  /// i.e. the last commit point of CommitRawLattice() (zero if it has not
+  /// been called since InitDecoding()).
+  int32 NumFramesCommitted() const { return first_frame_; }
 
 
   /// [Deprecated, users should now use GetRawLattice and determinize it
@@ -348,7 +452,7 @@ class LatticeFasterDecoderTpl {
   // internals.
 
   // Deletes the elements of the singly linked list tok->links.
-  inline static void DeleteForwardLinks(Token *tok);
+  inline void DeleteForwardLinks(Token *tok);
 
   // head of per-frame list of Tokens (list is in topological order),
   // and something saying whether we ever pruned it using PruneForwardLinks.
@@ -360,7 +464,7 @@ class LatticeFasterDecoderTpl {
                  must_prune_tokens(true) { }
   };
 
-  using Elem = typename HashList<StateId, Token*>::Elem;
+  using Elem = typename HashT<StateId, Token*>::Elem;
   // Equivalent to:
   //  struct Elem {
   //    StateId key;
@@ -452,18 +556,42 @@ class LatticeFasterDecoderTpl {
   /// preceding ProcessEmitting().
   void ProcessNonemitting(BaseFloat cost_cutoff);
 
-  // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
+  // HashList defined in ../util/hash-list.h (or OpenHashList, which has the
+  // same interface).  It actually allows us to maintain
   // more than one list (e.g. for current and previous frames), but only one of
   // them at a time can be indexed by StateId.  It is indexed by frame-index
   // plus one, where the frame-index is zero-based, as used in decodable object.
   // That is, the emitting probs of frame t are accounted for in tokens at
   // toks_[t+1].  The zeroth frame is for nonemitting transition at the start of
   // the graph.
-  HashList<StateId, Token*> toks_;
+  HashT<StateId, Token*> toks_;
 
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
+  // The lists before first_frame_ are empty, as their tokens were freed by
+  // CommitRawLattice().
+  int32 first_frame_;
+  // Tokens and ForwardLinks are allocated from these pools rather than with
+  // new and delete.  ClearActiveTokens() frees all of them at once with
+  // Reset(), keeping the memory, so after the first few utterances decoding
+  // does no memory allocation for them.
+  MemoryPool<Token> token_pool_;
+  MemoryPool<ForwardLinkT> link_pool_;
+  // The memory used by the tokens and links, as reported to
+  // MemoryBudget::Global() by UpdateMemoryUsage().
+  MemoryAccount token_memory_;
+  MemoryAccount link_memory_;
+  // The factor by which the beam and max-active are currently reduced because
+  // the process is over its memory budget; 1.0 normally.
+  BaseFloat beam_scale_;
+  // The factor set by SetBeamScale(); 1.0 by default.
+  BaseFloat external_beam_scale_;
+
+  // Called once per frame: reports the memory used to MemoryBudget::Global(),
+  // and updates beam_scale_ if config_.memory_min_beam_scale < 1.0.
+  void UpdateMemoryUsage();
+
   std::vector<const Elem* > queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
 
@@ -480,6 +608,14 @@ class LatticeFasterDecoderTpl {
   LatticeFasterDecoderConfig config_;
   int32 num_toks_; // current total #toks allocated...
   bool warned_;
+  bool warned_memory_;  // true if we warned about the memory budget.
+
+  // Set by SetFrameStats(); NULL if we are not collecting statistics.
+  std::vector<DecoderFrameStats> *frame_stats_;
+  // The statistics of the frame being decoded; the arc counts are updated by
+  // ProcessEmitting() and ProcessNonemitting() whether or not frame_stats_ is
+  // set, as that is cheaper than checking.
+  DecoderFrameStats cur_frame_stats_;
 
   /// decoding_finalized_ is true if someone called FinalizeDecoding().  [note,
   /// calling this is optional].  If true, it's forbidden to decode more.  Also,
@@ -193,7 +193,7 @@ bool LatticeFasterOnlineDecoderTpl<FST>::GetRawLatticePruned(
   // an extra frame for the start-state).
   int32 num_frames = this->active_toks_.size() - 1;
   KALDI_ASSERT(num_frames > 0);
-  for (int32 f = 0; f <= num_frames; f++) {
+  for (int32 f = this->first_frame_; f <= num_frames; f++) {
     if (this->active_toks_[f].toks == NULL) {
       KALDI_WARN << "No tokens active on frame " << f
                  << ": not producing lattice.\n";
@@ -203,13 +203,13 @@ bool LatticeFasterOnlineDecoderTpl<FST>::GetRawLatticePruned(
   unordered_map<Token*, StateId> tok_map;
   std::queue<std::pair<Token*, int32> > tok_queue;
   // First initialize the queue and states.  Put the initial state on the queue;
-  // this is the last token in the list active_toks_[0].toks.
-  for (Token *tok = this->active_toks_[0].toks;
+  // this is the last token in the list active_toks_[first_frame_].toks.
+  for (Token *tok = this->active_toks_[this->first_frame_].toks;
        tok != NULL; tok = tok->next) {
     if (tok->next == NULL) {
       tok_map[tok] = ofst->AddState();
       ofst->SetStart(tok_map[tok]);
-      std::pair<Token*, int32> tok_pair(tok, 0);  // #frame = 0
+      std::pair<Token*, int32> tok_pair(tok, this->first_frame_);
       tok_queue.push(tok_pair);
     }
   }
@@ -271,6 +271,7 @@ template class LatticeFasterOnlineDecoderTpl<fst::Fst<fst::StdArc> >;
 template class LatticeFasterOnlineDecoderTpl<fst::VectorFst<fst::StdArc> >;
 template class LatticeFasterOnlineDecoderTpl<fst::ConstFst<fst::StdArc> >;
 template class LatticeFasterOnlineDecoderTpl<fst::GrammarFst>;
+template class LatticeFasterOnlineDecoderTpl<fst::CsrFst>;
 
 
 } // end namespace kaldi.
@@ -0,0 +1,74 @@
+// decoder/lazy-hclg.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/lazy-hclg.h"
+
+namespace fst {
+
+const char kaldi_olabel_lookahead_fst_type[] = "kaldi_olabel_lookahead";
+
+}  // namespace fst
+
+
+namespace kaldi {
+
+LazyHclg::LazyHclg(const LazyHclgOptions &opts,
+                   const fst::Fst<fst::StdArc> &hcl,
+                   fst::VectorFst<fst::StdArc> *g):
+    hcl_(NULL), fst_(NULL) {
+  using namespace fst;
+  typedef StdArc Arc;
+  KALDI_ASSERT(opts.compose_cache_size > 0);
+  CacheOptions cache_opts(true, opts.compose_cache_size);
+
+  if (opts.lookahead) {
+    // Converting HCL to the lookahead type computes, for each state, the set
+    // of output labels reachable from it, and relabels the output labels so
+    // that these sets are intervals.  G's input labels have to be relabeled in
+    // the same way.
+    StdOLabelLookAheadConstFst *hcl_lookahead =
+        new StdOLabelLookAheadConstFst(hcl);
+    hcl_ = hcl_lookahead;
+    LabelLookAheadRelabeler<Arc>::Relabel(g, *hcl_lookahead, true);
+    ArcSort(g, ILabelCompare<Arc>());
+    // Because the matcher of hcl_lookahead is a lookahead matcher, ComposeFst
+    // uses the lookahead composition filter (with label and weight pushing).
+    fst_ = new ComposeFst<Arc>(*hcl_lookahead, *g, cache_opts);
+    if (fst_->Properties(kError, true))
+      KALDI_ERR << "Lookahead composition of HCL with G failed.";
+  } else {
+    // The table matcher does not need the output of HCL to be sorted.
+    typedef Fst<Arc> F;
+    hcl_ = new ConstFst<Arc>(hcl);
+    ArcSort(g, ILabelCompare<Arc>());
+    ComposeFstImplOptions<TableMatcher<F>, SortedMatcher<F> >
+        impl_opts(cache_opts);
+    impl_opts.matcher1 = new TableMatcher<F>(*hcl_, MATCH_OUTPUT,
+                                             opts.table_opts);
+    fst_ = new ComposeFst<Arc>(*hcl_, *g, impl_opts);
+  }
+  KALDI_LOG << "Composing HCL with G on the fly"
+            << (opts.lookahead ? " using label lookahead" : "")
+            << ", with a cache of " << opts.compose_cache_size << " bytes.";
+}
+
+LazyHclg::~LazyHclg() {
+  delete fst_;
+  delete hcl_;
+}
+
+}  // namespace kaldi
@@ -0,0 +1,121 @@
+// decoder/lazy-hclg.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_LAZY_HCLG_H_
+#define KALDI_DECODER_LAZY_HCLG_H_
+
+/**
+   This header implements decoding with a graph HCLG that is never built
+   explicitly: we compose HCL with G lazily, as the decoder visits the states.
+   This avoids building (and storing) the static HCLG, which for very large
+   vocabularies and language models can be tens of gigabytes.
+
+   HCL is the composition of H, C and L (with L_disambig, as when building
+   HCLG; it may be determinized and minimized as usual), after removing the
+   disambiguation symbols from its input side, e.g. with
+     fstrmsymbols --remove-from-output=false disambig_tid.int HCL.fst
+   Its output side keeps the #0 symbol, which G (as produced by arpa2fst
+   --disambig-symbol=#0) has on the input side of its backoff arcs.
+ */
+
+#include "fst/fstlib.h"
+#include "fst/matcher-fst.h"
+#include "base/kaldi-common.h"
+#include "itf/options-itf.h"
+#include "fstext/table-matcher.h"
+
+namespace fst {
+
+// The FST type of an HCL that has been prepared for output-label lookahead
+// composition.  This is the same as OpenFst's StdOLabelLookAheadFst, except
+// for the type name: the name of that type is defined in OpenFst's optional
+// lookahead extension library, which Kaldi does not link against.
+extern const char kaldi_olabel_lookahead_fst_type[];
+typedef MatcherFst<ConstFst<StdArc>,
+                   LabelLookAheadMatcher<SortedMatcher<ConstFst<StdArc> >,
+                                         olabel_lookahead_flags,
+                                         FastLogAccumulator<StdArc> >,
+                   kaldi_olabel_lookahead_fst_type,
+                   LabelLookAheadRelabeler<StdArc> > StdOLabelLookAheadConstFst;
+
+}  // namespace fst
+
+
+namespace kaldi {
+
+struct LazyHclgOptions {
+  bool lookahead;
+  int64 compose_cache_size;
+  fst::TableMatcherOptions table_opts;
+
+  LazyHclgOptions(): lookahead(true), compose_cache_size(1 << 30) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("lookahead", &lookahead, "If true, compose HCL with G "
+                   "using output-label lookahead, which prunes paths through "
+                   "HCL that cannot be matched by G and pushes the G weights "
+                   "forward, so that they become available to the beam "
+                   "pruning before the word label is reached.  If false, "
+                   "a table matcher is used on the output of HCL.");
+    opts->Register("compose-cache-size", &compose_cache_size, "Maximum "
+                   "memory in bytes used for caching the expanded states of "
+                   "the lazily composed graph; states are discarded when "
+                   "it is exceeded (and recomputed if they are visited "
+                   "again).");
+    opts->Register("table-ratio", &table_opts.table_ratio, "Only relevant "
+                   "if --lookahead=false; see TableMatcherOptions.");
+    opts->Register("min-table-size", &table_opts.min_table_size, "Only "
+                   "relevant if --lookahead=false; see TableMatcherOptions.");
+  }
+};
+
+
+/**
+   This class holds the lazily computed composition of HCL with G, which can be
+   given to the decoders templated on fst::Fst<fst::StdArc> (for example,
+   LatticeFasterDecoder).  The expanded states are cached across utterances,
+   subject to the limit opts.compose_cache_size.
+
+   This class is not thread-safe: use one object per decoding thread.
+ */
+class LazyHclg {
+ public:
+  /// Constructor.  'hcl' only needs to exist during the constructor.  'g' is
+  /// modified (its input labels are sorted, and with lookahead, also
+  /// relabeled to match the relabeled HCL) and must outlive this object.
+  LazyHclg(const LazyHclgOptions &opts,
+           const fst::Fst<fst::StdArc> &hcl,
+           fst::VectorFst<fst::StdArc> *g);
+
+  ~LazyHclg();
+
+  /// Returns the composed graph.
+  const fst::Fst<fst::StdArc> &Fst() const { return *fst_; }
+
+ private:
+  // The HCL as a ConstFst, or as a lookahead FST; owned here, and referred to
+  // by fst_.
+  fst::Fst<fst::StdArc> *hcl_;
+  fst::ComposeFst<fst::StdArc> *fst_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LazyHclg);
+};
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_LAZY_HCLG_H_
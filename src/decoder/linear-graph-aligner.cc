@@ -0,0 +1,259 @@
+// decoder/linear-graph-aligner.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+
+#include "decoder/linear-graph-aligner.h"
+#include "util/stl-utils.h"
+
+namespace kaldi {
+
+
+bool LinearGraphAligner::Init(const fst::VectorFst<fst::StdArc> &fst) {
+  typedef fst::StdArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Weight Weight;
+  loop_label_.clear();
+  loop_cost_.clear();
+  fwd_label_.clear();
+  fwd_cost_.clear();
+  StateId s = fst.Start();
+  if (s == fst::kNoStateId)
+    return false;
+  std::vector<bool> visited(fst.NumStates(), false);
+  while (true) {
+    visited[s] = true;
+    int32 loop_label = 0;
+    BaseFloat loop_cost = 0.0;
+    bool has_fwd = false;
+    Arc fwd;
+    for (fst::ArcIterator<fst::VectorFst<Arc> > aiter(fst, s);
+         !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel == 0)
+        return false;
+      if (arc.nextstate == s) {
+        if (loop_label != 0)
+          return false;
+        loop_label = arc.ilabel;
+        loop_cost = arc.weight.Value();
+      } else {
+        if (has_fwd || visited[arc.nextstate])
+          return false;
+        has_fwd = true;
+        fwd = arc;
+      }
+    }
+    loop_label_.push_back(loop_label);
+    loop_cost_.push_back(loop_cost);
+    if (!has_fwd) {
+      if (fst.Final(s) == Weight::Zero())
+        return false;
+      final_cost_ = fst.Final(s).Value();
+      return true;
+    }
+    if (fst.Final(s) != Weight::Zero())
+      return false;
+    fwd_label_.push_back(fwd.ilabel);
+    fwd_cost_.push_back(fwd.weight.Value());
+    s = fwd.nextstate;
+  }
+}
+
+
+double LinearGraphAligner::Forward(DecodableInterface *decodable,
+                                   BaseFloat beam, bool viterbi) {
+  const double inf = std::numeric_limits<double>::infinity();
+  const BaseFloat float_inf = std::numeric_limits<BaseFloat>::infinity();
+  int32 N = fwd_label_.size(), T = decodable->NumFramesReady();
+  band_begin_.assign(1, 0);
+  band_end_.assign(1, 1);
+  band_offset_.assign(1, 0);
+  cost_.assign(1, 0.0);
+  stay_cost_.assign(1, 0.0);
+  move_cost_.assign(1, 0.0);
+  from_prev_.assign(1, 0);
+  if (N > T)  // each arc to the next position takes a frame.
+    return inf;
+
+  for (int32 t = 0; t < T; t++) {
+    int32 prev_begin = band_begin_[t], prev_end = band_end_[t],
+        prev_offset = band_offset_[t];
+    // The positions reachable after t+1 frames from which the end can still
+    // be reached in the remaining T-t-1 frames.
+    int32 begin = std::max(prev_begin, N - (T - t - 1)),
+        end = std::min(prev_end + 1, N + 1);
+    if (begin >= end)
+      return inf;
+    int32 offset = cost_.size(), size = end - begin;
+    cost_.resize(offset + size);
+    stay_cost_.resize(offset + size);
+    move_cost_.resize(offset + size);
+    if (viterbi)
+      from_prev_.resize(offset + size);
+    BaseFloat *stay = &(stay_cost_[offset]), *move = &(move_cost_[offset]);
+    // The arc costs; this is where the decodable object is called.
+    for (int32 k = begin; k < end; k++) {
+      int32 i = k - begin;
+      stay[i] = (k < prev_end && loop_label_[k] != 0 ?
+                 loop_cost_[k] - decodable->LogLikelihood(t, loop_label_[k]) :
+                 float_inf);
+      move[i] = (k > prev_begin ?
+                 fwd_cost_[k - 1] - decodable->LogLikelihood(t,
+                                                             fwd_label_[k - 1]) :
+                 float_inf);
+    }
+    // The recursion itself only looks at contiguous arrays.
+    const double *prev = &(cost_[prev_offset]);
+    double *cur = &(cost_[offset]), best = inf;
+    int32 j = begin - prev_begin;  // index in 'prev' of position 'begin'.
+    for (int32 i = 0; i < size; i++, j++) {
+      double s = (j < prev_end - prev_begin ? prev[j] + stay[i] : inf),
+          m = (j > 0 ? prev[j - 1] + move[i] : inf);
+      if (viterbi) {
+        from_prev_[offset + i] = (m < s);
+        cur[i] = std::min(s, m);
+      } else if (s == inf) {
+        cur[i] = m;
+      } else if (m == inf) {
+        cur[i] = s;
+      } else {
+        cur[i] = -LogAdd(-s, -m);
+      }
+      best = std::min(best, cur[i]);
+    }
+    if (best == inf)
+      return inf;
+
+    // Prune the ends of the band.
+    double cutoff = best + beam;
+    int32 new_begin = begin, new_end = end;
+    while (cur[new_begin - begin] > cutoff)
+      new_begin++;
+    while (cur[new_end - 1 - begin] > cutoff)
+      new_end--;
+    if (new_begin != begin || new_end != end) {
+      int32 shift = new_begin - begin, new_size = new_end - new_begin;
+      std::copy(cost_.begin() + offset + shift,
+                cost_.begin() + offset + shift + new_size,
+                cost_.begin() + offset);
+      std::copy(stay_cost_.begin() + offset + shift,
+                stay_cost_.begin() + offset + shift + new_size,
+                stay_cost_.begin() + offset);
+      std::copy(move_cost_.begin() + offset + shift,
+                move_cost_.begin() + offset + shift + new_size,
+                move_cost_.begin() + offset);
+      cost_.resize(offset + new_size);
+      stay_cost_.resize(offset + new_size);
+      move_cost_.resize(offset + new_size);
+      if (viterbi) {
+        std::copy(from_prev_.begin() + offset + shift,
+                  from_prev_.begin() + offset + shift + new_size,
+                  from_prev_.begin() + offset);
+        from_prev_.resize(offset + new_size);
+      }
+    }
+    band_begin_.push_back(new_begin);
+    band_end_.push_back(new_end);
+    band_offset_.push_back(offset);
+  }
+  if (band_end_[T] != N + 1)
+    return inf;
+  return cost_[band_offset_[T] + N - band_begin_[T]] + final_cost_;
+}
+
+
+bool LinearGraphAligner::Align(DecodableInterface *decodable, BaseFloat beam,
+                               std::vector<int32> *alignment, BaseFloat *cost,
+                               Vector<BaseFloat> *per_frame_acoustic_costs) {
+  double total_cost = Forward(decodable, beam, true);
+  if (total_cost == std::numeric_limits<double>::infinity())
+    return false;
+  int32 T = decodable->NumFramesReady(), k = fwd_label_.size();
+  alignment->resize(T);
+  if (per_frame_acoustic_costs != NULL)
+    per_frame_acoustic_costs->Resize(T);
+  for (int32 t = T; t > 0; t--) {
+    int32 i = band_offset_[t] + k - band_begin_[t];
+    BaseFloat acoustic_cost;
+    if (from_prev_[i]) {
+      k--;
+      (*alignment)[t - 1] = fwd_label_[k];
+      acoustic_cost = move_cost_[i] - fwd_cost_[k];
+    } else {
+      (*alignment)[t - 1] = loop_label_[k];
+      acoustic_cost = stay_cost_[i] - loop_cost_[k];
+    }
+    if (per_frame_acoustic_costs != NULL)
+      (*per_frame_acoustic_costs)(t - 1) = acoustic_cost;
+  }
+  KALDI_ASSERT(k == 0);
+  *cost = total_cost;
+  return true;
+}
+
+
+bool LinearGraphAligner::ComputePosteriors(DecodableInterface *decodable,
+                                           BaseFloat beam, Posterior *post,
+                                           BaseFloat *cost) {
+  const double inf = std::numeric_limits<double>::infinity();
+  double total_cost = Forward(decodable, beam, false);
+  if (total_cost == inf)
+    return false;
+  int32 T = decodable->NumFramesReady(), N = fwd_label_.size();
+  post->clear();
+  post->resize(T);
+  // next_beta[k - band_begin_[t + 1]] is the cost of getting from position k
+  // after t+1 frames to the end.
+  std::vector<double> next_beta(band_end_[T] - band_begin_[T], inf), beta;
+  next_beta.back() = final_cost_;  // band_end_[T] is N + 1.
+  for (int32 t = T - 1; t >= 0; t--) {
+    int32 begin = band_begin_[t], end = band_end_[t],
+        next_begin = band_begin_[t + 1], next_end = band_end_[t + 1],
+        next_offset = band_offset_[t + 1];
+    const double *alpha = &(cost_[band_offset_[t]]);
+    beta.assign(end - begin, inf);
+    for (int32 k = begin; k < end; k++) {
+      double s = inf, m = inf;
+      if (k >= next_begin && k < next_end) {
+        int32 i = k - next_begin;
+        s = stay_cost_[next_offset + i] + next_beta[i];
+        if (s != inf)
+          (*post)[t].push_back(std::make_pair(
+              loop_label_[k],
+              static_cast<BaseFloat>(Exp(total_cost - alpha[k - begin] - s))));
+      }
+      if (k < N && k + 1 >= next_begin && k + 1 < next_end) {
+        int32 i = k + 1 - next_begin;
+        m = move_cost_[next_offset + i] + next_beta[i];
+        if (m != inf)
+          (*post)[t].push_back(std::make_pair(
+              fwd_label_[k],
+              static_cast<BaseFloat>(Exp(total_cost - alpha[k - begin] - m))));
+      }
+      beta[k - begin] = (s == inf ? m : (m == inf ? s : -LogAdd(-s, -m)));
+    }
+    MergePairVectorSumming(&((*post)[t]));
+    next_beta.swap(beta);
+  }
+  *cost = total_cost;
+  return true;
+}
+
+
+}  // namespace kaldi
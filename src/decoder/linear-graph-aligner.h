@@ -0,0 +1,107 @@
+// decoder/linear-graph-aligner.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_LINEAR_GRAPH_ALIGNER_H_
+#define KALDI_DECODER_LINEAR_GRAPH_ALIGNER_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "fst/fstlib.h"
+#include "hmm/posterior.h"
+#include "itf/decodable-itf.h"
+#include "matrix/kaldi-vector.h"
+
+namespace kaldi {
+
+/**
+   LinearGraphAligner does forced alignment (Viterbi) and forward-backward on
+   training graphs that are a simple chain: each state has at most one
+   self-loop and one arc to the next state, all with transition-ids on the
+   input side, and only the last state is final.  This is what
+   compile-train-graphs produces for a transcript when the lexicon has a single
+   pronunciation for each word and no optional silence.  For such graphs the
+   search is a dynamic program over (frame, position in the chain) in which
+   each frame only looks at positions k and k-1, so it is done with contiguous
+   arrays over the band of positions that are within the beam, instead of the
+   hash and tokens of FasterDecoder.  It gives the same alignment as
+   FasterDecoder when the beam is large enough (e.g. the default --beam=200
+   of the alignment programs).
+
+   The costs are those of the graph arcs plus the negated log-likelihoods from
+   the decodable object (so any acoustic scale is as in the decodable).
+*/
+class LinearGraphAligner {
+ public:
+  LinearGraphAligner(): final_cost_(0.0) { }
+
+  /// Returns true if 'fst' is a chain as described above, in which case it
+  /// stores it for Align() and ComputePosteriors(); else returns false.
+  bool Init(const fst::VectorFst<fst::StdArc> &fst);
+
+  /// Finds the best path, keeping at each frame the positions whose cost is
+  /// within 'beam' of the best.  Returns false if no path reached the end of
+  /// the chain at the last frame.  On success outputs the transition-id of
+  /// each frame to 'alignment', the total cost to 'cost' and, if
+  /// 'per_frame_acoustic_costs' is non-NULL, the acoustic cost of each frame.
+  bool Align(DecodableInterface *decodable, BaseFloat beam,
+             std::vector<int32> *alignment, BaseFloat *cost,
+             Vector<BaseFloat> *per_frame_acoustic_costs);
+
+  /// Does forward-backward with the same pruning as Align(), and outputs the
+  /// posteriors of the transition-ids on each frame to 'post' and the total
+  /// cost (negated log of the sum over paths) to 'cost'.  Returns false if no
+  /// path reached the end of the chain.
+  bool ComputePosteriors(DecodableInterface *decodable, BaseFloat beam,
+                         Posterior *post, BaseFloat *cost);
+
+ private:
+  // The forward pass used by both of the functions above; if 'viterbi' it
+  // takes the min over the incoming arcs and records which one was used in
+  // from_prev_, else it log-adds them.  Returns the total cost, or infinity if
+  // the end of the chain was not reached.
+  double Forward(DecodableInterface *decodable, BaseFloat beam, bool viterbi);
+
+  // The chain: position k (0 <= k <= N, where N = fwd_label_.size()) is the
+  // k'th state.  Position k has a self-loop with transition-id loop_label_[k]
+  // (or 0 if it has none) and cost loop_cost_[k], and for k < N an arc to
+  // position k+1 with transition-id fwd_label_[k] and cost fwd_cost_[k].
+  std::vector<int32> loop_label_;
+  std::vector<BaseFloat> loop_cost_;
+  std::vector<int32> fwd_label_;
+  std::vector<BaseFloat> fwd_cost_;
+  BaseFloat final_cost_;
+
+  // The following are set by Forward().  band_begin_[t] and band_end_[t] are
+  // the range of positions kept after t frames, and the entries for position
+  // k in that range are at index band_offset_[t] + k - band_begin_[t] of the
+  // following arrays: 'cost_' is the forward cost; 'stay_cost_' and
+  // 'move_cost_' are the costs (graph plus acoustic) of the arcs by which
+  // frame t-1 got to k, from k and from k-1 respectively; and, for Viterbi,
+  // 'from_prev_' is nonzero if the best path came from k-1.
+  std::vector<int32> band_begin_;
+  std::vector<int32> band_end_;
+  std::vector<int32> band_offset_;
+  std::vector<double> cost_;
+  std::vector<BaseFloat> stay_cost_;
+  std::vector<BaseFloat> move_cost_;
+  std::vector<char> from_prev_;
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_LINEAR_GRAPH_ALIGNER_H_
@@ -19,6 +19,7 @@
 // limitations under the License.
 #include "decoder/training-graph-compiler.h"
 #include "hmm/hmm-utils.h" // for GetHTransducer
+#include "util/kaldi-thread.h"
 
 namespace kaldi {
 
@@ -29,7 +30,7 @@ TrainingGraphCompiler::TrainingGraphCompiler(const TransitionModel &trans_model,
                                              const std::vector<int32> &disambig_syms,
                                              const TrainingGraphCompilerOptions &opts):
     trans_model_(trans_model), ctx_dep_(ctx_dep), lex_fst_(lex_fst),
-    disambig_syms_(disambig_syms), opts_(opts) {
+    disambig_syms_(disambig_syms), opts_(opts), num_cache_hits_(0) {
   using namespace fst;
   const std::vector<int32> &phone_syms = trans_model_.GetPhones();  // needed to create context fst.
 
@@ -61,13 +62,44 @@ TrainingGraphCompiler::TrainingGraphCompiler(const TransitionModel &trans_model,
   }
 }
 
+TrainingGraphCompiler::~TrainingGraphCompiler() {
+  for (GraphCache::iterator iter = graph_cache_.begin();
+       iter != graph_cache_.end(); ++iter)
+    delete iter->second;
+  delete lex_fst_;
+}
+
+const fst::VectorFst<fst::StdArc> *TrainingGraphCompiler::GetCachedGraph(
+    const std::vector<int32> &transcript) {
+  GraphCache::const_iterator iter = graph_cache_.find(transcript);
+  if (iter == graph_cache_.end())
+    return NULL;
+  num_cache_hits_++;
+  return iter->second;
+}
+
+void TrainingGraphCompiler::CacheGraph(const std::vector<int32> &transcript,
+                                       const fst::VectorFst<fst::StdArc> &fst) {
+  if (static_cast<int32>(graph_cache_.size()) < opts_.max_cached_graphs &&
+      graph_cache_.count(transcript) == 0)
+    graph_cache_[transcript] = new fst::VectorFst<fst::StdArc>(fst);
+}
+
 bool TrainingGraphCompiler::CompileGraphFromText(
     const std::vector<int32> &transcript,
     fst::VectorFst<fst::StdArc> *out_fst) {
   using namespace fst;
+  const VectorFst<StdArc> *cached = GetCachedGraph(transcript);
+  if (cached != NULL) {
+    *out_fst = *cached;
+    return true;
+  }
   VectorFst<StdArc> word_fst;
   MakeLinearAcceptor(transcript, &word_fst);
-  return CompileGraph(word_fst, out_fst);
+  if (!CompileGraph(word_fst, out_fst))
+    return false;
+  CacheGraph(transcript, *out_fst);
+  return true;
 }
 
 bool TrainingGraphCompiler::CompileGraph(const fst::VectorFst<fst::StdArc> &word_fst,
@@ -108,8 +140,19 @@ bool TrainingGraphCompiler::CompileGraph(const fst::VectorFst<fst::StdArc> &word
                                         h_cfg,
                                         &disambig_syms_h);
 
-  VectorFst<StdArc> &trans2word_fst = *out_fst;  // transition-id to word.
-  TableCompose(*H, ctx2word_fst, &trans2word_fst);
+  *out_fst = ctx2word_fst;
+  CompileGraphWithH(*H, disambig_syms_h, out_fst);
+  delete H;
+  return true;
+}
+
+void TrainingGraphCompiler::CompileGraphWithH(
+    const fst::VectorFst<fst::StdArc> &H,
+    const std::vector<int32> &disambig_syms_h,
+    fst::VectorFst<fst::StdArc> *fst) const {
+  using namespace fst;
+  VectorFst<StdArc> trans2word_fst;  // transition-id to word.
+  TableCompose(H, *fst, &trans2word_fst);
 
   KALDI_ASSERT(trans2word_fst.Start() != kNoStateId);
 
@@ -124,7 +167,6 @@ bool TrainingGraphCompiler::CompileGraph(const fst::VectorFst<fst::StdArc> &word
       RemoveEpsLocal(&trans2word_fst);
   }
 
-
   // Encoded minimization.
   MinimizeEncoded(&trans2word_fst);
 
@@ -137,8 +179,8 @@ bool TrainingGraphCompiler::CompileGraph(const fst::VectorFst<fst::StdArc> &word
                check_no_self_loops,
                &trans2word_fst);
 
-  delete H;
-  return true;
+  KALDI_ASSERT(trans2word_fst.Start() != kNoStateId);
+  *fst = trans2word_fst;
 }
 
 
@@ -146,16 +188,57 @@ bool TrainingGraphCompiler::CompileGraphsFromText(
     const std::vector<std::vector<int32> > &transcripts,
     std::vector<fst::VectorFst<fst::StdArc>*> *out_fsts) {
   using namespace fst;
-  std::vector<const VectorFst<StdArc>* > word_fsts(transcripts.size());
+  KALDI_ASSERT(out_fsts != NULL && out_fsts->empty());
+  out_fsts->resize(transcripts.size(), NULL);
+  // We compile each distinct transcript that is not in the cache once;
+  // to_compile[j] is the index in 'transcripts' of the j'th of them, and
+  // compiled_index[i] is the j for transcript i, or -1 if it was cached.
+  std::vector<const VectorFst<StdArc>* > word_fsts;
+  std::vector<size_t> to_compile;
+  std::vector<int32> compiled_index(transcripts.size(), -1);
+  std::unordered_map<std::vector<int32>, int32, VectorHasher<int32> > index_of;
+  for (size_t i = 0; i < transcripts.size(); i++) {
+    const VectorFst<StdArc> *cached = GetCachedGraph(transcripts[i]);
+    if (cached != NULL) {
+      (*out_fsts)[i] = cached->Copy();
+      continue;
+    }
+    std::pair<std::unordered_map<std::vector<int32>, int32,
+                                 VectorHasher<int32> >::iterator, bool> ret =
+        index_of.insert(std::make_pair(transcripts[i],
+                                       static_cast<int32>(word_fsts.size())));
+    compiled_index[i] = ret.first->second;
+    if (ret.second) {
+      VectorFst<StdArc> *word_fst = new VectorFst<StdArc>();
+      MakeLinearAcceptor(transcripts[i], word_fst);
+      word_fsts.push_back(word_fst);
+      to_compile.push_back(i);
+    }
+  }
+  std::vector<VectorFst<StdArc>* > compiled_fsts;
+  bool ans = CompileGraphs(word_fsts, &compiled_fsts);
+  DeletePointers(&word_fsts);
+  if (!ans) {
+    DeletePointers(&compiled_fsts);
+    DeletePointers(out_fsts);
+    return false;
+  }
+  for (size_t j = 0; j < to_compile.size(); j++)
+    CacheGraph(transcripts[to_compile[j]], *(compiled_fsts[j]));
+  // The first transcript that maps to each compiled graph takes it; any
+  // repeats get copies.
+  std::vector<bool> taken(compiled_fsts.size(), false);
   for (size_t i = 0; i < transcripts.size(); i++) {
-    VectorFst<StdArc> *word_fst = new VectorFst<StdArc>();
-    MakeLinearAcceptor(transcripts[i], word_fst);
-    word_fsts[i] = word_fst;
+    int32 j = compiled_index[i];
+    if (j < 0) continue;
+    if (!taken[j]) {
+      (*out_fsts)[i] = compiled_fsts[j];
+      taken[j] = true;
+    } else {
+      (*out_fsts)[i] = compiled_fsts[j]->Copy();
+    }
   }
-  bool ans = CompileGraphs(word_fsts, out_fsts);
-  for (size_t i = 0; i < transcripts.size(); i++)
-    delete word_fsts[i];
-  return ans;
+  return true;
 }
 
 bool TrainingGraphCompiler::CompileGraphs(
@@ -204,34 +287,21 @@ bool TrainingGraphCompiler::CompileGraphs(
                                         h_cfg,
                                         &disambig_syms_h);
 
-  for (size_t i = 0; i < out_fsts->size(); i++) {
-    VectorFst<StdArc> &ctx2word_fst = *((*out_fsts)[i]);
-    VectorFst<StdArc> trans2word_fst;
-    TableCompose(*H, ctx2word_fst, &trans2word_fst);
-
-    DeterminizeStarInLog(&trans2word_fst);
-
-    if (!disambig_syms_h.empty()) {
-      RemoveSomeInputSymbols(disambig_syms_h, &trans2word_fst);
-      if (opts_.rm_eps)
-        RemoveEpsLocal(&trans2word_fst);
+  if (opts_.num_threads > 1 && out_fsts->size() > 1) {
+    // Each task only reads H; we make sure its properties are all known
+    // first, so that the compositions don't need to update them.
+    H->Properties(kFstProperties, true);
+    ThreadPool pool(std::min<int32>(opts_.num_threads, out_fsts->size()));
+    for (size_t i = 0; i < out_fsts->size(); i++) {
+      VectorFst<StdArc> *fst = (*out_fsts)[i];
+      pool.Submit([this, H, &disambig_syms_h, fst]() {
+          CompileGraphWithH(*H, disambig_syms_h, fst);
+        });
     }
-
-    // Encoded minimization.
-    MinimizeEncoded(&trans2word_fst);
-
-    std::vector<int32> disambig;
-    bool check_no_self_loops = true;
-    AddSelfLoops(trans_model_,
-                 disambig,
-                 opts_.self_loop_scale,
-                 opts_.reorder,
-                 check_no_self_loops,
-                 &trans2word_fst);
-
-    KALDI_ASSERT(trans2word_fst.Start() != kNoStateId);
-
-    *((*out_fsts)[i]) = trans2word_fst;
+    pool.Wait();
+  } else {
+    for (size_t i = 0; i < out_fsts->size(); i++)
+      CompileGraphWithH(*H, disambig_syms_h, (*out_fsts)[i]);
   }
 
   delete H;
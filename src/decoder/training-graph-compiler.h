@@ -20,11 +20,15 @@
 #ifndef KALDI_DECODER_TRAINING_GRAPH_COMPILER_H_
 #define KALDI_DECODER_TRAINING_GRAPH_COMPILER_H_
 
+#include <unordered_map>
+#include <vector>
+
 #include "base/kaldi-common.h"
 #include "hmm/transition-model.h"
 #include "fst/fstlib.h"
 #include "fstext/fstext-lib.h"
 #include "tree/context-dep.h"
+#include "util/stl-utils.h"
 
 
 namespace kaldi {
@@ -35,6 +39,8 @@ struct TrainingGraphCompilerOptions {
   BaseFloat self_loop_scale;
   bool rm_eps;
   bool reorder;  // (Dan-style graphs)
+  int32 num_threads;
+  int32 max_cached_graphs;
 
   explicit TrainingGraphCompilerOptions(BaseFloat transition_scale = 1.0,
                                         BaseFloat self_loop_scale = 1.0,
@@ -42,7 +48,9 @@ struct TrainingGraphCompilerOptions {
       transition_scale(transition_scale),
       self_loop_scale(self_loop_scale),
       rm_eps(false),
-      reorder(b) { }
+      reorder(b),
+      num_threads(1),
+      max_cached_graphs(1000) { }
 
   void Register(OptionsItf *opts) {
     opts->Register("transition-scale", &transition_scale, "Scale of transition "
@@ -52,6 +60,13 @@ struct TrainingGraphCompilerOptions {
     opts->Register("reorder", &reorder, "Reorder transition ids for greater decoding efficiency.");
     opts->Register("rm-eps", &rm_eps,  "Remove [most] epsilons before minimization (only applicable "
                    "if disambig symbols present)");
+    opts->Register("compile-num-threads", &num_threads, "Number of threads "
+                   "used to determinize and minimize the graphs of a batch "
+                   "(see --batch-size, where applicable).");
+    opts->Register("max-cached-graphs", &max_cached_graphs, "Maximum number "
+                   "of graphs compiled from transcripts that are kept, so that "
+                   "repeated transcripts are compiled only once.  Zero "
+                   "disables the cache.");
   }
 };
 
@@ -81,7 +96,10 @@ class TrainingGraphCompiler {
       const std::vector<const fst::VectorFst<fst::StdArc> *> &word_fsts,
       std::vector<fst::VectorFst<fst::StdArc> *> *out_fsts);
 
-  // This version creates an FST from the text and calls CompileGraph.
+  // This version creates an FST from the text and calls CompileGraph.  If
+  // opts.max_cached_graphs > 0, the graphs compiled by this function and by
+  // CompileGraphsFromText() are cached by transcript, so repeated transcripts
+  // are compiled only once.
   bool CompileGraphFromText(const std::vector<int32> &transcript,
                             fst::VectorFst<fst::StdArc> *out_fst);
 
@@ -91,8 +109,26 @@ class TrainingGraphCompiler {
       std::vector<fst::VectorFst<fst::StdArc> *> *out_fsts);
 
 
-  ~TrainingGraphCompiler() { delete lex_fst_; }
+  // Returns the number of graphs that were found in the cache.
+  int64 NumCacheHits() const { return num_cache_hits_; }
+
+  ~TrainingGraphCompiler();
  private:
+  // Composes H with 'fst' (which on entry is the context-dependent graph
+  // C * L * G) and finishes the compilation: determinization, minimization and
+  // the self-loops.  Called from CompileGraphs(), possibly from several threads
+  // at once.
+  void CompileGraphWithH(const fst::VectorFst<fst::StdArc> &H,
+                         const std::vector<int32> &disambig_syms_h,
+                         fst::VectorFst<fst::StdArc> *fst) const;
+
+  // Returns the cached graph for 'transcript', or NULL.
+  const fst::VectorFst<fst::StdArc> *GetCachedGraph(
+      const std::vector<int32> &transcript);
+  // Adds a copy of 'fst' to the cache, if it is not full.
+  void CacheGraph(const std::vector<int32> &transcript,
+                  const fst::VectorFst<fst::StdArc> &fst);
+
   const TransitionModel &trans_model_;
   const ContextDependency &ctx_dep_;
   fst::VectorFst<fst::StdArc> *lex_fst_; // lexicon FST (an input; we take
@@ -104,6 +140,13 @@ class TrainingGraphCompiler {
   // this is one of Dan's extensions.
 
   TrainingGraphCompilerOptions opts_;
+
+  // The graphs compiled from transcripts; see opts_.max_cached_graphs.  When
+  // it is full we simply stop adding to it.
+  typedef std::unordered_map<std::vector<int32>, fst::VectorFst<fst::StdArc>*,
+                             VectorHasher<int32> > GraphCache;
+  GraphCache graph_cache_;
+  int64 num_cache_hits_;
 };
 
 
@@ -0,0 +1,183 @@
+// decoder/training-graph-reader.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/training-graph-reader.h"
+
+namespace kaldi {
+
+SequentialTrainingGraphReader::SequentialTrainingGraphReader(
+    const std::string &rspecifier,
+    const TransitionModel &trans_model,
+    const TrainingGraphReaderOptions &opts):
+    opts_(opts), fst_reader_(NULL), compiler_(NULL),
+    transcript_reader_(NULL), compile_done_(false), stop_(false),
+    current_(NULL), current_index_(0) {
+  if (!opts_.CompileGraphs()) {
+    fst_reader_ = new SequentialTableReader<fst::VectorFstHolder>(rspecifier);
+    return;
+  }
+  if (opts_.tree_rxfilename.empty())
+    KALDI_ERR << "--compile-graphs.lexicon requires --compile-graphs.tree";
+  KALDI_ASSERT(opts_.batch_size > 0 && opts_.batches_ahead > 0);
+  ReadKaldiObject(opts_.tree_rxfilename, &ctx_dep_);
+  // The compiler takes ownership of the lexicon.
+  fst::VectorFst<fst::StdArc> *lex_fst =
+      fst::ReadFstKaldi(opts_.lex_rxfilename);
+  std::vector<int32> disambig_syms;
+  if (!opts_.disambig_rxfilename.empty() &&
+      !ReadIntegerVectorSimple(opts_.disambig_rxfilename, &disambig_syms))
+    KALDI_ERR << "Could not read disambiguation symbols from "
+              << opts_.disambig_rxfilename;
+  // The same options as compile-train-graphs: we will add the transition
+  // probabilities when aligning.
+  TrainingGraphCompilerOptions gopts;
+  gopts.transition_scale = 0.0;
+  gopts.self_loop_scale = 0.0;
+  gopts.num_threads = opts_.num_threads;
+  gopts.max_cached_graphs = opts_.max_cached_graphs;
+  compiler_ = new TrainingGraphCompiler(trans_model, ctx_dep_, lex_fst,
+                                        disambig_syms, gopts);
+  transcript_reader_ = new SequentialInt32VectorReader(rspecifier);
+  compile_thread_ = std::thread(&SequentialTrainingGraphReader::CompileLoop,
+                                this);
+}
+
+SequentialTrainingGraphReader::~SequentialTrainingGraphReader() {
+  if (compile_thread_.joinable()) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    compile_thread_.join();
+  }
+  delete current_;
+  for (size_t i = 0; i < queue_.size(); i++)
+    delete queue_[i];
+  delete transcript_reader_;
+  if (compiler_ != NULL)
+    KALDI_LOG << "Compiled training graphs; " << compiler_->NumCacheHits()
+              << " were repeated transcripts taken from the cache.";
+  delete compiler_;
+  delete fst_reader_;
+}
+
+void SequentialTrainingGraphReader::CompileLoop() {
+  try {
+    std::vector<std::vector<int32> > transcripts;
+    while (!transcript_reader_->Done()) {
+      Batch *batch = new Batch();
+      transcripts.clear();
+      for (; !transcript_reader_->Done() &&
+               static_cast<int32>(transcripts.size()) < opts_.batch_size;
+           transcript_reader_->Next()) {
+        batch->keys.push_back(transcript_reader_->Key());
+        transcripts.push_back(transcript_reader_->Value());
+      }
+      if (!compiler_->CompileGraphsFromText(transcripts, &(batch->fsts)))
+        KALDI_ERR << "Not expecting CompileGraphs to fail.";
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (static_cast<int32>(queue_.size()) >= opts_.batches_ahead &&
+             !stop_)
+        cond_.wait(lock);
+      if (stop_) {
+        delete batch;
+        break;
+      }
+      queue_.push_back(batch);
+      cond_.notify_all();
+    }
+  } catch (const std::exception &e) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    error_ = e.what();
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  compile_done_ = true;
+  cond_.notify_all();
+}
+
+void SequentialTrainingGraphReader::EnsureCurrent() {
+  while (true) {
+    if (current_ != NULL) {
+      // Like compile-train-graphs, skip graphs that came out empty.
+      while (current_index_ < current_->keys.size() &&
+             current_->fsts[current_index_] != NULL &&
+             current_->fsts[current_index_]->Start() == fst::kNoStateId) {
+        KALDI_WARN << "Empty training graph for utterance "
+                   << current_->keys[current_index_];
+        current_index_++;
+      }
+      if (current_index_ < current_->keys.size())
+        return;
+      delete current_;
+      current_ = NULL;
+      current_index_ = 0;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (queue_.empty() && !compile_done_)
+      cond_.wait(lock);
+    if (!error_.empty())
+      KALDI_ERR << "Error compiling training graphs: " << error_;
+    if (queue_.empty())
+      return;  // compile_done_ is true.
+    current_ = queue_.front();
+    queue_.pop_front();
+    cond_.notify_all();
+  }
+}
+
+bool SequentialTrainingGraphReader::Done() {
+  if (fst_reader_ != NULL)
+    return fst_reader_->Done();
+  EnsureCurrent();
+  return current_ == NULL;
+}
+
+std::string SequentialTrainingGraphReader::Key() {
+  if (fst_reader_ != NULL)
+    return fst_reader_->Key();
+  KALDI_ASSERT(!Done());
+  return current_->keys[current_index_];
+}
+
+const fst::VectorFst<fst::StdArc> &SequentialTrainingGraphReader::Value() {
+  if (fst_reader_ != NULL)
+    return fst_reader_->Value();
+  KALDI_ASSERT(!Done() && current_->fsts[current_index_] != NULL);
+  return *(current_->fsts[current_index_]);
+}
+
+void SequentialTrainingGraphReader::FreeCurrent() {
+  if (fst_reader_ != NULL) {
+    fst_reader_->FreeCurrent();
+  } else {
+    KALDI_ASSERT(!Done());
+    delete current_->fsts[current_index_];
+    current_->fsts[current_index_] = NULL;
+  }
+}
+
+void SequentialTrainingGraphReader::Next() {
+  if (fst_reader_ != NULL) {
+    fst_reader_->Next();
+    return;
+  }
+  KALDI_ASSERT(!Done());
+  current_index_++;
+}
+
+}  // namespace kaldi
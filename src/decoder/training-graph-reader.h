@@ -0,0 +1,139 @@
+// decoder/training-graph-reader.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_TRAINING_GRAPH_READER_H_
+#define KALDI_DECODER_TRAINING_GRAPH_READER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "decoder/training-graph-compiler.h"
+#include "fstext/kaldi-fst-io.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+
+struct TrainingGraphReaderOptions {
+  std::string tree_rxfilename;
+  std::string lex_rxfilename;
+  std::string disambig_rxfilename;
+  int32 batch_size;
+  int32 num_threads;
+  int32 batches_ahead;
+  int32 max_cached_graphs;
+
+  TrainingGraphReaderOptions(): batch_size(250), num_threads(1),
+                                batches_ahead(2), max_cached_graphs(1000) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("compile-graphs.lexicon", &lex_rxfilename, "If set, the "
+                   "graphs-rspecifier is read as transcripts (integer word "
+                   "sequences, as for compile-train-graphs) and the training "
+                   "graphs are compiled in-process with this lexicon FST, "
+                   "rather than read from an archive written by "
+                   "compile-train-graphs.  Requires --compile-graphs.tree.");
+    opts->Register("compile-graphs.tree", &tree_rxfilename, "The tree, for "
+                   "use with --compile-graphs.lexicon.");
+    opts->Register("compile-graphs.read-disambig-syms", &disambig_rxfilename,
+                   "File containing the list of disambiguation symbols in the "
+                   "phone symbol table, for use with --compile-graphs.lexicon.");
+    opts->Register("compile-graphs.batch-size", &batch_size, "Number of "
+                   "transcripts compiled at a time.");
+    opts->Register("compile-graphs.num-threads", &num_threads, "Number of "
+                   "threads used to compile each batch of graphs.");
+    opts->Register("compile-graphs.batches-ahead", &batches_ahead, "Maximum "
+                   "number of compiled batches waiting to be aligned.");
+    opts->Register("compile-graphs.max-cached-graphs", &max_cached_graphs,
+                   "Maximum number of graphs kept so that repeated "
+                   "transcripts are compiled only once.");
+  }
+
+  bool CompileGraphs() const { return !lex_rxfilename.empty(); }
+};
+
+
+/**
+   SequentialTrainingGraphReader gives the aligners (e.g. gmm-align-compiled)
+   their training graphs with the interface of
+   SequentialTableReader<fst::VectorFstHolder>.  By default it just reads them
+   from the archive written by compile-train-graphs.  If
+   opts.lex_rxfilename is set, it instead reads transcripts and compiles the
+   graphs itself, exactly as compile-train-graphs would (i.e. without
+   transition probabilities); this is done in batches by a background thread
+   that runs up to opts.batches_ahead batches ahead of the alignment, so the
+   large graph archives need never be written to disk.
+*/
+class SequentialTrainingGraphReader {
+ public:
+  /// 'trans_model' must outlive this object.
+  SequentialTrainingGraphReader(const std::string &rspecifier,
+                                const TransitionModel &trans_model,
+                                const TrainingGraphReaderOptions &opts);
+
+  bool Done();
+  std::string Key();
+  const fst::VectorFst<fst::StdArc> &Value();
+  void Next();
+  /// Frees the current graph, as SequentialTableReader::FreeCurrent().
+  void FreeCurrent();
+
+  ~SequentialTrainingGraphReader();
+
+ private:
+  struct Batch {
+    std::vector<std::string> keys;
+    std::vector<fst::VectorFst<fst::StdArc>*> fsts;
+    ~Batch() { DeletePointers(&fsts); }
+  };
+
+  // The loop of compile_thread_.
+  void CompileLoop();
+  // Makes current_ point to a batch with an unread graph, if there is one,
+  // waiting for compile_thread_ if necessary.
+  void EnsureCurrent();
+
+  TrainingGraphReaderOptions opts_;
+  // Used if !opts_.CompileGraphs().
+  SequentialTableReader<fst::VectorFstHolder> *fst_reader_;
+
+  // The rest is used if opts_.CompileGraphs().
+  ContextDependency ctx_dep_;
+  TrainingGraphCompiler *compiler_;
+  SequentialInt32VectorReader *transcript_reader_;
+  std::thread compile_thread_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<Batch*> queue_;  // batches waiting to be read.
+  bool compile_done_;  // true when compile_thread_ has finished.
+  bool stop_;  // tells compile_thread_ to stop early.
+  std::string error_;  // the error message if compile_thread_ failed.
+
+  // The batch being read, and the index of the current graph in it; owned by
+  // the reading thread.
+  Batch *current_;
+  size_t current_index_;
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_TRAINING_GRAPH_READER_H_
@@ -69,16 +69,33 @@ void OfflineFeatureTpl<F>::Compute(
     return;
   }
   output->Resize(rows_out, cols_out);
-  Vector<BaseFloat> window;  // windowed waveform.
+  // We extract the windows for blocks of frames and compute their features
+  // with one call to ComputeBatch(), which does the filterbank and cepstral
+  // transforms as matrix operations.  The block size is a compromise between
+  // the efficiency of those operations and keeping the windows in cache.
+  const int32 block_size = 64;
+  const FrameExtractionOptions &frame_opts = computer_.GetFrameOptions();
+  Matrix<BaseFloat> windows(std::min(block_size, rows_out),
+                            frame_opts.PaddedWindowSize(), kUndefined);
+  Vector<BaseFloat> window,  // windowed waveform.
+      raw_log_energies(windows.NumRows());
   bool use_raw_log_energy = computer_.NeedRawLogEnergy();
-  for (int32 r = 0; r < rows_out; r++) {  // r is frame index.
-    BaseFloat raw_log_energy = 0.0;
-    ExtractWindow(0, wave, r, computer_.GetFrameOptions(),
-                  feature_window_function_, &window,
-                  (use_raw_log_energy ? &raw_log_energy : NULL));
-
-    SubVector<BaseFloat> output_row(*output, r);
-    computer_.Compute(raw_log_energy, vtln_warp, &window, &output_row);
+  for (int32 start = 0; start < rows_out; start += block_size) {
+    int32 num_frames = std::min(block_size, rows_out - start);
+    for (int32 i = 0; i < num_frames; i++) {
+      BaseFloat raw_log_energy = 0.0;
+      ExtractWindow(0, wave, start + i, frame_opts,
+                    feature_window_function_, &window,
+                    (use_raw_log_energy ? &raw_log_energy : NULL));
+      windows.Row(i).CopyFromVec(window);
+      raw_log_energies(i) = raw_log_energy;
+    }
+    SubMatrix<BaseFloat> these_windows(windows, 0, num_frames,
+                                       0, windows.NumCols()),
+        output_rows(*output, start, num_frames, 0, cols_out);
+    SubVector<BaseFloat> these_energies(raw_log_energies, 0, num_frames);
+    computer_.ComputeBatch(these_energies, vtln_warp, &these_windows,
+                           &output_rows);
   }
 }
 
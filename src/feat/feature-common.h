@@ -94,6 +94,27 @@ class ExampleFeatureComputer {
                VectorBase<BaseFloat> *signal_frame,
                VectorBase<BaseFloat> *feature);
 
+  /**
+     Computes the features for a block of frames; it must give the same
+     results as calling Compute() on each row, up to roundoff.  It is used by
+     OfflineFeatureTpl, which processes a whole utterance, so that the
+     filterbank and cepstral transforms can be done as matrix products; a
+     class with nothing to gain from this may just call Compute() for each row.
+
+     @param [in] signal_raw_log_energies  The raw log-energies of the frames
+         (see Compute()); ignored if this->NeedRawLogEnergy() returns false.
+     @param [in] vtln_warp  The VTLN warping factor, as for Compute().
+     @param [in] signal_frames  The frames of the signal, one per row, each as
+         extracted by ExtractWindow(); it is used as a workspace.
+     @param [out] features  A matrix with the same number of rows as
+         'signal_frames' and this->Dim() columns, to which the features will
+         be written.
+  */
+  void ComputeBatch(const VectorBase<BaseFloat> &signal_raw_log_energies,
+                    BaseFloat vtln_warp,
+                    MatrixBase<BaseFloat> *signal_frames,
+                    MatrixBase<BaseFloat> *features);
+
  private:
   // disallow assignment.
   ExampleFeatureComputer &operator = (const ExampleFeatureComputer &in);
@@ -443,9 +443,50 @@ static void UnitTestHTKCompare4() {
 
 
 
+static void UnitTestBatchCompute() {
+  std::cout << "=== UnitTestBatchCompute() ===\n";
+  // Checks that the block-wise computation in Fbank::Compute() (which uses
+  // FbankComputer::ComputeBatch()) matches computing one frame at a time.
+  Vector<BaseFloat> v(RandInt(100, 20000));
+  v.SetRandn();
+  v.Scale(1000.0);
+
+  FbankOptions op;
+  op.frame_opts.dither = 0.0;
+  op.frame_opts.round_to_power_of_two = (RandInt(0, 1) == 0);
+  op.use_energy = (RandInt(0, 1) == 0);
+  op.raw_energy = (RandInt(0, 1) == 0);
+  op.htk_compat = (RandInt(0, 1) == 0);
+  op.use_log_fbank = (RandInt(0, 1) == 0);
+  op.use_power = (RandInt(0, 1) == 0);
+  BaseFloat vtln_warp = (RandInt(0, 1) == 0 ? 1.0 : 0.9);
+
+  Fbank fbank(op);
+  Matrix<BaseFloat> m;
+  fbank.Compute(v, vtln_warp, &m);
+
+  FbankComputer computer(op);
+  FeatureWindowFunction window_function(op.frame_opts);
+  int32 num_frames = NumFrames(v.Dim(), op.frame_opts);
+  KALDI_ASSERT(m.NumRows() == num_frames);
+  Matrix<BaseFloat> m2(num_frames, computer.Dim());
+  Vector<BaseFloat> window;
+  for (int32 r = 0; r < num_frames; r++) {
+    BaseFloat raw_log_energy = 0.0;
+    ExtractWindow(0, v, r, op.frame_opts, window_function, &window,
+                  (computer.NeedRawLogEnergy() ? &raw_log_energy : NULL));
+    SubVector<BaseFloat> feature(m2, r);
+    computer.Compute(raw_log_energy, vtln_warp, &window, &feature);
+  }
+  AssertEqual(m, m2, 1.0e-04);
+  std::cout << "Test passed :)\n\n";
+}
+
+
 static void UnitTestFeat() {
   UnitTestReadWave();
   UnitTestSimple();
+  UnitTestBatchCompute();
   UnitTestHTKCompare1();
   UnitTestHTKCompare2();
   UnitTestHTKCompare3();
@@ -122,4 +122,64 @@ void FbankComputer::Compute(BaseFloat signal_raw_log_energy,
   }
 }
 
+void FbankComputer::ComputeBatch(
+    const VectorBase<BaseFloat> &signal_raw_log_energies,
+    BaseFloat vtln_warp,
+    MatrixBase<BaseFloat> *signal_frames,
+    MatrixBase<BaseFloat> *features) {
+  int32 num_frames = signal_frames->NumRows(),
+      padded_window_size = signal_frames->NumCols();
+  KALDI_ASSERT(padded_window_size == opts_.frame_opts.PaddedWindowSize() &&
+               signal_raw_log_energies.Dim() == num_frames &&
+               features->NumRows() == num_frames &&
+               features->NumCols() == this->Dim());
+
+  const MelBanks &mel_banks = *(GetMelBanks(vtln_warp));
+
+  Vector<BaseFloat> log_energies(signal_raw_log_energies);
+  for (int32 r = 0; r < num_frames; r++) {
+    SubVector<BaseFloat> signal_frame(*signal_frames, r);
+    // Compute energy after window function (not the raw one).
+    if (opts_.use_energy && !opts_.raw_energy)
+      log_energies(r) = Log(std::max<BaseFloat>(
+          VecVec(signal_frame, signal_frame),
+          std::numeric_limits<float>::epsilon()));
+    if (srfft_ != NULL)  // Compute FFT using split-radix algorithm.
+      srfft_->Compute(signal_frame.Data(), true);
+    else  // An alternative algorithm that works for non-powers-of-two.
+      RealFft(&signal_frame, true);
+    // Convert the FFT into a power spectrum.
+    ComputePowerSpectrum(&signal_frame);
+  }
+  SubMatrix<BaseFloat> power_spectra(*signal_frames, 0, num_frames,
+                                     0, padded_window_size / 2 + 1);
+
+  // Use magnitude instead of power if requested.
+  if (!opts_.use_power)
+    power_spectra.ApplyPow(0.5);
+
+  int32 mel_offset = ((opts_.use_energy && !opts_.htk_compat) ? 1 : 0);
+  SubMatrix<BaseFloat> mel_energies(*features, 0, num_frames,
+                                    mel_offset, opts_.mel_opts.num_bins);
+
+  // Sum with mel fiterbanks over the power spectra
+  mel_banks.Compute(power_spectra, &mel_energies);
+  if (opts_.use_log_fbank) {
+    // Avoid log of zero (which should be prevented anyway by dithering).
+    mel_energies.ApplyFloor(std::numeric_limits<float>::epsilon());
+    mel_energies.ApplyLog();  // take the log.
+  }
+
+  // Copy energy as first value (or the last, if htk_compat == true).
+  if (opts_.use_energy) {
+    int32 energy_index = opts_.htk_compat ? opts_.mel_opts.num_bins : 0;
+    for (int32 r = 0; r < num_frames; r++) {
+      BaseFloat log_energy = log_energies(r);
+      if (opts_.energy_floor > 0.0 && log_energy < log_energy_floor_)
+        log_energy = log_energy_floor_;
+      (*features)(r, energy_index) = log_energy;
+    }
+  }
+}
+
 }  // namespace kaldi
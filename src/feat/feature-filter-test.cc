@@ -0,0 +1,122 @@
+// feat/feature-filter-test.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include "feat/feature-filter.h"
+#include "transform/cmvn.h"
+
+namespace kaldi {
+
+// Tests that a chain of filters created from strings gives the same result as
+// calling the underlying functions directly.
+void UnitTestFeatureFilterChain() {
+  int32 num_frames = RandInt(5, 30), dim = RandInt(2, 10);
+  Matrix<BaseFloat> feats(num_frames, dim);
+  feats.SetRandn();
+  feats.Add(2.0);
+
+  Matrix<double> cmvn_stats;
+  InitCmvnStats(dim, &cmvn_stats);
+  AccCmvnStats(feats, NULL, &cmvn_stats);
+  WriteKaldiObject(cmvn_stats, "tmp.cmvn", RandInt(0, 1) == 0);
+
+  int32 left_context = RandInt(0, 2), right_context = RandInt(0, 2),
+      spliced_dim = dim * 3 * (1 + left_context + right_context),
+      out_dim = RandInt(1, 5);
+  Matrix<BaseFloat> transform(out_dim, spliced_dim + 1);
+  transform.SetRandn();
+  {
+    BaseFloatMatrixWriter writer("ark:tmp.transforms.ark");
+    writer.Write("utt1", transform);
+  }
+  int32 n = RandInt(1, 3);
+
+  // The direct computation.
+  Matrix<BaseFloat> ref(feats);
+  ApplyCmvn(cmvn_stats, true, &ref);
+  Matrix<BaseFloat> deltas, spliced;
+  ComputeDeltas(DeltaFeaturesOptions(), ref, &deltas);
+  SpliceFrames(deltas, left_context, right_context, &spliced);
+  Matrix<BaseFloat> transformed(num_frames, out_dim);
+  transformed.AddMatMat(1.0, spliced, kNoTrans,
+                        transform.Range(0, out_dim, 0, spliced_dim), kTrans,
+                        0.0);
+  Vector<BaseFloat> offset(out_dim);
+  offset.CopyColFromMat(transform, spliced_dim);
+  transformed.AddVecToRows(1.0, offset);
+  int32 num_out = (num_frames + n - 1) / n;
+  Matrix<BaseFloat> subsampled(num_out, out_dim);
+  for (int32 i = 0; i < num_out; i++)
+    subsampled.Row(i).CopyFromVec(transformed.Row(i * n));
+
+  FeatureFilterChain chain;
+  chain.Append("apply-cmvn --norm-vars=true tmp.cmvn");
+  chain.Append("add-deltas");
+  std::ostringstream splice;
+  splice << "splice-feats --left-context=" << left_context
+         << " --right-context=" << right_context;
+  chain.Append(splice.str());
+  chain.Append("transform-feats ark:tmp.transforms.ark");
+  std::ostringstream subsample;
+  subsample << "subsample-feats --n=" << n;
+  chain.Append(subsample.str());
+  KALDI_ASSERT(chain.NumFilters() == 5);
+
+  Matrix<BaseFloat> out(feats);
+  KALDI_ASSERT(chain.Apply("utt1", &out));
+  AssertEqual(out, subsampled);
+
+  // There is no transform for "utt2".
+  Matrix<BaseFloat> out2(feats);
+  KALDI_ASSERT(!chain.Apply("utt2", &out2));
+
+  std::remove("tmp.cmvn");
+  std::remove("tmp.transforms.ark");
+}
+
+void UnitTestFeatureFilterErrors() {
+  const char *bad_commands[] = { "", "copy-feats", "splice-feats foo",
+                                 "splice-feats --left=3", "transform-feats",
+                                 "subsample-feats --n=0",
+                                 "apply-cmvn --norm-means=false "
+                                 "--norm-vars=true foo" };
+  for (size_t i = 0; i < sizeof(bad_commands) / sizeof(bad_commands[0]);
+       i++) {
+    bool threw = false;
+    try {
+      FeatureFilter *filter = FeatureFilter::NewFromString(bad_commands[i]);
+      delete filter;
+    } catch (const std::exception &) {
+      threw = true;
+    }
+    KALDI_ASSERT(threw);
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  SetVerboseLevel(1);
+  for (int32 i = 0; i < 10; i++)
+    UnitTestFeatureFilterChain();
+  UnitTestFeatureFilterErrors();
+  std::cout << "Tests succeeded.\n";
+  return 0;
+}
@@ -0,0 +1,309 @@
+// feat/feature-filter.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "feat/feature-filter.h"
+#include "transform/cmvn.h"
+
+namespace kaldi {
+
+CmvnFeatureFilter::CmvnFeatureFilter(
+    const std::string &cmvn_rspecifier_or_rxfilename,
+    const std::string &utt2spk_rspecifier,
+    bool norm_means, bool norm_vars, bool reverse,
+    const std::vector<int32> &skip_dims):
+    norm_means_(norm_means), norm_vars_(norm_vars), reverse_(reverse),
+    skip_dims_(skip_dims), use_global_stats_(false) {
+  if (norm_vars && !norm_means)
+    KALDI_ERR << "You cannot normalize the variance but not the mean.";
+  if (!norm_means)
+    return;  // We are a no-op; don't even open the stats.
+  if (ClassifyRspecifier(cmvn_rspecifier_or_rxfilename, NULL, NULL)
+      != kNoRspecifier) {
+    if (!stats_reader_.Open(cmvn_rspecifier_or_rxfilename, utt2spk_rspecifier))
+      KALDI_ERR << "Problem opening CMVN stats with rspecifier "
+                << '"' << cmvn_rspecifier_or_rxfilename << '"'
+                << " and utt2spk rspecifier "
+                << '"' << utt2spk_rspecifier << '"';
+  } else {
+    if (utt2spk_rspecifier != "")
+      KALDI_ERR << "--utt2spk option not compatible with rxfilename as input "
+                << "(did you forget ark:?)";
+    use_global_stats_ = true;
+    ReadKaldiObject(cmvn_rspecifier_or_rxfilename, &global_stats_);
+    if (!skip_dims_.empty())
+      FakeStatsForSomeDims(skip_dims_, &global_stats_);
+  }
+}
+
+bool CmvnFeatureFilter::Apply(const std::string &utt,
+                              Matrix<BaseFloat> *feats) {
+  if (!norm_means_)
+    return true;
+  Matrix<double> utt_stats;
+  const Matrix<double> *stats = &global_stats_;
+  if (!use_global_stats_) {
+    if (!stats_reader_.HasKey(utt)) {
+      KALDI_WARN << "No normalization statistics available for key "
+                 << utt << ", producing no output for this utterance";
+      return false;
+    }
+    if (skip_dims_.empty()) {
+      stats = &(stats_reader_.Value(utt));
+    } else {
+      utt_stats = stats_reader_.Value(utt);
+      FakeStatsForSomeDims(skip_dims_, &utt_stats);
+      stats = &utt_stats;
+    }
+  }
+  if (reverse_)
+    ApplyCmvnReverse(*stats, norm_vars_, feats);
+  else
+    ApplyCmvn(*stats, norm_vars_, feats);
+  return true;
+}
+
+
+bool DeltaFeatureFilter::Apply(const std::string &utt,
+                               Matrix<BaseFloat> *feats) {
+  if (feats->NumRows() == 0) {
+    KALDI_WARN << "Empty feature matrix for key " << utt;
+    return false;
+  }
+  if (truncate_ != 0) {
+    if (truncate_ > feats->NumCols())
+      KALDI_ERR << "Cannot truncate features as dimension " << feats->NumCols()
+                << " is smaller than truncation dimension.";
+    SubMatrix<BaseFloat> feats_sub(*feats, 0, feats->NumRows(), 0, truncate_);
+    ComputeDeltas(opts_, feats_sub, &output_);
+  } else {
+    ComputeDeltas(opts_, *feats, &output_);
+  }
+  feats->Swap(&output_);
+  return true;
+}
+
+
+SpliceFeatureFilter::SpliceFeatureFilter(int32 left_context,
+                                         int32 right_context):
+    left_context_(left_context), right_context_(right_context) {
+  if (left_context < 0 || right_context < 0)
+    KALDI_ERR << "Invalid context " << left_context << ", " << right_context
+              << " for splicing: must be nonnegative.";
+}
+
+bool SpliceFeatureFilter::Apply(const std::string &utt,
+                                Matrix<BaseFloat> *feats) {
+  SpliceFrames(*feats, left_context_, right_context_, &output_);
+  feats->Swap(&output_);
+  return true;
+}
+
+
+TransformFeatureFilter::TransformFeatureFilter(
+    const std::string &transform_rspecifier_or_rxfilename,
+    const std::string &utt2spk_rspecifier): use_global_transform_(false) {
+  if (ClassifyRspecifier(transform_rspecifier_or_rxfilename, NULL, NULL)
+      == kNoRspecifier) {
+    use_global_transform_ = true;
+    ReadKaldiObject(transform_rspecifier_or_rxfilename, &global_transform_);
+  } else if (!transform_reader_.Open(transform_rspecifier_or_rxfilename,
+                                     utt2spk_rspecifier)) {
+    KALDI_ERR << "Problem opening transforms with rspecifier "
+              << '"' << transform_rspecifier_or_rxfilename << '"'
+              << " and utt2spk rspecifier "
+              << '"' << utt2spk_rspecifier << '"';
+  }
+}
+
+bool TransformFeatureFilter::Apply(const std::string &utt,
+                                   Matrix<BaseFloat> *feats) {
+  if (!use_global_transform_ && !transform_reader_.HasKey(utt)) {
+    KALDI_WARN << "No fMLLR transform available for utterance "
+               << utt << ", producing no output for this utterance";
+    return false;
+  }
+  const Matrix<BaseFloat> &trans =
+      (use_global_transform_ ? global_transform_ :
+       transform_reader_.Value(utt));
+  int32 transform_rows = trans.NumRows(),
+      transform_cols = trans.NumCols(),
+      feat_dim = feats->NumCols();
+  output_.Resize(feats->NumRows(), transform_rows, kUndefined);
+  if (transform_cols == feat_dim) {
+    output_.AddMatMat(1.0, *feats, kNoTrans, trans, kTrans, 0.0);
+  } else if (transform_cols == feat_dim + 1) {
+    SubMatrix<BaseFloat> linear_part(trans, 0, transform_rows, 0, feat_dim);
+    output_.AddMatMat(1.0, *feats, kNoTrans, linear_part, kTrans, 0.0);
+    Vector<BaseFloat> offset(transform_rows);
+    offset.CopyColFromMat(trans, feat_dim);
+    output_.AddVecToRows(1.0, offset);
+  } else {
+    KALDI_WARN << "Transform matrix for utterance " << utt << " has bad "
+               << "dimension " << transform_rows << "x" << transform_cols
+               << " versus feat dim " << feat_dim;
+    if (transform_cols == feat_dim + 2)
+      KALDI_WARN << "[perhaps the transform was created by compose-transforms, "
+          "and you forgot the --b-is-affine option?]";
+    return false;
+  }
+  feats->Swap(&output_);
+  return true;
+}
+
+
+SubsampleFeatureFilter::SubsampleFeatureFilter(int32 n, int32 offset):
+    n_(n), offset_(offset) {
+  if (n == 0 || offset < 0 || (n < 0 && offset != 0))
+    KALDI_ERR << "Invalid options for subsampling: n = " << n
+              << ", offset = " << offset << " (n must be nonzero, and "
+              << "offset cannot be used with negative n).";
+}
+
+bool SubsampleFeatureFilter::Apply(const std::string &utt,
+                                   Matrix<BaseFloat> *feats) {
+  if (n_ > 0) {
+    int32 num_indexes = 0;
+    for (int32 k = offset_; k < feats->NumRows(); k += n_)
+      num_indexes++;
+    if (num_indexes == 0) {
+      KALDI_WARN << "For utterance " << utt << ", output would have no rows, "
+                 << "producing no output.";
+      return false;
+    }
+    output_.Resize(num_indexes, feats->NumCols(), kUndefined);
+    int32 i = 0;
+    for (int32 k = offset_; k < feats->NumRows(); k += n_, i++)
+      output_.Row(i).CopyFromVec(feats->Row(k));
+  } else {
+    int32 repeat = -n_;
+    output_.Resize(feats->NumRows() * repeat, feats->NumCols(), kUndefined);
+    for (int32 i = 0; i < output_.NumRows(); i++)
+      output_.Row(i).CopyFromVec(feats->Row(i / repeat));
+  }
+  feats->Swap(&output_);
+  return true;
+}
+
+
+FeatureFilter *FeatureFilter::NewFromString(const std::string &command) {
+  std::vector<std::string> args;
+  SplitStringToVector(command, " \t", true, &args);
+  if (args.empty())
+    KALDI_ERR << "Empty feature filter specification.";
+  std::string name = args[0];
+
+  // We parse the options with ParseOptions, as the programs do.  The
+  // program name goes in argv[0], and we turn off the printing of the
+  // arguments.
+  std::string program_name = GetProgramName(),
+      print_args = "--print-args=false";
+  std::vector<const char*> argv;
+  argv.push_back(program_name.c_str());
+  argv.push_back(print_args.c_str());
+  for (size_t i = 1; i < args.size(); i++)
+    argv.push_back(args[i].c_str());
+  int32 argc = argv.size();
+
+  std::string usage = "Feature filter \"" + command + "\"\n";
+  ParseOptions po(usage.c_str());
+  FeatureFilter *ans = NULL;
+  if (name == "apply-cmvn") {
+    std::string utt2spk_rspecifier, skip_dims_str;
+    bool norm_vars = false, norm_means = true, reverse = false;
+    po.Register("utt2spk", &utt2spk_rspecifier,
+                "rspecifier for utterance to speaker map");
+    po.Register("norm-vars", &norm_vars, "If true, normalize variances.");
+    po.Register("norm-means", &norm_means, "You can set this to false to turn "
+                "off mean normalization.");
+    po.Register("skip-dims", &skip_dims_str, "Dimensions for which to skip "
+                "normalization: colon-separated list of integers, e.g. "
+                "13:14:15)");
+    po.Register("reverse", &reverse, "If true, apply CMVN in a reverse sense, "
+                "so as to transform zero-mean, unit-variance input into data "
+                "with the given mean and variance.");
+    po.Read(argc, &(argv[0]));
+    if (po.NumArgs() != 1)
+      KALDI_ERR << "Expected one argument (the CMVN stats) in feature filter "
+                << '"' << command << '"';
+    std::vector<int32> skip_dims;
+    if (!SplitStringToIntegers(skip_dims_str, ":", false, &skip_dims))
+      KALDI_ERR << "Bad --skip-dims option (should be colon-separated list "
+                << "of integers) in feature filter \"" << command << '"';
+    ans = new CmvnFeatureFilter(po.GetArg(1), utt2spk_rspecifier, norm_means,
+                                norm_vars, reverse, skip_dims);
+  } else if (name == "add-deltas") {
+    DeltaFeaturesOptions opts;
+    int32 truncate = 0;
+    po.Register("truncate", &truncate, "If nonzero, first truncate features "
+                "to this dimension.");
+    opts.Register(&po);
+    po.Read(argc, &(argv[0]));
+    if (po.NumArgs() != 0)
+      KALDI_ERR << "Unexpected arguments in feature filter \"" << command
+                << '"';
+    ans = new DeltaFeatureFilter(opts, truncate);
+  } else if (name == "splice-feats") {
+    int32 left_context = 4, right_context = 4;
+    po.Register("left-context", &left_context,
+                "Number of frames of left context");
+    po.Register("right-context", &right_context,
+                "Number of frames of right context");
+    po.Read(argc, &(argv[0]));
+    if (po.NumArgs() != 0)
+      KALDI_ERR << "Unexpected arguments in feature filter \"" << command
+                << '"';
+    ans = new SpliceFeatureFilter(left_context, right_context);
+  } else if (name == "transform-feats") {
+    std::string utt2spk_rspecifier;
+    po.Register("utt2spk", &utt2spk_rspecifier,
+                "rspecifier for utterance to speaker map");
+    po.Read(argc, &(argv[0]));
+    if (po.NumArgs() != 1)
+      KALDI_ERR << "Expected one argument (the transform) in feature filter "
+                << '"' << command << '"';
+    ans = new TransformFeatureFilter(po.GetArg(1), utt2spk_rspecifier);
+  } else if (name == "subsample-feats") {
+    int32 n = 1, offset = 0;
+    po.Register("n", &n, "Take every n'th feature, for this value of n"
+                "(with negative value, repeats each feature n times)");
+    po.Register("offset", &offset, "Start with the feature with this offset, "
+                "then take every n'th feature.");
+    po.Read(argc, &(argv[0]));
+    if (po.NumArgs() != 0)
+      KALDI_ERR << "Unexpected arguments in feature filter \"" << command
+                << '"';
+    ans = new SubsampleFeatureFilter(n, offset);
+  } else {
+    KALDI_ERR << "Unknown feature filter '" << name << "' in \"" << command
+              << "\": expected apply-cmvn, add-deltas, splice-feats, "
+              << "transform-feats or subsample-feats.";
+  }
+  return ans;
+}
+
+
+bool FeatureFilterChain::Apply(const std::string &utt,
+                               Matrix<BaseFloat> *feats) {
+  for (size_t i = 0; i < filters_.size(); i++)
+    if (!filters_[i]->Apply(utt, feats))
+      return false;
+  return true;
+}
+
+}  // namespace kaldi
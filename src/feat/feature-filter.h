@@ -0,0 +1,168 @@
+// feat/feature-filter.h
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_FEAT_FEATURE_FILTER_H_
+#define KALDI_FEAT_FEATURE_FILTER_H_
+
+#include <string>
+#include <vector>
+
+#include "matrix/matrix-lib.h"
+#include "util/common-utils.h"
+#include "feat/feature-functions.h"
+
+namespace kaldi {
+/// @addtogroup  feat FeatureExtraction
+/// @{
+
+/// FeatureFilter is the interface for the per-utterance feature-processing
+/// stages of programs such as apply-cmvn, add-deltas, splice-feats,
+/// transform-feats and subsample-feats.  A FeatureFilterChain applies a
+/// sequence of them to each utterance within one process, so pipelines like
+///  "apply-cmvn ... | splice-feats ... | transform-feats ..."
+/// do not have to write and re-read the features between stages (see the
+/// program process-feats).
+class FeatureFilter {
+ public:
+  /// Applies the filter to the features 'feats' of utterance 'utt', in place
+  /// (the dimensions of *feats may change).  Returns false, after printing a
+  /// warning, if there should be no output for this utterance, e.g. because
+  /// there were no CMVN stats or no transform for it.
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats) = 0;
+
+  /// Creates a filter from a command line in the same form as that of the
+  /// corresponding program, but without the input and output specifiers,
+  /// e.g. "splice-feats --left-context=3 --right-context=3" or
+  /// "apply-cmvn --utt2spk=ark:data/train/utt2spk scp:data/train/cmvn.scp".
+  /// The supported programs are apply-cmvn, add-deltas, splice-feats,
+  /// transform-feats and subsample-feats, with the same options and defaults
+  /// as the programs.  Throws on error.
+  static FeatureFilter *NewFromString(const std::string &command);
+
+  virtual ~FeatureFilter() { }
+};
+
+
+/// Cepstral mean and variance normalization, as in apply-cmvn.
+class CmvnFeatureFilter: public FeatureFilter {
+ public:
+  /// 'cmvn_rspecifier_or_rxfilename' is as the first argument of apply-cmvn;
+  /// 'utt2spk_rspecifier' may be empty.
+  CmvnFeatureFilter(const std::string &cmvn_rspecifier_or_rxfilename,
+                    const std::string &utt2spk_rspecifier,
+                    bool norm_means, bool norm_vars, bool reverse,
+                    const std::vector<int32> &skip_dims);
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats);
+ private:
+  bool norm_means_;
+  bool norm_vars_;
+  bool reverse_;
+  std::vector<int32> skip_dims_;
+  bool use_global_stats_;
+  Matrix<double> global_stats_;  // used if use_global_stats_.
+  RandomAccessDoubleMatrixReaderMapped stats_reader_;
+};
+
+
+/// Adds delta features, as in add-deltas.
+class DeltaFeatureFilter: public FeatureFilter {
+ public:
+  /// If 'truncate' is nonzero, the features are first truncated to that
+  /// dimension.
+  DeltaFeatureFilter(const DeltaFeaturesOptions &opts, int32 truncate):
+      opts_(opts), truncate_(truncate) { }
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats);
+ private:
+  DeltaFeaturesOptions opts_;
+  int32 truncate_;
+  Matrix<BaseFloat> output_;
+};
+
+
+/// Splices frames with left and right context, as in splice-feats.
+class SpliceFeatureFilter: public FeatureFilter {
+ public:
+  SpliceFeatureFilter(int32 left_context, int32 right_context);
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats);
+ private:
+  int32 left_context_;
+  int32 right_context_;
+  Matrix<BaseFloat> output_;
+};
+
+
+/// Applies a linear or affine transform, as in transform-feats.
+class TransformFeatureFilter: public FeatureFilter {
+ public:
+  /// 'transform_rspecifier_or_rxfilename' is as the first argument of
+  /// transform-feats; 'utt2spk_rspecifier' may be empty.
+  TransformFeatureFilter(const std::string &transform_rspecifier_or_rxfilename,
+                         const std::string &utt2spk_rspecifier);
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats);
+ private:
+  bool use_global_transform_;
+  Matrix<BaseFloat> global_transform_;  // used if use_global_transform_.
+  RandomAccessBaseFloatMatrixReaderMapped transform_reader_;
+  Matrix<BaseFloat> output_;
+};
+
+
+/// Takes every n'th frame, or repeats frames if n is negative, as in
+/// subsample-feats.
+class SubsampleFeatureFilter: public FeatureFilter {
+ public:
+  SubsampleFeatureFilter(int32 n, int32 offset);
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats);
+ private:
+  int32 n_;
+  int32 offset_;
+  Matrix<BaseFloat> output_;
+};
+
+
+/// Applies a sequence of FeatureFilters to a feature matrix.
+class FeatureFilterChain {
+ public:
+  FeatureFilterChain() { }
+
+  /// Appends a filter to the chain; takes ownership of the pointer.
+  void Append(FeatureFilter *filter) { filters_.push_back(filter); }
+
+  /// Appends a filter created by FeatureFilter::NewFromString().
+  void Append(const std::string &command) {
+    Append(FeatureFilter::NewFromString(command));
+  }
+
+  int32 NumFilters() const { return filters_.size(); }
+
+  /// Applies all the filters in order.  Returns false if any of them did
+  /// (in which case there should be no output for this utterance).
+  bool Apply(const std::string &utt, Matrix<BaseFloat> *feats);
+
+  ~FeatureFilterChain() { DeletePointers(&filters_); }
+ private:
+  std::vector<FeatureFilter*> filters_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(FeatureFilterChain);
+};
+
+/// @} End of "addtogroup feat"
+}  // namespace kaldi
+
+
+#endif  // KALDI_FEAT_FEATURE_FILTER_H_
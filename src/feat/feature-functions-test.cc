@@ -89,6 +89,9 @@ void UnitTestOnlineCmvn() {
     if (! output_feats.ApproxEqual(output_feats2, 0.0001)) {
       KALDI_ERR << "Features differ " << output_feats << " vs. " << output_feats2;
     }
+    // in-place operation must give the same result.
+    SlidingWindowCmn(opts, feats, &feats);
+    AssertEqual(feats, output_feats, 0.0);
   }
 }
 
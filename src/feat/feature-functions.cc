@@ -246,15 +246,25 @@ void SlidingWindowCmnOptions::Check() const {
   // else ignored so value doesn't matter.
 }
 
-// Internal version of SlidingWindowCmn with double-precision arguments.
-void SlidingWindowCmnInternal(const SlidingWindowCmnOptions &opts,
-                              const MatrixBase<double> &input,
-                              MatrixBase<double> *output) {
+// Internal version of SlidingWindowCmn.  The window statistics are running sums
+// in double precision, whatever the type of the features; the per-frame work is
+// done in loops over the dimension that the compiler can vectorize, with the
+// floating-point operations in the same order as when this used the vector
+// operations (AddVec() and so on).
+template<typename Real>
+static void SlidingWindowCmnInternal(const SlidingWindowCmnOptions &opts,
+                                     const MatrixBase<Real> &input,
+                                     MatrixBase<Real> *output) {
   opts.Check();
   int32 num_frames = input.NumRows(), dim = input.NumCols(),
         last_window_start = -1, last_window_end = -1,
         warning_count = 0;
-  Vector<double> cur_sum(dim), cur_sumsq(dim);
+  Vector<double> cur_sum(dim), cur_sumsq(dim), scale(dim);
+  // Remove these __restrict__ modifiers if they cause compilation problems.
+  // It's just an optimization.
+  double *__restrict__ sum = cur_sum.Data(),
+      *__restrict__ sumsq = cur_sumsq.Data(),
+      *__restrict__ inv_stddev = scale.Data();
 
   for (int32 t = 0; t < num_frames; t++) {
     int32 window_start, window_end; // note: window_end will be one
@@ -280,26 +290,36 @@ void SlidingWindowCmnInternal(const SlidingWindowCmnOptions &opts,
       if (window_start < 0) window_start = 0;
     }
     if (last_window_start == -1) {
-      SubMatrix<double> input_part(input,
-                                      window_start, window_end - window_start,
-                                      0, dim);
+      Matrix<double> input_part(input.RowRange(window_start,
+                                               window_end - window_start));
       cur_sum.AddRowSumMat(1.0, input_part , 0.0);
       if (opts.normalize_variance)
         cur_sumsq.AddDiagMat2(1.0, input_part, kTrans, 0.0);
     } else {
       if (window_start > last_window_start) {
         KALDI_ASSERT(window_start == last_window_start + 1);
-        SubVector<double> frame_to_remove(input, last_window_start);
-        cur_sum.AddVec(-1.0, frame_to_remove);
-        if (opts.normalize_variance)
-          cur_sumsq.AddVec2(-1.0, frame_to_remove);
+        const Real *__restrict__ frame_to_remove =
+            input.RowData(last_window_start);
+        for (int32 d = 0; d < dim; d++)
+          sum[d] -= frame_to_remove[d];
+        if (opts.normalize_variance) {
+          for (int32 d = 0; d < dim; d++) {
+            double x = frame_to_remove[d];
+            sumsq[d] -= x * x;
+          }
+        }
       }
       if (window_end > last_window_end) {
         KALDI_ASSERT(window_end == last_window_end + 1);
-        SubVector<double> frame_to_add(input, last_window_end);
-        cur_sum.AddVec(1.0, frame_to_add);
-        if (opts.normalize_variance)
-          cur_sumsq.AddVec2(1.0, frame_to_add);
+        const Real *__restrict__ frame_to_add = input.RowData(last_window_end);
+        for (int32 d = 0; d < dim; d++)
+          sum[d] += frame_to_add[d];
+        if (opts.normalize_variance) {
+          for (int32 d = 0; d < dim; d++) {
+            double x = frame_to_add[d];
+            sumsq[d] += x * x;
+          }
+        }
       }
     }
     int32 window_frames = window_end - window_start;
@@ -307,41 +327,51 @@ void SlidingWindowCmnInternal(const SlidingWindowCmnOptions &opts,
     last_window_end = window_end;
 
     KALDI_ASSERT(window_frames > 0);
-    SubVector<double> input_frame(input, t),
-        output_frame(*output, t);
-    output_frame.CopyFromVec(input_frame);
-    output_frame.AddVec(-1.0 / window_frames, cur_sum);
-
-    if (opts.normalize_variance) {
-      if (window_frames == 1) {
-        output_frame.Set(0.0);
-      } else {
-        Vector<double> variance(cur_sumsq);
-        variance.Scale(1.0 / window_frames);
-        variance.AddVec2(-1.0 / (window_frames * window_frames), cur_sum);
-        // now "variance" is the variance of the features in the window,
-        // around their own mean.
-        int32 num_floored;
-	variance.ApplyFloor(1.0e-10, &num_floored);
-        if (num_floored > 0 && num_frames > 1) {
-          if (opts.max_warnings == warning_count) {
-            KALDI_WARN << "Suppressing the remaining variance flooring "
-                       << "warnings. Run program with --max-warnings=-1 to "
-                       << "see all warnings.";
-          }
-          // If opts.max_warnings is a negative number, we won't restrict the
-          // number of times that the warning is printed out.
-          else if (opts.max_warnings < 0
-                   || opts.max_warnings > warning_count) {
-            KALDI_WARN << "Flooring when normalizing variance, floored "
-                       << num_floored << " elements; num-frames was "
-                       << window_frames;
-          }
-          warning_count++;
+    const Real *__restrict__ input_frame = input.RowData(t);
+    Real *__restrict__ output_frame = output->RowData(t);
+    double mean_scale = -1.0 / window_frames;
+
+    if (!opts.normalize_variance) {
+      for (int32 d = 0; d < dim; d++)
+        output_frame[d] = static_cast<double>(input_frame[d]) +
+            mean_scale * sum[d];
+    } else if (window_frames == 1) {
+      for (int32 d = 0; d < dim; d++)
+        output_frame[d] = 0.0;
+    } else {
+      double var_scale = 1.0 / window_frames,
+          mean_sq_scale = -1.0 / (window_frames * window_frames);
+      int32 num_floored = 0;
+      for (int32 d = 0; d < dim; d++) {
+        // the variance of the features in the window, around their own mean.
+        double variance = sumsq[d] * var_scale;
+        variance += mean_sq_scale * sum[d] * sum[d];
+        if (variance < 1.0e-10) {
+          variance = 1.0e-10;
+          num_floored++;
         }
-        variance.ApplyPow(-0.5); // get inverse standard deviation.
-        output_frame.MulElements(variance);
+        inv_stddev[d] = variance;
       }
+      if (num_floored > 0 && num_frames > 1) {
+        if (opts.max_warnings == warning_count) {
+          KALDI_WARN << "Suppressing the remaining variance flooring "
+                     << "warnings. Run program with --max-warnings=-1 to "
+                     << "see all warnings.";
+        }
+        // If opts.max_warnings is a negative number, we won't restrict the
+        // number of times that the warning is printed out.
+        else if (opts.max_warnings < 0
+                 || opts.max_warnings > warning_count) {
+          KALDI_WARN << "Flooring when normalizing variance, floored "
+                     << num_floored << " elements; num-frames was "
+                     << window_frames;
+        }
+        warning_count++;
+      }
+      scale.ApplyPow(-0.5); // get inverse standard deviation.
+      for (int32 d = 0; d < dim; d++)
+        output_frame[d] = (static_cast<double>(input_frame[d]) +
+                           mean_scale * sum[d]) * inv_stddev[d];
     }
   }
 }
@@ -351,10 +381,15 @@ void SlidingWindowCmn(const SlidingWindowCmnOptions &opts,
                       const MatrixBase<BaseFloat> &input,
                       MatrixBase<BaseFloat> *output) {
   KALDI_ASSERT(SameDim(input, *output) && input.NumRows() > 0);
-  Matrix<double> input_dbl(input), output_dbl(input.NumRows(), input.NumCols());
-  // call double-precision version
-  SlidingWindowCmnInternal(opts, input_dbl, &output_dbl);
-  output->CopyFromMat(output_dbl);
+  // The statistics are accumulated in double precision inside, so there is no
+  // need to convert the whole matrix to double.  We do need a copy if the
+  // operation is in-place, as earlier input frames are read again.
+  if (input.Data() == output->Data()) {
+    Matrix<BaseFloat> input_copy(input);
+    SlidingWindowCmnInternal(opts, input_copy, output);
+  } else {
+    SlidingWindowCmnInternal(opts, input, output);
+  }
 }
 
 
@@ -124,6 +124,16 @@ class MfccComputer {
                VectorBase<BaseFloat> *signal_frame,
                VectorBase<BaseFloat> *feature);
 
+  /// Computes the features for a block of frames (one per row of
+  /// 'signal_frames', which is used as a workspace); the results are the same
+  /// as from Compute() up to roundoff, but the filterbank and the DCT are is
+  /// done with matrix operations.  See ExampleFeatureComputer::ComputeBatch()
+  /// in feature-common.h.
+  void ComputeBatch(const VectorBase<BaseFloat> &signal_raw_log_energies,
+                    BaseFloat vtln_warp,
+                    MatrixBase<BaseFloat> *signal_frames,
+                    MatrixBase<BaseFloat> *features);
+
   ~MfccComputer();
  private:
   // disallow assignment.
@@ -84,4 +84,18 @@ void SpectrogramComputer::Compute(BaseFloat signal_raw_log_energy,
   (*feature)(0) = signal_raw_log_energy;
 }
 
+void SpectrogramComputer::ComputeBatch(
+    const VectorBase<BaseFloat> &signal_raw_log_energies,
+    BaseFloat vtln_warp,
+    MatrixBase<BaseFloat> *signal_frames,
+    MatrixBase<BaseFloat> *features) {
+  KALDI_ASSERT(signal_raw_log_energies.Dim() == signal_frames->NumRows() &&
+               features->NumRows() == signal_frames->NumRows());
+  for (int32 r = 0; r < signal_frames->NumRows(); r++) {
+    SubVector<BaseFloat> signal_frame(*signal_frames, r),
+        feature(*features, r);
+    Compute(signal_raw_log_energies(r), vtln_warp, &signal_frame, &feature);
+  }
+}
+
 }  // namespace kaldi
@@ -250,6 +250,38 @@ void MelBanks::Compute(const VectorBase<BaseFloat> &power_spectrum,
   }
 }
 
+void MelBanks::Compute(const MatrixBase<BaseFloat> &power_spectra,
+                       MatrixBase<BaseFloat> *mel_energies_out) const {
+  int32 num_bins = bins_.size(),
+      num_frames = power_spectra.NumRows();
+  KALDI_ASSERT(mel_energies_out->NumRows() == num_frames &&
+               mel_energies_out->NumCols() == num_bins);
+
+  Vector<BaseFloat> energies(num_frames, kUndefined);
+  for (int32 i = 0; i < num_bins; i++) {
+    int32 offset = bins_[i].first;
+    const Vector<BaseFloat> &v(bins_[i].second);
+    energies.AddMatVec(1.0, power_spectra.ColRange(offset, v.Dim()), kNoTrans,
+                       v, 0.0);
+    mel_energies_out->CopyColFromVec(energies, i);
+  }
+  // HTK-like flooring- for testing purposes (we prefer dither)
+  if (htk_mode_)
+    mel_energies_out->ApplyFloor(1.0);
+
+  // See the comment about OpenBlas in the vector version of Compute().
+  KALDI_ASSERT(!KALDI_ISNAN(mel_energies_out->Sum()));
+
+  if (debug_) {
+    fprintf(stderr, "MEL BANKS:\n");
+    for (int32 r = 0; r < num_frames; r++) {
+      for (int32 i = 0; i < num_bins; i++)
+        fprintf(stderr, " %f", (*mel_energies_out)(r, i));
+      fprintf(stderr, "\n");
+    }
+  }
+}
+
 void ComputeLifterCoeffs(BaseFloat Q, VectorBase<BaseFloat> *coeffs) {
   // Compute liftering coefficients (scaling on cepstral coeffs)
   // coeffs are numbered slightly differently from HTK: the zeroth
@@ -111,6 +111,14 @@ class MelBanks {
   void Compute(const VectorBase<BaseFloat> &fft_energies,
                VectorBase<BaseFloat> *mel_energies_out) const;
 
+  /// Computes the Mel energies of several frames at once: row i of
+  /// "mel_energies_out" is set to what the vector version of Compute() would
+  /// give for row i of "fft_energies".  Each bin is applied to its band of
+  /// FFT bins for all the frames in one matrix-vector product, which is much
+  /// faster than doing one frame at a time.
+  void Compute(const MatrixBase<BaseFloat> &fft_energies,
+               MatrixBase<BaseFloat> *mel_energies_out) const;
+
   int32 NumBins() const { return bins_.size(); }
 
   // returns vector of central freq of each bin; needed by plp code.
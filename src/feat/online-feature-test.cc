@@ -22,6 +22,7 @@
 #include "feat/online-feature.h"
 #include "feat/wave-reader.h"
 #include "matrix/kaldi-matrix.h"
+#include "transform/cmvn.h"
 #include "transform/transform-common.h"
 
 namespace kaldi {
@@ -94,6 +95,75 @@ void TestOnlineMatrixCacheFeature() {
   AssertEqual(input_feats, output_feats);
 }
 
+// test OnlineCacheFeature with a bounded number of cached frames.
+void TestOnlineCacheFeatureBounded() {
+  int32 dim = 2 + rand() % 5;
+  int32 num_frames = 100 + rand() % 100;
+  Matrix<BaseFloat> input_feats(num_frames, dim);
+  input_feats.SetRandn();
+
+  OnlineMatrixFeature matrix_feats(input_feats);
+  OnlineCacheFeature cache(&matrix_feats, 1 + rand() % 20);
+  for (int32 i = 0; i < 3 * num_frames; i++) {
+    // mostly recent frames, as in online decoding.
+    int32 t = std::min(num_frames - 1, i / 3 + rand() % 10);
+    Vector<BaseFloat> feat(dim);
+    cache.GetFrame(t, &feat);
+    SubVector<BaseFloat> input_feat(input_feats, t);
+    AssertEqual(feat, input_feat);
+    std::vector<int32> frames;
+    frames.push_back(t);
+    frames.push_back(rand() % num_frames);
+    frames.push_back(t);
+    Matrix<BaseFloat> feats(3, dim);
+    cache.GetFrames(frames, &feats);
+    for (int32 j = 0; j < 3; j++) {
+      SubVector<BaseFloat> feat(feats, j), input_feat(input_feats, frames[j]);
+      AssertEqual(feat, input_feat);
+    }
+  }
+}
+
+// test that OnlineCmvn gives the same output and state in bounded-memory mode.
+void TestOnlineCmvnBounded() {
+  int32 dim = 2 + rand() % 5;
+  int32 num_frames = 500 + rand() % 500;
+  Matrix<BaseFloat> input_feats(num_frames, dim);
+  input_feats.SetRandn();
+  input_feats.Add(1.0);
+
+  Matrix<double> global_stats(2, dim + 1);
+  AccCmvnStats(input_feats, NULL, &global_stats);
+
+  OnlineCmvnOptions opts;
+  opts.cmn_window = 50 + rand() % 100;
+  opts.speaker_frames = opts.cmn_window;
+  opts.global_frames = 20;
+  opts.normalize_variance = (rand() % 2 == 0);
+  OnlineCmvnOptions bounded_opts(opts);
+  bounded_opts.max_retained_frames = opts.cmn_window + 1 + rand() % 100;
+  bounded_opts.Check();
+
+  OnlineMatrixFeature matrix_feats(input_feats);
+  OnlineCmvnState state(global_stats);
+  OnlineCmvn cmvn(opts, state, &matrix_feats),
+      bounded_cmvn(bounded_opts, state, &matrix_feats);
+  for (int32 t = 0; t < num_frames; t++) {
+    Vector<BaseFloat> feat(dim), bounded_feat(dim);
+    cmvn.GetFrame(t, &feat);
+    bounded_cmvn.GetFrame(t, &bounded_feat);
+    AssertEqual(feat, bounded_feat);
+    if (t % 100 == 0 || t == num_frames - 1) {
+      OnlineCmvnState cur_state, bounded_state;
+      int32 cur_frame = std::max(-1, t - rand() % 10);
+      cmvn.GetState(cur_frame, &cur_state);
+      bounded_cmvn.GetState(cur_frame, &bounded_state);
+      AssertEqual(cur_state.speaker_cmvn_stats,
+                  bounded_state.speaker_cmvn_stats);
+    }
+  }
+}
+
 void TestOnlineDeltaFeature() {
   int32 dim = 2 + rand() % 5;  // dimension of features.
   int32 num_frames = 100 + rand() % 100;
@@ -244,6 +314,43 @@ void TestOnlinePlp() {
   }
 }
 
+// Checks that the features are the same whether the waveform arrives one frame
+// shift at a time (so the frames are computed one by one) or all at once (so
+// they are computed in blocks with FbankComputer::ComputeBatch()).
+void TestOnlineFbankChunkSizes() {
+  std::ifstream is("../feat/test_data/test.wav", std::ios_base::binary);
+  WaveData wave;
+  wave.Read(is);
+  KALDI_ASSERT(wave.Data().NumRows() == 1);
+  SubVector<BaseFloat> waveform(wave.Data(), 0);
+
+  FbankOptions op;
+  op.frame_opts.dither = 0.0;
+  op.frame_opts.samp_freq = wave.SampFreq();
+  op.use_energy = (RandInt(0, 1) == 0);
+  if (RandInt(0, 1) == 0)
+    op.frame_opts.snip_edges = false;
+
+  OnlineFbank online_fbank_whole(op);
+  online_fbank_whole.AcceptWaveform(wave.SampFreq(), waveform);
+  online_fbank_whole.InputFinished();
+  Matrix<BaseFloat> whole_feats;
+  GetOutput(&online_fbank_whole, &whole_feats);
+
+  OnlineFbank online_fbank_frames(op);
+  int32 shift = op.frame_opts.WindowShift();
+  for (int32 offset = 0; offset < waveform.Dim(); offset += shift) {
+    int32 length = std::min(shift, waveform.Dim() - offset);
+    online_fbank_frames.AcceptWaveform(wave.SampFreq(),
+                                       waveform.Range(offset, length));
+  }
+  online_fbank_frames.InputFinished();
+  Matrix<BaseFloat> frame_feats;
+  GetOutput(&online_fbank_frames, &frame_feats);
+
+  AssertEqual(whole_feats, frame_feats);
+}
+
 void TestOnlineTransform() {
   std::ifstream is("../feat/test_data/test.wav", std::ios_base::binary);
   WaveData wave;
@@ -420,10 +527,13 @@ int main() {
   using namespace kaldi;
   for (int i = 0; i < 10; i++) {
     TestOnlineMatrixCacheFeature();
+    TestOnlineCacheFeatureBounded();
+    TestOnlineCmvnBounded();
     TestOnlineDeltaFeature();
     TestOnlineSpliceFrames();
     TestOnlineMfcc();
     TestOnlinePlp();
+    TestOnlineFbankChunkSizes();
     TestOnlineTransform();
     TestOnlineAppendFeature();
     TestRecyclingVector();
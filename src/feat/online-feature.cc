@@ -130,6 +130,7 @@ void OnlineGenericBaseFeature<C>::InputFinished() {
 template <class C>
 void OnlineGenericBaseFeature<C>::AcceptWaveform(
     BaseFloat sampling_rate, const VectorBase<BaseFloat> &original_waveform) {
+  KALDI_TRACE_SPAN("OnlineBaseFeature::AcceptWaveform");
   if (original_waveform.Dim() == 0)
     return;  // Nothing to do.
   if (input_finished_)
@@ -169,17 +170,49 @@ void OnlineGenericBaseFeature<C>::ComputeFeatures() {
 
   Vector<BaseFloat> window;
   bool need_raw_log_energy = computer_.NeedRawLogEnergy();
-  for (int32 frame = num_frames_old; frame < num_frames_new; frame++) {
+  // note: this online feature-extraction code does not support VTLN.
+  BaseFloat vtln_warp = 1.0;
+  if (num_frames_new - num_frames_old == 1) {
+    int32 frame = num_frames_old;
     BaseFloat raw_log_energy = 0.0;
     ExtractWindow(waveform_offset_, waveform_remainder_, frame,
                   frame_opts, window_function_, &window,
                   need_raw_log_energy ? &raw_log_energy : NULL);
     Vector<BaseFloat> *this_feature = new Vector<BaseFloat>(computer_.Dim(),
                                                             kUndefined);
-    // note: this online feature-extraction code does not support VTLN.
-    BaseFloat vtln_warp = 1.0;
     computer_.Compute(raw_log_energy, vtln_warp, &window, this_feature);
     features_.PushBack(this_feature);
+  } else if (num_frames_new > num_frames_old) {
+    // When several frames are ready (e.g. if the waveform arrives in large
+    // chunks) we compute them with ComputeBatch(), as OfflineFeatureTpl does,
+    // which does the filterbank and cepstral transforms as matrix products.
+    const int32 block_size = 64;
+    int32 num_frames = num_frames_new - num_frames_old;
+    Matrix<BaseFloat> windows(std::min(block_size, num_frames),
+                              frame_opts.PaddedWindowSize(), kUndefined),
+        features(windows.NumRows(), computer_.Dim(), kUndefined);
+    Vector<BaseFloat> raw_log_energies(windows.NumRows());
+    for (int32 start = num_frames_old; start < num_frames_new;
+         start += block_size) {
+      int32 this_num_frames = std::min(block_size, num_frames_new - start);
+      for (int32 i = 0; i < this_num_frames; i++) {
+        BaseFloat raw_log_energy = 0.0;
+        ExtractWindow(waveform_offset_, waveform_remainder_, start + i,
+                      frame_opts, window_function_, &window,
+                      need_raw_log_energy ? &raw_log_energy : NULL);
+        windows.Row(i).CopyFromVec(window);
+        raw_log_energies(i) = raw_log_energy;
+      }
+      SubMatrix<BaseFloat> these_windows(windows, 0, this_num_frames,
+                                         0, windows.NumCols()),
+          these_features(features, 0, this_num_frames, 0, features.NumCols());
+      SubVector<BaseFloat> these_energies(raw_log_energies, 0,
+                                          this_num_frames);
+      computer_.ComputeBatch(these_energies, vtln_warp, &these_windows,
+                             &these_features);
+      for (int32 i = 0; i < this_num_frames; i++)
+        features_.PushBack(new Vector<BaseFloat>(these_features.Row(i)));
+    }
   }
   // OK, we will now discard any portion of the signal that will not be
   // necessary to compute frames in the future.
@@ -238,8 +271,9 @@ void OnlineCmvnState::Read(std::istream &is, bool binary) {
 OnlineCmvn::OnlineCmvn(const OnlineCmvnOptions &opts,
                        const OnlineCmvnState &cmvn_state,
                        OnlineFeatureInterface *src):
-    opts_(opts), temp_stats_(2, src->Dim() + 1),
-    temp_feats_(src->Dim()), temp_feats_dbl_(src->Dim()),
+    opts_(opts), num_cached_stats_discarded_(0), num_speaker_stats_frames_(0),
+    temp_stats_(2, src->Dim() + 1),
+    temp_feats_(src->Dim()),
     src_(src) {
   SetState(cmvn_state);
   if (!SplitStringToIntegers(opts.skip_dims, ":", false, &skip_dims_))
@@ -249,8 +283,9 @@ OnlineCmvn::OnlineCmvn(const OnlineCmvnOptions &opts,
 
 OnlineCmvn::OnlineCmvn(const OnlineCmvnOptions &opts,
                        OnlineFeatureInterface *src):
-    opts_(opts), temp_stats_(2, src->Dim() + 1),
-    temp_feats_(src->Dim()), temp_feats_dbl_(src->Dim()),
+    opts_(opts), num_cached_stats_discarded_(0), num_speaker_stats_frames_(0),
+    temp_stats_(2, src->Dim() + 1),
+    temp_feats_(src->Dim()),
     src_(src) {
   if (!SplitStringToIntegers(opts.skip_dims, ":", false, &skip_dims_))
     KALDI_ERR << "Bad --skip-dims option (should be colon-separated list of "
@@ -278,19 +313,27 @@ void OnlineCmvn::GetMostRecentCachedFrame(int32 frame,
       return;
     }
   }
-  int32 n = frame / opts_.modulus;
-  if (n >= cached_stats_modulo_.size()) {
-    if (cached_stats_modulo_.size() == 0) {
+  int32 n = frame / opts_.modulus,
+      num_cached = num_cached_stats_discarded_ +
+                   static_cast<int32>(cached_stats_modulo_.size());
+  if (n >= num_cached) {
+    if (num_cached == 0) {
       *cached_frame = -1;
       stats->SetZero();
       return;
     } else {
-      n = static_cast<int32>(cached_stats_modulo_.size() - 1);
+      n = num_cached - 1;
     }
   }
+  if (n < num_cached_stats_discarded_)
+    KALDI_ERR << "Requested CMVN for frame " << frame << ", which is too far "
+              << "in the past for max-retained-frames = "
+              << opts_.max_retained_frames;
   *cached_frame = n * opts_.modulus;
-  KALDI_ASSERT(cached_stats_modulo_[n] != NULL);
-  stats->CopyFromMat(*(cached_stats_modulo_[n]));
+  Matrix<double> *cached_stats =
+      cached_stats_modulo_[n - num_cached_stats_discarded_];
+  KALDI_ASSERT(cached_stats != NULL);
+  stats->CopyFromMat(*cached_stats);
 }
 
 // Initialize ring buffer for caching stats.
@@ -305,18 +348,31 @@ void OnlineCmvn::InitRingBufferIfNeeded() {
 void OnlineCmvn::CacheFrame(int32 frame, const MatrixBase<double> &stats) {
   KALDI_ASSERT(frame >= 0);
   if (frame % opts_.modulus == 0) {  // store in cached_stats_modulo_.
-    int32 n = frame / opts_.modulus;
-    if (n >= cached_stats_modulo_.size()) {
+    int32 n = frame / opts_.modulus,
+        num_cached = num_cached_stats_discarded_ +
+                     static_cast<int32>(cached_stats_modulo_.size());
+    if (n >= num_cached) {
       // The following assert is a limitation on in what order you can call
       // CacheFrame.  Fortunately the calling code always calls it in sequence,
       // which it has to because you need a previous frame to compute the
       // current one.
-      KALDI_ASSERT(n == cached_stats_modulo_.size());
+      KALDI_ASSERT(n == num_cached);
       cached_stats_modulo_.push_back(new Matrix<double>(stats));
-    } else {
+      if (opts_.max_retained_frames > 0) {
+        // bounded-memory mode: forget the stats for frames that are too old to
+        // be requested.
+        while (static_cast<int32>(cached_stats_modulo_.size()) *
+               opts_.modulus > opts_.max_retained_frames &&
+               cached_stats_modulo_.size() > 1) {
+          delete cached_stats_modulo_.front();
+          cached_stats_modulo_.pop_front();
+          num_cached_stats_discarded_++;
+        }
+      }
+    } else if (n >= num_cached_stats_discarded_) {
       KALDI_WARN << "Did not expect to reach this part of code.";
       // do what seems right, but we shouldn't get here.
-      cached_stats_modulo_[n]->CopyFromMat(stats);
+      cached_stats_modulo_[n - num_cached_stats_discarded_]->CopyFromMat(stats);
     }
   } else {  // store in the ring buffer.
     InitRingBufferIfNeeded();
@@ -334,34 +390,60 @@ OnlineCmvn::~OnlineCmvn() {
   cached_stats_modulo_.clear();
 }
 
+// Adds (if add == true) or subtracts a frame to/from the sliding-window stats,
+// in a loop the compiler can vectorize; the results are the same as with
+// AddVec() and AddVec2() on the double-precision features.
+static inline void UpdateOnlineCmvnStats(const VectorBase<BaseFloat> &feat,
+                                         bool add, bool normalize_variance,
+                                         MatrixBase<double> *stats) {
+  int32 dim = feat.Dim();
+  // Remove these __restrict__ modifiers if they cause compilation problems.
+  // It's just an optimization.
+  const BaseFloat *__restrict__ feat_data = feat.Data();
+  double *__restrict__ sum = stats->RowData(0),
+      *__restrict__ sumsq = stats->RowData(1);
+  if (add) {
+    for (int32 d = 0; d < dim; d++)
+      sum[d] += feat_data[d];
+    if (normalize_variance) {
+      for (int32 d = 0; d < dim; d++) {
+        double x = feat_data[d];
+        sumsq[d] += x * x;
+      }
+    }
+    sum[dim] += 1.0;
+  } else {
+    for (int32 d = 0; d < dim; d++)
+      sum[d] -= feat_data[d];
+    if (normalize_variance) {
+      for (int32 d = 0; d < dim; d++) {
+        double x = feat_data[d];
+        sumsq[d] -= x * x;
+      }
+    }
+    sum[dim] -= 1.0;
+  }
+}
+
 void OnlineCmvn::ComputeStatsForFrame(int32 frame,
                                       MatrixBase<double> *stats_out) {
   KALDI_ASSERT(frame >= 0 && frame < src_->NumFramesReady());
 
-  int32 dim = this->Dim(), cur_frame;
+  int32 cur_frame;
   GetMostRecentCachedFrame(frame, &cur_frame, stats_out);
 
   Vector<BaseFloat> &feats(temp_feats_);
-  Vector<double> &feats_dbl(temp_feats_dbl_);
   while (cur_frame < frame) {
     cur_frame++;
     src_->GetFrame(cur_frame, &feats);
-    feats_dbl.CopyFromVec(feats);
-    stats_out->Row(0).Range(0, dim).AddVec(1.0, feats_dbl);
-    if (opts_.normalize_variance)
-      stats_out->Row(1).Range(0, dim).AddVec2(1.0, feats_dbl);
-    (*stats_out)(0, dim) += 1.0;
+    UpdateOnlineCmvnStats(feats, true, opts_.normalize_variance, stats_out);
     // it's a sliding buffer; a frame at the back may be
     // leaving the buffer so we have to subtract that.
     int32 prev_frame = cur_frame - opts_.cmn_window;
     if (prev_frame >= 0) {
       // we need to subtract frame prev_f from the stats.
       src_->GetFrame(prev_frame, &feats);
-      feats_dbl.CopyFromVec(feats);
-      stats_out->Row(0).Range(0, dim).AddVec(-1.0, feats_dbl);
-      if (opts_.normalize_variance)
-        stats_out->Row(1).Range(0, dim).AddVec2(-1.0, feats_dbl);
-      (*stats_out)(0, dim) -= 1.0;
+      UpdateOnlineCmvnStats(feats, false, opts_.normalize_variance, stats_out);
     }
     CacheFrame(cur_frame, (*stats_out));
   }
@@ -418,8 +500,22 @@ void OnlineCmvn::SmoothOnlineCmvnStats(const MatrixBase<double> &speaker_stats,
   }
 }
 
+void OnlineCmvn::AdvanceSpeakerStats(int32 frame) {
+  int32 dim = this->Dim();
+  if (speaker_stats_.NumRows() == 0)
+    speaker_stats_.Resize(2, dim + 1);
+  Vector<BaseFloat> &feat(temp_feats_);
+  for (; num_speaker_stats_frames_ <= frame; num_speaker_stats_frames_++) {
+    src_->GetFrame(num_speaker_stats_frames_, &feat);
+    UpdateOnlineCmvnStats(feat, true, true, &speaker_stats_);
+  }
+}
+
 void OnlineCmvn::GetFrame(int32 frame,
                           VectorBase<BaseFloat> *feat) {
+  KALDI_TRACE_SPAN("OnlineCmvn::GetFrame");
+  if (opts_.max_retained_frames > 0)
+    AdvanceSpeakerStats(frame);
   src_->GetFrame(frame, feat);
   KALDI_ASSERT(feat->Dim() == this->Dim());
   int32 dim = feat->Dim();
@@ -473,7 +569,25 @@ void OnlineCmvn::GetState(int32 cur_frame,
       state_out->speaker_cmvn_stats.Resize(2, dim + 1);
     Vector<BaseFloat> feat(dim);
     Vector<double> feat_dbl(dim);
-    for (int32 t = 0; t <= cur_frame; t++) {
+    int32 begin_frame = 0;
+    if (opts_.max_retained_frames > 0 && cur_frame >= 0) {
+      // In bounded-memory mode the early frames may be gone, so we start from
+      // the stats accumulated as the frames were processed; any frames after
+      // cur_frame that they include are subtracted.
+      AdvanceSpeakerStats(cur_frame);
+      state_out->speaker_cmvn_stats.AddMat(1.0, speaker_stats_);
+      for (int32 t = cur_frame + 1; t < num_speaker_stats_frames_; t++) {
+        src_->GetFrame(t, &feat);
+        feat_dbl.CopyFromVec(feat);
+        state_out->speaker_cmvn_stats(0, dim) -= 1.0;
+        state_out->speaker_cmvn_stats.Row(0).Range(0, dim).AddVec(-1.0,
+                                                                   feat_dbl);
+        state_out->speaker_cmvn_stats.Row(1).Range(0, dim).AddVec2(-1.0,
+                                                                    feat_dbl);
+      }
+      begin_frame = cur_frame + 1;
+    }
+    for (int32 t = begin_frame; t <= cur_frame; t++) {
       src_->GetFrame(t, &feat);
       feat_dbl.CopyFromVec(feat);
       state_out->speaker_cmvn_stats(0, dim) += 1.0;
@@ -601,18 +715,48 @@ OnlineDeltaFeature::OnlineDeltaFeature(const DeltaFeaturesOptions &opts,
                                        OnlineFeatureInterface *src):
     src_(src), opts_(opts), delta_features_(opts) { }
 
+Vector<BaseFloat> *OnlineCacheFeature::CachedFrame(int32 t) const {
+  if (max_cached_frames_ <= 0) {
+    return (static_cast<size_t>(t) < cache_.size() ? cache_[t] : NULL);
+  } else {
+    if (cache_.empty())
+      return NULL;
+    int32 index = t % max_cached_frames_;
+    return (cache_frames_[index] == t ? cache_[index] : NULL);
+  }
+}
+
+void OnlineCacheFeature::CacheFrame(int32 t,
+                                    const VectorBase<BaseFloat> &feat) {
+  int32 index = t;
+  if (max_cached_frames_ <= 0) {
+    if (static_cast<size_t>(t) >= cache_.size())
+      cache_.resize(t + 1, NULL);
+  } else {
+    if (cache_.empty()) {
+      cache_.resize(max_cached_frames_, NULL);
+      cache_frames_.resize(max_cached_frames_, -1);
+    }
+    index = t % max_cached_frames_;
+    cache_frames_[index] = t;
+  }
+  if (cache_[index] == NULL) {
+    cache_[index] = new Vector<BaseFloat>(feat);
+    memory_.Add(feat.Dim() * sizeof(BaseFloat));
+  } else {
+    cache_[index]->CopyFromVec(feat);
+  }
+}
+
 void OnlineCacheFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   KALDI_ASSERT(frame >= 0);
-  if (static_cast<size_t>(frame) < cache_.size() && cache_[frame] != NULL) {
-    feat->CopyFromVec(*(cache_[frame]));
+  Vector<BaseFloat> *cached = CachedFrame(frame);
+  if (cached != NULL) {
+    feat->CopyFromVec(*cached);
   } else {
-    if (static_cast<size_t>(frame) >= cache_.size())
-      cache_.resize(frame + 1, NULL);
-    int32 dim = this->Dim();
-    cache_[frame] = new Vector<BaseFloat>(dim);
     // The following call will crash if frame "frame" is not ready.
-    src_->GetFrame(frame, cache_[frame]);
-    feat->CopyFromVec(*(cache_[frame]));
+    src_->GetFrame(frame, feat);
+    CacheFrame(frame, *feat);
   }
 }
 
@@ -629,8 +773,9 @@ void OnlineCacheFeature::GetFrames(
   non_cached_indexes.reserve(frames.size());
   for (int32 i = 0; i < num_frames; i++) {
     int32 t = frames[i];
-    if (static_cast<size_t>(t) < cache_.size() && cache_[t] != NULL) {
-      feats->Row(i).CopyFromVec(*(cache_[t]));
+    Vector<BaseFloat> *cached = CachedFrame(t);
+    if (cached != NULL) {
+      feats->Row(i).CopyFromVec(*cached);
     } else {
       non_cached_frames.push_back(t);
       non_cached_indexes.push_back(i);
@@ -645,16 +790,11 @@ void OnlineCacheFeature::GetFrames(
   src_->GetFrames(non_cached_frames, &non_cached_feats);
   for (int32 i = 0; i < num_non_cached_frames; i++) {
     int32 t = non_cached_frames[i];
-    if (static_cast<size_t>(t) < cache_.size() && cache_[t] != NULL) {
-      // We can reach this point due to repeat indexes in 'non_cached_frames'.
-      feats->Row(non_cached_indexes[i]).CopyFromVec(*(cache_[t]));
-    } else {
-      SubVector<BaseFloat> this_feat(non_cached_feats, i);
-      feats->Row(non_cached_indexes[i]).CopyFromVec(this_feat);
-      if (static_cast<size_t>(t) >= cache_.size())
-        cache_.resize(t + 1, NULL);
-      cache_[t] = new Vector<BaseFloat>(this_feat);
-    }
+    SubVector<BaseFloat> this_feat(non_cached_feats, i);
+    feats->Row(non_cached_indexes[i]).CopyFromVec(this_feat);
+    // There may be repeat indexes in 'non_cached_frames'.
+    if (CachedFrame(t) == NULL)
+      CacheFrame(t, this_feat);
   }
 }
 
@@ -663,6 +803,8 @@ void OnlineCacheFeature::ClearCache() {
   for (size_t i = 0; i < cache_.size(); i++)
     delete cache_[i];
   cache_.resize(0);
+  cache_frames_.resize(0);
+  memory_.Set(0);
 }
 
 
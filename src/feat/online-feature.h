@@ -29,6 +29,7 @@
 
 #include "matrix/matrix-lib.h"
 #include "util/common-utils.h"
+#include "util/memory-budget.h"
 #include "base/kaldi-error.h"
 #include "feat/feature-functions.h"
 #include "feat/feature-mfcc.h"
@@ -213,6 +214,11 @@ struct OnlineCmvnOptions {
   int32 ring_buffer_size;  // not configurable from command line; size of ring
                            // buffer used for caching CMVN stats.  Must be >=
                            // modulus.
+  int32 max_retained_frames;  // not configurable from command line; if > 0,
+                              // bounded-memory mode: stats are only cached for
+                              // the most recent this-many frames, and the
+                              // stats for GetState() are accumulated as we go.
+                              // Must exceed cmn_window.
   std::string skip_dims; // Colon-separated list of dimensions to skip normalization
                          // of, e.g. 13:14:15.
 
@@ -224,11 +230,13 @@ struct OnlineCmvnOptions {
       normalize_variance(false),
       modulus(20),
       ring_buffer_size(20),
+      max_retained_frames(-1),
       skip_dims("") { }
 
   void Check() const {
     KALDI_ASSERT(speaker_frames <= cmn_window && global_frames <= speaker_frames
                  && modulus > 0);
+    KALDI_ASSERT(max_retained_frames <= 0 || max_retained_frames > cmn_window);
   }
 
   void Register(ParseOptions *po) {
@@ -424,20 +432,32 @@ class OnlineCmvn: public OnlineFeatureInterface {
                                  // will reflect the CMVN state that we froze
                                  // at.
 
+  /// Adds the stats of any frames up to and including "frame" that are not
+  /// yet in speaker_stats_ (only used if opts_.max_retained_frames > 0).
+  void AdvanceSpeakerStats(int32 frame);
+
   // The variable below reflects the raw (count, x, x^2) statistics of the
-  // input, computed every opts_.modulus frames.  raw_stats_[n / opts_.modulus]
+  // input, computed every opts_.modulus frames.
+  // cached_stats_modulo_[n / opts_.modulus - num_cached_stats_discarded_]
   // contains the (count, x, x^2) statistics for the frames from
-  // std::max(0, n - opts_.cmn_window) through n.
-  std::vector<Matrix<double>*> cached_stats_modulo_;
+  // std::max(0, n - opts_.cmn_window) through n.  In bounded-memory mode
+  // (opts_.max_retained_frames > 0) the oldest elements are discarded.
+  std::deque<Matrix<double>*> cached_stats_modulo_;
+  int32 num_cached_stats_discarded_;
   // the variable below is a ring-buffer of cached stats.  the int32 is the
   // frame index.
   std::vector<std::pair<int32, Matrix<double> > > cached_stats_ring_;
 
+  // Only used in bounded-memory mode: the (count, x, x^2) stats of frames 0
+  // through num_speaker_stats_frames_ - 1, as needed by GetState(), which
+  // cannot go back to the start of the utterance in that mode.
+  Matrix<double> speaker_stats_;
+  int32 num_speaker_stats_frames_;
+
   // Some temporary variables used inside functions of this class, which
   // put here to avoid reallocation.
   Matrix<double> temp_stats_;
   Vector<BaseFloat> temp_feats_;
-  Vector<double> temp_feats_dbl_;
 
   OnlineFeatureInterface *src_;  // Not owned here
 };
@@ -586,11 +606,31 @@ class OnlineCacheFeature: public OnlineFeatureInterface {
   void ClearCache();  // this should be called if you change the underlying
                       // features in some way.
 
-  explicit OnlineCacheFeature(OnlineFeatureInterface *src): src_(src) { }
+  /// If max_cached_frames > 0, only the most recently requested frames are
+  /// kept (in a ring buffer of that size), so the memory used does not grow
+  /// with the length of the stream; frames that have dropped out of the
+  /// cache are obtained from "src" again if they are requested.
+  explicit OnlineCacheFeature(OnlineFeatureInterface *src,
+                              int32 max_cached_frames = -1):
+      src_(src), max_cached_frames_(max_cached_frames),
+      memory_(kMemoryFeatureCache) { }
  private:
+  // Returns the cached features for frame t, or NULL if not cached.
+  inline Vector<BaseFloat> *CachedFrame(int32 t) const;
+
+  // Caches "feat" as the features for frame t (which must not be cached).
+  void CacheFrame(int32 t, const VectorBase<BaseFloat> &feat);
 
   OnlineFeatureInterface *src_;  // Not owned here
+  int32 max_cached_frames_;
+  // If max_cached_frames_ <= 0, cache_[t] is the features for frame t, or
+  // NULL.  Otherwise cache_ is a ring buffer: cache_[t % max_cached_frames_]
+  // holds frame cache_frames_[t % max_cached_frames_], if that is t.
   std::vector<Vector<BaseFloat>* > cache_;
+  std::vector<int32> cache_frames_;
+  // The memory used by the cached frames, as reported to
+  // MemoryBudget::Global().
+  MemoryAccount memory_;
 };
 
 
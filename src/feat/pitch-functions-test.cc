@@ -282,6 +282,38 @@ static void UnitTestDelay() {
   }
 }
 
+// Make sure that limiting the history kept by the online pitch extractor
+// doesn't change the first-pass online output.
+static void UnitTestMaxFramesHistory() {
+  KALDI_LOG << "=== UnitTestMaxFramesHistory() ===\n";
+  for (int32 n = 0; n < 3; n++) {
+    PitchExtractionOptions op;
+    op.frames_per_chunk = 10;
+    op.simulate_first_pass_online = true;
+    op.max_frames_latency = 20;
+    op.recompute_frame = 100;
+
+    int32 size = 80000 + rand() % 20000;
+    Vector<BaseFloat> v(size);
+    double cur_freq = 200.0, normalized_time = 0.0;
+    for (int32 i = 0; i < size; i++) {
+      v(i) = RandGauss() + cos(normalized_time * M_2PI);
+      cur_freq += RandGauss();  // let the frequency wander a little.
+      if (cur_freq < 100.0) cur_freq = 100.0;
+      if (cur_freq > 300.0) cur_freq = 300.0;
+      normalized_time += cur_freq / op.samp_freq;
+    }
+
+    Matrix<BaseFloat> m1;
+    ComputeKaldiPitch(op, v, &m1);
+    op.max_frames_history = (n == 0 ? 21 : 50 + rand() % 200);
+    Matrix<BaseFloat> m2;
+    ComputeKaldiPitch(op, v, &m2);
+    AssertEqual(m1, m2, 1.0e-08);  // should be identical.
+  }
+  KALDI_LOG << "Test passed :)\n";
+}
+
 extern bool pitch_use_naive_search; // was declared in pitch-functions.cc
 
 // Make sure that doing a calculation on the whole waveform gives
@@ -599,6 +631,7 @@ static void UnitTestFeatNoKeele() {
   UnitTestSnipEdges();
   UnitTestDelay();
   UnitTestSearch();
+  UnitTestMaxFramesHistory();
 }
 
 static void UnitTestFeatWithKeele() {
@@ -22,6 +22,7 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <deque>
 #include <limits>
 
 #include "feat/feature-functions.h"
@@ -212,7 +213,7 @@ class PitchFrameInfo {
   /// info for the final state; the iterator will be decremented inside this
   /// function.
   void SetBestState(int32 best_state,
-      std::vector<std::pair<int32, BaseFloat> > &lag_nccf);
+      std::deque<std::pair<int32, BaseFloat> > &lag_nccf);
 
   /// This function may be called on the last (most recent) PitchFrameInfo
   /// object; it computes how many frames of latency there is because the
@@ -225,6 +226,12 @@ class PitchFrameInfo {
   /// This function updates
   bool UpdatePreviousBestState(PitchFrameInfo *prev_frame);
 
+  /// Makes this the first frame in the traceback, by forgetting the previous
+  /// frame (which the caller is about to delete).  Like frame -1, this frame's
+  /// lag-index and NCCF will no longer be written by SetBestState(), so they
+  /// are fixed at their current values.
+  void SetAsFirstFrame() { prev_info_ = NULL; }
+
   /// This constructor is used for frame -1; it sets the costs to be all zeros
   /// the pov_nccf's to zero and the backpointers to -1.
   explicit PitchFrameInfo(int32 num_states);
@@ -485,13 +492,14 @@ void PitchFrameInfo::ComputeBacktraces(
 
 void PitchFrameInfo::SetBestState(
     int32 best_state,
-    std::vector<std::pair<int32, BaseFloat> > &lag_nccf) {
+    std::deque<std::pair<int32, BaseFloat> > &lag_nccf) {
 
   // This function would naturally be recursive, but we have coded this to avoid
   // recursion, which would otherwise eat up the stack.  Think of it as a static
   // member function, except we do use "this" right at the beginning.
 
-  std::vector<std::pair<int32, BaseFloat> >::reverse_iterator iter = lag_nccf.rbegin();
+  std::deque<std::pair<int32, BaseFloat> >::reverse_iterator iter =
+      lag_nccf.rbegin();
 
   PitchFrameInfo *this_info = this;  // it will change in the loop.
   while (this_info != NULL) {
@@ -640,6 +648,24 @@ class OnlinePitchFeatureImpl {
   /// from AcceptWaveform().
   void UpdateRemainder(const VectorBase<BaseFloat> &downsampled_wave_part);
 
+  /// The number of frames for which we have done the Viterbi computation,
+  /// including any that were discarded by PruneHistory().
+  int32 NumFramesProcessed() const {
+    return static_cast<int32>(frame_info_.size()) - 1 +
+        num_frame_info_discarded_;
+  }
+
+  /// This function is called from AcceptWaveform() if
+  /// opts_.max_frames_history > 0.  It discards the PitchFrameInfo objects
+  /// for frames before the most recent frame on which all paths in the
+  /// traceback agree, and for frames more than opts_.max_frames_history
+  /// in the past even if the paths don't agree; and it discards lag_nccf_
+  /// for frames more than opts_.max_frames_history in the past, except those
+  /// that were not ready before this call to AcceptWaveform()
+  /// (prev_frames_ready is the value of NumFramesReady() before the call), as
+  /// the user has not had the chance to read them.
+  void PruneHistory(int32 prev_frames_ready);
+
 
   // The following variables don't change throughout the lifetime
   // of this object.
@@ -663,9 +689,15 @@ class OnlinePitchFeatureImpl {
   // This object is used to resample the signal.
   LinearResample *signal_resampler_;
 
-  // frame_info_ is indexed by [frame-index + 1].  frame_info_[0] is an object
-  // that corresponds to frame -1, which is not a real frame.
-  std::vector<PitchFrameInfo*> frame_info_;
+  // frame_info_ is indexed by [frame-index + 1 - num_frame_info_discarded_].
+  // frame_info_[0] is an object that corresponds to frame -1, which is not a
+  // real frame, or (after PruneHistory()) to the last discarded frame, whose
+  // traceback is fixed.
+  std::deque<PitchFrameInfo*> frame_info_;
+
+  // The number of frames whose PitchFrameInfo objects were discarded by
+  // PruneHistory().
+  int32 num_frame_info_discarded_;
 
 
   // nccf_info_ is indexed by frame-index, from frame 0 to at most
@@ -690,7 +722,12 @@ class OnlinePitchFeatureImpl {
   // The resampled-lag index and the NCCF (as computed for POV, without ballast
   // term) for each frame, as determined by Viterbi traceback from the best
   // final state.
-  std::vector<std::pair<int32, BaseFloat> > lag_nccf_;
+  // It is indexed by [frame-index - num_lag_nccf_discarded_].
+  std::deque<std::pair<int32, BaseFloat> > lag_nccf_;
+
+  // The number of frames whose entries in lag_nccf_ were discarded by
+  // PruneHistory().
+  int32 num_lag_nccf_discarded_;
 
   bool input_finished_;
 
@@ -714,7 +751,8 @@ class OnlinePitchFeatureImpl {
 
 OnlinePitchFeatureImpl::OnlinePitchFeatureImpl(
     const PitchExtractionOptions &opts):
-    opts_(opts), forward_cost_remainder_(0.0), input_finished_(false),
+    opts_(opts), num_frame_info_discarded_(0), forward_cost_remainder_(0.0),
+    num_lag_nccf_discarded_(0), input_finished_(false),
     signal_sumsq_(0.0), signal_sum_(0.0), downsampled_samples_processed_(0) {
   signal_resampler_ = new LinearResample(opts.samp_freq, opts.resample_freq,
                                          opts.lowpass_cutoff,
@@ -729,6 +767,12 @@ OnlinePitchFeatureImpl::OnlinePitchFeatureImpl(
 
   frames_latency_ = 0;  // will be set in AcceptWaveform()
 
+  if (opts.max_frames_history != 0 &&
+      opts.max_frames_history <= opts.max_frames_latency)
+    KALDI_ERR << "--max-frames-history=" << opts.max_frames_history
+              << " must exceed --max-frames-latency="
+              << opts.max_frames_latency;
+
   // Choose the lags at which we resample the NCCF.
   SelectLags(opts, &lags_);
 
@@ -793,9 +837,7 @@ int32 OnlinePitchFeatureImpl::NumFramesAvailable(
 
 void OnlinePitchFeatureImpl::UpdateRemainder(
     const VectorBase<BaseFloat> &downsampled_wave_part) {
-  // frame_info_ has an extra element at frame-1, so subtract
-  // one from the length.
-  int64 num_frames = static_cast<int64>(frame_info_.size()) - 1,
+  int64 num_frames = NumFramesProcessed(),
       next_frame = num_frames,
       frame_shift = opts_.NccfWindowShift(),
       next_frame_sample = frame_shift * next_frame;
@@ -911,7 +953,7 @@ BaseFloat OnlinePitchFeatureImpl::FrameShiftInSeconds() const {
 }
 
 int32 OnlinePitchFeatureImpl::NumFramesReady() const {
-  int32 num_frames = lag_nccf_.size(),
+  int32 num_frames = lag_nccf_.size() + num_lag_nccf_discarded_,
       latency = frames_latency_;
   KALDI_ASSERT(latency <= num_frames);
   return num_frames - latency;
@@ -921,8 +963,13 @@ int32 OnlinePitchFeatureImpl::NumFramesReady() const {
 void OnlinePitchFeatureImpl::GetFrame(int32 frame,
                                       VectorBase<BaseFloat> *feat) {
   KALDI_ASSERT(frame < NumFramesReady() && feat->Dim() == 2);
-  (*feat)(0) = lag_nccf_[frame].second;
-  (*feat)(1) = 1.0 / lags_(lag_nccf_[frame].first);
+  if (frame < num_lag_nccf_discarded_)
+    KALDI_ERR << "Pitch for frame " << frame << " is no longer available "
+              << "(--max-frames-history=" << opts_.max_frames_history << ")";
+  const std::pair<int32, BaseFloat> &lag_nccf =
+      lag_nccf_[frame - num_lag_nccf_discarded_];
+  (*feat)(0) = lag_nccf.second;
+  (*feat)(1) = 1.0 / lags_(lag_nccf.first);
 }
 
 void OnlinePitchFeatureImpl::InputFinished() {
@@ -931,7 +978,7 @@ void OnlinePitchFeatureImpl::InputFinished() {
   // after setting input_finished_ to true, NumFramesAvailable()
   // will return a slightly larger number.
   AcceptWaveform(opts_.samp_freq, Vector<BaseFloat>());
-  int32 num_frames = static_cast<size_t>(frame_info_.size() - 1);
+  int32 num_frames = NumFramesProcessed();
   if (num_frames < opts_.recompute_frame && !opts_.nccf_ballast_online)
     RecomputeBacktraces();
   frames_latency_ = 0;
@@ -943,7 +990,7 @@ void OnlinePitchFeatureImpl::InputFinished() {
 // see comment with declaration.  This is only relevant for online
 // operation (it gets called for non-online mode, but is a no-op).
 void OnlinePitchFeatureImpl::RecomputeBacktraces() {
-  KALDI_ASSERT(!opts_.nccf_ballast_online);
+  KALDI_ASSERT(!opts_.nccf_ballast_online && num_frame_info_discarded_ == 0);
   int32 num_frames = static_cast<int32>(frame_info_.size()) - 1;
 
   // The assertion reflects how we believe this function will be called.
@@ -1049,6 +1096,7 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
   // flush out the last few samples of input waveform only if input_finished_ ==
   // true.
   const bool flush = input_finished_;
+  const int32 prev_frames_ready = NumFramesReady();
 
   Vector<BaseFloat> downsampled_wave;
   signal_resampler_->Resample(wave, flush, &downsampled_wave);
@@ -1069,7 +1117,7 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
   int32 end_frame = NumFramesAvailable(
       downsampled_samples_processed_ + downsampled_wave.Dim(), opts_.snip_edges);
   // "start_frame" is the first frame-index we process
-  int32 start_frame = frame_info_.size() - 1,
+  int32 start_frame = NumFramesProcessed(),
       num_new_frames = end_frame - start_frame;
 
   if (num_new_frames == 0) {
@@ -1190,11 +1238,50 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
   // Trace back the best-path.
   int32 best_final_state;
   forward_cost_.Min(&best_final_state);
-  lag_nccf_.resize(frame_info_.size() - 1);  // will keep any existing data.
+  // will keep any existing data.
+  lag_nccf_.resize(NumFramesProcessed() - num_lag_nccf_discarded_);
   frame_info_.back()->SetBestState(best_final_state, lag_nccf_);
   frames_latency_ =
       frame_info_.back()->ComputeLatency(opts_.max_frames_latency);
   KALDI_VLOG(4) << "Latency is " << frames_latency_;
+  // We can't prune before the backtraces for the first recompute_frame frames
+  // have been recomputed, as RecomputeBacktraces() needs them.  There is no
+  // point pruning once the input is finished, and the user may not yet have
+  // read the frames that became ready on the previous call.
+  if (opts_.max_frames_history > 0 && !input_finished_ &&
+      (opts_.nccf_ballast_online ||
+       NumFramesProcessed() >= opts_.recompute_frame))
+    PruneHistory(prev_frames_ready);
+}
+
+void OnlinePitchFeatureImpl::PruneHistory(int32 prev_frames_ready) {
+  // The traceback from all states of the last frame converges to a single
+  // state on the frame before "latency" frames back from the last one (if it
+  // converges after frame_info_[0]), so that frame and the ones before it
+  // can't change any more; that frame can become the new frame_info_[0].
+  int32 last_index = static_cast<int32>(frame_info_.size()) - 1,
+      latency = frame_info_.back()->ComputeLatency(last_index),
+      new_first_index = last_index - latency - 1;
+  // Limit the length of the traceback even if it has not converged.
+  new_first_index = std::max(new_first_index,
+                             last_index - opts_.max_frames_history);
+  if (new_first_index > 0) {
+    for (int32 i = 0; i < new_first_index; i++)
+      delete frame_info_[i];
+    frame_info_.erase(frame_info_.begin(),
+                      frame_info_.begin() + new_first_index);
+    frame_info_.front()->SetAsFirstFrame();
+    num_frame_info_discarded_ += new_first_index;
+  }
+  // We must keep the entries of lag_nccf_ for the frames after
+  // frame_info_[0], as SetBestState() writes them.
+  int32 num_discard = std::min(NumFramesProcessed() -
+                               opts_.max_frames_history,
+                               prev_frames_ready) - num_lag_nccf_discarded_;
+  if (num_discard > 0) {
+    lag_nccf_.erase(lag_nccf_.begin(), lag_nccf_.begin() + num_discard);
+    num_lag_nccf_discarded_ += num_discard;
+  }
 }
 
 
@@ -1295,7 +1382,10 @@ void ComputeKaldiPitch(const PitchExtractionOptions &opts,
     ComputeKaldiPitchFirstPass(opts, wave, output);
     return;
   }
-  OnlinePitchFeature pitch_extractor(opts);
+  // We read all the frames at the end, so we can't discard any.
+  PitchExtractionOptions full_opts(opts);
+  full_opts.max_frames_history = 0;
+  OnlinePitchFeature pitch_extractor(full_opts);
 
   if (opts.frames_per_chunk == 0) {
     pitch_extractor.AcceptWaveform(opts.samp_freq, wave);
@@ -73,6 +73,18 @@ struct PitchExtractionOptions {
   // can just leave this value at zero.
   int32 max_frames_latency;
 
+  // If nonzero, the online pitch extractor keeps the traceback information
+  // and the output for only this many of the most recent frames, so that its
+  // memory use and per-frame cost do not grow with the length of the input;
+  // this is intended for very long streams.  Frames older than this, that
+  // were ready before the most recent call to AcceptWaveform(), can no longer
+  // be accessed via GetFrame().  The traceback of frames older than this is
+  // fixed even if it has not yet converged, but it normally converges within
+  // a few tens of frames.  Must exceed max_frames_latency, and should exceed
+  // the left-context needed by OnlineProcessPitch (see
+  // normalization_left_context).  Zero means keep all frames.
+  int32 max_frames_history;
+
   // Only relevant for the function ComputeKaldiPitch which is called by
   // compute-kaldi-pitch-feats. If nonzero, we provide the input as chunks of
   // this size. This affects the energy normalization which has a small effect
@@ -126,6 +138,7 @@ struct PitchExtractionOptions {
       lowpass_filter_width(1),
       upsample_filter_width(5),
       max_frames_latency(0),
+      max_frames_history(0),
       frames_per_chunk(0),
       simulate_first_pass_online(false),
       recompute_frame(500),
@@ -190,6 +203,12 @@ struct PitchExtractionOptions {
                    "introduce into the feature processing (affects output only "
                    "if --frames-per-chunk > 0 and "
                    "--simulate-first-pass-online=true");
+    opts->Register("max-frames-history", &max_frames_history, "If nonzero, "
+                   "online pitch extraction keeps only this many of the most "
+                   "recent frames in memory, for use with very long streams; "
+                   "older frames can no longer be accessed.  Must exceed "
+                   "--max-frames-latency.  Only relevant for online "
+                   "operation or with --simulate-first-pass-online=true.");
     opts->Register("snip-edges", &snip_edges, "If this is set to false, the "
                    "incomplete frames near the ending edge won't be snipped, "
                    "so that the number of frames is the file size divided by "
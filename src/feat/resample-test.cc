@@ -275,8 +275,43 @@ void UnitTestLinearResample2() {
   AssertEqual(self1, cross, 0.001);
 }
 
+// Checks that the SIMD kernels (if any) agree with the generic code, for the
+// common sample-rate conversions, with the signal processed in pieces.
+void UnitTestLinearResampleSimd() {
+  int32 rates[][2] = { { 8000, 16000 }, { 44100, 16000 }, { 48000, 16000 },
+                       { 16000, 4000 }, { 22050, 16000 } };
+  for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+    int32 samp_freq = rates[r][0], resamp_freq = rates[r][1];
+    BaseFloat cutoff = 0.99 * 0.5 * std::min(samp_freq, resamp_freq);
+    int32 num_samp = 1000 + Rand() % 3000, num_pieces = RandInt(1, 4);
+    Vector<BaseFloat> signal(num_samp);
+    signal.SetRandn();
+
+    Vector<BaseFloat> output[2];
+    for (int32 use_simd = 0; use_simd <= 1; use_simd++) {
+      LinearResample::SetUseSimd(use_simd != 0);
+      LinearResample resampler(samp_freq, resamp_freq, cutoff, 6);
+      for (int32 p = 0; p < num_pieces; p++) {
+        int32 start = num_samp * p / num_pieces,
+            end = num_samp * (p + 1) / num_pieces;
+        SubVector<BaseFloat> piece(signal, start, end - start);
+        Vector<BaseFloat> piece_output;
+        resampler.Resample(piece, p + 1 == num_pieces, &piece_output);
+        int32 dim = output[use_simd].Dim();
+        output[use_simd].Resize(dim + piece_output.Dim(), kCopyData);
+        output[use_simd].Range(dim, piece_output.Dim()).CopyFromVec(
+            piece_output);
+      }
+    }
+    KALDI_ASSERT(output[0].Dim() == output[1].Dim() &&
+                 output[0].ApproxEqual(output[1], 1.0e-05));
+  }
+  KALDI_LOG << "Resampling kernels are " << LinearResample::SimdKernelName();
+}
+
 int main() {
   try {
+    UnitTestLinearResampleSimd();
     for (int32 x = 0; x < 50; x++)
       UnitTestLinearResample();
     for (int32 x = 0; x < 50; x++)
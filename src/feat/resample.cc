@@ -27,8 +27,165 @@
 #include "matrix/matrix-functions.h"
 #include "feat/resample.h"
 
+// As in matrix/srfft.cc, the SIMD kernels are compiled for x86 with
+// GCC-compatible compilers (selected at run time, so no special compiler flags
+// are needed), and for 64-bit ARM (NEON, which is always available).
+#if defined(__GNUC__) && (__GNUC__ >= 8 || defined(__clang__)) && \
+    defined(__x86_64__)
+#define KALDI_RESAMPLE_X86_SIMD 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define KALDI_RESAMPLE_NEON 1
+#include <arm_neon.h>
+#endif
+
 namespace kaldi {
 
+namespace {
+
+// The number of taps in each row of LinearResample::weights_ is rounded up to
+// a multiple of this.
+const int32 kTapsMultiple = 8;
+
+// The kernels compute a block of n consecutive output samples of
+// LinearResample, all of whose filter windows lie inside the input: they set
+//   out[k] = sum_{0 <= j < num_taps} w[p * w_stride + j] * x[first_index[p] + j]
+// for 0 <= k < n, where p starts at 'phase' and cycles through
+// 0 .. num_phases - 1, and x advances by input_step each time p wraps
+// around to zero.  num_taps is a multiple of kTapsMultiple.
+template<typename Real>
+void ResampleBlockGeneric(const Real *x, const Real *w, int32 w_stride,
+                          int32 num_taps, const int32 *first_index,
+                          int32 num_phases, int32 input_step, int32 phase,
+                          int32 n, Real *out) {
+  for (int32 k = 0; k < n; k++) {
+    const Real *xk = x + first_index[phase], *wk = w + phase * w_stride;
+    Real sum = 0.0;
+    for (int32 j = 0; j < num_taps; j++)
+      sum += wk[j] * xk[j];
+    out[k] = sum;
+    if (++phase == num_phases) {
+      phase = 0;
+      x += input_step;
+    }
+  }
+}
+
+#ifdef KALDI_RESAMPLE_X86_SIMD
+
+__attribute__((target("avx2,fma")))
+void ResampleBlockAvx2(const float *x, const float *w, int32 w_stride,
+                       int32 num_taps, const int32 *first_index,
+                       int32 num_phases, int32 input_step, int32 phase,
+                       int32 n, float *out) {
+  for (int32 k = 0; k < n; k++) {
+    const float *xk = x + first_index[phase], *wk = w + phase * w_stride;
+    __m256 acc = _mm256_mul_ps(_mm256_loadu_ps(wk), _mm256_loadu_ps(xk));
+    for (int32 j = 8; j < num_taps; j += 8)
+      acc = _mm256_fmadd_ps(_mm256_loadu_ps(wk + j), _mm256_loadu_ps(xk + j),
+                            acc);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc),
+                          _mm256_extractf128_ps(acc, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    out[k] = _mm_cvtss_f32(s);
+    if (++phase == num_phases) {
+      phase = 0;
+      x += input_step;
+    }
+  }
+  _mm256_zeroupper();
+}
+
+#endif  // KALDI_RESAMPLE_X86_SIMD
+
+#ifdef KALDI_RESAMPLE_NEON
+
+void ResampleBlockNeon(const float *x, const float *w, int32 w_stride,
+                       int32 num_taps, const int32 *first_index,
+                       int32 num_phases, int32 input_step, int32 phase,
+                       int32 n, float *out) {
+  for (int32 k = 0; k < n; k++) {
+    const float *xk = x + first_index[phase], *wk = w + phase * w_stride;
+    float32x4_t acc0 = vmulq_f32(vld1q_f32(wk), vld1q_f32(xk)),
+        acc1 = vmulq_f32(vld1q_f32(wk + 4), vld1q_f32(xk + 4));
+    for (int32 j = 8; j < num_taps; j += 8) {
+      acc0 = vfmaq_f32(acc0, vld1q_f32(wk + j), vld1q_f32(xk + j));
+      acc1 = vfmaq_f32(acc1, vld1q_f32(wk + j + 4), vld1q_f32(xk + j + 4));
+    }
+    out[k] = vaddvq_f32(vaddq_f32(acc0, acc1));
+    if (++phase == num_phases) {
+      phase = 0;
+      x += input_step;
+    }
+  }
+}
+
+#endif  // KALDI_RESAMPLE_NEON
+
+struct ResampleKernels {
+  const char *name;
+  void (*block)(const float *x, const float *w, int32 w_stride,
+                int32 num_taps, const int32 *first_index, int32 num_phases,
+                int32 input_step, int32 phase, int32 n, float *out);
+};
+
+const ResampleKernels kGenericKernels = { "generic",
+                                          ResampleBlockGeneric<float> };
+#ifdef KALDI_RESAMPLE_X86_SIMD
+const ResampleKernels kAvx2Kernels = { "avx2", ResampleBlockAvx2 };
+#endif
+#ifdef KALDI_RESAMPLE_NEON
+const ResampleKernels kNeonKernels = { "neon", ResampleBlockNeon };
+#endif
+
+const ResampleKernels *SelectSimdKernels() {
+#ifdef KALDI_RESAMPLE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return &kAvx2Kernels;
+#endif
+#ifdef KALDI_RESAMPLE_NEON
+  return &kNeonKernels;
+#endif
+  return &kGenericKernels;
+}
+
+bool resample_use_simd = true;
+
+const ResampleKernels &Kernels() {
+  static const ResampleKernels *simd_kernels = SelectSimdKernels();
+  return (resample_use_simd ? *simd_kernels : kGenericKernels);
+}
+
+inline void ResampleBlock(const float *x, const float *w, int32 w_stride,
+                          int32 num_taps, const int32 *first_index,
+                          int32 num_phases, int32 input_step, int32 phase,
+                          int32 n, float *out) {
+  Kernels().block(x, w, w_stride, num_taps, first_index, num_phases,
+                  input_step, phase, n, out);
+}
+
+inline void ResampleBlock(const double *x, const double *w, int32 w_stride,
+                          int32 num_taps, const int32 *first_index,
+                          int32 num_phases, int32 input_step, int32 phase,
+                          int32 n, double *out) {
+  ResampleBlockGeneric(x, w, w_stride, num_taps, first_index, num_phases,
+                       input_step, phase, n, out);
+}
+
+}  // namespace
+
+
+void LinearResample::SetUseSimd(bool use_simd) {
+  resample_use_simd = use_simd;
+}
+
+const char *LinearResample::SimdKernelName() {
+  return (sizeof(BaseFloat) == sizeof(float) ? Kernels().name : "generic");
+}
+
+
 
 LinearResample::LinearResample(int32 samp_rate_in_hz,
                                int32 samp_rate_out_hz,
@@ -103,10 +260,11 @@ int64 LinearResample::GetNumOutputSamples(int64 input_num_samp,
 
 void LinearResample::SetIndexesAndWeights() {
   first_index_.resize(output_samples_in_unit_);
-  weights_.resize(output_samples_in_unit_);
+  std::vector<int32> num_indices(output_samples_in_unit_);
 
   double window_width = num_zeros_ / (2.0 * filter_cutoff_);
 
+  int32 max_num_indices = 0;
   for (int32 i = 0; i < output_samples_in_unit_; i++) {
     double output_t = i / static_cast<double>(samp_rate_out_);
     double min_t = output_t - window_width, max_t = output_t + window_width;
@@ -118,16 +276,24 @@ void LinearResample::SetIndexesAndWeights() {
     // that we unnecessarily include something with a zero coefficient,
     // but this is only a slight efficiency issue.
     int32 min_input_index = ceil(min_t * samp_rate_in_),
-        max_input_index = floor(max_t * samp_rate_in_),
-        num_indices = max_input_index - min_input_index + 1;
+        max_input_index = floor(max_t * samp_rate_in_);
     first_index_[i] = min_input_index;
-    weights_[i].Resize(num_indices);
-    for (int32 j = 0; j < num_indices; j++) {
-      int32 input_index = min_input_index + j;
+    num_indices[i] = max_input_index - min_input_index + 1;
+    max_num_indices = std::max(max_num_indices, num_indices[i]);
+  }
+  // Pad all rows of the filter bank to the same length, a multiple of
+  // kTapsMultiple, for the SIMD kernels.
+  int32 num_taps = (max_num_indices + kTapsMultiple - 1) /
+      kTapsMultiple * kTapsMultiple;
+  weights_.Resize(output_samples_in_unit_, num_taps);
+  for (int32 i = 0; i < output_samples_in_unit_; i++) {
+    double output_t = i / static_cast<double>(samp_rate_out_);
+    for (int32 j = 0; j < num_indices[i]; j++) {
+      int32 input_index = first_index_[i] + j;
       double input_t = input_index / static_cast<double>(samp_rate_in_),
           delta_t = input_t - output_t;
       // sign of delta_t doesn't matter.
-      weights_[i](j) = FilterFunc(delta_t) / samp_rate_in_;
+      weights_(i, j) = FilterFunc(delta_t) / samp_rate_in_;
     }
   }
 }
@@ -160,6 +326,7 @@ void LinearResample::Resample(const VectorBase<BaseFloat> &input,
 
   output->Resize(tot_output_samp - output_sample_offset_);
 
+  int32 num_taps = weights_.NumCols();
   // samp_out is the index into the total output signal, not just the part
   // of it we are producing here.
   for (int64 samp_out = output_sample_offset_;
@@ -168,35 +335,54 @@ void LinearResample::Resample(const VectorBase<BaseFloat> &input,
     int64 first_samp_in;
     int32 samp_out_wrapped;
     GetIndexes(samp_out, &first_samp_in, &samp_out_wrapped);
-    const Vector<BaseFloat> &weights = weights_[samp_out_wrapped];
     // first_input_index is the first index into "input" that we have a weight
     // for.
     int32 first_input_index = static_cast<int32>(first_samp_in -
                                                  input_sample_offset_);
-    BaseFloat this_output;
+    int32 output_index = static_cast<int32>(samp_out - output_sample_offset_);
     if (first_input_index >= 0 &&
-        first_input_index + weights.Dim() <= input_dim) {
-      SubVector<BaseFloat> input_part(input, first_input_index, weights.Dim());
-      this_output = VecVec(input_part, weights);
-    } else {  // Handle edge cases.
-      this_output = 0.0;
-      for (int32 i = 0; i < weights.Dim(); i++) {
-        BaseFloat weight = weights(i);
-        int32 input_index = first_input_index + i;
-        if (input_index < 0 && input_remainder_.Dim() + input_index >= 0) {
-          this_output += weight *
-              input_remainder_(input_remainder_.Dim() + input_index);
-        } else if (input_index >= 0 && input_index < input_dim) {
-          this_output += weight * input(input_index);
-        } else if (input_index >= input_dim) {
-          // We're past the end of the input and are adding zero; should only
-          // happen if the user specified flush == true, or else we would not
-          // be trying to output this sample.
-          KALDI_ASSERT(flush);
-        }
+        first_input_index + num_taps <= input_dim) {
+      // Find the block of output samples starting from this one whose windows
+      // are all inside the input, and compute them together.
+      int64 block_end = samp_out + 1;
+      for (; block_end < tot_output_samp; block_end++) {
+        int64 next_first_samp_in;
+        int32 next_samp_out_wrapped;
+        GetIndexes(block_end, &next_first_samp_in, &next_samp_out_wrapped);
+        if (next_first_samp_in - input_sample_offset_ + num_taps > input_dim)
+          break;
+      }
+      // 'unit_start' points to the input sample at the start of the repeating
+      // unit that samp_out is in.
+      const BaseFloat *unit_start = input.Data() + first_input_index -
+          first_index_[samp_out_wrapped];
+      ResampleBlock(unit_start, weights_.Data(), weights_.Stride(), num_taps,
+                    &(first_index_[0]), output_samples_in_unit_,
+                    input_samples_in_unit_, samp_out_wrapped,
+                    static_cast<int32>(block_end - samp_out),
+                    output->Data() + output_index);
+      samp_out = block_end - 1;
+      continue;
+    }
+    // Handle edge cases.
+    SubVector<BaseFloat> weights(weights_, samp_out_wrapped);
+    BaseFloat this_output = 0.0;
+    for (int32 i = 0; i < num_taps; i++) {
+      BaseFloat weight = weights(i);
+      int32 input_index = first_input_index + i;
+      if (input_index < 0 && input_remainder_.Dim() + input_index >= 0) {
+        this_output += weight *
+            input_remainder_(input_remainder_.Dim() + input_index);
+      } else if (input_index >= 0 && input_index < input_dim) {
+        this_output += weight * input(input_index);
+      } else if (input_index >= input_dim) {
+        // We're past the end of the input and are adding zero; should only
+        // happen if the user specified flush == true, or else we would not
+        // be trying to output this sample.  (The zero padding of the filter
+        // bank may go past the end.)
+        KALDI_ASSERT(flush || weight == 0.0);
       }
     }
-    int32 output_index = static_cast<int32>(samp_out - output_sample_offset_);
     (*output)(output_index) = this_output;
   }
 
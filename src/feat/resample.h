@@ -189,6 +189,18 @@ class LinearResample {
   //// Return the input and output sampling rates (for checks, for example)
   inline int32 GetInputSamplingRate() { return samp_rate_in_; }
   inline int32 GetOutputSamplingRate() { return samp_rate_out_; }
+
+  /// The output samples whose filter window lies entirely inside the current
+  /// piece of input are computed in blocks, from the polyphase filter bank
+  /// weights_, by SIMD kernels where available (AVX2 on x86 if the CPU
+  /// supports it, and NEON on 64-bit ARM; only if BaseFloat is float).  They
+  /// agree with the generic code up to roundoff.  SetUseSimd(false) forces the
+  /// generic code; it is intended for testing and benchmarking.
+  static void SetUseSimd(bool use_simd);
+
+  /// Returns the name of the kernels currently in use, e.g. "avx2" or
+  /// "generic".
+  static const char *SimdKernelName();
  private:
   /// This function outputs the number of output samples we will output
   /// for a signal with "input_num_samp" input samples.  If flush == true,
@@ -237,8 +249,11 @@ class LinearResample {
   /// extrapolate the correct input-sample index for arbitrary output samples.
   std::vector<int32> first_index_;
 
-  /// Weights on the input samples, for this output-sample index.
-  std::vector<Vector<BaseFloat> > weights_;
+  /// The polyphase filter bank: row i contains the weights on the input
+  /// samples starting from first_index_[i], for this output-sample index.  All
+  /// rows have the same length, which is a multiple of 8; the taps outside
+  /// the filter window are zero.
+  Matrix<BaseFloat> weights_;
 
   // the following variables keep track of where we are in a particular signal,
   // if it is being provided over multiple calls to Resample().
@@ -52,12 +52,32 @@ void UnitTestFFTbasedConvolution() {
     AssertEqual(signal, signal_test, 0.0001 * signal.Dim());
   }
 }
+
+void UnitTestAddNoise() {
+  for (int32 i = 0; i < 5; i++) {
+    int32 signal_length = 4000 + Rand() % 400,
+        noise_length = 1000 + Rand() % 100;
+    BaseFloat samp_freq = 1000.0, snr_db = RandInt(0, 20),
+        signal_power = 2.0;
+    Vector<BaseFloat> signal(signal_length), noise(noise_length);
+    noise.SetRandn();
+    AddNoise(&noise, snr_db, 1.0, samp_freq, signal_power, &signal);
+    // the noise was scaled to the SNR relative to signal_power, and added
+    // starting at 1 second.
+    BaseFloat noise_power = VecVec(noise, noise) / noise_length;
+    AssertEqual(10.0 * std::log10(signal_power / noise_power), snr_db, 0.01);
+    KALDI_ASSERT(signal.Range(0, samp_freq).Norm(2.0) == 0.0);
+    SubVector<BaseFloat> added(signal, samp_freq, noise_length);
+    AssertEqual(added, noise);
+  }
+}
 }
 
 int main() {
   using namespace kaldi;
   UnitTestFFTbasedConvolution();
   UnitTestFFTbasedBlockConvolution();
+  UnitTestAddNoise();
   KALDI_LOG << "Tests succeeded.";
 
 }
@@ -53,6 +53,57 @@ void FFTbasedConvolveSignals(const Vector<BaseFloat> &filter, Vector<BaseFloat>
 */
 void FFTbasedBlockConvolveSignals(const Vector<BaseFloat> &filter, Vector<BaseFloat> *signal);
 
+/*
+   The following functions implement the data augmentation done by
+   wav-reverberate and wav-reverberate-batch.
+*/
+
+/*
+   This function is to repeatedly concatenate signal1 by itself
+   to match the length of signal2 and add the two signals together.
+*/
+void AddVectorsOfUnequalLength(const VectorBase<BaseFloat> &signal1,
+                               Vector<BaseFloat> *signal2);
+
+/*
+   This function is to add signal1 to signal2 starting at the offset of signal2
+   This will not extend the length of signal2.
+*/
+void AddVectorsWithOffset(const Vector<BaseFloat> &signal1, int32 offset,
+                          Vector<BaseFloat> *signal2);
+
+/*
+   Early reverberation component of the signal is composed of reflections
+   within 0.05 seconds of the direct path signal (assumed to be the peak of
+   the room impulse response). This function returns the energy in
+   this early reverberation component of the signal.
+   The input parameters to this function are the room impulse response, the signal
+   and their sampling frequency respectively.
+*/
+BaseFloat ComputeEarlyReverbEnergy(const Vector<BaseFloat> &rir,
+                                   const Vector<BaseFloat> &signal,
+                                   BaseFloat samp_freq);
+
+/*
+   This is the core function to do reverberation on the given signal.
+   The input parameters to this function are the room impulse response,
+   the sampling frequency and the signal respectively.
+   The length of the signal will be extended to (original signal length +
+   rir length - 1) after the reverberation.  Returns the energy of the
+   early reverberation (see ComputeEarlyReverbEnergy()).
+*/
+float DoReverberation(const Vector<BaseFloat> &rir, BaseFloat samp_freq,
+                      Vector<BaseFloat> *signal);
+
+/*
+   The noise will be scaled before the addition to match the given
+   signal-to-noise ratio (SNR), relative to "signal_power", and added to
+   the signal starting at "time" seconds.
+*/
+void AddNoise(Vector<BaseFloat> *noise, BaseFloat snr_db,
+              BaseFloat time, BaseFloat samp_freq,
+              BaseFloat signal_power, Vector<BaseFloat> *signal);
+
 }  // namespace kaldi
 
 #endif  // KALDI_FEAT_SIGNAL_H_
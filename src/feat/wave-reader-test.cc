@@ -198,11 +198,145 @@ static void UnitTestEndless2() {
   AssertEqual(wave.Data(), expected);
 }
 
+static void UnitTestMuLawALaw() {
+  const int hz = 8000;
+  for (int a_law = 0; a_law < 2; a_law++) {
+    const char file_data[] = {
+      'R', 'I', 'F', 'F',
+      DWRD(44),   // File length after this point.
+      'W', 'A', 'V', 'E',
+      'f', 'm', 't', ' ',
+      DWRD(18),   // sizeof(struct WAVEFORMATEX)
+      WRD(a_law ? 6 : 7),  // WORD  wFormatTag; WAVE_FORMAT_ALAW or _MULAW
+      WRD(1),     // WORD  nChannels;
+      DWRD(hz),   // DWORD nSamplesPerSec;
+      DWRD(hz),   // DWORD nAvgBytesPerSec;
+      WRD(1),     // WORD  nBlockAlign;
+      WRD(8),     // WORD  wBitsPerSample;
+      WRD(0),     // WORD  cbSize;
+      'd', 'a', 't', 'a',
+      DWRD(6),    // 'data' chunk length.
+      0x00, 0x55, (char)0xd5, (char)0x80, 0x2a, (char)0xff
+    };
+    // Reference values from Python's audioop.ulaw2lin() and alaw2lin().
+    const char *expect_mat = (a_law ?
+                              "[ -5504 -8 8 5504 -32256 848 ]" :
+                              "[ -32124 -716 716 32124 -5372 0 ]");
+
+    std::istringstream iws(std::string(file_data, sizeof file_data),
+                           std::ios::in | std::ios::binary);
+    WaveData wave;
+    wave.Read(iws);
+
+    std::istringstream ies(expect_mat, std::ios::in);
+    Matrix<BaseFloat> expected;
+    expected.Read(ies, false /* text */);
+
+    AssertEqual(wave.SampFreq(), hz, 0);
+    AssertEqual(wave.Data(), expected);
+  }
+}
+
+static void UnitTestFlacMono() {
+  // A FLAC file with 16-bit samples at 16kHz, a PADDING metadata block and
+  // two frames: one with an LPC subframe (order 3, two residual partitions,
+  // the second one escaped), and one with a FIXED subframe (order 2, four
+  // partitions) and a wasted bit.  Written with a small test encoder.
+  const unsigned char file_data[] = {
+    0x66, 0x4c, 0x61, 0x43, 0x00, 0x00, 0x00, 0x22, 0x00, 0x10, 0x10, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0xe8, 0x00, 0xf0, 0x00, 0x00,
+    0x00, 0x34, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x81, 0x00, 0x00, 0x03, 0x00, 0x00,
+    0x00, 0xff, 0xf8, 0x65, 0x08, 0x00, 0x1f, 0xa8, 0x44, 0xff, 0xfb, 0x03,
+    0x87, 0x06, 0xab, 0x62, 0x14, 0xee, 0x08, 0x19, 0x39, 0x03, 0xac, 0x2c,
+    0xa7, 0x0c, 0x90, 0xa6, 0xed, 0xcd, 0x3d, 0x94, 0xa9, 0x61, 0x9f, 0x09,
+    0xb5, 0x9a, 0xef, 0xb3, 0x7c, 0x7a, 0x8f, 0xd7, 0x40, 0xf8, 0x43, 0x47,
+    0x28, 0x9c, 0x4a, 0x68, 0xbb, 0x8b, 0x2c, 0x8d, 0x07, 0xa4, 0x3b, 0xc0,
+    0x7b, 0xd7, 0xfa, 0x24, 0xdd, 0xc5, 0xff, 0xf8, 0x65, 0x08, 0x01, 0x13,
+    0x99, 0x15, 0x81, 0x33, 0x01, 0x10, 0x16, 0x4c, 0x2e, 0xce, 0x51, 0xc6,
+    0xcc, 0xe9, 0xf1, 0x52, 0xbf, 0xf5, 0x19, 0xb3, 0x26, 0x42, 0x96, 0x00,
+    0x90, 0x4a, 0xa9, 0xad, 0xa2, 0xb2, 0x40, 0x73, 0x7b, 0x95, 0x14, 0xbb,
+    0x24, 0x26, 0x3d, 0x46,
+  };
+  const char expect_mat[] = "[ -5 903 1707 2337 2799 3010 2931 2609 2043 1266 441 -493 -1317 -2067 -2599 -2938 -2996 -2767 -2304 -1637 -828 55 954 1724 2375 2833 2984 2922 2567 1968 1220 363 614 272 -850 -322 660 -874 748 834 -386 30 280 534 862 -144 524 676 -64 -130 552 702 ]";
+
+  std::istringstream iws(std::string(reinterpret_cast<const char*>(file_data),
+                                     sizeof file_data),
+                         std::ios::in | std::ios::binary);
+  WaveData wave;
+  wave.Read(iws);
+
+  std::istringstream ies(expect_mat, std::ios::in);
+  Matrix<BaseFloat> expected;
+  expected.Read(ies, false /* text */);
+
+  AssertEqual(wave.SampFreq(), 16000, 0);
+  AssertEqual(wave.Data(), expected);
+}
+
+static void UnitTestFlacStereo() {
+  // A FLAC file with 24-bit stereo samples at 44.1kHz and two frames: one
+  // with mid/side stereo and VERBATIM subframes, and one with left/side
+  // stereo and CONSTANT and FIXED (order 1) subframes.  The samples are
+  // scaled to the 16-bit range.
+  const unsigned char file_data[] = {
+    0x66, 0x4c, 0x61, 0x43, 0x80, 0x00, 0x00, 0x22, 0x00, 0x10, 0x10, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0a, 0xc4, 0x43, 0x70, 0x00, 0x00,
+    0x00, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xf8, 0x69, 0xac, 0x00, 0x05,
+    0xe5, 0x02, 0x70, 0x83, 0x5c, 0xd9, 0xe4, 0x0d, 0x1f, 0x9d, 0xc0, 0x08,
+    0x9b, 0x11, 0xd6, 0x3f, 0xeb, 0x0e, 0x9f, 0x3e, 0x02, 0xf3, 0x22, 0x01,
+    0xf5, 0x65, 0x92, 0x06, 0xe1, 0xe8, 0xf5, 0x29, 0x4e, 0xdb, 0xc1, 0xfd,
+    0x05, 0xb7, 0xf3, 0xb8, 0x99, 0x1b, 0xff, 0xf8, 0x60, 0x80, 0x01, 0x03,
+    0xfd, 0x00, 0x12, 0xd6, 0x87, 0x12, 0x09, 0x6b, 0x46, 0x01, 0xec, 0xff,
+    0x40, 0x10, 0xfe, 0xc0, 0x23, 0xb5,
+  };
+  const char expect_mat[] =
+      "[ 25509.3671875 -15184.80859375 15141.390625 -19994.46875 -28064.26953125 -14946.29296875 4822.52734375 4822.52734375 4822.52734375 4822.52734375\n"
+      "  32097.35546875 -4327.08984375 1046.11328125 24400.60546875 6688.10546875 22432.77734375 -0.01953125 0.02734375 -0.03515625 0.04296875 ]";
+
+  std::istringstream iws(std::string(reinterpret_cast<const char*>(file_data),
+                                     sizeof file_data),
+                         std::ios::in | std::ios::binary);
+  WaveInfo info;
+  info.Read(iws);
+  KALDI_ASSERT(info.GetEncoding() == WaveInfo::kFlac &&
+               info.NumChannels() == 2 && info.SampleCount() == 10 &&
+               info.BitsPerSample() == 24);
+
+  iws.seekg(0);
+  WaveData wave;
+  wave.Read(iws);
+
+  std::istringstream ies(expect_mat, std::ios::in);
+  Matrix<BaseFloat> expected;
+  expected.Read(ies, false /* text */);
+
+  AssertEqual(wave.SampFreq(), 44100, 0);
+  AssertEqual(wave.Data(), expected);
+
+  // Corrupting a byte should make the CRC check fail.
+  std::string corrupt(reinterpret_cast<const char*>(file_data),
+                      sizeof file_data);
+  corrupt[sizeof file_data - 5] ^= 0x10;
+  std::istringstream ics(corrupt, std::ios::in | std::ios::binary);
+  bool threw = false;
+  try {
+    wave.Read(ics);
+  } catch (const std::exception &e) {
+    threw = true;
+  }
+  KALDI_ASSERT(threw);
+}
+
 static void UnitTest() {
   UnitTestStereo8K();
   UnitTestMono22K();
   UnitTestEndless1();
   UnitTestEndless2();
+  UnitTestMuLawALaw();
+  UnitTestFlacMono();
+  UnitTestFlacStereo();
 }
 
 int main() {
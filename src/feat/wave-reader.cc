@@ -112,6 +112,17 @@ static void WriteUint16(std::ostream &os, int16 i) {
 }
 
 void WaveInfo::Read(std::istream &is) {
+  // We look at the first byte to see what kind of file this is; peek() works
+  // for any kind of stream, including pipes.
+  int first_byte = is.peek();
+  if (first_byte == 'f') {
+    ReadFlac(is);
+    return;
+  }
+  if (first_byte == 'O')
+    KALDI_ERR << "WaveData: this looks like Ogg data (e.g. Opus), which is "
+              << "not supported; decode it with a pipe in your wav.scp.";
+  encoding_ = kPcm16;
   WaveHeaderReadGofer reader(is);
   reader.Read4ByteTag();
   if (strcmp(reader.tag, "RIFF") == 0)
@@ -177,15 +188,22 @@ void WaveInfo::Read(std::istream &is) {
            guid4 = reader.ReadUint32();
     fmt_chunk_read = 40;
 
-    // Support only KSDATAFORMAT_SUBTYPE_PCM for now. Interesting formats:
+    // Support only KSDATAFORMAT_SUBTYPE_PCM, ALAW and MULAW for now.
+    // Interesting formats:
     // ("00000001-0000-0010-8000-00aa00389b71", KSDATAFORMAT_SUBTYPE_PCM)
     // ("00000003-0000-0010-8000-00aa00389b71", KSDATAFORMAT_SUBTYPE_IEEE_FLOAT)
     // ("00000006-0000-0010-8000-00aa00389b71", KSDATAFORMAT_SUBTYPE_ALAW)
     // ("00000007-0000-0010-8000-00aa00389b71", KSDATAFORMAT_SUBTYPE_MULAW)
-    if (guid1 != 0x00000001 || guid2 != 0x00100000 ||
+    if ((guid1 != 0x00000001 && guid1 != 0x00000006 &&
+         guid1 != 0x00000007) || guid2 != 0x00100000 ||
         guid3 != 0xAA000080 || guid4 != 0x719B3800) {
       KALDI_ERR << "WaveData: unsupported WAVE_FORMAT_EXTENSIBLE format.";
     }
+    if (guid1 == 0x00000006) encoding_ = kALaw;
+    if (guid1 == 0x00000007) encoding_ = kMuLaw;
+  } else if (audio_format == 6 || audio_format == 7) {
+    // WAVE_FORMAT_ALAW or WAVE_FORMAT_MULAW.
+    encoding_ = (audio_format == 6 ? kALaw : kMuLaw);
   } else {
     KALDI_ERR << "WaveData: can read only PCM data, format id in file is: "
               << audio_format;
@@ -196,7 +214,8 @@ void WaveInfo::Read(std::istream &is) {
 
   if (num_channels_ == 0)
     KALDI_ERR << "WaveData: no channels present";
-  if (bits_per_sample != 16)
+  bits_per_sample_ = bits_per_sample;
+  if (bits_per_sample != (encoding_ == kPcm16 ? 16 : 8))
     KALDI_ERR << "WaveData: unsupported bits_per_sample = " << bits_per_sample;
   if (byte_rate != sample_rate * bits_per_sample/8 * num_channels_)
     KALDI_ERR << "Unexpected byte rate " << byte_rate << " vs. "
@@ -269,6 +288,456 @@ void WaveInfo::Read(std::istream &is) {
     samp_count_ = data_chunk_size / block_align;
 }
 
+void WaveInfo::ReadFlac(std::istream &is) {
+  char tag[5] = { '\0', '\0', '\0', '\0', '\0' };
+  is.read(tag, 4);
+  if (is.fail() || strcmp(tag, "fLaC") != 0)
+    KALDI_ERR << "WaveData: expected fLaC, got " << tag;
+  encoding_ = kFlac;
+  reverse_bytes_ = false;
+
+  // The metadata blocks; the first one must be STREAMINFO, and the others we
+  // skip.
+  bool last_block = false, seen_streaminfo = false;
+  while (!last_block) {
+    unsigned char block_header[4];
+    is.read(reinterpret_cast<char*>(block_header), 4);
+    if (is.fail())
+      KALDI_ERR << "WaveData: unexpected end of file in FLAC metadata";
+    last_block = (block_header[0] & 0x80) != 0;
+    int32 block_type = block_header[0] & 0x7F;
+    uint32 block_size = (static_cast<uint32>(block_header[1]) << 16) |
+        (static_cast<uint32>(block_header[2]) << 8) | block_header[3];
+    if (block_type == 0) {  // STREAMINFO
+      if (block_size != 34)
+        KALDI_ERR << "WaveData: FLAC STREAMINFO block has size " << block_size;
+      unsigned char b[34];
+      is.read(reinterpret_cast<char*>(b), 34);
+      if (is.fail())
+        KALDI_ERR << "WaveData: unexpected end of file in FLAC metadata";
+      // Bytes 0-9 are the minimum and maximum block and frame sizes.  Then
+      // come 20 bits of sample rate, 3 bits of (channels - 1), 5 bits of
+      // (bits per sample - 1) and 36 bits of total samples, all big-endian;
+      // then the MD5 signature, which we don't check.
+      uint32 sample_rate = (static_cast<uint32>(b[10]) << 12) |
+          (static_cast<uint32>(b[11]) << 4) | (b[12] >> 4);
+      num_channels_ = ((b[12] >> 1) & 0x7) + 1;
+      bits_per_sample_ = (((b[12] & 0x1) << 4) | (b[13] >> 4)) + 1;
+      uint64 total_samples = (static_cast<uint64>(b[13] & 0xF) << 32) |
+          (static_cast<uint64>(b[14]) << 24) |
+          (static_cast<uint64>(b[15]) << 16) |
+          (static_cast<uint64>(b[16]) << 8) | b[17];
+      if (sample_rate == 0)
+        KALDI_ERR << "WaveData: FLAC sample rate is zero";
+      if (bits_per_sample_ < 4)
+        KALDI_ERR << "WaveData: unsupported FLAC bits per sample "
+                  << bits_per_sample_;
+      samp_freq_ = static_cast<BaseFloat>(sample_rate);
+      // A total of zero means unknown.
+      if (total_samples == 0 ||
+          total_samples > static_cast<uint64>(
+              std::numeric_limits<int32>::max()))
+        samp_count_ = -1;
+      else
+        samp_count_ = static_cast<int32>(total_samples);
+      seen_streaminfo = true;
+    } else {
+      if (!seen_streaminfo)
+        KALDI_ERR << "WaveData: FLAC metadata does not start with STREAMINFO";
+      if (block_type == 127)
+        KALDI_ERR << "WaveData: invalid FLAC metadata block type";
+      is.ignore(block_size);
+      if (is.fail())
+        KALDI_ERR << "WaveData: unexpected end of file in FLAC metadata";
+    }
+  }
+  if (!seen_streaminfo)
+    KALDI_ERR << "WaveData: FLAC metadata has no STREAMINFO";
+}
+
+
+// Returns the linear value (in the 16-bit range) of an A-law sample; see ITU-T
+// G.711.
+static inline int16 ALawToLinear(uint8 a_val) {
+  a_val ^= 0x55;
+  int32 t = (a_val & 0x0F) << 4, seg = (a_val & 0x70) >> 4;
+  if (seg == 0) {
+    t += 8;
+  } else {
+    t += 0x108;
+    t <<= seg - 1;
+  }
+  return (a_val & 0x80) ? t : -t;
+}
+
+// Returns the linear value (in the 16-bit range) of a mu-law sample; see ITU-T
+// G.711.
+static inline int16 MuLawToLinear(uint8 u_val) {
+  u_val = ~u_val;
+  int32 t = (((u_val & 0x0F) << 3) + 0x84) << ((u_val & 0x70) >> 4);
+  return (u_val & 0x80) ? (0x84 - t) : (t - 0x84);
+}
+
+
+// This class reads bits, most significant first, from a buffer containing
+// FLAC frames.  Reading past the end of the buffer gives zero bits, and sets a
+// flag that the caller should check.
+class FlacBitReader {
+ public:
+  FlacBitReader(const unsigned char *data, size_t size):
+      data_(data), size_(size), pos_(0), cache_(0), cache_bits_(0) { }
+
+  // Reads an unsigned number of num_bits <= 56 bits.
+  uint64 ReadBits(int32 num_bits) {
+    if (num_bits == 0) return 0;
+    if (cache_bits_ < num_bits) Refill();
+    uint64 ans = cache_ >> (64 - num_bits);
+    cache_ <<= num_bits;
+    cache_bits_ -= num_bits;
+    return ans;
+  }
+
+  // Reads a two's-complement signed number of num_bits <= 56 bits.
+  int64 ReadSignedBits(int32 num_bits) {
+    if (num_bits == 0) return 0;
+    uint64 u = ReadBits(num_bits);
+    return static_cast<int64>(u << (64 - num_bits)) >> (64 - num_bits);
+  }
+
+  // Reads a unary-coded number: the number of zero bits before a one bit.
+  uint32 ReadUnary() {
+    uint32 ans = 0;
+    while (true) {
+      if (cache_bits_ == 0) {
+        Refill();
+        if (Overrun()) return ans;
+      }
+      if (cache_ & (static_cast<uint64>(1) << 63)) {
+        cache_ <<= 1;
+        cache_bits_--;
+        return ans;
+      }
+      cache_ <<= 1;
+      cache_bits_--;
+      ans++;
+    }
+  }
+
+  // Reads a Rice-coded signed number with parameter "param".
+  int64 ReadRice(int32 param) {
+    uint64 u = (static_cast<uint64>(ReadUnary()) << param) | ReadBits(param);
+    return static_cast<int64>(u >> 1) ^ -static_cast<int64>(u & 1);
+  }
+
+  void AlignToByte() {
+    int32 skip = cache_bits_ % 8;
+    cache_ <<= skip;
+    cache_bits_ -= skip;
+  }
+
+  // The number of whole bytes consumed so far; only meaningful after
+  // AlignToByte().
+  size_t BytePosition() const { return pos_ - cache_bits_ / 8; }
+
+  // True if we tried to read past the end of the data.
+  bool Overrun() const { return BytePosition() > size_; }
+
+ private:
+  // Fills the cache so it has more than 56 bits.
+  void Refill() {
+    while (cache_bits_ <= 56) {
+      uint64 byte = (pos_ < size_ ? data_[pos_] : 0);
+      cache_ |= byte << (56 - cache_bits_);
+      cache_bits_ += 8;
+      pos_++;
+    }
+  }
+
+  const unsigned char *data_;
+  size_t size_;
+  size_t pos_;  // The index of the next byte to put into the cache.
+  uint64 cache_;  // The next bits to read, left-aligned.
+  int32 cache_bits_;  // The number of valid bits in cache_.
+};
+
+// The CRC-8 of FLAC frame headers (polynomial x^8 + x^2 + x + 1).
+static uint8 FlacCrc8(const unsigned char *data, size_t size) {
+  uint8 crc = 0;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= data[i];
+    for (int32 j = 0; j < 8; j++)
+      crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+  }
+  return crc;
+}
+
+// The CRC-16 of FLAC frames (polynomial x^16 + x^15 + x^2 + 1).
+static uint16 FlacCrc16(const unsigned char *data, size_t size) {
+  uint16 crc = 0;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= static_cast<uint16>(data[i]) << 8;
+    for (int32 j = 0; j < 8; j++)
+      crc = (crc & 0x8000) ? ((crc << 1) ^ 0x8005) : (crc << 1);
+  }
+  return crc;
+}
+
+// Reads the residual of a FIXED or LPC subframe into samples[order ...
+// block_size - 1].
+static void ReadFlacResidual(FlacBitReader *reader, int32 block_size,
+                             int32 order, int64 *samples) {
+  int32 method = reader->ReadBits(2);
+  if (method > 1)
+    KALDI_ERR << "WaveData: invalid FLAC residual coding method";
+  int32 param_bits = (method == 0 ? 4 : 5),
+      escape_param = (1 << param_bits) - 1,
+      partition_order = reader->ReadBits(4),
+      partition_size = block_size >> partition_order;
+  if ((partition_size << partition_order) != block_size ||
+      partition_size < order)
+    KALDI_ERR << "WaveData: invalid FLAC partition order " << partition_order
+              << " for block size " << block_size;
+  int32 i = order;
+  for (int32 p = 0; p < (1 << partition_order); p++) {
+    int32 end = (p + 1) * partition_size,
+        param = reader->ReadBits(param_bits);
+    if (param == escape_param) {
+      int32 num_bits = reader->ReadBits(5);
+      for (; i < end; i++)
+        samples[i] = reader->ReadSignedBits(num_bits);
+    } else {
+      for (; i < end; i++)
+        samples[i] = reader->ReadRice(param);
+    }
+    if (reader->Overrun())
+      KALDI_ERR << "WaveData: FLAC data is truncated";
+  }
+}
+
+// Reads one subframe of a FLAC frame (i.e. one channel) into
+// samples[0 ... block_size - 1].
+static void ReadFlacSubframe(FlacBitReader *reader, int32 block_size,
+                             int32 bits_per_sample, int64 *samples) {
+  if (reader->ReadBits(1) != 0)
+    KALDI_ERR << "WaveData: invalid FLAC subframe header";
+  int32 type = reader->ReadBits(6), wasted_bits = 0;
+  if (reader->ReadBits(1))
+    wasted_bits = reader->ReadUnary() + 1;
+  bits_per_sample -= wasted_bits;
+  if (bits_per_sample <= 0)
+    KALDI_ERR << "WaveData: invalid FLAC wasted bits";
+
+  if (type == 0) {  // CONSTANT
+    int64 value = reader->ReadSignedBits(bits_per_sample);
+    for (int32 i = 0; i < block_size; i++)
+      samples[i] = value;
+  } else if (type == 1) {  // VERBATIM
+    for (int32 i = 0; i < block_size; i++)
+      samples[i] = reader->ReadSignedBits(bits_per_sample);
+  } else if (type >= 8 && type <= 12) {  // FIXED
+    int32 order = type - 8;
+    if (order > block_size)
+      KALDI_ERR << "WaveData: FLAC predictor order exceeds block size";
+    for (int32 i = 0; i < order; i++)
+      samples[i] = reader->ReadSignedBits(bits_per_sample);
+    ReadFlacResidual(reader, block_size, order, samples);
+    // The residual is the difference of the given order.
+    switch (order) {
+      case 1:
+        for (int32 i = 1; i < block_size; i++)
+          samples[i] += samples[i - 1];
+        break;
+      case 2:
+        for (int32 i = 2; i < block_size; i++)
+          samples[i] += 2 * samples[i - 1] - samples[i - 2];
+        break;
+      case 3:
+        for (int32 i = 3; i < block_size; i++)
+          samples[i] += 3 * (samples[i - 1] - samples[i - 2]) +
+              samples[i - 3];
+        break;
+      case 4:
+        for (int32 i = 4; i < block_size; i++)
+          samples[i] += 4 * (samples[i - 1] + samples[i - 3]) -
+              6 * samples[i - 2] - samples[i - 4];
+        break;
+      default:
+        break;
+    }
+  } else if (type >= 32) {  // LPC
+    int32 order = type - 31;
+    if (order > block_size)
+      KALDI_ERR << "WaveData: FLAC predictor order exceeds block size";
+    for (int32 i = 0; i < order; i++)
+      samples[i] = reader->ReadSignedBits(bits_per_sample);
+    int32 precision = reader->ReadBits(4) + 1;
+    if (precision == 16)
+      KALDI_ERR << "WaveData: invalid FLAC LPC precision";
+    int32 shift = reader->ReadSignedBits(5);
+    if (shift < 0)
+      KALDI_ERR << "WaveData: negative FLAC LPC shift";
+    int64 coefs[32];
+    for (int32 j = 0; j < order; j++)
+      coefs[j] = reader->ReadSignedBits(precision);
+    ReadFlacResidual(reader, block_size, order, samples);
+    for (int32 i = order; i < block_size; i++) {
+      int64 sum = 0;
+      for (int32 j = 0; j < order; j++)
+        sum += coefs[j] * samples[i - 1 - j];
+      samples[i] += sum >> shift;
+    }
+  } else {
+    KALDI_ERR << "WaveData: reserved FLAC subframe type " << type;
+  }
+  if (wasted_bits != 0)
+    for (int32 i = 0; i < block_size; i++)
+      samples[i] *= (static_cast<int64>(1) << wasted_bits);
+}
+
+// Decodes the FLAC frames in "buffer" (everything after the metadata), and
+// outputs the samples, scaled to the 16-bit range, to *wave (one row per
+// channel).
+static void DecodeFlacFrames(const WaveInfo &info,
+                             const std::vector<char> &buffer,
+                             Matrix<BaseFloat> *wave) {
+  const unsigned char *data =
+      reinterpret_cast<const unsigned char*>(buffer.data());
+  size_t size = buffer.size();
+  int32 num_channels = info.NumChannels();
+  std::vector<std::vector<BaseFloat> > channel_data(num_channels);
+  if (!info.IsStreamed())
+    for (int32 c = 0; c < num_channels; c++)
+      channel_data[c].reserve(info.SampleCount());
+  std::vector<int64> samples;
+
+  FlacBitReader reader(data, size);
+  size_t frame_start = 0;
+  while (frame_start < size) {
+    if (!info.IsStreamed() &&
+        channel_data[0].size() >= static_cast<size_t>(info.SampleCount()))
+      break;  // ignore any trailing data (e.g. ID3 tags).
+    if (reader.ReadBits(15) != 0x7FFC)
+      KALDI_ERR << "WaveData: expected a FLAC frame at byte " << frame_start
+                << " of the FLAC frames.";
+    reader.ReadBits(1);  // the blocking strategy: we don't care.
+    int32 block_size_code = reader.ReadBits(4),
+        sample_rate_code = reader.ReadBits(4),
+        channel_code = reader.ReadBits(4),
+        sample_size_code = reader.ReadBits(3);
+    reader.ReadBits(1);  // reserved.
+    // The frame or sample number, coded like UTF-8.
+    uint32 first_byte = reader.ReadBits(8);
+    int32 num_leading_ones = 0;
+    while (num_leading_ones < 8 && (first_byte & (0x80 >> num_leading_ones)))
+      num_leading_ones++;
+    if (num_leading_ones == 1 || num_leading_ones == 8)
+      KALDI_ERR << "WaveData: invalid FLAC frame number";
+    int32 num_extra_bytes = (num_leading_ones == 0 ? 0 : num_leading_ones - 1);
+    for (int32 i = 0; i < num_extra_bytes; i++)
+      if ((reader.ReadBits(8) & 0xC0) != 0x80)
+        KALDI_ERR << "WaveData: invalid FLAC frame number";
+
+    int32 block_size;
+    if (block_size_code == 0)
+      KALDI_ERR << "WaveData: reserved FLAC block size";
+    else if (block_size_code == 1)
+      block_size = 192;
+    else if (block_size_code <= 5)
+      block_size = 576 << (block_size_code - 2);
+    else if (block_size_code == 6)
+      block_size = reader.ReadBits(8) + 1;
+    else if (block_size_code == 7)
+      block_size = reader.ReadBits(16) + 1;
+    else
+      block_size = 256 << (block_size_code - 8);
+
+    static const int32 sample_rates[] = { 0, 88200, 176400, 192000, 8000,
+                                          16000, 22050, 24000, 32000, 44100,
+                                          48000, 96000 };
+    int32 sample_rate = 0;
+    if (sample_rate_code == 0)
+      sample_rate = info.SampFreq();
+    else if (sample_rate_code < 12)
+      sample_rate = sample_rates[sample_rate_code];
+    else if (sample_rate_code == 12)
+      sample_rate = reader.ReadBits(8) * 1000;
+    else if (sample_rate_code == 13)
+      sample_rate = reader.ReadBits(16);
+    else if (sample_rate_code == 14)
+      sample_rate = reader.ReadBits(16) * 10;
+    else
+      KALDI_ERR << "WaveData: invalid FLAC sample rate code";
+    if (sample_rate != info.SampFreq())
+      KALDI_ERR << "WaveData: FLAC sample rate changes from "
+                << info.SampFreq() << " to " << sample_rate;
+
+    static const int32 sample_sizes[] = { 0, 8, 12, 0, 16, 20, 24, 32 };
+    int32 bits_per_sample = (sample_size_code == 0 ? info.BitsPerSample() :
+                             sample_sizes[sample_size_code]);
+    if (bits_per_sample == 0)
+      KALDI_ERR << "WaveData: reserved FLAC sample size";
+    // Codes 8, 9 and 10 are left/side, side/right and mid/side stereo.
+    int32 frame_channels = (channel_code < 8 ? channel_code + 1 : 2);
+    if (channel_code > 10 || frame_channels != num_channels)
+      KALDI_ERR << "WaveData: invalid FLAC channel assignment " << channel_code;
+
+    size_t header_end = reader.BytePosition();
+    uint8 crc8 = reader.ReadBits(8);
+    if (reader.Overrun())
+      KALDI_ERR << "WaveData: FLAC data is truncated";
+    if (crc8 != FlacCrc8(data + frame_start, header_end - frame_start))
+      KALDI_ERR << "WaveData: FLAC frame header CRC mismatch";
+
+    samples.resize(static_cast<size_t>(block_size) * num_channels);
+    for (int32 c = 0; c < num_channels; c++) {
+      // The side channel has one extra bit.
+      bool is_side = (channel_code == 8 && c == 1) ||
+          (channel_code == 9 && c == 0) || (channel_code == 10 && c == 1);
+      ReadFlacSubframe(&reader, block_size, bits_per_sample + (is_side ? 1 : 0),
+                       &(samples[c * block_size]));
+    }
+    reader.AlignToByte();
+    size_t frame_end = reader.BytePosition();
+    uint16 crc16 = reader.ReadBits(16);
+    if (reader.Overrun())
+      KALDI_ERR << "WaveData: FLAC data is truncated";
+    if (crc16 != FlacCrc16(data + frame_start, frame_end - frame_start))
+      KALDI_ERR << "WaveData: FLAC frame CRC mismatch";
+    frame_start = reader.BytePosition();
+
+    int64 *ch0 = &(samples[0]), *ch1 = ch0 + block_size;
+    for (int32 i = 0; i < block_size && num_channels == 2; i++) {
+      if (channel_code == 8) {  // left/side
+        ch1[i] = ch0[i] - ch1[i];
+      } else if (channel_code == 9) {  // side/right
+        ch0[i] += ch1[i];
+      } else if (channel_code == 10) {  // mid/side
+        int64 mid = ch0[i] * 2 + (ch1[i] & 1), side = ch1[i];
+        ch0[i] = (mid + side) >> 1;
+        ch1[i] = (mid - side) >> 1;
+      }
+    }
+    // We scale to the 16-bit range, as for wave files.
+    BaseFloat scale = pow(2.0, 16 - bits_per_sample);
+    for (int32 c = 0; c < num_channels; c++) {
+      const int64 *s = &(samples[c * block_size]);
+      std::vector<BaseFloat> &this_channel = channel_data[c];
+      for (int32 i = 0; i < block_size; i++)
+        this_channel.push_back(scale * s[i]);
+    }
+  }
+  int32 num_samples = channel_data[0].size();
+  if (!info.IsStreamed() && num_samples != info.SampleCount()) {
+    KALDI_WARN << "Expected " << info.SampleCount() << " samples of FLAC "
+               << "data, but read " << num_samples << ". Truncated file?";
+    num_samples = std::min<int32>(num_samples, info.SampleCount());
+  }
+  wave->Resize(num_channels, num_samples, kUndefined);
+  for (int32 c = 0; c < num_channels; c++)
+    std::copy(channel_data[c].begin(), channel_data[c].begin() + num_samples,
+              wave->RowData(c));
+}
+
 void WaveData::Read(std::istream &is) {
   const uint32 kBlockSize = 1024 * 1024;
 
@@ -278,8 +747,11 @@ void WaveData::Read(std::istream &is) {
   data_.Resize(0, 0);  // clear the data.
   samp_freq_ = header.SampFreq();
 
+  // For FLAC we read to the end of the stream.
+  bool read_to_end = header.IsStreamed() ||
+      header.GetEncoding() == WaveInfo::kFlac;
   std::vector<char> buffer;
-  uint32 bytes_to_go = header.IsStreamed() ? kBlockSize : header.DataBytes();
+  uint32 bytes_to_go = read_to_end ? kBlockSize : header.DataBytes();
 
   // Once in a while header.DataBytes() will report an insane value;
   // read the file to the end
@@ -290,7 +762,7 @@ void WaveData::Read(std::istream &is) {
     is.read(&buffer[offset], block_bytes);
     uint32 bytes_read = is.gcount();
     buffer.resize(offset + bytes_read);
-    if (!header.IsStreamed())
+    if (!read_to_end)
       bytes_to_go -= bytes_read;
   }
 
@@ -300,17 +772,31 @@ void WaveData::Read(std::istream &is) {
   if (buffer.size() == 0)
     KALDI_ERR << "WaveData: empty file (no data)";
 
+  if (header.GetEncoding() == WaveInfo::kFlac) {
+    DecodeFlacFrames(header, buffer, &data_);
+    return;
+  }
+
   if (!header.IsStreamed() && buffer.size() < header.DataBytes()) {
     KALDI_WARN << "Expected " << header.DataBytes() << " bytes of wave data, "
                << "but read only " << buffer.size() << " bytes. "
                << "Truncated file?";
   }
 
-  uint16 *data_ptr = reinterpret_cast<uint16*>(&buffer[0]);
-
   // The matrix is arranged row per channel, column per sample.
   data_.Resize(header.NumChannels(),
                buffer.size() / header.BlockAlign());
+  if (header.GetEncoding() != WaveInfo::kPcm16) {
+    const uint8 *byte_ptr = reinterpret_cast<const uint8*>(&buffer[0]);
+    bool a_law = (header.GetEncoding() == WaveInfo::kALaw);
+    for (uint32 i = 0; i < data_.NumCols(); ++i)
+      for (uint32 j = 0; j < data_.NumRows(); ++j, ++byte_ptr)
+        data_(j, i) = (a_law ? ALawToLinear(*byte_ptr) :
+                       MuLawToLinear(*byte_ptr));
+    return;
+  }
+
+  uint16 *data_ptr = reinterpret_cast<uint16*>(&buffer[0]);
   for (uint32 i = 0; i < data_.NumCols(); ++i) {
     for (uint32 j = 0; j < data_.NumRows(); ++j) {
       int16 k = *data_ptr++;
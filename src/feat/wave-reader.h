@@ -42,6 +42,15 @@
 //   a formal specification but it did not completely make sense.  And there
 //   doesn't seem to be a consensus on what makes a valid wave file,
 //   particularly where the accuracy of header information is concerned.]
+//
+//  Besides 16-bit PCM, we can read 8-bit A-law and mu-law data (G.711) from
+//  wave files, and we can read FLAC files (native FLAC, not Ogg FLAC; see
+//  RFC 9639), which are recognized by their "fLaC" marker.  This means that
+//  wav.scp files can refer directly to such files, without a "sox ... |"
+//  command that forks a process per utterance; and for decoding in parallel
+//  with the feature extraction, you can read them with a "bgN" rspecifier,
+//  e.g. scp,bg4:wav.scp (see kaldi-table.h).  Ogg (e.g. Opus) data is not
+//  supported.
 */
 
 
@@ -64,8 +73,17 @@ const BaseFloat kWaveSampleMax = 32768.0;
 /// This class reads and hold wave file header information.
 class WaveInfo {
  public:
+  /// The encoding of the samples in the file.
+  enum Encoding {
+    kPcm16,  // 16-bit linear PCM (wave files)
+    kALaw,   // 8-bit A-law (wave files)
+    kMuLaw,  // 8-bit mu-law (wave files)
+    kFlac    // FLAC
+  };
+
   WaveInfo() : samp_freq_(0), samp_count_(0),
-               num_channels_(0), reverse_bytes_(0) {}
+               num_channels_(0), reverse_bytes_(0), encoding_(kPcm16),
+               bits_per_sample_(16) {}
 
   /// Is stream size unknown? Duration and SampleCount not valid if true.
   bool IsStreamed() const { return samp_count_ < 0; }
@@ -82,24 +100,39 @@ class WaveInfo {
   /// Number of channels, 1 to 16.
   int32 NumChannels() const { return num_channels_; }
 
-  /// Bytes per sample.
-  size_t BlockAlign() const { return 2 * num_channels_; }
+  /// Bytes per sample (for all channels).  Not valid for FLAC.
+  size_t BlockAlign() const {
+    return (encoding_ == kPcm16 ? 2 : 1) * num_channels_;
+  }
 
-  /// Wave data bytes. Invalid if IsStreamed() is true.
+  /// Wave data bytes. Invalid if IsStreamed() is true, or for FLAC.
   size_t DataBytes() const { return samp_count_ * BlockAlign(); }
 
+  /// The encoding of the data.
+  Encoding GetEncoding() const { return encoding_; }
+
+  /// Bits per sample of the encoded data, e.g. 8 for A-law and mu-law; for
+  /// FLAC this may be anything from 4 to 32.
+  int32 BitsPerSample() const { return bits_per_sample_; }
+
   /// Is data file byte order different from machine byte order?
   bool ReverseBytes() const { return reverse_bytes_; }
 
   /// 'is' should be opened in binary mode. Read() will throw on error.
-  /// On success 'is' will be positioned at the beginning of wave data.
+  /// On success 'is' will be positioned at the beginning of wave data (for
+  /// FLAC, at the first frame).
   void Read(std::istream &is);
 
  private:
+  /// Called from Read() for FLAC files; reads the metadata blocks.
+  void ReadFlac(std::istream &is);
+
   BaseFloat samp_freq_;
   int32 samp_count_;     // 0 if empty, -1 if undefined length.
   uint8 num_channels_;
   bool reverse_bytes_;   // File endianness differs from host.
+  Encoding encoding_;
+  int32 bits_per_sample_;
 };
 
 /// This class's purpose is to read in Wave files.
@@ -22,7 +22,44 @@
 #include "util/common-utils.h"
 #include "matrix/kaldi-matrix.h"
 #include "transform/cmvn.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// This class is used to parallelize over multiple threads the application of
+// CMVN to the utterances.  The tables are read in the main thread; the features
+// are kept as they were read (e.g. compressed) until the work happens in the
+// operator (), and the output happens in the destructor, in the original order.
+class ApplyCmvnTask {
+ public:
+  ApplyCmvnTask(const std::string &utt, const GeneralMatrix &feats,
+                const Matrix<double> &cmvn_stats, bool norm_vars,
+                bool reverse, BaseFloatMatrixWriter *writer):
+      utt_(utt), input_feats_(feats), cmvn_stats_(cmvn_stats),
+      norm_vars_(norm_vars), reverse_(reverse), writer_(writer) { }
+
+  void operator () () {
+    input_feats_.GetMatrix(&feats_);
+    input_feats_.Clear();
+    if (reverse_) {
+      ApplyCmvnReverse(cmvn_stats_, norm_vars_, &feats_);
+    } else {
+      ApplyCmvn(cmvn_stats_, norm_vars_, &feats_);
+    }
+  }
 
+  ~ApplyCmvnTask() { writer_->Write(utt_, feats_); }
+ private:
+  std::string utt_;
+  GeneralMatrix input_feats_;
+  Matrix<double> cmvn_stats_;
+  bool norm_vars_;
+  bool reverse_;
+  BaseFloatMatrixWriter *writer_;
+  Matrix<BaseFloat> feats_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -41,6 +78,7 @@ int main(int argc, char *argv[]) {
     bool norm_means = true;
     bool reverse = false;
     std::string skip_dims_str;
+    TaskSequencerConfig sequencer_config;
 
     po.Register("utt2spk", &utt2spk_rspecifier,
                 "rspecifier for utterance to speaker map");
@@ -53,6 +91,7 @@ int main(int argc, char *argv[]) {
     po.Register("reverse", &reverse, "If true, apply CMVN in a reverse sense, "
                 "so as to transform zero-mean, unit-variance input into data "
                 "with the given mean and variance.");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -94,8 +133,11 @@ int main(int argc, char *argv[]) {
 
     kaldi::int32 num_done = 0, num_err = 0;
 
-    SequentialBaseFloatMatrixReader feat_reader(feat_rspecifier);
+    SequentialGeneralMatrixReader feat_reader(feat_rspecifier);
     BaseFloatMatrixWriter feat_writer(feat_wspecifier);
+    // CMVN is applied in the threads, but the output is the same as with one
+    // thread.
+    TaskSequencer<ApplyCmvnTask> sequencer(sequencer_config);
 
     if (ClassifyRspecifier(cmvn_rspecifier_or_rxfilename, NULL, NULL)
         != kNoRspecifier) { // reading from a Table: per-speaker or per-utt CMN/CVN.
@@ -106,27 +148,17 @@ int main(int argc, char *argv[]) {
 
       for (; !feat_reader.Done(); feat_reader.Next()) {
         std::string utt = feat_reader.Key();
-        Matrix<BaseFloat> feat(feat_reader.Value());
-        if (norm_means) {
-          if (!cmvn_reader.HasKey(utt)) {
-            KALDI_WARN << "No normalization statistics available for key "
-                       << utt << ", producing no output for this utterance";
-            num_err++;
-            continue;
-          }
-          Matrix<double> cmvn_stats = cmvn_reader.Value(utt);
-          if (!skip_dims.empty())
-            FakeStatsForSomeDims(skip_dims, &cmvn_stats);
-
-          if (reverse) {
-            ApplyCmvnReverse(cmvn_stats, norm_vars, &feat);
-          } else {
-            ApplyCmvn(cmvn_stats, norm_vars, &feat);
-          }
-          feat_writer.Write(utt, feat);
-        } else {
-          feat_writer.Write(utt, feat);
+        if (!cmvn_reader.HasKey(utt)) {
+          KALDI_WARN << "No normalization statistics available for key "
+                     << utt << ", producing no output for this utterance";
+          num_err++;
+          continue;
         }
+        Matrix<double> cmvn_stats = cmvn_reader.Value(utt);
+        if (!skip_dims.empty())
+          FakeStatsForSomeDims(skip_dims, &cmvn_stats);
+        sequencer.Run(new ApplyCmvnTask(utt, feat_reader.Value(), cmvn_stats,
+                                        norm_vars, reverse, &feat_writer));
         num_done++;
       }
     } else {
@@ -143,18 +175,12 @@ int main(int argc, char *argv[]) {
 
       for (;!feat_reader.Done(); feat_reader.Next()) {
         std::string utt = feat_reader.Key();
-        Matrix<BaseFloat> feat(feat_reader.Value());
-        if (norm_means) {
-          if (reverse) {
-            ApplyCmvnReverse(cmvn_stats, norm_vars, &feat);
-          } else {
-            ApplyCmvn(cmvn_stats, norm_vars, &feat);
-          }
-        }
-        feat_writer.Write(utt, feat);
+        sequencer.Run(new ApplyCmvnTask(utt, feat_reader.Value(), cmvn_stats,
+                                        norm_vars, reverse, &feat_writer));
         num_done++;
       }
     }
+    sequencer.Wait();
     if (norm_vars)
       KALDI_LOG << "Applied cepstral mean and variance normalization to "
                 << num_done << " utterances, errors on " << num_err;
@@ -22,6 +22,7 @@
 #include "util/common-utils.h"
 #include "matrix/kaldi-matrix.h"
 #include "transform/cmvn.h"
+#include "util/kaldi-thread.h"
 
 namespace kaldi {
 
@@ -48,6 +49,76 @@ bool AccCmvnStatsWrapper(const std::string &utt,
   }
 }
 
+// Gets the weights for an utterance into "weights" (or leaves it empty if there
+// is no --weights option); returns false, with a warning, if they are not
+// available.
+bool GetCmvnWeights(const std::string &utt, int32 num_frames,
+                    RandomAccessBaseFloatVectorReader *weights_reader,
+                    Vector<BaseFloat> *weights) {
+  weights->Resize(0);
+  if (!weights_reader->IsOpen())
+    return true;
+  if (!weights_reader->HasKey(utt)) {
+    KALDI_WARN << "No weights available for utterance " << utt;
+    return false;
+  }
+  *weights = weights_reader->Value(utt);
+  if (weights->Dim() != num_frames) {
+    KALDI_WARN << "Weights for utterance " << utt << " have wrong dimension "
+               << weights->Dim() << " vs. " << num_frames;
+    return false;
+  }
+  return true;
+}
+
+// This class is used to parallelize the accumulation of the stats for a
+// speaker (or for an utterance, without --spk2utt) over multiple threads.  The
+// tables are read in the main thread; the features are kept as they were read
+// (e.g. compressed) until the work happens in the operator (), and the output
+// happens in the destructor, in the original order.
+class CmvnStatsTask {
+ public:
+  CmvnStatsTask(const std::string &key, DoubleMatrixWriter *writer):
+      key_(key), writer_(writer), dim_(-1) { }
+
+  // As in the single-threaded version of this program, the stats are
+  // initialized with the dimension of the first utterance that was found,
+  // even if its weights were not available.
+  void SetDim(int32 dim) { if (dim_ == -1) dim_ = dim; }
+
+  // "weights" may be empty, meaning no weighting.
+  void AddUtterance(const GeneralMatrix &feats,
+                    const Vector<BaseFloat> &weights) {
+    feats_.push_back(feats);
+    weights_.push_back(weights);
+  }
+
+  void operator () () {
+    if (dim_ != -1)
+      InitCmvnStats(dim_, &stats_);
+    Matrix<BaseFloat> feats;
+    for (size_t i = 0; i < feats_.size(); i++) {
+      feats_[i].GetMatrix(&feats);
+      AccCmvnStats(feats, (weights_[i].Dim() != 0 ? &(weights_[i]) : NULL),
+                   &stats_);
+    }
+  }
+
+  ~CmvnStatsTask() {
+    if (stats_.NumRows() == 0)
+      KALDI_WARN << "No stats accumulated for speaker " << key_;
+    else
+      writer_->Write(key_, stats_);
+  }
+ private:
+  std::string key_;
+  DoubleMatrixWriter *writer_;
+  int32 dim_;
+  std::vector<GeneralMatrix> feats_;
+  std::vector<Vector<BaseFloat> > weights_;
+  Matrix<double> stats_;
+};
+
 
 }
 
@@ -68,10 +139,12 @@ int main(int argc, char *argv[]) {
     ParseOptions po(usage);
     std::string spk2utt_rspecifier, weights_rspecifier;
     bool binary = true;
+    TaskSequencerConfig sequencer_config;
     po.Register("spk2utt", &spk2utt_rspecifier, "rspecifier for speaker to utterance-list map");
     po.Register("binary", &binary, "write in binary mode (applies only to global CMN/CVN)");
     po.Register("weights", &weights_rspecifier, "rspecifier for a vector of floats "
                 "for each utterance, that's a per-frame weight.");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -91,16 +164,20 @@ int main(int argc, char *argv[]) {
       std::string wspecifier = wspecifier_or_wxfilename;
 
       DoubleMatrixWriter writer(wspecifier);
+      // The stats are accumulated in the threads, but the output, and the
+      // order of the additions within a speaker, are the same as with one
+      // thread.
+      TaskSequencer<CmvnStatsTask> sequencer(sequencer_config);
 
       if (spk2utt_rspecifier != "") {
         SequentialTokenVectorReader spk2utt_reader(spk2utt_rspecifier);
-        RandomAccessBaseFloatMatrixReader feat_reader(rspecifier);
+        RandomAccessGeneralMatrixReader feat_reader(rspecifier);
 
         for (; !spk2utt_reader.Done(); spk2utt_reader.Next()) {
           std::string spk = spk2utt_reader.Key();
           const std::vector<std::string> &uttlist = spk2utt_reader.Value();
-          bool is_init = false;
-          Matrix<double> stats;
+          CmvnStatsTask *task = new CmvnStatsTask(spk, &writer);
+          Vector<BaseFloat> weights;
           for (size_t i = 0; i < uttlist.size(); i++) {
             std::string utt = uttlist[i];
             if (!feat_reader.HasKey(utt)) {
@@ -108,40 +185,38 @@ int main(int argc, char *argv[]) {
               num_err++;
               continue;
             }
-            const Matrix<BaseFloat> &feats = feat_reader.Value(utt);
-            if (!is_init) {
-              InitCmvnStats(feats.NumCols(), &stats);
-              is_init = true;
-            }
-            if (!AccCmvnStatsWrapper(utt, feats, &weights_reader, &stats)) {
+            const GeneralMatrix &feats = feat_reader.Value(utt);
+            task->SetDim(feats.NumCols());
+            if (!GetCmvnWeights(utt, feats.NumRows(), &weights_reader,
+                                &weights)) {
               num_err++;
             } else {
+              task->AddUtterance(feats, weights);
               num_done++;
             }
           }
-          if (stats.NumRows() == 0) {
-            KALDI_WARN << "No stats accumulated for speaker " << spk;
-          } else {
-            writer.Write(spk, stats);
-          }
+          sequencer.Run(task);
         }
       } else {  // per-utterance normalization
-        SequentialBaseFloatMatrixReader feat_reader(rspecifier);
+        SequentialGeneralMatrixReader feat_reader(rspecifier);
 
         for (; !feat_reader.Done(); feat_reader.Next()) {
           std::string utt = feat_reader.Key();
-          Matrix<double> stats;
-          const Matrix<BaseFloat> &feats = feat_reader.Value();
-          InitCmvnStats(feats.NumCols(), &stats);
-
-          if (!AccCmvnStatsWrapper(utt, feats, &weights_reader, &stats)) {
+          const GeneralMatrix &feats = feat_reader.Value();
+          Vector<BaseFloat> weights;
+          if (!GetCmvnWeights(utt, feats.NumRows(), &weights_reader,
+                              &weights)) {
             num_err++;
             continue;
           }
-          writer.Write(feat_reader.Key(), stats);
+          CmvnStatsTask *task = new CmvnStatsTask(utt, &writer);
+          task->SetDim(feats.NumCols());
+          task->AddUtterance(feats, weights);
+          sequencer.Run(task);
           num_done++;
         }
       }
+      // The destructor of the sequencer will wait for any remaining tasks.
     } else { // accumulate global stats
       if (spk2utt_rspecifier != "")
         KALDI_ERR << "--spk2utt option not compatible with wxfilename as output "
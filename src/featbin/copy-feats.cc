@@ -22,6 +22,30 @@
 #include "util/common-utils.h"
 #include "matrix/kaldi-matrix.h"
 
+namespace kaldi {
+
+// Writes *mat compressed.  With the "bg" wspecifier option the compression is
+// done by the background writer threads; *mat is then swapped into a
+// shared_ptr, so that the lambda can hold it without copying it, and left
+// empty.
+static void WriteCompressed(const std::string &key,
+                            CompressionMethod compression_method,
+                            bool background, Matrix<BaseFloat> *mat,
+                            CompressedMatrixWriter *writer) {
+  if (!background) {
+    writer->Write(key, CompressedMatrix(*mat, compression_method));
+    return;
+  }
+  std::shared_ptr<Matrix<BaseFloat> > mat_ptr =
+      std::make_shared<Matrix<BaseFloat> >();
+  mat_ptr->Swap(mat);
+  writer->WriteDeferred(key, [mat_ptr, compression_method](
+      CompressedMatrix *cmat) {
+      cmat->CopyFromMat(*mat_ptr, compression_method);
+    });
+}
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -108,35 +132,39 @@ int main(int argc, char *argv[]) {
         }
       } else {
         CompressedMatrixWriter kaldi_writer(wspecifier);
+        WspecifierOptions wopts;
+        ClassifyWspecifier(wspecifier, NULL, NULL, &wopts);
+        // The num-frames are written first, because WriteCompressed() may
+        // leave the matrix empty.
         if (htk_in) {
           SequentialTableReader<HtkMatrixHolder> htk_reader(rspecifier);
           for (; !htk_reader.Done(); htk_reader.Next(), num_done++) {
-            kaldi_writer.Write(htk_reader.Key(),
-                               CompressedMatrix(htk_reader.Value().first,
-                                                compression_method));
             if (!num_frames_wspecifier.empty())
               num_frames_writer.Write(htk_reader.Key(),
                                       htk_reader.Value().first.NumRows());
+            WriteCompressed(htk_reader.Key(), compression_method,
+                            wopts.background, &(htk_reader.Value().first),
+                            &kaldi_writer);
           }
         } else if (sphinx_in) {
           SequentialTableReader<SphinxMatrixHolder<> > sphinx_reader(rspecifier);
           for (; !sphinx_reader.Done(); sphinx_reader.Next(), num_done++) {
-            kaldi_writer.Write(sphinx_reader.Key(),
-                               CompressedMatrix(sphinx_reader.Value(),
-                                                compression_method));
             if (!num_frames_wspecifier.empty())
               num_frames_writer.Write(sphinx_reader.Key(),
                                       sphinx_reader.Value().NumRows());
+            WriteCompressed(sphinx_reader.Key(), compression_method,
+                            wopts.background, &(sphinx_reader.Value()),
+                            &kaldi_writer);
           }
         } else {
           SequentialBaseFloatMatrixReader kaldi_reader(rspecifier);
           for (; !kaldi_reader.Done(); kaldi_reader.Next(), num_done++) {
-            kaldi_writer.Write(kaldi_reader.Key(),
-                               CompressedMatrix(kaldi_reader.Value(),
-                                                compression_method));
             if (!num_frames_wspecifier.empty())
               num_frames_writer.Write(kaldi_reader.Key(),
                                       kaldi_reader.Value().NumRows());
+            WriteCompressed(kaldi_reader.Key(), compression_method,
+                            wopts.background, &(kaldi_reader.Value()),
+                            &kaldi_writer);
           }
         }
       }
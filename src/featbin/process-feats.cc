@@ -0,0 +1,89 @@
+// featbin/process-feats.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "feat/feature-filter.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+
+    const char *usage =
+        "Apply a chain of feature-processing stages within one process, with\n"
+        "no writing and re-reading of the features between stages.  Each\n"
+        "stage is given as the command line of the program that would do it,\n"
+        "without the input and output specifiers; the supported programs are\n"
+        "apply-cmvn, add-deltas, splice-feats, transform-feats and\n"
+        "subsample-feats, with the same options as those programs.\n"
+        "Utterances for which any stage fails (e.g. because there are no\n"
+        "CMVN stats for it) produce no output.\n"
+        "\n"
+        "Usage: process-feats [options] <stage1> [<stage2> ...] \\\n"
+        "                <feats-rspecifier> <feats-wspecifier>\n"
+        "e.g.: process-feats 'apply-cmvn --utt2spk=ark:data/train/utt2spk\n"
+        "  scp:data/train/cmvn.scp' 'splice-feats --left-context=3\n"
+        "  --right-context=3' 'transform-feats exp/tri2b/final.mat' \\\n"
+        "  scp:data/train/feats.scp ark:-\n"
+        "which is equivalent to\n"
+        " apply-cmvn --utt2spk=ark:data/train/utt2spk scp:data/train/cmvn.scp\\\n"
+        "  scp:data/train/feats.scp ark:- | splice-feats --left-context=3\\\n"
+        "  --right-context=3 ark:- ark:- | transform-feats\\\n"
+        "  exp/tri2b/final.mat ark:- ark:-\n";
+
+    ParseOptions po(usage);
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 3) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    FeatureFilterChain chain;
+    for (int32 i = 1; i <= po.NumArgs() - 2; i++)
+      chain.Append(po.GetArg(i));
+
+    std::string feat_rspecifier = po.GetArg(po.NumArgs() - 1),
+        feat_wspecifier = po.GetArg(po.NumArgs());
+
+    SequentialBaseFloatMatrixReader feat_reader(feat_rspecifier);
+    BaseFloatMatrixWriter feat_writer(feat_wspecifier);
+
+    int32 num_done = 0, num_err = 0;
+    Matrix<BaseFloat> feats;
+    for (; !feat_reader.Done(); feat_reader.Next()) {
+      std::string utt = feat_reader.Key();
+      // Shallow swap rather than copy; the reader's value is not used again.
+      feats.Swap(&(feat_reader.Value()));
+      if (!chain.Apply(utt, &feats)) {
+        num_err++;
+        continue;
+      }
+      feat_writer.Write(utt, feats);
+      num_done++;
+    }
+    KALDI_LOG << "Applied " << chain.NumFilters() << " stages to " << num_done
+              << " utterances; " << num_err << " had errors.";
+    return (num_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,283 @@
+// featbin/wav-reverberate-batch.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "feat/resample.h"
+#include "feat/signal.h"
+#include "feat/wave-reader.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+struct ReverberateBatchOptions {
+  BaseFloat speed;
+  bool shift_output;
+  bool normalize_output;
+  BaseFloat volume;
+  int32 input_channel;
+  int32 rir_channel;
+  int32 noise_channel;
+
+  ReverberateBatchOptions(): speed(1.0), shift_output(true),
+                             normalize_output(true), volume(0.0),
+                             input_channel(0), rir_channel(0),
+                             noise_channel(0) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("speed", &speed, "If not 1.0, speed-perturb the input "
+                   "by this factor (as 'sox speed' does: the tempo and the "
+                   "pitch both change) before reverberating it.");
+    opts->Register("shift-output", &shift_output,
+                   "If true, the reverberated waveform will be shifted by the "
+                   "amount of the peak position of the RIR and the length of "
+                   "the output waveform will be equal to the input waveform. "
+                   "If false, the length of the output waveform will be "
+                   "equal to (original input length + rir length - 1).");
+    opts->Register("normalize-output", &normalize_output,
+                   "If true, then after reverberating and possibly adding "
+                   "noise, scale so that the signal energy is the same as "
+                   "the original input signal.  See also --volume.");
+    opts->Register("volume", &volume, "If nonzero, a scaling factor on the "
+                   "signal that is applied after reverberating and possibly "
+                   "adding noise; overrides --normalize-output.");
+    opts->Register("input-wave-channel", &input_channel,
+                   "Specifies the channel to be used from the input.");
+    opts->Register("rir-channel", &rir_channel,
+                   "Specifies the channel of the room impulse responses.");
+    opts->Register("noise-channel", &noise_channel,
+                   "Specifies the channel of the additive signals.");
+  }
+};
+
+// This class does the augmentation of one utterance, so that it can be run in
+// multiple threads by TaskSequencer.  The tables are read in the main thread;
+// the work is done in operator (), and the output in the destructor, in the
+// original order.  The computation is the same as in wav-reverberate (with
+// --multi-channel-output=false and --duration=0).
+class ReverberateTask {
+ public:
+  ReverberateTask(const ReverberateBatchOptions &opts,
+                  const std::string &utt,
+                  const WaveData &input,
+                  TableWriter<WaveHolder> *writer):
+      opts_(opts), utt_(utt), input_(input), have_rir_(false),
+      have_noise_(false), snr_(0.0), start_time_(0.0), writer_(writer) { }
+
+  void SetImpulseResponse(const WaveData &rir) {
+    rir_ = rir;
+    have_rir_ = true;
+  }
+
+  void SetNoise(const WaveData &noise, BaseFloat snr, BaseFloat start_time) {
+    noise_ = noise;
+    snr_ = snr;
+    start_time_ = start_time;
+    have_noise_ = true;
+  }
+
+  void operator () () {
+    BaseFloat samp_freq = input_.SampFreq();
+    Vector<BaseFloat> input(input_.Data().Row(opts_.input_channel));
+    if (opts_.speed != 1.0) {
+      Vector<BaseFloat> perturbed;
+      ResampleWaveform(samp_freq * opts_.speed, input, samp_freq, &perturbed);
+      input.Swap(&perturbed);
+    }
+    int32 num_samp_input = input.Dim();
+    float power_before_reverb = VecVec(input, input) / input.Dim();
+
+    int32 shift_index = 0, num_samp_rir = 0;
+    float early_energy = power_before_reverb;
+    if (have_rir_) {
+      Vector<BaseFloat> rir(rir_.Data().Row(opts_.rir_channel));
+      rir.Scale(1.0 / (1 << 15));
+      num_samp_rir = rir.Dim();
+      early_energy = DoReverberation(rir, rir_.SampFreq(), &input);
+      if (opts_.shift_output)
+        rir.Max(&shift_index);
+    }
+    if (have_noise_) {
+      Vector<BaseFloat> noise(noise_.Data().Row(opts_.noise_channel));
+      AddNoise(&noise, snr_, start_time_, samp_freq, early_energy, &input);
+    }
+    float power_after_reverb = VecVec(input, input) / input.Dim();
+
+    if (opts_.volume > 0)
+      input.Scale(opts_.volume);
+    else if (opts_.normalize_output)
+      input.Scale(sqrt(power_before_reverb / power_after_reverb));
+
+    int32 num_samp_output = (opts_.shift_output ? num_samp_input :
+                             num_samp_input + num_samp_rir - 1);
+    Matrix<BaseFloat> output(1, num_samp_output, kUndefined);
+    output.Row(0).CopyFromVec(input.Range(shift_index, num_samp_output));
+    output_ = WaveData(samp_freq, output);
+  }
+
+  ~ReverberateTask() { writer_->Write(utt_, output_); }
+ private:
+  const ReverberateBatchOptions &opts_;
+  std::string utt_;
+  WaveData input_;
+  bool have_rir_;
+  WaveData rir_;
+  bool have_noise_;
+  WaveData noise_;
+  BaseFloat snr_;
+  BaseFloat start_time_;
+  TableWriter<WaveHolder> *writer_;
+  WaveData output_;
+};
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+
+    const char *usage =
+        "Corrupts a whole archive of wave files in one process, optionally\n"
+        "speed-perturbing them, reverberating them with a per-utterance room\n"
+        "impulse response and adding a per-utterance noise signal.  This\n"
+        "does the same computation as wav-reverberate, but avoids starting a\n"
+        "process per utterance and can use multiple threads.\n"
+        "The impulse responses, noises, SNRs and start times are tables\n"
+        "indexed by utterance (e.g. scp files, whose entries may be piped\n"
+        "commands).  Only one additive signal per utterance is supported.\n"
+        "Usage:  wav-reverberate-batch [options...] <wav-rspecifier> "
+        "<wav-wspecifier>\n"
+        "e.g.\n"
+        "wav-reverberate-batch --num-threads=8 --impulse-responses=scp:rir.scp "
+        "--additive-signals=scp:noise.scp --snrs=ark:snrs.txt "
+        "scp:wav.scp ark:reverb.ark\n";
+
+    ParseOptions po(usage);
+    ReverberateBatchOptions opts;
+    TaskSequencerConfig sequencer_config;
+    std::string rir_rspecifier, noise_rspecifier, snr_rspecifier,
+        start_time_rspecifier;
+
+    opts.Register(&po);
+    sequencer_config.Register(&po);
+    po.Register("impulse-responses", &rir_rspecifier, "rspecifier of the "
+                "room impulse response for each utterance, in wav format.  "
+                "Utterances without one are not output.");
+    po.Register("additive-signals", &noise_rspecifier, "rspecifier of the "
+                "additive signal (noise) for each utterance, in wav format.  "
+                "Requires --snrs.  Utterances without one are not output.");
+    po.Register("snrs", &snr_rspecifier, "rspecifier of the SNR (dB) with "
+                "which to add the additive signal, for each utterance.");
+    po.Register("start-times", &start_time_rspecifier, "rspecifier of the "
+                "time (in seconds) at which the additive signal starts, for "
+                "each utterance; if not set, the additive signals start at "
+                "the start of the utterances.");
+
+    po.Read(argc, argv);
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+    KALDI_ASSERT(opts.speed > 0.0);
+    if (!noise_rspecifier.empty() && snr_rspecifier.empty())
+      KALDI_ERR << "--additive-signals option requires --snrs to be set.";
+
+    std::string wav_rspecifier = po.GetArg(1),
+        wav_wspecifier = po.GetArg(2);
+
+    SequentialTableReader<WaveHolder> wav_reader(wav_rspecifier);
+    RandomAccessTableReader<WaveHolder> rir_reader(rir_rspecifier),
+        noise_reader(noise_rspecifier);
+    RandomAccessBaseFloatReader snr_reader(snr_rspecifier),
+        start_time_reader(start_time_rspecifier);
+    TableWriter<WaveHolder> wav_writer(wav_wspecifier);
+    // The sequencer is declared after the writer, so that its destructor,
+    // which waits for the remaining tasks, is called first.
+    TaskSequencer<ReverberateTask> sequencer(sequencer_config);
+
+    int32 num_done = 0, num_err = 0;
+    for (; !wav_reader.Done(); wav_reader.Next()) {
+      std::string utt = wav_reader.Key();
+      const WaveData &wave = wav_reader.Value();
+      if (opts.input_channel >= wave.Data().NumRows()) {
+        KALDI_WARN << "Utterance " << utt << " has no channel "
+                   << opts.input_channel;
+        num_err++;
+        continue;
+      }
+      // We do the checks here, rather than in the task, so that the errors
+      // do not happen in the threads.
+      const WaveData *rir = NULL, *noise = NULL;
+      BaseFloat snr = 0.0, start_time = 0.0;
+      if (rir_reader.IsOpen()) {
+        if (!rir_reader.HasKey(utt)) {
+          KALDI_WARN << "No impulse response for utterance " << utt;
+          num_err++;
+          continue;
+        }
+        rir = &(rir_reader.Value(utt));
+        if (opts.rir_channel >= rir->Data().NumRows()) {
+          KALDI_WARN << "Impulse response for utterance " << utt
+                     << " has no channel " << opts.rir_channel;
+          num_err++;
+          continue;
+        }
+      }
+      if (noise_reader.IsOpen()) {
+        if (!noise_reader.HasKey(utt) || !snr_reader.HasKey(utt) ||
+            (start_time_reader.IsOpen() && !start_time_reader.HasKey(utt))) {
+          KALDI_WARN << "No additive signal, SNR or start time for utterance "
+                     << utt;
+          num_err++;
+          continue;
+        }
+        noise = &(noise_reader.Value(utt));
+        if (noise->SampFreq() != wave.SampFreq()) {
+          KALDI_WARN << "Sampling frequency of the additive signal for "
+                     << "utterance " << utt << " does not match: "
+                     << noise->SampFreq() << " vs. " << wave.SampFreq();
+          num_err++;
+          continue;
+        }
+        if (opts.noise_channel >= noise->Data().NumRows()) {
+          KALDI_WARN << "Additive signal for utterance " << utt
+                     << " has no channel " << opts.noise_channel;
+          num_err++;
+          continue;
+        }
+        snr = snr_reader.Value(utt);
+        if (start_time_reader.IsOpen())
+          start_time = start_time_reader.Value(utt);
+      }
+      ReverberateTask *task = new ReverberateTask(opts, utt, wave,
+                                                  &wav_writer);
+      if (rir != NULL)
+        task->SetImpulseResponse(*rir);
+      if (noise != NULL)
+        task->SetNoise(*noise, snr, start_time);
+      sequencer.Run(task);
+      num_done++;
+    }
+    sequencer.Wait();
+    KALDI_LOG << "Corrupted " << num_done << " utterances; " << num_err
+              << " had errors.";
+    return (num_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
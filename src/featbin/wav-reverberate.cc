@@ -24,95 +24,10 @@
 
 namespace kaldi {
 
-/*
-   This function is to repeatedly concatenate signal1 by itself 
-   to match the length of signal2 and add the two signals together.
-*/
-void AddVectorsOfUnequalLength(const VectorBase<BaseFloat> &signal1,
-                                     Vector<BaseFloat> *signal2) {
-  for (int32 po = 0; po < signal2->Dim(); po += signal1.Dim()) {
-    int32 block_length = signal1.Dim();
-    if (signal2->Dim() - po < block_length) block_length = signal2->Dim() - po;
-    signal2->Range(po, block_length).AddVec(1.0, signal1.Range(0, block_length));
-  }
-}
-
-/*
-   This function is to add signal1 to signal2 starting at the offset of signal2
-   This will not extend the length of signal2.
-*/
-void AddVectorsWithOffset(const Vector<BaseFloat> &signal1, int32 offset,
-                                             Vector<BaseFloat> *signal2) {
-  int32 add_length = std::min(signal2->Dim() - offset, signal1.Dim());
-  if (add_length > 0)
-    signal2->Range(offset, add_length).AddVec(1.0, signal1.Range(0, add_length));
-}
-
-
 BaseFloat MaxAbsolute(const Vector<BaseFloat> &vector) {
   return std::max(std::abs(vector.Max()), std::abs(vector.Min()));
 }
 
-/* 
-   Early reverberation component of the signal is composed of reflections 
-   within 0.05 seconds of the direct path signal (assumed to be the peak of 
-   the room impulse response). This function returns the energy in 
-   this early reverberation component of the signal. 
-   The input parameters to this function are the room impulse response, the signal
-   and their sampling frequency respectively.
-*/
-BaseFloat ComputeEarlyReverbEnergy(const Vector<BaseFloat> &rir, const Vector<BaseFloat> &signal,
-                                   BaseFloat samp_freq) {
-  int32 peak_index = 0;
-  rir.Max(&peak_index);
-  KALDI_VLOG(1) << "peak index is " << peak_index;
-
-  const float sec_before_peak = 0.001;
-  const float sec_after_peak = 0.05;
-  int32 early_rir_start_index = peak_index - sec_before_peak * samp_freq;
-  int32 early_rir_end_index = peak_index + sec_after_peak * samp_freq;
-  if (early_rir_start_index < 0) early_rir_start_index = 0;
-  if (early_rir_end_index > rir.Dim()) early_rir_end_index = rir.Dim();
-
-  int32 duration = early_rir_end_index - early_rir_start_index;
-  Vector<BaseFloat> early_rir(rir.Range(early_rir_start_index, duration));
-  Vector<BaseFloat> early_reverb(signal);
-  FFTbasedBlockConvolveSignals(early_rir, &early_reverb);
-
-  // compute the energy
-  return VecVec(early_reverb, early_reverb) / early_reverb.Dim();
-}
-
-/*
-   This is the core function to do reverberation on the given signal.
-   The input parameters to this function are the room impulse response,
-   the sampling frequency and the signal respectively.
-   The length of the signal will be extended to (original signal length +
-   rir length - 1) after the reverberation.
-*/
-float DoReverberation(const Vector<BaseFloat> &rir, BaseFloat samp_freq,
-                        Vector<BaseFloat> *signal) {
-  float signal_power = ComputeEarlyReverbEnergy(rir, *signal, samp_freq);
-  FFTbasedBlockConvolveSignals(rir, signal);
-  return signal_power;
-}
-
-/*
-   The noise will be scaled before the addition
-   to match the given signal-to-noise ratio (SNR).
-*/
-void AddNoise(Vector<BaseFloat> *noise, BaseFloat snr_db,
-                BaseFloat time, BaseFloat samp_freq,
-                BaseFloat signal_power, Vector<BaseFloat> *signal) {
-  float noise_power = VecVec(*noise, *noise) / noise->Dim();
-  float scale_factor = sqrt(pow(10, -snr_db / 10) * signal_power / noise_power);
-  noise->Scale(scale_factor);
-  KALDI_VLOG(1) << "Noise signal is being scaled with " << scale_factor
-                << " to generate output with SNR " << snr_db << "db\n";
-  int32 offset = time * samp_freq;
-  AddVectorsWithOffset(*noise, offset, signal);
-}
-
 /*
    This function converts comma-spearted string into float vector.
 */
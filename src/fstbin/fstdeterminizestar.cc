@@ -77,10 +77,20 @@ int main(int argc, char *argv[]) {
     float delta = kDelta;
     int max_states = -1;
     bool use_log = false;
+    std::string spill_dir;
+    int32 num_threads = 1;
     ParseOptions po(usage);
     po.Register("use-log", &use_log, "Determinize in log semiring.");
     po.Register("delta", &delta, "Delta value used to determine equivalence of weights.");
     po.Register("max-states", &max_states, "Maximum number of states in determinized FST before it will abort.");
+    po.Register("spill-dir", &spill_dir, "If set, keep the determinizer's "
+                "subsets of states and finished output states in a temporary "
+                "memory-mapped file in this directory, so they can be paged "
+                "out.  This greatly reduces the memory needed for very large "
+                "graphs, at some cost in speed.");
+    po.Register("num-threads", &num_threads, "Number of threads used to "
+                "expand determinized states.  The output is equivalent but "
+                "its states may be numbered differently.");
     po.Read(argc, argv);
 
     if (po.NumArgs() > 2) {
@@ -101,14 +111,22 @@ int main(int argc, char *argv[]) {
       VectorFst<StdArc> *fst = ReadFstKaldi(fst_in_str);
 
       ArcSort(fst, ILabelCompare<StdArc>());  // improves speed.
+      std::unique_ptr<MappedArena> arena(spill_dir.empty() ? NULL :
+                                         new MappedArena(spill_dir));
       if (use_log) {
-        DeterminizeStarInLog(fst, delta, &debug_location, max_states);
+        DeterminizeStarInLog(fst, delta, &debug_location, max_states,
+                             arena.get(), num_threads);
       } else {
         VectorFst<StdArc> det_fst;
-        DeterminizeStar(*fst, &det_fst, delta, &debug_location, max_states);
+        DeterminizeStar(*fst, &det_fst, delta, &debug_location, max_states,
+                        false, arena.get(), num_threads);
         *fst = det_fst;  // will do shallow copy and then det_fst goes
         // out of scope anyway.
       }
+      if (arena != NULL)
+        KALDI_LOG << "Used " << (arena->BytesAllocated() / 1.0e+06)
+                  << " MB of memory-mapped storage in " << spill_dir;
+      arena.reset();
       WriteFstKaldi(*fst, fst_out_str);
       delete fst;
     } else { // Dealing with archives.
@@ -120,11 +138,16 @@ int main(int argc, char *argv[]) {
         fst_reader.FreeCurrent();
         ArcSort(&fst, ILabelCompare<StdArc>()); // improves speed.
         try {
+          // A new arena for each FST, so the memory is freed each time.
+          std::unique_ptr<MappedArena> arena(spill_dir.empty() ? NULL :
+                                             new MappedArena(spill_dir));
           if (use_log) {
-            DeterminizeStarInLog(&fst, delta, &debug_location, max_states);
+            DeterminizeStarInLog(&fst, delta, &debug_location, max_states,
+                                 arena.get(), num_threads);
           } else {
             VectorFst<StdArc> det_fst;
-            DeterminizeStar(fst, &det_fst, delta, &debug_location, max_states);
+            DeterminizeStar(fst, &det_fst, delta, &debug_location, max_states,
+                            false, arena.get(), num_threads);
             fst = det_fst;  // will do shallow copy and then det_fst goes out
             // of scope anyway.
           }
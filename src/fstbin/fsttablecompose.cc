@@ -25,6 +25,7 @@
 #include "fstext/table-matcher.h"
 #include "fstext/fstext-utils.h"
 #include "fstext/kaldi-fst-io.h"
+#include "util/kaldi-thread.h"
 
 
 /*
@@ -39,6 +40,79 @@
 
 */
 
+namespace kaldi {
+
+// This class composes one pair of FSTs in operator (), which may run in a
+// separate thread, and writes the output in its destructor, which the
+// TaskSequencer calls in the original order of the inputs.  If 'cache_pool' is
+// non-NULL the composition uses a cache from it (so the FST on the matched side
+// must be the same for all tasks), otherwise it uses 'opts'.
+class TableComposeTask {
+ public:
+  // Takes ownership of 'fst1' if 'own_fst1' is true, and likewise for 'fst2'.
+  // If 'skip_empty' is true, empty outputs are counted as errors and not
+  // written.
+  TableComposeTask(const std::string &key,
+                   const fst::VectorFst<fst::StdArc> *fst1, bool own_fst1,
+                   const fst::VectorFst<fst::StdArc> *fst2, bool own_fst2,
+                   const fst::TableComposeOptions &opts,
+                   fst::TableComposeCachePool<fst::Fst<fst::StdArc> >
+                   *cache_pool,
+                   bool skip_empty,
+                   TableWriter<fst::VectorFstHolder> *fst_writer,
+                   int32 *num_done, int32 *num_err):
+      key_(key), fst1_(fst1), own_fst1_(own_fst1), fst2_(fst2),
+      own_fst2_(own_fst2), opts_(opts), cache_pool_(cache_pool),
+      skip_empty_(skip_empty), fst_writer_(fst_writer), num_done_(num_done),
+      num_err_(num_err) { }
+
+  void operator () () {
+    if (cache_pool_ != NULL) {
+      fst::TableComposeCache<fst::Fst<fst::StdArc> > *cache =
+          cache_pool_->Get();
+      fst::TableCompose(*fst1_, *fst2_, &result_, cache);
+      cache_pool_->Put(cache);
+    } else {
+      fst::TableCompose(*fst1_, *fst2_, &result_, opts_);
+    }
+    FreeInputs();  // They are no longer needed.
+  }
+
+  ~TableComposeTask() {
+    FreeInputs();  // in case operator () was never called.
+    if (skip_empty_ && result_.NumStates() == 0) {
+      KALDI_WARN << "Empty output for key " << key_;
+      (*num_err_)++;
+    } else {
+      fst_writer_->Write(key_, result_);
+      (*num_done_)++;
+    }
+  }
+ private:
+  void FreeInputs() {
+    if (own_fst1_) delete fst1_;
+    if (own_fst2_) delete fst2_;
+    own_fst1_ = own_fst2_ = false;
+    fst1_ = fst2_ = NULL;
+  }
+
+  std::string key_;
+  const fst::VectorFst<fst::StdArc> *fst1_;
+  bool own_fst1_;
+  const fst::VectorFst<fst::StdArc> *fst2_;
+  bool own_fst2_;
+  const fst::TableComposeOptions &opts_;
+  fst::TableComposeCachePool<fst::Fst<fst::StdArc> > *cache_pool_;
+  bool skip_empty_;
+  fst::VectorFst<fst::StdArc> result_;  // The output; written in the
+                                        // destructor.
+  TableWriter<fst::VectorFstHolder> *fst_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
@@ -59,6 +133,11 @@ int main(int argc, char *argv[]) {
         "semiring] that is more efficient for certain cases-- in particular,\n"
         "where one of the FSTs (the left one, if --match-side=left) has large\n"
         "out-degree\n"
+        "When one argument is an archive and the other a single FST on the\n"
+        "matched side (the first FST with --match-side=left, the second with\n"
+        "--match-side=right), the matcher of the single FST is reused across\n"
+        "the archive.  With archives, --num-threads > 1 composes several FSTs\n"
+        "at once, still writing them in the input order.\n"
         "\n"
         "Usage:  fsttablecompose (fst1-rxfilename|fst1-rspecifier) "
         "(fst2-rxfilename|fst2-rspecifier) [(out-rxfilename|out-rspecifier)]\n";
@@ -68,15 +147,23 @@ int main(int argc, char *argv[]) {
     TableComposeOptions opts;
     std::string match_side = "left";
     std::string compose_filter = "sequence";
+    int32 max_table_mb = 0;
 
     po.Register("connect", &opts.connect, "If true, trim FST before output.");
     po.Register("match-side", &match_side, "Side of composition to do table "
                 "match, one of: \"left\" or \"right\".");
     po.Register("compose-filter", &compose_filter, "Composition filter to use, "
                 "one of: \"alt_sequence\", \"auto\", \"match\", \"sequence\"");
-    
+    po.Register("max-table-mb", &max_table_mb, "If > 0, limit on the memory "
+                "(in MB) used by the matcher's lookup tables; useful when "
+                "composing very large FSTs.");
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    sequencer_config.Register(&po);
+
     po.Read(argc, argv);
 
+    opts.max_table_bytes = static_cast<size_t>(max_table_mb) << 20;
+
     if (match_side == "left") {
       opts.table_match_type = MATCH_OUTPUT;
     } else if (match_side == "right") {
@@ -141,25 +228,45 @@ int main(int argc, char *argv[]) {
 
       WriteFstKaldi(composed_fst, fst_out_str);
       return 0;
-    } else if (!is_table_1 && is_table_2
-               && opts.table_match_type == MATCH_OUTPUT) {
-      // second arg is an archive, and match-side=left (default).
-      TableComposeCache<Fst<StdArc> > cache(opts);
-      VectorFst<StdArc> *fst1 = ReadFstKaldi(fst1_in_str);      
-      SequentialTableReader<VectorFstHolder> fst2_reader(fst2_in_str);
+    } else if ((!is_table_1 && is_table_2
+                && opts.table_match_type == MATCH_OUTPUT) ||
+               (is_table_1 && !is_table_2
+                && opts.table_match_type == MATCH_INPUT)) {
+      // One arg is an archive and the other is a single FST on the matched
+      // side (e.g. the first arg, with match-side=left, the default), so the
+      // matcher built for the single FST can be reused.
+      bool single_is_1 = !is_table_1;
+      TableComposeCachePool<Fst<StdArc> > cache_pool(opts);
+      VectorFst<StdArc> *single_fst =
+          ReadFstKaldi(single_is_1 ? fst1_in_str : fst2_in_str);
+      SequentialTableReader<VectorFstHolder> fst_reader(
+          single_is_1 ? fst2_in_str : fst1_in_str);
       TableWriter<VectorFstHolder> fst_writer(fst_out_str);
-      int32 n_done = 0;
+      int32 n_done = 0, n_err = 0;
 
-      // Checks if <fst1> is olabel sorted.
-      if (fst1->Properties(fst::kOLabelSorted, true) == 0) {
+      // Checks if the single FST is sorted on the matched side.
+      if (single_is_1 && single_fst->Properties(fst::kOLabelSorted, true) == 0)
         KALDI_WARN << "The first FST is not olabel sorted.";
+      if (!single_is_1 && single_fst->Properties(fst::kILabelSorted, true) == 0)
+        KALDI_WARN << "The second FST is not ilabel sorted.";
+      {
+        TaskSequencer<TableComposeTask> sequencer(sequencer_config);
+        for (; !fst_reader.Done(); fst_reader.Next()) {
+          std::string key = fst_reader.Key();
+          VectorFst<StdArc> *fst = new VectorFst<StdArc>(fst_reader.Value());
+          fst_reader.FreeCurrent();
+          if (single_is_1)
+            sequencer.Run(new TableComposeTask(
+                key, single_fst, false, fst, true, opts,
+                &cache_pool, false, &fst_writer, &n_done, &n_err));
+          else
+            sequencer.Run(new TableComposeTask(
+                key, fst, true, single_fst, false, opts,
+                &cache_pool, false, &fst_writer, &n_done, &n_err));
+        }
+        sequencer.Wait();
       }
-      for (; !fst2_reader.Done(); fst2_reader.Next(), n_done++) {
-        VectorFst<StdArc> fst2(fst2_reader.Value());
-        VectorFst<StdArc> fst_out;
-        TableCompose(*fst1, fst2, &fst_out, &cache);
-        fst_writer.Write(fst2_reader.Key(), fst_out);
-      }
+      delete single_fst;
       KALDI_LOG << "Composed " << n_done << " FSTs.";
       return (n_done != 0 ? 0 : 1);
     } else if (is_table_1 && is_table_2) {
@@ -167,24 +274,24 @@ int main(int argc, char *argv[]) {
       RandomAccessTableReader<VectorFstHolder> fst2_reader(fst2_in_str);
       TableWriter<VectorFstHolder> fst_writer(fst_out_str);
       int32 n_done = 0, n_err = 0;
-      for (; !fst1_reader.Done(); fst1_reader.Next()) {
-        std::string key = fst1_reader.Key();
-        if (!fst2_reader.HasKey(key)) {
-          KALDI_WARN << "No such key " << key << " in second table.";
-          n_err++;
-        } else {
-          const VectorFst<StdArc> &fst1(fst1_reader.Value()),
-              &fst2(fst2_reader.Value(key));
-          VectorFst<StdArc> result;
-          TableCompose(fst1, fst2, &result, opts);
-          if (result.NumStates() == 0) {
-            KALDI_WARN << "Empty output for key " << key;
+      {
+        TaskSequencer<TableComposeTask> sequencer(sequencer_config);
+        for (; !fst1_reader.Done(); fst1_reader.Next()) {
+          std::string key = fst1_reader.Key();
+          if (!fst2_reader.HasKey(key)) {
+            KALDI_WARN << "No such key " << key << " in second table.";
             n_err++;
           } else {
-            fst_writer.Write(key, result);
-            n_done++;
+            VectorFst<StdArc>
+                *fst1 = new VectorFst<StdArc>(fst1_reader.Value()),
+                *fst2 = new VectorFst<StdArc>(fst2_reader.Value(key));
+            fst1_reader.FreeCurrent();
+            sequencer.Run(new TableComposeTask(
+                key, fst1, true, fst2, true, opts, NULL, true, &fst_writer,
+                &n_done, &n_err));
           }
         }
+        sequencer.Wait();
       }
       KALDI_LOG << "Successfully composed " << n_done << " FSTs, errors or "
                 << "empty output on " << n_err;
@@ -0,0 +1,72 @@
+// fstbin/make-csr-fst.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "fst/fstlib.h"
+#include "fstext/kaldi-fst-io.h"
+#include "fstext/csr-fst.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+
+    const char *usage =
+        "Convert a decoding graph (e.g. HCLG.fst) to CsrFst, a compact format\n"
+        "that decoders can traverse faster and that is memory-mapped when\n"
+        "read, so that processes on the same machine that decode with the\n"
+        "same graph share one copy of it.  Decoders that accept it (e.g.\n"
+        "nnet3-latgen-faster) detect the format automatically.  See\n"
+        "fstext/csr-fst.h.\n"
+        "\n"
+        "Usage: make-csr-fst [options] <fst-in> <csr-fst-out>\n"
+        "e.g.: make-csr-fst HCLG.fst HCLG.csr\n";
+
+    ParseOptions po(usage);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string fst_in_str = po.GetArg(1),
+        fst_out_str = po.GetArg(2);
+
+    Fst<StdArc> *fst = ReadFstKaldiGeneric(fst_in_str);
+    CsrFst csr_fst(*fst);
+    delete fst;
+
+    // CsrFst does not support non-binary write.  In order for the output to
+    // be memory-mappable it must be written to a file of its own, as here.
+    bool binary = true;
+    WriteKaldiObject(csr_fst, fst_out_str, binary);
+
+    KALDI_LOG << "Wrote CsrFst with " << csr_fst.NumStates() << " states and "
+              << csr_fst.NumArcs() << " arcs to "
+              << PrintableWxfilename(fst_out_str);
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
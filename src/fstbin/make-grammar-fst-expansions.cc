@@ -0,0 +1,77 @@
+// fstbin/make-grammar-fst-expansions.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "fst/fstlib.h"
+#include "decoder/grammar-fst.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+    using kaldi::int32;
+
+    const char *usage =
+        "Expand, in advance, the states of a GrammarFst (as written by\n"
+        "make-grammar-fst) where nonterminals are entered, and write the\n"
+        "expanded states to a file that can be given to the decoder\n"
+        "along with the GrammarFst (e.g. nnet3-latgen-grammar --expansions).\n"
+        "This saves the decoder from expanding those states on the fly.\n"
+        "\n"
+        "Usage: make-grammar-fst-expansions [options] <grammar-fst-in> "
+        "<expansions-out>\n"
+        "e.g.: make-grammar-fst-expansions HCLG_grammar.fst "
+        "HCLG_grammar.expansions\n";
+
+    ParseOptions po(usage);
+
+    bool top_level_only = false;
+
+    po.Register("top-level-only", &top_level_only, "If true, only expand "
+                "the states of the top-level FST (and not those where the "
+                "sub-grammars invoke each other).");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string grammar_fst_rxfilename = po.GetArg(1),
+        expansions_wxfilename = po.GetArg(2);
+
+    GrammarFst grammar_fst;
+    ReadKaldiObject(grammar_fst_rxfilename, &grammar_fst);
+
+    int32 num_expanded = grammar_fst.PrecomputeExpansions(top_level_only);
+
+    bool binary = true;  // GrammarFst does not support non-binary write.
+    Output ko(expansions_wxfilename, binary);
+    grammar_fst.WriteExpansions(ko.Stream(), binary);
+
+    KALDI_LOG << "Expanded " << num_expanded << " states and wrote them to "
+              << expansions_wxfilename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
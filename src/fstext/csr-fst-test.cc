@@ -0,0 +1,169 @@
+// fstext/csr-fst-test.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+#include <cstddef>
+#include <cstring>
+#include <sstream>
+
+#include "fstext/csr-fst.h"
+#include "fstext/kaldi-fst-io.h"
+#include "fstext/rand-fst.h"
+#include "util/kaldi-io.h"
+
+namespace fst {
+
+// Checks that 'csr' has the same states, final-probs and arcs as 'fst', with
+// the arcs of each state in the same order.
+void CheckSameFst(const VectorFst<StdArc> &fst, const CsrFst &csr) {
+  KALDI_ASSERT(csr.Start() == fst.Start() &&
+               csr.NumStates() == fst.NumStates());
+  for (StdArc::StateId s = 0; s < fst.NumStates(); s++) {
+    KALDI_ASSERT(csr.Final(s) == fst.Final(s));
+    KALDI_ASSERT(csr.NumArcs(s) == fst.NumArcs(s) &&
+                 csr.NumInputEpsilons(s) == fst.NumInputEpsilons(s));
+    ArcIterator<CsrFst> aiter(csr, s);
+    size_t i = 0;
+    for (ArcIterator<VectorFst<StdArc> > fst_aiter(fst, s); !fst_aiter.Done();
+         fst_aiter.Next(), aiter.Next(), i++) {
+      KALDI_ASSERT(!aiter.Done());
+      const StdArc &arc = aiter.Value(), &fst_arc = fst_aiter.Value();
+      KALDI_ASSERT(&arc == csr.Arcs(s) + i);
+      KALDI_ASSERT(arc.ilabel == fst_arc.ilabel &&
+                   arc.olabel == fst_arc.olabel &&
+                   arc.weight == fst_arc.weight &&
+                   arc.nextstate == fst_arc.nextstate);
+    }
+    KALDI_ASSERT(aiter.Done());
+  }
+}
+
+// Returns true if reading 'data' as a CsrFst throws.
+bool ReadFails(const std::string &data) {
+  try {
+    std::istringstream is(data);
+    CsrFst csr;
+    csr.Read(is, true);
+    return false;
+  } catch (...) {
+    return true;
+  }
+}
+
+// Checks that Read() detects some kinds of corruption that would otherwise
+// lead to out-of-range accesses when decoding.
+void TestCorruptCsrFst() {
+  RandFstOptions opts;
+  VectorFst<StdArc> *fst = RandFst<StdArc>(opts);
+  CsrFst csr(*fst);
+  std::ostringstream os;
+  csr.Write(os, true);
+  const std::string data = os.str();
+  KALDI_ASSERT(!ReadFails(data));
+
+  // Find the arrays, which are just before the "</CsrFst> " at the end.
+  int32 num_states = csr.NumStates();
+  size_t num_arcs = 0;
+  for (int32 s = 0; s < num_states; s++)
+    num_arcs += csr.NumArcs(s);
+  size_t footer_size = std::string("</CsrFst> ").size(),
+      offsets_pos = data.size() - footer_size - sizeof(uint32) *
+      (2 * num_states + 1),
+      num_input_eps_pos = offsets_pos + sizeof(uint32) * (num_states + 1),
+      arcs_pos = offsets_pos - sizeof(float) * num_states -
+      sizeof(StdArc) * num_arcs;
+
+  // A truncated file.
+  KALDI_ASSERT(ReadFails(data.substr(0, data.size() - footer_size - 1)));
+  if (num_arcs > 0) {
+    // An arc going to a nonexistent state.
+    std::string bad(data);
+    int32 nextstate = num_states;
+    memcpy(&bad[arcs_pos + offsetof(StdArc, nextstate)], &nextstate,
+           sizeof(nextstate));
+    KALDI_ASSERT(ReadFails(bad));
+  }
+  if (num_states > 1) {
+    // Arc offsets out of order.
+    std::string bad(data);
+    uint32 offset = num_arcs + 1;
+    memcpy(&bad[offsets_pos + sizeof(uint32)], &offset, sizeof(offset));
+    KALDI_ASSERT(ReadFails(bad));
+  }
+  if (num_states > 0) {
+    // A wrong number of input epsilons.
+    std::string bad(data);
+    uint32 num_input_eps = csr.NumInputEpsilons(0) + 1;
+    memcpy(&bad[num_input_eps_pos], &num_input_eps, sizeof(num_input_eps));
+    KALDI_ASSERT(ReadFails(bad));
+  }
+  delete fst;
+}
+
+void TestCsrFst() {
+  RandFstOptions opts;
+  VectorFst<StdArc> *fst = RandFst<StdArc>(opts);
+  CsrFst csr(*fst);
+  CheckSameFst(*fst, csr);
+
+  std::ostringstream os;
+  csr.Write(os, true);
+  CsrFst csr2;
+  std::istringstream is(os.str());
+  csr2.Read(is, true);
+  CheckSameFst(*fst, csr2);
+
+  // Test memory-mapping.
+  kaldi::WriteKaldiObject(csr, "tmpf.csr", true);
+  KALDI_ASSERT(IsCsrFstFile("tmpf.csr"));
+  CsrFst *csr3 = ReadCsrFstKaldi("tmpf.csr");
+  KALDI_ASSERT(csr3->IsMapped());
+  CheckSameFst(*fst, *csr3);
+  delete csr3;
+
+  // A CsrFst in an archive can't be mapped, but can be read.
+  {
+    kaldi::Output ko("tmpf.csr", true);
+    kaldi::WriteToken(ko.Stream(), true, "utt1");
+    csr.Write(ko.Stream(), true);
+  }
+  KALDI_ASSERT(!IsCsrFstFile("tmpf.csr"));
+  CsrFst csr4;
+  KALDI_ASSERT(!csr4.Map("tmpf.csr") && csr4.NumStates() == 0);
+  {
+    bool binary;
+    kaldi::Input ki("tmpf.csr", &binary);
+    kaldi::ExpectToken(ki.Stream(), binary, "utt1");
+    csr4.Read(ki.Stream(), binary);
+  }
+  KALDI_ASSERT(!csr4.IsMapped());
+  CheckSameFst(*fst, csr4);
+  unlink("tmpf.csr");
+  delete fst;
+}
+
+}  // namespace fst
+
+int main() {
+  for (int i = 0; i < 20; i++) {
+    fst::TestCsrFst();
+    fst::TestCorruptCsrFst();
+  }
+  std::cout << "Test OK\n";
+}
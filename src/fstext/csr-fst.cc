@@ -0,0 +1,233 @@
+// fstext/csr-fst.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+#include "fstext/csr-fst.h"
+
+namespace fst {
+
+void CsrFst::Init(const Fst<StdArc> &fst) {
+  mapped_file_.Close();
+  // We need the number of states; this works for any FST type, though for
+  // VectorFst and ConstFst, CountStates() is fast.
+  StateId num_states = CountStates(fst);
+  start_ = fst.Start();
+  final_costs_storage_.resize(num_states);
+  arc_offsets_storage_.resize(num_states + 1);
+  num_input_eps_storage_.resize(num_states);
+  std::vector<Arc> &arcs = arcs_storage_;
+  arcs.clear();
+  for (StateId s = 0; s < num_states; s++) {
+    final_costs_storage_[s] = fst.Final(s).Value();
+    arc_offsets_storage_[s] = arcs.size();
+    uint32 num_input_eps = 0;
+    for (ArcIterator<Fst<StdArc> > aiter(fst, s); !aiter.Done();
+         aiter.Next()) {
+      arcs.push_back(aiter.Value());
+      if (aiter.Value().ilabel == 0)
+        num_input_eps++;
+    }
+    num_input_eps_storage_[s] = num_input_eps;
+    if (arcs.size() >= std::numeric_limits<uint32>::max())
+      KALDI_ERR << "FST has too many arcs for CsrFst.";
+  }
+  arc_offsets_storage_[num_states] = arcs.size();
+  // Free the memory that the vector may have over-allocated.
+  std::vector<Arc>(arcs).swap(arcs);
+  num_states_ = num_states;
+  num_arcs_ = arcs.size();
+  SetPointers();
+}
+
+void CsrFst::Clear() {
+  mapped_file_.Close();
+  start_ = kNoStateId;
+  num_states_ = 0;
+  num_arcs_ = 0;
+  std::vector<float>().swap(final_costs_storage_);
+  arc_offsets_storage_.assign(1, 0);
+  std::vector<uint32>().swap(num_input_eps_storage_);
+  std::vector<Arc>().swap(arcs_storage_);
+  SetPointers();
+}
+
+size_t CsrFst::ArraysSize() const {
+  return sizeof(Arc) * num_arcs_ + sizeof(float) * num_states_ +
+      sizeof(uint32) * (num_states_ + 1) + sizeof(uint32) * num_states_;
+}
+
+void CsrFst::SetPointers() {
+  final_costs_ = final_costs_storage_.data();
+  arc_offsets_ = arc_offsets_storage_.data();
+  num_input_eps_ = num_input_eps_storage_.data();
+  arcs_ = arcs_storage_.data();
+}
+
+void CsrFst::SetPointers(const char *data) {
+  // This is the order in which Write() writes the arrays.  The arcs come
+  // first because they have the largest alignment requirement.
+  arcs_ = reinterpret_cast<const Arc*>(data);
+  data += sizeof(Arc) * num_arcs_;
+  final_costs_ = reinterpret_cast<const float*>(data);
+  data += sizeof(float) * num_states_;
+  arc_offsets_ = reinterpret_cast<const uint32*>(data);
+  data += sizeof(uint32) * (num_states_ + 1);
+  num_input_eps_ = reinterpret_cast<const uint32*>(data);
+}
+
+void CsrFst::Check() const {
+  if (start_ != kNoStateId && (start_ < 0 || start_ >= num_states_))
+    KALDI_ERR << "Corrupt CsrFst: invalid start state " << start_;
+  if (arc_offsets_[0] != 0 || arc_offsets_[num_states_] != num_arcs_)
+    KALDI_ERR << "Corrupt CsrFst: invalid arc offsets";
+  for (StateId s = 0; s < num_states_; s++) {
+    uint32 begin = arc_offsets_[s], end = arc_offsets_[s + 1];
+    if (end < begin || end > num_arcs_)
+      KALDI_ERR << "Corrupt CsrFst: invalid arc offsets for state " << s;
+    uint32 num_input_eps = 0;
+    for (uint32 a = begin; a < end; a++) {
+      const Arc &arc = arcs_[a];
+      if (arc.nextstate < 0 || arc.nextstate >= num_states_)
+        KALDI_ERR << "Corrupt CsrFst: invalid nextstate " << arc.nextstate
+                  << " on an arc of state " << s;
+      if (arc.ilabel == 0)
+        num_input_eps++;
+    }
+    if (num_input_eps != num_input_eps_[s])
+      KALDI_ERR << "Corrupt CsrFst: wrong number of input epsilons for state "
+                << s;
+  }
+}
+
+void CsrFst::Write(std::ostream &os, bool binary) const {
+  using namespace kaldi;
+  if (!binary)
+    KALDI_ERR << "CsrFst::Write only supports binary mode.";
+  std::ostringstream header;
+  WriteToken(header, binary, "<CsrFst>");
+  WriteBasicType(header, binary, static_cast<int32>(start_));
+  WriteBasicType(header, binary, static_cast<int64>(num_states_));
+  WriteBasicType(header, binary, static_cast<int64>(num_arcs_));
+  // Work out how much padding we need so that the arrays would be aligned if
+  // we are at the start of a file, after the "\0B" written by Output.  The
+  // 1 + sizeof(int32) is for the padding size itself, as written by
+  // WriteBasicType().
+  size_t header_size = 2 + header.str().size() + 1 + sizeof(int32);
+  int32 padding = (kAlignment - header_size % kAlignment) % kAlignment;
+  WriteBasicType(header, binary, padding);
+  os << header.str();
+  for (int32 i = 0; i < padding; i++)
+    os.put('\0');
+  os.write(reinterpret_cast<const char*>(arcs_), sizeof(Arc) * num_arcs_);
+  os.write(reinterpret_cast<const char*>(final_costs_),
+           sizeof(float) * num_states_);
+  os.write(reinterpret_cast<const char*>(arc_offsets_),
+           sizeof(uint32) * (num_states_ + 1));
+  os.write(reinterpret_cast<const char*>(num_input_eps_),
+           sizeof(uint32) * num_states_);
+  WriteToken(os, binary, "</CsrFst>");
+  if (!os.good())
+    KALDI_ERR << "Error writing CsrFst to stream";
+}
+
+void CsrFst::ReadHeader(std::istream &is) {
+  using namespace kaldi;
+  int32 start, padding;
+  int64 num_states, num_arcs;
+  ExpectToken(is, true, "<CsrFst>");
+  ReadBasicType(is, true, &start);
+  ReadBasicType(is, true, &num_states);
+  ReadBasicType(is, true, &num_arcs);
+  ReadBasicType(is, true, &padding);
+  if (num_states < 0 || num_states >= std::numeric_limits<int32>::max() ||
+      num_arcs < 0 || num_arcs >= std::numeric_limits<uint32>::max() ||
+      start < kNoStateId || start >= num_states ||
+      padding < 0 || padding >= static_cast<int32>(kAlignment))
+    KALDI_ERR << "Invalid header reading CsrFst";
+  is.ignore(padding);
+  if (!is.good())
+    KALDI_ERR << "Error reading CsrFst header";
+  start_ = start;
+  num_states_ = num_states;
+  num_arcs_ = num_arcs;
+}
+
+void CsrFst::Read(std::istream &is, bool binary) {
+  using namespace kaldi;
+  if (!binary)
+    KALDI_ERR << "CsrFst::Read only supports binary mode.";
+  mapped_file_.Close();
+  ReadHeader(is);
+  arcs_storage_.resize(num_arcs_);
+  final_costs_storage_.resize(num_states_);
+  arc_offsets_storage_.resize(num_states_ + 1);
+  num_input_eps_storage_.resize(num_states_);
+  is.read(reinterpret_cast<char*>(arcs_storage_.data()),
+          sizeof(Arc) * num_arcs_);
+  is.read(reinterpret_cast<char*>(final_costs_storage_.data()),
+          sizeof(float) * num_states_);
+  is.read(reinterpret_cast<char*>(arc_offsets_storage_.data()),
+          sizeof(uint32) * (num_states_ + 1));
+  is.read(reinterpret_cast<char*>(num_input_eps_storage_.data()),
+          sizeof(uint32) * num_states_);
+  ExpectToken(is, binary, "</CsrFst>");
+  SetPointers();
+  Check();
+}
+
+bool CsrFst::Map(const std::string &filename) {
+  using namespace kaldi;
+  Clear();
+  if (!mapped_file_.Open(filename))
+    return false;  // MappedFile::Open() will have printed a warning.
+  const char *data = mapped_file_.Data();
+  size_t size = mapped_file_.Size();
+  const char header[] = "\0B<CsrFst>";
+  const size_t header_size = sizeof(header) - 1;
+  if (size < header_size || std::memcmp(data, header, header_size) != 0) {
+    KALDI_WARN << "Cannot map " << filename << ": it does not start with "
+               << "a binary-mode CsrFst.";
+    Clear();
+    return false;
+  }
+  MemoryStreambuf header_buf(data + 2, size - 2);
+  std::istream header_is(&header_buf);
+  ReadHeader(header_is);
+  size_t offset = 2 + static_cast<size_t>(header_is.tellg());
+  if (offset % kAlignment != 0) {
+    KALDI_WARN << "Cannot map " << filename << ": the data is not aligned "
+               << "(was it written with other objects?)";
+    Clear();
+    return false;
+  }
+  size_t end = offset + ArraysSize();
+  if (end > size)
+    KALDI_ERR << "Truncated CsrFst in " << filename;
+  MemoryStreambuf footer_buf(data + end, size - end);
+  std::istream footer_is(&footer_buf);
+  ExpectToken(footer_is, true, "</CsrFst>");
+  SetPointers(data + offset);
+  Check();
+  return true;
+}
+
+}  // namespace fst
@@ -0,0 +1,215 @@
+// fstext/csr-fst.h
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_FSTEXT_CSR_FST_H_
+#define KALDI_FSTEXT_CSR_FST_H_
+
+#include <string>
+#include <vector>
+
+#include <fst/fstlib.h>
+#include "base/kaldi-common.h"
+#include "util/kaldi-mmap.h"
+
+namespace fst {
+
+class CsrFst;
+
+// Declare that we'll be overriding class ArcIterator for class CsrFst (as for
+// GrammarFst in ../decoder/grammar-fst.h).
+template<> class ArcIterator<CsrFst>;
+
+/**
+   CsrFst is a compact, read-only copy of an FST over StdArc, intended for
+   decoding graphs (HCLG).  The decoders can be templated on it, e.g.
+   LatticeFasterDecoderTpl<fst::CsrFst>.  Like GrammarFst, it does not inherit
+   from class Fst and only supports the parts of the interface that the
+   decoders need.
+
+   The arcs of all the states are stored in one array, in "compressed sparse
+   row" form as in CudaFst (../cudadecoder/cuda-fst.h): the arcs of state s
+   are at positions arc_offsets_[s] through arc_offsets_[s+1] - 1, in the same
+   order as in the input FST, and num_input_eps_[s] is the number of them with
+   ilabel == 0.  Each arc is a StdArc, i.e. four 32-bit fields, so ArcIterator
+   can return references into the array without copying.  This takes 12 bytes
+   per state (ConstFst takes 20) and the arcs of consecutive states are
+   contiguous in memory, which makes it cheaper to traverse than the generic
+   Fst interface.
+
+   The arcs are kept in their original order (unlike CudaFst, which puts the
+   emitting arcs first), because the order in which the decoders expand arcs
+   affects their adaptive beam, so reordering them could change the lattices.
+   So decoding with a CsrFst gives the same output as with the FST it was made
+   from.  The number of arcs is limited to 2^32 - 1.
+
+   The on-disk format (see Write()) is the same as the in-memory one, so a
+   file containing just a CsrFst can be memory-mapped and used in place (see
+   Map()).  The mapping is shared, so processes that decode with the same
+   graph on one machine share one copy of it in the page cache, and loading it
+   takes no time.  Use ReadCsrFstKaldi() in kaldi-fst-io.h to map or read one.
+*/
+class CsrFst {
+ public:
+  typedef StdArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Weight Weight;
+  typedef Arc::Label Label;
+
+  CsrFst(): start_(kNoStateId), num_states_(0), num_arcs_(0),
+            arc_offsets_storage_(1, 0) { SetPointers(); }
+
+  /// Makes a copy of 'fst'.
+  explicit CsrFst(const Fst<StdArc> &fst) { Init(fst); }
+
+  /// Makes *this a copy of 'fst'.
+  void Init(const Fst<StdArc> &fst);
+
+  StateId Start() const { return start_; }
+
+  StateId NumStates() const { return num_states_; }
+
+  size_t NumArcs() const { return num_arcs_; }
+
+  Weight Final(StateId s) const { return Weight(final_costs_[s]); }
+
+  size_t NumArcs(StateId s) const {
+    return arc_offsets_[s + 1] - arc_offsets_[s];
+  }
+
+  /// Returns the number of non-emitting arcs of state s, i.e. the arcs with
+  /// ilabel == 0.
+  size_t NumInputEpsilons(StateId s) const { return num_input_eps_[s]; }
+
+  /// The arcs of state s are Arcs(s)[0] through Arcs(s)[NumArcs(s) - 1].
+  const Arc *Arcs(StateId s) const { return arcs_ + arc_offsets_[s]; }
+
+  std::string Type() const { return "csr"; }
+
+  /// Binary mode only (it will crash if binary == false).  The arrays are
+  /// padded so that in a file written by kaldi::Output in binary mode, with
+  /// nothing else in it, they start at an offset that is a multiple of
+  /// kAlignment bytes; this is what Map() requires.
+  void Write(std::ostream &os, bool binary) const;
+
+  /// Reads the format that Write() outputs.  Binary mode only.
+  void Read(std::istream &is, bool binary);
+
+  /// Memory-maps 'filename' (which must be an actual filename, not a pipe or
+  /// an offset into a file) that was written by kaldi::Output in binary mode
+  /// containing just a CsrFst, and makes *this refer to the mapped data.  The
+  /// mapping is read-only and shared between processes.  Returns true on
+  /// success; on failure (e.g. if the file was not written that way) prints a
+  /// warning, leaves *this empty and returns false, in which case you can
+  /// still use Read().  Throws on a corrupt file; this checks all of the
+  /// data, as Read() does, so the whole file is read once.
+  bool Map(const std::string &filename);
+
+  /// Returns true if *this refers to a memory-mapped file.
+  bool IsMapped() const { return mapped_file_.IsOpen(); }
+
+  static const size_t kAlignment = 64;
+
+ private:
+  friend class ArcIterator<CsrFst>;
+
+  // Reads everything before the arrays in the format of Write(), setting
+  // start_, num_states_ and num_arcs_.
+  void ReadHeader(std::istream &is);
+
+  // Makes *this an empty FST, unmapping any mapped file.
+  void Clear();
+
+  // Returns the total size in bytes of the arrays, as written to disk.
+  size_t ArraysSize() const;
+
+  // Makes the pointers point to the data in the *_storage_ vectors.
+  void SetPointers();
+
+  // Makes the pointers point to 'data', which is the arrays in the on-disk
+  // format.
+  void SetPointers(const char *data);
+
+  // Checks that the data is consistent, so that a corrupt or truncated file
+  // gives an error here rather than out-of-range accesses when decoding: that
+  // the start state is valid, the arc offsets are in order and within the arc
+  // array, each arc's nextstate is a valid state, and num_input_eps_ is right.
+  // Throws if not.  Takes time linear in the size of the FST.
+  void Check() const;
+
+  StateId start_;
+  StateId num_states_;
+  size_t num_arcs_;
+
+  // The following point either into the *_storage_ vectors below, or into
+  // mapped_file_.
+  // final_costs_[s] is the final cost of state s (infinity if not final).
+  const float *final_costs_;
+  // Dimension NumStates() + 1; see the class comment.
+  const uint32 *arc_offsets_;
+  // Dimension NumStates(); see the class comment.
+  const uint32 *num_input_eps_;
+  // Dimension NumArcs().
+  const Arc *arcs_;
+
+  std::vector<float> final_costs_storage_;
+  std::vector<uint32> arc_offsets_storage_;
+  std::vector<uint32> num_input_eps_storage_;
+  std::vector<Arc> arcs_storage_;
+
+  kaldi::MappedFile mapped_file_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CsrFst);
+};
+
+
+/**
+   This is the overridden template for class ArcIterator for CsrFst.  It
+   visits the arcs of the state in the order of the input FST.
+ */
+template <>
+class ArcIterator<CsrFst> {
+ public:
+  typedef CsrFst::Arc Arc;
+  typedef CsrFst::StateId StateId;
+
+  inline ArcIterator(const CsrFst &fst, StateId s):
+      arcs_(fst.arcs_ + fst.arc_offsets_[s]),
+      narcs_(fst.arc_offsets_[s + 1] - fst.arc_offsets_[s]), i_(0) { }
+
+  inline bool Done() const { return i_ >= narcs_; }
+
+  inline void Next() { i_++; }
+
+  inline const Arc &Value() const { return arcs_[i_]; }
+
+  inline void Reset() { i_ = 0; }
+
+  inline void Seek(size_t a) { i_ = a; }
+
+  inline size_t Position() const { return i_; }
+
+ private:
+  const Arc *arcs_;
+  size_t narcs_;
+  size_t i_;
+};
+
+}  // namespace fst
+
+#endif  // KALDI_FSTEXT_CSR_FST_H_
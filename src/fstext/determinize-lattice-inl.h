@@ -59,10 +59,9 @@ template<class IntType> class LatticeStringRepository {
 
     std::pair<typename SetType::iterator, bool> pr = set_.insert(new_entry_);
     if (pr.second) { // Was successfully inserted (was not there).  We need to
-                     // replace the element we inserted, which resides on the
-                     // stack, with one from the heap.
+                     // replace the element we inserted with a new one.
       const Entry *ans = new_entry_;
-      new_entry_ = new Entry();
+      new_entry_ = NewEntry();
       return ans;
     } else { // Was not inserted because an equivalent Entry already
              // existed.
@@ -166,19 +165,31 @@ template<class IntType> class LatticeStringRepository {
     return e;
   }
 
-  LatticeStringRepository() { new_entry_ = new Entry; }
+  LatticeStringRepository(): cur_block_(0), next_in_block_(0) {
+    new_entry_ = NewEntry();
+  }
 
   void Destroy() {
-    for (typename SetType::iterator iter = set_.begin();
-         iter != set_.end();
-         ++iter)
-      delete *iter;
+    for (size_t i = 0; i < blocks_.size(); i++)
+      delete [] blocks_[i];
+    { std::vector<Entry*> tmp; tmp.swap(blocks_); }
+    { std::vector<Entry*> tmp; tmp.swap(free_entries_); }
     SetType tmp;
     tmp.swap(set_);
-    if (new_entry_) {
-      delete new_entry_;
-      new_entry_ = NULL;
-    }
+    cur_block_ = 0;
+    next_in_block_ = 0;
+    new_entry_ = NULL;
+  }
+
+  // Forgets all strings, but keeps the memory (the entries and the buckets of
+  // the hash), so that the repository can be reused without allocating
+  // anything.  Also makes the repository usable again after Destroy().
+  void Clear() {
+    set_.clear();
+    free_entries_.clear();
+    cur_block_ = 0;
+    next_in_block_ = 0;
+    new_entry_ = NewEntry();
   }
 
   // Rebuild will rebuild this object, guaranteeing only
@@ -191,11 +202,11 @@ template<class IntType> class LatticeStringRepository {
              iter = to_keep.begin();
          iter != to_keep.end(); ++iter)
       RebuildHelper(*iter, &tmp_set);
-    // Now delete all elems not in tmp_set.
+    // Now free all elems not in tmp_set.
     for (typename SetType::iterator iter = set_.begin();
          iter != set_.end(); ++iter) {
-      if (tmp_set.count(*iter) == 0)
-        delete (*iter); // delete the Entry; not needed.
+      if (tmp_set.count(*iter) == 0)  // the Entry is not needed.
+        free_entries_.push_back(const_cast<Entry*>(*iter));
     }
     set_.swap(tmp_set);
   }
@@ -235,11 +246,35 @@ template<class IntType> class LatticeStringRepository {
     }
   }
 
+  // Entries are allocated in blocks of this size, and are never freed
+  // individually, only put on free_entries_.
+  static const size_t kBlockSize = 1024;
+
+  Entry *NewEntry() {
+    if (!free_entries_.empty()) {
+      Entry *ans = free_entries_.back();
+      free_entries_.pop_back();
+      return ans;
+    }
+    if (next_in_block_ == kBlockSize) {
+      cur_block_++;
+      next_in_block_ = 0;
+    }
+    if (cur_block_ == blocks_.size())
+      blocks_.push_back(new Entry[kBlockSize]);
+    return blocks_[cur_block_] + next_in_block_++;
+  }
+
   KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeStringRepository);
   Entry *new_entry_; // We always have a pre-allocated Entry ready to use,
                      // to avoid unnecessary news and deletes.
   SetType set_;
 
+  std::vector<Entry*> blocks_;  // Owned here; each has kBlockSize entries.
+  size_t cur_block_;  // The block entries are being allocated from...
+  size_t next_in_block_;  // ... and the index of the next one in it.
+  std::vector<Entry*> free_entries_;  // Entries freed by Rebuild().
+
 };
 
 
@@ -91,6 +91,7 @@ template<class Label, class StringId> class StringRepository {
     else if (id>=single_symbol_start) {
       v->resize(1); (*v)[0] = id - single_symbol_start;
     } else {
+      std::lock_guard<std::mutex> lock(mutex_);
       assert(static_cast<size_t>(id) < vec_.size());
       *v = *(vec_[id]);
     }
@@ -132,6 +133,7 @@ template<class Label, class StringId> class StringRepository {
   KALDI_DISALLOW_COPY_AND_ASSIGN(StringRepository);
 
   StringId IdOfSeqInternal(const std::vector<Label> &v) {
+    std::lock_guard<std::mutex> lock(mutex_);
     typename MapType::iterator iter = map_.find(&v);
     if (iter != map_.end()) {
       return iter->second;
@@ -147,6 +149,10 @@ template<class Label, class StringId> class StringRepository {
 
   std::vector<std::vector<Label>* > vec_;
   MapType map_;
+  // Guards vec_ and map_, since the multi-threaded version of DeterminizeStar
+  // uses one repository from several threads.  Strings of length zero and one
+  // do not need it.
+  std::mutex mutex_;
 
   static const StringId string_start = (StringId) 0;  // This must not change.  It's assumed.
   StringId string_end;  // = (numeric_limits<StringId>::max() / 2) - 1; // all hash values must be <= this.
@@ -173,11 +179,17 @@ template<class F> class DeterminizerStar {
 
   // Initializer.  After initializing the object you will typically call
   // Determinize() and then one of the Output functions.
+  // If 'arena' is non-NULL, the subsets and the arcs of finished output
+  // states are stored in it instead of in separately allocated vectors.  If
+  // num_threads > 1, subsets are expanded in parallel.  (See the
+  // documentation of DeterminizeStar()).
   DeterminizerStar(const Fst<Arc> &ifst, float delta = kDelta,
-                   int max_states = -1, bool allow_partial = false):
+                   int max_states = -1, bool allow_partial = false,
+                   kaldi::MappedArena *arena = NULL, int num_threads = 1):
       ifst_(ifst.Copy()), delta_(delta), max_states_(max_states),
       determinized_(false), allow_partial_(allow_partial),
-      is_partial_(false), equal_(delta),
+      is_partial_(false), arena_(arena), num_threads_(num_threads),
+      pool_(NULL), equal_(delta),
       hash_(ifst.Properties(kExpanded, false) ?
               down_cast<const ExpandedFst<Arc>*,
               const Fst<Arc> >(&ifst)->NumStates()/2 + 3 : 20,
@@ -201,9 +213,14 @@ template<class F> class DeterminizerStar {
       assert(cur_id == 0 && "Do not call Determinize twice.");
     }
     while (!Q_.empty()) {
-      std::pair<std::vector<Element>*, OutputStateId> cur_pair = Q_.front();
-      Q_.pop_front();
-      ProcessSubset(cur_pair);
+      if (num_threads_ > 1) {
+        ProcessBatch();
+      } else {
+        std::pair<Subset, OutputStateId> cur_pair = Q_.front();
+        Q_.pop_front();
+        ProcessSubset(cur_pair);
+        if (arena_ != NULL) SpillArcs(cur_pair.second);
+      }
       if (debug_ptr && *debug_ptr) Debug();  // will exit.
       if (max_states_ > 0 && output_arcs_.size() > max_states_) {
         if (allow_partial_ == false) {
@@ -227,13 +244,16 @@ template<class F> class DeterminizerStar {
   // frees all except output_arcs_, which contains the important info
   // we need to output.
   void FreeMostMemory() {
+    FreeThreads();
     if (ifst_) {
       delete ifst_;
       ifst_ = NULL;
     }
-    for (typename SubsetHash::iterator iter = hash_.begin();
-        iter != hash_.end(); ++iter)
-      delete iter->first;
+    if (arena_ == NULL) {  // else the subsets are in the arena.
+      for (typename SubsetHash::iterator iter = hash_.begin();
+           iter != hash_.end(); ++iter)
+        delete [] iter->first.elems;
+    }
     SubsetHash tmp;
     tmp.swap(hash_);
   }
@@ -271,9 +291,46 @@ template<class F> class DeterminizerStar {
     Weight weight;
   };
 
+  // A subset as stored in hash_ and Q_: 'size' Elements starting at 'elems',
+  // owned by this class (allocated with new [], or from arena_ if set).  To
+  // look up a subset held in a std::vector, we construct a Subset that points
+  // to its data.
+  struct Subset {
+    const Element *elems;
+    size_t size;
+    Subset(const Element *e, size_t s): elems(e), size(s) { }
+  };
+
+  // Copies 'subset' to memory owned by this class.
+  Subset NewSubset(const std::vector<Element> &subset) {
+    size_t size = subset.size();
+    Element *elems;
+    if (arena_ != NULL) {
+      // Element is trivially destructible for the weight types we use, so
+      // never calling its destructor (arena memory is freed in bulk) is OK.
+      elems = static_cast<Element*>(arena_->Allocate(size * sizeof(Element)));
+      std::uninitialized_copy(subset.begin(), subset.end(), elems);
+    } else {
+      elems = new Element[size];
+      std::copy(subset.begin(), subset.end(), elems);
+    }
+    return Subset(elems, size);
+  }
+
+  // The result of expanding a subset (see ExpandSubset()): the arcs out of
+  // output-state 'state', whose nextstates (except for the final-weight, which
+  // if present is the first "arc") are filled in by CommitSubset() from the
+  // corresponding destination subsets.
+  struct ExpandedSubset {
+    OutputStateId state;
+    bool is_final;
+    std::vector<TempArc> arcs;
+    std::vector<std::vector<Element> > dest_subsets;
+    ExpandedSubset(): state(kNoStateId), is_final(false) { }
+  };
 
   // Hashing function used in hash of subsets.
-  // A subset is a pointer to vector<Element>.
+  // A subset is a pointer to an array of Elements, and its size.
   // The Elements are in sorted order on state id, and without repeated states.
   // Because the order of Elements is fixed, we can use a hashing function that is
   // order-dependent.  However the weights are not included in the hashing function--
@@ -287,10 +344,10 @@ template<class F> class DeterminizerStar {
 
   class SubsetKey {
    public:
-    size_t operator ()(const std::vector<Element> * subset) const {  // hashes only the state and string.
+    size_t operator ()(const Subset &subset) const {  // hashes only the state and string.
       size_t hash = 0, factor = 1;
-      for (typename std::vector<Element>::const_iterator iter = subset->begin();
-           iter != subset->end(); ++iter) {
+      for (const Element *iter = subset.elems, *end = subset.elems + subset.size;
+           iter != end; ++iter) {
         hash *= factor;
         hash += iter->state + 103333 * iter->string;
         factor *= 23531;  // these numbers are primes.
@@ -303,13 +360,11 @@ template<class F> class DeterminizerStar {
   // and string, and approximate match on weights.
   class SubsetEqual {
    public:
-    bool operator ()(const std::vector<Element> *s1,
-                     const std::vector<Element> *s2) const {
-      size_t sz = s1->size();
-      assert(sz >= 0);
-      if (sz != s2->size()) return false;
-      typename std::vector<Element>::const_iterator iter1 = s1->begin(),
-          iter1_end = s1->end(), iter2 = s2->begin();
+    bool operator ()(const Subset &s1, const Subset &s2) const {
+      size_t sz = s1.size;
+      if (sz != s2.size) return false;
+      const Element *iter1 = s1.elems, *iter1_end = s1.elems + sz,
+          *iter2 = s2.elems;
       for (; iter1 < iter1_end; ++iter1, ++iter2) {
         if (iter1->state != iter2->state ||
            iter1->string != iter2->string ||
@@ -327,12 +382,11 @@ template<class F> class DeterminizerStar {
   // Used only for debug.
   class SubsetEqualStates {
    public:
-    bool operator ()(const std::vector<Element> *s1, const std::vector<Element> *s2) const {
-      size_t sz = s1->size();
-      assert(sz>=0);
-      if (sz != s2->size()) return false;
-      typename std::vector<Element>::const_iterator iter1 = s1->begin(),
-          iter1_end = s1->end(), iter2=s2->begin();
+    bool operator ()(const Subset &s1, const Subset &s2) const {
+      size_t sz = s1.size;
+      if (sz != s2.size) return false;
+      const Element *iter1 = s1.elems, *iter1_end = s1.elems + sz,
+          *iter2 = s2.elems;
       for (; iter1 < iter1_end; ++iter1, ++iter2) {
         if (iter1->state != iter2->state) return false;
       }
@@ -341,7 +395,7 @@ template<class F> class DeterminizerStar {
   };
 
   // Define the hash type we use to store subsets.
-  typedef unordered_map<const std::vector<Element>*, OutputStateId, SubsetKey, SubsetEqual> SubsetHash;
+  typedef unordered_map<Subset, OutputStateId, SubsetKey, SubsetEqual> SubsetHash;
 
   class EpsilonClosure {
    public:
@@ -355,8 +409,8 @@ template<class F> class DeterminizerStar {
     // This function computes epsilon closure of subset of states by following epsilon links.
     // Called by ProcessSubset.
     // Has no side effects except on the repository.
-    void GetEpsilonClosure(const std::vector<Element> &input_subset,
-                        std::vector<Element> *output_subset);
+    void GetEpsilonClosure(const Subset &input_subset,
+                           std::vector<Element> *output_subset);
 
    private:
     struct EpsilonClosureInfo {
@@ -429,10 +483,12 @@ template<class F> class DeterminizerStar {
 
 
   // This function works out the final-weight of the determinized state.
-  // called by ProcessSubset.
-  // Has no side effects except on the variable repository_, and output_arcs_.
+  // called by ExpandSubset.
+  // Has no side effects except on the variable repository_, and "expanded".
 
-  void ProcessFinal(const std::vector<Element> &closed_subset, OutputStateId state) {
+  void ProcessFinal(const Fst<Arc> &ifst,
+                    const std::vector<Element> &closed_subset,
+                    ExpandedSubset *expanded) {
     // processes final-weights for this subset.
     bool is_final = false;
     StringId final_string = 0;  // = 0 to keep compiler happy.
@@ -444,7 +500,7 @@ template<class F> class DeterminizerStar {
         end = closed_subset.end();
     for (; iter != end; ++iter) {
       const Element &elem = *iter;
-      Weight this_final_weight = ifst_->Final(elem.state);
+      Weight this_final_weight = ifst.Final(elem.state);
       if (this_final_weight != Weight::Zero()) {
         if (!is_final) {  // first final-weight
           final_string = elem.string;
@@ -465,14 +521,16 @@ template<class F> class DeterminizerStar {
       temp_arc.nextstate = kNoStateId;  // special marker meaning "final weight".
       temp_arc.ostring = final_string;
       temp_arc.weight = final_weight;
-      output_arcs_[state].push_back(temp_arc);
+      expanded->arcs.push_back(temp_arc);
+      expanded->is_final = true;
     }
   }
 
   // ProcessTransition is called from "ProcessTransitions".  Broken out for
-  // clarity.  Has side effects on output_arcs_, and (via SubsetToStateId), Q_
-  // and hash_.
-  void ProcessTransition(OutputStateId state, Label ilabel, std::vector<Element> *subset);
+  // clarity.  Has side effects on "expanded" (and on the repository), and
+  // swaps the normalized subset into it.
+  void ProcessTransition(Label ilabel, std::vector<Element> *subset,
+                         ExpandedSubset *expanded);
 
   // "less than" operator for pair<Label, Element>.   Used in ProcessTransitions.
   // Lexicographical order, with comparing the state only for "Element".
@@ -496,9 +554,10 @@ template<class F> class DeterminizerStar {
   // Does this by creating a big vector of pairs <Label, Element> and then sorting them
   // using a lexicographical ordering, and calling ProcessTransition for each range
   // with the same ilabel.
-  // Side effects on repository, and (via ProcessTransition) on Q_, hash_,
-  // and output_arcs_.
-  void ProcessTransitions(const std::vector<Element> &closed_subset, OutputStateId state) {
+  // Side effects on repository, and (via ProcessTransition) on "expanded".
+  void ProcessTransitions(const Fst<Arc> &ifst,
+                          const std::vector<Element> &closed_subset,
+                          ExpandedSubset *expanded) {
     std::vector<std::pair<Label, Element> > all_elems;
     {  // Push back into "all_elems", elements corresponding to all non-epsilon-input transitions
       // out of all states in "closed_subset".
@@ -506,7 +565,7 @@ template<class F> class DeterminizerStar {
           end = closed_subset.end();
       for (; iter != end; ++iter) {
         const Element &elem = *iter;
-        for (ArcIterator<Fst<Arc> > aiter(*ifst_, elem.state);
+        for (ArcIterator<Fst<Arc> > aiter(ifst, elem.state);
              !aiter.Done(); aiter.Next()) {
           const Arc &arc = aiter.Value();
           if (arc.ilabel != 0) {  // Non-epsilon transition -- ignore epsilons here.
@@ -544,7 +603,7 @@ template<class F> class DeterminizerStar {
         cur++;
       }
       // We now have a subset for this ilabel.
-      ProcessTransition(state, ilabel, &this_subset);
+      ProcessTransition(ilabel, &this_subset, expanded);
     }
   }
 
@@ -554,23 +613,23 @@ template<class F> class DeterminizerStar {
   // Side effects on hash_ and Q_, and on output_arcs_ [just affects the size].
   OutputStateId SubsetToStateId(const std::vector<Element> &subset) {  // may add the subset to the queue.
     typedef typename SubsetHash::iterator IterType;
-    IterType iter = hash_.find(&subset);
+    IterType iter = hash_.find(Subset(subset.data(), subset.size()));
     if (iter == hash_.end()) {  // was not there.
-      std::vector<Element> *new_subset = new std::vector<Element>(subset);
+      Subset new_subset = NewSubset(subset);
       OutputStateId new_state_id = (OutputStateId) output_arcs_.size();
-      bool ans = hash_.insert(std::pair<const std::vector<Element>*,
+      bool ans = hash_.insert(std::pair<const Subset,
                                         OutputStateId>(new_subset,
                                                        new_state_id)).second;
       assert(ans);
       output_arcs_.push_back(std::vector<TempArc>());
       if (allow_partial_ == false) {
         // If --allow-partial is not requested, we do the old way.
-        Q_.push_front(std::pair<std::vector<Element>*, OutputStateId>(new_subset,  new_state_id));
+        Q_.push_front(std::pair<Subset, OutputStateId>(new_subset,  new_state_id));
       } else {
         // If --allow-partial is requested, we do breadth first search. This
         // ensures that when we return partial results, we return the states
         // that are reachable by the fewest steps from the start state.
-        Q_.push_back(std::pair<std::vector<Element>*, OutputStateId>(new_subset,  new_state_id));
+        Q_.push_back(std::pair<Subset, OutputStateId>(new_subset,  new_state_id));
       }
       return new_state_id;
     } else {
@@ -579,32 +638,147 @@ template<class F> class DeterminizerStar {
   }
 
 
-  // ProcessSubset does the processing of a determinized state, i.e. it creates
-  // transitions out of it and adds new determinized states to the queue if necessary.
+  // ExpandSubset does the processing of a determinized state, i.e. it works
+  // out the transitions out of it, and the subsets they lead to.
   // The first stage is "EpsilonClosure" (follow epsilons to get a possibly larger set
   // of (states, weights)).  After that we ignore epsilons.  We process the final-weight
-  // of the state, and then handle transitions out (this may add more determinized states
-  // to the queue).
-  void ProcessSubset(const std::pair<std::vector<Element>*, OutputStateId> & pair) {
-    const std::vector<Element> *subset = pair.first;
-    OutputStateId state = pair.second;
-
+  // of the state, and then handle transitions out.  The only side effects are
+  // on the repository (which is thread-safe) and on "expanded", so with a
+  // separate 'ifst' and 'epsilon_closure' per thread this may be called from
+  // several threads at once.
+  void ExpandSubset(const Subset &subset, const Fst<Arc> &ifst,
+                    EpsilonClosure *epsilon_closure,
+                    ExpandedSubset *expanded) {
     std::vector<Element> closed_subset;  // subset after epsilon closure.
-    epsilon_closure_.GetEpsilonClosure(*subset, &closed_subset);
+    epsilon_closure->GetEpsilonClosure(subset, &closed_subset);
 
     // Now follow non-epsilon arcs [and also process final states]
-    ProcessFinal(closed_subset, state);
+    ProcessFinal(ifst, closed_subset, expanded);
 
     // Now handle transitions out of these states.
-    ProcessTransitions(closed_subset, state);
+    ProcessTransitions(ifst, closed_subset, expanded);
+  }
+
+  // CommitSubset adds the arcs worked out by ExpandSubset to output_arcs_,
+  // converting the destination subsets to state-ids (this may add new
+  // states to the queue).  Side effects on hash_, Q_ and output_arcs_.
+  void CommitSubset(ExpandedSubset *expanded) {
+    std::vector<TempArc> &arcs = expanded->arcs;
+    size_t offset = (expanded->is_final ? 1 : 0);
+    KALDI_ASSERT(arcs.size() == offset + expanded->dest_subsets.size());
+    for (size_t i = offset; i < arcs.size(); i++)
+      arcs[i].nextstate = SubsetToStateId(expanded->dest_subsets[i - offset]);
+    output_arcs_[expanded->state].swap(arcs);
+  }
+
+  // ProcessSubset processes one determinized state: it creates transitions
+  // out of it and adds new determinized states to the queue if necessary.
+  void ProcessSubset(const std::pair<Subset, OutputStateId> & pair) {
+    ExpandedSubset expanded;
+    expanded.state = pair.second;
+    ExpandSubset(pair.first, *ifst_, &epsilon_closure_, &expanded);
+    CommitSubset(&expanded);
+  }
+
+  // ProcessBatch is the multi-threaded version of ProcessSubset: it takes
+  // a batch of subsets from the front of the queue, expands them in parallel
+  // and then commits them, in order, in this thread.  The states are numbered
+  // differently from the single-threaded version, but the result is
+  // equivalent.
+  void ProcessBatch() {
+    if (pool_ == NULL) InitThreads();
+    size_t batch_size = std::min(Q_.size(),
+                                 static_cast<size_t>(num_threads_) * 16);
+    std::vector<std::pair<Subset, OutputStateId> > batch(
+        Q_.begin(), Q_.begin() + batch_size);
+    Q_.erase(Q_.begin(), Q_.begin() + batch_size);
+    std::vector<ExpandedSubset> expanded(batch_size);
+    // Errors (e.g. a non-functional FST) are rethrown from this thread.
+    std::vector<std::exception_ptr> errors(num_threads_);
+    for (int t = 0; t < num_threads_; t++) {
+      pool_->Submit([this, t, batch_size, &batch, &expanded, &errors]() {
+          try {
+            for (size_t i = t; i < batch_size; i += num_threads_) {
+              expanded[i].state = batch[i].second;
+              ExpandSubset(batch[i].first, *(thread_ifsts_[t]),
+                           thread_closures_[t], &(expanded[i]));
+            }
+          } catch (...) {
+            errors[t] = std::current_exception();
+          }
+        });
+    }
+    pool_->Wait();
+    for (int t = 0; t < num_threads_; t++)
+      if (errors[t]) std::rethrow_exception(errors[t]);
+    for (size_t i = 0; i < batch_size; i++) {
+      CommitSubset(&(expanded[i]));
+      if (arena_ != NULL) SpillArcs(expanded[i].state);
+    }
+  }
+
+  // Creates the thread pool, and a copy of the input FST (a thread-safe
+  // copy, in case it is computed on demand) and an EpsilonClosure object for
+  // each thread.
+  void InitThreads() {
+    pool_ = new kaldi::ThreadPool(num_threads_);
+    for (int t = 0; t < num_threads_; t++) {
+      const Fst<Arc> *ifst = ifst_->Copy(true);
+      thread_ifsts_.push_back(ifst);
+      thread_closures_.push_back(new EpsilonClosure(ifst, max_states_,
+                                                    &repository_, delta_));
+    }
+  }
+
+  void FreeThreads() {
+    delete pool_;
+    pool_ = NULL;
+    for (size_t t = 0; t < thread_ifsts_.size(); t++) {
+      delete thread_closures_[t];
+      delete thread_ifsts_[t];
+    }
+    thread_closures_.clear();
+    thread_ifsts_.clear();
+  }
+
+  // Called (if arena_ != NULL) when we have finished processing 'state': moves
+  // its arcs from output_arcs_ to the arena.
+  void SpillArcs(OutputStateId state) {
+    std::vector<TempArc> &arcs = output_arcs_[state];
+    if (spilled_arcs_.size() <= static_cast<size_t>(state))
+      spilled_arcs_.resize(state + 1, std::pair<const TempArc*, size_t>(NULL, 0));
+    if (arcs.empty()) return;
+    TempArc *data = static_cast<TempArc*>(
+        arena_->Allocate(arcs.size() * sizeof(TempArc)));
+    std::uninitialized_copy(arcs.begin(), arcs.end(), data);
+    spilled_arcs_[state] = std::pair<const TempArc*, size_t>(data, arcs.size());
+    std::vector<TempArc> temp;
+    temp.swap(arcs);
+  }
+
+  // Outputs the range of arcs of output-state 'state', which are either in
+  // output_arcs_ or (if they were moved by SpillArcs()) in spilled_arcs_.
+  void GetArcs(OutputStateId state, const TempArc **begin,
+               const TempArc **end) const {
+    if (static_cast<size_t>(state) < spilled_arcs_.size() &&
+        spilled_arcs_[state].second != 0) {
+      *begin = spilled_arcs_[state].first;
+      *end = *begin + spilled_arcs_[state].second;
+    } else {
+      const std::vector<TempArc> &arcs = output_arcs_[state];
+      *begin = arcs.data();
+      *end = arcs.data() + arcs.size();
+    }
   }
 
   void Debug();
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(DeterminizerStar);
-  std::deque<std::pair<std::vector<Element>*, OutputStateId> > Q_;  // queue of subsets to be processed.
+  std::deque<std::pair<Subset, OutputStateId> > Q_;  // queue of subsets to be processed.
 
   std::vector<std::vector<TempArc> > output_arcs_;  // essentially an FST in our format.
+  // Only used if arena_ != NULL: the arcs of finished states, in the arena.
+  std::vector<std::pair<const TempArc*, size_t> > spilled_arcs_;
 
   const Fst<Arc> *ifst_;
   float delta_;
@@ -612,6 +786,12 @@ template<class F> class DeterminizerStar {
   bool determinized_; // used to check usage.
   bool allow_partial_;  // output paritial results or not
   bool is_partial_;     // if we get partial results or not
+  kaldi::MappedArena *arena_;  // not owned; may be NULL.
+  int num_threads_;
+  // The following are only used if num_threads_ > 1.
+  kaldi::ThreadPool *pool_;
+  std::vector<const Fst<Arc>*> thread_ifsts_;
+  std::vector<EpsilonClosure*> thread_closures_;
   SubsetKey hasher_;  // object that computes keys-- has no data members.
   SubsetEqual equal_;  // object that compares subsets-- only data member is delta_.
   SubsetHash hash_;  // hash from Subset to StateId in final Fst.
@@ -624,10 +804,12 @@ template<class F> class DeterminizerStar {
 template<class F>
 bool DeterminizeStar(F &ifst, MutableFst<typename F::Arc> *ofst,
                      float delta, bool *debug_ptr, int max_states,
-                     bool allow_partial) {
+                     bool allow_partial, kaldi::MappedArena *arena,
+                     int num_threads) {
   ofst->SetOutputSymbols(ifst.OutputSymbols());
   ofst->SetInputSymbols(ifst.InputSymbols());
-  DeterminizerStar<F> det(ifst, delta, max_states, allow_partial);
+  DeterminizerStar<F> det(ifst, delta, max_states, allow_partial, arena,
+                          num_threads);
   det.Determinize(debug_ptr);
   det.Output(ofst);
   return det.IsPartial();
@@ -638,10 +820,12 @@ template<class F>
 bool DeterminizeStar(F &ifst,
                      MutableFst<GallicArc<typename F::Arc> > *ofst, float delta,
                      bool *debug_ptr, int max_states,
-                     bool allow_partial) {
+                     bool allow_partial, kaldi::MappedArena *arena,
+                     int num_threads) {
   ofst->SetOutputSymbols(ifst.InputSymbols());
   ofst->SetInputSymbols(ifst.InputSymbols());
-  DeterminizerStar<F> det(ifst, delta, max_states, allow_partial);
+  DeterminizerStar<F> det(ifst, delta, max_states, allow_partial, arena,
+                          num_threads);
   det.Determinize(debug_ptr);
   det.Output(ofst);
   return det.IsPartial();
@@ -649,10 +833,11 @@ bool DeterminizeStar(F &ifst,
 
 template<class F>
 void DeterminizerStar<F>::EpsilonClosure::
-            GetEpsilonClosure(const std::vector<Element> &input_subset,
-                                       std::vector<Element> *output_subset) {
+            GetEpsilonClosure(const Subset &subset,
+                              std::vector<Element> *output_subset) {
   ecinfo_.resize(0);
-  size_t size = input_subset.size();
+  const Element *input_subset = subset.elems;
+  size_t size = subset.size;
   // find whether input fst is known to be sorted in input label.
   bool sorted =
           ((ifst_->Properties(kILabelSorted, false) & kILabelSorted) != 0);
@@ -664,7 +849,7 @@ void DeterminizerStar<F>::EpsilonClosure::
 
   size_t s = queue_2_.size();
   if (s == 0) {
-    *output_subset = input_subset;
+    output_subset->assign(input_subset, input_subset + size);
     return;
   } else {
     // queue_2 not empty. Need to create the vector<info>
@@ -880,9 +1065,8 @@ void DeterminizerStar<F>::Output(MutableFst<GallicArc<Arc> > *ofst,
   ofst->SetStart(0);
   // now process transitions.
   for (StateId this_state = 0; this_state < nStates; this_state++) {
-    std::vector<TempArc> &this_vec(output_arcs_[this_state]);
-    typename std::vector<TempArc>::const_iterator iter = this_vec.begin(),
-        end = this_vec.end();
+    const TempArc *iter, *end;
+    GetArcs(this_state, &iter, &end);
     for (; iter != end; ++iter) {
       const TempArc &temp_arc(*iter);
       GallicArc<Arc> new_arc;
@@ -903,9 +1087,14 @@ void DeterminizerStar<F>::Output(MutableFst<GallicArc<Arc> > *ofst,
       }
     }
     // Free up memory.  Do this inside the loop as ofst is also allocating memory
-    if (destroy) { std::vector<TempArc> temp; temp.swap(this_vec); }
+    if (destroy) { std::vector<TempArc> temp; temp.swap(output_arcs_[this_state]); }
+  }
+  if (destroy) {
+    std::vector<std::vector<TempArc> > temp;
+    temp.swap(output_arcs_);
+    std::vector<std::pair<const TempArc*, size_t> > temp2;
+    temp2.swap(spilled_arcs_);
   }
-  if (destroy) { std::vector<std::vector<TempArc> > temp; temp.swap(output_arcs_); }
 }
 
 template<class F>
@@ -928,10 +1117,8 @@ void DeterminizerStar<F>::Output(MutableFst<Arc> *ofst, bool destroy) {
   }
   ofst->SetStart(0);
   for (OutputStateId this_state = 0; this_state < num_states; this_state++) {
-    std::vector<TempArc> &this_vec(output_arcs_[this_state]);
-
-    typename std::vector<TempArc>::const_iterator iter = this_vec.begin(),
-        end = this_vec.end();
+    const TempArc *iter, *end;
+    GetArcs(this_state, &iter, &end);
     for (; iter != end; ++iter) {
       const TempArc &temp_arc(*iter);
       std::vector<Label> seq;
@@ -976,17 +1163,20 @@ void DeterminizerStar<F>::Output(MutableFst<Arc> *ofst, bool destroy) {
       }
     }
     // Free up memory.  Do this inside the loop as ofst is also allocating memory
-    if (destroy) { std::vector<TempArc> temp; temp.swap(this_vec); }
+    if (destroy) { std::vector<TempArc> temp; temp.swap(output_arcs_[this_state]); }
   }
   if (destroy) {
     std::vector<std::vector<TempArc> > temp;
     temp.swap(output_arcs_);
+    std::vector<std::pair<const TempArc*, size_t> > temp2;
+    temp2.swap(spilled_arcs_);
     repository_.Destroy();
   }
 }
 
 template<class F> void DeterminizerStar<F>::
-ProcessTransition(OutputStateId state, Label ilabel, std::vector<Element> *subset) {
+ProcessTransition(Label ilabel, std::vector<Element> *subset,
+                  ExpandedSubset *expanded) {
   // At input, "subset" may contain duplicates for a given dest state (but in sorted
   // order).  This function removes duplicates from "subset", normalizes it, and adds
   // a transition to the dest. state (possibly affecting Q_ and hash_, if state did not
@@ -1054,14 +1244,16 @@ ProcessTransition(OutputStateId state, Label ilabel, std::vector<Element> *subse
     }
   }
 
-  // Now add an arc to the state that the subset represents.
-  // We may create a new state id for this (in SubsetToStateId).
+  // Now add an arc to the state that the subset represents.  Its nextstate
+  // is filled in by CommitSubset() (we may create a new state id for it).
   TempArc temp_arc;
   temp_arc.ilabel = ilabel;
-  temp_arc.nextstate = SubsetToStateId(*subset);  // may or may not really add the subset.
+  temp_arc.nextstate = kNoStateId;
   temp_arc.ostring = common_str;
   temp_arc.weight = tot_weight;
-  output_arcs_[state].push_back(temp_arc);  // record the arc.
+  expanded->arcs.push_back(temp_arc);  // record the arc.
+  expanded->dest_subsets.push_back(std::vector<Element>());
+  expanded->dest_subsets.back().swap(*subset);
 }
 
 template<class F>
@@ -1083,8 +1275,10 @@ void DeterminizerStar<F>::Debug() {
 
   std::vector<OutputStateId> predecessor(max_state+1, kNoStateId);
   for (size_t i = 0; i < max_state; i++) {
-    for (size_t j = 0; j < output_arcs_[i].size(); j++) {
-      OutputStateId nextstate = output_arcs_[i][j].nextstate;
+    const TempArc *begin, *end;
+    GetArcs(i, &begin, &end);
+    for (const TempArc *arc = begin; arc != end; ++arc) {
+      OutputStateId nextstate = arc->nextstate;
       // Always find an earlier-numbered predecessor; this
       // is always possible because of the way the algorithm
       // works.
@@ -1099,16 +1293,17 @@ void DeterminizerStar<F>::Debug() {
   while (cur_state != 0 && cur_state != kNoStateId) {
     OutputStateId last_state = predecessor[cur_state];
     std::pair<Label, StringId> p;
-    size_t i;
-    for (i = 0; i < output_arcs_[last_state].size(); i++) {
-      if (output_arcs_[last_state][i].nextstate == cur_state) {
-        p.first = output_arcs_[last_state][i].ilabel;
-        p.second = output_arcs_[last_state][i].ostring;
+    const TempArc *arc, *end;
+    GetArcs(last_state, &arc, &end);
+    for (; arc != end; ++arc) {
+      if (arc->nextstate == cur_state) {
+        p.first = arc->ilabel;
+        p.second = arc->ostring;
         traceback.push_back(p);
         break;
       }
     }
-    KALDI_ASSERT(i != output_arcs_[last_state].size());  // Or fell off loop.
+    KALDI_ASSERT(arc != end);  // Or fell off loop.
     cur_state = last_state;
   }
   if (cur_state == kNoStateId)
@@ -57,6 +57,33 @@ template<class Arc> void TestDeterminizeGeneral() {
 }
 
 
+// test that multi-threaded determinization, and determinization that stores
+// its subsets in a file-backed arena, give equivalent results to the normal
+// version.
+template<class Arc> void TestDeterminizeThreaded() {
+  int max_states = 100; // don't allow more det-states than this.
+  for(int i = 0; i < 50; i++) {
+    VectorFst<Arc> *fst = RandFst<Arc>();
+    VectorFst<Arc> ofst, ofst_threaded;
+    bool ok = true;
+    try {
+      DeterminizeStar<Fst<Arc> >(*fst, &ofst, kDelta, NULL, max_states);
+    } catch (...) {
+      ok = false;  // probably not determinizable.
+    }
+    if (ok) {
+      kaldi::MappedArena arena(kaldi::Rand() % 2 == 0 ? "" : ".");
+      int num_threads = 2 + kaldi::Rand() % 3;
+      DeterminizeStar<Fst<Arc> >(*fst, &ofst_threaded, kDelta, NULL,
+                                 max_states, false, &arena, num_threads);
+      assert(RandEquivalent(ofst, ofst_threaded, 5/*paths*/, 0.01/*delta*/,
+                            kaldi::Rand()/*seed*/, 100/*path length, max*/));
+    }
+    delete fst;
+  }
+}
+
+
 // Don't instantiate with log semiring, as RandEquivalent may fail.
 template<class Arc>  void TestDeterminize() {
   typedef typename Arc::Label Label;
@@ -500,6 +527,7 @@ int main() {
     fst::TestStringRepository<fst::StdArc, unsigned char>();
     fst::TestStringRepository<fst::StdArc, char>();
     fst::TestDeterminizeGeneral<fst::StdArc>();
+    fst::TestDeterminizeThreaded<fst::StdArc>();
     fst::TestDeterminize<fst::StdArc>();
     // fst::TestDeterminize2<fst::StdArc>();
     fst::TestPush<fst::StdArc>();
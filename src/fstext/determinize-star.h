@@ -24,10 +24,15 @@
 #include <fst/fstlib.h>
 #include <fst/fst-decl.h>
 #include <algorithm>
+#include <exception>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <vector>
 #include <stdexcept> // this algorithm uses exceptions
+#include "util/kaldi-mmap.h"
+#include "util/kaldi-thread.h"
 
 namespace fst {
 
@@ -81,6 +86,21 @@ namespace fst {
     specified max_states is reached (when larger than zero), instead of throwing
     out an error.
 
+    If 'arena' is non-NULL, the subsets of states (which are the main memory
+    cost for big graphs) and the arcs of output states that have been finished
+    are stored in it rather than in separately allocated vectors.  With a
+    file-backed arena (see kaldi::MappedArena) the kernel can page them out,
+    which lets us determinize graphs that would not otherwise fit in memory;
+    the hash table only holds a pointer and size for each subset.  The arena
+    must outlive the call; its memory is not freed until it is destroyed.
+
+    If num_threads > 1, batches of determinized states are expanded (epsilon
+    closure, final-weights and the subsets their transitions lead to) in
+    parallel, and only the lookup of the destination subsets is done serially.
+    The states are numbered differently than with one thread, but the output
+    is equivalent.  If ifst is computed on demand, each thread uses its own
+    copy of it.
+
     Caution, the return status is un-intuitive: this function will return false if
     determinization completed normally, and true if it was stopped early by
     reaching the 'max-states' limit, and a partial FST was generated.
@@ -90,7 +110,9 @@ bool DeterminizeStar(F &ifst, MutableFst<typename F::Arc> *ofst,
                      float delta = kDelta,
                      bool *debug_ptr = NULL,
                      int max_states = -1,
-                     bool allow_partial = false);
+                     bool allow_partial = false,
+                     kaldi::MappedArena *arena = NULL,
+                     int num_threads = 1);
 
 
 
@@ -111,7 +133,9 @@ template<class F>
 bool DeterminizeStar(F &ifst, MutableFst<GallicArc<typename F::Arc> > *ofst,
                      float delta = kDelta, bool *debug_ptr = NULL,
                      int max_states = -1,
-                     bool allow_partial = false);
+                     bool allow_partial = false,
+                     kaldi::MappedArena *arena = NULL,
+                     int num_threads = 1);
 
 
 /// @} end "addtogroup fst_extensions"
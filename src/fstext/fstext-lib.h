@@ -33,4 +33,5 @@
 #include "fstext/determinize-lattice.h"
 #include "fstext/deterministic-fst.h"
 #include "fstext/kaldi-fst-io.h"
+#include "fstext/csr-fst.h"
 #endif
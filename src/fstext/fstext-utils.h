@@ -82,7 +82,9 @@ void GetSymbols(const SymbolTable &symtab,
 
 inline
 void DeterminizeStarInLog(VectorFst<StdArc> *fst, float delta = kDelta, bool *debug_ptr = NULL,
-                          int max_states = -1);
+                          int max_states = -1,
+                          kaldi::MappedArena *arena = NULL,
+                          int num_threads = 1);
 
 
 // e.g. of using this function: PushInLog<REWEIGHT_TO_INITIAL>(fst, kPushWeights|kPushLabels);
@@ -19,6 +19,9 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstring>
+#include <fstream>
+
 #include "fstext/kaldi-fst-io.h"
 #include "base/kaldi-error.h"
 #include "base/kaldi-math.h"
@@ -91,6 +94,29 @@ Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename, bool throw_on_err) {
   return fst;
 }
 
+bool IsCsrFstFile(std::string rxfilename) {
+  if (kaldi::ClassifyRxfilename(rxfilename) != kaldi::kFileInput)
+    return false;
+  std::ifstream is(rxfilename.c_str(), std::ios::binary);
+  const char header[] = "\0B<CsrFst>";
+  const size_t header_size = sizeof(header) - 1;
+  char buf[header_size];
+  is.read(buf, header_size);
+  return is.good() && std::memcmp(buf, header, header_size) == 0;
+}
+
+CsrFst *ReadCsrFstKaldi(std::string rxfilename) {
+  CsrFst *fst = new CsrFst();
+  if (kaldi::ClassifyRxfilename(rxfilename) == kaldi::kFileInput &&
+      fst->Map(rxfilename))
+    return fst;
+  // Map() prints a warning if the file could not be mapped.
+  bool binary;
+  kaldi::Input ki(rxfilename, &binary);
+  fst->Read(ki.Stream(), binary);
+  return fst;
+}
+
 VectorFst<StdArc> *CastOrConvertToVectorFst(Fst<StdArc> *fst) {
   // This version currently supports ConstFst<StdArc> or VectorFst<StdArc>
   std::string real_type = fst->Type();
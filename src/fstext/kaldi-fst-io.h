@@ -26,6 +26,7 @@
 #include <fst/fst-decl.h>
 #include <fst/script/print-impl.h>
 #include "base/kaldi-common.h"
+#include "fstext/csr-fst.h"
 
 // Some functions for writing Fsts.
 // I/O for FSTs is a bit of a mess, and not very well integrated with Kaldi's
@@ -50,6 +51,19 @@ VectorFst<StdArc> *ReadFstKaldi(std::string rxfilename);
 Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename,
                                  bool throw_on_err = true);
 
+// Returns true if 'rxfilename' is a file (not a pipe, the standard input or an
+// offset into a file) that starts with a binary-mode CsrFst (see csr-fst.h).
+// Used by programs that accept either a normal FST or a CsrFst as the
+// decoding graph.
+bool IsCsrFstFile(std::string rxfilename);
+
+// Reads a CsrFst (see csr-fst.h) using Kaldi I/O mechanisms.  If rxfilename is
+// a file that was written with nothing but the CsrFst in it, the file is
+// memory-mapped (with MAP_SHARED) and used in place, so that processes on the
+// same machine decoding with the same graph share its memory; otherwise it is
+// read in the normal way.  On error, throws using KALDI_ERR.
+CsrFst *ReadCsrFstKaldi(std::string rxfilename);
+
 // This function attempts to dynamic_cast the pointer 'fst' (which will likely
 // have been returned by ReadFstGeneric()), to the more derived
 // type VectorFst<StdArc>. If this succeeds, it returns the same pointer;
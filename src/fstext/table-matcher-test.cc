@@ -21,6 +21,9 @@
 #include "fstext/fst-test-utils.h"
 #include "base/kaldi-math.h"
 
+#include <thread>
+#include <vector>
+
 namespace fst{
 
 
@@ -240,6 +243,52 @@ template<class Arc>  void TestTableMatcherCacheRight(bool connect) {
 }
 
 
+// Tests TableComposeCachePool: several threads compose different left FSTs
+// with the same right FST, each using a cache from the pool.
+template<class Arc>  void TestTableComposeCachePool() {
+  VectorFst<Arc> *fst2 = RandFst<Arc>();
+  ILabelCompare<Arc> ilabel_comp;
+  ArcSort(fst2, ilabel_comp);
+
+  TableComposeOptions opts;
+  opts.table_match_type = MATCH_INPUT;
+  opts.min_table_size = 1 + kaldi::Rand() % 5;
+  opts.table_ratio = 0.25 * (kaldi::Rand() % 5);
+
+  int num_fsts = 8, num_threads = 4;
+  std::vector<VectorFst<Arc>*> fst1s(num_fsts);
+  std::vector<VectorFst<Arc> > composed(num_fsts);
+  for (int i = 0; i < num_fsts; i++) {
+    fst1s[i] = RandFst<Arc>();
+    OLabelCompare<Arc> olabel_comp;
+    ArcSort(fst1s[i], olabel_comp);
+  }
+  TableComposeCachePool<Fst<Arc> > pool(opts);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.push_back(std::thread([&, t]() {
+          for (int i = t; i < num_fsts; i += num_threads) {
+            TableComposeCache<Fst<Arc> > *cache = pool.Get();
+            TableCompose(*(fst1s[i]), *fst2, &(composed[i]), cache);
+            pool.Put(cache);
+          }
+        }));
+  }
+  for (int t = 0; t < num_threads; t++)
+    threads[t].join();
+
+  for (int i = 0; i < num_fsts; i++) {
+    VectorFst<Arc> composed_baseline;
+    Compose(*(fst1s[i]), *fst2, &composed_baseline);
+    assert(RandEquivalent(composed[i], composed_baseline, 5/*paths*/,
+                          0.01/*delta*/, kaldi::Rand()/*seed*/,
+                          20/*path length-- max?*/));
+    delete fst1s[i];
+  }
+  delete fst2;
+}
+
+
 } // namespace fst
 
 int main() {
@@ -253,5 +302,6 @@ int main() {
     TestTableMatcherCacheLeft<fst::StdArc>(false);
     TestTableMatcherCacheRight<fst::StdArc>(true);
     TestTableMatcherCacheRight<fst::StdArc>(false);
+    TestTableComposeCachePool<fst::StdArc>();
   }
 }
@@ -22,6 +22,9 @@
 #include <fst/fstlib.h>
 #include <fst/fst-decl.h>
 
+#include <mutex>
+#include <vector>
+
 
 
 namespace fst {
@@ -42,7 +45,14 @@ namespace fst {
 struct TableMatcherOptions {
   float table_ratio;  // we construct the table if it would be at least this full.
   int min_table_size;
-  TableMatcherOptions(): table_ratio(0.25), min_table_size(4) { }
+  // If > 0, a limit on the memory used by the tables.  When a new table would
+  // exceed it, all the tables are freed and are recreated when next needed.
+  // This bounds the memory when composing with very large FSTs (where
+  // otherwise we would end up with a table for most states), at the cost of
+  // some speed.
+  size_t max_table_bytes;
+  TableMatcherOptions(): table_ratio(0.25), min_table_size(4),
+                         max_table_bytes(0) { }
 };
 
 
@@ -71,7 +81,7 @@ class TableMatcherImpl : public MatcherBase<typename F::Arc> {
             Arc(kNoLabel, 0, Weight::One(), kNoStateId) :
             Arc(0, kNoLabel, Weight::One(), kNoStateId)),
       aiter_(NULL),
-      s_(kNoStateId), opts_(opts),
+      s_(kNoStateId), table_bytes_(0), opts_(opts),
       backoff_matcher_(fst, match_type)
   {
     assert(opts_.min_table_size > 0);
@@ -86,11 +96,7 @@ class TableMatcherImpl : public MatcherBase<typename F::Arc> {
   virtual const FST &GetFst() const { return *fst_; }
 
   virtual ~TableMatcherImpl() {
-    std::vector<ArcId> *const empty = ((std::vector<ArcId>*)(NULL)) + 1;  // special marker.
-    for (size_t i = 0; i < tables_.size(); i++) {
-      if (tables_[i] != NULL && tables_[i] != empty)
-        delete tables_[i];
-    }
+    FreeTables();
     delete aiter_;
     delete fst_;
   }
@@ -137,6 +143,13 @@ class TableMatcherImpl : public MatcherBase<typename F::Arc> {
         return;  // table would be too sparse.
       }
       // OK, now we are creating the table.
+      size_t this_table_bytes = (highest_label + 1) * sizeof(ArcId);
+      if (opts_.max_table_bytes > 0 &&
+          table_bytes_ + this_table_bytes > opts_.max_table_bytes) {
+        // Note: aiter_ is NULL at this point, so no table is in use.
+        FreeTables();
+      }
+      table_bytes_ += this_table_bytes;
       this_table_ = new std::vector<ArcId> (highest_label+1, kNoStateId);
       ArcId pos = 0;
       for (aiter.Seek(0); !aiter.Done(); aiter.Next(), pos++) {
@@ -225,6 +238,19 @@ class TableMatcherImpl : public MatcherBase<typename F::Arc> {
   virtual const Arc& Value_() const { return Value(); }
   virtual void Next_() { Next(); }
 
+  // Deletes the tables (they will be recreated if needed).  The "empty"
+  // markers are kept, since they take no memory.
+  void FreeTables() {
+    std::vector<ArcId> *const empty = ((std::vector<ArcId>*)(NULL)) + 1;  // special marker.
+    for (size_t i = 0; i < tables_.size(); i++) {
+      if (tables_[i] != NULL && tables_[i] != empty) {
+        delete tables_[i];
+        tables_[i] = NULL;
+      }
+    }
+    table_bytes_ = 0;
+  }
+
   MatchType match_type_;
   FST *fst_;
   bool current_loop_;
@@ -233,6 +259,7 @@ class TableMatcherImpl : public MatcherBase<typename F::Arc> {
   ArcIterator<FST> *aiter_;
   StateId s_;
   std::vector<std::vector<ArcId> *> tables_;
+  size_t table_bytes_;  // memory used by tables_.
   TableMatcherOptions opts_;
   BackoffMatcher backoff_matcher_;
 
@@ -371,6 +398,46 @@ void TableCompose(const Fst<Arc> &ifst1, const Fst<Arc> &ifst2,
 }
 
 
+/// TableComposeCachePool lets several threads do compositions that all share
+/// the same FST on the table-matched side (the left FST for MATCH_OUTPUT, the
+/// right one for MATCH_INPUT).  The lookup tables of a TableMatcher are built
+/// lazily as states are visited, so a TableComposeCache cannot be used by two
+/// threads at once; instead each composition takes a cache with Get(), uses it
+/// with TableCompose(), and gives it back with Put().  Caches are only created
+/// when none is free, so there are never more of them than compositions
+/// running at once, and each keeps its tables across compositions.
+template<class F>
+class TableComposeCachePool {
+ public:
+  explicit TableComposeCachePool(const TableComposeOptions &opts):
+      opts_(opts) { }
+
+  TableComposeCache<F> *Get() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty())
+      return new TableComposeCache<F>(opts_);
+    TableComposeCache<F> *ans = free_.back();
+    free_.pop_back();
+    return ans;
+  }
+
+  void Put(TableComposeCache<F> *cache) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(cache);
+  }
+
+  ~TableComposeCachePool() {
+    for (size_t i = 0; i < free_.size(); i++)
+      delete free_[i];
+  }
+
+ private:
+  TableComposeOptions opts_;
+  std::mutex mutex_;
+  std::vector<TableComposeCache<F>*> free_;
+};
+
+
 
 } // end namespace fst
 #endif
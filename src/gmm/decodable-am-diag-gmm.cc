@@ -18,6 +18,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <vector>
 using std::vector;
 
@@ -32,6 +33,9 @@ BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodZeroBased(
   KALDI_ASSERT(static_cast<size_t>(state) < static_cast<size_t>(NumIndices()) &&
                "Likely graph/model mismatch, e.g. using wrong HCLG.fst");
 
+  if (frame_block_size_ > 1)
+    return BlockLogLikelihoodZeroBased(frame, state);
+
   if (log_like_cache_[state].hit_time == frame) {
     return log_like_cache_[state].log_like;  // return cached value, if found
   }
@@ -71,6 +75,50 @@ BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodZeroBased(
   return log_sum;
 }
 
+BaseFloat DecodableAmDiagGmmUnmapped::BlockLogLikelihoodZeroBased(
+    int32 frame, int32 state) {
+  int32 start = block_start_[state];
+  if (start >= 0 && frame >= start && frame < start + frame_block_size_)
+    return block_loglikes_(state, frame - start);
+
+  const DiagGmm &pdf = acoustic_model_.GetPdf(state);
+  if (pdf.Dim() != feature_matrix_.NumCols()) {
+    KALDI_ERR << "Dim mismatch: data dim = "  << feature_matrix_.NumCols()
+        << " vs. model dim = " << pdf.Dim();
+  }
+  if (!pdf.valid_gconsts()) {
+    KALDI_ERR << "State "  << (state)  << ": Must call ComputeGconsts() "
+        "before computing likelihood.";
+  }
+  int32 num_frames = std::min(frame_block_size_,
+                              feature_matrix_.NumRows() - frame),
+      dim = feature_matrix_.NumCols();
+  SubMatrix<BaseFloat> data(feature_matrix_, frame, num_frames, 0, dim),
+      data_sq(feats_squared_, frame, num_frames, 0, dim);
+  SubVector<BaseFloat> loglikes(block_loglikes_.Row(state), 0, num_frames);
+  pdf.FrameLogLikelihoods(data, data_sq, log_sum_exp_prune_, &loglikes);
+  for (int32 t = 0; t < num_frames; t++)
+    if (KALDI_ISNAN(loglikes(t)) || KALDI_ISINF(loglikes(t)))
+      KALDI_ERR << "Invalid answer (overflow or invalid variances/features?)";
+  block_start_[state] = frame;
+  return loglikes(0);
+}
+
+void DecodableAmDiagGmmUnmapped::SetFrameBlockSize(int32 block_size) {
+  KALDI_ASSERT(block_size > 0);
+  frame_block_size_ = block_size;
+  if (block_size > 1) {
+    feats_squared_ = feature_matrix_;
+    feats_squared_.ApplyPow(2.0);
+    block_loglikes_.Resize(acoustic_model_.NumPdfs(), block_size, kUndefined);
+    block_start_.assign(acoustic_model_.NumPdfs(), -1);
+  } else {
+    feats_squared_.Resize(0, 0);
+    block_loglikes_.Resize(0, 0);
+    block_start_.clear();
+  }
+}
+
 void DecodableAmDiagGmmUnmapped::ResetLogLikeCache() {
   if (static_cast<int32>(log_like_cache_.size()) != acoustic_model_.NumPdfs()) {
     log_like_cache_.resize(acoustic_model_.NumPdfs());
@@ -53,10 +53,18 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
                              BaseFloat log_sum_exp_prune = -1.0):
     acoustic_model_(am), feature_matrix_(feats),
     previous_frame_(-1), log_sum_exp_prune_(log_sum_exp_prune), 
-    data_squared_(feats.NumCols()) {
+    data_squared_(feats.NumCols()), frame_block_size_(1) {
     ResetLogLikeCache();
   }
 
+  /// If block_size > 1, the log-likelihood of a pdf is computed for the
+  /// requested frame and the following block_size - 1 frames at once, using
+  /// matrix-matrix products (see DiagGmm::FrameLogLikelihoods()), and cached.
+  /// Pdfs that are active on one frame are usually active on the next few
+  /// frames too, so in decoding and alignment this is much faster than
+  /// computing one frame at a time.  Values of 8 to 16 work well.
+  void SetFrameBlockSize(int32 block_size);
+
   // Note, frames are numbered from zero.  But state_index is numbered
   // from one (this routine is called by FSTs).
   virtual BaseFloat LogLikelihood(int32 frame, int32 state_index) {
@@ -75,6 +83,8 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
  protected:
   void ResetLogLikeCache();
   virtual BaseFloat LogLikelihoodZeroBased(int32 frame, int32 state_index);
+  // This is called by LogLikelihoodZeroBased() if frame_block_size_ > 1.
+  BaseFloat BlockLogLikelihoodZeroBased(int32 frame, int32 state_index);
 
   const AmDiagGmm &acoustic_model_;
   const Matrix<BaseFloat> &feature_matrix_;
@@ -90,6 +100,15 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
  private:
   Vector<BaseFloat> data_squared_;  ///< Cache for fast likelihood calculation
 
+  // The following are used if frame_block_size_ > 1.
+  int32 frame_block_size_;
+  // The squares of the features.
+  Matrix<BaseFloat> feats_squared_;
+  // Row p contains the log-likelihoods of pdf p for frames
+  // block_start_[p] ... block_start_[p] + frame_block_size_ - 1 (or up to the
+  // last frame); block_start_[p] is -1 if nothing is cached for p.
+  Matrix<BaseFloat> block_loglikes_;
+  std::vector<int32> block_start_;
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmDiagGmmUnmapped);
 };
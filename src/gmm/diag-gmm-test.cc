@@ -174,6 +174,26 @@ void UnitTestDiagGmm() {
       gmm2.LogLikelihoodsPreselect(feat, indices, &loglikes);
       AssertEqual(loglikes.LogSumExp(), loglike_gmm2);
     }
+    {
+      // FrameLogLikelihoods() on a few frames, with and without pruning.
+      int32 num_frames = 1 + Rand() % 5;
+      Matrix<BaseFloat> data(num_frames, dim);
+      data.SetRandn();
+      data.CopyRowFromVec(feat, 0);
+      Matrix<BaseFloat> data_sq(data);
+      data_sq.ApplyPow(2.0);
+      Vector<BaseFloat> frame_loglikes(num_frames),
+          frame_loglikes_pruned(num_frames);
+      gmm2.FrameLogLikelihoods(data, data_sq, -1.0, &frame_loglikes);
+      gmm2.FrameLogLikelihoods(data, data_sq, 5.0, &frame_loglikes_pruned);
+      AssertEqual(frame_loglikes(0), loglike_gmm2, 0.001);
+      for (int32 t = 0; t < num_frames; t++) {
+        BaseFloat loglike = gmm2.LogLikelihood(data.Row(t));
+        AssertEqual(frame_loglikes(t), loglike, 0.001);
+        KALDI_ASSERT(frame_loglikes_pruned(t) <= loglike + 0.001 &&
+                     frame_loglikes_pruned(t) >= loglike - 0.01);
+      }
+    }
 
     // single component mean accessor + mutator
     DiagGmm gmm3;
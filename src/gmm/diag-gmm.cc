@@ -562,6 +562,43 @@ void DiagGmm::LogLikelihoods(const MatrixBase<BaseFloat> &data,
 }
 
 
+void DiagGmm::FrameLogLikelihoods(const MatrixBase<BaseFloat> &data,
+                                  const MatrixBase<BaseFloat> &data_sq,
+                                  BaseFloat log_sum_exp_prune,
+                                  VectorBase<BaseFloat> *loglikes) const {
+  int32 num_frames = data.NumRows();
+  KALDI_ASSERT(SameDim(data, data_sq) && loglikes->Dim() == num_frames);
+  if (data.NumCols() != Dim()) {
+    KALDI_ERR << "DiagGmm::FrameLogLikelihoods, dimension "
+              << "mismatch " << data.NumCols() << " vs. "<< Dim();
+  }
+  if (num_frames == 0)
+    return;
+  Matrix<BaseFloat> comp_loglikes(num_frames, NumGauss(), kUndefined);
+  comp_loglikes.CopyRowsFromVec(gconsts_);
+  // comp_loglikes +=  data * (means * inv(vars))^T.
+  comp_loglikes.AddMatMat(1.0, data, kNoTrans, means_invvars_, kTrans, 1.0);
+  // comp_loglikes += -0.5 * data_sq * inv(vars)^T.
+  comp_loglikes.AddMatMat(-0.5, data_sq, kNoTrans, inv_vars_, kTrans, 1.0);
+
+  if (log_sum_exp_prune > 0.0) {
+    for (int32 t = 0; t < num_frames; t++)
+      (*loglikes)(t) = comp_loglikes.Row(t).LogSumExp(log_sum_exp_prune);
+    return;
+  }
+  // Do the log-sum-exp for all the frames at once: subtract the maximum of
+  // each row, exponentiate and sum the rows.
+  Vector<BaseFloat> max_loglikes(num_frames, kUndefined);
+  for (int32 t = 0; t < num_frames; t++)
+    max_loglikes(t) = comp_loglikes.Row(t).Max();
+  comp_loglikes.AddVecToCols(-1.0, max_loglikes);
+  comp_loglikes.ApplyExp();
+  loglikes->AddColSumMat(1.0, comp_loglikes, 0.0);
+  loglikes->ApplyLog();
+  loglikes->AddVec(1.0, max_loglikes);
+}
+
+
 
 void DiagGmm::LogLikelihoodsPreselect(const VectorBase<BaseFloat> &data,
                                       const std::vector<int32> &indices,
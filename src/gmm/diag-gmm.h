@@ -91,6 +91,18 @@ class DiagGmm {
   void LogLikelihoods(const MatrixBase<BaseFloat> &data,
                       Matrix<BaseFloat> *loglikes) const;
 
+  /// Outputs to "loglikes" the log-likelihood of each row of "data" (i.e. what
+  /// LogLikelihood() would return for it), using matrix-matrix products for
+  /// all the frames at once, which is much faster than calling
+  /// LogLikelihood() for each frame.  "data_sq" must contain the squares of
+  /// the elements of "data".  If log_sum_exp_prune > 0, it is used as the
+  /// pruning beam for the sum over the Gaussians (see
+  /// VectorBase::LogSumExp()).
+  void FrameLogLikelihoods(const MatrixBase<BaseFloat> &data,
+                           const MatrixBase<BaseFloat> &data_sq,
+                           BaseFloat log_sum_exp_prune,
+                           VectorBase<BaseFloat> *loglikes) const;
+
 
   /// Outputs the per-component log-likelihoods of a subset of mixture
   /// components.  Note: at output, loglikes->Dim() will equal indices.size().
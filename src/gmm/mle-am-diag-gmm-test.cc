@@ -21,6 +21,7 @@
 #include "gmm/am-diag-gmm.h"
 #include "gmm/mle-am-diag-gmm.h"
 #include "util/kaldi-io.h"
+#include "util/kaldi-thread.h"
 
 using kaldi::AmDiagGmm;
 using kaldi::AccumAmDiagGmm;
@@ -91,6 +92,49 @@ void TestAmDiagGmmAccsIO(const AmDiagGmm &am_gmm,
   unlink("tmpfb");
 }
 
+// Checks that accumulating with several threads via AccumAmDiagGmmShards gives
+// the same stats as accumulating directly.
+void TestAmDiagGmmAccsThreaded(const AmDiagGmm &am_gmm,
+                               const Matrix<BaseFloat> &feats) {
+  int32 num_utts = 5, num_frames = feats.NumRows() / num_utts;
+  AccumAmDiagGmm accs, accs_threaded;
+  accs.Init(am_gmm, kGmmAll);
+  accs_threaded.Init(am_gmm, kGmmAll);
+
+  TaskSequencerConfig config;
+  config.num_threads = 2;
+  AccumAmDiagGmmShards shards(am_gmm, am_gmm.Dim(), kGmmAll,
+                              config.num_threads);
+  double tot_like = 0.0, tot_weight = 0.0;
+  {
+    TaskSequencer<AccumAmDiagGmmUtteranceClass> sequencer(config);
+    for (int32 u = 0; u < num_utts; u++) {
+      SubMatrix<BaseFloat> utt_feats(feats, u * num_frames, num_frames,
+                                     0, feats.NumCols());
+      std::vector<std::vector<std::pair<int32, BaseFloat> > > post(num_frames);
+      for (int32 t = 0; t < num_frames; t++) {
+        int32 pdf_id = RandInt(0, am_gmm.NumPdfs() - 1);
+        BaseFloat weight = RandUniform();
+        accs.AccumulateForGmm(am_gmm, utt_feats.Row(t), pdf_id, weight);
+        post[t].push_back(std::make_pair(pdf_id, weight));
+      }
+      sequencer.Run(new AccumAmDiagGmmUtteranceClass(
+          am_gmm, utt_feats, NULL, &post, &shards, &tot_like, &tot_weight));
+    }
+  }
+  shards.MergeInto(&accs_threaded);
+  AssertEqual(accs.TotLogLike(), accs_threaded.TotLogLike(), 1e-4);
+  AssertEqual(accs.TotCount(), accs_threaded.TotCount(), 1e-4);
+  AssertEqual(accs.TotLogLike(), tot_like, 1e-4);
+  AssertEqual(accs.TotCount(), tot_weight, 1e-4);
+  for (int32 i = 0; i < accs.NumAccs(); i++) {
+    KALDI_ASSERT(accs.GetAcc(i).occupancy().ApproxEqual(
+        accs_threaded.GetAcc(i).occupancy(), 1e-4));
+    KALDI_ASSERT(accs.GetAcc(i).mean_accumulator().ApproxEqual(
+        accs_threaded.GetAcc(i).mean_accumulator(), 1e-4));
+  }
+}
+
 void UnitTestMleAmDiagGmm() {
   int32 dim = 1 + kaldi::RandInt(0, 9),  // random dimension of the gmm
       num_pdfs = 5 + kaldi::RandInt(0, 9);  // random number of states
@@ -126,6 +170,7 @@ void UnitTestMleAmDiagGmm() {
     }
   }
   TestAmDiagGmmAccsIO(am_gmm, feats);
+  TestAmDiagGmmAccsThreaded(am_gmm, feats);
 }
 
 
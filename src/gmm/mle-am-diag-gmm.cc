@@ -286,4 +286,90 @@ void AccumAmDiagGmm::Add(BaseFloat scale, const AccumAmDiagGmm &other) {
     gmm_accumulators_[i]->Add(scale, *(other.gmm_accumulators_[i]));
 }
 
+
+AccumAmDiagGmmShards::AccumAmDiagGmmShards(const AmDiagGmm &model, int32 dim,
+                                           GmmFlagsType flags,
+                                           int32 num_shards) {
+  KALDI_ASSERT(num_shards > 0);
+  for (int32 i = 0; i < num_shards; i++) {
+    shards_.push_back(new AccumAmDiagGmm());
+    shards_.back()->Init(model, dim, flags);
+  }
+  free_shards_ = shards_;
+}
+
+AccumAmDiagGmmShards::~AccumAmDiagGmmShards() {
+  DeletePointers(&shards_);
+}
+
+AccumAmDiagGmm *AccumAmDiagGmmShards::Acquire() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (free_shards_.empty())
+    shard_released_.wait(lock);
+  AccumAmDiagGmm *ans = free_shards_.back();
+  free_shards_.pop_back();
+  return ans;
+}
+
+void AccumAmDiagGmmShards::Release(AccumAmDiagGmm *shard) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_shards_.push_back(shard);
+  }
+  shard_released_.notify_one();
+}
+
+void AccumAmDiagGmmShards::MergeInto(AccumAmDiagGmm *acc) const {
+  KALDI_ASSERT(free_shards_.size() == shards_.size() &&
+               "MergeInto() called while shards are in use");
+  for (size_t i = 0; i < shards_.size(); i++)
+    acc->Add(1.0, *(shards_[i]));
+}
+
+
+AccumAmDiagGmmUtteranceClass::AccumAmDiagGmmUtteranceClass(
+    const AmDiagGmm &am_gmm,
+    const MatrixBase<BaseFloat> &feats,
+    const MatrixBase<BaseFloat> *stats_feats,
+    std::vector<std::vector<std::pair<int32, BaseFloat> > > *pdf_post,
+    AccumAmDiagGmmShards *shards,
+    double *tot_like,
+    double *tot_weight):
+    am_gmm_(am_gmm), feats_(feats), shards_(shards),
+    tot_like_ptr_(tot_like), tot_weight_ptr_(tot_weight),
+    tot_like_(0.0), tot_weight_(0.0) {
+  KALDI_ASSERT(static_cast<int32>(pdf_post->size()) == feats.NumRows());
+  if (stats_feats != NULL) {
+    KALDI_ASSERT(stats_feats->NumRows() == feats.NumRows());
+    stats_feats_ = *stats_feats;
+  }
+  pdf_post_.swap(*pdf_post);
+}
+
+void AccumAmDiagGmmUtteranceClass::operator () () {
+  AccumAmDiagGmm *acc = shards_->Acquire();
+  bool two_feats = (stats_feats_.NumRows() != 0);
+  for (size_t i = 0; i < pdf_post_.size(); i++) {
+    for (size_t j = 0; j < pdf_post_[i].size(); j++) {
+      int32 pdf_id = pdf_post_[i][j].first;
+      BaseFloat weight = pdf_post_[i][j].second;
+      BaseFloat like;
+      if (two_feats)
+        like = acc->AccumulateForGmmTwofeats(am_gmm_, feats_.Row(i),
+                                             stats_feats_.Row(i), pdf_id,
+                                             weight);
+      else
+        like = acc->AccumulateForGmm(am_gmm_, feats_.Row(i), pdf_id, weight);
+      tot_like_ += like * weight;
+      tot_weight_ += weight;
+    }
+  }
+  shards_->Release(acc);
+}
+
+AccumAmDiagGmmUtteranceClass::~AccumAmDiagGmmUtteranceClass() {
+  *tot_like_ptr_ += tot_like_;
+  *tot_weight_ptr_ += tot_weight_;
+}
+
 }  // namespace kaldi
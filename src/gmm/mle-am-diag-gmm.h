@@ -23,6 +23,8 @@
 #ifndef KALDI_GMM_MLE_AM_DIAG_GMM_H_
 #define KALDI_GMM_MLE_AM_DIAG_GMM_H_ 1
 
+#include <condition_variable>
+#include <mutex>
 #include <vector>
 
 #include "gmm/am-diag-gmm.h"
@@ -107,6 +109,80 @@ class AccumAmDiagGmm {
   KALDI_DISALLOW_COPY_AND_ASSIGN(AccumAmDiagGmm);
 };
 
+/// AccumAmDiagGmmShards is for accumulating AccumAmDiagGmm stats from several
+/// threads at once.  It holds a number of accumulators ("shards"), each of
+/// which is used by one thread at a time: a thread calls Acquire(), accumulates
+/// into the shard it got, and calls Release().  At the end, MergeInto() sums
+/// the shards.  With one shard per thread, threads never wait for each other
+/// except briefly in Acquire() and Release().
+class AccumAmDiagGmmShards {
+ public:
+  /// Creates 'num_shards' accumulators, initialized as by
+  /// AccumAmDiagGmm::Init(model, dim, flags).
+  AccumAmDiagGmmShards(const AmDiagGmm &model, int32 dim, GmmFlagsType flags,
+                       int32 num_shards);
+
+  ~AccumAmDiagGmmShards();
+
+  /// Returns a shard that no other thread is using, waiting until one is
+  /// released if necessary.
+  AccumAmDiagGmm *Acquire();
+
+  /// Makes a shard obtained from Acquire() available again.
+  void Release(AccumAmDiagGmm *shard);
+
+  /// Adds all the shards to 'acc', which must have been initialized with the
+  /// same model and dimension.  All the shards must have been released.
+  void MergeInto(AccumAmDiagGmm *acc) const;
+
+ private:
+  std::vector<AccumAmDiagGmm*> shards_;
+  std::vector<AccumAmDiagGmm*> free_shards_;
+  std::mutex mutex_;
+  std::condition_variable shard_released_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(AccumAmDiagGmmShards);
+};
+
+/// This class accumulates the stats for one utterance into an
+/// AccumAmDiagGmmShards object; it is for use with TaskSequencer, so that
+/// the gmm-acc-stats* programs can accumulate in several threads.  The
+/// log-likelihood and the total weight are added to *tot_like and
+/// *tot_weight in the destructor, which TaskSequencer calls in the main
+/// thread.
+class AccumAmDiagGmmUtteranceClass {
+ public:
+  /// 'pdf_post' contains, for each frame of 'feats', pairs (pdf-id, weight)
+  /// (i.e. it is a Posterior, as output by ConvertPosteriorToPdfs());
+  /// this object takes its contents (by swapping).  If 'stats_feats' is not
+  /// NULL, it is used to accumulate the stats and 'feats' only to compute the
+  /// Gaussian posteriors, as in AccumulateForGmmTwofeats().  The features
+  /// are copied.
+  AccumAmDiagGmmUtteranceClass(const AmDiagGmm &am_gmm,
+                               const MatrixBase<BaseFloat> &feats,
+                               const MatrixBase<BaseFloat> *stats_feats,
+                               std::vector<std::vector<
+                                 std::pair<int32, BaseFloat> > > *pdf_post,
+                               AccumAmDiagGmmShards *shards,
+                               double *tot_like,
+                               double *tot_weight);
+
+  void operator () ();
+
+  ~AccumAmDiagGmmUtteranceClass();
+
+ private:
+  const AmDiagGmm &am_gmm_;
+  Matrix<BaseFloat> feats_;
+  Matrix<BaseFloat> stats_feats_;
+  std::vector<std::vector<std::pair<int32, BaseFloat> > > pdf_post_;
+  AccumAmDiagGmmShards *shards_;
+  double *tot_like_ptr_;
+  double *tot_weight_ptr_;
+  double tot_like_;
+  double tot_weight_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(AccumAmDiagGmmUtteranceClass);
+};
+
 /// for computing the maximum-likelihood estimates of the parameters of
 /// an acoustic model that uses diagonal Gaussian mixture models as emission densities.
 void MleAmDiagGmmUpdate(const MleDiagGmmOptions &config,
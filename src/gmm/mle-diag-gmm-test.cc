@@ -22,6 +22,7 @@
 #include "gmm/diag-gmm-normal.h"
 #include "gmm/mle-diag-gmm.h"
 #include "util/kaldi-io.h"
+#include "util/kaldi-thread.h"
 
 using namespace kaldi;
 
@@ -84,6 +85,43 @@ void TestComponentAcc(const DiagGmm &gmm, const Matrix<BaseFloat> &feats) {
   }
 }
 
+// Checks that accumulating in chunks with several threads via
+// AccumDiagGmmShards gives the same stats as accumulating directly.
+void TestAccumThreaded(const DiagGmm &gmm, const Matrix<BaseFloat> &feats) {
+  AccumDiagGmm acc(gmm, kGmmAll), acc_threaded(gmm, kGmmAll);
+  Vector<BaseFloat> weights(feats.NumRows());
+  for (int32 i = 0; i < feats.NumRows(); i++) {
+    weights(i) = (RandInt(0, 4) == 0 ? 0.0 : RandUniform());
+    acc.AccumulateFromDiag(gmm, feats.Row(i), weights(i));
+  }
+
+  TaskSequencerConfig config;
+  config.num_threads = 2;
+  AccumDiagGmmShards shards(gmm, kGmmAll, config.num_threads);
+  double tot_like = 0.0, tot_weight = 0.0;
+  {
+    TaskSequencer<AccumDiagGmmChunkClass> sequencer(config);
+    int32 chunk_size = 1 + RandInt(0, 100);
+    for (int32 start = 0; start < feats.NumRows(); start += chunk_size) {
+      int32 this_size = std::min(chunk_size, feats.NumRows() - start);
+      Matrix<BaseFloat> chunk(feats.RowRange(start, this_size));
+      Vector<BaseFloat> chunk_weights(weights.Range(start, this_size));
+      sequencer.Run(new AccumDiagGmmChunkClass(gmm, &chunk, &chunk_weights,
+                                               &shards, &tot_like,
+                                               &tot_weight));
+    }
+  }
+  shards.MergeInto(&acc_threaded);
+  acc.AssertEqual(acc_threaded);
+  AssertEqual(weights.Sum(), tot_weight, 1.0e-4);
+  AssertEqual(acc.occupancy().Sum(), tot_weight, 1.0e-4);
+
+  shards.SetZero();
+  AccumDiagGmm acc_zero(gmm, kGmmAll);
+  shards.MergeInto(&acc_zero);
+  KALDI_ASSERT(acc_zero.occupancy().Sum() == 0.0);
+}
+
 void test_flags_driven_update(const DiagGmm &gmm,
                               const Matrix<BaseFloat> &feats,
                               GmmFlagsType flags) {
@@ -356,6 +394,7 @@ UnitTestEstimateDiagGmm() {
       test_flags_driven_update(*gmm, feats, kGmmWeights | kGmmMeans);
       std::cout << "Testing component-wise accumulation" << '\n';
       TestComponentAcc(*gmm, feats);
+      TestAccumThreaded(*gmm, feats);
     }
 
     iteration++;
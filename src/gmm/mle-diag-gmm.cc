@@ -555,6 +555,85 @@ BaseFloat AccumDiagGmm::AccumulateFromDiagMultiThreaded(
   return tot_like;
 }
 
+
+AccumDiagGmmShards::AccumDiagGmmShards(const DiagGmm &gmm,
+                                       GmmFlagsType flags,
+                                       int32 num_shards) {
+  KALDI_ASSERT(num_shards > 0);
+  for (int32 i = 0; i < num_shards; i++)
+    shards_.push_back(new AccumDiagGmm(gmm, flags));
+  free_shards_ = shards_;
+}
+
+AccumDiagGmmShards::~AccumDiagGmmShards() {
+  DeletePointers(&shards_);
+}
+
+AccumDiagGmm *AccumDiagGmmShards::Acquire() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (free_shards_.empty())
+    shard_released_.wait(lock);
+  AccumDiagGmm *ans = free_shards_.back();
+  free_shards_.pop_back();
+  return ans;
+}
+
+void AccumDiagGmmShards::Release(AccumDiagGmm *shard) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_shards_.push_back(shard);
+  }
+  shard_released_.notify_one();
+}
+
+void AccumDiagGmmShards::SetZero() {
+  KALDI_ASSERT(free_shards_.size() == shards_.size() &&
+               "SetZero() called while shards are in use");
+  for (size_t i = 0; i < shards_.size(); i++)
+    shards_[i]->SetZero(shards_[i]->Flags());
+}
+
+void AccumDiagGmmShards::MergeInto(AccumDiagGmm *acc) const {
+  KALDI_ASSERT(free_shards_.size() == shards_.size() &&
+               "MergeInto() called while shards are in use");
+  for (size_t i = 0; i < shards_.size(); i++)
+    acc->Add(1.0, *(shards_[i]));
+}
+
+
+AccumDiagGmmChunkClass::AccumDiagGmmChunkClass(
+    const DiagGmm &gmm,
+    Matrix<BaseFloat> *feats,
+    Vector<BaseFloat> *frame_weights,
+    AccumDiagGmmShards *shards,
+    double *tot_like,
+    double *tot_weight):
+    gmm_(gmm), shards_(shards),
+    tot_like_ptr_(tot_like), tot_weight_ptr_(tot_weight),
+    tot_like_(0.0), tot_weight_(0.0) {
+  KALDI_ASSERT(frame_weights->Dim() == 0 ||
+               frame_weights->Dim() == feats->NumRows());
+  feats_.Swap(feats);
+  frame_weights_.Swap(frame_weights);
+}
+
+void AccumDiagGmmChunkClass::operator () () {
+  AccumDiagGmm *acc = shards_->Acquire();
+  bool have_weights = (frame_weights_.Dim() != 0);
+  for (int32 t = 0; t < feats_.NumRows(); t++) {
+    BaseFloat weight = (have_weights ? frame_weights_(t) : 1.0);
+    if (weight == 0.0) continue;
+    tot_like_ += weight * acc->AccumulateFromDiag(gmm_, feats_.Row(t), weight);
+    tot_weight_ += weight;
+  }
+  shards_->Release(acc);
+}
+
+AccumDiagGmmChunkClass::~AccumDiagGmmChunkClass() {
+  *tot_like_ptr_ += tot_like_;
+  *tot_weight_ptr_ += tot_weight_;
+}
+
 void AccumDiagGmm::AssertEqual(const AccumDiagGmm &other) {
   KALDI_ASSERT(dim_ == other.dim_ && num_comp_ == other.num_comp_ &&
                flags_ == other.flags_);
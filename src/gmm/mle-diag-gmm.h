@@ -24,6 +24,10 @@
 #ifndef KALDI_GMM_MLE_DIAG_GMM_H_
 #define KALDI_GMM_MLE_DIAG_GMM_H_ 1
 
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
 #include "gmm/diag-gmm.h"
 #include "gmm/diag-gmm-normal.h"
 #include "gmm/model-common.h"
@@ -198,6 +202,77 @@ class AccumDiagGmm {
 };
 
 
+/// AccumDiagGmmShards is for accumulating AccumDiagGmm stats from several
+/// threads at once, in the same way as AccumAmDiagGmmShards: a thread calls
+/// Acquire(), accumulates into the shard it got, and calls Release(); at the
+/// end, MergeInto() sums the shards.
+class AccumDiagGmmShards {
+ public:
+  /// Creates 'num_shards' accumulators, initialized as by
+  /// AccumDiagGmm::Resize(gmm, flags).
+  AccumDiagGmmShards(const DiagGmm &gmm, GmmFlagsType flags,
+                     int32 num_shards);
+
+  ~AccumDiagGmmShards();
+
+  /// Returns a shard that no other thread is using, waiting until one is
+  /// released if necessary.
+  AccumDiagGmm *Acquire();
+
+  /// Makes a shard obtained from Acquire() available again.
+  void Release(AccumDiagGmm *shard);
+
+  /// Sets all the shards to zero, e.g. before the next iteration of EM.
+  /// All the shards must have been released.
+  void SetZero();
+
+  /// Adds all the shards to 'acc', which must have the same dimension and
+  /// number of Gaussians.  All the shards must have been released.
+  void MergeInto(AccumDiagGmm *acc) const;
+
+ private:
+  std::vector<AccumDiagGmm*> shards_;
+  std::vector<AccumDiagGmm*> free_shards_;
+  std::mutex mutex_;
+  std::condition_variable shard_released_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(AccumDiagGmmShards);
+};
+
+/// This class accumulates the stats for a block of frames (e.g. an utterance,
+/// or a minibatch of frames from several utterances) into an
+/// AccumDiagGmmShards object; it is for use with TaskSequencer.  The
+/// log-likelihood and the total weight are added to *tot_like and
+/// *tot_weight in the destructor, which TaskSequencer calls in the main
+/// thread.
+class AccumDiagGmmChunkClass {
+ public:
+  /// This object takes the contents of 'feats' and 'frame_weights' (by
+  /// swapping).  'frame_weights' may be empty, meaning all frames have
+  /// weight 1.0; otherwise its dimension must equal feats->NumRows().
+  AccumDiagGmmChunkClass(const DiagGmm &gmm,
+                         Matrix<BaseFloat> *feats,
+                         Vector<BaseFloat> *frame_weights,
+                         AccumDiagGmmShards *shards,
+                         double *tot_like,
+                         double *tot_weight);
+
+  void operator () ();
+
+  ~AccumDiagGmmChunkClass();
+
+ private:
+  const DiagGmm &gmm_;
+  Matrix<BaseFloat> feats_;
+  Vector<BaseFloat> frame_weights_;
+  AccumDiagGmmShards *shards_;
+  double *tot_like_ptr_;
+  double *tot_weight_ptr_;
+  double tot_like_;
+  double tot_weight_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(AccumDiagGmmChunkClass);
+};
+
+
 /// Returns "augmented" version of flags: e.g. if just updating means, need
 /// weights too.
 GmmFlagsType AugmentGmmFlags(GmmFlagsType f);
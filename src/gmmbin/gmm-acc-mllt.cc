@@ -19,6 +19,8 @@
 // limitations under the License.
 
 
+#include <map>
+
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "gmm/am-diag-gmm.h"
@@ -94,16 +96,27 @@ int main(int argc, char *argv[]) {
 
         Posterior pdf_posterior;
         ConvertPosteriorToPdfs(trans_model, posterior, &pdf_posterior);
-        for (size_t i = 0; i < posterior.size(); i++) {
-          for (size_t j = 0; j < pdf_posterior[i].size(); j++) {
-            int32 pdf_id = pdf_posterior[i][j].first;
-            BaseFloat weight = pdf_posterior[i][j].second;
-
-            tot_like_this_file += mllt_accs.AccumulateFromGmm(am_gmm.GetPdf(pdf_id),
-                                                              mat.Row(i),
-                                                              weight) * weight;
-            tot_weight += weight;
+        // Group the frames by pdf, so that the stats for each pdf in this
+        // file are accumulated in one batch.
+        std::map<int32, std::vector<std::pair<int32, BaseFloat> > > pdf_frames;
+        for (size_t i = 0; i < posterior.size(); i++)
+          for (size_t j = 0; j < pdf_posterior[i].size(); j++)
+            pdf_frames[pdf_posterior[i][j].first].push_back(
+                std::make_pair(static_cast<int32>(i),
+                               pdf_posterior[i][j].second));
+        std::map<int32, std::vector<std::pair<int32, BaseFloat> > >::const_iterator
+            iter = pdf_frames.begin(), end = pdf_frames.end();
+        for (; iter != end; ++iter) {
+          int32 pdf_id = iter->first, num_frames = iter->second.size();
+          Matrix<BaseFloat> feats(num_frames, mat.NumCols(), kUndefined);
+          Vector<BaseFloat> weights(num_frames, kUndefined);
+          for (int32 k = 0; k < num_frames; k++) {
+            feats.Row(k).CopyFromVec(mat.Row(iter->second[k].first));
+            weights(k) = iter->second[k].second;
           }
+          tot_like_this_file += mllt_accs.AccumulateFromGmm(
+              am_gmm.GetPdf(pdf_id), feats, weights);
+          tot_weight += weights.Sum();
         }
         KALDI_LOG << "Average like for this file is "
                   << (tot_like_this_file/tot_weight) << " over "
@@ -23,6 +23,8 @@
 #include "gmm/am-diag-gmm.h"
 #include "hmm/transition-model.h"
 #include "gmm/mle-am-diag-gmm.h"
+#include "hmm/posterior.h"
+#include "util/kaldi-thread.h"
 
 
 
@@ -39,7 +41,9 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     bool binary = true;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
     po.Register("binary", &binary, "Write output in binary mode");
+    sequencer_config.Register(&po);
     po.Read(argc, argv);
 
     if (po.NumArgs() != 4) {
@@ -66,13 +70,18 @@ int main(int argc, char *argv[]) {
     AccumAmDiagGmm gmm_accs;
     gmm_accs.Init(am_gmm, kGmmAll);
 
-    double tot_like = 0.0;
-    kaldi::int64 tot_t = 0;
+    double tot_like = 0.0, tot_t = 0.0;
+    // Each thread accumulates into its own copy of the stats; they are summed
+    // into gmm_accs at the end.
+    int32 num_shards = std::max(1, sequencer_config.num_threads);
+    AccumAmDiagGmmShards gmm_acc_shards(am_gmm, am_gmm.Dim(), kGmmAll,
+                                        num_shards);
 
     SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
     RandomAccessInt32VectorReader alignments_reader(alignments_rspecifier);
 
     int32 num_done = 0, num_err = 0;
+    TaskSequencer<AccumAmDiagGmmUtteranceClass> sequencer(sequencer_config);
     for (; !feature_reader.Done(); feature_reader.Next()) {
       std::string key = feature_reader.Key();
       if (!alignments_reader.HasKey(key)) {
@@ -90,25 +99,21 @@ int main(int argc, char *argv[]) {
         }
 
         num_done++;
-        BaseFloat tot_like_this_file = 0.0;
-
+        Posterior pdf_post(alignment.size());
         for (size_t i = 0; i < alignment.size(); i++) {
           int32 tid = alignment[i],  // transition identifier.
               pdf_id = trans_model.TransitionIdToPdf(tid);
           trans_model.Accumulate(1.0, tid, &transition_accs);
-          tot_like_this_file += gmm_accs.AccumulateForGmm(am_gmm, mat.Row(i),
-                                                          pdf_id, 1.0);
-        }
-        tot_like += tot_like_this_file;
-        tot_t += alignment.size();
-        if (num_done % 50 == 0) {
-          KALDI_LOG << "Processed " << num_done << " utterances; for utterance "
-                    << key << " avg. like is "
-                    << (tot_like_this_file/alignment.size())
-                    << " over " << alignment.size() <<" frames.";
+          pdf_post[i].push_back(std::make_pair(pdf_id, 1.0));
         }
+        sequencer.Run(new AccumAmDiagGmmUtteranceClass(
+            am_gmm, mat, NULL, &pdf_post, &gmm_acc_shards, &tot_like, &tot_t));
+        if (num_done % 50 == 0)
+          KALDI_LOG << "Processed " << num_done << " utterances.";
       }
     }
+    sequencer.Wait();
+    gmm_acc_shards.MergeInto(&gmm_accs);
     KALDI_LOG << "Done " << num_done << " files, " << num_err
               << " with errors.";
 
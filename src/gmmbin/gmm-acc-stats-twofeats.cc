@@ -26,6 +26,7 @@
 #include "hmm/transition-model.h"
 #include "gmm/mle-am-diag-gmm.h"
 #include "hmm/posterior.h"
+#include "util/kaldi-thread.h"
 
 
 int main(int argc, char *argv[]) {
@@ -41,7 +42,9 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     bool binary = true;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
     po.Register("binary", &binary, "Write output in binary mode");
+    sequencer_config.Register(&po);
     po.Read(argc, argv);
 
     if (po.NumArgs() != 5) {
@@ -71,7 +74,9 @@ int main(int argc, char *argv[]) {
     trans_model.InitStats(&transition_accs);
     int32 new_dim = 0;
     AccumAmDiagGmm gmm_accs;
-    // will initialize once we know new_dim.
+    // will initialize once we know new_dim.  Each thread accumulates into its
+    // own copy of the stats; they are summed into gmm_accs at the end.
+    AccumAmDiagGmmShards *gmm_acc_shards = NULL;
 
     double tot_like = 0.0;
     double tot_t = 0.0;
@@ -81,6 +86,7 @@ int main(int argc, char *argv[]) {
     RandomAccessPosteriorReader posteriors_reader(posteriors_rspecifier);
 
     int32 num_done = 0, num_no2ndfeats = 0, num_no_posterior = 0, num_other_error = 0;
+    TaskSequencer<AccumAmDiagGmmUtteranceClass> sequencer(sequencer_config);
     for (; !feature1_reader.Done(); feature1_reader.Next()) {
       std::string key = feature1_reader.Key();
       if (!feature2_reader.HasKey(key)) {
@@ -95,6 +101,9 @@ int main(int argc, char *argv[]) {
         if (new_dim == 0) {
           new_dim = mat2.NumCols();
           gmm_accs.Init(am_gmm, new_dim, kGmmAll);
+          gmm_acc_shards = new AccumAmDiagGmmShards(
+              am_gmm, new_dim, kGmmAll,
+              std::max(1, sequencer_config.num_threads));
         }
         const Posterior &posterior = posteriors_reader.Value(key);
 
@@ -111,41 +120,30 @@ int main(int argc, char *argv[]) {
         }
 
         num_done++;
-        BaseFloat tot_like_this_file = 0.0,
-            tot_weight_this_file = 0.0;
 
-        Posterior pdf_posterior;
-        ConvertPosteriorToPdfs(trans_model, posterior, &pdf_posterior);
         for (size_t i = 0; i < posterior.size(); i++) {
-          // Accumulates for GMM.
-          for (size_t j = 0; j <pdf_posterior[i].size(); j++) {
-            int32 pdf_id = pdf_posterior[i][j].first;
-            BaseFloat weight = pdf_posterior[i][j].second;
-            tot_like_this_file += weight *
-                gmm_accs.AccumulateForGmmTwofeats(am_gmm,
-                                                  mat1.Row(i),
-                                                  mat2.Row(i),
-                                                  pdf_id,
-                                                  weight);
-            tot_weight_this_file += weight;
-          }
-
-          // Accumulates for transitions.
+          // Accumulates for transitions; the GMM stats are accumulated by
+          // the sequencer's threads.
           for (size_t j = 0; j < posterior[i].size(); j++) {
             int32 tid = posterior[i][j].first;
             BaseFloat weight = posterior[i][j].second;
             trans_model.Accumulate(weight, tid, &transition_accs);
           }
         }
-        KALDI_LOG << "Average like for this file is "
-                  << (tot_like_this_file/tot_weight_this_file) << " over "
-                  << tot_weight_this_file <<" frames.";
-        tot_like += tot_like_this_file;
-        tot_t += tot_weight_this_file;
+        Posterior pdf_posterior;
+        ConvertPosteriorToPdfs(trans_model, posterior, &pdf_posterior);
+        sequencer.Run(new AccumAmDiagGmmUtteranceClass(
+            am_gmm, mat1, &mat2, &pdf_posterior, gmm_acc_shards,
+            &tot_like, &tot_t));
         if (num_done % 10 == 0)
-          KALDI_LOG << "Avg like per frame so far is " << (tot_like/tot_t);
+          KALDI_LOG << "Processed " << num_done << " utterances.";
       }
     }
+    sequencer.Wait();
+    if (gmm_acc_shards != NULL) {
+      gmm_acc_shards->MergeInto(&gmm_accs);
+      delete gmm_acc_shards;
+    }
 
     KALDI_LOG << "Done " << num_done << " files, " << num_no_posterior
               << " with no posteriors, " << num_no2ndfeats
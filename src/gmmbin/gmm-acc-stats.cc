@@ -25,6 +25,7 @@
 #include "hmm/transition-model.h"
 #include "gmm/mle-am-diag-gmm.h"
 #include "hmm/posterior.h"
+#include "util/kaldi-thread.h"
 
 
 int main(int argc, char *argv[]) {
@@ -42,9 +43,11 @@ int main(int argc, char *argv[]) {
     bool binary = true;
     std::string update_flags_str = "mvwt"; // note: t is ignored, we acc
     // transition stats regardless.
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
     po.Register("binary", &binary, "Write output in binary mode");
     po.Register("update-flags", &update_flags_str, "Which GMM parameters will be "
                 "updated: subset of mvwt.");
+    sequencer_config.Register(&po);
     po.Read(argc, argv);
 
     if (po.NumArgs() != 4) {
@@ -74,11 +77,18 @@ int main(int argc, char *argv[]) {
 
     double tot_like = 0.0;
     double tot_t = 0.0;
+    // Each thread accumulates into its own copy of the stats; they are summed
+    // into gmm_accs at the end.
+    int32 num_shards = std::max(1, sequencer_config.num_threads);
+    AccumAmDiagGmmShards gmm_acc_shards(am_gmm, am_gmm.Dim(),
+                                        StringToGmmFlags(update_flags_str),
+                                        num_shards);
 
     SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
     RandomAccessPosteriorReader posteriors_reader(posteriors_rspecifier);
 
     int32 num_done = 0, num_err = 0;
+    TaskSequencer<AccumAmDiagGmmUtteranceClass> sequencer(sequencer_config);
     for (; !feature_reader.Done(); feature_reader.Next()) {
       std::string key = feature_reader.Key();
       if (!posteriors_reader.HasKey(key)) {
@@ -97,36 +107,27 @@ int main(int argc, char *argv[]) {
         }
 
         num_done++;
-        BaseFloat tot_like_this_file = 0.0, tot_weight = 0.0;
 
-        Posterior pdf_posterior;
-        ConvertPosteriorToPdfs(trans_model, posterior, &pdf_posterior);
         for (size_t i = 0; i < posterior.size(); i++) {
-          // Accumulates for GMM.
-          for (size_t j = 0; j < pdf_posterior[i].size(); j++) {
-            int32 pdf_id = pdf_posterior[i][j].first;
-            BaseFloat weight = pdf_posterior[i][j].second;
-            tot_like_this_file += gmm_accs.AccumulateForGmm(am_gmm, mat.Row(i), pdf_id, weight)
-                * weight;
-            tot_weight += weight;
-          }
-
-          // Accumulates for transitions.
+          // Accumulates for transitions; the GMM stats are accumulated by
+          // the sequencer's threads.
           for (size_t j = 0; j < posterior[i].size(); j++) {
             int32 tid = posterior[i][j].first;
             BaseFloat weight = posterior[i][j].second;
             trans_model.Accumulate(weight, tid, &transition_accs);
           }
         }
-        if (num_done % 50 == 0) {
-          KALDI_LOG << "Processed " << num_done << " utterances; for utterance "
-                    << key << " avg. like is " << (tot_like_this_file/tot_weight)
-                    << " over " << tot_weight <<" frames.";
-        }
-        tot_like += tot_like_this_file;
-        tot_t += tot_weight;
+        Posterior pdf_posterior;
+        ConvertPosteriorToPdfs(trans_model, posterior, &pdf_posterior);
+        sequencer.Run(new AccumAmDiagGmmUtteranceClass(
+            am_gmm, mat, NULL, &pdf_posterior, &gmm_acc_shards,
+            &tot_like, &tot_t));
+        if (num_done % 50 == 0)
+          KALDI_LOG << "Processed " << num_done << " utterances.";
       }
     }
+    sequencer.Wait();
+    gmm_acc_shards.MergeInto(&gmm_accs);
 
     KALDI_LOG << "Done " << num_done << " files, " << num_err
               << " with errors.";
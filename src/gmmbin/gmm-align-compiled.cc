@@ -26,6 +26,8 @@
 #include "hmm/hmm-utils.h"
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
+#include "decoder/linear-graph-aligner.h"
+#include "decoder/training-graph-reader.h"
 #include "gmm/decodable-am-diag-gmm.h"
 #include "lat/kaldi-lattice.h" // for {Compact}LatticeArc
 
@@ -45,16 +47,22 @@ int main(int argc, char *argv[]) {
         " gmm-align-compiled 1.mdl ark:graphs.fsts scp:train.scp ark:1.ali\n"
         "or:\n"
         " compile-train-graphs tree 1.mdl lex.fst 'ark:sym2int.pl -f 2- words.txt text|' \\\n"
-        "   ark:- | gmm-align-compiled 1.mdl ark:- scp:train.scp t, ark:1.ali\n";
+        "   ark:- | gmm-align-compiled 1.mdl ark:- scp:train.scp t, ark:1.ali\n"
+        "or, compiling the graphs in-process:\n"
+        " gmm-align-compiled --compile-graphs.tree=tree --compile-graphs.lexicon=lex.fst \\\n"
+        "   1.mdl 'ark:sym2int.pl -f 2- words.txt text|' scp:train.scp ark:1.ali\n";
 
     ParseOptions po(usage);
     AlignConfig align_config;
+    TrainingGraphReaderOptions graph_reader_opts;
     BaseFloat acoustic_scale = 1.0;
     BaseFloat transition_scale = 1.0;
     BaseFloat self_loop_scale = 1.0;
-    std::string per_frame_acwt_wspecifier;
+    int32 frame_block_size = 1;
+    std::string per_frame_acwt_wspecifier, posteriors_wspecifier;
 
     align_config.Register(&po);
+    graph_reader_opts.Register(&po);
     po.Register("transition-scale", &transition_scale,
                 "Transition-probability scale [relative to acoustics]");
     po.Register("acoustic-scale", &acoustic_scale,
@@ -64,6 +72,15 @@ int main(int argc, char *argv[]) {
     po.Register("write-per-frame-acoustic-loglikes", &per_frame_acwt_wspecifier,
                 "Wspecifier for table of vectors containing the acoustic log-likelihoods "
                 "per frame for each utterance. E.g. ark:foo/per_frame_logprobs.1.ark");
+    po.Register("write-posteriors", &posteriors_wspecifier,
+                "Wspecifier for the posteriors of the transition-ids on each "
+                "frame, from forward-backward on the graph (a soft version of "
+                "ali-to-post on the alignment).  Only done for graphs that are "
+                "a simple chain (see --linear-aligner); for other utterances "
+                "nothing is written.");
+    po.Register("frame-block-size", &frame_block_size,
+                "If >1, compute the likelihoods of all pdfs for this many "
+                "frames at a time using matrix operations.");
     po.Read(argc, argv);
 
     if (po.NumArgs() < 4 || po.NumArgs() > 5) {
@@ -86,11 +103,13 @@ int main(int argc, char *argv[]) {
       am_gmm.Read(ki.Stream(), binary);
     }
 
-    SequentialTableReader<fst::VectorFstHolder> fst_reader(fst_rspecifier);
+    SequentialTrainingGraphReader fst_reader(fst_rspecifier, trans_model,
+                                             graph_reader_opts);
     RandomAccessBaseFloatMatrixReader feature_reader(feature_rspecifier);
     Int32VectorWriter alignment_writer(alignment_wspecifier);
     BaseFloatWriter scores_writer(scores_wspecifier);
     BaseFloatVectorWriter per_frame_acwt_writer(per_frame_acwt_wspecifier);
+    PosteriorWriter posterior_writer(posteriors_wspecifier);
 
     int num_done = 0, num_err = 0, num_retry = 0;
     double tot_like = 0.0;
@@ -123,6 +142,7 @@ int main(int argc, char *argv[]) {
 
         DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
                                                acoustic_scale);
+        gmm_decodable.SetFrameBlockSize(frame_block_size);
 
         KALDI_LOG << utt;
         AlignUtteranceWrapper(align_config, utt,
@@ -130,6 +150,19 @@ int main(int argc, char *argv[]) {
                               &alignment_writer, &scores_writer,
                               &num_done, &num_err, &num_retry,
                               &tot_like, &frame_count, &per_frame_acwt_writer);
+        if (posterior_writer.IsOpen()) {
+          // Note: if --careful=true, decode_fst is no longer a chain.
+          LinearGraphAligner aligner;
+          Posterior post;
+          BaseFloat cost;
+          if (aligner.Init(decode_fst) &&
+              aligner.ComputePosteriors(&gmm_decodable, align_config.beam,
+                                        &post, &cost))
+            posterior_writer.Write(utt, post);
+          else
+            KALDI_WARN << "Not writing posteriors for utterance " << utt
+                       << " (graph is not a simple chain, or no path).";
+        }
       }
     }
     KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count)
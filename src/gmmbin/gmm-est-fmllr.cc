@@ -30,6 +30,7 @@ using std::vector;
 #include "hmm/transition-model.h"
 #include "transform/fmllr-diag-gmm.h"
 #include "hmm/posterior.h"
+#include "util/kaldi-thread.h"
 
 namespace kaldi {
 void AccumulateForUtterance(const Matrix<BaseFloat> &feats,
@@ -39,16 +40,64 @@ void AccumulateForUtterance(const Matrix<BaseFloat> &feats,
                             FmllrDiagGmmAccs *spk_stats) {
   Posterior pdf_post;
   ConvertPosteriorToPdfs(trans_model, post, &pdf_post);
-  for (size_t i = 0; i < post.size(); i++) {
-    for (size_t j = 0; j < pdf_post[i].size(); j++) {
-      int32 pdf_id = pdf_post[i][j].first;
-      spk_stats->AccumulateForGmm(am_gmm.GetPdf(pdf_id),
-                                  feats.Row(i),
-                                  pdf_post[i][j].second);
-    }
-  }
+  spk_stats->AccumulateForPdfs(am_gmm, feats, pdf_post);
 }
 
+/// This class estimates the fMLLR transform of one speaker (or utterance) in
+/// operator(), which may be run in a separate thread; the destructor, which is
+/// called in the original order, writes it out.
+class FmllrEstimateTask {
+ public:
+  FmllrEstimateTask(const FmllrOptions &opts,
+                    const TransitionModel &trans_model,
+                    const AmDiagGmm &am_gmm,
+                    const std::string &key,
+                    BaseFloatMatrixWriter *transform_writer,
+                    double *tot_impr, double *tot_t):
+      opts_(opts), trans_model_(trans_model), am_gmm_(am_gmm), key_(key),
+      transform_writer_(transform_writer), tot_impr_(tot_impr), tot_t_(tot_t),
+      impr_(0.0), count_(0.0) { }
+
+  /// Adds an utterance to be accumulated; the data is copied.
+  void AddUtterance(const Matrix<BaseFloat> &feats, const Posterior &post) {
+    feats_.push_back(feats);
+    post_.push_back(post);
+  }
+
+  void operator () () {
+    FmllrDiagGmmAccs spk_stats(am_gmm_.Dim(), opts_);
+    for (size_t i = 0; i < feats_.size(); i++)
+      AccumulateForUtterance(feats_[i], post_[i], trans_model_, am_gmm_,
+                             &spk_stats);
+    feats_.clear();
+    post_.clear();
+    transform_.Resize(am_gmm_.Dim(), am_gmm_.Dim() + 1);
+    transform_.SetUnit();
+    spk_stats.Update(opts_, &transform_, &impr_, &count_);
+  }
+
+  ~FmllrEstimateTask() {
+    transform_writer_->Write(key_, transform_);
+    KALDI_LOG << "For " << key_ << ", auxf-impr from fMLLR is "
+              << (impr_ / count_) << ", over " << count_ << " frames.";
+    *tot_impr_ += impr_;
+    *tot_t_ += count_;
+  }
+
+ private:
+  const FmllrOptions &opts_;
+  const TransitionModel &trans_model_;
+  const AmDiagGmm &am_gmm_;
+  std::string key_;
+  BaseFloatMatrixWriter *transform_writer_;
+  double *tot_impr_;
+  double *tot_t_;
+  std::vector<Matrix<BaseFloat> > feats_;
+  std::vector<Posterior> post_;
+  Matrix<BaseFloat> transform_;
+  BaseFloat impr_;
+  BaseFloat count_;
+};
 
 }
 
@@ -59,16 +108,19 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Estimate global fMLLR transforms, either per utterance or for the supplied\n"
         "set of speakers (spk2utt option).  Reads posteriors (on transition-ids).  Writes\n"
-        "to a table of matrices.\n"
+        "to a table of matrices.  With --num-threads > 1, the transforms of different\n"
+        "speakers are estimated in parallel.\n"
         "Usage: gmm-est-fmllr [options] <model-in> "
         "<feature-rspecifier> <post-rspecifier> <transform-wspecifier>\n";
 
     ParseOptions po(usage);
     FmllrOptions fmllr_opts;
+    TaskSequencerConfig sequencer_config;
     string spk2utt_rspecifier;
     po.Register("spk2utt", &spk2utt_rspecifier, "rspecifier for speaker to "
                 "utterance-list map");
     fmllr_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -99,13 +151,16 @@ int main(int argc, char *argv[]) {
     BaseFloatMatrixWriter transform_writer(trans_wspecifier);
 
     int32 num_done = 0, num_no_post = 0, num_other_error = 0;
+    TaskSequencer<FmllrEstimateTask> sequencer(sequencer_config);
     if (spk2utt_rspecifier != "") {  // per-speaker adaptation
       SequentialTokenVectorReader spk2utt_reader(spk2utt_rspecifier);
       RandomAccessBaseFloatMatrixReader feature_reader(feature_rspecifier);
 
       for (; !spk2utt_reader.Done(); spk2utt_reader.Next()) {
-        FmllrDiagGmmAccs spk_stats(am_gmm.Dim(), fmllr_opts);
         string spk = spk2utt_reader.Key();
+        FmllrEstimateTask *task = new FmllrEstimateTask(
+            fmllr_opts, trans_model, am_gmm, spk, &transform_writer,
+            &tot_impr, &tot_t);
         const vector<string> &uttlist = spk2utt_reader.Value();
         for (size_t i = 0; i < uttlist.size(); i++) {
           std::string utt = uttlist[i];
@@ -128,22 +183,12 @@ int main(int argc, char *argv[]) {
             continue;
           }
 
-          AccumulateForUtterance(feats, post, trans_model, am_gmm, &spk_stats);
+          task->AddUtterance(feats, post);
 
           num_done++;
         }  // end looping over all utterances of the current speaker
 
-        BaseFloat impr, spk_tot_t;
-        {  // Compute the transform and write it out.
-          Matrix<BaseFloat> transform(am_gmm.Dim(), am_gmm.Dim()+1);
-          transform.SetUnit();
-          spk_stats.Update(fmllr_opts, &transform, &impr, &spk_tot_t);
-          transform_writer.Write(spk, transform);
-        }
-        KALDI_LOG << "For speaker " << spk << ", auxf-impr from fMLLR is "
-                  << (impr/spk_tot_t) << ", over " << spk_tot_t << " frames.";
-        tot_impr += impr;
-        tot_t += spk_tot_t;
+        sequencer.Run(task);
       }  // end looping over speakers
     } else {  // per-utterance adaptation
       SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
@@ -166,24 +211,14 @@ int main(int argc, char *argv[]) {
         }
         num_done++;
 
-        FmllrDiagGmmAccs spk_stats(am_gmm.Dim(), fmllr_opts);
-
-        AccumulateForUtterance(feats, post, trans_model, am_gmm,
-                               &spk_stats);
-
-        BaseFloat impr, utt_tot_t;
-        {  // Compute the transform and write it out.
-          Matrix<BaseFloat> transform(am_gmm.Dim(), am_gmm.Dim()+1);
-          transform.SetUnit();
-          spk_stats.Update(fmllr_opts, &transform, &impr, &utt_tot_t);
-          transform_writer.Write(utt, transform);
-        }
-        KALDI_LOG << "For utterance " << utt << ", auxf-impr from fMLLR is "
-                  << (impr/utt_tot_t) << ", over " << utt_tot_t << " frames.";
-        tot_impr += impr;
-        tot_t += utt_tot_t;
+        FmllrEstimateTask *task = new FmllrEstimateTask(
+            fmllr_opts, trans_model, am_gmm, utt, &transform_writer,
+            &tot_impr, &tot_t);
+        task->AddUtterance(feats, post);
+        sequencer.Run(task);
       }
     }
+    sequencer.Wait();  // the tasks write out the transforms as they finish.
 
     KALDI_LOG << "Done " << num_done << " files, " << num_no_post
               << " with no posts, " << num_other_error << " with other errors.";
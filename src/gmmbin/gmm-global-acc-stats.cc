@@ -24,6 +24,7 @@
 #include "gmm/full-gmm.h"
 #include "gmm/diag-gmm.h"
 #include "gmm/mle-full-gmm.h"
+#include "util/kaldi-thread.h"
 
 
 int main(int argc, char *argv[]) {
@@ -40,6 +41,7 @@ int main(int argc, char *argv[]) {
     bool binary = true;
     std::string update_flags_str = "mvw";
     std::string gselect_rspecifier, weights_rspecifier;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
     po.Register("binary", &binary, "Write output in binary mode");
     po.Register("update-flags", &update_flags_str, "Which GMM parameters will be "
                 "updated: subset of mvw.");
@@ -47,6 +49,7 @@ int main(int argc, char *argv[]) {
                 "to limit the #Gaussians accessed on each frame.");
     po.Register("weights", &weights_rspecifier, "rspecifier for a vector of floats "
                 "for each utterance, that's a per-frame weight.");
+    sequencer_config.Register(&po);
     po.Read(argc, argv);
 
     if (po.NumArgs() != 3) {
@@ -69,6 +72,12 @@ int main(int argc, char *argv[]) {
     gmm_accs.Resize(gmm, StringToGmmFlags(update_flags_str));
     
     double tot_like = 0.0, tot_weight = 0.0;
+    // Without --gselect, the stats are accumulated by the sequencer's
+    // threads, each into its own shard; they are summed into gmm_accs at the
+    // end.
+    AccumDiagGmmShards gmm_acc_shards(gmm, StringToGmmFlags(update_flags_str),
+                                      std::max(1, sequencer_config.num_threads));
+    TaskSequencer<AccumDiagGmmChunkClass> sequencer(sequencer_config);
 
     SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
     RandomAccessInt32VectorVectorReader gselect_reader(gselect_rspecifier);
@@ -130,13 +139,12 @@ int main(int argc, char *argv[]) {
             gmm_accs.AccumulateForComponent(data, this_gselect[j], loglikes(j));
         }
       } else { // no gselect..
-        for (int32 i = 0; i < file_frames; i++) {
-          BaseFloat weight = (weights.Dim() != 0) ? weights(i) : 1.0;
-          if (weight == 0.0) continue;
-          file_weight += weight;
-          file_like += weight *
-              gmm_accs.AccumulateFromDiag(gmm, mat.Row(i), weight);
-        }
+        Matrix<BaseFloat> feats(mat);
+        sequencer.Run(new AccumDiagGmmChunkClass(gmm, &feats, &weights,
+                                                 &gmm_acc_shards, &tot_like,
+                                                 &tot_weight));
+        num_done++;
+        continue;
       }
       KALDI_VLOG(2) << "File '" << key << "': Average likelihood = "
                     << (file_like/file_weight) << " over "
@@ -145,6 +153,8 @@ int main(int argc, char *argv[]) {
       tot_weight += file_weight;
       num_done++;
     }
+    sequencer.Wait();
+    gmm_acc_shards.MergeInto(&gmm_accs);
     KALDI_LOG << "Done " << num_done << " files; "
               << num_err << " with errors.";
     KALDI_LOG << "Overall likelihood per "
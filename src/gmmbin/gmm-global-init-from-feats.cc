@@ -24,6 +24,7 @@
 #include "gmm/full-gmm.h"
 #include "gmm/diag-gmm.h"
 #include "gmm/mle-full-gmm.h"
+#include "util/kaldi-thread.h"
 
 namespace kaldi {
 
@@ -83,6 +84,70 @@ void TrainOneIter(const Matrix<BaseFloat> &feats,
             << (objf_change / count) << " over " << count << " frames.";
 }
 
+// This version of TrainOneIter() does not need the features in memory: it
+// reads them again from 'feature_rspecifier' and accumulates the stats in
+// minibatches of 'minibatch_size' frames, each of which is given to one of
+// the threads of 'sequencer_config'.  Each thread accumulates into its own
+// shard of the stats.
+void TrainOneIterStreaming(const std::string &feature_rspecifier,
+                           const MleDiagGmmOptions &gmm_opts,
+                           int32 iter,
+                           int32 minibatch_size,
+                           const TaskSequencerConfig &sequencer_config,
+                           DiagGmm *gmm) {
+  int32 dim = gmm->Dim();
+  AccumDiagGmmShards shards(*gmm, kGmmAll,
+                            std::max(1, sequencer_config.num_threads));
+  double tot_like = 0.0, tot_weight = 0.0;
+  {
+    TaskSequencer<AccumDiagGmmChunkClass> sequencer(sequencer_config);
+    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    Matrix<BaseFloat> minibatch(minibatch_size, dim, kUndefined);
+    Vector<BaseFloat> no_weights;
+    int32 num_in_minibatch = 0;
+    for (; !feature_reader.Done(); feature_reader.Next()) {
+      const Matrix<BaseFloat> &this_feats = feature_reader.Value();
+      if (this_feats.NumCols() != dim)
+        KALDI_ERR << "Features have inconsistent dims "
+                  << this_feats.NumCols() << " vs. " << dim
+                  << " (current utt is) " << feature_reader.Key();
+      for (int32 t = 0; t < this_feats.NumRows(); t++) {
+        minibatch.Row(num_in_minibatch++).CopyFromVec(this_feats.Row(t));
+        if (num_in_minibatch == minibatch_size) {
+          // The task takes the contents of 'minibatch' (by swapping).
+          sequencer.Run(new AccumDiagGmmChunkClass(*gmm, &minibatch,
+                                                   &no_weights, &shards,
+                                                   &tot_like, &tot_weight));
+          minibatch.Resize(minibatch_size, dim, kUndefined);
+          num_in_minibatch = 0;
+        }
+      }
+    }
+    if (num_in_minibatch > 0) {
+      minibatch.Resize(num_in_minibatch, dim, kCopyData);
+      sequencer.Run(new AccumDiagGmmChunkClass(*gmm, &minibatch, &no_weights,
+                                               &shards, &tot_like,
+                                               &tot_weight));
+    }
+    // the destructor of 'sequencer' waits for the remaining tasks.
+  }
+  if (tot_weight == 0.0)
+    KALDI_ERR << "No features were read on iteration " << iter;
+
+  AccumDiagGmm gmm_acc(*gmm, kGmmAll);
+  shards.MergeInto(&gmm_acc);
+
+  KALDI_LOG << "Likelihood per frame on iteration " << iter
+            << " was " << (tot_like / tot_weight) << " over "
+            << tot_weight << " frames.";
+
+  BaseFloat objf_change, count;
+  MleDiagGmmUpdate(gmm_opts, gmm_acc, kGmmAll, gmm, &objf_change, &count);
+
+  KALDI_LOG << "Objective-function change on iteration " << iter << " was "
+            << (objf_change / count) << " over " << count << " frames.";
+}
+
 } // namespace kaldi
 
 int main(int argc, char *argv[]) {
@@ -91,7 +156,9 @@ int main(int argc, char *argv[]) {
 
     const char *usage =
         "This program initializes a single diagonal GMM and does multiple iterations of\n"
-        "training from features stored in memory.\n"
+        "training from features stored in memory.  With --streaming=true, only the\n"
+        "frames used to initialize the means are kept in memory, and each iteration\n"
+        "reads all the features again (so the rspecifier must not be stdin).\n"
         "Usage:  gmm-global-init-from-feats [options] <feature-rspecifier> <model-out>\n"
         "e.g.: gmm-global-init-from-feats scp:train.scp 1.mdl\n";
 
@@ -105,6 +172,8 @@ int main(int argc, char *argv[]) {
     int32 num_frames = 200000;
     int32 srand_seed = 0;
     int32 num_threads = 4;
+    bool streaming = false;
+    int32 minibatch_size = 10000;
     
     po.Register("binary", &binary, "Write output in binary mode");
     po.Register("num-gauss", &num_gauss, "Number of Gaussians in the model");
@@ -117,6 +186,12 @@ int main(int argc, char *argv[]) {
     po.Register("srand", &srand_seed, "Seed for random number generator ");
     po.Register("num-threads", &num_threads, "Number of threads used for "
                 "statistics accumulation");
+    po.Register("streaming", &streaming, "If true, train on all the input "
+                "features by reading them again on each iteration, instead of "
+                "on --num-frames frames stored in memory (which are then only "
+                "used for initialization).");
+    po.Register("minibatch-size", &minibatch_size, "With --streaming=true, "
+                "the number of frames given to a thread at a time.");
                 
     gmm_opts.Register(&po);
 
@@ -131,6 +206,16 @@ int main(int argc, char *argv[]) {
 
     std::string feature_rspecifier = po.GetArg(1),
         model_wxfilename = po.GetArg(2);
+
+    if (streaming) {
+      std::string rxfilename;
+      ClassifyRspecifier(feature_rspecifier, &rxfilename, NULL);
+      if (rxfilename == "" || rxfilename == "-")
+        KALDI_ERR << "With --streaming=true the features are read once per "
+                  << "iteration, so they cannot come from stdin: "
+                  << feature_rspecifier;
+      KALDI_ASSERT(minibatch_size > 0);
+    }
     
     Matrix<BaseFloat> feats;
 
@@ -185,13 +270,22 @@ int main(int argc, char *argv[]) {
               << num_gauss_init << " Gaussians.";
     InitGmmFromRandomFrames(feats, &gmm);
 
+    TaskSequencerConfig sequencer_config;
+    sequencer_config.num_threads = num_threads;
+    if (streaming)
+      feats.Resize(0, 0);  // the stored frames are no longer needed.
+
     // we'll increase the #Gaussians by splitting,
     // till halfway through training.
     int32 cur_num_gauss = num_gauss_init,
         gauss_inc = (num_gauss - num_gauss_init) / (num_iters / 2);
         
     for (int32 iter = 0; iter < num_iters; iter++) {
-      TrainOneIter(feats, gmm_opts, iter, num_threads, &gmm);
+      if (streaming)
+        TrainOneIterStreaming(feature_rspecifier, gmm_opts, iter,
+                              minibatch_size, sequencer_config, &gmm);
+      else
+        TrainOneIter(feats, gmm_opts, iter, num_threads, &gmm);
 
       int32 next_num_gauss = std::min(num_gauss, cur_num_gauss + gauss_inc);
       if (next_num_gauss > gmm.NumGauss()) {
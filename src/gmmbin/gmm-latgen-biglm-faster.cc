@@ -27,6 +27,7 @@
 #include "hmm/transition-model.h"
 #include "fstext/fstext-lib.h"
 #include "decoder/lattice-biglm-faster-decoder.h"
+#include "lm/const-arpa-lm.h"
 #include "gmm/decodable-am-diag-gmm.h"
 #include "base/timer.h"
 
@@ -156,10 +157,12 @@ int main(int argc, char *argv[]) {
         "this decoder applies the difference during decoding\n"
         "Usage: gmm-latgen-biglm-faster [options] model-in (fst-in|fsts-rspecifier) "
         "oldlm-fst-in newlm-fst-in features-rspecifier"
-        " lattice-wspecifier [ words-wspecifier [alignments-wspecifier] ]\n";
+        " lattice-wspecifier [ words-wspecifier [alignments-wspecifier] ]\n"
+        "With --const-arpa=true, newlm-fst-in is instead a ConstArpaLm, as\n"
+        "created by arpa-to-const-arpa.\n";
     ParseOptions po(usage);
     Timer timer;
-    bool allow_partial = false;
+    bool allow_partial = false, const_arpa = false;
     BaseFloat acoustic_scale = 0.1;
     LatticeBiglmFasterDecoderConfig config;
     
@@ -169,6 +172,10 @@ int main(int argc, char *argv[]) {
 
     po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial, "If true, produce output even if end state was not reached.");
+    po.Register("const-arpa", &const_arpa, "If true, read the new LM as a "
+                "ConstArpaLm rather than an FST; this avoids converting large "
+                "LMs to FSTs, and the lookups are faster than in a backoff "
+                "FST.");
     
     po.Read(argc, argv);
 
@@ -199,14 +206,24 @@ int main(int argc, char *argv[]) {
         fst::ReadFstKaldiGeneric(old_lm_fst_rxfilename));
     ApplyProbabilityScale(-1.0, old_lm_fst); // Negate old LM probs...
     
-    VectorFst<StdArc> *new_lm_fst = fst::CastOrConvertToVectorFst(
-        fst::ReadFstKaldiGeneric(new_lm_fst_rxfilename));
+    VectorFst<StdArc> *new_lm_fst = NULL;
+    ConstArpaLm new_lm_const_arpa;
+    fst::DeterministicOnDemandFst<StdArc> *new_lm_dfst = NULL;
+    if (const_arpa) {
+      ReadKaldiObject(new_lm_fst_rxfilename, &new_lm_const_arpa);
+      new_lm_dfst = new ConstArpaLmDeterministicFst(new_lm_const_arpa);
+    } else {
+      new_lm_fst = fst::CastOrConvertToVectorFst(
+          fst::ReadFstKaldiGeneric(new_lm_fst_rxfilename));
+      new_lm_dfst = new fst::BackoffDeterministicOnDemandFst<StdArc>(
+          *new_lm_fst);
+    }
 
     fst::BackoffDeterministicOnDemandFst<StdArc> old_lm_dfst(*old_lm_fst);
-    fst::BackoffDeterministicOnDemandFst<StdArc> new_lm_dfst(*new_lm_fst);
+    // Note: the decoder caches the arcs of the composed LM, so there is no
+    // need for a CacheDeterministicOnDemandFst here.
     fst::ComposeDeterministicOnDemandFst<StdArc> compose_dfst(&old_lm_dfst,
-                                                              &new_lm_dfst);
-    fst::CacheDeterministicOnDemandFst<StdArc> cache_dfst(&compose_dfst);
+                                                              new_lm_dfst);
 
     bool determinize = config.determinize_lattice;
     CompactLatticeWriter compact_lattice_writer;
@@ -237,7 +254,7 @@ int main(int argc, char *argv[]) {
       Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
 
       {
-        LatticeBiglmFasterDecoder decoder(*decode_fst, config, &cache_dfst);
+        LatticeBiglmFasterDecoder decoder(*decode_fst, config, &compose_dfst);
     
         for (; !feature_reader.Done(); feature_reader.Next()) {
           std::string utt = feature_reader.Key();
@@ -284,7 +301,7 @@ int main(int argc, char *argv[]) {
           continue;
         }
         LatticeBiglmFasterDecoder decoder(fst_reader.Value(), config,
-                                          &cache_dfst);
+                                          &compose_dfst);
         DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
                                                acoustic_scale);
         double like;
@@ -309,6 +326,8 @@ int main(int argc, char *argv[]) {
     KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
               << frame_count<<" frames.";
 
+    delete new_lm_dfst;
+    delete new_lm_fst;
     delete word_syms;
     if (num_success != 0) return 0;
     else return 1;
@@ -47,6 +47,7 @@ int main(int argc, char *argv[]) {
     Timer timer;
     bool allow_partial = false;
     BaseFloat acoustic_scale = 0.1;
+    int32 frame_block_size = 1;
     LatticeFasterDecoderConfig config;
 
     std::string word_syms_filename;
@@ -57,6 +58,10 @@ int main(int argc, char *argv[]) {
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
                 "If true, produce output even if end state was not reached.");
+    po.Register("frame-block-size", &frame_block_size,
+                "If >1, compute the likelihoods of all pdfs for this many "
+                "frames at a time using matrix operations (faster for "
+                "wide beams).");
 
     po.Read(argc, argv);
 
@@ -124,6 +129,7 @@ int main(int argc, char *argv[]) {
 
           DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
                                                  acoustic_scale);
+          gmm_decodable.SetFrameBlockSize(frame_block_size);
 
           double like;
           if (DecodeUtteranceLatticeFaster(
@@ -159,6 +165,7 @@ int main(int argc, char *argv[]) {
         LatticeFasterDecoder decoder(fst_reader.Value(), config);
         DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
                                                acoustic_scale);
+        gmm_decodable.SetFrameBlockSize(frame_block_size);
         double like;
         if (DecodeUtteranceLatticeFaster(
                 decoder, gmm_decodable, trans_model, word_syms, utt,
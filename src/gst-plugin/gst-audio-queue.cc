@@ -0,0 +1,113 @@
+// gst-plugin/gst-audio-queue.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+
+#include "gst-plugin/gst-audio-queue.h"
+
+namespace kaldi {
+
+
+GstAudioQueue::GstAudioQueue(int32 max_samples):
+    max_samples_(max_samples), ended_(false), flushing_(false) {
+  KALDI_ASSERT(max_samples > 0);
+  g_mutex_init(&lock_);
+  g_cond_init(&data_cond_);
+  g_cond_init(&space_cond_);
+}
+
+GstAudioQueue::~GstAudioQueue() {
+  g_cond_clear(&data_cond_);
+  g_cond_clear(&space_cond_);
+  g_mutex_clear(&lock_);
+}
+
+void GstAudioQueue::SetMaxSamples(int32 max_samples) {
+  KALDI_ASSERT(max_samples > 0);
+  g_mutex_lock(&lock_);
+  max_samples_ = max_samples;
+  g_cond_broadcast(&space_cond_);
+  g_mutex_unlock(&lock_);
+}
+
+bool GstAudioQueue::Push(GstBuffer *buf) {
+  GstMapInfo info;
+  if (!gst_buffer_map(buf, &info, GST_MAP_READ))
+    KALDI_ERR << "Could not map GStreamer buffer";
+  const SampleType *data = reinterpret_cast<const SampleType*>(info.data);
+  size_t num_samples = info.size / sizeof(SampleType);
+
+  g_mutex_lock(&lock_);
+  while (!flushing_ && samples_.size() >= static_cast<size_t>(max_samples_))
+    g_cond_wait(&space_cond_, &lock_);
+  bool ans = !flushing_;
+  if (ans) {
+    samples_.insert(samples_.end(), data, data + num_samples);
+    g_cond_signal(&data_cond_);
+  }
+  g_mutex_unlock(&lock_);
+  gst_buffer_unmap(buf, &info);
+  return ans;
+}
+
+bool GstAudioQueue::Pop(Vector<BaseFloat> *data) {
+  std::vector<BaseFloat> samples;
+  g_mutex_lock(&lock_);
+  while (!flushing_ && !ended_ && samples_.empty())
+    g_cond_wait(&data_cond_, &lock_);
+  if (!flushing_)
+    samples.swap(samples_);
+  g_cond_signal(&space_cond_);
+  g_mutex_unlock(&lock_);
+  if (samples.empty())
+    return false;
+  data->Resize(samples.size(), kUndefined);
+  std::copy(samples.begin(), samples.end(), data->Data());
+  return true;
+}
+
+void GstAudioQueue::SetEnded() {
+  g_mutex_lock(&lock_);
+  ended_ = true;
+  g_cond_signal(&data_cond_);
+  g_mutex_unlock(&lock_);
+}
+
+void GstAudioQueue::SetFlushing(bool flushing) {
+  g_mutex_lock(&lock_);
+  flushing_ = flushing;
+  g_cond_broadcast(&data_cond_);
+  g_cond_broadcast(&space_cond_);
+  g_mutex_unlock(&lock_);
+}
+
+bool GstAudioQueue::IsFlushing() {
+  g_mutex_lock(&lock_);
+  bool ans = flushing_;
+  g_mutex_unlock(&lock_);
+  return ans;
+}
+
+void GstAudioQueue::Reset() {
+  g_mutex_lock(&lock_);
+  samples_.clear();
+  ended_ = false;
+  g_cond_broadcast(&space_cond_);
+  g_mutex_unlock(&lock_);
+}
+
+}  // namespace kaldi
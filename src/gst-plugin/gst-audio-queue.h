@@ -0,0 +1,78 @@
+// gst-plugin/gst-audio-queue.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_GST_PLUGIN_GST_AUDIO_QUEUE_H_
+#define KALDI_GST_PLUGIN_GST_AUDIO_QUEUE_H_
+
+#include <vector>
+#include <gst/gst.h>
+#include "matrix/kaldi-vector.h"
+
+namespace kaldi {
+
+
+// A bounded queue of audio samples, between the GStreamer streaming thread
+// (which calls Push()) and a decoding thread (which calls Pop()).  Push()
+// blocks while the queue is full, so if decoding falls behind, the upstream
+// elements are slowed down instead of the audio piling up in memory.
+class GstAudioQueue {
+ public:
+  typedef int16 SampleType;  // hardcoded 16-bit audio
+
+  // 'max_samples' is the number of samples at which Push() starts to block.
+  explicit GstAudioQueue(int32 max_samples);
+
+  void SetMaxSamples(int32 max_samples);
+
+  // Appends the samples in 'buf' (mono, 16-bit), first waiting until the queue
+  // has fewer than max_samples samples.  Returns false, dropping the samples,
+  // if the queue is flushing.
+  bool Push(GstBuffer *buf);
+
+  // Waits until there are samples in the queue, and moves all of them to
+  // 'data'.  Returns false if there are no more samples: if the queue is
+  // ended and empty, or if it is flushing.
+  bool Pop(Vector<BaseFloat> *data);
+
+  // Says that there is no more audio (end of stream).
+  void SetEnded();
+
+  // While flushing, Push() and Pop() return false at once (and do not wait),
+  // so both threads can be stopped.
+  void SetFlushing(bool flushing);
+
+  bool IsFlushing();
+
+  // Empties the queue and clears the "ended" flag, for the next stream.
+  void Reset();
+
+  ~GstAudioQueue();
+
+ private:
+  std::vector<BaseFloat> samples_;
+  int32 max_samples_;
+  bool ended_;
+  bool flushing_;
+  GMutex lock_;
+  GCond data_cond_;  // signaled when samples are added, or on SetEnded().
+  GCond space_cond_;  // signaled when samples are removed.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(GstAudioQueue);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_GST_PLUGIN_GST_AUDIO_QUEUE_H_
@@ -0,0 +1,964 @@
+// gst-plugin/gst-online-nnet3-decode.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * GStreamer plugin for automatic speech recognition with nnet3 models,
+ * based on Kaldi's SingleUtteranceNnet3Decoder (as in
+ * online2-tcp-nnet3-decode-faster), or, for elements with a batch-group, on
+ * OnlineNnet3BatchDecoder, which computes the neural net for the streams of
+ * all the elements of the group together.
+ *
+ * The audio is decoded by a task (thread) of the element's source pad, not
+ * by the streaming thread.  Between them is a queue of at most
+ * max-queued-audio seconds of audio; when it is full the streaming thread
+ * waits, so the upstream elements are slowed down rather than audio piling
+ * up when decoding can't keep up.
+ *
+ * The final result for each segment (between endpoints, if do-endpointing is
+ * true) is pushed on the source pad as a line of text and emitted by the
+ * final-result signal; partial results are emitted by the partial-result
+ * signal.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0  filesrc location=test.wav \
+ *     ! decodebin ! audioconvert ! audioresample \
+ *     ! onlinennet3decode model=$dir/final.mdl fst=$dir/HCLG.fst \
+ *                         word-syms=$dir/words.txt \
+ *                         mfcc-config=$dir/conf/mfcc.conf \
+ *                         ivector-extraction-config=$dir/conf/ivector_extractor.conf \
+ *                         frame-subsampling-factor=3 acoustic-scale=1.0 \
+ *     ! filesink location=$resultfile
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#else
+#  define VERSION "1.0"
+#endif
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gst-plugin/kaldimarshal.h"
+#include "gst-plugin/gst-online-nnet3-decode.h"
+
+#include "fstext/fstext-lib.h"
+#include "lat/lattice-functions.h"
+#include "nnet3/nnet-utils.h"
+#include "online2/online-nnet3-decoding.h"
+#include "online2/online-ivector-feature.h"
+
+namespace kaldi {
+
+namespace {
+// The models of the batch groups, indexed by batch-group name.
+std::mutex batch_groups_mutex;
+std::map<std::string, OnlineNnet3GstModels*> batch_groups;
+}
+
+OnlineNnet3GstModels::OnlineNnet3GstModels(
+    const OnlineNnet3GstConfig &config,
+    const std::string &model_rxfilename,
+    const std::string &fst_rxfilename,
+    const std::string &word_syms_filename):
+    config_(config), model_rxfilename_(model_rxfilename),
+    fst_rxfilename_(fst_rxfilename), feature_info_(NULL), decode_fst_(NULL),
+    word_syms_(NULL), decodable_info_(NULL), batch_decoder_(NULL),
+    ref_count_(1) {
+  feature_info_ = new OnlineNnet2FeaturePipelineInfo(config_.feature_opts);
+  {
+    bool binary;
+    Input ki(model_rxfilename, &binary);
+    trans_model_.Read(ki.Stream(), binary);
+    am_nnet_.Read(ki.Stream(), binary);
+    SetBatchnormTestMode(true, &(am_nnet_.GetNnet()));
+    SetDropoutTestMode(true, &(am_nnet_.GetNnet()));
+    nnet3::CollapseModel(nnet3::CollapseModelConfig(), &(am_nnet_.GetNnet()));
+  }
+  decode_fst_ = ReadFstKaldiGeneric(fst_rxfilename);
+  if (!(word_syms_ = fst::SymbolTable::ReadText(word_syms_filename)))
+    KALDI_ERR << "Could not read symbol table from file "
+              << word_syms_filename;
+  if (config_.batch_group.empty()) {
+    decodable_info_ = new nnet3::DecodableNnetSimpleLoopedInfo(
+        config_.decodable_opts, &am_nnet_);
+  } else {
+    // The options shared with the looped computation are taken from it.
+    compute_opts_.acoustic_scale = config_.decodable_opts.acoustic_scale;
+    compute_opts_.frame_subsampling_factor =
+        config_.decodable_opts.frame_subsampling_factor;
+    compute_opts_.frames_per_chunk = config_.batch_frames_per_chunk;
+    compute_opts_.minibatch_size = config_.batch_minibatch_size;
+    batch_decoder_ = new OnlineNnet3BatchDecoder(
+        config_.batch_opts, compute_opts_, config_.decoder_opts,
+        *feature_info_, trans_model_, am_nnet_, *decode_fst_);
+  }
+}
+
+OnlineNnet3GstModels::~OnlineNnet3GstModels() {
+  delete batch_decoder_;
+  delete decodable_info_;
+  delete word_syms_;
+  delete decode_fst_;
+  delete feature_info_;
+}
+
+OnlineNnet3GstModels *OnlineNnet3GstModels::Acquire(
+    const OnlineNnet3GstConfig &config,
+    const std::string &model_rxfilename,
+    const std::string &fst_rxfilename,
+    const std::string &word_syms_filename,
+    std::string *error) {
+  try {
+    if (config.batch_group.empty())
+      return new OnlineNnet3GstModels(config, model_rxfilename,
+                                      fst_rxfilename, word_syms_filename);
+    std::lock_guard<std::mutex> lock(batch_groups_mutex);
+    std::map<std::string, OnlineNnet3GstModels*>::iterator iter =
+        batch_groups.find(config.batch_group);
+    if (iter != batch_groups.end()) {
+      OnlineNnet3GstModels *models = iter->second;
+      if (models->model_rxfilename_ != model_rxfilename ||
+          models->fst_rxfilename_ != fst_rxfilename) {
+        *error = "batch group " + config.batch_group + " uses model " +
+            models->model_rxfilename_ + " and fst " + models->fst_rxfilename_;
+        return NULL;
+      }
+      models->ref_count_++;
+      return models;
+    }
+    OnlineNnet3GstModels *models = new OnlineNnet3GstModels(
+        config, model_rxfilename, fst_rxfilename, word_syms_filename);
+    batch_groups[config.batch_group] = models;
+    return models;
+  } catch (const std::exception &e) {
+    *error = e.what();
+    return NULL;
+  }
+}
+
+void OnlineNnet3GstModels::Release(OnlineNnet3GstModels *models) {
+  if (models->config_.batch_group.empty()) {
+    delete models;
+    return;
+  }
+  std::lock_guard<std::mutex> lock(batch_groups_mutex);
+  if (--models->ref_count_ == 0) {
+    batch_groups.erase(models->config_.batch_group);
+    delete models;
+  }
+}
+
+
+GST_DEBUG_CATEGORY_STATIC(gst_online_nnet3_decode_debug);
+#define GST_CAT_DEFAULT gst_online_nnet3_decode_debug
+
+enum {
+  PARTIAL_RESULT_SIGNAL,
+  FINAL_RESULT_SIGNAL,
+  LAST_SIGNAL
+};
+
+enum {
+  PROP_0,
+  PROP_SILENT,
+  PROP_MODEL,
+  PROP_FST,
+  PROP_WORD_SYMS,
+  PROP_LAST
+};
+
+#define DEFAULT_MODEL           "final.mdl"
+#define DEFAULT_FST             "HCLG.fst"
+#define DEFAULT_WORD_SYMS       "words.txt"
+
+
+/* the capabilities of the inputs and outputs. */
+static GstStaticPadTemplate sink_factory =
+    GST_STATIC_PAD_TEMPLATE("sink",
+                            GST_PAD_SINK,
+                            GST_PAD_ALWAYS,
+                            GST_STATIC_CAPS(
+                                "audio/x-raw, "
+                                "format = (string) S16LE, "
+                                "channels = (int) 1, "
+                                "rate = (int) [ 1, MAX ] "));
+
+
+static GstStaticPadTemplate src_factory =
+    GST_STATIC_PAD_TEMPLATE("src",
+                            GST_PAD_SRC,
+                            GST_PAD_ALWAYS,
+                            GST_STATIC_CAPS("text/x-raw, format= { utf8 }"));
+
+static guint gst_online_nnet3_decode_signals[LAST_SIGNAL];
+
+// The names of the Kaldi options, indexed by property id minus PROP_LAST.
+// The property names are the same but with '.' replaced by '-', since GObject
+// does not allow dots in property names.
+static std::vector<std::string> *gst_online_nnet3_decode_option_names = NULL;
+
+#define gst_online_nnet3_decode_parent_class parent_class
+G_DEFINE_TYPE(GstOnlineNnet3Decode, gst_online_nnet3_decode, GST_TYPE_ELEMENT);
+
+
+static void
+gst_online_nnet3_decode_set_property(GObject * object, guint prop_id,
+                                     const GValue * value,
+                                     GParamSpec * pspec);
+static void
+gst_online_nnet3_decode_get_property(GObject * object, guint prop_id,
+                                     GValue * value, GParamSpec * pspec);
+static GstStateChangeReturn
+gst_online_nnet3_decode_change_state(GstElement *element,
+                                     GstStateChange transition);
+static void
+gst_online_nnet3_decode_finalize(GObject * object);
+
+static gboolean
+gst_online_nnet3_decode_sink_event(GstPad * pad, GstObject * parent,
+                                   GstEvent * event);
+
+static GstFlowReturn gst_online_nnet3_decode_chain(GstPad * pad,
+                                                   GstObject * parent,
+                                                   GstBuffer * buf);
+
+static void
+gst_online_nnet3_decode_loop(GstOnlineNnet3Decode * filter);
+
+
+/* GObject vmethod implementations */
+
+/* Installs a property for each of the Kaldi options, with the defaults of
+ * OnlineNnet3GstConfig.  We do this once for the class (not for each
+ * instance), so that there can be several instances. */
+static void
+gst_online_nnet3_decode_install_option_properties(GObjectClass *gobject_class) {
+  OnlineNnet3GstConfig config;
+  SimpleOptions simple_options;
+  config.Register(&simple_options);
+  gst_online_nnet3_decode_option_names = new std::vector<std::string>;
+
+  bool tmp_bool;
+  int32 tmp_int;
+  uint32 tmp_uint;
+  float tmp_float;
+  double tmp_double;
+  std::string tmp_string;
+  std::vector<std::pair<std::string, SimpleOptions::OptionInfo> >
+      option_info_list = simple_options.GetOptionInfoList();
+  for (size_t i = 0; i < option_info_list.size(); i++) {
+    const std::string &name = option_info_list[i].first;
+    const SimpleOptions::OptionInfo &option_info = option_info_list[i].second;
+    std::string prop_name(name);
+    std::replace(prop_name.begin(), prop_name.end(), '.', '-');
+    const gchar *doc = option_info.doc.c_str();
+    GParamFlags flags = (GParamFlags) G_PARAM_READWRITE;
+    GParamSpec *pspec = NULL;
+    switch (option_info.type) {
+      case SimpleOptions::kBool:
+        simple_options.GetOption(name, &tmp_bool);
+        pspec = g_param_spec_boolean(prop_name.c_str(), doc, doc, tmp_bool,
+                                     flags);
+        break;
+      case SimpleOptions::kInt32:
+        simple_options.GetOption(name, &tmp_int);
+        pspec = g_param_spec_int(prop_name.c_str(), doc, doc, G_MININT,
+                                 G_MAXINT, tmp_int, flags);
+        break;
+      case SimpleOptions::kUint32:
+        simple_options.GetOption(name, &tmp_uint);
+        pspec = g_param_spec_uint(prop_name.c_str(), doc, doc, 0, G_MAXUINT,
+                                  tmp_uint, flags);
+        break;
+      case SimpleOptions::kFloat:
+        simple_options.GetOption(name, &tmp_float);
+        pspec = g_param_spec_float(prop_name.c_str(), doc, doc, -G_MAXFLOAT,
+                                   G_MAXFLOAT, tmp_float, flags);
+        break;
+      case SimpleOptions::kDouble:
+        simple_options.GetOption(name, &tmp_double);
+        pspec = g_param_spec_double(prop_name.c_str(), doc, doc, -G_MAXDOUBLE,
+                                    G_MAXDOUBLE, tmp_double, flags);
+        break;
+      case SimpleOptions::kString:
+        simple_options.GetOption(name, &tmp_string);
+        pspec = g_param_spec_string(prop_name.c_str(), doc, doc,
+                                    tmp_string.c_str(), flags);
+        break;
+    }
+    g_object_class_install_property(
+        gobject_class, PROP_LAST + gst_online_nnet3_decode_option_names->size(),
+        pspec);
+    gst_online_nnet3_decode_option_names->push_back(name);
+  }
+}
+
+/* initialize the onlinennet3decode's class */
+static void gst_online_nnet3_decode_class_init(GstOnlineNnet3DecodeClass * klass) {
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+
+  gobject_class->set_property = gst_online_nnet3_decode_set_property;
+  gobject_class->get_property = gst_online_nnet3_decode_get_property;
+  gobject_class->finalize = gst_online_nnet3_decode_finalize;
+
+  gstelement_class->change_state = gst_online_nnet3_decode_change_state;
+
+  g_object_class_install_property(G_OBJECT_CLASS(klass),
+                                  PROP_SILENT,
+                                  g_param_spec_boolean("silent",
+                                                       "Silence the decoder",
+                                                       "Determines whether incoming audio is sent to the decoder or not",
+                                                       false,
+                                                       (GParamFlags) G_PARAM_READWRITE));
+  g_object_class_install_property(G_OBJECT_CLASS(klass),
+                                  PROP_MODEL,
+                                  g_param_spec_string("model",
+                                                      "Acoustic model",
+                                                      "Filename of the nnet3 acoustic model",
+                                                      DEFAULT_MODEL,
+                                                      (GParamFlags) G_PARAM_READWRITE));
+  g_object_class_install_property(G_OBJECT_CLASS(klass),
+                                  PROP_FST,
+                                  g_param_spec_string("fst",
+                                                      "Decoding FST",
+                                                      "Filename of the HCLG FST",
+                                                      DEFAULT_FST,
+                                                      (GParamFlags) G_PARAM_READWRITE));
+  g_object_class_install_property(G_OBJECT_CLASS(klass),
+                                  PROP_WORD_SYMS,
+                                  g_param_spec_string("word-syms",
+                                                      "Word symbols",
+                                                      "Name of word symbols file (typically words.txt)",
+                                                      DEFAULT_WORD_SYMS,
+                                                      (GParamFlags) G_PARAM_READWRITE));
+  gst_online_nnet3_decode_install_option_properties(gobject_class);
+
+  gst_element_class_set_details_simple(gstelement_class,
+                                       "OnlineNnet3Decode",
+                                       "Speech/Audio",
+                                       "Convert speech to text",
+                                       "Kaldi");
+
+  gst_element_class_add_pad_template(gstelement_class,
+                                     gst_static_pad_template_get(&src_factory));
+  gst_element_class_add_pad_template(gstelement_class,
+                                     gst_static_pad_template_get(&sink_factory));
+
+  gst_online_nnet3_decode_signals[PARTIAL_RESULT_SIGNAL]
+      = g_signal_new("partial-result", G_TYPE_FROM_CLASS(klass),
+                     G_SIGNAL_RUN_LAST,
+                     G_STRUCT_OFFSET(GstOnlineNnet3DecodeClass, partial_result),
+                     NULL, NULL, kaldi_marshal_VOID__STRING, G_TYPE_NONE, 1,
+                     G_TYPE_STRING);
+  gst_online_nnet3_decode_signals[FINAL_RESULT_SIGNAL]
+      = g_signal_new("final-result", G_TYPE_FROM_CLASS(klass),
+                     G_SIGNAL_RUN_LAST,
+                     G_STRUCT_OFFSET(GstOnlineNnet3DecodeClass, final_result),
+                     NULL, NULL, kaldi_marshal_VOID__STRING, G_TYPE_NONE, 1,
+                     G_TYPE_STRING);
+}
+
+
+/* initialize the new element
+ * instantiate pads and add them to element
+ * set pad calback functions
+ * initialize instance structure
+ */
+static void
+gst_online_nnet3_decode_init(GstOnlineNnet3Decode * filter) {
+  filter->silent_ = false;
+  filter->model_rspecifier_ = g_strdup(DEFAULT_MODEL);
+  filter->fst_rspecifier_ = g_strdup(DEFAULT_FST);
+  filter->word_syms_filename_ = g_strdup(DEFAULT_WORD_SYMS);
+
+  filter->config_ = new OnlineNnet3GstConfig();
+  filter->simple_options_ = new SimpleOptions();
+  filter->config_->Register(filter->simple_options_);
+
+  filter->models_ = NULL;
+  filter->sample_rate_ = 16000;
+  filter->audio_queue_ = new GstAudioQueue(
+      static_cast<int32>(filter->sample_rate_ *
+                         filter->config_->max_queued_audio) + 1);
+
+  filter->sinkpad_ = gst_pad_new_from_static_template(&sink_factory, "sink");
+  gst_pad_set_event_function(filter->sinkpad_,
+                             GST_DEBUG_FUNCPTR(gst_online_nnet3_decode_sink_event));
+  gst_pad_set_chain_function(filter->sinkpad_,
+                             GST_DEBUG_FUNCPTR(gst_online_nnet3_decode_chain));
+  gst_element_add_pad(GST_ELEMENT(filter), filter->sinkpad_);
+
+  filter->srcpad_ = gst_pad_new_from_static_template(&src_factory, "src");
+  gst_pad_use_fixed_caps(filter->srcpad_);
+  gst_element_add_pad(GST_ELEMENT(filter), filter->srcpad_);
+}
+
+static bool
+gst_online_nnet3_decode_allocate(GstOnlineNnet3Decode * filter) {
+  if (!filter->models_) {
+    GST_INFO_OBJECT(filter, "Loading Kaldi models");
+    std::string error;
+    filter->models_ = OnlineNnet3GstModels::Acquire(
+        *(filter->config_), filter->model_rspecifier_,
+        filter->fst_rspecifier_, filter->word_syms_filename_, &error);
+    if (!filter->models_) {
+      GST_ERROR_OBJECT(filter, "Could not load the models: %s",
+                       error.c_str());
+      return false;
+    }
+    if (!filter->config_->batch_group.empty() &&
+        filter->config_->do_endpointing)
+      GST_WARNING_OBJECT(filter, "do-endpointing is not supported with "
+                         "batch-group; each stream is one segment");
+    GST_INFO_OBJECT(filter, "Finished loading Kaldi models");
+  }
+  return true;
+}
+
+static void
+gst_online_nnet3_decode_finalize(GObject * object) {
+  GstOnlineNnet3Decode *filter = GST_ONLINENNET3DECODE(object);
+
+  g_free(filter->model_rspecifier_);
+  g_free(filter->fst_rspecifier_);
+  g_free(filter->word_syms_filename_);
+  if (filter->models_) {
+    OnlineNnet3GstModels::Release(filter->models_);
+    filter->models_ = NULL;
+  }
+  delete filter->audio_queue_;
+  filter->audio_queue_ = NULL;
+  delete filter->simple_options_;
+  filter->simple_options_ = NULL;
+  delete filter->config_;
+  filter->config_ = NULL;
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void
+gst_online_nnet3_decode_set_property(GObject * object, guint prop_id,
+                                     const GValue * value, GParamSpec * pspec) {
+  GstOnlineNnet3Decode *filter = GST_ONLINENNET3DECODE(object);
+
+  if (prop_id == PROP_SILENT) {
+    filter->silent_ = g_value_get_boolean(value);
+    return;
+  }
+  // All other props cannot be changed after the models are loaded.
+  if (filter->models_) {
+    GST_WARNING_OBJECT(filter, "Decoder already initialized, cannot change its properties");
+    return;
+  }
+  switch (prop_id) {
+    case PROP_MODEL:
+      g_free(filter->model_rspecifier_);
+      filter->model_rspecifier_ = g_value_dup_string(value);
+      break;
+    case PROP_FST:
+      g_free(filter->fst_rspecifier_);
+      filter->fst_rspecifier_ = g_value_dup_string(value);
+      break;
+    case PROP_WORD_SYMS:
+      g_free(filter->word_syms_filename_);
+      filter->word_syms_filename_ = g_value_dup_string(value);
+      break;
+    default:
+      if (prop_id >= PROP_LAST && prop_id - PROP_LAST <
+          gst_online_nnet3_decode_option_names->size()) {
+        const std::string &name =
+            (*gst_online_nnet3_decode_option_names)[prop_id - PROP_LAST];
+        SimpleOptions::OptionType option_type;
+        if (filter->simple_options_->GetOptionType(name, &option_type)) {
+          switch (option_type) {
+            case SimpleOptions::kBool:
+              filter->simple_options_->SetOption(
+                  name, static_cast<bool>(g_value_get_boolean(value)));
+              break;
+            case SimpleOptions::kInt32:
+              filter->simple_options_->SetOption(name, g_value_get_int(value));
+              break;
+            case SimpleOptions::kUint32:
+              filter->simple_options_->SetOption(name, g_value_get_uint(value));
+              break;
+            case SimpleOptions::kFloat:
+              filter->simple_options_->SetOption(name, g_value_get_float(value));
+              break;
+            case SimpleOptions::kDouble:
+              filter->simple_options_->SetOption(name, g_value_get_double(value));
+              break;
+            case SimpleOptions::kString:
+              filter->simple_options_->SetOption(
+                  name, std::string(g_value_get_string(value) ?
+                                    g_value_get_string(value) : ""));
+              break;
+          }
+          break;
+        }
+      }
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_online_nnet3_decode_get_property(GObject * object, guint prop_id,
+                                     GValue * value, GParamSpec * pspec) {
+  bool tmp_bool;
+  int32 tmp_int;
+  uint32 tmp_uint;
+  float tmp_float;
+  double tmp_double;
+  std::string tmp_string;
+
+  GstOnlineNnet3Decode *filter = GST_ONLINENNET3DECODE(object);
+
+  switch (prop_id) {
+    case PROP_SILENT:
+      g_value_set_boolean(value, filter->silent_);
+      break;
+    case PROP_MODEL:
+      g_value_set_string(value, filter->model_rspecifier_);
+      break;
+    case PROP_FST:
+      g_value_set_string(value, filter->fst_rspecifier_);
+      break;
+    case PROP_WORD_SYMS:
+      g_value_set_string(value, filter->word_syms_filename_);
+      break;
+    default:
+      if (prop_id >= PROP_LAST && prop_id - PROP_LAST <
+          gst_online_nnet3_decode_option_names->size()) {
+        const std::string &name =
+            (*gst_online_nnet3_decode_option_names)[prop_id - PROP_LAST];
+        SimpleOptions::OptionType option_type;
+        if (filter->simple_options_->GetOptionType(name, &option_type)) {
+          switch (option_type) {
+            case SimpleOptions::kBool:
+              filter->simple_options_->GetOption(name, &tmp_bool);
+              g_value_set_boolean(value, tmp_bool);
+              break;
+            case SimpleOptions::kInt32:
+              filter->simple_options_->GetOption(name, &tmp_int);
+              g_value_set_int(value, tmp_int);
+              break;
+            case SimpleOptions::kUint32:
+              filter->simple_options_->GetOption(name, &tmp_uint);
+              g_value_set_uint(value, tmp_uint);
+              break;
+            case SimpleOptions::kFloat:
+              filter->simple_options_->GetOption(name, &tmp_float);
+              g_value_set_float(value, tmp_float);
+              break;
+            case SimpleOptions::kDouble:
+              filter->simple_options_->GetOption(name, &tmp_double);
+              g_value_set_double(value, tmp_double);
+              break;
+            case SimpleOptions::kString:
+              filter->simple_options_->GetOption(name, &tmp_string);
+              g_value_set_string(value, tmp_string.c_str());
+              break;
+          }
+          break;
+        }
+      }
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+}
+
+
+static GstStateChangeReturn
+gst_online_nnet3_decode_change_state(GstElement *element, GstStateChange transition) {
+  GstStateChangeReturn ret = GST_STATE_CHANGE_SUCCESS;
+  GstOnlineNnet3Decode *filter = GST_ONLINENNET3DECODE(element);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      if (!gst_online_nnet3_decode_allocate(filter))
+        return GST_STATE_CHANGE_FAILURE;
+      break;
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      filter->audio_queue_->SetFlushing(false);
+      filter->audio_queue_->Reset();
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      // Unblock the streaming thread and the decoding task, then stop the
+      // task.
+      filter->audio_queue_->SetFlushing(true);
+      gst_pad_stop_task(filter->srcpad_);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    return ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      /* We won't release the models once they are loaded, since model loading
+         could take a lot of time */
+      GST_INFO_OBJECT(filter, "Refusing to unload models");
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+/* Converts the word sequence of a linear lattice to text. */
+static std::string
+gst_online_nnet3_decode_lattice_to_text(GstOnlineNnet3Decode * filter,
+                                        const Lattice &lat) {
+  std::vector<int32> words;
+  fst::GetLinearSymbolSequence(lat, static_cast<std::vector<int32> *>(0),
+                               &words, static_cast<LatticeWeight*>(0));
+  const fst::SymbolTable &word_syms = filter->models_->WordSyms();
+  std::ostringstream ss;
+  for (size_t i = 0; i < words.size(); i++) {
+    std::string word = word_syms.Find(words[i]);
+    if (word == "")
+      GST_ERROR_OBJECT(filter, "Word-id %d not in symbol table!", words[i]);
+    if (i > 0)
+      ss << ' ';
+    ss << word;
+  }
+  return ss.str();
+}
+
+static std::string
+gst_online_nnet3_decode_lattice_to_text(GstOnlineNnet3Decode * filter,
+                                        const CompactLattice &clat) {
+  if (clat.NumStates() == 0)
+    return "";
+  CompactLattice best_path_clat;
+  CompactLatticeShortestPath(clat, &best_path_clat);
+  Lattice best_path_lat;
+  ConvertLattice(best_path_clat, &best_path_lat);
+  return gst_online_nnet3_decode_lattice_to_text(filter, best_path_lat);
+}
+
+static void
+gst_online_nnet3_decode_push_partial(GstOnlineNnet3Decode * filter,
+                                     const std::string &text) {
+  GST_DEBUG_OBJECT(filter, "PARTIAL: %s", text.c_str());
+  g_signal_emit(filter, gst_online_nnet3_decode_signals[PARTIAL_RESULT_SIGNAL],
+                0, text.c_str());
+}
+
+/*
+ * Emit the final result of a segment:
+ *   * as a line of text through the source pad of the element
+ *   * by the final-result signal
+ */
+static void
+gst_online_nnet3_decode_push_final(GstOnlineNnet3Decode * filter,
+                                   const std::string &text) {
+  GST_DEBUG_OBJECT(filter, "FINAL: %s", text.c_str());
+  std::string line = text + "\n";
+  GstBuffer *buffer = gst_buffer_new_and_alloc(line.size());
+  gst_buffer_fill(buffer, 0, line.c_str(), line.size());
+  gst_pad_push(filter->srcpad_, buffer);
+  g_signal_emit(filter, gst_online_nnet3_decode_signals[FINAL_RESULT_SIGNAL],
+                0, text.c_str());
+}
+
+/* Decodes one stream with SingleUtteranceNnet3Decoder, starting a new
+ * segment at each endpoint if do-endpointing is true. */
+static void
+gst_online_nnet3_decode_stream(GstOnlineNnet3Decode * filter) {
+  const OnlineNnet3GstModels &models = *(filter->models_);
+  const OnlineNnet3GstConfig &config = models.Config();
+  BaseFloat samp_freq = filter->sample_rate_;
+  int32 partial_period = static_cast<int32>(config.partial_result_period *
+                                            samp_freq),
+      samp_count = 0, next_partial = partial_period;
+
+  OnlineNnet2FeaturePipeline feature_pipeline(models.FeatureInfo());
+  SingleUtteranceNnet3Decoder decoder(config.decoder_opts,
+                                      models.GetTransitionModel(),
+                                      *(models.DecodableInfo()),
+                                      models.DecodeFst(), &feature_pipeline);
+  int32 frame_offset = 0;
+  bool eos = false;
+  while (!eos) {
+    decoder.InitDecoding(frame_offset);
+    OnlineSilenceWeighting silence_weighting(
+        models.GetTransitionModel(),
+        models.FeatureInfo().silence_weighting_config,
+        config.decodable_opts.frame_subsampling_factor);
+    std::vector<std::pair<int32, BaseFloat> > delta_weights;
+
+    while (true) {
+      Vector<BaseFloat> wave_part;
+      eos = !filter->audio_queue_->Pop(&wave_part);
+      if (eos) {
+        feature_pipeline.InputFinished();
+        decoder.AdvanceDecoding();
+        decoder.FinalizeDecoding();
+        if (decoder.NumFramesDecoded() > 0) {
+          CompactLattice clat;
+          decoder.GetLattice(true, &clat);
+          gst_online_nnet3_decode_push_final(
+              filter, gst_online_nnet3_decode_lattice_to_text(filter, clat));
+        }
+        break;
+      }
+      feature_pipeline.AcceptWaveform(samp_freq, wave_part);
+      samp_count += wave_part.Dim();
+
+      if (silence_weighting.Active() &&
+          feature_pipeline.IvectorFeature() != NULL) {
+        silence_weighting.ComputeCurrentTraceback(decoder.Decoder());
+        silence_weighting.GetDeltaWeights(
+            feature_pipeline.NumFramesReady(),
+            frame_offset * config.decodable_opts.frame_subsampling_factor,
+            &delta_weights);
+        feature_pipeline.UpdateFrameWeights(delta_weights);
+      }
+      decoder.AdvanceDecoding();
+
+      if (config.do_endpointing && decoder.EndpointDetected(
+              config.endpoint_opts)) {
+        decoder.FinalizeDecoding();
+        frame_offset += decoder.NumFramesDecoded();
+        CompactLattice clat;
+        decoder.GetLattice(true, &clat);
+        gst_online_nnet3_decode_push_final(
+            filter, gst_online_nnet3_decode_lattice_to_text(filter, clat));
+        break;
+      }
+      if (partial_period > 0 && samp_count >= next_partial) {
+        if (decoder.NumFramesDecoded() > 0) {
+          Lattice lat;
+          decoder.GetBestPath(false, &lat);
+          gst_online_nnet3_decode_push_partial(
+              filter, gst_online_nnet3_decode_lattice_to_text(filter, lat));
+        }
+        next_partial = samp_count + partial_period;
+      }
+    }
+  }
+}
+
+/* Decodes one stream with the OnlineNnet3BatchDecoder of the element's batch
+ * group. */
+static void
+gst_online_nnet3_decode_stream_batched(GstOnlineNnet3Decode * filter) {
+  const OnlineNnet3GstConfig &config = filter->models_->Config();
+  OnlineNnet3BatchDecoder *batch_decoder = filter->models_->BatchDecoder();
+  BaseFloat samp_freq = filter->sample_rate_;
+  int32 partial_period = static_cast<int32>(config.partial_result_period *
+                                            samp_freq),
+      samp_count = 0, next_partial = partial_period;
+
+  int32 stream_id = batch_decoder->OpenStream();
+  Vector<BaseFloat> wave_part;
+  while (filter->audio_queue_->Pop(&wave_part)) {
+    batch_decoder->AcceptWaveform(stream_id, samp_freq, wave_part);
+    samp_count += wave_part.Dim();
+    if (partial_period > 0 && samp_count >= next_partial) {
+      Lattice lat;
+      if (batch_decoder->GetBestPath(stream_id, &lat))
+        gst_online_nnet3_decode_push_partial(
+            filter, gst_online_nnet3_decode_lattice_to_text(filter, lat));
+      next_partial = samp_count + partial_period;
+    }
+  }
+  batch_decoder->InputFinished(stream_id);
+  CompactLattice clat;
+  if (batch_decoder->GetLattice(stream_id, &clat))
+    gst_online_nnet3_decode_push_final(
+        filter, gst_online_nnet3_decode_lattice_to_text(filter, clat));
+  batch_decoder->CloseStream(stream_id);
+}
+
+/* The function run by the task of the source pad: decodes the audio of one
+ * stream, then pushes EOS (unless the stream was interrupted by flushing)
+ * and pauses the task. */
+static void
+gst_online_nnet3_decode_loop(GstOnlineNnet3Decode * filter) {
+  GST_DEBUG_OBJECT(filter, "starting decoding loop");
+  try {
+    if (filter->models_->BatchDecoder() != NULL)
+      gst_online_nnet3_decode_stream_batched(filter);
+    else
+      gst_online_nnet3_decode_stream(filter);
+  } catch (const std::exception &e) {
+    GST_ELEMENT_ERROR(filter, STREAM, DECODE, (NULL),
+                      ("Decoding failed: %s", e.what()));
+  }
+  GST_DEBUG_OBJECT(filter, "Finished decoding loop");
+  if (!filter->audio_queue_->IsFlushing()) {
+    GST_DEBUG_OBJECT(filter, "Pushing EOS event");
+    gst_pad_push_event(filter->srcpad_, gst_event_new_eos());
+  }
+
+  GST_DEBUG_OBJECT(filter, "Pausing decoding task");
+  gst_pad_pause_task(filter->srcpad_);
+  filter->audio_queue_->Reset();
+}
+
+/* GstElement vmethod implementations */
+/* this function handles sink events */
+static gboolean
+gst_online_nnet3_decode_sink_event(GstPad * pad, GstObject * parent, GstEvent * event) {
+  gboolean ret;
+  GstOnlineNnet3Decode *filter;
+
+  filter = GST_ONLINENNET3DECODE(parent);
+  GST_DEBUG_OBJECT(filter, "Handling %s event", GST_EVENT_TYPE_NAME(event));
+
+  switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_SEGMENT:
+    {
+      ret = gst_pad_event_default(pad, parent, event);
+      GST_DEBUG_OBJECT(filter, "Starting decoding task");
+      gst_pad_start_task(filter->srcpad_,
+                         (GstTaskFunction) gst_online_nnet3_decode_loop, filter, NULL);
+      GST_DEBUG_OBJECT(filter, "Started decoding task");
+      break;
+    }
+    case GST_EVENT_CAPS:
+    {
+      GstCaps *caps;
+      gst_event_parse_caps(event, &caps);
+      GstStructure *structure = gst_caps_get_structure(caps, 0);
+      gint rate;
+      if (gst_structure_get_int(structure, "rate", &rate)) {
+        filter->sample_rate_ = rate;
+        filter->audio_queue_->SetMaxSamples(
+            static_cast<int32>(rate * filter->config_->max_queued_audio) + 1);
+      }
+      gst_event_unref(event);
+      // The output is text, not audio.
+      GstCaps *src_caps = gst_caps_new_simple("text/x-raw", "format",
+                                              G_TYPE_STRING, "utf8", NULL);
+      ret = gst_pad_push_event(filter->srcpad_, gst_event_new_caps(src_caps));
+      gst_caps_unref(src_caps);
+      break;
+    }
+    case GST_EVENT_FLUSH_START:
+    {
+      filter->audio_queue_->SetFlushing(true);
+      ret = gst_pad_event_default(pad, parent, event);
+      break;
+    }
+    case GST_EVENT_FLUSH_STOP:
+    {
+      filter->audio_queue_->SetFlushing(false);
+      filter->audio_queue_->Reset();
+      ret = gst_pad_event_default(pad, parent, event);
+      break;
+    }
+    case GST_EVENT_EOS:
+    {
+      /* end-of-stream: the decoding task pushes EOS when it has decoded
+         all the audio */
+      GST_DEBUG_OBJECT(filter, "EOS received");
+      filter->audio_queue_->SetEnded();
+      gst_event_unref(event);
+      ret = TRUE;
+      break;
+    }
+    default:
+      ret = gst_pad_event_default(pad, parent, event);
+      break;
+  }
+  return ret;
+}
+
+/* chain function
+ * this function gives the audio to the decoding task, waiting if its queue
+ * is full
+ */
+static GstFlowReturn gst_online_nnet3_decode_chain(GstPad * pad,
+                                                   GstObject * parent,
+                                                   GstBuffer * buf) {
+  GstOnlineNnet3Decode *filter;
+
+  filter = GST_ONLINENNET3DECODE(parent);
+
+  if (G_UNLIKELY(!filter->models_))
+    goto not_negotiated;
+  if (!filter->silent_) {
+    if (!filter->audio_queue_->Push(buf)) {
+      gst_buffer_unref(buf);
+      return GST_FLOW_FLUSHING;
+    }
+  }
+  gst_buffer_unref(buf);
+  return GST_FLOW_OK;
+
+  /* special cases */
+  not_negotiated: {
+    GST_ELEMENT_ERROR(filter, CORE, NEGOTIATION, (NULL),
+                      ("models weren't loaded before chain function"));
+
+    gst_buffer_unref(buf);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+}
+
+
+/* entry point to initialize the plug-in
+ * initialize the plug-in itself
+ * register the element factories and other features
+ */
+static gboolean
+onlinennet3decode_init(GstPlugin * onlinennet3decode) {
+  /* debug category for fltering log messages
+   */
+  GST_DEBUG_CATEGORY_INIT(gst_online_nnet3_decode_debug, "onlinennet3decode",
+                          0, "Automatic Speech Recognition");
+
+  return gst_element_register(onlinennet3decode, "onlinennet3decode", GST_RANK_NONE,
+                              GST_TYPE_ONLINENNET3DECODE);
+}
+
+#ifndef PACKAGE
+#define PACKAGE "onlinennet3decode"
+#endif
+
+GST_PLUGIN_DEFINE(
+    GST_VERSION_MAJOR,
+    GST_VERSION_MINOR,
+    onlinennet3decode,
+    "Online speech recognizer with nnet3 models based on the Kaldi toolkit",
+    onlinennet3decode_init,
+    VERSION,
+    "LGPL",  // Changing it into Apache prevents the plugin from loading, see gst/gstplugin.c in GStreamer source
+    "Kaldi",
+    "http://kaldi-asr.org/"
+)
+}
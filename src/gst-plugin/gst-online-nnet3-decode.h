@@ -0,0 +1,185 @@
+// gst-plugin/gst-online-nnet3-decode.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_GST_PLUGIN_GST_ONLINE_NNET3_DECODE_H_
+#define KALDI_GST_PLUGIN_GST_ONLINE_NNET3_DECODE_H_
+
+#include <string>
+#include <gst/gst.h>
+
+#include "decoder/lattice-faster-decoder.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/decodable-simple-looped.h"
+#include "nnet3/nnet-batch-compute.h"
+#include "online2/online-endpoint.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "online2/online-nnet3-batch-decoding.h"
+#include "util/simple-options.h"
+#include "gst-plugin/gst-audio-queue.h"
+
+namespace kaldi {
+
+
+// The Kaldi options of the onlinennet3decode element; each of them is exposed
+// as a property of the element.
+struct OnlineNnet3GstConfig {
+  OnlineNnet2FeaturePipelineConfig feature_opts;
+  nnet3::NnetSimpleLoopedComputationOptions decodable_opts;
+  LatticeFasterDecoderConfig decoder_opts;
+  OnlineEndpointConfig endpoint_opts;
+  OnlineNnet3BatchDecoderConfig batch_opts;
+  bool do_endpointing;
+  BaseFloat max_queued_audio;
+  BaseFloat partial_result_period;
+  std::string batch_group;
+  int32 batch_minibatch_size;
+  int32 batch_frames_per_chunk;
+
+  OnlineNnet3GstConfig(): do_endpointing(true), max_queued_audio(2.0),
+                          partial_result_period(0.5),
+                          batch_minibatch_size(16),
+                          batch_frames_per_chunk(51) { }
+
+  void Register(OptionsItf *opts) {
+    feature_opts.Register(opts);
+    decodable_opts.Register(opts);
+    decoder_opts.Register(opts);
+    endpoint_opts.Register(opts);
+    opts->Register("do-endpointing", &do_endpointing, "If true, output a "
+                   "final result and start a new utterance at each endpoint "
+                   "(not supported with batch-group)");
+    opts->Register("max-queued-audio", &max_queued_audio, "Seconds of audio "
+                   "that may wait to be decoded before the element blocks the "
+                   "upstream elements");
+    opts->Register("partial-result-period", &partial_result_period,
+                   "Seconds of audio between partial results (0 for none)");
+    opts->Register("batch-group", &batch_group, "If nonempty, the elements "
+                   "with the same batch-group share one copy of the models "
+                   "and compute the neural net for all their streams together "
+                   "in minibatches.  The models and options are those of the "
+                   "first element of the group to start.");
+    batch_opts.Register(opts);
+    opts->Register("batch-minibatch-size", &batch_minibatch_size, "With "
+                   "batch-group: number of chunks per minibatch");
+    opts->Register("batch-frames-per-chunk", &batch_frames_per_chunk, "With "
+                   "batch-group: number of frames per chunk (the chunks are "
+                   "computed with left and right context, not looped)");
+  }
+};
+
+
+// The models used by onlinennet3decode elements.  An element with an empty
+// batch-group has its own; the elements of a batch group share one, which
+// also holds the OnlineNnet3BatchDecoder that decodes all their streams.
+class OnlineNnet3GstModels {
+ public:
+  // Returns the models for an element with these options, loading them if
+  // necessary; returns NULL and sets 'error' on failure.  Each successful call
+  // must be matched by a call to Release().
+  static OnlineNnet3GstModels *Acquire(const OnlineNnet3GstConfig &config,
+                                       const std::string &model_rxfilename,
+                                       const std::string &fst_rxfilename,
+                                       const std::string &word_syms_filename,
+                                       std::string *error);
+
+  static void Release(OnlineNnet3GstModels *models);
+
+  const OnlineNnet3GstConfig &Config() const { return config_; }
+  const OnlineNnet2FeaturePipelineInfo &FeatureInfo() const {
+    return *feature_info_;
+  }
+  const TransitionModel &GetTransitionModel() const { return trans_model_; }
+  const fst::Fst<fst::StdArc> &DecodeFst() const { return *decode_fst_; }
+  const fst::SymbolTable &WordSyms() const { return *word_syms_; }
+  // NULL if batched.
+  const nnet3::DecodableNnetSimpleLoopedInfo *DecodableInfo() const {
+    return decodable_info_;
+  }
+  // NULL if not batched.
+  OnlineNnet3BatchDecoder *BatchDecoder() const { return batch_decoder_; }
+
+ private:
+  OnlineNnet3GstModels(const OnlineNnet3GstConfig &config,
+                       const std::string &model_rxfilename,
+                       const std::string &fst_rxfilename,
+                       const std::string &word_syms_filename);
+  ~OnlineNnet3GstModels();
+
+  OnlineNnet3GstConfig config_;
+  std::string model_rxfilename_;
+  std::string fst_rxfilename_;
+  OnlineNnet2FeaturePipelineInfo *feature_info_;
+  TransitionModel trans_model_;
+  nnet3::AmNnetSimple am_nnet_;
+  fst::Fst<fst::StdArc> *decode_fst_;
+  fst::SymbolTable *word_syms_;
+  nnet3::DecodableNnetSimpleLoopedInfo *decodable_info_;
+  nnet3::NnetBatchComputerOptions compute_opts_;
+  OnlineNnet3BatchDecoder *batch_decoder_;
+  int32 ref_count_;  // guarded by the registry's mutex.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(OnlineNnet3GstModels);
+};
+
+
+G_BEGIN_DECLS
+
+/* #defines don't like whitespacey bits */
+#define GST_TYPE_ONLINENNET3DECODE \
+    (gst_online_nnet3_decode_get_type())
+#define GST_ONLINENNET3DECODE(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ONLINENNET3DECODE,GstOnlineNnet3Decode))
+#define GST_ONLINENNET3DECODE_CLASS(klass) \
+    (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_ONLINENNET3DECODE,GstOnlineNnet3DecodeClass))
+#define GST_IS_ONLINENNET3DECODE(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ONLINENNET3DECODE))
+#define GST_IS_ONLINENNET3DECODE_CLASS(klass) \
+    (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ONLINENNET3DECODE))
+
+typedef struct _GstOnlineNnet3Decode      GstOnlineNnet3Decode;
+typedef struct _GstOnlineNnet3DecodeClass GstOnlineNnet3DecodeClass;
+
+struct _GstOnlineNnet3Decode {
+  GstElement element;
+
+  GstPad *sinkpad_, *srcpad_;
+
+  bool silent_;
+
+  gchar* model_rspecifier_;
+  gchar* fst_rspecifier_;
+  gchar* word_syms_filename_;
+
+  OnlineNnet3GstConfig *config_;
+  SimpleOptions *simple_options_;
+
+  OnlineNnet3GstModels *models_;
+  GstAudioQueue *audio_queue_;
+  gint sample_rate_;
+};
+
+struct _GstOnlineNnet3DecodeClass {
+  GstElementClass parent_class;
+  void (*partial_result)(GstElement *element, const gchar *hyp_str);
+  void (*final_result)(GstElement *element, const gchar *hyp_str);
+};
+
+GType gst_online_nnet3_decode_get_type(void);
+
+G_END_DECLS
+}
+#endif  // KALDI_GST_PLUGIN_GST_ONLINE_NNET3_DECODE_H_
@@ -81,6 +81,69 @@ void TestPosteriorIo() {
     }
   }
 }
+
+void TestCompactPosterior() {
+  Posterior post(RandInt(0, 20));
+  for (int32 i = 0; i < post.size(); i++) {
+    int32 s = RandInt(0, 3);
+    for (int32 j = 0; j < s; j++)
+      post[i].push_back(std::pair<int32,BaseFloat>(
+          RandInt(1, 10), RandUniform()));
+  }
+  CompactPosterior cpost(post);
+  Posterior post2;
+  cpost.CopyToPosterior(&post2);
+  KALDI_ASSERT(post == post2);
+  KALDI_ASSERT(ApproxEqual(cpost.Total(), TotalPosterior(post)));
+
+  // The I/O format is the same as that of Posterior.
+  bool binary = (RandInt(0, 1) == 0);
+  std::ostringstream os;
+  WritePosterior(os, binary, post);
+  CompactPosterior cpost2;
+  std::istringstream is(os.str());
+  cpost2.Read(is, binary);
+  std::ostringstream os2;
+  cpost.Write(os2, binary);
+  KALDI_ASSERT(os.str() == os2.str() &&
+               cpost2.NumElements() == cpost.NumElements());
+
+  BaseFloat scale = RandUniform();
+  cpost.Scale(scale);
+  ScalePosterior(scale, &post);
+  cpost.CopyToPosterior(&post2);
+  KALDI_ASSERT(post == post2);
+
+  Posterior other(post.size());
+  for (int32 i = 0; i < other.size(); i++)
+    if (RandInt(0, 1) == 0)
+      other[i].push_back(std::pair<int32,BaseFloat>(RandInt(1, 10), 1.0));
+  bool merge = (RandInt(0, 1) == 0), drop_frames = (RandInt(0, 1) == 0);
+  post2.clear();  // MergePosteriors() appends to the output.
+  int32 num_disjoint = MergePosteriors(post, other, merge, drop_frames,
+                                       &post2);
+  KALDI_ASSERT(cpost.Merge(CompactPosterior(other), merge, drop_frames) ==
+               num_disjoint);
+  Posterior post3;
+  cpost.CopyToPosterior(&post3);
+  KALDI_ASSERT(post2 == post3);
+
+  cpost.SortFrames();
+  for (int32 i = 0; i < post2.size(); i++)
+    MergePairVectorSumming(&(post2[i]));
+  cpost.CopyToPosterior(&post3);
+  KALDI_ASSERT(post2 == post3);
+
+  if (post2.size() > 0) {
+    int32 first = RandInt(0, post2.size() - 1),
+        num_frames = RandInt(0, post2.size() - first);
+    cpost.SelectFrames(first, num_frames);
+    cpost.CopyToPosterior(&post3);
+    KALDI_ASSERT(post3.size() == num_frames &&
+                 std::equal(post3.begin(), post3.end(),
+                            post2.begin() + first));
+  }
+}
 }
 
 int main() {
@@ -88,6 +151,7 @@ int main() {
   for (int i = 0; i < 10; i++) {
     kaldi::TestVectorToPosteriorEntry();
     kaldi::TestPosteriorIo();
+    kaldi::TestCompactPosterior();
   }
   std::cout << "Test OK.\n";
 }
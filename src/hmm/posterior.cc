@@ -153,6 +153,300 @@ bool PosteriorHolder::Read(std::istream &is) {
   }
 }
 
+void CompactPosterior::CopyFromPosterior(const Posterior &post) {
+  int32 num_frames = post.size(), num_elements = 0;
+  for (int32 t = 0; t < num_frames; t++)
+    num_elements += post[t].size();
+  Clear();
+  Reserve(num_frames, num_elements);
+  for (int32 t = 0; t < num_frames; t++) {
+    AddFrame();
+    for (size_t i = 0; i < post[t].size(); i++)
+      AddElement(post[t][i].first, post[t][i].second);
+  }
+}
+
+void CompactPosterior::CopyToPosterior(Posterior *post) const {
+  int32 num_frames = NumFrames();
+  post->clear();
+  post->resize(num_frames);
+  for (int32 t = 0; t < num_frames; t++) {
+    std::vector<std::pair<int32, BaseFloat> > &this_post = (*post)[t];
+    this_post.resize(FrameSize(t));
+    for (int32 i = row_offsets_[t], j = 0; i < row_offsets_[t + 1]; i++, j++)
+      this_post[j] = std::make_pair(ids_[i], weights_[i]);
+  }
+}
+
+void CompactPosterior::Reserve(int32 num_frames, int32 num_elements) {
+  row_offsets_.reserve(num_frames + 1);
+  ids_.reserve(num_elements);
+  weights_.reserve(num_elements);
+}
+
+void CompactPosterior::Clear() {
+  row_offsets_.resize(1);
+  row_offsets_[0] = 0;
+  ids_.clear();
+  weights_.clear();
+}
+
+void CompactPosterior::Swap(CompactPosterior *other) {
+  row_offsets_.swap(other->row_offsets_);
+  ids_.swap(other->ids_);
+  weights_.swap(other->weights_);
+}
+
+void CompactPosterior::Scale(BaseFloat scale) {
+  for (size_t i = 0; i < weights_.size(); i++)
+    weights_[i] *= scale;
+}
+
+BaseFloat CompactPosterior::Total() const {
+  double sum = 0.0;
+  for (size_t i = 0; i < weights_.size(); i++)
+    sum += weights_[i];
+  return sum;
+}
+
+// static
+void CompactPosterior::AppendFrame(
+    const std::vector<std::pair<int32, BaseFloat> > &pairs,
+    std::vector<int32> *new_offsets,
+    std::vector<int32> *new_ids,
+    std::vector<BaseFloat> *new_weights) {
+  for (size_t i = 0; i < pairs.size(); i++) {
+    new_ids->push_back(pairs[i].first);
+    new_weights->push_back(pairs[i].second);
+  }
+  new_offsets->push_back(new_ids->size());
+}
+
+void CompactPosterior::SortFrames() {
+  int32 num_frames = NumFrames();
+  std::vector<int32> new_offsets(1, 0), new_ids;
+  std::vector<BaseFloat> new_weights;
+  new_offsets.reserve(num_frames + 1);
+  new_ids.reserve(ids_.size());
+  new_weights.reserve(weights_.size());
+  std::vector<std::pair<int32, BaseFloat> > pairs;
+  for (int32 t = 0; t < num_frames; t++) {
+    pairs.clear();
+    for (int32 i = row_offsets_[t]; i < row_offsets_[t + 1]; i++)
+      pairs.push_back(std::make_pair(ids_[i], weights_[i]));
+    MergePairVectorSumming(&pairs);
+    AppendFrame(pairs, &new_offsets, &new_ids, &new_weights);
+  }
+  row_offsets_.swap(new_offsets);
+  ids_.swap(new_ids);
+  weights_.swap(new_weights);
+}
+
+void CompactPosterior::WeightSilence(const TransitionModel &trans_model,
+                                     const ConstIntegerSet<int32> &silence_set,
+                                     BaseFloat silence_scale,
+                                     bool distribute) {
+  // We compact the arrays as we go: elements are never moved to a later
+  // position, so we can write to the same arrays that we read from.
+  int32 num_frames = NumFrames(), out = 0;
+  for (int32 t = 0; t < num_frames; t++) {
+    int32 begin = row_offsets_[t], end = row_offsets_[t + 1];
+    row_offsets_[t] = out;
+    if (!distribute) {
+      for (int32 i = begin; i < end; i++) {
+        int32 tid = ids_[i];
+        BaseFloat weight = weights_[i];
+        if (silence_set.count(trans_model.TransitionIdToPhone(tid)) != 0) {
+          if (silence_scale == 0.0) continue;
+          weight *= silence_scale;
+        }
+        ids_[out] = tid;
+        weights_[out] = weight;
+        out++;
+      }
+    } else {
+      BaseFloat sil_weight = 0.0, nonsil_weight = 0.0;
+      for (int32 i = begin; i < end; i++) {
+        int32 phone = trans_model.TransitionIdToPhone(ids_[i]);
+        if (silence_set.count(phone) != 0) sil_weight += weights_[i];
+        else nonsil_weight += weights_[i];
+      }
+      KALDI_ASSERT(sil_weight >= 0.0 && nonsil_weight >= 0.0);
+      BaseFloat frame_scale = 1.0;
+      if (sil_weight + nonsil_weight != 0.0)
+        frame_scale = (sil_weight * silence_scale + nonsil_weight) /
+            (sil_weight + nonsil_weight);
+      if (frame_scale == 0.0) continue;
+      for (int32 i = begin; i < end; i++) {
+        ids_[out] = ids_[i];
+        weights_[out] = weights_[i] * frame_scale;
+        out++;
+      }
+    }
+  }
+  row_offsets_[num_frames] = out;
+  ids_.resize(out);
+  weights_.resize(out);
+}
+
+int32 CompactPosterior::Merge(const CompactPosterior &other,
+                              bool merge, bool drop_frames) {
+  KALDI_ASSERT(NumFrames() == other.NumFrames());
+  int32 num_frames = NumFrames(), num_disjoint = 0;
+  std::vector<int32> new_offsets(1, 0), new_ids;
+  std::vector<BaseFloat> new_weights;
+  new_offsets.reserve(num_frames + 1);
+  new_ids.reserve(ids_.size() + other.ids_.size());
+  new_weights.reserve(ids_.size() + other.ids_.size());
+  std::vector<std::pair<int32, BaseFloat> > pairs;
+  for (int32 t = 0; t < num_frames; t++) {
+    pairs.clear();
+    for (int32 i = row_offsets_[t]; i < row_offsets_[t + 1]; i++)
+      pairs.push_back(std::make_pair(ids_[i], weights_[i]));
+    int32 num_this = pairs.size();
+    for (int32 i = other.row_offsets_[t]; i < other.row_offsets_[t + 1]; i++)
+      pairs.push_back(std::make_pair(other.ids_[i], other.weights_[i]));
+    // The frames are small, so a quadratic check is faster than the hash set
+    // that PosteriorEntriesAreDisjoint() uses.
+    bool disjoint = true;
+    for (int32 i = 0; i < num_this && disjoint; i++)
+      for (size_t j = num_this; j < pairs.size(); j++)
+        if (pairs[i].first == pairs[j].first) { disjoint = false; break; }
+    if (merge)
+      MergePairVectorSumming(&pairs);
+    else
+      std::sort(pairs.begin(), pairs.end());
+    if (disjoint) {
+      num_disjoint++;
+      if (drop_frames)
+        pairs.clear();
+    }
+    AppendFrame(pairs, &new_offsets, &new_ids, &new_weights);
+  }
+  row_offsets_.swap(new_offsets);
+  ids_.swap(new_ids);
+  weights_.swap(new_weights);
+  return num_disjoint;
+}
+
+void CompactPosterior::SelectFrames(int32 first, int32 num_frames) {
+  KALDI_ASSERT(first >= 0 && num_frames >= 0 &&
+               first + num_frames <= NumFrames());
+  int32 begin = row_offsets_[first],
+      end = row_offsets_[first + num_frames];
+  ids_.erase(ids_.begin() + end, ids_.end());
+  ids_.erase(ids_.begin(), ids_.begin() + begin);
+  weights_.erase(weights_.begin() + end, weights_.end());
+  weights_.erase(weights_.begin(), weights_.begin() + begin);
+  row_offsets_.erase(row_offsets_.begin() + first + num_frames + 1,
+                     row_offsets_.end());
+  row_offsets_.erase(row_offsets_.begin(), row_offsets_.begin() + first);
+  for (size_t t = 0; t < row_offsets_.size(); t++)
+    row_offsets_[t] -= begin;
+}
+
+void CompactPosterior::Write(std::ostream &os, bool binary) const {
+  int32 num_frames = NumFrames();
+  if (binary) {
+    WriteBasicType(os, binary, num_frames);
+    for (int32 t = 0; t < num_frames; t++) {
+      int32 size = FrameSize(t);
+      WriteBasicType(os, binary, size);
+      for (int32 i = row_offsets_[t]; i < row_offsets_[t + 1]; i++) {
+        WriteBasicType(os, binary, ids_[i]);
+        WriteBasicType(os, binary, weights_[i]);
+      }
+    }
+  } else {
+    for (int32 t = 0; t < num_frames; t++) {
+      os << "[ ";
+      for (int32 i = row_offsets_[t]; i < row_offsets_[t + 1]; i++)
+        os << ids_[i] << ' ' << weights_[i] << ' ';
+      os << "] ";
+    }
+    os << '\n';
+  }
+  if (!os.good())
+    KALDI_ERR << "Output stream error writing Posterior.";
+}
+
+void CompactPosterior::Read(std::istream &is, bool binary) {
+  Clear();
+  if (binary) {
+    int32 num_frames;
+    ReadBasicType(is, true, &num_frames);
+    if (num_frames < 0 || num_frames > 10000000)
+      KALDI_ERR << "Reading posterior: got negative or improbably large size"
+                << num_frames;
+    row_offsets_.reserve(num_frames + 1);
+    for (int32 t = 0; t < num_frames; t++) {
+      int32 size;
+      ReadBasicType(is, true, &size);
+      if (size < 0)
+        KALDI_ERR << "Reading posteriors: got negative size";
+      AddFrame();
+      for (int32 i = 0; i < size; i++) {
+        int32 id;
+        BaseFloat weight;
+        ReadBasicType(is, true, &id);
+        ReadBasicType(is, true, &weight);
+        AddElement(id, weight);
+      }
+    }
+  } else {
+    // The text format is not used where speed matters.
+    Posterior post;
+    ReadPosterior(is, false, &post);
+    CopyFromPosterior(post);
+  }
+}
+
+// static
+bool CompactPosteriorHolder::Write(std::ostream &os, bool binary, const T &t) {
+  InitKaldiOutputStream(os, binary);  // Puts binary header if binary mode.
+  try {
+    t.Write(os, binary);
+    return true;
+  } catch(const std::exception &e) {
+    KALDI_WARN << "Exception caught writing table of posteriors. " << e.what();
+    return false;  // Write failure.
+  }
+}
+
+bool CompactPosteriorHolder::Read(std::istream &is) {
+  t_.Clear();
+  bool is_binary;
+  if (!InitKaldiInputStream(is, &is_binary)) {
+    KALDI_WARN << "Reading Table object, failed reading binary header";
+    return false;
+  }
+  try {
+    t_.Read(is, is_binary);
+    return true;
+  } catch (std::exception &e) {
+    KALDI_WARN << "Exception caught reading table of posteriors. " << e.what();
+    t_.Clear();
+    return false;
+  }
+}
+
+bool CompactPosteriorHolder::ExtractRange(const CompactPosteriorHolder &other,
+                                          const std::string &range) {
+  // The range is of the form first:last, as for the rows of a matrix.
+  std::vector<int32> frame_range;
+  int32 num_frames = other.t_.NumFrames();
+  if (!SplitStringToIntegers(range, ":", false, &frame_range) ||
+      frame_range.size() != 2 || frame_range[0] < 0 ||
+      frame_range[0] > frame_range[1] || frame_range[1] >= num_frames) {
+    KALDI_WARN << "Invalid range specifier " << range
+               << " for posterior with " << num_frames << " frames.";
+    return false;
+  }
+  t_ = other.t_;
+  t_.SelectFrames(frame_range[0], frame_range[1] - frame_range[0] + 1);
+  return true;
+}
+
 // static
 bool GaussPostHolder::Write(std::ostream &os, bool binary, const T &t) {
   InitKaldiOutputStream(os, binary);  // Puts binary header if binary mode.
@@ -94,6 +94,141 @@ void WritePosterior(std::ostream &os, bool binary, const Posterior &post);
 /// stand-alone function for reading a Posterior.
 void ReadPosterior(std::istream &os, bool binary, Posterior *post);
 
+/// CompactPosterior stores the same information as Posterior, but in three
+/// flat arrays, like the CSR format of sparse matrices: the (id, weight) pairs
+/// of frame t are at positions RowOffsets()[t] ... RowOffsets()[t+1] - 1 of
+/// Ids() and Weights().  This avoids the allocation per frame that Posterior
+/// needs, which matters for programs that mostly read and write large archives
+/// of posteriors, and the arrays can be copied to a CuSparseMatrix as they are
+/// (see CuSparseMatrix::CopyFromCsr()).  It is written in the same format as
+/// Posterior, so CompactPosteriorHolder and PosteriorHolder can read each
+/// other's archives.
+class CompactPosterior {
+ public:
+  CompactPosterior(): row_offsets_(1, 0) { }
+
+  explicit CompactPosterior(const Posterior &post) { CopyFromPosterior(post); }
+
+  void CopyFromPosterior(const Posterior &post);
+
+  void CopyToPosterior(Posterior *post) const;
+
+  int32 NumFrames() const { return row_offsets_.size() - 1; }
+
+  /// Returns the total number of (id, weight) pairs.
+  int32 NumElements() const { return ids_.size(); }
+
+  int32 FrameSize(int32 t) const {
+    return row_offsets_[t + 1] - row_offsets_[t];
+  }
+  /// Returns the ids for frame t; there are FrameSize(t) of them.
+  const int32 *FrameIds(int32 t) const { return ids_.data() + row_offsets_[t]; }
+  /// Returns the weights for frame t; there are FrameSize(t) of them.
+  const BaseFloat *FrameWeights(int32 t) const {
+    return weights_.data() + row_offsets_[t];
+  }
+
+  const std::vector<int32> &RowOffsets() const { return row_offsets_; }
+  const std::vector<int32> &Ids() const { return ids_; }
+  const std::vector<BaseFloat> &Weights() const { return weights_; }
+
+  /// Appends an empty frame; AddElement() then adds to it.
+  void AddFrame() { row_offsets_.push_back(row_offsets_.back()); }
+
+  /// Adds an element to the last frame.
+  void AddElement(int32 id, BaseFloat weight) {
+    KALDI_ASSERT(NumFrames() > 0);
+    ids_.push_back(id);
+    weights_.push_back(weight);
+    row_offsets_.back()++;
+  }
+
+  /// Reserves space for the given number of frames and elements.
+  void Reserve(int32 num_frames, int32 num_elements);
+
+  /// Sets to zero frames.
+  void Clear();
+
+  void Swap(CompactPosterior *other);
+
+  /// Scales the weights; the same as ScalePosterior().
+  void Scale(BaseFloat scale);
+
+  /// Returns the total of all the weights; the same as TotalPosterior().
+  BaseFloat Total() const;
+
+  /// Sorts the elements of each frame on the id, adding together the weights
+  /// of duplicate ids and removing zero weights, as MergePairVectorSumming()
+  /// does.  Afterwards the arrays meet the requirements of
+  /// CuSparseMatrix::CopyFromCsr().
+  void SortFrames();
+
+  /// Does the same as WeightSilencePost() (if distribute == false) or
+  /// WeightSilencePostDistributed() (if distribute == true), in place.
+  void WeightSilence(const TransitionModel &trans_model,
+                     const ConstIntegerSet<int32> &silence_set,
+                     BaseFloat silence_scale,
+                     bool distribute);
+
+  /// Merges 'other' into *this; does the same as MergePosteriors() with *this
+  /// as 'post1' and as the output.  The two must have the same number of
+  /// frames.  Returns the number of frames for which the two were disjoint.
+  int32 Merge(const CompactPosterior &other, bool merge, bool drop_frames);
+
+  /// Keeps only the frames first ... first + num_frames - 1.
+  void SelectFrames(int32 first, int32 num_frames);
+
+  /// Writes in the same format as WritePosterior().
+  void Write(std::ostream &os, bool binary) const;
+
+  /// Reads in the same format as ReadPosterior().
+  void Read(std::istream &is, bool binary);
+
+ private:
+  // Appends the frame 'pairs' to the arrays that SortFrames() and Merge()
+  // build up before swapping them with ours.
+  static void AppendFrame(const std::vector<std::pair<int32, BaseFloat> > &pairs,
+                          std::vector<int32> *new_offsets,
+                          std::vector<int32> *new_ids,
+                          std::vector<BaseFloat> *new_weights);
+
+  std::vector<int32> row_offsets_;  // dimension NumFrames() + 1.
+  std::vector<int32> ids_;
+  std::vector<BaseFloat> weights_;
+};
+
+
+// CompactPosteriorHolder is a holder for CompactPosterior.  Unlike
+// PosteriorHolder it supports ranges of frames in scp files, e.g.
+// "1.ark:100[10:19]" for frames 10 through 19.
+class CompactPosteriorHolder {
+ public:
+  typedef CompactPosterior T;
+
+  CompactPosteriorHolder() { }
+
+  static bool Write(std::ostream &os, bool binary, const T &t);
+
+  void Clear() { t_.Clear(); }
+
+  // Reads into the holder.
+  bool Read(std::istream &is);
+
+  // Kaldi objects always have the stream open in binary mode for
+  // reading.
+  static bool IsReadInBinary() { return true; }
+
+  T &Value() { return t_; }
+
+  void Swap(CompactPosteriorHolder *other) { t_.Swap(&(other->t_)); }
+
+  bool ExtractRange(const CompactPosteriorHolder &other,
+                    const std::string &range);
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CompactPosteriorHolder);
+  T t_;
+};
+
 
 // GaussPostHolder is a holder for GaussPost, which is
 // std::vector<std::vector<std::pair<int32, Vector<BaseFloat> > > >
@@ -145,6 +280,12 @@ typedef TableWriter<GaussPostHolder> GaussPostWriter;
 typedef SequentialTableReader<GaussPostHolder> SequentialGaussPostReader;
 typedef RandomAccessTableReader<GaussPostHolder> RandomAccessGaussPostReader;
 
+typedef TableWriter<CompactPosteriorHolder> CompactPosteriorWriter;
+typedef SequentialTableReader<CompactPosteriorHolder>
+    SequentialCompactPosteriorReader;
+typedef RandomAccessTableReader<CompactPosteriorHolder>
+    RandomAccessCompactPosteriorReader;
+
 
 /// Scales the BaseFloat (weight) element in the posterior entries.
 void ScalePosterior(BaseFloat scale, Posterior *post);
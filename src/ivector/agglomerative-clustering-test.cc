@@ -0,0 +1,86 @@
+// ivector/agglomerative-clustering-test.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unordered_map>
+#include <vector>
+
+#include "ivector/agglomerative-clustering.h"
+
+namespace kaldi {
+
+// Renumbers the cluster labels in "assignments" from 0 in the order of their
+// first point, so that partitions can be compared regardless of how the
+// clusters are numbered.
+void CanonicalizeAssignments(std::vector<int32> *assignments) {
+  std::unordered_map<int32, int32> new_label;
+  for (size_t i = 0; i < assignments->size(); i++) {
+    int32 label = (*assignments)[i];
+    if (new_label.count(label) == 0) {
+      int32 n = new_label.size();
+      new_label[label] = n;
+    }
+    (*assignments)[i] = new_label[label];
+  }
+}
+
+// Checks that AgglomerativeClusterNnChain() gives the same partition as
+// AgglomerativeCluster() for the stopping rules where they are meant to agree,
+// i.e. without a limit on the cluster size.
+void UnitTestNnChainSameAsAgglomerativeCluster() {
+  int32 num_points = RandInt(1, 100), dim = RandInt(1, 5);
+  // Random points in a few well-separated groups, so that the clustering is
+  // not trivial; the costs are squared distances.
+  int32 num_groups = RandInt(1, 5);
+  Matrix<BaseFloat> centers(num_groups, dim), points(num_points, dim);
+  centers.SetRandn();
+  centers.Scale(10.0);
+  points.SetRandn();
+  for (int32 i = 0; i < num_points; i++)
+    points.Row(i).AddVec(1.0, centers.Row(RandInt(0, num_groups - 1)));
+  Matrix<BaseFloat> costs(num_points, num_points);
+  for (int32 i = 0; i < num_points; i++) {
+    for (int32 j = 0; j < num_points; j++) {
+      Vector<BaseFloat> diff(points.Row(i));
+      diff.AddVec(-1.0, points.Row(j));
+      costs(i, j) = VecVec(diff, diff);
+    }
+  }
+
+  BaseFloat threshold = RandUniform() * 50.0;
+  int32 min_clusters = RandInt(1, 10);
+  std::vector<int32> assignments, nn_chain_assignments;
+  AgglomerativeCluster(costs, threshold, min_clusters, num_points + 1, 1.0,
+                       &assignments);
+  Matrix<BaseFloat> costs_copy(costs);
+  AgglomerativeClusterNnChain(&costs_copy, threshold, min_clusters, 1.0,
+                              &nn_chain_assignments);
+  CanonicalizeAssignments(&assignments);
+  CanonicalizeAssignments(&nn_chain_assignments);
+  KALDI_ASSERT(assignments == nn_chain_assignments);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 100; i++)
+    UnitTestNnChainSameAsAgglomerativeCluster();
+  std::cout << "Test OK.\n";
+  return 0;
+}
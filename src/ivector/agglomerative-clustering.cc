@@ -20,6 +20,7 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <limits>
 #include "ivector/agglomerative-clustering.h"
 
 namespace kaldi {
@@ -235,4 +236,135 @@ void AgglomerativeCluster(
   ac.Cluster();
 }
 
+// Finds the root of the tree containing "i" in the union-find forest
+// "parent" (with path compression).
+static int32 FindClusterRoot(int32 i, std::vector<int32> *parent) {
+  int32 root = i;
+  while ((*parent)[root] != root)
+    root = (*parent)[root];
+  while ((*parent)[i] != root) {
+    int32 next = (*parent)[i];
+    (*parent)[i] = root;
+    i = next;
+  }
+  return root;
+}
+
+void AgglomerativeClusterNnChain(
+    Matrix<BaseFloat> *costs,
+    BaseFloat threshold,
+    int32 min_clusters,
+    BaseFloat max_cluster_fraction,
+    std::vector<int32> *assignments_out) {
+  KALDI_ASSERT(min_clusters >= 0);
+  KALDI_ASSERT(max_cluster_fraction >= 1.0 / min_clusters);
+  int32 num_points = costs->NumRows();
+  KALDI_ASSERT(costs->NumCols() == num_points);
+  int32 max_cluster_size = ceil(num_points * max_cluster_fraction);
+  Matrix<BaseFloat> &c = *costs;
+
+  // Make the matrix symmetric, using the upper triangle.
+  for (int32 i = 0; i < num_points; i++)
+    for (int32 j = i + 1; j < num_points; j++)
+      c(j, i) = c(i, j);
+
+  // Each cluster is identified by the index of one of its points (its
+  // "slot"); row and column "slot" of c contain the average costs between
+  // that cluster and the others.  "active" contains the slots of the
+  // clusters that may still be merged, and position[slot] is the index of
+  // the slot in "active".
+  std::vector<int32> active(num_points), position(num_points),
+      size(num_points, 1);
+  for (int32 i = 0; i < num_points; i++)
+    active[i] = position[i] = i;
+
+  // Each merge is (cost, (slot1, slot2)); the merged cluster gets slot1.
+  std::vector<std::pair<BaseFloat, std::pair<int32, int32> > > merges;
+  std::vector<int32> chain;
+
+  while (active.size() > 1) {
+    if (chain.empty())
+      chain.push_back(active[0]);
+    int32 a = chain.back(),
+        prev = (chain.size() >= 2 ? chain[chain.size() - 2] : -1);
+    // Find the nearest neighbor of a, preferring the previous cluster in the
+    // chain in case of ties (this ensures that the chain terminates).
+    int32 best = prev;
+    BaseFloat best_cost = (prev >= 0 ? c(a, prev) :
+                           std::numeric_limits<BaseFloat>::infinity());
+    const BaseFloat *row = c.RowData(a);
+    for (size_t k = 0; k < active.size(); k++) {
+      int32 b = active[k];
+      if (b != a && row[b] < best_cost &&
+          size[a] + size[b] <= max_cluster_size) {
+        best = b;
+        best_cost = row[b];
+      }
+    }
+    if (best < 0 || best_cost > threshold) {
+      // Cluster a cannot be merged with anything, now or later: with
+      // average linkage, the cost between a and any merged cluster is at
+      // least the smaller of the costs between a and its parts.
+      int32 last = active.back();
+      active[position[a]] = last;
+      position[last] = position[a];
+      active.pop_back();
+      chain.pop_back();
+      continue;
+    }
+    if (best != prev) {
+      chain.push_back(best);
+      continue;
+    }
+    // a and prev are reciprocal nearest neighbors: merge them.
+    chain.pop_back();
+    chain.pop_back();
+    int32 b = prev;
+    merges.push_back(std::make_pair(best_cost, std::make_pair(a, b)));
+    BaseFloat scale_a = size[a] / static_cast<BaseFloat>(size[a] + size[b]),
+        scale_b = size[b] / static_cast<BaseFloat>(size[a] + size[b]);
+    BaseFloat *row_a = c.RowData(a);
+    const BaseFloat *row_b = c.RowData(b);
+    for (size_t k = 0; k < active.size(); k++) {
+      int32 d = active[k];
+      if (d != a && d != b) {
+        row_a[d] = scale_a * row_a[d] + scale_b * row_b[d];
+        c(d, a) = row_a[d];
+      }
+    }
+    size[a] += size[b];
+    int32 last = active.back();
+    active[position[b]] = last;
+    position[last] = position[b];
+    active.pop_back();
+  }
+
+  // The merges were not found in order of increasing cost.  If there are
+  // too few clusters left, we undo the most costly merges, which (since
+  // average linkage has no inversions) are the last merges that
+  // AgglomerativeCluster() would have done.
+  int32 num_merges = merges.size();
+  if (num_points - num_merges < min_clusters) {
+    num_merges = std::max(num_points - min_clusters, 0);
+    std::stable_sort(merges.begin(), merges.end());
+  }
+  std::vector<int32> parent(num_points);
+  for (int32 i = 0; i < num_points; i++)
+    parent[i] = i;
+  for (int32 m = 0; m < num_merges; m++) {
+    int32 root1 = FindClusterRoot(merges[m].second.first, &parent),
+        root2 = FindClusterRoot(merges[m].second.second, &parent);
+    parent[root2] = root1;
+  }
+  assignments_out->resize(num_points);
+  std::vector<int32> root_label(num_points, 0);
+  int32 num_labels = 0;
+  for (int32 i = 0; i < num_points; i++) {
+    int32 root = FindClusterRoot(i, &parent);
+    if (root_label[root] == 0)
+      root_label[root] = ++num_labels;
+    (*assignments_out)[i] = root_label[root];
+  }
+}
+
 }  // end namespace kaldi.
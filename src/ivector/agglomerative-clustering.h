@@ -185,6 +185,31 @@ void AgglomerativeCluster(
     BaseFloat max_cluster_fraction,
     std::vector<int32> *assignments_out);
 
+/** This does the same clustering as AgglomerativeCluster() (without the
+ *  two-pass approximation), but using the nearest-neighbor-chain algorithm,
+ *  which needs O(N^2) time and no memory beyond the N x N cost matrix;
+ *  AgglomerativeCluster() needs O(N^2 log N) time and stores all the
+ *  pairwise costs in a hash map and a priority queue, which is not practical
+ *  for recordings with tens of thousands of segments.
+ *
+ *  Only the upper triangle of "costs" is used (as in AgglomerativeCluster()),
+ *  and the matrix is used as workspace: its contents are undefined on exit.
+ *
+ *  The result is the same as that of AgglomerativeCluster(), except for the
+ *  numbering of the clusters and the resolution of ties, when
+ *  max_cluster_fraction is 1.0.  When the cluster size is limited, pairs of
+ *  clusters that would be too large are not considered for merging, which
+ *  can make the order of the merges, and hence the result, differ.
+ *  The cluster labels are numbered from 1 in the order of their first
+ *  point.
+ */
+void AgglomerativeClusterNnChain(
+    Matrix<BaseFloat> *costs,
+    BaseFloat threshold,
+    int32 min_clusters,
+    BaseFloat max_cluster_fraction,
+    std::vector<int32> *assignments_out);
+
 }  // end namespace kaldi.
 
 #endif  // KALDI_IVECTOR_AGGLOMERATIVE_CLUSTERING_H_
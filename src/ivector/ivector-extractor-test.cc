@@ -21,6 +21,7 @@
 #include "gmm/full-gmm-normal.h"
 #include "ivector/ivector-extractor.h"
 #include "util/kaldi-io.h"
+#include "util/kaldi-thread.h"
 
 
 namespace kaldi {
@@ -139,6 +140,109 @@ void TestIvectorExtraction(const IvectorExtractor &extractor,
             << ", objf_change2 = " << objf_change2;
   
   KALDI_ASSERT(ivector1.ApproxEqual(ivector2));
+
+  // With a tolerance on the residual, CG still converges from the default
+  // starting point, and a warm start from the solution stays there.
+  Vector<double> ivector3(ivector_dim), ivector4(ivector2);
+  online_stats.GetIvector(num_cg_iters, &ivector3, 1.0e-06);
+  online_stats.GetIvector(num_cg_iters, &ivector4, 1.0e-06);
+  KALDI_ASSERT(ivector1.ApproxEqual(ivector3) &&
+               ivector1.ApproxEqual(ivector4));
+}
+
+// Checks that GetIvectorDistributionBatch() gives the same ivectors as
+// GetIvectorDistribution() called for each utterance separately.
+void TestIvectorExtractionBatch(
+    const IvectorExtractor &extractor,
+    const std::vector<Matrix<BaseFloat> > &all_feats,
+    const FullGmm &fgmm) {
+  int32 num_utts = all_feats.size(),
+      ivector_dim = extractor.IvectorDim();
+  std::vector<IvectorExtractorUtteranceStats*> utt_stats(num_utts);
+  std::vector<const IvectorExtractorUtteranceStats*> utt_stats_ptrs(num_utts);
+  Matrix<double> ivectors1(num_utts, ivector_dim),
+      ivectors2(num_utts, ivector_dim);
+  for (int32 utt = 0; utt < num_utts; utt++) {
+    const Matrix<BaseFloat> &feats = all_feats[utt];
+    Posterior post(feats.NumRows());
+    for (int32 t = 0; t < feats.NumRows(); t++) {
+      Vector<BaseFloat> posterior(fgmm.NumGauss(), kUndefined);
+      fgmm.ComponentPosteriors(feats.Row(t), &posterior);
+      for (int32 i = 0; i < posterior.Dim(); i++)
+        if (utt % 2 == 0 || i % 2 == 0)  // make some of the counts zero.
+          post[t].push_back(std::make_pair(i, posterior(i)));
+    }
+    utt_stats[utt] = new IvectorExtractorUtteranceStats(extractor.NumGauss(),
+                                                        feats.NumCols(),
+                                                        false);
+    utt_stats[utt]->AccStats(feats, post);
+    utt_stats_ptrs[utt] = utt_stats[utt];
+    SubVector<double> ivector1(ivectors1, utt);
+    extractor.GetIvectorDistribution(*(utt_stats[utt]), &ivector1, NULL);
+  }
+  extractor.GetIvectorDistributionBatch(utt_stats_ptrs, &ivectors2);
+  KALDI_LOG << "ivectors1 = " << ivectors1;
+  KALDI_LOG << "ivectors2 = " << ivectors2;
+  KALDI_ASSERT(ivectors1.ApproxEqual(ivectors2, 1.0e-06));
+  DeletePointers(&utt_stats);
+}
+
+
+// Checks that stats accumulated in two separate objects and then added
+// together (as when ivector-extractor-acc-stats uses --num-shards) give the
+// same update as stats accumulated in one object.  The stats for the weights
+// are randomized, so we don't check when they are used.
+void TestIvectorExtractorStatsAdd(
+    const IvectorExtractor &extractor,
+    const IvectorExtractorStatsOptions &stats_opts,
+    const std::vector<Matrix<BaseFloat> > &all_feats,
+    const FullGmm &fgmm) {
+  if (extractor.IvectorDependentWeights())
+    return;
+  IvectorExtractorStats stats(extractor, stats_opts),
+      stats1(extractor, stats_opts), stats2(extractor, stats_opts);
+  for (size_t utt = 0; utt < all_feats.size(); utt++) {
+    stats.AccStatsForUtterance(extractor, all_feats[utt], fgmm);
+    (utt % 2 == 0 ? stats1 : stats2).AccStatsForUtterance(
+        extractor, all_feats[utt], fgmm);
+  }
+  stats1.Add(stats2);
+  {
+    // The non-const Write() flushes the cache of the R stats, which is
+    // required before Update().
+    std::ostringstream os;
+    stats.Write(os, true);
+    stats1.Write(os, true);
+  }
+  IvectorExtractorEstimationOptions estimation_opts;
+  estimation_opts.gaussian_min_count = extractor.FeatDim() + 5;
+  IvectorExtractor extractor1(extractor), extractor2(extractor);
+  double auxf_impr = stats.Update(estimation_opts, &extractor1),
+      auxf_impr1 = stats1.Update(estimation_opts, &extractor2);
+  KALDI_LOG << "Auxf improvement is " << auxf_impr << " vs. " << auxf_impr1
+            << " with stats added together.";
+  KALDI_ASSERT(ApproxEqual(stats.AuxfPerFrame(), stats1.AuxfPerFrame()));
+  KALDI_ASSERT(ApproxEqual(auxf_impr, auxf_impr1, 1.0e-04));
+}
+
+// Checks that the update gives exactly the same model with one thread as with
+// several.
+void TestIvectorExtractorUpdateThreaded(const IvectorExtractor &extractor,
+                                        const IvectorExtractorStats &stats) {
+  IvectorExtractorEstimationOptions estimation_opts;
+  estimation_opts.gaussian_min_count = extractor.FeatDim() + 5;
+  IvectorExtractor extractor1(extractor), extractor2(extractor);
+  int32 num_threads = g_num_threads;
+  g_num_threads = 1;
+  double auxf_impr1 = stats.Update(estimation_opts, &extractor1);
+  g_num_threads = 4;
+  double auxf_impr2 = stats.Update(estimation_opts, &extractor2);
+  g_num_threads = num_threads;
+  KALDI_ASSERT(auxf_impr1 == auxf_impr2);
+  std::ostringstream os1, os2;
+  extractor1.Write(os1, false);
+  extractor2.Write(os2, false);
+  KALDI_ASSERT(os1.str() == os2.str());
 }
 
 
@@ -184,7 +288,10 @@ void UnitTestIvectorExtractor() {
       stats.AccStatsForUtterance(extractor, feats, fgmm);
       TestIvectorExtraction(extractor, feats, fgmm);
     }
+    TestIvectorExtractionBatch(extractor, all_feats, fgmm);
+    TestIvectorExtractorStatsAdd(extractor, stats_opts, all_feats, fgmm);
     TestIvectorExtractorStatsIO(stats);
+    TestIvectorExtractorUpdateThreaded(extractor, stats);
     
     IvectorExtractorEstimationOptions estimation_opts;
     estimation_opts.gaussian_min_count = dim + 5;
@@ -64,11 +64,67 @@ void IvectorExtractor::GetIvectorDistribution(
     const IvectorExtractorUtteranceStats &utt_stats,
     VectorBase<double> *mean,
     SpMatrix<double> *var) const {
+  Vector<double> linear(IvectorDim());
+  SpMatrix<double> quadratic(IvectorDim());
+  GetIvectorDistMean(utt_stats, &linear, &quadratic);
+  GetIvectorDistPrior(utt_stats, &linear, &quadratic);
+  SolveIvectorDistribution(utt_stats, linear, &quadratic, mean, var);
+}
+
+
+void IvectorExtractor::GetIvectorDistributionBatch(
+    const std::vector<const IvectorExtractorUtteranceStats*> &utt_stats,
+    MatrixBase<double> *means) const {
+  int32 B = utt_stats.size(), I = NumGauss(), D = FeatDim(),
+      S = IvectorDim();
+  KALDI_ASSERT(means->NumRows() == B && means->NumCols() == S);
+  if (B == 0) return;
+
+  // gamma(b, i) is the count of Gaussian i in utterance b.
+  Matrix<double> gamma(B, I);
+  for (int32 b = 0; b < B; b++)
+    gamma.Row(b).CopyFromVec(utt_stats[b]->gamma_);
+
+  // Row b of "linear" gets \sum_i \M_i^T \Sigma_i^{-1} X_{b,i}, computed
+  // one Gaussian at a time as a (B x D) times (D x S) product.
+  Matrix<double> linear(B, S), X_i(B, D);
+  for (int32 i = 0; i < I; i++) {
+    bool any_nonzero = false;
+    for (int32 b = 0; b < B; b++) {
+      if (gamma(b, i) != 0.0) {
+        X_i.Row(b).CopyFromVec(utt_stats[b]->X_.Row(i));
+        any_nonzero = true;
+      } else {
+        X_i.Row(b).SetZero();
+      }
+    }
+    if (any_nonzero)
+      linear.AddMatMat(1.0, X_i, kNoTrans, Sigma_inv_M_[i], kNoTrans, 1.0);
+  }
+  // Row b of "quadratic" gets the packed form of \sum_i gamma(b, i) U_i.
+  Matrix<double> quadratic(B, S * (S + 1) / 2);
+  quadratic.AddMatMat(1.0, gamma, kNoTrans, U_, kNoTrans, 0.0);
+
+  for (int32 b = 0; b < B; b++) {
+    SpMatrix<double> this_quadratic(S, kUndefined);
+    SubVector<double> q_vec(this_quadratic.Data(), S * (S + 1) / 2);
+    q_vec.CopyFromVec(quadratic.Row(b));
+    SubVector<double> this_linear(linear, b), this_mean(*means, b);
+    GetIvectorDistPrior(*(utt_stats[b]), &this_linear, &this_quadratic);
+    SolveIvectorDistribution(*(utt_stats[b]), this_linear, &this_quadratic,
+                             &this_mean, NULL);
+  }
+}
+
+
+void IvectorExtractor::SolveIvectorDistribution(
+    const IvectorExtractorUtteranceStats &utt_stats,
+    const VectorBase<double> &linear,
+    SpMatrix<double> *quadratic_in,
+    VectorBase<double> *mean,
+    SpMatrix<double> *var) const {
+  SpMatrix<double> &quadratic = *quadratic_in;
   if (!IvectorDependentWeights()) {
-    Vector<double> linear(IvectorDim());
-    SpMatrix<double> quadratic(IvectorDim());
-    GetIvectorDistMean(utt_stats, &linear, &quadratic);
-    GetIvectorDistPrior(utt_stats, &linear, &quadratic);
     if (var != NULL) {
       var->CopyFromSp(quadratic);
       var->Invert(); // now it's a variance.
@@ -80,10 +136,6 @@ void IvectorExtractor::GetIvectorDistribution(
       mean->AddSpVec(1.0, quadratic, linear, 0.0);
     }
   } else {
-    Vector<double> linear(IvectorDim());
-    SpMatrix<double> quadratic(IvectorDim());
-    GetIvectorDistMean(utt_stats, &linear, &quadratic);
-    GetIvectorDistPrior(utt_stats, &linear, &quadratic);
     // At this point, "linear" and "quadratic" contain
     // the mean and prior-related terms, and we avoid
     // recomputing those.
@@ -520,6 +572,21 @@ double IvectorExtractor::GetAcousticAuxfVariance(
   }
 }
 
+// This class does M_i <-- M_i Tinv for one Gaussian index i; it's used in
+// TransformIvectors().
+class IvectorExtractorTransformClass {
+ public:
+  IvectorExtractorTransformClass(const MatrixBase<double> &Tinv,
+                                 Matrix<double> *M):
+      Tinv_(Tinv), M_(M) { }
+  void operator () () {
+    M_->AddMatMat(1.0, Matrix<double>(*M_), kNoTrans, Tinv_, kNoTrans, 0.0);
+  }
+ private:
+  const MatrixBase<double> &Tinv_;
+  Matrix<double> *M_;
+};
+
 void IvectorExtractor::TransformIvectors(const MatrixBase<double> &T,
                                          double new_prior_offset) {
   Matrix<double> Tinv(T);
@@ -528,8 +595,13 @@ void IvectorExtractor::TransformIvectors(const MatrixBase<double> &T,
   if (IvectorDependentWeights())
     w_.AddMatMat(1.0, Matrix<double>(w_), kNoTrans, Tinv, kNoTrans, 0.0);
   // next: M_i <-- M_i Tinv.  (construct temporary copy with Matrix<double>(M_[i]))
-  for (int32 i = 0; i < NumGauss(); i++)
-    M_[i].AddMatMat(1.0, Matrix<double>(M_[i]), kNoTrans, Tinv, kNoTrans, 0.0);
+  {
+    TaskSequencerConfig sequencer_opts;
+    sequencer_opts.num_threads = g_num_threads;
+    TaskSequencer<IvectorExtractorTransformClass> sequencer(sequencer_opts);
+    for (int32 i = 0; i < NumGauss(); i++)
+      sequencer.Run(new IvectorExtractorTransformClass(Tinv, &(M_[i])));
+  }
   KALDI_LOG << "Setting iVector prior offset to " << new_prior_offset;
   prior_offset_ = new_prior_offset;
 }
@@ -731,7 +803,8 @@ void OnlineIvectorEstimationStats::Read(std::istream &is, bool binary) {
 
 void OnlineIvectorEstimationStats::GetIvector(
     int32 num_cg_iters,
-    VectorBase<double> *ivector) const {
+    VectorBase<double> *ivector,
+    BaseFloat cg_tolerance) const {
   KALDI_ASSERT(ivector != NULL && ivector->Dim() ==
                this->IvectorDim());
 
@@ -744,7 +817,11 @@ void OnlineIvectorEstimationStats::GetIvector(
       (*ivector)(0) = prior_offset_;  // better initial guess.
     LinearCgdOptions opts;
     opts.max_iters = num_cg_iters;
-    LinearCgd(opts, quadratic_term_, linear_term_, ivector);
+    if (cg_tolerance > 0.0)
+      opts.max_error = cg_tolerance * linear_term_.Norm(2.0);
+    int32 num_iters = LinearCgd(opts, quadratic_term_, linear_term_, ivector);
+    KALDI_VLOG(5) << "Estimated the iVector in " << num_iters
+                  << " iterations of conjugate gradient.";
   } else {
     // Use 'default' value.
     ivector->SetZero();
@@ -1065,11 +1142,13 @@ void IvectorExtractorStats::CommitStatsForW(
 }
 
 void IvectorExtractorStats::CommitStatsForPrior(
+    double auxf,
     const VectorBase<double> &ivec_mean,
     const SpMatrix<double> &ivec_var) {
   SpMatrix<double> ivec_scatter(ivec_var);
   ivec_scatter.AddVec2(1.0, ivec_mean);
   prior_stats_lock_.lock();
+  tot_auxf_ += auxf;
   num_ivectors_ += 1.0;
   ivector_sum_.AddVec(1.0, ivec_mean);
   ivector_scatter_.AddSp(1.0, ivec_scatter);
@@ -1089,13 +1168,12 @@ void IvectorExtractorStats::CommitStatsForUtterance(
                                    &ivec_mean,
                                    &ivec_var);
 
-  if (config_.compute_auxf)
-    tot_auxf_ += extractor.GetAuxf(utt_stats, ivec_mean, &ivec_var);
-
   CommitStatsForM(extractor, utt_stats, ivec_mean, ivec_var);
   if (extractor.IvectorDependentWeights())
     CommitStatsForW(extractor, utt_stats, ivec_mean, ivec_var);
-  CommitStatsForPrior(ivec_mean, ivec_var);
+  double auxf = (config_.compute_auxf ?
+                 extractor.GetAuxf(utt_stats, ivec_mean, &ivec_var) : 0.0);
+  CommitStatsForPrior(auxf, ivec_mean, ivec_var);
   if (!S_.empty())
     CommitStatsForSigma(extractor, utt_stats);
 }
@@ -1185,6 +1263,12 @@ void IvectorExtractorStats::Add(const IvectorExtractorStats &other) {
   for (size_t i = 0; i < Y_.size(); i++)
     Y_[i].AddMat(weight, other.Y_[i]);
   R_.AddMat(weight, other.R_);
+  if (other.R_num_cached_ > 0) {
+    // "other" may have stats cached that it has not yet added to its R_.
+    int32 n = other.R_num_cached_;
+    R_.AddMatMat(weight, other.R_gamma_cache_.RowRange(0, n), kTrans,
+                 other.R_ivec_scatter_cache_.RowRange(0, n), kNoTrans, 1.0);
+  }
   Q_.AddMat(weight, other.Q_);
   G_.AddMat(weight, other.G_);
   KALDI_ASSERT(S_.size() == other.S_.size());
@@ -1434,12 +1518,140 @@ double IvectorExtractorStats::UpdateProjections(
   return tot_impr / count;
 }
 
+void IvectorExtractorStats::GetRawVariance(
+    int32 i,
+    const IvectorExtractor &extractor,
+    SpMatrix<double> *S) const {
+  int32 feat_dim = extractor.FeatDim(),
+      ivector_dim = extractor.IvectorDim();
+  *S = S_[i]; // Set it to the raw scatter statistics.
+
+  // The equations for estimating the variance are similar to
+  // those used in SGMMs.  We need to convert it to a centered
+  // covariance, and for this we can use a combination of other
+  // stats and the model parameters.
+
+  const Matrix<double> &M = extractor.M_[i];
+  // Y * M^T.
+  Matrix<double> YM(feat_dim, feat_dim);
+  YM.AddMatMat(1.0, Y_[i], kNoTrans, M, kTrans, 0.0);
+  Matrix<double> YMMY(YM, kTrans);
+  YMMY.AddMat(1.0, YM);
+  // Now, YMMY = Y * M^T + M * Y^T.  This is a kind of cross-term
+  // between the mean and the data, which we subtract.
+  SpMatrix<double> YMMY_sp(YMMY, kTakeMeanAndCheck);
+  S->AddSp(-1.0, YMMY_sp);
+
+  // Add in a mean-squared term.
+  SpMatrix<double> R(ivector_dim); // will be scatter of iVectors, weighted
+                                   // by count for this Gaussian.
+  SubVector<double> R_vec(R.Data(),
+                          ivector_dim * (ivector_dim + 1) / 2);
+  R_vec.CopyFromVec(R_.Row(i)); //
+
+  S->AddMat2Sp(1.0, M, kNoTrans, R, 1.0);
+}
+
+double IvectorExtractorStats::UpdateVariance(
+    int32 i,
+    const SpMatrix<double> &S,
+    const SpMatrix<double> &var_floor,
+    IvectorExtractor *extractor,
+    int32 *num_floored) const {
+  SpMatrix<double> floored_var(S);
+  SpMatrix<double> old_inv_var(extractor->Sigma_inv_[i]);
+
+  *num_floored = floored_var.ApplyFloor(var_floor);
+  if (*num_floored > 0)
+    KALDI_LOG << "For Gaussian index " << i << ", floored "
+              << *num_floored << " eigenvalues of variance.";
+  // this objf is per frame;
+  double old_objf = -0.5 * (TraceSpSp(S, old_inv_var) -
+                            old_inv_var.LogPosDefDet());
+
+  SpMatrix<double> new_inv_var(floored_var);
+  new_inv_var.Invert();
+
+  double new_objf = -0.5 * (TraceSpSp(S, new_inv_var) -
+                               new_inv_var.LogPosDefDet());
+  if (i < 4) {
+    KALDI_VLOG(1) << "Objf impr/frame for variance for Gaussian index "
+                  << i << " was " << (new_objf - old_objf);
+  }
+  extractor->Sigma_inv_[i].CopyFromSp(new_inv_var);
+  return gamma_(i) * (new_objf - old_objf);
+}
+
+// This class computes the un-floored variance for one Gaussian index.  The
+// contribution to the variance floor is added in the destructor, which
+// TaskSequencer calls in order, so the floor does not depend on the number of
+// threads.
+class IvectorExtractorRawVarianceClass {
+ public:
+  IvectorExtractorRawVarianceClass(const IvectorExtractorStats &stats,
+                                   int32 i,
+                                   const IvectorExtractor &extractor,
+                                   SpMatrix<double> *raw_variance,
+                                   SpMatrix<double> *var_floor,
+                                   double *var_floor_count):
+      stats_(stats), i_(i), extractor_(extractor),
+      raw_variance_(raw_variance), var_floor_(var_floor),
+      var_floor_count_(var_floor_count) { }
+  void operator () () {
+    stats_.GetRawVariance(i_, extractor_, raw_variance_);
+  }
+  ~IvectorExtractorRawVarianceClass() {
+    double gamma = stats_.gamma_(i_);
+    var_floor_->AddSp(1.0, *raw_variance_);
+    *var_floor_count_ += gamma;
+    raw_variance_->Scale(1.0 / gamma);
+  }
+ private:
+  const IvectorExtractorStats &stats_;
+  int32 i_;
+  const IvectorExtractor &extractor_;
+  SpMatrix<double> *raw_variance_;
+  SpMatrix<double> *var_floor_;
+  double *var_floor_count_;
+};
+
+class IvectorExtractorUpdateVarianceClass {
+ public:
+  IvectorExtractorUpdateVarianceClass(const IvectorExtractorStats &stats,
+                                      int32 i,
+                                      const SpMatrix<double> &raw_variance,
+                                      const SpMatrix<double> &var_floor,
+                                      IvectorExtractor *extractor,
+                                      double *tot_impr,
+                                      int32 *tot_num_floored):
+      stats_(stats), i_(i), raw_variance_(raw_variance),
+      var_floor_(var_floor), extractor_(extractor), tot_impr_(tot_impr),
+      tot_num_floored_(tot_num_floored), impr_(0.0), num_floored_(0) { }
+  void operator () () {
+    impr_ = stats_.UpdateVariance(i_, raw_variance_, var_floor_, extractor_,
+                                  &num_floored_);
+  }
+  ~IvectorExtractorUpdateVarianceClass() {
+    *tot_impr_ += impr_;
+    *tot_num_floored_ += num_floored_;
+  }
+ private:
+  const IvectorExtractorStats &stats_;
+  int32 i_;
+  const SpMatrix<double> &raw_variance_;
+  const SpMatrix<double> &var_floor_;
+  IvectorExtractor *extractor_;
+  double *tot_impr_;
+  int32 *tot_num_floored_;
+  double impr_;
+  int32 num_floored_;
+};
+
 double IvectorExtractorStats::UpdateVariances(
     const IvectorExtractorEstimationOptions &opts,
     IvectorExtractor *extractor) const {
   int32 num_gauss = extractor->NumGauss(),
-      feat_dim = extractor->FeatDim(),
-      ivector_dim = extractor->IvectorDim();
+      feat_dim = extractor->FeatDim();
   KALDI_ASSERT(!S_.empty());
   double tot_objf_impr = 0.0;
 
@@ -1449,39 +1661,18 @@ double IvectorExtractorStats::UpdateVariances(
   SpMatrix<double> var_floor(feat_dim);
   double var_floor_count = 0.0;
 
-  for (int32 i = 0; i < num_gauss; i++) {
-    if (gamma_(i) < opts.gaussian_min_count) continue; // warned in UpdateProjections
-    SpMatrix<double> &S(raw_variances[i]);
-    S = S_[i]; // Set it to the raw scatter statistics.
-
-    // The equations for estimating the variance are similar to
-    // those used in SGMMs.  We need to convert it to a centered
-    // covariance, and for this we can use a combination of other
-    // stats and the model parameters.
-
-    Matrix<double> M(extractor->M_[i]);
-    // Y * M^T.
-    Matrix<double> YM(feat_dim, feat_dim);
-    YM.AddMatMat(1.0, Y_[i], kNoTrans, M, kTrans, 0.0);
-    Matrix<double> YMMY(YM, kTrans);
-    YMMY.AddMat(1.0, YM);
-    // Now, YMMY = Y * M^T + M * Y^T.  This is a kind of cross-term
-    // between the mean and the data, which we subtract.
-    SpMatrix<double> YMMY_sp(YMMY, kTakeMeanAndCheck);
-    S.AddSp(-1.0, YMMY_sp);
-
-    // Add in a mean-squared term.
-    SpMatrix<double> R(ivector_dim); // will be scatter of iVectors, weighted
-                                     // by count for this Gaussian.
-    SubVector<double> R_vec(R.Data(),
-                            ivector_dim * (ivector_dim + 1) / 2);
-    R_vec.CopyFromVec(R_.Row(i)); //
-
-    S.AddMat2Sp(1.0, M, kNoTrans, R, 1.0);
-
-    var_floor.AddSp(1.0, S);
-    var_floor_count += gamma_(i);
-    S.Scale(1.0 / gamma_(i));
+  TaskSequencerConfig sequencer_opts;
+  sequencer_opts.num_threads = g_num_threads;
+  {
+    TaskSequencer<IvectorExtractorRawVarianceClass> sequencer(
+        sequencer_opts);
+    for (int32 i = 0; i < num_gauss; i++) {
+      if (gamma_(i) < opts.gaussian_min_count)
+        continue; // warned in UpdateProjections
+      sequencer.Run(new IvectorExtractorRawVarianceClass(
+          *this, i, *extractor, &(raw_variances[i]), &var_floor,
+          &var_floor_count));
+    }
   }
   KALDI_ASSERT(var_floor_count > 0.0);
   KALDI_ASSERT(opts.variance_floor_factor > 0.0 &&
@@ -1501,32 +1692,15 @@ double IvectorExtractorStats::UpdateVariances(
   }
 
   int32 tot_num_floored = 0;
-  for (int32 i = 0; i < num_gauss; i++) {
-    SpMatrix<double> &S(raw_variances[i]); // un-floored variance.
-    if (S.NumRows() == 0) continue; // due to low count.
-    SpMatrix<double> floored_var(S);
-    SpMatrix<double> old_inv_var(extractor->Sigma_inv_[i]);
-
-    int32 num_floored = floored_var.ApplyFloor(var_floor);
-    tot_num_floored += num_floored;
-    if (num_floored > 0)
-      KALDI_LOG << "For Gaussian index " << i << ", floored "
-                << num_floored << " eigenvalues of variance.";
-    // this objf is per frame;
-    double old_objf = -0.5 * (TraceSpSp(S, old_inv_var) -
-                              old_inv_var.LogPosDefDet());
-
-    SpMatrix<double> new_inv_var(floored_var);
-    new_inv_var.Invert();
-
-    double new_objf = -0.5 * (TraceSpSp(S, new_inv_var) -
-                                 new_inv_var.LogPosDefDet());
-    if (i < 4) {
-      KALDI_VLOG(1) << "Objf impr/frame for variance for Gaussian index "
-                    << i << " was " << (new_objf - old_objf);
+  {
+    TaskSequencer<IvectorExtractorUpdateVarianceClass> sequencer(
+        sequencer_opts);
+    for (int32 i = 0; i < num_gauss; i++) {
+      if (raw_variances[i].NumRows() == 0) continue; // due to low count.
+      sequencer.Run(new IvectorExtractorUpdateVarianceClass(
+          *this, i, raw_variances[i], var_floor, extractor,
+          &tot_objf_impr, &tot_num_floored));
     }
-    tot_objf_impr += gamma_(i) * (new_objf - old_objf);
-    extractor->Sigma_inv_[i].CopyFromSp(new_inv_var);
   }
   double floored_percent = tot_num_floored * 100.0 / (num_gauss * feat_dim);
   KALDI_LOG << "Floored " << floored_percent << "% of all Gaussian eigenvalues";
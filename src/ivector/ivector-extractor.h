@@ -153,6 +153,20 @@ class IvectorExtractor {
       VectorBase<double> *mean,
       SpMatrix<double> *var) const;
 
+  /// Gets the means of the distributions over ivectors for a batch of
+  /// utterances: row b of "means" (which must have utt_stats.size() rows and
+  /// this->IvectorDim() columns) is set to what GetIvectorDistribution() would
+  /// output for *(utt_stats[b]), up to roundoff.  The terms arising from the
+  /// Gaussian means are computed for the whole batch as matrix-matrix
+  /// products, which is much faster than doing it one utterance at a time
+  /// when the extractor is large; the memory needed for temporaries is about
+  /// utt_stats.size() * IvectorDim()^2 / 2 doubles.  This function is
+  /// single-threaded; to use multiple threads, call it for different batches
+  /// in parallel (it is const).
+  void GetIvectorDistributionBatch(
+      const std::vector<const IvectorExtractorUtteranceStats*> &utt_stats,
+      MatrixBase<double> *means) const;
+
   /// The distribution over iVectors, in our formulation, is not centered at
   /// zero; its first dimension has a nonzero offset.  This function returns
   /// that offset.
@@ -251,6 +265,18 @@ class IvectorExtractor {
  protected:
   void ComputeDerivedVars();
   void ComputeDerivedVars(int32 i);
+
+  // Gets the distribution over ivectors given "linear" and "quadratic", which
+  // must already contain the terms from the means and the prior (see
+  // GetIvectorDistMean() and GetIvectorDistPrior()); this is the part of
+  // GetIvectorDistribution() that is done per utterance.  "quadratic" is
+  // consumed (i.e. its value on exit is undefined).
+  void SolveIvectorDistribution(
+      const IvectorExtractorUtteranceStats &utt_stats,
+      const VectorBase<double> &linear,
+      SpMatrix<double> *quadratic,
+      VectorBase<double> *mean,
+      SpMatrix<double> *var) const;
   friend class IvectorExtractorComputeDerivedVarsClass;
 
   // Imagine we'll project the iVectors with transformation T, so apply T^{-1}
@@ -349,8 +375,13 @@ class OnlineIvectorEstimationStats {
   /// set to a positive number, the number of conjugate gradient iterations will
   /// be limited to that number.  Note: the iVectors output still have a nonzero
   /// mean (first dim offset by PriorOffset()).
+  /// If "cg_tolerance" is > 0, the conjugate gradient also stops once the
+  /// 2-norm of the residual is below "cg_tolerance" times the 2-norm of the
+  /// linear term; with a good starting point this usually takes only a few
+  /// iterations.
   void GetIvector(int32 num_cg_iters,
-                  VectorBase<double> *ivector) const;
+                  VectorBase<double> *ivector,
+                  BaseFloat cg_tolerance = 0.0) const;
 
   double NumFrames() const { return num_frames_; }
 
@@ -475,6 +506,8 @@ struct IvectorExtractorEstimationOptions {
 
 class IvectorExtractorUpdateProjectionClass;
 class IvectorExtractorUpdateWeightClass;
+class IvectorExtractorRawVarianceClass;
+class IvectorExtractorUpdateVarianceClass;
 
 /// IvectorExtractorStats is a class used to update the parameters of the
 /// ivector extractor
@@ -487,6 +520,9 @@ class IvectorExtractorStats {
   IvectorExtractorStats(const IvectorExtractor &extractor,
                         const IvectorExtractorStatsOptions &stats_opts);
 
+  /// Adds the stats in "other" to this object (including any stats "other"
+  /// has cached).  Used to merge stats accumulated separately, e.g. in
+  /// different threads to avoid lock contention.
   void Add(const IvectorExtractorStats &other);
 
   void AccStatsForUtterance(const IvectorExtractor &extractor,
@@ -524,6 +560,8 @@ class IvectorExtractorStats {
  protected:
   friend class IvectorExtractorUpdateProjectionClass;
   friend class IvectorExtractorUpdateWeightClass;
+  friend class IvectorExtractorRawVarianceClass;
+  friend class IvectorExtractorUpdateVarianceClass;
 
 
   // This is called by AccStatsForUtterance
@@ -558,8 +596,10 @@ class IvectorExtractorStats {
                        const VectorBase<double> &ivec_mean,
                        const SpMatrix<double> &ivec_var);
 
-  /// Commit the stats used to update the prior distribution.
-  void CommitStatsForPrior(const VectorBase<double> &ivec_mean,
+  /// Commit the stats used to update the prior distribution, and the
+  /// auxiliary function for the utterance (which shares the same lock).
+  void CommitStatsForPrior(double auxf,
+                           const VectorBase<double> &ivec_mean,
                            const SpMatrix<double> &ivec_var);
 
   // Updates M.  Returns the objf improvement per frame.
@@ -587,6 +627,22 @@ class IvectorExtractorStats {
   double UpdateVariances(const IvectorExtractorEstimationOptions &opts,
                          IvectorExtractor *extractor) const;
 
+  // This internally called function sets *S to the centered scatter for
+  // Gaussian index i (i.e. gamma(i) times the un-floored variance).
+  void GetRawVariance(int32 i,
+                      const IvectorExtractor &extractor,
+                      SpMatrix<double> *S) const;
+
+  // This internally called function updates the variance for Gaussian index
+  // i, given its un-floored variance S and the variance floor.  Returns the
+  // objf improvement for this index, and sets *num_floored to the number of
+  // floored eigenvalues.
+  double UpdateVariance(int32 i,
+                        const SpMatrix<double> &S,
+                        const SpMatrix<double> &var_floor,
+                        IvectorExtractor *extractor,
+                        int32 *num_floored) const;
+
 
 
   // Updates the prior; returns obj improvement per frame.
@@ -661,8 +717,8 @@ class IvectorExtractorStats {
   std::vector< SpMatrix<double> > S_;
 
 
-  /// This mutex guards num_ivectors_, ivector_sum_ and ivector_scatter_ (for multi-threaded
-  /// update)
+  /// This mutex guards tot_auxf_, num_ivectors_, ivector_sum_ and
+  /// ivector_scatter_ (for multi-threaded update)
   std::mutex prior_stats_lock_;
 
   /// Count of the number of iVectors we trained on.   Need for prior re-estimation.
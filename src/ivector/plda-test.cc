@@ -87,6 +87,35 @@ void UnitTestPldaEstimation(int32 dim) {
               << "should be: " << s;
   }
 
+  {
+    // Check that LogLikelihoodRatios() agrees with LogLikelihoodRatio().
+    PldaConfig plda_config;
+    int32 num_enroll = 1 + Rand() % 10, num_test = 1 + Rand() % 10,
+        num_enroll_utts = 1 + Rand() % 5;
+    Matrix<double> enroll(num_enroll, dim), test(num_test, dim);
+    for (int32 i = 0; i < num_enroll; i++) {
+      Vector<double> ivector(dim);
+      ivector.SetRandn();
+      ivector.AddVec(1.0, global_mean);
+      SubVector<double> row(enroll, i);
+      plda.TransformIvector(plda_config, ivector, num_enroll_utts, &row);
+    }
+    for (int32 j = 0; j < num_test; j++) {
+      Vector<double> ivector(dim);
+      ivector.SetRandn();
+      ivector.AddVec(1.0, global_mean);
+      SubVector<double> row(test, j);
+      plda.TransformIvector(plda_config, ivector, 1, &row);
+    }
+    Matrix<double> scores(num_enroll, num_test), scores2(num_enroll, num_test);
+    plda.LogLikelihoodRatios(enroll, num_enroll_utts, test, &scores);
+    for (int32 i = 0; i < num_enroll; i++)
+      for (int32 j = 0; j < num_test; j++)
+        scores2(i, j) = plda.LogLikelihoodRatio(enroll.Row(i),
+                                                num_enroll_utts,
+                                                test.Row(j));
+    KALDI_ASSERT(scores.ApproxEqual(scores2, 1.0e-06));
+  }
 }
 
 }
@@ -192,6 +192,68 @@ double Plda::LogLikelihoodRatio(
 }
 
 
+void Plda::GetLogLikelihoodRatioTerms(
+    const VectorBase<double> &transformed_enroll_ivector,
+    int32 n, // number of enrollment utterances.
+    VectorBase<double> *linear,
+    double *offset,
+    VectorBase<double> *quadratic) const {
+  int32 dim = Dim();
+  KALDI_ASSERT(transformed_enroll_ivector.Dim() == dim &&
+               linear->Dim() == dim);
+  // With the mean m and variance v of the distribution given the class, as
+  // in LogLikelihoodRatio(), and w = I + \Psi the variance without the class,
+  // the log-likelihood ratio is
+  //  -0.5 [ (u - m)^2 / v + log v ] + 0.5 [ u^2 / w + log w ],
+  // summed over dimensions; we expand it as a polynomial in u.
+  double tot_offset = 0.0;
+  for (int32 i = 0; i < dim; i++) {
+    double mean = n * psi_(i) / (n * psi_(i) + 1.0)
+        * transformed_enroll_ivector(i),
+        variance = 1.0 + psi_(i) / (n * psi_(i) + 1.0),
+        variance_without_class = 1.0 + psi_(i);
+    (*linear)(i) = mean / variance;
+    tot_offset += -0.5 * (mean * mean / variance + Log(variance)) +
+        0.5 * Log(variance_without_class);
+    if (quadratic != NULL)
+      (*quadratic)(i) = -0.5 * (1.0 / variance -
+                                1.0 / variance_without_class);
+  }
+  *offset = tot_offset;
+}
+
+
+void Plda::LogLikelihoodRatios(
+    const MatrixBase<double> &transformed_enroll_ivectors,
+    int32 num_enroll_utts,
+    const MatrixBase<double> &transformed_test_ivectors,
+    MatrixBase<double> *scores) const {
+  int32 dim = Dim(), num_enroll = transformed_enroll_ivectors.NumRows(),
+      num_test = transformed_test_ivectors.NumRows();
+  KALDI_ASSERT(transformed_enroll_ivectors.NumCols() == dim &&
+               transformed_test_ivectors.NumCols() == dim &&
+               scores->NumRows() == num_enroll &&
+               scores->NumCols() == num_test);
+  Matrix<double> linear(num_enroll, dim, kUndefined);
+  Vector<double> offsets(num_enroll), quadratic(dim);
+  for (int32 i = 0; i < num_enroll; i++) {
+    SubVector<double> linear_row(linear, i);
+    GetLogLikelihoodRatioTerms(transformed_enroll_ivectors.Row(i),
+                               num_enroll_utts, &linear_row,
+                               &(offsets(i)), (i == 0 ? &quadratic : NULL));
+  }
+  Matrix<double> test_sq(transformed_test_ivectors);
+  test_sq.ApplyPow(2.0);
+  Vector<double> test_terms(num_test);
+  test_terms.AddMatVec(1.0, test_sq, kNoTrans, quadratic, 0.0);
+
+  scores->AddMatMat(1.0, linear, kNoTrans,
+                    transformed_test_ivectors, kTrans, 0.0);
+  scores->AddVecToCols(1.0, offsets);
+  scores->AddVecToRows(1.0, test_terms);
+}
+
+
 void Plda::SmoothWithinClassCovariance(double smoothing_factor) {
   KALDI_ASSERT(smoothing_factor >= 0.0 && smoothing_factor <= 1.0);
   // smoothing_factor > 1.0 is possible but wouldn't really make sense.
@@ -122,6 +122,34 @@ class Plda {
                             const VectorBase<double> &transformed_test_ivector)
                             const;
 
+  /// This is for computing LogLikelihoodRatio() for many pairs of iVectors
+  /// efficiently.  The log-likelihood ratio is a quadratic function of the
+  /// test iVector u:
+  ///  LogLikelihoodRatio(e, n, u) = VecVec(linear, u) + offset
+  ///                                  + VecVec(quadratic, u .* u),
+  /// where "linear" and "offset" depend on the transformed enrollment iVector
+  /// e and the number of enrollment utterances n, and "quadratic" depends
+  /// only on n.  This function outputs those quantities; "quadratic" may be
+  /// NULL if not needed.  The dims of the vectors must be Dim().
+  void GetLogLikelihoodRatioTerms(
+      const VectorBase<double> &transformed_enroll_ivector,
+      int32 num_enroll_utts,
+      VectorBase<double> *linear,
+      double *offset,
+      VectorBase<double> *quadratic) const;
+
+  /// Computes LogLikelihoodRatio() for all pairs of enrollment and test
+  /// iVectors (the rows of the respective matrices), using a matrix product:
+  /// (*scores)(i, j) is the log-likelihood ratio for enrollment iVector i
+  /// and test iVector j, up to roundoff.  All enrollment iVectors are
+  /// assumed to be averaged over "num_enroll_utts" utterances.  "scores" must
+  /// have the correct dimensions.
+  void LogLikelihoodRatios(
+      const MatrixBase<double> &transformed_enroll_ivectors,
+      int32 num_enroll_utts,
+      const MatrixBase<double> &transformed_test_ivectors,
+      MatrixBase<double> *scores) const;
+
 
   /// This function smooths the within-class covariance by adding to it,
   /// smoothing_factor (e.g. 0.1) times the between-class covariance (it's
@@ -49,7 +49,7 @@ int main(int argc, char *argv[]) {
     ParseOptions po(usage);
     std::string reco2num_spk_rspecifier;
     BaseFloat threshold = 0.0, max_spk_fraction = 1.0;
-    bool read_costs = false;
+    bool read_costs = false, nn_chain = false;
     int32 first_pass_max_utterances = std::numeric_limits<int16>::max();
 
     po.Register("reco2num-spk-rspecifier", &reco2num_spk_rspecifier,
@@ -70,6 +70,11 @@ int main(int argc, char *argv[]) {
       " total fraction of utterances in them is less than this threshold."
       " This is active only when reco2num-spk-rspecifier is supplied and"
       " 1.0 / num-spk <= max-spk-fraction <= 1.0.");
+    po.Register("nn-chain", &nn_chain, "If true, use the nearest-neighbor-"
+      "chain algorithm, which takes O(N^2) time and no memory beyond the"
+      " score matrix, for recordings with many utterances.  It gives the same"
+      " result as single-pass clustering (except with --max-spk-fraction < 1,"
+      " where it may differ); --first-pass-max-utterances is ignored.");
 
     po.Read(argc, argv);
 
@@ -100,20 +105,22 @@ int main(int argc, char *argv[]) {
         costs.Scale(-1);
       std::vector<std::string> uttlist = reco2utt_reader.Value(reco);
       std::vector<int32> spk_ids;
+      BaseFloat this_threshold = threshold, this_max_spk_fraction = 1.0;
+      int32 min_clusters = 1;
       if (reco2num_spk_rspecifier.size()) {
         int32 num_speakers = reco2num_spk_reader.Value(reco);
+        this_threshold = std::numeric_limits<BaseFloat>::max();
+        min_clusters = num_speakers;
         if (1.0 / num_speakers <= max_spk_fraction && max_spk_fraction <= 1.0)
-          AgglomerativeCluster(costs, std::numeric_limits<BaseFloat>::max(),
-                               num_speakers, first_pass_max_utterances,
-                               max_spk_fraction, &spk_ids);
-        else
-          AgglomerativeCluster(costs, std::numeric_limits<BaseFloat>::max(),
-                               num_speakers, first_pass_max_utterances,
-                               1.0, &spk_ids);
-      } else {
-        AgglomerativeCluster(costs, threshold, 1, first_pass_max_utterances,
-                             1.0, &spk_ids);
+          this_max_spk_fraction = max_spk_fraction;
       }
+      if (nn_chain)
+        AgglomerativeClusterNnChain(&costs, this_threshold, min_clusters,
+                                    this_max_spk_fraction, &spk_ids);
+      else
+        AgglomerativeCluster(costs, this_threshold, min_clusters,
+                             first_pass_max_utterances,
+                             this_max_spk_fraction, &spk_ids);
       for (int32 i = 0; i < spk_ids.size(); i++)
         label_writer.Write(uttlist[i], spk_ids[i]);
     }
@@ -89,6 +89,85 @@ class IvectorExtractTask {
   double auxf_change_;
 };
 
+// This is like IvectorExtractTask, but it processes a batch of utterances
+// using IvectorExtractor::GetIvectorDistributionBatch(), which is faster
+// for large extractors.  Used if --batch-size > 1.
+class IvectorExtractBatchTask {
+ public:
+  IvectorExtractBatchTask(const IvectorExtractor &extractor,
+                          BaseFloatVectorWriter *writer,
+                          double *tot_auxf_change):
+      extractor_(extractor), writer_(writer),
+      tot_auxf_change_(tot_auxf_change) { }
+
+  void AddUtterance(const std::string &utt,
+                    const Matrix<BaseFloat> &feats,
+                    const Posterior &posterior) {
+    utts_.push_back(utt);
+    feats_.push_back(feats);
+    posteriors_.push_back(posterior);
+  }
+
+  int32 NumUtterances() const { return utts_.size(); }
+
+  void operator () () {
+    bool need_2nd_order_stats = false;
+    int32 num_utts = utts_.size();
+    std::vector<IvectorExtractorUtteranceStats*> utt_stats(num_utts);
+    std::vector<const IvectorExtractorUtteranceStats*> utt_stats_const(
+        num_utts);
+    for (int32 u = 0; u < num_utts; u++) {
+      utt_stats[u] = new IvectorExtractorUtteranceStats(extractor_.NumGauss(),
+                                                        extractor_.FeatDim(),
+                                                        need_2nd_order_stats);
+      utt_stats[u]->AccStats(feats_[u], posteriors_[u]);
+      utt_stats_const[u] = utt_stats[u];
+    }
+    // We don't need the features any more.
+    std::vector<Matrix<BaseFloat> >().swap(feats_);
+
+    ivectors_.Resize(num_utts, extractor_.IvectorDim());
+    extractor_.GetIvectorDistributionBatch(utt_stats_const, &ivectors_);
+
+    if (tot_auxf_change_ != NULL) {
+      auxf_changes_.resize(num_utts);
+      Vector<double> default_ivector(extractor_.IvectorDim());
+      default_ivector(0) = extractor_.PriorOffset();
+      for (int32 u = 0; u < num_utts; u++)
+        auxf_changes_[u] =
+            extractor_.GetAuxf(*(utt_stats[u]), ivectors_.Row(u)) -
+            extractor_.GetAuxf(*(utt_stats[u]), default_ivector);
+    }
+    DeletePointers(&utt_stats);
+  }
+  ~IvectorExtractBatchTask() {
+    for (size_t u = 0; u < utts_.size(); u++) {
+      if (tot_auxf_change_ != NULL) {
+        double T = TotalPosterior(posteriors_[u]);
+        *tot_auxf_change_ += auxf_changes_[u];
+        KALDI_VLOG(2) << "Auxf change for utterance " << utts_[u] << " was "
+                      << (auxf_changes_[u] / T) << " per frame over " << T
+                      << " frames (weighted)";
+      }
+      // As in IvectorExtractTask, we write out the offset of the iVectors
+      // from the mean of the prior distribution.
+      ivectors_(u, 0) -= extractor_.PriorOffset();
+      KALDI_VLOG(2) << "Ivector norm for utterance " << utts_[u]
+                    << " was " << ivectors_.Row(u).Norm(2.0);
+      writer_->Write(utts_[u], Vector<BaseFloat>(ivectors_.Row(u)));
+    }
+  }
+ private:
+  const IvectorExtractor &extractor_;
+  std::vector<std::string> utts_;
+  std::vector<Matrix<BaseFloat> > feats_;
+  std::vector<Posterior> posteriors_;
+  BaseFloatVectorWriter *writer_;
+  double *tot_auxf_change_; // if non-NULL we need the auxf change.
+  Matrix<double> ivectors_;
+  std::vector<double> auxf_changes_;
+};
+
 int32 RunPerSpeaker(const std::string &ivector_extractor_rxfilename,
                    const IvectorEstimationOptions &opts,
                    bool compute_objf_change,
@@ -226,6 +305,8 @@ int main(int argc, char *argv[]) {
     IvectorEstimationOptions opts;
     std::string spk2utt_rspecifier;
     TaskSequencerConfig sequencer_config;
+    CpuAllocatorOptions cpu_allocator_opts;
+    int32 batch_size = 1;
     po.Register("compute-objf-change", &compute_objf_change,
                 "If true, compute the change in objective function from using "
                 "nonzero iVector (a potentially useful diagnostic).  Combine "
@@ -236,9 +317,16 @@ int main(int argc, char *argv[]) {
                 "is not the normal way iVectors are obtained for speaker-id. "
                 "This option will cause the program to ignore the --num-threads "
                 "option.");
+    po.Register("batch-size", &batch_size, "If >1, the iVectors are computed "
+                "for this many utterances at a time, using matrix-matrix "
+                "products; this is faster for large extractors, and is "
+                "combined with --num-threads (each thread processes a batch).  "
+                "Note: the memory used per thread is proportional to "
+                "batch-size * ivector-dim^2.");
 
     opts.Register(&po);
     sequencer_config.Register(&po);
+    cpu_allocator_opts.Register(&po);
 
     po.Read(argc, argv);
 
@@ -246,6 +334,9 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       exit(1);
     }
+    SetCpuAllocatorOptions(cpu_allocator_opts);
+    if (batch_size < 1)
+      KALDI_ERR << "Invalid --batch-size=" << batch_size;
 
     std::string ivector_extractor_rxfilename = po.GetArg(1),
         feature_rspecifier = po.GetArg(2),
@@ -269,6 +360,9 @@ int main(int argc, char *argv[]) {
 
       {
         TaskSequencer<IvectorExtractTask> sequencer(sequencer_config);
+        TaskSequencer<IvectorExtractBatchTask> batch_sequencer(
+            sequencer_config);
+        IvectorExtractBatchTask *batch_task = NULL;
         for (; !feature_reader.Done(); feature_reader.Next()) {
           std::string utt = feature_reader.Key();
           if (!posterior_reader.HasKey(utt)) {
@@ -302,13 +396,27 @@ int main(int argc, char *argv[]) {
                          &posterior);
           // note: now, this_t == sum of posteriors.
 
-          sequencer.Run(new IvectorExtractTask(extractor, utt, mat, posterior,
-                                               &ivector_writer, auxf_ptr));
+          if (batch_size == 1) {
+            sequencer.Run(new IvectorExtractTask(extractor, utt, mat,
+                                                 posterior, &ivector_writer,
+                                                 auxf_ptr));
+          } else {
+            if (batch_task == NULL)
+              batch_task = new IvectorExtractBatchTask(
+                  extractor, &ivector_writer, auxf_ptr);
+            batch_task->AddUtterance(utt, mat, posterior);
+            if (batch_task->NumUtterances() == batch_size) {
+              batch_sequencer.Run(batch_task);
+              batch_task = NULL;
+            }
+          }
 
           tot_t += this_t;
           num_done++;
         }
-        // Destructor of "sequencer" will wait for any remaining tasks.
+        if (batch_task != NULL)
+          batch_sequencer.Run(batch_task);
+        // Destructors of the sequencers will wait for any remaining tasks.
       }
 
       KALDI_LOG << "Done " << num_done << " files, " << num_err
@@ -317,6 +425,8 @@ int main(int argc, char *argv[]) {
         KALDI_LOG << "Overall average objective-function change from estimating "
                   << "ivector was " << (tot_auxf_change / tot_t) << " per frame "
                   << " over " << tot_t << " (weighted) frames.";
+      if (cpu_allocator_opts.cache_memory)
+        PrintCpuMemoryUsage();
 
       return (num_done != 0 ? 0 : 1);
     } else {
@@ -23,10 +23,73 @@
 #include "gmm/am-diag-gmm.h"
 #include "ivector/ivector-extractor.h"
 #include "util/kaldi-thread.h"
+#include "util/kaldi-semaphore.h"
 
 
 namespace kaldi {
 
+// This class holds a number of copies ("shards") of the stats, so that
+// threads can accumulate stats without contending for the locks inside a
+// single IvectorExtractorStats object.  A thread takes a shard with Acquire()
+// and gives it back with Release(); if all shards are in use, Acquire() waits.
+// The first shard is the stats object passed to the constructor, and
+// MergeShards() adds the others to it.  Each shard takes as much memory as
+// the stats themselves, so the number of shards is a tradeoff between speed
+// and memory.
+class IvectorStatsShards {
+ public:
+  IvectorStatsShards(const IvectorExtractor &extractor,
+                     const IvectorExtractorStatsOptions &stats_opts,
+                     int32 num_shards,
+                     IvectorExtractorStats *stats):
+      free_shards_semaphore_(num_shards) {
+    KALDI_ASSERT(num_shards > 0);
+    shards_.push_back(stats);
+    for (int32 i = 1; i < num_shards; i++)
+      shards_.push_back(new IvectorExtractorStats(extractor, stats_opts));
+    free_shards_ = shards_;
+  }
+
+  IvectorExtractorStats *Acquire() {
+    free_shards_semaphore_.Wait();
+    std::lock_guard<std::mutex> lock(mutex_);
+    KALDI_ASSERT(!free_shards_.empty());
+    IvectorExtractorStats *ans = free_shards_.back();
+    free_shards_.pop_back();
+    return ans;
+  }
+
+  void Release(IvectorExtractorStats *stats) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_shards_.push_back(stats);
+    }
+    free_shards_semaphore_.Signal();
+  }
+
+  // Adds the stats in the other shards to the stats object that was passed
+  // to the constructor.  Must be called when no shards are in use.
+  void MergeShards() {
+    KALDI_ASSERT(free_shards_.size() == shards_.size());
+    for (size_t i = 1; i < shards_.size(); i++) {
+      shards_[0]->Add(*(shards_[i]));
+      delete shards_[i];
+    }
+    shards_.resize(1);
+    free_shards_ = shards_;
+  }
+
+  ~IvectorStatsShards() {
+    for (size_t i = 1; i < shards_.size(); i++)
+      delete shards_[i];
+  }
+ private:
+  std::vector<IvectorExtractorStats*> shards_;
+  std::vector<IvectorExtractorStats*> free_shards_;
+  std::mutex mutex_;
+  Semaphore free_shards_semaphore_;
+};
+
 // this class is used to run the command
 //  stats.AccStatsForUtterance(extractor, mat, posterior);
 // in parallel.
@@ -35,13 +98,15 @@ class IvectorTask {
   IvectorTask(const IvectorExtractor &extractor,
               const Matrix<BaseFloat> &features,
               const Posterior &posterior,
-              IvectorExtractorStats *stats): extractor_(extractor),
+              IvectorStatsShards *shards): extractor_(extractor),
                                     features_(features),
                                     posterior_(posterior),
-                                    stats_(stats) { }
+                                    shards_(shards) { }
 
   void operator () () {
-    stats_->AccStatsForUtterance(extractor_, features_, posterior_);
+    IvectorExtractorStats *stats = shards_->Acquire();
+    stats->AccStatsForUtterance(extractor_, features_, posterior_);
+    shards_->Release(stats);
   }
   ~IvectorTask() { }  // the destructor doesn't have to do anything.
  private:
@@ -50,7 +115,7 @@ class IvectorTask {
                                // Table and the reference we get from that is
                                // not valid long-term.
   Posterior posterior_;  // as above.
-  IvectorExtractorStats *stats_;
+  IvectorStatsShards *shards_;
 };
 
 
@@ -67,8 +132,9 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Accumulate stats for iVector extractor training\n"
         "Reads in features and Gaussian-level posteriors (typically from a full GMM)\n"
-        "Supports multiple threads, but won't be able to make use of too many at a time\n"
-        "(e.g. more than about 4)\n"
+        "Supports multiple threads; to make use of more than about 4 threads,\n"
+        "set --num-shards (e.g. equal to --num-threads) so that the threads\n"
+        "accumulate into separate copies of the stats.\n"
         "Usage:  ivector-extractor-acc-stats [options] <model-in> <feature-rspecifier>"
         "<posteriors-rspecifier> <stats-out>\n"
         "e.g.: \n"
@@ -79,7 +145,14 @@ int main(int argc, char *argv[]) {
     bool binary = true;
     IvectorExtractorStatsOptions stats_opts;
     TaskSequencerConfig sequencer_opts;
+    int32 num_shards = 1;
     po.Register("binary", &binary, "Write output in binary mode");
+    po.Register("num-shards", &num_shards, "Number of copies of the stats "
+                "that the threads accumulate into, which are added together "
+                "at the end.  Larger values reduce lock contention between "
+                "threads (there is no point making it larger than "
+                "--num-threads), but each copy takes as much memory as the "
+                "stats themselves.");
     stats_opts.Register(&po);
     sequencer_opts.Register(&po);
 
@@ -113,6 +186,12 @@ int main(int argc, char *argv[]) {
     ReadKaldiObject(ivector_extractor_rxfilename, &extractor);
 
     IvectorExtractorStats stats(extractor, stats_opts);
+    if (num_shards < 1)
+      KALDI_ERR << "Invalid --num-shards=" << num_shards;
+    IvectorStatsShards shards(extractor, stats_opts,
+                              std::min(num_shards,
+                                       sequencer_opts.num_threads),
+                              &stats);
 
 
     int64 tot_t = 0;
@@ -139,7 +218,7 @@ int main(int argc, char *argv[]) {
           continue;
         }
 
-        sequencer.Run(new IvectorTask(extractor, mat, posterior, &stats));
+        sequencer.Run(new IvectorTask(extractor, mat, posterior, &shards));
 
         tot_t += posterior.size();
         num_done++;
@@ -147,6 +226,7 @@ int main(int argc, char *argv[]) {
       // destructor of "sequencer" will wait for any remaining tasks that
       // have not yet completed.
     }
+    shards.MergeShards();
 
     KALDI_LOG << "Done " << num_done << " files, " << num_err
               << " with errors.  Total frames " << tot_t;
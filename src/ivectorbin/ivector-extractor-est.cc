@@ -21,6 +21,37 @@
 #include "ivector/ivector-extractor.h"
 #include "util/kaldi-thread.h"
 
+namespace kaldi {
+
+// This class reads the stats from one file, for use with TaskSequencer, so
+// that several stats files can be read at once.  In the destructor, which
+// TaskSequencer calls sequentially, the stats are added to *tot_stats (or, if
+// it is NULL, it takes ownership of our stats).
+class IvectorExtractorStatsReadClass {
+ public:
+  IvectorExtractorStatsReadClass(const std::string &stats_rxfilename,
+                                 IvectorExtractorStats **tot_stats):
+      stats_rxfilename_(stats_rxfilename), tot_stats_(tot_stats),
+      stats_(new IvectorExtractorStats()) { }
+  void operator () () {
+    ReadKaldiObject(stats_rxfilename_, stats_);
+  }
+  ~IvectorExtractorStatsReadClass() {
+    if (*tot_stats_ == NULL) {
+      *tot_stats_ = stats_;
+    } else {
+      (*tot_stats_)->Add(*stats_);
+      delete stats_;
+    }
+  }
+ private:
+  std::string stats_rxfilename_;
+  IvectorExtractorStats **tot_stats_;
+  IvectorExtractorStats *stats_;
+};
+
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     typedef kaldi::int32 int32;
@@ -28,8 +59,11 @@ int main(int argc, char *argv[]) {
 
     const char *usage =
         "Do model re-estimation of iVector extractor (this is\n"
-        "the update phase of a single pass of E-M)\n"
-        "Usage: ivector-extractor-est [options] <model-in> <stats-in> <model-out>\n";
+        "the update phase of a single pass of E-M).  If several stats files are\n"
+        "given, they are read in parallel and summed, so there is no need to run\n"
+        "ivector-extractor-sum-accs first.\n"
+        "Usage: ivector-extractor-est [options] <model-in> <stats-in1> "
+        "[<stats-in2> ...] <model-out>\n";
 
     bool binary = true;
     IvectorExtractorEstimationOptions update_opts;
@@ -37,32 +71,45 @@ int main(int argc, char *argv[]) {
     kaldi::ParseOptions po(usage);
     po.Register("binary", &binary, "Write output in binary mode");
     po.Register("num-threads", &g_num_threads,
-                "Number of threads used in update");
+                "Number of threads used in update (and for reading stats)");
 
     update_opts.Register(&po);
 
     po.Read(argc, argv);
 
-    if (po.NumArgs() != 3) {
+    if (po.NumArgs() < 3) {
       po.PrintUsage();
       exit(1);
     }
 
     std::string model_rxfilename = po.GetArg(1),
-        stats_rxfilename = po.GetArg(2),
-        model_wxfilename = po.GetArg(3);
+        model_wxfilename = po.GetArg(po.NumArgs());
 
     KALDI_LOG << "Reading model";
     IvectorExtractor extractor;
     ReadKaldiObject(model_rxfilename, &extractor);
 
     KALDI_LOG << "Reading statistics";
-    IvectorExtractorStats stats;
-    ReadKaldiObject(stats_rxfilename, &stats);
+    IvectorExtractorStats *stats = NULL;
+    {
+      TaskSequencerConfig sequencer_opts;
+      sequencer_opts.num_threads = g_num_threads;
+      // Each task holds a whole stats object in memory, so don't queue up
+      // more tasks than there are threads.
+      sequencer_opts.num_threads_total = g_num_threads;
+      TaskSequencer<IvectorExtractorStatsReadClass> sequencer(sequencer_opts);
+      for (int32 i = 2; i < po.NumArgs(); i++)
+        sequencer.Run(new IvectorExtractorStatsReadClass(po.GetArg(i),
+                                                         &stats));
+    }
+    KALDI_ASSERT(stats != NULL);
+    if (po.NumArgs() > 3)
+      KALDI_LOG << "Summed stats from " << (po.NumArgs() - 2) << " files";
 
-    stats.Update(update_opts, &extractor);
+    stats->Update(update_opts, &extractor);
     WriteKaldiObject(extractor, model_wxfilename, binary);
-    stats.IvectorVarianceDiagnostic(extractor);
+    stats->IvectorVarianceDiagnostic(extractor);
+    delete stats;
 
     KALDI_LOG << "Updated model and wrote it to "
               << model_wxfilename;
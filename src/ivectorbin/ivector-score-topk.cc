@@ -0,0 +1,295 @@
+// ivectorbin/ivector-score-topk.cc
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <functional>
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "ivector/plda.h"
+#include "cudamatrix/cu-matrix.h"
+#include "cudamatrix/cu-vector.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+
+// The enrollment iVectors with a particular number of enrollment utterances,
+// in the form needed for scoring: the score for enrollment iVector i and test
+// iVector u is VecVec(linear.Row(i), u) + offsets(i) + VecVec(quadratic, u.^2)
+// (see Plda::GetLogLikelihoodRatioTerms()).
+struct EnrollGroup {
+  std::vector<int32> enroll_indexes;  // indexes into the list of keys.
+  std::vector<Vector<BaseFloat> > linear_rows;
+  std::vector<BaseFloat> offset_vec;
+  Vector<BaseFloat> quadratic;
+  CuMatrix<BaseFloat> linear;
+  CuVector<BaseFloat> offsets;
+};
+
+// Scores a block of test iVectors (the rows of "test", already transformed)
+// against all the enrollment iVectors and writes the best "top_k" for each.
+void ScoreBlock(const std::vector<std::string> &test_keys,
+                const Matrix<BaseFloat> &test,
+                const std::vector<std::string> &enroll_keys,
+                int32 top_k,
+                std::vector<EnrollGroup> *groups,
+                std::ostream &os) {
+  int32 num_test = test_keys.size();
+  KALDI_ASSERT(test.NumRows() >= num_test);
+  SubMatrix<BaseFloat> test_part(test, 0, num_test, 0, test.NumCols());
+  CuMatrix<BaseFloat> cu_test(test_part);
+  Matrix<BaseFloat> test_sq(test_part);
+  test_sq.ApplyPow(2.0);
+
+  // candidates[t] contains (score, enroll index) pairs for test iVector t.
+  std::vector<std::vector<std::pair<BaseFloat, int32> > > candidates(num_test);
+  for (size_t g = 0; g < groups->size(); g++) {
+    EnrollGroup &group = (*groups)[g];
+    int32 num_enroll = group.enroll_indexes.size(),
+        this_k = std::min(top_k, num_enroll);
+    CuMatrix<BaseFloat> cu_scores(num_test, num_enroll, kUndefined);
+    cu_scores.AddMatMat(1.0, cu_test, kNoTrans, group.linear, kTrans, 0.0);
+    cu_scores.AddVecToRows(1.0, group.offsets);
+    Vector<BaseFloat> test_terms(num_test);
+    test_terms.AddMatVec(1.0, test_sq, kNoTrans, group.quadratic, 0.0);
+    cu_scores.AddVecToCols(1.0, CuVector<BaseFloat>(test_terms));
+    Matrix<BaseFloat> scores(cu_scores);
+
+    std::vector<std::pair<BaseFloat, int32> > row(num_enroll);
+    for (int32 t = 0; t < num_test; t++) {
+      for (int32 i = 0; i < num_enroll; i++)
+        row[i] = std::pair<BaseFloat, int32>(scores(t, i),
+                                             group.enroll_indexes[i]);
+      std::nth_element(row.begin(), row.begin() + (this_k - 1), row.end(),
+                       std::greater<std::pair<BaseFloat, int32> >());
+      candidates[t].insert(candidates[t].end(), row.begin(),
+                           row.begin() + this_k);
+    }
+  }
+  for (int32 t = 0; t < num_test; t++) {
+    std::vector<std::pair<BaseFloat, int32> > &this_candidates =
+        candidates[t];
+    int32 this_k = std::min<int32>(top_k, this_candidates.size());
+    std::partial_sort(this_candidates.begin(),
+                      this_candidates.begin() + this_k,
+                      this_candidates.end(),
+                      std::greater<std::pair<BaseFloat, int32> >());
+    for (int32 k = 0; k < this_k; k++)
+      os << enroll_keys[this_candidates[k].second] << ' ' << test_keys[t]
+         << ' ' << this_candidates[k].first << '\n';
+  }
+}
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  typedef kaldi::int32 int32;
+  typedef kaldi::int64 int64;
+  try {
+    const char *usage =
+        "For each test iVector (or x-vector), finds the enrollment iVectors\n"
+        "with the highest scores and writes them with their scores, as lines\n"
+        "<enroll-key> <test-key> <score>\n"
+        "(best first for each test key).  This is for searching large sets of\n"
+        "enrollment speakers: all the scores are computed as matrix products,\n"
+        "on the GPU if one is used.  If --plda is given the scores are PLDA\n"
+        "log-likelihood ratios, exactly as in ivector-plda-scoring (see its\n"
+        "--num-utts option and the PLDA options); otherwise they are cosine\n"
+        "similarities.\n"
+        "\n"
+        "Usage: ivector-score-topk [options] <enroll-ivector-rspecifier> "
+        "<test-ivector-rspecifier>\n"
+        " <scores-wxfilename>\n"
+        "e.g.: ivector-score-topk --plda=plda --top-k=5 "
+        "--num-utts=ark:exp/train/num_utts.ark\n"
+        " ark:exp/train/spk_ivectors.ark ark:exp/test/ivectors.ark scores\n"
+        "See also: ivector-plda-scoring, ivector-compute-dot-products\n";
+
+    ParseOptions po(usage);
+
+    std::string plda_rxfilename, num_utts_rspecifier, use_gpu = "no";
+    int32 top_k = 10, batch_size = 256;
+
+    PldaConfig plda_config;
+    plda_config.Register(&po);
+    po.Register("plda", &plda_rxfilename, "PLDA model; if not given, we "
+                "compute cosine similarities.");
+    po.Register("num-utts", &num_utts_rspecifier, "Table to read the number "
+                "of utterances per enrollment speaker, e.g. "
+                "ark:num_utts.ark (only relevant with --plda)");
+    po.Register("top-k", &top_k, "Number of enrollment iVectors to output "
+                "per test iVector.");
+    po.Register("batch-size", &batch_size, "Number of test iVectors to score "
+                "at a time; the memory needed for the scores is batch-size "
+                "times the number of enrollment iVectors.");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+#if HAVE_CUDA==1
+    CuDevice::RegisterDeviceOptions(&po);
+#endif
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (top_k <= 0 || batch_size <= 0)
+      KALDI_ERR << "--top-k and --batch-size must be positive.";
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
+    std::string enroll_ivector_rspecifier = po.GetArg(1),
+        test_ivector_rspecifier = po.GetArg(2),
+        scores_wxfilename = po.GetArg(3);
+
+    bool use_plda = !plda_rxfilename.empty();
+    Plda plda;
+    if (use_plda)
+      ReadKaldiObject(plda_rxfilename, &plda);
+    else if (!num_utts_rspecifier.empty())
+      KALDI_WARN << "--num-utts has no effect without --plda.";
+
+    SequentialBaseFloatVectorReader enroll_ivector_reader(
+        enroll_ivector_rspecifier);
+    RandomAccessInt32Reader num_utts_reader(num_utts_rspecifier);
+
+    std::vector<std::string> enroll_keys;
+    std::vector<EnrollGroup> groups;
+    // maps the number of enrollment utterances to an index into "groups".
+    std::map<int32, int32> num_utts_to_group;
+    int32 dim = -1, num_enroll_err = 0;
+
+    KALDI_LOG << "Reading enrollment iVectors";
+    for (; !enroll_ivector_reader.Done(); enroll_ivector_reader.Next()) {
+      std::string spk = enroll_ivector_reader.Key();
+      const Vector<BaseFloat> &ivector = enroll_ivector_reader.Value();
+      if (dim == -1) dim = ivector.Dim();
+      if (ivector.Dim() != dim)
+        KALDI_ERR << "Dimension mismatch for enrollment iVector " << spk
+                  << ": " << ivector.Dim() << " vs. " << dim;
+      int32 num_examples = 1;
+      if (use_plda && !num_utts_rspecifier.empty()) {
+        if (!num_utts_reader.HasKey(spk)) {
+          KALDI_WARN << "Number of utterances not given for speaker " << spk;
+          num_enroll_err++;
+          continue;
+        }
+        num_examples = num_utts_reader.Value(spk);
+      }
+      if (num_utts_to_group.count(num_examples) == 0) {
+        num_utts_to_group[num_examples] = groups.size();
+        groups.resize(groups.size() + 1);
+      }
+      EnrollGroup &group = groups[num_utts_to_group[num_examples]];
+      Vector<BaseFloat> linear(dim);
+      double offset = 0.0;
+      if (use_plda) {
+        Vector<double> transformed_ivector(plda.Dim()),
+            linear_dbl(plda.Dim()), quadratic(plda.Dim());
+        plda.TransformIvector(plda_config, Vector<double>(ivector),
+                              num_examples, &transformed_ivector);
+        plda.GetLogLikelihoodRatioTerms(transformed_ivector, num_examples,
+                                        &linear_dbl, &offset, &quadratic);
+        linear.CopyFromVec(linear_dbl);
+        if (group.quadratic.Dim() == 0)
+          group.quadratic = Vector<BaseFloat>(quadratic);
+      } else {
+        linear.CopyFromVec(ivector);
+        BaseFloat norm = linear.Norm(2.0);
+        if (norm != 0.0)
+          linear.Scale(1.0 / norm);
+        if (group.quadratic.Dim() == 0)
+          group.quadratic.Resize(dim);
+      }
+      group.enroll_indexes.push_back(enroll_keys.size());
+      group.linear_rows.push_back(linear);
+      group.offset_vec.push_back(offset);
+      enroll_keys.push_back(spk);
+    }
+    KALDI_LOG << "Read " << enroll_keys.size() << " enrollment iVectors, "
+              << "errors on " << num_enroll_err;
+    if (enroll_keys.empty())
+      KALDI_ERR << "No enrollment iVectors present.";
+
+    for (size_t g = 0; g < groups.size(); g++) {
+      EnrollGroup &group = groups[g];
+      int32 num_enroll = group.linear_rows.size();
+      Matrix<BaseFloat> linear(num_enroll, dim, kUndefined);
+      Vector<BaseFloat> offsets(num_enroll, kUndefined);
+      for (int32 i = 0; i < num_enroll; i++) {
+        linear.Row(i).CopyFromVec(group.linear_rows[i]);
+        offsets(i) = group.offset_vec[i];
+      }
+      group.linear_rows.clear();
+      group.offset_vec.clear();
+      group.linear.Swap(&linear);
+      group.offsets.Swap(&offsets);
+    }
+
+    SequentialBaseFloatVectorReader test_ivector_reader(
+        test_ivector_rspecifier);
+    Output ko(scores_wxfilename, false);
+
+    int64 num_test_done = 0;
+    std::vector<std::string> test_keys;
+    Matrix<BaseFloat> test(batch_size, dim);
+    for (; !test_ivector_reader.Done(); test_ivector_reader.Next()) {
+      std::string utt = test_ivector_reader.Key();
+      const Vector<BaseFloat> &ivector = test_ivector_reader.Value();
+      if (ivector.Dim() != dim)
+        KALDI_ERR << "Dimension mismatch for test iVector " << utt
+                  << ": " << ivector.Dim() << " vs. " << dim;
+      SubVector<BaseFloat> row(test, test_keys.size());
+      if (use_plda) {
+        // num_examples is always 1 for test.
+        plda.TransformIvector(plda_config, ivector, 1, &row);
+      } else {
+        row.CopyFromVec(ivector);
+        BaseFloat norm = row.Norm(2.0);
+        if (norm != 0.0)
+          row.Scale(1.0 / norm);
+      }
+      test_keys.push_back(utt);
+      if (static_cast<int32>(test_keys.size()) == batch_size) {
+        ScoreBlock(test_keys, test, enroll_keys, top_k, &groups, ko.Stream());
+        num_test_done += test_keys.size();
+        test_keys.clear();
+      }
+    }
+    if (!test_keys.empty()) {
+      ScoreBlock(test_keys, test, enroll_keys, top_k, &groups, ko.Stream());
+      num_test_done += test_keys.size();
+    }
+
+    KALDI_LOG << "Scored " << num_test_done << " test iVectors against "
+              << enroll_keys.size() << " enrollment iVectors, writing the "
+              << "best " << top_k << " for each.";
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
+    return (num_test_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,291 @@
+// kws/kws-inverted-index.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstring>
+
+#include "kws/kws-inverted-index.h"
+#include "util/kaldi-io.h"
+
+namespace kaldi {
+
+static const char kSegmentMagic[8] = { 'K', 'W', 'S', 'I', 'N', 'V', '0', '1' };
+
+// Each segment starts with this header.  The key table starts right after it,
+// followed by the words and then the postings.  The size of a segment is a
+// multiple of 8 bytes, so that the tables of all the segments are aligned.
+struct KwsInvertedIndex::SegmentHeader {
+  char magic[8];
+  uint64 size;  // Total size of the segment in bytes, including the header.
+  uint32 num_keys;
+  uint32 num_words;
+  uint64 postings_size;
+  uint32 max_order;
+  uint32 reserved;
+};
+
+// An entry of the key table; the table is sorted on the word sequences.
+struct KwsInvertedIndex::KeyEntry {
+  uint64 postings_offset;  // Byte offset in the postings of the segment.
+  uint32 words_offset;  // Index of the first word in the words of the segment.
+  uint32 order;  // Number of words.
+  uint32 num_postings;
+  uint32 reserved;
+};
+
+
+static inline void WriteVarint(uint64 value, std::string *buf) {
+  while (value >= 128) {
+    buf->push_back(static_cast<char>((value & 127) | 128));
+    value >>= 7;
+  }
+  buf->push_back(static_cast<char>(value));
+}
+
+static inline uint64 ReadVarint(const unsigned char **p) {
+  uint64 value = 0;
+  int32 shift = 0;
+  while (**p & 128) {
+    value |= static_cast<uint64>(**p & 127) << shift;
+    shift += 7;
+    (*p)++;
+  }
+  value |= static_cast<uint64>(**p) << shift;
+  (*p)++;
+  return value;
+}
+
+// Times are not expected to be negative, but we use the "zigzag" encoding so
+// that negative numbers don't take 10 bytes.
+static inline uint64 ZigZag(int32 i) {
+  return (static_cast<uint32>(i) << 1) ^ static_cast<uint32>(i >> 31);
+}
+
+static inline int32 UnZigZag(uint64 u) {
+  uint32 v = static_cast<uint32>(u);
+  return static_cast<int32>((v >> 1) ^ (0u - (v & 1)));
+}
+
+static bool ComparePostings(const KwsPosting &a, const KwsPosting &b) {
+  if (a.utt != b.utt) return a.utt < b.utt;
+  if (a.label != b.label) return a.label < b.label;
+  return a.tbeg < b.tbeg;
+}
+
+
+KwsInvertedIndexBuilder::KwsInvertedIndexBuilder(int32 max_order):
+    max_order_(max_order) {
+  KALDI_ASSERT(max_order > 0);
+}
+
+void KwsInvertedIndexBuilder::AddIndex(const KwsLexicographicFst &index) {
+  if (index.Start() == fst::kNoStateId)
+    return;
+  std::vector<int32> words;
+  AddPostings(index, index.Start(), KwsLexicographicWeight::One(), &words);
+}
+
+void KwsInvertedIndexBuilder::AddPostings(const KwsLexicographicFst &index,
+                                          KwsLexicographicFst::StateId s,
+                                          const KwsLexicographicWeight &weight,
+                                          std::vector<int32> *words) {
+  typedef KwsLexicographicArc Arc;
+  for (fst::ArcIterator<KwsLexicographicFst> aiter(index, s); !aiter.Done();
+       aiter.Next()) {
+    const Arc &arc = aiter.Value();
+    KwsLexicographicWeight this_weight = fst::Times(weight, arc.weight);
+    KwsLexicographicWeight final_weight = index.Final(arc.nextstate);
+    if (final_weight != KwsLexicographicWeight::Zero()) {
+      // As in kws-search, the arcs into final states end the factors; their
+      // output label is the utterance id.
+      if (words->empty())
+        continue;
+      KwsLexicographicWeight w = fst::Times(this_weight, final_weight);
+      KwsPosting posting;
+      posting.utt = arc.olabel;
+      posting.label = arc.ilabel;
+      posting.tbeg = static_cast<int32>(w.Value2().Value1().Value());
+      posting.tend = static_cast<int32>(w.Value2().Value2().Value());
+      posting.score = w.Value1().Value();
+      postings_[*words].push_back(posting);
+    } else if (arc.ilabel == 0) {
+      AddPostings(index, arc.nextstate, this_weight, words);
+    } else if (static_cast<int32>(words->size()) < max_order_) {
+      words->push_back(arc.ilabel);
+      AddPostings(index, arc.nextstate, this_weight, words);
+      words->pop_back();
+    }
+  }
+}
+
+void KwsInvertedIndexBuilder::Write(std::ostream &os) const {
+  typedef KwsInvertedIndex::KeyEntry KeyEntry;
+  typedef KwsInvertedIndex::SegmentHeader SegmentHeader;
+  std::vector<KeyEntry> keys;
+  keys.reserve(postings_.size());
+  std::vector<int32> words;
+  std::string postings;
+  std::vector<KwsPosting> sorted;
+  for (std::map<std::vector<int32>, std::vector<KwsPosting> >::const_iterator
+           iter = postings_.begin(); iter != postings_.end(); ++iter) {
+    KeyEntry entry;
+    entry.postings_offset = postings.size();
+    entry.words_offset = words.size();
+    entry.order = iter->first.size();
+    entry.num_postings = iter->second.size();
+    entry.reserved = 0;
+    keys.push_back(entry);
+    words.insert(words.end(), iter->first.begin(), iter->first.end());
+    sorted = iter->second;
+    std::sort(sorted.begin(), sorted.end(), ComparePostings);
+    int32 prev_utt = 0;
+    for (size_t i = 0; i < sorted.size(); i++) {
+      const KwsPosting &p = sorted[i];
+      WriteVarint(ZigZag(p.utt - prev_utt), &postings);
+      WriteVarint(ZigZag(p.label), &postings);
+      WriteVarint(ZigZag(p.tbeg), &postings);
+      WriteVarint(ZigZag(p.tend - p.tbeg), &postings);
+      char score[sizeof(BaseFloat)];
+      memcpy(score, &p.score, sizeof(BaseFloat));
+      postings.append(score, sizeof(BaseFloat));
+      prev_utt = p.utt;
+    }
+  }
+  SegmentHeader header;
+  memcpy(header.magic, kSegmentMagic, sizeof(header.magic));
+  uint64 size = sizeof(SegmentHeader) + keys.size() * sizeof(KeyEntry) +
+      words.size() * sizeof(int32) + postings.size();
+  int32 padding = (8 - size % 8) % 8;
+  header.size = size + padding;
+  header.num_keys = keys.size();
+  header.num_words = words.size();
+  header.postings_size = postings.size();
+  header.max_order = max_order_;
+  header.reserved = 0;
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (!keys.empty())
+    os.write(reinterpret_cast<const char*>(&(keys[0])),
+             keys.size() * sizeof(KeyEntry));
+  if (!words.empty())
+    os.write(reinterpret_cast<const char*>(&(words[0])),
+             words.size() * sizeof(int32));
+  os.write(postings.data(), postings.size());
+  os.write("\0\0\0\0\0\0\0", padding);
+  if (!os.good())
+    KALDI_ERR << "Error writing inverted KWS index.";
+}
+
+
+void KwsInvertedIndex::Open(const std::string &filename) {
+  segments_.clear();
+  buffer_.clear();
+  mapped_file_.Close();
+  if (ClassifyRxfilename(filename) == kFileInput &&
+      mapped_file_.Open(filename)) {
+    data_ = mapped_file_.Data();
+    size_ = mapped_file_.Size();
+  } else {
+    KALDI_WARN << "Cannot use mmap() for " << filename << "; reading it into "
+               << "memory.";
+    Input ki(filename);  // the file has no binary header.
+    std::istream &is = ki.Stream();
+    char buf[65536];
+    while (is.read(buf, sizeof(buf)) || is.gcount() > 0)
+      buffer_.insert(buffer_.end(), buf, buf + is.gcount());
+    data_ = buffer_.empty() ? NULL : &(buffer_[0]);
+    size_ = buffer_.size();
+  }
+  InitSegments(filename);
+}
+
+void KwsInvertedIndex::InitSegments(const std::string &filename) {
+  max_order_ = 0;
+  size_t offset = 0;
+  while (offset < size_) {
+    if (size_ - offset < sizeof(SegmentHeader))
+      KALDI_ERR << "Inverted KWS index " << filename << " is truncated.";
+    const SegmentHeader *header =
+        reinterpret_cast<const SegmentHeader*>(data_ + offset);
+    if (memcmp(header->magic, kSegmentMagic, sizeof(kSegmentMagic)) != 0)
+      KALDI_ERR << "File " << filename << " is not an inverted KWS index, or "
+                << "is corrupted (at byte " << offset << ").";
+    if (header->size > size_ - offset ||
+        sizeof(SegmentHeader) + header->num_keys * sizeof(KeyEntry) +
+        header->num_words * sizeof(int32) + header->postings_size >
+        header->size)
+      KALDI_ERR << "Inverted KWS index " << filename << " is truncated or "
+                << "corrupted.";
+    Segment segment;
+    const char *p = data_ + offset + sizeof(SegmentHeader);
+    segment.keys = reinterpret_cast<const KeyEntry*>(p);
+    segment.num_keys = header->num_keys;
+    p += header->num_keys * sizeof(KeyEntry);
+    segment.words = reinterpret_cast<const int32*>(p);
+    p += header->num_words * sizeof(int32);
+    segment.postings = reinterpret_cast<const unsigned char*>(p);
+    segment.postings_size = header->postings_size;
+    segments_.push_back(segment);
+    int32 order = header->max_order;
+    max_order_ = (segments_.size() == 1 ? order : std::min(max_order_, order));
+    offset += header->size;
+  }
+  KALDI_VLOG(1) << "Opened inverted KWS index " << filename << " with "
+                << segments_.size() << " segments.";
+}
+
+int32 KwsInvertedIndex::Lookup(const std::vector<int32> &words,
+                               std::vector<KwsPosting> *postings) const {
+  KALDI_ASSERT(!words.empty() &&
+               static_cast<int32>(words.size()) <= max_order_);
+  int32 num_found = 0;
+  for (size_t i = 0; i < segments_.size(); i++) {
+    const Segment &segment = segments_[i];
+    // Compares the word sequence of a key with 'words'.
+    const int32 *seg_words = segment.words;
+    const KeyEntry *end = segment.keys + segment.num_keys;
+    const KeyEntry *entry = std::lower_bound(
+        segment.keys, end, words,
+        [seg_words](const KeyEntry &key, const std::vector<int32> &w) {
+          return std::lexicographical_compare(
+              seg_words + key.words_offset,
+              seg_words + key.words_offset + key.order, w.begin(), w.end());
+        });
+    if (entry == end || entry->order != words.size() ||
+        !std::equal(words.begin(), words.end(),
+                    seg_words + entry->words_offset))
+      continue;
+    if (entry->postings_offset > segment.postings_size)
+      KALDI_ERR << "Inverted KWS index is corrupted.";
+    const unsigned char *p = segment.postings + entry->postings_offset;
+    int32 utt = 0;
+    for (uint32 n = 0; n < entry->num_postings; n++) {
+      KwsPosting posting;
+      utt += UnZigZag(ReadVarint(&p));
+      posting.utt = utt;
+      posting.label = UnZigZag(ReadVarint(&p));
+      posting.tbeg = UnZigZag(ReadVarint(&p));
+      posting.tend = posting.tbeg + UnZigZag(ReadVarint(&p));
+      memcpy(&posting.score, p, sizeof(BaseFloat));
+      p += sizeof(BaseFloat);
+      postings->push_back(posting);
+    }
+    num_found += entry->num_postings;
+  }
+  return num_found;
+}
+
+}  // namespace kaldi
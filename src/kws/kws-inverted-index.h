@@ -0,0 +1,141 @@
+// kws/kws-inverted-index.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_KWS_KWS_INVERTED_INDEX_H_
+#define KALDI_KWS_KWS_INVERTED_INDEX_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "util/kaldi-mmap.h"
+#include "kws/kaldi-kws.h"
+
+namespace kaldi {
+
+/// One occurrence of a word sequence in the index.  'utt' and 'label' are the
+/// output and input labels of the final arc of the factor in the
+/// KwsLexicographicFst index, i.e. the utterance id and the symbol that
+/// distinguishes the clusters of the utterance (see kws-search.cc); 'score' is
+/// the negated log posterior.
+struct KwsPosting {
+  int32 utt;
+  int32 label;
+  int32 tbeg;
+  int32 tend;
+  BaseFloat score;
+};
+
+/**
+   KwsInvertedIndexBuilder converts KWS indexes, as written by
+   lattice-to-kws-index and kws-index-union, into the inverted format read by
+   KwsInvertedIndex: for each word sequence of up to 'max_order' words, a list
+   of its occurrences (KwsPosting).
+
+   The file format is a sequence of segments, each of which is a complete
+   inverted index; Write() appends a new segment, so that new data can be
+   added to an existing index without rebuilding it.  A segment consists of a
+   header, a table of the word sequences (sorted, so that they can be found by
+   binary search), the words of the sequences, and the posting lists.  In the
+   posting lists, the utterance ids (which are sorted) and times are stored as
+   variable-length integers and the utterance ids as differences, which makes
+   the postings about half the size of KwsPosting.  The numbers are stored
+   in the byte order of the machine, so the files are not portable between
+   machines of different endianness.
+*/
+class KwsInvertedIndexBuilder {
+ public:
+  explicit KwsInvertedIndexBuilder(int32 max_order);
+
+  /// Adds the occurrences of all the word sequences of up to max_order words
+  /// in 'index', which must be a KWS index as output by lattice-to-kws-index
+  /// or kws-index-union.
+  void AddIndex(const KwsLexicographicFst &index);
+
+  /// Returns the number of distinct word sequences added so far.
+  int32 NumKeys() const { return postings_.size(); }
+
+  /// Writes a segment containing everything added so far.  'os' must be in
+  /// binary mode.
+  void Write(std::ostream &os) const;
+
+ private:
+  void AddPostings(const KwsLexicographicFst &index,
+                   KwsLexicographicFst::StateId s,
+                   const KwsLexicographicWeight &weight,
+                   std::vector<int32> *words);
+
+  int32 max_order_;
+  std::map<std::vector<int32>, std::vector<KwsPosting> > postings_;
+};
+
+
+/**
+   KwsInvertedIndex gives access to an inverted index written by
+   KwsInvertedIndexBuilder.  The file is used via mmap() if possible (it is
+   read into memory otherwise), so opening it takes very little time and
+   lookups read only the pages they need.
+*/
+class KwsInvertedIndex {
+ public:
+  KwsInvertedIndex(): data_(NULL), size_(0), max_order_(0) { }
+
+  /// Opens the index in 'filename'.  If it is an ordinary file, it is mapped
+  /// into memory; otherwise (e.g. for a pipe) it is read into memory.
+  void Open(const std::string &filename);
+
+  /// Appends to 'postings' the occurrences of the word sequence 'words' in
+  /// all the segments of the index, and returns the number appended.
+  /// 'words' must not be longer than MaxOrder().
+  int32 Lookup(const std::vector<int32> &words,
+               std::vector<KwsPosting> *postings) const;
+
+  int32 NumSegments() const { return segments_.size(); }
+
+  /// The smallest max_order of any of the segments.
+  int32 MaxOrder() const { return max_order_; }
+
+ private:
+  friend class KwsInvertedIndexBuilder;
+  struct SegmentHeader;
+  struct KeyEntry;
+  struct Segment {
+    const KeyEntry *keys;
+    int32 num_keys;
+    const int32 *words;
+    const unsigned char *postings;
+    uint64 postings_size;
+  };
+
+  // Finds the segments in data_.
+  void InitSegments(const std::string &filename);
+
+  MappedFile mapped_file_;
+  // Used if the file could not be mapped.
+  std::vector<char> buffer_;
+  const char *data_;
+  size_t size_;
+  std::vector<Segment> segments_;
+  int32 max_order_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(KwsInvertedIndex);
+};
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_KWS_KWS_INVERTED_INDEX_H_
@@ -0,0 +1,100 @@
+// kwsbin/kws-index-to-inverted.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fstream>
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "fstext/kaldi-fst-io.h"
+#include "kws/kws-inverted-index.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Convert KWS indexes (as written by lattice-to-kws-index or\n"
+        "kws-index-union) to the inverted format searched by\n"
+        "kws-search-inverted, which lists the occurrences of each word\n"
+        "sequence of up to --max-order words.  All the indexes in the input\n"
+        "table are converted into one segment of the inverted index.  With\n"
+        "--append=true the segment is appended to an existing inverted index,\n"
+        "so new data can be added without rebuilding the whole index.\n"
+        "\n"
+        "Usage: kws-index-to-inverted [options] <index-rspecifier> "
+        "<inverted-index-wxfilename>\n"
+        " e.g.: kws-index-to-inverted --max-order=3 ark:index.idx "
+        "index.inv\n";
+
+    ParseOptions po(usage);
+
+    int32 max_order = 3;
+    bool append = false;
+    po.Register("max-order", &max_order, "Maximum number of words in the "
+                "word sequences that are indexed; keywords with more words "
+                "than this cannot be searched.");
+    po.Register("append", &append, "If true, append to an existing inverted "
+                "index (must be an ordinary file).");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string index_rspecifier = po.GetArg(1),
+        inverted_wxfilename = po.GetArg(2);
+
+    SequentialTableReader< VectorFstTplHolder<KwsLexicographicArc> >
+        index_reader(index_rspecifier);
+
+    KwsInvertedIndexBuilder builder(max_order);
+    int32 n_done = 0;
+    for (; !index_reader.Done(); index_reader.Next()) {
+      builder.AddIndex(index_reader.Value());
+      index_reader.FreeCurrent();
+      n_done++;
+    }
+
+    if (append) {
+      if (ClassifyWxfilename(inverted_wxfilename) != kFileOutput)
+        KALDI_ERR << "--append=true requires an ordinary file, not "
+                  << inverted_wxfilename;
+      std::ofstream os(inverted_wxfilename.c_str(),
+                       std::ios::out | std::ios::binary | std::ios::app);
+      if (!os.is_open())
+        KALDI_ERR << "Could not open " << inverted_wxfilename
+                  << " for appending";
+      builder.Write(os);
+    } else {
+      bool binary = true, write_header = false;
+      Output ko(inverted_wxfilename, binary, write_header);
+      builder.Write(ko.Stream());
+    }
+
+    KALDI_LOG << "Converted " << n_done << " indexes, with "
+              << builder.NumKeys() << " word sequences, to "
+              << inverted_wxfilename;
+    return (n_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
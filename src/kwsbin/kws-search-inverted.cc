@@ -0,0 +1,227 @@
+// kwsbin/kws-search-inverted.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <map>
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "fstext/kaldi-fst-io.h"
+#include "kws/kws-inverted-index.h"
+
+namespace kaldi {
+
+// A path through a keyword FST: its output words (without epsilons) and cost.
+struct KeywordPath {
+  std::vector<int32> words;
+  double cost;
+};
+
+// Appends to 'paths' the paths of 'keyword' (which must be acyclic) that
+// start from state s, given the words and cost of the path up to s.
+static void GetKeywordPaths(const fst::VectorFst<fst::StdArc> &keyword,
+                            fst::StdArc::StateId s,
+                            KeywordPath *path,
+                            std::vector<KeywordPath> *paths) {
+  fst::StdArc::Weight final_weight = keyword.Final(s);
+  if (final_weight != fst::StdArc::Weight::Zero() && !path->words.empty()) {
+    paths->push_back(*path);
+    paths->back().cost += final_weight.Value();
+  }
+  for (fst::ArcIterator<fst::VectorFst<fst::StdArc> > aiter(keyword, s);
+       !aiter.Done(); aiter.Next()) {
+    const fst::StdArc &arc = aiter.Value();
+    double cost = path->cost;
+    path->cost += arc.weight.Value();
+    if (arc.olabel != 0)
+      path->words.push_back(arc.olabel);
+    GetKeywordPaths(keyword, arc.nextstate, path, paths);
+    if (arc.olabel != 0)
+      path->words.pop_back();
+    path->cost = cost;
+  }
+}
+
+static bool CompareScores(const KwsPosting &a, const KwsPosting &b) {
+  return a.score < b.score;
+}
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Search keywords in an inverted index written by\n"
+        "kws-index-to-inverted.  The output is as for kws-search, i.e. the\n"
+        "results are written as vectors\n"
+        "utt_id beg_frame end_frame neg_logprob\n"
+        "for each keyword id.  As with kws-search, each path of the keyword\n"
+        "FST is searched, and for each utterance and time cluster the best\n"
+        "match is output.  Keyword paths with more words than the --max-order\n"
+        "used to build the index cannot be searched; they are reported.\n"
+        "\n"
+        "Usage: kws-search-inverted [options] <inverted-index-rxfilename> "
+        "<keywords-rspecifier> <results-wspecifier>\n"
+        " e.g.: kws-search-inverted index.inv ark:keywords.fsts "
+        "ark:results\n"
+        "See also: kws-index-to-inverted, kws-search\n";
+
+    ParseOptions po(usage);
+
+    int32 n_best = -1;
+    int32 keyword_nbest = -1;
+    bool strict = true;
+    double negative_tolerance = -0.1;
+    double keyword_beam = -1;
+    int32 frame_subsampling_factor = 1;
+
+    po.Register("frame-subsampling-factor", &frame_subsampling_factor,
+                "Frame subsampling factor. (Default value 1)");
+    po.Register("nbest", &n_best, "Return the best n hypotheses.");
+    po.Register("keyword-nbest", &keyword_nbest,
+                "Pick the best n keywords if the FST contains "
+                "multiple keywords.");
+    po.Register("strict", &strict, "Affects the return status of the program.");
+    po.Register("negative-tolerance", &negative_tolerance,
+                "The program will print a warning if we get negative score "
+                "smaller than this tolerance.");
+    po.Register("keyword-beam", &keyword_beam,
+                "Prune the FST with the given beam if the FST contains "
+                "multiple keywords.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (n_best < 0 && n_best != -1)
+      KALDI_ERR << "Bad number for nbest";
+    if (keyword_nbest < 0 && keyword_nbest != -1)
+      KALDI_ERR << "Bad number for keyword-nbest";
+    if (keyword_beam < 0 && keyword_beam != -1)
+      KALDI_ERR << "Bad number for keyword-beam";
+
+    std::string index_rxfilename = po.GetArg(1),
+        keyword_rspecifier = po.GetArg(2),
+        result_wspecifier = po.GetArg(3);
+
+    KwsInvertedIndex index;
+    index.Open(index_rxfilename);
+
+    SequentialTableReader<VectorFstHolder> keyword_reader(keyword_rspecifier);
+    TableWriter<BasicVectorHolder<double> > result_writer(result_wspecifier);
+
+    int32 n_done = 0, n_fail = 0;
+    int64 n_results = 0;
+    for (; !keyword_reader.Done(); keyword_reader.Next()) {
+      std::string key = keyword_reader.Key();
+      VectorFst<StdArc> keyword = keyword_reader.Value();
+      keyword_reader.FreeCurrent();
+
+      // Process the case where we have confusion for keywords
+      if (keyword_beam != -1) {
+        Prune(&keyword, keyword_beam);
+      }
+      if (keyword_nbest != -1) {
+        VectorFst<StdArc> tmp;
+        ShortestPath(keyword, &tmp, keyword_nbest, true, true);
+        keyword = tmp;
+      }
+      if (keyword.Start() == kNoStateId)
+        continue;
+      if (keyword.Properties(kAcyclic, true) == 0) {
+        KALDI_WARN << "Keyword FST for " << key << " has cycles; use "
+                   << "--keyword-nbest.";
+        n_fail++;
+        continue;
+      }
+
+      std::vector<KeywordPath> paths;
+      KeywordPath path;
+      path.cost = 0.0;
+      GetKeywordPaths(keyword, keyword.Start(), &path, &paths);
+
+      // The best match for each (utterance, cluster label).
+      std::map<std::pair<int32, int32>, KwsPosting> best;
+      std::vector<KwsPosting> postings;
+      for (size_t i = 0; i < paths.size(); i++) {
+        if (static_cast<int32>(paths[i].words.size()) > index.MaxOrder()) {
+          KALDI_WARN << "Keyword " << key << " has a path with "
+                     << paths[i].words.size() << " words, but the index only "
+                     << "has sequences of up to " << index.MaxOrder()
+                     << " words; not searching it.";
+          continue;
+        }
+        postings.clear();
+        index.Lookup(paths[i].words, &postings);
+        for (size_t j = 0; j < postings.size(); j++) {
+          KwsPosting p = postings[j];
+          p.score += paths[i].cost;
+          std::pair<int32, int32> pr(p.utt, p.label);
+          std::map<std::pair<int32, int32>, KwsPosting>::iterator iter =
+              best.find(pr);
+          if (iter == best.end())
+            best[pr] = p;
+          else if (p.score < iter->second.score)
+            iter->second = p;
+        }
+      }
+
+      std::vector<KwsPosting> results;
+      for (std::map<std::pair<int32, int32>, KwsPosting>::const_iterator
+               iter = best.begin(); iter != best.end(); ++iter)
+        results.push_back(iter->second);
+      std::stable_sort(results.begin(), results.end(), CompareScores);
+      if (n_best != -1 && static_cast<int32>(results.size()) > n_best)
+        results.resize(n_best);
+
+      for (size_t i = 0; i < results.size(); i++) {
+        double score = results[i].score;
+        if (score < 0) {
+          if (score < negative_tolerance) {
+            KALDI_WARN << "Score out of expected range: " << score;
+          }
+          score = 0.0;
+        }
+        std::vector<double> result;
+        result.push_back(results[i].utt);
+        result.push_back(results[i].tbeg * frame_subsampling_factor);
+        result.push_back(results[i].tend * frame_subsampling_factor);
+        result.push_back(score);
+        result_writer.Write(key, result);
+      }
+      n_results += results.size();
+      n_done++;
+    }
+
+    KALDI_LOG << "Done " << n_done << " keywords (" << n_fail << " failed), "
+              << "found " << n_results << " results.";
+    if (strict == true)
+      return (n_done != 0 ? 0 : 1);
+    else
+      return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -77,6 +77,14 @@ class PrunedCompactLatticeComposer {
   // out of the composed state numbered 'composed_state_to_expand'.
   void ProcessQueueElement(int32 composed_state_to_expand);
 
+  // This function pops up to opts_.expand_batch_size elements from the queue
+  // (but no more than 'arc_limit' minus the current number of arcs, since each
+  // element produces at most one arc) and processes them in order.  Composed
+  // states created while processing the batch are not expanded until a later
+  // batch, which lets a det_fst_ that defers the computation of its new states
+  // compute them all at once.
+  void ProcessQueueBatch(int32 arc_limit);
+
   // This is a part of ProcessQueueElements() that has been broken out
   // for clarity. it process the arc_index'th arc out of this source state.
   void ProcessTransition(int32 composed_src_state,
@@ -375,6 +383,10 @@ class PrunedCompactLatticeComposer {
   // will matter more for early iterations of the composition, when we need
   // to access the output lattice in topological order).
   std::set<int32> accessed_lat_states_;
+
+  // Temporary storage used in ProcessQueueBatch(), kept here to avoid
+  // reallocating it.
+  std::vector<int32> batch_states_;
 };
 
 
@@ -751,6 +763,30 @@ void PrunedCompactLatticeComposer::ProcessQueueElement(
   }
 }
 
+void PrunedCompactLatticeComposer::ProcessQueueBatch(int32 arc_limit) {
+  int32 batch_size = std::min<int32>(opts_.expand_batch_size,
+                                     arc_limit - num_arcs_out_);
+  batch_states_.clear();
+  while (static_cast<int32>(batch_states_.size()) < batch_size &&
+         !composed_state_queue_.empty()) {
+    batch_states_.push_back(composed_state_queue_.top().second);
+    composed_state_queue_.pop();
+  }
+  std::vector<int32>::const_iterator iter = batch_states_.begin(),
+      end = batch_states_.end();
+  for (; iter != end; ++iter) {
+    bool reached_final = output_reached_final_;
+    ProcessQueueElement(*iter);
+    if (output_reached_final_ != reached_final) {
+      // The first final-state was reached, which called
+      // RecomputePruningInfo(); that rebuilt composed_state_queue_ from all
+      // the composed states, including the rest of this batch, so we must
+      // not process them here as well.
+      break;
+    }
+  }
+}
+
 void PrunedCompactLatticeComposer::ProcessTransition(int32 src_composed_state,
                                                      int32 arc_index) {
   // Make src_composed_state a const pointer not a reference, as we may have to
@@ -899,9 +935,13 @@ void PrunedCompactLatticeComposer::Compose() {
     int32 this_iter_arc_limit = GetCurrentArcLimit();
     while (num_arcs_out_ < this_iter_arc_limit &&
            !composed_state_queue_.empty()) {
-      int32 src_composed_state = composed_state_queue_.top().second;
-      composed_state_queue_.pop();
-      ProcessQueueElement(src_composed_state);
+      if (opts_.expand_batch_size > 1) {
+        ProcessQueueBatch(this_iter_arc_limit);
+      } else {
+        int32 src_composed_state = composed_state_queue_.top().second;
+        composed_state_queue_.pop();
+        ProcessQueueElement(src_composed_state);
+      }
     }
     if (composed_state_queue_.empty())
       break;
@@ -121,10 +121,21 @@ struct ComposeLatticePrunedOptions {
   // heuristics will be less accurate).
   BaseFloat growth_ratio;
 
+  // 'expand_batch_size' is the number of queue elements (best-first frontier
+  // states) that we pop and expand together.  With the default of 1 the
+  // composition is strictly best-first.  Larger values let on-demand FSTs that
+  // defer the computation of new states (e.g. the batched RNNLM FSTs) compute
+  // many states in one go, since states created while processing a batch are
+  // not expanded until the next batch.  All states in a batch are within the
+  // current beam, and the batch never exceeds the current arc limit, so the
+  // pruning behavior is only changed in the order of expansion.
+  int32 expand_batch_size;
+
   ComposeLatticePrunedOptions(): lattice_compose_beam(6.0),
                                  max_arcs(100000),
                                  initial_num_arcs(100),
-                                 growth_ratio(1.5) { }
+                                 growth_ratio(1.5),
+                                 expand_batch_size(1) { }
   void Register(OptionsItf *po) {
     po->Register("lattice-compose-beam", &lattice_compose_beam,
                  "Beam used in pruned lattice composition, which determines how "
@@ -135,6 +146,10 @@ struct ComposeLatticePrunedOptions {
     po->Register("growth-ratio", &growth_ratio, "Factor used in the lattice "
                  "composition algorithm; must be >1.0.  Affects speed vs. "
                  "the optimality of the best-first composition.");
+    po->Register("expand-batch-size", &expand_batch_size, "Number of "
+                 "best-first frontier states that are expanded together in "
+                 "pruned composition; values >1 help language models that "
+                 "compute their states in batches (e.g. RNNLMs on GPU).");
   }
 };
 
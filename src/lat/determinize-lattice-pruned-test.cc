@@ -23,6 +23,7 @@
 #include "fstext/fst-test-utils.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
+#include "hmm/hmm-test-utils.h"
 
 namespace fst {
 // Caution: these tests are not as generic as you might think from all the
@@ -136,6 +137,148 @@ template<class Arc> void TestDeterminizeLatticePruned2() {
   }
 }
 
+// test that DeterminizeLatticePrunedChunked() gives the same output as
+// DeterminizeLatticePruned(), on lattices made by concatenating random
+// lattices so that there are states to split them at.
+void TestDeterminizeLatticePrunedChunked() {
+  typedef kaldi::LatticeArc Arc;
+  for (int i = 0; i < 100; i++) {
+    RandFstOptions opts;
+    opts.n_states = 4;
+    opts.n_arcs = 10;
+    opts.n_final = 2;
+    opts.allow_empty = false;
+    opts.weight_multiplier = 0.5;
+    opts.acyclic = true;
+    VectorFst<Arc> fst;
+    int num_parts = 2 + kaldi::Rand() % 4;
+    for (int j = 0; j < num_parts; j++) {
+      VectorFst<Arc> *part = RandPairFst<Arc>(opts);
+      if (j == 0) fst = *part;
+      else Concat(&fst, *part);
+      delete part;
+    }
+    Connect(&fst);
+    bool sorted = TopSort(&fst);
+    KALDI_ASSERT(sorted);
+    ArcSort(&fst, ILabelCompare<Arc>());
+
+    DeterminizeLatticeChunkedOptions chunk_opts;
+    chunk_opts.num_threads = 2 + kaldi::Rand() % 3;
+    chunk_opts.min_chunk_states = 1 + kaldi::Rand() % 4;
+    kaldi::CompactLattice det_fst, chunked_det_fst;
+    bool ans = DeterminizeLatticePruned<kaldi::LatticeWeight, kaldi::int32>(
+        fst, 10.0, &det_fst);
+    bool chunked_ans = DeterminizeLatticePrunedChunked(
+        fst, 10.0, &chunked_det_fst, chunk_opts);
+    KALDI_ASSERT(chunked_det_fst.Properties(kIDeterministic, true) &
+                 kIDeterministic);
+    if (ans && chunked_ans)
+      KALDI_ASSERT(RandEquivalent(det_fst, chunked_det_fst, 5/*paths*/,
+                                  0.01/*delta*/, kaldi::Rand()/*seed*/,
+                                  100/*path length, max*/));
+  }
+}
+
+// test that the determinizers, which are reused between calls (see
+// LatticeDeterminizerPrunedPool), give the same output for a lattice whatever
+// lattices they determinized before, including with a different delta.
+void TestDeterminizeLatticePrunedReuse() {
+  typedef kaldi::LatticeArc Arc;
+  RandFstOptions opts;
+  opts.n_states = 4;
+  opts.n_arcs = 10;
+  opts.n_final = 2;
+  opts.allow_empty = false;
+  opts.weight_multiplier = 0.5;
+  opts.acyclic = true;
+  int num_fsts = 20;
+  std::vector<VectorFst<Arc>*> fsts(num_fsts);
+  std::vector<kaldi::CompactLattice> det_fsts(num_fsts);
+  std::vector<bool> ans(num_fsts);
+  for (int i = 0; i < num_fsts; i++) {
+    fsts[i] = RandPairFst<Arc>(opts);
+    bool sorted = TopSort(fsts[i]);
+    KALDI_ASSERT(sorted);
+    ans[i] = DeterminizeLatticePruned<kaldi::LatticeWeight, kaldi::int32>(
+        *fsts[i], 10.0, &(det_fsts[i]));
+  }
+  for (int i = num_fsts - 1; i >= 0; i--) {
+    DeterminizeLatticePrunedOptions lat_opts;
+    if (i % 2 == 0)
+      lat_opts.delta = 2 * kDelta;  // makes the hashes be re-created.
+    kaldi::CompactLattice det_fst;
+    bool this_ans = DeterminizeLatticePruned<kaldi::LatticeWeight,
+                                             kaldi::int32>(
+        *fsts[i], 10.0, &det_fst, lat_opts);
+    KALDI_ASSERT(this_ans == ans[i]);
+    if (this_ans)
+      KALDI_ASSERT(RandEquivalent(det_fst, det_fsts[i], 5/*paths*/,
+                                  0.01/*delta*/, kaldi::Rand()/*seed*/,
+                                  100/*path length, max*/));
+    delete fsts[i];
+  }
+}
+
+// test that CachingLatticeDeterminizer gives the same output as
+// DeterminizeLatticePhonePrunedWrapper() when it is given growing prefixes of a
+// lattice, as when it is used for partial results while decoding.
+void TestCachingLatticeDeterminizer() {
+  typedef kaldi::LatticeArc Arc;
+  kaldi::ContextDependency *ctx_dep;
+  kaldi::TransitionModel *trans_model = kaldi::GenRandTransitionModel(&ctx_dep);
+  int num_tids = trans_model->NumTransitionIds();
+  for (int i = 0; i < 20; i++) {
+    RandFstOptions opts;
+    opts.n_states = 4;
+    opts.n_arcs = 10;
+    opts.n_final = 2;
+    opts.allow_empty = false;
+    opts.weight_multiplier = 0.5;
+    opts.acyclic = true;
+    DeterminizeLatticePhonePrunedOptions det_opts;
+    CachingLatticeDeterminizer determinizer(*trans_model, 10.0, det_opts,
+                                            1 + kaldi::Rand() % 4);
+    VectorFst<Arc> fst;
+    int num_parts = 2 + kaldi::Rand() % 5;
+    for (int j = 0; j < num_parts; j++) {
+      VectorFst<Arc> *part = RandPairFst<Arc>(opts);
+      // The input labels have to be transition-ids.
+      for (StateIterator<VectorFst<Arc> > siter(*part); !siter.Done();
+           siter.Next()) {
+        for (MutableArcIterator<VectorFst<Arc> > aiter(part, siter.Value());
+             !aiter.Done(); aiter.Next()) {
+          Arc arc = aiter.Value();
+          if (arc.ilabel != 0)
+            arc.ilabel = 1 + arc.ilabel % num_tids;
+          aiter.SetValue(arc);
+        }
+      }
+      Connect(part);
+      bool sorted = TopSort(part);
+      KALDI_ASSERT(sorted);
+      // Concat() appends the states of "part" after those of "fst", so each
+      // lattice is a longer version of the previous one, as for a lattice
+      // being decoded, and it stays topologically sorted.
+      if (j == 0) fst = *part;
+      else Concat(&fst, *part);
+      delete part;
+
+      // Both functions modify their input.
+      VectorFst<Arc> lat(fst), lat_copy(fst);
+      kaldi::CompactLattice det_fst, cached_det_fst;
+      bool ans = DeterminizeLatticePhonePrunedWrapper(
+          *trans_model, &lat, 10.0, &det_fst, det_opts);
+      bool cached_ans = determinizer.Determinize(&lat_copy, &cached_det_fst);
+      if (ans && cached_ans)
+        KALDI_ASSERT(RandEquivalent(det_fst, cached_det_fst, 5/*paths*/,
+                                    0.01/*delta*/, kaldi::Rand()/*seed*/,
+                                    100/*path length, max*/));
+    }
+  }
+  delete trans_model;
+  delete ctx_dep;
+}
 
 } // end namespace fst
 
@@ -143,5 +286,8 @@ int main() {
   using namespace fst;
   TestDeterminizeLatticePruned<kaldi::LatticeArc>();
   TestDeterminizeLatticePruned2<kaldi::LatticeArc>();
+  TestDeterminizeLatticePrunedChunked();
+  TestDeterminizeLatticePrunedReuse();
+  TestCachingLatticeDeterminizer();
   std::cout << "Tests succeeded\n";
 }
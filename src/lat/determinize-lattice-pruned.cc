@@ -21,12 +21,17 @@
 
 #include <vector>
 #include <climits>
+#include <functional>
 #include "fstext/determinize-lattice.h" // for LatticeStringRepository
 #include "fstext/fstext-utils.h"
 #include "lat/lattice-functions.h"  // for PruneLattice
 #include "lat/minimize-lattice.h"   // for minimization
 #include "lat/push-lattice.h"       // for minimization
+#include <memory>
+#include <mutex>
 #include "lat/determinize-lattice-pruned.h"
+#include "util/kaldi-thread.h"
+#include "util/memory-budget.h"
 
 namespace fst {
 
@@ -191,11 +196,85 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   LatticeDeterminizerPruned(const ExpandedFst<Arc> &ifst,
                             double beam,
                             DeterminizeLatticePrunedOptions opts):
-      num_arcs_(0), num_elems_(0), ifst_(ifst.Copy()), beam_(beam), opts_(opts),
+      num_arcs_(0), num_elems_(0), ifst_(NULL), beam_(beam), opts_(opts),
       equal_(opts_.delta), determinized_(false),
-      minimal_hash_(3, hasher_, equal_), initial_hash_(3, hasher_, equal_) {
+      minimal_hash_(3, hasher_, equal_), initial_hash_(3, hasher_, equal_),
+      raw_lattice_memory_(kaldi::kMemoryRawLattice),
+      memory_(kaldi::kMemoryDeterminization) {
+    Init(ifst, beam, opts);
+  }
+
+  // This constructor is for objects that will determinize several lattices:
+  // call Init(), Determinize() and Output(ofst, false), then Clear() before
+  // the next Init().  Clear() keeps the memory of the hashes, the string
+  // repository, the subsets, the tasks and the output states, so later
+  // lattices hardly need to allocate anything.
+  LatticeDeterminizerPruned():
+      num_arcs_(0), num_elems_(0), ifst_(NULL), beam_(0.0),
+      equal_(opts_.delta), determinized_(false),
+      minimal_hash_(3, hasher_, equal_), initial_hash_(3, hasher_, equal_),
+      raw_lattice_memory_(kaldi::kMemoryRawLattice),
+      memory_(kaldi::kMemoryDeterminization) { }
+
+  void Init(const ExpandedFst<Arc> &ifst,
+            double beam,
+            DeterminizeLatticePrunedOptions opts) {
     KALDI_ASSERT(Weight::Properties() & kIdempotent); // this algorithm won't
     // work correctly otherwise.
+    KALDI_ASSERT(ifst_ == NULL && output_states_.empty() &&
+                 "Call Clear() before re-initializing the determinizer.");
+    if (opts.delta != equal_.delta_) {
+      // The hashes keep their own copies of equal_.
+      equal_ = SubsetEqual(opts.delta);
+      { MinimalSubsetHash tmp(3, hasher_, equal_); tmp.swap(minimal_hash_); }
+      { InitialSubsetHash tmp(3, hasher_, equal_); tmp.swap(initial_hash_); }
+    }
+    ifst_ = ifst.Copy();
+    beam_ = beam;
+    opts_ = opts;
+    determinized_ = false;
+    size_t num_arcs = 0;
+    for (StateIterator<ExpandedFst<Arc> > siter(ifst); !siter.Done();
+         siter.Next())
+      num_arcs += ifst.NumArcs(siter.Value());
+    raw_lattice_memory_.Set(ifst.NumStates() * sizeof(Weight) +
+                            num_arcs * sizeof(Arc));
+  }
+
+  // Forgets the lattice and the output, so that Init() can be called again,
+  // but keeps the memory.  Must not be called after Output(ofst, true).
+  void Clear() {
+    if (ifst_) {
+      delete ifst_;
+      ifst_ = NULL;
+      raw_lattice_memory_.Set(0);
+    }
+    minimal_hash_.clear();
+    for (typename InitialSubsetHash::iterator iter = initial_hash_.begin();
+         iter != initial_hash_.end(); ++iter)
+      free_subsets_.push_back(const_cast<vector<Element>*>(iter->first));
+    initial_hash_.clear();
+    while (!queue_.empty()) {
+      FreeTask(queue_.top());
+      queue_.pop();
+    }
+    free_output_states_.insert(free_output_states_.end(),
+                               output_states_.begin(), output_states_.end());
+    output_states_.clear();
+    isymbol_or_final_.clear();
+    repository_.Clear();
+    num_arcs_ = 0;
+    num_elems_ = 0;
+    determinized_ = false;
+    memory_.Set(0);
+  }
+
+  // The approximate memory used by the current lattice, as in
+  // CheckMemoryUsage().
+  size_t MemoryUsage() const {
+    return static_cast<size_t>(repository_.MemSize()) +
+        static_cast<size_t>(num_arcs_) * sizeof(TempArc) +
+        static_cast<size_t>(num_elems_) * sizeof(Element);
   }
 
   void FreeOutputStates() {
@@ -211,6 +290,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     if (ifst_) {
       delete ifst_;
       ifst_ = NULL;
+      raw_lattice_memory_.Set(0);
     }
     { MinimalSubsetHash tmp; tmp.swap(minimal_hash_); }
 
@@ -243,6 +323,12 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   ~LatticeDeterminizerPruned() {
     FreeMostMemory();
     FreeOutputStates();
+    for (size_t i = 0; i < free_subsets_.size(); i++)
+      delete free_subsets_[i];
+    for (size_t i = 0; i < free_tasks_.size(); i++)
+      delete free_tasks_[i];
+    for (size_t i = 0; i < free_output_states_.size(); i++)
+      delete free_output_states_[i];
     // rest is deleted by destructors.
   }
 
@@ -294,6 +380,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
         arcs_size = num_arcs_ * sizeof(TempArc),
         elems_size = num_elems_ * sizeof(Element),
         total_size = repo_size + arcs_size + elems_size;
+    memory_.Set(total_size);
     if (opts_.max_mem > 0 && total_size > opts_.max_mem) { // We passed the memory threshold.
       // This is usually due to the repository getting large, so we
       // clean this out.
@@ -366,7 +453,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       }
       queue_.pop();
       ProcessTransition(task->state, task->label, &(task->subset));
-      delete task;
+      FreeTask(task);
     }
     determinized_ = true;
     if (effective_beam != NULL) {
@@ -538,7 +625,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       return state_id;
     }
     OutputStateId state_id = static_cast<OutputStateId>(output_states_.size());
-    OutputState *new_state = new OutputState(subset, forward_cost);
+    OutputState *new_state = NewOutputState(subset, forward_cost);
     minimal_hash_[&(new_state->minimal_subset)] = state_id;
     output_states_.push_back(new_state);
     num_elems_ += subset.size();
@@ -592,7 +679,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // Before returning "ans", add the initial subset to the hash,
     // so that we can bypass the epsilon-closure etc., next time
     // we process the same initial subset.
-    vector<Element> *initial_subset_ptr = new vector<Element>(subset_in);
+    vector<Element> *initial_subset_ptr = NewSubset(subset_in);
     elem.state = ans;
     initial_hash_[initial_subset_ptr] = elem;
     num_elems_ += initial_subset_ptr->size(); // keep track of memory usage.
@@ -639,13 +726,18 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // be so at output].  This function follows input-epsilons, and augments the
     // subset accordingly.
 
-    std::priority_queue<Element, vector<Element>, greater<Element> > queue;
-    unordered_map<InputStateId, Element> cur_subset;
+    // "queue" is a priority queue (a heap, with the smallest state first) and
+    // "cur_subset" a map from state to Element; they are class members so
+    // that their memory is reused, and they are left empty.
+    vector<Element> &queue(closure_queue_tmp_);
+    unordered_map<InputStateId, Element> &cur_subset(closure_subset_tmp_);
     typedef typename unordered_map<InputStateId, Element>::iterator MapIter;
     typedef typename vector<Element>::const_iterator VecIter;
+    greater<Element> heap_compare;
 
     for (VecIter iter = subset->begin(); iter != subset->end(); ++iter) {
-      queue.push(*iter);
+      queue.push_back(*iter);
+      std::push_heap(queue.begin(), queue.end(), heap_compare);
       cur_subset[iter->state] = *iter;
     }
 
@@ -655,8 +747,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     int counter = 0; // stops infinite loops here for non-lattice-determinizable input
     // (e.g. input with negative-cost epsilon loops); useful in testing.
     while (queue.size() != 0) {
-      Element elem = queue.top();
-      queue.pop();
+      std::pop_heap(queue.begin(), queue.end(), heap_compare);
+      Element elem = queue.back();
+      queue.pop_back();
 
       // The next if-statement is a kind of optimization.  It's to prevent us
       // unnecessarily repeating the processing of a state.  "cur_subset" always
@@ -689,7 +782,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
             next_elem.string = (arc.olabel == 0 ? elem.string :
                                 repository_.Successor(elem.string, arc.olabel));
             cur_subset[next_elem.state] = next_elem;
-            queue.push(next_elem);
+            queue.push_back(next_elem);
+            std::push_heap(queue.begin(), queue.end(), heap_compare);
           } else {
             // was not inserted because one already there.  In normal
             // determinization we'd add the weights.  Here, we find which one
@@ -708,7 +802,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                                   repository_.Successor(elem.string, arc.olabel));
               iter->second.string = next_elem.string;
               iter->second.weight = next_elem.weight;
-              queue.push(next_elem);
+              queue.push_back(next_elem);
+              std::push_heap(queue.begin(), queue.end(), heap_compare);
               replaced_elems = true;
             }
             // else it is the same or worse, so use original one.
@@ -724,6 +819,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       for (; iter != end; ++iter) subset->push_back(iter->second);
       // sort by state ID, because the subset hash function is order-dependent(see SubsetKey)
       std::sort(subset->begin(), subset->end());
+      cur_subset.clear();
     }
   }
 
@@ -940,7 +1036,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     while (cur != end) {
       // The old code (non-pruned) called ProcessTransition; here, instead,
       // we'll put the calls into a priority queue.
-      Task *task = new Task;
+      Task *task = NewTask();
       // Process ranges that share the same input symbol.
       Label ilabel = cur->first;
       task->state = output_state_id;
@@ -965,7 +1061,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 
       if (task->priority_cost > cutoff_) {
         // This task would never get done as it's past the pruning cutoff.
-        delete task;
+        FreeTask(task);
       } else {
         MakeSubsetUnique(&(task->subset)); // remove duplicate Elements with the same state.
         queue_.push(task); // Push the task onto the queue.  The queue keeps it
@@ -1080,7 +1176,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       // Weight::One() is the "forward-weight" of this determinized state...
       // i.e. the minimal cost from the start of the determinized FST to this
       // state [One() because it's the start state].
-      OutputState *initial_state = new OutputState(subset, 0);
+      OutputState *initial_state = NewOutputState(subset, 0);
       KALDI_ASSERT(output_states_.empty());
       output_states_.push_back(initial_state);
       num_elems_ += subset.size();
@@ -1170,6 +1266,50 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 
   vector<pair<Label, Element> > all_elems_tmp_; // temporary vector used in ProcessTransitions.
 
+  // temporaries used in EpsilonClosure().
+  vector<Element> closure_queue_tmp_;
+  unordered_map<InputStateId, Element> closure_subset_tmp_;
+
+  // Objects freed by Clear() and Determinize(), kept for reuse; owned here.
+  // Their vectors keep their capacity.
+  vector<vector<Element>*> free_subsets_;
+  vector<Task*> free_tasks_;
+  vector<OutputState*> free_output_states_;
+
+  vector<Element> *NewSubset(const vector<Element> &subset) {
+    if (free_subsets_.empty())
+      return new vector<Element>(subset);
+    vector<Element> *ans = free_subsets_.back();
+    free_subsets_.pop_back();
+    *ans = subset;
+    return ans;
+  }
+
+  Task *NewTask() {
+    if (free_tasks_.empty())
+      return new Task;
+    Task *ans = free_tasks_.back();
+    free_tasks_.pop_back();
+    return ans;
+  }
+
+  void FreeTask(Task *task) {
+    task->subset.clear();
+    free_tasks_.push_back(task);
+  }
+
+  OutputState *NewOutputState(const vector<Element> &minimal_subset,
+                              double forward_cost) {
+    if (free_output_states_.empty())
+      return new OutputState(minimal_subset, forward_cost);
+    OutputState *ans = free_output_states_.back();
+    free_output_states_.pop_back();
+    ans->minimal_subset = minimal_subset;
+    ans->arcs.clear();
+    ans->forward_cost = forward_cost;
+    return ans;
+  }
+
   enum IsymbolOrFinal { OSF_UNKNOWN = 0, OSF_NO = 1, OSF_YES = 2 };
 
   vector<char> isymbol_or_final_; // A kind of cache; it says whether
@@ -1179,6 +1319,11 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   LatticeStringRepository<IntType> repository_;  // defines a compact and fast way of
   // storing sequences of labels.
 
+  // The approximate memory used by ifst_ and by our own data structures, as
+  // reported to kaldi::MemoryBudget::Global().
+  kaldi::MemoryAccount raw_lattice_memory_;
+  kaldi::MemoryAccount memory_;
+
   void AddStrings(const vector<Element> &vec,
                   vector<StringId> *needed_strings) {
     for (typename std::vector<Element>::const_iterator iter = vec.begin();
@@ -1188,6 +1333,72 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 };
 
 
+// Setting up and freeing the hashes, string repository and subsets of a
+// LatticeDeterminizerPruned takes a large part of the time for small lattices,
+// e.g. when decoding many short utterances.  This process-wide pool keeps
+// determinizers that were used for small lattices, so their memory can be
+// reused; it is thread-safe, and each determinizer is only used by one thread
+// at a time.
+template<class Weight, class IntType>
+class LatticeDeterminizerPrunedPool {
+ public:
+  typedef LatticeDeterminizerPruned<Weight, IntType> Determinizer;
+
+  static LatticeDeterminizerPrunedPool &Instance() {
+    static LatticeDeterminizerPrunedPool pool;
+    return pool;
+  }
+
+  // Returns a determinizer on which Init() can be called.
+  Determinizer *Get() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!free_.empty()) {
+        Determinizer *ans = free_.back();
+        free_.pop_back();
+        return ans;
+      }
+    }
+    return new Determinizer();
+  }
+
+  // Returns true if 'det', which has determinized a lattice, is small enough
+  // to be kept by Release(); if not, it should be output with destroy == true
+  // and deleted, so that the memory is freed.
+  static bool CanKeep(const Determinizer &det) {
+    return det.MemoryUsage() <= kMaxMemory;
+  }
+
+  // Takes ownership of 'det', for which CanKeep() must be true.
+  void Release(Determinizer *det) {
+    det->Clear();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (free_.size() < kMaxNumFree) {
+        free_.push_back(det);
+        return;
+      }
+    }
+    delete det;
+  }
+
+  ~LatticeDeterminizerPrunedPool() {
+    for (size_t i = 0; i < free_.size(); i++)
+      delete free_[i];
+  }
+
+ private:
+  // Lattices bigger than this (as estimated by MemoryUsage()) are rare and
+  // slow enough that reusing the memory does not matter.
+  static const size_t kMaxMemory = 4000000;
+  // More than one per thread would be pointless.
+  static const size_t kMaxNumFree = 64;
+
+  std::mutex mutex_;
+  std::vector<Determinizer*> free_;
+};
+
+
 // normally Weight would be LatticeWeight<float> (which has two floats),
 // or possibly TropicalWeightTpl<float>, and IntType would be int32.
 // Caution: there are two versions of the function DeterminizeLatticePruned,
@@ -1209,20 +1420,26 @@ bool DeterminizeLatticePruned(
                              // retrying.
   VectorFst<ArcTpl<Weight> > temp_fst;
 
+  typedef LatticeDeterminizerPrunedPool<Weight, IntType> PoolType;
+  PoolType &pool = PoolType::Instance();
   for (int32 iter = 0; iter < max_num_iters; iter++) {
-    LatticeDeterminizerPruned<Weight, IntType> det(iter == 0 ? ifst : temp_fst,
-                                                   beam, opts);
+    std::unique_ptr<LatticeDeterminizerPruned<Weight, IntType> > det(
+        pool.Get());
+    det->Init(iter == 0 ? ifst : temp_fst, beam, opts);
     double effective_beam;
-    bool ans = det.Determinize(&effective_beam);
+    bool ans = det->Determinize(&effective_beam);
+    bool keep = PoolType::CanKeep(*det);
     // if it returns false it will typically still produce reasonable output,
     // just with a narrower beam than "beam".  If the user specifies an infinite
     // beam we don't do this beam-narrowing.
     if (effective_beam >= beam * opts.retry_cutoff ||
         beam == std::numeric_limits<double>::infinity() ||
         iter + 1 == max_num_iters) {
-      det.Output(ofst);
+      det->Output(ofst, !keep);  // big lattices free memory as they go.
+      if (keep) pool.Release(det.release());
       return ans;
     } else {
+      if (keep) pool.Release(det.release());
       // The code below to set "beam" is a heuristic.
       // If effective_beam is very small, we want to reduce by a lot.
       // But never change the beam by more than a factor of two.
@@ -1261,19 +1478,25 @@ bool DeterminizeLatticePruned(const ExpandedFst<ArcTpl<Weight> > &ifst,
                              // retrying.
   VectorFst<ArcTpl<Weight> > temp_fst;
 
+  typedef LatticeDeterminizerPrunedPool<Weight, IntType> PoolType;
+  PoolType &pool = PoolType::Instance();
   for (int32 iter = 0; iter < max_num_iters; iter++) {
-    LatticeDeterminizerPruned<Weight, IntType> det(iter == 0 ? ifst : temp_fst,
-                                                   beam, opts);
+    std::unique_ptr<LatticeDeterminizerPruned<Weight, IntType> > det(
+        pool.Get());
+    det->Init(iter == 0 ? ifst : temp_fst, beam, opts);
     double effective_beam;
-    bool ans = det.Determinize(&effective_beam);
+    bool ans = det->Determinize(&effective_beam);
+    bool keep = PoolType::CanKeep(*det);
     // if it returns false it will typically still
     // produce reasonable output, just with a
     // narrower beam than "beam".
     if (effective_beam >= beam * opts.retry_cutoff ||
         iter + 1 == max_num_iters) {
-      det.Output(ofst);
+      det->Output(ofst, !keep);  // big lattices free memory as they go.
+      if (keep) pool.Release(det.release());
       return ans;
     } else {
+      if (keep) pool.Release(det.release());
       // The code below to set "beam" is a heuristic.
       // If effective_beam is very small, we want to reduce by a lot.
       // But never change the beam by more than a factor of two.
@@ -1509,6 +1732,327 @@ bool DeterminizeLatticePhonePrunedWrapper(
   return ans;
 }
 
+// Outputs the states of the topologically sorted lattice "ifst" at which
+// DeterminizeLatticePrunedChunked() splits it: states that every successful
+// path passes through, at least min_chunk_states apart.  (*cuts)[0] is always
+// the start state, 0.
+static void FindLatticeSplitStates(
+    const ExpandedFst<kaldi::LatticeArc> &ifst,
+    int32 min_chunk_states,
+    std::vector<kaldi::LatticeArc::StateId> *cuts) {
+  typedef kaldi::LatticeArc Arc;
+  typedef Arc::StateId StateId;
+  KALDI_ASSERT(ifst.Start() == 0 && min_chunk_states > 0);
+  cuts->clear();
+  cuts->push_back(0);
+  StateId num_states = ifst.NumStates();
+  // max_dest is the highest-numbered destination of any arc leaving a state
+  // numbered lower than s.  If that is not more than s and none of those
+  // states is final, every successful path must pass through s.
+  StateId max_dest = 0;
+  bool seen_final = false;
+  for (StateId s = 0; s < num_states; s++) {
+    if (!seen_final && max_dest <= s && s - cuts->back() >= min_chunk_states &&
+        num_states - s >= min_chunk_states)
+      cuts->push_back(s);
+    if (ifst.Final(s) != Arc::Weight::Zero())
+      seen_final = true;
+    for (ArcIterator<ExpandedFst<Arc> > aiter(ifst, s); !aiter.Done();
+         aiter.Next())
+      max_dest = std::max(max_dest, aiter.Value().nextstate);
+  }
+}
+
+// Copies to "piece" the part of "ifst" between states 'begin' and 'end',
+// which are split states as output by FindLatticeSplitStates() (or, for
+// the last piece, end is ifst.NumStates()).  States are renumbered to start
+// from zero, and 'end' becomes a final state with no arcs.
+static void GetLatticePiece(const ExpandedFst<kaldi::LatticeArc> &ifst,
+                            kaldi::LatticeArc::StateId begin,
+                            kaldi::LatticeArc::StateId end,
+                            VectorFst<kaldi::LatticeArc> *piece) {
+  typedef kaldi::LatticeArc Arc;
+  typedef Arc::StateId StateId;
+  piece->DeleteStates();
+  bool is_last = (end == ifst.NumStates());
+  StateId num_states = end - begin + (is_last ? 0 : 1);
+  for (StateId s = 0; s < num_states; s++)
+    piece->AddState();
+  piece->SetStart(0);
+  for (StateId s = begin; s < end; s++) {
+    piece->SetFinal(s - begin, ifst.Final(s));
+    for (ArcIterator<ExpandedFst<Arc> > aiter(ifst, s); !aiter.Done();
+         aiter.Next()) {
+      Arc arc = aiter.Value();
+      arc.nextstate -= begin;
+      piece->AddArc(s - begin, arc);
+    }
+  }
+  if (!is_last)
+    piece->SetFinal(end - begin, Arc::Weight::One());
+}
+
+// Outputs to "joined" the concatenation of the determinized pieces of a
+// lattice, as CompactLattice, with the pieces joined by epsilon arcs from the
+// final states of each piece to the start state of the next one (carrying the
+// final weights).  If any piece is empty, the output is empty.
+static void JoinLatticePieces(
+    const std::vector<const kaldi::CompactLattice*> &det_pieces,
+    kaldi::CompactLattice *joined) {
+  typedef kaldi::CompactLatticeArc CompactArc;
+  typedef CompactArc::StateId StateId;
+  int32 num_pieces = det_pieces.size();
+  joined->DeleteStates();
+  std::vector<StateId> offsets(num_pieces);
+  for (int32 i = 0; i < num_pieces; i++) {
+    if (det_pieces[i]->Start() == kNoStateId) {
+      // Nothing survived in this piece, so the whole output is empty.
+      joined->DeleteStates();
+      return;
+    }
+    offsets[i] = joined->NumStates();
+    for (StateId s = 0; s < det_pieces[i]->NumStates(); s++)
+      joined->AddState();
+  }
+  if (num_pieces == 0)
+    return;
+  joined->SetStart(offsets[0] + det_pieces[0]->Start());
+  for (int32 i = 0; i < num_pieces; i++) {
+    const kaldi::CompactLattice &det_piece = *(det_pieces[i]);
+    for (StateId s = 0; s < det_piece.NumStates(); s++) {
+      for (ArcIterator<kaldi::CompactLattice> aiter(det_piece, s);
+           !aiter.Done(); aiter.Next()) {
+        CompactArc arc = aiter.Value();
+        arc.nextstate += offsets[i];
+        joined->AddArc(offsets[i] + s, arc);
+      }
+      CompactArc::Weight final_weight = det_piece.Final(s);
+      if (final_weight == CompactArc::Weight::Zero())
+        continue;
+      if (i + 1 == num_pieces) {
+        joined->SetFinal(offsets[i] + s, final_weight);
+      } else {
+        joined->AddArc(offsets[i] + s,
+                       CompactArc(0, 0, final_weight,
+                                  offsets[i + 1] + det_pieces[i + 1]->Start()));
+      }
+    }
+  }
+}
+
+// Splits "ifst" at the states in "cuts" (see FindLatticeSplitStates()),
+// determinizes the pieces with "determinize" on num_threads threads, and
+// outputs to "joined" the concatenation of the results (see
+// JoinLatticePieces()), converted back to Lattice with
+// ConvertLattice(..., invert).  Returns false if any call to "determinize"
+// returned false.
+static bool DeterminizeLatticePieces(
+    const ExpandedFst<kaldi::LatticeArc> &ifst,
+    const std::vector<kaldi::LatticeArc::StateId> &cuts,
+    int32 num_threads,
+    const std::function<bool(MutableFst<kaldi::LatticeArc>*,
+                             MutableFst<kaldi::CompactLatticeArc>*)> &determinize,
+    bool invert,
+    MutableFst<kaldi::LatticeArc> *joined) {
+  int32 num_pieces = cuts.size();
+  std::vector<VectorFst<kaldi::LatticeArc> > pieces(num_pieces);
+  for (int32 i = 0; i < num_pieces; i++)
+    GetLatticePiece(ifst, cuts[i],
+                    (i + 1 < num_pieces ? cuts[i + 1] : ifst.NumStates()),
+                    &(pieces[i]));
+
+  std::vector<kaldi::CompactLattice> det_pieces(num_pieces);
+  std::vector<char> ok(num_pieces, 1);
+  {
+    kaldi::ThreadPool pool(std::min(num_threads, num_pieces));
+    for (int32 i = 0; i < num_pieces; i++) {
+      pool.Submit([&, i] () {
+          ok[i] = determinize(&(pieces[i]), &(det_pieces[i]));
+          pieces[i].DeleteStates();  // free the memory.
+        });
+    }
+  }  // the destructor of "pool" waits for the tasks to finish.
+
+  bool ans = true;
+  std::vector<const kaldi::CompactLattice*> det_piece_ptrs(num_pieces);
+  for (int32 i = 0; i < num_pieces; i++) {
+    if (!ok[i])
+      ans = false;
+    det_piece_ptrs[i] = &(det_pieces[i]);
+  }
+  kaldi::CompactLattice clat;
+  JoinLatticePieces(det_piece_ptrs, &clat);
+  ConvertLattice(clat, joined, invert);
+  return ans;
+}
+
+bool DeterminizeLatticePrunedChunked(
+    const ExpandedFst<kaldi::LatticeArc> &ifst,
+    double prune,
+    MutableFst<kaldi::CompactLatticeArc> *ofst,
+    const DeterminizeLatticeChunkedOptions &chunk_opts,
+    DeterminizeLatticePrunedOptions opts) {
+  std::vector<kaldi::LatticeArc::StateId> cuts;
+  if (chunk_opts.num_threads > 1 && ifst.Start() == 0 &&
+      ifst.Properties(kTopSorted, true) != 0)
+    FindLatticeSplitStates(ifst, chunk_opts.min_chunk_states, &cuts);
+  if (cuts.size() <= 1)
+    return DeterminizeLatticePruned<kaldi::LatticeWeight, kaldi::int32>(
+        ifst, prune, ofst, opts);
+
+  std::function<bool(MutableFst<kaldi::LatticeArc>*,
+                     MutableFst<kaldi::CompactLatticeArc>*)> determinize =
+      [prune, &opts] (MutableFst<kaldi::LatticeArc> *lat,
+                      MutableFst<kaldi::CompactLatticeArc> *clat) -> bool {
+    if (lat->Properties(kTopSorted, true) == 0 && !TopSort(lat))
+      KALDI_ERR << "Topological sorting of lattice failed.";
+    ArcSort(lat, ILabelCompare<kaldi::LatticeArc>());
+    return DeterminizeLatticePruned<kaldi::LatticeWeight, kaldi::int32>(
+        *lat, prune, clat, opts);
+  };
+  VectorFst<kaldi::LatticeArc> joined;
+  bool ans = DeterminizeLatticePieces(ifst, cuts, chunk_opts.num_threads,
+                                      determinize, false, &joined);
+  if (!determinize(&joined, ofst))
+    ans = false;
+  return ans;
+}
+
+bool DeterminizeLatticePhonePrunedChunkedWrapper(
+    const kaldi::TransitionModel &trans_model,
+    MutableFst<kaldi::LatticeArc> *ifst,
+    double prune,
+    MutableFst<kaldi::CompactLatticeArc> *ofst,
+    const DeterminizeLatticeChunkedOptions &chunk_opts,
+    DeterminizeLatticePhonePrunedOptions opts) {
+  std::vector<kaldi::LatticeArc::StateId> cuts;
+  if (chunk_opts.num_threads > 1) {
+    if (ifst->Properties(fst::kTopSorted, true) == 0 && !TopSort(ifst))
+      KALDI_ERR << "Topological sorting of state-level lattice failed "
+                << "(probably your lexicon has empty words or your LM has "
+                << "epsilon cycles).";
+    if (ifst->Start() == 0)
+      FindLatticeSplitStates(*ifst, chunk_opts.min_chunk_states, &cuts);
+  }
+  if (cuts.size() <= 1)
+    return DeterminizeLatticePhonePrunedWrapper(trans_model, ifst, prune,
+                                                ofst, opts);
+
+  // Only the final determinization needs to minimize.
+  DeterminizeLatticePhonePrunedOptions piece_opts(opts);
+  piece_opts.minimize = false;
+  std::function<bool(MutableFst<kaldi::LatticeArc>*,
+                     MutableFst<kaldi::CompactLatticeArc>*)> determinize =
+      [&trans_model, prune, &piece_opts] (
+          MutableFst<kaldi::LatticeArc> *lat,
+          MutableFst<kaldi::CompactLatticeArc> *clat) -> bool {
+    return DeterminizeLatticePhonePrunedWrapper(trans_model, lat, prune, clat,
+                                                piece_opts);
+  };
+  VectorFst<kaldi::LatticeArc> joined;
+  bool ans = DeterminizeLatticePieces(*ifst, cuts, chunk_opts.num_threads,
+                                      determinize, true, &joined);
+  if (!DeterminizeLatticePhonePrunedWrapper(trans_model, &joined, prune, ofst,
+                                            opts))
+    ans = false;
+  return ans;
+}
+
+// Returns true if the states begin through end of "ifst" would be copied to
+// "piece" by GetLatticePiece(ifst, begin, end, &piece).
+static bool LatticePieceEquals(const ExpandedFst<kaldi::LatticeArc> &ifst,
+                               kaldi::LatticeArc::StateId begin,
+                               kaldi::LatticeArc::StateId end,
+                               const VectorFst<kaldi::LatticeArc> &piece) {
+  typedef kaldi::LatticeArc Arc;
+  typedef Arc::StateId StateId;
+  KALDI_ASSERT(end < ifst.NumStates());
+  if (piece.NumStates() != end - begin + 1)
+    return false;
+  for (StateId s = begin; s < end; s++) {
+    if (ifst.Final(s) != piece.Final(s - begin) ||
+        ifst.NumArcs(s) != piece.NumArcs(s - begin))
+      return false;
+    ArcIterator<VectorFst<Arc> > piece_aiter(piece, s - begin);
+    for (ArcIterator<ExpandedFst<Arc> > aiter(ifst, s); !aiter.Done();
+         aiter.Next(), piece_aiter.Next()) {
+      const Arc &arc = aiter.Value(), &piece_arc = piece_aiter.Value();
+      if (arc.ilabel != piece_arc.ilabel || arc.olabel != piece_arc.olabel ||
+          arc.weight != piece_arc.weight ||
+          arc.nextstate - begin != piece_arc.nextstate)
+        return false;
+    }
+  }
+  return true;
+}
+
+bool CachingLatticeDeterminizer::Determinize(
+    MutableFst<kaldi::LatticeArc> *ifst,
+    MutableFst<kaldi::CompactLatticeArc> *ofst) {
+  typedef kaldi::LatticeArc::StateId StateId;
+  if (ifst->Properties(fst::kTopSorted, true) == 0 && !TopSort(ifst))
+    KALDI_ERR << "Topological sorting of state-level lattice failed "
+              << "(probably your lexicon has empty words or your LM has "
+              << "epsilon cycles).";
+  std::vector<StateId> cuts;
+  if (ifst->Start() == 0)
+    FindLatticeSplitStates(*ifst, min_chunk_states_, &cuts);
+  if (cuts.size() <= 1) {
+    pieces_.clear();
+    return DeterminizeLatticePhonePrunedWrapper(trans_model_, ifst, prune_,
+                                                ofst, opts_);
+  }
+  size_t num_pieces = cuts.size();
+  // Work out how many of the pieces from last time are unchanged.  None of
+  // them is the last piece, which was not remembered.
+  size_t num_reused = 0;
+  while (num_reused < pieces_.size() && num_reused + 1 < num_pieces) {
+    const Piece &piece = pieces_[num_reused];
+    if (piece.begin != cuts[num_reused] ||
+        piece.end != cuts[num_reused + 1] ||
+        !LatticePieceEquals(*ifst, piece.begin, piece.end, piece.lat))
+      break;
+    num_reused++;
+  }
+  pieces_.resize(num_reused);
+
+  // Only the final determinization needs to minimize.
+  DeterminizeLatticePhonePrunedOptions piece_opts(opts_);
+  piece_opts.minimize = false;
+  pieces_.resize(num_pieces - 1);
+  for (size_t i = num_reused; i + 1 < num_pieces; i++) {
+    Piece &piece = pieces_[i];
+    piece.begin = cuts[i];
+    piece.end = cuts[i + 1];
+    GetLatticePiece(*ifst, piece.begin, piece.end, &(piece.lat));
+    // Copy it, as DeterminizeLatticePhonePrunedWrapper() modifies its input.
+    VectorFst<kaldi::LatticeArc> lat(piece.lat);
+    piece.ok = DeterminizeLatticePhonePrunedWrapper(
+        trans_model_, &lat, prune_, &(piece.det), piece_opts);
+  }
+  VectorFst<kaldi::LatticeArc> last_lat;
+  GetLatticePiece(*ifst, cuts.back(), ifst->NumStates(), &last_lat);
+  kaldi::CompactLattice last_det;
+  bool ans = DeterminizeLatticePhonePrunedWrapper(
+      trans_model_, &last_lat, prune_, &last_det, piece_opts);
+
+  std::vector<const kaldi::CompactLattice*> det_pieces;
+  for (size_t i = 0; i < pieces_.size(); i++) {
+    if (!pieces_[i].ok)
+      ans = false;
+    det_pieces.push_back(&(pieces_[i].det));
+  }
+  det_pieces.push_back(&last_det);
+  kaldi::CompactLattice clat;
+  JoinLatticePieces(det_pieces, &clat);
+  VectorFst<kaldi::LatticeArc> joined;
+  ConvertLattice(clat, &joined, true);
+  if (!DeterminizeLatticePhonePrunedWrapper(trans_model_, &joined, prune_,
+                                            ofst, opts_))
+    ans = false;
+  return ans;
+}
+
 // Instantiate the templates for the types we might need.
 // Note: there are actually four templates, each of which
 // we instantiate for a single type.
@@ -289,6 +289,139 @@ bool DeterminizeLatticePhonePrunedWrapper(
     DeterminizeLatticePhonePrunedOptions opts
       = DeterminizeLatticePhonePrunedOptions());
 
+/// Options for DeterminizeLatticePrunedChunked() and
+/// DeterminizeLatticePhonePrunedChunkedWrapper().
+struct DeterminizeLatticeChunkedOptions {
+  // num_threads: the number of threads used to determinize the pieces of a
+  // lattice; if <= 1, lattices are not split.
+  int num_threads;
+  // min_chunk_states: the minimum number of states of the input lattice in
+  // each piece.
+  int min_chunk_states;
+  DeterminizeLatticeChunkedOptions(): num_threads(1),
+                                      min_chunk_states(10000) { }
+  void Register(kaldi::OptionsItf *opts) {
+    opts->Register("num-threads", &num_threads, "Number of threads used to "
+                   "determinize each lattice.  If > 1, long lattices are split "
+                   "at states that all paths pass through, and the pieces "
+                   "are determinized in parallel (see --min-chunk-states).");
+    opts->Register("min-chunk-states", &min_chunk_states, "Minimum number of "
+                   "states in each piece of a lattice that is split for "
+                   "multi-threaded determinization (see --num-threads).");
+  }
+};
+
+/** This is a multi-threaded version of DeterminizeLatticePruned() (the version
+    that outputs CompactLattice), for long lattices.  It has the same
+    requirements on the input: words on the input side, and topologically
+    sorted.
+
+    The lattice is split at states that every successful path passes through
+    (for lattices from decoding, this typically happens in silences), into
+    pieces of at least chunk_opts.min_chunk_states states.  The pieces are
+    determinized in parallel on chunk_opts.num_threads threads, the results
+    are joined back together and the joined lattice, which is much smaller
+    than the input, is determinized again.  Because every path passes through
+    the same split points, pruning each piece with the beam "prune" does not
+    remove any path that is within "prune" of the best path of the whole
+    lattice, so the output is the same as that of DeterminizeLatticePruned()
+    except for the effect of ties and of the max_mem, max_states etc. options,
+    which apply to each piece separately.  If the lattice cannot be split, this
+    just calls DeterminizeLatticePruned().
+    Returns false if any call to DeterminizeLatticePruned() returned false.
+*/
+bool DeterminizeLatticePrunedChunked(
+    const ExpandedFst<kaldi::LatticeArc> &ifst,
+    double prune,
+    MutableFst<kaldi::CompactLatticeArc> *ofst,
+    const DeterminizeLatticeChunkedOptions &chunk_opts,
+    DeterminizeLatticePrunedOptions opts = DeterminizeLatticePrunedOptions());
+
+/** This is a multi-threaded version of DeterminizeLatticePhonePrunedWrapper(),
+    for long lattices; like that function, it requires transition-ids on the
+    input side of "ifst" and words on the output side.  It splits the lattice
+    and determinizes the pieces in parallel as described for
+    DeterminizeLatticePrunedChunked().
+*/
+bool DeterminizeLatticePhonePrunedChunkedWrapper(
+    const kaldi::TransitionModel &trans_model,
+    MutableFst<kaldi::LatticeArc> *ifst,
+    double prune,
+    MutableFst<kaldi::CompactLatticeArc> *ofst,
+    const DeterminizeLatticeChunkedOptions &chunk_opts,
+    DeterminizeLatticePhonePrunedOptions opts
+      = DeterminizeLatticePhonePrunedOptions());
+
+/**
+   This class is for when the lattice of an utterance is determinized
+   repeatedly while the utterance is being decoded, e.g. to get partial
+   results in online decoding.  Determinize() gives the same output as
+   DeterminizeLatticePhonePrunedWrapper(), but it splits the lattice as
+   DeterminizeLatticePhonePrunedChunkedWrapper() does and remembers the
+   determinized pieces.  Decoders only add to the end of the lattice (apart
+   from pruning, which rarely changes the parts of the lattice far behind the
+   current frame), so on the next call the pieces at the start of the lattice
+   that have not changed are not determinized again: only the new part of the
+   lattice, and the joined lattice, which is much smaller than the input, are
+   determinized.
+
+   This is not truly incremental: each call still compares the whole input
+   lattice with the remembered pieces, and the caller normally has to get the
+   whole raw lattice from the decoder (GetRawLattice()) to call it, so the cost
+   of each call is still linear in the length of the utterance.  What it saves
+   is determinizing the unchanged pieces again, which is most of the cost of
+   determinization.
+
+   Call Reset() (or use a new object) for each utterance.
+*/
+class CachingLatticeDeterminizer {
+ public:
+  /// "prune" and "opts" are as for DeterminizeLatticePhonePrunedWrapper();
+  /// pieces will have at least "min_chunk_states" states.
+  CachingLatticeDeterminizer(
+      const kaldi::TransitionModel &trans_model,
+      double prune,
+      const DeterminizeLatticePhonePrunedOptions &opts,
+      int min_chunk_states = 1000):
+      trans_model_(trans_model), prune_(prune), opts_(opts),
+      min_chunk_states_(min_chunk_states) { }
+
+  /// Does the same as DeterminizeLatticePhonePrunedWrapper(trans_model, ifst,
+  /// prune, ofst, opts), with the arguments given to the constructor.  "ifst"
+  /// would normally be a longer version of the lattice given to the previous
+  /// call.
+  bool Determinize(MutableFst<kaldi::LatticeArc> *ifst,
+                   MutableFst<kaldi::CompactLatticeArc> *ofst);
+
+  /// Returns the number of pieces remembered from the previous call.
+  int NumCachedPieces() const { return pieces_.size(); }
+
+  /// Forgets the pieces remembered from the previous call.
+  void Reset() { pieces_.clear(); }
+
+ private:
+  struct Piece {
+    // The range of states of the input lattice that this piece covers, as
+    // for GetLatticePiece() in the .cc file.
+    kaldi::LatticeArc::StateId begin;
+    kaldi::LatticeArc::StateId end;
+    // The piece of the input lattice; used to check if it has changed.
+    VectorFst<kaldi::LatticeArc> lat;
+    // The determinized piece.
+    kaldi::CompactLattice det;
+    // The return value of DeterminizeLatticePhonePrunedWrapper().
+    bool ok;
+  };
+
+  const kaldi::TransitionModel &trans_model_;
+  double prune_;
+  DeterminizeLatticePhonePrunedOptions opts_;
+  int min_chunk_states_;
+  // The pieces of the lattice given to the previous call to Determinize(),
+  // except the last one.
+  std::vector<Piece> pieces_;
+};
+
 /// @} end "addtogroup fst_extensions"
 
 } // end namespace fst
@@ -18,6 +18,10 @@
 // limitations under the License.
 
 
+#include <fstream>
+#include <iterator>
+#include <string>
+
 #include "lat/kaldi-lattice.h"
 #include "fstext/rand-fst.h"
 
@@ -65,6 +69,57 @@ void TestCompactLatticeTable(bool binary) {
   }
 }
 
+void TestPackedCompactLattice() {
+  CompactLattice *clat = RandCompactLattice();
+  std::ostringstream os;
+  KALDI_ASSERT(WritePackedCompactLattice(os, *clat));
+  {
+    std::istringstream is(os.str());
+    CompactLattice *clat2 = NULL;
+    KALDI_ASSERT(ReadCompactLattice(is, true, &clat2));
+    KALDI_ASSERT(fst::Equal(*clat, *clat2));
+    delete clat2;
+  }
+  {
+    std::istringstream is(os.str());
+    Lattice *lat = NULL;
+    KALDI_ASSERT(ReadLattice(is, true, &lat));
+    CompactLattice clat3;
+    ConvertLattice(*lat, &clat3);
+    KALDI_ASSERT(fst::Equal(*clat, clat3));
+    delete lat;
+  }
+  {
+    // A truncated lattice should be detected.
+    std::string str = os.str();
+    std::istringstream is(str.substr(0, str.size() - 1));
+    CompactLattice *clat4 = NULL;
+    KALDI_ASSERT(!ReadPackedCompactLattice(is, &clat4) && clat4 == NULL);
+  }
+  delete clat;
+}
+
+// The packed format is only written with the "packed" wspecifier option, and
+// the readers accept it without any option.
+void TestPackedCompactLatticeTable(bool packed) {
+  CompactLattice *clat = RandCompactLattice();
+  {
+    CompactLatticeWriter writer(packed ? "ark,packed:tmpf" : "ark:tmpf");
+    writer.Write("key", *clat);
+  }
+  {
+    std::ifstream is("tmpf", std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(is)),
+                         std::istreambuf_iterator<char>());
+    KALDI_ASSERT((contents.find("<PackedLat>") != std::string::npos) ==
+                 packed);
+  }
+  SequentialCompactLatticeReader reader("ark:tmpf");
+  KALDI_ASSERT(!reader.Done() && reader.Key() == "key" &&
+               fst::Equal(reader.Value(), *clat));
+  delete clat;
+}
+
 // Write as CompactLattice, read as Lattice.
 void TestCompactLatticeTableCross(bool binary) {
   CompactLatticeWriter writer(binary ? "ark:tmpf" : "ark,t:tmpf");
@@ -167,6 +222,10 @@ int main() {
     TestLatticeTable(binary);
     TestLatticeTableCross(binary);
   }
+  for (int i = 0; i < 10; i++)
+    TestPackedCompactLattice();
+  TestPackedCompactLatticeTable(false);
+  TestPackedCompactLatticeTable(true);
   std::cout << "Test OK\n";
   
   unlink("tmpf");
@@ -89,6 +89,253 @@ bool WriteCompactLattice(std::ostream &os, bool binary,
   }
 }
 
+static const char *kPackedLatticeToken = "<PackedLat>";
+
+static inline void WriteVarint(uint64 value, std::string *buf) {
+  while (value >= 128) {
+    buf->push_back(static_cast<char>((value & 127) | 128));
+    value >>= 7;
+  }
+  buf->push_back(static_cast<char>(value));
+}
+
+// Returns false if the varint runs past "end" or is too long.
+static inline bool ReadVarint(const unsigned char **p, const unsigned char *end,
+                              uint64 *value) {
+  *value = 0;
+  for (int32 shift = 0; *p < end && shift < 64; shift += 7) {
+    unsigned char c = *((*p)++);
+    *value |= static_cast<uint64>(c & 127) << shift;
+    if (!(c & 128)) return true;
+  }
+  return false;
+}
+
+// Labels and state deltas may be negative, so we use the "zigzag" encoding,
+// which makes small negative numbers small too.
+static inline uint64 ZigZag(int32 i) {
+  return (static_cast<uint32>(i) << 1) ^ static_cast<uint32>(i >> 31);
+}
+
+static inline int32 UnZigZag(uint64 u) {
+  uint32 v = static_cast<uint32>(u);
+  return static_cast<int32>((v >> 1) ^ (0u - (v & 1)));
+}
+
+static inline void WriteFloat(float f, std::string *buf) {
+  buf->append(reinterpret_cast<const char*>(&f), sizeof(f));
+}
+
+static inline bool ReadFloat(const unsigned char **p, const unsigned char *end,
+                             float *f) {
+  if (end - *p < static_cast<ptrdiff_t>(sizeof(*f))) return false;
+  memcpy(f, *p, sizeof(*f));
+  *p += sizeof(*f);
+  return true;
+}
+
+namespace {
+
+// Writes CompactLatticeWeights to the packed format.  The alignment strings
+// are pooled: the first occurrence of a string is written as 0 followed by the
+// string, and later occurrences as (1 + its index in the pool).  Within a
+// string, transition-ids are delta-coded, so the self-loops that make up most
+// of an alignment take one byte each.
+class PackedWeightWriter {
+ public:
+  explicit PackedWeightWriter(std::string *buf): buf_(buf) { }
+
+  void Write(const CompactLatticeWeight &w) {
+    WriteFloat(w.Weight().Value1(), buf_);
+    WriteFloat(w.Weight().Value2(), buf_);
+    const std::vector<int32> &str = w.String();
+    StringMap::const_iterator iter = string_index_.find(str);
+    if (iter != string_index_.end()) {
+      WriteVarint(1 + iter->second, buf_);
+      return;
+    }
+    uint64 index = string_index_.size();
+    string_index_[str] = index;
+    WriteVarint(0, buf_);
+    WriteVarint(str.size(), buf_);
+    int32 prev = 0;
+    for (size_t i = 0; i < str.size(); i++) {
+      WriteVarint(ZigZag(str[i] - prev), buf_);
+      prev = str[i];
+    }
+  }
+ private:
+  typedef unordered_map<std::vector<int32>, uint64,
+                        VectorHasher<int32> > StringMap;
+  std::string *buf_;
+  StringMap string_index_;
+};
+
+class PackedWeightReader {
+ public:
+  PackedWeightReader(const unsigned char **p, const unsigned char *end):
+      p_(p), end_(end) { }
+
+  bool Read(CompactLatticeWeight *w) {
+    float v1, v2;
+    uint64 index;
+    if (!ReadFloat(p_, end_, &v1) || !ReadFloat(p_, end_, &v2) ||
+        !ReadVarint(p_, end_, &index))
+      return false;
+    if (index == 0) {
+      uint64 len;
+      if (!ReadVarint(p_, end_, &len) ||
+          len > static_cast<uint64>(end_ - *p_))  // each element >= 1 byte.
+        return false;
+      strings_.resize(strings_.size() + 1);
+      std::vector<int32> &str = strings_.back();
+      str.resize(len);
+      int32 prev = 0;
+      for (size_t i = 0; i < len; i++) {
+        uint64 delta;
+        if (!ReadVarint(p_, end_, &delta)) return false;
+        str[i] = prev = prev + UnZigZag(delta);
+      }
+      index = strings_.size();
+    } else if (index > strings_.size()) {
+      return false;
+    }
+    *w = CompactLatticeWeight(LatticeWeight(v1, v2), strings_[index - 1]);
+    return true;
+  }
+ private:
+  const unsigned char **p_;
+  const unsigned char *end_;
+  std::vector<std::vector<int32> > strings_;
+};
+
+}  // namespace
+
+bool WritePackedCompactLattice(std::ostream &os, const CompactLattice &clat) {
+  typedef CompactLattice::StateId StateId;
+  std::string buf;
+  PackedWeightWriter weight_writer(&buf);
+  StateId num_states = clat.NumStates();
+  for (StateId s = 0; s < num_states; s++) {
+    CompactLatticeWeight final_weight = clat.Final(s);
+    bool is_final = (final_weight != CompactLatticeWeight::Zero());
+    WriteVarint(clat.NumArcs(s) * 2 + (is_final ? 1 : 0), &buf);
+    if (is_final)
+      weight_writer.Write(final_weight);
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      // The low bit says whether the olabel differs from the ilabel; lattices
+      // are normally acceptors, so it is usually zero.
+      bool is_acceptor_arc = (arc.ilabel == arc.olabel);
+      WriteVarint((ZigZag(arc.ilabel) << 1) + (is_acceptor_arc ? 0 : 1), &buf);
+      if (!is_acceptor_arc)
+        WriteVarint(ZigZag(arc.olabel), &buf);
+      WriteVarint(ZigZag(arc.nextstate - s), &buf);
+      weight_writer.Write(arc.weight);
+    }
+  }
+  WriteToken(os, true, kPackedLatticeToken);
+  WriteBasicType(os, true, static_cast<int32>(num_states));
+  WriteBasicType(os, true, static_cast<int32>(clat.Start()));
+  WriteBasicType(os, true, static_cast<int64>(buf.size()));
+  os.write(buf.data(), buf.size());
+  if (os.fail())
+    KALDI_WARN << "Stream failure detected.";
+  return os.good();
+}
+
+bool ReadPackedCompactLattice(std::istream &is, CompactLattice **clat) {
+  typedef CompactLattice::StateId StateId;
+  KALDI_ASSERT(*clat == NULL);
+  int32 num_states, start;
+  int64 num_bytes;
+  try {
+    ExpectToken(is, true, kPackedLatticeToken);
+    ReadBasicType(is, true, &num_states);
+    ReadBasicType(is, true, &start);
+    ReadBasicType(is, true, &num_bytes);
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Reading packed lattice: error reading header: " << e.what();
+    return false;
+  }
+  if (num_states < 0 || start < -1 || start >= num_states || num_bytes < 0) {
+    KALDI_WARN << "Reading packed lattice: invalid header, file pos is "
+               << is.tellg();
+    return false;
+  }
+  // We read the whole lattice in one go, and decode it from memory.
+  std::vector<unsigned char> buf(num_bytes);
+  if (num_bytes > 0 &&
+      !is.read(reinterpret_cast<char*>(&(buf[0])), num_bytes)) {
+    KALDI_WARN << "Reading packed lattice: unexpected end of stream.";
+    return false;
+  }
+  const unsigned char *p = (num_bytes > 0 ? &(buf[0]) : NULL),
+      *end = p + num_bytes;
+  PackedWeightReader weight_reader(&p, end);
+
+  CompactLattice *ans = new CompactLattice();
+  ans->ReserveStates(num_states);
+  for (StateId s = 0; s < num_states; s++)
+    ans->AddState();
+  if (start != fst::kNoStateId)
+    ans->SetStart(start);
+  bool ok = true;
+  for (StateId s = 0; s < num_states && ok; s++) {
+    uint64 code;
+    if (!ReadVarint(&p, end, &code) ||
+        (code >> 1) > static_cast<uint64>(end - p)) {
+      ok = false;
+      break;
+    }
+    if (code & 1) {
+      CompactLatticeWeight final_weight;
+      if (!weight_reader.Read(&final_weight)) {
+        ok = false;
+        break;
+      }
+      ans->SetFinal(s, final_weight);
+    }
+    size_t num_arcs = code >> 1;
+    ans->ReserveArcs(s, num_arcs);
+    for (size_t i = 0; i < num_arcs; i++) {
+      uint64 label_code, olabel_code, delta;
+      CompactLatticeArc arc;
+      if (!ReadVarint(&p, end, &label_code)) {
+        ok = false;
+        break;
+      }
+      arc.ilabel = arc.olabel = UnZigZag(label_code >> 1);
+      if (label_code & 1) {
+        if (!ReadVarint(&p, end, &olabel_code)) {
+          ok = false;
+          break;
+        }
+        arc.olabel = UnZigZag(olabel_code);
+      }
+      if (!ReadVarint(&p, end, &delta) ||
+          !weight_reader.Read(&arc.weight)) {
+        ok = false;
+        break;
+      }
+      arc.nextstate = s + UnZigZag(delta);
+      if (arc.nextstate < 0 || arc.nextstate >= num_states) {
+        ok = false;
+        break;
+      }
+      ans->AddArc(s, arc);
+    }
+  }
+  if (!ok || p != end) {
+    KALDI_WARN << "Reading packed lattice: corrupted data.";
+    delete ans;
+    return false;
+  }
+  *clat = ans;
+  return true;
+}
+
 /// LatticeReader provides (static) functions for reading both Lattice
 /// and CompactLattice, in text form.
 class LatticeReader {
@@ -305,6 +552,8 @@ bool ReadCompactLattice(std::istream &is, bool binary,
                         CompactLattice **clat) {
   KALDI_ASSERT(*clat == NULL);
   if (binary) {
+    if (is.peek() == kPackedLatticeToken[0])
+      return ReadPackedCompactLattice(is, clat);
     fst::FstHeader hdr;
     if (!hdr.Read(is, "<unknown>")) {
       KALDI_WARN << "Reading compact lattice: error reading FST header.";
@@ -374,8 +623,9 @@ bool CompactLatticeHolder::Read(std::istream &is) {
     // cannot begin with space because it starts with the FST Type() which is not
     // space).
     return ReadCompactLattice(is, false, &t_);
-  } else if (c != 214) { // 214 is first char of FST magic number,
-    // on little-endian machines which is all we support (\326 octal)
+  } else if (c != 214 && c != kPackedLatticeToken[0]) {
+    // 214 is first char of FST magic number, on little-endian machines which
+    // is all we support (\326 octal); '<' starts the packed format.
     KALDI_WARN << "Reading compact lattice: does not appear to be an FST "
                << " [non-space but no magic number detected], file pos is "
                << is.tellg();
@@ -418,6 +668,16 @@ bool ReadLattice(std::istream &is, bool binary,
                  Lattice **lat) {
   KALDI_ASSERT(*lat == NULL);
   if (binary) {
+    if (is.peek() == kPackedLatticeToken[0]) {
+      // A CompactLattice in the packed format; we convert it.
+      CompactLattice *clat = NULL;
+      if (!ReadPackedCompactLattice(is, &clat))
+        return false;
+      *lat = new Lattice();
+      ConvertLattice(*clat, *lat);
+      delete clat;
+      return true;
+    }
     fst::FstHeader hdr;
     if (!hdr.Read(is, "<unknown>")) {
       KALDI_WARN << "Reading lattice: error reading FST header.";
@@ -490,8 +750,9 @@ bool LatticeHolder::Read(std::istream &is) {
     // cannot begin with space because it starts with the FST Type() which is not
     // space).
     return ReadLattice(is, false, &t_);
-  } else if (c != 214) { // 214 is first char of FST magic number,
-    // on little-endian machines which is all we support (\326 octal)
+  } else if (c != 214 && c != kPackedLatticeToken[0]) {
+    // 214 is first char of FST magic number, on little-endian machines which
+    // is all we support (\326 octal); '<' starts the packed format.
     KALDI_WARN << "Reading compact lattice: does not appear to be an FST "
                << " [non-space but no magic number detected], file pos is "
                << is.tellg();
@@ -56,6 +56,20 @@ bool WriteCompactLattice(std::ostream &os, bool binary,
 bool WriteLattice(std::ostream &os, bool binary,
                   const Lattice &lat);
 
+// The "packed" binary format for CompactLattice, which the table writers use in
+// binary mode if the "packed" wspecifier option is given (e.g.
+// "ark,packed:1.lats").  It is typically less than half the size of OpenFst's
+// binary format, and is lossless: the states are delta-coded, labels and
+// alignment strings are written as variable-length integers, and each
+// distinct alignment string is written only once per lattice.  OpenFst and
+// older versions of Kaldi cannot read it, which is why it is not the default.
+// The format begins with the token "<PackedLat>", so it can be told apart from
+// OpenFst's binary format; ReadCompactLattice() and ReadLattice() accept both
+// in binary mode.
+bool WritePackedCompactLattice(std::ostream &os, const CompactLattice &clat);
+// the following function requires that *clat be NULL when called.
+bool ReadPackedCompactLattice(std::istream &is, CompactLattice **clat);
+
 // the following function requires that *clat be
 // NULL when called.
 bool ReadCompactLattice(std::istream &is, bool binary,
@@ -104,6 +118,15 @@ class CompactLatticeHolder {
   T *t_;
 };
 
+// With the "packed" wspecifier option, compact lattices are written in the
+// packed format (see WritePackedCompactLattice()).
+template<>
+struct HolderPackedWriter<CompactLatticeHolder> {
+  static bool Write(std::ostream &os, const CompactLattice &clat) {
+    return WritePackedCompactLattice(os, clat);
+  }
+};
+
 class LatticeHolder {
  public:
   typedef Lattice T;
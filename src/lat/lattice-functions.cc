@@ -1427,26 +1427,36 @@ BaseFloat LatticeForwardBackwardMmi(
                                          &den_post,
                                          NULL);
 
+  ComputeMmiPosteriors(tmodel, num_ali, drop_frames, convert_to_pdf_ids,
+                       cancel, &den_post, post);
+  return ans;
+}
+
+void ComputeMmiPosteriors(const TransitionModel &tmodel,
+                          const std::vector<int32> &num_ali,
+                          bool drop_frames,
+                          bool convert_to_pdf_ids,
+                          bool cancel,
+                          Posterior *den_post,
+                          Posterior *post) {
   Posterior num_post;
   AlignmentToPosterior(num_ali, &num_post);
 
   // Now negate the MMI posteriors and add the numerator
   // posteriors.
-  ScalePosterior(-1.0, &den_post);
+  ScalePosterior(-1.0, den_post);
 
   if (convert_to_pdf_ids) {
     Posterior num_tmp;
     ConvertPosteriorToPdfs(tmodel, num_post, &num_tmp);
     num_tmp.swap(num_post);
     Posterior den_tmp;
-    ConvertPosteriorToPdfs(tmodel, den_post, &den_tmp);
-    den_tmp.swap(den_post);
+    ConvertPosteriorToPdfs(tmodel, *den_post, &den_tmp);
+    den_tmp.swap(*den_post);
   }
 
-  MergePosteriors(num_post, den_post,
+  MergePosteriors(num_post, *den_post,
                   cancel, drop_frames, post);
-
-  return ans;
 }
 
 
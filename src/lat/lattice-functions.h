@@ -269,6 +269,19 @@ BaseFloat LatticeForwardBackwardMmi(
     bool cancel,
     Posterior *arc_post);
 
+/// This does the part of LatticeForwardBackwardMmi() that comes after the
+/// forward-backward on the denominator lattice: 'den_post' is the
+/// transition-id posterior of the denominator lattice (e.g. as output by
+/// LatticeForwardBackward()), and is consumed by this function.  The other
+/// arguments are as for LatticeForwardBackwardMmi().
+void ComputeMmiPosteriors(const TransitionModel &trans,
+                          const std::vector<int32> &num_ali,
+                          bool drop_frames,
+                          bool convert_to_pdf_ids,
+                          bool cancel,
+                          Posterior *den_post,
+                          Posterior *arc_post);
+
 
 /// This function takes a CompactLattice that should only contain a single
 /// linear sequence (e.g. derived from lattice-1best), and that should have been
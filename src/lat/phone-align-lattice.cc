@@ -114,9 +114,27 @@ class LatticePhoneAligner {
     }
 
     ComputationState(): weight_(LatticeWeight::One()) { } // initial state.
-    ComputationState(const ComputationState &other):
-        transition_ids_(other.transition_ids_), word_labels_(other.word_labels_),
-        weight_(other.weight_) { }
+    /// Constructs the computation state that Advance(arc, opts, weight) would
+    /// turn 'other' into.  This avoids copying 'other' and then reallocating
+    /// the vectors to append the arc's symbols.
+    ComputationState(const ComputationState &other,
+                     const CompactLatticeArc &arc,
+                     const PhoneAlignLatticeOptions &opts,
+                     LatticeWeight *weight) {
+      const std::vector<int32> &string = arc.weight.String();
+      transition_ids_.reserve(other.transition_ids_.size() + string.size());
+      transition_ids_.insert(transition_ids_.end(),
+                             other.transition_ids_.begin(),
+                             other.transition_ids_.end());
+      transition_ids_.insert(transition_ids_.end(),
+                             string.begin(), string.end());
+      word_labels_.reserve(other.word_labels_.size() + 1);
+      word_labels_ = other.word_labels_;
+      if (arc.ilabel != 0 && !opts.replace_output_symbols) // note: arc.ilabel==arc.olabel (acceptor)
+        word_labels_.push_back(arc.ilabel);
+      *weight = Times(other.weight_, arc.weight.Weight());
+      weight_ = LatticeWeight::One();
+    }
    private:
     std::vector<int32> transition_ids_;
     std::vector<int32> word_labels_;
@@ -126,7 +144,7 @@ class LatticePhoneAligner {
 
   struct Tuple {
     Tuple(StateId input_state, ComputationState comp_state):
-        input_state(input_state), comp_state(comp_state) {}
+        input_state(input_state), comp_state(std::move(comp_state)) {}
     StateId input_state;
     ComputationState comp_state;
   };
@@ -151,7 +169,7 @@ class LatticePhoneAligner {
     MapType::iterator iter = map_.find(tuple);
     if (iter == map_.end()) { // not in map.
       StateId output_state = lat_out_->AddState();
-      map_[tuple] = output_state;
+      map_.insert(std::make_pair(tuple, output_state));
       if (add_to_queue)
         queue_.push_back(std::make_pair(tuple, output_state));
       return output_state;
@@ -193,7 +211,7 @@ class LatticePhoneAligner {
 
   void ProcessQueueElement() {
     KALDI_ASSERT(!queue_.empty());
-    Tuple tuple = queue_.back().first;
+    Tuple tuple(std::move(queue_.back().first));
     StateId output_state = queue_.back().second;
     queue_.pop_back();
 
@@ -227,10 +245,10 @@ class LatticePhoneAligner {
       for(fst::ArcIterator<CompactLattice> aiter(lat_, tuple.input_state);
           !aiter.Done(); aiter.Next()) {
         const CompactLatticeArc &arc = aiter.Value();
-        Tuple next_tuple(tuple);
         LatticeWeight weight;
-        next_tuple.comp_state.Advance(arc, opts_, &weight);
-        next_tuple.input_state = arc.nextstate;
+        Tuple next_tuple(arc.nextstate,
+                         ComputationState(tuple.comp_state, arc, opts_,
+                                          &weight));
         StateId next_output_state = GetStateForTuple(next_tuple, true); // true == add to queue,
         // if not already present.
         // We add an epsilon arc here (as the input and output happens
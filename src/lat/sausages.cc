@@ -19,8 +19,12 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <limits>
+#include <mutex>
+
 #include "lat/sausages.h"
 #include "lat/lattice-functions.h"
+#include "util/kaldi-thread.h"
 
 namespace kaldi {
 
@@ -429,4 +433,195 @@ MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in,
 }
 
 
+SegmentedMinimumBayesRisk::SegmentedMinimumBayesRisk(
+    const CompactLattice &clat_in,
+    const SegmentedMbrOptions &opts,
+    MinimumBayesRiskOptions mbr_opts):
+    opts_(opts), num_segments_(0), bayes_risk_(0.0) {
+  KALDI_ASSERT(opts_.num_threads > 0);
+  if (opts_.max_segment_length <= 0) {
+    MinimumBayesRisk mbr(clat_in, mbr_opts);
+    AppendSegment(mbr, 0);
+    return;
+  }
+  KALDI_ASSERT(opts_.split_threshold > 0.5 && opts_.split_threshold <= 1.0);
+  CompactLattice clat(clat_in);
+  kaldi::uint64 props = clat.Properties(fst::kFstProperties, false);
+  if (!(props & fst::kTopSorted)) {
+    if (fst::TopSort(&clat) == false)
+      KALDI_ERR << "Cycles detected in lattice.";
+  }
+  std::vector<int32> state_times;
+  CompactLatticeStateTimes(clat, &state_times);
+  std::vector<int32> split_states;
+  GetSplitStates(clat, state_times, &split_states);
+  if (split_states.empty()) {
+    MinimumBayesRisk mbr(clat, mbr_opts);
+    AppendSegment(mbr, 0);
+    return;
+  }
+
+  // Segment i goes from state segment_start[i] to segment_start[i+1], or to
+  // the end of the lattice for the last segment.
+  std::vector<int32> segment_start(1, 0);
+  segment_start.insert(segment_start.end(), split_states.begin(),
+                       split_states.end());
+  int32 num_segments = segment_start.size();
+  std::vector<MinimumBayesRisk*> mbr(num_segments, NULL);
+
+  // Extracting the segment and doing the MBR decoding only read 'clat', so
+  // the segments can be processed in parallel.
+  std::mutex error_mutex;
+  std::string error;
+  auto process_segment = [&](int32 i) {
+    try {
+      CompactLattice segment;
+      ExtractSegment(clat, state_times, segment_start[i],
+                     (i + 1 < num_segments ? segment_start[i + 1] : -1),
+                     &segment);
+      mbr[i] = new MinimumBayesRisk(segment, mbr_opts);
+    } catch (const std::exception &e) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      error = e.what();
+    }
+  };
+  if (opts_.num_threads > 1 && num_segments > 1) {
+    ThreadPool pool(std::min(opts_.num_threads, num_segments));
+    for (int32 i = 0; i < num_segments; i++)
+      pool.Submit([&process_segment, i]() { process_segment(i); });
+    pool.Wait();
+  } else {
+    for (int32 i = 0; i < num_segments; i++)
+      process_segment(i);
+  }
+
+  for (int32 i = 0; i < num_segments; i++) {
+    if (mbr[i] != NULL)
+      AppendSegment(*(mbr[i]), state_times[segment_start[i]]);
+    delete mbr[i];
+  }
+  if (!error.empty())
+    KALDI_ERR << "Error in MBR decoding of lattice segment: " << error;
+}
+
+void SegmentedMinimumBayesRisk::GetSplitStates(
+    const CompactLattice &clat,
+    const std::vector<int32> &state_times,
+    std::vector<int32> *split_states) const {
+  split_states->clear();
+  std::vector<double> alpha, beta;
+  if (!ComputeCompactLatticeAlphas(clat, &alpha) ||
+      !ComputeCompactLatticeBetas(clat, &beta) ||
+      clat.Start() == fst::kNoStateId)
+    return;
+  double tot_like = beta[clat.Start()],
+      log_threshold = Log(opts_.split_threshold);
+  if (!(tot_like > -std::numeric_limits<double>::infinity()))
+    return;  // No successful paths, or NaN.
+  int32 num_states = clat.NumStates(), num_frames = 0;
+
+  // The candidates are pairs (time, state).  We don't split at final states,
+  // or at states with no arcs leaving them.
+  std::vector<std::pair<int32, int32> > candidates;
+  for (int32 s = 0; s < num_states; s++) {
+    num_frames = std::max(num_frames, state_times[s]);
+    if (s == clat.Start() || clat.Final(s) != CompactLatticeWeight::Zero() ||
+        clat.NumArcs(s) == 0)
+      continue;
+    if (alpha[s] + beta[s] - tot_like >= log_threshold)
+      candidates.push_back(std::make_pair(state_times[s], s));
+  }
+  std::sort(candidates.begin(), candidates.end());
+
+  // Greedily choose, for each segment, the last candidate that keeps it
+  // within max_segment_length frames (or the first one after that, if there
+  // is none).
+  int32 prev_time = 0, pending = -1;
+  for (size_t i = 0; i < candidates.size(); i++) {
+    int32 t = candidates[i].first, s = candidates[i].second;
+    if (t <= prev_time)
+      continue;
+    if (t - prev_time > opts_.max_segment_length && pending != -1) {
+      split_states->push_back(pending);
+      prev_time = state_times[pending];
+      pending = -1;
+    }
+    if (t - prev_time <= opts_.max_segment_length) {
+      pending = s;
+    } else {
+      split_states->push_back(s);
+      prev_time = t;
+    }
+  }
+  if (pending != -1 && num_frames - prev_time > opts_.max_segment_length)
+    split_states->push_back(pending);
+}
+
+void SegmentedMinimumBayesRisk::ExtractSegment(
+    const CompactLattice &clat,
+    const std::vector<int32> &state_times,
+    int32 start_state, int32 end_state,
+    CompactLattice *segment) {
+  segment->DeleteStates();
+  int32 num_states = clat.NumStates(),
+      end_time = (end_state == -1 ? std::numeric_limits<int32>::max() :
+                  state_times[end_state]);
+  // Because 'clat' is topologically sorted, visiting the states in order
+  // visits every reachable state after all its predecessors, and numbering the
+  // new states in that order keeps 'segment' topologically sorted.
+  std::vector<int32> state_map(num_states, -1);
+  state_map[start_state] = segment->AddState();
+  segment->SetStart(state_map[start_state]);
+  for (int32 s = start_state; s < num_states; s++) {
+    int32 new_s = state_map[s];
+    if (new_s == -1)
+      continue;
+    if (s == end_state) {
+      segment->SetFinal(new_s, CompactLatticeWeight::One());
+      continue;
+    }
+    if (end_state == -1)
+      segment->SetFinal(new_s, clat.Final(s));
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      CompactLatticeArc arc = aiter.Value();
+      // Arcs that go past the end of the segment bypass 'end_state'; they
+      // are dropped.
+      if (state_times[arc.nextstate] > end_time)
+        continue;
+      if (state_map[arc.nextstate] == -1)
+        state_map[arc.nextstate] = segment->AddState();
+      arc.nextstate = state_map[arc.nextstate];
+      segment->AddArc(new_s, arc);
+    }
+  }
+  // Removes the states that don't reach 'end_state'.
+  fst::Connect(segment);
+  if (segment->Start() == fst::kNoStateId)
+    KALDI_ERR << "Lattice segment is empty (this should not happen).";
+}
+
+void SegmentedMinimumBayesRisk::AppendSegment(const MinimumBayesRisk &mbr,
+                                              int32 offset) {
+  const std::vector<int32> &one_best = mbr.GetOneBest();
+  one_best_.insert(one_best_.end(), one_best.begin(), one_best.end());
+  const std::vector<std::pair<BaseFloat, BaseFloat> >
+      &sausage_times = mbr.GetSausageTimes(),
+      &one_best_times = mbr.GetOneBestTimes();
+  for (size_t i = 0; i < sausage_times.size(); i++)
+    sausage_times_.push_back(std::make_pair(sausage_times[i].first + offset,
+                                            sausage_times[i].second + offset));
+  for (size_t i = 0; i < one_best_times.size(); i++)
+    one_best_times_.push_back(std::make_pair(one_best_times[i].first + offset,
+                                             one_best_times[i].second + offset));
+  const std::vector<BaseFloat> &conf = mbr.GetOneBestConfidences();
+  one_best_confidences_.insert(one_best_confidences_.end(), conf.begin(),
+                               conf.end());
+  const std::vector<std::vector<std::pair<int32, BaseFloat> > > &gamma =
+      mbr.GetSausageStats();
+  gamma_.insert(gamma_.end(), gamma.begin(), gamma.end());
+  bayes_risk_ += mbr.GetBayesRisk();
+  num_segments_++;
+}
+
 }  // namespace kaldi
@@ -265,6 +265,107 @@ class MinimumBayesRisk {
   };
 };
 
+
+struct SegmentedMbrOptions {
+  /// If > 0, the lattice is split into segments of about this many frames,
+  /// and MBR decoding is done separately for each segment.
+  int32 max_segment_length;
+  /// The lattice may be split only at states whose posterior is at least this
+  /// much (i.e. states that almost all the paths go through).
+  BaseFloat split_threshold;
+  /// The number of threads used to process the segments.
+  int32 num_threads;
+
+  SegmentedMbrOptions(): max_segment_length(0), split_threshold(0.99),
+                         num_threads(1) { }
+  void Register(OptionsItf *opts) {
+    opts->Register("max-segment-length", &max_segment_length, "If >0, split "
+                   "the lattice into segments of about this many frames, at "
+                   "states that almost all paths go through (see "
+                   "--split-threshold), and do MBR decoding on each segment "
+                   "separately.  This makes long lattices much faster to "
+                   "process.");
+    opts->Register("split-threshold", &split_threshold, "With "
+                   "--max-segment-length > 0, the minimum posterior of a "
+                   "lattice state at which the lattice may be split (must "
+                   "be > 0.5)");
+    opts->Register("num-threads", &num_threads, "With --max-segment-length "
+                   "> 0, the number of threads used to process the segments.");
+  }
+};
+
+/// This class does the same as MinimumBayesRisk, but for long lattices: it
+/// splits the lattice into segments at states with posterior close to one
+/// (the paths that bypass those states are dropped), does MBR decoding on the
+/// segments in parallel and concatenates the results.  The times it outputs
+/// are relative to the start of the whole lattice.  The time and memory
+/// of MBR decoding grow faster than linearly with the length of the lattice,
+/// so this is much faster for lattices of long recordings.  If
+/// opts.max_segment_length <= 0 or there are no suitable states to split
+/// at, the result is the same as from MinimumBayesRisk.
+class SegmentedMinimumBayesRisk {
+ public:
+  SegmentedMinimumBayesRisk(
+      const CompactLattice &clat,
+      const SegmentedMbrOptions &opts,
+      MinimumBayesRiskOptions mbr_opts = MinimumBayesRiskOptions());
+
+  /// See MinimumBayesRisk::GetOneBest().
+  const std::vector<int32> &GetOneBest() const { return one_best_; }
+
+  /// See MinimumBayesRisk::GetSausageTimes().
+  const std::vector<std::pair<BaseFloat, BaseFloat> > &GetSausageTimes() const {
+    return sausage_times_;
+  }
+
+  /// See MinimumBayesRisk::GetOneBestTimes().
+  const std::vector<std::pair<BaseFloat, BaseFloat> > &GetOneBestTimes() const {
+    return one_best_times_;
+  }
+
+  /// See MinimumBayesRisk::GetOneBestConfidences().
+  const std::vector<BaseFloat> &GetOneBestConfidences() const {
+    return one_best_confidences_;
+  }
+
+  /// Returns the sum of the Bayes risks of the segments.
+  BaseFloat GetBayesRisk() const { return bayes_risk_; }
+
+  /// See MinimumBayesRisk::GetSausageStats().
+  const std::vector<std::vector<std::pair<int32, BaseFloat> > > &GetSausageStats() const {
+    return gamma_;
+  }
+
+  int32 NumSegments() const { return num_segments_; }
+
+ private:
+  // Works out the states at which to split 'clat', which must be
+  // topologically sorted, and outputs them in order.
+  void GetSplitStates(const CompactLattice &clat,
+                      const std::vector<int32> &state_times,
+                      std::vector<int32> *split_states) const;
+
+  // Outputs to 'segment' the part of 'clat' from state 'start_state' to state
+  // 'end_state', or to the end of the lattice if end_state == -1.
+  static void ExtractSegment(const CompactLattice &clat,
+                             const std::vector<int32> &state_times,
+                             int32 start_state, int32 end_state,
+                             CompactLattice *segment);
+
+  // Appends the output of the MBR decoding of a segment to the output of
+  // this object; 'offset' is the time of the start of the segment.
+  void AppendSegment(const MinimumBayesRisk &mbr, int32 offset);
+
+  SegmentedMbrOptions opts_;
+  int32 num_segments_;
+  std::vector<int32> one_best_;
+  std::vector<std::pair<BaseFloat, BaseFloat> > sausage_times_;
+  std::vector<std::pair<BaseFloat, BaseFloat> > one_best_times_;
+  std::vector<BaseFloat> one_best_confidences_;
+  BaseFloat bayes_risk_;
+  std::vector<std::vector<std::pair<int32, BaseFloat> > > gamma_;
+};
+
 }  // namespace kaldi
 
 #endif  // KALDI_LAT_SAUSAGES_H_
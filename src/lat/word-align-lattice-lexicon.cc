@@ -141,11 +141,6 @@ class LatticeLexiconWordAligner {
 
     ComputationState(): phone_fresh_(kNotFresh), word_fresh_(kNotFresh),
                         weight_(LatticeWeight::One()) { } // initial state.
-
-    ComputationState(const ComputationState &other):
-        phones_(other.phones_), words_(other.words_),
-        phone_fresh_(other.phone_fresh_), word_fresh_(other.word_fresh_),
-        transition_ids_(other.transition_ids_), weight_(other.weight_) { }
    private:
     std::vector<int32> phones_; // sequence of pending phones
     std::vector<int32> words_; // sequence of pending words.
@@ -172,7 +167,7 @@ class LatticeLexiconWordAligner {
 
   struct Tuple {
     Tuple(StateId input_state, ComputationState comp_state):
-        input_state(input_state), comp_state(comp_state) {}
+        input_state(input_state), comp_state(std::move(comp_state)) {}
     Tuple() {}
     StateId input_state;
     ComputationState comp_state;
@@ -199,7 +194,7 @@ class LatticeLexiconWordAligner {
     MapType::iterator iter = map_.find(tuple);
     if (iter == map_.end()) { // not in map.
       StateId output_state = lat_out_->AddState();
-      map_[tuple] = output_state;
+      map_.insert(std::make_pair(tuple, output_state));
       queue_.push_back(std::make_pair(tuple, output_state));
       return output_state;
     } else {
@@ -267,7 +262,7 @@ class LatticeLexiconWordAligner {
 
   void ProcessQueueElement() {
     KALDI_ASSERT(!queue_.empty());
-    Tuple tuple = queue_.back().first;
+    Tuple tuple(std::move(queue_.back().first));
     StateId output_state = queue_.back().second;
     queue_.pop_back();
 
@@ -23,6 +23,74 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/phone-align-lattice.h"
 #include "lat/lattice-functions.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// This class aligns one lattice in operator (), which may run in a separate
+// thread, and writes the output in its destructor, which the TaskSequencer
+// calls in the original order of the lattices.
+class PhoneAlignLatticeTask {
+ public:
+  // Takes ownership of "clat".
+  PhoneAlignLatticeTask(const TransitionModel &tmodel,
+                        const PhoneAlignLatticeOptions &opts,
+                        const std::string &key,
+                        bool output_if_error,
+                        CompactLattice *clat,
+                        CompactLatticeWriter *clat_writer,
+                        int32 *num_done,
+                        int32 *num_err):
+      tmodel_(tmodel), opts_(opts), key_(key),
+      output_if_error_(output_if_error), clat_(clat),
+      clat_writer_(clat_writer), num_done_(num_done), num_err_(num_err),
+      ok_(false) { }
+
+  void operator () () {
+    ok_ = PhoneAlignLattice(*clat_, tmodel_, opts_, &aligned_clat_);
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+    if (aligned_clat_.Start() != fst::kNoStateId)
+      TopSortCompactLatticeIfNeeded(&aligned_clat_);
+  }
+
+  ~PhoneAlignLatticeTask() {
+    delete clat_;  // in case operator () was never called.
+    if (!ok_) {
+      (*num_err_)++;
+      if (!output_if_error_)
+        KALDI_WARN << "Lattice for " << key_ << " did align correctly";
+      else {
+        if (aligned_clat_.Start() != fst::kNoStateId) {
+          KALDI_LOG << "Outputting partial lattice for " << key_;
+          clat_writer_->Write(key_, aligned_clat_);
+        }
+      }
+    } else {
+      if (aligned_clat_.Start() == fst::kNoStateId) {
+        (*num_err_)++;
+        KALDI_WARN << "Lattice was empty for key " << key_;
+      } else {
+        (*num_done_)++;
+        KALDI_VLOG(2) << "Aligned lattice for " << key_;
+        clat_writer_->Write(key_, aligned_clat_);
+      }
+    }
+  }
+ private:
+  const TransitionModel &tmodel_;
+  const PhoneAlignLatticeOptions &opts_;
+  std::string key_;
+  bool output_if_error_;
+  CompactLattice *clat_;  // The input lattice.  Owned locally.
+  CompactLattice aligned_clat_;  // The output; written in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+  bool ok_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -50,6 +118,8 @@ int main(int argc, char *argv[]) {
     
     PhoneAlignLatticeOptions opts;
     opts.Register(&po);
+    TaskSequencerConfig sequencer_config; // has --num-threads option
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -71,35 +141,17 @@ int main(int argc, char *argv[]) {
 
     int32 num_done = 0, num_err = 0;
     
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      const CompactLattice &clat = clat_reader.Value();
-
-      CompactLattice aligned_clat;
-      bool ok = PhoneAlignLattice(clat, tmodel, opts, &aligned_clat);
-      
-      if (!ok) {
-        num_err++;
-        if (!output_if_error)
-          KALDI_WARN << "Lattice for " << key << " did align correctly";
-        else {
-          if (aligned_clat.Start() != fst::kNoStateId) {
-            KALDI_LOG << "Outputting partial lattice for " << key;
-            TopSortCompactLatticeIfNeeded(&aligned_clat);
-            clat_writer.Write(key, aligned_clat);
-          }
-        }
-      } else {
-        if (aligned_clat.Start() == fst::kNoStateId) {
-          num_err++;
-          KALDI_WARN << "Lattice was empty for key " << key;
-        } else {
-          num_done++;
-          KALDI_VLOG(2) << "Aligned lattice for " << key;
-          TopSortCompactLatticeIfNeeded(&aligned_clat);
-          clat_writer.Write(key, aligned_clat);
-        }
+    {
+      TaskSequencer<PhoneAlignLatticeTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        sequencer.Run(new PhoneAlignLatticeTask(
+            tmodel, opts, key, output_if_error, clat, &clat_writer,
+            &num_done, &num_err));
       }
+      sequencer.Wait();
     }
     KALDI_LOG << "Successfully aligned " << num_done << " lattices; "
               << num_err << " had errors.";
@@ -23,6 +23,86 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/word-align-lattice-lexicon.h"
 #include "lat/lattice-functions.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// This class aligns one lattice in operator (), which may run in a separate
+// thread, and writes the output in its destructor, which the TaskSequencer
+// calls in the original order of the lattices.
+class WordAlignLatticeLexiconTask {
+ public:
+  // Takes ownership of "clat".
+  WordAlignLatticeLexiconTask(const TransitionModel &tmodel,
+                              const WordAlignLatticeLexiconInfo &lexicon_info,
+                              const WordAlignLatticeLexiconOpts &opts,
+                              const std::string &key,
+                              bool output_if_error,
+                              bool output_if_empty,
+                              CompactLattice *clat,
+                              CompactLatticeWriter *clat_writer,
+                              int32 *num_done,
+                              int32 *num_err):
+      tmodel_(tmodel), lexicon_info_(lexicon_info), opts_(opts), key_(key),
+      output_if_error_(output_if_error), output_if_empty_(output_if_empty),
+      clat_(clat), clat_writer_(clat_writer), num_done_(num_done),
+      num_err_(num_err), ok_(false) { }
+
+  void operator () () {
+    ok_ = WordAlignLatticeLexicon(*clat_, tmodel_, lexicon_info_, opts_,
+                                  &aligned_clat_);
+    if (aligned_clat_.Start() != fst::kNoStateId)
+      TopSortCompactLatticeIfNeeded(&aligned_clat_);
+  }
+
+  ~WordAlignLatticeLexiconTask() {
+    if (!ok_) {
+      (*num_err_)++;
+      if (output_if_empty_ && aligned_clat_.NumStates() == 0 &&
+          clat_->NumStates() != 0) {
+        KALDI_WARN << "Algorithm produced no output (due to --max-expand?), "
+                   << "so passing input through as output, for key " << key_;
+        clat_writer_->Write(key_, *clat_);
+      } else if (!output_if_error_) {
+        KALDI_WARN << "Lattice for " << key_ << " did not align correctly";
+      } else {
+        if (aligned_clat_.Start() != fst::kNoStateId) {
+          KALDI_WARN << "Outputting partial lattice for " << key_;
+          clat_writer_->Write(key_, aligned_clat_);
+        } else {
+          KALDI_WARN << "Empty aligned lattice for " << key_
+                     << ", producing no output.";
+        }
+      }
+    } else {
+      if (aligned_clat_.Start() == fst::kNoStateId) {
+        (*num_err_)++;
+        KALDI_WARN << "Lattice was empty for key " << key_;
+      } else {
+        (*num_done_)++;
+        KALDI_VLOG(2) << "Aligned lattice for " << key_;
+        clat_writer_->Write(key_, aligned_clat_);
+      }
+    }
+    delete clat_;
+  }
+ private:
+  const TransitionModel &tmodel_;
+  const WordAlignLatticeLexiconInfo &lexicon_info_;
+  const WordAlignLatticeLexiconOpts &opts_;
+  std::string key_;
+  bool output_if_error_;
+  bool output_if_empty_;
+  CompactLattice *clat_;  // The input lattice.  Owned locally; kept until the
+                          // destructor, for --output-if-empty.
+  CompactLattice aligned_clat_;  // The output; written in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+  bool ok_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -55,6 +135,8 @@ int main(int argc, char *argv[]) {
     
     WordAlignLatticeLexiconOpts opts;
     opts.Register(&po);
+    TaskSequencerConfig sequencer_config; // has --num-threads option
+    sequencer_config.Register(&po);
     
     po.Read(argc, argv);
 
@@ -92,48 +174,17 @@ int main(int argc, char *argv[]) {
     
     int32 num_done = 0, num_err = 0;
     
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      const CompactLattice &clat = clat_reader.Value();
-      
-      CompactLattice aligned_clat;
-      
-      bool ok = WordAlignLatticeLexicon(clat, tmodel, lexicon_info, opts,
-                                        &aligned_clat);
-      
-      if (!ok) {
-        num_err++;
-        if (output_if_empty && aligned_clat.NumStates() == 0 &&
-            clat.NumStates() != 0) {
-          KALDI_WARN << "Algorithm produced no output (due to --max-expand?), "
-                     << "so passing input through as output, for key " << key;
-          TopSortCompactLatticeIfNeeded(&aligned_clat);
-          clat_writer.Write(key, clat);
-          continue;
-        }
-        if (!output_if_error)
-          KALDI_WARN << "Lattice for " << key << " did not align correctly";
-        else {
-          if (aligned_clat.Start() != fst::kNoStateId) {
-            KALDI_WARN << "Outputting partial lattice for " << key;
-            TopSortCompactLatticeIfNeeded(&aligned_clat);
-            clat_writer.Write(key, aligned_clat);
-          } else {
-            KALDI_WARN << "Empty aligned lattice for " << key
-                       << ", producing no output.";
-          }
-        }
-      } else {
-        if (aligned_clat.Start() == fst::kNoStateId) {
-          num_err++;
-          KALDI_WARN << "Lattice was empty for key " << key;
-        } else {
-          num_done++;
-          KALDI_VLOG(2) << "Aligned lattice for " << key;
-          TopSortCompactLatticeIfNeeded(&aligned_clat);
-          clat_writer.Write(key, aligned_clat);
-        }
+    {
+      TaskSequencer<WordAlignLatticeLexiconTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        sequencer.Run(new WordAlignLatticeLexiconTask(
+            tmodel, lexicon_info, opts, key, output_if_error, output_if_empty,
+            clat, &clat_writer, &num_done, &num_err));
       }
+      sequencer.Wait();
     }
     KALDI_LOG << "Successfully aligned " << num_done << " lattices; "
               << num_err << " had errors.";
@@ -22,6 +22,8 @@
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
+#include "nnet3/batched-lattice-posteriors.h"
+#include "cudamatrix/cu-device.h"
 
 namespace kaldi {
 
@@ -30,41 +32,51 @@ namespace kaldi {
 
 class ArcPosteriorComputer {
  public:
-  // Note: 'clat' must be topologically sorted.
+  // Note: 'clat' must be topologically sorted.  If 'arc_posts' is non-NULL
+  // it contains the arc posteriors as output by
+  // BatchedLatticePosteriors::GetArcPosteriors(), and they are not recomputed.
   ArcPosteriorComputer(const CompactLattice &clat,
                        BaseFloat min_post,
                        bool print_alignment,
-                       const TransitionModel *trans_model = NULL):
+                       const TransitionModel *trans_model = NULL,
+                       const std::vector<BaseFloat> *arc_posts = NULL):
       clat_(clat), min_post_(min_post), print_alignment_(print_alignment),
-      trans_model_(trans_model) { }
+      trans_model_(trans_model), arc_posts_(arc_posts) { }
 
   // returns the number of arc posteriors that it output.
   int32 OutputPosteriors(const std::string &utterance,
                          std::ostream &os) {
     int32 num_post = 0;
-    if (!ComputeCompactLatticeAlphas(clat_, &alpha_))
-      return num_post;
-    if (!ComputeCompactLatticeBetas(clat_, &beta_))
-      return num_post;
+    if (arc_posts_ == NULL) {
+      if (!ComputeCompactLatticeAlphas(clat_, &alpha_))
+        return num_post;
+      if (!ComputeCompactLatticeBetas(clat_, &beta_))
+        return num_post;
+    }
 
     CompactLatticeStateTimes(clat_, &state_times_);
     if (clat_.Start() < 0)
       return 0;
-    double tot_like = beta_[clat_.Start()];
+    double tot_like = (arc_posts_ == NULL ? beta_[clat_.Start()] : 0.0);
 
-    int32 num_states = clat_.NumStates();
+    int32 num_states = clat_.NumStates(), arc_index = 0;
     for (int32 state = 0; state < num_states; state++) {
       for (fst::ArcIterator<CompactLattice> aiter(clat_, state);
-           !aiter.Done(); aiter.Next()) {
+           !aiter.Done(); aiter.Next(), arc_index++) {
         const CompactLatticeArc &arc = aiter.Value();
-        double arc_loglike = -ConvertToCost(arc.weight) +
-            alpha_[state] + beta_[arc.nextstate] - tot_like;
-        KALDI_ASSERT(arc_loglike < 0.1 &&
-                     "Bad arc posterior in forward-backward computation");
-        if (arc_loglike > 0.0) arc_loglike = 0.0;
+        BaseFloat arc_post;
+        if (arc_posts_ != NULL) {
+          arc_post = (*arc_posts_)[arc_index];
+        } else {
+          double arc_loglike = -ConvertToCost(arc.weight) +
+              alpha_[state] + beta_[arc.nextstate] - tot_like;
+          KALDI_ASSERT(arc_loglike < 0.1 &&
+                       "Bad arc posterior in forward-backward computation");
+          if (arc_loglike > 0.0) arc_loglike = 0.0;
+          arc_post = exp(arc_loglike);
+        }
         int32 num_frames = arc.weight.String().size(),
             word = arc.ilabel;
-        BaseFloat arc_post = exp(arc_loglike);
         if (arc_post <= min_post_) continue;
         os << utterance << '\t' << state_times_[state] << '\t' << num_frames
            << '\t' << arc_post << '\t' << word;
@@ -104,6 +116,7 @@ class ArcPosteriorComputer {
   BaseFloat min_post_;
   bool print_alignment_;
   const TransitionModel *trans_model_;
+  const std::vector<BaseFloat> *arc_posts_;
 };
 
 }
@@ -138,6 +151,8 @@ int main(int argc, char *argv[]) {
     kaldi::BaseFloat acoustic_scale = 1.0, lm_scale = 1.0;
     kaldi::BaseFloat min_post = 0.0001;
     bool print_alignment = false;
+    int32 batch_size = 64;
+    std::string use_gpu = "no";
 
     kaldi::ParseOptions po(usage);
     po.Register("acoustic-scale", &acoustic_scale,
@@ -149,6 +164,10 @@ int main(int argc, char *argv[]) {
                 "arc.");
     po.Register("min-post", &min_post,
                 "Arc posteriors below this value will be pruned away");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("batch-size", &batch_size,
+                "Number of lattices to process at once when using the GPU");
     po.Read(argc, argv);
 
     if (po.NumArgs() < 2 || po.NumArgs() > 3) {
@@ -180,27 +199,61 @@ int main(int argc, char *argv[]) {
     int64 tot_post = 0;
     int32 num_lat_done = 0, num_lat_err = 0;
 
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      kaldi::CompactLattice clat = clat_reader.Value();
-      // FreeCurrent() is an optimization that prevents the lattice from being
-      // copied unnecessarily (OpenFst does copy-on-write).
-      clat_reader.FreeCurrent();
-      fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
-      kaldi::TopSortCompactLatticeIfNeeded(&clat);
-
-      kaldi::ArcPosteriorComputer computer(
-          clat, min_post, print_alignment,
-          (po.NumArgs() == 3 ? &trans_model : NULL));
-
-      int32 num_post = computer.OutputPosteriors(key, output.Stream());
-      if (num_post != 0) {
-        num_lat_done++;
-        tot_post += num_post;
-      } else {
-        num_lat_err++;
-        KALDI_WARN << "No posterior printed for " << key;
+    KALDI_ASSERT(batch_size > 0);
+    // When using the GPU, the forward-backward is done for 'batch_size'
+    // lattices at a time; otherwise one lattice at a time on the CPU.
+    bool batched = false;
+#if HAVE_CUDA == 1
+    kaldi::CuDevice::Instantiate().SelectGpuId(use_gpu);
+    batched = kaldi::CuDevice::Instantiate().Enabled();
+#endif
+    std::vector<std::string> keys;
+    std::vector<kaldi::CompactLattice> clats;
+
+    while (true) {
+      bool done = clat_reader.Done();
+      if (!done) {
+        keys.push_back(clat_reader.Key());
+        clats.push_back(clat_reader.Value());
+        // FreeCurrent() is an optimization that prevents the lattice from
+        // being copied unnecessarily (OpenFst does copy-on-write).
+        clat_reader.FreeCurrent();
+        kaldi::CompactLattice &clat = clats.back();
+        fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
+        kaldi::TopSortCompactLatticeIfNeeded(&clat);
+        clat_reader.Next();
+      }
+      if (clats.empty()) break;
+      if (!done && batched &&
+          static_cast<int32>(clats.size()) < batch_size) continue;
+
+      kaldi::BatchedLatticePosteriors batch;
+      if (batched) {
+        for (size_t i = 0; i < clats.size(); i++)
+          batch.AddLattice(clats[i]);
+        batch.Compute();
+      }
+      for (size_t i = 0; i < clats.size(); i++) {
+        std::vector<kaldi::BaseFloat> arc_posts;
+        if (batched)
+          batch.GetArcPosteriors(i, &arc_posts);
+        kaldi::ArcPosteriorComputer computer(
+            clats[i], min_post, print_alignment,
+            (po.NumArgs() == 3 ? &trans_model : NULL),
+            (batched ? &arc_posts : NULL));
+
+        int32 num_post = computer.OutputPosteriors(keys[i], output.Stream());
+        if (num_post != 0) {
+          num_lat_done++;
+          tot_post += num_post;
+        } else {
+          num_lat_err++;
+          KALDI_WARN << "No posterior printed for " << keys[i];
+        }
       }
+      keys.clear();
+      clats.clear();
+      if (done) break;
     }
     KALDI_LOG << "Printed posteriors for " << num_lat_done << " lattices ("
               << num_lat_err << " with errors); on average printed "
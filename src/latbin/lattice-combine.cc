@@ -41,6 +41,7 @@ using std::vector;
 #include "lat/lattice-functions.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/sausages.h"
+#include "util/kaldi-thread.h"
 
 namespace kaldi {
 
@@ -116,6 +117,76 @@ void SplitStringToWeights(const string &full, const char *delim,
   out->swap(tmp);
 }
 
+// Totals over utterances, updated by the destructors of class
+// CombineLatticeTask.
+struct CombineStats {
+  int32 n_success;
+  int32 n_other_errors;
+  CombineStats(): n_success(0), n_other_errors(0) { }
+};
+
+// This class normalizes and combines the lattices of one utterance in
+// operator (), which may run in a separate thread, and writes the output in
+// its destructor, which the TaskSequencer calls in the original order of the
+// utterances.
+class CombineLatticeTask {
+ public:
+  // Takes ownership of the lattices in "clats", which has one element per
+  // system; elements are NULL for systems that have no lattice for this
+  // utterance (but the first one must be present).
+  CombineLatticeTask(const std::string &key,
+                     const vector<vector<double> > &lat_scale,
+                     const vector<BaseFloat> &lat_weights,
+                     const vector<CompactLattice*> &clats,
+                     CompactLatticeWriter *clat_writer,
+                     CombineStats *stats):
+      key_(key), lat_scale_(lat_scale), lat_weights_(lat_weights),
+      clats_(clats), failed_(clats.size(), false), clat_writer_(clat_writer),
+      stats_(stats) {
+    KALDI_ASSERT(!clats_.empty() && clats_[0] != NULL);
+  }
+
+  void operator () () {
+    for (size_t i = 0; i < clats_.size(); i++) {
+      if (clats_[i] == NULL) continue;
+      fst::ScaleLattice(lat_scale_, clats_[i]);
+      failed_[i] = !CompactLatticeNormalize(clats_[i], lat_weights_[i]);
+      if (failed_[i] && i == 0)
+        break;
+      if (!failed_[i] && i > 0)
+        fst::Union(clats_[0], *(clats_[i]));
+      if (i > 0) {
+        delete clats_[i];  // This is no longer needed so we can delete it now.
+        clats_[i] = NULL;
+      }
+    }
+  }
+
+  ~CombineLatticeTask() {
+    for (size_t i = 0; i < failed_.size(); i++) {
+      if (failed_[i]) {
+        KALDI_WARN << "Could not normalize lattice for system " << (i + 1)
+                   << ", utterance: " << key_;
+        stats_->n_other_errors++;
+      }
+    }
+    if (!failed_[0]) {
+      clat_writer_->Write(key_, *(clats_[0]));
+      stats_->n_success++;
+    }
+    DeletePointers(&clats_);
+  }
+
+ private:
+  std::string key_;
+  const vector<vector<double> > &lat_scale_;
+  const vector<BaseFloat> &lat_weights_;
+  vector<CompactLattice*> clats_;  // The input lattices.  Owned locally.
+  vector<bool> failed_;
+  CompactLatticeWriter *clat_writer_;
+  CombineStats *stats_;
+};
+
 }  // end namespace kaldi
 
 
@@ -146,6 +217,8 @@ int main(int argc, char *argv[]) {
                 "probabilities");
     po.Register("lat-weights", &weight_str, "Colon-separated list of weights "
                 "for each rspecifier (which should sum to 1), e.g. '0.2:0.8'");
+    TaskSequencerConfig sequencer_config; // has --num-threads option
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -180,50 +253,41 @@ int main(int argc, char *argv[]) {
     if (!weight_str.empty())
       SplitStringToWeights(weight_str, ":", &lat_weights);
 
-    int32 n_utts = 0, n_total_lats = 0, n_success = 0, n_missing = 0,
-        n_other_errors = 0;
+    int32 n_utts = 0, n_total_lats = 0, n_missing = 0;
+    CombineStats stats;
     vector< vector<double> > lat_scale = fst::LatticeScale(lm_scale,
                                                            acoustic_scale);
 
-    for (; !clat_reader1.Done(); clat_reader1.Next()) {
-      std::string key = clat_reader1.Key();
-      CompactLattice clat1 = clat_reader1.Value();
-      clat_reader1.FreeCurrent();
-      n_utts++;
-      n_total_lats++;
-      fst::ScaleLattice(lat_scale, &clat1);
-      bool success = CompactLatticeNormalize(&clat1, lat_weights[0]);
-      if (!success) {
-        KALDI_WARN << "Could not normalize lattice for system 1, utterance: "
-                   << key;
-        n_other_errors++;
-        continue;
-      }
-
-      for (int32 i = 0; i < num_args-2; ++i) {
-        if (clat_reader_vec[i]->HasKey(key)) {
-          CompactLattice clat2 = clat_reader_vec[i]->Value(key);
-          n_total_lats++;
-          fst::ScaleLattice(lat_scale, &clat2);
-          success = CompactLatticeNormalize(&clat2, lat_weights[i+1]);
-          if (!success) {
-            KALDI_WARN << "Could not normalize lattice for system "<< (i + 2)
-                       << ", utterance: " << key;
-            n_other_errors++;
-            continue;
+    {
+      // The lattices are read in this thread (the random-access readers are
+      // not thread-safe), and normalized and combined in the others.
+      TaskSequencer<CombineLatticeTask> sequencer(sequencer_config);
+      for (; !clat_reader1.Done(); clat_reader1.Next()) {
+        std::string key = clat_reader1.Key();
+        vector<CompactLattice*> clats(num_args-1,
+                                      static_cast<CompactLattice*>(NULL));
+        clats[0] = new CompactLattice(clat_reader1.Value());
+        clat_reader1.FreeCurrent();
+        n_utts++;
+        n_total_lats++;
+
+        for (int32 i = 0; i < num_args-2; ++i) {
+          if (clat_reader_vec[i]->HasKey(key)) {
+            clats[i+1] = new CompactLattice(clat_reader_vec[i]->Value(key));
+            n_total_lats++;
+          } else {
+            KALDI_WARN << "No lattice found for utterance " << key << " for "
+                       << "system " << (i + 2) << ", rspecifier: "
+                       << clat_rspec_vec[i];
+            n_missing++;
           }
-          fst::Union(&clat1, clat2);
-        } else {
-          KALDI_WARN << "No lattice found for utterance " << key << " for "
-                     << "system " << (i + 2) << ", rspecifier: "
-                     << clat_rspec_vec[i];
-          n_missing++;
         }
+        sequencer.Run(new CombineLatticeTask(key, lat_scale, lat_weights,
+                                             clats, &clat_writer, &stats));
       }
-
-      clat_writer.Write(key, clat1);
-      n_success++;
+      sequencer.Wait();
     }
+    int32 n_success = stats.n_success, n_other_errors = stats.n_other_errors;
 
     KALDI_LOG << "Processed " << n_utts << " utterances: with a total of "
               << n_total_lats << " lattices across " << (num_args-1)
@@ -17,12 +17,135 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <mutex>
 
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+typedef fst::MapFst<fst::StdArc, LatticeArc,
+                    fst::StdToLatticeMapper<BaseFloat> > MappedFst;
+
+// Copies of the (mapped) FST that the lattices are composed with, for the
+// composition threads.  A MapFst caches the states it has expanded and the
+// cache is not thread-safe, so each composition takes a copy with Get() and
+// gives it back with Put().  Copies are only made when none is free, and they
+// keep their caches across lattices.
+class MappedFstPool {
+ public:
+  explicit MappedFstPool(const MappedFst &fst): fst_(fst) { }
+
+  MappedFst *Get() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty())
+      return fst_.Copy(true);  // true means thread-safe copy.
+    MappedFst *ans = free_.back();
+    free_.pop_back();
+    return ans;
+  }
+
+  void Put(MappedFst *fst) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(fst);
+  }
+
+  ~MappedFstPool() { DeletePointers(&free_); }
+
+ private:
+  const MappedFst &fst_;
+  std::mutex mutex_;
+  std::vector<MappedFst*> free_;
+};
+
+// This class composes one lattice in operator (), which may run in a separate
+// thread, and writes the output in its destructor, which the TaskSequencer
+// calls in the original order of the lattices.  The lattice is composed either
+// with an FST from 'fst_pool' (if non-NULL) or with the lattice 'lat2'.
+class LatticeComposeTask {
+ public:
+  // Takes ownership of 'lat1' and 'lat2' (the latter may be NULL).
+  LatticeComposeTask(const std::string &key, Lattice *lat1, Lattice *lat2,
+                     MappedFstPool *fst_pool, int32 phi_label,
+                     CompactLatticeWriter *compact_lattice_writer,
+                     LatticeWriter *lattice_writer,
+                     int32 *num_done, int32 *num_fail):
+      key_(key), lat1_(lat1), lat2_(lat2), fst_pool_(fst_pool),
+      phi_label_(phi_label), compact_lattice_writer_(compact_lattice_writer),
+      lattice_writer_(lattice_writer), num_done_(num_done),
+      num_fail_(num_fail) { }
+
+  void operator () () {
+    if (fst_pool_ != NULL) {
+      ArcSort(lat1_, fst::OLabelCompare<LatticeArc>());
+      MappedFst *mapped_fst2 = fst_pool_->Get();
+      if (phi_label_ > 0)
+        PhiCompose(*lat1_, *mapped_fst2, phi_label_, &composed_lat_);
+      else
+        Compose(*lat1_, *mapped_fst2, &composed_lat_);
+      fst_pool_->Put(mapped_fst2);
+    } else {
+      // Make sure that either lat2 is ilabel sorted
+      // or lat1 is olabel sorted, to ensure that
+      // composition will work.
+      if (lat2_->Properties(fst::kILabelSorted, true) == 0
+          && lat1_->Properties(fst::kOLabelSorted, true) == 0) {
+        // arbitrarily choose to sort lat2 rather than lat1.
+        fst::ILabelCompare<LatticeArc> ilabel_comp;
+        fst::ArcSort(lat2_, ilabel_comp);
+      }
+      if (phi_label_ > 0) {
+        PropagateFinal(phi_label_, lat2_);
+        PhiCompose(*lat1_, *lat2_, phi_label_, &composed_lat_);
+      } else {
+        Compose(*lat1_, *lat2_, &composed_lat_);
+      }
+    }
+    delete lat1_;  // These are no longer needed so we can delete them now.
+    delete lat2_;
+    lat1_ = lat2_ = NULL;
+    if (compact_lattice_writer_ != NULL &&
+        composed_lat_.Start() != fst::kNoStateId) {
+      ConvertLattice(composed_lat_, &composed_clat_);
+      composed_lat_.DeleteStates();
+    }
+  }
+
+  ~LatticeComposeTask() {
+    delete lat1_;  // in case operator () was never called.
+    delete lat2_;
+    if (composed_lat_.Start() == fst::kNoStateId &&
+        composed_clat_.Start() == fst::kNoStateId) {
+      KALDI_WARN << "Empty lattice for utterance " << key_
+                 << " (incompatible LM?)";
+      (*num_fail_)++;
+    } else {
+      if (compact_lattice_writer_ != NULL)
+        compact_lattice_writer_->Write(key_, composed_clat_);
+      else
+        lattice_writer_->Write(key_, composed_lat_);
+      (*num_done_)++;
+    }
+  }
+ private:
+  std::string key_;
+  Lattice *lat1_;
+  Lattice *lat2_;
+  MappedFstPool *fst_pool_;
+  int32 phi_label_;
+  Lattice composed_lat_;  // The output, if we write Lattice.
+  CompactLattice composed_clat_;  // The output, if we write CompactLattice.
+  CompactLatticeWriter *compact_lattice_writer_;
+  LatticeWriter *lattice_writer_;
+  int32 *num_done_;
+  int32 *num_fail_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -43,7 +166,9 @@ int main(int argc, char *argv[]) {
         "Usage: lattice-compose [options] lattice-rspecifier1 "
         "(lattice-rspecifier2|fst-rxfilename2) lattice-wspecifier\n"
         " e.g.: lattice-compose ark:1.lats ark:2.lats ark:composed.lats\n"
-        " or: lattice-compose ark:1.lats G.fst ark:composed.lats\n";
+        " or: lattice-compose ark:1.lats G.fst ark:composed.lats\n"
+        "With --num-threads > 1, several lattices are composed at once (and\n"
+        "still written in the input order).\n";
 
     ParseOptions po(usage);
 
@@ -55,6 +180,8 @@ int main(int argc, char *argv[]) {
     po.Register("num-states-cache", &num_states_cache,
                 "Number of states we cache when mapping LM FST to lattice type. "
                 "More -> more memory but faster.");
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    sequencer_config.Register(&po);
     po.Read(argc, argv);
 
     if (po.NumArgs() != 3) {
@@ -96,29 +223,21 @@ int main(int argc, char *argv[]) {
       fst::CacheOptions cache_opts(true, num_states_cache);
       fst::MapFstOptions mapfst_opts(cache_opts);
       fst::StdToLatticeMapper<BaseFloat> mapper;
-      fst::MapFst<StdArc, LatticeArc, fst::StdToLatticeMapper<BaseFloat> >
-          mapped_fst2(*fst2, mapper, mapfst_opts);
-      for (; !lattice_reader1.Done(); lattice_reader1.Next()) {
-        std::string key = lattice_reader1.Key();
-        KALDI_VLOG(1) << "Processing lattice for key " << key;
-        Lattice lat1 = lattice_reader1.Value();
-        ArcSort(&lat1, fst::OLabelCompare<LatticeArc>());
-        Lattice composed_lat;
-        if (phi_label > 0) PhiCompose(lat1, mapped_fst2, phi_label, &composed_lat);
-        else Compose(lat1, mapped_fst2, &composed_lat);
-        if (composed_lat.Start() == fst::kNoStateId) {
-          KALDI_WARN << "Empty lattice for utterance " << key << " (incompatible LM?)";
-          n_fail++;
-        } else {
-          if (write_compact) {
-            CompactLattice clat;
-            ConvertLattice(composed_lat, &clat);
-            compact_lattice_writer.Write(key, clat);
-          } else {
-            lattice_writer.Write(key, composed_lat);
-          }
-          n_done++;
+      MappedFst mapped_fst2(*fst2, mapper, mapfst_opts);
+      {
+        MappedFstPool fst_pool(mapped_fst2);
+        TaskSequencer<LatticeComposeTask> sequencer(sequencer_config);
+        for (; !lattice_reader1.Done(); lattice_reader1.Next()) {
+          std::string key = lattice_reader1.Key();
+          KALDI_VLOG(1) << "Processing lattice for key " << key;
+          Lattice *lat1 = new Lattice(lattice_reader1.Value());
+          lattice_reader1.FreeCurrent();
+          sequencer.Run(new LatticeComposeTask(
+              key, lat1, NULL, &fst_pool, phi_label,
+              write_compact ? &compact_lattice_writer : NULL, &lattice_writer,
+              &n_done, &n_fail));
         }
+        sequencer.Wait();
       }
       delete fst2;
     } else {
@@ -128,49 +247,25 @@ int main(int argc, char *argv[]) {
       // case we don't do any projection; we assume that the user has already
       // done this (e.g. with lattice-project).
       RandomAccessLatticeReader lattice_reader2(lats_rspecifier2);
+      TaskSequencer<LatticeComposeTask> sequencer(sequencer_config);
       for (; !lattice_reader1.Done(); lattice_reader1.Next()) {
         std::string key = lattice_reader1.Key();
         KALDI_VLOG(1) << "Processing lattice for key " << key;
-        Lattice lat1 = lattice_reader1.Value();
-        lattice_reader1.FreeCurrent();
         if (!lattice_reader2.HasKey(key)) {
           KALDI_WARN << "Not producing output for utterance " << key
                      << " because not present in second table.";
           n_fail++;
           continue;
         }
-        Lattice lat2 = lattice_reader2.Value(key);
-        // Make sure that either lat2 is ilabel sorted
-        // or lat1 is olabel sorted, to ensure that
-        // composition will work.
-        if (lat2.Properties(fst::kILabelSorted, true) == 0
-            && lat1.Properties(fst::kOLabelSorted, true) == 0) {
-          // arbitrarily choose to sort lat2 rather than lat1.
-          fst::ILabelCompare<LatticeArc> ilabel_comp;
-          fst::ArcSort(&lat2, ilabel_comp);
-        }
-
-        Lattice lat_out;
-        if (phi_label > 0) {
-          PropagateFinal(phi_label, &lat2);
-          PhiCompose(lat1, lat2, phi_label, &lat_out);
-        } else {
-          Compose(lat1, lat2, &lat_out);
-        }
-        if (lat_out.Start() == fst::kNoStateId) {
-          KALDI_WARN << "Empty lattice for utterance " << key << " (incompatible LM?)";
-          n_fail++;
-        } else {
-          if (write_compact) {
-            CompactLattice clat_out;
-            ConvertLattice(lat_out, &clat_out);
-            compact_lattice_writer.Write(key, clat_out);
-          } else {
-            lattice_writer.Write(key, lat_out);
-          }
-          n_done++;
-        }
+        Lattice *lat1 = new Lattice(lattice_reader1.Value()),
+            *lat2 = new Lattice(lattice_reader2.Value(key));
+        lattice_reader1.FreeCurrent();
+        sequencer.Run(new LatticeComposeTask(
+            key, lat1, lat2, NULL, phi_label,
+            write_compact ? &compact_lattice_writer : NULL, &lattice_writer,
+            &n_done, &n_fail));
       }
+      sequencer.Wait();
     }
 
     KALDI_LOG << "Done " << n_done << " lattices; failed for "
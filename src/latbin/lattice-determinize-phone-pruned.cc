@@ -49,6 +49,7 @@ int main(int argc, char *argv[]) {
     BaseFloat beam = 10.0;
     fst::DeterminizeLatticePhonePrunedOptions opts;
     opts.max_mem = 50000000;
+    fst::DeterminizeLatticeChunkedOptions chunk_opts;
 
     po.Register("write-compact", &write_compact, 
                 "If true, write in normal (compact) form. "
@@ -60,6 +61,7 @@ int main(int argc, char *argv[]) {
                 " likelihoods.");
     po.Register("beam", &beam, "Pruning beam [applied after acoustic scaling].");
     opts.Register(&po);
+    chunk_opts.Register(&po);
     po.Read(argc, argv);
 
     if (po.NumArgs() != 3) {
@@ -111,8 +113,8 @@ int main(int argc, char *argv[]) {
       fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &lat);
 
       CompactLattice det_clat;
-      if (!DeterminizeLatticePhonePrunedWrapper(
-              trans_model, &lat, beam, &det_clat, opts)) {
+      if (!DeterminizeLatticePhonePrunedChunkedWrapper(
+              trans_model, &lat, beam, &det_clat, chunk_opts, opts)) {
         KALDI_WARN << "For key " << key << ", determinization did not succeed"
             "(partial output will be pruned tighter than the specified beam.)";
         n_warn++;
@@ -48,6 +48,7 @@ int main(int argc, char *argv[]) {
     // being more part of "fst world", so we register its elements independently.
     opts.max_mem = 50000000;
     opts.max_loop = 0; // was 500000;
+    fst::DeterminizeLatticeChunkedOptions chunk_opts;
 
     po.Register("write-compact", &write_compact, 
                 "If true, write in normal (compact) form. "
@@ -61,6 +62,7 @@ int main(int argc, char *argv[]) {
     po.Register("minimize", &minimize,
                 "If true, push and minimize after determinization");
     opts.Register(&po);
+    chunk_opts.Register(&po);
     po.Read(argc, argv);
 
     if (po.NumArgs() != 2) {
@@ -115,7 +117,8 @@ int main(int argc, char *argv[]) {
       }
       fst::ArcSort(&lat, fst::ILabelCompare<LatticeArc>());
       CompactLattice det_clat;
-      if (!DeterminizeLatticePruned(lat, beam, &det_clat, opts)) {
+      if (!DeterminizeLatticePrunedChunked(lat, beam, &det_clat, chunk_opts,
+                                           opts)) {
         KALDI_WARN << "For key " << key << ", determinization did not succeed"
             "(partial output will be pruned tighter than the specified beam.)";
         n_warn++;
@@ -45,9 +45,18 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     BaseFloat lm_scale = 1.0;
+    bool use_mmap = false;
+    int32 lm_cache_size = 0;
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
                 "costs; frequently 1.0 or -1.0");
+    po.Register("use-mmap", &use_mmap, "If true, map the LM file into memory "
+                "with mmap() instead of reading it, so that jobs on the same "
+                "machine share one copy of it (the file must have been written "
+                "by a recent arpa-to-const-arpa).");
+    po.Register("lm-cache-size", &lm_cache_size, "If positive, cache up to "
+                "this many LM lookups (history plus word) across lattices, "
+                "which helps when many lattices share the same histories.");
 
     po.Read(argc, argv);
 
@@ -62,12 +71,19 @@ int main(int argc, char *argv[]) {
 
     // Reads the language model in ConstArpaLm format.
     ConstArpaLm const_arpa;
-    ReadKaldiObject(lm_rxfilename, &const_arpa);
+    if (use_mmap)
+      const_arpa.ReadMmap(lm_rxfilename);
+    else
+      ReadKaldiObject(lm_rxfilename, &const_arpa);
 
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
+    ConstArpaLmCache *lm_cache = NULL;
+    if (lm_cache_size > 0)
+      lm_cache = new ConstArpaLmCache(lm_cache_size);
+
     int32 n_done = 0, n_fail = 0;
     for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
       std::string key = compact_lattice_reader.Key();
@@ -85,7 +101,7 @@ int main(int argc, char *argv[]) {
 
         // Wraps the ConstArpaLm format language model into FST. We re-create it
         // for each lattice to prevent memory usage increasing with time.
-        ConstArpaLmDeterministicFst const_arpa_fst(const_arpa);
+        ConstArpaLmDeterministicFst const_arpa_fst(const_arpa, lm_cache);
 
         // Composes lattice with language model.
         CompactLattice composed_clat;
@@ -114,6 +130,10 @@ int main(int argc, char *argv[]) {
       }
     }
 
+    if (lm_cache != NULL) {
+      lm_cache->PrintStats("LM lookup cache");
+      delete lm_cache;
+    }
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
     return (n_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
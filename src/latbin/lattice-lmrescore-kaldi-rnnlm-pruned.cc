@@ -28,6 +28,184 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/compose-lattice-pruned.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// The on-demand FSTs used to rescore one lattice: the old LM, with a scale of
+// -lm_scale, and the RNNLM, with a scale of lm_scale.  They are not
+// thread-safe, so each thread needs its own; the models they use are shared.
+struct RescoringLms {
+  fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract_base;
+  fst::ScaleDeterministicOnDemandFst *lm_to_subtract;
+  // Exactly one of the following two is non-NULL.
+  rnnlm::KaldiRnnlmDeterministicFst *rnnlm_fst;
+  rnnlm::KaldiRnnlmBatchDeterministicFst *rnnlm_batch_fst;
+  rnnlm::RnnlmBatchComputer *batch_computer;
+  fst::ScaleDeterministicOnDemandFst *lm_to_add;
+
+  RescoringLms(): lm_to_subtract_base(NULL), lm_to_subtract(NULL),
+                  rnnlm_fst(NULL), rnnlm_batch_fst(NULL),
+                  batch_computer(NULL), lm_to_add(NULL) { }
+
+  // Forgets the RNNLM states of the last lattice.
+  void Clear() {
+    if (rnnlm_fst != NULL)
+      rnnlm_fst->Clear();
+    else
+      rnnlm_batch_fst->Clear();
+  }
+
+  ~RescoringLms() {
+    delete lm_to_add;
+    delete rnnlm_fst;
+    delete rnnlm_batch_fst;
+    delete batch_computer;
+    delete lm_to_subtract;
+    delete lm_to_subtract_base;
+  }
+};
+
+// Creates RescoringLms objects as they are needed and keeps them for reuse,
+// so there are only as many of them as there are lattices being rescored at
+// once (i.e. at most --num-threads).  Exactly one of 'const_arpa' and
+// 'lm_to_subtract_fst' must be non-NULL.
+class RescoringLmsPool {
+ public:
+  RescoringLmsPool(BaseFloat lm_scale,
+                   const ConstArpaLm *const_arpa,
+                   const fst::VectorFst<fst::StdArc> *lm_to_subtract_fst,
+                   int32 max_ngram_order,
+                   const rnnlm::RnnlmComputeStateInfo &info,
+                   int32 batch_size,
+                   rnnlm::KaldiRnnlmStateCache *lm_cache):
+      lm_scale_(lm_scale), const_arpa_(const_arpa),
+      lm_to_subtract_fst_(lm_to_subtract_fst),
+      max_ngram_order_(max_ngram_order), info_(info), batch_size_(batch_size),
+      lm_cache_(lm_cache) { }
+
+  RescoringLms *Get() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!free_lms_.empty()) {
+        RescoringLms *ans = free_lms_.back();
+        free_lms_.pop_back();
+        return ans;
+      }
+    }
+    RescoringLms *ans = new RescoringLms();
+    if (const_arpa_ != NULL)
+      ans->lm_to_subtract_base = new ConstArpaLmDeterministicFst(*const_arpa_);
+    else
+      ans->lm_to_subtract_base =
+          new fst::BackoffDeterministicOnDemandFst<fst::StdArc>(
+              *lm_to_subtract_fst_);
+    ans->lm_to_subtract = new fst::ScaleDeterministicOnDemandFst(
+        -lm_scale_, ans->lm_to_subtract_base);
+    if (batch_size_ > 0) {
+      ans->batch_computer = new rnnlm::RnnlmBatchComputer(
+          info_.opts, info_.rnnlm, info_.word_embedding_mat, batch_size_);
+      ans->rnnlm_batch_fst = new rnnlm::KaldiRnnlmBatchDeterministicFst(
+          max_ngram_order_, ans->batch_computer);
+      ans->lm_to_add = new fst::ScaleDeterministicOnDemandFst(
+          lm_scale_, ans->rnnlm_batch_fst);
+    } else {
+      ans->rnnlm_fst = new rnnlm::KaldiRnnlmDeterministicFst(
+          max_ngram_order_, info_, lm_cache_);
+      ans->lm_to_add = new fst::ScaleDeterministicOnDemandFst(
+          lm_scale_, ans->rnnlm_fst);
+    }
+    return ans;
+  }
+
+  void Release(RescoringLms *lms) {
+    lms->Clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_lms_.push_back(lms);
+  }
+
+  ~RescoringLmsPool() {
+    for (size_t i = 0; i < free_lms_.size(); i++)
+      delete free_lms_[i];
+  }
+
+ private:
+  BaseFloat lm_scale_;
+  const ConstArpaLm *const_arpa_;
+  const fst::VectorFst<fst::StdArc> *lm_to_subtract_fst_;
+  int32 max_ngram_order_;
+  const rnnlm::RnnlmComputeStateInfo &info_;
+  int32 batch_size_;
+  rnnlm::KaldiRnnlmStateCache *lm_cache_;
+
+  std::mutex mutex_;
+  std::vector<RescoringLms*> free_lms_;
+};
+
+class RescoreLatticeTask {
+ public:
+  RescoreLatticeTask(const ComposeLatticePrunedOptions &compose_opts,
+                     BaseFloat acoustic_scale,
+                     const std::string &key,
+                     const CompactLattice &clat,
+                     RescoringLmsPool *lms_pool,
+                     CompactLatticeWriter *clat_writer,
+                     int32 *num_done,
+                     int32 *num_err):
+      compose_opts_(compose_opts), acoustic_scale_(acoustic_scale), key_(key),
+      clat_(clat), lms_pool_(lms_pool), clat_writer_(clat_writer),
+      num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    // Before composing with the LM FST, we scale the lattice weights
+    // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+    // We do it this way so we can determinize and it will give the
+    // right effect (taking the "best path" through the LM) regardless
+    // of the sign of lm_scale.
+    if (acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), &clat_);
+    }
+    TopSortCompactLatticeIfNeeded(&clat_);
+
+    RescoringLms *lms = lms_pool_->Get();
+    fst::ComposeDeterministicOnDemandFst<fst::StdArc> combined_lms(
+        lms->lm_to_subtract, lms->lm_to_add);
+
+    // Composes lattice with language model.
+    ComposeCompactLatticePruned(compose_opts_, clat_,
+                                &combined_lms, &composed_clat_);
+    lms_pool_->Release(lms);
+    clat_.DeleteStates();
+
+    if (composed_clat_.NumStates() != 0 && acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                        &composed_clat_);
+    }
+  }
+
+  ~RescoreLatticeTask() {
+    if (composed_clat_.NumStates() == 0) {
+      // Something went wrong.  A warning will already have been printed.
+      (*num_err_)++;
+    } else {
+      clat_writer_->Write(key_, composed_clat_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  const ComposeLatticePrunedOptions &compose_opts_;
+  BaseFloat acoustic_scale_;
+  std::string key_;
+  CompactLattice clat_;
+  CompactLattice composed_clat_;  // Written in the destructor.
+  RescoringLmsPool *lms_pool_;
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -44,6 +222,10 @@ int main(int argc, char *argv[]) {
         "scripts/rnnlm/lmrescore_pruned.sh. An example for rescoring \n"
         "lattices is at egs/swbd/s5c/local/rnnlm/run_lstm.sh \n"
         "\n"
+        "With --num-threads > 1, lattices are rescored in parallel (each thread\n"
+        "has its own on-demand LM FSTs; the models are shared), and are written\n"
+        "in the input order.\n"
+        "\n"
         "Usage: lattice-lmrescore-kaldi-rnnlm-pruned [options] \\\n"
         "             <old-lm-rxfilename> <embedding-file> \\\n"
         "             <raw-rnnlm-rxfilename> \\\n"
@@ -60,11 +242,16 @@ int main(int argc, char *argv[]) {
     ParseOptions po(usage);
     rnnlm::RnnlmComputeStateComputationOptions opts;
     ComposeLatticePrunedOptions compose_opts;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     int32 max_ngram_order = 3;
     BaseFloat lm_scale = 0.5;
     BaseFloat acoustic_scale = 0.1;
     bool use_carpa = false;
+    bool use_mmap = false;
+    int32 lm_cache_size = 0;
+    int32 batch_size = 0;
+    std::string use_gpu = "no";
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -77,9 +264,22 @@ int main(int argc, char *argv[]) {
         "saves time and reduces output lattice size).");
     po.Register("use-const-arpa", &use_carpa, "If true, read the old-LM file "
                 "as a const-arpa file as opposed to an FST file");
+    po.Register("use-mmap", &use_mmap, "If true (and --use-const-arpa=true), "
+                "map the const-arpa LM into memory with mmap() instead of "
+                "reading it, so that jobs on the same machine share one copy.");
+    po.Register("lm-cache-size", &lm_cache_size, "If positive, cache up to "
+                "this many RNNLM states across lattices, so that histories "
+                "shared by many lattices are computed once.");
+    po.Register("batch-size", &batch_size, "If positive, compute the RNNLM "
+                "for up to this many histories at once, taken from the "
+                "frontier of the pruned composition (much faster with a GPU; "
+                "--lm-cache-size is then ignored).");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
 
     opts.Register(&po);
     compose_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -91,6 +291,12 @@ int main(int argc, char *argv[]) {
     if (opts.bos_index == -1 || opts.eos_index == -1) {
       KALDI_ERR << "must set --bos-symbol and --eos-symbol options";
     }
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
 
     std::string lm_to_subtract_rxfilename, lats_rspecifier,
                 word_embedding_rxfilename, rnnlm_rxfilename, lats_wspecifier;
@@ -102,30 +308,21 @@ int main(int argc, char *argv[]) {
     lats_wspecifier = po.GetArg(5);
 
     // for G.fst
-    fst::ScaleDeterministicOnDemandFst *lm_to_subtract_det_scale = NULL;
-    fst::BackoffDeterministicOnDemandFst<StdArc> *lm_to_subtract_det_backoff = NULL;
     VectorFst<StdArc> *lm_to_subtract_fst = NULL;
 
     // for G.carpa
     ConstArpaLm* const_arpa = NULL;
-    fst::DeterministicOnDemandFst<StdArc> *carpa_lm_to_subtract_fst = NULL;
 
     KALDI_LOG << "Reading old LMs...";
     if (use_carpa) {
       const_arpa = new ConstArpaLm();
-      ReadKaldiObject(lm_to_subtract_rxfilename, const_arpa);
-      carpa_lm_to_subtract_fst = new ConstArpaLmDeterministicFst(*const_arpa);
-      lm_to_subtract_det_scale
-        = new fst::ScaleDeterministicOnDemandFst(-lm_scale,
-                                                 carpa_lm_to_subtract_fst);
+      if (use_mmap)
+        const_arpa->ReadMmap(lm_to_subtract_rxfilename);
+      else
+        ReadKaldiObject(lm_to_subtract_rxfilename, const_arpa);
     } else {
       lm_to_subtract_fst = fst::ReadAndPrepareLmFst(
           lm_to_subtract_rxfilename);
-      lm_to_subtract_det_backoff =
-        new fst::BackoffDeterministicOnDemandFst<StdArc>(*lm_to_subtract_fst);
-      lm_to_subtract_det_scale =
-           new fst::ScaleDeterministicOnDemandFst(-lm_scale,
-                                                  lm_to_subtract_det_backoff);
     }
 
     kaldi::nnet3::Nnet rnnlm;
@@ -144,61 +341,39 @@ int main(int argc, char *argv[]) {
 
     int32 num_done = 0, num_err = 0;
 
-    rnnlm::KaldiRnnlmDeterministicFst* lm_to_add_orig = 
-         new rnnlm::KaldiRnnlmDeterministicFst(max_ngram_order, info);
-
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      fst::DeterministicOnDemandFst<StdArc> *lm_to_add =
-         new fst::ScaleDeterministicOnDemandFst(lm_scale, lm_to_add_orig);
-
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
-
-      // Before composing with the LM FST, we scale the lattice weights
-      // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-      // We do it this way so we can determinize and it will give the
-      // right effect (taking the "best path" through the LM) regardless
-      // of the sign of lm_scale.
-      if (acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
+    rnnlm::KaldiRnnlmStateCache *lm_cache = NULL;
+    if (lm_cache_size > 0 && batch_size <= 0)
+      lm_cache = new rnnlm::KaldiRnnlmStateCache(lm_cache_size);
+
+    {
+      RescoringLmsPool lms_pool(lm_scale, const_arpa, lm_to_subtract_fst,
+                                max_ngram_order, info, batch_size, lm_cache);
+      TaskSequencer<RescoreLatticeTask> sequencer(sequencer_config);
+
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        std::string key = compact_lattice_reader.Key();
+        sequencer.Run(new RescoreLatticeTask(compose_opts, acoustic_scale,
+                                             key,
+                                             compact_lattice_reader.Value(),
+                                             &lms_pool,
+                                             &compact_lattice_writer,
+                                             &num_done, &num_err));
+        compact_lattice_reader.FreeCurrent();
       }
-      TopSortCompactLatticeIfNeeded(&clat);
-
-      fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
-          lm_to_subtract_det_scale, lm_to_add);
-
-      // Composes lattice with language model.
-      CompactLattice composed_clat;
-      ComposeCompactLatticePruned(compose_opts, clat,
-                                  &combined_lms, &composed_clat);
-
-      lm_to_add_orig->Clear();
-
-      if (composed_clat.NumStates() == 0) {
-        // Something went wrong.  A warning will already have been printed.
-        num_err++;
-      } else {
-        if (acoustic_scale != 1.0) {
-          if (acoustic_scale == 0.0)
-            KALDI_ERR << "Acoustic scale cannot be zero.";
-          fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
-                            &composed_clat);
-        }
-        compact_lattice_writer.Write(key, composed_clat);
-        num_done++;
-      }
-      delete lm_to_add;
+      sequencer.Wait();
     }
 
     delete lm_to_subtract_fst;
-    delete lm_to_add_orig;
-    delete lm_to_subtract_det_backoff;
-    delete lm_to_subtract_det_scale;
-
     delete const_arpa;
-    delete carpa_lm_to_subtract_fst;
 
+    if (lm_cache != NULL) {
+      lm_cache->PrintStats("RNNLM state cache");
+      delete lm_cache;
+    }
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
     KALDI_LOG << "Overall, succeeded for " << num_done
               << " lattices, failed for " << num_err;
     return (num_done != 0 ? 0 : 1);
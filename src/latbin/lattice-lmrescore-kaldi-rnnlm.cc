@@ -51,6 +51,7 @@ int main(int argc, char *argv[]) {
     rnnlm::RnnlmComputeStateComputationOptions opts;
 
     int32 max_ngram_order = 3;
+    int32 lm_cache_size = 0;
     BaseFloat lm_scale = 1.0;
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
@@ -59,6 +60,9 @@ int main(int argc, char *argv[]) {
         "If positive, allow RNNLM histories longer than this to be identified "
         "with each other for rescoring purposes (an approximation that "
         "saves time and reduces output lattice size).");
+    po.Register("lm-cache-size", &lm_cache_size, "If positive, cache up to "
+                "this many RNNLM states across lattices, so that histories "
+                "shared by many lattices are computed once.");
     opts.Register(&po);
 
     po.Read(argc, argv);
@@ -93,7 +97,12 @@ int main(int argc, char *argv[]) {
 
     int32 n_done = 0, n_fail = 0;
 
-    rnnlm::KaldiRnnlmDeterministicFst rnnlm_fst(max_ngram_order, info);
+    rnnlm::KaldiRnnlmStateCache *lm_cache = NULL;
+    if (lm_cache_size > 0)
+      lm_cache = new rnnlm::KaldiRnnlmStateCache(lm_cache_size);
+
+    rnnlm::KaldiRnnlmDeterministicFst rnnlm_fst(max_ngram_order, info,
+                                                lm_cache);
 
     for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
       std::string key = compact_lattice_reader.Key();
@@ -138,6 +147,10 @@ int main(int argc, char *argv[]) {
       rnnlm_fst.Clear();
     }
 
+    if (lm_cache != NULL) {
+      lm_cache->PrintStats("RNNLM state cache");
+      delete lm_cache;
+    }
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
     return (n_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
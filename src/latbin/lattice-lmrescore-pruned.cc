@@ -60,6 +60,7 @@ int main(int argc, char *argv[]) {
     BaseFloat lm_scale = 1.0;
     BaseFloat acoustic_scale = 1.0;
     bool add_const_arpa = false;
+    bool use_mmap = false;
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -69,7 +70,9 @@ int main(int argc, char *argv[]) {
     po.Register("add-const-arpa", &add_const_arpa, "If true, <lm-to-add> is expected"
                 "to be in const-arpa format; if false it's expected to be in FST"
                 "format.");
-
+    po.Register("use-mmap", &use_mmap, "If true (and --add-const-arpa=true), "
+                "map the const-arpa LM into memory with mmap() instead of "
+                "reading it, so that jobs on the same machine share one copy.");
 
     po.Read(argc, argv);
 
@@ -89,7 +92,10 @@ int main(int argc, char *argv[]) {
     VectorFst<StdArc> *lm_to_add_fst = NULL;
     ConstArpaLm const_arpa;
     if (add_const_arpa) {
-      ReadKaldiObject(lm_to_add_rxfilename, &const_arpa);
+      if (use_mmap)
+        const_arpa.ReadMmap(lm_to_add_rxfilename);
+      else
+        ReadKaldiObject(lm_to_add_rxfilename, &const_arpa);
     } else {
       lm_to_add_fst = fst::ReadAndPrepareLmFst(lm_to_add_rxfilename);
     }
@@ -24,6 +24,7 @@
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
+#include "util/kaldi-thread.h"
 
 namespace kaldi {
 
@@ -74,7 +75,11 @@ void ConvertLatticeToUnweightedAcceptor(const kaldi::Lattice &ilat,
   fst::ArcSort(ofst, fst::StdILabelCompare());
 }
 
-void CreateEditDistance(const fst::StdVectorFst &fst1,
+// Creates the edit-distance transducer between the output symbols of any of
+// the FSTs in 'fsts1' and the input symbols of 'fst2'.  With more than one
+// FST in 'fsts1' (one lattice per system), the result composed with the
+// reference can be shared by all of them.
+void CreateEditDistance(const std::vector<const fst::StdVectorFst*> &fsts1,
                         const fst::StdVectorFst &fst2,
                         fst::StdVectorFst *pfst) {
   typedef fst::StdArc StdArc;
@@ -85,9 +90,14 @@ void CreateEditDistance(const fst::StdVectorFst &fst1,
   Weight insertion_cost(1.0);
   Weight deletion_cost(1.0);
 
-  // create set of output symbols in fst1
+  // create set of output symbols in fsts1
   std::vector<Label> fst1syms, fst2syms;
-  GetOutputSymbols(fst1, false /*no epsilons*/, &fst1syms);
+  for (size_t i = 0; i < fsts1.size(); i++) {
+    std::vector<Label> syms;
+    GetOutputSymbols(*(fsts1[i]), false /*no epsilons*/, &syms);
+    fst1syms.insert(fst1syms.end(), syms.begin(), syms.end());
+  }
+  SortAndUniq(&fst1syms);
   GetInputSymbols(fst2, false /*no epsilons*/, &fst2syms);
 
   pfst->AddState();
@@ -160,18 +170,228 @@ bool CheckFst(const fst::StdVectorFst &fst, string name, string key) {
   return true;
 #endif
 }
-}
+
+
+// Totals over utterances, updated by the destructors of class OracleTask.
+struct OracleStats {
+  int32 n_done;
+  int32 n_fail;
+  int32 tot_correct;
+  int32 tot_substitutions;
+  int32 tot_insertions;
+  int32 tot_deletions;
+  int32 tot_words;
+  // The number of utterances for which each system had the oracle path.
+  std::vector<int32> num_best;
+
+  explicit OracleStats(int32 num_systems):
+      n_done(0), n_fail(0), tot_correct(0), tot_substitutions(0),
+      tot_insertions(0), tot_deletions(0), tot_words(0),
+      num_best(num_systems, 0) { }
+};
+
+// This class finds the oracle path for one utterance in operator (), which may
+// run in a separate thread, and writes the output in its destructor, which the
+// TaskSequencer calls in the original order of the utterances.  When there is
+// one lattice per system, the reference side of the computation (the edit
+// distance transducer composed with the reference) is built once and shared by
+// all of them, and the oracle is the best path over all the systems.
+class OracleTask {
+ public:
+  // Takes ownership of the lattices in "lats", which has one element per
+  // system; elements are NULL for systems that have no lattice for this
+  // utterance.
+  OracleTask(const std::string &key,
+             const std::vector<int32> &reference,
+             const LabelPairVector &wildcards,
+             const fst::SymbolTable *word_syms,
+             const std::vector<Lattice*> &lats,
+             Int32VectorWriter *transcriptions_writer,
+             Int32Writer *edit_distance_writer,
+             CompactLatticeWriter *lats_writer,
+             OracleStats *stats):
+      key_(key), reference_(reference), wildcards_(wildcards),
+      word_syms_(word_syms), lats_(lats),
+      transcriptions_writer_(transcriptions_writer),
+      edit_distance_writer_(edit_distance_writer), lats_writer_(lats_writer),
+      stats_(stats), best_system_(-1), correct_(0), substitutions_(0),
+      insertions_(0), deletions_(0), num_words_(0) { }
+
+  void operator () () {
+    using fst::StdArc;
+    using fst::VectorFst;
+    int32 num_systems = lats_.size();
+    // remove all weights while creating standard FSTs
+    std::vector<VectorFst<StdArc> > lattice_fsts(num_systems);
+    std::vector<const VectorFst<StdArc>*> present_fsts;
+    for (int32 s = 0; s < num_systems; s++) {
+      if (lats_[s] == NULL) continue;
+      ConvertLatticeToUnweightedAcceptor(*(lats_[s]), wildcards_,
+                                         &(lattice_fsts[s]));
+      CheckFst(lattice_fsts[s], "lattice_fst_", key_);
+      present_fsts.push_back(&(lattice_fsts[s]));
+    }
+
+    // TODO: map certain symbols (using an FST created with CreateMapFst())
+    VectorFst<StdArc> reference_fst;
+    MakeLinearAcceptor(reference_, &reference_fst);
+
+    // Remove any wildcards in reference.
+    fst::Relabel(&reference_fst, wildcards_, wildcards_);
+    CheckFst(reference_fst, "reference_fst_", key_);
+
+    fst::StdVectorFst edit_distance_fst;
+    CreateEditDistance(present_fsts, reference_fst, &edit_distance_fst);
+
+    // compose with edit distance transducer
+    VectorFst<StdArc> edit_ref_fst;
+    fst::Compose(edit_distance_fst, reference_fst, &edit_ref_fst);
+    CheckFst(edit_ref_fst, "composed_", key_);
+
+    // make sure composed FST is input sorted
+    fst::ArcSort(&edit_ref_fst, fst::StdILabelCompare());
+
+    int32 best_errs = 0;
+    for (int32 s = 0; s < num_systems; s++) {
+      if (lats_[s] == NULL) continue;
+      // compose with previous result
+      VectorFst<StdArc> result_fst;
+      fst::Compose(lattice_fsts[s], edit_ref_fst, &result_fst);
+      CheckFst(result_fst, "result_", key_);
+
+      // find out best path
+      VectorFst<StdArc> best_path;
+      fst::ShortestPath(result_fst, &best_path);
+      CheckFst(best_path, "best_path_", key_);
+      if (best_path.Start() == fst::kNoStateId)
+        continue;
+
+      // count errors
+      int32 correct, substitutions, insertions, deletions, num_words;
+      CountErrors(best_path, &correct, &substitutions,
+                  &insertions, &deletions, &num_words);
+      int32 errs = substitutions + insertions + deletions;
+      if (best_system_ == -1 || errs < best_errs) {
+        best_system_ = s;
+        best_errs = errs;
+        correct_ = correct;
+        substitutions_ = substitutions;
+        insertions_ = insertions;
+        deletions_ = deletions;
+        num_words_ = num_words;
+        best_path_ = best_path;
+      }
+    }
+    if (best_system_ == -1)
+      return;
+    GetLinearSymbolSequence(best_path_, &oracle_words_, &reference_words_,
+                            &weight_);
+
+    // If requested, find the lattice that only contains the oracle path.
+    if (lats_writer_->IsOpen()) {
+      CompactLattice oracle_clat_mask;
+      MakeLinearAcceptor(oracle_words_, &oracle_clat_mask);
+
+      CompactLattice clat;
+      ConvertLattice(*(lats_[best_system_]), &clat);
+      fst::Relabel(&clat, wildcards_, LabelPairVector());
+      fst::ArcSort(&clat, fst::ILabelCompare<CompactLatticeArc>());
+      fst::Compose(oracle_clat_mask, clat, &oracle_clat_mask);
+      fst::ShortestPath(oracle_clat_mask, &oracle_clat_);
+      fst::Project(&oracle_clat_, fst::PROJECT_OUTPUT);
+      TopSortCompactLatticeIfNeeded(&oracle_clat_);
+    }
+    DeletePointers(&lats_);
+  }
+
+  ~OracleTask() {
+    DeletePointers(&lats_);  // in case operator () was never called.
+    stats_->n_done++;
+    if (best_system_ == -1) {
+      KALDI_WARN << "Best-path failed for key " << key_;
+      stats_->n_fail++;
+      return;
+    }
+    int32 tot_errs = substitutions_ + insertions_ + deletions_;
+    if (edit_distance_writer_->IsOpen())
+      edit_distance_writer_->Write(key_, tot_errs);
+    KALDI_LOG << "%WER " << (100.*tot_errs) / num_words_ << " [ " << tot_errs
+              << " / " << num_words_ << ", " << insertions_ << " insertions, "
+              << deletions_ << " deletions, " << substitutions_ << " sub ]";
+    stats_->tot_correct += correct_;
+    stats_->tot_substitutions += substitutions_;
+    stats_->tot_insertions += insertions_;
+    stats_->tot_deletions += deletions_;
+    stats_->tot_words += num_words_;
+    stats_->num_best[best_system_]++;
+
+    KALDI_LOG << "For utterance " << key_ << ", best cost " << weight_;
+    if (stats_->num_best.size() > 1)
+      KALDI_VLOG(1) << "Oracle path for utterance " << key_
+                    << " is from system " << (best_system_ + 1);
+    if (transcriptions_writer_->IsOpen())
+      transcriptions_writer_->Write(key_, oracle_words_);
+    if (word_syms_ != NULL) {
+      std::cerr << key_ << " (oracle) ";
+      for (size_t i = 0; i < oracle_words_.size(); i++) {
+        std::string s = word_syms_->Find(oracle_words_[i]);
+        if (s == "")
+          KALDI_ERR << "Word-id " << oracle_words_[i]
+                    << " not in symbol table.";
+        std::cerr << s << ' ';
+      }
+      std::cerr << '\n' << key_ << " (reference) ";
+      for (size_t i = 0; i < reference_words_.size(); i++) {
+        std::string s = word_syms_->Find(reference_words_[i]);
+        if (s == "")
+          KALDI_ERR << "Word-id " << reference_words_[i]
+                    << " not in symbol table.";
+        std::cerr << s << ' ';
+      }
+      std::cerr << '\n';
+    }
+
+    if (lats_writer_->IsOpen()) {
+      if (oracle_clat_.Start() == fst::kNoStateId) {
+        KALDI_WARN << "Failed to find the oracle path in the original "
+                   << "lattice: " << key_;
+      } else {
+        lats_writer_->Write(key_, oracle_clat_);
+      }
+    }
+  }
+
+ private:
+  std::string key_;
+  std::vector<int32> reference_;
+  const LabelPairVector &wildcards_;
+  const fst::SymbolTable *word_syms_;
+  std::vector<Lattice*> lats_;  // The input lattices.  Owned locally.
+  Int32VectorWriter *transcriptions_writer_;
+  Int32Writer *edit_distance_writer_;
+  CompactLatticeWriter *lats_writer_;
+  OracleStats *stats_;
+
+  // The following are the output, written in the destructor.
+  int32 best_system_;  // -1 if no system had a path.
+  int32 correct_;
+  int32 substitutions_;
+  int32 insertions_;
+  int32 deletions_;
+  int32 num_words_;
+  fst::StdVectorFst best_path_;
+  std::vector<int32> oracle_words_;
+  std::vector<int32> reference_words_;
+  fst::StdArc::Weight weight_;
+  CompactLattice oracle_clat_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
-    using fst::SymbolTable;
-    using fst::VectorFst;
-    using fst::StdArc;
     typedef kaldi::int32 int32;
-    typedef kaldi::int64 int64;
-    typedef fst::StdArc::Weight Weight;
-    typedef fst::StdArc::StateId StateId;
 
     const char *usage =
         "Finds the path having the smallest edit-distance between a lattice\n"
@@ -188,7 +408,12 @@ int main(int argc, char *argv[]) {
         "optimal path as a lattice.\n"
         "Note: you can use this program to compute the n-best oracle WER by\n"
         "first piping the input lattices through lattice-to-nbest and then\n"
-        "nbest-to-lattice.\n";
+        "nbest-to-lattice.\n"
+        "With --num-systems=N, the first N arguments are lattice rspecifiers\n"
+        "from different systems, and the oracle is found over all of them\n"
+        "(i.e. it is the oracle of their combination), e.g.:\n"
+        "  lattice-oracle --num-systems=2 ark:a/lat.1 ark:b/lat.1 \\\n"
+        "       ark:ref.int ark,t:-\n";
 
     ParseOptions po(usage);
 
@@ -196,6 +421,7 @@ int main(int argc, char *argv[]) {
     std::string wild_syms_rxfilename;
     std::string wildcard_symbols;
     std::string lats_wspecifier;
+    int32 num_systems = 1;
 
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
@@ -211,21 +437,32 @@ int main(int argc, char *argv[]) {
     po.Register("write-lattices", &lats_wspecifier, "If supplied, write the "
                 "lattice that contains only the oracle path to the given "
                 "wspecifier.");
+    po.Register("num-systems", &num_systems, "Number of lattice rspecifiers "
+                "at the start of the command line; the oracle path is found "
+                "over the lattices of all of them.  Only the first is read "
+                "sequentially.");
+    TaskSequencerConfig sequencer_config; // has --num-threads option
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
-    if (po.NumArgs() != 3 && po.NumArgs() != 4) {
+    if (num_systems < 1 || (po.NumArgs() != num_systems + 2 &&
+                            po.NumArgs() != num_systems + 3)) {
       po.PrintUsage();
       exit(1);
     }
 
     std::string lats_rspecifier = po.GetArg(1),
-        reference_rspecifier = po.GetArg(2),
-        transcriptions_wspecifier = po.GetArg(3),
-        edit_distance_wspecifier = po.GetOptArg(4);
+        reference_rspecifier = po.GetArg(num_systems + 1),
+        transcriptions_wspecifier = po.GetArg(num_systems + 2),
+        edit_distance_wspecifier = po.GetOptArg(num_systems + 3);
 
     // will read input as  lattices
     SequentialLatticeReader lattice_reader(lats_rspecifier);
+    std::vector<RandomAccessLatticeReader*> other_lattice_readers;
+    for (int32 s = 1; s < num_systems; s++)
+      other_lattice_readers.push_back(
+          new RandomAccessLatticeReader(po.GetArg(s + 1)));
     RandomAccessInt32VectorReader reference_reader(reference_rspecifier);
     Int32VectorWriter transcriptions_writer(transcriptions_wspecifier);
     Int32Writer edit_distance_writer(edit_distance_wspecifier);
@@ -256,138 +493,58 @@ int main(int argc, char *argv[]) {
         wildcards.emplace_back(wildcard_symbols_vec[i], 0);
     }
 
-    int32 n_done = 0, n_fail = 0;
-    int32 tot_correct = 0, tot_substitutions = 0,
-          tot_insertions = 0, tot_deletions = 0, tot_words = 0;
-
-    for (; !lattice_reader.Done(); lattice_reader.Next()) {
-      std::string key = lattice_reader.Key();
-      const Lattice &lat = lattice_reader.Value();
-      std::cerr << "Lattice " << key << " read." << std::endl;
-
-      // remove all weights while creating a standard FST
-      VectorFst<StdArc> lattice_fst;
-      ConvertLatticeToUnweightedAcceptor(lat, wildcards, &lattice_fst);
-      CheckFst(lattice_fst, "lattice_fst_", key);
-
-      // TODO: map certain symbols (using an FST created with CreateMapFst())
-      if (!reference_reader.HasKey(key)) {
-        KALDI_WARN << "No reference present for utterance " << key;
-        n_fail++;
-        continue;
-      }
-      const std::vector<int32> &reference = reference_reader.Value(key);
-      VectorFst<StdArc> reference_fst;
-      MakeLinearAcceptor(reference, &reference_fst);
-
-      // Remove any wildcards in reference.
-      fst::Relabel(&reference_fst, wildcards, wildcards);
-      CheckFst(reference_fst, "reference_fst_", key);
-
-      // recreate edit distance fst if necessary
-      fst::StdVectorFst edit_distance_fst;
-      CreateEditDistance(lattice_fst, reference_fst, &edit_distance_fst);
-
-      // compose with edit distance transducer
-      VectorFst<StdArc> edit_ref_fst;
-      fst::Compose(edit_distance_fst, reference_fst, &edit_ref_fst);
-      CheckFst(edit_ref_fst, "composed_", key);
-
-      // make sure composed FST is input sorted
-      fst::ArcSort(&edit_ref_fst, fst::StdILabelCompare());
-
-      // compose with previous result
-      VectorFst<StdArc> result_fst;
-      fst::Compose(lattice_fst, edit_ref_fst, &result_fst);
-      CheckFst(result_fst, "result_", key);
-
-      // find out best path
-      VectorFst<StdArc> best_path;
-      fst::ShortestPath(result_fst, &best_path);
-      CheckFst(best_path, "best_path_", key);
-
-      if (best_path.Start() == fst::kNoStateId) {
-        KALDI_WARN << "Best-path failed for key " << key;
-        n_fail++;
-      } else {
-        // count errors
-        int32 correct, substitutions, insertions, deletions, num_words;
-        CountErrors(best_path, &correct, &substitutions,
-                    &insertions, &deletions, &num_words);
-        int32 tot_errs = substitutions + insertions + deletions;
-        if (edit_distance_wspecifier != "")
-          edit_distance_writer.Write(key, tot_errs);
-        KALDI_LOG << "%WER " << (100.*tot_errs) / num_words << " [ " << tot_errs
-                  << " / " << num_words << ", " << insertions << " insertions, "
-                  << deletions << " deletions, " << substitutions << " sub ]";
-        tot_correct += correct;
-        tot_substitutions += substitutions;
-        tot_insertions += insertions;
-        tot_deletions += deletions;
-        tot_words += num_words;
-
-        std::vector<int32> oracle_words;
-        std::vector<int32> reference_words;
-        Weight weight;
-        GetLinearSymbolSequence(best_path, &oracle_words,
-                                &reference_words, &weight);
-        KALDI_LOG << "For utterance " << key << ", best cost " << weight;
-        if (transcriptions_wspecifier != "")
-          transcriptions_writer.Write(key, oracle_words);
-        if (word_syms != NULL) {
-          std::cerr << key << " (oracle) ";
-          for (size_t i = 0; i < oracle_words.size(); i++) {
-            std::string s = word_syms->Find(oracle_words[i]);
-            if (s == "")
-              KALDI_ERR << "Word-id " << oracle_words[i]
-                  << " not in symbol table.";
-            std::cerr << s << ' ';
-          }
-          std::cerr << '\n' << key << " (reference) ";
-          for (size_t i = 0; i < reference_words.size(); i++) {
-            std::string s = word_syms->Find(reference_words[i]);
-            if (s == "")
-              KALDI_ERR << "Word-id " << reference_words[i]
-                        << " not in symbol table.";
-            std::cerr << s << ' ';
-          }
-          std::cerr << '\n';
+    OracleStats stats(num_systems);
+    int32 n_no_ref = 0, n_missing = 0;
+    {
+      TaskSequencer<OracleTask> sequencer(sequencer_config);
+      for (; !lattice_reader.Done(); lattice_reader.Next()) {
+        std::string key = lattice_reader.Key();
+        std::cerr << "Lattice " << key << " read." << std::endl;
+
+        if (!reference_reader.HasKey(key)) {
+          KALDI_WARN << "No reference present for utterance " << key;
+          n_no_ref++;
+          continue;
         }
-
-        // If requested, write the lattice that only contains the oracle path.
-        if (lats_wspecifier != "") {
-          CompactLattice oracle_clat_mask;
-          MakeLinearAcceptor(oracle_words, &oracle_clat_mask);
-
-          CompactLattice clat;
-          CompactLattice oracle_clat;
-          ConvertLattice(lat, &clat);
-          fst::Relabel(&clat, wildcards, LabelPairVector());
-          fst::ArcSort(&clat, fst::ILabelCompare<CompactLatticeArc>());
-          fst::Compose(oracle_clat_mask, clat, &oracle_clat_mask);
-          fst::ShortestPath(oracle_clat_mask, &oracle_clat);
-          fst::Project(&oracle_clat, fst::PROJECT_OUTPUT);
-          TopSortCompactLatticeIfNeeded(&oracle_clat);
-
-          if (oracle_clat.Start() == fst::kNoStateId) {
-            KALDI_WARN << "Failed to find the oracle path in the original "
-                       << "lattice: " << key;
+        std::vector<Lattice*> lats(num_systems, NULL);
+        lats[0] = new Lattice(lattice_reader.Value());
+        lattice_reader.FreeCurrent();
+        for (int32 s = 1; s < num_systems; s++) {
+          if (other_lattice_readers[s - 1]->HasKey(key)) {
+            lats[s] = new Lattice(other_lattice_readers[s - 1]->Value(key));
           } else {
-            lats_writer.Write(key, oracle_clat);
+            KALDI_WARN << "No lattice found for utterance " << key << " for "
+                       << "system " << (s + 1);
+            n_missing++;
           }
         }
+        sequencer.Run(new OracleTask(key, reference_reader.Value(key),
+                                     wildcards, word_syms, lats,
+                                     &transcriptions_writer,
+                                     &edit_distance_writer, &lats_writer,
+                                     &stats));
       }
-      n_done++;
+      sequencer.Wait();
     }
     delete word_syms;
-    int32 tot_errs = tot_substitutions + tot_deletions + tot_insertions;
+    DeletePointers(&other_lattice_readers);
+    int32 tot_errs = stats.tot_substitutions + stats.tot_deletions +
+        stats.tot_insertions;
     // Warning: the script egs/s5/*/steps/oracle_wer.sh parses the next line.
-    KALDI_LOG << "Overall %WER " << (100.*tot_errs)/tot_words << " [ "
-              << tot_errs << " / " << tot_words << ", " << tot_insertions
-              << " insertions, " << tot_deletions << " deletions, "
-              << tot_substitutions << " substitutions ]";
-    KALDI_LOG << "Scored " << n_done << " lattices, " << n_fail
-              << " not present in ref.";
+    KALDI_LOG << "Overall %WER " << (100.*tot_errs)/stats.tot_words << " [ "
+              << tot_errs << " / " << stats.tot_words << ", "
+              << stats.tot_insertions << " insertions, "
+              << stats.tot_deletions << " deletions, "
+              << stats.tot_substitutions << " substitutions ]";
+    if (num_systems > 1) {
+      for (int32 s = 0; s < num_systems; s++)
+        KALDI_LOG << "System " << (s + 1) << " had the oracle path for "
+                  << stats.num_best[s] << " utterances.";
+      KALDI_LOG << n_missing << " lattices were missing for systems other "
+                << "than the first.";
+    }
+    KALDI_LOG << "Scored " << stats.n_done << " lattices, "
+              << (stats.n_fail + n_no_ref) << " not present in ref.";
   } catch(const std::exception &e) {
     std::cerr << e.what();
     return -1;
@@ -23,6 +23,34 @@
 #include "lat/sausages.h"
 #include <numeric>
 
+namespace kaldi {
+
+// Writes the ctm lines for one utterance; 'Mbr' is MinimumBayesRisk or
+// SegmentedMinimumBayesRisk.
+template<class Mbr>
+void WriteCtm(const std::string &key, const Mbr &mbr, BaseFloat frame_shift,
+              bool print_silence, std::ostream &os,
+              int32 *n_words, BaseFloat *tot_bayes_risk) {
+  const std::vector<BaseFloat> &conf = mbr.GetOneBestConfidences();
+  const std::vector<int32> &words = mbr.GetOneBest();
+  const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
+      mbr.GetOneBestTimes();
+  KALDI_ASSERT(conf.size() == words.size() && words.size() == times.size());
+  for (size_t i = 0; i < words.size(); i++) {
+    KALDI_ASSERT(words[i] != 0 || print_silence); // Should not have epsilons.
+    os << key << " 1 " << (frame_shift * times[i].first) << ' '
+       << (frame_shift * (times[i].second-times[i].first)) << ' '
+       << words[i] << ' ' << conf[i] << '\n';
+  }
+  KALDI_LOG << "For utterance " << key << ", Bayes Risk "
+            << mbr.GetBayesRisk() << ", avg. confidence per-word "
+            << std::accumulate(conf.begin(),conf.end(),0.0) / words.size();
+  *n_words += words.size();
+  *tot_bayes_risk += mbr.GetBayesRisk();
+}
+
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
@@ -75,6 +103,8 @@ int main(int argc, char *argv[]) {
 
     MinimumBayesRiskOptions mbr_opts;
     mbr_opts.Register(&po);
+    SegmentedMbrOptions segment_opts;
+    segment_opts.Register(&po);
 
     po.Read(argc, argv);
 
@@ -138,7 +168,13 @@ int main(int argc, char *argv[]) {
       MinimumBayesRisk *mbr = NULL;
 
       if (one_best_rspecifier == "") {
-        mbr = new MinimumBayesRisk(clat, mbr_opts);
+        // This is the same as MinimumBayesRisk unless --max-segment-length
+        // is set.
+        SegmentedMinimumBayesRisk segmented_mbr(clat, segment_opts, mbr_opts);
+        WriteCtm(key, segmented_mbr, frame_shift, mbr_opts.print_silence,
+                 ko.Stream(), &n_words, &tot_bayes_risk);
+        n_done++;
+        continue;
       } else {
         // check,
         if (!one_best_reader.HasKey(key)) {
@@ -161,23 +197,9 @@ int main(int argc, char *argv[]) {
         }
       }
 
-      const std::vector<BaseFloat> &conf = mbr->GetOneBestConfidences();
-      const std::vector<int32> &words = mbr->GetOneBest();
-      const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
-          mbr->GetOneBestTimes();
-      KALDI_ASSERT(conf.size() == words.size() && words.size() == times.size());
-      for (size_t i = 0; i < words.size(); i++) {
-        KALDI_ASSERT(words[i] != 0 || mbr_opts.print_silence); // Should not have epsilons.
-        ko.Stream() << key << " 1 " << (frame_shift * times[i].first) << ' '
-                    << (frame_shift * (times[i].second-times[i].first)) << ' '
-                    << words[i] << ' ' << conf[i] << '\n';
-      }
-      KALDI_LOG << "For utterance " << key << ", Bayes Risk "
-                << mbr->GetBayesRisk() << ", avg. confidence per-word "
-                << std::accumulate(conf.begin(),conf.end(),0.0) / words.size();
+      WriteCtm(key, *mbr, frame_shift, mbr_opts.print_silence, ko.Stream(),
+               &n_words, &tot_bayes_risk);
       n_done++;
-      n_words += mbr->GetOneBest().size();
-      tot_bayes_risk += mbr->GetBayesRisk();
       delete mbr;
     }
 
@@ -23,6 +23,41 @@
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
+#include "nnet3/batched-lattice-posteriors.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+
+// Does forward-backward on the lattices in "batch", writes the posteriors
+// and log-likes, and clears the batch.
+static void ProcessBatch(const std::vector<std::string> &keys,
+                         BatchedLatticePosteriors *batch,
+                         PosteriorWriter *posterior_writer,
+                         BaseFloatWriter *loglikes_writer,
+                         double *total_like, double *total_ac_like,
+                         double *total_time) {
+  batch->Compute();
+  for (size_t i = 0; i < keys.size(); i++) {
+    Posterior post;
+    double lat_ac_like;
+    batch->GetPosterior(i, &post, &lat_ac_like);
+    double lat_like = batch->TotalLogLike(i),
+        lat_time = post.size();
+    *total_like += lat_like;
+    *total_time += lat_time;
+    *total_ac_like += lat_ac_like;
+    KALDI_VLOG(2) << "Processed lattice for utterance: " << keys[i]
+                  << ". Average log-likelihood = " << (lat_like/lat_time)
+                  << " over " << lat_time << " frames.  Average acoustic "
+                  << "log-like per frame is " << (lat_ac_like/lat_time);
+    if (loglikes_writer->IsOpen())
+      loglikes_writer->Write(keys[i], lat_like);
+    posterior_writer->Write(keys[i], post);
+  }
+  batch->Clear();
+}
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -38,11 +73,17 @@ int main(int argc, char *argv[]) {
         "See also: lattice-to-ctm-conf, post-to-pdf-post, lattice-arc-post\n";
 
     kaldi::BaseFloat acoustic_scale = 1.0, lm_scale = 1.0;
+    int32 batch_size = 64;
+    std::string use_gpu = "no";
     kaldi::ParseOptions po(usage);
     po.Register("acoustic-scale", &acoustic_scale,
                 "Scaling factor for acoustic likelihoods");
     po.Register("lm-scale", &lm_scale,
                 "Scaling factor for \"graph costs\" (including LM costs)");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("batch-size", &batch_size,
+                "Number of lattices to process at once when using the GPU");
     po.Read(argc, argv);
 
     if (po.NumArgs() < 2 || po.NumArgs() > 3) {
@@ -57,6 +98,17 @@ int main(int argc, char *argv[]) {
         posteriors_wspecifier = po.GetArg(2),
         loglikes_wspecifier = po.GetOptArg(3);
 
+    KALDI_ASSERT(batch_size > 0);
+    // The forward-backward is only batched when using the GPU; on the CPU
+    // there is no advantage.
+    bool batched = false;
+#if HAVE_CUDA == 1
+    kaldi::CuDevice::Instantiate().SelectGpuId(use_gpu);
+    batched = kaldi::CuDevice::Instantiate().Enabled();
+#endif
+    kaldi::BatchedLatticePosteriors batch;
+    std::vector<std::string> batch_keys;
+
     // Read as regular lattice
     kaldi::SequentialLatticeReader lattice_reader(lats_rspecifier);
 
@@ -83,6 +135,18 @@ int main(int argc, char *argv[]) {
           KALDI_ERR << "Cycles detected in lattice.";
       }
 
+      if (batched) {
+        batch.AddLattice(lat);
+        batch_keys.push_back(key);
+        n_done++;
+        if (static_cast<int32>(batch_keys.size()) == batch_size) {
+          ProcessBatch(batch_keys, &batch, &posterior_writer, &loglikes_writer,
+                       &total_like, &total_ac_like, &total_time);
+          batch_keys.clear();
+        }
+        continue;
+      }
+
       kaldi::Posterior post;
       lat_like = kaldi::LatticeForwardBackward(lat, &post, &lat_ac_like);
       total_like += lat_like;
@@ -102,12 +166,18 @@ int main(int argc, char *argv[]) {
       posterior_writer.Write(key, post);
       n_done++;
     }
+    if (!batch_keys.empty())
+      ProcessBatch(batch_keys, &batch, &posterior_writer, &loglikes_writer,
+                   &total_like, &total_ac_like, &total_time);
 
     KALDI_LOG << "Overall average log-like/frame is "
               << (total_like/total_time) << " over " << total_time
               << " frames.  Average acoustic like/frame is "
               << (total_ac_like/total_time);
     KALDI_LOG << "Done " << n_done << " lattices.";
+#if HAVE_CUDA == 1
+    kaldi::CuDevice::Instantiate().PrintProfile();
+#endif
     return (n_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what();
@@ -22,6 +22,53 @@
 #include "util/common-utils.h"
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// This class computes the union of a pair of lattices and determinizes it in
+// operator (), which may run in a separate thread, and writes the output in
+// its destructor, which the TaskSequencer calls in the original order of the
+// lattices.
+class LatticeUnionTask {
+ public:
+  // Takes ownership of "lat1" and "lat2"; "lat2" may be NULL, in which case
+  // the output is the determinized "lat1".
+  LatticeUnionTask(const std::string &key, Lattice *lat1, Lattice *lat2,
+                   CompactLatticeWriter *clat_writer, int32 *num_done):
+      key_(key), lat1_(lat1), lat2_(lat2), clat_writer_(clat_writer),
+      num_done_(num_done) { }
+
+  void operator () () {
+    if (lat2_ != NULL)
+      Union(lat1_, *lat2_);
+    Invert(lat1_);  // so that word labels are on the input.
+    // The determinization obviates the need to convert to conpact lattice
+    // format using ConvertLattice(*lat1_, &clat_out_);
+    DeterminizeLattice(*lat1_, &clat_out_);
+    delete lat1_;  // These are no longer needed so we can delete them now.
+    lat1_ = NULL;
+    delete lat2_;
+    lat2_ = NULL;
+  }
+
+  ~LatticeUnionTask() {
+    delete lat1_;  // in case operator () was never called.
+    delete lat2_;
+    clat_writer_->Write(key_, clat_out_);
+    (*num_done_)++;
+  }
+
+ private:
+  std::string key_;
+  Lattice *lat1_;
+  Lattice *lat2_;
+  CompactLattice clat_out_;
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -40,6 +87,8 @@ int main(int argc, char *argv[]) {
         " e.g.: lattice-union ark:den.lats ark:num.lats ark:union.lats\n";
 
     ParseOptions po(usage);
+    TaskSequencerConfig sequencer_config; // has --num-threads option
+    sequencer_config.Register(&po);
     po.Read(argc, argv);
 
     if (po.NumArgs() != 3) {
@@ -58,28 +107,25 @@ int main(int argc, char *argv[]) {
 
     int32 n_done = 0, n_union = 0, n_no_lat = 0;
 
-    for (; !lattice_reader1.Done(); lattice_reader1.Next()) {
-      std::string key = lattice_reader1.Key();
-      Lattice lat1 = lattice_reader1.Value();
-      lattice_reader1.FreeCurrent();
-      if (lattice_reader2.HasKey(key)) {
-        const Lattice &lat2 = lattice_reader2.Value(key);
-        Union(&lat1, lat2);
-        n_union++;
-      } else {
-        KALDI_WARN << "No lattice found for utterance " << key << " in "
-                   << lats_rspecifier2 << ". Result of union will be the "
-                   << "lattice found in " << lats_rspecifier1;
-        n_no_lat++;
+    {
+      TaskSequencer<LatticeUnionTask> sequencer(sequencer_config);
+      for (; !lattice_reader1.Done(); lattice_reader1.Next()) {
+        std::string key = lattice_reader1.Key();
+        Lattice *lat1 = new Lattice(lattice_reader1.Value()), *lat2 = NULL;
+        lattice_reader1.FreeCurrent();
+        if (lattice_reader2.HasKey(key)) {
+          lat2 = new Lattice(lattice_reader2.Value(key));
+          n_union++;
+        } else {
+          KALDI_WARN << "No lattice found for utterance " << key << " in "
+                     << lats_rspecifier2 << ". Result of union will be the "
+                     << "lattice found in " << lats_rspecifier1;
+          n_no_lat++;
+        }
+        sequencer.Run(new LatticeUnionTask(key, lat1, lat2,
+                                           &compact_lattice_writer, &n_done));
       }
-
-      Invert(&lat1);  // so that word labels are on the input.
-      CompactLattice clat_out;
-      DeterminizeLattice(lat1, &clat_out);
-      // The determinization obviates the need to convert to conpact lattice
-      // format using ConvertLattice(lat1, &clat_out);
-      compact_lattice_writer.Write(key, clat_out);
-      n_done++;
+      sequencer.Wait();
     }
 
     KALDI_LOG << "Total " << n_done << "lattices written. Computed union for "
@@ -20,11 +20,14 @@
 
 #include <fst/fstlib.h>
 
+#include <algorithm>
+#include <memory>
 #include <sstream>
 
 #include "base/kaldi-error.h"
 #include "base/kaldi-math.h"
 #include "lm/arpa-file-parser.h"
+#include "util/kaldi-thread.h"
 #include "util/text-utils.h"
 
 namespace kaldi {
@@ -132,6 +135,18 @@ void ArpaFileParser::Read(std::istream &is) {
   NGram ngram;
   ngram.words.reserve(ngram_counts_.size());
 
+  // If we are using several threads, the n-gram lines are read in batches,
+  // which are parsed in parallel and then consumed in order.  Adding words to
+  // the symbol table is not thread-safe, so then we use one thread.
+  const size_t kLinesPerBatch = 10000;
+  std::unique_ptr<ThreadPool> pool;
+  if (options_.num_threads > 1 &&
+      !(symbols_ != NULL &&
+        options_.oov_handling == ArpaParseOptions::kAddToSymbols))
+    pool.reset(new ThreadPool(options_.num_threads));
+  std::vector<std::string> lines;
+  std::vector<int32> line_numbers;
+
   // Processes "\N-grams:" section.
   for (int32 cur_order = 1; cur_order <= ngram_counts_.size(); ++cur_order) {
     // Skips n-grams with zero count.
@@ -176,73 +191,18 @@ void ArpaFileParser::Read(std::istream &is) {
         }
       }
 
-      std::vector<std::string> col;
-      SplitStringToVector(current_line_, " \t", true, &col);
-
-      if (col.size() < 1 + cur_order ||
-          col.size() > 2 + cur_order ||
-          (cur_order == ngram_counts_.size() && col.size() != 1 + cur_order)) {
-        PARSE_ERR << "Invalid n-gram data line";
-      }
       ++ngram_count;
-
-      // Parse out n-gram logprob and, if present, backoff weight.
-      if (!ConvertStringToReal(col[0], &ngram.logprob)) {
-        PARSE_ERR << "invalid n-gram logprob '" << col[0] << "'";
-      }
-      ngram.backoff = 0.0;
-      if (col.size() > cur_order + 1) {
-        if (!ConvertStringToReal(col[cur_order + 1], &ngram.backoff))
-          PARSE_ERR << "invalid backoff weight '" << col[cur_order + 1] << "'";
-      }
-      // Convert to natural log.
-      ngram.logprob *= M_LN10;
-      ngram.backoff *= M_LN10;
-
-      ngram.words.resize(cur_order);
-      bool skip_ngram = false;
-      for (int32 index = 0; !skip_ngram && index < cur_order; ++index) {
-        int32 word;
-        if (symbols_) {
-          // Symbol table provided, so symbol labels are expected.
-          if (options_.oov_handling == ArpaParseOptions::kAddToSymbols) {
-            word = symbols_->AddSymbol(col[1 + index]);
-          } else {
-            word = symbols_->Find(col[1 + index]);
-            if (word == -1) { // fst::kNoSymbol
-              switch (options_.oov_handling) {
-                case ArpaParseOptions::kReplaceWithUnk:
-                  word = options_.unk_symbol;
-                  break;
-                case ArpaParseOptions::kSkipNGram:
-                  if (ShouldWarn())
-                    KALDI_WARN << LineReference() << " skipped: word '"
-                               << col[1 + index] << "' not in symbol table";
-                  skip_ngram = true;
-                  break;
-                default:
-                  PARSE_ERR << "word '"  << col[1 + index]
-                            << "' not in symbol table";
-              }
-            }
-          }
-        } else {
-          // Symbols not provided, LM file should contain integers.
-          if (!ConvertStringToInteger(col[1 + index], &word) || word < 0) {
-            PARSE_ERR << "invalid symbol '" << col[1 + index] << "'";
-          }
-        }
-        // Whichever way we got it, an epsilon is invalid.
-        if (word == 0) {
-          PARSE_ERR << "epsilon symbol '" << col[1 + index]
-                    << "' is illegal in ARPA LM";
-        }
-        ngram.words[index] = word;
-      }
-      if (!skip_ngram) {
-        ConsumeNGram(ngram);
+      if (pool == NULL) {
+        ProcessNGramLine(cur_order, &ngram);
+      } else {
+        lines.push_back(current_line_);
+        line_numbers.push_back(line_number_);
+        if (lines.size() >= kLinesPerBatch * options_.num_threads)
+          ProcessNGramLines(cur_order, pool.get(), &lines, &line_numbers);
       }
     }
+    if (pool != NULL)
+      ProcessNGramLines(cur_order, pool.get(), &lines, &line_numbers);
     if (ngram_count > ngram_counts_[cur_order - 1]) {
       PARSE_ERR << "header said there would be " << ngram_counts_[cur_order - 1]
                 << " n-grams of order " << cur_order
@@ -267,6 +227,142 @@ void ArpaFileParser::Read(std::istream &is) {
 #undef PARSE_ERR
 }
 
+ArpaFileParser::ParseStatus ArpaFileParser::ParseNGram(
+    const std::string &line, int32 order, NGram *ngram,
+    std::string *message) const {
+  std::vector<std::string> col;
+  SplitStringToVector(line, " \t", true, &col);
+
+  if (col.size() < 1 + order ||
+      col.size() > 2 + order ||
+      (order == ngram_counts_.size() && col.size() != 1 + order)) {
+    *message = "Invalid n-gram data line";
+    return kNGramError;
+  }
+
+  // Parse out n-gram logprob and, if present, backoff weight.
+  if (!ConvertStringToReal(col[0], &ngram->logprob)) {
+    *message = "invalid n-gram logprob '" + col[0] + "'";
+    return kNGramError;
+  }
+  ngram->backoff = 0.0;
+  if (col.size() > order + 1) {
+    if (!ConvertStringToReal(col[order + 1], &ngram->backoff)) {
+      *message = "invalid backoff weight '" + col[order + 1] + "'";
+      return kNGramError;
+    }
+  }
+  // Convert to natural log.
+  ngram->logprob *= M_LN10;
+  ngram->backoff *= M_LN10;
+
+  ngram->words.resize(order);
+  for (int32 index = 0; index < order; ++index) {
+    int32 word;
+    if (symbols_) {
+      // Symbol table provided, so symbol labels are expected.
+      if (options_.oov_handling == ArpaParseOptions::kAddToSymbols) {
+        word = symbols_->AddSymbol(col[1 + index]);
+      } else {
+        word = symbols_->Find(col[1 + index]);
+        if (word == -1) { // fst::kNoSymbol
+          switch (options_.oov_handling) {
+            case ArpaParseOptions::kReplaceWithUnk:
+              word = options_.unk_symbol;
+              break;
+            case ArpaParseOptions::kSkipNGram:
+              *message = col[1 + index];
+              return kNGramSkipped;
+            default:
+              *message = "word '" + col[1 + index] + "' not in symbol table";
+              return kNGramError;
+          }
+        }
+      }
+    } else {
+      // Symbols not provided, LM file should contain integers.
+      if (!ConvertStringToInteger(col[1 + index], &word) || word < 0) {
+        *message = "invalid symbol '" + col[1 + index] + "'";
+        return kNGramError;
+      }
+    }
+    // Whichever way we got it, an epsilon is invalid.
+    if (word == 0) {
+      *message = "epsilon symbol '" + col[1 + index] +
+          "' is illegal in ARPA LM";
+      return kNGramError;
+    }
+    ngram->words[index] = word;
+  }
+  return kNGramOk;
+}
+
+void ArpaFileParser::ProcessNGramLine(int32 order, NGram *ngram) {
+  std::string message;
+  switch (ParseNGram(current_line_, order, ngram, &message)) {
+    case kNGramOk:
+      ConsumeNGram(*ngram);
+      break;
+    case kNGramSkipped:
+      if (ShouldWarn())
+        KALDI_WARN << LineReference() << " skipped: word '"
+                   << message << "' not in symbol table";
+      break;
+    default:
+      KALDI_ERR << LineReference() << ": " << message;
+  }
+}
+
+void ArpaFileParser::ProcessNGramLines(int32 order, ThreadPool *pool,
+                                       std::vector<std::string> *lines,
+                                       std::vector<int32> *line_numbers) {
+  size_t num_lines = lines->size();
+  if (num_lines == 0)
+    return;
+  std::vector<NGram> ngrams(num_lines);
+  std::vector<ParseStatus> status(num_lines);
+  std::vector<std::string> messages(num_lines);
+  size_t num_tasks = pool->NumThreads(),
+      block_size = (num_lines + num_tasks - 1) / num_tasks;
+  for (size_t begin = 0; begin < num_lines; begin += block_size) {
+    size_t end = std::min(begin + block_size, num_lines);
+    pool->Submit([this, order, begin, end, lines, &ngrams, &status,
+                  &messages]() {
+      for (size_t i = begin; i < end; i++)
+        status[i] = ParseNGram((*lines)[i], order, &(ngrams[i]),
+                               &(messages[i]));
+    });
+  }
+  pool->Wait();
+
+  // Consume the n-grams in order, making LineNumber() and LineReference()
+  // refer to the line of each one.  At exit, current_line_ and line_number_
+  // will refer to the line after the batch, as they did on entry.
+  std::string next_line;
+  next_line.swap(current_line_);
+  int32 next_line_number = line_number_;
+  for (size_t i = 0; i < num_lines; i++) {
+    current_line_.swap((*lines)[i]);
+    line_number_ = (*line_numbers)[i];
+    switch (status[i]) {
+      case kNGramOk:
+        ConsumeNGram(ngrams[i]);
+        break;
+      case kNGramSkipped:
+        if (ShouldWarn())
+          KALDI_WARN << LineReference() << " skipped: word '"
+                     << messages[i] << "' not in symbol table";
+        break;
+      default:
+        KALDI_ERR << LineReference() << ": " << messages[i];
+    }
+  }
+  current_line_.swap(next_line);
+  line_number_ = next_line_number;
+  lines->clear();
+  line_numbers->clear();
+}
+
 std::string ArpaFileParser::LineReference() const {
   std::ostringstream ss;
   ss << "line " << line_number_ << " [" << current_line_ << "]";
@@ -31,6 +31,8 @@
 
 namespace kaldi {
 
+class ThreadPool;
+
 /**
   Options that control ArpaFileParser
 */
@@ -44,7 +46,7 @@ struct ArpaParseOptions {
 
   ArpaParseOptions():
       bos_symbol(-1), eos_symbol(-1), unk_symbol(-1),
-      oov_handling(kRaiseError), max_warnings(30) { }
+      oov_handling(kRaiseError), max_warnings(30), num_threads(1) { }
 
   void Register(OptionsItf *opts) {
     // Registering only the max_warnings count, since other options are
@@ -53,6 +55,11 @@ struct ArpaParseOptions {
     opts->Register("max-arpa-warnings", &max_warnings,
                    "Maximum warnings to report on ARPA parsing, "
                    "0 to disable, -1 to show all");
+    opts->Register("num-threads", &num_threads,
+                   "Number of threads used to parse the n-gram lines of the "
+                   "ARPA file (the n-grams are still processed in file "
+                   "order).  Not used when words are added to the symbol "
+                   "table.");
   }
 
   int32 bos_symbol;  ///< Symbol for <s>, Required non-epsilon.
@@ -60,6 +67,7 @@ struct ArpaParseOptions {
   int32 unk_symbol;  ///< Symbol for <unk>, Required for kReplaceWithUnk.
   OovHandling oov_handling;  ///< How to handle OOV words in the file.
   int32 max_warnings;  ///< Maximum warnings to report, <0 unlimited.
+  int32 num_threads;  ///< Number of threads for parsing n-gram lines.
 };
 
 /**
@@ -133,6 +141,32 @@ class ArpaFileParser {
   const std::vector<int32>& NgramCounts() const { return ngram_counts_; }
 
  private:
+  // The result of parsing an n-gram line.
+  enum ParseStatus {
+    kNGramOk,       // The n-gram was parsed.
+    kNGramSkipped,  // The n-gram has an OOV word and is to be skipped.
+    kNGramError     // The line is invalid.
+  };
+
+  // Parses the n-gram line 'line' of order 'order' into 'ngram'.  If the
+  // n-gram is skipped, sets *message to the OOV word; if there is an error,
+  // sets *message to its description.  This does not change the state of
+  // this object, so it may be called from several threads at once unless
+  // words are being added to the symbol table.
+  ParseStatus ParseNGram(const std::string &line, int32 order,
+                         NGram *ngram, std::string *message) const;
+
+  // Parses current_line_, which is an n-gram line of order 'order', and gives
+  // the n-gram to ConsumeNGram() unless it is to be skipped.
+  void ProcessNGramLine(int32 order, NGram *ngram);
+
+  // Parses the n-gram lines 'lines' of order 'order', with line numbers
+  // 'line_numbers', in parallel on 'pool', and then gives the n-grams to
+  // ConsumeNGram() in order.  Clears 'lines' and 'line_numbers'.
+  void ProcessNGramLines(int32 order, ThreadPool *pool,
+                         std::vector<std::string> *lines,
+                         std::vector<int32> *line_numbers);
+
   ArpaParseOptions options_;
   fst::SymbolTable* symbols_;  // the pointer is not owned here.
   int32 line_number_;
@@ -139,6 +139,17 @@ ArpaLmCompilerImpl<HistKey>::ArpaLmCompilerImpl(
     ArpaLmCompiler* parent, fst::StdVectorFst* fst, Symbol sub_eps)
     : parent_(parent), fst_(fst), bos_symbol_(parent->Options().bos_symbol),
       eos_symbol_(parent->Options().eos_symbol), sub_eps_(sub_eps) {
+  // There is about one state (and history) per n-gram of less than the
+  // highest order.  Reserving space for them up front avoids the temporary
+  // doubling of memory when the state vector and the hash table grow, which
+  // dominates the peak memory for large models.
+  const std::vector<int32> &ngram_counts = parent->NgramCounts();
+  size_t num_histories = 1;
+  for (size_t i = 0; i + 1 < ngram_counts.size(); i++)
+    num_histories += ngram_counts[i];
+  history_.reserve(num_histories);
+  fst_->ReserveStates(num_histories + 2);
+
   // The algorithm maintains state per history. The 0-gram is a special state
   // for empty history. All unigrams (including BOS) backoff into this state.
   StateId zerogram = fst_->AddState();
@@ -368,6 +379,9 @@ void ArpaLmCompiler::Check() const {
 }
 
 void ArpaLmCompiler::ReadComplete() {
+  // The history map is no longer needed; free it before the epsilon removal.
+  delete impl_;
+  impl_ = NULL;
   fst_.SetInputSymbols(Symbols());
   fst_.SetOutputSymbols(Symbols());
   RemoveRedundantStates();
@@ -0,0 +1,188 @@
+// lm/const-arpa-lm-test.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-math.h"
+#include "lm/const-arpa-lm.h"
+#include "util/kaldi-io.h"
+
+namespace kaldi {
+
+static const int32 kBos = 1, kEos = 2;
+
+// Returns a random logprob from a small set, so that values are repeated as in
+// real LMs.
+static std::string RandomLogprob() {
+  std::ostringstream os;
+  os << std::fixed << std::setprecision(5) << -RandInt(0, 5000) / 1000.0;
+  return os.str();
+}
+
+// Writes a random ARPA LM with integer words 1 through num_words, <s> = 1 and
+// </s> = 2, to "filename".  Each n-gram of order > 1 has its history in the
+// LM, as in a real ARPA file.
+static void WriteRandomArpa(int32 ngram_order, int32 num_words,
+                            const std::string &filename) {
+  // ngrams[n] contains the n-grams of order n + 1.
+  std::vector<std::set<std::vector<int32> > > ngrams(ngram_order);
+  for (int32 w = 1; w <= num_words; w++)
+    ngrams[0].insert(std::vector<int32>(1, w));
+  for (int32 n = 1; n < ngram_order; n++) {
+    std::vector<std::vector<int32> > histories(ngrams[n - 1].begin(),
+                                               ngrams[n - 1].end());
+    for (int32 i = 0; i < 3 * num_words && !histories.empty(); i++) {
+      std::vector<int32> ngram = histories[RandInt(0, histories.size() - 1)];
+      if (ngram.back() == kEos)
+        continue;
+      int32 word = RandInt(1, num_words);
+      if (word == kBos)
+        continue;
+      // <s> can only appear at the start.
+      bool ok = true;
+      for (size_t j = 1; j < ngram.size(); j++)
+        if (ngram[j] == kBos) ok = false;
+      if (!ok)
+        continue;
+      ngram.push_back(word);
+      ngrams[n].insert(ngram);
+    }
+  }
+  // If there happen to be no n-grams of some order, the LM has a lower order.
+  while (ngrams.back().empty())
+    ngrams.pop_back();
+  ngram_order = ngrams.size();
+
+  Output ko(filename, false);
+  std::ostream &os = ko.Stream();
+  os << "\\data\\\n";
+  for (int32 n = 0; n < ngram_order; n++)
+    os << "ngram " << (n + 1) << "=" << ngrams[n].size() << "\n";
+  for (int32 n = 0; n < ngram_order; n++) {
+    os << "\n\\" << (n + 1) << "-grams:\n";
+    std::set<std::vector<int32> >::const_iterator iter = ngrams[n].begin();
+    for (; iter != ngrams[n].end(); ++iter) {
+      os << RandomLogprob();
+      for (size_t j = 0; j < iter->size(); j++)
+        os << (j == 0 ? "\t" : " ") << (*iter)[j];
+      // Some backoffs are exactly zero, which the compact format treats
+      // specially.
+      if (n + 1 < ngram_order && RandInt(0, 3) != 0)
+        os << "\t" << (RandInt(0, 2) == 0 ? "0.0" : RandomLogprob());
+      os << "\n";
+    }
+  }
+  os << "\n\\end\\\n";
+}
+
+// Checks that lm1 and lm2 give the same logprobs for random n-grams, to
+// within "relative_tolerance", and agree on which histories exist.
+static void CheckSameLm(int32 num_words, const ConstArpaLm &lm1,
+                        const ConstArpaLm &lm2, float relative_tolerance) {
+  KALDI_ASSERT(lm1.NgramOrder() == lm2.NgramOrder() &&
+               lm1.BosSymbol() == lm2.BosSymbol() &&
+               lm1.EosSymbol() == lm2.EosSymbol());
+  for (int32 i = 0; i < 1000; i++) {
+    std::vector<int32> hist(RandInt(0, lm1.NgramOrder() - 1));
+    for (size_t j = 0; j < hist.size(); j++)
+      hist[j] = RandInt(1, num_words);
+    if (!hist.empty() && RandInt(0, 1) == 0)
+      hist[0] = kBos;
+    int32 word = RandInt(1, num_words);
+    KALDI_ASSERT(ApproxEqual(lm1.GetNgramLogprob(word, hist),
+                             lm2.GetNgramLogprob(word, hist),
+                             relative_tolerance));
+    KALDI_ASSERT(lm1.HistoryStateExists(hist) ==
+                 lm2.HistoryStateExists(hist));
+  }
+}
+
+static void ReadLm(const std::string &filename, ConstArpaLm *lm) {
+  bool binary;
+  Input ki(filename, &binary);
+  lm->Read(ki.Stream(), binary);
+}
+
+// Checks that the compact format gives the same results as the standard one.
+// With 16-bit quantization the codebooks can hold all the distinct values of
+// this small LM, so nothing is lost by quantizing; the only difference is that
+// the standard format clears the lowest bit of the logprobs of the n-grams
+// that have no children (see DecodeChildInfo()), so we allow a difference of a
+// few units in the last place.
+void UnitTestCompactConstArpaLm() {
+  int32 ngram_order = RandInt(1, 4), num_words = RandInt(3, 30);
+  WriteRandomArpa(ngram_order, num_words, "tmp.arpa");
+  ArpaParseOptions options;
+  options.bos_symbol = kBos;
+  options.eos_symbol = kEos;
+  KALDI_ASSERT(BuildConstArpaLm(options, 0, "tmp.arpa", "tmp.carpa"));
+  KALDI_ASSERT(BuildConstArpaLm(options, 16, "tmp.arpa", "tmp.compact"));
+
+  ConstArpaLm lm, compact_lm;
+  ReadLm("tmp.carpa", &lm);
+  ReadLm("tmp.compact", &compact_lm);
+  KALDI_ASSERT(!lm.IsCompact() && compact_lm.IsCompact());
+  CheckSameLm(num_words, lm, compact_lm, 1.0e-06);
+
+  unlink("tmp.arpa");
+  unlink("tmp.carpa");
+  unlink("tmp.compact");
+}
+
+// Checks that ReadMmap() gives the same LM as Read(), for both formats.
+void UnitTestConstArpaLmMmap() {
+  int32 ngram_order = RandInt(1, 4), num_words = RandInt(3, 30);
+  WriteRandomArpa(ngram_order, num_words, "tmp.arpa");
+  ArpaParseOptions options;
+  options.bos_symbol = kBos;
+  options.eos_symbol = kEos;
+  int32 quantize_bits = (RandInt(0, 1) == 0 ? 0 : 8 * RandInt(1, 2));
+  KALDI_ASSERT(BuildConstArpaLm(options, quantize_bits, "tmp.arpa",
+                                "tmp.carpa"));
+
+  ConstArpaLm lm, mapped_lm;
+  ReadLm("tmp.carpa", &lm);
+  mapped_lm.ReadMmap("tmp.carpa");
+  KALDI_ASSERT(!lm.IsMapped() && (mapped_lm.IsMapped() ||
+                                  (lm.IsCompact() && lm.NgramOrder() == 1)));
+  KALDI_ASSERT(lm.IsCompact() == (quantize_bits != 0) &&
+               mapped_lm.IsCompact() == lm.IsCompact());
+  CheckSameLm(num_words, lm, mapped_lm, 0.0);
+
+  unlink("tmp.arpa");
+  unlink("tmp.carpa");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++) {
+    UnitTestCompactConstArpaLm();
+    UnitTestConstArpaLmMmap();
+  }
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -18,6 +18,7 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
 #include <sstream>
 #include <utility>
@@ -49,6 +50,81 @@ struct ArpaLine {
   }
 };
 
+// Extends the hash <h> of a word sequence by prepending <word> to the sequence.
+// In the compact format we hash n-grams starting from the last word, so that
+// for backoff the hashes of "C", "B C", "A B C" can be computed incrementally;
+// the hash of the empty sequence is zero.
+static inline uint64 CompactHashExtend(uint64 h, int32 word) {
+  h ^= static_cast<uint64>(static_cast<uint32>(word)) + 0x9e3779b97f4a7c15ULL
+      + (h << 6) + (h >> 2);
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// Works out, from the hash of an n-gram, the bucket in a compact table with
+// <num_buckets> buckets where we start looking for it, and its 31-bit nonzero
+// fingerprint.
+static inline void CompactHashLocation(uint64 h, int64 num_buckets,
+                                       int64 *bucket, uint32 *fingerprint) {
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 29;
+  *bucket = static_cast<int64>(((h & 0xffffffffULL) *
+                                static_cast<uint64>(num_buckets)) >> 32);
+  *fingerprint = static_cast<uint32>(h >> 33);
+  if (*fingerprint == 0) *fingerprint = 1;
+}
+
+// The top bit of a fingerprint word in the compact format, which says whether
+// the n-gram has children.
+static const uint32 kCompactHasChildren = 0x80000000u;
+
+// Given values (which will be sorted), creates a sorted codebook of at most
+// <num_codes> values for quantizing them: if there are no more than
+// <num_codes> distinct values we just use them, otherwise we split the sorted
+// values into <num_codes> bins with equal numbers of values and use the mean
+// of each bin.
+static void MakeCodebook(std::vector<float> *values, int32 num_codes,
+                         std::vector<float> *codebook) {
+  KALDI_ASSERT(num_codes > 0);
+  codebook->clear();
+  std::sort(values->begin(), values->end());
+  if (values->empty()) {
+    codebook->push_back(0.0);
+    return;
+  }
+  std::vector<float> distinct(*values);
+  distinct.erase(std::unique(distinct.begin(), distinct.end()),
+                 distinct.end());
+  if (distinct.size() <= static_cast<size_t>(num_codes)) {
+    codebook->swap(distinct);
+    return;
+  }
+  int64 num_values = values->size();
+  for (int32 b = 0; b < num_codes; b++) {
+    int64 begin = num_values * b / num_codes,
+        end = num_values * (b + 1) / num_codes;
+    if (begin == end) continue;
+    double sum = 0.0;
+    for (int64 i = begin; i < end; i++)
+      sum += (*values)[i];
+    codebook->push_back(sum / (end - begin));
+  }
+}
+
+// Returns the index of the closest entry to <value> among the entries of the
+// codebook starting from <begin>, which must be sorted.
+static int32 QuantizeValue(const std::vector<float> &codebook, int32 begin,
+                           float value) {
+  KALDI_ASSERT(begin < static_cast<int32>(codebook.size()));
+  std::vector<float>::const_iterator first = codebook.begin() + begin,
+      iter = std::lower_bound(first, codebook.end(), value);
+  if (iter == codebook.end()) return codebook.size() - 1;
+  if (iter != first && value - *(iter - 1) < *iter - value)
+    --iter;
+  return iter - codebook.begin();
+}
+
 // Auxiliary class to build ConstArpaLm. We first use this class to figure out
 // the relative address of different LmStates, and then put everything into one
 // block in memory.
@@ -176,8 +252,11 @@ class LmState {
 // auxiliary class LmState above.
 class ConstArpaLmBuilder : public ArpaFileParser {
  public:
-  explicit ConstArpaLmBuilder(ArpaParseOptions options)
-      : ArpaFileParser(options, NULL) {
+  ConstArpaLmBuilder(ArpaParseOptions options, int32 quantize_bits)
+      : ArpaFileParser(options, NULL), quantize_bits_(quantize_bits) {
+    if (quantize_bits_ != 0 && quantize_bits_ != 8 && quantize_bits_ != 16)
+      KALDI_ERR << "Invalid value " << quantize_bits_ << " for quantize-bits; "
+                << "expected 0, 8 or 16.";
     ngram_order_ = 0;
     num_words_ = 0;
     overflow_buffer_size_ = 0;
@@ -218,6 +297,15 @@ class ConstArpaLmBuilder : public ArpaFileParser {
   virtual void ReadComplete();
 
  private:
+  // Builds <compact_lm_>, the compact format of the language model, from
+  // <seq_to_state_>; used instead of the rest of ReadComplete() if
+  // <quantize_bits_> is nonzero.
+  void BuildCompact();
+
+  // Adds an n-gram to the hash table of its order in <compact_lm_>.
+  void AddCompactEntry(const std::vector<int32> &words, float logprob,
+                       float backoff_logprob, bool has_children);
+
   struct WordsAndLmStatePairLessThan {
     bool operator()(
         const std::pair<std::vector<int32>*, LmState*>& lhs,
@@ -262,6 +350,17 @@ class ConstArpaLmBuilder : public ArpaFileParser {
   // Hash table from word sequences to LmStates.
   unordered_map<std::vector<int32>,
                 LmState*, VectorHasher<int32> > seq_to_state_;
+
+  // Number of bits of the quantized logprobs in the compact format, or 0 if we
+  // are building the normal format.
+  int32 quantize_bits_;
+
+  // The language model in the compact format, if <quantize_bits_> is nonzero.
+  ConstArpaLm compact_lm_;
+
+  // Number of n-grams that we added to the compact format whose fingerprint
+  // was already present in their probe sequence, which makes them unreachable.
+  int64 num_compact_collisions_;
 };
 
 void ConstArpaLmBuilder::HeaderAvailable() {
@@ -354,6 +453,12 @@ void ConstArpaLmBuilder::ConsumeNGram(const NGram &ngram) {
 //    <unigram_states_>
 //    <overflow_buffer_>
 void ConstArpaLmBuilder::ReadComplete() {
+  if (quantize_bits_ != 0) {
+    BuildCompact();
+    is_built_ = true;
+    return;
+  }
+
   // STEP 1: sorting LmStates lexicographically.
   // Vector for holding the sorted LmStates.
   std::vector<std::pair<std::vector<int32>*, LmState*> > sorted_vec;
@@ -480,11 +585,193 @@ void ConstArpaLmBuilder::ReadComplete() {
   is_built_ = true;
 }
 
+void ConstArpaLmBuilder::BuildCompact() {
+  ConstArpaLm &lm = compact_lm_;
+  lm.bos_symbol_ = Options().bos_symbol;
+  lm.eos_symbol_ = Options().eos_symbol;
+  lm.unk_symbol_ = Options().unk_symbol;
+  lm.ngram_order_ = ngram_order_;
+  lm.num_words_ = num_words_;
+  lm.quantize_bits_ = quantize_bits_;
+  lm.compact_ = true;
+  KALDI_ASSERT(ngram_order_ > 0);
+  KALDI_ASSERT(lm.bos_symbol_ < num_words_ && lm.bos_symbol_ > 0);
+  KALDI_ASSERT(lm.eos_symbol_ < num_words_ && lm.eos_symbol_ > 0);
+  KALDI_ASSERT(lm.unk_symbol_ < num_words_ &&
+               (lm.unk_symbol_ > 0 || lm.unk_symbol_ == -1));
+
+  // STEP 1: filling in the unigrams, and collecting the logprobs and nonzero
+  // backoff logprobs of the higher orders for the codebooks. The n-grams of
+  // the highest order are children of the LmStates of order
+  // (ngram_order_ - 1) and do not have LmStates themselves.
+  lm.unigram_logprobs_.resize(num_words_, 0.0);
+  lm.unigram_backoffs_.resize(num_words_, 0.0);
+  lm.unigram_flags_.resize(num_words_, 0);
+  std::vector<int64> counts(ngram_order_ + 1, 0);
+  std::vector<std::vector<float> > logprobs(ngram_order_ + 1),
+      backoffs(ngram_order_ + 1);
+  unordered_map<std::vector<int32>,
+                LmState*, VectorHasher<int32> >::const_iterator iter;
+  for (iter = seq_to_state_.begin(); iter != seq_to_state_.end(); ++iter) {
+    const LmState *state = iter->second;
+    int32 order = iter->first.size();
+    if (order == 1) {
+      int32 word = iter->first[0];
+      lm.unigram_logprobs_[word] = state->Logprob();
+      lm.unigram_backoffs_[word] = state->BackoffLogprob();
+      lm.unigram_flags_[word] = ConstArpaLm::kUnigramExists |
+          (state->NumChildren() > 0 ? ConstArpaLm::kUnigramHasChildren : 0);
+    } else {
+      counts[order]++;
+      logprobs[order].push_back(state->Logprob());
+      if (state->BackoffLogprob() != 0.0)
+        backoffs[order].push_back(state->BackoffLogprob());
+    }
+    if (state->IsChildFinalOrder()) {
+      LmState *nonconst_state = iter->second;
+      for (int32 j = 0; j < state->NumChildren(); ++j) {
+        counts[ngram_order_]++;
+        logprobs[ngram_order_].push_back(
+            nonconst_state->GetChild(j).second.prob);
+      }
+    }
+  }
+
+  // STEP 2: creating the codebooks. Backoff code zero is reserved for a
+  // backoff of exactly zero, which is what most n-grams have.
+  int32 num_codes = 1 << quantize_bits_;
+  lm.prob_codebooks_.resize(ngram_order_ + 1);
+  lm.backoff_codebooks_.resize(ngram_order_ + 1);
+  for (int32 order = 2; order <= ngram_order_; order++) {
+    MakeCodebook(&(logprobs[order]), num_codes,
+                 &(lm.prob_codebooks_[order]));
+    std::vector<float>().swap(logprobs[order]);
+    if (order < ngram_order_) {
+      std::vector<float> codebook;
+      MakeCodebook(&(backoffs[order]), num_codes - 1, &codebook);
+      lm.backoff_codebooks_[order].push_back(0.0);
+      lm.backoff_codebooks_[order].insert(lm.backoff_codebooks_[order].end(),
+                                          codebook.begin(), codebook.end());
+      std::vector<float>().swap(backoffs[order]);
+    }
+  }
+
+  // STEP 3: allocating the hash tables. We aim for a load factor of 0.8.
+  const BaseFloat load_factor = 0.8;
+  lm.compact_tables_.resize(ngram_order_ + 1);
+  int64 offset = 0;
+  for (int32 order = 2; order <= ngram_order_; order++) {
+    lm.SetCompactTableLayout(order, 1, 0);
+    int32 entries_per_bucket = lm.compact_tables_[order].entries_per_bucket;
+    int64 num_buckets = static_cast<int64>(
+        counts[order] / (entries_per_bucket * load_factor)) + 1;
+    KALDI_ASSERT(num_buckets < (static_cast<int64>(1) << 32));
+    lm.SetCompactTableLayout(order, num_buckets, offset);
+    offset += num_buckets * ConstArpaLm::kCompactBucketSize;
+  }
+  lm.compact_data_size_ = offset;
+  if (offset > 0) {
+    void *data;
+    if (!KALDI_MEMALIGN(ConstArpaLm::kCompactBucketSize, offset, &data))
+      KALDI_ERR << "Failed to allocate " << offset << " bytes for the compact "
+                << "ConstArpaLm.";
+    lm.compact_data_ = static_cast<char*>(data);
+    memset(lm.compact_data_, 0, offset);
+  }
+
+  // STEP 4: inserting the n-grams.
+  num_compact_collisions_ = 0;
+  for (iter = seq_to_state_.begin(); iter != seq_to_state_.end(); ++iter) {
+    const LmState *state = iter->second;
+    if (iter->first.size() > 1)
+      AddCompactEntry(iter->first, state->Logprob(), state->BackoffLogprob(),
+                      state->NumChildren() > 0);
+    if (state->IsChildFinalOrder()) {
+      LmState *nonconst_state = iter->second;
+      std::vector<int32> words(iter->first);
+      words.push_back(0);
+      for (int32 j = 0; j < state->NumChildren(); ++j) {
+        std::pair<int32, LmState::ChildType> child =
+            nonconst_state->GetChild(j);
+        words.back() = child.first;
+        AddCompactEntry(words, child.second.prob, 0.0, false);
+      }
+    }
+  }
+  if (num_compact_collisions_ > 0)
+    KALDI_WARN << num_compact_collisions_ << " n-grams have the same "
+               << "fingerprint as another n-gram and will not be found in "
+               << "lookups.";
+  KALDI_LOG << "The hash tables of the compact ConstArpaLm take "
+            << lm.compact_data_size_ << " bytes.";
+  lm.memory_assigned_ = false;
+  lm.initialized_ = true;
+}
+
+void ConstArpaLmBuilder::AddCompactEntry(const std::vector<int32> &words,
+                                         float logprob,
+                                         float backoff_logprob,
+                                         bool has_children) {
+  ConstArpaLm &lm = compact_lm_;
+  int32 order = words.size();
+  KALDI_ASSERT(order >= 2 && order <= ngram_order_);
+  const ConstArpaLm::CompactTable &table = lm.compact_tables_[order];
+  uint64 hash = 0;
+  for (int32 i = order - 1; i >= 0; --i)
+    hash = CompactHashExtend(hash, words[i]);
+  int64 bucket_index;
+  uint32 fingerprint;
+  CompactHashLocation(hash, table.num_buckets, &bucket_index, &fingerprint);
+
+  // Linear probing for an empty slot; the load factor ensures there is one.
+  char *data = lm.compact_data_ + table.offset;
+  while (true) {
+    char *bucket = data + bucket_index * ConstArpaLm::kCompactBucketSize;
+    uint32 *fingerprints = reinterpret_cast<uint32*>(bucket);
+    for (int32 slot = 0; slot < table.entries_per_bucket; ++slot) {
+      if ((fingerprints[slot] & ~kCompactHasChildren) == fingerprint) {
+        num_compact_collisions_++;
+      } else if (fingerprints[slot] == 0) {
+        fingerprints[slot] = fingerprint |
+            (has_children ? kCompactHasChildren : 0);
+        int32 prob_code = QuantizeValue(lm.prob_codebooks_[order], 0,
+                                        logprob),
+            backoff_code = 0;
+        if (backoff_logprob != 0.0) {
+          KALDI_ASSERT(table.backoff_offset >= 0);
+          // Code zero is reserved for zero backoffs; see BuildCompact().
+          backoff_code = QuantizeValue(lm.backoff_codebooks_[order], 1,
+                                       backoff_logprob);
+        }
+        if (quantize_bits_ == 8) {
+          reinterpret_cast<uint8*>(bucket + table.prob_offset)[slot] =
+              prob_code;
+          if (table.backoff_offset >= 0)
+            reinterpret_cast<uint8*>(bucket + table.backoff_offset)[slot] =
+                backoff_code;
+        } else {
+          reinterpret_cast<uint16*>(bucket + table.prob_offset)[slot] =
+              prob_code;
+          if (table.backoff_offset >= 0)
+            reinterpret_cast<uint16*>(bucket + table.backoff_offset)[slot] =
+                backoff_code;
+        }
+        return;
+      }
+    }
+    if (++bucket_index == table.num_buckets) bucket_index = 0;
+  }
+}
+
 void ConstArpaLmBuilder::Write(std::ostream &os, bool binary) const {
   if (!binary) {
     KALDI_ERR << "text-mode writing is not implemented for ConstArpaLmBuilder.";
   }
   KALDI_ASSERT(is_built_);
+  if (quantize_bits_ != 0) {
+    compact_lm_.Write(os, binary);
+    return;
+  }
 
   // Creates ConstArpaLm.
   ConstArpaLm const_arpa_lm(
@@ -494,11 +781,43 @@ void ConstArpaLmBuilder::Write(std::ostream &os, bool binary) const {
   const_arpa_lm.Write(os, binary);
 }
 
+ConstArpaLm::~ConstArpaLm() {
+  if (memory_assigned_) {
+    if (!mapped_file_.IsOpen())
+      delete[] lm_states_;
+    delete[] unigram_states_;
+    delete[] overflow_buffer_;
+  }
+  if (compact_data_ != NULL && !mapped_file_.IsOpen())
+    KALDI_MEMALIGN_FREE(compact_data_);
+}
+
+// Writes <token>, first padding the stream with spaces (which ReadToken() and
+// ExpectToken() skip) so that if <num_bytes> more bytes are written after the
+// token, the stream position will be a multiple of <alignment>. This is what
+// makes the data that follows usable in place by ConstArpaLm::ReadMmap(). We
+// cannot do this if the position is unknown, e.g. for pipes.
+static void WriteTokenAligned(std::ostream &os, bool binary,
+                              const char *token, int64 num_bytes,
+                              int64 alignment) {
+  std::streamoff pos = os.tellp();
+  if (pos >= 0) {
+    int64 end = pos + strlen(token) + 1 + num_bytes;
+    for (int64 pad = (alignment - end % alignment) % alignment; pad > 0; pad--)
+      os.put(' ');
+  }
+  WriteToken(os, binary, token);
+}
+
 void ConstArpaLm::Write(std::ostream &os, bool binary) const {
   KALDI_ASSERT(initialized_);
   if (!binary) {
     KALDI_ERR << "text-mode writing is not implemented for ConstArpaLm.";
   }
+  if (compact_) {
+    WriteCompact(os, binary);
+    return;
+  }
 
   WriteToken(os, binary, "<ConstArpaLm>");
 
@@ -510,8 +829,10 @@ void ConstArpaLm::Write(std::ostream &os, bool binary) const {
   WriteBasicType(os, binary, ngram_order_);
   WriteToken(os, binary, "</LmInfo>");
 
-  // LmStates section.
-  WriteToken(os, binary, "<LmStates>");
+  // LmStates section. The token is followed by <lm_states_size_>, which takes
+  // 1 + sizeof(int64) bytes.
+  WriteTokenAligned(os, binary, "<LmStates>", 1 + sizeof(int64),
+                    kFileAlignment);
   WriteBasicType(os, binary, lm_states_size_);
   os.write(reinterpret_cast<char *>(lm_states_),
            sizeof(int32) * lm_states_size_);
@@ -579,8 +900,17 @@ void ConstArpaLm::Read(std::istream &is, bool binary) {
   int first_char = is.peek();
   if (first_char == 4) {  // Old on-disk format starts with length of int32.
     ReadInternalOldFormat(is, binary);
-  } else {                // New on-disk format starts with token <ConstArpaLm>.
-    ReadInternal(is, binary);
+  } else {                // New on-disk formats start with a token.
+    std::string token;
+    ReadToken(is, binary, &token);
+    if (token == "<ConstArpaLm>") {
+      ReadInternal(is, binary);
+    } else if (token == "<CompactConstArpaLm>") {
+      ReadInternalCompact(is, binary);
+    } else {
+      KALDI_ERR << "Expected token <ConstArpaLm> or <CompactConstArpaLm>, got "
+                << token;
+    }
   }
 }
 
@@ -590,8 +920,6 @@ void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
     KALDI_ERR << "text-mode reading is not implemented for ConstArpaLm.";
   }
 
-  ExpectToken(is, binary, "<ConstArpaLm>");
-
   // Misc info.
   ExpectToken(is, binary, "<LmInfo>");
   ReadBasicType(is, binary, &bos_symbol_);
@@ -603,9 +931,14 @@ void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
   // LmStates section.
   ExpectToken(is, binary, "<LmStates>");
   ReadBasicType(is, binary, &lm_states_size_);
-  lm_states_ = new int32[lm_states_size_];
-  is.read(reinterpret_cast<char *>(lm_states_),
-          sizeof(int32) * lm_states_size_);
+  char *mapped_data = GetMappedData(is, sizeof(int32) * lm_states_size_);
+  if (mapped_data != NULL) {
+    lm_states_ = reinterpret_cast<int32*>(mapped_data);
+  } else {
+    lm_states_ = new int32[lm_states_size_];
+    is.read(reinterpret_cast<char *>(lm_states_),
+            sizeof(int32) * lm_states_size_);
+  }
   if (!is.good()) {
     KALDI_ERR << "ConstArpaLm <LmStates> section reading failed.";
   }
@@ -662,6 +995,305 @@ void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
   initialized_ = true;
 }
 
+// Writes the size of <vec> and then its contents in binary.
+template<class T>
+static void WriteCompactArray(std::ostream &os, bool binary,
+                              const std::vector<T> &vec) {
+  int64 size = vec.size();
+  WriteBasicType(os, binary, size);
+  if (size > 0)
+    os.write(reinterpret_cast<const char*>(&(vec[0])), sizeof(T) * size);
+  if (!os.good())
+    KALDI_ERR << "ConstArpaLm writing failed.";
+}
+
+// Reads an array written by WriteCompactArray().
+template<class T>
+static void ReadCompactArray(std::istream &is, bool binary,
+                             std::vector<T> *vec) {
+  int64 size;
+  ReadBasicType(is, binary, &size);
+  KALDI_ASSERT(size >= 0);
+  vec->resize(size);
+  if (size > 0)
+    is.read(reinterpret_cast<char*>(&((*vec)[0])), sizeof(T) * size);
+  if (!is.good())
+    KALDI_ERR << "ConstArpaLm reading failed.";
+}
+
+void ConstArpaLm::WriteCompact(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<CompactConstArpaLm>");
+
+  // Misc info.
+  WriteToken(os, binary, "<LmInfo>");
+  WriteBasicType(os, binary, bos_symbol_);
+  WriteBasicType(os, binary, eos_symbol_);
+  WriteBasicType(os, binary, unk_symbol_);
+  WriteBasicType(os, binary, ngram_order_);
+  WriteBasicType(os, binary, quantize_bits_);
+  WriteToken(os, binary, "</LmInfo>");
+
+  // Unigram section.
+  WriteToken(os, binary, "<LmUnigram>");
+  WriteCompactArray(os, binary, unigram_logprobs_);
+  WriteCompactArray(os, binary, unigram_backoffs_);
+  WriteCompactArray(os, binary, unigram_flags_);
+  WriteToken(os, binary, "</LmUnigram>");
+
+  // Codebooks for orders >= 2; there are no backoffs for the highest order.
+  WriteToken(os, binary, "<LmCodebooks>");
+  for (int32 order = 2; order <= ngram_order_; order++) {
+    WriteCompactArray(os, binary, prob_codebooks_[order]);
+    if (order < ngram_order_)
+      WriteCompactArray(os, binary, backoff_codebooks_[order]);
+  }
+  WriteToken(os, binary, "</LmCodebooks>");
+
+  // Hash tables; the layout of each table follows from its number of buckets.
+  // The token is followed by the numbers of buckets and <compact_data_size_>,
+  // each taking 1 + sizeof(int64) bytes.
+  WriteTokenAligned(os, binary, "<LmTables>",
+                    ngram_order_ * (1 + sizeof(int64)), kFileAlignment);
+  for (int32 order = 2; order <= ngram_order_; order++)
+    WriteBasicType(os, binary, compact_tables_[order].num_buckets);
+  WriteBasicType(os, binary, compact_data_size_);
+  os.write(compact_data_, compact_data_size_);
+  if (!os.good()) {
+    KALDI_ERR << "ConstArpaLm <LmTables> section writing failed.";
+  }
+  WriteToken(os, binary, "</LmTables>");
+  WriteToken(os, binary, "</CompactConstArpaLm>");
+}
+
+void ConstArpaLm::ReadInternalCompact(std::istream &is, bool binary) {
+  KALDI_ASSERT(!initialized_);
+
+  // Misc info.
+  ExpectToken(is, binary, "<LmInfo>");
+  ReadBasicType(is, binary, &bos_symbol_);
+  ReadBasicType(is, binary, &eos_symbol_);
+  ReadBasicType(is, binary, &unk_symbol_);
+  ReadBasicType(is, binary, &ngram_order_);
+  ReadBasicType(is, binary, &quantize_bits_);
+  ExpectToken(is, binary, "</LmInfo>");
+  KALDI_ASSERT(ngram_order_ > 0);
+  KALDI_ASSERT(quantize_bits_ == 8 || quantize_bits_ == 16);
+
+  // Unigram section.
+  ExpectToken(is, binary, "<LmUnigram>");
+  ReadCompactArray(is, binary, &unigram_logprobs_);
+  ReadCompactArray(is, binary, &unigram_backoffs_);
+  ReadCompactArray(is, binary, &unigram_flags_);
+  ExpectToken(is, binary, "</LmUnigram>");
+  num_words_ = unigram_logprobs_.size();
+  KALDI_ASSERT(unigram_backoffs_.size() == num_words_ &&
+               unigram_flags_.size() == num_words_);
+
+  // Codebooks.
+  ExpectToken(is, binary, "<LmCodebooks>");
+  prob_codebooks_.resize(ngram_order_ + 1);
+  backoff_codebooks_.resize(ngram_order_ + 1);
+  int32 num_codes = 1 << quantize_bits_;
+  for (int32 order = 2; order <= ngram_order_; order++) {
+    ReadCompactArray(is, binary, &(prob_codebooks_[order]));
+    KALDI_ASSERT(!prob_codebooks_[order].empty() &&
+                 prob_codebooks_[order].size() <= num_codes);
+    if (order < ngram_order_) {
+      ReadCompactArray(is, binary, &(backoff_codebooks_[order]));
+      KALDI_ASSERT(!backoff_codebooks_[order].empty() &&
+                   backoff_codebooks_[order].size() <= num_codes);
+    }
+  }
+  ExpectToken(is, binary, "</LmCodebooks>");
+
+  // Hash tables.
+  ExpectToken(is, binary, "<LmTables>");
+  compact_tables_.resize(ngram_order_ + 1);
+  int64 offset = 0;
+  for (int32 order = 2; order <= ngram_order_; order++) {
+    int64 num_buckets;
+    ReadBasicType(is, binary, &num_buckets);
+    KALDI_ASSERT(num_buckets > 0);
+    SetCompactTableLayout(order, num_buckets, offset);
+    offset += num_buckets * kCompactBucketSize;
+  }
+  ReadBasicType(is, binary, &compact_data_size_);
+  if (compact_data_size_ != offset)
+    KALDI_ERR << "ConstArpaLm <LmTables> section has the wrong size, "
+              << compact_data_size_ << " vs. " << offset;
+  if (compact_data_size_ > 0) {
+    compact_data_ = GetMappedData(is, compact_data_size_);
+    if (compact_data_ == NULL) {
+      void *data;
+      if (!KALDI_MEMALIGN(kCompactBucketSize, compact_data_size_, &data))
+        KALDI_ERR << "Failed to allocate " << compact_data_size_ << " bytes "
+                  << "for ConstArpaLm.";
+      compact_data_ = static_cast<char*>(data);
+      is.read(compact_data_, compact_data_size_);
+    }
+  }
+  if (!is.good()) {
+    KALDI_ERR << "ConstArpaLm <LmTables> section reading failed.";
+  }
+  ExpectToken(is, binary, "</LmTables>");
+  ExpectToken(is, binary, "</CompactConstArpaLm>");
+
+  KALDI_ASSERT(bos_symbol_ < num_words_ && bos_symbol_ > 0);
+  KALDI_ASSERT(eos_symbol_ < num_words_ && eos_symbol_ > 0);
+  KALDI_ASSERT(unk_symbol_ < num_words_ &&
+               (unk_symbol_ > 0 || unk_symbol_ == -1));
+  compact_ = true;
+  initialized_ = true;
+}
+
+void ConstArpaLm::ReadMmap(const std::string &filename) {
+  KALDI_ASSERT(!initialized_);
+  if (ClassifyRxfilename(filename) != kFileInput ||
+      !mapped_file_.Open(filename)) {
+    KALDI_WARN << "Cannot use mmap() for " << filename << "; reading it into "
+               << "memory.";
+    bool binary;
+    Input ki(filename, &binary);
+    Read(ki.Stream(), binary);
+    return;
+  }
+  // We parse the file from the mapped memory; GetMappedData() makes the large
+  // arrays point into it.
+  MemoryStreambuf streambuf(mapped_file_.Data(), mapped_file_.Size());
+  std::istream is(&streambuf);
+  bool binary;
+  if (!InitKaldiInputStream(is, &binary))
+    KALDI_ERR << "Failed to read the header of " << filename;
+  Read(is, binary);
+
+  const char *data = compact_ ? compact_data_ :
+      reinterpret_cast<const char*>(lm_states_);
+  if (data == NULL) {
+    // A compact-format unigram LM has no hash tables, so there is nothing to
+    // use in place.
+    mapped_file_.Close();
+  } else if (data < mapped_file_.Data() ||
+             data >= mapped_file_.Data() + mapped_file_.Size()) {
+    KALDI_WARN << "The language model in " << filename << " is in an old "
+               << "format or is not aligned, so it has been read into memory "
+               << "rather than used via mmap(). Rebuild it with "
+               << "arpa-to-const-arpa to be able to use mmap().";
+    mapped_file_.Close();
+  }
+}
+
+char *ConstArpaLm::GetMappedData(std::istream &is, int64 num_bytes) {
+  if (!mapped_file_.IsOpen()) return NULL;
+  std::streamoff offset = is.tellg();
+  if (offset < 0 || offset % sizeof(int32) != 0) return NULL;
+  if (offset + num_bytes > mapped_file_.Size())
+    KALDI_ERR << "ConstArpaLm file " << mapped_file_.Filename()
+              << " is truncated.";
+  is.seekg(num_bytes, std::ios::cur);
+  // The data is never written to, so casting away the const is safe.
+  return const_cast<char*>(mapped_file_.Data()) + offset;
+}
+
+void ConstArpaLm::SetCompactTableLayout(int32 order, int64 num_buckets,
+                                        int64 offset) {
+  KALDI_ASSERT(order >= 2 && order <= ngram_order_ &&
+               compact_tables_.size() > order);
+  int32 code_bytes = quantize_bits_ / 8;
+  bool has_backoff = (order < ngram_order_);
+  int32 entry_bytes = sizeof(uint32) + code_bytes * (has_backoff ? 2 : 1);
+  CompactTable &table = compact_tables_[order];
+  table.offset = offset;
+  table.num_buckets = num_buckets;
+  table.entries_per_bucket = kCompactBucketSize / entry_bytes;
+  table.prob_offset = sizeof(uint32) * table.entries_per_bucket;
+  table.backoff_offset = has_backoff ?
+      table.prob_offset + code_bytes * table.entries_per_bucket : -1;
+}
+
+bool ConstArpaLm::FindCompactEntry(int32 order, uint64 hash,
+                                   const char **bucket, int32 *slot) const {
+  const CompactTable &table = compact_tables_[order];
+  int64 bucket_index;
+  uint32 fingerprint;
+  CompactHashLocation(hash, table.num_buckets, &bucket_index, &fingerprint);
+  const char *data = compact_data_ + table.offset;
+  for (int64 n = 0; n < table.num_buckets; n++) {
+    const char *this_bucket = data + bucket_index * kCompactBucketSize;
+    const uint32 *fingerprints = reinterpret_cast<const uint32*>(this_bucket);
+    for (int32 i = 0; i < table.entries_per_bucket; i++) {
+      uint32 this_fingerprint = fingerprints[i] & ~kCompactHasChildren;
+      if (this_fingerprint == fingerprint) {
+        *bucket = this_bucket;
+        *slot = i;
+        return true;
+      } else if (this_fingerprint == 0) {
+        return false;
+      }
+    }
+    if (++bucket_index == table.num_buckets) bucket_index = 0;
+  }
+  return false;
+}
+
+float ConstArpaLm::GetNgramLogprobCompact(
+    const int32 word, const std::vector<int32>& hist) const {
+  int32 hist_size = hist.size();
+  KALDI_ASSERT(hist_size + 1 <= ngram_order_);
+
+  // This is equivalent to GetNgramLogprobRecurse(), but we go from short to
+  // long histories so the hashes can be computed incrementally: the answer is
+  // the logprob of the longest n-gram that exists, plus the backoff logprobs
+  // of the longer histories. We only look for an n-gram if its history has
+  // children. We add each backoff to the result so far, as the recursion does,
+  // so that the result is exactly the same.
+  float logprob = UnigramExists(word) ? unigram_logprobs_[word] :
+      std::numeric_limits<float>::min();
+  uint64 hist_hash = 0, ngram_hash = CompactHashExtend(0, word);
+  const char *bucket;
+  int32 slot;
+  for (int32 k = 1; k <= hist_size; ++k) {
+    // The history is formed by the last k words of <hist>.
+    int32 hist_word = hist[hist_size - k];
+    hist_hash = CompactHashExtend(hist_hash, hist_word);
+    ngram_hash = CompactHashExtend(ngram_hash, hist_word);
+    bool has_children;
+    float this_backoff;
+    if (k == 1) {
+      if (!UnigramExists(hist_word)) continue;
+      has_children = (unigram_flags_[hist_word] & kUnigramHasChildren) != 0;
+      this_backoff = unigram_backoffs_[hist_word];
+    } else {
+      if (!FindCompactEntry(k, hist_hash, &bucket, &slot)) continue;
+      has_children =
+          (CompactFingerprint(bucket, slot) & kCompactHasChildren) != 0;
+      this_backoff = CompactBackoff(k, bucket, slot);
+    }
+    if (has_children && FindCompactEntry(k + 1, ngram_hash, &bucket, &slot))
+      logprob = CompactLogprob(k + 1, bucket, slot);
+    else
+      logprob = this_backoff + logprob;
+  }
+  return logprob;
+}
+
+bool ConstArpaLm::HistoryStateExistsCompact(
+    const std::vector<int32>& hist) const {
+  int32 hist_size = hist.size();
+  KALDI_ASSERT(hist_size > 0);
+  if (hist_size >= ngram_order_) return false;
+  if (hist_size == 1) {
+    return UnigramExists(hist[0]) &&
+        (unigram_flags_[hist[0]] & kUnigramHasChildren) != 0;
+  }
+  uint64 hash = 0;
+  for (int32 i = hist_size - 1; i >= 0; --i)
+    hash = CompactHashExtend(hash, hist[i]);
+  const char *bucket;
+  int32 slot;
+  return FindCompactEntry(hist_size, hash, &bucket, &slot) &&
+      (CompactFingerprint(bucket, slot) & kCompactHasChildren) != 0;
+}
+
 void ConstArpaLm::ReadInternalOldFormat(std::istream &is, bool binary) {
   KALDI_ASSERT(!initialized_);
   if (!binary) {
@@ -724,6 +1356,7 @@ bool ConstArpaLm::HistoryStateExists(const std::vector<int32>& hist) const {
   if (hist.size() == 0) {
     return true;
   }
+  if (compact_) return HistoryStateExistsCompact(hist);
 
   // Tries to locate the LmState of the given word sequence.
   int32* lm_state = GetLmState(hist);
@@ -764,19 +1397,20 @@ float ConstArpaLm::GetNgramLogprob(const int32 word,
   int32 mapped_word = word;
   if (unk_symbol_ != -1) {
     KALDI_ASSERT(mapped_word >= 0);
-    if (mapped_word >= num_words_ || unigram_states_[mapped_word] == NULL) {
+    if (!UnigramExists(mapped_word)) {
       mapped_word = unk_symbol_;
     }
     for (int32 i = 0; i < mapped_hist.size(); ++i) {
       KALDI_ASSERT(mapped_hist[i] >= 0);
-      if (mapped_hist[i] >= num_words_ ||
-          unigram_states_[mapped_hist[i]] == NULL) {
+      if (!UnigramExists(mapped_hist[i])) {
         mapped_hist[i] = unk_symbol_;
       }
     }
   }
 
   // Loops up n-gram probability.
+  if (compact_)
+    return GetNgramLogprobCompact(mapped_word, mapped_hist);
   return GetNgramLogprobRecurse(mapped_word, mapped_hist);
 }
 
@@ -951,6 +1585,10 @@ void ConstArpaLm::WriteArpaRecurse(int32* lm_state,
 
 void ConstArpaLm::WriteArpa(std::ostream &os) const {
   KALDI_ASSERT(initialized_);
+  if (compact_) {
+    KALDI_ERR << "WriteArpa() is not possible for the compact ConstArpaLm "
+              << "format, which does not store the words of the n-grams.";
+  }
 
   std::vector<ArpaLine> tmp_output;
   for (int32 i = 0; i < num_words_; ++i) {
@@ -1011,7 +1649,7 @@ void ConstArpaLm::WriteArpa(std::ostream &os) const {
 }
 
 ConstArpaLmDeterministicFst::ConstArpaLmDeterministicFst(
-    const ConstArpaLm& lm) : lm_(lm) {
+    const ConstArpaLm& lm, ConstArpaLmCache *cache) : lm_(lm), cache_(cache) {
   // Creates a history state for <s>.
   std::vector<Label> bos_state(1, lm_.BosSymbol());
   state_to_wseq_.push_back(bos_state);
@@ -1027,28 +1665,48 @@ fst::StdArc::Weight ConstArpaLmDeterministicFst::Final(StateId s) {
   return Weight(-logprob);
 }
 
+void ConstArpaLmDeterministicFst::ComputeArcInfo(
+    const std::vector<Label> &wseq, ConstArpaLmArcInfo *info) const {
+  KALDI_ASSERT(!wseq.empty());
+  std::vector<Label> hist(wseq.begin(), wseq.end() - 1);
+  info->logprob = lm_.GetNgramLogprob(wseq.back(), hist);
+  if (info->logprob == std::numeric_limits<float>::min()) {
+    info->next_hist_length = -1;
+    return;
+  }
+
+  // Locates the next state in ConstArpaLm. Note that OOV and backoff have been
+  // taken care of in ConstArpaLm.
+  std::vector<Label> next_wseq(wseq);
+  while (next_wseq.size() >= lm_.NgramOrder()) {
+    // History state has at most lm_.NgramOrder() -1 words in the state.
+    next_wseq.erase(next_wseq.begin(), next_wseq.begin() + 1);
+  }
+  while (!lm_.HistoryStateExists(next_wseq)) {
+    KALDI_ASSERT(next_wseq.size() > 0);
+    next_wseq.erase(next_wseq.begin(), next_wseq.begin() + 1);
+  }
+  info->next_hist_length = next_wseq.size();
+}
+
 bool ConstArpaLmDeterministicFst::GetArc(StateId s,
                                          Label ilabel, fst::StdArc *oarc) {
   // At this point, we should have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
+  // <wseq> is the history followed by the word; this is the key in <cache_>.
   std::vector<Label> wseq = state_to_wseq_[s];
-
-  float logprob = lm_.GetNgramLogprob(ilabel, wseq);
-  if (logprob == std::numeric_limits<float>::min()) {
-    return false;
-  }
-
-  // Locates the next state in ConstArpaLm. Note that OOV and backoff have been
-  // taken care of in ConstArpaLm.
   wseq.push_back(ilabel);
-  while (wseq.size() >= lm_.NgramOrder()) {
-    // History state has at most lm_.NgramOrder() -1 words in the state.
-    wseq.erase(wseq.begin(), wseq.begin() + 1);
+  ConstArpaLmArcInfo info;
+  if (cache_ == NULL || !cache_->Find(wseq, &info)) {
+    ComputeArcInfo(wseq, &info);
+    if (cache_ != NULL)
+      cache_->Insert(wseq, info);
   }
-  while (!lm_.HistoryStateExists(wseq)) {
-    KALDI_ASSERT(wseq.size() > 0);
-    wseq.erase(wseq.begin(), wseq.begin() + 1);
+  if (info.next_hist_length < 0) {
+    return false;
   }
+  float logprob = info.logprob;
+  wseq.erase(wseq.begin(), wseq.end() - info.next_hist_length);
 
   std::pair<const std::vector<Label>, StateId> wseq_state_pair(
       wseq, static_cast<Label>(state_to_wseq_.size()));
@@ -1074,7 +1732,14 @@ bool ConstArpaLmDeterministicFst::GetArc(StateId s,
 bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
                       const std::string& const_arpa_wxfilename) {
-  ConstArpaLmBuilder lm_builder(options);
+  return BuildConstArpaLm(options, 0, arpa_rxfilename, const_arpa_wxfilename);
+}
+
+bool BuildConstArpaLm(const ArpaParseOptions& options,
+                      int32 quantize_bits,
+                      const std::string& arpa_rxfilename,
+                      const std::string& const_arpa_wxfilename) {
+  ConstArpaLmBuilder lm_builder(options, quantize_bits);
   KALDI_LOG << "Reading " << arpa_rxfilename;
   Input ki(arpa_rxfilename);
   lm_builder.Read(ki.Stream());
@@ -27,6 +27,8 @@
 #include "fstext/deterministic-fst.h"
 #include "lm/arpa-file-parser.h"
 #include "util/common-utils.h"
+#include "util/kaldi-mmap.h"
+#include "util/lru-cache.h"
 
 namespace kaldi {
 
@@ -194,6 +196,27 @@ namespace kaldi {
        of LmState whose address differs too much from the parent address. See
        above how we handle the leaf case.
     5. With the information in step 4, create the class ConstArpaLm.
+
+    There is also a "compact" on-disk format, which is what you get if you give
+    a nonzero --quantize-bits option to arpa-to-const-arpa. For large
+    high-order language models the lookups in the format above are dominated
+    by cache misses: each GetNgramLogprob() follows one relative pointer and
+    does one binary search per history word. In the compact format we instead
+    have, for each order n >= 2, a hash table keyed on a 64-bit hash of the
+    whole n-gram (this is similar to the "probing" data structure of KenLM).
+    The tables are arrays of 64-byte buckets, each of which holds a few
+    entries; an entry consists of
+      - a 31-bit fingerprint of the n-gram's hash (the remaining bit says
+        whether the n-gram has any children, i.e. whether it is a history
+        state), and
+      - the logprob and (except for the highest order) the backoff logprob,
+        quantized to 8 or 16 bits using a codebook per order.
+    We use linear probing over buckets, so a lookup usually touches exactly one
+    cache line. The unigrams are kept unquantized in arrays indexed by word.
+    Backoff code zero is reserved for a backoff of exactly 0.0. Note that since
+    we only store fingerprints, not the words, an n-gram that is not in the LM
+    has a small chance (of order 1e-9 per lookup) of being mistaken for one that
+    is; and WriteArpa() cannot be used in this format.
 */
 
 // Forward declaration of Auxiliary struct ArpaLine.
@@ -217,6 +240,8 @@ class ConstArpaLm {
     lm_states_ = NULL;
     unigram_states_ = NULL;
     overflow_buffer_ = NULL;
+    compact_data_ = NULL;
+    compact_ = false;
     memory_assigned_ = false;
     initialized_ = false;
   }
@@ -242,22 +267,27 @@ class ConstArpaLm {
     KALDI_ASSERT(unk_symbol_ < num_words_ &&
                  (unk_symbol_ > 0 || unk_symbol_ == -1));
     lm_states_end_ = lm_states_ + lm_states_size_ - 1;
+    compact_data_ = NULL;
+    compact_ = false;
     memory_assigned_ = false;
     initialized_ = true;
   }
 
-  ~ConstArpaLm() {
-    if (memory_assigned_) {
-      delete[] lm_states_;
-      delete[] unigram_states_;
-      delete[] overflow_buffer_;
-    }
-  }
+  ~ConstArpaLm();
 
   // Reads the ConstArpaLm format language model. It calls ReadInternal() or
   // ReadInternalOldFormat() to do the actual reading.
   void Read(std::istream &is, bool binary);
 
+  // Reads the language model from <filename> by mapping the file into memory
+  // with mmap(MAP_SHARED), instead of copying the LmStates (or, for the compact
+  // format, the hash tables) into memory. This way the processes that use the
+  // same LM on a machine share one copy of it in the page cache, and loading
+  // takes very little time. This requires <filename> to be an ordinary file
+  // written by a version of Write() that aligns the data; otherwise (e.g. for
+  // pipes or for old files) we warn and read it normally.
+  void ReadMmap(const std::string &filename);
+
   // Writes the language model in ConstArpaLm format.
   void Write(std::ostream &os, bool binary) const;
 
@@ -278,10 +308,60 @@ class ConstArpaLm {
   int32 UnkSymbol() const { return unk_symbol_; }
   int32 NgramOrder() const { return ngram_order_; }
 
+  // Returns true if the LM is in the compact (hashed and quantized) format; see
+  // the comment at the top of this file.
+  bool IsCompact() const { return compact_; }
+
+  // Returns true if ReadMmap() was able to use the file in place, i.e. the
+  // large arrays point into the mapped file.  (This is never the case for a
+  // compact-format unigram LM, which has no large arrays.)
+  bool IsMapped() const { return mapped_file_.IsOpen(); }
+
  private:
-  // Function that loads data from stream to the class.
+  friend class ConstArpaLmBuilder;
+
+  // Describes the hash table for one n-gram order in the compact format. It
+  // is an array of <num_buckets> 64-byte buckets starting at
+  // <compact_data_> + <offset>; each bucket holds <entries_per_bucket>
+  // entries, stored as an array of uint32 fingerprints, followed by an array
+  // of logprob codes at byte <prob_offset> and, except for the highest order,
+  // an array of backoff codes at byte <backoff_offset>.
+  struct CompactTable {
+    int64 offset;
+    int64 num_buckets;
+    int32 entries_per_bucket;
+    int32 prob_offset;
+    int32 backoff_offset;   // -1 if there are no backoffs.
+  };
+
+  // Size of the buckets of the compact format, in bytes; it is the size of a
+  // cache line.
+  static const int32 kCompactBucketSize = 64;
+
+  // Alignment, in bytes, of the LmStates and the hash tables in the files we
+  // write, so that they can be used in place by ReadMmap().
+  static const int32 kFileAlignment = 64;
+
+  // Bits of the unigram_flags_ array in the compact format.
+  enum { kUnigramExists = 1, kUnigramHasChildren = 2 };
+
+  // Function that loads data from stream to the class. The token <ConstArpaLm>
+  // has already been read.
   void ReadInternal(std::istream &is, bool binary);
 
+  // Reads the compact format. The token <CompactConstArpaLm> has already been
+  // read.
+  void ReadInternalCompact(std::istream &is, bool binary);
+
+  // Writes the compact format.
+  void WriteCompact(std::ostream &os, bool binary) const;
+
+  // If we are reading via ReadMmap(), and the next <num_bytes> bytes of <is>
+  // are suitably aligned in the file, skips them in <is> and returns their
+  // address in the mapped file. Otherwise returns NULL, and the caller should
+  // read the data from <is>.
+  char *GetMappedData(std::istream &is, int64 num_bytes);
+
   // Function that loads data from stream to the class. This is a deprecated one
   // that handles the old on-disk format. We keep this for back-compatibility
   // purpose. We have modified the Write() function so for all the new on-disk
@@ -321,6 +401,53 @@ class ConstArpaLm {
                         const std::vector<int32>& seq,
                         std::vector<ArpaLine> *output) const;
 
+  // Returns true if <word> is a unigram of the language model; <word> must be
+  // nonnegative.
+  inline bool UnigramExists(const int32 word) const {
+    if (word >= num_words_) return false;
+    return compact_ ? (unigram_flags_[word] & kUnigramExists) != 0 :
+        unigram_states_[word] != NULL;
+  }
+
+  // The compact-format versions of GetNgramLogprobRecurse() and
+  // HistoryStateExists(). Out-of-vocabulary words must already have been
+  // mapped to <unk>.
+  float GetNgramLogprobCompact(const int32 word,
+                               const std::vector<int32>& hist) const;
+  bool HistoryStateExistsCompact(const std::vector<int32>& hist) const;
+
+  // Sets up compact_tables_[order] for a table with <num_buckets> buckets
+  // starting at byte <offset> of <compact_data_>.
+  void SetCompactTableLayout(int32 order, int64 num_buckets, int64 offset);
+
+  // Looks up the n-gram with hash <hash> in the compact table for <order>
+  // (which must be >= 2). If found, returns true and sets <*bucket> and
+  // <*slot> to its location.
+  bool FindCompactEntry(int32 order, uint64 hash,
+                        const char **bucket, int32 *slot) const;
+
+  // Returns the fingerprint word (including the has-children bit), the
+  // dequantized logprob and the dequantized backoff logprob of a compact-table
+  // entry.
+  inline uint32 CompactFingerprint(const char *bucket, int32 slot) const {
+    return reinterpret_cast<const uint32*>(bucket)[slot];
+  }
+  inline float CompactLogprob(int32 order, const char *bucket,
+                              int32 slot) const {
+    return prob_codebooks_[order][CompactCode(
+        bucket + compact_tables_[order].prob_offset, slot)];
+  }
+  inline float CompactBackoff(int32 order, const char *bucket,
+                              int32 slot) const {
+    return backoff_codebooks_[order][CompactCode(
+        bucket + compact_tables_[order].backoff_offset, slot)];
+  }
+  inline int32 CompactCode(const char *codes, int32 slot) const {
+    return quantize_bits_ == 8 ?
+        reinterpret_cast<const uint8*>(codes)[slot] :
+        reinterpret_cast<const uint16*>(codes)[slot];
+  }
+
   // We assign memory in Read(). If it is called, we have to release memory in
   // the destructor.
   bool memory_assigned_;
@@ -382,8 +509,56 @@ class ConstArpaLm {
   //
   // x = 1 + 1 + 1 + 2 * children.size() = 3 + 2 * children.size()
   int32* lm_states_;
+
+  // The rest of the members are only used in the compact format.
+
+  // True if we are using the compact format.
+  bool compact_;
+
+  // Number of bits (8 or 16) of the quantized logprobs and backoffs.
+  int32 quantize_bits_;
+
+  // Unquantized unigram logprobs and backoff logprobs, indexed by word, and
+  // the flags kUnigramExists and kUnigramHasChildren.
+  std::vector<float> unigram_logprobs_;
+  std::vector<float> unigram_backoffs_;
+  std::vector<uint8> unigram_flags_;
+
+  // Codebooks for the quantized logprobs and backoffs, indexed by order. Only
+  // orders >= 2 are used, and there are no backoffs for the highest order.
+  std::vector<std::vector<float> > prob_codebooks_;
+  std::vector<std::vector<float> > backoff_codebooks_;
+
+  // The hash tables, indexed by order (orders >= 2 only).
+  std::vector<CompactTable> compact_tables_;
+
+  // The 64-byte aligned memory block containing all the hash tables, of size
+  // <compact_data_size_> bytes.
+  char *compact_data_;
+  int64 compact_data_size_;
+
+  // The file, if we were read by ReadMmap(). While it is open, <lm_states_>
+  // or <compact_data_> point into it and are not owned by this class.
+  MappedFile mapped_file_;
 };
 
+// The result of ConstArpaLmDeterministicFst::GetArc() for a history and a
+// word, as stored in ConstArpaLmCache.
+struct ConstArpaLmArcInfo {
+  // The LM log-probability of the word given the history.
+  float logprob;
+  // The successor history state is the last <next_hist_length> words of the
+  // history followed by the word; -1 if there is no arc.
+  int32 next_hist_length;
+};
+
+// A cache from (history followed by a word) to the corresponding
+// ConstArpaLmArcInfo, which may be shared by the ConstArpaLmDeterministicFst
+// objects for many lattices, in different threads, so that the LM lookups for
+// common histories are not repeated for every lattice.
+typedef LruCache<std::vector<int32>, ConstArpaLmArcInfo,
+                 VectorHasher<int32> > ConstArpaLmCache;
+
 /**
  This class wraps a ConstArpaLm format language model with the interface defined
  in DeterministicOnDemandFst.
@@ -395,7 +570,10 @@ class ConstArpaLmDeterministicFst
   typedef fst::StdArc::StateId StateId;
   typedef fst::StdArc::Label Label;
 
-  explicit ConstArpaLmDeterministicFst(const ConstArpaLm& lm);
+  // If <cache> is not NULL, it is used to look up arcs before going to the LM
+  // (it is not owned here, and must have been used only with this LM).
+  explicit ConstArpaLmDeterministicFst(const ConstArpaLm& lm,
+                                       ConstArpaLmCache *cache = NULL);
 
   // We cannot use "const" because the pure virtual function in the interface is
   // not const.
@@ -408,12 +586,18 @@ class ConstArpaLmDeterministicFst
   virtual bool GetArc(StateId s, Label ilabel, fst::StdArc* oarc);
 
  private:
+  // Works out the ConstArpaLmArcInfo for <wseq>, which is a history followed
+  // by a word, from the LM.
+  void ComputeArcInfo(const std::vector<Label> &wseq,
+                      ConstArpaLmArcInfo *info) const;
+
   typedef unordered_map<std::vector<Label>,
                         StateId, VectorHasher<Label> > MapType;
   StateId start_state_;
   MapType wseq_to_state_;
   std::vector<std::vector<Label> > state_to_wseq_;
   const ConstArpaLm& lm_;
+  ConstArpaLmCache *cache_;
 };
 
 // Reads in an Arpa format language model and converts it into ConstArpaLm
@@ -423,6 +607,14 @@ bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
                       const std::string& const_arpa_wxfilename);
 
+// As above, but if <quantize_bits> is 8 or 16 it writes the compact format
+// (see the comment at the top of this file) with the logprobs and backoffs
+// quantized to that number of bits; if it is 0 it is the same as above.
+bool BuildConstArpaLm(const ArpaParseOptions& options,
+                      int32 quantize_bits,
+                      const std::string& arpa_rxfilename,
+                      const std::string& const_arpa_wxfilename);
+
 }  // namespace kaldi
 
 #endif  // KALDI_LM_CONST_ARPA_LM_H_
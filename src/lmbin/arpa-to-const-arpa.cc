@@ -38,6 +38,11 @@ int main(int argc, char *argv[]) {
         "format language model to integers using utils/map_arpa_m.pl, and\n"
         "then use this program to build a ConstArpaLm format language model.\n"
         "\n"
+        "With --quantize-bits=8 or 16 it writes a compact format in which the\n"
+        "n-grams are found by hashing and the log-probabilities are quantized;\n"
+        "this is faster to look up for large LMs, but only approximates the\n"
+        "probabilities of the Arpa LM.\n"
+        "\n"
         "Usage: arpa-to-const-arpa [opts] <input-arpa> <const-arpa>\n"
         " e.g.: arpa-to-const-arpa --bos-symbol=1 --eos-symbol=2 \\\n"
         "                          arpa.txt const_arpa";
@@ -45,6 +50,7 @@ int main(int argc, char *argv[]) {
     kaldi::ParseOptions po(usage);
 
     ArpaParseOptions options;
+    int32 quantize_bits = 0;
     options.Register(&po);
 
     // Ideally, these registrations would be in ArpaParseOptions, but some
@@ -59,6 +65,10 @@ int main(int argc, char *argv[]) {
     po.Register("eos-symbol", &options.eos_symbol,
                 "Integer corresponds to </s>. You must set this to your actual "
                 "EOS integer.");
+    po.Register("quantize-bits", &quantize_bits,
+                "If 8 or 16, write the compact (hashed, quantized) format with "
+                "log-probabilities and backoffs quantized to this many bits; "
+                "if 0, write the exact format.");
 
     po.Read(argc, argv);
 
@@ -75,7 +85,7 @@ int main(int argc, char *argv[]) {
     std::string arpa_rxfilename = po.GetArg(1),
         const_arpa_wxfilename = po.GetOptArg(2);
 
-    bool ans = BuildConstArpaLm(options, arpa_rxfilename,
+    bool ans = BuildConstArpaLm(options, quantize_bits, arpa_rxfilename,
                                 const_arpa_wxfilename);
     if (ans)
       return 0;
@@ -450,6 +450,21 @@ void inline clapack_Xsptrf(KaldiBlasInt *num_rows, double *Mdata,
                            KaldiBlasInt *ipiv, KaldiBlasInt *result) {
   dsptrf_(const_cast<char *>("U"), num_rows, Mdata, ipiv, result);
 }
+//
+inline void clapack_Xsyevd(char *jobz, KaldiBlasInt *num_rows, float *Mdata,
+                           KaldiBlasInt *stride, float *w, float *p_work,
+                           KaldiBlasInt *l_work, KaldiBlasInt *p_iwork,
+                           KaldiBlasInt *l_iwork, KaldiBlasInt *result) {
+  ssyevd_(jobz, const_cast<char *>("U"), num_rows, Mdata, stride, w,
+          p_work, l_work, p_iwork, l_iwork, result);
+}
+inline void clapack_Xsyevd(char *jobz, KaldiBlasInt *num_rows, double *Mdata,
+                           KaldiBlasInt *stride, double *w, double *p_work,
+                           KaldiBlasInt *l_work, KaldiBlasInt *p_iwork,
+                           KaldiBlasInt *l_iwork, KaldiBlasInt *result) {
+  dsyevd_(jobz, const_cast<char *>("U"), num_rows, Mdata, stride, w,
+          p_work, l_work, p_iwork, l_iwork, result);
+}
 #else
 inline void clapack_Xgetrf(MatrixIndexT num_rows, MatrixIndexT num_cols,
                            float *Mdata, MatrixIndexT stride, 
@@ -0,0 +1,84 @@
+// matrix/compressed-matrix-speed-test.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//  http://www.apache.org/licenses/LICENSE-2.0
+
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "matrix/matrix-lib.h"
+#include "base/timer.h"
+
+namespace kaldi {
+
+static void CsvResult(std::string test, const std::string &kernels,
+                      int dim, BaseFloat measure, std::string units) {
+  std::cout << test << "," << kernels << "," << dim << "," << measure
+            << "," << units << "\n";
+}
+
+static std::string MethodName(CompressionMethod method) {
+  switch (method) {
+    case kSpeechFeature: return "kSpeechFeature";
+    case kTwoByteAuto: return "kTwoByteAuto";
+    case kOneByteAuto: return "kOneByteAuto";
+    default: return "other";
+  }
+}
+
+// Measures compression and decompression speed in millions of elements per
+// second, for a matrix the size of a typical chunk of an nnet3 example.
+static void CompressedMatrixSpeed(CompressionMethod method) {
+  MatrixIndexT num_rows = 300, num_cols = 40;
+  Matrix<BaseFloat> M(num_rows, num_cols), M2(num_rows, num_cols);
+  M.SetRandn();
+  BaseFloat time_in_secs = 0.1, elements = num_rows * num_cols;
+  std::string kernels = CompressedMatrix::SimdKernelName();
+  {
+    int32 iter = 0;
+    CompressedMatrix cmat;
+    Timer t;
+    for (; t.Elapsed() < time_in_secs; iter++)
+      cmat.CopyFromMat(M, method);
+    CsvResult("Compress " + MethodName(method), kernels, num_cols,
+              elements * iter / (t.Elapsed() * 1.0e+06), "Melements/sec");
+  }
+  {
+    int32 iter = 0;
+    CompressedMatrix cmat(M, method);
+    Timer t;
+    for (; t.Elapsed() < time_in_secs; iter++)
+      cmat.CopyToMat(&M2);
+    CsvResult("Decompress " + MethodName(method), kernels, num_cols,
+              elements * iter / (t.Elapsed() * 1.0e+06), "Melements/sec");
+  }
+}
+
+static void CompressedMatrixSpeedTest() {
+  CompressionMethod methods[] = { kSpeechFeature, kTwoByteAuto,
+                                  kOneByteAuto };
+  for (int32 use_simd = 0; use_simd <= 1; use_simd++) {
+    CompressedMatrix::SetUseSimd(use_simd == 1);
+    for (int32 i = 0; i < 3; i++)
+      CompressedMatrixSpeed(methods[i]);
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  kaldi::CompressedMatrixSpeedTest();
+  KALDI_LOG << "Tests succeeded.";
+}
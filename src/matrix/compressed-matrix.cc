@@ -22,8 +22,432 @@
 #include "matrix/compressed-matrix.h"
 #include <algorithm>
 
+// SIMD versions of the inner loops are compiled for x86 with GCC-compatible
+// compilers (AVX2, used if the CPU supports it, so no special compiler flags
+// are needed), and for 64-bit ARM (NEON, which is always available).
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define KALDI_COMPRESSED_MATRIX_X86_SIMD 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define KALDI_COMPRESSED_MATRIX_NEON 1
+#include <arm_neon.h>
+#endif
+
 namespace kaldi {
 
+namespace {
+
+// The following functions are the inner loops of compression and
+// decompression.  The generic versions define the arithmetic; the SIMD
+// versions reproduce it exactly (including the places where the generic code
+// works in double precision), so the compressed data and the decompressed
+// matrices do not depend on which version is used.  (This holds unless the
+// compiler is allowed to fuse multiplies and adds, e.g. with -march=native,
+// in which case results may differ in the last bit.)
+
+inline uint16 EncodeUint16(float min_value, float range, float value) {
+  float f = (value - min_value) / range;
+  if (f > 1.0) f = 1.0;  // Note: this should not happen.
+  if (f < 0.0) f = 0.0;  // Note: this should not happen.
+  return static_cast<int>(f * 65535 + 0.499);  // + 0.499 is to
+  // round to closest int; avoids bias.
+}
+
+inline uint8 EncodeUint8(float min_value, float range, float value) {
+  float f = (value - min_value) / range;
+  if (f > 1.0) f = 1.0;  // Note: this should not happen.
+  if (f < 0.0) f = 0.0;  // Note: this should not happen.
+  return static_cast<int>(f * 255 + 0.499);  // + 0.499 is to
+  // round to closest int; avoids bias.
+}
+
+// 'p' is the four percentiles p0, p25, p75, p100 of the column.
+inline float DecodeChar(const float *p, uint8 value) {
+  if (value <= 64) {
+    return p[0] + (p[1] - p[0]) * value * (1/64.0);
+  } else if (value <= 192) {
+    return p[1] + (p[2] - p[1]) * (value - 64) * (1/128.0);
+  } else {
+    return p[2] + (p[3] - p[2]) * (value - 192) * (1/63.0);
+  }
+}
+
+void DecodeUint8Generic(float min_value, float increment, const uint8 *in,
+                        int32 n, float *out) {
+  for (int32 i = 0; i < n; i++)
+    out[i] = min_value + in[i] * increment;
+}
+
+void DecodeUint16Generic(float min_value, float increment, const uint16 *in,
+                         int32 n, float *out) {
+  for (int32 i = 0; i < n; i++)
+    out[i] = min_value + in[i] * increment;
+}
+
+void DecodeColumnGeneric(const float *p, const uint8 *in, int32 n,
+                         float *out) {
+  for (int32 i = 0; i < n; i++)
+    out[i] = DecodeChar(p, in[i]);
+}
+
+void EncodeUint8Generic(float min_value, float range, const float *in,
+                        int32 n, uint8 *out) {
+  for (int32 i = 0; i < n; i++)
+    out[i] = EncodeUint8(min_value, range, in[i]);
+}
+
+void EncodeUint16Generic(float min_value, float range, const float *in,
+                         int32 n, uint16 *out) {
+  for (int32 i = 0; i < n; i++)
+    out[i] = EncodeUint16(min_value, range, in[i]);
+}
+
+#ifdef KALDI_COMPRESSED_MATRIX_X86_SIMD
+
+// Each of the x86 kernels calls _mm256_zeroupper() after its vector loop,
+// because some compilers do not insert it when the function returns to
+// non-AVX code, and without it the following SSE code can be very slow.
+
+__attribute__((target("avx2")))
+void DecodeUint8Avx2(float min_value, float increment, const uint8 *in,
+                     int32 n, float *out) {
+  const __m256 min_v = _mm256_set1_ps(min_value),
+      inc_v = _mm256_set1_ps(increment);
+  int32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i)));
+    _mm256_storeu_ps(out + i, _mm256_add_ps(
+        min_v, _mm256_mul_ps(_mm256_cvtepi32_ps(v), inc_v)));
+  }
+  _mm256_zeroupper();
+  DecodeUint8Generic(min_value, increment, in + i, n - i, out + i);
+}
+
+__attribute__((target("avx2")))
+void DecodeUint16Avx2(float min_value, float increment, const uint16 *in,
+                      int32 n, float *out) {
+  const __m256 min_v = _mm256_set1_ps(min_value),
+      inc_v = _mm256_set1_ps(increment);
+  int32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_cvtepu16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+    _mm256_storeu_ps(out + i, _mm256_add_ps(
+        min_v, _mm256_mul_ps(_mm256_cvtepi32_ps(v), inc_v)));
+  }
+  _mm256_zeroupper();
+  DecodeUint16Generic(min_value, increment, in + i, n - i, out + i);
+}
+
+__attribute__((target("avx2")))
+void DecodeColumnAvx2(const float *p, const uint8 *in, int32 n, float *out) {
+  // Each byte value selects one of three segments; for each segment we have
+  // the base (p0, p25 or p75), the width of the segment, the byte value at its
+  // start and the scale, which is applied in double precision as in
+  // DecodeChar().
+  const __m256 base0 = _mm256_set1_ps(p[0]), base1 = _mm256_set1_ps(p[1]),
+      base2 = _mm256_set1_ps(p[2]),
+      width0 = _mm256_set1_ps(p[1] - p[0]),
+      width1 = _mm256_set1_ps(p[2] - p[1]),
+      width2 = _mm256_set1_ps(p[3] - p[2]),
+      start0 = _mm256_setzero_ps(), start1 = _mm256_set1_ps(64.0f),
+      start2 = _mm256_set1_ps(192.0f);
+  const __m256d scale0 = _mm256_set1_pd(1/64.0),
+      scale1 = _mm256_set1_pd(1/128.0), scale2 = _mm256_set1_pd(1/63.0);
+  const __m256i i64 = _mm256_set1_epi32(64), i192 = _mm256_set1_epi32(192);
+  int32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i)));
+    __m256i gt64 = _mm256_cmpgt_epi32(v, i64),
+        gt192 = _mm256_cmpgt_epi32(v, i192);
+    __m256 m1 = _mm256_castsi256_ps(gt64), m2 = _mm256_castsi256_ps(gt192);
+    __m256 base = _mm256_blendv_ps(_mm256_blendv_ps(base0, base1, m1),
+                                   base2, m2),
+        width = _mm256_blendv_ps(_mm256_blendv_ps(width0, width1, m1),
+                                 width2, m2),
+        start = _mm256_blendv_ps(_mm256_blendv_ps(start0, start1, m1),
+                                 start2, m2);
+    __m256 prod = _mm256_mul_ps(width,
+                                _mm256_sub_ps(_mm256_cvtepi32_ps(v), start));
+    for (int32 half = 0; half < 2; half++) {
+      __m128i h1 = (half == 0 ? _mm256_castsi256_si128(gt64) :
+                    _mm256_extracti128_si256(gt64, 1)),
+          h2 = (half == 0 ? _mm256_castsi256_si128(gt192) :
+                _mm256_extracti128_si256(gt192, 1));
+      __m256d d1 = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(h1)),
+          d2 = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(h2));
+      __m256d scale = _mm256_blendv_pd(_mm256_blendv_pd(scale0, scale1, d1),
+                                       scale2, d2);
+      __m128 b = (half == 0 ? _mm256_castps256_ps128(base) :
+                  _mm256_extractf128_ps(base, 1)),
+          q = (half == 0 ? _mm256_castps256_ps128(prod) :
+               _mm256_extractf128_ps(prod, 1));
+      __m256d r = _mm256_add_pd(_mm256_cvtps_pd(b),
+                                _mm256_mul_pd(_mm256_cvtps_pd(q), scale));
+      _mm_storeu_ps(out + i + 4 * half, _mm256_cvtpd_ps(r));
+    }
+  }
+  _mm256_zeroupper();
+  DecodeColumnGeneric(p, in + i, n - i, out + i);
+}
+
+// Returns the 8 elements of 'in' encoded as in EncodeUint16(), as int32.
+__attribute__((target("avx2")))
+inline void EncodeAvx2(__m256 min_v, __m256 range_v, __m256 max_int,
+                       const float *in, __m128i *lo, __m128i *hi) {
+  __m256 f = _mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(in), min_v),
+                           range_v);
+  f = _mm256_max_ps(_mm256_min_ps(f, _mm256_set1_ps(1.0f)),
+                    _mm256_setzero_ps());
+  f = _mm256_mul_ps(f, max_int);
+  const __m256d round = _mm256_set1_pd(0.499);
+  *lo = _mm256_cvttpd_epi32(_mm256_add_pd(
+      _mm256_cvtps_pd(_mm256_castps256_ps128(f)), round));
+  *hi = _mm256_cvttpd_epi32(_mm256_add_pd(
+      _mm256_cvtps_pd(_mm256_extractf128_ps(f, 1)), round));
+}
+
+__attribute__((target("avx2")))
+void EncodeUint8Avx2(float min_value, float range, const float *in,
+                     int32 n, uint8 *out) {
+  const __m256 min_v = _mm256_set1_ps(min_value),
+      range_v = _mm256_set1_ps(range), max_int = _mm256_set1_ps(255.0f);
+  int32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i lo, hi;
+    EncodeAvx2(min_v, range_v, max_int, in + i, &lo, &hi);
+    __m128i w = _mm_packus_epi32(lo, hi);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+                     _mm_packus_epi16(w, w));
+  }
+  _mm256_zeroupper();
+  EncodeUint8Generic(min_value, range, in + i, n - i, out + i);
+}
+
+__attribute__((target("avx2")))
+void EncodeUint16Avx2(float min_value, float range, const float *in,
+                      int32 n, uint16 *out) {
+  const __m256 min_v = _mm256_set1_ps(min_value),
+      range_v = _mm256_set1_ps(range), max_int = _mm256_set1_ps(65535.0f);
+  int32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i lo, hi;
+    EncodeAvx2(min_v, range_v, max_int, in + i, &lo, &hi);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                     _mm_packus_epi32(lo, hi));
+  }
+  _mm256_zeroupper();
+  EncodeUint16Generic(min_value, range, in + i, n - i, out + i);
+}
+
+#endif  // KALDI_COMPRESSED_MATRIX_X86_SIMD
+
+#ifdef KALDI_COMPRESSED_MATRIX_NEON
+
+void DecodeUint8Neon(float min_value, float increment, const uint8 *in,
+                     int32 n, float *out) {
+  const float32x4_t min_v = vdupq_n_f32(min_value),
+      inc_v = vdupq_n_f32(increment);
+  int32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint16x8_t w = vmovl_u8(vld1_u8(in + i));
+    vst1q_f32(out + i, vaddq_f32(min_v, vmulq_f32(
+        vcvtq_f32_u32(vmovl_u16(vget_low_u16(w))), inc_v)));
+    vst1q_f32(out + i + 4, vaddq_f32(min_v, vmulq_f32(
+        vcvtq_f32_u32(vmovl_high_u16(w)), inc_v)));
+  }
+  DecodeUint8Generic(min_value, increment, in + i, n - i, out + i);
+}
+
+void DecodeUint16Neon(float min_value, float increment, const uint16 *in,
+                      int32 n, float *out) {
+  const float32x4_t min_v = vdupq_n_f32(min_value),
+      inc_v = vdupq_n_f32(increment);
+  int32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint16x8_t w = vld1q_u16(in + i);
+    vst1q_f32(out + i, vaddq_f32(min_v, vmulq_f32(
+        vcvtq_f32_u32(vmovl_u16(vget_low_u16(w))), inc_v)));
+    vst1q_f32(out + i + 4, vaddq_f32(min_v, vmulq_f32(
+        vcvtq_f32_u32(vmovl_high_u16(w)), inc_v)));
+  }
+  DecodeUint16Generic(min_value, increment, in + i, n - i, out + i);
+}
+
+// Decodes 4 bytes (as uint32) of a column; see DecodeColumnAvx2().
+inline float32x4_t DecodeColumnNeon4(const float *p, uint32x4_t v) {
+  uint32x4_t m1 = vcgtq_u32(v, vdupq_n_u32(64)),
+      m2 = vcgtq_u32(v, vdupq_n_u32(192));
+  float32x4_t base = vbslq_f32(m2, vdupq_n_f32(p[2]),
+                               vbslq_f32(m1, vdupq_n_f32(p[1]),
+                                         vdupq_n_f32(p[0]))),
+      width = vbslq_f32(m2, vdupq_n_f32(p[3] - p[2]),
+                        vbslq_f32(m1, vdupq_n_f32(p[2] - p[1]),
+                                  vdupq_n_f32(p[1] - p[0]))),
+      start = vbslq_f32(m2, vdupq_n_f32(192.0f),
+                        vbslq_f32(m1, vdupq_n_f32(64.0f), vdupq_n_f32(0.0f)));
+  float32x4_t prod = vmulq_f32(width, vsubq_f32(vcvtq_f32_u32(v), start));
+  int32x4_t s1 = vreinterpretq_s32_u32(m1), s2 = vreinterpretq_s32_u32(m2);
+  uint64x2_t d1_lo = vreinterpretq_u64_s64(vmovl_s32(vget_low_s32(s1))),
+      d1_hi = vreinterpretq_u64_s64(vmovl_high_s32(s1)),
+      d2_lo = vreinterpretq_u64_s64(vmovl_s32(vget_low_s32(s2))),
+      d2_hi = vreinterpretq_u64_s64(vmovl_high_s32(s2));
+  const float64x2_t scale0 = vdupq_n_f64(1/64.0),
+      scale1 = vdupq_n_f64(1/128.0), scale2 = vdupq_n_f64(1/63.0);
+  float64x2_t scale_lo = vbslq_f64(d2_lo, scale2,
+                                   vbslq_f64(d1_lo, scale1, scale0)),
+      scale_hi = vbslq_f64(d2_hi, scale2, vbslq_f64(d1_hi, scale1, scale0));
+  float64x2_t r_lo = vaddq_f64(vcvt_f64_f32(vget_low_f32(base)),
+                               vmulq_f64(vcvt_f64_f32(vget_low_f32(prod)),
+                                         scale_lo)),
+      r_hi = vaddq_f64(vcvt_high_f64_f32(base),
+                       vmulq_f64(vcvt_high_f64_f32(prod), scale_hi));
+  return vcvt_high_f32_f64(vcvt_f32_f64(r_lo), r_hi);
+}
+
+void DecodeColumnNeon(const float *p, const uint8 *in, int32 n, float *out) {
+  int32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint16x8_t w = vmovl_u8(vld1_u8(in + i));
+    vst1q_f32(out + i, DecodeColumnNeon4(p, vmovl_u16(vget_low_u16(w))));
+    vst1q_f32(out + i + 4, DecodeColumnNeon4(p, vmovl_high_u16(w)));
+  }
+  DecodeColumnGeneric(p, in + i, n - i, out + i);
+}
+
+// Returns the 4 elements of 'in' encoded as in EncodeUint16(), as uint32.
+inline uint32x4_t EncodeNeon4(float32x4_t min_v, float32x4_t range_v,
+                              float32x4_t max_int, const float *in) {
+  float32x4_t f = vdivq_f32(vsubq_f32(vld1q_f32(in), min_v), range_v);
+  f = vmaxq_f32(vminq_f32(f, vdupq_n_f32(1.0f)), vdupq_n_f32(0.0f));
+  f = vmulq_f32(f, max_int);
+  const float64x2_t round = vdupq_n_f64(0.499);
+  int64x2_t lo = vcvtq_s64_f64(vaddq_f64(vcvt_f64_f32(vget_low_f32(f)),
+                                         round)),
+      hi = vcvtq_s64_f64(vaddq_f64(vcvt_high_f64_f32(f), round));
+  return vreinterpretq_u32_s32(vcombine_s32(vmovn_s64(lo), vmovn_s64(hi)));
+}
+
+void EncodeUint8Neon(float min_value, float range, const float *in,
+                     int32 n, uint8 *out) {
+  const float32x4_t min_v = vdupq_n_f32(min_value),
+      range_v = vdupq_n_f32(range), max_int = vdupq_n_f32(255.0f);
+  int32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint16x8_t w = vcombine_u16(
+        vmovn_u32(EncodeNeon4(min_v, range_v, max_int, in + i)),
+        vmovn_u32(EncodeNeon4(min_v, range_v, max_int, in + i + 4)));
+    vst1_u8(out + i, vmovn_u16(w));
+  }
+  EncodeUint8Generic(min_value, range, in + i, n - i, out + i);
+}
+
+void EncodeUint16Neon(float min_value, float range, const float *in,
+                      int32 n, uint16 *out) {
+  const float32x4_t min_v = vdupq_n_f32(min_value),
+      range_v = vdupq_n_f32(range), max_int = vdupq_n_f32(65535.0f);
+  int32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    vst1q_u16(out + i, vcombine_u16(
+        vmovn_u32(EncodeNeon4(min_v, range_v, max_int, in + i)),
+        vmovn_u32(EncodeNeon4(min_v, range_v, max_int, in + i + 4))));
+  }
+  EncodeUint16Generic(min_value, range, in + i, n - i, out + i);
+}
+
+#endif  // KALDI_COMPRESSED_MATRIX_NEON
+
+struct CompressionKernels {
+  const char *name;
+  void (*decode_uint8)(float min_value, float increment, const uint8 *in,
+                       int32 n, float *out);
+  void (*decode_uint16)(float min_value, float increment, const uint16 *in,
+                        int32 n, float *out);
+  void (*decode_column)(const float *p, const uint8 *in, int32 n, float *out);
+  void (*encode_uint8)(float min_value, float range, const float *in,
+                       int32 n, uint8 *out);
+  void (*encode_uint16)(float min_value, float range, const float *in,
+                        int32 n, uint16 *out);
+};
+
+const CompressionKernels kGenericKernels = {
+  "generic", DecodeUint8Generic, DecodeUint16Generic, DecodeColumnGeneric,
+  EncodeUint8Generic, EncodeUint16Generic
+};
+
+#ifdef KALDI_COMPRESSED_MATRIX_X86_SIMD
+const CompressionKernels kAvx2Kernels = {
+  "avx2", DecodeUint8Avx2, DecodeUint16Avx2, DecodeColumnAvx2,
+  EncodeUint8Avx2, EncodeUint16Avx2
+};
+#endif
+#ifdef KALDI_COMPRESSED_MATRIX_NEON
+const CompressionKernels kNeonKernels = {
+  "neon", DecodeUint8Neon, DecodeUint16Neon, DecodeColumnNeon,
+  EncodeUint8Neon, EncodeUint16Neon
+};
+#endif
+
+const CompressionKernels *SelectSimdKernels() {
+#ifdef KALDI_COMPRESSED_MATRIX_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return &kAvx2Kernels;
+#endif
+#ifdef KALDI_COMPRESSED_MATRIX_NEON
+  return &kNeonKernels;
+#endif
+  return &kGenericKernels;
+}
+
+bool compressed_matrix_use_simd = true;
+
+const CompressionKernels &Kernels() {
+  static const CompressionKernels *simd_kernels = SelectSimdKernels();
+  return (compressed_matrix_use_simd ? *simd_kernels : kGenericKernels);
+}
+
+// The kernels work on float; these functions take care of rows of double.
+// DecodeTarget() returns the location to decode a row of n elements to, and
+// FinishDecode() copies it to the row if that was not the row itself.
+inline float *DecodeTarget(float *row, int32 n, std::vector<float> *buffer) {
+  return row;
+}
+inline float *DecodeTarget(double *row, int32 n, std::vector<float> *buffer) {
+  if (buffer->size() < static_cast<size_t>(n)) buffer->resize(n);
+  return buffer->data();
+}
+inline void FinishDecode(const float *decoded, int32 n, float *row) { }
+inline void FinishDecode(const float *decoded, int32 n, double *row) {
+  for (int32 i = 0; i < n; i++)
+    row[i] = decoded[i];
+}
+// EncodeSource() returns the row as float.
+inline const float *EncodeSource(const float *row, int32 n,
+                                 std::vector<float> *buffer) {
+  return row;
+}
+inline const float *EncodeSource(const double *row, int32 n,
+                                 std::vector<float> *buffer) {
+  if (buffer->size() < static_cast<size_t>(n)) buffer->resize(n);
+  for (int32 i = 0; i < n; i++)
+    (*buffer)[i] = row[i];
+  return buffer->data();
+}
+
+}  // namespace
+
+void CompressedMatrix::SetUseSimd(bool use_simd) {
+  compressed_matrix_use_simd = use_simd;
+}
+
+const char *CompressedMatrix::SimdKernelName() {
+  return Kernels().name;
+}
+
 //static
 MatrixIndexT CompressedMatrix::DataSize(const GlobalHeader &header) {
   // Returns size in bytes of the data.
@@ -166,10 +590,12 @@ void CompressedMatrix::CopyFromMat(
     uint16 *data = reinterpret_cast<uint16*>(static_cast<char*>(data_) +
                                              sizeof(GlobalHeader));
     int32 num_rows = mat.NumRows(), num_cols = mat.NumCols();
+    const CompressionKernels &kernels = Kernels();
+    std::vector<float> buffer;
     for (int32 r = 0; r < num_rows; r++) {
-      const Real *row_data = mat.RowData(r);
-      for (int32 c = 0; c < num_cols; c++)
-        data[c] = FloatToUint16(global_header, row_data[c]);
+      kernels.encode_uint16(global_header.min_value, global_header.range,
+                            EncodeSource(mat.RowData(r), num_cols, &buffer),
+                            num_cols, data);
       data += num_cols;
     }
   } else {
@@ -177,10 +603,12 @@ void CompressedMatrix::CopyFromMat(
     uint8 *data = reinterpret_cast<uint8*>(static_cast<char*>(data_) +
                                            sizeof(GlobalHeader));
     int32 num_rows = mat.NumRows(), num_cols = mat.NumCols();
+    const CompressionKernels &kernels = Kernels();
+    std::vector<float> buffer;
     for (int32 r = 0; r < num_rows; r++) {
-      const Real *row_data = mat.RowData(r);
-      for (int32 c = 0; c < num_cols; c++)
-        data[c] = FloatToUint8(global_header, row_data[c]);
+      kernels.encode_uint8(global_header.min_value, global_header.range,
+                           EncodeSource(mat.RowData(r), num_cols, &buffer),
+                           num_cols, data);
       data += num_cols;
     }
   }
@@ -347,24 +775,14 @@ CompressedMatrix& CompressedMatrix::operator =(const MatrixBase<double> &mat);
 inline uint16 CompressedMatrix::FloatToUint16(
     const GlobalHeader &global_header,
     float value) {
-  float f = (value - global_header.min_value) /
-      global_header.range;
-  if (f > 1.0) f = 1.0;  // Note: this should not happen.
-  if (f < 0.0) f = 0.0;  // Note: this should not happen.
-  return static_cast<int>(f * 65535 + 0.499);  // + 0.499 is to
-  // round to closest int; avoids bias.
+  return EncodeUint16(global_header.min_value, global_header.range, value);
 }
 
 
 inline uint8 CompressedMatrix::FloatToUint8(
     const GlobalHeader &global_header,
     float value) {
-  float f = (value - global_header.min_value) /
-      global_header.range;
-  if (f > 1.0) f = 1.0;  // Note: this should not happen.
-  if (f < 0.0) f = 0.0;  // Note: this should not happen.
-  return static_cast<int>(f * 255 + 0.499);  // + 0.499 is to
-  // round to closest int; avoids bias.
+  return EncodeUint8(global_header.min_value, global_header.range, value);
 }
 
 
@@ -490,13 +908,8 @@ inline uint8 CompressedMatrix::FloatToChar(
 inline float CompressedMatrix::CharToFloat(
     float p0, float p25, float p75, float p100,
     uint8 value) {
-  if (value <= 64) {
-    return p0 + (p25 - p0) * value * (1/64.0);
-  } else if (value <= 192) {
-    return p25 + (p75 - p25) * (value - 64) * (1/128.0);
-  } else {
-    return p75 + (p100 - p75) * (value - 192) * (1/63.0);
-  }
+  const float p[4] = { p0, p25, p75, p100 };
+  return DecodeChar(p, value);
 }
 
 
@@ -631,19 +1044,26 @@ void CompressedMatrix::CopyToMat(MatrixBase<Real> *mat,
   KALDI_ASSERT(mat->NumCols() == num_cols);
 
   DataFormat format = static_cast<DataFormat>(h->format);
+  const CompressionKernels &kernels = Kernels();
+  std::vector<float> buffer;
   if (format == kOneByteWithColHeaders) {
     PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
     uint8 *byte_data = reinterpret_cast<uint8*>(per_col_header +
                                                 h->num_cols);
+    // The columns are decoded into 'buffer' and then copied to the
+    // (strided) columns of 'mat'.
+    buffer.resize(num_rows);
+    Real *mat_data = mat->Data();
+    MatrixIndexT stride = mat->Stride();
     for (int32 i = 0; i < num_cols; i++, per_col_header++) {
-      float p0 = Uint16ToFloat(*h, per_col_header->percentile_0),
-          p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
-          p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
-          p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
-      for (int32 j = 0; j < num_rows; j++, byte_data++) {
-        float f = CharToFloat(p0, p25, p75, p100, *byte_data);
-        (*mat)(j, i) = f;
-      }
+      float p[4] = { Uint16ToFloat(*h, per_col_header->percentile_0),
+                     Uint16ToFloat(*h, per_col_header->percentile_25),
+                     Uint16ToFloat(*h, per_col_header->percentile_75),
+                     Uint16ToFloat(*h, per_col_header->percentile_100) };
+      kernels.decode_column(p, byte_data, num_rows, buffer.data());
+      for (int32 j = 0; j < num_rows; j++)
+        mat_data[j * stride + i] = buffer[j];
+      byte_data += num_rows;
     }
   } else if (format == kTwoByte) {
     const uint16 *data = reinterpret_cast<const uint16*>(h + 1);
@@ -651,8 +1071,9 @@ void CompressedMatrix::CopyToMat(MatrixBase<Real> *mat,
         increment = h->range * (1.0 / 65535.0);
     for (int32 i = 0; i < num_rows; i++) {
       Real *row_data = mat->RowData(i);
-      for (int32 j = 0; j < num_cols; j++)
-        row_data[j] = min_value + data[j] * increment;
+      float *target = DecodeTarget(row_data, num_cols, &buffer);
+      kernels.decode_uint16(min_value, increment, data, num_cols, target);
+      FinishDecode(target, num_cols, row_data);
       data += num_cols;
     }
   } else {
@@ -662,8 +1083,9 @@ void CompressedMatrix::CopyToMat(MatrixBase<Real> *mat,
     const uint8 *data = reinterpret_cast<const uint8*>(h + 1);
     for (int32 i = 0; i < num_rows; i++) {
       Real *row_data = mat->RowData(i);
-      for (int32 j = 0; j < num_cols; j++)
-        row_data[j] = min_value + data[j] * increment;
+      float *target = DecodeTarget(row_data, num_cols, &buffer);
+      kernels.decode_uint8(min_value, increment, data, num_cols, target);
+      FinishDecode(target, num_cols, row_data);
       data += num_cols;
     }
   }
@@ -706,8 +1128,10 @@ void CompressedMatrix::CopyRowToVec(MatrixIndexT row,
         increment = h->range * (1.0 / 65535.0);
     const uint16 *row_data = reinterpret_cast<uint16*>(h + 1) + (num_cols * row);
     Real *v_data = v->Data();
-    for (int32 c = 0; c < num_cols; c++)
-      v_data[c] = min_value + row_data[c] * increment;
+    std::vector<float> buffer;
+    float *target = DecodeTarget(v_data, num_cols, &buffer);
+    Kernels().decode_uint16(min_value, increment, row_data, num_cols, target);
+    FinishDecode(target, num_cols, v_data);
   } else {
     KALDI_ASSERT(format == kOneByte);
     int32 num_cols = h->num_cols;
@@ -715,8 +1139,10 @@ void CompressedMatrix::CopyRowToVec(MatrixIndexT row,
         increment = h->range * (1.0 / 255.0);
     const uint8 *row_data = reinterpret_cast<uint8*>(h + 1) + (num_cols * row);
     Real *v_data = v->Data();
-    for (int32 c = 0; c < num_cols; c++)
-      v_data[c] = min_value + row_data[c] * increment;
+    std::vector<float> buffer;
+    float *target = DecodeTarget(v_data, num_cols, &buffer);
+    Kernels().decode_uint8(min_value, increment, row_data, num_cols, target);
+    FinishDecode(target, num_cols, v_data);
   }
 }
 
@@ -736,14 +1162,16 @@ void CompressedMatrix::CopyColToVec(MatrixIndexT col,
                                                 h->num_cols);
     byte_data += col*h->num_rows;  // point to first value in the column we want
     per_col_header += col;
-    float p0 = Uint16ToFloat(*h, per_col_header->percentile_0),
-        p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
-        p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
-        p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
-    for (int32 i = 0; i < h->num_rows; i++, byte_data++) {
-      float f = CharToFloat(p0, p25, p75, p100, *byte_data);
-      (*v)(i) = f;
-    }
+    float p[4] = { Uint16ToFloat(*h, per_col_header->percentile_0),
+                   Uint16ToFloat(*h, per_col_header->percentile_25),
+                   Uint16ToFloat(*h, per_col_header->percentile_75),
+                   Uint16ToFloat(*h, per_col_header->percentile_100) };
+    int32 num_rows = h->num_rows;
+    Real *v_data = v->Data();
+    std::vector<float> buffer;
+    float *target = DecodeTarget(v_data, num_rows, &buffer);
+    Kernels().decode_column(p, byte_data, num_rows, target);
+    FinishDecode(target, num_rows, v_data);
   } else if (format == kTwoByte) {
     int32 num_rows = h->num_rows, num_cols = h->num_cols;
     float min_value = h->min_value,
@@ -790,6 +1218,8 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
       tgt_cols = dest->NumCols(), tgt_rows = dest->NumRows();
 
   DataFormat format = static_cast<DataFormat>(h->format);
+  const CompressionKernels &kernels = Kernels();
+  std::vector<float> buffer;
   if (format == kOneByteWithColHeaders) {
     PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
     uint8 *byte_data = reinterpret_cast<uint8*>(per_col_header +
@@ -801,18 +1231,19 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
 
     per_col_header += col_offset;  // skip the appropriate number of headers
 
+    buffer.resize(tgt_rows);
+    Real *dest_data = dest->Data();
+    MatrixIndexT stride = dest->Stride();
     for (int32 i = 0;
          i < tgt_cols;
          i++, per_col_header++, start_of_subcol+=num_rows) {
-      byte_data = start_of_subcol;
-      float p0 = Uint16ToFloat(*h, per_col_header->percentile_0),
-          p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
-          p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
-          p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
-      for (int32 j = 0; j < tgt_rows; j++, byte_data++) {
-        float f = CharToFloat(p0, p25, p75, p100, *byte_data);
-        (*dest)(j, i) = f;
-      }
+      float p[4] = { Uint16ToFloat(*h, per_col_header->percentile_0),
+                     Uint16ToFloat(*h, per_col_header->percentile_25),
+                     Uint16ToFloat(*h, per_col_header->percentile_75),
+                     Uint16ToFloat(*h, per_col_header->percentile_100) };
+      kernels.decode_column(p, start_of_subcol, tgt_rows, buffer.data());
+      for (int32 j = 0; j < tgt_rows; j++)
+        dest_data[j * stride + i] = buffer[j];
     }
   } else if (format == kTwoByte) {
     const uint16 *data = reinterpret_cast<const uint16*>(h+1) + col_offset +
@@ -822,8 +1253,9 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
 
     for (int32 row = 0; row < tgt_rows; row++) {
       Real *dest_row = dest->RowData(row);
-      for (int32 col = 0; col < tgt_cols; col++)
-        dest_row[col] = min_value + increment * data[col];
+      float *target = DecodeTarget(dest_row, tgt_cols, &buffer);
+      kernels.decode_uint16(min_value, increment, data, tgt_cols, target);
+      FinishDecode(target, tgt_cols, dest_row);
       data += num_cols;
     }
   } else {
@@ -834,8 +1266,9 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
         increment = h->range * (1.0 / 255.0);
     for (int32 row = 0; row < tgt_rows; row++) {
       Real *dest_row = dest->RowData(row);
-      for (int32 col = 0; col < tgt_cols; col++)
-        dest_row[col] = min_value + increment * data[col];
+      float *target = DecodeTarget(dest_row, tgt_cols, &buffer);
+      kernels.decode_uint8(min_value, increment, data, tgt_cols, target);
+      FinishDecode(target, tgt_cols, dest_row);
       data += num_cols;
     }
   }
@@ -176,8 +176,23 @@ class CompressedMatrix {
   /// It scales the floating point values in GlobalHeader by alpha.
   void Scale(float alpha);
 
+  /// By default, compression (for kTwoByteAuto, kOneByteAuto and the other
+  /// methods that use a global range) and decompression use SIMD kernels
+  /// where available: AVX2 on x86 if the CPU supports it, and NEON on 64-bit
+  /// ARM.  Their output is the same as that of the generic code.
+  /// SetUseSimd(false) forces the generic code; it is intended for testing and
+  /// benchmarking.
+  static void SetUseSimd(bool use_simd);
+
+  /// Returns the name of the kernels currently in use, e.g. "avx2" or
+  /// "generic".
+  static const char *SimdKernelName();
+
   friend class Matrix<float>;
   friend class Matrix<double>;
+  // CuMatrixBase::CopyFromCompressedMat() decompresses the data on the GPU,
+  // so it needs to know the format.
+  template<typename Real> friend class CuMatrixBase;
  private:
 
   // This enum describes the different compressed-data formats: these are
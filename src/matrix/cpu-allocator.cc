@@ -0,0 +1,164 @@
+// matrix/cpu-allocator.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <new>
+#include <vector>
+
+#include "matrix/cpu-allocator.h"
+
+namespace kaldi {
+
+namespace {
+
+// Each block starts with a header of kHeaderSize bytes (which keeps the
+// alignment of what follows) containing its size class, or -1 if it is not
+// cached.
+const size_t kHeaderSize = 16;
+
+// The size classes are 64 bytes, and then four per power of two,
+// i.e. 80, 96, 112, 128, 160, ... bytes, up to kMaxCachedSize.
+const size_t kMinClassSize = 64, kMaxCachedSize = 1 << 20;
+const int32 kNumClasses = 4 * 14 + 1;  // 64 bytes to 1MB.
+
+// Returns the class of blocks of at least 'size' bytes, size <= kMaxCachedSize.
+inline int32 SizeClass(size_t size) {
+  if (size <= kMinClassSize)
+    return 0;
+  size_t n = size - 1;
+  int32 e = 0;  // 2^e <= n < 2^(e+1); e >= 6.
+  while ((n >> (e + 1)) != 0) e++;
+  int32 m = static_cast<int32>((n >> (e - 2)) & 3);
+  return (e - 6) * 4 + m + 1;
+}
+
+inline size_t ClassSize(int32 c) {
+  if (c == 0)
+    return kMinClassSize;
+  int32 e = (c - 1) / 4 + 6, m = (c - 1) % 4;
+  return static_cast<size_t>(4 + m + 1) << (e - 2);
+}
+
+bool cache_memory = false;
+size_t max_cached_bytes = 64 << 20;
+
+// The statistics of the threads that have exited; each thread keeps its own
+// in ThreadCache, so as not to need atomic operations for every allocation.
+std::atomic<int64> exited_num_allocations(0), exited_num_cache_hits(0);
+
+// Set when the cache of this thread has been destroyed (at thread exit), after
+// which memory freed by the thread, e.g. by static objects, is not cached.
+thread_local bool thread_cache_destroyed = false;
+
+struct ThreadCache {
+  std::vector<void*> free_blocks[kNumClasses];
+  size_t bytes_cached;
+  int64 num_allocations;
+  int64 num_cache_hits;
+
+  ThreadCache(): bytes_cached(0), num_allocations(0), num_cache_hits(0) { }
+  ~ThreadCache() {
+    for (int32 c = 0; c < kNumClasses; c++)
+      for (size_t i = 0; i < free_blocks[c].size(); i++)
+        KALDI_MEMALIGN_FREE(free_blocks[c][i]);
+    exited_num_allocations += num_allocations;
+    exited_num_cache_hits += num_cache_hits;
+    thread_cache_destroyed = true;
+  }
+};
+
+ThreadCache &GetThreadCache() {
+  static thread_local ThreadCache cache;
+  return cache;
+}
+
+inline void *AllocateBlock(size_t size, int32 size_class) {
+  void *data, *temp;
+  if ((data = KALDI_MEMALIGN(16, size, &temp)) == NULL)
+    throw std::bad_alloc();
+  *static_cast<int32*>(data) = size_class;
+  return data;
+}
+
+}  // namespace
+
+
+void SetCpuAllocatorOptions(const CpuAllocatorOptions &opts) {
+  KALDI_ASSERT(opts.max_cached_mb >= 0);
+  cache_memory = opts.cache_memory;
+  max_cached_bytes = static_cast<size_t>(opts.max_cached_mb) << 20;
+}
+
+void *CpuAllocate(size_t size) {
+  size_t total_size = size + kHeaderSize;
+  void *block;
+  if (!cache_memory || thread_cache_destroyed) {
+    block = AllocateBlock(total_size, -1);
+  } else {
+    ThreadCache &cache = GetThreadCache();
+    cache.num_allocations++;
+    if (total_size > kMaxCachedSize)
+      return static_cast<char*>(AllocateBlock(total_size, -1)) + kHeaderSize;
+    int32 c = SizeClass(total_size);
+    std::vector<void*> &free_blocks = cache.free_blocks[c];
+    if (!free_blocks.empty()) {
+      block = free_blocks.back();
+      free_blocks.pop_back();
+      cache.bytes_cached -= ClassSize(c);
+      cache.num_cache_hits++;
+    } else {
+      block = AllocateBlock(ClassSize(c), c);
+    }
+  }
+  return static_cast<char*>(block) + kHeaderSize;
+}
+
+void CpuFree(void *ptr) {
+  if (ptr == NULL)
+    return;
+  void *block = static_cast<char*>(ptr) - kHeaderSize;
+  int32 c = *static_cast<int32*>(block);
+  if (c >= 0 && cache_memory && !thread_cache_destroyed) {
+    ThreadCache &cache = GetThreadCache();
+    size_t class_size = ClassSize(c);
+    if (cache.bytes_cached + class_size <= max_cached_bytes) {
+      cache.free_blocks[c].push_back(block);
+      cache.bytes_cached += class_size;
+      return;
+    }
+  }
+  KALDI_MEMALIGN_FREE(block);
+}
+
+void PrintCpuMemoryUsage() {
+  int64 allocations = exited_num_allocations, hits = exited_num_cache_hits;
+  size_t bytes_cached = 0;
+  if (!thread_cache_destroyed) {
+    const ThreadCache &cache = GetThreadCache();
+    allocations += cache.num_allocations;
+    hits += cache.num_cache_hits;
+    bytes_cached = cache.bytes_cached;
+  }
+  KALDI_LOG << "CPU matrix allocator: " << allocations << " allocations "
+            << "with caching on, " << hits << " of them ("
+            << (allocations == 0 ? 0.0 : 100.0 * hits / allocations)
+            << "%) from the caches; " << (bytes_cached / 1.0e+06)
+            << " MB cached by this thread; caching is "
+            << (cache_memory ? "on" : "off") << ".";
+}
+
+}  // namespace kaldi
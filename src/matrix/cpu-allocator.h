@@ -0,0 +1,81 @@
+// matrix/cpu-allocator.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_CPU_ALLOCATOR_H_
+#define KALDI_MATRIX_CPU_ALLOCATOR_H_
+
+#include <cstddef>
+
+#include "base/kaldi-common.h"
+#include "itf/options-itf.h"
+
+namespace kaldi {
+
+/**
+   Options for the allocator of the memory of Matrix, Vector and PackedMatrix
+   (and of CuMatrix and CuVector when no GPU is used).  Code in nnet3,
+   transform and ivector creates and destroys very many small temporaries, and
+   for these posix_memalign() and free() take a noticeable part of the time.
+   If cache_memory is true, freed blocks of up to 1MB are kept in a cache
+   private to the thread that freed them, in size classes (four per power of
+   two), and reused by later allocations of that thread; larger blocks, and
+   any that would take a thread's cache over max_cached_mb, are freed at once.
+   The caches are freed when their threads exit.
+*/
+struct CpuAllocatorOptions {
+  // True if we cache freed memory.  It is false by default, so the memory of
+  // matrices is returned to the system as soon as they are destroyed.
+  bool cache_memory;
+
+  // The largest amount of memory, in megabytes, that each thread keeps in its
+  // cache.
+  int32 max_cached_mb;
+
+  CpuAllocatorOptions(): cache_memory(false), max_cached_mb(64) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("cpu-cache-memory", &cache_memory, "If true, cache the "
+                   "memory of freed CPU matrices and vectors in each thread, "
+                   "for reuse; this speeds up code that creates many small "
+                   "temporaries.");
+    opts->Register("cpu-max-cached-mb", &max_cached_mb, "Maximum memory, in "
+                   "megabytes, cached per thread if --cpu-cache-memory=true.");
+  }
+};
+
+/// Sets the options of the allocator; this may be done at any time, e.g.
+/// after the options are read from the command line.  Blocks already in the
+/// caches stay there (until they are reused or their thread exits).
+void SetCpuAllocatorOptions(const CpuAllocatorOptions &opts);
+
+/// Returns memory aligned to 16 bytes, as KALDI_MEMALIGN(16, ...) does; throws
+/// std::bad_alloc on failure.  The memory must be freed with CpuFree(), which
+/// may be called from any thread.
+void *CpuAllocate(size_t size);
+
+/// Frees memory returned by CpuAllocate(); does nothing if 'ptr' is NULL.
+void CpuFree(void *ptr);
+
+/// Prints (with KALDI_LOG) statistics of the allocator: the number of
+/// allocations done while caching was on, by this thread and by the threads
+/// that have exited, how many of them were served from the caches, and the
+/// memory currently in the cache of this thread.
+void PrintCpuMemoryUsage();
+
+}  // namespace kaldi
+
+#endif  // KALDI_MATRIX_CPU_ALLOCATOR_H_
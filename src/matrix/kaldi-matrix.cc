@@ -28,6 +28,10 @@
 #include "matrix/jama-eig.h"
 #include "matrix/compressed-matrix.h"
 #include "matrix/sparse-matrix.h"
+#include "matrix/cpu-allocator.h"
+#include "matrix/simd-math.h"
+#include "matrix/small-gemm.h"
+#include "matrix/sparse-gemm.h"
 
 static_assert(int(kaldi::kNoTrans) == int(CblasNoTrans) && int(kaldi::kTrans) == int(CblasTrans), 
     "kaldi::kNoTrans and kaldi::kTrans must be equal to the appropriate CBLAS library constants!");
@@ -180,6 +184,10 @@ void MatrixBase<Real>::AddMatMat(const Real alpha,
                || (transA == kTrans && transB == kTrans && A.num_rows_ == B.num_cols_ && A.num_cols_ == num_rows_ && B.num_rows_ == num_cols_));
   KALDI_ASSERT(&A !=  this && &B != this);
   if (num_rows_ == 0) return;
+  if (SmallGemm(alpha, transA, A.data_, A.num_rows_, A.num_cols_, A.stride_,
+                transB, B.data_, B.stride_, beta, data_, num_rows_, num_cols_,
+                stride_))
+    return;
   cblas_Xgemm(alpha, transA, A.data_, A.num_rows_, A.num_cols_, A.stride_,
               transB, B.data_, B.stride_, beta, data_, num_rows_, num_cols_, stride_);
 
@@ -491,59 +499,9 @@ template<typename Real>
 void MatrixBase<Real>::AddMatSmat(Real alpha, const MatrixBase<Real> &A,
                                   const SparseMatrix<Real> &B,
                                   MatrixTransposeType transB, Real beta) {
-  if (transB == kNoTrans) {
-    KALDI_ASSERT(NumRows() == A.NumRows());
-    KALDI_ASSERT(NumCols() == B.NumCols());
-    KALDI_ASSERT(A.NumCols() == B.NumRows());
-
-    this->Scale(beta);
-    MatrixIndexT b_num_rows = B.NumRows(),
-        this_num_rows = this->NumRows();
-    // Iterate over the rows of sparse matrix B and columns of A.
-    for (MatrixIndexT k = 0; k < b_num_rows; ++k) {
-      const SparseVector<Real> &B_row_k = B.Row(k);
-      MatrixIndexT num_elems = B_row_k.NumElements();
-      const Real *a_col_k = A.Data() + k;
-      for (MatrixIndexT e = 0; e < num_elems; ++e) {
-        const std::pair<MatrixIndexT, Real> &p = B_row_k.GetElement(e);
-        MatrixIndexT j = p.first;
-        Real alpha_B_kj = alpha * p.second;
-        Real *this_col_j = this->Data() + j;
-        // Add to entire 'j'th column of *this at once using cblas_Xaxpy.
-        // pass stride to write a colmun as matrices are stored in row major order.
-        cblas_Xaxpy(this_num_rows, alpha_B_kj, a_col_k, A.stride_,
-                    this_col_j, this->stride_);
-        //for (MatrixIndexT i = 0; i < this_num_rows; ++i)
-        // this_col_j[i*this->stride_] +=  alpha_B_kj * a_col_k[i*A.stride_];
-      }
-    }
-  } else {
-    KALDI_ASSERT(NumRows() == A.NumRows());
-    KALDI_ASSERT(NumCols() == B.NumRows());
-    KALDI_ASSERT(A.NumCols() == B.NumCols());
-
-    this->Scale(beta);
-    MatrixIndexT b_num_rows = B.NumRows(),
-        this_num_rows = this->NumRows();
-    // Iterate over the rows of sparse matrix B and columns of *this.
-    for (MatrixIndexT j = 0; j < b_num_rows; ++j) {
-      const SparseVector<Real> &B_row_j = B.Row(j);
-      MatrixIndexT num_elems = B_row_j.NumElements();
-      Real *this_col_j = this->Data() + j;
-      for (MatrixIndexT e = 0; e < num_elems; ++e) {
-        const std::pair<MatrixIndexT, Real> &p = B_row_j.GetElement(e);
-        MatrixIndexT k = p.first;
-        Real alpha_B_jk = alpha * p.second;
-        const Real *a_col_k = A.Data() + k;
-        // Add to entire 'j'th column of *this at once using cblas_Xaxpy.
-        // pass stride to write a column as matrices are stored in row major order.
-        cblas_Xaxpy(this_num_rows, alpha_B_jk, a_col_k, A.stride_,
-                    this_col_j, this->stride_);
-        //for (MatrixIndexT i = 0; i < this_num_rows; ++i) 
-        // this_col_j[i*this->stride_] +=  alpha_B_jk * a_col_k[i*A.stride_];
-      }
-    }
-  }
+  // See sparse-gemm.h; the rows of A are processed in blocks, with SIMD, rather
+  // than with a strided cblas_Xaxpy() per nonzero element of B.
+  SparseGemm(alpha, A, B, transB, beta, this);
 }
 
 template<typename Real>
@@ -601,10 +559,10 @@ template<typename Real>
 void MatrixBase<Real>::AddMatDiagVec(
     const Real alpha,
     const MatrixBase<Real> &M, MatrixTransposeType transM,
-    VectorBase<Real> &v,
+    const VectorBase<Real> &v,
     Real beta) {
 
-  if (beta != 1.0) this->Scale(beta);
+  if (beta != 1.0 && beta != 0.0) this->Scale(beta);
 
   if (transM == kNoTrans) {
     KALDI_ASSERT(SameDim(*this, M));
@@ -625,6 +583,17 @@ void MatrixBase<Real>::AddMatDiagVec(
   Real *data = data_;
   const Real *Mdata = M.Data(), *vdata = v.Data();
   if (num_rows_ == 0) return;
+  if (beta == 0.0) {
+    // Overwrite *this, without a separate pass to zero it (and without
+    // propagating any NaN's it may contain).
+    for (MatrixIndexT i = 0; i < num_rows; i++) {
+      Real *row = data + i * stride;
+      const Real *Mrow = Mdata + i * M_row_stride;
+      for (MatrixIndexT j = 0; j < num_cols; j++)
+        row[j] = alpha * vdata[j] * Mrow[j * M_col_stride];
+    }
+    return;
+  }
   for (MatrixIndexT i = 0; i < num_rows; i++){
       for(MatrixIndexT j = 0; j < num_cols; j ++ ){
           data[i*stride + j] += alpha * vdata[j] * Mdata[i*M_row_stride + j*M_col_stride];
@@ -794,9 +763,6 @@ inline void Matrix<Real>::Init(const MatrixIndexT rows,
   KALDI_ASSERT(rows > 0 && cols > 0);
   MatrixIndexT skip, stride;
   size_t size;
-  void *data;  // aligned memory block
-  void *temp;  // memory block to be really freed
-
   // compute the size of skip and real cols
   skip = ((16 / sizeof(Real)) - cols % (16 / sizeof(Real)))
       % (16 / sizeof(Real));
@@ -805,14 +771,10 @@ inline void Matrix<Real>::Init(const MatrixIndexT rows,
       * sizeof(Real);
 
   // allocate the memory and set the right dimensions and parameters
-  if (NULL != (data = KALDI_MEMALIGN(16, size, &temp))) {
-    MatrixBase<Real>::data_        = static_cast<Real *> (data);
-    MatrixBase<Real>::num_rows_      = rows;
-    MatrixBase<Real>::num_cols_      = cols;
-    MatrixBase<Real>::stride_  = (stride_type == kDefaultStride ? stride : cols);
-  } else {
-    throw std::bad_alloc();
-  }
+  MatrixBase<Real>::data_        = static_cast<Real *> (CpuAllocate(size));
+  MatrixBase<Real>::num_rows_      = rows;
+  MatrixBase<Real>::num_cols_      = cols;
+  MatrixBase<Real>::stride_  = (stride_type == kDefaultStride ? stride : cols);
 }
 
 template<typename Real>
@@ -1128,7 +1090,7 @@ template<typename Real>
 void Matrix<Real>::Destroy() {
   // we need to free the data block if it was defined
   if (NULL != MatrixBase<Real>::data_)
-    KALDI_MEMALIGN_FREE( MatrixBase<Real>::data_);
+    CpuFree(MatrixBase<Real>::data_);
   MatrixBase<Real>::data_ = NULL;
   MatrixBase<Real>::num_rows_ = MatrixBase<Real>::num_cols_
       = MatrixBase<Real>::stride_ = 0;
@@ -1353,26 +1315,16 @@ void MatrixBase<Real>::SetUnit() {
 
 template<typename Real>
 void MatrixBase<Real>::SetRandn() {
-  kaldi::RandomState rstate;
-  for (MatrixIndexT row = 0; row < num_rows_; row++) {
-    Real *row_data = this->RowData(row);
-    MatrixIndexT nc = (num_cols_ % 2 == 1) ? num_cols_ - 1 : num_cols_;
-    for (MatrixIndexT col = 0; col < nc; col += 2) {
-      kaldi::RandGauss2(row_data + col, row_data + col + 1, &rstate);
-    }
-    if (nc != num_cols_) row_data[nc] = static_cast<Real>(kaldi::RandGauss(&rstate));
-  }
+  kaldi::RandomGenerator generator;
+  for (MatrixIndexT row = 0; row < num_rows_; row++)
+    generator.FillGauss(this->RowData(row), num_cols_);
 }
 
 template<typename Real>
 void MatrixBase<Real>::SetRandUniform() {
-  kaldi::RandomState rstate;
-  for (MatrixIndexT row = 0; row < num_rows_; row++) {
-    Real *row_data = this->RowData(row);
-    for (MatrixIndexT col = 0; col < num_cols_; col++, row_data++) {
-      *row_data = static_cast<Real>(kaldi::RandUniform(&rstate));
-    }
-  }
+  kaldi::RandomGenerator generator;
+  for (MatrixIndexT row = 0; row < num_rows_; row++)
+    generator.FillUniform(this->RowData(row), num_cols_);
 }
 
 template<typename Real>
@@ -1529,12 +1481,17 @@ void Matrix<Real>::Read(std::istream & is, bool binary, bool add) {
       specific_error << ": Expected \"[\", got \"" << str << '"';
       goto bad;
     }
-    // At this point, we have read "[".
-    std::vector<std::vector<Real>* > data;
-    std::vector<Real> *cur_row = new std::vector<Real>;
+    // At this point, we have read "[".  We store the elements in 'data', in
+    // row-major order, and the number of elements of each row in 'row_sizes'.
+    // We look at the characters through the stream buffer, and read the
+    // numbers with ReadRealText(), which is much faster than operator >>.
+    std::vector<Real> data;
+    std::vector<size_t> row_sizes;
+    size_t row_start = 0;  // index in 'data' of the start of the current row.
+    std::streambuf *sb = is.rdbuf();
     while (1) {
-      int i = is.peek();
-      if (i == -1) { specific_error << "Got EOF while reading matrix data"; goto cleanup; }
+      int i = sb->sgetc();
+      if (i == -1) { specific_error << "Got EOF while reading matrix data"; goto bad; }
       else if (static_cast<char>(i) == ']') {  // Finished reading matrix.
         is.get();  // eat the "]".
         i = is.peek();
@@ -1547,71 +1504,59 @@ void Matrix<Real>::Read(std::istream & is, bool binary, bool add) {
           // we got the data we needed, so just warn for this error.
         }
         // Now process the data.
-        if (!cur_row->empty()) data.push_back(cur_row);
-        else delete(cur_row);
-        cur_row = NULL;
-        if (data.empty()) { this->Resize(0, 0); return; }
+        if (data.size() != row_start) row_sizes.push_back(data.size() - row_start);
+        if (row_sizes.empty()) { this->Resize(0, 0); return; }
         else {
-          int32 num_rows = data.size(), num_cols = data[0]->size();
-          this->Resize(num_rows, num_cols);
+          int32 num_rows = row_sizes.size(), num_cols = row_sizes[0];
           for (int32 i = 0; i < num_rows; i++) {
-            if (static_cast<int32>(data[i]->size()) != num_cols) {
+            if (static_cast<int32>(row_sizes[i]) != num_cols) {
               specific_error << "Matrix has inconsistent #cols: " << num_cols
-                             << " vs." << data[i]->size() << " (processing row"
+                             << " vs." << row_sizes[i] << " (processing row"
                              << i << ")";
-              goto cleanup;
+              goto bad;
             }
-            for (int32 j = 0; j < num_cols; j++)
-              (*this)(i, j) = (*(data[i]))[j];
-            delete data[i];
-            data[i] = NULL;
           }
+          this->Resize(num_rows, num_cols, kUndefined);
+          for (int32 i = 0; i < num_rows; i++)
+            std::copy(data.begin() + i * num_cols,
+                      data.begin() + (i + 1) * num_cols, this->RowData(i));
         }
         return;
       } else if (static_cast<char>(i) == '\n' || static_cast<char>(i) == ';') {
         // End of matrix row.
-        is.get();
-        if (cur_row->size() != 0) {
-          data.push_back(cur_row);
-          cur_row = new std::vector<Real>;
-          cur_row->reserve(data.back()->size());
+        sb->sbumpc();
+        if (data.size() != row_start) {
+          row_sizes.push_back(data.size() - row_start);
+          row_start = data.size();
         }
       } else if ( (i >= '0' && i <= '9') || i == '-' ) {  // A number...
         Real r;
-        is >> r;
-        if (is.fail()) {
+        if (!ReadRealText(is, &r)) {
           specific_error << "Stream failure/EOF while reading matrix data.";
-          goto cleanup;
+          goto bad;
         }
-        cur_row->push_back(r);
+        data.push_back(r);
       } else if (isspace(i)) {
-        is.get();  // eat the space and do nothing.
+        sb->sbumpc();  // eat the space and do nothing.
       } else {  // NaN or inf or error.
         std::string str;
         is >> str;
         if (!KALDI_STRCASECMP(str.c_str(), "inf") ||
             !KALDI_STRCASECMP(str.c_str(), "infinity")) {
-          cur_row->push_back(std::numeric_limits<Real>::infinity());
+          data.push_back(std::numeric_limits<Real>::infinity());
           KALDI_WARN << "Reading infinite value into matrix.";
         } else if (!KALDI_STRCASECMP(str.c_str(), "nan")) {
-          cur_row->push_back(std::numeric_limits<Real>::quiet_NaN());
+          data.push_back(std::numeric_limits<Real>::quiet_NaN());
           KALDI_WARN << "Reading NaN value into matrix.";
         } else {
           if (str.length() > 20) str = str.substr(0, 17) + "...";
           specific_error << "Expecting numeric matrix data, got " << str;
-          goto cleanup;
+          goto bad;
         }
       }
     }
     // Note, we never leave the while () loop before this
     // line (we return from it.)
- cleanup: // We only reach here in case of error in the while loop above.
-    if(cur_row != NULL)
-      delete cur_row;
-    for (size_t i = 0; i < data.size(); i++)
-      if(data[i] != NULL)
-        delete data[i];
-    // and then go on to "bad" below, where we print error.
   }
 bad:
   KALDI_ERR << "Failed to read matrix from stream.  " << specific_error.str()
@@ -2118,10 +2063,8 @@ void MatrixBase<Real>::Exp(const MatrixBase<Real> &src) {
   Real *row_data = data_;
   const Real *src_row_data = src.Data();
   for (MatrixIndexT row = 0; row < num_rows;
-       row++,row_data += stride_, src_row_data += src.stride_) {
-    for (MatrixIndexT col = 0; col < num_cols; col++)
-      row_data[col] = kaldi::Exp(src_row_data[col]);
-  }
+       row++,row_data += stride_, src_row_data += src.stride_)
+    SimdExp(src_row_data, row_data, num_cols);
 }
 
 template<typename Real>
@@ -2189,10 +2132,8 @@ void MatrixBase<Real>::Log(const MatrixBase<Real> &src) {
   Real *row_data = data_;
   const Real *src_row_data = src.Data();
   for (MatrixIndexT row = 0; row < num_rows;
-       row++,row_data += stride_, src_row_data += src.stride_) {
-    for (MatrixIndexT col = 0; col < num_cols; col++)
-      row_data[col] = kaldi::Log(src_row_data[col]);
-  }
+       row++,row_data += stride_, src_row_data += src.stride_)
+    SimdLog(src_row_data, row_data, num_cols);
 }
 
 template<typename Real>
@@ -2736,14 +2677,8 @@ Real MatrixBase<Real>::LogSumExp(Real prune) const {
     cutoff = max_elem - prune;
 
   double sum_relto_max_elem = 0.0;
-
-  for (MatrixIndexT i = 0; i < num_rows_; i++) {
-    for (MatrixIndexT j = 0; j < num_cols_; j++) {
-      BaseFloat f = (*this)(i, j);
-      if (f >= cutoff)
-        sum_relto_max_elem += kaldi::Exp(f - max_elem);
-    }
-  }
+  for (MatrixIndexT i = 0; i < num_rows_; i++)
+    sum_relto_max_elem += SimdSumExp(RowData(i), num_cols_, max_elem, cutoff);
   return max_elem + kaldi::Log(sum_relto_max_elem);
 }
 
@@ -2751,9 +2686,11 @@ template<typename Real>
 Real MatrixBase<Real>::ApplySoftMax() {
   Real max = this->Max(), sum = 0.0;
   // the 'max' helps to get in good numeric range.
-  for (MatrixIndexT i = 0; i < num_rows_; i++)
-    for (MatrixIndexT j = 0; j < num_cols_; j++)
-      sum += ((*this)(i, j) = kaldi::Exp((*this)(i, j) - max));
+  this->Add(-max);
+  for (MatrixIndexT i = 0; i < num_rows_; i++) {
+    SimdExp(RowData(i), RowData(i), num_cols_);
+    sum += SubVector<Real>(*this, i).Sum();
+  }
   this->Scale(1.0 / sum);
   return max + kaldi::Log(sum);
 }
@@ -24,12 +24,15 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <limits>
 #include <string>
 #include "matrix/cblas-wrappers.h"
 #include "matrix/kaldi-vector.h"
 #include "matrix/kaldi-matrix.h"
 #include "matrix/sp-matrix.h"
 #include "matrix/sparse-matrix.h"
+#include "matrix/cpu-allocator.h"
+#include "matrix/simd-math.h"
 
 namespace kaldi {
 
@@ -171,18 +174,8 @@ inline void Vector<Real>::Init(const MatrixIndexT dim) {
     this->data_ = NULL;
     return;
   }
-  MatrixIndexT size;
-  void *data;
-  void *free_data;
-
-  size = dim * sizeof(Real);
-
-  if ((data = KALDI_MEMALIGN(16, size, &free_data)) != NULL) {
-    this->data_ = static_cast<Real*> (data);
-    this->dim_ = dim;
-  } else {
-    throw std::bad_alloc();
-  }
+  this->data_ = static_cast<Real*>(CpuAllocate(dim * sizeof(Real)));
+  this->dim_ = dim;
 }
 
 
@@ -279,7 +272,7 @@ template<typename Real>
 void Vector<Real>::Destroy() {
   /// we need to free the data block if it was defined
   if (this->data_ != NULL)
-    KALDI_MEMALIGN_FREE(this->data_);
+    CpuFree(this->data_);
   this->data_ = NULL;
   this->dim_ = 0;
 }
@@ -299,20 +292,14 @@ bool VectorBase<Real>::IsZero(Real cutoff) const {
 
 template<typename Real>
 void VectorBase<Real>::SetRandn() {
-  kaldi::RandomState rstate;
-  MatrixIndexT last = (Dim() % 2 == 1) ? Dim() - 1 : Dim();
-  for (MatrixIndexT i = 0; i < last; i += 2) {
-    kaldi::RandGauss2(data_ + i, data_ + i + 1, &rstate);
-  }
-  if (Dim() != last) data_[last] = static_cast<Real>(kaldi::RandGauss(&rstate));
+  kaldi::RandomGenerator generator;
+  generator.FillGauss(data_, dim_);
 }
 
 template<typename Real>
 void VectorBase<Real>::SetRandUniform() {
-  kaldi::RandomState rstate;
-  for (MatrixIndexT i = 0; i < Dim(); i++) {
-    *(data_+i) = RandUniform(&rstate);
-  }
+  kaldi::RandomGenerator generator;
+  generator.FillUniform(data_, dim_);
 }
 
 template<typename Real>
@@ -762,13 +749,7 @@ Real VectorBase<Real>::LogSumExp(Real prune) const {
   if (prune > 0.0 && max_elem - prune > cutoff) // explicit pruning...
     cutoff = max_elem - prune;
 
-  double sum_relto_max_elem = 0.0;
-
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    BaseFloat f = data_[i];
-    if (f >= cutoff)
-      sum_relto_max_elem += Exp(f - max_elem);
-  }
+  double sum_relto_max_elem = SimdSumExp(data_, dim_, max_elem, cutoff);
   return max_elem + Log(sum_relto_max_elem);
 }
 
@@ -781,11 +762,10 @@ void VectorBase<Real>::InvertElements() {
 
 template<typename Real>
 void VectorBase<Real>::ApplyLog() {
-  for (MatrixIndexT i = 0; i < dim_; i++) {
+  for (MatrixIndexT i = 0; i < dim_; i++)
     if (data_[i] < 0.0)
       KALDI_ERR << "Trying to take log of a negative number.";
-    data_[i] = Log(data_[i]);
-  }
+  SimdLog(data_, data_, dim_);
 }
 
 template<typename Real>
@@ -798,9 +778,7 @@ void VectorBase<Real>::ApplyLogAndCopy(const VectorBase<Real> &v) {
 
 template<typename Real>
 void VectorBase<Real>::ApplyExp() {
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    data_[i] = Exp(data_[i]);
-  }
+  SimdExp(data_, data_, dim_);
 }
 
 template<typename Real>
@@ -865,21 +843,20 @@ MatrixIndexT VectorBase<Real>::ApplyFloor(const VectorBase<Real> &floor_vec) {
 
 template<typename Real>
 Real VectorBase<Real>::ApplySoftMax() {
-  Real max = this->Max(), sum = 0.0;
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    sum += (data_[i] = Exp(data_[i] - max));
-  }
+  Real max = this->Max();
+  this->Add(-max);
+  SimdExp(data_, data_, dim_);
+  Real sum = this->Sum();
   this->Scale(1.0 / sum);
   return max + Log(sum);
 }
 
 template<typename Real>
 Real VectorBase<Real>::ApplyLogSoftMax() {
-  Real max = this->Max(), sum = 0.0;
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    sum += Exp((data_[i] -= max));
-  }
-  sum = Log(sum);
+  Real max = this->Max();
+  this->Add(-max);
+  Real sum = Log(SimdSumExp(data_, dim_, Real(0.0),
+                            -std::numeric_limits<Real>::infinity()));
   this->Add(-1.0 * sum);
   return max + sum;
 }
@@ -899,17 +876,7 @@ void VectorBase<double>::Tanh(const VectorBase<double> &src) {
 template<typename Real>
 void VectorBase<Real>::Tanh(const VectorBase<Real> &src) {
   KALDI_ASSERT(dim_ == src.dim_);
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    Real x = src.data_[i];
-    if (x > 0.0) {
-      Real inv_expx = Exp(-x);
-      x = -1.0 + 2.0 / (1.0 + inv_expx * inv_expx);
-    } else {
-      Real expx = Exp(x);
-      x = 1.0 - 2.0 / (1.0 + expx * expx);
-    }
-    data_[i] = x;
-  }
+  SimdTanh(src.data_, data_, dim_);
 }
 #endif
 
@@ -937,17 +904,7 @@ void VectorBase<double>::Sigmoid(const VectorBase<double> &src) {
 template<typename Real>
 void VectorBase<Real>::Sigmoid(const VectorBase<Real> &src) {
   KALDI_ASSERT(dim_ == src.dim_);
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    Real x = src.data_[i];
-    // We aim to avoid floating-point overflow here.
-    if (x > 0.0) {
-      x = 1.0 / (1.0 + Exp(-x));
-    } else {
-      Real ex = Exp(x);
-      x = ex / (ex + 1.0);
-    }
-    data_[i] = x;
-  }
+  SimdSigmoid(src.data_, data_, dim_);
 }
 #endif
 
@@ -1167,20 +1124,24 @@ void Vector<Real>::Read(std::istream &is,  bool binary, bool add) {
       goto bad;
     }
     std::vector<Real> data;
+    // We look at the characters through the stream buffer, and read the
+    // numbers with ReadRealText(), which is much faster than operator >>.
+    std::streambuf *sb = is.rdbuf();
     while (1) {
-      int i = is.peek();
+      int i = sb->sgetc();
       if (i == '-' || (i >= '0' && i <= '9')) {  // common cases first.
         Real r;
-        is >> r;
-        if (is.fail()) { specific_error << "Failed to read number."; goto bad; }
-        if (! std::isspace(is.peek()) && is.peek() != ']') {
+        if (!ReadRealText(is, &r)) {
+          specific_error << "Failed to read number."; goto bad;
+        }
+        if (!std::isspace(sb->sgetc()) && sb->sgetc() != ']') {
           specific_error << "Expected whitespace after number."; goto bad;
         }
         data.push_back(r);
         // But don't eat whitespace... we want to check that it's not newlines
         // which would be valid only for a matrix.
       } else if (i == ' ' || i == '\t') {
-        is.get();
+        sb->sbumpc();
       } else if (i == ']') {
         is.get();  // eat the ']'
         this->Resize(data.size());
@@ -26,6 +26,7 @@
 #include "matrix/matrix-lib.h"
 #include "util/stl-utils.h"
 #include <numeric>
+#include <thread>
 #include <time.h> // This is only needed for UnitTestSvdSpeed, you can
 // comment it (and that function) out if it causes problems.  
 #include <matrix/cblas-wrappers.h>
@@ -3605,6 +3606,25 @@ template<typename Real> static void UnitTestSplitRadixComplexFft2() {
       KALDI_ASSERT(ApproxEqual(v, vorig));
     }
   }
+
+  // The SIMD kernels (if any) agree with the generic code.
+  for (MatrixIndexT logn = 1; logn <= 12; logn++) {
+    MatrixIndexT N = 1 << logn;
+    SplitRadixComplexFft<Real> srfft(N);
+    Vector<Real> v(N*2), v_generic(N*2);
+    v.SetRandn();
+    v_generic.CopyFromVec(v);
+    bool forward = (logn % 2 == 0);
+    SplitRadixComplexFft<Real>::SetUseSimd(false);
+    KALDI_ASSERT(std::string(SplitRadixComplexFft<Real>::SimdKernelName()) ==
+                 "generic");
+    srfft.Compute(v_generic.Data(), forward);
+    SplitRadixComplexFft<Real>::SetUseSimd(true);
+    srfft.Compute(v.Data(), forward);
+    KALDI_ASSERT(v.ApproxEqual(v_generic, 1.0e-05));
+  }
+  KALDI_LOG << "Split-radix FFT kernels are "
+            << SplitRadixComplexFft<Real>::SimdKernelName();
 }
 
 
@@ -4054,6 +4074,237 @@ template<typename Real> static void UnitTestCompressedMatrix2() {
 }
 
 
+template<typename Real> static void UnitTestSimdMath() {
+  // Tests that the SIMD exp, log, tanh and sigmoid (if any) agree with the
+  // generic code, including on odd lengths and special values.
+  KALDI_LOG << "Math kernels are " << SimdMathKernelName();
+  Real tol = (sizeof(Real) == 4 ? 1.0e-06 : 1.0e-14);
+  for (int32 i = 0; i < 20; i++) {
+    int32 dim = RandInt(1, 100);
+    Vector<Real> x(dim);
+    x.SetRandn();
+    x.Scale(RandInt(1, 30));
+    if (i % 5 == 0) x(RandInt(0, dim - 1)) = 100.0;  // out of range of exp.
+    Vector<Real> pos(x);
+    pos.ApplyAbs();
+    if (i % 5 == 1) pos(RandInt(0, dim - 1)) = 0.0;
+
+    SimdMathSetUseSimd(false);
+    KALDI_ASSERT(std::string(SimdMathKernelName()) == "generic");
+    Vector<Real> exp_generic(x), log_generic(pos), tanh_generic(dim),
+        sigmoid_generic(dim), softmax_generic(x);
+    exp_generic.ApplyExp();
+    log_generic.ApplyLog();
+    tanh_generic.Tanh(x);
+    sigmoid_generic.Sigmoid(x);
+    Real lse_generic = x.LogSumExp(),
+        softmax_sum_generic = softmax_generic.ApplySoftMax();
+
+    SimdMathSetUseSimd(true);
+    Vector<Real> exp(x), log(pos), tanh(dim), sigmoid(dim), softmax(x);
+    exp.ApplyExp();
+    log.ApplyLog();
+    tanh.Tanh(x);
+    sigmoid.Sigmoid(x);
+    Real lse = x.LogSumExp(), softmax_sum = softmax.ApplySoftMax();
+
+    for (int32 j = 0; j < dim; j++) {
+      if (exp_generic(j) == std::numeric_limits<Real>::infinity())
+        KALDI_ASSERT(exp(j) == exp_generic(j));
+      else
+        KALDI_ASSERT(std::abs(exp(j) - exp_generic(j)) <=
+                     tol * exp_generic(j));
+      if (log_generic(j) == -std::numeric_limits<Real>::infinity())
+        KALDI_ASSERT(log(j) == log_generic(j));
+      else
+        KALDI_ASSERT(std::abs(log(j) - log_generic(j)) <=
+                     tol * std::max<Real>(1.0, std::abs(log_generic(j))));
+      KALDI_ASSERT(std::abs(tanh(j) - tanh_generic(j)) <= tol);
+      KALDI_ASSERT(std::abs(sigmoid(j) - sigmoid_generic(j)) <= tol);
+    }
+    AssertEqual(lse, lse_generic, tol * 10);
+    AssertEqual(softmax_sum, softmax_sum_generic, tol * 10);
+    KALDI_ASSERT(softmax.ApproxEqual(softmax_generic, tol * 10));
+  }
+}
+
+
+template<typename Real> static void UnitTestSmallGemm() {
+  // Tests that AddMatMat() gives the same result with and without the
+  // small-matrix kernels, for all the transpose types.
+  KALDI_LOG << "Small GEMM kernels are " << SmallGemmKernelName();
+  int64 threshold = SmallGemmThreshold();
+  for (int32 i = 0; i < 40; i++) {
+    int32 num_rows = RandInt(1, 30), num_cols = RandInt(1, 70),
+        k = RandInt(1, 100);
+    MatrixTransposeType transA = (RandInt(0, 1) == 0 ? kNoTrans : kTrans),
+        transB = (RandInt(0, 1) == 0 ? kNoTrans : kTrans);
+    Matrix<Real> A(transA == kNoTrans ? num_rows : k,
+                   transA == kNoTrans ? k : num_rows),
+        B(transB == kNoTrans ? k : num_cols,
+          transB == kNoTrans ? num_cols : k),
+        M(num_rows, num_cols + 3);
+    A.SetRandn();
+    B.SetRandn();
+    M.SetRandn();
+    SubMatrix<Real> M_sub(M, 0, num_rows, 1, num_cols);
+    Matrix<Real> M2(M);
+    SubMatrix<Real> M2_sub(M2, 0, num_rows, 1, num_cols);
+    Real alpha = RandGauss(), beta = (i % 3 == 0 ? 0.0 : RandGauss());
+
+    SetSmallGemmThreshold(0);
+    M_sub.AddMatMat(alpha, A, transA, B, transB, beta);
+    SetSmallGemmThreshold(threshold);
+    M2_sub.AddMatMat(alpha, A, transA, B, transB, beta);
+    KALDI_ASSERT(M2.ApproxEqual(M, 1.0e-05));
+  }
+}
+
+
+template<typename Real> static void UnitTestCpuAllocator() {
+  // Tests that matrices and vectors behave the same with the caching
+  // allocator, including when memory moves between them and between threads.
+  CpuAllocatorOptions opts;
+  opts.cache_memory = true;
+  opts.max_cached_mb = 1;
+  SetCpuAllocatorOptions(opts);
+  for (int32 i = 0; i < 100; i++) {
+    int32 num_rows = RandInt(1, 50), num_cols = RandInt(1, 50);
+    Matrix<Real> M(num_rows, num_cols);
+    M.SetRandn();
+    Matrix<Real> M2(M);
+    AssertEqual(M, M2);
+    Vector<Real> v(RandInt(1, 2000));
+    v.SetRandn();
+    Vector<Real> v2(v);
+    AssertEqual(v, v2);
+    SpMatrix<Real> S(RandInt(1, 20));
+    S.SetRandn();
+    SpMatrix<Real> S2(S);
+    AssertEqual(S, S2);
+    if (i % 3 == 0) {
+      Matrix<Real> M3(S);
+      M3.Swap(&M2);
+      AssertEqual(M, M3);
+    }
+    if (i % 10 == 0) {
+      // memory allocated in one thread and freed in another.
+      std::thread t([&v2]() { Vector<Real> tmp(v2); tmp.Swap(&v2); });
+      t.join();
+      AssertEqual(v, v2);
+    }
+  }
+  PrintCpuMemoryUsage();
+  opts.cache_memory = false;
+  SetCpuAllocatorOptions(opts);
+}
+
+
+template<typename Real> static void UnitTestCompressedMatrixSimd() {
+  // Tests that the SIMD kernels (if any) give the same compressed data and
+  // the same decompressed matrices as the generic code.
+  KALDI_LOG << "Compressed-matrix kernels are "
+            << CompressedMatrix::SimdKernelName();
+  for (int32 i = 0; i < 20; i++) {
+    int32 num_rows = RandInt(1, 100), num_cols = RandInt(1, 70);
+    Matrix<Real> M(num_rows, num_cols);
+    M.SetRandn();
+    M.Scale(RandInt(1, 10));
+    if (RandInt(0, 1) == 0) M.Add(RandInt(-10, 10));
+    CompressionMethod methods[] = { kSpeechFeature, kTwoByteAuto,
+                                    kOneByteAuto };
+    CompressionMethod method = methods[RandInt(0, 2)];
+
+    CompressedMatrix::SetUseSimd(false);
+    CompressedMatrix cmat_generic(M, method);
+    Matrix<Real> M_generic(cmat_generic);
+    Vector<Real> row_generic(num_cols), col_generic(num_rows);
+    int32 r = RandInt(0, num_rows - 1), c = RandInt(0, num_cols - 1);
+    cmat_generic.CopyRowToVec(r, &row_generic);
+    cmat_generic.CopyColToVec(c, &col_generic);
+    Matrix<Real> sub_generic(num_rows - r, num_cols - c);
+    cmat_generic.CopyToMat(r, c, &sub_generic);
+
+    CompressedMatrix::SetUseSimd(true);
+    CompressedMatrix cmat(M, method);
+    Matrix<Real> M2(cmat);
+    Vector<Real> row(num_cols), col(num_rows);
+    cmat.CopyRowToVec(r, &row);
+    cmat.CopyColToVec(c, &col);
+    Matrix<Real> sub(num_rows - r, num_cols - c);
+    cmat.CopyToMat(r, c, &sub);
+
+    std::ostringstream os_generic, os;
+    cmat_generic.Write(os_generic, true);
+    cmat.Write(os, true);
+    KALDI_ASSERT(os_generic.str() == os.str());
+#ifdef __FMA__
+    // The compiler may fuse multiplies and adds differently in the two
+    // versions of the code.
+    Real tol = 1.0e-06;
+#else
+    Real tol = 0.0;
+#endif
+    KALDI_ASSERT(ApproxEqual(M_generic, M2, tol));
+    KALDI_ASSERT(ApproxEqual(row_generic, row, tol));
+    KALDI_ASSERT(ApproxEqual(col_generic, col, tol));
+    KALDI_ASSERT(ApproxEqual(sub_generic, sub, tol));
+  }
+}
+
+static void UnitTestQuantizedMatrix() {
+  KALDI_LOG << "Quantized-matrix kernels are "
+            << QuantizedMatrix::SimdKernelName();
+  for (int32 i = 0; i < 20; i++) {
+    int32 num_rows = RandInt(1, 70), num_cols = RandInt(1, 100),
+        dim = RandInt(1, 300);
+    Matrix<BaseFloat> A(num_rows, dim), B(num_cols, dim),
+        C(num_rows, num_cols);
+    A.SetRandn();
+    B.SetRandn();
+    if (RandInt(0, 1) == 0) B.Row(RandInt(0, num_cols - 1)).SetZero();
+    C.SetRandn();
+    QuantizedMatrix qB(B);
+    KALDI_ASSERT(qB.NumRows() == num_cols && qB.NumCols() == dim);
+
+    // Dequantization is accurate to half a quantization step.
+    Matrix<BaseFloat> B2(num_cols, dim);
+    qB.CopyToMat(&B2);
+    for (int32 r = 0; r < num_cols; r++)
+      for (int32 c = 0; c < dim; c++)
+        KALDI_ASSERT(std::abs(B(r, c) - B2(r, c)) <= 0.501 * qB.Scale(r));
+
+    // I/O.
+    for (int32 binary = 0; binary <= 1; binary++) {
+      std::ostringstream os;
+      qB.Write(os, binary);
+      QuantizedMatrix qB3;
+      std::istringstream is(os.str());
+      qB3.Read(is, binary);
+      Matrix<BaseFloat> B3(num_cols, dim);
+      qB3.CopyToMat(&B3);
+      KALDI_ASSERT(B2.ApproxEqual(B3, 1.0e-05));
+    }
+
+    // The SIMD and generic kernels compute the same integer dot products.
+    BaseFloat alpha = 0.5 * RandInt(1, 4), beta = 0.5 * RandInt(0, 2);
+    Matrix<BaseFloat> C_generic(C), C_simd(C), C_ref(C);
+    QuantizedMatrix::SetUseSimd(false);
+    AddMatQuantizedMat(alpha, A, qB, beta, &C_generic);
+    QuantizedMatrix::SetUseSimd(true);
+    AddMatQuantizedMat(alpha, A, qB, beta, &C_simd);
+    KALDI_ASSERT(C_generic.ApproxEqual(C_simd, 1.0e-06));
+
+    // Compare with the unquantized product; the error of each product is of
+    // the order of 1% of the typical size of the elements.
+    C_ref.AddMatMat(alpha, A, kNoTrans, B, kTrans, beta);
+    Matrix<BaseFloat> diff(C_ref);
+    diff.AddMat(-1.0, C_simd);
+    KALDI_ASSERT(diff.FrobeniusNorm() <=
+                 0.02 * alpha * std::sqrt(dim * num_rows * num_cols) + 1.0e-04);
+  }
+}
+
 template<typename Real> static void UnitTestCompressedMatrix() {
   // This is the basic test.
 
@@ -4602,6 +4853,11 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   // UnitTestSvdBad<Real>(); // test bug in Jama SVD code.
   UnitTestCompressedMatrix<Real>();
   UnitTestCompressedMatrix2<Real>();
+  UnitTestCompressedMatrixSimd<Real>();
+  UnitTestSimdMath<Real>();
+  UnitTestSmallGemm<Real>();
+  UnitTestCpuAllocator<Real>();
+  UnitTestQuantizedMatrix();
   UnitTestExtractCompressedMatrix<Real>();
   UnitTestResize<Real>();
   UnitTestResizeCopyDataDifferentStrideType<Real>();
@@ -32,6 +32,11 @@
 #include "matrix/compressed-matrix.h"
 #include "matrix/sparse-matrix.h"
 #include "matrix/optimization.h"
+#include "matrix/quantized-matrix.h"
+#include "matrix/cpu-allocator.h"
+#include "matrix/simd-math.h"
+#include "matrix/small-gemm.h"
+#include "matrix/sparse-gemm.h"
 
 #endif
 
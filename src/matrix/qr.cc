@@ -429,12 +429,56 @@ void SpMatrix<Real>::Qr(MatrixBase<Real> *Q) {
   }
 }
 
+#if !defined(HAVE_ATLAS) && !defined(USE_KALDI_SVD)
+template<typename Real>
+bool SpMatrix<Real>::LapackSyevd(VectorBase<Real> *s,
+                                 MatrixBase<Real> *P) const {
+  MatrixIndexT dim = this->NumRows();
+  KALDI_ASSERT(s->Dim() == dim);
+  KALDI_ASSERT(P == NULL || (P->NumRows() == dim && P->NumCols() == dim));
+  if (dim == 0)
+    return true;
+  // LAPACK works in column-major order, but since A is symmetric that makes
+  // no difference on input; on output, the eigenvectors are in the columns as
+  // LAPACK sees them, i.e. in the rows of A, so we transpose at the end.
+  Matrix<Real> A(*this);
+  KaldiBlasInt N = dim, LDA = A.Stride(), l_work = -1, l_iwork = -1, result;
+  char *jobz = const_cast<char*>(P != NULL ? "V" : "N");
+  Real work_query;
+  KaldiBlasInt iwork_query;
+  // query for work space
+  clapack_Xsyevd(jobz, &N, A.Data(), &LDA, s->Data(), &work_query, &l_work,
+                 &iwork_query, &l_iwork, &result);
+  KALDI_ASSERT(result == 0 &&
+               "Call to CLAPACK ?syevd_ called with wrong arguments");
+  l_work = static_cast<KaldiBlasInt>(work_query);
+  l_iwork = iwork_query;
+  std::vector<Real> work(std::max<KaldiBlasInt>(l_work, 1));
+  std::vector<KaldiBlasInt> iwork(std::max<KaldiBlasInt>(l_iwork, 1));
+  clapack_Xsyevd(jobz, &N, A.Data(), &LDA, s->Data(), &(work[0]), &l_work,
+                 &(iwork[0]), &l_iwork, &result);
+  KALDI_ASSERT(result >= 0 &&
+               "Call to CLAPACK ?syevd_ called with wrong arguments");
+  if (result != 0)
+    return false;
+  if (P != NULL)
+    P->CopyFromMat(A, kTrans);
+  return true;
+}
+#endif
+
 template<typename Real>
 void SpMatrix<Real>::Eig(VectorBase<Real> *s, MatrixBase<Real> *P) const {
   MatrixIndexT dim = this->NumRows();
   KALDI_ASSERT(s->Dim() == dim);
   KALDI_ASSERT(P == NULL || (P->NumRows() == dim && P->NumCols() == dim));
 
+#if !defined(HAVE_ATLAS) && !defined(USE_KALDI_SVD)
+  if (LapackSyevd(s, P))
+    return;
+  KALDI_WARN << "CLAPACK ?syevd_ did not converge; using the QR method.";
+#endif
+
   SpMatrix<Real> A(*this); // Copy *this, since the tridiagonalization
   // and QR decomposition are destructive.
   // Note: for efficiency of memory access, the tridiagonalization
@@ -560,6 +604,14 @@ template
 void SpMatrix<float>::Eig(VectorBase<float>*, MatrixBase<float>*) const;
 template
 void SpMatrix<double>::Eig(VectorBase<double>*, MatrixBase<double>*) const;
+#if !defined(HAVE_ATLAS) && !defined(USE_KALDI_SVD)
+template
+bool SpMatrix<float>::LapackSyevd(VectorBase<float>*,
+                                  MatrixBase<float>*) const;
+template
+bool SpMatrix<double>::LapackSyevd(VectorBase<double>*,
+                                   MatrixBase<double>*) const;
+#endif
 
 template
 void SpMatrix<float>::TopEigs(VectorBase<float>*, MatrixBase<float>*, MatrixIndexT) const;
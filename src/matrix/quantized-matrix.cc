@@ -0,0 +1,345 @@
+// matrix/quantized-matrix.cc
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "matrix/quantized-matrix.h"
+#include <algorithm>
+#include <cmath>
+
+// As in compressed-matrix.cc, the SIMD kernels are compiled for x86 with
+// GCC-compatible compilers (selected at run time, so no special compiler flags
+// are needed), and for 64-bit ARM (NEON, which is always available).
+#if defined(__GNUC__) && (__GNUC__ >= 8 || defined(__clang__)) && \
+    defined(__x86_64__)
+#define KALDI_QUANTIZED_MATRIX_X86_SIMD 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define KALDI_QUANTIZED_MATRIX_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace kaldi {
+
+namespace {
+
+// The maximum number of rows of the (quantized) input that the kernels
+// process together against one row of the parameters.
+const int32 kMaxKernelRows = 4;
+
+// Computes out[r] = sum_i w[i] * x[r * x_stride + i] for 0 <= r < num_x, for
+// int8 values in [-127, 127]; 'n' is a multiple of 32 and num_x <= 4.
+void DotRowsGeneric(const int8 *w, const int8 *x, int32 x_stride,
+                    int32 num_x, int32 n, int32 *out) {
+  for (int32 r = 0; r < num_x; r++) {
+    const int8 *xr = x + r * x_stride;
+    int32 sum = 0;
+    for (int32 i = 0; i < n; i++)
+      sum += static_cast<int32>(w[i]) * static_cast<int32>(xr[i]);
+    out[r] = sum;
+  }
+}
+
+#ifdef KALDI_QUANTIZED_MATRIX_X86_SIMD
+
+// The x86 instructions multiply unsigned by signed bytes, so we multiply
+// |x| by w * sign(x).  As the values are limited to [-127, 127], the 16-bit
+// sums of pairs of products that _mm256_maddubs_epi16 computes cannot
+// saturate.  As in compressed-matrix.cc, each kernel calls _mm256_zeroupper()
+// before returning.
+
+__attribute__((target("avx2")))
+inline int32 HorizontalSumAvx2(__m256i v) {
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v),
+                            _mm256_extracti128_si256(v, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(s);
+}
+
+__attribute__((target("avx2")))
+inline __m256i DotStepAvx2(__m256i acc, __m256i w, __m256i x) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i prod = _mm256_maddubs_epi16(_mm256_sign_epi8(x, x),
+                                      _mm256_sign_epi8(w, x));
+  return _mm256_add_epi32(acc, _mm256_madd_epi16(prod, ones));
+}
+
+__attribute__((target("avx2")))
+void DotRowsAvx2(const int8 *w, const int8 *x, int32 x_stride,
+                 int32 num_x, int32 n, int32 *out) {
+  __m256i acc[kMaxKernelRows];
+  for (int32 r = 0; r < num_x; r++)
+    acc[r] = _mm256_setzero_si256();
+  for (int32 i = 0; i < n; i += 32) {
+    __m256i wv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+    for (int32 r = 0; r < num_x; r++) {
+      __m256i xv = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(x + r * x_stride + i));
+      acc[r] = DotStepAvx2(acc[r], wv, xv);
+    }
+  }
+  for (int32 r = 0; r < num_x; r++)
+    out[r] = HorizontalSumAvx2(acc[r]);
+  _mm256_zeroupper();
+}
+
+// The VNNI instruction accumulates the four products directly into 32 bits.
+__attribute__((target("avx2,avx512f,avx512vl,avx512vnni")))
+void DotRowsAvx512Vnni(const int8 *w, const int8 *x, int32 x_stride,
+                       int32 num_x, int32 n, int32 *out) {
+  __m256i acc[kMaxKernelRows];
+  for (int32 r = 0; r < num_x; r++)
+    acc[r] = _mm256_setzero_si256();
+  for (int32 i = 0; i < n; i += 32) {
+    __m256i wv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+    for (int32 r = 0; r < num_x; r++) {
+      __m256i xv = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(x + r * x_stride + i));
+      acc[r] = _mm256_dpbusd_epi32(acc[r], _mm256_sign_epi8(xv, xv),
+                                   _mm256_sign_epi8(wv, xv));
+    }
+  }
+  for (int32 r = 0; r < num_x; r++)
+    out[r] = HorizontalSumAvx2(acc[r]);
+  _mm256_zeroupper();
+}
+
+#endif  // KALDI_QUANTIZED_MATRIX_X86_SIMD
+
+#ifdef KALDI_QUANTIZED_MATRIX_NEON
+
+// This uses widening multiplies rather than the dot-product instructions, which
+// are not present on all ARMv8 CPUs.
+void DotRowsNeon(const int8 *w, const int8 *x, int32 x_stride,
+                 int32 num_x, int32 n, int32 *out) {
+  int32x4_t acc[kMaxKernelRows];
+  for (int32 r = 0; r < num_x; r++)
+    acc[r] = vdupq_n_s32(0);
+  for (int32 i = 0; i < n; i += 16) {
+    int8x16_t wv = vld1q_s8(w + i);
+    for (int32 r = 0; r < num_x; r++) {
+      int8x16_t xv = vld1q_s8(x + r * x_stride + i);
+      int16x8_t p = vmull_s8(vget_low_s8(wv), vget_low_s8(xv));
+      p = vmlal_s8(p, vget_high_s8(wv), vget_high_s8(xv));
+      acc[r] = vpadalq_s16(acc[r], p);
+    }
+  }
+  for (int32 r = 0; r < num_x; r++)
+    out[r] = vaddvq_s32(acc[r]);
+}
+
+#endif  // KALDI_QUANTIZED_MATRIX_NEON
+
+struct QuantizedKernels {
+  const char *name;
+  void (*dot_rows)(const int8 *w, const int8 *x, int32 x_stride,
+                   int32 num_x, int32 n, int32 *out);
+};
+
+const QuantizedKernels kGenericKernels = { "generic", DotRowsGeneric };
+#ifdef KALDI_QUANTIZED_MATRIX_X86_SIMD
+const QuantizedKernels kAvx2Kernels = { "avx2", DotRowsAvx2 };
+const QuantizedKernels kAvx512VnniKernels = { "avx512vnni",
+                                              DotRowsAvx512Vnni };
+#endif
+#ifdef KALDI_QUANTIZED_MATRIX_NEON
+const QuantizedKernels kNeonKernels = { "neon", DotRowsNeon };
+#endif
+
+const QuantizedKernels *SelectSimdKernels() {
+#ifdef KALDI_QUANTIZED_MATRIX_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512vnni") &&
+      __builtin_cpu_supports("avx512vl"))
+    return &kAvx512VnniKernels;
+  if (__builtin_cpu_supports("avx2"))
+    return &kAvx2Kernels;
+#endif
+#ifdef KALDI_QUANTIZED_MATRIX_NEON
+  return &kNeonKernels;
+#endif
+  return &kGenericKernels;
+}
+
+bool quantized_matrix_use_simd = true;
+
+const QuantizedKernels &Kernels() {
+  static const QuantizedKernels *simd_kernels = SelectSimdKernels();
+  return (quantized_matrix_use_simd ? *simd_kernels : kGenericKernels);
+}
+
+}  // namespace
+
+
+void QuantizedMatrix::SetUseSimd(bool use_simd) {
+  quantized_matrix_use_simd = use_simd;
+}
+
+const char *QuantizedMatrix::SimdKernelName() {
+  return Kernels().name;
+}
+
+// static
+BaseFloat QuantizedMatrix::QuantizeVector(const BaseFloat *v, int32 dim,
+                                          int8 *out) {
+  BaseFloat max_abs = 0.0;
+  for (int32 i = 0; i < dim; i++)
+    max_abs = std::max(max_abs, std::abs(v[i]));
+  int32 stride = RoundUpStride(dim);
+  if (max_abs == 0.0) {
+    std::fill(out, out + stride, 0);
+    return 0.0;
+  }
+  BaseFloat scale = max_abs / 127.0, inv_scale = 127.0 / max_abs;
+  for (int32 i = 0; i < dim; i++) {
+    // The value is in [-127, 127] up to roundoff; the clamp handles that.
+    int32 q = static_cast<int32>(std::floor(v[i] * inv_scale + 0.5));
+    out[i] = static_cast<int8>(std::max(-127, std::min(127, q)));
+  }
+  std::fill(out + dim, out + stride, 0);
+  return scale;
+}
+
+void QuantizedMatrix::CopyFromMat(const MatrixBase<BaseFloat> &mat) {
+  num_rows_ = mat.NumRows();
+  num_cols_ = mat.NumCols();
+  stride_ = RoundUpStride(num_cols_);
+  scales_.resize(num_rows_);
+  data_.resize(static_cast<size_t>(num_rows_) * stride_);
+  for (int32 r = 0; r < num_rows_; r++)
+    scales_[r] = QuantizeVector(mat.RowData(r), num_cols_,
+                                &(data_[0]) + r * stride_);
+}
+
+void QuantizedMatrix::CopyToMat(MatrixBase<BaseFloat> *mat) const {
+  KALDI_ASSERT(mat->NumRows() == num_rows_ && mat->NumCols() == num_cols_);
+  for (int32 r = 0; r < num_rows_; r++) {
+    const int8 *row_data = RowData(r);
+    BaseFloat *mat_data = mat->RowData(r), scale = scales_[r];
+    for (int32 c = 0; c < num_cols_; c++)
+      mat_data[c] = scale * row_data[c];
+  }
+}
+
+void QuantizedMatrix::Swap(QuantizedMatrix *other) {
+  std::swap(num_rows_, other->num_rows_);
+  std::swap(num_cols_, other->num_cols_);
+  std::swap(stride_, other->stride_);
+  scales_.swap(other->scales_);
+  data_.swap(other->data_);
+}
+
+void QuantizedMatrix::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<QuantizedMatrix>");
+  WriteBasicType(os, binary, num_rows_);
+  WriteBasicType(os, binary, num_cols_);
+  if (!binary) os << "\n";
+  for (int32 r = 0; r < num_rows_; r++) {
+    WriteBasicType(os, binary, static_cast<float>(scales_[r]));
+    const int8 *row_data = RowData(r);
+    if (binary) {
+      os.write(reinterpret_cast<const char*>(row_data), num_cols_);
+    } else {
+      for (int32 c = 0; c < num_cols_; c++)
+        WriteBasicType(os, binary, row_data[c]);
+      os << "\n";
+    }
+  }
+  WriteToken(os, binary, "</QuantizedMatrix>");
+  if (os.fail())
+    KALDI_ERR << "Error writing QuantizedMatrix to stream.";
+}
+
+void QuantizedMatrix::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<QuantizedMatrix>");
+  ReadBasicType(is, binary, &num_rows_);
+  ReadBasicType(is, binary, &num_cols_);
+  if (num_rows_ < 0 || num_cols_ < 0)
+    KALDI_ERR << "Invalid dimensions " << num_rows_ << " x " << num_cols_
+              << " reading QuantizedMatrix.";
+  stride_ = RoundUpStride(num_cols_);
+  scales_.resize(num_rows_);
+  data_.clear();
+  data_.resize(static_cast<size_t>(num_rows_) * stride_, 0);
+  for (int32 r = 0; r < num_rows_; r++) {
+    float scale;
+    ReadBasicType(is, binary, &scale);
+    scales_[r] = scale;
+    int8 *row_data = &(data_[0]) + r * stride_;
+    if (binary) {
+      is.read(reinterpret_cast<char*>(row_data), num_cols_);
+    } else {
+      for (int32 c = 0; c < num_cols_; c++)
+        ReadBasicType(is, binary, row_data + c);
+    }
+    for (int32 c = 0; c < num_cols_; c++)
+      if (row_data[c] == -128)
+        KALDI_ERR << "Invalid value -128 reading QuantizedMatrix.";
+  }
+  ExpectToken(is, binary, "</QuantizedMatrix>");
+  if (is.fail())
+    KALDI_ERR << "Error reading QuantizedMatrix from stream.";
+}
+
+
+void AddMatQuantizedMat(BaseFloat alpha, const MatrixBase<BaseFloat> &A,
+                        const QuantizedMatrix &B, BaseFloat beta,
+                        MatrixBase<BaseFloat> *C) {
+  KALDI_ASSERT(A.NumCols() == B.NumCols() && A.NumRows() == C->NumRows() &&
+               B.NumRows() == C->NumCols());
+  int32 num_rows = A.NumRows(), num_cols = B.NumRows(),
+      dim = A.NumCols(), stride = B.Stride();
+  if (num_rows == 0 || num_cols == 0) return;
+  if (dim == 0) {
+    if (beta == 0.0) C->SetZero();
+    else C->Scale(beta);
+    return;
+  }
+  const QuantizedKernels &kernels = Kernels();
+
+  // Quantize the rows of A.
+  std::vector<int8> a_data(static_cast<size_t>(num_rows) * stride);
+  std::vector<BaseFloat> a_scales(num_rows);
+  for (int32 r = 0; r < num_rows; r++)
+    a_scales[r] = QuantizedMatrix::QuantizeVector(A.RowData(r), dim,
+                                                  &(a_data[0]) + r * stride);
+
+  // We go through the rows of B in blocks of roughly 256KB, which stay in
+  // cache while we go through all the rows of A.
+  int32 block_size = std::max<int32>(1, (1 << 18) / stride);
+  int32 dots[kMaxKernelRows];
+  for (int32 c_begin = 0; c_begin < num_cols; c_begin += block_size) {
+    int32 c_end = std::min(num_cols, c_begin + block_size);
+    for (int32 r = 0; r < num_rows; r += kMaxKernelRows) {
+      int32 this_num_rows = std::min(kMaxKernelRows, num_rows - r);
+      const int8 *a_rows = &(a_data[0]) + r * stride;
+      for (int32 c = c_begin; c < c_end; c++) {
+        kernels.dot_rows(B.RowData(c), a_rows, stride, this_num_rows,
+                         stride, dots);
+        BaseFloat b_scale = alpha * B.Scale(c);
+        for (int32 i = 0; i < this_num_rows; i++) {
+          BaseFloat *c_elem = C->RowData(r + i) + c,
+              value = b_scale * a_scales[r + i] * dots[i];
+          *c_elem = (beta == 0.0 ? value : value + beta * *c_elem);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace kaldi
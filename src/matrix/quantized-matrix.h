@@ -0,0 +1,127 @@
+// matrix/quantized-matrix.h
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_QUANTIZED_MATRIX_H_
+#define KALDI_MATRIX_QUANTIZED_MATRIX_H_ 1
+
+#include <vector>
+#include "matrix/kaldi-matrix.h"
+
+namespace kaldi {
+
+/// \addtogroup matrix_group
+/// @{
+
+/**
+   QuantizedMatrix stores a matrix as signed 8-bit integers with one scale per
+   row: element (r, c) represents Scale(r) * q(r, c), where q(r, c) is in the
+   range [-127, 127] and Scale(r) is the largest absolute value in row r of the
+   original matrix divided by 127 (symmetric, per-row quantization).  It is
+   intended for the parameter matrices of neural networks at test time, where
+   the rows of the matrix correspond to outputs; see AddMatQuantizedMat().
+
+   Unlike CompressedMatrix, this is not meant as a storage format for general
+   data: it does not support lossless round trips and has no operations apart
+   from conversion, I/O and multiplication.
+ */
+class QuantizedMatrix {
+ public:
+  QuantizedMatrix(): num_rows_(0), num_cols_(0), stride_(0) { }
+
+  /// Quantizes 'mat'.
+  explicit QuantizedMatrix(const MatrixBase<BaseFloat> &mat) {
+    CopyFromMat(mat);
+  }
+
+  /// Quantizes 'mat', replacing any previous contents.
+  void CopyFromMat(const MatrixBase<BaseFloat> &mat);
+
+  /// Copies the dequantized matrix to 'mat', which must have the right size.
+  void CopyToMat(MatrixBase<BaseFloat> *mat) const;
+
+  int32 NumRows() const { return num_rows_; }
+  int32 NumCols() const { return num_cols_; }
+
+  /// Returns the scale of row r.
+  BaseFloat Scale(int32 r) const { return scales_[r]; }
+
+  /// Returns a pointer to the quantized data of row r.  Each row is padded
+  /// with zeros to Stride() bytes.
+  const int8 *RowData(int32 r) const { return &(data_[0]) + r * stride_; }
+
+  /// Returns the number of bytes between the starts of successive rows; it
+  /// is NumCols() rounded up to a multiple of 32.
+  int32 Stride() const { return stride_; }
+
+  /// Returns the size of the data (for diagnostics).
+  size_t SizeInBytes() const {
+    return data_.size() + scales_.size() * sizeof(BaseFloat);
+  }
+
+  void Write(std::ostream &os, bool binary) const;
+  void Read(std::istream &is, bool binary);
+
+  void Swap(QuantizedMatrix *other);
+
+  /// The matrix multiplication uses SIMD kernels where available: AVX-512
+  /// VNNI or AVX2 on x86 if the CPU supports them, and NEON on 64-bit ARM.
+  /// All of them compute exactly the same integer dot products as the generic
+  /// code.  SetUseSimd(false) forces the generic code; it is intended for
+  /// testing and benchmarking.
+  static void SetUseSimd(bool use_simd);
+
+  /// Returns the name of the kernels currently in use, e.g. "avx2" or
+  /// "generic".
+  static const char *SimdKernelName();
+
+  /// Quantizes the vector v (of dimension 'dim') into 'out', which must have
+  /// space for RoundUpStride(dim) elements (the padding is set to zero), and
+  /// returns the scale.  This is the quantization applied to each row of the
+  /// input of AddMatQuantizedMat().
+  static BaseFloat QuantizeVector(const BaseFloat *v, int32 dim, int8 *out);
+
+  /// Returns 'dim' rounded up to a multiple of 32.
+  static int32 RoundUpStride(int32 dim) { return (dim + 31) & ~31; }
+
+ private:
+  int32 num_rows_;
+  int32 num_cols_;
+  int32 stride_;
+  std::vector<BaseFloat> scales_;
+  std::vector<int8> data_;
+};
+
+
+/**
+   Does C = alpha * A * B^T + beta * C, where B is quantized; the rows of B
+   correspond to the columns of C, as with the linear parameters of an affine
+   layer.  Each row of A is quantized to 8 bits on the fly (see
+   QuantizedMatrix::QuantizeVector()), the dot products are computed exactly in
+   32-bit integers, and the result is scaled back to floating point.  If beta
+   is zero, C is not read, so it may contain NaN's.
+ */
+void AddMatQuantizedMat(BaseFloat alpha, const MatrixBase<BaseFloat> &A,
+                        const QuantizedMatrix &B, BaseFloat beta,
+                        MatrixBase<BaseFloat> *C);
+
+/// @} end of \addtogroup matrix_group
+
+}  // namespace kaldi
+
+#endif  // KALDI_MATRIX_QUANTIZED_MATRIX_H_
@@ -0,0 +1,751 @@
+// matrix/simd-math.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+
+#include "matrix/simd-math.h"
+#include "base/kaldi-math.h"
+
+// As in compressed-matrix.cc, the x86 kernels are compiled for AVX2 with GCC
+// attributes (used if the CPU supports it, so no special compiler flags are
+// needed), and the NEON kernels for 64-bit ARM, where NEON is always
+// available.
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define KALDI_SIMD_MATH_X86_SIMD 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define KALDI_SIMD_MATH_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace kaldi {
+
+namespace {
+
+// The generic versions are the loops that VectorBase used to contain.
+
+template<typename Real>
+void ExpGeneric(const Real *x, Real *y, MatrixIndexT n) {
+  for (MatrixIndexT i = 0; i < n; i++)
+    y[i] = Exp(x[i]);
+}
+
+template<typename Real>
+void LogGeneric(const Real *x, Real *y, MatrixIndexT n) {
+  for (MatrixIndexT i = 0; i < n; i++)
+    y[i] = Log(x[i]);
+}
+
+template<typename Real>
+inline Real TanhScalar(Real x) {
+  if (x > 0.0) {
+    Real inv_expx = Exp(-x);
+    return -1.0 + 2.0 / (1.0 + inv_expx * inv_expx);
+  } else {
+    Real expx = Exp(x);
+    return 1.0 - 2.0 / (1.0 + expx * expx);
+  }
+}
+
+template<typename Real>
+void TanhGeneric(const Real *x, Real *y, MatrixIndexT n) {
+  for (MatrixIndexT i = 0; i < n; i++)
+    y[i] = TanhScalar(x[i]);
+}
+
+template<typename Real>
+inline Real SigmoidScalar(Real x) {
+  // We aim to avoid floating-point overflow here.
+  if (x > 0.0) {
+    return 1.0 / (1.0 + Exp(-x));
+  } else {
+    Real ex = Exp(x);
+    return ex / (ex + 1.0);
+  }
+}
+
+template<typename Real>
+void SigmoidGeneric(const Real *x, Real *y, MatrixIndexT n) {
+  for (MatrixIndexT i = 0; i < n; i++)
+    y[i] = SigmoidScalar(x[i]);
+}
+
+template<typename Real>
+double SumExpGeneric(const Real *x, MatrixIndexT n, Real offset,
+                     Real cutoff) {
+  double sum = 0.0;
+  for (MatrixIndexT i = 0; i < n; i++)
+    if (x[i] >= cutoff)
+      sum += Exp(x[i] - offset);
+  return sum;
+}
+
+// Constants of the approximations.  exp(x) is computed as 2^k exp(r), where k
+// = round(x / log(2)) and r = x - k log(2) (with log(2) split into two parts
+// so r is accurate), |r| <= log(2)/2; exp(r) is a minimax polynomial for float
+// (from Cephes) and a Taylor series for double.  log(x) is computed from x =
+// 2^k m with sqrt(1/2) <= m < sqrt(2), as k log(2) + 2 atanh(s) with s =
+// (m - 1) / (m + 1), |s| <= 0.172, using the series of atanh.
+// The fast paths are used only for arguments in these ranges:
+const float kExpMinFloat = -87.0f, kExpMaxFloat = 88.0f;
+const double kExpMinDouble = -707.0, kExpMaxDouble = 707.0;
+
+const float kLog2eFloat = 1.44269504088896341f,
+    kLn2HiFloat = 0.693359375f, kLn2LoFloat = -2.12194440e-4f;
+const double kLog2eDouble = 1.4426950408889634074,
+    kLn2HiDouble = 6.93147180369123816490e-01,
+    kLn2LoDouble = 1.90821492927058770002e-10;
+
+// Coefficients of exp(r) for float, highest order first; the constant and
+// linear terms are 1.
+const float kExpCoeffsFloat[6] = {
+  1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f,
+  4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f
+};
+// 1/k! for k = 13 down to 2.
+const double kExpCoeffsDouble[12] = {
+  1.0 / 6227020800.0, 1.0 / 479001600.0, 1.0 / 39916800.0,
+  1.0 / 3628800.0, 1.0 / 362880.0, 1.0 / 40320.0, 1.0 / 5040.0,
+  1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 0.5
+};
+// 1/(2k+1), for k = 5 down to 1 (float) or 11 down to 1 (double); the
+// constant term is 1.
+const float kLogCoeffsFloat[5] = {
+  1.0f / 11, 1.0f / 9, 1.0f / 7, 1.0f / 5, 1.0f / 3
+};
+const double kLogCoeffsDouble[11] = {
+  1.0 / 23, 1.0 / 21, 1.0 / 19, 1.0 / 17, 1.0 / 15, 1.0 / 13,
+  1.0 / 11, 1.0 / 9, 1.0 / 7, 1.0 / 5, 1.0 / 3
+};
+
+
+#ifdef KALDI_SIMD_MATH_X86_SIMD
+
+// As in the other AVX2 kernels, each kernel calls _mm256_zeroupper() before
+// returning.
+
+// exp(x) for x in [kExpMinFloat, kExpMaxFloat].
+__attribute__((target("avx2,fma")))
+inline __m256 ExpAvx2(__m256 x) {
+  __m256 k = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(kLog2eFloat)),
+                             _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m256 r = _mm256_fnmadd_ps(k, _mm256_set1_ps(kLn2HiFloat), x);
+  r = _mm256_fnmadd_ps(k, _mm256_set1_ps(kLn2LoFloat), r);
+  __m256 p = _mm256_set1_ps(kExpCoeffsFloat[0]);
+  for (int32 i = 1; i < 6; i++)
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kExpCoeffsFloat[i]));
+  p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r),
+                      _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+  __m256i e = _mm256_slli_epi32(
+      _mm256_add_epi32(_mm256_cvtps_epi32(k), _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+}
+
+// exp(x) for x in [kExpMinDouble, kExpMaxDouble].
+__attribute__((target("avx2,fma")))
+inline __m256d ExpAvx2(__m256d x) {
+  __m256d k = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(kLog2eDouble)),
+                              _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(kLn2HiDouble), x);
+  r = _mm256_fnmadd_pd(k, _mm256_set1_pd(kLn2LoDouble), r);
+  __m256d p = _mm256_set1_pd(kExpCoeffsDouble[0]);
+  for (int32 i = 1; i < 12; i++)
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(kExpCoeffsDouble[i]));
+  p = _mm256_fmadd_pd(p, _mm256_mul_pd(r, r),
+                      _mm256_add_pd(r, _mm256_set1_pd(1.0)));
+  // Adding 1.5 * 2^52 puts k in the low bits of the double; only the low 11
+  // bits of k + 1023 remain after the shift.
+  __m256i ki = _mm256_castpd_si256(
+      _mm256_add_pd(k, _mm256_set1_pd(6755399441055744.0)));
+  __m256i e = _mm256_slli_epi64(
+      _mm256_add_epi64(ki, _mm256_set1_epi64x(1023)), 52);
+  return _mm256_mul_pd(p, _mm256_castsi256_pd(e));
+}
+
+// log(x) for normal, positive, finite x.
+__attribute__((target("avx2,fma")))
+inline __m256 LogAvx2(__m256 x) {
+  __m256i xi = _mm256_castps_si256(x);
+  __m256 k = _mm256_cvtepi32_ps(_mm256_sub_epi32(
+      _mm256_srli_epi32(xi, 23), _mm256_set1_epi32(127)));
+  __m256 m = _mm256_castsi256_ps(_mm256_or_si256(
+      _mm256_and_si256(xi, _mm256_set1_epi32(0x007fffff)),
+      _mm256_set1_epi32(0x3f800000)));  // 1 <= m < 2.
+  __m256 big = _mm256_cmp_ps(m, _mm256_set1_ps(M_SQRT2), _CMP_GT_OQ);
+  m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+  k = _mm256_add_ps(k, _mm256_and_ps(big, _mm256_set1_ps(1.0f)));
+  __m256 f = _mm256_sub_ps(m, _mm256_set1_ps(1.0f)),
+      s = _mm256_div_ps(f, _mm256_add_ps(m, _mm256_set1_ps(1.0f))),
+      z = _mm256_mul_ps(s, s);
+  __m256 p = _mm256_set1_ps(kLogCoeffsFloat[0]);
+  for (int32 i = 1; i < 5; i++)
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(kLogCoeffsFloat[i]));
+  // 2 atanh(s) = 2s + 2s z p.
+  __m256 s2 = _mm256_add_ps(s, s);
+  __m256 ans = _mm256_fmadd_ps(_mm256_mul_ps(s2, z), p,
+                               _mm256_mul_ps(k, _mm256_set1_ps(kLn2LoFloat)));
+  ans = _mm256_add_ps(ans, s2);
+  return _mm256_fmadd_ps(k, _mm256_set1_ps(kLn2HiFloat), ans);
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256d LogAvx2(__m256d x) {
+  __m256i xi = _mm256_castpd_si256(x);
+  // The exponent bits, as a double: OR-ing them into the bits of 2^52 gives
+  // 2^52 + bits.
+  __m256d k = _mm256_sub_pd(
+      _mm256_castsi256_pd(_mm256_or_si256(
+          _mm256_srli_epi64(xi, 52),
+          _mm256_set1_epi64x(0x4330000000000000LL))),
+      _mm256_set1_pd(4503599627370496.0 + 1023.0));
+  __m256d m = _mm256_castsi256_pd(_mm256_or_si256(
+      _mm256_and_si256(xi, _mm256_set1_epi64x(0x000fffffffffffffLL)),
+      _mm256_set1_epi64x(0x3ff0000000000000LL)));  // 1 <= m < 2.
+  __m256d big = _mm256_cmp_pd(m, _mm256_set1_pd(M_SQRT2), _CMP_GT_OQ);
+  m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+  k = _mm256_add_pd(k, _mm256_and_pd(big, _mm256_set1_pd(1.0)));
+  __m256d f = _mm256_sub_pd(m, _mm256_set1_pd(1.0)),
+      s = _mm256_div_pd(f, _mm256_add_pd(m, _mm256_set1_pd(1.0))),
+      z = _mm256_mul_pd(s, s);
+  __m256d p = _mm256_set1_pd(kLogCoeffsDouble[0]);
+  for (int32 i = 1; i < 11; i++)
+    p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(kLogCoeffsDouble[i]));
+  __m256d s2 = _mm256_add_pd(s, s);
+  __m256d ans = _mm256_fmadd_pd(_mm256_mul_pd(s2, z), p,
+                                _mm256_mul_pd(k, _mm256_set1_pd(kLn2LoDouble)));
+  ans = _mm256_add_pd(ans, s2);
+  return _mm256_fmadd_pd(k, _mm256_set1_pd(kLn2HiDouble), ans);
+}
+
+// The following are the kernels; they do blocks of 8 floats or 4 doubles with
+// the approximations, a block with arguments outside the ranges of the
+// approximations with the generic code, and the remaining elements by
+// copying them to a padded block.
+
+__attribute__((target("avx2,fma")))
+void ExpAvx2(const float *x, float *y, MatrixIndexT n) {
+  const __m256 lo = _mm256_set1_ps(kExpMinFloat),
+      hi = _mm256_set1_ps(kExpMaxFloat);
+  MatrixIndexT i = 0;
+  float buf[8];
+  for (; i < n; i += 8) {
+    const float *in = x + i;
+    if (i + 8 > n) {
+      for (int32 j = 0; j < 8; j++) buf[j] = (i + j < n ? x[i + j] : 0.0f);
+      in = buf;
+    }
+    __m256 v = _mm256_loadu_ps(in);
+    __m256 ok = _mm256_and_ps(_mm256_cmp_ps(v, lo, _CMP_GE_OQ),
+                              _mm256_cmp_ps(v, hi, _CMP_LE_OQ));
+    if (_mm256_movemask_ps(ok) != 0xff) {
+      ExpGeneric(x + i, y + i, std::min<MatrixIndexT>(8, n - i));
+    } else if (in == buf) {
+      _mm256_storeu_ps(buf, ExpAvx2(v));
+      for (MatrixIndexT j = 0; i + j < n; j++) y[i + j] = buf[j];
+    } else {
+      _mm256_storeu_ps(y + i, ExpAvx2(v));
+    }
+  }
+  _mm256_zeroupper();
+}
+
+__attribute__((target("avx2,fma")))
+void ExpAvx2(const double *x, double *y, MatrixIndexT n) {
+  const __m256d lo = _mm256_set1_pd(kExpMinDouble),
+      hi = _mm256_set1_pd(kExpMaxDouble);
+  MatrixIndexT i = 0;
+  double buf[4];
+  for (; i < n; i += 4) {
+    const double *in = x + i;
+    if (i + 4 > n) {
+      for (int32 j = 0; j < 4; j++) buf[j] = (i + j < n ? x[i + j] : 0.0);
+      in = buf;
+    }
+    __m256d v = _mm256_loadu_pd(in);
+    __m256d ok = _mm256_and_pd(_mm256_cmp_pd(v, lo, _CMP_GE_OQ),
+                               _mm256_cmp_pd(v, hi, _CMP_LE_OQ));
+    if (_mm256_movemask_pd(ok) != 0xf) {
+      ExpGeneric(x + i, y + i, std::min<MatrixIndexT>(4, n - i));
+    } else if (in == buf) {
+      _mm256_storeu_pd(buf, ExpAvx2(v));
+      for (MatrixIndexT j = 0; i + j < n; j++) y[i + j] = buf[j];
+    } else {
+      _mm256_storeu_pd(y + i, ExpAvx2(v));
+    }
+  }
+  _mm256_zeroupper();
+}
+
+__attribute__((target("avx2,fma")))
+void LogAvx2(const float *x, float *y, MatrixIndexT n) {
+  const __m256 lo = _mm256_set1_ps(std::numeric_limits<float>::min()),
+      hi = _mm256_set1_ps(std::numeric_limits<float>::max());
+  MatrixIndexT i = 0;
+  float buf[8];
+  for (; i < n; i += 8) {
+    const float *in = x + i;
+    if (i + 8 > n) {
+      for (int32 j = 0; j < 8; j++) buf[j] = (i + j < n ? x[i + j] : 1.0f);
+      in = buf;
+    }
+    __m256 v = _mm256_loadu_ps(in);
+    __m256 ok = _mm256_and_ps(_mm256_cmp_ps(v, lo, _CMP_GE_OQ),
+                              _mm256_cmp_ps(v, hi, _CMP_LE_OQ));
+    if (_mm256_movemask_ps(ok) != 0xff) {
+      LogGeneric(x + i, y + i, std::min<MatrixIndexT>(8, n - i));
+    } else if (in == buf) {
+      _mm256_storeu_ps(buf, LogAvx2(v));
+      for (MatrixIndexT j = 0; i + j < n; j++) y[i + j] = buf[j];
+    } else {
+      _mm256_storeu_ps(y + i, LogAvx2(v));
+    }
+  }
+  _mm256_zeroupper();
+}
+
+__attribute__((target("avx2,fma")))
+void LogAvx2(const double *x, double *y, MatrixIndexT n) {
+  const __m256d lo = _mm256_set1_pd(std::numeric_limits<double>::min()),
+      hi = _mm256_set1_pd(std::numeric_limits<double>::max());
+  MatrixIndexT i = 0;
+  double buf[4];
+  for (; i < n; i += 4) {
+    const double *in = x + i;
+    if (i + 4 > n) {
+      for (int32 j = 0; j < 4; j++) buf[j] = (i + j < n ? x[i + j] : 1.0);
+      in = buf;
+    }
+    __m256d v = _mm256_loadu_pd(in);
+    __m256d ok = _mm256_and_pd(_mm256_cmp_pd(v, lo, _CMP_GE_OQ),
+                               _mm256_cmp_pd(v, hi, _CMP_LE_OQ));
+    if (_mm256_movemask_pd(ok) != 0xf) {
+      LogGeneric(x + i, y + i, std::min<MatrixIndexT>(4, n - i));
+    } else if (in == buf) {
+      _mm256_storeu_pd(buf, LogAvx2(v));
+      for (MatrixIndexT j = 0; i + j < n; j++) y[i + j] = buf[j];
+    } else {
+      _mm256_storeu_pd(y + i, LogAvx2(v));
+    }
+  }
+  _mm256_zeroupper();
+}
+
+// For tanh and sigmoid, the argument of exp() is -|x| or -2|x|, which we
+// floor at the bottom of the range of ExpAvx2(): this changes the result by
+// much less than its precision.  NaNs are passed through.
+
+__attribute__((target("avx2,fma")))
+inline __m256 TanhAvx2(__m256 x) {
+  const __m256 sign = _mm256_set1_ps(-0.0f), one = _mm256_set1_ps(1.0f);
+  __m256 ax = _mm256_andnot_ps(sign, x);
+  __m256 e = ExpAvx2(_mm256_max_ps(_mm256_mul_ps(ax, _mm256_set1_ps(-2.0f)),
+                                   _mm256_set1_ps(kExpMinFloat)));
+  __m256 t = _mm256_div_ps(_mm256_sub_ps(one, e), _mm256_add_ps(one, e));
+  t = _mm256_or_ps(t, _mm256_and_ps(sign, x));
+  return _mm256_blendv_ps(t, x, _mm256_cmp_ps(x, x, _CMP_UNORD_Q));
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256d TanhAvx2(__m256d x) {
+  const __m256d sign = _mm256_set1_pd(-0.0), one = _mm256_set1_pd(1.0);
+  __m256d ax = _mm256_andnot_pd(sign, x);
+  __m256d e = ExpAvx2(_mm256_max_pd(_mm256_mul_pd(ax, _mm256_set1_pd(-2.0)),
+                                    _mm256_set1_pd(kExpMinDouble)));
+  __m256d t = _mm256_div_pd(_mm256_sub_pd(one, e), _mm256_add_pd(one, e));
+  t = _mm256_or_pd(t, _mm256_and_pd(sign, x));
+  return _mm256_blendv_pd(t, x, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256 SigmoidAvx2(__m256 x) {
+  const __m256 sign = _mm256_set1_ps(-0.0f), one = _mm256_set1_ps(1.0f);
+  __m256 e = ExpAvx2(_mm256_max_ps(_mm256_or_ps(x, sign),
+                                   _mm256_set1_ps(kExpMinFloat)));
+  __m256 s = _mm256_div_ps(one, _mm256_add_ps(one, e));
+  s = _mm256_blendv_ps(_mm256_mul_ps(e, s), s,
+                       _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ));
+  return _mm256_blendv_ps(s, x, _mm256_cmp_ps(x, x, _CMP_UNORD_Q));
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256d SigmoidAvx2(__m256d x) {
+  const __m256d sign = _mm256_set1_pd(-0.0), one = _mm256_set1_pd(1.0);
+  __m256d e = ExpAvx2(_mm256_max_pd(_mm256_or_pd(x, sign),
+                                    _mm256_set1_pd(kExpMinDouble)));
+  __m256d s = _mm256_div_pd(one, _mm256_add_pd(one, e));
+  s = _mm256_blendv_pd(_mm256_mul_pd(e, s), s,
+                       _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_GT_OQ));
+  return _mm256_blendv_pd(s, x, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+}
+
+__attribute__((target("avx2,fma")))
+void TanhAvx2(const float *x, float *y, MatrixIndexT n) {
+  MatrixIndexT i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(y + i, TanhAvx2(_mm256_loadu_ps(x + i)));
+  if (i < n) {
+    float buf[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    for (MatrixIndexT j = 0; i + j < n; j++) buf[j] = x[i + j];
+    _mm256_storeu_ps(buf, TanhAvx2(_mm256_loadu_ps(buf)));
+    for (MatrixIndexT j = 0; i + j < n; j++) y[i + j] = buf[j];
+  }
+  _mm256_zeroupper();
+}
+
+__attribute__((target("avx2,fma")))
+void TanhAvx2(const double *x, double *y, MatrixIndexT n) {
+  MatrixIndexT i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(y + i, TanhAvx2(_mm256_loadu_pd(x + i)));
+  if (i < n) {
+    double buf[4] = { 0, 0, 0, 0 };
+    for (MatrixIndexT j = 0; i + j < n; j++) buf[j] = x[i + j];
+    _mm256_storeu_pd(buf, TanhAvx2(_mm256_loadu_pd(buf)));
+    for (MatrixIndexT j = 0; i + j < n; j++) y[i + j] = buf[j];
+  }
+  _mm256_zeroupper();
+}
+
+__attribute__((target("avx2,fma")))
+void SigmoidAvx2(const float *x, float *y, MatrixIndexT n) {
+  MatrixIndexT i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(y + i, SigmoidAvx2(_mm256_loadu_ps(x + i)));
+  if (i < n) {
+    float buf[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    for (MatrixIndexT j = 0; i + j < n; j++) buf[j] = x[i + j];
+    _mm256_storeu_ps(buf, SigmoidAvx2(_mm256_loadu_ps(buf)));
+    for (MatrixIndexT j = 0; i + j < n; j++) y[i + j] = buf[j];
+  }
+  _mm256_zeroupper();
+}
+
+__attribute__((target("avx2,fma")))
+void SigmoidAvx2(const double *x, double *y, MatrixIndexT n) {
+  MatrixIndexT i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(y + i, SigmoidAvx2(_mm256_loadu_pd(x + i)));
+  if (i < n) {
+    double buf[4] = { 0, 0, 0, 0 };
+    for (MatrixIndexT j = 0; i + j < n; j++) buf[j] = x[i + j];
+    _mm256_storeu_pd(buf, SigmoidAvx2(_mm256_loadu_pd(buf)));
+    for (MatrixIndexT j = 0; i + j < n; j++) y[i + j] = buf[j];
+  }
+  _mm256_zeroupper();
+}
+
+// In the sums, x - offset is floored and capped to the range of ExpAvx2(), and
+// the elements below the cutoff (or NaN) are masked out.
+
+__attribute__((target("avx2,fma")))
+double SumExpAvx2(const float *x, MatrixIndexT n, float offset,
+                  float cutoff) {
+  const __m256 off = _mm256_set1_ps(offset), cut = _mm256_set1_ps(cutoff),
+      lo = _mm256_set1_ps(kExpMinFloat), hi = _mm256_set1_ps(kExpMaxFloat);
+  __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+  MatrixIndexT i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(x + i);
+    __m256 mask = _mm256_cmp_ps(v, cut, _CMP_GE_OQ);
+    __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(v, off), lo), hi);
+    __m256 e = _mm256_and_ps(ExpAvx2(a), mask);
+    sum0 = _mm256_add_pd(sum0, _mm256_cvtps_pd(_mm256_castps256_ps128(e)));
+    sum1 = _mm256_add_pd(sum1, _mm256_cvtps_pd(_mm256_extractf128_ps(e, 1)));
+  }
+  double buf[4];
+  _mm256_storeu_pd(buf, _mm256_add_pd(sum0, sum1));
+  _mm256_zeroupper();
+  return (buf[0] + buf[1]) + (buf[2] + buf[3]) +
+      SumExpGeneric(x + i, n - i, offset, cutoff);
+}
+
+__attribute__((target("avx2,fma")))
+double SumExpAvx2(const double *x, MatrixIndexT n, double offset,
+                  double cutoff) {
+  const __m256d off = _mm256_set1_pd(offset), cut = _mm256_set1_pd(cutoff),
+      lo = _mm256_set1_pd(kExpMinDouble), hi = _mm256_set1_pd(kExpMaxDouble);
+  __m256d sum = _mm256_setzero_pd();
+  MatrixIndexT i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d v = _mm256_loadu_pd(x + i);
+    __m256d mask = _mm256_cmp_pd(v, cut, _CMP_GE_OQ);
+    __m256d a = _mm256_min_pd(_mm256_max_pd(_mm256_sub_pd(v, off), lo), hi);
+    sum = _mm256_add_pd(sum, _mm256_and_pd(ExpAvx2(a), mask));
+  }
+  double buf[4];
+  _mm256_storeu_pd(buf, sum);
+  _mm256_zeroupper();
+  return (buf[0] + buf[1]) + (buf[2] + buf[3]) +
+      SumExpGeneric(x + i, n - i, offset, cutoff);
+}
+
+#endif  // KALDI_SIMD_MATH_X86_SIMD
+
+#ifdef KALDI_SIMD_MATH_NEON
+
+// The NEON kernels are for float only; they follow the AVX2 versions.
+
+inline float32x4_t ExpNeon(float32x4_t x) {
+  float32x4_t k = vrndnq_f32(vmulq_n_f32(x, kLog2eFloat));
+  float32x4_t r = vfmsq_f32(x, k, vdupq_n_f32(kLn2HiFloat));
+  r = vfmsq_f32(r, k, vdupq_n_f32(kLn2LoFloat));
+  float32x4_t p = vdupq_n_f32(kExpCoeffsFloat[0]);
+  for (int32 i = 1; i < 6; i++)
+    p = vfmaq_f32(vdupq_n_f32(kExpCoeffsFloat[i]), p, r);
+  p = vfmaq_f32(vaddq_f32(r, vdupq_n_f32(1.0f)), p, vmulq_f32(r, r));
+  int32x4_t e = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(k), vdupq_n_s32(127)),
+                            23);
+  return vmulq_f32(p, vreinterpretq_f32_s32(e));
+}
+
+inline float32x4_t LogNeon(float32x4_t x) {
+  uint32x4_t xi = vreinterpretq_u32_f32(x);
+  float32x4_t k = vcvtq_f32_s32(vsubq_s32(
+      vreinterpretq_s32_u32(vshrq_n_u32(xi, 23)), vdupq_n_s32(127)));
+  float32x4_t m = vreinterpretq_f32_u32(vorrq_u32(
+      vandq_u32(xi, vdupq_n_u32(0x007fffff)), vdupq_n_u32(0x3f800000)));
+  uint32x4_t big = vcgtq_f32(m, vdupq_n_f32(M_SQRT2));
+  m = vbslq_f32(big, vmulq_n_f32(m, 0.5f), m);
+  k = vaddq_f32(k, vreinterpretq_f32_u32(
+      vandq_u32(big, vreinterpretq_u32_f32(vdupq_n_f32(1.0f)))));
+  float32x4_t f = vsubq_f32(m, vdupq_n_f32(1.0f)),
+      s = vdivq_f32(f, vaddq_f32(m, vdupq_n_f32(1.0f))),
+      z = vmulq_f32(s, s);
+  float32x4_t p = vdupq_n_f32(kLogCoeffsFloat[0]);
+  for (int32 i = 1; i < 5; i++)
+    p = vfmaq_f32(vdupq_n_f32(kLogCoeffsFloat[i]), p, z);
+  float32x4_t s2 = vaddq_f32(s, s);
+  float32x4_t ans = vfmaq_f32(vmulq_n_f32(k, kLn2LoFloat),
+                              vmulq_f32(s2, z), p);
+  ans = vaddq_f32(ans, s2);
+  return vfmaq_f32(ans, k, vdupq_n_f32(kLn2HiFloat));
+}
+
+inline float32x4_t TanhNeon(float32x4_t x) {
+  const float32x4_t one = vdupq_n_f32(1.0f);
+  float32x4_t e = ExpNeon(vmaxq_f32(vmulq_n_f32(vabsq_f32(x), -2.0f),
+                                    vdupq_n_f32(kExpMinFloat)));
+  float32x4_t t = vdivq_f32(vsubq_f32(one, e), vaddq_f32(one, e));
+  // Copy the sign of x; vbslq takes the sign bit from x.
+  t = vbslq_f32(vdupq_n_u32(0x80000000), x, t);
+  return vbslq_f32(vceqq_f32(x, x), t, x);
+}
+
+inline float32x4_t SigmoidNeon(float32x4_t x) {
+  const float32x4_t one = vdupq_n_f32(1.0f);
+  float32x4_t e = ExpNeon(vmaxq_f32(vnegq_f32(vabsq_f32(x)),
+                                    vdupq_n_f32(kExpMinFloat)));
+  float32x4_t s = vdivq_f32(one, vaddq_f32(one, e));
+  s = vbslq_f32(vcgtq_f32(x, vdupq_n_f32(0.0f)), s, vmulq_f32(e, s));
+  return vbslq_f32(vceqq_f32(x, x), s, x);
+}
+
+void ExpNeon(const float *x, float *y, MatrixIndexT n) {
+  const float32x4_t lo = vdupq_n_f32(kExpMinFloat),
+      hi = vdupq_n_f32(kExpMaxFloat);
+  float buf[4];
+  for (MatrixIndexT i = 0; i < n; i += 4) {
+    const float *in = x + i;
+    if (i + 4 > n) {
+      for (int32 j = 0; j < 4; j++) buf[j] = (i + j < n ? x[i + j] : 0.0f);
+      in = buf;
+    }
+    float32x4_t v = vld1q_f32(in);
+    uint32x4_t ok = vandq_u32(vcgeq_f32(v, lo), vcleq_f32(v, hi));
+    if (vminvq_u32(ok) == 0) {
+      ExpGeneric(x + i, y + i, std::min<MatrixIndexT>(4, n - i));
+    } else if (in == buf) {
+      vst1q_f32(buf, ExpNeon(v));
+      for (MatrixIndexT j = 0; i + j < n; j++) y[i + j] = buf[j];
+    } else {
+      vst1q_f32(y + i, ExpNeon(v));
+    }
+  }
+}
+
+void LogNeon(const float *x, float *y, MatrixIndexT n) {
+  const float32x4_t lo = vdupq_n_f32(std::numeric_limits<float>::min()),
+      hi = vdupq_n_f32(std::numeric_limits<float>::max());
+  float buf[4];
+  for (MatrixIndexT i = 0; i < n; i += 4) {
+    const float *in = x + i;
+    if (i + 4 > n) {
+      for (int32 j = 0; j < 4; j++) buf[j] = (i + j < n ? x[i + j] : 1.0f);
+      in = buf;
+    }
+    float32x4_t v = vld1q_f32(in);
+    uint32x4_t ok = vandq_u32(vcgeq_f32(v, lo), vcleq_f32(v, hi));
+    if (vminvq_u32(ok) == 0) {
+      LogGeneric(x + i, y + i, std::min<MatrixIndexT>(4, n - i));
+    } else if (in == buf) {
+      vst1q_f32(buf, LogNeon(v));
+      for (MatrixIndexT j = 0; i + j < n; j++) y[i + j] = buf[j];
+    } else {
+      vst1q_f32(y + i, LogNeon(v));
+    }
+  }
+}
+
+void TanhNeon(const float *x, float *y, MatrixIndexT n) {
+  MatrixIndexT i = 0;
+  for (; i + 4 <= n; i += 4)
+    vst1q_f32(y + i, TanhNeon(vld1q_f32(x + i)));
+  if (i < n) {
+    float buf[4] = { 0, 0, 0, 0 };
+    for (MatrixIndexT j = 0; i + j < n; j++) buf[j] = x[i + j];
+    vst1q_f32(buf, TanhNeon(vld1q_f32(buf)));
+    for (MatrixIndexT j = 0; i + j < n; j++) y[i + j] = buf[j];
+  }
+}
+
+void SigmoidNeon(const float *x, float *y, MatrixIndexT n) {
+  MatrixIndexT i = 0;
+  for (; i + 4 <= n; i += 4)
+    vst1q_f32(y + i, SigmoidNeon(vld1q_f32(x + i)));
+  if (i < n) {
+    float buf[4] = { 0, 0, 0, 0 };
+    for (MatrixIndexT j = 0; i + j < n; j++) buf[j] = x[i + j];
+    vst1q_f32(buf, SigmoidNeon(vld1q_f32(buf)));
+    for (MatrixIndexT j = 0; i + j < n; j++) y[i + j] = buf[j];
+  }
+}
+
+double SumExpNeon(const float *x, MatrixIndexT n, float offset,
+                  float cutoff) {
+  const float32x4_t off = vdupq_n_f32(offset), cut = vdupq_n_f32(cutoff),
+      lo = vdupq_n_f32(kExpMinFloat), hi = vdupq_n_f32(kExpMaxFloat);
+  float64x2_t sum0 = vdupq_n_f64(0.0), sum1 = vdupq_n_f64(0.0);
+  MatrixIndexT i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t v = vld1q_f32(x + i);
+    uint32x4_t mask = vcgeq_f32(v, cut);
+    float32x4_t a = vminq_f32(vmaxq_f32(vsubq_f32(v, off), lo), hi);
+    float32x4_t e = vreinterpretq_f32_u32(
+        vandq_u32(vreinterpretq_u32_f32(ExpNeon(a)), mask));
+    sum0 = vaddq_f64(sum0, vcvt_f64_f32(vget_low_f32(e)));
+    sum1 = vaddq_f64(sum1, vcvt_high_f64_f32(e));
+  }
+  return vaddvq_f64(vaddq_f64(sum0, sum1)) +
+      SumExpGeneric(x + i, n - i, offset, cutoff);
+}
+
+#endif  // KALDI_SIMD_MATH_NEON
+
+
+struct MathKernels {
+  const char *name;
+  void (*exp_float)(const float *x, float *y, MatrixIndexT n);
+  void (*exp_double)(const double *x, double *y, MatrixIndexT n);
+  void (*log_float)(const float *x, float *y, MatrixIndexT n);
+  void (*log_double)(const double *x, double *y, MatrixIndexT n);
+  void (*tanh_float)(const float *x, float *y, MatrixIndexT n);
+  void (*tanh_double)(const double *x, double *y, MatrixIndexT n);
+  void (*sigmoid_float)(const float *x, float *y, MatrixIndexT n);
+  void (*sigmoid_double)(const double *x, double *y, MatrixIndexT n);
+  double (*sum_exp_float)(const float *x, MatrixIndexT n, float offset,
+                          float cutoff);
+  double (*sum_exp_double)(const double *x, MatrixIndexT n, double offset,
+                           double cutoff);
+};
+
+const MathKernels kGenericKernels = {
+  "generic", ExpGeneric<float>, ExpGeneric<double>, LogGeneric<float>,
+  LogGeneric<double>, TanhGeneric<float>, TanhGeneric<double>,
+  SigmoidGeneric<float>, SigmoidGeneric<double>, SumExpGeneric<float>,
+  SumExpGeneric<double>
+};
+
+#ifdef KALDI_SIMD_MATH_X86_SIMD
+const MathKernels kAvx2Kernels = {
+  "avx2", ExpAvx2, ExpAvx2, LogAvx2, LogAvx2, TanhAvx2, TanhAvx2,
+  SigmoidAvx2, SigmoidAvx2, SumExpAvx2, SumExpAvx2
+};
+#endif
+#ifdef KALDI_SIMD_MATH_NEON
+const MathKernels kNeonKernels = {
+  "neon", ExpNeon, ExpGeneric<double>, LogNeon, LogGeneric<double>,
+  TanhNeon, TanhGeneric<double>, SigmoidNeon, SigmoidGeneric<double>,
+  SumExpNeon, SumExpGeneric<double>
+};
+#endif
+
+const MathKernels *SelectSimdKernels() {
+#ifdef KALDI_SIMD_MATH_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return &kAvx2Kernels;
+#endif
+#ifdef KALDI_SIMD_MATH_NEON
+  return &kNeonKernels;
+#endif
+  return &kGenericKernels;
+}
+
+bool simd_math_use_simd = true;
+
+const MathKernels &Kernels() {
+  static const MathKernels *simd_kernels = SelectSimdKernels();
+  return (simd_math_use_simd ? *simd_kernels : kGenericKernels);
+}
+
+}  // namespace
+
+
+void SimdExp(const float *x, float *y, MatrixIndexT n) {
+  Kernels().exp_float(x, y, n);
+}
+void SimdExp(const double *x, double *y, MatrixIndexT n) {
+  Kernels().exp_double(x, y, n);
+}
+void SimdLog(const float *x, float *y, MatrixIndexT n) {
+  Kernels().log_float(x, y, n);
+}
+void SimdLog(const double *x, double *y, MatrixIndexT n) {
+  Kernels().log_double(x, y, n);
+}
+void SimdTanh(const float *x, float *y, MatrixIndexT n) {
+  Kernels().tanh_float(x, y, n);
+}
+void SimdTanh(const double *x, double *y, MatrixIndexT n) {
+  Kernels().tanh_double(x, y, n);
+}
+void SimdSigmoid(const float *x, float *y, MatrixIndexT n) {
+  Kernels().sigmoid_float(x, y, n);
+}
+void SimdSigmoid(const double *x, double *y, MatrixIndexT n) {
+  Kernels().sigmoid_double(x, y, n);
+}
+double SimdSumExp(const float *x, MatrixIndexT n, float offset,
+                  float cutoff) {
+  return Kernels().sum_exp_float(x, n, offset, cutoff);
+}
+double SimdSumExp(const double *x, MatrixIndexT n, double offset,
+                  double cutoff) {
+  return Kernels().sum_exp_double(x, n, offset, cutoff);
+}
+
+void SimdMathSetUseSimd(bool use_simd) {
+  simd_math_use_simd = use_simd;
+}
+
+const char *SimdMathKernelName() {
+  return Kernels().name;
+}
+
+}  // namespace kaldi
@@ -0,0 +1,82 @@
+// matrix/simd-math.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_SIMD_MATH_H_
+#define KALDI_MATRIX_SIMD_MATH_H_
+
+#include "matrix/matrix-common.h"
+
+namespace kaldi {
+
+/// @addtogroup matrix_funcs_misc
+/// @{
+
+/**
+   Element-wise exp, log, tanh and sigmoid on arrays, as used by
+   VectorBase::ApplyExp(), ApplyLog(), Tanh(), Sigmoid(), ApplySoftMax(),
+   LogSumExp() and the corresponding MatrixBase functions.
+
+   Where available, they use SIMD polynomial approximations: AVX2 (with FMA) on
+   x86 if the CPU supports it, and NEON on 64-bit ARM (float only).  The
+   relative errors of these, compared with the correctly rounded result, are
+   at most:
+     - exp: 2 ulp for float, 2 ulp for double;
+     - log: 2 ulp for float, 2 ulp for double (absolute error 2 ulp of
+            log(2) near x = 1);
+     - tanh and sigmoid: as for the generic code, which computes them from
+            exp(), i.e. an absolute error of about 1e-7 for float and 2e-16 for
+            double.
+   The approximations are used only for arguments where they are accurate and
+   the result is a normal number (e.g. -87 <= x <= 88 for exp of float); any
+   SIMD block containing other arguments (including infinities and NaNs) is
+   done with the libm functions, so special values behave as before.
+
+   The in-place versions are allowed, i.e. x == y.
+*/
+void SimdExp(const float *x, float *y, MatrixIndexT n);
+void SimdExp(const double *x, double *y, MatrixIndexT n);
+
+/// The arguments must be positive (or zero, giving -inf).
+void SimdLog(const float *x, float *y, MatrixIndexT n);
+void SimdLog(const double *x, double *y, MatrixIndexT n);
+
+void SimdTanh(const float *x, float *y, MatrixIndexT n);
+void SimdTanh(const double *x, double *y, MatrixIndexT n);
+
+void SimdSigmoid(const float *x, float *y, MatrixIndexT n);
+void SimdSigmoid(const double *x, double *y, MatrixIndexT n);
+
+/// Returns the sum of exp(x[i] - offset) over the i with x[i] >= cutoff,
+/// accumulated in double.  This is the inner loop of LogSumExp(); the
+/// elements that are summed must have x[i] - offset <= 0.
+double SimdSumExp(const float *x, MatrixIndexT n, float offset, float cutoff);
+double SimdSumExp(const double *x, MatrixIndexT n, double offset,
+                  double cutoff);
+
+/// SimdMathSetUseSimd(false) forces the generic code, which uses the libm
+/// functions as Kaldi did before these functions existed; it is intended for
+/// testing and benchmarking.
+void SimdMathSetUseSimd(bool use_simd);
+
+/// Returns the name of the kernels in use, e.g. "avx2" or "generic".
+const char *SimdMathKernelName();
+
+/// @} end of "addtogroup matrix_funcs_misc"
+
+}  // namespace kaldi
+
+#endif  // KALDI_MATRIX_SIMD_MATH_H_
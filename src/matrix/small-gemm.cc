@@ -0,0 +1,278 @@
+// matrix/small-gemm.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "matrix/small-gemm.h"
+
+// See compressed-matrix.cc regarding these conditions.
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define KALDI_SMALL_GEMM_X86_SIMD 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define KALDI_SMALL_GEMM_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace kaldi {
+
+namespace {
+
+// The micro-kernels compute a block of up to kBlockRows rows and kPanelCols
+// columns of the output, from kBlockRows rows of op(A) and a panel of
+// kPanelCols columns of op(B) that has been copied to a contiguous buffer, K
+// by kPanelCols (padded with zeros).  Copying the panel makes the kernels the
+// same for both values of transB, and it is reused by all the row blocks.
+const int32 kBlockRows = 6, kPanelCols = 16;
+
+// Adds alpha times the product to the block of M; 'mr' and 'nr' are the
+// numbers of rows and columns in the block, and element (i, k) of op(A) is
+// a[i * a_row_stride + k * a_col_stride].
+typedef void (*SmallGemmKernel)(int32 mr, int32 nr, MatrixIndexT K,
+                                const float *a, MatrixIndexT a_row_stride,
+                                MatrixIndexT a_col_stride,
+                                const float *b_panel, float alpha,
+                                float *m, MatrixIndexT m_stride);
+
+#ifdef KALDI_SMALL_GEMM_X86_SIMD
+
+// The accumulators are named variables rather than arrays, so that they are
+// kept in registers at -O1, at which Kaldi is usually compiled.  If mr <
+// kBlockRows, the missing rows are computed from the first row and then
+// discarded.
+__attribute__((target("avx2,fma")))
+void KernelAvx2(int32 mr, int32 nr, MatrixIndexT K,
+                const float *a, MatrixIndexT a_row_stride,
+                MatrixIndexT a_col_stride, const float *b_panel, float alpha,
+                float *m, MatrixIndexT m_stride) {
+  MatrixIndexT o[kBlockRows];
+  for (int32 r = 0; r < kBlockRows; r++)
+    o[r] = (r < mr ? r * a_row_stride : 0);
+  const MatrixIndexT o1 = o[1], o2 = o[2], o3 = o[3], o4 = o[4], o5 = o[5];
+  __m256 c00 = _mm256_setzero_ps(), c01 = c00, c10 = c00, c11 = c00,
+      c20 = c00, c21 = c00, c30 = c00, c31 = c00, c40 = c00, c41 = c00,
+      c50 = c00, c51 = c00;
+  for (MatrixIndexT k = 0; k < K; k++, a += a_col_stride,
+           b_panel += kPanelCols) {
+    __m256 b0 = _mm256_loadu_ps(b_panel), b1 = _mm256_loadu_ps(b_panel + 8),
+        av;
+#define KALDI_SMALL_GEMM_ROW(offset, acc0, acc1)    \
+    av = _mm256_broadcast_ss(a + offset);           \
+    acc0 = _mm256_fmadd_ps(av, b0, acc0);           \
+    acc1 = _mm256_fmadd_ps(av, b1, acc1);
+    KALDI_SMALL_GEMM_ROW(0, c00, c01)
+    KALDI_SMALL_GEMM_ROW(o1, c10, c11)
+    KALDI_SMALL_GEMM_ROW(o2, c20, c21)
+    KALDI_SMALL_GEMM_ROW(o3, c30, c31)
+    KALDI_SMALL_GEMM_ROW(o4, c40, c41)
+    KALDI_SMALL_GEMM_ROW(o5, c50, c51)
+#undef KALDI_SMALL_GEMM_ROW
+  }
+  __m256 acc[kBlockRows][2] = { { c00, c01 }, { c10, c11 }, { c20, c21 },
+                                { c30, c31 }, { c40, c41 }, { c50, c51 } };
+  __m256 alpha_v = _mm256_set1_ps(alpha);
+  for (int32 r = 0; r < mr; r++) {
+    float *m_row = m + r * m_stride;
+    if (nr == kPanelCols) {
+      _mm256_storeu_ps(m_row, _mm256_fmadd_ps(alpha_v, acc[r][0],
+                                              _mm256_loadu_ps(m_row)));
+      _mm256_storeu_ps(m_row + 8, _mm256_fmadd_ps(alpha_v, acc[r][1],
+                                                  _mm256_loadu_ps(m_row + 8)));
+    } else {
+      float buf[kPanelCols];
+      _mm256_storeu_ps(buf, _mm256_mul_ps(alpha_v, acc[r][0]));
+      _mm256_storeu_ps(buf + 8, _mm256_mul_ps(alpha_v, acc[r][1]));
+      for (int32 j = 0; j < nr; j++)
+        m_row[j] += buf[j];
+    }
+  }
+  _mm256_zeroupper();
+}
+
+#endif  // KALDI_SMALL_GEMM_X86_SIMD
+
+#ifdef KALDI_SMALL_GEMM_NEON
+
+void KernelNeon(int32 mr, int32 nr, MatrixIndexT K,
+                const float *a, MatrixIndexT a_row_stride,
+                MatrixIndexT a_col_stride, const float *b_panel, float alpha,
+                float *m, MatrixIndexT m_stride) {
+  MatrixIndexT o[kBlockRows];
+  for (int32 r = 0; r < kBlockRows; r++)
+    o[r] = (r < mr ? r * a_row_stride : 0);
+  float32x4_t acc[kBlockRows][4];
+  for (int32 r = 0; r < kBlockRows; r++)
+    for (int32 q = 0; q < 4; q++)
+      acc[r][q] = vdupq_n_f32(0.0f);
+  for (MatrixIndexT k = 0; k < K; k++, a += a_col_stride,
+           b_panel += kPanelCols) {
+    float32x4_t b0 = vld1q_f32(b_panel), b1 = vld1q_f32(b_panel + 4),
+        b2 = vld1q_f32(b_panel + 8), b3 = vld1q_f32(b_panel + 12);
+    for (int32 r = 0; r < kBlockRows; r++) {
+      float av = a[o[r]];
+      acc[r][0] = vfmaq_n_f32(acc[r][0], b0, av);
+      acc[r][1] = vfmaq_n_f32(acc[r][1], b1, av);
+      acc[r][2] = vfmaq_n_f32(acc[r][2], b2, av);
+      acc[r][3] = vfmaq_n_f32(acc[r][3], b3, av);
+    }
+  }
+  for (int32 r = 0; r < mr; r++) {
+    float *m_row = m + r * m_stride;
+    if (nr == kPanelCols) {
+      for (int32 q = 0; q < 4; q++)
+        vst1q_f32(m_row + 4 * q,
+                  vfmaq_n_f32(vld1q_f32(m_row + 4 * q), acc[r][q], alpha));
+    } else {
+      float buf[kPanelCols];
+      for (int32 q = 0; q < 4; q++)
+        vst1q_f32(buf + 4 * q, vmulq_n_f32(acc[r][q], alpha));
+      for (int32 j = 0; j < nr; j++)
+        m_row[j] += buf[j];
+    }
+  }
+}
+
+#endif  // KALDI_SMALL_GEMM_NEON
+
+struct SmallGemmKernels {
+  const char *name;
+  SmallGemmKernel kernel;
+};
+
+SmallGemmKernels SelectKernels() {
+#ifdef KALDI_SMALL_GEMM_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    SmallGemmKernels ans = { "avx2", KernelAvx2 };
+    return ans;
+  }
+#endif
+#ifdef KALDI_SMALL_GEMM_NEON
+  SmallGemmKernels ans = { "neon", KernelNeon };
+  return ans;
+#endif
+  SmallGemmKernels none = { "none", NULL };
+  return none;
+}
+
+const SmallGemmKernels &Kernels() {
+  static const SmallGemmKernels kernels = SelectKernels();
+  return kernels;
+}
+
+// The kernels were faster than single-threaded OpenBLAS for all the products
+// of at least kMinRows rows and at most kMaxK inner dimension that we timed
+// up to this size, which includes the 20 x 512 x 512 products of online
+// decoding.  With fewer rows, copying the panels of B costs too much, and with
+// larger K they no longer fit in the cache.
+int64 small_gemm_threshold = 16 * 1024 * 1024;
+const MatrixIndexT kMinRows = 4, kMaxK = 1024;
+
+}  // namespace
+
+
+bool SmallGemm(float alpha,
+               MatrixTransposeType transA, const float *A,
+               MatrixIndexT a_num_rows, MatrixIndexT a_num_cols,
+               MatrixIndexT a_stride,
+               MatrixTransposeType transB, const float *B,
+               MatrixIndexT b_stride,
+               float beta, float *M,
+               MatrixIndexT num_rows, MatrixIndexT num_cols,
+               MatrixIndexT stride) {
+  SmallGemmKernel kernel = Kernels().kernel;
+  MatrixIndexT K = (transA == kNoTrans ? a_num_cols : a_num_rows);
+  if (kernel == NULL || num_rows < kMinRows || K > kMaxK ||
+      static_cast<int64>(num_rows) * num_cols * K > small_gemm_threshold)
+    return false;
+
+  for (MatrixIndexT i = 0; i < num_rows; i++) {
+    float *m_row = M + i * stride;
+    if (beta == 0.0) {
+      std::memset(m_row, 0, sizeof(float) * num_cols);  // as BLAS does.
+    } else if (beta != 1.0) {
+      for (MatrixIndexT j = 0; j < num_cols; j++)
+        m_row[j] *= beta;
+    }
+  }
+  if (alpha == 0.0 || K == 0)
+    return true;
+
+  MatrixIndexT a_row_stride = (transA == kNoTrans ? a_stride : 1),
+      a_col_stride = (transA == kNoTrans ? 1 : a_stride);
+  // The panel is on the stack if it is small enough, to save the allocation
+  // for the smallest products.
+  const MatrixIndexT kMaxStackK = 256;
+  float stack_panel[kMaxStackK * kPanelCols];
+  std::vector<float> heap_panel;
+  float *panel = stack_panel;
+  if (K > kMaxStackK) {
+    heap_panel.resize(static_cast<size_t>(K) * kPanelCols);
+    panel = &(heap_panel[0]);
+  }
+  for (MatrixIndexT j0 = 0; j0 < num_cols; j0 += kPanelCols) {
+    int32 nr = std::min<MatrixIndexT>(kPanelCols, num_cols - j0);
+    if (nr < kPanelCols)
+      std::fill(panel, panel + K * kPanelCols, 0.0f);
+    if (transB == kNoTrans) {
+      for (MatrixIndexT k = 0; k < K; k++)
+        std::memcpy(panel + k * kPanelCols, B + k * b_stride + j0,
+                    sizeof(float) * nr);
+    } else {
+      for (int32 j = 0; j < nr; j++) {
+        const float *b_row = B + (j0 + j) * b_stride;
+        for (MatrixIndexT k = 0; k < K; k++)
+          panel[k * kPanelCols + j] = b_row[k];
+      }
+    }
+    for (MatrixIndexT i0 = 0; i0 < num_rows; i0 += kBlockRows) {
+      int32 mr = std::min<MatrixIndexT>(kBlockRows, num_rows - i0);
+      kernel(mr, nr, K, A + i0 * a_row_stride, a_row_stride, a_col_stride,
+             panel, alpha, M + i0 * stride + j0, stride);
+    }
+  }
+  return true;
+}
+
+bool SmallGemm(double alpha,
+               MatrixTransposeType transA, const double *A,
+               MatrixIndexT a_num_rows, MatrixIndexT a_num_cols,
+               MatrixIndexT a_stride,
+               MatrixTransposeType transB, const double *B,
+               MatrixIndexT b_stride,
+               double beta, double *M,
+               MatrixIndexT num_rows, MatrixIndexT num_cols,
+               MatrixIndexT stride) {
+  return false;  // There are no kernels for double.
+}
+
+void SetSmallGemmThreshold(int64 max_flops) {
+  small_gemm_threshold = max_flops;
+}
+
+int64 SmallGemmThreshold() {
+  return small_gemm_threshold;
+}
+
+const char *SmallGemmKernelName() {
+  return Kernels().name;
+}
+
+}  // namespace kaldi
@@ -0,0 +1,78 @@
+// matrix/small-gemm.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_SMALL_GEMM_H_
+#define KALDI_MATRIX_SMALL_GEMM_H_
+
+#include "matrix/matrix-common.h"
+
+namespace kaldi {
+
+/// @addtogroup matrix_funcs_misc
+/// @{
+
+/**
+   SmallGemm() is the path of MatrixBase::AddMatMat() for small products, for
+   which the call overhead of BLAS (argument checking, thread dispatch and
+   packing for large blocks) is a large part of the time; a typical case is the
+   product of a chunk of 20 frames of online decoding with a 512 x 512 weight
+   matrix.  It computes, like cblas_Xgemm(),
+      M = beta M + alpha op(A) op(B)
+   where op(A) is num_rows by K and op(B) is K by num_cols, using register-
+   blocked micro-kernels: AVX2 (with FMA) on x86 if the CPU supports it, and
+   NEON on 64-bit ARM.  These exist only for float.
+
+   It returns false, without doing anything, if there is no kernel for Real,
+   if the product is larger than SmallGemmThreshold(), or if its shape is one
+   for which the kernels are slower than BLAS (fewer than 4 rows, or K > 1024);
+   the caller should then use BLAS.  The result differs from that of BLAS only
+   by rounding.
+*/
+bool SmallGemm(float alpha,
+               MatrixTransposeType transA, const float *A,
+               MatrixIndexT a_num_rows, MatrixIndexT a_num_cols,
+               MatrixIndexT a_stride,
+               MatrixTransposeType transB, const float *B,
+               MatrixIndexT b_stride,
+               float beta, float *M,
+               MatrixIndexT num_rows, MatrixIndexT num_cols,
+               MatrixIndexT stride);
+bool SmallGemm(double alpha,
+               MatrixTransposeType transA, const double *A,
+               MatrixIndexT a_num_rows, MatrixIndexT a_num_cols,
+               MatrixIndexT a_stride,
+               MatrixTransposeType transB, const double *B,
+               MatrixIndexT b_stride,
+               double beta, double *M,
+               MatrixIndexT num_rows, MatrixIndexT num_cols,
+               MatrixIndexT stride);
+
+/// Sets the largest product, in multiply-adds (num_rows * num_cols * K), for
+/// which SmallGemm() is used.  0 means that AddMatMat() always uses BLAS.
+void SetSmallGemmThreshold(int64 max_flops);
+
+int64 SmallGemmThreshold();
+
+/// Returns the name of the kernels in use, e.g. "avx2", or "none" if there are
+/// none for this machine.
+const char *SmallGemmKernelName();
+
+/// @} end of "addtogroup matrix_funcs_misc"
+
+}  // namespace kaldi
+
+#endif  // KALDI_MATRIX_SMALL_GEMM_H_
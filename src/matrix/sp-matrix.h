@@ -161,8 +161,9 @@ class SpMatrix : public PackedMatrix<Real> {
                         Real tolerance = 0.001) const;
 
   /// Solves the symmetric eigenvalue problem: at end we should have (*this) = P
-  /// * diag(s) * P^T.  We solve the problem using the symmetric QR method.
-  /// P may be NULL.
+  /// * diag(s) * P^T.  We solve the problem using LAPACK's divide-and-conquer
+  /// solver (?syevd) if we are compiled with LAPACK, and otherwise (or if that
+  /// fails) using the symmetric QR method.  P may be NULL.
   /// Implemented in qr.cc.
   /// If you need the eigenvalues sorted, the function SortSvd declared in
   /// kaldi-matrix is suitable.
@@ -355,6 +356,12 @@ class SpMatrix : public PackedMatrix<Real> {
   /// this.
   void Qr(MatrixBase<Real> *Q);
 
+#if !defined(HAVE_ATLAS) && !defined(USE_KALDI_SVD)
+  /// Does the same as Eig(), using LAPACK's ?syevd; returns false if it did
+  /// not converge.  Implemented in qr.cc.
+  bool LapackSyevd(VectorBase<Real> *s, MatrixBase<Real> *P) const;
+#endif
+
  private:
  void EigInternal(VectorBase<Real> *s, MatrixBase<Real> *P,
                    Real tolerance, int recurse) const;
@@ -0,0 +1,287 @@
+// matrix/sparse-gemm.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <vector>
+
+#include "matrix/sparse-gemm.h"
+
+// See compressed-matrix.cc regarding these conditions.
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define KALDI_SPARSE_GEMM_X86_SIMD 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define KALDI_SPARSE_GEMM_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace kaldi {
+
+namespace {
+
+// The number of rows of A (and M) processed at once.  A block of rows is
+// transposed into a buffer with kLanes elements per column, so that for each
+// nonzero element B(j, k) the kernels do one multiply-add of kLanes values.
+const int32 kLanes = 16;
+
+// In the kernels, 'a_t' is the transposed block of A, with column k of the
+// block at a_t + k * kLanes.
+
+// For transB == kTrans: sets acc[i] = sum_k B(j, k) * a_t[k * kLanes + i],
+// for the nonzero elements B(j, k) of one row of B, given as 'n' pairs.
+typedef void (*SparseDotKernel)(const std::pair<MatrixIndexT, float> *e,
+                                MatrixIndexT n, const float *a_t, float *acc);
+
+// For transB == kNoTrans: for the nonzero elements B(j, k) of row j of B,
+// adds B(j, k) * a_t[j * kLanes + i] to m_t[k * kLanes + i]; 'a_col' is
+// a_t + j * kLanes.
+typedef void (*SparseAxpyKernel)(const std::pair<MatrixIndexT, float> *e,
+                                 MatrixIndexT n, const float *a_col,
+                                 float *m_t);
+
+template<typename Real>
+void SparseDotGeneric(const std::pair<MatrixIndexT, Real> *e, MatrixIndexT n,
+                      const Real *a_t, Real *acc) {
+  for (int32 i = 0; i < kLanes; i++)
+    acc[i] = 0.0;
+  for (MatrixIndexT p = 0; p < n; p++) {
+    Real b = e[p].second;
+    const Real *a_col = a_t + e[p].first * kLanes;
+    for (int32 i = 0; i < kLanes; i++)
+      acc[i] += b * a_col[i];
+  }
+}
+
+template<typename Real>
+void SparseAxpyGeneric(const std::pair<MatrixIndexT, Real> *e, MatrixIndexT n,
+                       const Real *a_col, Real *m_t) {
+  for (MatrixIndexT p = 0; p < n; p++) {
+    Real b = e[p].second;
+    Real *m_col = m_t + e[p].first * kLanes;
+    for (int32 i = 0; i < kLanes; i++)
+      m_col[i] += b * a_col[i];
+  }
+}
+
+#ifdef KALDI_SPARSE_GEMM_X86_SIMD
+
+__attribute__((target("avx2,fma")))
+void SparseDotAvx2(const std::pair<MatrixIndexT, float> *e, MatrixIndexT n,
+                   const float *a_t, float *acc) {
+  // two independent sets of accumulators, to hide the latency of the FMAs.
+  __m256 s0 = _mm256_setzero_ps(), s1 = s0, t0 = s0, t1 = s0;
+  MatrixIndexT p = 0;
+  for (; p + 1 < n; p += 2) {
+    const float *a0 = a_t + e[p].first * kLanes,
+        *a1 = a_t + e[p + 1].first * kLanes;
+    __m256 b0 = _mm256_set1_ps(e[p].second), b1 = _mm256_set1_ps(e[p + 1].second);
+    s0 = _mm256_fmadd_ps(b0, _mm256_loadu_ps(a0), s0);
+    s1 = _mm256_fmadd_ps(b0, _mm256_loadu_ps(a0 + 8), s1);
+    t0 = _mm256_fmadd_ps(b1, _mm256_loadu_ps(a1), t0);
+    t1 = _mm256_fmadd_ps(b1, _mm256_loadu_ps(a1 + 8), t1);
+  }
+  if (p < n) {
+    const float *a0 = a_t + e[p].first * kLanes;
+    __m256 b0 = _mm256_set1_ps(e[p].second);
+    s0 = _mm256_fmadd_ps(b0, _mm256_loadu_ps(a0), s0);
+    s1 = _mm256_fmadd_ps(b0, _mm256_loadu_ps(a0 + 8), s1);
+  }
+  _mm256_storeu_ps(acc, _mm256_add_ps(s0, t0));
+  _mm256_storeu_ps(acc + 8, _mm256_add_ps(s1, t1));
+  _mm256_zeroupper();
+}
+
+__attribute__((target("avx2,fma")))
+void SparseAxpyAvx2(const std::pair<MatrixIndexT, float> *e, MatrixIndexT n,
+                    const float *a_col, float *m_t) {
+  __m256 a0 = _mm256_loadu_ps(a_col), a1 = _mm256_loadu_ps(a_col + 8);
+  for (MatrixIndexT p = 0; p < n; p++) {
+    float *m_col = m_t + e[p].first * kLanes;
+    __m256 b = _mm256_set1_ps(e[p].second);
+    _mm256_storeu_ps(m_col,
+                     _mm256_fmadd_ps(b, a0, _mm256_loadu_ps(m_col)));
+    _mm256_storeu_ps(m_col + 8,
+                     _mm256_fmadd_ps(b, a1, _mm256_loadu_ps(m_col + 8)));
+  }
+  _mm256_zeroupper();
+}
+
+#endif  // KALDI_SPARSE_GEMM_X86_SIMD
+
+#ifdef KALDI_SPARSE_GEMM_NEON
+
+void SparseDotNeon(const std::pair<MatrixIndexT, float> *e, MatrixIndexT n,
+                   const float *a_t, float *acc) {
+  float32x4_t s0 = vdupq_n_f32(0.0f), s1 = s0, s2 = s0, s3 = s0;
+  for (MatrixIndexT p = 0; p < n; p++) {
+    const float *a = a_t + e[p].first * kLanes;
+    float b = e[p].second;
+    s0 = vfmaq_n_f32(s0, vld1q_f32(a), b);
+    s1 = vfmaq_n_f32(s1, vld1q_f32(a + 4), b);
+    s2 = vfmaq_n_f32(s2, vld1q_f32(a + 8), b);
+    s3 = vfmaq_n_f32(s3, vld1q_f32(a + 12), b);
+  }
+  vst1q_f32(acc, s0);
+  vst1q_f32(acc + 4, s1);
+  vst1q_f32(acc + 8, s2);
+  vst1q_f32(acc + 12, s3);
+}
+
+void SparseAxpyNeon(const std::pair<MatrixIndexT, float> *e, MatrixIndexT n,
+                    const float *a_col, float *m_t) {
+  float32x4_t a0 = vld1q_f32(a_col), a1 = vld1q_f32(a_col + 4),
+      a2 = vld1q_f32(a_col + 8), a3 = vld1q_f32(a_col + 12);
+  for (MatrixIndexT p = 0; p < n; p++) {
+    float *m = m_t + e[p].first * kLanes;
+    float b = e[p].second;
+    vst1q_f32(m, vfmaq_n_f32(vld1q_f32(m), a0, b));
+    vst1q_f32(m + 4, vfmaq_n_f32(vld1q_f32(m + 4), a1, b));
+    vst1q_f32(m + 8, vfmaq_n_f32(vld1q_f32(m + 8), a2, b));
+    vst1q_f32(m + 12, vfmaq_n_f32(vld1q_f32(m + 12), a3, b));
+  }
+}
+
+#endif  // KALDI_SPARSE_GEMM_NEON
+
+struct SparseGemmKernels {
+  const char *name;
+  SparseDotKernel dot;
+  SparseAxpyKernel axpy;
+};
+
+SparseGemmKernels SelectKernels() {
+#ifdef KALDI_SPARSE_GEMM_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    SparseGemmKernels ans = { "avx2", SparseDotAvx2, SparseAxpyAvx2 };
+    return ans;
+  }
+#endif
+#ifdef KALDI_SPARSE_GEMM_NEON
+  SparseGemmKernels ans = { "neon", SparseDotNeon, SparseAxpyNeon };
+  return ans;
+#endif
+  SparseGemmKernels generic = { "generic", SparseDotGeneric<float>,
+                                SparseAxpyGeneric<float> };
+  return generic;
+}
+
+const SparseGemmKernels &Kernels() {
+  static const SparseGemmKernels kernels = SelectKernels();
+  return kernels;
+}
+
+inline void SparseDot(const std::pair<MatrixIndexT, float> *e, MatrixIndexT n,
+                      const float *a_t, float *acc) {
+  Kernels().dot(e, n, a_t, acc);
+}
+inline void SparseDot(const std::pair<MatrixIndexT, double> *e,
+                      MatrixIndexT n, const double *a_t, double *acc) {
+  SparseDotGeneric(e, n, a_t, acc);
+}
+inline void SparseAxpy(const std::pair<MatrixIndexT, float> *e,
+                       MatrixIndexT n, const float *a_col, float *m_t) {
+  Kernels().axpy(e, n, a_col, m_t);
+}
+inline void SparseAxpy(const std::pair<MatrixIndexT, double> *e,
+                       MatrixIndexT n, const double *a_col, double *m_t) {
+  SparseAxpyGeneric(e, n, a_col, m_t);
+}
+
+// Copies rows r0 ... r0 + nr - 1 of A, transposed, to a_t, padding with
+// zeros up to kLanes rows.
+template<typename Real>
+void TransposeBlock(const MatrixBase<Real> &A, MatrixIndexT r0, int32 nr,
+                    Real *a_t) {
+  MatrixIndexT num_cols = A.NumCols();
+  if (nr < kLanes)
+    std::fill(a_t, a_t + num_cols * kLanes, Real(0));
+  for (int32 i = 0; i < nr; i++) {
+    const Real *a_row = A.RowData(r0 + i);
+    for (MatrixIndexT k = 0; k < num_cols; k++)
+      a_t[k * kLanes + i] = a_row[k];
+  }
+}
+
+}  // namespace
+
+
+template<typename Real>
+void SparseGemm(Real alpha, const MatrixBase<Real> &A,
+                const SparseMatrix<Real> &B, MatrixTransposeType transB,
+                Real beta, MatrixBase<Real> *M) {
+  MatrixIndexT num_rows = M->NumRows(), num_cols = M->NumCols();
+  KALDI_ASSERT(A.NumRows() == num_rows);
+  if (transB == kTrans)
+    KALDI_ASSERT(num_cols == B.NumRows() && A.NumCols() == B.NumCols());
+  else
+    KALDI_ASSERT(num_cols == B.NumCols() && A.NumCols() == B.NumRows());
+  KALDI_ASSERT(&A != M);
+  if (num_rows == 0 || num_cols == 0)
+    return;
+
+  std::vector<Real> a_t(A.NumCols() * kLanes),
+      m_t(transB == kNoTrans ? num_cols * kLanes : kLanes);
+  for (MatrixIndexT r0 = 0; r0 < num_rows; r0 += kLanes) {
+    int32 nr = std::min<MatrixIndexT>(kLanes, num_rows - r0);
+    TransposeBlock(A, r0, nr, a_t.data());
+    if (transB == kTrans) {
+      // M(r, j) = beta M(r, j) + alpha sum_k A(r, k) B(j, k).
+      Real *acc = m_t.data();
+      for (MatrixIndexT j = 0; j < num_cols; j++) {
+        const SparseVector<Real> &row = B.Row(j);
+        SparseDot(row.Data(), row.NumElements(), a_t.data(), acc);
+        Real *m = M->RowData(r0) + j;
+        MatrixIndexT stride = M->Stride();
+        for (int32 i = 0; i < nr; i++, m += stride)
+          *m = (beta == 0.0 ? 0.0 : beta * *m) + alpha * acc[i];
+      }
+    } else {
+      // M(r, k) = beta M(r, k) + alpha sum_j A(r, j) B(j, k).
+      std::fill(m_t.begin(), m_t.end(), Real(0));
+      MatrixIndexT b_num_rows = B.NumRows();
+      for (MatrixIndexT j = 0; j < b_num_rows; j++) {
+        const SparseVector<Real> &row = B.Row(j);
+        SparseAxpy(row.Data(), row.NumElements(), a_t.data() + j * kLanes,
+                   m_t.data());
+      }
+      for (int32 i = 0; i < nr; i++) {
+        Real *m_row = M->RowData(r0 + i);
+        const Real *src = m_t.data() + i;
+        for (MatrixIndexT k = 0; k < num_cols; k++)
+          m_row[k] = (beta == 0.0 ? 0.0 : beta * m_row[k]) +
+              alpha * src[k * kLanes];
+      }
+    }
+  }
+}
+
+template
+void SparseGemm(float alpha, const MatrixBase<float> &A,
+                const SparseMatrix<float> &B, MatrixTransposeType transB,
+                float beta, MatrixBase<float> *M);
+template
+void SparseGemm(double alpha, const MatrixBase<double> &A,
+                const SparseMatrix<double> &B, MatrixTransposeType transB,
+                double beta, MatrixBase<double> *M);
+
+const char *SparseGemmKernelName() {
+  return Kernels().name;
+}
+
+}  // namespace kaldi
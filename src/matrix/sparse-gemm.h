@@ -0,0 +1,55 @@
+// matrix/sparse-gemm.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_SPARSE_GEMM_H_
+#define KALDI_MATRIX_SPARSE_GEMM_H_
+
+#include "matrix/kaldi-matrix.h"
+#include "matrix/sparse-matrix.h"
+
+namespace kaldi {
+
+/// @addtogroup matrix_funcs_misc
+/// @{
+
+/**
+   SparseGemm() is the implementation of MatrixBase::AddMatSmat(), i.e. it
+   computes
+      M = beta M + alpha A op(B)
+   where A is dense and B is sparse; it is used for products with pruned
+   weight matrices, which are stored as B = W, so that op(B) = W^T in the
+   forward pass and W in the backward pass.
+
+   The rows of A are processed in blocks of 16, which are first transposed
+   into a buffer, so that each nonzero element of B is used for 16 rows at
+   once with SIMD multiply-adds (AVX2 with FMA on x86 if the CPU supports it,
+   NEON on 64-bit ARM, for float; plain C++ otherwise).  It requires &M != &A.
+*/
+template<typename Real>
+void SparseGemm(Real alpha, const MatrixBase<Real> &A,
+                const SparseMatrix<Real> &B, MatrixTransposeType transB,
+                Real beta, MatrixBase<Real> *M);
+
+/// Returns the name of the kernels in use for float, e.g. "avx2", or
+/// "generic".
+const char *SparseGemmKernelName();
+
+/// @} end of "addtogroup matrix_funcs_misc"
+
+}  // namespace kaldi
+
+#endif  // KALDI_MATRIX_SPARSE_GEMM_H_
@@ -268,6 +268,37 @@ void UnitTestMatrixAddMatSmat() {
 }
 
 
+// Compares AddMatSmat() with AddMatMat() on the dense copy of B, for numbers
+// of rows that are not multiples of the block size of SparseGemm(), and for
+// beta == 0 with NaN's in the output (which must not be read).
+template <typename Real>
+void UnitTestMatrixAddMatSmatDense() {
+  for (int32 t = 0; t < 10; t++) {
+    MatrixIndexT m = RandInt(1, 40), n = RandInt(1, 30), o = RandInt(1, 30);
+    MatrixTransposeType Btrans = (RandInt(0, 1) == 0 ? kTrans : kNoTrans);
+    Real alpha = 0.5 + RandUniform(), beta = (t % 2 == 0 ? 0.0 : 0.7);
+
+    Matrix<Real> A(m, n);
+    A.SetRandn();
+    SparseMatrix<Real> B(Btrans == kNoTrans ? n : o,
+                         Btrans == kNoTrans ? o : n);
+    B.SetRandn(0.8);
+    Matrix<Real> B_dense(B.NumRows(), B.NumCols());
+    B.CopyToMat(&B_dense);
+
+    Matrix<Real> M(m, o + 3), M2(m, o);
+    M.SetRandn();
+    SubMatrix<Real> M_part(M, 0, m, 1, o);
+    if (beta == 0.0)
+      M_part.Set(std::numeric_limits<Real>::quiet_NaN());
+    else
+      M2.CopyFromMat(M_part);
+    M2.AddMatMat(alpha, A, kNoTrans, B_dense, Btrans, beta);
+    M_part.AddMatSmat(alpha, A, B, Btrans, beta);
+    AssertEqual(M_part, M2);
+  }
+}
+
 template <typename Real>
 void UnitTestMatrixAddSmatMat() {
 
@@ -329,6 +360,7 @@ void SparseMatrixUnitTest() {
 
   // Matrix functions involving sparse matrices.
   UnitTestMatrixAddMatSmat<Real>();
+  UnitTestMatrixAddMatSmatDense<Real>();
   UnitTestMatrixAddSmatMat<Real>();
 }
 
@@ -28,8 +28,294 @@
 #include "matrix/srfft.h"
 #include "matrix/matrix-functions.h"
 
+// As in quantized-matrix.cc, the SIMD kernels are compiled for x86 with
+// GCC-compatible compilers (selected at run time, so no special compiler flags
+// are needed), and for 64-bit ARM (NEON, which is always available).
+#if defined(__GNUC__) && (__GNUC__ >= 8 || defined(__clang__)) && \
+    defined(__x86_64__)
+#define KALDI_SRFFT_X86_SIMD 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define KALDI_SRFFT_NEON 1
+#include <arm_neon.h>
+#endif
+
 namespace kaldi {
 
+namespace {
+
+// The SIMD kernels do steps 1 to 4 of one level of the split-radix recursion
+// (see SplitRadixComplexFft::ComputeSteps()) in a single pass over the data:
+// for each n < m/4, the butterflies of step 1 for the points n and n + m/4 give
+// the inputs of steps 2 to 4 for the point n.  'tab' is the table of twiddle
+// factors for this level (see ComputeTables()), which has an entry for every
+// 0 < n < m/4; the kernels do not treat n == m/8 as a special case, so the
+// results differ from the generic code only by roundoff.  They exist only for
+// float.
+
+// Does the computation for the single point n, for the ends of the vectorized
+// loops.
+inline void SplitRadixStepsPoint(float *xr, float *xi, int32 m,
+                                 const float *tab, int32 n) {
+  int32 m2 = m / 2, m4 = m / 4, nel = m4 - 1;
+  float a = xr[n], b = xr[n + m2];
+  xr[n] = a + b;
+  float r1 = a - b;
+  a = xr[n + m4]; b = xr[n + m2 + m4];
+  xr[n + m4] = a + b;
+  float r2 = a - b;
+  a = xi[n]; b = xi[n + m2];
+  xi[n] = a + b;
+  float i1 = a - b;
+  a = xi[n + m4]; b = xi[n + m2 + m4];
+  xi[n + m4] = a + b;
+  float i2 = a - b;
+
+  float t1 = r1 + i2, t2 = i1 + r2;
+  i1 = i1 - r2;
+  r2 = r1 - i2;
+  r1 = t1;
+  i2 = t2;
+
+  if (n > 0) {
+    const float *t = tab + n - 1;
+    t2 = t[0] * (r1 + i1);
+    t1 = t[nel] * r1 + t2;
+    r1 = t[2 * nel] * i1 + t2;
+    i1 = t1;
+    t2 = t[3 * nel] * (r2 + i2);
+    t1 = t[4 * nel] * r2 + t2;
+    r2 = t[5 * nel] * i2 + t2;
+    i2 = t1;
+  }
+  xr[n + m2] = r1;
+  xr[n + m2 + m4] = r2;
+  xi[n + m2] = i1;
+  xi[n + m2 + m4] = i2;
+}
+
+#ifdef KALDI_SRFFT_X86_SIMD
+
+// Does the points n, n+1, ... n+7; requires n > 0.  As in quantized-matrix.cc,
+// the kernels that call this call _mm256_zeroupper() before returning.
+__attribute__((target("avx2")))
+inline void SplitRadixStepsAvx2Block(float *xr, float *xi, int32 m,
+                                     const float *tab, int32 n) {
+  int32 m2 = m / 2, m4 = m / 4, nel = m4 - 1;
+  __m256 a = _mm256_loadu_ps(xr + n), b = _mm256_loadu_ps(xr + n + m2);
+  _mm256_storeu_ps(xr + n, _mm256_add_ps(a, b));
+  __m256 r1 = _mm256_sub_ps(a, b);
+  a = _mm256_loadu_ps(xr + n + m4);
+  b = _mm256_loadu_ps(xr + n + m2 + m4);
+  _mm256_storeu_ps(xr + n + m4, _mm256_add_ps(a, b));
+  __m256 r2 = _mm256_sub_ps(a, b);
+  a = _mm256_loadu_ps(xi + n);
+  b = _mm256_loadu_ps(xi + n + m2);
+  _mm256_storeu_ps(xi + n, _mm256_add_ps(a, b));
+  __m256 i1 = _mm256_sub_ps(a, b);
+  a = _mm256_loadu_ps(xi + n + m4);
+  b = _mm256_loadu_ps(xi + n + m2 + m4);
+  _mm256_storeu_ps(xi + n + m4, _mm256_add_ps(a, b));
+  __m256 i2 = _mm256_sub_ps(a, b);
+
+  __m256 t1 = _mm256_add_ps(r1, i2), t2 = _mm256_add_ps(i1, r2);
+  i1 = _mm256_sub_ps(i1, r2);
+  r2 = _mm256_sub_ps(r1, i2);
+  r1 = t1;
+  i2 = t2;
+
+  const float *t = tab + n - 1;
+  t2 = _mm256_mul_ps(_mm256_loadu_ps(t), _mm256_add_ps(r1, i1));
+  t1 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(t + nel), r1), t2);
+  r1 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(t + 2 * nel), i1), t2);
+  i1 = t1;
+  t2 = _mm256_mul_ps(_mm256_loadu_ps(t + 3 * nel), _mm256_add_ps(r2, i2));
+  t1 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(t + 4 * nel), r2), t2);
+  r2 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(t + 5 * nel), i2), t2);
+  i2 = t1;
+
+  _mm256_storeu_ps(xr + n + m2, r1);
+  _mm256_storeu_ps(xr + n + m2 + m4, r2);
+  _mm256_storeu_ps(xi + n + m2, i1);
+  _mm256_storeu_ps(xi + n + m2 + m4, i2);
+}
+
+__attribute__((target("avx2")))
+void SplitRadixStepsAvx2(float *xr, float *xi, int32 m, const float *tab) {
+  int32 m4 = m / 4, n = 1;
+  SplitRadixStepsPoint(xr, xi, m, tab, 0);
+  for (; n + 8 <= m4; n += 8)
+    SplitRadixStepsAvx2Block(xr, xi, m, tab, n);
+  for (; n < m4; n++)
+    SplitRadixStepsPoint(xr, xi, m, tab, n);
+  _mm256_zeroupper();
+}
+
+__attribute__((target("avx2,avx512f")))
+void SplitRadixStepsAvx512(float *xr, float *xi, int32 m, const float *tab) {
+  int32 m2 = m / 2, m4 = m / 4, nel = m4 - 1, n = 1;
+  SplitRadixStepsPoint(xr, xi, m, tab, 0);
+  for (; n + 16 <= m4; n += 16) {
+    __m512 a = _mm512_loadu_ps(xr + n), b = _mm512_loadu_ps(xr + n + m2);
+    _mm512_storeu_ps(xr + n, _mm512_add_ps(a, b));
+    __m512 r1 = _mm512_sub_ps(a, b);
+    a = _mm512_loadu_ps(xr + n + m4);
+    b = _mm512_loadu_ps(xr + n + m2 + m4);
+    _mm512_storeu_ps(xr + n + m4, _mm512_add_ps(a, b));
+    __m512 r2 = _mm512_sub_ps(a, b);
+    a = _mm512_loadu_ps(xi + n);
+    b = _mm512_loadu_ps(xi + n + m2);
+    _mm512_storeu_ps(xi + n, _mm512_add_ps(a, b));
+    __m512 i1 = _mm512_sub_ps(a, b);
+    a = _mm512_loadu_ps(xi + n + m4);
+    b = _mm512_loadu_ps(xi + n + m2 + m4);
+    _mm512_storeu_ps(xi + n + m4, _mm512_add_ps(a, b));
+    __m512 i2 = _mm512_sub_ps(a, b);
+
+    __m512 t1 = _mm512_add_ps(r1, i2), t2 = _mm512_add_ps(i1, r2);
+    i1 = _mm512_sub_ps(i1, r2);
+    r2 = _mm512_sub_ps(r1, i2);
+    r1 = t1;
+    i2 = t2;
+
+    const float *t = tab + n - 1;
+    t2 = _mm512_mul_ps(_mm512_loadu_ps(t), _mm512_add_ps(r1, i1));
+    t1 = _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(t + nel), r1), t2);
+    r1 = _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(t + 2 * nel), i1), t2);
+    i1 = t1;
+    t2 = _mm512_mul_ps(_mm512_loadu_ps(t + 3 * nel), _mm512_add_ps(r2, i2));
+    t1 = _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(t + 4 * nel), r2), t2);
+    r2 = _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(t + 5 * nel), i2), t2);
+    i2 = t1;
+
+    _mm512_storeu_ps(xr + n + m2, r1);
+    _mm512_storeu_ps(xr + n + m2 + m4, r2);
+    _mm512_storeu_ps(xi + n + m2, i1);
+    _mm512_storeu_ps(xi + n + m2 + m4, i2);
+  }
+  for (; n + 8 <= m4; n += 8)
+    SplitRadixStepsAvx2Block(xr, xi, m, tab, n);
+  for (; n < m4; n++)
+    SplitRadixStepsPoint(xr, xi, m, tab, n);
+  _mm256_zeroupper();
+}
+
+#endif  // KALDI_SRFFT_X86_SIMD
+
+#ifdef KALDI_SRFFT_NEON
+
+void SplitRadixStepsNeon(float *xr, float *xi, int32 m, const float *tab) {
+  int32 m2 = m / 2, m4 = m / 4, nel = m4 - 1, n = 1;
+  SplitRadixStepsPoint(xr, xi, m, tab, 0);
+  for (; n + 4 <= m4; n += 4) {
+    float32x4_t a = vld1q_f32(xr + n), b = vld1q_f32(xr + n + m2);
+    vst1q_f32(xr + n, vaddq_f32(a, b));
+    float32x4_t r1 = vsubq_f32(a, b);
+    a = vld1q_f32(xr + n + m4);
+    b = vld1q_f32(xr + n + m2 + m4);
+    vst1q_f32(xr + n + m4, vaddq_f32(a, b));
+    float32x4_t r2 = vsubq_f32(a, b);
+    a = vld1q_f32(xi + n);
+    b = vld1q_f32(xi + n + m2);
+    vst1q_f32(xi + n, vaddq_f32(a, b));
+    float32x4_t i1 = vsubq_f32(a, b);
+    a = vld1q_f32(xi + n + m4);
+    b = vld1q_f32(xi + n + m2 + m4);
+    vst1q_f32(xi + n + m4, vaddq_f32(a, b));
+    float32x4_t i2 = vsubq_f32(a, b);
+
+    float32x4_t t1 = vaddq_f32(r1, i2), t2 = vaddq_f32(i1, r2);
+    i1 = vsubq_f32(i1, r2);
+    r2 = vsubq_f32(r1, i2);
+    r1 = t1;
+    i2 = t2;
+
+    const float *t = tab + n - 1;
+    t2 = vmulq_f32(vld1q_f32(t), vaddq_f32(r1, i1));
+    t1 = vaddq_f32(vmulq_f32(vld1q_f32(t + nel), r1), t2);
+    r1 = vaddq_f32(vmulq_f32(vld1q_f32(t + 2 * nel), i1), t2);
+    i1 = t1;
+    t2 = vmulq_f32(vld1q_f32(t + 3 * nel), vaddq_f32(r2, i2));
+    t1 = vaddq_f32(vmulq_f32(vld1q_f32(t + 4 * nel), r2), t2);
+    r2 = vaddq_f32(vmulq_f32(vld1q_f32(t + 5 * nel), i2), t2);
+    i2 = t1;
+
+    vst1q_f32(xr + n + m2, r1);
+    vst1q_f32(xr + n + m2 + m4, r2);
+    vst1q_f32(xi + n + m2, i1);
+    vst1q_f32(xi + n + m2 + m4, i2);
+  }
+  for (; n < m4; n++)
+    SplitRadixStepsPoint(xr, xi, m, tab, n);
+}
+
+#endif  // KALDI_SRFFT_NEON
+
+struct SplitRadixKernels {
+  const char *name;
+  // NULL for the generic code.
+  void (*steps)(float *xr, float *xi, int32 m, const float *tab);
+};
+
+const SplitRadixKernels kGenericKernels = { "generic", NULL };
+#ifdef KALDI_SRFFT_X86_SIMD
+const SplitRadixKernels kAvx2Kernels = { "avx2", SplitRadixStepsAvx2 };
+const SplitRadixKernels kAvx512Kernels = { "avx512", SplitRadixStepsAvx512 };
+#endif
+#ifdef KALDI_SRFFT_NEON
+const SplitRadixKernels kNeonKernels = { "neon", SplitRadixStepsNeon };
+#endif
+
+const SplitRadixKernels *SelectSimdKernels() {
+#ifdef KALDI_SRFFT_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return &kAvx512Kernels;
+  if (__builtin_cpu_supports("avx2"))
+    return &kAvx2Kernels;
+#endif
+#ifdef KALDI_SRFFT_NEON
+  return &kNeonKernels;
+#endif
+  return &kGenericKernels;
+}
+
+bool srfft_use_simd = true;
+
+const SplitRadixKernels &Kernels() {
+  static const SplitRadixKernels *simd_kernels = SelectSimdKernels();
+  return (srfft_use_simd ? *simd_kernels : kGenericKernels);
+}
+
+// Does steps 1 to 4 of a level of size m >= 16 with the SIMD kernels and
+// returns true, or returns false if there are none.
+inline bool SplitRadixStepsSimd(float *xr, float *xi, MatrixIndexT m,
+                                const float *tab) {
+  const SplitRadixKernels &kernels = Kernels();
+  if (kernels.steps == NULL)
+    return false;
+  kernels.steps(xr, xi, m, tab);
+  return true;
+}
+
+inline bool SplitRadixStepsSimd(double *xr, double *xi, MatrixIndexT m,
+                                const double *tab) {
+  return false;
+}
+
+}  // namespace
+
+
+template<typename Real>
+void SplitRadixComplexFft<Real>::SetUseSimd(bool use_simd) {
+  srfft_use_simd = use_simd;
+}
+
+template<typename Real>
+const char *SplitRadixComplexFft<Real>::SimdKernelName() {
+  return Kernels().name;
+}
+
 
 template<typename Real>
 SplitRadixComplexFft<Real>::SplitRadixComplexFft(MatrixIndexT N) {
@@ -63,7 +349,7 @@ SplitRadixComplexFft<Real>::SplitRadixComplexFft(
     tab_ = new Real*[logn_ - 3];
     for (MatrixIndexT i = logn_; i >= 4 ; i--) {
       MatrixIndexT m = 1 << i, m2 = m / 2, m4 = m2 / 2;
-      MatrixIndexT this_array_size = 6 * (m4 - 2);
+      MatrixIndexT this_array_size = 6 * (m4 - 1);
       tab_[i-4] = new Real[this_array_size];
       std::memcpy(tab_[i-4], other.tab_[i-4],
                   sizeof(Real) * this_array_size);
@@ -74,7 +360,7 @@ SplitRadixComplexFft<Real>::SplitRadixComplexFft(
 template<typename Real>
 void SplitRadixComplexFft<Real>::ComputeTables() {
   MatrixIndexT    imax, lg2, i, j;
-  MatrixIndexT     m, m2, m4, m8, nel, n;
+  MatrixIndexT     m, m2, m4, nel, n;
   Real    *cn, *spcn, *smcn, *c3n, *spc3n, *smc3n;
   Real    ang, c, s;
 
@@ -97,10 +383,12 @@ void SplitRadixComplexFft<Real>::ComputeTables() {
     tab_ = new Real* [logn_-3];
     for (i = logn_; i>=4 ; i--) {
       /* Compute a few constants */
-      m = 1 << i; m2 = m / 2; m4 = m2 / 2; m8 = m4 /2;
+      m = 1 << i; m2 = m / 2; m4 = m2 / 2;
 
-      /* Allocate memory for tables */
-      nel = m4 - 2;
+      /* Allocate memory for tables.  They include the entry for n == m8,
+         which ComputeRecursive() treats as a special case, so that the
+         vectorized code can index them directly. */
+      nel = m4 - 1;
 
       tab_[i-4] = new Real[6*nel];
 
@@ -110,7 +398,6 @@ void SplitRadixComplexFft<Real>::ComputeTables() {
 
       /* Compute tables */
       for (n = 1; n < m4; n++) {
-        if (n == m8) continue;
         ang = n * M_2PI / m;
         c = std::cos(ang); s = std::sin(ang);
         *cn++ = c; *spcn++ = - (s + c); *smcn++ = s - c;
@@ -208,8 +495,8 @@ void SplitRadixComplexFft<Real>::BitReversePermute(Real *x, MatrixIndexT logn) c
 
 
 template<typename Real>
-void SplitRadixComplexFft<Real>::ComputeRecursive(Real *xr, Real *xi, MatrixIndexT logn) const {
-
+void SplitRadixComplexFft<Real>::ComputeSteps(Real *xr, Real *xi,
+                                             MatrixIndexT logn) const {
   MatrixIndexT    m, m2, m4, m8, nel, n;
   Real    *xr1, *xr2, *xi1, *xi2;
   Real    *cn = nullptr, *spcn = nullptr, *smcn = nullptr, *c3n = nullptr,
@@ -217,6 +504,78 @@ void SplitRadixComplexFft<Real>::ComputeRecursive(Real *xr, Real *xi, MatrixInde
   Real    tmp1, tmp2;
   Real   sqhalf = M_SQRT1_2;
 
+  m = 1 << logn; m2 = m / 2; m4 = m2 / 2; m8 = m4 /2;
+
+  /* Step 1 */
+  xr1 = xr; xr2 = xr1 + m2;
+  xi1 = xi; xi2 = xi1 + m2;
+  for (n = 0; n < m2; n++) {
+    tmp1 = *xr1 + *xr2;
+    *xr2 = *xr1 - *xr2;
+    xr2++;
+    *xr1++ = tmp1;
+    tmp2 = *xi1 + *xi2;
+    *xi2 = *xi1 - *xi2;
+    xi2++;
+    *xi1++ = tmp2;
+  }
+
+  /* Step 2 */
+  xr1 = xr + m2; xr2 = xr1 + m4;
+  xi1 = xi + m2; xi2 = xi1 + m4;
+  for (n = 0; n < m4; n++) {
+    tmp1 = *xr1 + *xi2;
+    tmp2 = *xi1 + *xr2;
+    *xi1 = *xi1 - *xr2;
+    xi1++;
+    *xr2++ = *xr1 - *xi2;
+    *xr1++ = tmp1;
+    *xi2++ = tmp2;
+    // xr1++; xr2++; xi1++; xi2++;
+  }
+
+  /* Steps 3 & 4 */
+  xr1 = xr + m2; xr2 = xr1 + m4;
+  xi1 = xi + m2; xi2 = xi1 + m4;
+  if (logn >= 4) {
+    nel = m4 - 1;
+    cn  = tab_[logn-4]; spcn  = cn + nel;  smcn  = spcn + nel;
+    c3n = smcn + nel;  spc3n = c3n + nel; smc3n = spc3n + nel;
+  }
+  xr1++; xr2++; xi1++; xi2++;
+  // xr1++; xi1++;
+  for (n = 1; n < m4; n++) {
+    if (n == m8) {
+      tmp1 =  sqhalf * (*xr1 + *xi1);
+      *xi1 =  sqhalf * (*xi1 - *xr1);
+      *xr1 =  tmp1;
+      tmp2 =  sqhalf * (*xi2 - *xr2);
+      *xi2 = -sqhalf * (*xr2 + *xi2);
+      *xr2 =  tmp2;
+      if (logn >= 4) {  // skip the table entries for n == m8.
+        cn++; spcn++; smcn++; c3n++; spc3n++; smc3n++;
+      }
+    } else {
+      tmp2 = *cn++ * (*xr1 + *xi1);
+      tmp1 = *spcn++ * *xr1 + tmp2;
+      *xr1 = *smcn++ * *xi1 + tmp2;
+      *xi1 = tmp1;
+      tmp2 = *c3n++ * (*xr2 + *xi2);
+      tmp1 = *spc3n++ * *xr2 + tmp2;
+      *xr2 = *smc3n++ * *xi2 + tmp2;
+      *xi2 = tmp1;
+    }
+    xr1++; xr2++; xi1++; xi2++;
+  }
+}
+
+template<typename Real>
+void SplitRadixComplexFft<Real>::ComputeRecursive(Real *xr, Real *xi, MatrixIndexT logn) const {
+
+  MatrixIndexT    m, m2, m4;
+  Real    *xr1, *xr2, *xi1, *xi2;
+  Real    tmp1, tmp2;
+
   /* Check range of logn */
   if (logn < 0)
     KALDI_ERR << "Error: logn is out of bounds in SRFFT";
@@ -277,67 +636,12 @@ void SplitRadixComplexFft<Real>::ComputeRecursive(Real *xr, Real *xi, MatrixInde
   }
 
   /* Compute a few constants */
-  m = 1 << logn; m2 = m / 2; m4 = m2 / 2; m8 = m4 /2;
-
-
-  /* Step 1 */
-  xr1 = xr; xr2 = xr1 + m2;
-  xi1 = xi; xi2 = xi1 + m2;
-  for (n = 0; n < m2; n++) {
-    tmp1 = *xr1 + *xr2;
-    *xr2 = *xr1 - *xr2;
-    xr2++;
-    *xr1++ = tmp1;
-    tmp2 = *xi1 + *xi2;
-    *xi2 = *xi1 - *xi2;
-    xi2++;
-    *xi1++ = tmp2;
-  }
-
-  /* Step 2 */
-  xr1 = xr + m2; xr2 = xr1 + m4;
-  xi1 = xi + m2; xi2 = xi1 + m4;
-  for (n = 0; n < m4; n++) {
-    tmp1 = *xr1 + *xi2;
-    tmp2 = *xi1 + *xr2;
-    *xi1 = *xi1 - *xr2;
-    xi1++;
-    *xr2++ = *xr1 - *xi2;
-    *xr1++ = tmp1;
-    *xi2++ = tmp2;
-    // xr1++; xr2++; xi1++; xi2++;
-  }
+  m = 1 << logn; m2 = m / 2;
 
-  /* Steps 3 & 4 */
-  xr1 = xr + m2; xr2 = xr1 + m4;
-  xi1 = xi + m2; xi2 = xi1 + m4;
-  if (logn >= 4) {
-    nel = m4 - 2;
-    cn  = tab_[logn-4]; spcn  = cn + nel;  smcn  = spcn + nel;
-    c3n = smcn + nel;  spc3n = c3n + nel; smc3n = spc3n + nel;
-  }
-  xr1++; xr2++; xi1++; xi2++;
-  // xr1++; xi1++;
-  for (n = 1; n < m4; n++) {
-    if (n == m8) {
-      tmp1 =  sqhalf * (*xr1 + *xi1);
-      *xi1 =  sqhalf * (*xi1 - *xr1);
-      *xr1 =  tmp1;
-      tmp2 =  sqhalf * (*xi2 - *xr2);
-      *xi2 = -sqhalf * (*xr2 + *xi2);
-      *xr2 =  tmp2;
-    } else {
-      tmp2 = *cn++ * (*xr1 + *xi1);
-      tmp1 = *spcn++ * *xr1 + tmp2;
-      *xr1 = *smcn++ * *xi1 + tmp2;
-      *xi1 = tmp1;
-      tmp2 = *c3n++ * (*xr2 + *xi2);
-      tmp1 = *spc3n++ * *xr2 + tmp2;
-      *xr2 = *smc3n++ * *xi2 + tmp2;
-      *xi2 = tmp1;
-    }
-    xr1++; xr2++; xi1++; xi2++;
-  }
+  /* Steps 1 to 4 of this level, done in one pass by the SIMD kernels if
+     they are available. */
+  if (logn < 4 || !SplitRadixStepsSimd(xr, xi, m, tab_[logn-4]))
+    ComputeSteps(xr, xi, logn);
 
   /* Call ssrec again with half DFT length */
   ComputeRecursive(xr, xi, logn-1);
@@ -79,6 +79,17 @@ class SplitRadixComplexFft {
 
   ~SplitRadixComplexFft();
 
+  /// For float, the butterflies are done by SIMD kernels where available:
+  /// AVX-512 or AVX2 on x86 if the CPU supports them, and NEON on 64-bit ARM.
+  /// They agree with the generic code up to roundoff.  SetUseSimd(false)
+  /// forces the generic code, for all instances of this class; it is intended
+  /// for testing and benchmarking.
+  static void SetUseSimd(bool use_simd);
+
+  /// Returns the name of the kernels currently in use for float, e.g. "avx2"
+  /// or "generic".
+  static const char *SimdKernelName();
+
  protected:
   // temp_buffer_ is allocated only if someone calls Compute with only one Real*
   // argument and we need a temporary buffer while creating interleaved data.
@@ -86,6 +97,9 @@ class SplitRadixComplexFft {
  private:
   void ComputeTables();
   void ComputeRecursive(Real *xr, Real *xi, Integer logn) const;
+  // Does the butterflies of one level of ComputeRecursive() with the generic
+  // code.
+  void ComputeSteps(Real *xr, Real *xi, Integer logn) const;
   void BitReversePermute(Real *x, Integer logn) const;
 
   Integer N_;
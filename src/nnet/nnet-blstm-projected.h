@@ -534,6 +534,7 @@ class BlstmProjected : public MultistreamComponent {
 
     KALDI_ASSERT(in.NumRows() % NumStreams() == 0);
     int32 S = NumStreams();
+    const CuVectorBase<BaseFloat> *frame_mask = FrameMask(in.NumRows());
     int32 T = in.NumRows() / NumStreams();
 
     // buffers,
@@ -625,12 +626,8 @@ class BlstmProjected : public MultistreamComponent {
       y_r.AddMatMat(1.0, y_m, kNoTrans, f_w_r_m_, kTrans, 0.0);
 
       // set zeros to padded frames,
-      if (sequence_lengths_.size() > 0) {
-        for (int s = 0; s < S; s++) {
-          if (t > sequence_lengths_[s]) {
-            y_all.Row(s).SetZero();
-          }
-        }
+      if (frame_mask != NULL) {
+        y_all.MulRowsVec(frame_mask->Range((t-1)*S, S));
       }
     }
 
@@ -697,12 +694,8 @@ class BlstmProjected : public MultistreamComponent {
       y_r.AddMatMat(1.0, y_m, kNoTrans, b_w_r_m_, kTrans, 0.0);
 
       // set zeros to padded frames,
-      if (sequence_lengths_.size() > 0) {
-        for (int s = 0; s < S; s++) {
-          if (t > sequence_lengths_[s]) {
-            y_all.Row(s).SetZero();
-          }
-        }
+      if (frame_mask != NULL) {
+        y_all.MulRowsVec(frame_mask->Range((t-1)*S, S));
       }
     }
 
@@ -725,6 +718,7 @@ class BlstmProjected : public MultistreamComponent {
     // the number of sequences to be processed in parallel
     int32 T = in.NumRows() / NumStreams();
     int32 S = NumStreams();
+    const CuVectorBase<BaseFloat> *frame_mask = FrameMask(in.NumRows());
 
     // buffers,
     f_backpropagate_buf_.Resize((T+2)*S, 7 * cell_dim_ + proj_dim_, kSetZero);
@@ -850,12 +844,8 @@ class BlstmProjected : public MultistreamComponent {
       }
 
       // set zeros to padded frames,
-      if (sequence_lengths_.size() > 0) {
-        for (int s = 0; s < S; s++) {
-          if (t > sequence_lengths_[s]) {
-            d_all.Row(s).SetZero();
-          }
-        }
+      if (frame_mask != NULL) {
+        d_all.MulRowsVec(frame_mask->Range((t-1)*S, S));
       }
     }
 
@@ -978,12 +968,8 @@ class BlstmProjected : public MultistreamComponent {
       }
 
       // set zeros to padded frames,
-      if (sequence_lengths_.size() > 0) {
-        for (int s = 0; s < S; s++) {
-          if (t > sequence_lengths_[s]) {
-            d_all.Row(s).SetZero();
-          }
-        }
+      if (frame_mask != NULL) {
+        d_all.MulRowsVec(frame_mask->Range((t-1)*S, S));
       }
     }
 
@@ -264,6 +264,69 @@ namespace nnet1 {
     delete c;
   }
 
+  void UnitTestPackedSequences(const std::string& config) {
+    MultistreamComponent* c =
+      dynamic_cast<MultistreamComponent*>(Component::Init(config));
+    KALDI_ASSERT(c != NULL);
+    int32 dim_in = c->InputDim(), dim_out = c->OutputDim();
+    // two sentences,
+    int32 len_a = 7, len_b = 5;
+    CuMatrix<BaseFloat> in_a(len_a, dim_in), in_b(len_b, dim_in),
+                        out_diff_a(len_a, dim_out), out_diff_b(len_b, dim_out);
+    in_a.SetRandn(); in_b.SetRandn();
+    out_diff_a.SetRandn(); out_diff_b.SetRandn();
+
+    // the reference, each sentence alone,
+    CuMatrix<BaseFloat> out_a, out_b, in_diff_a, in_diff_b;
+    c->SetSeqLengths(std::vector<int32>(1, len_a));
+    c->ResetStreams(std::vector<int32>(1, 1));
+    c->Propagate(in_a, &out_a);
+    c->Backpropagate(in_a, out_a, out_diff_a, &in_diff_a);
+    c->SetSeqLengths(std::vector<int32>(1, len_b));
+    c->ResetStreams(std::vector<int32>(1, 1));
+    c->Propagate(in_b, &out_b);
+    c->Backpropagate(in_b, out_b, out_diff_b, &in_diff_b);
+
+    // 2 streams, the 1st has 'a', padded frame, 'b', the 2nd has 'b',
+    int32 S = 2, T = len_a + 1 + len_b;
+    CuMatrix<BaseFloat> in(T*S, dim_in), out_diff(T*S, dim_out), out, in_diff;
+    Vector<BaseFloat> mask(T*S);
+    for (int32 t = 0; t < len_a; t++) {
+      in.Row(t*S).CopyFromVec(in_a.Row(t));
+      out_diff.Row(t*S).CopyFromVec(out_diff_a.Row(t));
+      mask(t*S) = 1.0;
+    }
+    for (int32 t = 0; t < len_b; t++) {
+      in.Row((len_a + 1 + t)*S).CopyFromVec(in_b.Row(t));
+      out_diff.Row((len_a + 1 + t)*S).CopyFromVec(out_diff_b.Row(t));
+      mask((len_a + 1 + t)*S) = 1.0;
+      in.Row(t*S + 1).CopyFromVec(in_b.Row(t));
+      out_diff.Row(t*S + 1).CopyFromVec(out_diff_b.Row(t));
+      mask(t*S + 1) = 1.0;
+    }
+    std::vector<int32> seq_lengths;
+    seq_lengths.push_back(T);
+    seq_lengths.push_back(len_b);
+    c->SetSeqLengths(seq_lengths);
+    c->SetFrameMask(CuVector<BaseFloat>(mask));
+    c->ResetStreams(std::vector<int32>(S, 1));
+    c->Propagate(in, &out);
+    c->Backpropagate(in, out, out_diff, &in_diff);
+
+    // the packed sentences give the same outputs and derivatives,
+    for (int32 t = 0; t < len_a; t++) {
+      AssertEqual(out.Row(t*S), out_a.Row(t));
+      AssertEqual(in_diff.Row(t*S), in_diff_a.Row(t));
+    }
+    for (int32 t = 0; t < len_b; t++) {
+      AssertEqual(out.Row((len_a + 1 + t)*S), out_b.Row(t));
+      AssertEqual(in_diff.Row((len_a + 1 + t)*S), in_diff_b.Row(t));
+      AssertEqual(in_diff.Row(t*S + 1), in_diff_b.Row(t));
+    }
+
+    delete c;
+  }
+
 }  // namespace nnet1
 }  // namespace kaldi
 
@@ -287,6 +350,9 @@ int main() {
     UnitTestConvolutionalComponent3x3();
     UnitTestMaxPoolingComponent();
     UnitTestDropoutComponent();
+    UnitTestPackedSequences("<LstmProjected> <InputDim> 10 <OutputDim> 8 <CellDim> 12");
+    UnitTestPackedSequences("<BlstmProjected> <InputDim> 10 <OutputDim> 8 <CellDim> 12");
+    UnitTestPackedSequences("<RecurrentComponent> <InputDim> 10 <OutputDim> 8");
     // end of unit-tests,
     if (loop == 0)
         KALDI_LOG << "Tests without GPU use succeeded.";
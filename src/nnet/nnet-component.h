@@ -22,6 +22,7 @@
 #ifndef KALDI_NNET_NNET_COMPONENT_H_
 #define KALDI_NNET_NNET_COMPONENT_H_
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 
@@ -290,6 +291,17 @@ class MultistreamComponent : public UpdatableComponent {
 
   virtual void SetSeqLengths(const std::vector<int32>& sequence_lengths) {
     sequence_lengths_ = sequence_lengths;
+    frame_mask_.Resize(0);
+  }
+
+  /// Optionally marks the padded frames explicitly, 1.0 for the frames of
+  /// a sequence and 0.0 for padding, with the rows in the order of the input
+  /// (frame 't' of stream 's' is at row t*NumStreams()+s).  The recurrent
+  /// state is zeroed at the padded frames, so that several sequences can be
+  /// packed into one stream, separated by a padded frame.
+  /// It has to be set after SetSeqLengths(), which clears it.
+  virtual void SetFrameMask(const CuVectorBase<BaseFloat>& frame_mask) {
+    frame_mask_ = frame_mask;
   }
 
   int32 NumStreams() const {
@@ -301,7 +313,37 @@ class MultistreamComponent : public UpdatableComponent {
   { }
 
  protected:
+  /// Returns the mask of the padded frames for an input with 'num_rows'
+  /// rows, i.e. the one from SetFrameMask() or the one implied by the
+  /// 'sequence_lengths_'.  Returns NULL if there is no padding.
+  const CuVectorBase<BaseFloat>* FrameMask(int32 num_rows) {
+    if (frame_mask_.Dim() > 0) {
+      KALDI_ASSERT(frame_mask_.Dim() == num_rows);
+      return &frame_mask_;
+    }
+    int32 S = sequence_lengths_.size();
+    if (S == 0) return NULL;
+    int32 T = num_rows / S;
+    if (*std::min_element(sequence_lengths_.begin(),
+                          sequence_lengths_.end()) >= T) {
+      return NULL;
+    }
+    Vector<BaseFloat> mask(num_rows, kUndefined);
+    for (int32 t = 0; t < T; t++) {
+      for (int32 s = 0; s < S; s++) {
+        mask(t*S + s) = (t < sequence_lengths_[s] ? 1.0 : 0.0);
+      }
+    }
+    length_mask_ = mask;  // a single upload to the GPU,
+    return &length_mask_;
+  }
+
   std::vector<int32> sequence_lengths_;
+
+  /// The mask from SetFrameMask(), or empty,
+  CuVector<BaseFloat> frame_mask_;
+  /// Buffer for the mask implied by 'sequence_lengths_',
+  CuVector<BaseFloat> length_mask_;
 };
 
 
@@ -374,6 +374,7 @@ class LstmProjected : public MultistreamComponent {
     KALDI_ASSERT(in.NumRows() % NumStreams() == 0);
     int32 T = in.NumRows() / NumStreams();
     int32 S = NumStreams();
+    const CuVectorBase<BaseFloat> *frame_mask = FrameMask(in.NumRows());
 
     // buffers,
     propagate_buf_.Resize((T+2)*S, 7 * cell_dim_ + proj_dim_, kSetZero);
@@ -456,12 +457,8 @@ class LstmProjected : public MultistreamComponent {
       y_r.AddMatMat(1.0, y_m, kNoTrans, w_r_m_, kTrans, 0.0);
 
       // set zeros to padded frames,
-      if (sequence_lengths_.size() > 0) {
-        for (int s = 0; s < S; s++) {
-          if (t > sequence_lengths_[s]) {
-            y_all.Row(s).SetZero();
-          }
-        }
+      if (frame_mask != NULL) {
+        y_all.MulRowsVec(frame_mask->Range((t-1)*S, S));
       }
     }
 
@@ -480,6 +477,7 @@ class LstmProjected : public MultistreamComponent {
     // the number of sequences to be processed in parallel
     int32 T = in.NumRows() / NumStreams();
     int32 S = NumStreams();
+    const CuVectorBase<BaseFloat> *frame_mask = FrameMask(in.NumRows());
 
     // buffer,
     backpropagate_buf_.Resize((T+2)*S, 7 * cell_dim_ + proj_dim_, kSetZero);
@@ -602,12 +600,8 @@ class LstmProjected : public MultistreamComponent {
       }
 
       // set zeros to padded frames,
-      if (sequence_lengths_.size() > 0) {
-        for (int s = 0; s < S; s++) {
-          if (t > sequence_lengths_[s]) {
-            d_all.Row(s).SetZero();
-          }
-        }
+      if (frame_mask != NULL) {
+        d_all.MulRowsVec(frame_mask->Range((t-1)*S, S));
       }
     }
 
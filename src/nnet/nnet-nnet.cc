@@ -298,6 +298,16 @@ void Nnet::SetSeqLengths(const std::vector<int32> &sequence_lengths) {
   }
 }
 
+void Nnet::SetFrameMask(const CuVectorBase<BaseFloat> &frame_mask) {
+  for (int32 c = 0; c < NumComponents(); c++) {
+    if (GetComponent(c).IsMultistream()) {
+      MultistreamComponent& comp =
+        dynamic_cast<MultistreamComponent&>(GetComponent(c));
+      comp.SetFrameMask(frame_mask);
+    }
+  }
+}
+
 void Nnet::Init(const std::string &proto_file) {
   Input in(proto_file);
   std::istream &is = in.Stream();
@@ -131,6 +131,10 @@ class Nnet {
   /// Set sequence length in LSTM multi-stream training,
   void SetSeqLengths(const std::vector<int32> &sequence_lengths);
 
+  /// Set the mask of padded frames in LSTM multi-stream training,
+  /// (allows packing several sequences into a stream, call after SetSeqLengths),
+  void SetFrameMask(const CuVectorBase<BaseFloat> &frame_mask);
+
   /// Initialize the Nnet from the prototype,
   void Init(const std::string &proto_file);
 
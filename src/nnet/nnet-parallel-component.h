@@ -351,6 +351,14 @@ class ParallelComponent : public MultistreamComponent {
     }
   }
 
+  void SetFrameMask(const CuVectorBase<BaseFloat>& frame_mask) {
+    frame_mask_ = frame_mask;
+    // loop over nnets,
+    for (int32 i = 0; i < nnet_.size(); i++) {
+      nnet_[i].SetFrameMask(frame_mask);
+    }
+  }
+
  private:
   std::vector<Nnet> nnet_;
 };
@@ -45,6 +45,7 @@ const std::vector<int32>& RandomizerMask::Generate(int32 mask_size) {
 /* MatrixRandomizer:: */
 
 void MatrixRandomizer::AddData(const CuMatrixBase<BaseFloat>& m) {
+  minibatch_.reset();  // the buffer may be moved,
   // pre-allocate before 1st use
   if (data_.NumCols() == 0) {
     data_.Resize(conf_.randomizer_size, m.NumCols());
@@ -80,8 +81,13 @@ void MatrixRandomizer::Randomize(const std::vector<int32>& mask) {
   KALDI_ASSERT(data_begin_ == 0);
   KALDI_ASSERT(data_end_ > 0);
   KALDI_ASSERT(data_end_ == mask.size());
-  // Copy to auxiliary buffer for unshuffled data
-  data_aux_ = data_;
+  // Move the unshuffled data to the auxiliary buffer; the buffers are
+  // swapped rather than copied, as 'data_' is overwritten anyway.
+  minibatch_.reset();
+  if (data_aux_.NumRows() != data_.NumRows() ||
+      data_aux_.NumCols() != data_.NumCols())
+    data_aux_.Resize(data_.NumRows(), data_.NumCols(), kUndefined);
+  data_aux_.Swap(&data_);
   // Put the mask to GPU
   CuArray<int32> mask_in_gpu(mask.size());
   mask_in_gpu.CopyFromVec(mask);
@@ -91,7 +97,8 @@ void MatrixRandomizer::Randomize(const std::vector<int32>& mask) {
   //  is larger than capacity 'randomizer_size'.
   //  The extra rows in 'data_aux_' do not contain speech frames and
   //  are not copied from 'data_aux_', the extra rows in 'data_' are
-  //  unchanged by cu::Randomize.)
+  //  left undefined by cu::Randomize, which is fine as they are beyond
+  //  'data_end_'.)
   cu::Randomize(data_aux_, mask_in_gpu, &data_);
 }
 
@@ -102,10 +109,10 @@ void MatrixRandomizer::Next() {
 const CuMatrixBase<BaseFloat>& MatrixRandomizer::Value() {
   // make sure we have data for next minibatch,
   KALDI_ASSERT(data_end_ - data_begin_ >= conf_.minibatch_size);
-  // prepare the mini-batch buffer,
-  minibatch_.Resize(conf_.minibatch_size, data_.NumCols(), kUndefined);
-  minibatch_.CopyFromMat(data_.RowRange(data_begin_, conf_.minibatch_size));
-  return minibatch_;
+  // point the mini-batch window at the rows of the buffer,
+  minibatch_.reset(new CuSubMatrix<BaseFloat>(
+      data_.RowRange(data_begin_, conf_.minibatch_size)));
+  return *minibatch_;
 }
 
 
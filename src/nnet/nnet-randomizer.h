@@ -21,6 +21,7 @@
 #ifndef KALDI_NNET_NNET_RANDOMIZER_H_
 #define KALDI_NNET_NNET_RANDOMIZER_H_
 
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -127,13 +128,15 @@ class MatrixRandomizer {
   /// Sets cursor to next mini-batch
   void Next();
 
-  /// Returns matrix-window with next mini-batch
+  /// Returns matrix-window with next mini-batch.  This is a sub-matrix of the
+  /// buffer, which stays on the GPU, so no copy is made; it is valid until
+  /// the next call to AddData() or Randomize().
   const CuMatrixBase<BaseFloat>& Value();
 
  private:
   CuMatrix<BaseFloat> data_;  // can be larger than 'randomizer_size'
   CuMatrix<BaseFloat> data_aux_;  // auxiliary buffer for shuffling
-  CuMatrix<BaseFloat> minibatch_;  // buffer for mini-batch
+  std::unique_ptr<CuSubMatrix<BaseFloat> > minibatch_;  // window of 'data_'
 
   /// A cursor, pointing to the 'row' where the next mini-batch begins,
   int32 data_begin_;
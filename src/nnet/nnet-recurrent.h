@@ -211,6 +211,7 @@ class RecurrentComponent : public MultistreamComponent {
     KALDI_ASSERT(in.NumRows() % NumStreams() == 0);
     int32 T = in.NumRows() / NumStreams();
     int32 S = NumStreams();
+    const CuVectorBase<BaseFloat> *frame_mask = FrameMask(in.NumRows());
 
     // Precopy bias,
     out->AddVecToRows(1.0, bias_, 0.0);
@@ -225,12 +226,8 @@ class RecurrentComponent : public MultistreamComponent {
       out->RowRange(t*S, S).AddMatMat(1.0, out->RowRange((t-1)*S, S), kNoTrans, w_recurrent_, kTrans, 1.0);
       out->RowRange(t*S, S).Tanh(out->RowRange(t*S, S));
       // Zero output for padded frames,
-      if (sequence_lengths_.size() == S) {
-        for (int32 s = 0; s < S; s++) {
-          if (t >= sequence_lengths_[s]) {
-            out->Row(t*S + s).SetZero();
-          }
-        }
+      if (frame_mask != NULL) {
+        out->RowRange(t*S, S).MulRowsVec(frame_mask->Range(t*S, S));
       }
       //
     }
@@ -247,6 +244,7 @@ class RecurrentComponent : public MultistreamComponent {
 
     int32 T = in.NumRows() / NumStreams();
     int32 S = NumStreams();
+    const CuVectorBase<BaseFloat> *frame_mask = FrameMask(in.NumRows());
 
     // Apply BPTT on 'out_diff',
     out_diff_bptt_ = out_diff;
@@ -256,6 +254,11 @@ class RecurrentComponent : public MultistreamComponent {
       CuSubMatrix<BaseFloat> d_t1 = out_diff_bptt_.RowRange((t-1)*S, S);
       const CuSubMatrix<BaseFloat> y_t = out.RowRange(t*S, S);
 
+      // Zero diff for padded frames (before it leaks to the previous frame),
+      if (frame_mask != NULL) {
+        d_t.MulRowsVec(frame_mask->Range(t*S, S));
+      }
+
       // BPTT,
       d_t.DiffTanh(y_t, d_t);
       d_t1.AddMatMat(1.0, d_t, kNoTrans, w_recurrent_, kNoTrans, 1.0);
@@ -265,15 +268,6 @@ class RecurrentComponent : public MultistreamComponent {
         d_t1.ApplyFloor(-diff_clip_);
         d_t1.ApplyCeiling(diff_clip_);
       }
-
-      // Zero diff for padded frames,
-      if (sequence_lengths_.size() == S) {
-        for (int32 s = 0; s < S; s++) {
-          if (t >= sequence_lengths_[s]) {
-            out_diff_bptt_.Row(t*S + s).SetZero();
-          }
-        }
-      }
     }
 
     // Apply 'DiffTanh' on first block,
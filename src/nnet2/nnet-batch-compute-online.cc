@@ -0,0 +1,159 @@
+// nnet2/nnet-batch-compute-online.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <map>
+
+#include "nnet2/nnet-batch-compute-online.h"
+
+namespace kaldi {
+namespace nnet2 {
+
+NnetOnlineBatchComputer::NnetOnlineBatchComputer(
+    const Nnet &nnet, const NnetOnlineBatchComputerOptions &opts):
+    nnet_(nnet), opts_(opts), finished_(false),
+    num_batches_(0), num_chunks_(0) {
+  KALDI_ASSERT(opts_.max_streams > 0);
+  worker_ = std::thread(RunWorker, this);
+}
+
+void NnetOnlineBatchComputer::Compute(NnetOnlineComputer *computer,
+                                      const CuMatrixBase<BaseFloat> &input,
+                                      CuMatrix<BaseFloat> *output) {
+  KALDI_ASSERT(&(computer->nnet_) == &nnet_ && output != NULL);
+  Task task;
+  task.computer = computer;
+  task.input = &input;
+  task.output = output;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(&task);
+  }
+  queue_cond_.notify_one();
+  task.done.Wait();
+  if (task.error)
+    std::rethrow_exception(task.error);
+}
+
+NnetOnlineBatchComputer::~NnetOnlineBatchComputer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_ = true;
+  }
+  queue_cond_.notify_one();
+  worker_.join();
+  if (num_batches_ > 0)
+    KALDI_LOG << "Computed " << num_chunks_ << " chunks in " << num_batches_
+              << " batches, average batch size "
+              << (num_chunks_ / static_cast<BaseFloat>(num_batches_));
+}
+
+void NnetOnlineBatchComputer::RunWorker(NnetOnlineBatchComputer *me) {
+  while (true) {
+    std::vector<Task*> tasks;
+    {
+      std::unique_lock<std::mutex> lock(me->mutex_);
+      me->queue_cond_.wait(lock, [me] {
+          return me->finished_ || !me->queue_.empty(); });
+      if (me->queue_.empty())
+        return;  // finished_ is true.
+      size_t num_tasks = std::min<size_t>(me->queue_.size(),
+                                          me->opts_.max_streams);
+      tasks.assign(me->queue_.begin(), me->queue_.begin() + num_tasks);
+      me->queue_.erase(me->queue_.begin(), me->queue_.begin() + num_tasks);
+    }
+    // Group the tasks that produce output by the shape of their input: the
+    // number of input rows, and whether the spliced components have reusable
+    // frames from a previous chunk (which determines the number of rows at
+    // each component).
+    std::map<std::pair<int32, bool>, std::vector<Task*> > groups;
+    for (size_t i = 0; i < tasks.size(); i++) {
+      Task *task = tasks[i];
+      try {
+        NnetOnlineComputer *computer = task->computer;
+        if (computer->PrepareInput(*(task->input))) {
+          std::pair<int32, bool> shape(computer->data_[0].NumRows(),
+                                       computer->HasReusableInputs());
+          groups[shape].push_back(task);
+          continue;
+        }
+        task->output->Resize(0, 0);
+      } catch (...) {
+        task->error = std::current_exception();
+      }
+      task->done.Signal();
+    }
+    std::map<std::pair<int32, bool>, std::vector<Task*> >::const_iterator
+        iter = groups.begin(), end = groups.end();
+    for (; iter != end; ++iter) {
+      const std::vector<Task*> &group = iter->second;
+      try {
+        me->ComputeBatch(group);
+      } catch (...) {
+        for (size_t i = 0; i < group.size(); i++)
+          group[i]->error = std::current_exception();
+      }
+      for (size_t i = 0; i < group.size(); i++)
+        group[i]->done.Signal();
+    }
+  }
+}
+
+void NnetOnlineBatchComputer::ComputeBatch(const std::vector<Task*> &tasks) {
+  int32 num_streams = tasks.size();
+  num_batches_++;
+  num_chunks_ += num_streams;
+  if (num_streams == 1) {
+    NnetOnlineComputer *computer = tasks[0]->computer;
+    computer->Propagate();
+    *(tasks[0]->output) = computer->data_.back();
+    return;
+  }
+  CuMatrix<BaseFloat> batch_input, batch_output;
+  for (int32 c = 0; c < nnet_.NumComponents(); c++) {
+    // Each stream's chunk becomes one chunk of a multi-chunk ChunkInfo; the
+    // chunks have the same offsets since the inputs have the same shape.
+    ChunkInfo input_chunk_info, output_chunk_info;
+    for (int32 s = 0; s < num_streams; s++)
+      tasks[s]->computer->PrepareComponentInput(c, &input_chunk_info,
+                                                &output_chunk_info);
+    int32 input_rows = tasks[0]->computer->data_[c].NumRows(),
+        output_rows = output_chunk_info.NumRows();
+    batch_input.Resize(num_streams * input_rows, input_chunk_info.NumCols(),
+                       kUndefined);
+    for (int32 s = 0; s < num_streams; s++) {
+      const CuMatrix<BaseFloat> &input = tasks[s]->computer->data_[c];
+      KALDI_ASSERT(input.NumRows() == input_rows);
+      batch_input.RowRange(s * input_rows, input_rows).CopyFromMat(input);
+    }
+    ChunkInfo batch_input_info(input_chunk_info.NumCols(), num_streams,
+                               input_chunk_info.GetOffset(0),
+                               input_chunk_info.GetOffset(input_rows - 1)),
+        batch_output_info(output_chunk_info.NumCols(), num_streams,
+                          output_chunk_info.GetOffset(0),
+                          output_chunk_info.GetOffset(output_rows - 1));
+    nnet_.GetComponent(c).Propagate(batch_input_info, batch_output_info,
+                                    batch_input, &batch_output);
+    for (int32 s = 0; s < num_streams; s++)
+      tasks[s]->computer->data_[c + 1] =
+          batch_output.RowRange(s * output_rows, output_rows);
+  }
+  for (int32 s = 0; s < num_streams; s++)
+    *(tasks[s]->output) = tasks[s]->computer->data_.back();
+}
+
+}  // namespace nnet2
+}  // namespace kaldi
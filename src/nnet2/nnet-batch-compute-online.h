@@ -0,0 +1,116 @@
+// nnet2/nnet-batch-compute-online.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET2_NNET_BATCH_COMPUTE_ONLINE_H_
+#define KALDI_NNET2_NNET_BATCH_COMPUTE_ONLINE_H_
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "nnet2/nnet-compute-online.h"
+#include "util/kaldi-semaphore.h"
+
+namespace kaldi {
+namespace nnet2 {
+
+
+struct NnetOnlineBatchComputerOptions {
+  int32 max_streams;
+
+  NnetOnlineBatchComputerOptions(): max_streams(64) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("nnet-batch-max-streams", &max_streams, "Maximum number "
+                   "of online-decoding streams whose chunks are evaluated "
+                   "together in one batch of the neural net computation.");
+  }
+};
+
+
+/**
+   class NnetOnlineBatchComputer lets many streams that are being decoded
+   simultaneously (each with its own NnetOnlineComputer) share one thread that
+   does the neural net computation.  A single worker thread takes all the
+   chunks that are waiting, and evaluates the chunks that have the same shape
+   (the same number of frames, and all in the middle of their utterances) as
+   one minibatch, so that the matrix multiplications are done for many
+   streams at once rather than one small one per stream.
+
+   The chunks are evaluated as soon as the worker is free, so the batches are
+   larger the more streams there are and the longer each computation takes;
+   with a single stream it behaves like NnetOnlineComputer::Compute().
+*/
+class NnetOnlineBatchComputer {
+ public:
+  /// Starts the worker thread.  The computers given to Compute() must have
+  /// been constructed with the same "nnet".
+  NnetOnlineBatchComputer(const Nnet &nnet,
+                          const NnetOnlineBatchComputerOptions &opts);
+
+  /// This does the same as computer->Compute(input, output), but the
+  /// computation is done by the worker thread, together with that of other
+  /// streams.  It blocks until the output is ready.  It is safe to call this
+  /// from multiple threads, but each NnetOnlineComputer may be used by only
+  /// one thread at a time.
+  void Compute(NnetOnlineComputer *computer,
+               const CuMatrixBase<BaseFloat> &input,
+               CuMatrix<BaseFloat> *output);
+
+  /// Waits for the worker thread to finish; there must be no calls to
+  /// Compute() in progress.
+  ~NnetOnlineBatchComputer();
+
+ private:
+  struct Task {
+    NnetOnlineComputer *computer;
+    const CuMatrixBase<BaseFloat> *input;
+    CuMatrix<BaseFloat> *output;
+    std::exception_ptr error;
+    Semaphore done;  // signaled by the worker when the task is finished.
+  };
+
+  static void RunWorker(NnetOnlineBatchComputer *me);
+
+  // Does the computation for a group of tasks whose inputs (already prepared
+  // by NnetOnlineComputer::PrepareInput()) have the same shape.
+  void ComputeBatch(const std::vector<Task*> &tasks);
+
+  const Nnet &nnet_;
+  NnetOnlineBatchComputerOptions opts_;
+
+  std::mutex mutex_;  // guards queue_ and finished_.
+  std::condition_variable queue_cond_;
+  std::vector<Task*> queue_;
+  bool finished_;
+
+  // Statistics, accessed only by the worker thread.
+  int64 num_batches_;
+  int64 num_chunks_;
+
+  std::thread worker_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetOnlineBatchComputer);
+};
+
+
+}  // namespace nnet2
+}  // namespace kaldi
+
+#endif  // KALDI_NNET2_NNET_BATCH_COMPUTE_ONLINE_H_
@@ -35,13 +35,21 @@ NnetOnlineComputer::NnetOnlineComputer(const Nnet &nnet, bool pad_input)
 void NnetOnlineComputer::Compute(const CuMatrixBase<BaseFloat> &input,
                                  CuMatrix<BaseFloat> *output) {
   KALDI_ASSERT(output != NULL);
+  if (PrepareInput(input)) {
+    Propagate();
+    *output = data_.back();
+  } else {
+    output->Resize(0, 0);
+  }
+}
+
+bool NnetOnlineComputer::PrepareInput(const CuMatrixBase<BaseFloat> &input) {
   KALDI_ASSERT(!finished_);
   int32 dim = input.NumCols();
 
-  // If input is empty, we also set output to zero size.
+  // If input is empty, there is no output.
   if (input.NumRows() == 0) {
-    output->Resize(0, 0);
-    return;
+    return false;
   } else {
     // store the last frame as it might be needed for padding when Flush() is
     // called.
@@ -86,12 +94,8 @@ void NnetOnlineComputer::Compute(const CuMatrixBase<BaseFloat> &input,
     // if we did a forward pass, component input buffers would be non-empty
     // these buffers store information equivalent to having an nnet_input
     // buffer of (nnet_.LeftContext() + nnet_.RightContext())
-    for (int32 i = 0; i < reusable_component_inputs_.size(); i++)  {
-      if (reusable_component_inputs_[i].NumRows() > 0) {
-        extra_input_rows = nnet_.LeftContext() + nnet_.RightContext();
-        break;
-      }
-    }
+    if (HasReusableInputs())
+      extra_input_rows = nnet_.LeftContext() + nnet_.RightContext();
     // add unprocessed input from the previous calls
     input_data.Resize(input.NumRows() + unprocessed_buffer_.NumRows(), dim);
     if (unprocessed_buffer_.NumRows() > 0)
@@ -106,15 +110,20 @@ void NnetOnlineComputer::Compute(const CuMatrixBase<BaseFloat> &input,
       nnet_.LeftContext() + nnet_.RightContext() + 1) {
     // we have sufficient frames to compute at least one nnet output
     nnet_.ComputeChunkInfo(num_effective_input_rows, 1, &chunk_info_);
-    Propagate();
-    *output = data_.back();
+    return true;
   } else {
-    // store the input in the unprocessed_buffer_
+    // store the input in the unprocessed_buffer_; not enough input context
+    // to produce any output.
     unprocessed_buffer_ = input_data;
-    // not enough input context so just return an empty array
-    output->Resize(0, 0);
+    return false;
   }
+}
 
+bool NnetOnlineComputer::HasReusableInputs() const {
+  for (size_t i = 0; i < reusable_component_inputs_.size(); i++)
+    if (reusable_component_inputs_[i].NumRows() > 0)
+      return true;
+  return false;
 }
 
 void NnetOnlineComputer::Flush(CuMatrix<BaseFloat> *output) {
@@ -148,67 +157,73 @@ void NnetOnlineComputer::Flush(CuMatrix<BaseFloat> *output) {
 void NnetOnlineComputer::Propagate() {
   // This method is like the normal nnet propagate, but we reuse the frames
   // computed from the previous chunk, at each component.
-
   for (int32 c = 0; c < nnet_.NumComponents(); c++) {
-    // we assume that the chunks are always contiguous
-    chunk_info_[c].MakeOffsetsContiguous();
-    chunk_info_[c + 1].MakeOffsetsContiguous();
-
-    const Component &component = nnet_.GetComponent(c);
-    CuMatrix<BaseFloat> &input_data = data_[c], &output_data = data_[c + 1];
-    CuMatrix<BaseFloat> input_data_temp;
-
-    if (component.Context().size() > 1)  {
-      int32 dim = component.InputDim();
-      if (reusable_component_inputs_[c].NumRows() > 0) {
-        // concatenate any frames computed by previous component
-        // in the last call, to the input of the current component
-        input_data_temp.Resize(reusable_component_inputs_[c].NumRows()
-                               + input_data.NumRows(), dim);
-        input_data_temp.Range(0, reusable_component_inputs_[c].NumRows(),
-                       0, dim).CopyFromMat(reusable_component_inputs_[c]);
-        input_data_temp.Range(reusable_component_inputs_[c].NumRows(),
-                              input_data.NumRows(), 0, dim).CopyFromMat(
-                                  input_data);
-        input_data = input_data_temp;
-      }
-      // store any frames which can be reused in the next call
-      reusable_component_inputs_[c].Resize(component.Context().back() -
-                                component.Context().front(), dim);
-      reusable_component_inputs_[c].CopyFromMat(
-          input_data.RowRange(input_data.NumRows() -
-                              reusable_component_inputs_[c].NumRows(),
-                              reusable_component_inputs_[c].NumRows()));
+    ChunkInfo input_chunk_info, output_chunk_info;
+    PrepareComponentInput(c, &input_chunk_info, &output_chunk_info);
+    nnet_.GetComponent(c).Propagate(input_chunk_info, output_chunk_info,
+                                    data_[c], &(data_[c + 1]));
+  }
+}
+
+void NnetOnlineComputer::PrepareComponentInput(int32 c,
+                                               ChunkInfo *input_chunk_info,
+                                               ChunkInfo *output_chunk_info) {
+  // we assume that the chunks are always contiguous
+  chunk_info_[c].MakeOffsetsContiguous();
+  chunk_info_[c + 1].MakeOffsetsContiguous();
+
+  const Component &component = nnet_.GetComponent(c);
+  CuMatrix<BaseFloat> &input_data = data_[c];
+  CuMatrix<BaseFloat> input_data_temp;
+
+  if (component.Context().size() > 1)  {
+    int32 dim = component.InputDim();
+    if (reusable_component_inputs_[c].NumRows() > 0) {
+      // concatenate any frames computed by previous component
+      // in the last call, to the input of the current component
+      input_data_temp.Resize(reusable_component_inputs_[c].NumRows()
+                             + input_data.NumRows(), dim);
+      input_data_temp.Range(0, reusable_component_inputs_[c].NumRows(),
+                     0, dim).CopyFromMat(reusable_component_inputs_[c]);
+      input_data_temp.Range(reusable_component_inputs_[c].NumRows(),
+                            input_data.NumRows(), 0, dim).CopyFromMat(
+                                input_data);
+      input_data = input_data_temp;
     }
+    // store any frames which can be reused in the next call
+    reusable_component_inputs_[c].Resize(component.Context().back() -
+                              component.Context().front(), dim);
+    reusable_component_inputs_[c].CopyFromMat(
+        input_data.RowRange(input_data.NumRows() -
+                            reusable_component_inputs_[c].NumRows(),
+                            reusable_component_inputs_[c].NumRows()));
+  }
 
-    // chunk_info objects provided assume that we added all the reusable
-    // context at the input of the nnet. However we are reusing hidden
-    // activations computed in the previous call.
-    // Hence we manipulate the chunk_info objects to reflect the state of the
-    // actual chunk, each component is computing, in the current Propagate.
-    // As before we always assume the chunks are contiguous.
-
-    // modifying the input chunk_info
-    int32 chunk_size_assumed = chunk_info_[c].ChunkSize();
-    int32 last_offset = chunk_info_[c].GetOffset(chunk_size_assumed - 1);
-    int32 first_offset = last_offset - input_data.NumRows() + 1;
-    ChunkInfo input_chunk_info(chunk_info_[c].NumCols(),
-                               chunk_info_[c].NumChunks(),
-                               first_offset,
-                               last_offset);
-    // modifying the output chunk_info
-    chunk_size_assumed = chunk_info_[c + 1].ChunkSize();
-    last_offset = chunk_info_[c + 1].GetOffset(chunk_size_assumed - 1);
-    first_offset = last_offset - (input_data.NumRows() -
-                                  (component.Context().back() -
-                                   component.Context().front())) + 1;
-    ChunkInfo output_chunk_info(chunk_info_[c + 1].NumCols(),
-                                chunk_info_[c + 1].NumChunks(),
+  // chunk_info objects provided assume that we added all the reusable
+  // context at the input of the nnet. However we are reusing hidden
+  // activations computed in the previous call.
+  // Hence we manipulate the chunk_info objects to reflect the state of the
+  // actual chunk, each component is computing, in the current Propagate.
+  // As before we always assume the chunks are contiguous.
+
+  // modifying the input chunk_info
+  int32 chunk_size_assumed = chunk_info_[c].ChunkSize();
+  int32 last_offset = chunk_info_[c].GetOffset(chunk_size_assumed - 1);
+  int32 first_offset = last_offset - input_data.NumRows() + 1;
+  *input_chunk_info = ChunkInfo(chunk_info_[c].NumCols(),
+                                chunk_info_[c].NumChunks(),
                                 first_offset,
                                 last_offset);
-    component.Propagate(input_chunk_info, output_chunk_info,
-                        input_data, &output_data);
-  }
+  // modifying the output chunk_info
+  chunk_size_assumed = chunk_info_[c + 1].ChunkSize();
+  last_offset = chunk_info_[c + 1].GetOffset(chunk_size_assumed - 1);
+  first_offset = last_offset - (input_data.NumRows() -
+                                (component.Context().back() -
+                                 component.Context().front())) + 1;
+  *output_chunk_info = ChunkInfo(chunk_info_[c + 1].NumCols(),
+                                 chunk_info_[c + 1].NumChunks(),
+                                 first_offset,
+                                 last_offset);
 }
 
 }  // namespace nnet2
@@ -71,8 +71,25 @@ class NnetOnlineComputer {
   void Flush(CuMatrix<BaseFloat> *output);
 
  private:
+  friend class NnetOnlineBatchComputer;
+
+  // Called from Compute(): sets up data_[0] and chunk_info_ for the
+  // computation on "input".  Returns false if there is not yet enough input
+  // to produce any output (the input is then kept in unprocessed_buffer_).
+  bool PrepareInput(const CuMatrixBase<BaseFloat> &input);
+
+  // Returns true if we have stored the inputs of any spliced components from
+  // a previous call.
+  bool HasReusableInputs() const;
+
   void Propagate();
 
+  // Prepends the reusable frames from the previous call to the input data_[c]
+  // of component c, stores the frames to be reused in the next call, and
+  // outputs the chunk-infos for propagating component c.
+  void PrepareComponentInput(int32 c, ChunkInfo *input_chunk_info,
+                             ChunkInfo *output_chunk_info);
+
   const Nnet &nnet_;
 
   // data_ contains the intermediate stages and the output of the most recent
@@ -21,6 +21,7 @@
 #include "nnet2/nnet-nnet.h"
 #include "nnet2/nnet-compute.h"
 #include "nnet2/nnet-compute-online.h"
+#include "nnet2/nnet-batch-compute-online.h"
 
 namespace kaldi {
 namespace nnet2 {
@@ -116,6 +117,65 @@ void UnitTestNnetComputeChunked() {
   delete nnet;
 }
 
+// Computes one stream in chunks of "chunk_size" frames through "batch_computer".
+static void ComputeOnlineStream(const Nnet &nnet,
+                                NnetOnlineBatchComputer *batch_computer,
+                                const CuMatrix<BaseFloat> *input,
+                                int32 chunk_size,
+                                CuMatrix<BaseFloat> *output) {
+  NnetOnlineComputer computer(nnet, true);
+  int32 num_feats = input->NumRows(), cur_input_pos = 0, cur_output_pos = 0;
+  while (cur_input_pos <= num_feats) {
+    CuMatrix<BaseFloat> output_part;
+    if (cur_input_pos < num_feats) {
+      int32 this_chunk_size = std::min(chunk_size, num_feats - cur_input_pos);
+      batch_computer->Compute(&computer,
+                              input->RowRange(cur_input_pos, this_chunk_size),
+                              &output_part);
+      cur_input_pos += this_chunk_size;
+    } else {
+      computer.Flush(&output_part);
+      cur_input_pos++;
+    }
+    if (output_part.NumRows() != 0) {
+      output->RowRange(cur_output_pos, output_part.NumRows()).CopyFromMat(
+          output_part);
+      cur_output_pos += output_part.NumRows();
+    }
+  }
+  KALDI_ASSERT(cur_output_pos == num_feats);
+}
+
+void UnitTestNnetOnlineBatchCompute() {
+  int32 input_dim = 10 + rand() % 40, output_dim = 100 + rand() % 500;
+  Nnet *nnet = GenRandomNnet(input_dim, output_dim);
+  int32 num_streams = 2 + rand() % 4, chunk_size = 1 + rand() % 10;
+  NnetOnlineBatchComputerOptions opts;
+  opts.max_streams = 1 + rand() % 4;
+  std::vector<CuMatrix<BaseFloat> > inputs(num_streams), outputs(num_streams);
+  std::vector<std::thread> threads;
+  {
+    NnetOnlineBatchComputer batch_computer(*nnet, opts);
+    for (int32 s = 0; s < num_streams; s++) {
+      inputs[s].Resize(50 + rand() % 200, input_dim);
+      inputs[s].SetRandn();
+      outputs[s].Resize(inputs[s].NumRows(), output_dim);
+      threads.push_back(std::thread(ComputeOnlineStream, std::cref(*nnet),
+                                    &batch_computer, &(inputs[s]),
+                                    chunk_size, &(outputs[s])));
+    }
+    for (int32 s = 0; s < num_streams; s++)
+      threads[s].join();
+  }
+  for (int32 s = 0; s < num_streams; s++) {
+    CuMatrix<BaseFloat> ref_output(inputs[s].NumRows(), output_dim);
+    NnetComputation(*nnet, inputs[s], true, &ref_output);
+    AssertEqual(ref_output, outputs[s]);
+  }
+  KALDI_LOG << "OK";
+  delete nnet;
+}
+
 }  // namespace nnet2
 }  // namespace kaldi
 
@@ -129,6 +189,8 @@ int main() {
   for (int32 i = 0; i < 10; i++) 
     UnitTestNnetCompute();
     UnitTestNnetComputeChunked();
+  for (int32 i = 0; i < 5; i++)
+    UnitTestNnetOnlineBatchCompute();
   return 0;
 }
   
@@ -226,9 +226,63 @@ void TestAttentionForwardBackward() {
   }
 }
 
+// Checks the CPU version of the fused attention code in cu-math.h against
+// AttentionForward() and AttentionBackward().
+void TestFusedAttention() {
+  BaseFloat key_scale = 0.5 * RandInt(1, 3);
+  bool output_context = (RandInt(0, 1) == 0);
+  int32 output_num_rows = RandInt(1, 50),
+      value_dim = RandInt(10, 30), key_dim = RandInt(10, 30),
+      row_shift = RandInt(1, 5), context_dim = RandInt(2, 5),
+      num_extra_rows = (context_dim - 1) * row_shift,
+      input_num_rows = output_num_rows + num_extra_rows,
+      query_dim = key_dim + context_dim,
+      output_dim = value_dim + (output_context ? context_dim : 0);
+  CuMatrix<BaseFloat> keys(input_num_rows, key_dim),
+      queries(output_num_rows, query_dim),
+      values(input_num_rows, value_dim),
+      C(output_num_rows, context_dim),
+      output(output_num_rows, output_dim),
+      output_deriv(output_num_rows, output_dim),
+      keys_deriv(input_num_rows, key_dim),
+      queries_deriv(output_num_rows, query_dim),
+      values_deriv(input_num_rows, value_dim);
+  keys.SetRandn();
+  queries.SetRandn();
+  values.SetRandn();
+  output_deriv.SetRandn();
+  keys_deriv.SetRandn();
+  queries_deriv.SetRandn();
+  values_deriv.SetRandn();
+  Matrix<BaseFloat> C2(output_num_rows, context_dim),
+      output2(output_num_rows, output_dim),
+      keys_deriv2(keys_deriv), queries_deriv2(queries_deriv),
+      values_deriv2(values_deriv);
+
+  AttentionForward(key_scale, keys, queries, values, &C, &output);
+  AttentionBackward(key_scale, keys, queries, values, C, output_deriv,
+                    &keys_deriv, &queries_deriv, &values_deriv);
+  cu::CpuRestrictedAttentionForward(key_scale, Matrix<BaseFloat>(keys),
+                                    Matrix<BaseFloat>(queries),
+                                    Matrix<BaseFloat>(values),
+                                    &C2, &output2);
+  cu::CpuRestrictedAttentionBackward(key_scale, Matrix<BaseFloat>(keys),
+                                     Matrix<BaseFloat>(queries),
+                                     Matrix<BaseFloat>(values), C2,
+                                     Matrix<BaseFloat>(output_deriv),
+                                     &keys_deriv2, &queries_deriv2,
+                                     &values_deriv2);
+  KALDI_ASSERT(ApproxEqual(Matrix<BaseFloat>(C), C2));
+  KALDI_ASSERT(ApproxEqual(Matrix<BaseFloat>(output), output2));
+  KALDI_ASSERT(ApproxEqual(Matrix<BaseFloat>(keys_deriv), keys_deriv2));
+  KALDI_ASSERT(ApproxEqual(Matrix<BaseFloat>(queries_deriv), queries_deriv2));
+  KALDI_ASSERT(ApproxEqual(Matrix<BaseFloat>(values_deriv), values_deriv2));
+}
+
 void UnitTestAttention() {
   UnitTestAttentionDotProductAndAddScales();
   TestAttentionForwardBackward();
+  TestFusedAttention();
 }
 
 
@@ -41,15 +41,16 @@ void GetAttentionDotProducts(BaseFloat alpha,
       context_dim = C->NumCols();
   KALDI_ASSERT(num_extra_rows > 0 && num_extra_rows % (context_dim - 1) == 0);
   int32 row_shift = num_extra_rows / (context_dim - 1);
-  CuMatrix<BaseFloat> Ctrans(C->NumCols(),
-                             C->NumRows());
-  for (int32 o = 0; o < context_dim; o++) {
-    CuSubVector<BaseFloat> c_col(Ctrans, o);
-    CuSubMatrix<BaseFloat> B_part(B, o * row_shift, num_output_rows,
-                                  0, input_num_cols);
-    c_col.AddDiagMatMat(alpha, A, kNoTrans, B_part, kTrans, 0.0);
-  }
-  C->CopyFromMat(Ctrans, kTrans);
+  // Row i of C is the product of row i of A with the transpose of the matrix
+  // whose rows are rows i, i + row_shift, i + 2 * row_shift, ... of B, so
+  // this is a strided-batched product with one (small) product per row.
+  CuSubMatrix<BaseFloat> A_row(A, 0, 1, 0, input_num_cols),
+      B_rows(B.Data(), context_dim, input_num_cols, row_shift * B.Stride()),
+      C_row(*C, 0, 1, 0, context_dim);
+  AddMatMatStridedBatched<BaseFloat>(alpha, &C_row, C->Stride(),
+                                     A_row, A.Stride(), kNoTrans,
+                                     B_rows, B.Stride(), kTrans,
+                                     0.0, num_output_rows);
 }
 
 void ApplyScalesToOutput(BaseFloat alpha,
@@ -64,13 +65,14 @@ void ApplyScalesToOutput(BaseFloat alpha,
       context_dim = C.NumCols();
   KALDI_ASSERT(num_extra_rows > 0 && num_extra_rows % (context_dim - 1) == 0);
   int32 row_shift = num_extra_rows / (context_dim - 1);
-  CuMatrix<BaseFloat> Ctrans(C, kTrans);
-  for (int32 o = 0; o < context_dim; o++) {
-    CuSubVector<BaseFloat> c_col(Ctrans, o);
-    CuSubMatrix<BaseFloat> B_part(B, o * row_shift, num_output_rows,
-                                  0, input_num_cols);
-    A->AddDiagVecMat(alpha, c_col, B_part, kNoTrans, 1.0);
-  }
+  // As in GetAttentionDotProducts(), one small product per row of A.
+  CuSubMatrix<BaseFloat> A_row(*A, 0, 1, 0, input_num_cols),
+      B_rows(B.Data(), context_dim, input_num_cols, row_shift * B.Stride()),
+      C_row(C, 0, 1, 0, context_dim);
+  AddMatMatStridedBatched<BaseFloat>(alpha, &A_row, A->Stride(),
+                                     C_row, C.Stride(), kNoTrans,
+                                     B_rows, B.Stride(), kNoTrans,
+                                     1.0, num_output_rows);
 }
 
 void ApplyScalesToInput(BaseFloat alpha,
@@ -85,6 +87,8 @@ void ApplyScalesToInput(BaseFloat alpha,
       context_dim = C.NumCols();
   KALDI_ASSERT(num_extra_rows > 0 && num_extra_rows % (context_dim - 1) == 0);
   int32 row_shift = num_extra_rows / (context_dim - 1);
+  // This can't be done as one batched product like ApplyScalesToOutput(),
+  // because the groups of rows of B that it would write to overlap.
   CuMatrix<BaseFloat> Ctrans(C, kTrans);
   for (int32 o = 0; o < context_dim; o++) {
     CuSubVector<BaseFloat> c_col(Ctrans, o);
@@ -118,6 +122,16 @@ void AttentionForward(BaseFloat key_scale,
                (output->NumCols() == value_dim ||
                 output->NumCols() == value_dim + context_dim));
 
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    // On GPU the fused kernel is much faster than the sequence of operations
+    // below; on CPU the BLAS-based operations are faster.
+    cu::RestrictedAttentionForward(key_scale, keys, queries, values,
+                                   c, output);
+    return;
+  }
+#endif
+
   CuSubMatrix<BaseFloat> queries_key_part(
       queries, 0, num_output_rows,
       0, key_dim),
@@ -183,6 +197,15 @@ void AttentionBackward(BaseFloat key_scale,
                (output_deriv.NumCols() == value_dim ||
                 output_deriv.NumCols() == value_dim + context_dim));
 
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    cu::RestrictedAttentionBackward(key_scale, keys, queries, values, c,
+                                    output_deriv, keys_deriv, queries_deriv,
+                                    values_deriv);
+    return;
+  }
+#endif
+
   CuMatrix<BaseFloat> c_deriv(num_output_rows, context_dim,
                               kUndefined);
 
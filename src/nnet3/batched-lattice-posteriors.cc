@@ -0,0 +1,342 @@
+// nnet3/batched-lattice-posteriors.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <limits>
+#include <unordered_map>
+
+#include "nnet3/batched-lattice-posteriors.h"
+#include "cudamatrix/cu-array.h"
+#include "cudamatrix/cu-device.h"
+#include "cudamatrix/cu-kernels-ansi.h"
+#include "util/stl-utils.h"
+
+namespace kaldi {
+
+// The following overloads extract, from arcs and final-probs of Lattice and
+// CompactLattice, the total cost, its acoustic part, and the transition-ids.
+static inline void GetArcInfo(const LatticeArc &arc, BaseFloat *cost,
+                              BaseFloat *acoustic_cost,
+                              std::vector<int32> *labels) {
+  *cost = ConvertToCost(arc.weight);
+  *acoustic_cost = arc.weight.Value2();
+  labels->clear();
+  if (arc.ilabel != 0)
+    labels->push_back(arc.ilabel);
+}
+
+static inline void GetArcInfo(const CompactLatticeArc &arc, BaseFloat *cost,
+                              BaseFloat *acoustic_cost,
+                              std::vector<int32> *labels) {
+  *cost = ConvertToCost(arc.weight);
+  *acoustic_cost = arc.weight.Weight().Value2();
+  *labels = arc.weight.String();
+}
+
+static inline void GetFinalInfo(const LatticeWeight &w, BaseFloat *cost,
+                                BaseFloat *acoustic_cost) {
+  *cost = ConvertToCost(w);
+  *acoustic_cost = w.Value2();
+}
+
+// Note: any transition-ids in the final-prob of a CompactLattice (which
+// are unusual) are ignored by this class.
+static inline void GetFinalInfo(const CompactLatticeWeight &w, BaseFloat *cost,
+                                BaseFloat *acoustic_cost) {
+  *cost = ConvertToCost(w);
+  *acoustic_cost = w.Weight().Value2();
+}
+
+
+template<class Arc>
+int32 BatchedLatticePosteriors::AddLatticeInternal(
+    const fst::VectorFst<Arc> &lat) {
+  typedef typename Arc::StateId StateId;
+  if (lat.Properties(fst::kTopSorted, true) == 0)
+    KALDI_ERR << "Input lattice must be topologically sorted.";
+  computed_ = false;
+  int32 graph = graph_start_.size(),
+      state_offset = state_graph_.size(),
+      num_states = lat.NumStates();
+  if (num_states == 0) {
+    graph_start_.push_back(-1);
+  } else {
+    KALDI_ASSERT(lat.Start() == 0);
+    graph_start_.push_back(state_offset);
+  }
+  state_graph_.resize(state_offset + num_states, graph);
+  state_time_.resize(state_offset + num_states, -1);
+  if (num_states > 0)
+    state_time_[state_offset] = 0;
+
+  int32 num_frames = 0;
+  std::vector<int32> labels;
+  for (StateId s = 0; s < num_states; s++) {
+    int32 this_state = state_offset + s,
+        this_time = state_time_[this_state];
+    if (out_arc_offsets_.empty())
+      out_arc_offsets_.push_back(0);
+    for (fst::ArcIterator<fst::VectorFst<Arc> > aiter(lat, s); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      BaseFloat cost, acoustic_cost;
+      GetArcInfo(arc, &cost, &acoustic_cost, &labels);
+      int32 next_state = state_offset + arc.nextstate,
+          next_time = this_time + static_cast<int32>(labels.size());
+      if (state_time_[next_state] == -1)
+        state_time_[next_state] = next_time;
+      else
+        KALDI_ASSERT(state_time_[next_state] == next_time &&
+                     "Lattice is inconsistent (times of states differ)");
+      arc_src_.push_back(this_state);
+      arc_dst_.push_back(next_state);
+      arc_cost_.push_back(cost);
+      arc_acoustic_cost_.push_back(acoustic_cost);
+      if (arc_label_offsets_.empty())
+        arc_label_offsets_.push_back(0);
+      arc_labels_.insert(arc_labels_.end(), labels.begin(), labels.end());
+      arc_label_offsets_.push_back(arc_labels_.size());
+    }
+    out_arc_offsets_.push_back(arc_src_.size());
+    BaseFloat final_cost, final_acoustic_cost;
+    GetFinalInfo(lat.Final(s), &final_cost, &final_acoustic_cost);
+    final_cost_.push_back(final_cost);
+    final_acoustic_cost_.push_back(final_acoustic_cost);
+    num_frames = std::max(num_frames, this_time);
+  }
+  graph_num_frames_.push_back(num_frames);
+  graph_state_offsets_.push_back(state_graph_.size());
+  graph_arc_offsets_.push_back(arc_src_.size());
+  return graph;
+}
+
+int32 BatchedLatticePosteriors::AddLattice(const Lattice &lat) {
+  return AddLatticeInternal(lat);
+}
+
+int32 BatchedLatticePosteriors::AddLattice(const CompactLattice &clat) {
+  return AddLatticeInternal(clat);
+}
+
+void BatchedLatticePosteriors::Clear() {
+  graph_start_.clear();
+  graph_state_offsets_.assign(1, 0);
+  graph_arc_offsets_.assign(1, 0);
+  graph_num_frames_.clear();
+  state_graph_.clear();
+  state_time_.clear();
+  out_arc_offsets_.clear();
+  final_cost_.clear();
+  final_acoustic_cost_.clear();
+  arc_src_.clear();
+  arc_dst_.clear();
+  arc_cost_.clear();
+  arc_acoustic_cost_.clear();
+  arc_label_offsets_.clear();
+  arc_labels_.clear();
+  computed_ = false;
+  alpha_.clear();
+  beta_.clear();
+  arc_post_.clear();
+}
+
+void BatchedLatticePosteriors::Compute() {
+  int32 num_states = state_graph_.size(),
+      num_arcs = arc_src_.size();
+  if (out_arc_offsets_.empty())
+    out_arc_offsets_.push_back(0);
+  // Work out the incoming arcs of each state, sorted by destination state.
+  std::vector<int32> in_arc_offsets(num_states + 1, 0),
+      in_arcs(num_arcs);
+  for (int32 a = 0; a < num_arcs; a++)
+    in_arc_offsets[arc_dst_[a] + 1]++;
+  for (int32 s = 0; s < num_states; s++)
+    in_arc_offsets[s + 1] += in_arc_offsets[s];
+  {
+    std::vector<int32> next(in_arc_offsets.begin(), in_arc_offsets.end() - 1);
+    for (int32 a = 0; a < num_arcs; a++)
+      in_arcs[next[arc_dst_[a]]++] = a;
+  }
+  alpha_.assign(num_states, -std::numeric_limits<double>::infinity());
+  beta_.resize(num_states);
+  arc_post_.resize(num_arcs);
+  for (size_t i = 0; i < graph_start_.size(); i++)
+    if (graph_start_[i] >= 0)
+      alpha_[graph_start_[i]] = 0.0;
+
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    ComputeGpu(in_arc_offsets, in_arcs);
+  } else
+#endif
+  {
+    ComputeCpu(in_arc_offsets, in_arcs);
+  }
+  computed_ = true;
+}
+
+void BatchedLatticePosteriors::ComputeCpu(
+    const std::vector<int32> &in_arc_offsets,
+    const std::vector<int32> &in_arcs) {
+  int32 num_states = state_graph_.size(),
+      num_arcs = arc_src_.size();
+  // The states of each lattice are topologically sorted and the lattices don't
+  // share states, so the global numbering is topologically sorted.
+  for (int32 s = 0; s < num_states; s++) {
+    double this_alpha = alpha_[s];
+    for (int32 a = out_arc_offsets_[s]; a < out_arc_offsets_[s + 1]; a++)
+      alpha_[arc_dst_[a]] = LogAdd(alpha_[arc_dst_[a]],
+                                   this_alpha - arc_cost_[a]);
+  }
+  for (int32 s = num_states - 1; s >= 0; s--) {
+    double this_beta = -final_cost_[s];
+    for (int32 a = out_arc_offsets_[s]; a < out_arc_offsets_[s + 1]; a++)
+      this_beta = LogAdd(this_beta, beta_[arc_dst_[a]] - arc_cost_[a]);
+    beta_[s] = this_beta;
+  }
+  for (int32 a = 0; a < num_arcs; a++) {
+    int32 src = arc_src_[a],
+        start = graph_start_[state_graph_[src]];
+    double log_post = alpha_[src] - arc_cost_[a] + beta_[arc_dst_[a]] -
+        beta_[start];
+    if (log_post > 0.0)  // roundoff.
+      log_post = 0.0;
+    arc_post_[a] = Exp(log_post);
+  }
+}
+
+void BatchedLatticePosteriors::ComputeGpu(
+    const std::vector<int32> &in_arc_offsets,
+    const std::vector<int32> &in_arcs) {
+#if HAVE_CUDA == 1
+  CuTimer tim;
+  int32 num_states = state_graph_.size(),
+      num_arcs = arc_src_.size();
+  // Work out the level of each state (the length of the longest path from the
+  // start state), and sort the states by level.
+  std::vector<int32> level(num_states, 0);
+  int32 num_levels = 0;
+  for (int32 s = 0; s < num_states; s++) {
+    num_levels = std::max(num_levels, level[s] + 1);
+    for (int32 a = out_arc_offsets_[s]; a < out_arc_offsets_[s + 1]; a++)
+      level[arc_dst_[a]] = std::max(level[arc_dst_[a]], level[s] + 1);
+  }
+  std::vector<int32> level_offsets(num_levels + 1, 0),
+      level_states(num_states);
+  for (int32 s = 0; s < num_states; s++)
+    level_offsets[level[s] + 1]++;
+  for (int32 l = 0; l < num_levels; l++)
+    level_offsets[l + 1] += level_offsets[l];
+  {
+    std::vector<int32> next(level_offsets.begin(), level_offsets.end() - 1);
+    for (int32 s = 0; s < num_states; s++)
+      level_states[next[level[s]]++] = s;
+  }
+
+  CuArray<int32> level_states_gpu(level_states),
+      in_arc_offsets_gpu(in_arc_offsets), in_arcs_gpu(in_arcs),
+      out_arc_offsets_gpu(out_arc_offsets_), arc_src_gpu(arc_src_),
+      arc_dst_gpu(arc_dst_), state_graph_gpu(state_graph_),
+      graph_start_gpu(graph_start_);
+  CuArray<BaseFloat> arc_cost_gpu(arc_cost_), final_cost_gpu(final_cost_),
+      arc_post_gpu(num_arcs, kUndefined);
+  CuArray<double> alpha_gpu(alpha_), beta_gpu(num_states, kUndefined);
+
+  dim3 dimBlock(CU1DBLOCK);
+  for (int32 l = 0; l < num_levels; l++) {
+    int32 n = level_offsets[l + 1] - level_offsets[l];
+    dim3 dimGrid(n_blocks(n, CU1DBLOCK));
+    cuda_dag_forward(dimGrid, dimBlock,
+                     level_states_gpu.Data() + level_offsets[l], n,
+                     in_arc_offsets_gpu.Data(), in_arcs_gpu.Data(),
+                     arc_src_gpu.Data(), arc_cost_gpu.Data(),
+                     alpha_gpu.Data());
+  }
+  for (int32 l = num_levels - 1; l >= 0; l--) {
+    int32 n = level_offsets[l + 1] - level_offsets[l];
+    dim3 dimGrid(n_blocks(n, CU1DBLOCK));
+    cuda_dag_backward(dimGrid, dimBlock,
+                      level_states_gpu.Data() + level_offsets[l], n,
+                      out_arc_offsets_gpu.Data(), arc_dst_gpu.Data(),
+                      arc_cost_gpu.Data(), final_cost_gpu.Data(),
+                      beta_gpu.Data());
+  }
+  if (num_arcs > 0) {
+    dim3 dimGrid(n_blocks(num_arcs, CU1DBLOCK));
+    cuda_dag_arc_posteriors(dimGrid, dimBlock, num_arcs, arc_src_gpu.Data(),
+                            arc_dst_gpu.Data(), arc_cost_gpu.Data(),
+                            state_graph_gpu.Data(), graph_start_gpu.Data(),
+                            alpha_gpu.Data(), beta_gpu.Data(),
+                            arc_post_gpu.Data());
+  }
+  CU_SAFE_CALL(cudaGetLastError());
+  alpha_gpu.CopyToVec(&alpha_);
+  beta_gpu.CopyToVec(&beta_);
+  arc_post_gpu.CopyToVec(&arc_post_);
+  CuDevice::Instantiate().AccuProfile(__func__, tim);
+#else
+  KALDI_ERR << "ComputeGpu() called without CUDA support.";
+#endif
+}
+
+double BatchedLatticePosteriors::TotalLogLike(int32 i) const {
+  KALDI_ASSERT(computed_ && i >= 0 && i < NumLattices());
+  if (graph_start_[i] < 0)
+    return -std::numeric_limits<double>::infinity();
+  return beta_[graph_start_[i]];
+}
+
+void BatchedLatticePosteriors::GetArcPosteriors(
+    int32 i, std::vector<BaseFloat> *arc_post) const {
+  KALDI_ASSERT(computed_ && i >= 0 && i < NumLattices());
+  arc_post->assign(arc_post_.begin() + graph_arc_offsets_[i],
+                   arc_post_.begin() + graph_arc_offsets_[i + 1]);
+}
+
+void BatchedLatticePosteriors::GetPosterior(int32 i, Posterior *post,
+                                            double *acoustic_like_sum) const {
+  KALDI_ASSERT(computed_ && i >= 0 && i < NumLattices());
+  post->clear();
+  post->resize(graph_num_frames_[i]);
+  if (acoustic_like_sum)
+    *acoustic_like_sum = 0.0;
+  if (graph_start_[i] < 0)
+    return;
+  double tot_like = beta_[graph_start_[i]];
+  for (int32 a = graph_arc_offsets_[i]; a < graph_arc_offsets_[i + 1]; a++) {
+    BaseFloat p = arc_post_[a];
+    int32 t = state_time_[arc_src_[a]];
+    for (int32 j = arc_label_offsets_[a]; j < arc_label_offsets_[a + 1];
+         j++, t++)
+      (*post)[t].push_back(std::make_pair(arc_labels_[j], p));
+    if (acoustic_like_sum)
+      *acoustic_like_sum -= p * arc_acoustic_cost_[a];
+  }
+  if (acoustic_like_sum) {
+    for (int32 s = graph_state_offsets_[i]; s < graph_state_offsets_[i + 1];
+         s++) {
+      if (final_cost_[s] != std::numeric_limits<BaseFloat>::infinity())
+        *acoustic_like_sum -= Exp(alpha_[s] - final_cost_[s] - tot_like) *
+            final_acoustic_cost_[s];
+    }
+  }
+  // Now combine any posteriors with the same transition-id.
+  for (size_t t = 0; t < post->size(); t++)
+    MergePairVectorSumming(&((*post)[t]));
+}
+
+
+}  // namespace kaldi
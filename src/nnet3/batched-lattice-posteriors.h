@@ -0,0 +1,144 @@
+// nnet3/batched-lattice-posteriors.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_BATCHED_LATTICE_POSTERIORS_H_
+#define KALDI_NNET3_BATCHED_LATTICE_POSTERIORS_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "lat/kaldi-lattice.h"
+#include "hmm/posterior.h"
+
+namespace kaldi {
+
+/**
+   This class does the forward-backward computation of LatticeForwardBackward()
+   (i.e. computes arc posteriors) for a batch of lattices at once, using the
+   GPU if one is in use and the CPU otherwise.  The lattices may be of type
+   Lattice or CompactLattice and must be topologically sorted.
+
+   The lattices are copied into a single graph with the arcs stored in CSR
+   form.  On the GPU, the forward and backward passes are done level by level,
+   where the level of a state is the length of the longest path to it from the
+   start state; all the states of a level (from all the lattices) are processed
+   by a single kernel.  For lattices from the decoder, the number of levels is
+   approximately the number of frames.
+
+   This is in nnet3/ only because it needs both lat/ and cudamatrix/; it does
+   not depend on anything in nnet3.
+
+   Example:
+     BatchedLatticePosteriors batch;
+     for (size_t i = 0; i < lats.size(); i++)
+       batch.AddLattice(lats[i]);
+     batch.Compute();
+     for (size_t i = 0; i < lats.size(); i++)
+       batch.GetPosterior(i, &(posts[i]));
+*/
+class BatchedLatticePosteriors {
+ public:
+  BatchedLatticePosteriors(): graph_state_offsets_(1, 0),
+                              graph_arc_offsets_(1, 0), computed_(false) { }
+
+  /// Adds a lattice to the batch and returns its index.  The lattice is
+  /// copied, so it does not need to exist after this call.
+  int32 AddLattice(const Lattice &lat);
+
+  /// Adds a CompactLattice to the batch and returns its index.  Each arc
+  /// spans the frames of the transition-ids in its weight's string.
+  int32 AddLattice(const CompactLattice &clat);
+
+  int32 NumLattices() const { return graph_start_.size(); }
+
+  /// Does the forward-backward computation for all the lattices added so far.
+  void Compute();
+
+  /// Returns the total log-likelihood of lattice i, as returned by
+  /// LatticeForwardBackward().  Only valid after Compute().
+  double TotalLogLike(int32 i) const;
+
+  /// Outputs the posteriors of the arcs of lattice i, in the order in which
+  /// the arcs would be visited by iterating over states and then over the arcs
+  /// of each state.  Only valid after Compute().
+  void GetArcPosteriors(int32 i, std::vector<BaseFloat> *arc_post) const;
+
+  /// Outputs the posteriors of transition-ids for each frame of lattice i,
+  /// as LatticeForwardBackward() does (including the 'acoustic_like_sum'
+  /// output, if non-NULL).  Only valid after Compute().
+  void GetPosterior(int32 i, Posterior *post,
+                    double *acoustic_like_sum = NULL) const;
+
+  /// Removes all the lattices.
+  void Clear();
+
+ private:
+  template<class Arc>
+  int32 AddLatticeInternal(const fst::VectorFst<Arc> &lat);
+
+  void ComputeCpu(const std::vector<int32> &in_arc_offsets,
+                  const std::vector<int32> &in_arcs);
+
+  void ComputeGpu(const std::vector<int32> &in_arc_offsets,
+                  const std::vector<int32> &in_arcs);
+
+  // The following describe the lattices; states and arcs are numbered
+  // globally, with the states and arcs of lattice i being
+  // graph_state_offsets_[i] ... graph_state_offsets_[i+1] - 1 and
+  // graph_arc_offsets_[i] ... graph_arc_offsets_[i+1] - 1.
+
+  // The global index of the start state of each lattice, or -1 if the lattice
+  // was empty.
+  std::vector<int32> graph_start_;
+  std::vector<int32> graph_state_offsets_;
+  std::vector<int32> graph_arc_offsets_;
+  // The number of frames of each lattice.
+  std::vector<int32> graph_num_frames_;
+
+  // Indexed by state: the lattice it is in, and its frame index.
+  std::vector<int32> state_graph_;
+  std::vector<int32> state_time_;
+  // The arcs leaving state s are out_arc_offsets_[s] ...
+  // out_arc_offsets_[s+1] - 1.
+  std::vector<int32> out_arc_offsets_;
+  // The final cost of each state (infinity if not final), and its acoustic
+  // part.
+  std::vector<BaseFloat> final_cost_;
+  std::vector<BaseFloat> final_acoustic_cost_;
+
+  // Indexed by arc.
+  std::vector<int32> arc_src_;
+  std::vector<int32> arc_dst_;
+  std::vector<BaseFloat> arc_cost_;
+  std::vector<BaseFloat> arc_acoustic_cost_;
+  // The transition-ids on arc a are arc_labels_[arc_label_offsets_[a]] ...
+  // arc_labels_[arc_label_offsets_[a+1] - 1]; they are on consecutive frames
+  // starting from the time of arc_src_[a].
+  std::vector<int32> arc_label_offsets_;
+  std::vector<int32> arc_labels_;
+
+  // The results of Compute().
+  bool computed_;
+  std::vector<double> alpha_;
+  std::vector<double> beta_;
+  std::vector<BaseFloat> arc_post_;
+};
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_NNET3_BATCHED_LATTICE_POSTERIORS_H_
@@ -521,6 +521,62 @@ static void ConvolveForwardInternal(
   }
 }
 
+// Returns true if the forward computation should be done by
+// ConvolveForwardDirect().  On GPU the single large multiplication done with
+// the temporary matrix is faster than one multiplication per output height.
+static bool UseDirectConvolution(const ConvolutionComputation &cc) {
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    return false;
+#endif
+  if (cc.temp_cols == 0)
+    return false;  // There is no temporary matrix anyway.
+  for (size_t s = 0; s < cc.steps.size(); s++)
+    if (cc.steps[s].direct_blocks.empty())
+      return false;
+  return true;
+}
+
+// Does the same as ConvolveForwardInternal(), but without a temporary matrix:
+// each output height is computed by multiplying the range of the input
+// columns that it depends on by the corresponding parameters.  Requires that
+// cc.steps[*].direct_blocks are all nonempty.
+static void ConvolveForwardDirect(
+    const ConvolutionComputation &cc,
+    const CuMatrixBase<BaseFloat> &input,
+    const CuMatrixBase<BaseFloat> &params,
+    CuMatrixBase<BaseFloat> *output) {
+  int32 output_rows = output->NumRows(),
+      num_filters_in = cc.num_filters_in,
+      num_filters_out = cc.num_filters_out;
+  int32 num_steps = cc.steps.size();
+  for (int32 s = 0; s < num_steps; s++) {
+    const ConvolutionComputation::ConvolutionStep &step = cc.steps[s];
+    KALDI_ASSERT(!step.direct_blocks.empty());
+    CuSubMatrix<BaseFloat> input_part(input,
+                                      step.input_time_shift * cc.num_images,
+                                      output_rows, 0, input.NumCols());
+    for (int32 h = 0; h < cc.height_out; h++) {
+      int32 height_in_start = step.direct_blocks[3 * h],
+          block_start = step.direct_blocks[3 * h + 1],
+          num_blocks = step.direct_blocks[3 * h + 2];
+      if (num_blocks == 0)
+        continue;
+      CuSubMatrix<BaseFloat> output_part(*output, 0, output_rows,
+                                         h * num_filters_out,
+                                         num_filters_out),
+          input_block(input_part, 0, output_rows,
+                      height_in_start * num_filters_in,
+                      num_blocks * num_filters_in),
+          params_block(params, 0, params.NumRows(),
+                       step.params_start_col + block_start * num_filters_in,
+                       num_blocks * num_filters_in);
+      output_part.AddMatMat(1.0, input_block, kNoTrans,
+                            params_block, kTrans, 1.0);
+    }
+  }
+}
+
 void ConvolveForward(
     const ConvolutionComputation &cc,
     const CuMatrixBase<BaseFloat> &input,
@@ -555,6 +611,11 @@ void ConvolveForward(
     return;
   }
 
+  if (UseDirectConvolution(cc)) {
+    ConvolveForwardDirect(cc, input, params, output);
+    return;
+  }
+
   CuMatrix<BaseFloat> temp_mat(cc.temp_rows, cc.temp_cols,
                                kUndefined, kStrideEqualNumCols);
 
@@ -1304,6 +1365,26 @@ void ConvolutionComputation::ComputeDerived() {
     step.first_column = columns[0];
 
 
+    step.direct_blocks.clear();
+    int32 blocks_per_height = temp_height / height_out;
+    KALDI_ASSERT(blocks_per_height * height_out == temp_height);
+    std::vector<int32> direct_blocks(3 * height_out);
+    bool direct_ok = true;
+    for (int32 h = 0; h < height_out && direct_ok; h++) {
+      const int32 *this_map = &(step.height_map[h * blocks_per_height]);
+      int32 begin = 0, end = blocks_per_height;
+      while (begin < end && this_map[begin] == -1) begin++;
+      while (end > begin && this_map[end - 1] == -1) end--;
+      for (int32 b = begin + 1; b < end; b++)
+        if (this_map[b] != this_map[begin] + (b - begin))
+          direct_ok = false;
+      direct_blocks[3 * h] = (begin < end ? this_map[begin] : 0);
+      direct_blocks[3 * h + 1] = begin;
+      direct_blocks[3 * h + 2] = end - begin;
+    }
+    if (direct_ok)
+      step.direct_blocks.swap(direct_blocks);
+
     bool need_temp_matrix =
         !(step.columns_are_contiguous && step.height_map[0] == 0 &&
           step.height_map.size() == height_in);
@@ -339,6 +339,16 @@ struct ConvolutionComputation {
     // only of interest if 'columns_are_contiguous' is true (it enables an
     // optimization).
     int32 first_column;
+    // 'direct_blocks' is derived from 'height_map'.  It is nonempty if, for
+    // each output height, the elements of 'height_map' for that height that
+    // are not -1 form a contiguous range of input heights; the forward
+    // computation can then be done directly from the input, with one matrix
+    // multiplication per output height and no temporary matrix (see
+    // ConvolveForward()).  It has 3 * height_out elements: for each output
+    // height, the first input height, the index of the first block of the
+    // kernel used (i.e. the offset into this height's part of 'height_map'),
+    // and the number of blocks (which may be zero).
+    std::vector<int32> direct_blocks;
   };
   std::vector<ConvolutionStep> steps;
 
@@ -347,7 +357,7 @@ struct ConvolutionComputation {
   void Read(std::istream &is, bool binary);
 
   // Computes derived variables in 'steps', i.e. 'columns', 'backward_columns',
-  // columns_are_contiguous, and 'first_column'.
+  // columns_are_contiguous, 'first_column' and 'direct_blocks'.
   void ComputeDerived();
 
   // check that this computation makes sense; crash if not.
@@ -473,6 +483,10 @@ void CompileConvolutionComputation(
              conv_comp.num_t_out * conv_comp.num_images
              by conv_comp.height_out * num_filters_out.  It must
              satisfy output.NumCols() == output.Stride().
+
+   When not using a GPU, if all the steps of the computation allow it (see
+   ConvolutionStep::direct_blocks), the convolution is done directly from the
+   input, without copying it to a temporary matrix.
  */
 void ConvolveForward(
     const ConvolutionComputation &conv_comp,
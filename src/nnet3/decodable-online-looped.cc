@@ -31,10 +31,14 @@ DecodableNnetLoopedOnlineBase::DecodableNnetLoopedOnlineBase(
     current_log_post_subsampled_offset_(-1),
     info_(info),
     frame_offset_(0),
+    warm_start_offset_(0),
     input_features_(input_features),
     ivector_features_(ivector_features),
     computer_(info_.opts.compute_config, info_.computation,
-              info_.nnet, NULL) {   // NULL is 'nnet_to_update'
+              info_.nnet, NULL),   // NULL is 'nnet_to_update'
+    input_offset_(0),
+    keep_looped_state_(false),
+    last_chunk_padded_(false) {
   // Check that feature dimensions match.
   KALDI_ASSERT(input_features_ != NULL);
   int32 nnet_input_dim = info_.nnet.InputDim("input"),
@@ -53,6 +57,59 @@ DecodableNnetLoopedOnlineBase::DecodableNnetLoopedOnlineBase(
 }
 
 
+void DecodableNnetLoopedOnlineBase::Reset(
+    OnlineFeatureInterface *input_features,
+    OnlineFeatureInterface *ivector_features) {
+  KALDI_ASSERT(input_features != NULL &&
+               input_features->Dim() == input_features_->Dim() &&
+               (ivector_features == NULL) == (ivector_features_ == NULL));
+  if (ivector_features != NULL)
+    KALDI_ASSERT(ivector_features->Dim() == ivector_features_->Dim());
+  input_features_ = input_features;
+  ivector_features_ = ivector_features;
+  current_log_post_.Resize(0, 0);
+  num_chunks_computed_ = 0;
+  current_log_post_subsampled_offset_ = -1;
+  frame_offset_ = 0;
+  warm_start_offset_ = 0;
+  input_offset_ = 0;
+  last_chunk_padded_ = false;
+  kept_state_.num_chunks_computed = 0;
+  computer_.Reset();
+}
+
+bool DecodableNnetLoopedOnlineBase::GetLoopedState(
+    DecodableNnetLoopedState *state) const {
+  if (kept_state_.num_chunks_computed > 0) {
+    *state = kept_state_;
+    return true;
+  }
+  if (num_chunks_computed_ == 0 || last_chunk_padded_)
+    return false;
+  state->num_chunks_computed = num_chunks_computed_;
+  computer_.SaveState(&(state->computer_state));
+  return true;
+}
+
+void DecodableNnetLoopedOnlineBase::SetLoopedState(
+    const DecodableNnetLoopedState &state) {
+  KALDI_ASSERT(num_chunks_computed_ == 0 && state.num_chunks_computed > 0);
+  computer_.RestoreState(state.computer_state);
+  num_chunks_computed_ = state.num_chunks_computed;
+  // The next chunk starts at input frame (num_chunks_computed_ *
+  // frames_per_chunk + frames_right_context).  We put the first frame of this
+  // utterance there, preceded by copies of it as needed to make its index a
+  // multiple of the frame-subsampling factor.  The output frames before it
+  // belong to the previous utterance, and are never accessed.
+  int32 sf = info_.opts.frame_subsampling_factor,
+      right_context = info_.frames_right_context,
+      padding = (sf - right_context % sf) % sf;
+  input_offset_ = num_chunks_computed_ * info_.frames_per_chunk +
+      right_context + padding;
+  warm_start_offset_ = input_offset_ / sf;
+}
+
+
 int32 DecodableNnetLoopedOnlineBase::NumFramesReady() const {
   // note: the ivector_features_ may have 2 or 3 fewer frames ready than
   // input_features_, but we don't wait for them; we just use the most recent
@@ -72,14 +129,16 @@ int32 DecodableNnetLoopedOnlineBase::NumFramesReady() const {
     // note: info_.right_context_ includes both the model context and any
     // extra_right_context_ (but this
     int32 non_subsampled_output_frames_ready =
-        std::max<int32>(0, features_ready - info_.frames_right_context);
+        std::max<int32>(0, features_ready + input_offset_ -
+                        info_.frames_right_context);
     int32 num_chunks_ready = non_subsampled_output_frames_ready /
                              info_.frames_per_chunk;
     // note: the division by the frame subsampling factor 'sf' below
     // doesn't need any attention to rounding because info_.frames_per_chunk
     // is always a multiple of 'sf' (see 'frames_per_chunk = GetChunksize..."
     // in decodable-simple-looped.cc).
-    return num_chunks_ready * info_.frames_per_chunk / sf - frame_offset_;
+    return std::max<int32>(0, num_chunks_ready * info_.frames_per_chunk / sf -
+                           warm_start_offset_) - frame_offset_;
   }
 }
 
@@ -116,6 +175,7 @@ void DecodableNnetLoopedOnlineBase::SetFrameOffset(int32 frame_offset) {
 }
 
 void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
+  KALDI_TRACE_SPAN("DecodableNnetLoopedOnline::AdvanceChunk");
   // Prepare the input data for the next chunk of features.
   // note: 'end' means one past the last.
   int32 begin_input_frame, end_input_frame;
@@ -132,9 +192,23 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
     end_input_frame = begin_input_frame + info_.frames_per_chunk;
   }
 
+  // From here on, the frame indexes are those of input_features_.
+  begin_input_frame -= input_offset_;
+  end_input_frame -= input_offset_;
+
   int32 num_feature_frames_ready = input_features_->NumFramesReady();
   bool is_finished = input_features_->IsLastFrame(num_feature_frames_ready - 1);
 
+  bool padded = (end_input_frame > num_feature_frames_ready);
+  if (padded && keep_looped_state_ && num_chunks_computed_ > 0 &&
+      !last_chunk_padded_ && kept_state_.num_chunks_computed == 0) {
+    // This is the first chunk that needs frames past the end of the input,
+    // so the state before it is the one to keep for the next utterance.
+    kept_state_.num_chunks_computed = num_chunks_computed_;
+    computer_.SaveState(&(kept_state_.computer_state));
+  }
+  last_chunk_padded_ = padded;
+
   if (end_input_frame > num_feature_frames_ready && !is_finished) {
     // we shouldn't be attempting to read past the end of the available features
     // until we have reached the end of the input (i.e. the end-user called
@@ -237,7 +311,7 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
 
 BaseFloat DecodableNnetLoopedOnline::LogLikelihood(int32 subsampled_frame,
                                                     int32 index) {
-  subsampled_frame += frame_offset_;
+  subsampled_frame += frame_offset_ + warm_start_offset_;
   EnsureFrameIsComputed(subsampled_frame);
   // note: we index by 'inde
   return current_log_post_(
@@ -248,7 +322,7 @@ BaseFloat DecodableNnetLoopedOnline::LogLikelihood(int32 subsampled_frame,
 
 BaseFloat DecodableAmNnetLoopedOnline::LogLikelihood(int32 subsampled_frame,
                                                     int32 index) {
-  subsampled_frame += frame_offset_;
+  subsampled_frame += frame_offset_ + warm_start_offset_;
   EnsureFrameIsComputed(subsampled_frame);
   return current_log_post_(
       subsampled_frame - current_log_post_subsampled_offset_,
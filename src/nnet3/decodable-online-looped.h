@@ -47,6 +47,22 @@ namespace nnet3 {
 // we use the same options and info class.
 
 
+// The state of the looped neural net computation of a
+// DecodableNnetLoopedOnlineBase object at some point in an utterance.  It can
+// be used to start the next utterance of the same speaker (or stream) with
+// the context, including any recurrent state, from that point, instead of
+// with the initial computation that processes the extra left context; this
+// reduces the work, and hence the latency, of the first chunk.  It is to the
+// neural net what OnlineIvectorExtractorAdaptationState is to the iVectors.
+// See DecodableNnetLoopedOnlineBase::GetLoopedState().
+struct DecodableNnetLoopedState {
+  // The number of chunks that had been computed; 0 if the state is empty.
+  int32 num_chunks_computed;
+  NnetComputerState computer_state;
+  DecodableNnetLoopedState(): num_chunks_computed(0) { }
+};
+
+
 // This object is used as a base class for DecodableNnetLoopedOnline
 // and DecodableAmNnetLoopedOnline.
 // It takes care of the neural net computation and computations related to how
@@ -93,6 +109,37 @@ class DecodableNnetLoopedOnlineBase: public DecodableInterface {
   /// Returns the frame offset value.
   int32 GetFrameOffset() const { return frame_offset_; }
 
+  /// Makes this object ready to decode a new utterance, whose features are
+  /// 'input_features' and 'ivector_features' (which must have the same
+  /// dimensions as the ones given to the constructor).  This is as if the
+  /// object were constructed again, except that the memory of the neural net
+  /// computation is kept for reuse (see NnetComputer::Reset()).
+  void Reset(OnlineFeatureInterface *input_features,
+             OnlineFeatureInterface *ivector_features);
+
+  /// If 'keep' is true, this object keeps a copy of the state of the neural
+  /// net computation from just before the end of the input, for
+  /// GetLoopedState().  (The state at the very end is no use for the next
+  /// utterance, as the last chunks are computed with the last frame repeated
+  /// as right context.)
+  void SetKeepLoopedState(bool keep) { keep_looped_state_ = keep; }
+
+  /// Outputs a state with which to start the next utterance of the same
+  /// speaker or stream (see SetLoopedState()): the one kept from before the
+  /// end of the input, if SetKeepLoopedState(true) was called, or else the
+  /// current one if the end of the input has not been reached (e.g. because
+  /// decoding stopped at an endpoint).  Returns false if there is no such
+  /// state.
+  bool GetLoopedState(DecodableNnetLoopedState *state) const;
+
+  /// Makes the computation continue from a state output by GetLoopedState()
+  /// for a previous utterance, with this utterance's features following the
+  /// ones that state was computed from, instead of starting with the initial
+  /// left context.  Must be called before any frames are computed (e.g. just
+  /// after construction or Reset()), and the state must come from an object
+  /// with the same DecodableNnetSimpleLoopedInfo.
+  void SetLoopedState(const DecodableNnetLoopedState &state);
+
  protected:
 
   /// If the neural-network outputs for this frame are not cached, this function
@@ -127,6 +174,12 @@ class DecodableNnetLoopedOnlineBase: public DecodableInterface {
   // 0 unless SetFrameOffset() method is called.
   int32 frame_offset_;
 
+  // After SetLoopedState(), the frames of the neural net output (before
+  // frame_offset_ is applied) are numbered as if this utterance followed the
+  // frames that the state was computed from; this is the index of the output
+  // frame that corresponds to frame 0 of this utterance.  0 otherwise.
+  int32 warm_start_offset_;
+
  private:
 
   // This function does the computation for the next chunk.  It will change
@@ -139,6 +192,18 @@ class DecodableNnetLoopedOnlineBase: public DecodableInterface {
 
   NnetComputer computer_;
 
+  // The input-frame equivalent of warm_start_offset_: input frame t of the
+  // computation is frame t - input_offset_ of input_features_.
+  int32 input_offset_;
+
+  // See SetKeepLoopedState().
+  bool keep_looped_state_;
+  // True if the last chunk computed needed frames past the end of the input.
+  bool last_chunk_padded_;
+  // The state kept if keep_looped_state_ is true; empty until the first chunk
+  // that needs frames past the end of the input.
+  DecodableNnetLoopedState kept_state_;
+
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetLoopedOnlineBase);
 };
 
@@ -20,6 +20,7 @@
 #include "nnet3/decodable-simple-looped.h"
 #include "nnet3/nnet-utils.h"
 #include "nnet3/nnet-compile-looped.h"
+#include "util/kaldi-io.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -82,13 +83,80 @@ void DecodableNnetSimpleLoopedInfo::Init(
                                  num_sequences,
                                  &request1, &request2, &request3);
 
-  CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
-                &computation);
-  computation.ComputeCudaIndexes();
+  bool have_computation = false;
+  if (!opts.compiled_computation.empty()) {
+    bool binary;
+    Input ki(opts.compiled_computation, &binary);
+    have_computation = ReadComputation(ki.Stream(), binary);
+    if (!have_computation)
+      KALDI_WARN << "The computation in " << opts.compiled_computation
+                 << " does not match the model and options; compiling it "
+                 "again.";
+  }
+  if (!have_computation) {
+    CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
+                  &computation);
+    computation.ComputeCudaIndexes();
+  }
   KALDI_VLOG(3) << "Computation is:\n"
                 << NnetComputationPrintInserter{computation, *nnet};
 }
 
+void DecodableNnetSimpleLoopedInfo::WriteComputation(std::ostream &os,
+                                                     bool binary) const {
+  WriteToken(os, binary, "<LoopedComputation>");
+  // The component types and dimensions are written as a sanity check that the
+  // computation is used with the model it was compiled for.
+  WriteToken(os, binary, "<Components>");
+  WriteBasicType(os, binary, nnet.NumComponents());
+  for (int32 c = 0; c < nnet.NumComponents(); c++) {
+    const Component *component = nnet.GetComponent(c);
+    WriteToken(os, binary, component->Type());
+    WriteBasicType(os, binary, component->InputDim());
+    WriteBasicType(os, binary, component->OutputDim());
+  }
+  opts.optimize_config.Write(os, binary);
+  request1.Write(os, binary);
+  request2.Write(os, binary);
+  request3.Write(os, binary);
+  computation.Write(os, binary);
+  WriteToken(os, binary, "</LoopedComputation>");
+}
+
+bool DecodableNnetSimpleLoopedInfo::ReadComputation(std::istream &is,
+                                                    bool binary) {
+  ExpectToken(is, binary, "<LoopedComputation>");
+  ExpectToken(is, binary, "<Components>");
+  int32 num_components;
+  ReadBasicType(is, binary, &num_components);
+  if (num_components != nnet.NumComponents())
+    return false;
+  for (int32 c = 0; c < num_components; c++) {
+    const Component *component = nnet.GetComponent(c);
+    std::string type;
+    int32 input_dim, output_dim;
+    ReadToken(is, binary, &type);
+    ReadBasicType(is, binary, &input_dim);
+    ReadBasicType(is, binary, &output_dim);
+    if (type != component->Type() || input_dim != component->InputDim() ||
+        output_dim != component->OutputDim())
+      return false;
+  }
+  NnetOptimizeOptions optimize_config;
+  optimize_config.Read(is, binary);
+  ComputationRequest r1, r2, r3;
+  r1.Read(is, binary);
+  r2.Read(is, binary);
+  r3.Read(is, binary);
+  if (!(optimize_config == opts.optimize_config) || !(r1 == request1) ||
+      !(r2 == request2) || !(r3 == request3))
+    return false;
+  // NnetComputation::Read() also computes the CUDA indexes.
+  computation.Read(is, binary);
+  ExpectToken(is, binary, "</LoopedComputation>");
+  return true;
+}
+
 
 DecodableNnetSimpleLooped::DecodableNnetSimpleLooped(
     const DecodableNnetSimpleLoopedInfo &info,
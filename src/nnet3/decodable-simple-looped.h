@@ -49,6 +49,7 @@ struct NnetSimpleLoopedComputationOptions {
   int32 frames_per_chunk;
   BaseFloat acoustic_scale;
   bool debug_computation;
+  std::string compiled_computation;
   NnetOptimizeOptions optimize_config;
   NnetComputeOptions compute_config;
   NnetSimpleLoopedComputationOptions():
@@ -83,6 +84,11 @@ struct NnetSimpleLoopedComputationOptions {
                    "if needed.");
     opts->Register("debug-computation", &debug_computation, "If true, turn on "
                    "debug for the actual computation (very verbose!)");
+    opts->Register("compiled-computation", &compiled_computation,
+                   "If set, the rxfilename of a looped computation compiled "
+                   "ahead of time by nnet3-compile-looped, to be used instead "
+                   "of compiling it at startup.  It is ignored, with a warning, "
+                   "if it does not match the model and options.");
 
     // register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -119,6 +125,13 @@ class DecodableNnetSimpleLoopedInfo  {
   void Init(const NnetSimpleLoopedComputationOptions &opts,
             Nnet *nnet);
 
+  // Writes the compiled computation, together with the computation requests
+  // and optimization options that it was compiled from, so that it can later
+  // be read via the --compiled-computation option; this avoids the
+  // compilation, which for large models can take a significant time, when a
+  // decoder starts up.  See nnet3-compile-looped.
+  void WriteComputation(std::ostream &os, bool binary) const;
+
   const NnetSimpleLoopedComputationOptions &opts;
 
   const Nnet &nnet;
@@ -151,6 +164,13 @@ class DecodableNnetSimpleLoopedInfo  {
 
   // The compiled, 'looped' computation.
   NnetComputation computation;
+
+ private:
+  // Reads the computation as written by WriteComputation(); returns false,
+  // leaving 'computation' unchanged, if it was compiled for a different model
+  // (judging by the component types and dimensions), or from different
+  // computation requests or optimization options.
+  bool ReadComputation(std::istream &is, bool binary);
 };
 
 /*
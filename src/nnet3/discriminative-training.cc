@@ -21,6 +21,7 @@
 #include "nnet3/discriminative-training.h"
 #include "lat/lattice-functions.h"
 #include "cudamatrix/cu-matrix.h"
+#include "nnet3/batched-lattice-posteriors.h"
 
 namespace kaldi {
 namespace discriminative {
@@ -100,7 +101,8 @@ class DiscriminativeComputation {
       const CuMatrixBase<BaseFloat> &nnet_output,
       DiscriminativeObjectiveInfo *stats,
       CuMatrixBase<BaseFloat> *nnet_output_deriv,
-      CuMatrixBase<BaseFloat> *xent_output_deriv);
+      CuMatrixBase<BaseFloat> *xent_output_deriv,
+      DiscriminativeComputationPrep *prep);
 
   // Does the forward-backward computation and add the derivative of the
   // w.r.t. the nnet output (log-prob) times supervision_.weight times
@@ -134,8 +136,14 @@ class DiscriminativeComputation {
   // This will be used in the cross-entropy regularization code.
   CuMatrixBase<BaseFloat> *xent_output_deriv_;
 
-  // Denominator lattice.
-  Lattice den_lat_;
+  // Used if no DiscriminativeComputationPrep was given to the constructor.
+  DiscriminativeComputationPrep own_prep_;
+  // The prepared lattice and indexes: either own_prep_ or the one given to
+  // the constructor.
+  DiscriminativeComputationPrep *prep_;
+
+  // Denominator lattice; refers to prep_->den_lat.
+  Lattice &den_lat_;
 
   // List of silence phones. Useful to treat silence phones
   // differently in computing SMBR / MPFE objectives.
@@ -144,11 +152,10 @@ class DiscriminativeComputation {
   // The function that actually computes the objective and gradients
   double ComputeObjfAndDeriv(Posterior *post, Posterior *xent_post);
 
-  // This function looks up the nnet output the pdf-ids in the
-  // denominator lattice and the alignment in the case of "mmi" objective
-  // using the CuMatrix::Lookup() and stores them in "answers"
-  void LookupNnetOutput(std::vector<Int32Pair> *requested_indexes,
-                        std::vector<BaseFloat> *answers) const ;
+  // This function looks up the nnet output for prep_->requested_indexes (the
+  // pdf-ids in the denominator lattice and, for the "mmi" objective, the
+  // alignment) using CuMatrix::Lookup() and stores them in "answers"
+  void LookupNnetOutput(std::vector<BaseFloat> *answers) const;
 
   // Converts the answers looked up by LookupNnetOutput function into
   // log-likelihoods scaled by acoustic scale.
@@ -186,15 +193,18 @@ DiscriminativeComputation::DiscriminativeComputation(
                             const CuMatrixBase<BaseFloat> &nnet_output,
                             DiscriminativeObjectiveInfo *stats,
                             CuMatrixBase<BaseFloat> *nnet_output_deriv,
-                            CuMatrixBase<BaseFloat> *xent_output_deriv)
+                            CuMatrixBase<BaseFloat> *xent_output_deriv,
+                            DiscriminativeComputationPrep *prep)
   : opts_(opts), tmodel_(tmodel), log_priors_(log_priors),
   supervision_(supervision), nnet_output_(nnet_output),
   stats_(stats),
   nnet_output_deriv_(nnet_output_deriv),
-  xent_output_deriv_(xent_output_deriv) {
+  xent_output_deriv_(xent_output_deriv),
+  prep_(prep != NULL ? prep : &own_prep_),
+  den_lat_(prep_->den_lat) {
 
-  den_lat_ = supervision.den_lat;
-  TopSort(&den_lat_);
+  if (prep == NULL)
+    PrepareDiscriminativeComputation(opts, tmodel, supervision, &own_prep_);
 
   if (!SplitStringToIntegers(opts_.silence_phones_str, ":", false,
                              &silence_phones_)) {
@@ -203,58 +213,96 @@ DiscriminativeComputation::DiscriminativeComputation(
   }
 }
 
-void DiscriminativeComputation::LookupNnetOutput(
-    std::vector<Int32Pair> *requested_indexes,
-    std::vector<BaseFloat> *answers) const {
+static inline Int32Pair MakeInt32Pair(int32 first, int32 second) {
+  Int32Pair ans;
+  ans.first = first;
+  ans.second = second;
+  return ans;
+}
+
+void PrepareDiscriminativeComputation(
+    const DiscriminativeOptions &opts,
+    const TransitionModel &tmodel,
+    const DiscriminativeSupervision &supervision,
+    DiscriminativeComputationPrep *prep) {
+  typedef Lattice::Arc Arc;
+  typedef Arc::StateId StateId;
+
+  Lattice &den_lat = prep->den_lat;
+  den_lat = supervision.den_lat;
+  TopSort(&den_lat);
+
+  if (opts.criterion == "mmi" && opts.boost != 0.0) {
+    std::vector<int32> silence_phones;
+    if (!SplitStringToIntegers(opts.silence_phones_str, ":", false,
+                               &silence_phones)) {
+      KALDI_ERR << "Bad value for --silence-phones option: "
+                << opts.silence_phones_str;
+    }
+    BaseFloat max_silence_error = 0.0;
+    // This only changes the graph part of the weights, so the arcs, and the
+    // indexes below, are the same as without boosting.
+    LatticeBoost(tmodel, supervision.num_ali, silence_phones,
+                 opts.boost, max_silence_error, &den_lat);
+  }
+
   BaseFloat wiggle_room = 1.3; // value not critical.. it's just 'reserve'
 
-  int32 num_frames = supervision_.frames_per_sequence * supervision_.num_sequences;
-  int32 num_pdfs = tmodel_.NumPdfs();
+  int32 num_frames = supervision.frames_per_sequence * supervision.num_sequences;
+  int32 num_pdfs = tmodel.NumPdfs();
 
-  int32 num_reserve = wiggle_room * den_lat_.NumStates();
+  int32 num_reserve = wiggle_room * den_lat.NumStates();
 
-  if (opts_.criterion == "mmi") {
+  if (opts.criterion == "mmi") {
     // For looking up the posteriors corresponding to the pdfs in the alignment
     num_reserve += num_frames;
   }
 
+  std::vector<Int32Pair> *requested_indexes = &(prep->requested_indexes);
+  requested_indexes->clear();
   requested_indexes->reserve(num_reserve);
 
   // Denominator probabilities to look up from denominator lattice
   std::vector<int32> state_times;
-  int32 T = LatticeStateTimes(den_lat_, &state_times);
+  int32 T = LatticeStateTimes(den_lat, &state_times);
   KALDI_ASSERT(T == num_frames);
 
-  StateId num_states = den_lat_.NumStates();
+  StateId num_states = den_lat.NumStates();
   for (StateId s = 0; s < num_states; s++) {
     int32 t = state_times[s];
-    int32 seq = t / supervision_.frames_per_sequence,
-          idx = t % supervision_.frames_per_sequence;
+    int32 seq = t / supervision.frames_per_sequence,
+          idx = t % supervision.frames_per_sequence;
 
-    for (fst::ArcIterator<Lattice> aiter(den_lat_, s); !aiter.Done(); aiter.Next()) {
+    for (fst::ArcIterator<Lattice> aiter(den_lat, s); !aiter.Done(); aiter.Next()) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel != 0) { // input-side has transition-ids, output-side empty
-        int32 tid = arc.ilabel, pdf_id = tmodel_.TransitionIdToPdf(tid);
+        int32 tid = arc.ilabel, pdf_id = tmodel.TransitionIdToPdf(tid);
         // The ordering of the indexes is similar to that in chain models
-        requested_indexes->push_back(MakePair(idx * supervision_.num_sequences + seq, pdf_id));
+        requested_indexes->push_back(
+            MakeInt32Pair(idx * supervision.num_sequences + seq, pdf_id));
       }
     }
   }
 
-  if (opts_.criterion == "mmi") {
+  if (opts.criterion == "mmi") {
     // Numerator probabilities to look up from alignment
     for (int32 t = 0; t < num_frames; t++) {
-      int32 seq = t / supervision_.frames_per_sequence,
-            idx = t % supervision_.frames_per_sequence;
-      int32 tid = supervision_.num_ali[t],
-                  pdf_id = tmodel_.TransitionIdToPdf(tid);
+      int32 seq = t / supervision.frames_per_sequence,
+            idx = t % supervision.frames_per_sequence;
+      int32 tid = supervision.num_ali[t],
+                  pdf_id = tmodel.TransitionIdToPdf(tid);
       KALDI_ASSERT(pdf_id >= 0 && pdf_id < num_pdfs);
-      requested_indexes->push_back(MakePair(idx * supervision_.num_sequences + seq, pdf_id));
+      requested_indexes->push_back(
+          MakeInt32Pair(idx * supervision.num_sequences + seq, pdf_id));
     }
   }
+}
 
-  CuArray<Int32Pair> cu_requested_indexes(*requested_indexes);
-  answers->resize(requested_indexes->size());
+void DiscriminativeComputation::LookupNnetOutput(
+    std::vector<BaseFloat> *answers) const {
+  const std::vector<Int32Pair> &requested_indexes = prep_->requested_indexes;
+  CuArray<Int32Pair> cu_requested_indexes(requested_indexes);
+  answers->resize(requested_indexes.size());
   nnet_output_.Lookup(cu_requested_indexes, &((*answers)[0]));
   // requested_indexes now contain (t, j) pair and answers contains the
   // neural network output, which is log p(j|x(t)) for CE models
@@ -351,12 +399,8 @@ void DiscriminativeComputation::ProcessPosteriors(
 }
 
 void DiscriminativeComputation::Compute() {
-  if (opts_.criterion == "mmi" && opts_.boost != 0.0) {
-    BaseFloat max_silence_error = 0.0;
-    LatticeBoost(tmodel_, supervision_.num_ali, silence_phones_,
-                 opts_.boost, max_silence_error, &den_lat_);
-  }
-
+  // Note: for boosted MMI, the lattice was boosted by
+  // PrepareDiscriminativeComputation().
   int32 num_frames = supervision_.frames_per_sequence * supervision_.num_sequences;
 
   int32 num_pdfs = nnet_output_.NumCols();
@@ -368,11 +412,10 @@ void DiscriminativeComputation::Compute() {
   // communication over PciExpress, we look them up all at once using
   // CuMatrix::Lookup().
   std::vector<BaseFloat> answers;
-  std::vector<Int32Pair> requested_indexes;
 
-  LookupNnetOutput(&requested_indexes, &answers);
+  LookupNnetOutput(&answers);
 
-  ConvertAnswersToLogLike(requested_indexes, &answers);
+  ConvertAnswersToLogLike(prep_->requested_indexes, &answers);
 
   size_t index = 0;
 
@@ -530,6 +573,20 @@ double DiscriminativeComputation::ComputeObjfAndDeriv(Posterior *post,
     return ans;
   } else if (opts_.criterion == "mmi") {
     bool convert_to_pdfs = true, cancel = true;
+#if HAVE_CUDA == 1
+    if (CuDevice::Instantiate().Enabled()) {
+      // Do the forward-backward on the GPU; the result is the same as from
+      // LatticeForwardBackwardMmi().
+      BatchedLatticePosteriors batch;
+      batch.AddLattice(den_lat_);
+      batch.Compute();
+      Posterior den_post;
+      batch.GetPosterior(0, &den_post);
+      ComputeMmiPosteriors(tmodel_, supervision_.num_ali, opts_.drop_frames,
+                           convert_to_pdfs, cancel, &den_post, post);
+      return batch.TotalLogLike(0);
+    }
+#endif
     // we'll return the denominator-lattice forward backward likelihood,
     // which is one term in the objective function.
     return (LatticeForwardBackwardMmi(tmodel_, den_lat_, supervision_.num_ali,
@@ -550,10 +607,12 @@ void ComputeDiscriminativeObjfAndDeriv(const DiscriminativeOptions &opts,
                                        const CuMatrixBase<BaseFloat> &nnet_output,
                                        DiscriminativeObjectiveInfo *stats,
                                        CuMatrixBase<BaseFloat> *nnet_output_deriv,
-                                       CuMatrixBase<BaseFloat> *xent_output_deriv) {
+                                       CuMatrixBase<BaseFloat> *xent_output_deriv,
+                                       DiscriminativeComputationPrep *prep) {
   DiscriminativeComputation computation(opts, tmodel, log_priors, supervision,
                                         nnet_output, stats,
-                                        nnet_output_deriv, xent_output_deriv);
+                                        nnet_output_deriv, xent_output_deriv,
+                                        prep);
   computation.Compute();
 }
 
@@ -211,6 +211,32 @@ struct DiscriminativeObjectiveInfo {
   void Configure(const DiscriminativeOptions &opts);
 };
 
+/**
+   The part of the work of ComputeDiscriminativeObjfAndDeriv() that does not
+   depend on the neural net output: copying and topologically sorting the
+   denominator lattice, boosting it for boosted MMI, and working out which
+   elements of the nnet output will be needed.  Training programs can do this
+   for the next minibatch while the current one is being computed (see
+   NnetDiscriminativeTrainer::Prefetch()).
+*/
+struct DiscriminativeComputationPrep {
+  // The denominator lattice, topologically sorted (and boosted, for boosted
+  // MMI).
+  Lattice den_lat;
+  // The (row, pdf-id) elements of the nnet output to look up: one for each
+  // arc of den_lat with a nonzero ilabel, in order, then for "mmi" one for
+  // each frame of the numerator alignment.
+  std::vector<Int32Pair> requested_indexes;
+};
+
+/// Does the preparation described above.  It is thread-safe, and only reads
+/// 'tmodel' and 'supervision'.
+void PrepareDiscriminativeComputation(
+    const DiscriminativeOptions &opts,
+    const TransitionModel &tmodel,
+    const DiscriminativeSupervision &supervision,
+    DiscriminativeComputationPrep *prep);
+
 /**
    This function does forward-backward on the numerator and denominator 
    lattices and computes derivates wrt to the output for the specified 
@@ -232,6 +258,10 @@ struct DiscriminativeObjectiveInfo {
                            (which equals a posterior from the numerator forward-backward,
                            scaled by the supervision weight) is written to here.  This will
                            be used in the cross-entropy regularization code.  
+   @param [in,out] prep     If non-NULL, the output of
+                            PrepareDiscriminativeComputation() for 'supervision'
+                            and these options; it is used up (its lattice is
+                            modified).  If NULL, the preparation is done here.
 */
 void ComputeDiscriminativeObjfAndDeriv(
     const DiscriminativeOptions &opts,
@@ -241,7 +271,8 @@ void ComputeDiscriminativeObjfAndDeriv(
     const CuMatrixBase<BaseFloat> &nnet_output,
     DiscriminativeObjectiveInfo *stats,
     CuMatrixBase<BaseFloat> *nnet_output_deriv,
-    CuMatrixBase<BaseFloat> *xent_output_deriv);
+    CuMatrixBase<BaseFloat> *xent_output_deriv,
+    DiscriminativeComputationPrep *prep = NULL);
 
 }  // namespace discriminative
 }  // namespace kaldi
@@ -18,6 +18,7 @@
 // limitations under the License.
 
 #include "nnet3/natural-gradient-online.h"
+#include "cudamatrix/cu-math.h"
 #include "nnet3/nnet-parse.h"
 
 namespace kaldi {
@@ -369,13 +370,10 @@ void OnlineNaturalGradient::PreconditionDirectionsInternal(
     L_t.SymAddMat2(1.0, H_t, kTrans, 0.0);
   }
 
-  Matrix<BaseFloat> LK_cpu(LK_t);  // contains L and K on the CPU.
-  SubMatrix<BaseFloat> L_t_cpu(LK_cpu, 0, R, 0, R),
-      K_t_cpu(LK_cpu, R, R, 0, R);
   if (!compute_lk_together) {
     // the SymAddMat2 operations only set the lower triangle and diagonal.
-    L_t_cpu.CopyLowerToUpper();
-    K_t_cpu.CopyLowerToUpper();
+    L_t.CopyLowerToUpper();
+    K_t.CopyLowerToUpper();
   }
 
   // beta_t = \rho_t(1+\alpha) + \alpha/D tr(D_t)
@@ -384,20 +382,12 @@ void OnlineNaturalGradient::PreconditionDirectionsInternal(
   ComputeEt(d_t, beta_t, &e_t, &sqrt_e_t, &inv_sqrt_e_t);
   KALDI_VLOG(5) << "e_t = " << e_t;
 
-  // The double-precision Z_t here, and the scaling, is to avoid potential
-  // overflow, because Z_t is proportional to the fourth power of data.
-  SpMatrix<double> Z_t_double(R);
-  ComputeZt(N, rho_t, d_t, inv_sqrt_e_t, K_t_cpu, L_t_cpu, &Z_t_double);
-  BaseFloat z_t_scale = std::max<double>(1.0, Z_t_double.Trace());
-  Z_t_double.Scale(1.0 / z_t_scale);
-  SpMatrix<BaseFloat> Z_t_scaled(Z_t_double);
-
-  Matrix<BaseFloat> U_t(R, R);
-  Vector<BaseFloat> c_t(R);
   // do the symmetric eigenvalue decomposition Z_t = U_t C_t U_t^T.
-  Z_t_scaled.Eig(&c_t, &U_t);
+  Matrix<double> U_t_c_t(R + 1, R, kUndefined);
+  ComputeZtEig(N, rho_t, d_t, inv_sqrt_e_t, K_t, L_t, &U_t_c_t);
+  Matrix<BaseFloat> U_t(U_t_c_t.RowRange(0, R), kTrans);
+  Vector<BaseFloat> c_t(U_t_c_t.Row(R));
   SortSvd(&c_t, &U_t);
-  c_t.Scale(z_t_scale);
 
   const BaseFloat condition_threshold = 1.0e+06;
   // must_reorthogonalize will be true if the last diagonal element of c_t is
@@ -503,15 +493,16 @@ void OnlineNaturalGradient::ComputeWt1(int32 N,
   Vector<BaseFloat> inv_sqrt_c_t(sqrt_c_t);
   inv_sqrt_c_t.InvertElements();
 
-  Vector<BaseFloat> w_t_coeff(R);
+  // A_t and the coefficients of W_t below are copied to the GPU together, as
+  // the rows of one matrix, to save a host-to-device transfer.
+  Matrix<BaseFloat> A_t_w_t_coeff(R + 1, R, kUndefined);
+  SubMatrix<BaseFloat> A_t(A_t_w_t_coeff, 0, R, 0, R);
+  SubVector<BaseFloat> w_t_coeff(A_t_w_t_coeff, R);
   for (int32 i = 0; i < R; i++)
     w_t_coeff(i) = (1.0 - eta) / (eta/N) * (d_t(i) + rho_t);
-  CuVector<BaseFloat> w_t_coeff_gpu(w_t_coeff);
-  // B_t = J_t + (1-\eta)/(\eta/N) (D_t + \rho_t I) W_t
-  J_t->AddDiagVecMat(1.0, w_t_coeff_gpu, W_t, kNoTrans, 1.0);
 
   // A_t = (\eta/N) E_{t+1}^{0.5} C_t^{-0.5} U_t^T E_t^{-0.5}
-  Matrix<BaseFloat> A_t(U_t, kTrans);
+  A_t.CopyFromMat(U_t, kTrans);
   for (int32 i = 0; i < R; i++) {
     BaseFloat i_factor = (eta / N) * sqrt_e_t1(i) * inv_sqrt_c_t(i);
     for (int32 j = 0; j < R; j++) {
@@ -519,40 +510,61 @@ void OnlineNaturalGradient::ComputeWt1(int32 N,
       A_t(i, j) *= i_factor * j_factor;
     }
   }
+  CuMatrix<BaseFloat> A_t_w_t_coeff_gpu(A_t_w_t_coeff);
+  // B_t = J_t + (1-\eta)/(\eta/N) (D_t + \rho_t I) W_t
+  J_t->AddDiagVecMat(1.0, A_t_w_t_coeff_gpu.Row(R), W_t, kNoTrans, 1.0);
   // W_{t+1} = A_t B_t
-  CuMatrix<BaseFloat> A_t_gpu(A_t);
-  W_t1->AddMatMat(1.0, A_t_gpu, kNoTrans, *J_t, kNoTrans, 0.0);
+  W_t1->AddMatMat(1.0, A_t_w_t_coeff_gpu.RowRange(0, R), kNoTrans, *J_t,
+                  kNoTrans, 0.0);
 }
 
-void OnlineNaturalGradient::ComputeZt(int32 N,
-                                     BaseFloat rho_t,
-                                     const VectorBase<BaseFloat> &d_t,
-                                     const VectorBase<BaseFloat> &inv_sqrt_e_t,
-                                     const MatrixBase<BaseFloat> &K_t,
-                                     const MatrixBase<BaseFloat> &L_t,
-                                     SpMatrix<double> *Z_t) const {
+void OnlineNaturalGradient::ComputeZtEig(
+    int32 N,
+    BaseFloat rho_t,
+    const VectorBase<BaseFloat> &d_t,
+    const VectorBase<BaseFloat> &inv_sqrt_e_t,
+    const CuMatrixBase<BaseFloat> &K_t,
+    const CuMatrixBase<BaseFloat> &L_t,
+    MatrixBase<double> *U_t_c_t) const {
   // Use doubles because the range of quantities in Z_t can get large (fourth
-  // power of data), and we want to avoid overflow.  This routine is fast.
+  // power of data), and we want to avoid overflow.
   BaseFloat eta = Eta(N);
-  Vector<BaseFloat> d_t_rho_t(d_t);
-  d_t_rho_t.Add(rho_t);  // now d_t_rho_t is diag(D_t + \rho_t I).
-  double etaN = eta / N, eta1 = 1.0 - eta,
-      etaN_sq = etaN * etaN, eta1_sq = eta1 * eta1,
-      etaN_eta1 = etaN * eta1;
+  double etaN = eta / N, eta1 = 1.0 - eta;
   int32 R = d_t.Dim();
-  for (int32 i = 0; i < R; i++) {
-    double inv_sqrt_e_t_i = inv_sqrt_e_t(i), d_t_rho_t_i = d_t_rho_t(i);
-    for (int32 j = 0; j <= i; j++) {
-      double inv_sqrt_e_t_j = inv_sqrt_e_t(j), d_t_rho_t_j = d_t_rho_t(j),
-          L_t_i_j = 0.5 * (L_t(i, j) + L_t(j, i)),
-          K_t_i_j = 0.5 * (K_t(i, j) + K_t(j, i));
-      // See (eqn:Zt) in header.
-      (*Z_t)(i, j) = etaN_sq * inv_sqrt_e_t_i * K_t_i_j * inv_sqrt_e_t_j
-          + etaN_eta1 * inv_sqrt_e_t_i * L_t_i_j * inv_sqrt_e_t_j * d_t_rho_t_j
-          + etaN_eta1 * d_t_rho_t_i * inv_sqrt_e_t_i * L_t_i_j * inv_sqrt_e_t_j
-          + (i == j ? eta1_sq * d_t_rho_t_i * d_t_rho_t_i : 0.0);
-    }
-  }
+  // The vectors we need are copied to the GPU together: row 0 is
+  // diag(E_t^{-0.5}), row 1 is diag(D_t + \rho_t I) and row 2 is
+  // diag((1-\eta)^2 (D_t + \rho_t I)^2).
+  Matrix<double> vecs(3, R, kUndefined);
+  vecs.Row(0).CopyFromVec(inv_sqrt_e_t);
+  vecs.Row(1).CopyFromVec(d_t);
+  vecs.Row(1).Add(rho_t);
+  vecs.Row(2).CopyFromVec(vecs.Row(1));
+  vecs.Row(2).ApplyPow(2.0);
+  vecs.Row(2).Scale(eta1 * eta1);
+  CuMatrix<double> vecs_gpu(vecs);
+
+  CuMatrix<double> U_t_c_t_gpu(R + 1, R);
+  CuSubMatrix<double> Z_t(U_t_c_t_gpu, 0, R, 0, R),
+      c_t(U_t_c_t_gpu, R, 1, 0, R);
+  // See (eqn:Zt) in header.  First, Z_t = (\eta/N)^2 K_t
+  //    + (\eta/N)(1-\eta) (L_t (D_t + \rho_t I) + (D_t + \rho_t I) L_t).
+  CuMatrix<double> L_t_d_t(L_t);
+  L_t_d_t.MulColsVec(vecs_gpu.Row(1));
+  Z_t.CopyFromMat(K_t);
+  Z_t.Scale(etaN * etaN);
+  Z_t.AddMat(etaN * eta1, L_t_d_t);
+  Z_t.AddMat(etaN * eta1, L_t_d_t, kTrans);
+  // Z_t := E_t^{-0.5} Z_t E_t^{-0.5}.
+  Z_t.MulRowsVec(vecs_gpu.Row(0));
+  Z_t.MulColsVec(vecs_gpu.Row(0));
+  // Z_t += (1-\eta)^2 (D_t + \rho_t I)^2.
+  CuMatrix<double> diag(R, R);
+  diag.AddToDiag(1.0);
+  diag.MulColsVec(vecs_gpu.Row(2));
+  Z_t.AddMat(1.0, diag);
+
+  cu::SymEigBatched(&Z_t, &c_t);
+  U_t_c_t_gpu.CopyToMat(U_t_c_t);
 }
 
 void OnlineNaturalGradient::ComputeEt(const VectorBase<BaseFloat> &d_t,
@@ -245,9 +245,11 @@ namespace nnet3 {
            +(\eta/N)(1-\eta) E_t^{-0.5} L_t E_t^{-0.5} (D_t + \rho_t I)
            +(\eta/N)(1-\eta) (D_t + \rho_t I) E_t^{-0.5} L_t E_t^{-0.5}
            +(1-\eta)^2 (D_t + \rho_t I)^2                              (eqn:Zt)
-  We compute Z_t on the CPU using the expression above, and then do the symmetric
-  eigenvalue decomposition (also on the CPU):
+  We compute Z_t on the GPU (in double precision) using the expression above,
+  and then do the symmetric eigenvalue decomposition (also on the GPU, see
+  cu::SymEigBatched()):
       Z_t = U_t C_t U_t^T.
+  Only U_t and C_t, which are R x R, are copied back to the CPU.
   and we make sure the eigenvalues are sorted from largest to smallest, for
   reasons that will be mentioned later.
 
@@ -492,13 +494,17 @@ class OnlineNaturalGradient {
                  VectorBase<BaseFloat> *sqrt_e_t,
                  VectorBase<BaseFloat> *inv_sqrt_e_t) const;
 
-  void ComputeZt(int32 N,
-                 BaseFloat rho_t,
-                 const VectorBase<BaseFloat> &d_t,
-                 const VectorBase<BaseFloat> &inv_sqrt_e_t,
-                 const MatrixBase<BaseFloat> &K_t,
-                 const MatrixBase<BaseFloat> &L_t,
-                 SpMatrix<double> *Z_t) const;
+  // Computes Z_t (see (eqn:Zt)) and its eigenvalue decomposition
+  // Z_t = U_t C_t U_t^T.  Outputs U_t^T to the first R rows of U_t_c_t and the
+  // diagonal of C_t, in increasing order, to its last row.  K_t and L_t must
+  // be symmetric.
+  void ComputeZtEig(int32 N,
+                    BaseFloat rho_t,
+                    const VectorBase<BaseFloat> &d_t,
+                    const VectorBase<BaseFloat> &inv_sqrt_e_t,
+                    const CuMatrixBase<BaseFloat> &K_t,
+                    const CuMatrixBase<BaseFloat> &L_t,
+                    MatrixBase<double> *U_t_c_t) const;
   // Computes W_{t+1}.  Overwrites J_t.
   void ComputeWt1(int32 N,
                   const VectorBase<BaseFloat> &d_t,
@@ -18,6 +18,7 @@
 // limitations under the License.
 
 #include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-simple-component.h"
 #include "nnet3/nnet-utils.h"
 
 namespace kaldi {
@@ -41,7 +42,8 @@ DecodableNnetSimple::DecodableNnetSimple(
     ivector_(ivector), online_ivector_feats_(online_ivectors),
     online_ivector_period_(online_ivector_period),
     compiler_(*compiler),
-    current_log_post_subsampled_offset_(0) {
+    current_log_post_subsampled_offset_(0),
+    next_log_post_subsampled_offset_(-1) {
   num_subsampled_frames_ =
       (feats_.NumRows() + opts_.frame_subsampling_factor - 1) /
       opts_.frame_subsampling_factor;
@@ -54,6 +56,11 @@ DecodableNnetSimple::DecodableNnetSimple(
   CheckAndFixConfigs();
 }
 
+DecodableNnetSimple::~DecodableNnetSimple() {
+  if (next_chunk_thread_.joinable())
+    next_chunk_thread_.join();
+}
+
 
 DecodableAmNnetSimple::DecodableAmNnetSimple(
     const NnetSimpleComputationOptions &opts,
@@ -111,11 +118,47 @@ void DecodableNnetSimple::EnsureFrameIsComputed(int32 subsampled_frame) {
                subsampled_frame >= current_subsampled_offset +
                current_subsampled_frames_computed);
 
+  bool have_next_chunk = false;
+  if (next_chunk_thread_.joinable()) {
+    next_chunk_thread_.join();
+    if (next_chunk_error_) {
+      std::exception_ptr error = next_chunk_error_;
+      next_chunk_error_ = NULL;
+      std::rethrow_exception(error);
+    }
+    // The decoders go through the frames in order, so this is normally true.
+    have_next_chunk = (subsampled_frame == next_log_post_subsampled_offset_);
+  }
+  if (have_next_chunk) {
+    current_log_post_.Swap(&next_log_post_);
+  } else {
+    ComputeChunk(subsampled_frame, &current_log_post_);
+  }
+  current_log_post_subsampled_offset_ = subsampled_frame;
+  next_log_post_.Resize(0, 0);
+
+  int32 next_subsampled_frame = subsampled_frame + current_log_post_.NumRows();
+  if (opts_.compute_ahead && next_subsampled_frame < num_subsampled_frames_) {
+    next_log_post_subsampled_offset_ = next_subsampled_frame;
+    next_chunk_thread_ = std::thread(&DecodableNnetSimple::ComputeNextChunk,
+                                     this, next_subsampled_frame);
+  }
+}
+
+void DecodableNnetSimple::ComputeNextChunk(int32 start_subsampled_frame) {
+  try {
+    ComputeChunk(start_subsampled_frame, &next_log_post_);
+  } catch (...) {
+    next_chunk_error_ = std::current_exception();
+  }
+}
+
+void DecodableNnetSimple::ComputeChunk(int32 start_subsampled_frame,
+                                       Matrix<BaseFloat> *log_post) {
   // all subsampled frames pertain to the output of the network,
   // they are output frames divided by opts_.frame_subsampling_factor.
   int32 subsampling_factor = opts_.frame_subsampling_factor,
       subsampled_frames_per_chunk = opts_.frames_per_chunk / subsampling_factor,
-      start_subsampled_frame = subsampled_frame,
       num_subsampled_frames = std::min<int32>(num_subsampled_frames_ -
                                               start_subsampled_frame,
                                               subsampled_frames_per_chunk),
@@ -149,7 +192,7 @@ void DecodableNnetSimple::EnsureFrameIsComputed(int32 subsampled_frame) {
     SubMatrix<BaseFloat> input_feats(feats_.RowRange(first_input_frame,
                                                      num_input_frames));
     DoNnetComputation(first_input_frame, input_feats, ivector,
-                      first_output_frame, num_subsampled_frames);
+                      first_output_frame, num_subsampled_frames, log_post);
   } else {
     Matrix<BaseFloat> feats_block(num_input_frames, feats_.NumCols());
     int32 tot_input_feats = feats_.NumRows();
@@ -162,7 +205,7 @@ void DecodableNnetSimple::EnsureFrameIsComputed(int32 subsampled_frame) {
       dest.CopyFromVec(src);
     }
     DoNnetComputation(first_input_frame, feats_block, ivector,
-                      first_output_frame, num_subsampled_frames);
+                      first_output_frame, num_subsampled_frames, log_post);
   }
 }
 
@@ -217,7 +260,8 @@ void DecodableNnetSimple::DoNnetComputation(
     const MatrixBase<BaseFloat> &input_feats,
     const VectorBase<BaseFloat> &ivector,
     int32 output_t_start,
-    int32 num_subsampled_frames) {
+    int32 num_subsampled_frames,
+    Matrix<BaseFloat> *log_post) {
   ComputationRequest request;
   request.need_model_derivative = false;
   request.store_component_stats = false;
@@ -269,10 +313,9 @@ void DecodableNnetSimple::DoNnetComputation(
     cu_output.AddVecToRows(-1.0, log_priors_);
   // apply the acoustic scale
   cu_output.Scale(opts_.acoustic_scale);
-  current_log_post_.Resize(0, 0);
+  log_post->Resize(0, 0);
   // the following statement just swaps the pointers if we're not using a GPU.
-  cu_output.Swap(&current_log_post_);
-  current_log_post_subsampled_offset_ = output_t_start / subsample;
+  cu_output.Swap(log_post);
 }
 
 void DecodableNnetSimple::CheckAndFixConfigs() {
@@ -362,5 +405,98 @@ BaseFloat DecodableAmNnetSimpleParallel::LogLikelihood(int32 frame,
 }
 
 
+// If the descriptor of node 'node_index' (an output node or the input of a
+// component node) just forwards the output of another node, returns the index
+// of that node, else returns -1.
+static int32 ForwardedNode(const Nnet &nnet, int32 node_index) {
+  std::ostringstream os;
+  nnet.GetNode(node_index).descriptor.WriteConfig(os, nnet.GetNodeNames());
+  return nnet.GetNodeIndex(os.str());
+}
+
+DecodableNnetSparseOutputInfo::DecodableNnetSparseOutputInfo(
+    const NnetSimpleComputationOptions &opts_in,
+    const AmNnetSimple &am_nnet):
+    opts(opts_in), acoustic_scale(opts_in.acoustic_scale),
+    hidden_nnet(am_nnet.GetNnet()) {
+  opts.acoustic_scale = 1.0;
+  const Nnet &nnet = am_nnet.GetNnet();
+  int32 output_node = nnet.GetNodeIndex("output");
+  KALDI_ASSERT(output_node != -1 && nnet.IsOutputNode(output_node));
+  int32 node = ForwardedNode(nnet, output_node);
+  const Component *component = NULL;
+  if (node != -1 && nnet.IsComponentNode(node)) {
+    component = nnet.GetComponent(nnet.GetNode(node).u.component_index);
+    if (dynamic_cast<const LogSoftmaxComponent*>(component) != NULL) {
+      node = ForwardedNode(nnet, node - 1);
+      component = (node != -1 && nnet.IsComponentNode(node) ?
+                   nnet.GetComponent(nnet.GetNode(node).u.component_index) :
+                   NULL);
+    }
+  }
+  const AffineComponent *affine =
+      dynamic_cast<const AffineComponent*>(component);
+  if (affine == NULL)
+    KALDI_ERR << "Computing only the needed outputs requires the network to "
+              << "end in an affine layer, optionally followed by a "
+              << "log-softmax.";
+
+  // The input of the affine layer becomes the output of the network.  The
+  // node indexes of hidden_nnet are still the same as those of nnet.
+  hidden_nnet.GetNode(output_node).descriptor =
+      nnet.GetNode(node - 1).descriptor;
+  hidden_nnet.RemoveOrphanNodes();
+  hidden_nnet.RemoveOrphanComponents();
+
+  linear_params.Resize(affine->OutputDim(), affine->InputDim(), kUndefined);
+  affine->LinearParams().CopyToMat(&linear_params);
+  bias_params.Resize(affine->OutputDim(), kUndefined);
+  affine->BiasParams().CopyToVec(&bias_params);
+  if (am_nnet.Priors().Dim() != 0) {
+    KALDI_ASSERT(am_nnet.Priors().Dim() == bias_params.Dim());
+    Vector<BaseFloat> log_priors(am_nnet.Priors());
+    log_priors.ApplyLog();
+    bias_params.AddVec(-1.0, log_priors);
+  }
+  compiler.reset(new CachingOptimizingCompiler(hidden_nnet,
+                                               opts.optimize_config,
+                                               opts.compiler_config));
+}
+
+DecodableAmNnetSparseOutput::DecodableAmNnetSparseOutput(
+    const DecodableNnetSparseOutputInfo &info,
+    const TransitionModel &trans_model,
+    const MatrixBase<BaseFloat> &feats,
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period):
+    info_(info), trans_model_(trans_model),
+    decodable_nnet_(info.opts, info.hidden_nnet, Vector<BaseFloat>(), feats,
+                    info.compiler.get(), ivector, online_ivectors,
+                    online_ivector_period),
+    current_frame_(-1),
+    hidden_(decodable_nnet_.OutputDim()),
+    log_likes_(info.bias_params.Dim()),
+    log_like_frame_(info.bias_params.Dim(), -1) {
+  KALDI_ASSERT(hidden_.Dim() == info.linear_params.NumCols());
+}
+
+BaseFloat DecodableAmNnetSparseOutput::LogLikelihood(int32 frame,
+                                                     int32 transition_id) {
+  if (frame != current_frame_) {
+    decodable_nnet_.GetOutputForFrame(frame, &hidden_);
+    current_frame_ = frame;
+  }
+  int32 pdf_id = trans_model_.TransitionIdToPdfFast(transition_id);
+  if (log_like_frame_[pdf_id] != frame) {
+    log_likes_(pdf_id) = info_.acoustic_scale *
+        (VecVec(hidden_, info_.linear_params.Row(pdf_id)) +
+         info_.bias_params(pdf_id));
+    log_like_frame_[pdf_id] = frame;
+  }
+  return log_likes_(pdf_id);
+}
+
+
 } // namespace nnet3
 } // namespace kaldi
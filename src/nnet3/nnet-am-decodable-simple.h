@@ -20,6 +20,9 @@
 #ifndef KALDI_NNET3_NNET_AM_DECODABLE_SIMPLE_H_
 #define KALDI_NNET3_NNET_AM_DECODABLE_SIMPLE_H_
 
+#include <exception>
+#include <memory>
+#include <thread>
 #include <vector>
 #include "base/kaldi-common.h"
 #include "gmm/am-diag-gmm.h"
@@ -49,6 +52,7 @@ struct NnetSimpleComputationOptions {
   int32 frames_per_chunk;
   BaseFloat acoustic_scale;
   bool debug_computation;
+  bool compute_ahead;
   NnetOptimizeOptions optimize_config;
   NnetComputeOptions compute_config;
   CachingOptimizingCompilerOptions compiler_config;
@@ -61,7 +65,8 @@ struct NnetSimpleComputationOptions {
       frame_subsampling_factor(1),
       frames_per_chunk(50),
       acoustic_scale(0.1),
-      debug_computation(false) {
+      debug_computation(false),
+      compute_ahead(false) {
     compiler_config.cache_capacity += frames_per_chunk;
   }
 
@@ -94,6 +99,10 @@ struct NnetSimpleComputationOptions {
                    "input frames");
     opts->Register("debug-computation", &debug_computation, "If true, turn on "
                    "debug for the actual computation (very verbose!)");
+    opts->Register("compute-ahead", &compute_ahead, "If true, compute the "
+                   "next chunk of the neural net output in a background "
+                   "thread while the decoder is using the current one.  Only "
+                   "two chunks are ever held in memory.");
 
     // register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -102,6 +111,10 @@ struct NnetSimpleComputationOptions {
     // register the compute options with the prefix "computation".
     ParseOptions compute_opts("computation", opts);
     compute_config.Register(&compute_opts);
+
+    // register the compiler options with the prefix "compiler".
+    ParseOptions compiler_opts("compiler", opts);
+    compiler_config.Register(&compiler_opts);
   }
 };
 
@@ -154,6 +167,9 @@ class DecodableNnetSimple {
                       const MatrixBase<BaseFloat> *online_ivectors = NULL,
                       int32 online_ivector_period = 1);
 
+  // Waits for the background computation, if there is one (see the
+  // --compute-ahead option).
+  ~DecodableNnetSimple();
 
   // returns the number of frames of likelihoods.  The same as feats_.NumRows()
   // in the normal case (but may be less if opts_.frame_subsampling_factor !=
@@ -182,18 +198,30 @@ class DecodableNnetSimple {
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetSimple);
 
   // This call is made to ensure that we have the log-probs for this frame
-  // cached in current_log_post_.
+  // cached in current_log_post_.  If opts_.compute_ahead is true, it also
+  // starts the computation of the following chunk in next_chunk_thread_.
   void EnsureFrameIsComputed(int32 subsampled_frame);
 
+  // Computes the log-probs for the chunk starting at this frame, and puts them
+  // in 'log_post'.  Called from EnsureFrameIsComputed(), possibly in
+  // next_chunk_thread_; it does not change any members of this class.
+  void ComputeChunk(int32 start_subsampled_frame,
+                    Matrix<BaseFloat> *log_post);
+
+  // The function run by next_chunk_thread_: calls ComputeChunk() and puts the
+  // result in next_log_post_, or the exception in next_chunk_error_.
+  void ComputeNextChunk(int32 start_subsampled_frame);
+
   // This function does the actual nnet computation; it is called from
-  // EnsureFrameIsComputed.  Any padding at file start/end is done by
-  // the caller of this function (so the input should exceed the output
-  // by a suitable amount of context).  It puts its output in current_log_post_.
+  // ComputeChunk.  Any padding at file start/end is done by the caller of
+  // this function (so the input should exceed the output by a suitable amount
+  // of context).  It puts its output in 'log_post'.
   void DoNnetComputation(int32 input_t_start,
                          const MatrixBase<BaseFloat> &input_feats,
                          const VectorBase<BaseFloat> &ivector,
                          int32 output_t_start,
-                         int32 num_subsampled_frames);
+                         int32 num_subsampled_frames,
+                         Matrix<BaseFloat> *log_post);
 
   // Gets the iVector that will be used for this chunk of frames, if we are
   // using iVectors (else does nothing).  note: the num_output_frames is
@@ -244,6 +272,15 @@ class DecodableNnetSimple {
   // opts_.frame_subsampling_factor > 1, this will be measured in subsampled
   // frames.
   int32 current_log_post_subsampled_offset_;
+
+  // If opts_.compute_ahead is true, the thread computing the log-posteriors
+  // of the chunk after the current one, which starts at
+  // next_log_post_subsampled_offset_, into next_log_post_.  Those members
+  // must not be accessed while the thread is running.
+  std::thread next_chunk_thread_;
+  Matrix<BaseFloat> next_log_post_;
+  int32 next_log_post_subsampled_offset_;
+  std::exception_ptr next_chunk_error_;
 };
 
 class DecodableAmNnetSimple: public DecodableInterface {
@@ -392,6 +429,96 @@ class DecodableAmNnetSimpleParallel: public DecodableInterface {
 };
 
 
+/**
+   This class holds the parts of the model that DecodableAmNnetSparseOutput
+   needs; it is set up once and shared by the decodables of all the
+   utterances.  The network must end in an affine layer, optionally followed by
+   a log-softmax.  Those layers are removed from 'hidden_nnet', which computes
+   the input of the affine layer, and the affine layer's parameters are kept,
+   with the log-priors (if any) subtracted from the bias.
+*/
+class DecodableNnetSparseOutputInfo {
+ public:
+  DecodableNnetSparseOutputInfo(const NnetSimpleComputationOptions &opts,
+                                const AmNnetSimple &am_nnet);
+
+  // The options, except that opts.acoustic_scale is 1.0: the acoustic scale
+  // is applied by DecodableAmNnetSparseOutput, and is 'acoustic_scale'.
+  NnetSimpleComputationOptions opts;
+  BaseFloat acoustic_scale;
+
+  // The network up to the input of the final affine layer.
+  Nnet hidden_nnet;
+
+  // The parameters of the final affine layer, of dimension num-pdfs by
+  // hidden_nnet.OutputDim("output"), and num-pdfs.
+  Matrix<BaseFloat> linear_params;
+  Vector<BaseFloat> bias_params;
+
+  // The compiler for hidden_nnet.
+  std::unique_ptr<CachingOptimizingCompiler> compiler;
+
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetSparseOutputInfo);
+};
+
+/**
+   A decodable object that gives the same log-likelihoods as
+   DecodableAmNnetSimple, but computes the output layer only for the pdfs the
+   decoder asks for.  The decoders only ask for the pdfs of the arcs leaving
+   their active states, normally a small fraction of them, so this saves most
+   of the cost of the output layer (the rest of the network is computed in
+   chunks as in DecodableAmNnetSimple).  The log-likelihoods of the current
+   frame are cached; the decoders ask for the frames in order.
+
+   If the network ends in a log-softmax, its normalizer (which would need the
+   whole output layer) is not computed, so the log-likelihoods differ from
+   those of DecodableAmNnetSimple by a constant for each frame.  That does
+   not change the search or the pruning, or the posteriors in the lattices,
+   because each path has exactly one arc per frame; but the acoustic scores
+   in the lattices, and the total likelihoods, are different.
+*/
+class DecodableAmNnetSparseOutput: public DecodableInterface {
+ public:
+  /// See DecodableAmNnetSimple for the meaning of the arguments; 'info' must
+  /// outlive this object.
+  DecodableAmNnetSparseOutput(
+      const DecodableNnetSparseOutputInfo &info,
+      const TransitionModel &trans_model,
+      const MatrixBase<BaseFloat> &feats,
+      const VectorBase<BaseFloat> *ivector = NULL,
+      const MatrixBase<BaseFloat> *online_ivectors = NULL,
+      int32 online_ivector_period = 1);
+
+  virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
+
+  virtual inline int32 NumFramesReady() const {
+    return decodable_nnet_.NumFrames();
+  }
+
+  virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
+
+  virtual bool IsLastFrame(int32 frame) const {
+    KALDI_ASSERT(frame < NumFramesReady());
+    return (frame == NumFramesReady() - 1);
+  }
+
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmNnetSparseOutput);
+
+  const DecodableNnetSparseOutputInfo &info_;
+  const TransitionModel &trans_model_;
+  DecodableNnetSimple decodable_nnet_;
+
+  // The frame whose hidden-layer output is in 'hidden_', or -1.
+  int32 current_frame_;
+  Vector<BaseFloat> hidden_;
+  // log_likes_(p) is the log-likelihood of pdf p on frame log_like_frame_[p],
+  // which is -1 if it has not been computed.
+  Vector<BaseFloat> log_likes_;
+  std::vector<int32> log_like_frame_;
+};
+
 
 } // namespace nnet3
 } // namespace kaldi
@@ -1436,9 +1436,12 @@ void GetCommandsOfType(const NnetComputation &computation,
       command_indexes->push_back(c);
 }
 
-int64 GetMaxMemoryUse(const NnetComputation &computation) {
+int64 GetMaxMemoryUse(const NnetComputation &computation,
+                      int32 *max_memory_command) {
   int64 cur_memory_use = 0,
       max_memory_use = 0;
+  if (max_memory_command != NULL)
+    *max_memory_command = 0;
   int32 num_commands = computation.commands.size(),
       num_submatrices = computation.submatrices.size();
   // the vector 'num_compressed_bytes' is used to remember the number of bytes
@@ -1489,8 +1492,11 @@ int64 GetMaxMemoryUse(const NnetComputation &computation) {
         break;
     }
     KALDI_ASSERT(cur_memory_use >= 0);
-    if (cur_memory_use > max_memory_use)
+    if (cur_memory_use > max_memory_use) {
       max_memory_use = cur_memory_use;
+      if (max_memory_command != NULL)
+        *max_memory_command = command_index;
+    }
   }
   return max_memory_use;
 }
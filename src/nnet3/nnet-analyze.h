@@ -456,8 +456,10 @@ void CheckComputation(const Nnet &nnet,
 // Propagate() and Backprop() or other similar functions; it ignores precomputed
 // indexes and other things residing in the computation; and of course it
 // ignores things you might do with the output, such as the forward-backward
-// code for chain computation.
-int64 GetMaxMemoryUse(const NnetComputation &computation);
+// code for chain computation.  If 'max_memory_command' is non-NULL, it is set
+// to the index of the first command after which that maximum is reached.
+int64 GetMaxMemoryUse(const NnetComputation &computation,
+                      int32 *max_memory_command = NULL);
 
 
 } // namespace nnet3
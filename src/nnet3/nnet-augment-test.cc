@@ -0,0 +1,118 @@
+// nnet3/nnet-augment-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-augment.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Sets up indexes for 'num_sequences' sequences of 'num_frames' frames, in
+// either n-major or t-major order, and features in which row r has the value
+// 'r + 1' in every column, so we can tell where each row came from.
+static void GetTestInput(int32 num_sequences, int32 num_frames, int32 dim,
+                         bool t_major, std::vector<Index> *indexes,
+                         CuMatrix<BaseFloat> *features) {
+  indexes->clear();
+  if (t_major) {
+    for (int32 t = 0; t < num_frames; t++)
+      for (int32 n = 0; n < num_sequences; n++)
+        indexes->push_back(Index(n, t));
+  } else {
+    for (int32 n = 0; n < num_sequences; n++)
+      for (int32 t = 0; t < num_frames; t++)
+        indexes->push_back(Index(n, t));
+  }
+  Matrix<BaseFloat> mat(indexes->size(), dim);
+  for (int32 r = 0; r < mat.NumRows(); r++)
+    mat.Row(r).Set(r + 1);
+  features->Swap(&mat);
+}
+
+void UnitTestNnetInputAugmenter() {
+  int32 num_sequences = RandInt(1, 5), num_frames = RandInt(10, 50),
+      dim = RandInt(5, 40);
+  bool t_major = (RandInt(0, 1) == 0);
+  std::vector<Index> indexes;
+  CuMatrix<BaseFloat> features;
+  GetTestInput(num_sequences, num_frames, dim, t_major, &indexes, &features);
+  int32 num_rows = features.NumRows();
+
+  NnetAugmentOptions opts;
+  KALDI_ASSERT(!opts.Enabled());
+  opts.inputs = "input,input2";
+  opts.max_frame_shift = RandInt(0, 3);
+  opts.time_warp_max_frames = RandInt(0, 3);
+  opts.num_time_masks = RandInt(0, 2);
+  opts.time_mask_max_frames = RandInt(1, 5);
+  opts.num_freq_masks = RandInt(0, 2);
+  opts.freq_mask_max_bins = RandInt(1, 5);
+  NnetInputAugmenter augmenter(opts);
+  KALDI_ASSERT(augmenter.Augments("input2") == opts.Enabled() &&
+               !augmenter.Augments("ivector"));
+
+  CuMatrix<BaseFloat> augmented(features);
+  augmenter.Augment(indexes, &augmented);
+  Matrix<BaseFloat> orig(features), aug(augmented);
+
+  int32 num_zero_rows = 0;
+  for (int32 r = 0; r < num_rows; r++) {
+    SubVector<BaseFloat> row(aug, r);
+    BaseFloat value = row.Max();
+    if (value == 0.0) {
+      num_zero_rows++;
+      continue;
+    }
+    // Each row is a (possibly partly masked) copy of a row of the same
+    // sequence, shifted by no more than the shift plus the warp.
+    int32 src_row = static_cast<int32>(value) - 1;
+    KALDI_ASSERT(indexes[src_row].n == indexes[r].n);
+    KALDI_ASSERT(std::abs(indexes[src_row].t - indexes[r].t) <=
+                 opts.max_frame_shift + 2 * opts.time_warp_max_frames + 1);
+    int32 num_zero = 0;
+    for (int32 d = 0; d < dim; d++) {
+      if (row(d) == 0.0) num_zero++;
+      else KALDI_ASSERT(row(d) == value);
+    }
+    KALDI_ASSERT(num_zero <= opts.num_freq_masks * opts.freq_mask_max_bins);
+  }
+  KALDI_ASSERT(num_zero_rows <= num_sequences * opts.num_time_masks *
+               opts.time_mask_max_frames);
+  if (opts.max_frame_shift == 0 && opts.time_warp_max_frames == 0 &&
+      opts.num_time_masks == 0 && opts.num_freq_masks == 0)
+    KALDI_ASSERT(aug.ApproxEqual(orig));
+}
+
+}  // namespace nnet3
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+  for (int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    CuDevice::Instantiate().SetDebugStrideMode(true);
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    for (int32 i = 0; i < 50; i++)
+      UnitTestNnetInputAugmenter();
+  }
+  KALDI_LOG << "Nnet input augmentation tests succeeded.";
+  return 0;
+}
@@ -0,0 +1,177 @@
+// nnet3/nnet-augment.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "nnet3/nnet-augment.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-nnet.h"
+#include "cudamatrix/cu-array.h"
+#include "cudamatrix/cu-vector.h"
+#include "util/text-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+NnetInputAugmenter::NnetInputAugmenter(const NnetAugmentOptions &opts):
+    opts_(opts) {
+  SplitStringToVector(opts.inputs, ",", true, &input_names_);
+  KALDI_ASSERT(opts.max_frame_shift >= 0 && opts.time_warp_max_frames >= 0 &&
+               opts.num_time_masks >= 0 && opts.time_mask_max_frames >= 0 &&
+               opts.num_freq_masks >= 0 && opts.freq_mask_max_bins >= 0);
+}
+
+bool NnetInputAugmenter::Augments(const std::string &name) const {
+  return opts_.Enabled() &&
+      std::find(input_names_.begin(), input_names_.end(), name) !=
+      input_names_.end();
+}
+
+void NnetInputAugmenter::GetSequences(
+    const std::vector<Index> &indexes,
+    std::vector<std::vector<int32> > *sequences) {
+  // Each element is (n, t, row-index).
+  std::vector<std::pair<std::pair<int32, int32>, int32> > rows(indexes.size());
+  for (size_t i = 0; i < indexes.size(); i++)
+    rows[i] = std::make_pair(std::make_pair(indexes[i].n, indexes[i].t),
+                             static_cast<int32>(i));
+  std::sort(rows.begin(), rows.end());
+  sequences->clear();
+  for (size_t i = 0; i < rows.size(); i++) {
+    if (i == 0 || rows[i].first.first != rows[i - 1].first.first)
+      sequences->resize(sequences->size() + 1);
+    sequences->back().push_back(rows[i].second);
+  }
+}
+
+bool NnetInputAugmenter::GetSourceRows(
+    const std::vector<std::vector<int32> > &sequences,
+    std::vector<int32> *src_rows) const {
+  int32 max_shift = opts_.max_frame_shift, W = opts_.time_warp_max_frames;
+  if (max_shift == 0 && W == 0)
+    return false;
+  bool changed = false;
+  for (size_t s = 0; s < sequences.size(); s++) {
+    const std::vector<int32> &seq = sequences[s];
+    int32 T = seq.size(),
+        shift = (max_shift > 0 ? RandInt(-max_shift, max_shift) : 0);
+    // The warp moves frame 'center' to position 'new_center'; we only warp
+    // sequences long enough that both are strictly inside the sequence.
+    int32 center = 0, new_center = 0;
+    if (W > 0 && T > 2 * W + 2) {
+      center = RandInt(W + 1, T - 2 - W);
+      new_center = center + RandInt(-W, W);
+    }
+    for (int32 p = 0; p < T; p++) {
+      double src = p;
+      if (new_center != center) {
+        if (p < new_center)
+          src = p * static_cast<double>(center) / new_center;
+        else
+          src = center + (p - new_center) *
+              static_cast<double>(T - 1 - center) / (T - 1 - new_center);
+      }
+      int32 src_p = static_cast<int32>(src + 0.5) + shift;
+      src_p = std::max<int32>(0, std::min<int32>(T - 1, src_p));
+      (*src_rows)[seq[p]] = seq[src_p];
+      if (src_p != p)
+        changed = true;
+    }
+  }
+  return changed;
+}
+
+void NnetInputAugmenter::Augment(const std::vector<Index> &indexes,
+                                 CuMatrixBase<BaseFloat> *features) const {
+  int32 num_rows = features->NumRows(), dim = features->NumCols();
+  KALDI_ASSERT(static_cast<int32>(indexes.size()) == num_rows);
+  if (num_rows == 0)
+    return;
+  std::vector<std::vector<int32> > sequences;
+  GetSequences(indexes, &sequences);
+  int32 num_sequences = sequences.size();
+
+  std::vector<int32> src_rows(num_rows);
+  if (GetSourceRows(sequences, &src_rows)) {
+    CuMatrix<BaseFloat> orig_features(*features);
+    CuArray<int32> cu_src_rows(src_rows);
+    features->CopyRows(orig_features, cu_src_rows);
+  }
+
+  if (opts_.num_time_masks > 0 && opts_.time_mask_max_frames > 0) {
+    Vector<BaseFloat> row_scales(num_rows);
+    row_scales.Set(1.0);
+    for (int32 s = 0; s < num_sequences; s++) {
+      const std::vector<int32> &seq = sequences[s];
+      int32 T = seq.size();
+      for (int32 m = 0; m < opts_.num_time_masks; m++) {
+        int32 width = std::min(T, RandInt(1, opts_.time_mask_max_frames)),
+            start = RandInt(0, T - width);
+        for (int32 p = start; p < start + width; p++)
+          row_scales(seq[p]) = 0.0;
+      }
+    }
+    CuVector<BaseFloat> cu_row_scales(row_scales);
+    features->MulRowsVec(cu_row_scales);
+  }
+
+  if (opts_.num_freq_masks > 0 && opts_.freq_mask_max_bins > 0) {
+    // The masks are chosen per sequence and then expanded to one row per
+    // frame on the GPU.
+    Matrix<BaseFloat> sequence_scales(num_sequences, dim);
+    sequence_scales.Set(1.0);
+    std::vector<int32> row_to_sequence(num_rows);
+    for (int32 s = 0; s < num_sequences; s++) {
+      for (size_t p = 0; p < sequences[s].size(); p++)
+        row_to_sequence[sequences[s][p]] = s;
+      for (int32 m = 0; m < opts_.num_freq_masks; m++) {
+        int32 width = std::min(dim, RandInt(1, opts_.freq_mask_max_bins)),
+            start = RandInt(0, dim - width);
+        sequence_scales.Row(s).Range(start, width).SetZero();
+      }
+    }
+    CuMatrix<BaseFloat> cu_sequence_scales(sequence_scales),
+        scales(num_rows, dim, kUndefined);
+    CuArray<int32> cu_row_to_sequence(row_to_sequence);
+    scales.CopyRows(cu_sequence_scales, cu_row_to_sequence);
+    features->MulElements(scales);
+  }
+}
+
+void NnetInputAugmenter::AcceptInputs(const Nnet &nnet,
+                                      const std::vector<NnetIo> &inputs,
+                                      NnetComputer *computer) const {
+  for (size_t i = 0; i < inputs.size(); i++) {
+    const NnetIo &io = inputs[i];
+    int32 node_index = nnet.GetNodeIndex(io.name);
+    if (node_index == -1)
+      KALDI_ERR << "No node named '" << io.name << "' in nnet.";
+    if (nnet.IsInputNode(node_index)) {
+      CuMatrix<BaseFloat> cu_input(io.features.NumRows(),
+                                   io.features.NumCols(),
+                                   kUndefined);
+      cu_input.CopyFromGeneralMat(io.features);
+      if (Augments(io.name))
+        Augment(io.indexes, &cu_input);
+      computer->AcceptInput(io.name, &cu_input);
+    }
+  }
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
@@ -0,0 +1,138 @@
+// nnet3/nnet-augment.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_AUGMENT_H_
+#define KALDI_NNET3_NNET_AUGMENT_H_
+
+#include <string>
+#include <vector>
+#include "nnet3/nnet-common.h"
+#include "nnet3/nnet-example.h"
+#include "cudamatrix/cu-matrix.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+class Nnet;
+class NnetComputer;
+
+/**
+   Options for augmenting the input features of training minibatches, after
+   they have been copied to the GPU (see class NnetInputAugmenter).  The random
+   choices are made anew for each minibatch, so each epoch sees different
+   augmentations of the same egs.  All the augmentations are off by default.
+
+   Frequency masking only makes sense if the input features are
+   filterbank-like (e.g. fbank rather than MFCC), since it is the raw input
+   features that are masked.
+ */
+struct NnetAugmentOptions {
+  std::string inputs;
+  int32 max_frame_shift;
+  int32 time_warp_max_frames;
+  int32 num_time_masks;
+  int32 time_mask_max_frames;
+  int32 num_freq_masks;
+  int32 freq_mask_max_bins;
+
+  NnetAugmentOptions(): inputs("input"),
+                        max_frame_shift(0),
+                        time_warp_max_frames(0),
+                        num_time_masks(0),
+                        time_mask_max_frames(10),
+                        num_freq_masks(0),
+                        freq_mask_max_bins(10) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("inputs", &inputs, "Comma-separated list of the names of "
+                   "the input nodes whose features are augmented (e.g. not "
+                   "'ivector').");
+    opts->Register("max-frame-shift", &max_frame_shift, "If >0, the features "
+                   "of each sequence are shifted in time by a random number of "
+                   "frames in [-max-frame-shift, max-frame-shift], repeating "
+                   "the first or last frame at the edges.");
+    opts->Register("time-warp-max-frames", &time_warp_max_frames, "If >0, "
+                   "the time axis of each sequence is warped as in SpecAugment: "
+                   "a random point is moved by up to this many frames and the "
+                   "frames on either side are linearly stretched to match.");
+    opts->Register("num-time-masks", &num_time_masks, "Number of randomly "
+                   "placed time regions that are zeroed in each sequence.");
+    opts->Register("time-mask-max-frames", &time_mask_max_frames, "Maximum "
+                   "width in frames of each time mask.");
+    opts->Register("num-freq-masks", &num_freq_masks, "Number of randomly "
+                   "placed frequency bands that are zeroed in each sequence.");
+    opts->Register("freq-mask-max-bins", &freq_mask_max_bins, "Maximum "
+                   "width in feature dimensions of each frequency mask.");
+  }
+
+  // Returns true if any augmentation is enabled.
+  bool Enabled() const {
+    return max_frame_shift > 0 || time_warp_max_frames > 0 ||
+        (num_time_masks > 0 && time_mask_max_frames > 0) ||
+        (num_freq_masks > 0 && freq_mask_max_bins > 0);
+  }
+};
+
+
+/**
+   NnetInputAugmenter applies the augmentations in NnetAugmentOptions to the
+   input features of a minibatch, once they are on the GPU.  The random numbers
+   (which are few: a handful per sequence) are drawn on the CPU with RandInt(),
+   so backstitch training, which calls srand() before each of its two steps,
+   sees the same augmentation in both; the features themselves are changed
+   only by CuMatrix operations and never copied back.
+
+   Sequences are identified by the 'n' values of the input's indexes, and the
+   frames of a sequence are ordered by 't'; this works whether the rows are
+   ordered n-major (as in nnet3 egs) or t-major (as in chain egs).
+ */
+class NnetInputAugmenter {
+ public:
+  explicit NnetInputAugmenter(const NnetAugmentOptions &opts);
+
+  // Returns true if the input node named 'name' should be augmented.
+  bool Augments(const std::string &name) const;
+
+  // Augments 'features', whose rows correspond to 'indexes'.
+  void Augment(const std::vector<Index> &indexes,
+               CuMatrixBase<BaseFloat> *features) const;
+
+  // Does the same as computer->AcceptInputs(nnet, inputs), but augments the
+  // inputs for which Augments() returns true.
+  void AcceptInputs(const Nnet &nnet, const std::vector<NnetIo> &inputs,
+                    NnetComputer *computer) const;
+
+ private:
+  // Sets 'sequences' to the row indexes of each sequence in 'indexes', in
+  // order of 't'.
+  static void GetSequences(const std::vector<Index> &indexes,
+                           std::vector<std::vector<int32> > *sequences);
+
+  // Sets (*src_rows)[r] to the row that row r should be copied from, for the
+  // frame shift and the time warping; returns false if that would be a no-op.
+  bool GetSourceRows(const std::vector<std::vector<int32> > &sequences,
+                     std::vector<int32> *src_rows) const;
+
+  NnetAugmentOptions opts_;
+  std::vector<std::string> input_names_;
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_AUGMENT_H_
@@ -34,7 +34,7 @@ NnetBatchComputer::NnetBatchComputer(
     const VectorBase<BaseFloat> &priors):
     opts_(opts),
     nnet_(nnet),
-    compiler_(nnet_, opts.optimize_config),
+    compiler_(nnet_, opts.optimize_config, opts.compiler_config),
     log_priors_(priors),
     num_full_minibatches_(0) {
   log_priors_.ApplyLog();
@@ -242,6 +242,16 @@ int32 NnetBatchComputer::GetActualMinibatchSize(
   int32 num_tasks = info.tasks.size(),
       this_minibatch_size = GetMinibatchSize(info);
   KALDI_ASSERT(num_tasks > 0);
+  if (opts_.exact_partial_minibatches && opts_.compiler_config.use_shortcut) {
+    // Round up to a multiple of 'step', so that there are at most
+    // kMaxExactPartialSizes distinct sizes per computation group; otherwise,
+    // with e.g. minibatch_size=128, the distinct computation requests would be
+    // more than the compiler's cache can hold (--cache-capacity, default 64).
+    int32 step = (this_minibatch_size + kMaxExactPartialSizes - 1) /
+        kMaxExactPartialSizes;
+    return std::min(this_minibatch_size,
+                    ((num_tasks + step - 1) / step) * step);
+  }
   while (num_tasks <
          int32(opts_.partial_minibatch_factor * this_minibatch_size))
     this_minibatch_size *= opts_.partial_minibatch_factor;
@@ -517,6 +527,22 @@ void NnetBatchComputer::FormatOutputs(
     std::vector<int32_t> ldi(num_tasks), ldo(num_tasks);
     std::vector<int32_t> num_rows(num_tasks), num_cols(num_tasks);
 
+    // Rather than one synchronous copy to the CPU per task, the whole output
+    // is copied at once into pinned memory (which the pinned allocator
+    // caches, so this is cheap to allocate), asynchronously so that the
+    // batched copy for the tasks that want their output on the GPU is queued
+    // meanwhile; the tasks' CPU outputs are then filled from it.
+    PinnedMatrix<BaseFloat> output_staging;
+    CuEvent output_copied;
+    bool any_output_to_cpu = false;
+    for (int32 n = 0; n < num_tasks; n++)
+      any_output_to_cpu = any_output_to_cpu || tasks[n]->output_to_cpu;
+    if (any_output_to_cpu) {
+      output_staging.Resize(output.NumRows(), output_dim, kUndefined);
+      output.CopyToMatAsync(&output_staging);
+      output_copied.Record();
+    }
+
     int b=0;  // batch counter
     for (int32 n = 0; n < num_tasks; n++) {
       NnetInferenceTask *task = tasks[n];
@@ -529,16 +555,7 @@ void NnetBatchComputer::FormatOutputs(
       // This adds a bit of code complexity.  Perhaps output_to_cpu should 
       // be a property of the batch computer and not the tasks
       if (task->output_to_cpu) {
-        task->output_cpu.Resize(num_output_frames, output_dim,
-            kUndefined);
-        // if (left_unused > 0)
-        //   task->output_cpu.RowRange(0, left_unused).SetZero();
-        task->output_cpu.RowRange(left_unused, used).CopyFromMat(
-            output.RowRange(n * num_output_frames + left_unused, used));
-        // if (right_unused > 0)
-        //   task->output_cpu.RowRange(
-        //   0, left_unused + used, right_unused).SetZero();
-
+        // filled in below, once the copy has finished.
       } else {
         did_output_to_gpu = true;
         task->output.Resize(num_output_frames, output_dim,
@@ -563,6 +580,27 @@ void NnetBatchComputer::FormatOutputs(
     // execute batched copy
     cuda_batched_copy_mats(b, &num_rows[0], &num_cols[0], &inputs[0], &ldi[0], 
         &outputs[0], &ldo[0]);
+
+    if (any_output_to_cpu) {
+      output_copied.Synchronize();
+      for (int32 n = 0; n < num_tasks; n++) {
+        NnetInferenceTask *task = tasks[n];
+        if (!task->output_to_cpu)
+          continue;
+        int32 left_unused = task->num_initial_unused_output_frames,
+            used = task->num_used_output_frames;
+        task->output_cpu.Resize(num_output_frames, output_dim,
+            kUndefined);
+        // if (left_unused > 0)
+        //   task->output_cpu.RowRange(0, left_unused).SetZero();
+        task->output_cpu.RowRange(left_unused, used).CopyFromMat(
+            output_staging.RowRange(n * num_output_frames + left_unused,
+                                    used));
+        // if (right_unused > 0)
+        //   task->output_cpu.RowRange(
+        //   0, left_unused + used, right_unused).SetZero();
+      }
+    }
   
   } else
 #endif
@@ -641,20 +679,46 @@ bool NnetBatchComputer::Compute(bool allow_partial_minibatch) {
     return false;
 
   Timer tim;
-  Nnet *nnet_to_update = NULL;  // we're not doing any update
-  NnetComputer computer(opts_.compute_config, *(minfo->computation),
-                        nnet_, nnet_to_update);
-
-
   CuMatrix<BaseFloat> input;
   CuMatrix<BaseFloat> ivector;
   FormatInputs(minibatch_size, tasks, &input, &ivector);
-  computer.AcceptInput("input", &input);
-  if (ivector.NumRows() != 0)
-    computer.AcceptInput("ivector", &ivector);
-  computer.Run();
   CuMatrix<BaseFloat> output;
-  computer.GetOutputDestructive("output", &output);
+
+  bool use_graph = false;
+#if HAVE_CUDA == 1
+  if (opts_.compute_config.use_cuda_graph &&
+      opts_.compute_config.profile_file.empty() &&
+      CuDevice::Instantiate().Enabled()) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!minfo->graph_computer_in_use &&
+        NnetCudaGraphComputer::IsSuitable(*(minfo->computation))) {
+      minfo->graph_computer_in_use = true;
+      use_graph = true;
+    }
+  }
+#endif
+  if (use_graph) {
+    if (minfo->graph_computer == NULL)
+      minfo->graph_computer.reset(new NnetCudaGraphComputer(
+          opts_.compute_config, minfo->computation, nnet_));
+    NnetCudaGraphComputer *computer = minfo->graph_computer.get();
+    computer->AcceptInput("input", input);
+    if (ivector.NumRows() != 0)
+      computer->AcceptInput("ivector", ivector);
+    computer->Run();
+    output = computer->GetOutput("output");
+    std::unique_lock<std::mutex> lock(mutex_);
+    minfo->graph_computer_in_use = false;
+  } else {
+    Nnet *nnet_to_update = NULL;  // we're not doing any update
+    NnetComputer computer(opts_.compute_config, *(minfo->computation),
+                          nnet_, nnet_to_update);
+    computer.AcceptInput("input", &input);
+    if (ivector.NumRows() != 0)
+      computer.AcceptInput("ivector", &ivector);
+    computer.Run();
+    computer.GetOutputDestructive("output", &output);
+  }
   if (log_priors_.Dim() != 0) {
     output.AddVecToRows(-1.0, log_priors_);
   }
@@ -1236,6 +1300,7 @@ NnetBatchDecoder::NnetBatchDecoder(
   fst_(fst), decoder_opts_(decoder_opts),
   trans_model_(trans_model), word_syms_(word_syms),
   allow_partial_(allow_partial),  computer_(computer),
+  max_active_utts_(2 * num_threads),
   is_finished_(false), tasks_finished_(false), priority_offset_(0.0),
   tot_like_(0.0), frame_count_(0), num_success_(0), num_fail_(0),
   num_partial_(0) {
@@ -1267,27 +1332,40 @@ void NnetBatchDecoder::AcceptInput(
     const Vector<BaseFloat> *ivector,
     const Matrix<BaseFloat> *online_ivectors,
     int32 online_ivector_period){
-  // This function basically does a handshake with one of the decoder threads.
-  // It may have to wait till one of the decoder threads becomes ready.
-  input_utterance_.utterance_id = utterance_id;
-  input_utterance_.input = &input;
-  input_utterance_.ivector = ivector;
-  input_utterance_.online_ivectors = online_ivectors;
-  input_utterance_.online_ivector_period = online_ivector_period;
-
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (active_utts_.size() >= max_active_utts_)
+      cond_.wait(lock);
+  }
 
   UtteranceOutput *this_output = new UtteranceOutput();
   this_output->utterance_id = utterance_id;
+  this_output->finished = false;
   pending_utts_.push_back(this_output);
 
-  input_ready_semaphore_.Signal();
-  input_consumed_semaphore_.Wait();
+  UtteranceState *utt = new UtteranceState(fst_, decoder_opts_, this_output);
+  bool output_to_cpu = true;
+  computer_->SplitUtteranceIntoTasks(output_to_cpu, input, ivector,
+                                     online_ivectors, online_ivector_period,
+                                     &(utt->tasks));
+  SetPriorities(&(utt->tasks));
+  for (size_t i = 0; i < utt->tasks.size(); i++)
+    computer_->AcceptTask(&(utt->tasks[i]));
+  utt->decoder.InitDecoding();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    active_utts_.push_back(utt);
+  }
+  cond_.notify_all();
+  tasks_ready_semaphore_.Signal();
 }
 
 int32 NnetBatchDecoder::Finished() {
-  is_finished_ = true;
-  for (size_t i = 0; i < decode_threads_.size(); i++)
-    input_ready_semaphore_.Signal();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    is_finished_ = true;
+  }
+  cond_.notify_all();
   for (size_t i = 0; i < decode_threads_.size(); i++) {
     decode_threads_[i]->join();
     delete decode_threads_[i];
@@ -1370,88 +1448,106 @@ void NnetBatchDecoder::Compute() {
   while (!tasks_finished_) {
     tasks_ready_semaphore_.Wait();
     bool allow_partial_minibatch = true;
-    while (computer_->Compute(allow_partial_minibatch));
+    while (computer_->Compute(allow_partial_minibatch)) {
+      // Wake up the decoder threads that are waiting for tasks.  Locking the
+      // mutex makes sure that a thread which has just found no task ready is
+      // already waiting.
+      { std::unique_lock<std::mutex> lock(mutex_); }
+      cond_.notify_all();
+    }
+  }
+}
+
+NnetBatchDecoder::UtteranceState* NnetBatchDecoder::GetUtteranceToProcess() {
+  for (std::list<UtteranceState*>::iterator iter = active_utts_.begin();
+       iter != active_utts_.end(); ++iter) {
+    UtteranceState *utt = *iter;
+    if (utt->busy)
+      continue;
+    if (utt->num_tasks_decoded < utt->tasks.size() && !utt->next_task_ready)
+      utt->next_task_ready =
+          utt->tasks[utt->num_tasks_decoded].semaphore.TryWait();
+    if (utt->num_tasks_decoded == utt->tasks.size() || utt->next_task_ready) {
+      utt->busy = true;
+      return utt;
+    }
   }
+  return NULL;
 }
 
 void NnetBatchDecoder::Decode() {
   while (true) {
-    input_ready_semaphore_.Wait();
-    if (is_finished_)
-      return;
-
-    std::vector<NnetInferenceTask> tasks;
-    std::string utterance_id;
-    // we can be confident that the last element of 'pending_utts_' is the one
-    // for this utterance, as we know exactly at what point in the code the main
-    // thread will be in AcceptInput().
-    UtteranceOutput *output_utterance = pending_utts_.back();
+    UtteranceState *utt;
     {
-      UtteranceInput input_utterance(input_utterance_);
-      utterance_id = input_utterance.utterance_id;
-      bool output_to_cpu = true;
-      computer_->SplitUtteranceIntoTasks(output_to_cpu,
-                                         *(input_utterance.input),
-                                         input_utterance.ivector,
-                                         input_utterance.online_ivectors,
-                                         input_utterance.online_ivector_period,
-                                         &tasks);
-      KALDI_ASSERT(output_utterance->utterance_id == utterance_id);
-      input_consumed_semaphore_.Signal();
-      // Now let input_utterance go out of scope; it's no longer valid as it may
-      // be overwritten by something else.
+      std::unique_lock<std::mutex> lock(mutex_);
+      while ((utt = GetUtteranceToProcess()) == NULL) {
+        if (is_finished_ && active_utts_.empty())
+          return;
+        cond_.wait(lock);
+      }
     }
-
-    SetPriorities(&tasks);
-    for (size_t i = 0; i < tasks.size(); i++)
-      computer_->AcceptTask(&(tasks[i]));
-    tasks_ready_semaphore_.Signal();
-
-    {
-      int32 frame_offset = 0;
-      LatticeFasterDecoder decoder(fst_, decoder_opts_);
-      decoder.InitDecoding();
-
-
-      for (size_t i = 0; i < tasks.size(); i++) {
-        NnetInferenceTask &task = tasks[i];
-        task.semaphore.Wait();
-        UpdatePriorityOffset(task.priority);
-
-        SubMatrix<BaseFloat> post(task.output_cpu,
-                                  task.num_initial_unused_output_frames,
-                                  task.num_used_output_frames,
-                                  0, task.output_cpu.NumCols());
-        DecodableMatrixMapped decodable(trans_model_, post, frame_offset);
-        frame_offset += post.NumRows();
-        decoder.AdvanceDecoding(&decodable);
-        task.output.Resize(0, 0);  // Free some memory.
+    if (utt->num_tasks_decoded < utt->tasks.size()) {
+      DecodeTask(utt);
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        utt->next_task_ready = false;
+        utt->busy = false;
       }
-
-      bool use_final_probs = true;
-      if (!decoder.ReachedFinal()) {
-        if (allow_partial_) {
-          KALDI_WARN << "Outputting partial output for utterance "
-                     << utterance_id << " since no final-state reached\n";
-          use_final_probs = false;
-          std::unique_lock<std::mutex> lock(stats_mutex_);
-          num_partial_++;
-        } else {
-          KALDI_WARN << "Not producing output for utterance " << utterance_id
-                     << " since no final-state reached and "
-                     << "--allow-partial=false.\n";
-          std::unique_lock<std::mutex> lock(stats_mutex_);
-          num_fail_++;
-          continue;
-        }
+      // Another thread may now take this utterance, e.g. if its next task
+      // was already computed.
+      cond_.notify_all();
+    } else {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        active_utts_.remove(utt);
       }
-      // if we reached this point, we are getting a lattice.
-      decoder.GetRawLattice(&output_utterance->lat, use_final_probs);
-      // Let the decoder and the decodable object go out of scope, to save
-      // memory.
+      // AcceptInput() may now accept another utterance.
+      cond_.notify_all();
+      FinishUtterance(utt);
+      delete utt;
+    }
+  }
+}
+
+void NnetBatchDecoder::DecodeTask(UtteranceState *utt) {
+  NnetInferenceTask &task = utt->tasks[utt->num_tasks_decoded];
+  UpdatePriorityOffset(task.priority);
+
+  SubMatrix<BaseFloat> post(task.output_cpu,
+                            task.num_initial_unused_output_frames,
+                            task.num_used_output_frames,
+                            0, task.output_cpu.NumCols());
+  DecodableMatrixMapped decodable(trans_model_, post, utt->frame_offset);
+  utt->frame_offset += post.NumRows();
+  utt->decoder.AdvanceDecoding(&decodable);
+  task.output.Resize(0, 0);  // Free some memory.
+  task.output_cpu.Resize(0, 0);
+  utt->num_tasks_decoded++;
+}
+
+void NnetBatchDecoder::FinishUtterance(UtteranceState *utt) {
+  UtteranceOutput *output_utterance = utt->output;
+  const std::string &utterance_id = output_utterance->utterance_id;
+  bool use_final_probs = true;
+  if (!utt->decoder.ReachedFinal()) {
+    if (allow_partial_) {
+      KALDI_WARN << "Outputting partial output for utterance "
+                 << utterance_id << " since no final-state reached\n";
+      use_final_probs = false;
+      std::unique_lock<std::mutex> lock(stats_mutex_);
+      num_partial_++;
+    } else {
+      KALDI_WARN << "Not producing output for utterance " << utterance_id
+                 << " since no final-state reached and "
+                 << "--allow-partial=false.\n";
+      std::unique_lock<std::mutex> lock(stats_mutex_);
+      num_fail_++;
+      output_utterance->finished = true;
+      return;
     }
-    ProcessOutputUtterance(output_utterance);
   }
+  utt->decoder.GetRawLattice(&output_utterance->lat, use_final_probs);
+  ProcessOutputUtterance(output_utterance);
 }
 
 
@@ -1467,6 +1563,7 @@ void NnetBatchDecoder::ProcessOutputUtterance(UtteranceOutput *output) {
                << output->utterance_id;
     std::unique_lock<std::mutex> lock(stats_mutex_);
     num_fail_++;
+    output->finished = true;
     return;
   }
 
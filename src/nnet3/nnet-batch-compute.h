@@ -141,16 +141,22 @@ struct NnetInferenceTask {
 };
 
 
+// With --exact-partial-minibatches, the maximum number of distinct partial
+// minibatch sizes per computation group (see GetActualMinibatchSize()).
+const int32 kMaxExactPartialSizes = 16;
+
 struct NnetBatchComputerOptions: public NnetSimpleComputationOptions {
   int32 minibatch_size;
   int32 edge_minibatch_size;
   bool ensure_exact_final_context;
   BaseFloat partial_minibatch_factor;
+  bool exact_partial_minibatches;
 
   NnetBatchComputerOptions(): minibatch_size(128),
                               edge_minibatch_size(32),
                               ensure_exact_final_context(false),
-                              partial_minibatch_factor(0.5) {
+                              partial_minibatch_factor(0.5),
+                              exact_partial_minibatches(false) {
   }
 
   void Register(OptionsItf *po) {
@@ -174,6 +180,16 @@ struct NnetBatchComputerOptions: public NnetSimpleComputationOptions {
                  "for sizes: int(partial_minibatch_factor^n * minibatch_size "
                  ", for n = 0, 1, 2....  Set it to 0.0 if you want to use "
                  "only the specified minibatch sizes.");
+    po->Register("exact-partial-minibatches", &exact_partial_minibatches,
+                 "If true, compute partial minibatches with (nearly) as many "
+                 "chunks as are ready, instead of padding them to one of the "
+                 "sizes given by --partial-minibatch-factor.  Sizes are "
+                 "rounded up to a multiple of minibatch-size / 16, so there "
+                 "are at most 16 sizes per chunk type and the compiler's "
+                 "cache (--cache-capacity) is not flooded.  With "
+                 "--use-shortcut=true (the default), each new size only "
+                 "requires expanding the computation already compiled for "
+                 "two chunks, which is cheap; it is ignored otherwise.");
   }
 };
 
@@ -279,6 +295,9 @@ class NnetBatchComputer {
 
   const NnetBatchComputerOptions &GetOptions() { return opts_; }
 
+  /// Returns the compiler, e.g. to get its cache statistics.
+  const CachingOptimizingCompiler &GetCompiler() const { return compiler_; }
+
   ~NnetBatchComputer();
 
  private:
@@ -295,8 +314,15 @@ class NnetBatchComputer {
     // how 'full', on average, these minibatches were.
     double seconds_taken;  // The total time elapsed in computation for this
                           // minibatch type.
+    // If --use-cuda-graph=true, this is created by Compute() the first time
+    // this computation is done, and used instead of an NnetComputer.
+    // 'graph_computer_in_use' is true while a call to Compute() is using it
+    // (the others then use an NnetComputer); it is guarded by mutex_.
+    std::unique_ptr<NnetCudaGraphComputer> graph_computer;
+    bool graph_computer_in_use;
     MinibatchSizeInfo(): computation(NULL), num_done(0),
-                         tot_num_tasks(0), seconds_taken(0.0) { }
+                         tot_num_tasks(0), seconds_taken(0.0),
+                         graph_computer_in_use(false) { }
   };
 
 
@@ -609,6 +635,14 @@ class NnetBatchInference {
    NnetBatchComputer object).  The interface of this object should
    accessed from only one thread, though-- presumably the main thread of the
    program.
+
+   Several utterances per thread are decoded at once.  The decoder threads
+   are a shared pool: each time, a thread takes one of the utterances whose
+   next chunk of neural net output is ready, advances its decoder over that
+   chunk, and gives it back, so a long utterance does not hold on to a thread
+   while the chunks of shorter ones are waiting.  When an utterance has been
+   decoded, getting its lattice and determinizing it is a separate piece of
+   work, which may be done by any thread.
  */
 class NnetBatchDecoder {
  public:
@@ -629,7 +663,8 @@ class NnetBatchDecoder {
                            those lattices.
         @param [in] num_threads  The number of decoder threads to use.  It will use
                           two more threads on top of this: the main thread, for I/O,
-                          and a thread for possibly-GPU-based inference.
+                          and a thread for possibly-GPU-based inference.  Up to
+                          2 * num_threads utterances are decoded at a time.
         @param [in] computer The NnetBatchComputer object, through which the
                            neural net will be evaluated.
    */
@@ -644,8 +679,8 @@ class NnetBatchDecoder {
   /**
     The user should call this one by one for the utterances that
     it needs to compute (interspersed with calls to GetOutput()).  This
-    call will block when no threads are ready to start processing this
-    utterance.
+    call will block while the maximum number of utterances are being
+    decoded.
 
       @param [in] utterance_id  The string representing the utterance-id;
              it will be provided back to the user when GetOutput() is
@@ -722,14 +757,6 @@ class NnetBatchDecoder {
  private:
   KALDI_DISALLOW_COPY_AND_ASSIGN(NnetBatchDecoder);
 
-  struct UtteranceInput {
-    std::string utterance_id;
-    const Matrix<BaseFloat> *input;
-    const Vector<BaseFloat> *ivector;
-    const Matrix<BaseFloat> *online_ivectors;
-    int32 online_ivector_period;
-  };
-
   // This object is created when a thread finished an utterance.  For utterances
   // where decoding failed somehow, the relevant lattice (compact_lat, if
   // opts_.determinize == true, or lat otherwise) will be empty (have no
@@ -747,10 +774,47 @@ class NnetBatchDecoder {
                            // in the main thread to keep the order consistent.
   };
 
+  // The state of an utterance that is being decoded.  It is created by
+  // AcceptInput(), and deleted by the decoder thread that finishes it.
+  struct UtteranceState {
+    // The tasks into which we split this utterance.
+    std::vector<NnetInferenceTask> tasks;
+    // The number of tasks that the decoder has advanced over.
+    size_t num_tasks_decoded;
+    // The number of frames decoded, i.e. the frame offset of the next task.
+    int32 frame_offset;
+    // True if we have waited for the semaphore of tasks[num_tasks_decoded],
+    // i.e. its output is ready.
+    bool next_task_ready;
+    // True while a decoder thread is working on this utterance.
+    bool busy;
+    LatticeFasterDecoder decoder;
+    // The output, which is also in pending_utts_.
+    UtteranceOutput *output;
+    UtteranceState(const fst::Fst<fst::StdArc> &fst,
+                   const LatticeFasterDecoderConfig &config,
+                   UtteranceOutput *output):
+        num_tasks_decoded(0), frame_offset(0), next_task_ready(false),
+        busy(false), decoder(fst, config), output(output) { }
+  };
+
   // This is the decoding thread, several copies of which are run in the
   // background.  It will exit once the user calls Finished() and all
   // computation is completed.
   void Decode();
+
+  // Called with mutex_ held from Decode(): returns the oldest utterance in
+  // active_utts_ that a decoder thread can work on, i.e. that is not busy and
+  // either has its next task ready or has been decoded to the end, and sets
+  // it busy; or returns NULL if there is none.
+  UtteranceState *GetUtteranceToProcess();
+
+  // Advances the decoder of 'utt' over its next task, which must be ready.
+  void DecodeTask(UtteranceState *utt);
+
+  // Called when all the tasks of 'utt' have been decoded: gets the lattice
+  // and calls ProcessOutputUtterance().  'utt' is deleted by the caller.
+  void FinishUtterance(UtteranceState *utt);
   // static wrapper for Compute().
   static void DecodeFunc(NnetBatchDecoder *object) { object->Decode(); }
 
@@ -770,7 +834,7 @@ class NnetBatchDecoder {
 
   // This function does the determinization (if needed) and finds the best path through
   // the lattice to update the stats.  It is expected that when it is called, 'output' must
-  // have its 'lat' member set up.
+  // have its 'lat' member set up.  It sets output->finished.
   void ProcessOutputUtterance(UtteranceOutput *output);
 
   const fst::Fst<fst::StdArc> &fst_;
@@ -783,29 +847,22 @@ class NnetBatchDecoder {
   std::thread compute_thread_;  // Thread that calls computer_->Compute().
 
 
-  // 'input_utterance', together with utterance_ready_semaphore_ and
-  // utterance_consumed_semaphore_, use used to 'hand off' information about a
-  // newly provided utterance from AcceptInput() to a decoder thread that is
-  // ready to process a new utterance.
-  UtteranceInput input_utterance_;
-  Semaphore input_ready_semaphore_;  // Is signaled by the main thread when
-                                     // AcceptInput() is called and a new
-                                     // utterance is being provided (or when the
-                                     // input is finished), and waited on in
-                                     // decoder thread.
-  Semaphore input_consumed_semaphore_;  // Is signaled in decoder thread when it
-                                        // has finished consuming the input, so
-                                        // the main thread can know when it
-                                        // should continue (to avoid letting
-                                        // 'input' go out of scope while it's
-                                        // still needed).
+  // The utterances being decoded, oldest first.  Guarded by mutex_.
+  std::list<UtteranceState*> active_utts_;
+  // The maximum size of active_utts_; AcceptInput() waits while it is
+  // reached.
+  size_t max_active_utts_;
+  // mutex_ guards active_utts_, the 'busy' and 'next_task_ready' members of
+  // the utterances in it, and is_finished_.  cond_ is notified when any of
+  // those change, and by the compute thread when tasks have been computed.
+  std::mutex mutex_;
+  std::condition_variable cond_;
 
   Semaphore tasks_ready_semaphore_; // Is signaled when new tasks are added to
                                     // the computer_ object (or when we're finished).
 
-  bool is_finished_;  // True if the input is finished.  If this is true, a
-                      // signal to input_ready_semaphore_ indicates to the
-                      // decoder thread that it should terminate.
+  bool is_finished_;  // True if the input is finished.  If this is true and
+                      // active_utts_ is empty, the decoder threads terminate.
 
   bool tasks_finished_;  // True if we know that no more tasks will be given
                          // to the computer_ object.
@@ -105,7 +105,7 @@ void NnetChainComputeProb::Compute(const NnetChainExample &chain_eg) {
   NnetComputer computer(nnet_config_.compute_config, *computation,
                         nnet_, deriv_nnet_);
   // give the inputs to the computer object.
-  computer.AcceptInputs(nnet_, chain_eg.inputs);
+  prefetcher_.AcceptInputs(nnet_, chain_eg.inputs, &computer);
   computer.Run();
   this->ProcessOutputs(chain_eg, &computer);
   if (nnet_config_.compute_deriv)
@@ -76,6 +76,12 @@ class NnetChainComputeProb {
   // compute objective on one minibatch.
   void Compute(const NnetChainExample &chain_eg);
 
+  // If a GPU is in use, starts copying the input features of 'chain_eg' to it
+  // in the background; see NnetComputeProb::Prefetch().
+  void Prefetch(const NnetChainExample &chain_eg) {
+    prefetcher_.Prefetch(nnet_, chain_eg.inputs);
+  }
+
   // Prints out the final stats, and return true if there was a nonzero count.
   bool PrintTotalStats() const;
 
@@ -108,6 +114,8 @@ class NnetChainComputeProb {
 
   unordered_map<std::string, ChainObjectiveInfo, StringHasher> objf_info_;
 
+  // Copies the inputs of the minibatches given to Prefetch() to the GPU.
+  NnetInputPrefetcher prefetcher_;
 };
 
 /// This function zeros the stored component-level stats in the nnet using
@@ -0,0 +1,161 @@
+// nnet3/nnet-chain-example-loader.cc
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-chain-example-loader.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+NnetChainExampleLoader::NnetChainExampleLoader(
+    const NnetChainExampleLoaderOptions &opts,
+    const std::vector<std::string> &rspecifiers,
+    int32 srand_seed):
+    opts_(opts), num_readers_active_(rspecifiers.size()),
+    shuffle_done_(false), abort_(false), failed_(false) {
+  KALDI_ASSERT(opts_.buffer_size > 0 && opts_.prefetch > 0 &&
+               !rspecifiers.empty());
+  opts_.merging_config.ComputeDerived();
+  for (size_t i = 0; i < rspecifiers.size(); i++)
+    threads_.push_back(std::thread(&NnetChainExampleLoader::ReaderThread,
+                                   this, rspecifiers[i]));
+  threads_.push_back(std::thread(&NnetChainExampleLoader::ShuffleThread,
+                                 this, srand_seed));
+}
+
+void NnetChainExampleLoader::ReaderThread(std::string rspecifier) {
+  try {
+    SequentialNnetChainExampleReader reader(rspecifier);
+    for (; !reader.Done(); reader.Next()) {
+      NnetChainExample *eg = new NnetChainExample();
+      eg->Swap(&(reader.Value()));
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (static_cast<int32>(buffer_.size()) >= opts_.buffer_size &&
+             !abort_)
+        buffer_cond_.wait(lock);
+      if (abort_) {
+        delete eg;
+        break;
+      }
+      buffer_.push_back(eg);
+      buffer_cond_.notify_all();
+    }
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error reading examples from " << rspecifier;
+    std::lock_guard<std::mutex> lock(mutex_);
+    failed_ = true;
+    output_cond_.notify_all();
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  num_readers_active_--;
+  buffer_cond_.notify_all();
+}
+
+void NnetChainExampleLoader::ShuffleThread(int32 srand_seed) {
+  try {
+    std::mt19937 random_engine(srand_seed);
+    std::vector<NnetChainExample> merged;
+    ChainExampleMerger merger(opts_.merging_config, &merged);
+    bool input_ended = false;
+    while (true) {
+      NnetChainExample *eg = NULL;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // We wait until the buffer is full, as nnet3-chain-shuffle-egs does,
+        // so that the examples are as well mixed as they would be there.
+        while (static_cast<int32>(buffer_.size()) < opts_.buffer_size &&
+               num_readers_active_ > 0 && !abort_)
+          buffer_cond_.wait(lock);
+        if (abort_)
+          break;
+        if (!buffer_.empty()) {
+          size_t i = std::uniform_int_distribution<size_t>(
+              0, buffer_.size() - 1)(random_engine);
+          eg = buffer_[i];
+          buffer_[i] = buffer_.back();
+          buffer_.pop_back();
+          buffer_cond_.notify_all();
+        }
+      }
+      if (eg != NULL) {
+        merger.AcceptExample(eg);  // takes ownership.
+      } else {
+        merger.Finish();
+        input_ended = true;
+      }
+      for (size_t i = 0; i < merged.size(); i++) {
+        NnetChainExample *minibatch = new NnetChainExample();
+        minibatch->Swap(&(merged[i]));
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (static_cast<int32>(output_.size()) >= opts_.prefetch && !abort_)
+          output_cond_.wait(lock);
+        if (abort_) {
+          delete minibatch;
+          break;
+        }
+        output_.push_back(minibatch);
+        output_cond_.notify_all();
+      }
+      merged.clear();
+      if (input_ended)
+        break;
+    }
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error merging examples.";
+    std::lock_guard<std::mutex> lock(mutex_);
+    failed_ = true;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  shuffle_done_ = true;
+  output_cond_.notify_all();
+}
+
+bool NnetChainExampleLoader::GetMinibatch(NnetChainExample *eg) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (output_.empty() && !shuffle_done_ && !failed_)
+    output_cond_.wait(lock);
+  if (failed_)
+    KALDI_ERR << "Failed to read training examples.";
+  if (output_.empty())
+    return false;
+  NnetChainExample *minibatch = output_.front();
+  output_.pop_front();
+  output_cond_.notify_all();
+  lock.unlock();
+  eg->Swap(minibatch);
+  delete minibatch;
+  return true;
+}
+
+NnetChainExampleLoader::~NnetChainExampleLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    abort_ = true;
+    buffer_cond_.notify_all();
+    output_cond_.notify_all();
+  }
+  for (size_t i = 0; i < threads_.size(); i++)
+    threads_[i].join();
+  for (size_t i = 0; i < buffer_.size(); i++)
+    delete buffer_[i];
+  for (size_t i = 0; i < output_.size(); i++)
+    delete output_[i];
+}
+
+} // namespace nnet3
+} // namespace kaldi
@@ -0,0 +1,112 @@
+// nnet3/nnet-chain-example-loader.h
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_CHAIN_EXAMPLE_LOADER_H_
+#define KALDI_NNET3_NNET_CHAIN_EXAMPLE_LOADER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "nnet3/nnet-chain-example.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+struct NnetChainExampleLoaderOptions {
+  int32 buffer_size;
+  int32 prefetch;
+  ExampleMergingConfig merging_config;
+
+  NnetChainExampleLoaderOptions():
+      buffer_size(5000), prefetch(4), merging_config("64") { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("buffer-size", &buffer_size, "Size of the buffer from "
+                   "which examples are chosen at random; like the "
+                   "--buffer-size option of nnet3-chain-shuffle-egs.");
+    opts->Register("prefetch", &prefetch, "The number of merged minibatches "
+                   "that are prepared ahead of their use.");
+    merging_config.Register(opts);
+  }
+};
+
+
+/**
+   NnetChainExampleLoader does, inside the training program, what the pipeline
+   'nnet3-chain-copy-egs | nnet3-chain-shuffle-egs | nnet3-chain-merge-egs'
+   does: it reads one or more archives of (unmerged) examples, each in its own
+   thread, shuffles them with a buffer as nnet3-chain-shuffle-egs does, and
+   merges them into minibatches with class ChainExampleMerger, in a background
+   thread that keeps a few minibatches ready.  This saves the processes that
+   would otherwise parse and re-serialize every example.
+
+   Options of nnet3-chain-copy-egs such as --frame-shift are not supported;
+   egs that need them should still be prepared by a pipeline.
+ */
+class NnetChainExampleLoader {
+ public:
+  /// 'rspecifiers' are the archives to read, e.g. "ark:1.cegs"; they are read
+  /// in parallel.  'srand_seed' seeds the shuffling.
+  NnetChainExampleLoader(const NnetChainExampleLoaderOptions &opts,
+                         const std::vector<std::string> &rspecifiers,
+                         int32 srand_seed);
+
+  /// Outputs the next merged minibatch, returning false if there are no more.
+  /// Throws if reading an archive failed.
+  bool GetMinibatch(NnetChainExample *eg);
+
+  ~NnetChainExampleLoader();
+
+ private:
+  void ReaderThread(std::string rspecifier);
+  void ShuffleThread(int32 srand_seed);
+
+  NnetChainExampleLoaderOptions opts_;
+
+  // mutex_ guards all of the variables below, except threads_.
+  std::mutex mutex_;
+  // Notified when buffer_ or num_readers_active_ changes.
+  std::condition_variable buffer_cond_;
+  // Notified when output_ or shuffle_done_ changes.
+  std::condition_variable output_cond_;
+
+  // The shuffle buffer; owned pointers.
+  std::vector<NnetChainExample*> buffer_;
+  int32 num_readers_active_;
+  // Merged minibatches that are ready; owned pointers.
+  std::deque<NnetChainExample*> output_;
+  bool shuffle_done_;
+  // Set by the destructor, to make the threads exit early.
+  bool abort_;
+  // Set if reading an archive failed.
+  bool failed_;
+
+  std::vector<std::thread> threads_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetChainExampleLoader);
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_CHAIN_EXAMPLE_LOADER_H_
@@ -453,7 +453,12 @@ int32 GetNnetChainExampleSize(const NnetChainExample &a) {
 ChainExampleMerger::ChainExampleMerger(const ExampleMergingConfig &config,
                                        NnetChainExampleWriter *writer):
     finished_(false), num_egs_written_(0),
-    config_(config), writer_(writer) { }
+    config_(config), writer_(writer), output_(NULL) { }
+
+ChainExampleMerger::ChainExampleMerger(const ExampleMergingConfig &config,
+                                       std::vector<NnetChainExample> *output):
+    finished_(false), num_egs_written_(0),
+    config_(config), writer_(NULL), output_(output) { }
 
 
 void ChainExampleMerger::AcceptExample(NnetChainExample *eg) {
@@ -497,6 +502,12 @@ void ChainExampleMerger::WriteMinibatch(
   stats_.WroteExample(eg_size, structure_hash, minibatch_size);
   NnetChainExample merged_eg;
   MergeChainExamples(config_.compress, egs, &merged_eg);
+  if (output_ != NULL) {
+    num_egs_written_++;
+    output_->push_back(NnetChainExample());
+    output_->back().Swap(&merged_eg);
+    return;
+  }
   std::ostringstream key;
   key << "merged-" << (num_egs_written_++) << "-" << minibatch_size;
   writer_->Write(key.str(), merged_eg);
@@ -236,6 +236,13 @@ class ChainExampleMerger {
   ChainExampleMerger(const ExampleMergingConfig &config,
                      NnetChainExampleWriter *writer);
 
+  // This constructor is for use in programs that consume the merged
+  // examples directly (see class NnetChainExampleLoader): instead of being
+  // written out, they are appended to 'output', which the caller is expected
+  // to empty from time to time.
+  ChainExampleMerger(const ExampleMergingConfig &config,
+                     std::vector<NnetChainExample> *output);
+
   // This function accepts an example, and if possible, writes a merged example
   // out.  The ownership of the pointer 'a' is transferred to this class when
   // you call this function.
@@ -262,7 +269,9 @@ class ChainExampleMerger {
   bool finished_;
   int32 num_egs_written_;
   const ExampleMergingConfig &config_;
+  // Exactly one of writer_ and output_ is non-NULL.
   NnetChainExampleWriter *writer_;
+  std::vector<NnetChainExample> *output_;
   ExampleMergingStats stats_;
 
   // Note: the "key" into the egs is the first element of the vector.
@@ -34,7 +34,8 @@ NnetChainTrainer::NnetChainTrainer(const NnetChainTrainingOptions &opts,
               opts_.nnet_config.compiler_config),
     num_minibatches_processed_(0),
     max_change_stats_(*nnet),
-    srand_seed_(RandInt(0, 100000)) {
+    srand_seed_(RandInt(0, 100000)),
+    augmenter_(opts.nnet_config.augment_config) {
   if (opts.nnet_config.zero_component_stats)
     ZeroComponentStats(nnet);
   KALDI_ASSERT(opts.nnet_config.momentum >= 0.0 &&
@@ -103,7 +104,7 @@ void NnetChainTrainer::TrainInternal(const NnetChainExample &eg,
                         nnet_, delta_nnet_);
 
   // give the inputs to the computer object.
-  computer.AcceptInputs(*nnet_, eg.inputs);
+  prefetcher_.AcceptInputs(*nnet_, eg.inputs, &computer, &augmenter_);
   computer.Run();
 
   this->ProcessOutputs(false, eg, &computer);
@@ -148,7 +149,7 @@ void NnetChainTrainer::TrainInternalBackstitch(const NnetChainExample &eg,
   NnetComputer computer(nnet_config.compute_config, computation,
                         nnet_, delta_nnet_);
   // give the inputs to the computer object.
-  computer.AcceptInputs(*nnet_, eg.inputs);
+  prefetcher_.AcceptInputs(*nnet_, eg.inputs, &computer, &augmenter_);
   computer.Run();
 
   bool is_backstitch_step2 = !is_backstitch_step1;
@@ -61,6 +61,15 @@ class NnetChainTrainer {
   // train on one minibatch.
   void Train(const NnetChainExample &eg);
 
+  // If a GPU is in use, starts copying the input features of 'eg' to it in
+  // the background, so that this happens while the current minibatch is
+  // being trained on.  Call this with the next minibatch before calling
+  // Train() with the current one; 'eg' must not be changed until it has been
+  // given to Train().
+  void Prefetch(const NnetChainExample &eg) {
+    prefetcher_.Prefetch(*nnet_, eg.inputs);
+  }
+
   // Prints out the final stats, and return true if there was a nonzero count.
   bool PrintTotalStats() const;
 
@@ -102,6 +111,12 @@ class NnetChainTrainer {
   // consistent dropout masks.  It's set to a value derived from rand()
   // when the class is initialized.
   int32 srand_seed_;
+
+  // Copies the inputs of the minibatches given to Prefetch() to the GPU.
+  NnetInputPrefetcher prefetcher_;
+
+  // Augments the input features of each minibatch, if configured.
+  NnetInputAugmenter augmenter_;
 };
 
 
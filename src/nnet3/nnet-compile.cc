@@ -49,15 +49,20 @@ Compiler::Compiler(
 
 void Compiler::CreateComputation(const CompilerOptions &opts,
                                  NnetComputation *computation) {
+  KALDI_TRACE_SPAN("Compiler::CreateComputation");
   computation->Clear();
   ComputationGraphBuilder builder(nnet_, &graph_);
   // note: there are only >1 segments in a 'looped' computation.
   for (size_t segment = 0; segment < requests_.size(); segment++) {
-    builder.Compute(*(requests_[segment]));
+    {
+      KALDI_TRACE_SPAN("ComputationGraphBuilder::Compute");
+      builder.Compute(*(requests_[segment]));
+    }
     if (!builder.AllOutputsAreComputable()) {
       builder.ExplainWhyAllOutputsNotComputable();  // prints logging info
       KALDI_ERR << "Not all outputs were computable, cannot create computation.";
     }
+    KALDI_TRACE_SPAN("ComputationGraphBuilder::Prune");
     builder.Prune();
   }
   // see function declaration's comment for more on the meaning of "phases" (a
@@ -65,7 +70,10 @@ void Compiler::CreateComputation(const CompilerOptions &opts,
   // s, phases_per_segment[s] is a list of phases; each phase is a list of
   // cindex_ids.
   std::vector<std::vector<std::vector<int32> > > phases_per_segment;
-  ComputeComputationPhases(nnet_, graph_, &phases_per_segment);
+  {
+    KALDI_TRACE_SPAN("ComputeComputationPhases");
+    ComputeComputationPhases(nnet_, graph_, &phases_per_segment);
+  }
   std::vector<std::vector<int32> > steps;
   steps.reserve(1000);
 
@@ -75,6 +83,7 @@ void Compiler::CreateComputation(const CompilerOptions &opts,
 
 
   {
+    KALDI_TRACE_SPAN("ComputationStepsComputer");
     // note: this class will output to 'steps' and to 'cindex_id_to_location_'.
     // it may incidentally change 'graph_' by adding a few cindexes.
     ComputationStepsComputer steps_computer(nnet_, &graph_, &steps,
@@ -94,14 +103,19 @@ void Compiler::CreateComputation(const CompilerOptions &opts,
     steps_computer.Check();
   }
   std::vector<bool> deriv_needed;
-  ComputeDerivNeeded(steps, step_to_segment, &deriv_needed);
-  CreateStepInfo(deriv_needed, step_to_segment, &steps, computation);
-  AddCommands(deriv_needed, step_to_segment, computation);
-  // the following command reorders commands so kAcceptInput and kProvideOutput
-  // appear in the desired places.
-  ConsolidateIoOperations(nnet_, computation);
-  if (opts.output_debug_info)
+  {
+    KALDI_TRACE_SPAN("Compiler::AddCommands");
+    ComputeDerivNeeded(steps, step_to_segment, &deriv_needed);
+    CreateStepInfo(deriv_needed, step_to_segment, &steps, computation);
+    AddCommands(deriv_needed, step_to_segment, computation);
+    // the following command reorders commands so kAcceptInput and
+    // kProvideOutput appear in the desired places.
+    ConsolidateIoOperations(nnet_, computation);
+  }
+  if (opts.output_debug_info) {
+    KALDI_TRACE_SPAN("Compiler::OutputDebugInfo");
     OutputDebugInfo(computation);
+  }
 }
 
 void Compiler::AddCommands(const std::vector<bool> &deriv_needed,
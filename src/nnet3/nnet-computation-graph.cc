@@ -25,32 +25,107 @@ namespace kaldi {
 namespace nnet3 {
 
 
+// The hash of a block of cindexes.  This is a multiplicative hash (the
+// constant is 2^64 divided by the golden ratio), applied after each field is
+// added; the table is indexed by the lowest bits, so they need to be well
+// mixed.
+static inline size_t HashCindexIdBlock(int32 node_index, int32 n, int32 x,
+                                       int32 t_start) {
+  const uint64 kMultiplier = 11400714819323198485ull;
+  uint64 ans = static_cast<uint32>(node_index);
+  ans = (ans * kMultiplier) ^ static_cast<uint32>(n);
+  ans = (ans * kMultiplier) ^ static_cast<uint32>(x);
+  ans = (ans * kMultiplier) ^ static_cast<uint32>(t_start);
+  ans *= kMultiplier;
+  return static_cast<size_t>(ans ^ (ans >> 32));
+}
+
+void ComputationGraph::ResizeBlockTable(size_t size) {
+  KALDI_ASSERT((size & (size - 1)) == 0 &&
+               size > 2 * cindex_id_blocks_.size());
+  block_table_.clear();
+  block_table_.resize(size, -1);
+  size_t mask = size - 1;
+  int32 num_blocks = cindex_id_blocks_.size();
+  for (int32 b = 0; b < num_blocks; b++) {
+    const CindexIdBlock &block = cindex_id_blocks_[b];
+    size_t i = HashCindexIdBlock(block.node_index, block.n, block.x,
+                                 block.t_start) & mask;
+    while (block_table_[i] != -1)
+      i = (i + 1) & mask;
+    block_table_[i] = b;
+  }
+}
+
+int32* ComputationGraph::FindCindexIdEntry(const Cindex &cindex,
+                                           bool create) {
+  // We keep the table at most half full.
+  if (create && 2 * (cindex_id_blocks_.size() + 1) >= block_table_.size())
+    ResizeBlockTable(std::max<size_t>(1024, 2 * block_table_.size()));
+  else if (block_table_.empty())
+    return NULL;
+  const Index &index = cindex.second;
+  // this rounds down, also for negative t.
+  int32 t_start = index.t & ~(kBlockSize - 1);
+  size_t mask = block_table_.size() - 1,
+      i = HashCindexIdBlock(cindex.first, index.n, index.x, t_start) & mask;
+  while (true) {
+    int32 b = block_table_[i];
+    if (b == -1)
+      break;
+    CindexIdBlock &block = cindex_id_blocks_[b];
+    if (block.t_start == t_start && block.node_index == cindex.first &&
+        block.n == index.n && block.x == index.x)
+      return block.cindex_ids + (index.t - t_start);
+    i = (i + 1) & mask;
+  }
+  if (!create)
+    return NULL;
+  block_table_[i] = cindex_id_blocks_.size();
+  cindex_id_blocks_.resize(cindex_id_blocks_.size() + 1);
+  CindexIdBlock &block = cindex_id_blocks_.back();
+  block.node_index = cindex.first;
+  block.n = index.n;
+  block.x = index.x;
+  block.t_start = t_start;
+  for (int32 j = 0; j < kBlockSize; j++)
+    block.cindex_ids[j] = -1;
+  return block.cindex_ids + (index.t - t_start);
+}
+
+const int32* ComputationGraph::FindCindexIdEntry(const Cindex &cindex) const {
+  return const_cast<ComputationGraph*>(this)->FindCindexIdEntry(cindex, false);
+}
+
+void ComputationGraph::RebuildCindexIdMap() {
+  cindex_id_blocks_.clear();
+  block_table_.clear();
+  int32 num_cindex_ids = cindexes.size();
+  for (int32 cindex_id = 0; cindex_id < num_cindex_ids; cindex_id++)
+    *FindCindexIdEntry(cindexes[cindex_id], true) = cindex_id;
+}
+
 int32 ComputationGraph::GetCindexId(const Cindex &cindex,
                                     bool input, bool *is_new) {
-  typedef unordered_map<Cindex, int32, CindexHasher> map_type;
-  int32 new_index = cindexes.size();  // we'll add this if we don't find it.
-  std::pair<map_type::iterator, bool> p = cindex_to_cindex_id_.insert(
-      std::pair<Cindex, int32>(cindex, new_index));
-  if (p.second == true) {  // We added something to the hash.
-    *is_new = true;
-    KALDI_ASSERT(is_input.size() == cindexes.size());
-    cindexes.push_back(cindex);
-    is_input.push_back(input);
-    // make room for this "dependencies" entry.
-    dependencies.resize(new_index + 1);
-    return new_index;
-  } else { // We did not add anything.
+  int32 *entry = FindCindexIdEntry(cindex, true);
+  if (*entry != -1) {  // We did not add anything.
     *is_new = false;
-    return p.first->second;
+    return *entry;
   }
+  *is_new = true;
+  int32 new_index = cindexes.size();
+  *entry = new_index;
+  KALDI_ASSERT(is_input.size() == cindexes.size());
+  cindexes.push_back(cindex);
+  is_input.push_back(input);
+  // make room for this "dependencies" entry.
+  dependencies.resize(new_index + 1);
+  return new_index;
 }
+
 int32 ComputationGraph::GetCindexId(const Cindex &cindex) const {
-  typedef unordered_map<Cindex, int32, CindexHasher> map_type;
-  map_type::const_iterator iter = cindex_to_cindex_id_.find(cindex);
-  if (iter == cindex_to_cindex_id_.end())
-    return -1;
-  else
-    return iter->second;
+  const int32 *entry = FindCindexIdEntry(cindex);
+  return (entry == NULL ? -1 : *entry);
 }
 
 
@@ -79,17 +154,6 @@ void ComputationGraph::Renumber(int32 start_cindex_id,
     return;
   }
 
-  for (int32 old_cindex_id = start_cindex_id;
-       old_cindex_id < old_num_cindex_ids; old_cindex_id++) {
-    int32 new_cindex_id = old2new[old_cindex_id - start_cindex_id];
-    Cindex &cindex = cindexes[old_cindex_id];
-    if (new_cindex_id == -1) {
-      cindex_to_cindex_id_.erase(cindex);
-    } else if (new_cindex_id != old_cindex_id) {
-      cindex_to_cindex_id_[cindex] = new_cindex_id;
-    }
-  }
-
   std::vector<int32> temp;
   for (int32 c = start_cindex_id; c < new_num_cindex_ids; c++) {
     int32 d = new2old[c - start_cindex_id];
@@ -120,6 +184,8 @@ void ComputationGraph::Renumber(int32 start_cindex_id,
   cindexes.resize(new_num_cindex_ids);
   is_input.resize(new_num_cindex_ids);
   dependencies.resize(new_num_cindex_ids);
+  // It's simpler to rebuild the map than to delete entries from it.
+  RebuildCindexIdMap();
 }
 
 void ComputationGraphBuilder::PrintCindexId(std::ostream &os,
@@ -106,9 +106,41 @@ struct ComputationGraph {
   void Print(std::ostream &os, const std::vector<std::string> &node_names);
 
  private:
+  // The map from Cindex to cindex_id is stored in blocks of kBlockSize
+  // consecutive 't' values that have the same node-index, 'n' and 'x'; graph
+  // building mostly looks up cindexes with nearby 't' values one after the
+  // other, and this way they are mostly found in the same cache line.
+  static const int32 kBlockSize = 16;
+  struct CindexIdBlock {
+    int32 node_index;
+    int32 n;
+    int32 x;
+    int32 t_start;  // a multiple of kBlockSize.
+    int32 cindex_ids[kBlockSize];  // -1 for Cindexes that are not present.
+  };
+
+  // Returns the address of the element of a block that holds the cindex_id
+  // for this Cindex; if there is no such block, returns NULL if create ==
+  // false, and otherwise creates the block.
+  int32 *FindCindexIdEntry(const Cindex &cindex, bool create);
+  const int32 *FindCindexIdEntry(const Cindex &cindex) const;
+
+  // Resizes block_table_ to have 'size' entries (a power of two), and
+  // re-inserts all the blocks.
+  void ResizeBlockTable(size_t size);
+
+  // Recreates the blocks from "cindexes".
+  void RebuildCindexIdMap();
+
   /// Maps each Cindex to an integer cindex_id: reverse mapping of "cindexes".
-  /// Must be accessed via the GetCindexId() functions.
-  unordered_map<Cindex, int32, CindexHasher> cindex_to_cindex_id_;
+  /// Must be accessed via the GetCindexId() functions.  The blocks are indexed
+  /// by a hash table with open addressing and linear probing, whose size is a
+  /// power of two; it contains indexes into cindex_id_blocks_, or -1 for empty
+  /// entries.  For large computations the graph can have millions of
+  /// cindexes, and this lookup, which is the innermost loop of graph building,
+  /// was much slower with std::unordered_map.
+  std::vector<CindexIdBlock> cindex_id_blocks_;
+  std::vector<int32> block_table_;
 };
 
 
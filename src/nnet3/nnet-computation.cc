@@ -549,7 +549,14 @@ static void PrintCommand(std::ostream &os_out,
       if (c.arg2 == 0) os << "NULL, ";
       else os << "precomputed_indexes[" << c.arg2 << "], ";
       os << submatrix_strings[c.arg3] << ", &" << submatrix_strings[c.arg4]
-         << ")\n";
+         << ")";
+      if (c.arg7 >= 0) {  // see FusePropagations().
+        os << " [fused with " << nnet.GetComponentName(c.arg7);
+        if (c.alpha != 1.0)
+          os << ", scale=" << c.alpha;
+        os << "]";
+      }
+      os << "\n";
       break;
     case kBackprop:
     case kBackpropNoModelUpdate: {
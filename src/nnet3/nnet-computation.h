@@ -205,6 +205,10 @@ struct ComputationRequestPtrEqual {
      - arg6 is 1 if we need to call StoreStats() after the Propagate, or 0
        if we don't.  We used to have a separate command for storing the
        stats, but that has been removed.
+     - arg7 is normally -1; if it is a component-index (of a
+       RectifiedLinearComponent), the optimizer has fused the propagation
+       with that of the rectifier that followed it, and with a scale 'alpha';
+       see FusePropagations().
    - kBackprop: Do the back-propagation operation, see Component::Backprop()
      - arg1 is index of component in neural net
      - arg2 is index into ComponentPrecomputedIndexes (0 if NULL; always 0
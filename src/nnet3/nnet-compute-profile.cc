@@ -0,0 +1,179 @@
+// nnet3/nnet-compute-profile.cc
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <iomanip>
+#include "nnet3/nnet-compute-profile.h"
+#include "util/kaldi-io.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+namespace {
+
+// Writes 's' as a quoted JSON string.
+void WriteJsonString(std::ostream &os, const std::string &s) {
+  os << '"';
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '"' || s[i] == '\\') os << '\\';
+    os << s[i];
+  }
+  os << '"';
+}
+
+}  // namespace
+
+
+NnetComputeProfiler &NnetComputeProfiler::Instance() {
+  static NnetComputeProfiler profiler;
+  return profiler;
+}
+
+int32 NnetComputeProfiler::ThreadIndex() {
+  std::thread::id id = std::this_thread::get_id();
+  for (size_t i = 0; i < threads_.size(); i++)
+    if (threads_[i] == id)
+      return i;
+  threads_.push_back(id);
+  return threads_.size() - 1;
+}
+
+void NnetComputeProfiler::Record(const std::string &name,
+                                 const char *operation,
+                                 double start, double elapsed,
+                                 int64 flops, int64 bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_[std::make_pair(name, std::string(operation))].Add(elapsed, flops,
+                                                           bytes);
+  if (events_.size() < kMaxEvents) {
+    Event event;
+    event.name = name;
+    event.operation = operation;
+    event.start = start;
+    event.elapsed = elapsed;
+    event.flops = flops;
+    event.bytes = bytes;
+    event.thread = ThreadIndex();
+    events_.push_back(event);
+  }
+}
+
+void NnetComputeProfiler::WriteJson(std::ostream &os) const {
+  typedef std::pair<std::pair<std::string, std::string>, Stats> Entry;
+  std::vector<Entry> entries(stats_.begin(), stats_.end());
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) {
+              return a.second.seconds > b.second.seconds; });
+  double total_seconds = 0.0;
+  for (size_t i = 0; i < entries.size(); i++)
+    total_seconds += entries[i].second.seconds;
+  os << "{\n  \"total_seconds\": " << total_seconds << ",\n";
+  // We write the component operations and the other commands separately.
+  for (int32 pass = 0; pass < 2; pass++) {
+    os << (pass == 0 ? "  \"components\": [" : "  \"commands\": [");
+    bool first = true;
+    for (size_t i = 0; i < entries.size(); i++) {
+      const std::string &operation = entries[i].first.second;
+      if ((operation == "matrix") != (pass == 1))
+        continue;
+      const Stats &stats = entries[i].second;
+      os << (first ? "\n" : ",\n") << "    {\"name\": ";
+      WriteJsonString(os, entries[i].first.first);
+      if (pass == 0) {
+        os << ", \"operation\": ";
+        WriteJsonString(os, operation);
+      }
+      os << ", \"count\": " << stats.count
+         << ", \"seconds\": " << stats.seconds
+         << ", \"flops\": " << stats.flops
+         << ", \"bytes\": " << stats.bytes
+         << ", \"gflops_per_second\": "
+         << (stats.seconds > 0.0 ? stats.flops / stats.seconds * 1.0e-09 : 0.0)
+         << ", \"gbytes_per_second\": "
+         << (stats.seconds > 0.0 ? stats.bytes / stats.seconds * 1.0e-09 : 0.0)
+         << "}";
+      first = false;
+    }
+    os << "\n  ]" << (pass == 0 ? ",\n" : "\n");
+  }
+  os << "}\n";
+}
+
+void NnetComputeProfiler::WriteChromeTrace(std::ostream &os) const {
+  os << "[";
+  for (size_t i = 0; i < events_.size(); i++) {
+    const Event &event = events_[i];
+    // times are in microseconds.
+    os << (i == 0 ? "\n" : ",\n") << "{\"name\": ";
+    WriteJsonString(os, event.name);
+    os << ", \"cat\": \"" << event.operation << "\", \"ph\": \"X\""
+       << ", \"ts\": " << std::fixed << std::setprecision(3)
+       << (event.start * 1.0e+06)
+       << ", \"dur\": " << (event.elapsed * 1.0e+06)
+       << std::defaultfloat
+       << ", \"pid\": 0, \"tid\": " << event.thread
+       << ", \"args\": {\"flops\": " << event.flops
+       << ", \"bytes\": " << event.bytes << "}}";
+  }
+  os << "\n]\n";
+}
+
+void NnetComputeProfiler::Write(const std::string &filename,
+                                const std::string &format) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (format != "json" && format != "chrome")
+    KALDI_ERR << "Invalid profile format '" << format
+              << "', expected 'json' or 'chrome'";
+  {
+    Output ko(filename, false);
+    if (format == "json")
+      WriteJson(ko.Stream());
+    else
+      WriteChromeTrace(ko.Stream());
+  }
+  if (format == "chrome" && events_.size() == kMaxEvents)
+    KALDI_WARN << "Only the first " << kMaxEvents << " commands were "
+               << "written to the trace.";
+
+  // Print the components with the largest total time.
+  typedef std::pair<std::pair<std::string, std::string>, Stats> Entry;
+  std::vector<Entry> entries(stats_.begin(), stats_.end());
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) {
+              return a.second.seconds > b.second.seconds; });
+  double total_seconds = 0.0;
+  for (size_t i = 0; i < entries.size(); i++)
+    total_seconds += entries[i].second.seconds;
+  std::ostringstream os;
+  os << "Wrote nnet3 computation profile to " << filename << "; total time "
+     << total_seconds << "s, of which:\n";
+  for (size_t i = 0; i < std::min<size_t>(entries.size(), 20); i++) {
+    const Stats &stats = entries[i].second;
+    os << "  " << entries[i].first.first << " (" << entries[i].first.second
+       << "): " << stats.seconds << "s in " << stats.count << " calls, "
+       << (stats.seconds > 0.0 ? stats.flops / stats.seconds * 1.0e-09 : 0.0)
+       << " GFlop/s, "
+       << (stats.seconds > 0.0 ? stats.bytes / stats.seconds * 1.0e-09 : 0.0)
+       << " GB/s\n";
+  }
+  KALDI_LOG << os.str();
+}
+
+} // namespace nnet3
+} // namespace kaldi
@@ -0,0 +1,116 @@
+// nnet3/nnet-compute-profile.h
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_COMPUTE_PROFILE_H_
+#define KALDI_NNET3_NNET_COMPUTE_PROFILE_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+/**
+   NnetComputeProfiler accumulates the profile of the commands executed by
+   NnetComputer::Run() when the --profile-file option of NnetComputeOptions is
+   set (see WriteNnetComputeProfile() in nnet-compute.h).  For each command it
+   is given the elapsed time (measured with the GPU synchronized before and
+   after the command, so it is the actual time of the command's kernels), and
+   estimates of the floating-point operations and of the bytes of memory read
+   and written; these are summed per component and operation (e.g. the
+   propagate of component "tdnn3.affine") and per command type (e.g.
+   "kAddRows"), and the individual commands are also kept, up to a limit, for
+   writing in Chrome trace format.
+
+   There is one profiler per process (see Instance()); it may be used from
+   several threads.
+*/
+class NnetComputeProfiler {
+ public:
+  static NnetComputeProfiler &Instance();
+
+  /// Returns the time in seconds since the profiler was created.
+  double Now() const { return timer_.Elapsed(); }
+
+  /// Records the execution of one command.  'name' is the component name for
+  /// component commands and the command type otherwise; 'operation' is e.g.
+  /// "propagate", "backprop" or "matrix".  'start' is as returned by Now().
+  void Record(const std::string &name, const char *operation,
+              double start, double elapsed, int64 flops, int64 bytes);
+
+  /// Writes the profile to 'filename'.  If format == "json", it writes the
+  /// sums per component/operation and per command type as a JSON object
+  /// (sorted by decreasing time); if format == "chrome", it writes the
+  /// individual commands as a JSON array of trace events, for
+  /// chrome://tracing or Perfetto.  Also prints a summary with KALDI_LOG.
+  void Write(const std::string &filename, const std::string &format) const;
+
+ private:
+  NnetComputeProfiler() { }
+
+  struct Stats {
+    int64 count;
+    double seconds;
+    double flops;
+    double bytes;
+    Stats(): count(0), seconds(0.0), flops(0.0), bytes(0.0) { }
+    void Add(double elapsed, int64 f, int64 b) {
+      count++;
+      seconds += elapsed;
+      flops += f;
+      bytes += b;
+    }
+  };
+  struct Event {
+    std::string name;
+    const char *operation;
+    double start;
+    double elapsed;
+    int64 flops;
+    int64 bytes;
+    int32 thread;
+  };
+  // We don't keep more than this many events for the Chrome trace.
+  static const size_t kMaxEvents = 1000000;
+
+  void WriteJson(std::ostream &os) const;
+  void WriteChromeTrace(std::ostream &os) const;
+  // Returns a small integer identifying the calling thread.
+  int32 ThreadIndex();
+
+  Timer timer_;
+  mutable std::mutex mutex_;
+  // indexed by (name, operation).
+  std::map<std::pair<std::string, std::string>, Stats> stats_;
+  std::vector<Event> events_;
+  std::vector<std::thread::id> threads_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetComputeProfiler);
+};
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif  // KALDI_NNET3_NNET_COMPUTE_PROFILE_H_
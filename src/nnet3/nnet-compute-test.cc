@@ -27,6 +27,7 @@
 #include "nnet3/nnet-compute.h"
 #include "nnet3/nnet-am-decodable-simple.h"
 #include "nnet3/decodable-simple-looped.h"
+#include "nnet3/decodable-online-looped.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -144,6 +145,110 @@ void TestNnetDecodable(Nnet *nnet) {
   }
 }
 
+// Wraps a matrix of features, all of which are ready.
+class TestMatrixFeature: public OnlineFeatureInterface {
+ public:
+  explicit TestMatrixFeature(const MatrixBase<BaseFloat> &mat): mat_(mat) { }
+  virtual int32 Dim() const { return mat_.NumCols(); }
+  virtual BaseFloat FrameShiftInSeconds() const { return 0.01; }
+  virtual int32 NumFramesReady() const { return mat_.NumRows(); }
+  virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
+    feat->CopyFromVec(mat_.Row(frame));
+  }
+  virtual bool IsLastFrame(int32 frame) const {
+    return (frame + 1 == mat_.NumRows());
+  }
+ private:
+  const MatrixBase<BaseFloat> &mat_;
+};
+
+// Tests that starting an utterance from the state of the looped computation
+// kept from a previous one (DecodableNnetLoopedOnlineBase::SetLoopedState())
+// gives the same output as a computation over the two utterances' features
+// spliced together.
+void TestNnetDecodableWarmStart(Nnet *nnet) {
+  int32 num_frames1 = RandInt(1, 100), num_frames2 = RandInt(1, 50),
+      input_dim = nnet->InputDim("input"),
+      ivector_dim = std::max<int32>(0, nnet->InputDim("ivector"));
+  SetBatchnormTestMode(true, nnet);
+  SetDropoutTestMode(true, nnet);
+
+  NnetSimpleLoopedComputationOptions opts;
+  opts.frames_per_chunk = RandInt(1, 30);
+  Vector<BaseFloat> priors;
+  DecodableNnetSimpleLoopedInfo info(opts, priors, nnet);
+
+  Matrix<BaseFloat> input1(num_frames1, input_dim),
+      input2(num_frames2, input_dim);
+  input1.SetRandn();
+  input2.SetRandn();
+  // The iVectors are the same for all frames.
+  Vector<BaseFloat> ivector(ivector_dim);
+  ivector.SetRandn();
+  Matrix<BaseFloat> ivectors;
+  if (ivector_dim != 0) {
+    ivectors.Resize(100 + num_frames1 + num_frames2, ivector_dim);
+    ivectors.CopyRowsFromVec(ivector);
+  }
+  TestMatrixFeature ivector_feature(ivectors);
+  OnlineFeatureInterface *ivector_ptr =
+      (ivector_dim != 0 ? &ivector_feature : NULL);
+
+  DecodableNnetLoopedState state;
+  {
+    TestMatrixFeature feature1(input1);
+    DecodableNnetLoopedOnline decodable1(info, &feature1, ivector_ptr);
+    decodable1.SetKeepLoopedState(true);
+    int32 num_output_frames = decodable1.NumFramesReady();
+    for (int32 t = 0; t < num_output_frames; t++)
+      decodable1.LogLikelihood(t, 1);
+    if (!decodable1.GetLoopedState(&state)) {
+      KALDI_LOG << "Utterance too short to test warm start.";
+      return;
+    }
+  }
+
+  Matrix<BaseFloat> output2;
+  {
+    TestMatrixFeature feature2(input2);
+    DecodableNnetLoopedOnline decodable2(info, &feature2, ivector_ptr);
+    decodable2.SetLoopedState(state);
+    int32 num_output_frames = decodable2.NumFramesReady();
+    output2.Resize(num_output_frames, info.output_dim);
+    for (int32 t = 0; t < num_output_frames; t++)
+      for (int32 i = 0; i < info.output_dim; i++)
+        output2(t, i) = decodable2.LogLikelihood(t, i + 1);
+  }
+
+  // The spliced features: the part of input1 that the state was computed
+  // from, then copies of the first frame of input2 up to a multiple of the
+  // frame-subsampling factor, then input2.
+  int32 sf = opts.frame_subsampling_factor,
+      num_used1 = state.num_chunks_computed * info.frames_per_chunk +
+                  info.frames_right_context,
+      padding = (sf - info.frames_right_context % sf) % sf;
+  KALDI_ASSERT(num_used1 <= num_frames1);
+  Matrix<BaseFloat> spliced(num_used1 + padding + num_frames2, input_dim);
+  spliced.RowRange(0, num_used1).CopyFromMat(input1.RowRange(0, num_used1));
+  for (int32 i = 0; i < padding; i++)
+    spliced.Row(num_used1 + i).CopyFromVec(input2.Row(0));
+  spliced.RowRange(num_used1 + padding, num_frames2).CopyFromMat(input2);
+
+  TestMatrixFeature spliced_feature(spliced);
+  DecodableNnetLoopedOnline decodable3(info, &spliced_feature, ivector_ptr);
+  int32 offset = (num_used1 + padding) / sf;
+  KALDI_ASSERT(decodable3.NumFramesReady() == offset + output2.NumRows());
+  for (int32 t = 0; t < offset; t++)
+    decodable3.LogLikelihood(t, 1);
+  for (int32 t = 0; t < output2.NumRows(); t++) {
+    for (int32 i = 0; i < info.output_dim; i++) {
+      BaseFloat a = output2(t, i),
+          b = decodable3.LogLikelihood(offset + t, i + 1);
+      KALDI_ASSERT(ApproxEqual(a, b, 0.01));
+    }
+  }
+}
+
 void UnitTestNnetCompute() {
   for (int32 n = 0; n < 20; n++) {
     struct NnetGenerationOptions gen_config;
@@ -238,6 +343,46 @@ void UnitTestNnetCompute() {
 
     KALDI_LOG << "Output sum is " << output.Sum();
 
+    if (NnetCudaGraphComputer::IsSuitable(computation)) {
+      std::shared_ptr<const NnetComputation> computation_ptr(
+          new NnetComputation(computation));
+      NnetCudaGraphComputer graph_computer(compute_opts, computation_ptr,
+                                           nnet);
+      // Run it twice, as the second run replays the graph (with a GPU).
+      for (int32 n = 0; n < 2; n++) {
+        for (size_t i = 0; i < request.inputs.size(); i++) {
+          CuMatrix<BaseFloat> temp(inputs[i]);
+          graph_computer.AcceptInput(request.inputs[i].name, temp);
+        }
+        graph_computer.Run();
+        const CuMatrixBase<BaseFloat> &output_graph(
+            graph_computer.GetOutput("output"));
+        KALDI_LOG << "Output sum [graph] is " << output_graph.Sum();
+        if (!ApproxEqual(output, output_graph))
+          KALDI_ERR << "Regular and graph computations' outputs differ";
+      }
+    }
+
+    if (test_collapse_model && !request.NeedDerivatives()) {
+      // Test that after Reset(), the computation gives the same output when
+      // run again.  (We need test mode to be set, so that dropout is
+      // deterministic.)
+      NnetComputer computer_reset(compute_opts, computation, &nnet, NULL);
+      for (int32 n = 0; n < 2; n++) {
+        if (n == 1)
+          computer_reset.Reset();
+        for (size_t i = 0; i < request.inputs.size(); i++) {
+          CuMatrix<BaseFloat> temp(inputs[i]);
+          computer_reset.AcceptInput(request.inputs[i].name, &temp);
+        }
+        computer_reset.Run();
+        const CuMatrixBase<BaseFloat> &output_reset(
+            computer_reset.GetOutput("output"));
+        if (!ApproxEqual(output, output_reset))
+          KALDI_ERR << "Outputs differ after NnetComputer::Reset()";
+      }
+    }
+
     if (test_collapse_model) {
       NnetComputer computer_collapsed(compute_opts,
                                       computation_collapsed,
@@ -273,6 +418,7 @@ void UnitTestNnetCompute() {
       }
     }
     TestNnetDecodable(&nnet);
+    TestNnetDecodableWarmStart(&nnet);
   }
 }
 
@@ -17,9 +17,15 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <iterator>
 #include <sstream>
 #include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-augment.h"
+#include "nnet3/nnet-compute-profile.h"
+#include "nnet3/nnet-simple-component.h"
+#include "nnet3/nnet-convolutional-component.h"
+#include "cudamatrix/cu-device.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -207,6 +213,28 @@ NnetComputer::NnetComputer(const NnetComputer &other):
   }
 }
 
+// Calls the PropagateRectified() function of 'component', which must be one
+// that FusePropagations() fuses.
+static void PropagateRectified(const Component &component,
+                               const ComponentPrecomputedIndexes *indexes,
+                               const CuMatrixBase<BaseFloat> &in,
+                               BaseFloat scale,
+                               CuMatrixBase<BaseFloat> *out) {
+  const AffineComponent *affine =
+      dynamic_cast<const AffineComponent*>(&component);
+  if (affine != NULL) {
+    affine->PropagateRectified(in, scale, out);
+    return;
+  }
+  const TdnnComponent *tdnn = dynamic_cast<const TdnnComponent*>(&component);
+  if (tdnn != NULL) {
+    tdnn->PropagateRectified(indexes, in, scale, out);
+    return;
+  }
+  KALDI_ERR << "Fused propagation is not supported for component of type "
+            << component.Type();
+}
+
 void NnetComputer::ExecuteCommand() {
   const NnetComputation::Command &c = computation_.commands[program_counter_];
   int32 m1, m2;
@@ -240,6 +268,12 @@ void NnetComputer::ExecuteCommand() {
             computation_.component_precomputed_indexes[c.arg2].data;
         const CuSubMatrix<BaseFloat> input(GetSubMatrix(c.arg3));
         CuSubMatrix<BaseFloat> output(GetSubMatrix(c.arg4));
+        if (c.arg7 >= 0) {
+          // The optimizer fused this with the rectifier (and the scale) that
+          // followed it; see FusePropagations().
+          PropagateRectified(*component, indexes, input, c.alpha, &output);
+          break;
+        }
         void *memo = component->Propagate(indexes, input, &output);
         if (c.arg6) {  // need to store stats.
           KALDI_ASSERT(nnet_to_store_stats_ != NULL);
@@ -507,6 +541,109 @@ void NnetComputer::GetPointers(int32 indexes_multi_index,
               reinterpret_cast<CuArray<BaseFloat*>*>(pointers));
 }
 
+namespace {
+
+// Waits until the GPU work queued by this thread is done (does nothing if no
+// GPU is used).
+void SynchronizeStream() {
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
+#endif
+}
+
+// The names of the command types, indexed by CommandType.
+const char *kCommandTypeNames[] = {
+  "kAllocMatrix", "kDeallocMatrix", "kSwapMatrix", "kSetConst",
+  "kPropagate", "kBackprop", "kBackpropNoModelUpdate",
+  "kMatrixCopy", "kMatrixAdd", "kCopyRows", "kAddRows",
+  "kCopyRowsMulti", "kCopyToRowsMulti", "kAddRowsMulti", "kAddToRowsMulti",
+  "kAddRowRanges", "kCompressMatrix", "kDecompressMatrix",
+  "kAcceptInput", "kProvideOutput",
+  "kNoOperation", "kNoOperationPermanent", "kNoOperationMarker",
+  "kNoOperationLabel", "kGotoLabel" };
+
+}  // namespace
+
+int64 NnetComputer::SubMatrixSize(int32 submatrix_index) const {
+  if (submatrix_index <= 0)
+    return 0;
+  const NnetComputation::SubMatrixInfo &info =
+      computation_.submatrices[submatrix_index];
+  return static_cast<int64>(info.num_rows) * info.num_cols;
+}
+
+void NnetComputer::ProfileCommand(int32 command, double start,
+                                  double elapsed) {
+  const NnetComputation::Command &c = computation_.commands[command];
+  // 'flops' and 'elements' (the number of floats read or written) are rough
+  // estimates.  For components with parameters, we count 2 flops per
+  // parameter and row, which is right for affine-type components.
+  int64 flops = 0, elements = 0;
+  switch (c.command_type) {
+    case kPropagate: case kBackprop: case kBackpropNoModelUpdate: {
+      const Component *component = nnet_.GetComponent(c.arg1);
+      const UpdatableComponent *uc =
+          dynamic_cast<const UpdatableComponent*>(component);
+      int64 num_params = (uc != NULL ? uc->NumParameters() : 0);
+      bool propagate = (c.command_type == kPropagate);
+      int64 num_rows = computation_.submatrices[
+          propagate ? c.arg4 : c.arg5].num_rows;
+      if (propagate) {
+        elements = SubMatrixSize(c.arg3) + SubMatrixSize(c.arg4) + num_params;
+        flops = (num_params != 0 ? 2 * num_rows * num_params :
+                 SubMatrixSize(c.arg4));
+      } else {
+        elements = SubMatrixSize(c.arg3) + SubMatrixSize(c.arg4) +
+            SubMatrixSize(c.arg5) + SubMatrixSize(c.arg6) + num_params;
+        // one product for the input derivative and one for the parameter
+        // derivative.
+        int32 num_products = (c.arg6 > 0 ? 1 : 0) +
+            (c.command_type == kBackprop && num_params != 0 ? 1 : 0);
+        flops = (num_params != 0 ? 2 * num_rows * num_params * num_products :
+                 SubMatrixSize(c.arg6));
+      }
+      NnetComputeProfiler::Instance().Record(
+          nnet_.GetComponentName(c.arg1),
+          propagate ? "propagate" : "backprop",
+          start, elapsed, flops, elements * sizeof(BaseFloat));
+      return;
+    }
+    case kSetConst:
+      elements = SubMatrixSize(c.arg1);
+      break;
+    case kMatrixCopy: case kCopyRows: case kCopyRowsMulti:
+    case kCopyToRowsMulti:
+      elements = 2 * SubMatrixSize(c.arg1);
+      break;
+    case kMatrixAdd: case kAddRows: case kAddRowsMulti: case kAddToRowsMulti:
+      elements = 3 * SubMatrixSize(c.arg1);
+      flops = SubMatrixSize(c.arg1);
+      break;
+    case kAddRowRanges:
+      elements = 2 * SubMatrixSize(c.arg1) + SubMatrixSize(c.arg2);
+      flops = SubMatrixSize(c.arg2);
+      break;
+    case kCompressMatrix: case kDecompressMatrix:
+      elements = SubMatrixSize(c.arg1);
+      break;
+    case kNoOperation: case kNoOperationPermanent: case kNoOperationMarker:
+    case kNoOperationLabel: case kGotoLabel:
+      return;
+    default:
+      break;
+  }
+  NnetComputeProfiler::Instance().Record(
+      kCommandTypeNames[c.command_type], "matrix", start, elapsed, flops,
+      elements * sizeof(BaseFloat));
+}
+
+void WriteNnetComputeProfile(const NnetComputeOptions &opts) {
+  if (!opts.profile_file.empty())
+    NnetComputeProfiler::Instance().Write(opts.profile_file,
+                                          opts.profile_format);
+}
+
 void NnetComputer::Run() {
   const std::vector<NnetComputation::Command> &c = computation_.commands;
   int32 num_commands = c.size();
@@ -521,6 +658,7 @@ void NnetComputer::Run() {
   CommandDebugInfo info;
   Timer timer;
   double total_elapsed_previous = 0.0;
+  bool profile = !options_.profile_file.empty();
 
   for (; program_counter_ < num_commands; program_counter_++) {
     if (c[program_counter_].command_type == kAcceptInput ||
@@ -531,7 +669,18 @@ void NnetComputer::Run() {
     }
     if (debug_)
       DebugBeforeExecute(program_counter_, &info);
-    ExecuteCommand();
+    if (profile) {
+      NnetComputeProfiler &profiler = NnetComputeProfiler::Instance();
+      // We synchronize the GPU so that the time is that of the command's own
+      // kernels.
+      SynchronizeStream();
+      double start = profiler.Now();
+      ExecuteCommand();
+      SynchronizeStream();
+      ProfileCommand(program_counter_, start, profiler.Now() - start);
+    } else {
+      ExecuteCommand();
+    }
     if (debug_) {
       double total_elapsed_now = timer.Elapsed();
       DebugAfterExecute(program_counter_, info,
@@ -590,6 +739,10 @@ void NnetComputer::GetOutputDestructive(const std::string &node_name,
   matrices_[matrix_index].Resize(0, 0);
 }
 
+CuMatrix<BaseFloat> &NnetComputer::GetMatrix(int32 matrix_index) {
+  KALDI_ASSERT(static_cast<size_t>(matrix_index) < matrices_.size());
+  return matrices_[matrix_index];
+}
 
 void NnetComputer::CheckNoPendingIo() {
   const std::vector<NnetComputation::Command> &c = computation_.commands;
@@ -674,6 +827,56 @@ void NnetComputer::AcceptInputs(const Nnet &nnet,
   }
 }
 
+void NnetComputer::Reset() {
+  for (size_t i = 0; i < memos_.size(); i++)
+    if (memos_[i] != NULL)
+      KALDI_ERR << "NnetComputer::Reset() called while memos are stored.";
+  program_counter_ = 0;
+  pending_commands_.clear();
+  for (size_t i = 0; i < compressed_matrices_.size(); i++) {
+    delete compressed_matrices_[i];
+    compressed_matrices_[i] = NULL;
+  }
+}
+
+void NnetComputer::SaveState(NnetComputerState *state) const {
+  for (size_t i = 0; i < memos_.size(); i++)
+    if (memos_[i] != NULL)
+      KALDI_ERR << "NnetComputer::SaveState() called while memos are stored.";
+  for (size_t i = 0; i < compressed_matrices_.size(); i++)
+    if (compressed_matrices_[i] != NULL)
+      KALDI_ERR << "NnetComputer::SaveState() called while matrices are "
+          "compressed.";
+  state->program_counter = program_counter_;
+  state->pending_commands = pending_commands_;
+  state->matrices.resize(matrices_.size());
+  for (size_t m = 0; m < matrices_.size(); m++) {
+    const CuMatrix<BaseFloat> &src = matrices_[m];
+    CuMatrix<BaseFloat> &dest = state->matrices[m];
+    dest.Resize(src.NumRows(), src.NumCols(), kUndefined,
+                computation_.matrices[m].stride_type);
+    if (src.NumRows() != 0)
+      dest.CopyFromMat(src);
+  }
+}
+
+void NnetComputer::RestoreState(const NnetComputerState &state) {
+  if (state.program_counter < 0 ||
+      state.matrices.size() != matrices_.size())
+    KALDI_ERR << "NnetComputer::RestoreState(): the state is empty or is "
+        "from a different computation.";
+  Reset();
+  program_counter_ = state.program_counter;
+  pending_commands_ = state.pending_commands;
+  for (size_t m = 0; m < matrices_.size(); m++) {
+    const CuMatrix<BaseFloat> &src = state.matrices[m];
+    matrices_[m].Resize(src.NumRows(), src.NumCols(), kUndefined,
+                        computation_.matrices[m].stride_type);
+    if (src.NumRows() != 0)
+      matrices_[m].CopyFromMat(src);
+  }
+}
+
 NnetComputer::~NnetComputer() {
   // Delete any pointers that are present in compressed_matrices_.  Actually
   // they should all already have been deallocated and set to NULL if the
@@ -683,5 +886,350 @@ NnetComputer::~NnetComputer() {
     delete compressed_matrices_[i];
 }
 
+
+NnetCudaGraphComputer::NnetCudaGraphComputer(
+    const NnetComputeOptions &options,
+    const std::shared_ptr<const NnetComputation> &computation,
+    const Nnet &nnet):
+    options_(options), computation_(computation), nnet_(nnet),
+    computer_(options, *computation, nnet, NULL),
+#if HAVE_CUDA == 1
+    graph_exec_(NULL),
+#endif
+    have_graph_(false) {
+  if (!IsSuitable(*computation_))
+    KALDI_ERR << "This computation cannot be run by NnetCudaGraphComputer.";
+  const std::vector<NnetComputation::Command> &c = computation_->commands;
+  int32 num_commands = c.size();
+  std::vector<CuMatrix<BaseFloat> > &matrices = computer_.matrices_;
+
+  bool capture = false;
+#if HAVE_CUDA == 1
+  // The debug code reads the matrices back to the host after each command,
+  // which can't be done while capturing.
+  capture = CuDevice::Instantiate().Enabled() && !computer_.debug_;
+#endif
+  if (capture) {
+    // All the matrices are allocated first, as the allocator may synchronize,
+    // which is not allowed while capturing; the inputs are allocated here
+    // too, as the graph will read them from there.
+    for (int32 i = 0; i < num_commands; i++) {
+      if (c[i].command_type == kAllocMatrix ||
+          c[i].command_type == kAcceptInput) {
+        int32 m = computation_->submatrices[c[i].arg1].matrix_index;
+        const NnetComputation::MatrixInfo &info = computation_->matrices[m];
+        if (matrices[m].NumRows() == 0)
+          matrices[m].Resize(info.num_rows, info.num_cols, kUndefined,
+                             info.stride_type);
+      }
+    }
+  }
+#if HAVE_CUDA == 1
+  if (capture) {
+    CuDevice::Instantiate().SetDeferredFrees(&deferred_frees_);
+    CU_SAFE_CALL(cudaStreamBeginCapture(GetCudaStream(),
+                                        cudaStreamCaptureModeRelaxed));
+  }
+#endif
+  // While capturing, the commands are only recorded, not executed.  The
+  // deallocations are skipped so that no memory the graph uses is ever given
+  // to anyone else, and kSwapMatrix only swaps pointers, so it just changes
+  // which matrices the later commands are recorded with.
+  bool error = false;
+  try {
+    for (computer_.program_counter_ = 0;
+         computer_.program_counter_ < num_commands;
+         computer_.program_counter_++) {
+      const NnetComputation::Command &command = c[computer_.program_counter_];
+      switch (command.command_type) {
+        case kAllocMatrix: case kDeallocMatrix:
+          break;
+        case kAcceptInput:
+          input_names_.push_back(nnet_.GetNodeName(command.arg2));
+          if (capture)
+            inputs_.push_back(computer_.GetSubMatrix(command.arg1));
+          break;
+        case kProvideOutput:
+          output_names_.push_back(nnet_.GetNodeName(command.arg2));
+          if (capture)
+            graph_outputs_.push_back(computer_.GetSubMatrix(command.arg1));
+          break;
+        default:
+          if (capture)
+            computer_.ExecuteCommand();
+      }
+    }
+  } catch (...) {
+    error = true;
+  }
+  if (error && !capture)
+    KALDI_ERR << "Error setting up NnetCudaGraphComputer.";
+#if HAVE_CUDA == 1
+  if (capture) {
+    cudaGraph_t graph = NULL;
+    cudaError_t ret = cudaStreamEndCapture(GetCudaStream(), &graph);
+    CuDevice::Instantiate().SetDeferredFrees(NULL);
+    if (ret == cudaSuccess && !error)
+      ret = cudaGraphInstantiateWithFlags(&graph_exec_, graph, 0);
+    if (graph != NULL)
+      cudaGraphDestroy(graph);
+    if (ret == cudaSuccess && !error) {
+      have_graph_ = true;
+    } else {
+      cudaGetLastError();  // clears the error.
+      graph_exec_ = NULL;
+      KALDI_WARN << "Could not capture the computation into a CUDA graph ("
+                 << (error ? "a command failed" : cudaGetErrorString(ret))
+                 << "); it will be run without one.";
+      // Nothing that was recorded has been run, so the memory can go back.
+      for (size_t i = 0; i < deferred_frees_.size(); i++)
+        CuDevice::Instantiate().Free(deferred_frees_[i]);
+      deferred_frees_.clear();
+      for (size_t i = 0; i < matrices.size(); i++)
+        matrices[i].Resize(0, 0);
+    }
+  }
+#endif
+  if (!have_graph_) {
+    inputs_.clear();
+    graph_outputs_.clear();
+    input_values_.resize(input_names_.size());
+    outputs_.resize(output_names_.size());
+  }
+}
+
+bool NnetCudaGraphComputer::IsSuitable(const NnetComputation &computation) {
+  if (computation.need_model_derivative)
+    return false;
+  const std::vector<NnetComputation::Command> &c = computation.commands;
+  bool seen_output = false;
+  for (size_t i = 0; i < c.size(); i++) {
+    switch (c[i].command_type) {
+      case kProvideOutput:
+        seen_output = true;
+        break;
+      case kAcceptInput:
+        if (seen_output)  // e.g. an output-derivative, for the backward pass.
+          return false;
+        break;
+      case kBackprop: case kBackpropNoModelUpdate:
+      case kCompressMatrix: case kDecompressMatrix:
+      case kGotoLabel:
+        return false;
+      case kPropagate:
+        if (c[i].arg5 != 0 || c[i].arg6 != 0)  // memo or stats.
+          return false;
+        break;
+      default:
+        break;
+    }
+  }
+  return true;
+}
+
+void NnetCudaGraphComputer::AcceptInput(const std::string &node_name,
+                                        const CuMatrixBase<BaseFloat> &input) {
+  size_t i = std::find(input_names_.begin(), input_names_.end(), node_name) -
+      input_names_.begin();
+  if (i == input_names_.size())
+    KALDI_ERR << "No input named '" << node_name << "' in computation.";
+  if (have_graph_) {
+    inputs_[i].CopyFromMat(input);
+  } else {
+    input_values_[i].Resize(input.NumRows(), input.NumCols(), kUndefined);
+    input_values_[i].CopyFromMat(input);
+  }
+}
+
+void NnetCudaGraphComputer::Run() {
+#if HAVE_CUDA == 1
+  if (have_graph_) {
+    CU_SAFE_CALL(cudaGraphLaunch(graph_exec_, GetCudaStream()));
+    return;
+  }
+#endif
+  RunWithoutGraph();
+}
+
+void NnetCudaGraphComputer::RunWithoutGraph() {
+  NnetComputer computer(options_, *computation_, nnet_, NULL);
+  for (size_t i = 0; i < input_names_.size(); i++) {
+    if (input_values_[i].NumRows() == 0)
+      KALDI_ERR << "Input '" << input_names_[i] << "' was not given.";
+    computer.AcceptInput(input_names_[i], &(input_values_[i]));
+  }
+  // Run() stops before each output, which must be taken there (later calls
+  // to Run() would skip over it).
+  const std::vector<NnetComputation::Command> &c = computation_->commands;
+  int32 num_commands = c.size();
+  while (computer.program_counter_ < num_commands) {
+    computer.Run();
+    while (computer.program_counter_ < num_commands &&
+           c[computer.program_counter_].command_type == kProvideOutput) {
+      const std::string &name =
+          nnet_.GetNodeName(c[computer.program_counter_].arg2);
+      size_t i = std::find(output_names_.begin(), output_names_.end(),
+                           name) - output_names_.begin();
+      KALDI_ASSERT(i < output_names_.size());
+      outputs_[i] = computer.GetOutput(name);
+    }
+  }
+}
+
+const CuMatrixBase<BaseFloat> &NnetCudaGraphComputer::GetOutput(
+    const std::string &node_name) {
+  size_t i = std::find(output_names_.begin(), output_names_.end(),
+                       node_name) - output_names_.begin();
+  if (i == output_names_.size())
+    KALDI_ERR << "No output named '" << node_name << "' in computation.";
+  if (have_graph_)
+    return graph_outputs_[i];
+  return outputs_[i];
+}
+
+NnetCudaGraphComputer::~NnetCudaGraphComputer() {
+#if HAVE_CUDA == 1
+  if (graph_exec_ != NULL)
+    cudaGraphExecDestroy(graph_exec_);
+  for (size_t i = 0; i < deferred_frees_.size(); i++)
+    CuDevice::Instantiate().Free(deferred_frees_[i]);
+#endif
+}
+
+NnetInputPrefetcher::NnetInputPrefetcher(): num_started_(0), exit_(false) { }
+
+void NnetInputPrefetcher::Prefetch(const Nnet &nnet,
+                                   const std::vector<NnetIo> &inputs) {
+#if HAVE_CUDA == 1
+  if (!CuDevice::Instantiate().Enabled())
+    return;
+  Job *job = new Job();
+  job->inputs = &inputs;
+  job->done = false;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    int32 node_index = nnet.GetNodeIndex(inputs[i].name);
+    if (node_index != -1 && nnet.IsInputNode(node_index))
+      job->names.push_back(inputs[i].name);
+  }
+  if (!thread_.joinable()) {
+    CuDevice::Instantiate().AllowMultithreading();
+    thread_ = std::thread(&NnetInputPrefetcher::ThreadFunction, this,
+                          CuDevice::Instantiate().ThreadDeviceId());
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  jobs_.push_back(job);
+  cond_.notify_all();
+#endif
+}
+
+void NnetInputPrefetcher::ThreadFunction(int32 device_id) {
+#if HAVE_CUDA == 1
+  CuDevice::SetThreadDeviceId(device_id);
+  while (true) {
+    Job *job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (num_started_ == jobs_.size() && !exit_)
+        cond_.wait(lock);
+      if (exit_)
+        return;
+      job = jobs_[num_started_++];
+    }
+    std::vector<CuMatrix<BaseFloat>*> matrices;
+    try {
+      const std::vector<NnetIo> &inputs = *(job->inputs);
+      for (size_t i = 0, n = 0; i < inputs.size(); i++) {
+        if (n < job->names.size() && inputs[i].name == job->names[n]) {
+          const GeneralMatrix &features = inputs[i].features;
+          CuMatrix<BaseFloat> *mat = new CuMatrix<BaseFloat>(
+              features.NumRows(), features.NumCols(), kUndefined);
+          matrices.push_back(mat);
+          mat->CopyFromGeneralMat(features);
+          n++;
+        }
+      }
+      // The computation may use the matrices as soon as 'done' is set, on
+      // another stream, so wait for the copies to finish.
+      CU_SAFE_CALL(cudaStreamSynchronize(GetCudaStream()));
+    } catch (const std::exception &e) {
+      KALDI_WARN << "Error prefetching inputs; they will be copied "
+          "synchronously.";
+      for (size_t i = 0; i < matrices.size(); i++)
+        delete matrices[i];
+      matrices.clear();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    job->matrices.swap(matrices);
+    if (job->matrices.size() != job->names.size())
+      job->names.clear();
+    job->done = true;
+    cond_.notify_all();
+  }
+#endif
+}
+
+void NnetInputPrefetcher::AcceptInputs(const Nnet &nnet,
+                                       const std::vector<NnetIo> &inputs,
+                                       NnetComputer *computer,
+                                       const NnetInputAugmenter *augmenter) {
+  Job *job = NULL;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t i = 0;
+    while (i < jobs_.size() && jobs_[i]->inputs != &inputs)
+      i++;
+    if (i < jobs_.size()) {
+      // The jobs are done in order, so when this one is done the older ones
+      // are too.
+      while (!jobs_[i]->done)
+        cond_.wait(lock);
+      job = jobs_[i];
+      for (size_t j = 0; j < i; j++)
+        DeleteJob(jobs_[j]);
+      jobs_.erase(jobs_.begin(), jobs_.begin() + i + 1);
+      num_started_ -= i + 1;
+    }
+  }
+  if (job == NULL || job->names.empty()) {
+    if (augmenter != NULL)
+      augmenter->AcceptInputs(nnet, inputs, computer);
+    else
+      computer->AcceptInputs(nnet, inputs);
+  } else {
+    for (size_t i = 0; i < job->names.size(); i++) {
+      if (augmenter != NULL && augmenter->Augments(job->names[i])) {
+        for (size_t j = 0; j < inputs.size(); j++) {
+          if (inputs[j].name == job->names[i]) {
+            augmenter->Augment(inputs[j].indexes, job->matrices[i]);
+            break;
+          }
+        }
+      }
+      computer->AcceptInput(job->names[i], job->matrices[i]);
+    }
+  }
+  if (job != NULL)
+    DeleteJob(job);
+}
+
+void NnetInputPrefetcher::DeleteJob(Job *job) {
+  for (size_t i = 0; i < job->matrices.size(); i++)
+    delete job->matrices[i];
+  delete job;
+}
+
+NnetInputPrefetcher::~NnetInputPrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exit_ = true;
+    cond_.notify_all();
+  }
+  if (thread_.joinable())
+    thread_.join();
+  for (size_t i = 0; i < jobs_.size(); i++)
+    DeleteJob(jobs_[i]);
+}
+
+
 } // namespace nnet3
 } // namespace kaldi
@@ -26,10 +26,15 @@
 #include "nnet3/nnet-analyze.h"
 #include "nnet3/nnet-example.h"
 
+#include <condition_variable>
+#include <deque>
 #include <iostream>
 #include <sstream>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 
 namespace kaldi {
@@ -38,15 +43,50 @@ namespace nnet3 {
 
 struct NnetComputeOptions {
   bool debug;
-  NnetComputeOptions(): debug(false) { }
+  bool use_cuda_graph;
+  std::string profile_file;
+  std::string profile_format;
+  NnetComputeOptions(): debug(false), use_cuda_graph(false),
+                        profile_format("json") { }
   void Register(OptionsItf *opts) {
     opts->Register("debug", &debug, "If true, turn on "
                    "debug for the neural net computation (very verbose!) "
                    "Will be turned on regardless if --verbose >= 5");
+    opts->Register("use-cuda-graph", &use_cuda_graph, "If true and a GPU "
+                   "is used, the forward computations that are done "
+                   "repeatedly in batched inference (NnetBatchComputer) are "
+                   "captured into a CUDA graph the first time and replayed "
+                   "afterwards, which saves the kernel-launch overhead for "
+                   "small chunks.  Uses more GPU memory.");
+    opts->Register("profile-file", &profile_file, "If set, the time of each "
+                   "command of the computation (with the GPU synchronized "
+                   "after each one, which slows things down) and estimates "
+                   "of its floating-point operations and memory traffic are "
+                   "recorded, and written to this file at the end of the "
+                   "program, per component and per command type.  Disables "
+                   "--use-cuda-graph.");
+    opts->Register("profile-format", &profile_format, "Format of "
+                   "--profile-file: 'json' for the totals per component and "
+                   "command type, or 'chrome' for a trace of the individual "
+                   "commands that can be viewed in chrome://tracing.");
   }
 
 };
 
+/// Writes the profile accumulated by NnetComputer (see class
+/// NnetComputeProfiler in nnet-compute-profile.h) to opts.profile_file, in
+/// the format opts.profile_format; does nothing if opts.profile_file is empty.
+/// Programs call this at the end.
+void WriteNnetComputeProfile(const NnetComputeOptions &opts);
+
+/// The state of an NnetComputer between two chunks of a looped computation;
+/// see NnetComputer::SaveState().
+struct NnetComputerState {
+  int32 program_counter;  // -1 if empty.
+  std::vector<int32> pending_commands;
+  std::vector<CuMatrix<BaseFloat> > matrices;
+  NnetComputerState(): program_counter(-1) { }
+};
 
 /**
   class NnetComputer is responsible for executing the computation described in the
@@ -124,9 +164,50 @@ class NnetComputer {
   void GetOutputDestructive(const std::string &output_name,
                             CuMatrix<BaseFloat> *output);
 
+  /// The following two functions are for users of looped computations with
+  /// several sequences (i.e. several 'n' values), who want to save and
+  /// restore the recurrent state of individual sequences between chunks (i.e.
+  /// after GetOutput() and before the next AcceptInput()), for instance to
+  /// advance many different RNNLM histories in one batch; see class
+  /// RnnlmBatchComputer.  The rows of each matrix that belong to each
+  /// sequence can be worked out from the computation's matrix_debug_info.
+
+  /// Returns the index of the next command to be executed.  Between chunks of
+  /// a looped computation, this identifies where we are in the computation,
+  /// and hence which matrices are currently allocated.
+  int32 ProgramCounter() const { return program_counter_; }
+
+  /// Returns the matrix with index 'matrix_index' in the computation; it will
+  /// be empty if it is not currently allocated.  The caller may change its
+  /// contents but not its size.
+  CuMatrix<BaseFloat> &GetMatrix(int32 matrix_index);
+
+  /// Returns this object to the state it was in after construction, so that
+  /// the computation can be run again from the start (e.g. a looped
+  /// computation, for a new utterance) without constructing a new
+  /// NnetComputer.  The matrices that are still allocated are kept, and are
+  /// reused by the allocation commands whenever the sizes match, so after the
+  /// first time this avoids most of the memory allocation.  May not be called
+  /// while there are memos stored (i.e. between the forward and backward
+  /// passes of a training computation).
+  void Reset();
+
+  /// Copies the state of this object between two chunks of a looped
+  /// computation (i.e. after GetOutput() and before the next AcceptInput()),
+  /// which is the program counter and the matrices, to 'state'.  May not be
+  /// called while there are memos or compressed matrices stored.
+  void SaveState(NnetComputerState *state) const;
+
+  /// Restores a state saved by SaveState() from an NnetComputer for the same
+  /// computation, so that the computation continues from where that one was;
+  /// this is used to carry the recurrent state of a looped computation from
+  /// one utterance to the next.
+  void RestoreState(const NnetComputerState &state);
 
   ~NnetComputer();
  private:
+  friend class NnetCudaGraphComputer;
+
   void Init(); // called from constructors.
 
   const NnetComputeOptions &options_;
@@ -176,6 +257,15 @@ class NnetComputer {
   // executes the command in computation_.commands[program_counter_].
   void ExecuteCommand();
 
+  // Records, with NnetComputeProfiler, the execution of command 'command',
+  // which started at time 'start' (as given by NnetComputeProfiler::Now()) and
+  // took 'elapsed' seconds.
+  void ProfileCommand(int32 command, double start, double elapsed);
+
+  // Returns the number of elements of submatrix 'submatrix_index' (zero for
+  // submatrix zero, which is the empty submatrix).
+  int64 SubMatrixSize(int32 submatrix_index) const;
+
   // Returns the matrix index where the input (if is_output==false) or output
   // matrix index for "node_name" is stored.  This looks at the next command (at
   // program_counter_) and in pending_commands_, and sees whether we were
@@ -244,6 +334,151 @@ class NnetComputer {
 };
 
 
+/**
+   class NnetCudaGraphComputer executes a forward computation (e.g. one from
+   NnetBatchComputer) many times, with different inputs.  When a GPU is used,
+   the commands of the computation are captured into a CUDA graph once, by
+   the constructor, and each Run() just launches the graph, which avoids the
+   overhead of launching each kernel and cuBLAS call separately; this matters
+   when the chunks are small, as in online decoding.
+
+   Because the addresses of the matrices are part of the graph, all the
+   matrices of the computation are allocated by the constructor and kept until
+   this object is destroyed (NnetComputer frees each of them once it is no
+   longer needed, so this uses more memory), and the inputs are copied into
+   them.  If the capture fails (e.g. because some component copies data from
+   the host or synchronizes inside its Propagate()), a warning is printed and
+   Run() uses an NnetComputer; and without a GPU it always does.
+
+   Call AcceptInput() for each input, then Run(), then GetOutput().  This
+   class is not thread-safe, and it must be used and destroyed in threads
+   that use the GPU on which it was constructed.
+ */
+class NnetCudaGraphComputer {
+ public:
+  /// 'computation' must satisfy IsSuitable(), and must have had
+  /// ComputeCudaIndexes() called.
+  NnetCudaGraphComputer(const NnetComputeOptions &options,
+                        const std::shared_ptr<const NnetComputation>
+                        &computation,
+                        const Nnet &nnet);
+
+  /// Returns true if 'computation' can be run by this class: it must do only
+  /// the forward propagation (all the inputs come before all the outputs),
+  /// without storing stats or memos, and without compression or loops (as in
+  /// looped computations).
+  static bool IsSuitable(const NnetComputation &computation);
+
+  /// Copies 'input' to where the computation reads input node 'node_name'
+  /// from.  The dimensions must match.
+  void AcceptInput(const std::string &node_name,
+                   const CuMatrixBase<BaseFloat> &input);
+
+  /// Does the computation.  All the inputs must have been given.
+  void Run();
+
+  /// Returns the output for 'node_name', which is valid until the next call
+  /// to Run() or AcceptInput().
+  const CuMatrixBase<BaseFloat> &GetOutput(const std::string &node_name);
+
+  ~NnetCudaGraphComputer();
+ private:
+  // Does the computation with a new NnetComputer; used if there is no graph.
+  void RunWithoutGraph();
+
+  const NnetComputeOptions &options_;
+  std::shared_ptr<const NnetComputation> computation_;
+  const Nnet &nnet_;
+
+  // Its matrices are the ones that the graph uses.
+  NnetComputer computer_;
+
+  // The input node names, and the (sub)matrices, in computer_.matrices_,
+  // that the computation reads them from.
+  std::vector<std::string> input_names_;
+  std::vector<CuSubMatrix<BaseFloat> > inputs_;
+  // The output node names, and the (sub)matrices where the graph leaves them.
+  std::vector<std::string> output_names_;
+  std::vector<CuSubMatrix<BaseFloat> > graph_outputs_;
+  // The inputs given to AcceptInput() and the outputs computed, when there
+  // is no graph.
+  std::vector<CuMatrix<BaseFloat> > input_values_;
+  std::vector<CuMatrix<BaseFloat> > outputs_;
+
+  // The memory of the temporaries that were freed while capturing; see
+  // CuDevice::SetDeferredFrees().
+  std::vector<void*> deferred_frees_;
+#if HAVE_CUDA == 1
+  cudaGraphExec_t graph_exec_;  // NULL if there is no graph.
+#endif
+  bool have_graph_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetCudaGraphComputer);
+};
+
+
+/**
+   class NnetInputPrefetcher copies the input features of examples to the GPU
+   in a background thread, so that in training the inputs of the next
+   minibatch can be copied while the current one is being computed.  The
+   background thread uses the same GPU as the thread that first calls
+   Prefetch(), with its own CUDA stream (the per-thread default stream), so the
+   copies overlap with the kernels of the computation.  Without a GPU,
+   Prefetch() does nothing.
+
+   Typical use, in a trainer (see NnetChainTrainer::Prefetch()):
+   \code
+     prefetcher.Prefetch(nnet, next_eg.inputs);  // before training on 'eg'.
+     ...
+     NnetComputer computer(...);
+     prefetcher.AcceptInputs(nnet, eg.inputs, &computer);
+   \endcode
+ */
+class NnetInputAugmenter;
+
+class NnetInputPrefetcher {
+ public:
+  NnetInputPrefetcher();
+
+  /// Starts copying to the GPU the features of the elements of 'inputs' that
+  /// are input nodes of 'nnet'.  'inputs' must not be changed or destroyed
+  /// until it has been given to AcceptInputs().
+  void Prefetch(const Nnet &nnet, const std::vector<NnetIo> &inputs);
+
+  /// Does the same as computer->AcceptInputs(nnet, inputs), but uses the
+  /// copies made in the background if 'inputs' was given to Prefetch().  Any
+  /// prefetched inputs older than 'inputs' are discarded.  If 'augmenter' is
+  /// not NULL, the inputs it applies to are augmented on the GPU before being
+  /// given to 'computer'.
+  void AcceptInputs(const Nnet &nnet, const std::vector<NnetIo> &inputs,
+                    NnetComputer *computer,
+                    const NnetInputAugmenter *augmenter = NULL);
+
+  ~NnetInputPrefetcher();
+ private:
+  struct Job {
+    const std::vector<NnetIo> *inputs;
+    std::vector<std::string> names;
+    std::vector<CuMatrix<BaseFloat>*> matrices;
+    bool done;  // true when the copies have finished, or failed (in which
+                // case 'matrices' is empty).
+  };
+  void ThreadFunction(int32 device_id);
+  static void DeleteJob(Job *job);
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  // The jobs, oldest first.  The background thread works on them in order.
+  std::deque<Job*> jobs_;
+  // The number of jobs that the background thread has started or finished.
+  size_t num_started_;
+  bool exit_;
+  std::thread thread_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetInputPrefetcher);
+};
+
+
 
 } // namespace nnet3
 } // namespace kaldi
@@ -552,15 +552,46 @@ class TdnnComponent: public UpdatableComponent {
   };
 
   CuMatrixBase<BaseFloat> &LinearParams() { return linear_params_; }
+  const CuMatrixBase<BaseFloat> &LinearParams() const {
+    return linear_params_;
+  }
+  const CuVector<BaseFloat> &BiasParams() const { return bias_params_; }
 
   // This allows you to resize the vector in order to add a bias where
   // there previously was none-- obviously this should be done carefully.
   CuVector<BaseFloat> &BiasParams() { return bias_params_; }
 
+  // Does the same as Propagate() followed by a RectifiedLinearComponent and
+  // by multiplication by 'scale' (which must be positive), but adds the bias
+  // and applies the rectifier in a single kernel after the matrix
+  // multiplications.  Requires that there is a bias.  It is used where the
+  // optimizer fused these operations (see FusePropagations() in
+  // nnet-optimize-utils.h).
+  void PropagateRectified(const ComponentPrecomputedIndexes *indexes,
+                          const CuMatrixBase<BaseFloat> &in, BaseFloat scale,
+                          CuMatrixBase<BaseFloat> *out) const;
+
   BaseFloat OrthonormalConstraint() const { return orthonormal_constraint_; }
 
   void ConsolidateMemory();
- private:
+
+  // The following static functions do the work of ReorderIndexes(),
+  // GetInputIndexes(), IsComputable() and PrecomputeIndexes() for a given
+  // list of time offsets.  They are also used by QuantizedTdnnComponent (see
+  // nnet-quantized-component.h), which has the same input structure.
+  static void ReorderIndexesForOffsets(std::vector<Index> *input_indexes,
+                                       std::vector<Index> *output_indexes);
+  static void GetInputIndexesForOffsets(const std::vector<int32> &time_offsets,
+                                        const Index &output_index,
+                                        std::vector<Index> *desired_indexes);
+  static bool IsComputableForOffsets(const std::vector<int32> &time_offsets,
+                                     const Index &output_index,
+                                     const IndexSet &input_index_set,
+                                     std::vector<Index> *used_inputs);
+  static PrecomputedIndexes* PrecomputeIndexesForOffsets(
+      const std::vector<int32> &time_offsets,
+      const std::vector<Index> &input_indexes,
+      const std::vector<Index> &output_indexes);
 
   // This static function is a utility function that extracts a CuSubMatrix
   // representing a subset of rows of 'input_matrix'.
@@ -572,6 +603,9 @@ class TdnnComponent: public UpdatableComponent {
       int32 row_stride,
       int32 row_offset);
 
+  const std::vector<int32> &TimeOffsets() const { return time_offsets_; }
+ private:
+
   // see the definition for more explanation.
   static void ModifyComputationIo(time_height_convolution::ConvolutionComputationIo *io);
 
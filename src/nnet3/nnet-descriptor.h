@@ -511,6 +511,12 @@ class BinarySumDescriptor: public SumDescriptor {
   BinarySumDescriptor(Operation op, SumDescriptor *src1, SumDescriptor *src2):
       op_(op), src1_(src1), src2_(src2) {}
   virtual ~BinarySumDescriptor() { delete src1_; delete src2_; }
+
+  // these functions are not in the shared interface. they're used
+  // by ExportNnetToOnnx().
+  Operation Op() const { return op_; }
+  const SumDescriptor &Src1() const { return *src1_; }
+  const SumDescriptor &Src2() const { return *src2_; }
  private:
   Operation op_;
   SumDescriptor *src1_;
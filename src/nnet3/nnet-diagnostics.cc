@@ -87,7 +87,7 @@ void NnetComputeProb::Compute(const NnetExample &eg) {
   NnetComputer computer(config_.compute_config, *computation,
                         nnet_, deriv_nnet_);
   // give the inputs to the computer object.
-  computer.AcceptInputs(nnet_, eg.io);
+  prefetcher_.AcceptInputs(nnet_, eg.io, &computer);
   computer.Run();
   this->ProcessOutputs(eg, &computer);
   if (config_.compute_deriv)
@@ -125,6 +125,13 @@ class NnetComputeProb {
   // compute objective on one minibatch.
   void Compute(const NnetExample &eg);
 
+  // If a GPU is in use, starts copying the input features of 'eg' to it in
+  // the background, so that this happens while the current minibatch is
+  // being computed.  Call this with the next minibatch before calling
+  // Compute() with the current one; 'eg' must not be changed until it has
+  // been given to Compute().
+  void Prefetch(const NnetExample &eg) { prefetcher_.Prefetch(nnet_, eg.io); }
+
   // Prints out the final stats, and return true if there was a nonzero count.
   bool PrintTotalStats() const;
 
@@ -159,6 +166,9 @@ class NnetComputeProb {
   unordered_map<std::string, SimpleObjectiveInfo, StringHasher> objf_info_;
 
   unordered_map<std::string, PerDimObjectiveInfo, StringHasher> accuracy_info_;
+
+  // Copies the inputs of the minibatches given to Prefetch() to the GPU.
+  NnetInputPrefetcher prefetcher_;
 };
 
 
@@ -32,7 +32,8 @@ NnetDiscriminativeTrainer::NnetDiscriminativeTrainer(
     opts_(opts), tmodel_(tmodel), log_priors_(priors),
     nnet_(nnet),
     compiler_(*nnet, opts_.nnet_config.optimize_config),
-    num_minibatches_processed_(0) {
+    num_minibatches_processed_(0),
+    num_prep_started_(0), prep_exit_(false) {
   if (opts.nnet_config.zero_component_stats)
     ZeroComponentStats(nnet);
   if (opts.nnet_config.momentum == 0.0 &&
@@ -76,10 +77,13 @@ void NnetDiscriminativeTrainer::Train(const NnetDiscriminativeExample &eg) {
                         *nnet_,
                         (delta_nnet_ == NULL ? nnet_ : delta_nnet_));
   // give the inputs to the computer object.
-  computer.AcceptInputs(*nnet_, eg.inputs);
+  prefetcher_.AcceptInputs(*nnet_, eg.inputs, &computer);
   computer.Run();
 
-  this->ProcessOutputs(eg, &computer);
+  PrepJob *job = GetPrepJob(eg);
+  this->ProcessOutputs(eg, (job != NULL && !job->preps.empty() ?
+                            &(job->preps) : NULL), &computer);
+  delete job;
   computer.Run();
 
   if (delta_nnet_ != NULL) {
@@ -106,8 +110,74 @@ void NnetDiscriminativeTrainer::Train(const NnetDiscriminativeExample &eg) {
 }
 
 
-void NnetDiscriminativeTrainer::ProcessOutputs(const NnetDiscriminativeExample &eg,
-                                               NnetComputer *computer) {
+void NnetDiscriminativeTrainer::Prefetch(const NnetDiscriminativeExample &eg) {
+  prefetcher_.Prefetch(*nnet_, eg.inputs);
+  PrepJob *job = new PrepJob();
+  job->eg = &eg;
+  job->done = false;
+  if (!prep_thread_.joinable())
+    prep_thread_ = std::thread(&NnetDiscriminativeTrainer::PrepThreadFunction,
+                               this);
+  std::lock_guard<std::mutex> lock(prep_mutex_);
+  prep_jobs_.push_back(job);
+  prep_cond_.notify_all();
+}
+
+void NnetDiscriminativeTrainer::PrepThreadFunction() {
+  while (true) {
+    PrepJob *job;
+    {
+      std::unique_lock<std::mutex> lock(prep_mutex_);
+      while (num_prep_started_ == prep_jobs_.size() && !prep_exit_)
+        prep_cond_.wait(lock);
+      if (prep_exit_)
+        return;
+      job = prep_jobs_[num_prep_started_++];
+    }
+    std::vector<discriminative::DiscriminativeComputationPrep> preps;
+    try {
+      const std::vector<NnetDiscriminativeSupervision> &outputs =
+          job->eg->outputs;
+      preps.resize(outputs.size());
+      for (size_t i = 0; i < outputs.size(); i++)
+        PrepareDiscriminativeComputation(opts_.discriminative_config, tmodel_,
+                                         outputs[i].supervision, &(preps[i]));
+    } catch (const std::exception &e) {
+      // Train() will redo the preparation, and report the error.
+      KALDI_WARN << "Error preparing lattices in the background.";
+      preps.clear();
+    }
+    std::lock_guard<std::mutex> lock(prep_mutex_);
+    job->preps.swap(preps);
+    job->done = true;
+    prep_cond_.notify_all();
+  }
+}
+
+NnetDiscriminativeTrainer::PrepJob* NnetDiscriminativeTrainer::GetPrepJob(
+    const NnetDiscriminativeExample &eg) {
+  std::unique_lock<std::mutex> lock(prep_mutex_);
+  size_t i = 0;
+  while (i < prep_jobs_.size() && prep_jobs_[i]->eg != &eg)
+    i++;
+  if (i == prep_jobs_.size())
+    return NULL;
+  // The jobs are done in order, so when this one is done the older ones are
+  // too.
+  while (!prep_jobs_[i]->done)
+    prep_cond_.wait(lock);
+  PrepJob *job = prep_jobs_[i];
+  for (size_t j = 0; j < i; j++)
+    delete prep_jobs_[j];
+  prep_jobs_.erase(prep_jobs_.begin(), prep_jobs_.begin() + i + 1);
+  num_prep_started_ -= i + 1;
+  return job;
+}
+
+void NnetDiscriminativeTrainer::ProcessOutputs(
+    const NnetDiscriminativeExample &eg,
+    std::vector<discriminative::DiscriminativeComputationPrep> *preps,
+    NnetComputer *computer) {
   // normally the eg will have just one output named 'output', but
   // we don't assume this.
   std::vector<NnetDiscriminativeSupervision>::const_iterator iter = eg.outputs.begin(),
@@ -144,7 +214,10 @@ void NnetDiscriminativeTrainer::ProcessOutputs(const NnetDiscriminativeExample &
                                       sup.supervision, nnet_output,
                                       &stats,
                                       &nnet_output_deriv,
-                                      (use_xent ? &xent_deriv : NULL));
+                                      (use_xent ? &xent_deriv : NULL),
+                                      (preps != NULL ?
+                                       &((*preps)[iter - eg.outputs.begin()]) :
+                                       NULL));
 
     if (use_xent) {
       // this block computes the cross-entropy objective.
@@ -262,6 +335,16 @@ bool DiscriminativeObjectiveFunctionInfo::PrintTotalStats(const std::string &nam
 
 
 NnetDiscriminativeTrainer::~NnetDiscriminativeTrainer() {
+  {
+    std::lock_guard<std::mutex> lock(prep_mutex_);
+    prep_exit_ = true;
+    prep_cond_.notify_all();
+  }
+  if (prep_thread_.joinable())
+    prep_thread_.join();
+  for (size_t i = 0; i < prep_jobs_.size(); i++)
+    delete prep_jobs_[i];
+
   delete delta_nnet_;
 
   if (opts_.nnet_config.write_cache != "") {
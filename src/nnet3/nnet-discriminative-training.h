@@ -21,6 +21,10 @@
 #ifndef KALDI_NNET3_NNET_DISCRIMINATIVE_TRAINING_H_
 #define KALDI_NNET3_NNET_DISCRIMINATIVE_TRAINING_H_
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include "nnet3/nnet-example.h"
 #include "nnet3/nnet-computation.h"
 #include "nnet3/nnet-compute.h"
@@ -94,13 +98,37 @@ class NnetDiscriminativeTrainer {
   // train on one minibatch.
   void Train(const NnetDiscriminativeExample &eg);
 
+  // Starts the parts of the training on 'eg' that do not depend on the
+  // current model, so that they overlap with the training on the minibatch
+  // before it: in a background thread, the preparation of its lattices (see
+  // PrepareDiscriminativeComputation()), and the copying of its inputs to the
+  // GPU.  Call this with the next minibatch before calling Train() with the
+  // current one; 'eg' must not be changed until it has been given to Train().
+  void Prefetch(const NnetDiscriminativeExample &eg);
+
   // Prints out the final stats, and return true if there was a nonzero count.
   bool PrintTotalStats() const;
 
   ~NnetDiscriminativeTrainer();
  private:
-  void ProcessOutputs(const NnetDiscriminativeExample &eg,
-                      NnetComputer *computer);
+  // 'preps' is the prepared lattice computation for each element of
+  // eg.outputs, or NULL if they were not prepared in advance.
+  void ProcessOutputs(
+      const NnetDiscriminativeExample &eg,
+      std::vector<discriminative::DiscriminativeComputationPrep> *preps,
+      NnetComputer *computer);
+
+  // A job for the thread that prepares the lattice computations.
+  struct PrepJob {
+    const NnetDiscriminativeExample *eg;
+    std::vector<discriminative::DiscriminativeComputationPrep> preps;
+    bool done;  // true when 'preps' is ready, or the preparation failed (in
+                // which case 'preps' is empty).
+  };
+  void PrepThreadFunction();
+  // Waits for, and removes from prep_jobs_, the job for 'eg'; returns NULL if
+  // there is none.  Older jobs are discarded.
+  PrepJob *GetPrepJob(const NnetDiscriminativeExample &eg);
 
   const NnetDiscriminativeOptions opts_;
 
@@ -121,6 +149,21 @@ class NnetDiscriminativeTrainer {
   // normal case there will be just one output layer named "output".
   // So we store the objective functions per output layer.
   unordered_map<std::string, DiscriminativeObjectiveFunctionInfo, StringHasher> objf_info_;
+
+  // Copies the inputs of the minibatches given to Prefetch() to the GPU.
+  NnetInputPrefetcher prefetcher_;
+
+  // The variables below are for preparing the lattice computations of the
+  // minibatches given to Prefetch().  prep_mutex_ guards all but
+  // prep_thread_.
+  std::mutex prep_mutex_;
+  std::condition_variable prep_cond_;
+  // The jobs, oldest first.  The thread works on them in order.
+  std::deque<PrepJob*> prep_jobs_;
+  // The number of jobs that the thread has started or finished.
+  size_t num_prep_started_;
+  bool prep_exit_;
+  std::thread prep_thread_;
 };
 
 
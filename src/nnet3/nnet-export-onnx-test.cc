@@ -0,0 +1,429 @@
+// nnet3/nnet-export-onnx-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <map>
+#include "nnet3/nnet-export-onnx.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// A minimal reader of the protobuf wire format, and an interpreter for the
+// few ONNX operators the exporter uses, so that we can check the exported
+// graph against the nnet3 computation.
+class ProtoReader {
+ public:
+  explicit ProtoReader(const std::string &data): data_(data), pos_(0) { }
+
+  // Reads the next field; for length-delimited fields, *bytes is set, else
+  // *value.
+  bool Next(int32 *field, uint64 *value, std::string *bytes) {
+    if (pos_ >= data_.size()) return false;
+    uint64 key = ReadVarint();
+    *field = key >> 3;
+    switch (key & 7) {
+      case 0: *value = ReadVarint(); break;
+      case 2: {
+        uint64 size = ReadVarint();
+        KALDI_ASSERT(pos_ + size <= data_.size());
+        *bytes = data_.substr(pos_, size);
+        pos_ += size;
+        break;
+      }
+      case 5: {
+        *value = 0;
+        for (int32 i = 0; i < 4; i++)
+          *value |= static_cast<uint64>(
+              static_cast<unsigned char>(data_[pos_++])) << (8 * i);
+        break;
+      }
+      default: KALDI_ERR << "Unexpected wire type " << (key & 7);
+    }
+    return true;
+  }
+ private:
+  uint64 ReadVarint() {
+    uint64 ans = 0;
+    for (int32 shift = 0; ; shift += 7) {
+      KALDI_ASSERT(pos_ < data_.size());
+      unsigned char c = data_[pos_++];
+      ans |= static_cast<uint64>(c & 0x7F) << shift;
+      if (!(c & 0x80)) return ans;
+    }
+  }
+  const std::string &data_;
+  size_t pos_;
+};
+
+class OnnxInterpreter {
+ public:
+  explicit OnnxInterpreter(const std::string &model) {
+    ProtoReader reader(model);
+    int32 field;
+    uint64 value;
+    std::string bytes, graph;
+    while (reader.Next(&field, &value, &bytes)) {
+      if (field == 7) graph = bytes;
+      if (field == 14) ReadMetadata(bytes);
+    }
+    KALDI_ASSERT(!graph.empty());
+    ProtoReader graph_reader(graph);
+    while (graph_reader.Next(&field, &value, &bytes)) {
+      if (field == 1) nodes_.push_back(bytes);
+      else if (field == 5) ReadInitializer(bytes);
+      else if (field == 11) inputs_.push_back(ReadValueInfo(bytes));
+      else if (field == 12) outputs_.push_back(ReadValueInfo(bytes));
+    }
+  }
+
+  // Returns the dims of the input or output with this name.
+  std::vector<int64> GetDims(const std::string &name) const {
+    for (size_t i = 0; i < inputs_.size(); i++)
+      if (inputs_[i].first == name) return inputs_[i].second;
+    for (size_t i = 0; i < outputs_.size(); i++)
+      if (outputs_[i].first == name) return outputs_[i].second;
+    KALDI_ERR << "No input or output " << name;
+    return std::vector<int64>();
+  }
+
+  int32 GetMetadata(const std::string &key) const {
+    std::map<std::string, std::string>::const_iterator iter =
+        metadata_.find(key);
+    KALDI_ASSERT(iter != metadata_.end());
+    return std::atoi(iter->second.c_str());
+  }
+
+  void Run(const std::map<std::string, Matrix<BaseFloat> > &inputs,
+           const std::string &output_name, Matrix<BaseFloat> *output) {
+    values_.insert(inputs.begin(), inputs.end());
+    for (size_t i = 0; i < nodes_.size(); i++)
+      RunNode(nodes_[i]);
+    *output = values_[output_name];
+  }
+
+ private:
+  void ReadMetadata(const std::string &entry) {
+    ProtoReader reader(entry);
+    int32 field;
+    uint64 value;
+    std::string bytes, key;
+    while (reader.Next(&field, &value, &bytes)) {
+      if (field == 1) key = bytes;
+      else if (field == 2) metadata_[key] = bytes;
+    }
+  }
+
+  std::pair<std::string, std::vector<int64> > ReadValueInfo(
+      const std::string &value_info) {
+    std::pair<std::string, std::vector<int64> > ans;
+    ProtoReader reader(value_info);
+    int32 field;
+    uint64 value;
+    std::string bytes;
+    while (reader.Next(&field, &value, &bytes)) {
+      if (field == 1) {
+        ans.first = bytes;
+      } else if (field == 2) {
+        // TypeProto -> tensor_type -> shape -> dim -> dim_value.
+        std::string tensor_type = SubMessage(bytes, 1),
+            shape = SubMessage(tensor_type, 2);
+        ProtoReader shape_reader(shape);
+        while (shape_reader.Next(&field, &value, &bytes)) {
+          ProtoReader dim_reader(bytes);
+          std::string unused;
+          KALDI_ASSERT(dim_reader.Next(&field, &value, &unused) && field == 1);
+          ans.second.push_back(value);
+        }
+      }
+    }
+    return ans;
+  }
+
+  static std::string SubMessage(const std::string &message, int32 wanted) {
+    ProtoReader reader(message);
+    int32 field;
+    uint64 value;
+    std::string bytes;
+    while (reader.Next(&field, &value, &bytes))
+      if (field == wanted) return bytes;
+    KALDI_ERR << "Field " << wanted << " not found";
+    return "";
+  }
+
+  void ReadInitializer(const std::string &tensor) {
+    ProtoReader reader(tensor);
+    int32 field;
+    uint64 value;
+    std::string bytes, name, raw;
+    std::vector<int64> dims;
+    int32 data_type = 0;
+    while (reader.Next(&field, &value, &bytes)) {
+      if (field == 1) dims.push_back(value);
+      else if (field == 2) data_type = value;
+      else if (field == 8) name = bytes;
+      else if (field == 9) raw = bytes;
+    }
+    if (data_type == 7) {
+      std::vector<int64> &v = int_values_[name];
+      v.resize(raw.size() / 8);
+      for (size_t i = 0; i < v.size(); i++) {
+        uint64 x = 0;
+        for (int32 b = 0; b < 8; b++)
+          x |= static_cast<uint64>(
+              static_cast<unsigned char>(raw[8 * i + b])) << (8 * b);
+        v[i] = static_cast<int64>(x);
+      }
+    } else {
+      KALDI_ASSERT(data_type == 1 && dims.size() <= 2);
+      // Scalars and vectors are stored as one row.
+      int32 rows = (dims.size() == 2 ? dims[0] : 1),
+          cols = (dims.size() == 0 ? 1 : dims.back());
+      Matrix<BaseFloat> &m = values_[name];
+      m.Resize(rows, cols);
+      KALDI_ASSERT(raw.size() == 4 * static_cast<size_t>(rows) * cols);
+      for (int32 r = 0; r < rows; r++) {
+        for (int32 c = 0; c < cols; c++) {
+          size_t i = 4 * (static_cast<size_t>(r) * cols + c);
+          uint32 bits = 0;
+          for (int32 b = 0; b < 4; b++)
+            bits |= static_cast<uint32>(
+                static_cast<unsigned char>(raw[i + b])) << (8 * b);
+          float f;
+          std::memcpy(&f, &bits, sizeof(f));
+          m(r, c) = f;
+        }
+      }
+    }
+  }
+
+  // Computes a op b, where b may have one row, or be a scalar.
+  Matrix<BaseFloat> Binary(const Matrix<BaseFloat> &a,
+                           const Matrix<BaseFloat> &b, bool mul) {
+    Matrix<BaseFloat> ans(a);
+    for (int32 r = 0; r < a.NumRows(); r++) {
+      for (int32 c = 0; c < a.NumCols(); c++) {
+        BaseFloat y = b(b.NumRows() == 1 ? 0 : r, b.NumCols() == 1 ? 0 : c);
+        ans(r, c) = (mul ? a(r, c) * y : a(r, c) + y);
+      }
+    }
+    return ans;
+  }
+
+  void RunNode(const std::string &node) {
+    ProtoReader reader(node);
+    int32 field;
+    uint64 value;
+    std::string bytes, op_type, output;
+    std::vector<std::string> inputs;
+    std::map<std::string, int64> attributes;
+    while (reader.Next(&field, &value, &bytes)) {
+      if (field == 1) inputs.push_back(bytes);
+      else if (field == 2) output = bytes;
+      else if (field == 4) op_type = bytes;
+      else if (field == 5) {
+        ProtoReader attribute_reader(bytes);
+        std::string name, unused;
+        int64 i = 0;
+        while (attribute_reader.Next(&field, &value, &unused)) {
+          if (field == 1) name = unused;
+          else if (field == 3) i = value;
+        }
+        attributes[name] = i;
+      }
+    }
+    Matrix<BaseFloat> &ans = values_[output];
+    if (op_type == "Identity") {
+      ans = values_[inputs[0]];
+    } else if (op_type == "Gather") {
+      KALDI_ASSERT(attributes["axis"] == 0);
+      const Matrix<BaseFloat> &x = values_[inputs[0]];
+      const std::vector<int64> &indexes = int_values_[inputs[1]];
+      ans.Resize(indexes.size(), x.NumCols());
+      for (size_t i = 0; i < indexes.size(); i++)
+        ans.Row(i).CopyFromVec(x.Row(indexes[i]));
+    } else if (op_type == "Concat") {
+      KALDI_ASSERT(attributes["axis"] == 1);
+      std::vector<const Matrix<BaseFloat>*> parts;
+      int32 cols = 0;
+      for (size_t i = 0; i < inputs.size(); i++) {
+        parts.push_back(&values_[inputs[i]]);
+        cols += parts.back()->NumCols();
+      }
+      ans.Resize(parts[0]->NumRows(), cols);
+      for (size_t i = 0, offset = 0; i < parts.size(); i++) {
+        ans.ColRange(offset, parts[i]->NumCols()).CopyFromMat(*parts[i]);
+        offset += parts[i]->NumCols();
+      }
+    } else if (op_type == "Slice") {
+      KALDI_ASSERT(int_values_[inputs[3]][0] == 1);
+      int64 start = int_values_[inputs[1]][0], end = int_values_[inputs[2]][0];
+      ans = values_[inputs[0]].ColRange(start, end - start);
+    } else if (op_type == "Gemm") {
+      KALDI_ASSERT(attributes["transB"] == 1);
+      const Matrix<BaseFloat> &x = values_[inputs[0]], &w = values_[inputs[1]];
+      ans.Resize(x.NumRows(), w.NumRows());
+      ans.AddMatMat(1.0, x, kNoTrans, w, kTrans, 0.0);
+      if (inputs.size() == 3)
+        ans = Binary(ans, values_[inputs[2]], false);
+    } else if (op_type == "Add" || op_type == "Mul") {
+      ans = Binary(values_[inputs[0]], values_[inputs[1]], op_type == "Mul");
+    } else if (op_type == "Relu") {
+      ans = values_[inputs[0]];
+      ans.ApplyFloor(0.0);
+    } else if (op_type == "LogSoftmax") {
+      KALDI_ASSERT(attributes["axis"] == 1);
+      ans = values_[inputs[0]];
+      for (int32 r = 0; r < ans.NumRows(); r++)
+        ans.Row(r).ApplyLogSoftMax();
+    } else {
+      KALDI_ERR << "Operator " << op_type << " not supported in this test.";
+    }
+  }
+
+  std::vector<std::string> nodes_;
+  std::vector<std::pair<std::string, std::vector<int64> > > inputs_, outputs_;
+  std::map<std::string, std::string> metadata_;
+  std::map<std::string, Matrix<BaseFloat> > values_;
+  std::map<std::string, std::vector<int64> > int_values_;
+};
+
+
+void UnitTestExportNnetToOnnx() {
+  int32 f = RandInt(1, 3);
+  std::ostringstream config;
+  config << "input-node name=input dim=10\n"
+         << "input-node name=ivector dim=3\n"
+         << "component name=affine1 type=NaturalGradientAffineComponent "
+         << "input-dim=33 output-dim=20\n"
+         << "component-node name=affine1 component=affine1 input=Append("
+         << "Offset(input, -1), input, Offset(input, 1), "
+         << "ReplaceIndex(ivector, t, 0))\n"
+         << "component name=relu1 type=RectifiedLinearComponent dim=20\n"
+         << "component-node name=relu1 component=relu1 input=affine1\n"
+         << "dim-range-node name=relu1-part input-node=relu1 dim-offset=5 "
+         << "dim=10\n"
+         << "component name=linear2 type=LinearComponent input-dim=30 "
+         << "output-dim=8\n"
+         << "component-node name=linear2 component=linear2 input=Append("
+         << "Offset(relu1, -2), Offset(relu1-part, 2))\n"
+         << "component name=tdnn3 type=TdnnComponent input-dim=8 "
+         << "output-dim=10 time-offsets=" << -f << ",0," << f << "\n"
+         << "component-node name=tdnn3 component=tdnn3 input=linear2\n"
+         << "component name=affine4 type=AffineComponent input-dim=10 "
+         << "output-dim=5\n"
+         << "component-node name=affine4 component=affine4 input=Sum("
+         << "Scale(0.5, tdnn3), Offset(relu1-part, " << f << "))\n"
+         << "component name=log-softmax type=LogSoftmaxComponent dim=5\n"
+         << "component-node name=log-softmax component=log-softmax "
+         << "input=affine4\n"
+         << "output-node name=output input=log-softmax\n";
+  Nnet nnet;
+  std::istringstream is(config.str());
+  nnet.ReadConfig(is);
+  // Give the biases some values.
+  PerturbParams(0.1, &nnet);
+
+  OnnxExportOptions opts;
+  opts.frames_per_chunk = RandInt(1, 10);
+  opts.frame_subsampling_factor = f;
+  std::ostringstream os;
+  ExportNnetToOnnx(opts, nnet, os);
+  OnnxInterpreter interpreter(os.str());
+
+  int32 left_context, right_context;
+  ComputeSimpleNnetContext(nnet, &left_context, &right_context);
+  KALDI_ASSERT(interpreter.GetMetadata("left_context") == left_context &&
+               interpreter.GetMetadata("right_context") == right_context);
+  std::vector<int64> input_dims = interpreter.GetDims("input"),
+      output_dims = interpreter.GetDims("output");
+  int32 num_frames = (opts.frames_per_chunk - 1) * f + 1;
+  KALDI_ASSERT(input_dims[0] == left_context + num_frames + right_context &&
+               input_dims[1] == 10);
+  KALDI_ASSERT(output_dims[0] == opts.frames_per_chunk &&
+               output_dims[1] == 5);
+  KALDI_ASSERT(interpreter.GetDims("ivector")[0] == 1);
+
+  // DecodableNnetSimple repeats the first and last frames at the edges; the
+  // ONNX input has to contain the context explicitly.
+  Matrix<BaseFloat> feats(num_frames, 10), onnx_feats(input_dims[0], 10);
+  feats.SetRandn();
+  for (int32 i = 0; i < onnx_feats.NumRows(); i++) {
+    int32 t = std::min(std::max(i - left_context, 0), num_frames - 1);
+    onnx_feats.Row(i).CopyFromVec(feats.Row(t));
+  }
+  Vector<BaseFloat> ivector(3);
+  ivector.SetRandn();
+  std::map<std::string, Matrix<BaseFloat> > inputs;
+  inputs["input"] = onnx_feats;
+  inputs["ivector"].Resize(1, 3);
+  inputs["ivector"].Row(0).CopyFromVec(ivector);
+  Matrix<BaseFloat> onnx_output;
+  interpreter.Run(inputs, "output", &onnx_output);
+
+  NnetSimpleComputationOptions compute_opts;
+  compute_opts.frame_subsampling_factor = f;
+  compute_opts.acoustic_scale = 1.0;
+  compute_opts.frames_per_chunk = f * RandInt(1, 10);
+  CachingOptimizingCompiler compiler(nnet);
+  Vector<BaseFloat> priors;
+  DecodableNnetSimple decodable(compute_opts, nnet, priors, feats, &compiler,
+                                &ivector);
+  KALDI_ASSERT(decodable.NumFrames() == opts.frames_per_chunk);
+  Matrix<BaseFloat> output(opts.frames_per_chunk, 5);
+  for (int32 i = 0; i < opts.frames_per_chunk; i++) {
+    SubVector<BaseFloat> row(output, i);
+    decodable.GetOutputForFrame(i, &row);
+  }
+  KALDI_LOG << "ONNX output is " << onnx_output << ", nnet3 output is "
+            << output;
+  AssertEqual(output, onnx_output, 0.001);
+}
+
+void UnitTestExportNnetToOnnxUnsupported() {
+  std::string config =
+      "input-node name=input dim=10\n"
+      "component name=pnorm type=PnormComponent input-dim=10 output-dim=5\n"
+      "component-node name=pnorm component=pnorm input=input\n"
+      "output-node name=output input=pnorm\n";
+  Nnet nnet;
+  std::istringstream is(config);
+  nnet.ReadConfig(is);
+  std::ostringstream os;
+  bool threw = false;
+  try {
+    ExportNnetToOnnx(OnnxExportOptions(), nnet, os);
+  } catch (...) {
+    threw = true;
+  }
+  KALDI_ASSERT(threw);
+}
+
+}  // namespace nnet3
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+  SetVerboseLevel(2);
+  for (int32 i = 0; i < 10; i++)
+    UnitTestExportNnetToOnnx();
+  UnitTestExportNnetToOnnxUnsupported();
+  KALDI_LOG << "Nnet ONNX export tests succeeded.";
+  return 0;
+}
@@ -0,0 +1,609 @@
+// nnet3/nnet-export-onnx.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include "nnet3/nnet-export-onnx.h"
+#include "nnet3/nnet-graph.h"
+#include "nnet3/nnet-utils.h"
+#include "nnet3/nnet-simple-component.h"
+#include "nnet3/nnet-normalize-component.h"
+#include "nnet3/nnet-convolutional-component.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+namespace {
+
+// The following functions write the protobuf wire format, which is all we need
+// to write an ONNX model (see onnx.proto in the ONNX sources for the field
+// numbers).  Embedded messages are built in their own strings and written
+// with WriteBytesField().
+enum {
+  kWireVarint = 0,
+  kWireLengthDelimited = 2
+};
+
+void WriteVarint(uint64 value, std::string *out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+void WriteKey(int32 field, int32 wire_type, std::string *out) {
+  WriteVarint((static_cast<uint64>(field) << 3) | wire_type, out);
+}
+
+void WriteIntField(int32 field, int64 value, std::string *out) {
+  WriteKey(field, kWireVarint, out);
+  WriteVarint(static_cast<uint64>(value), out);
+}
+
+void WriteBytesField(int32 field, const std::string &value,
+                     std::string *out) {
+  WriteKey(field, kWireLengthDelimited, out);
+  WriteVarint(value.size(), out);
+  out->append(value);
+}
+
+void WriteFixed32(uint32 value, std::string *out) {
+  for (int32 i = 0; i < 4; i++)
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+// Field numbers and enum values from onnx.proto.
+enum {
+  kTensorFloat = 1,
+  kTensorInt64 = 7,
+  kAttributeInt = 2
+};
+
+// Builds the GraphProto of the model, and the model itself.
+class OnnxGraphBuilder {
+ public:
+  OnnxGraphBuilder(): counter_(0) { }
+
+  // Adds a node with one output and returns the name of that output; if
+  // 'output' is nonempty it is used as the name.
+  std::string AddNode(const std::string &op_type,
+                      const std::vector<std::string> &inputs,
+                      const std::string &attributes = "",
+                      const std::string &output = "") {
+    std::string name = (output.empty() ? NewName(op_type) : output), node;
+    for (size_t i = 0; i < inputs.size(); i++)
+      WriteBytesField(1, inputs[i], &node);
+    WriteBytesField(2, name, &node);
+    WriteBytesField(3, name, &node);
+    WriteBytesField(4, op_type, &node);
+    node.append(attributes);
+    WriteBytesField(1, node, &graph_);
+    return name;
+  }
+
+  // Adds an initializer (a constant tensor) and returns its name.
+  std::string AddFloatTensor(const std::vector<int64> &dims,
+                             const std::vector<float> &data) {
+    std::string raw;
+    raw.reserve(4 * data.size());
+    for (size_t i = 0; i < data.size(); i++) {
+      uint32 bits;
+      std::memcpy(&bits, &data[i], sizeof(bits));
+      WriteFixed32(bits, &raw);
+    }
+    return AddTensor(dims, kTensorFloat, raw);
+  }
+
+  std::string AddInt64Tensor(const std::vector<int64> &dims,
+                             const std::vector<int64> &data) {
+    std::string raw;
+    raw.reserve(8 * data.size());
+    for (size_t i = 0; i < data.size(); i++) {
+      uint64 value = static_cast<uint64>(data[i]);
+      WriteFixed32(static_cast<uint32>(value & 0xFFFFFFFF), &raw);
+      WriteFixed32(static_cast<uint32>(value >> 32), &raw);
+    }
+    return AddTensor(dims, kTensorInt64, raw);
+  }
+
+  void AddInput(const std::string &name, const std::vector<int64> &dims) {
+    WriteBytesField(11, ValueInfo(name, dims), &graph_);
+  }
+
+  void AddOutput(const std::string &name, const std::vector<int64> &dims) {
+    WriteBytesField(12, ValueInfo(name, dims), &graph_);
+  }
+
+  static std::string IntAttribute(const std::string &name, int64 value) {
+    std::string attribute, ans;
+    WriteBytesField(1, name, &attribute);
+    WriteIntField(3, value, &attribute);
+    WriteIntField(20, kAttributeInt, &attribute);
+    WriteBytesField(5, attribute, &ans);
+    return ans;
+  }
+
+  // Returns the serialized ModelProto.
+  std::string GetModel(
+      const std::vector<std::pair<std::string, std::string> > &metadata) const {
+    std::string graph(graph_), opset, model;
+    WriteBytesField(2, "kaldi_nnet3", &graph);
+    WriteBytesField(2, std::string(), &opset);  // the default domain.
+    WriteIntField(2, 13, &opset);
+    WriteIntField(1, 7, &model);  // IR version 7 goes with opset 13.
+    WriteBytesField(2, "kaldi", &model);
+    WriteBytesField(7, graph, &model);
+    WriteBytesField(8, opset, &model);
+    for (size_t i = 0; i < metadata.size(); i++) {
+      std::string entry;
+      WriteBytesField(1, metadata[i].first, &entry);
+      WriteBytesField(2, metadata[i].second, &entry);
+      WriteBytesField(14, entry, &model);
+    }
+    return model;
+  }
+
+ private:
+  std::string NewName(const std::string &prefix) {
+    std::ostringstream os;
+    os << prefix << '_' << counter_++;
+    return os.str();
+  }
+
+  std::string AddTensor(const std::vector<int64> &dims, int32 data_type,
+                        const std::string &raw_data) {
+    std::string name = NewName("const"), tensor;
+    for (size_t i = 0; i < dims.size(); i++)
+      WriteIntField(1, dims[i], &tensor);
+    WriteIntField(2, data_type, &tensor);
+    WriteBytesField(8, name, &tensor);
+    WriteBytesField(9, raw_data, &tensor);
+    WriteBytesField(5, tensor, &graph_);
+    return name;
+  }
+
+  static std::string ValueInfo(const std::string &name,
+                               const std::vector<int64> &dims) {
+    std::string shape, tensor_type, type, value_info;
+    for (size_t i = 0; i < dims.size(); i++) {
+      std::string dim;
+      WriteIntField(1, dims[i], &dim);
+      WriteBytesField(1, dim, &shape);
+    }
+    WriteIntField(1, kTensorFloat, &tensor_type);
+    WriteBytesField(2, shape, &tensor_type);
+    WriteBytesField(1, tensor_type, &type);
+    WriteBytesField(1, name, &value_info);
+    WriteBytesField(2, type, &value_info);
+    return value_info;
+  }
+
+  std::string graph_;  // the fields of the GraphProto written so far.
+  int32 counter_;  // used to make unique names.
+};
+
+
+void VectorToFloats(const CuVectorBase<BaseFloat> &v,
+                    std::vector<float> *out) {
+  Vector<BaseFloat> v_cpu(v);
+  out->resize(v_cpu.Dim());
+  for (int32 i = 0; i < v_cpu.Dim(); i++)
+    (*out)[i] = v_cpu(i);
+}
+
+// Outputs the matrix in row-major order.
+void MatrixToFloats(const CuMatrixBase<BaseFloat> &m,
+                    std::vector<float> *out) {
+  Matrix<BaseFloat> m_cpu(m);
+  out->resize(static_cast<size_t>(m_cpu.NumRows()) * m_cpu.NumCols());
+  for (int32 r = 0; r < m_cpu.NumRows(); r++)
+    for (int32 c = 0; c < m_cpu.NumCols(); c++)
+      (*out)[static_cast<size_t>(r) * m_cpu.NumCols() + c] = m_cpu(r, c);
+}
+
+
+// This class does the work of ExportNnetToOnnx().  The tensor of each node
+// has one row per frame the node has to compute, in increasing order of t
+// (see node_times_).
+class NnetOnnxExporter {
+ public:
+  NnetOnnxExporter(const OnnxExportOptions &opts, const Nnet &nnet):
+      opts_(opts), nnet_(nnet),
+      node_times_(nnet.NumNodes()), node_tensors_(nnet.NumNodes()) { }
+
+  void Export(std::ostream &os) {
+    int32 output_node = nnet_.GetNodeIndex(opts_.output_name);
+    if (output_node == -1 || !nnet_.IsOutputNode(output_node))
+      KALDI_ERR << "No output node called '" << opts_.output_name
+                << "' in the nnet.";
+    std::vector<int32> order;
+    ComputeOrder(&order);
+    ComputeRequiredTimes(output_node, order);
+    for (size_t i = 0; i < order.size(); i++) {
+      int32 node = order[i];
+      if (!node_times_[node].empty())
+        ComputeNode(node);
+    }
+    builder_.AddNode("Identity",
+                     std::vector<std::string>(1, node_tensors_[output_node]),
+                     "", opts_.output_name);
+    builder_.AddOutput(opts_.output_name,
+                       Dims(node_times_[output_node].size(),
+                            nnet_.OutputDim(opts_.output_name)));
+
+    std::vector<std::pair<std::string, std::string> > metadata;
+    AddMetadata("frames_per_chunk", opts_.frames_per_chunk, &metadata);
+    AddMetadata("frame_subsampling_factor", opts_.frame_subsampling_factor,
+                &metadata);
+    int32 input_node = nnet_.GetNodeIndex("input");
+    if (input_node != -1 && !node_times_[input_node].empty()) {
+      const std::vector<int32> &times = node_times_[input_node];
+      AddMetadata("left_context", -times.front(), &metadata);
+      AddMetadata("right_context", times.back() - node_times_[output_node].back(),
+                  &metadata);
+    }
+    std::string model = builder_.GetModel(metadata);
+    os.write(model.data(), model.size());
+    if (!os.good())
+      KALDI_ERR << "Error writing the ONNX model.";
+  }
+
+ private:
+  static std::vector<int64> Dims(int64 num_rows, int64 num_cols) {
+    std::vector<int64> dims(2);
+    dims[0] = num_rows;
+    dims[1] = num_cols;
+    return dims;
+  }
+
+  static void AddMetadata(
+      const std::string &key, int32 value,
+      std::vector<std::pair<std::string, std::string> > *metadata) {
+    std::ostringstream os;
+    os << value;
+    metadata->push_back(std::pair<std::string, std::string>(key, os.str()));
+  }
+
+  // Outputs the nodes in topological order.
+  void ComputeOrder(std::vector<int32> *order) const {
+    std::vector<std::vector<int32> > graph;
+    NnetToDirectedGraph(nnet_, &graph);
+    if (GraphHasCycles(graph))
+      KALDI_ERR << "Exporting recurrent networks to ONNX is not supported.";
+    std::vector<int32> node_to_order;
+    ComputeTopSortOrder(graph, &node_to_order);
+    order->resize(node_to_order.size());
+    for (size_t n = 0; n < node_to_order.size(); n++)
+      (*order)[node_to_order[n]] = n;
+  }
+
+  // Works out which frames each node has to compute, going backward from the
+  // output node.
+  void ComputeRequiredTimes(int32 output_node,
+                            const std::vector<int32> &order) {
+    int32 num_nodes = nnet_.NumNodes();
+    std::vector<std::set<int32> > required(num_nodes);
+    for (int32 i = 0; i < opts_.frames_per_chunk; i++)
+      required[output_node].insert(i * opts_.frame_subsampling_factor);
+    MiscComputationInfo misc_info;
+    for (int32 i = num_nodes - 1; i >= 0; i--) {
+      int32 node = order[i];
+      const std::set<int32> &times = required[node];
+      const NetworkNode &network_node = nnet_.GetNode(node);
+      std::set<int32>::const_iterator iter = times.begin();
+      for (; iter != times.end(); ++iter) {
+        Index index(0, *iter);
+        switch (network_node.node_type) {
+          case kDescriptor: {
+            std::vector<Cindex> dependencies;
+            network_node.descriptor.GetDependencies(index, &dependencies);
+            for (size_t j = 0; j < dependencies.size(); j++) {
+              CheckIndex(node, dependencies[j].second);
+              required[dependencies[j].first].insert(
+                  dependencies[j].second.t);
+            }
+            break;
+          }
+          case kComponent: {
+            const Component *c =
+                nnet_.GetComponent(network_node.u.component_index);
+            if (c->Properties() & kSimpleComponent) {
+              required[node - 1].insert(*iter);
+            } else {
+              std::vector<Index> input_indexes;
+              c->GetInputIndexes(misc_info, index, &input_indexes);
+              for (size_t j = 0; j < input_indexes.size(); j++) {
+                CheckIndex(node, input_indexes[j]);
+                required[node - 1].insert(input_indexes[j].t);
+              }
+            }
+            break;
+          }
+          case kDimRange:
+            required[network_node.u.node_index].insert(*iter);
+            break;
+          default:
+            break;
+        }
+      }
+    }
+    for (int32 node = 0; node < num_nodes; node++) {
+      if (required[node].empty())
+        continue;
+      std::vector<int32> &times = node_times_[node];
+      if (nnet_.IsInputNode(node)) {
+        // Inputs are contiguous ranges of frames.
+        for (int32 t = *required[node].begin(); t <= *required[node].rbegin();
+             t++)
+          times.push_back(t);
+      } else {
+        times.assign(required[node].begin(), required[node].end());
+      }
+    }
+  }
+
+  void CheckIndex(int32 node, const Index &index) const {
+    if (index.n != 0 || index.x != 0)
+      KALDI_ERR << "Exporting to ONNX: node " << nnet_.GetNodeName(node)
+                << " uses the 'n' or 'x' index, which is not supported.";
+  }
+
+  void ComputeNode(int32 node) {
+    const NetworkNode &network_node = nnet_.GetNode(node);
+    switch (network_node.node_type) {
+      case kInput: {
+        const std::string &name = nnet_.GetNodeName(node);
+        builder_.AddInput(name, Dims(node_times_[node].size(),
+                                     nnet_.InputDim(name)));
+        node_tensors_[node] = name;
+        break;
+      }
+      case kDescriptor:
+        node_tensors_[node] = DescriptorTensor(node);
+        break;
+      case kComponent:
+        node_tensors_[node] = ComponentTensor(node);
+        break;
+      case kDimRange: {
+        std::string rows = SelectRows(network_node.u.node_index,
+                                      node_times_[node]);
+        std::vector<std::string> inputs(1, rows);
+        std::vector<int64> dims(1, 1);
+        inputs.push_back(builder_.AddInt64Tensor(
+            dims, std::vector<int64>(1, network_node.dim_offset)));
+        inputs.push_back(builder_.AddInt64Tensor(
+            dims, std::vector<int64>(1, network_node.dim_offset +
+                                     network_node.dim)));
+        inputs.push_back(builder_.AddInt64Tensor(dims,
+                                                 std::vector<int64>(1, 1)));
+        node_tensors_[node] = builder_.AddNode("Slice", inputs);
+        break;
+      }
+      default:
+        KALDI_ERR << "Unexpected node type";
+    }
+  }
+
+  // Returns a tensor whose rows are frames 'times' of node 'src_node', which
+  // must be among node_times_[src_node].
+  std::string SelectRows(int32 src_node, const std::vector<int32> &times) {
+    const std::vector<int32> &src_times = node_times_[src_node];
+    if (times == src_times)
+      return node_tensors_[src_node];
+    std::vector<int64> indexes(times.size());
+    for (size_t i = 0; i < times.size(); i++) {
+      std::vector<int32>::const_iterator iter =
+          std::lower_bound(src_times.begin(), src_times.end(), times[i]);
+      KALDI_ASSERT(iter != src_times.end() && *iter == times[i]);
+      indexes[i] = iter - src_times.begin();
+    }
+    std::vector<std::string> inputs(1, node_tensors_[src_node]);
+    inputs.push_back(builder_.AddInt64Tensor(
+        std::vector<int64>(1, indexes.size()), indexes));
+    return builder_.AddNode("Gather", inputs,
+                            OnnxGraphBuilder::IntAttribute("axis", 0));
+  }
+
+  std::string SumDescriptorTensor(int32 node, const SumDescriptor &sum) {
+    const std::vector<int32> &times = node_times_[node];
+    const SimpleSumDescriptor *simple =
+        dynamic_cast<const SimpleSumDescriptor*>(&sum);
+    if (simple != NULL) {
+      const ForwardingDescriptor &src = simple->Src();
+      int32 src_node = -1;
+      std::vector<int32> src_times(times.size());
+      for (size_t i = 0; i < times.size(); i++) {
+        Cindex cindex = src.MapToInput(Index(0, times[i]));
+        if (src_node != -1 && cindex.first != src_node)
+          KALDI_ERR << "Exporting to ONNX: descriptor of node "
+                    << nnet_.GetNodeName(node) << " switches between nodes, "
+                    << "which is not supported.";
+        src_node = cindex.first;
+        src_times[i] = cindex.second.t;
+      }
+      std::string ans = SelectRows(src_node, src_times);
+      BaseFloat scale = src.GetScaleForNode(src_node);
+      if (scale != 1.0) {
+        std::vector<std::string> inputs(1, ans);
+        inputs.push_back(builder_.AddFloatTensor(std::vector<int64>(),
+                                                 std::vector<float>(1, scale)));
+        ans = builder_.AddNode("Mul", inputs);
+      }
+      return ans;
+    }
+    const BinarySumDescriptor *binary =
+        dynamic_cast<const BinarySumDescriptor*>(&sum);
+    if (binary != NULL && binary->Op() == BinarySumDescriptor::kSumOperation) {
+      std::vector<std::string> inputs;
+      inputs.push_back(SumDescriptorTensor(node, binary->Src1()));
+      inputs.push_back(SumDescriptorTensor(node, binary->Src2()));
+      return builder_.AddNode("Add", inputs);
+    }
+    std::ostringstream os;
+    sum.WriteConfig(os, nnet_.GetNodeNames());
+    KALDI_ERR << "Exporting to ONNX: descriptor " << os.str() << " of node "
+              << nnet_.GetNodeName(node) << " is not supported.";
+    return "";
+  }
+
+  std::string DescriptorTensor(int32 node) {
+    const Descriptor &descriptor = nnet_.GetNode(node).descriptor;
+    std::vector<std::string> parts(descriptor.NumParts());
+    for (int32 p = 0; p < descriptor.NumParts(); p++)
+      parts[p] = SumDescriptorTensor(node, descriptor.Part(p));
+    if (parts.size() == 1)
+      return parts[0];
+    return builder_.AddNode("Concat", parts,
+                            OnnxGraphBuilder::IntAttribute("axis", 1));
+  }
+
+  // Returns the name of a float initializer equal to v repeated 'dim / v.Dim()'
+  // times (used for components that work on blocks).
+  std::string TiledVector(const CuVectorBase<BaseFloat> &v, int32 dim) {
+    std::vector<float> block, data;
+    VectorToFloats(v, &block);
+    KALDI_ASSERT(!block.empty() && dim % block.size() == 0);
+    for (int32 i = 0; i < dim; i += block.size())
+      data.insert(data.end(), block.begin(), block.end());
+    return builder_.AddFloatTensor(std::vector<int64>(1, dim), data);
+  }
+
+  std::string MatrixTensor(const CuMatrixBase<BaseFloat> &m) {
+    std::vector<float> data;
+    MatrixToFloats(m, &data);
+    return builder_.AddFloatTensor(Dims(m.NumRows(), m.NumCols()), data);
+  }
+
+  // y = x W^T + b (b may be empty).
+  std::string Gemm(const std::string &x, const CuMatrixBase<BaseFloat> &w,
+                   const CuVectorBase<BaseFloat> *b) {
+    std::vector<std::string> inputs(1, x);
+    inputs.push_back(MatrixTensor(w));
+    if (b != NULL && b->Dim() != 0)
+      inputs.push_back(TiledVector(*b, b->Dim()));
+    return builder_.AddNode("Gemm", inputs,
+                            OnnxGraphBuilder::IntAttribute("transB", 1));
+  }
+
+  std::string ComponentTensor(int32 node) {
+    const Component *c =
+        nnet_.GetComponent(nnet_.GetNode(node).u.component_index);
+    const std::vector<int32> &times = node_times_[node];
+    const TdnnComponent *tdnn = dynamic_cast<const TdnnComponent*>(c);
+    if (tdnn != NULL) {
+      // Splice the input at the time offsets, then it's an affine transform.
+      const std::vector<int32> &offsets = tdnn->TimeOffsets();
+      std::vector<std::string> parts(offsets.size());
+      for (size_t i = 0; i < offsets.size(); i++) {
+        std::vector<int32> input_times(times);
+        for (size_t j = 0; j < times.size(); j++)
+          input_times[j] += offsets[i];
+        parts[i] = SelectRows(node - 1, input_times);
+      }
+      std::string x = (parts.size() == 1 ? parts[0] :
+                       builder_.AddNode("Concat", parts,
+                           OnnxGraphBuilder::IntAttribute("axis", 1)));
+      return Gemm(x, tdnn->LinearParams(), &(tdnn->BiasParams()));
+    }
+
+    std::string x = SelectRows(node - 1, times);
+    std::vector<std::string> inputs(1, x);
+    const std::string type = c->Type();
+    if (const AffineComponent *affine =
+        dynamic_cast<const AffineComponent*>(c)) {
+      return Gemm(x, affine->LinearParams(), &(affine->BiasParams()));
+    } else if (const FixedAffineComponent *fixed_affine =
+               dynamic_cast<const FixedAffineComponent*>(c)) {
+      return Gemm(x, fixed_affine->LinearParams(),
+                  &(fixed_affine->BiasParams()));
+    } else if (const LinearComponent *linear =
+               dynamic_cast<const LinearComponent*>(c)) {
+      return Gemm(x, linear->Params(), NULL);
+    } else if (const BatchNormComponent *batchnorm =
+               dynamic_cast<const BatchNormComponent*>(c)) {
+      if (batchnorm->Offset().Dim() == 0)
+        KALDI_ERR << "Exporting to ONNX: BatchNormComponent "
+                  << nnet_.GetNodeName(node) << " has no stats.";
+      inputs.push_back(TiledVector(batchnorm->Scale(), c->InputDim()));
+      std::vector<std::string> add_inputs(1, builder_.AddNode("Mul", inputs));
+      add_inputs.push_back(TiledVector(batchnorm->Offset(), c->InputDim()));
+      return builder_.AddNode("Add", add_inputs);
+    } else if (const FixedScaleComponent *fixed_scale =
+               dynamic_cast<const FixedScaleComponent*>(c)) {
+      inputs.push_back(TiledVector(fixed_scale->Scales(), c->InputDim()));
+      return builder_.AddNode("Mul", inputs);
+    } else if (const DropoutComponent *dropout =
+               dynamic_cast<const DropoutComponent*>(c)) {
+      // In test mode the dropout component scales by one minus the dropout
+      // proportion.
+      inputs.push_back(builder_.AddFloatTensor(
+          std::vector<int64>(),
+          std::vector<float>(1, 1.0 - dropout->DropoutProportion())));
+      return builder_.AddNode("Mul", inputs);
+    } else if (type == "RectifiedLinearComponent") {
+      return builder_.AddNode("Relu", inputs);
+    } else if (type == "SigmoidComponent") {
+      return builder_.AddNode("Sigmoid", inputs);
+    } else if (type == "TanhComponent") {
+      return builder_.AddNode("Tanh", inputs);
+    } else if (type == "SoftmaxComponent") {
+      return builder_.AddNode("Softmax", inputs,
+                              OnnxGraphBuilder::IntAttribute("axis", 1));
+    } else if (type == "LogSoftmaxComponent") {
+      return builder_.AddNode("LogSoftmax", inputs,
+                              OnnxGraphBuilder::IntAttribute("axis", 1));
+    } else if (type == "NoOpComponent" || type == "GeneralDropoutComponent" ||
+               type == "SpecAugmentTimeMaskComponent" ||
+               type == "ClipGradientComponent") {
+      // These are the identity at test time.
+      return x;
+    }
+    KALDI_ERR << "Exporting to ONNX: component type " << type
+              << " (node " << nnet_.GetNodeName(node) << ") is not supported.";
+    return "";
+  }
+
+  const OnnxExportOptions &opts_;
+  const Nnet &nnet_;
+  OnnxGraphBuilder builder_;
+  // The frames that each node has to compute, sorted; empty for nodes that
+  // are not needed.
+  std::vector<std::vector<int32> > node_times_;
+  // The name of the tensor containing the output of each node.
+  std::vector<std::string> node_tensors_;
+};
+
+}  // namespace
+
+
+void ExportNnetToOnnx(const OnnxExportOptions &opts,
+                      const Nnet &nnet,
+                      std::ostream &os) {
+  KALDI_ASSERT(opts.frames_per_chunk > 0 && opts.frame_subsampling_factor > 0);
+  Nnet nnet_copy(nnet);
+  SetBatchnormTestMode(true, &nnet_copy);
+  SetDropoutTestMode(true, &nnet_copy);
+  if (opts.collapse_model)
+    CollapseModel(CollapseModelConfig(), &nnet_copy);
+  NnetOnnxExporter exporter(opts, nnet_copy);
+  exporter.Export(os);
+}
+
+}  // namespace nnet3
+}  // namespace kaldi
@@ -0,0 +1,95 @@
+// nnet3/nnet-export-onnx.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_EXPORT_ONNX_H_
+#define KALDI_NNET3_NNET_EXPORT_ONNX_H_
+
+#include <string>
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "nnet3/nnet-nnet.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+/**
+   This file contains code for exporting a feedforward nnet3 model (e.g. a TDNN
+   or TDNN-F acoustic model) to the ONNX format, so that it can be run by
+   inference engines such as ONNX Runtime or TensorRT.
+
+   ONNX graphs work on fixed tensors, not on Indexes, so the exported graph
+   computes one chunk of a fixed size: given 'frames_per_chunk' output frames
+   (at t = 0, f, 2f, ... where f is the frame-subsampling-factor), it works out
+   which frames each node has to compute, like the nnet3 compiler does, and
+   turns the time-offsets of the Descriptors into Gather operations on the rows.
+   The graph has one input per input node of the nnet (e.g. "input" and
+   "ivector"), of shape [num-frames, dim], whose row i is frame t-min + i (so
+   for "input", t-min is minus the left context of the model), and one output,
+   of shape [frames-per-chunk, output-dim].  The model's left and right context
+   and the chunk size are stored in the metadata of the ONNX model.
+
+   Before exporting, the model is put in test mode and collapsed (see
+   CollapseModel()), so that dropout and batch-norm components are mostly
+   folded into the affine components.  Only networks without recurrence are
+   supported, with the Descriptors Append, Offset, Sum, Scale, Round and
+   ReplaceIndex, and the component types AffineComponent (and its
+   natural-gradient variant), FixedAffineComponent, LinearComponent,
+   TdnnComponent, RectifiedLinearComponent, SigmoidComponent, TanhComponent,
+   SoftmaxComponent, LogSoftmaxComponent, BatchNormComponent,
+   FixedScaleComponent, NoOpComponent and the dropout components; anything
+   else is an error.
+*/
+
+struct OnnxExportOptions {
+  int32 frames_per_chunk;
+  int32 frame_subsampling_factor;
+  std::string output_name;
+  bool collapse_model;
+
+  OnnxExportOptions(): frames_per_chunk(50),
+                       frame_subsampling_factor(1),
+                       output_name("output"),
+                       collapse_model(true) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("frames-per-chunk", &frames_per_chunk,
+                   "Number of output frames computed by the exported graph "
+                   "(after frame subsampling).");
+    opts->Register("frame-subsampling-factor", &frame_subsampling_factor,
+                   "Required if the frame-rate of the output (e.g. in 'chain' "
+                   "models) is less than the frame-rate of the original "
+                   "alignment.");
+    opts->Register("output-name", &output_name,
+                   "Name of the output node of the nnet to export.");
+    opts->Register("collapse-model", &collapse_model,
+                   "If true, collapse the model (see CollapseModel()) before "
+                   "exporting it.  Dropout and batch-norm components are "
+                   "set to test mode in any case.");
+  }
+};
+
+/// Writes 'nnet' to 'os' as a serialized ONNX ModelProto (binary protobuf),
+/// as described at the top of this file.  Dies with KALDI_ERR if the network
+/// uses something the exporter does not support.
+void ExportNnetToOnnx(const OnnxExportOptions &opts,
+                      const Nnet &nnet,
+                      std::ostream &os);
+
+}  // namespace nnet3
+}  // namespace kaldi
+
+#endif  // KALDI_NNET3_NNET_EXPORT_ONNX_H_
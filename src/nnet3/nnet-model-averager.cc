@@ -0,0 +1,74 @@
+// nnet3/nnet-model-averager.cc
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-model-averager.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+NnetModelAverager::NnetModelAverager(int32 num_workers):
+    num_workers_(num_workers), num_arrived_(0), num_done_(0),
+    generation_(0), all_done_(false), aborted_(false) {
+  KALDI_ASSERT(num_workers > 0);
+}
+
+bool NnetModelAverager::Average(bool done, Nnet *nnet) {
+  Vector<BaseFloat> params(NumParameters(*nnet), kUndefined);
+  VectorizeNnet(*nnet, &params);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (aborted_)
+    KALDI_ERR << "Model averaging was aborted (another worker failed).";
+  if (num_arrived_ == 0)
+    sum_.Resize(params.Dim());
+  else if (sum_.Dim() != params.Dim())
+    KALDI_ERR << "Averaging networks with different numbers of parameters.";
+  sum_.AddVec(1.0, params);
+  if (done)
+    num_done_++;
+  int64 generation = generation_;
+  if (++num_arrived_ == num_workers_) {
+    sum_.Scale(1.0 / num_workers_);
+    average_.Swap(&sum_);
+    all_done_ = (num_done_ == num_workers_);
+    num_arrived_ = 0;
+    num_done_ = 0;
+    generation_++;
+    cond_.notify_all();
+  } else {
+    while (generation_ == generation && !aborted_)
+      cond_.wait(lock);
+    if (aborted_)
+      KALDI_ERR << "Model averaging was aborted (another worker failed).";
+  }
+  bool all_done = all_done_;
+  lock.unlock();
+  UnVectorizeNnet(average_, nnet);
+  return all_done;
+}
+
+void NnetModelAverager::Abort() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  aborted_ = true;
+  cond_.notify_all();
+}
+
+} // namespace nnet3
+} // namespace kaldi
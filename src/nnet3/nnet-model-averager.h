@@ -0,0 +1,99 @@
+// nnet3/nnet-model-averager.h
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_MODEL_AVERAGER_H_
+#define KALDI_NNET3_NNET_MODEL_AVERAGER_H_
+
+#include <condition_variable>
+#include <mutex>
+#include "base/kaldi-common.h"
+#include "matrix/kaldi-vector.h"
+#include "nnet3/nnet-nnet.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+/**
+   NnetModelAverager does periodic parameter averaging between copies of a
+   neural network that are trained in parallel by threads of the same process,
+   typically each on its own GPU (see CuDevice::SetThreadDeviceId()).  This is
+   the in-process version of what the training scripts do with nnet3-average
+   between jobs, except that it can be done as often as every few minibatches.
+
+   Each of the 'num_workers' threads trains its own copy of the network and
+   calls Average() every so many minibatches; Average() waits until all the
+   threads have called it, and then sets all the copies to the average of
+   their parameters (the parameters as returned by VectorizeNnet(); things
+   like batch-norm stats are not averaged).  The averaging is done in host
+   memory.  Threads that have run out of data should keep calling Average()
+   with done == true, without training, until it returns true, e.g.:
+
+   \code
+     while (GetNextMinibatch(&eg)) {
+       trainer.Train(eg);
+       if (++num_minibatches % average_period == 0)
+         averager->Average(false, &nnet);
+     }
+     while (!averager->Average(true, &nnet));
+   \endcode
+
+   After the last call all the copies have identical parameters.
+*/
+class NnetModelAverager {
+ public:
+  explicit NnetModelAverager(int32 num_workers);
+
+  /// Waits until all workers have called this, then sets the parameters of
+  /// 'nnet' to the average over the workers.  'done' should be true if this
+  /// worker has no more data.  Returns true if all workers called this with
+  /// done == true, which means this was the final averaging.  Throws if
+  /// Abort() was called.
+  bool Average(bool done, Nnet *nnet);
+
+  /// Makes current and future calls to Average() throw; a worker should call
+  /// this if it fails, so that the others do not wait for it forever.
+  void Abort();
+
+ private:
+  int32 num_workers_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  // The number of workers that have called Average() in this round, and how
+  // many of those had done == true.
+  int32 num_arrived_;
+  int32 num_done_;
+  // Incremented each time a round of averaging completes.
+  int64 generation_;
+  // True if all workers were done in the last completed round.
+  bool all_done_;
+  bool aborted_;
+  // The sum of the parameters in the current round.
+  Vector<BaseFloat> sum_;
+  // The average from the last completed round.  It is not changed until all
+  // workers have called Average() again, so the workers may copy it without
+  // holding the lock.
+  Vector<BaseFloat> average_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetModelAverager);
+};
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_MODEL_AVERAGER_H_
@@ -456,8 +456,14 @@ void* BatchNormComponent::Propagate(const ComponentPrecomputedIndexes *indexes,
       else  // why was ComputeDerived() not called?
         KALDI_ERR << "Code error in BatchNormComponent";
     }
-    out->CopyFromMat(in);
-    out->MulColsVec(scale_);
+    // This does two passes over the data (the scale is applied as part of
+    // the copy if the propagation is not in-place).  Where possible, test-mode
+    // batchnorm is folded into a neighbouring affine component instead; see
+    // CollapseModel().
+    if (in.Data() == out->Data())
+      out->MulColsVec(scale_);
+    else
+      out->AddMatDiagVec(1.0, in, kNoTrans, scale_, 0.0);
     out->AddVecToRows(1.0, offset_, 1.0);
     return NULL;
   }
@@ -200,6 +200,9 @@ static void UnitTestNnetOptimizeInternal(int32 srand_seed) {
   // (without really changing anything).
   if (RandInt(0, 3) == 0) optimize_all.min_deriv_time = -200;
   if (RandInt(0, 3) == 0) optimize_all.max_deriv_time = 1000;
+  // and sometimes set a tiny memory budget, so that everything that can be
+  // recomputed in the backward pass is.
+  if (RandInt(0, 3) == 0) optimize_all.memory_budget_mb = 1.0e-03;
 
   // this is useful for debugging as it removes nans:
   // optimize_all.initialize_undefined = false;
@@ -273,6 +276,11 @@ static void UnitTestNnetOptimizeInternal(int32 srand_seed) {
                                                             compiler);
   optimize = optimize_all;
 
+  optimize.memory_budget_mb = 0.0;
+  bool succ_no_memory_budget = UnitTestNnetOptimizeWithOptions(srand_seed, optimize,
+                                                               compiler);
+  optimize = optimize_all;
+
 
 #define KALDI_SUCCFAIL(b) ((b) ? "SUCCESS" : "FAILURE")
   KALDI_ERR
@@ -288,7 +296,8 @@ static void UnitTestNnetOptimizeInternal(int32 srand_seed) {
     << "\n  allocate_from_other  ... " << KALDI_SUCCFAIL(succ_no_allocate_from_other)
     << "\n  move_sizing_commands ... " << KALDI_SUCCFAIL(succ_no_move_sizing_commands)
     << "\n  snip_row_ops         ... " << KALDI_SUCCFAIL(succ_no_snip_row_ops)
-    << "\n  no_deriv_time        ... " << KALDI_SUCCFAIL(succ_no_deriv_time);
+    << "\n  no_deriv_time        ... " << KALDI_SUCCFAIL(succ_no_deriv_time)
+    << "\n  memory_budget_mb     ... " << KALDI_SUCCFAIL(succ_no_memory_budget);
 #undef KALDI_SUCCFAIL
 }
 
@@ -302,6 +311,205 @@ static void UnitTestNnetOptimize() {
 
 
 
+// Tests FusePropagations() on a network where it applies, by comparing the
+// output with that of the unoptimized computation.
+static void UnitTestNnetOptimizeFusePropagations() {
+  std::string config =
+      "input-node name=input dim=10\n"
+      "component name=affine1 type=NaturalGradientAffineComponent "
+      "input-dim=30 output-dim=20\n"
+      "component name=relu1 type=RectifiedLinearComponent dim=20\n"
+      "component name=scale1 type=FixedScaleComponent dim=20 scale=0.5\n"
+      "component name=tdnn2 type=TdnnComponent input-dim=20 output-dim=15 "
+      "time-offsets=-1,0,1\n"
+      "component name=relu2 type=RectifiedLinearComponent dim=15\n"
+      "component name=affine3 type=AffineComponent input-dim=15 "
+      "output-dim=5\n"
+      "component-node name=affine1 component=affine1 "
+      "input=Append(Offset(input, -1), input, Offset(input, 1))\n"
+      "component-node name=relu1 component=relu1 input=affine1\n"
+      "component-node name=scale1 component=scale1 input=relu1\n"
+      "component-node name=tdnn2 component=tdnn2 input=scale1\n"
+      "component-node name=relu2 component=relu2 input=tdnn2\n"
+      "component-node name=affine3 component=affine3 input=relu2\n"
+      "output-node name=output input=affine3\n";
+  Nnet nnet;
+  {
+    std::istringstream is(config);
+    nnet.ReadConfig(is);
+  }
+  ComputationRequest request;
+  request.inputs.push_back(IoSpecification("input", -2, 12));
+  request.outputs.push_back(IoSpecification("output", 0, 10));
+
+  NnetComputation computation;
+  Compiler compiler(request, nnet);
+  CompilerOptions compiler_opts;
+  compiler.CreateComputation(compiler_opts, &computation);
+  NnetComputation computation_opt(computation);
+  NnetOptimizeOptions opt_config;
+  Optimize(opt_config, nnet, MaxOutputTimeInRequest(request),
+           &computation_opt);
+  {
+    std::ostringstream os;
+    computation_opt.Print(os, nnet);
+    KALDI_LOG << "Optimized computation is: " << os.str();
+  }
+  int32 num_fused = 0;
+  for (size_t i = 0; i < computation_opt.commands.size(); i++)
+    if (computation_opt.commands[i].command_type == kPropagate &&
+        computation_opt.commands[i].arg7 >= 0)
+      num_fused++;
+  KALDI_ASSERT(num_fused == 2);
+
+  computation.ComputeCudaIndexes();
+  computation_opt.ComputeCudaIndexes();
+  Matrix<BaseFloat> input(14, 10);
+  input.SetRandn();
+  NnetComputeOptions compute_opts;
+  NnetComputer computer(compute_opts, computation, nnet, NULL),
+      computer_opt(compute_opts, computation_opt, nnet, NULL);
+  CuMatrix<BaseFloat> temp(input), temp2(input);
+  computer.AcceptInput("input", &temp);
+  computer_opt.AcceptInput("input", &temp2);
+  computer.Run();
+  computer_opt.Run();
+  const CuMatrixBase<BaseFloat> &output(computer.GetOutput("output")),
+      &output_opt(computer_opt.GetOutput("output"));
+  KALDI_LOG << "Output sum is " << output.Sum() << ", [fused] "
+            << output_opt.Sum();
+  KALDI_ASSERT(output.ApproxEqual(output_opt));
+}
+
+
+// Tests OptimizeRecomputation() on a network where it applies: with a tiny
+// memory budget, the outputs of the affine+ReLU layers should be recomputed in
+// the backward pass, reducing the memory use without changing the results.
+static void UnitTestNnetOptimizeRecomputation() {
+  std::string config =
+      "input-node name=input dim=10\n"
+      "component name=affine1 type=AffineComponent input-dim=30 "
+      "output-dim=200\n"
+      "component name=relu1 type=RectifiedLinearComponent dim=200\n"
+      "component name=affine2 type=AffineComponent input-dim=200 "
+      "output-dim=200\n"
+      "component name=sigmoid2 type=SigmoidComponent dim=200\n"
+      "component name=affine3 type=AffineComponent input-dim=200 "
+      "output-dim=5\n"
+      "component-node name=affine1 component=affine1 "
+      "input=Append(Offset(input, -1), input, Offset(input, 1))\n"
+      "component-node name=relu1 component=relu1 input=affine1\n"
+      "component-node name=affine2 component=affine2 input=relu1\n"
+      "component-node name=sigmoid2 component=sigmoid2 input=affine2\n"
+      "component-node name=affine3 component=affine3 input=sigmoid2\n"
+      "output-node name=output input=affine3\n";
+  Nnet nnet;
+  {
+    std::istringstream is(config);
+    nnet.ReadConfig(is);
+  }
+  ComputationRequest request;
+  request.inputs.push_back(IoSpecification("input", -1, 11));
+  request.inputs[0].has_deriv = true;
+  request.outputs.push_back(IoSpecification("output", 0, 10));
+  request.outputs[0].has_deriv = true;
+
+  NnetComputation computation;
+  Compiler compiler(request, nnet);
+  CompilerOptions compiler_opts;
+  compiler.CreateComputation(compiler_opts, &computation);
+  NnetComputation computation_opt(computation),
+      computation_budget(computation);
+  NnetOptimizeOptions opt_config;
+  Optimize(opt_config, nnet, MaxOutputTimeInRequest(request),
+           &computation_opt);
+  opt_config.memory_budget_mb = 1.0e-03;
+  Optimize(opt_config, nnet, MaxOutputTimeInRequest(request),
+           &computation_budget);
+  {
+    std::ostringstream os;
+    computation_budget.Print(os, nnet);
+    KALDI_LOG << "Optimized computation with memory budget is: " << os.str();
+  }
+  int64 memory_use = GetMaxMemoryUse(computation_opt),
+      memory_use_budget = GetMaxMemoryUse(computation_budget);
+  KALDI_LOG << "Memory use is " << memory_use << " bytes, with budget "
+            << memory_use_budget;
+  KALDI_ASSERT(memory_use_budget < memory_use);
+
+  computation.ComputeCudaIndexes();
+  computation_budget.ComputeCudaIndexes();
+  Matrix<BaseFloat> input(12, 10), output_deriv(10, 5);
+  input.SetRandn();
+  output_deriv.SetRandn();
+  Nnet gradient(nnet);
+  ScaleNnet(0.0, &gradient);
+  SetNnetAsGradient(&gradient);
+  Nnet gradient_budget(gradient);
+  NnetComputeOptions compute_opts;
+  NnetComputer computer(compute_opts, computation, nnet, &gradient),
+      computer_budget(compute_opts, computation_budget, nnet,
+                      &gradient_budget);
+  CuMatrix<BaseFloat> temp(input), temp2(input);
+  computer.AcceptInput("input", &temp);
+  computer_budget.AcceptInput("input", &temp2);
+  computer.Run();
+  computer_budget.Run();
+  KALDI_ASSERT(computer.GetOutput("output").ApproxEqual(
+      computer_budget.GetOutput("output")));
+  CuMatrix<BaseFloat> temp3(output_deriv), temp4(output_deriv);
+  computer.AcceptInput("output", &temp3);
+  computer_budget.AcceptInput("output", &temp4);
+  computer.Run();
+  computer_budget.Run();
+  const CuMatrixBase<BaseFloat> &input_deriv(computer.GetOutput("input")),
+      &input_deriv_budget(computer_budget.GetOutput("input"));
+  KALDI_LOG << "Input-deriv sum is " << input_deriv.Sum()
+            << ", [with budget] " << input_deriv_budget.Sum();
+  KALDI_ASSERT(input_deriv.ApproxEqual(input_deriv_budget));
+  KALDI_ASSERT(NnetParametersAreIdentical(gradient, gradient_budget, 1.0e-05));
+}
+
+
+// Tests the on-disk computation cache: a second compiler, for a network with
+// the same structure but different parameters, should start out with the
+// computation that the first one compiled.
+static void UnitTestNnetOptimizeDiskCache() {
+  std::vector<std::string> configs;
+  NnetGenerationOptions gen_config;
+  GenerateConfigSequence(gen_config, &configs);
+  Nnet nnet;
+  for (size_t j = 0; j < configs.size(); j++) {
+    std::istringstream is(configs[j]);
+    nnet.ReadConfig(is);
+  }
+  ComputationRequest request;
+  std::vector<Matrix<BaseFloat> > inputs;
+  ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+
+  CachingOptimizingCompilerOptions compiler_config;
+  compiler_config.use_shortcut = false;  // so only one computation is cached.
+  compiler_config.cache_dir = ".";
+  std::string filename;
+  {
+    CachingOptimizingCompiler compiler(nnet, compiler_config);
+    filename = compiler.DiskCacheFilename();
+    std::remove(filename.c_str());
+    compiler.Compile(request);
+  }  // the destructor writes the cache.
+  {
+    Nnet nnet2(nnet);
+    PerturbParams(0.1, &nnet2);
+    CachingOptimizingCompiler compiler(nnet2, compiler_config);
+    KALDI_ASSERT(compiler.DiskCacheFilename() == filename);
+    std::ostringstream os;
+    compiler.WriteCache(os, false);
+    KALDI_ASSERT(os.str().find("<ComputationCacheSize> 1 ") !=
+                 std::string::npos);
+  }
+  std::remove(filename.c_str());
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -314,9 +522,13 @@ int main() {
   CuDevice::Instantiate().SetDebugStrideMode(true);
   CuDevice::Instantiate().SelectGpuId("no");
   UnitTestNnetOptimize();
+  UnitTestNnetOptimizeFusePropagations();
   CuDevice::Instantiate().SelectGpuId("yes");
 #endif
   UnitTestNnetOptimize();
+  UnitTestNnetOptimizeFusePropagations();
+  UnitTestNnetOptimizeRecomputation();
+  UnitTestNnetOptimizeDiskCache();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
@@ -20,6 +20,8 @@
 #include <map>
 #include "nnet3/nnet-optimize-utils.h"
 #include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-simple-component.h"
+#include "nnet3/nnet-convolutional-component.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -708,6 +710,84 @@ void RemoveNoOps(NnetComputation *computation) {
 }
 
 
+// Returns the index of the first command after command 'c' that is not an
+// allocation, deallocation or no-op (i.e. that may access the values of
+// matrices), or -1 if there is none.
+static int32 NextValueCommand(const NnetComputation &computation, int32 c) {
+  int32 num_commands = computation.commands.size();
+  for (c++; c < num_commands; c++) {
+    CommandType command_type = computation.commands[c].command_type;
+    if (command_type != kAllocMatrix && command_type != kDeallocMatrix &&
+        command_type != kNoOperation && command_type != kNoOperationPermanent)
+      return c;
+  }
+  return -1;
+}
+
+// Returns true if 'command' is an in-place propagation of submatrix
+// 'submatrix', with no memo or stats.
+static bool IsInPlacePropagate(const NnetComputation::Command &command,
+                               int32 submatrix) {
+  return command.command_type == kPropagate && command.arg3 == submatrix &&
+      command.arg4 == submatrix && command.arg5 == 0 && command.arg6 == 0;
+}
+
+// Returns true if the propagation of 'component' can be fused with a
+// rectifier after it (see PropagateRectified()).
+static bool CanPropagateRectified(const Component *component) {
+  if (dynamic_cast<const AffineComponent*>(component) != NULL)
+    return true;
+  // A TdnnComponent has kPropagateAdds if and only if it has no bias.
+  return dynamic_cast<const TdnnComponent*>(component) != NULL &&
+      !(component->Properties() & kPropagateAdds);
+}
+
+void FusePropagations(const Nnet &nnet, NnetComputation *computation) {
+  std::vector<NnetComputation::Command> &commands = computation->commands;
+  int32 num_commands = commands.size();
+  for (int32 c = 0; c < num_commands; c++)
+    if (commands[c].command_type == kBackprop ||
+        commands[c].command_type == kBackpropNoModelUpdate)
+      return;  // The backprop might need the values before the rectifier.
+
+  bool changed = false;
+  for (int32 c = 0; c < num_commands; c++) {
+    NnetComputation::Command &affine = commands[c];
+    if (affine.command_type != kPropagate || affine.arg7 >= 0 ||
+        affine.arg5 != 0 || affine.arg6 != 0 ||
+        !CanPropagateRectified(nnet.GetComponent(affine.arg1)))
+      continue;
+    int32 submatrix = affine.arg4,
+        r = NextValueCommand(*computation, c);
+    if (r < 0 || !IsInPlacePropagate(commands[r], submatrix) ||
+        dynamic_cast<const RectifiedLinearComponent*>(
+            nnet.GetComponent(commands[r].arg1)) == NULL)
+      continue;
+    BaseFloat scale = 1.0;
+    int32 s = NextValueCommand(*computation, r);
+    if (s >= 0 && IsInPlacePropagate(commands[s], submatrix)) {
+      const FixedScaleComponent *fixed_scale =
+          dynamic_cast<const FixedScaleComponent*>(
+              nnet.GetComponent(commands[s].arg1));
+      if (fixed_scale != NULL) {
+        BaseFloat min_scale = fixed_scale->Scales().Min(),
+            max_scale = fixed_scale->Scales().Max();
+        if (min_scale == max_scale && min_scale > 0.0) {
+          scale = min_scale;
+          commands[s].command_type = kNoOperation;
+        }
+      }
+    }
+    affine.arg7 = commands[r].arg1;
+    affine.alpha = scale;
+    commands[r].command_type = kNoOperation;
+    changed = true;
+  }
+  if (changed)
+    RemoveNoOps(computation);
+}
+
+
 VariableMergingOptimizer::VariableMergingOptimizer(
     const NnetOptimizeOptions &config,
     const Nnet &nnet,
@@ -4948,6 +5028,321 @@ void OptimizeMemoryCompression(const Nnet &nnet,
 }
 
 
+/**
+   This class is used in the function OptimizeRecomputation().  Each time
+   Optimize() is called it chooses one matrix to be recomputed in the backward
+   pass, if it can find one, and modifies the computation accordingly.
+ */
+class RecomputationOptimizer {
+ public:
+  /** @param [in] nnet         The neural net the computation is for.
+      @param [in] middle_command  Must be the command-index of the
+          command of type kNoOperationMarker in 'computation'.
+      @param [in] max_memory_command  The command-index after which the memory
+          use of the computation is greatest (see GetMaxMemoryUse()); we
+          only choose matrices that would not be allocated at that point.
+      @param [in,out] computation  The computation we're optimizing.
+  */
+  RecomputationOptimizer(const Nnet &nnet,
+                         int32 middle_command,
+                         int32 max_memory_command,
+                         NnetComputation *computation):
+      nnet_(nnet), middle_command_(middle_command),
+      max_memory_command_(max_memory_command), computation_(computation) { }
+
+  // Returns true if it chose a matrix to recompute (and modified the
+  // computation), and false otherwise.
+  bool Optimize();
+ private:
+  // For a matrix that we could recompute, this struct says how.
+  struct MatrixRecomputeInfo {
+    // m is the matrix-index of the matrix we're going to recompute.
+    int32 m;
+    // The command-indexes of the propagate commands that compute the matrix:
+    // the first one writes it from the component input, and the rest (if any)
+    // operate on it in-place.  We will repeat them in the backward pass.
+    std::vector<int32> propagate_commands;
+    // The command-index of the last command in the forward pass that accesses
+    // the matrix; we will deallocate the matrix after it.
+    int32 last_forward_command;
+    // The command-indexes of the backprop commands that read the matrix; we
+    // will recompute it just before the first of them.
+    std::vector<int32> backprop_commands;
+  };
+
+  // This function figures out whether we can recompute matrix m, in such a
+  // way that it would not be allocated at command 'max_memory_command_', and
+  // if so, outputs to 'info' and returns true.
+  bool ProcessMatrix(int32 m, MatrixRecomputeInfo *info) const;
+
+  // Returns true if the underlying matrix of submatrix s is not written to or
+  // deallocated after command c1 and before command c2.
+  bool MatrixIsUnchanged(int32 s, int32 c1, int32 c2) const;
+
+  // Returns the index of a submatrix of matrix 'new_m' with the same row and
+  // column ranges as submatrix s, creating it if it's not already in
+  // 'new_submatrices' (a map from s to the new submatrix).
+  int32 MapSubmatrix(int32 s, int32 new_m,
+                     std::map<int32, int32> *new_submatrices);
+
+  // This function modifies the commands in '*computation_' so that the
+  // matrix in 'info' is recomputed.  The backward pass uses a new matrix, so
+  // that each matrix is still allocated only once.
+  void ModifyComputation(const MatrixRecomputeInfo &info);
+
+  const Nnet &nnet_;
+  int32 middle_command_;
+  int32 max_memory_command_;
+  NnetComputation *computation_;
+  Analyzer analyzer_;
+};
+
+
+bool RecomputationOptimizer::Optimize() {
+  analyzer_.Init(nnet_, *computation_);
+  // note: matrix zero is not really a matrix.
+  int32 num_matrices = computation_->matrices.size();
+  MatrixRecomputeInfo info, best_info;
+  int64 best_num_elements = 0;
+  for (int32 m = 1; m < num_matrices; m++) {
+    if (ProcessMatrix(m, &info)) {
+      const NnetComputation::MatrixInfo &matrix_info =
+          computation_->matrices[m];
+      int64 num_elements = static_cast<int64>(matrix_info.num_rows) *
+          matrix_info.num_cols;
+      if (num_elements > best_num_elements) {
+        best_num_elements = num_elements;
+        best_info = info;
+      }
+    }
+  }
+  if (best_num_elements == 0)
+    return false;
+  ModifyComputation(best_info);
+  return true;
+}
+
+
+bool RecomputationOptimizer::ProcessMatrix(int32 m,
+                                           MatrixRecomputeInfo *info) const {
+  const MatrixAccesses &matrix_accesses = analyzer_.matrix_accesses[m];
+  if (matrix_accesses.is_input || matrix_accesses.is_output ||
+      matrix_accesses.deallocate_command < 0 ||
+      computation_->commands[matrix_accesses.deallocate_command].command_type
+      != kDeallocMatrix)
+    return false;
+
+  const std::vector<Access> &accesses = matrix_accesses.accesses;
+  // the 'kReadAccess' below is actually a don't-care.
+  Access middle_access(middle_command_, kReadAccess);
+  std::vector<Access>::const_iterator
+      middle_iter = std::lower_bound(accesses.begin(), accesses.end(),
+                                     middle_access),
+      iter = accesses.begin();
+  if (middle_iter == accesses.begin() || middle_iter == accesses.end())
+    return false;  // Not accessed in both the forward and backward passes.
+
+  int32 last_forward_command = middle_iter[-1].command_index,
+      first_backward_command = middle_iter->command_index;
+  if (max_memory_command_ <= last_forward_command ||
+      max_memory_command_ >= first_backward_command)
+    return false;  // Recomputing this wouldn't reduce the maximum memory use.
+
+  info->m = m;
+  info->propagate_commands.clear();
+  info->last_forward_command = last_forward_command;
+  info->backprop_commands.clear();
+
+  // Find the propagate commands that compute the matrix: the first writes the
+  // whole of it, and any others are done in-place on the whole of it.
+  for (; iter != middle_iter; ++iter) {
+    int32 c = iter->command_index;
+    const NnetComputation::Command &command = computation_->commands[c];
+    if (command.command_type != kPropagate ||
+        computation_->submatrices[command.arg4].matrix_index != m)
+      break;
+    bool in_place = (command.arg3 > 0 &&
+                     computation_->submatrices[command.arg3].matrix_index == m);
+    if (!computation_->IsWholeMatrix(command.arg4) ||
+        in_place != !info->propagate_commands.empty() ||
+        (in_place && !computation_->IsWholeMatrix(command.arg3)) ||
+        (!in_place && iter->access_type != kWriteAccess) ||
+        command.arg5 != 0)
+      return false;
+    int32 component_index = command.arg1,
+        properties = nnet_.GetComponent(component_index)->Properties();
+    if (properties & (kUsesMemo | kRandomComponent | kPropagateAdds))
+      return false;
+    if (properties & kUpdatableComponent) {
+      // The parameters must not be updated (e.g. by another use of the same
+      // component) before the recomputation.
+      for (int32 c2 = middle_command_; c2 < first_backward_command; c2++) {
+        const NnetComputation::Command &command2 = computation_->commands[c2];
+        if (command2.command_type == kBackprop &&
+            command2.arg1 == component_index)
+          return false;
+      }
+    }
+    info->propagate_commands.push_back(c);
+  }
+  if (info->propagate_commands.empty())
+    return false;
+  // The rest of the forward pass may only read the matrix.
+  for (; iter != middle_iter; ++iter)
+    if (iter->access_type != kReadAccess)
+      return false;
+  // ... and the backward pass may only read it in backprop commands.
+  for (; iter != accesses.end(); ++iter) {
+    CommandType command_type =
+        computation_->commands[iter->command_index].command_type;
+    if (iter->access_type != kReadAccess ||
+        (command_type != kBackprop && command_type != kBackpropNoModelUpdate))
+      return false;
+    info->backprop_commands.push_back(iter->command_index);
+  }
+  // The input of the first propagate command must still be there, unchanged,
+  // when we recompute.
+  int32 first_propagate_command = info->propagate_commands[0];
+  return MatrixIsUnchanged(computation_->commands[first_propagate_command].arg3,
+                           first_propagate_command, first_backward_command);
+}
+
+
+bool RecomputationOptimizer::MatrixIsUnchanged(int32 s, int32 c1,
+                                               int32 c2) const {
+  if (s <= 0)
+    return false;
+  const MatrixAccesses &matrix_accesses =
+      analyzer_.matrix_accesses[computation_->submatrices[s].matrix_index];
+  if (matrix_accesses.deallocate_command >= 0 &&
+      matrix_accesses.deallocate_command < c2)
+    return false;
+  std::vector<Access>::const_iterator
+      iter = matrix_accesses.accesses.begin(),
+      end = matrix_accesses.accesses.end();
+  for (; iter != end; ++iter)
+    if (iter->command_index > c1 && iter->command_index < c2 &&
+        iter->access_type != kReadAccess)
+      return false;
+  return true;
+}
+
+
+int32 RecomputationOptimizer::MapSubmatrix(
+    int32 s, int32 new_m, std::map<int32, int32> *new_submatrices) {
+  std::map<int32, int32>::iterator iter = new_submatrices->find(s);
+  if (iter != new_submatrices->end())
+    return iter->second;
+  NnetComputation::SubMatrixInfo submat_info = computation_->submatrices[s];
+  submat_info.matrix_index = new_m;
+  int32 new_s = computation_->submatrices.size();
+  computation_->submatrices.push_back(submat_info);
+  (*new_submatrices)[s] = new_s;
+  return new_s;
+}
+
+
+void RecomputationOptimizer::ModifyComputation(
+    const MatrixRecomputeInfo &info) {
+  std::vector<int32> whole_submatrices;
+  computation_->GetWholeSubmatrices(&whole_submatrices);
+  int32 m = info.m, s = whole_submatrices[m];
+  NnetComputation::MatrixInfo matrix_info = computation_->matrices[m];
+  int32 new_s = computation_->NewMatrix(matrix_info.num_rows,
+                                        matrix_info.num_cols,
+                                        matrix_info.stride_type),
+      new_m = computation_->submatrices[new_s].matrix_index;
+  if (!computation_->matrix_debug_info.empty())
+    computation_->matrix_debug_info[new_m] =
+        computation_->matrix_debug_info[m];
+
+  // In the backward pass, use 'new_m' instead of m.
+  std::map<int32, int32> new_submatrices;
+  new_submatrices[s] = new_s;
+  for (size_t i = 0; i < info.backprop_commands.size(); i++) {
+    std::vector<int32*> submatrix_args;
+    IdentifySubmatrixArgs(&(computation_->commands[info.backprop_commands[i]]),
+                          &submatrix_args);
+    for (size_t j = 0; j < submatrix_args.size(); j++) {
+      int32 *arg = submatrix_args[j];
+      if (*arg > 0 && computation_->submatrices[*arg].matrix_index == m)
+        *arg = MapSubmatrix(*arg, new_m, &new_submatrices);
+    }
+  }
+  computation_->commands[analyzer_.matrix_accesses[m].deallocate_command].arg1 =
+      new_s;
+
+  // 'pairs_to_insert' will be a list of pairs (command-index, command),
+  // meaning: (command-index just before which to insert this command; command
+  // to insert).
+  std::vector<std::pair<int32, NnetComputation::Command> >
+      pairs_to_insert;
+  pairs_to_insert.push_back(std::pair<int32, NnetComputation::Command>(
+      info.last_forward_command + 1,
+      NnetComputation::Command(kDeallocMatrix, s)));
+  int32 first_backward_command = info.backprop_commands[0];
+  pairs_to_insert.push_back(std::pair<int32, NnetComputation::Command>(
+      first_backward_command,
+      NnetComputation::Command(kAllocMatrix, new_s)));
+  for (size_t i = 0; i < info.propagate_commands.size(); i++) {
+    NnetComputation::Command command =
+        computation_->commands[info.propagate_commands[i]];
+    if (computation_->submatrices[command.arg3].matrix_index == m)
+      command.arg3 = new_s;
+    command.arg4 = new_s;
+    pairs_to_insert.push_back(std::pair<int32, NnetComputation::Command>(
+        first_backward_command, command));
+  }
+  InsertCommands(&pairs_to_insert, computation_);
+}
+
+
+void OptimizeRecomputation(const Nnet &nnet,
+                           int64 max_memory_bytes,
+                           NnetComputation *computation) {
+  if (max_memory_bytes <= 0 || computation->commands.empty())
+    return;
+  // don't apply this optimization to looped computations.
+  if (computation->commands.back().command_type == kGotoLabel)
+    return;
+
+  int32 max_memory_command;
+  int64 bytes_used_initial = GetMaxMemoryUse(*computation, &max_memory_command),
+      bytes_used = bytes_used_initial;
+  int32 num_recomputed = 0;
+  while (bytes_used > max_memory_bytes) {
+    // 'middle_command' will be the index of the command of type
+    // 'kNoOperationMarker' that separates the forward and backward passes.
+    // We have to look for it each time, as inserting commands moves it.
+    int32 middle_command = -1, num_commands = computation->commands.size();
+    for (int32 c = 0; c < num_commands; c++) {
+      if (computation->commands[c].command_type == kNoOperationMarker) {
+        if (middle_command >= 0)
+          return;  // More than one: this wasn't expected, so do nothing.
+        middle_command = c;
+      }
+    }
+    if (middle_command < 0)
+      return;  // This computation doesn't have a backprop pass.
+
+    RecomputationOptimizer opt(nnet, middle_command, max_memory_command,
+                               computation);
+    if (!opt.Optimize())
+      break;
+    num_recomputed++;
+    bytes_used = GetMaxMemoryUse(*computation, &max_memory_command);
+  }
+  if (num_recomputed > 0)
+    KALDI_VLOG(2) << "Recomputing " << num_recomputed << " matrices in the "
+                  << "backward pass reduced memory use from "
+                  << bytes_used_initial << " to " << bytes_used << " bytes.";
+  if (bytes_used > max_memory_bytes)
+    KALDI_WARN << "Computation uses " << bytes_used << " bytes, more than the "
+               << "memory budget of " << max_memory_bytes << " bytes, even "
+               << "with recomputation of activations.";
+}
+
+
 std::shared_ptr<const NnetComputation> ComputationCache::Find(
     const ComputationRequest &in_request) {
   std::lock_guard<std::mutex> lock(mutex_);
@@ -5015,22 +5410,31 @@ std::shared_ptr<const NnetComputation> ComputationCache::Insert(
 }
 
 
-void ComputationCache::Read(std::istream &is, bool binary) {
+void ComputationCache::Read(std::istream &is, bool binary, bool merge) {
   // Note: the object on disk doesn't have tokens like "<ComputationCache>"
   // and "</ComputationCache>" for back-compatibility reasons.
   int32 computation_cache_size;
   ExpectToken(is, binary, "<ComputationCacheSize>");
   ReadBasicType(is, binary, &computation_cache_size);
   KALDI_ASSERT(computation_cache_size >= 0);
-  computation_cache_.clear();
-  access_queue_.clear();
+  if (!merge) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (CacheType::const_iterator iter = computation_cache_.begin();
+         iter != computation_cache_.end(); ++iter)
+      delete iter->first;
+    computation_cache_.clear();
+    access_queue_.clear();
+  }
   ExpectToken(is, binary, "<ComputationCache>");
-  for (size_t c = 0; c < computation_cache_size; c++) {
+  for (int32 c = 0; c < computation_cache_size; c++) {
     ComputationRequest request;
     request.Read(is, binary);
     NnetComputation *computation = new NnetComputation();
     computation->Read(is, binary);
-    Insert(request, computation);
+    if (merge && Find(request) != NULL)
+      delete computation;
+    else
+      Insert(request, computation);
   }
 }
 
@@ -5049,6 +5453,7 @@ void ComputationCache::Check(const Nnet &nnet) const {
 }
 
 void ComputationCache::Write(std::ostream &os, bool binary) const {
+  std::lock_guard<std::mutex> lock(mutex_);
   WriteToken(os, binary, "<ComputationCacheSize>");
   WriteBasicType(os, binary, static_cast<int32>(computation_cache_.size()));
   WriteToken(os, binary, "<ComputationCache>");
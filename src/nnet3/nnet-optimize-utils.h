@@ -487,6 +487,20 @@ void RenumberComputation(NnetComputation *computation);
 /// Removes commands of type kNoOperation in the computation.
 void RemoveNoOps(NnetComputation *computation);
 
+/**
+   This optimization, for computations that have no backprop (i.e. for
+   inference), fuses the propagation of an AffineComponent (or a subclass), or
+   of a TdnnComponent that has a bias, with an in-place propagation of a
+   RectifiedLinearComponent immediately after it, and, if one follows that,
+   with an in-place FixedScaleComponent whose scales are all the same positive
+   value.  The affine command gets the rectifier's component-index as arg7
+   and the scale as alpha, so that NnetComputer calls PropagateRectified(),
+   which adds the bias and applies the rectifier in one kernel; the other
+   commands are removed.  (At test time BatchNormComponents can already be
+   folded into the affine components by CollapseModel()).
+ */
+void FusePropagations(const Nnet &nnet, NnetComputation *computation);
+
 /// This function outputs to "submatrix_args" the addresses of a subset of
 /// arguments arg1 through arg6 in "command", that correspond to the indexes of
 /// submatrices.  This is useful in renumbering code.  Note: some of the
@@ -593,6 +607,25 @@ void OptimizeMemoryCompression(const Nnet &nnet,
                                int32 memory_compression_level,
                                NnetComputation *computation);
 
+/// Reduces the maximum memory use of a computation with a backward pass, as
+/// given by GetMaxMemoryUse(), to 'max_memory_bytes' if it can, by recomputing
+/// activations ("checkpointing").  A matrix that is written by a propagate
+/// command (followed by in-place propagate commands, e.g. an affine component
+/// followed by a ReLU) and that is only read by backprop commands in the
+/// backward pass, is deallocated after its last use in the forward pass and
+/// reallocated and recomputed from the component input just before its first
+/// use in the backward pass; this is only possible if the component input is
+/// still around at that point and has not been changed, and if the components
+/// are not random and do not use a memo.  Matrices are chosen one by one,
+/// each time the largest one that is freed at the point where memory use is
+/// greatest, until the memory use is within 'max_memory_bytes' or no more
+/// matrices can be chosen.  Does nothing if max_memory_bytes <= 0, or for
+/// looped computations.  It should come after most other optimizations, but
+/// before OptimizeMemoryCompression().
+void OptimizeRecomputation(const Nnet &nnet,
+                           int64 max_memory_bytes,
+                           NnetComputation *computation);
+
 
 /// This function tries to optimize computation 'computation' for an 'looped'
 /// computation.  It expects as input a computation with no backprop but with
@@ -627,8 +660,10 @@ class ComputationCache {
   ComputationCache(int32 cache_capacity);
 
   // Note: if something fails in Read(), or the written cache was from an older
-  // format, it will just leave the cache empty.
-  void Read(std::istream &is, bool binary);
+  // format, it will just leave the cache empty.  If 'merge' is true, the
+  // current contents of the cache are kept, and computations that are already
+  // present are not replaced by the ones read.
+  void Read(std::istream &is, bool binary, bool merge = false);
 
   void Write(std::ostream &os, bool binary) const;
 
@@ -655,7 +690,7 @@ class ComputationCache {
   void Check(const Nnet &nnet) const;
  private:
 
-  std::mutex mutex_;  // Read/write mutex.
+  mutable std::mutex mutex_;  // Read/write mutex.
 
   int32 cache_capacity_;
 
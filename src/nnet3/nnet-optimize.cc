@@ -18,7 +18,12 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdio>
+#include <fstream>
 #include <iomanip>
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-optimize-utils.h"
 #include "nnet3/nnet-utils.h"
@@ -79,6 +84,14 @@ void NnetOptimizeOptions::Read(std::istream &is, bool binary) {
     ExpectToken(is, binary, "<MemoryCompressionLevel>");
     ReadBasicType(is, binary, &memory_compression_level);
   }
+  if (PeekToken(is, binary) == 'F') {
+    ExpectToken(is, binary, "<FusePropagations>");
+    ReadBasicType(is, binary, &fuse_propagations);
+  }
+  if (PeekToken(is, binary) == 'M') {
+    ExpectToken(is, binary, "<MemoryBudgetMb>");
+    ReadBasicType(is, binary, &memory_budget_mb);
+  }
   ExpectToken(is, binary, "</NnetOptimizeOptions>");
 }
 
@@ -122,6 +135,10 @@ void NnetOptimizeOptions::Write(std::ostream &os, bool binary) const {
   WriteBasicType(os, binary, snip_row_ops);
   WriteToken(os, binary, "<MemoryCompressionLevel>");
   WriteBasicType(os, binary, memory_compression_level);
+  WriteToken(os, binary, "<FusePropagations>");
+  WriteBasicType(os, binary, fuse_propagations);
+  WriteToken(os, binary, "<MemoryBudgetMb>");
+  WriteBasicType(os, binary, memory_budget_mb);
   WriteToken(os, binary, "</NnetOptimizeOptions>");
 }
 
@@ -143,7 +160,9 @@ bool NnetOptimizeOptions::operator == (const NnetOptimizeOptions &other) const {
           other.max_deriv_time == max_deriv_time &&
           other.max_deriv_time_relative == max_deriv_time_relative &&
           other.snip_row_ops == snip_row_ops &&
-          other.memory_compression_level == memory_compression_level);
+          other.memory_compression_level == memory_compression_level &&
+          other.fuse_propagations == fuse_propagations &&
+          other.memory_budget_mb == memory_budget_mb);
 }
 
 // move commands that resize and zero matrices to as late/early as possible.
@@ -508,6 +527,7 @@ void Optimize(const NnetOptimizeOptions &config,
               << GetMaxMemoryUse(*computation);
   }
 
+  KALDI_TRACE_SPAN("Optimize");
   { // Call LimitDerivativeTimes(); it's important that this
     // should come before other optimizations (search for "insist" in
     // nnet-optimize-utils.cc for the reasons).
@@ -527,6 +547,7 @@ void Optimize(const NnetOptimizeOptions &config,
     CheckComputation(nnet, *computation, true);
 
   if (config.optimize && config.consolidate_model_update) {
+    KALDI_TRACE_SPAN("ConsolidateModelUpdate");
     ConsolidateModelUpdate(nnet, computation);
 
     if (GetVerboseLevel() >= 3)
@@ -534,6 +555,7 @@ void Optimize(const NnetOptimizeOptions &config,
   }
 
   if (config.optimize && config.convert_addition) {
+    KALDI_TRACE_SPAN("ConvertAdditionToAssignment");
     ConvertAdditionToAssignment(nnet, computation);
     if (GetVerboseLevel() >= 3)
       CheckComputation(nnet, *computation, true);
@@ -542,6 +564,7 @@ void Optimize(const NnetOptimizeOptions &config,
 
   if (config.optimize &&  (config.snip_row_ops || config.optimize_row_ops ||
                            config.split_row_ops)) {
+    KALDI_TRACE_SPAN("OptimizeRowOps");
     bool must_renumber = false;
     if (config.snip_row_ops && SnipRowOps(computation))
       must_renumber = true;
@@ -559,6 +582,7 @@ void Optimize(const NnetOptimizeOptions &config,
 
   if (config.optimize && config.extend_matrices &&
       !config.optimize_looped_computation) {
+    KALDI_TRACE_SPAN("ExtendMatrices");
     ExtendMatrices(computation);
     if (GetVerboseLevel() >= 3)
       CheckComputation(nnet, *computation, false);
@@ -568,12 +592,14 @@ void Optimize(const NnetOptimizeOptions &config,
   if (config.optimize &&
       (config.remove_assignments || config.backprop_in_place ||
        config.propagate_in_place)) {
+    KALDI_TRACE_SPAN("VariableMergingOptimization");
     VariableMergingOptimization(config, nnet, computation);
     if (GetVerboseLevel() >= 3)
       CheckComputation(nnet, *computation, false);
   }
 
   if (config.optimize && config.initialize_undefined) {
+    KALDI_TRACE_SPAN("RemoveUnnecessaryZeroing");
     RemoveUnnecessaryZeroing(nnet, computation);
     if (GetVerboseLevel() >= 3)
       CheckComputation(nnet, *computation, false);
@@ -582,6 +608,7 @@ void Optimize(const NnetOptimizeOptions &config,
 
   if ((config.optimize && config.move_sizing_commands) ||
       config.optimize_looped_computation) {
+    KALDI_TRACE_SPAN("MoveSizingCommands");
     MoveSizingCommands(nnet, computation);
     if (GetVerboseLevel() >= 3)
       CheckComputation(nnet, *computation, false);
@@ -591,6 +618,7 @@ void Optimize(const NnetOptimizeOptions &config,
   // 'RemoveUnnecessaryAllocation()'.  We don't gate this by 'config.optimize'
   // because it's necessary for looped computation to run.
   if (config.optimize_looped_computation) {
+    KALDI_TRACE_SPAN("OptimizeLoopedComputation");
     OptimizeLoopedComputation(nnet, computation);
     if (GetVerboseLevel() >= 3)
       CheckComputation(nnet, *computation, false);
@@ -601,11 +629,21 @@ void Optimize(const NnetOptimizeOptions &config,
     // Don't do this if it's an looped computation because we're not sure if it
     // would be correct in that case, as written.  In any case the performance
     // benefit is tiny.
+    KALDI_TRACE_SPAN("RemoveUnnecessaryAllocation");
     RemoveUnnecessaryAllocation(nnet, computation);
     if (GetVerboseLevel() >= 3)
       CheckComputation(nnet, *computation, false);
   }
 
+  if (config.optimize && config.fuse_propagations) {
+    // This has to come after VariableMergingOptimization(), which makes the
+    // rectifiers propagate in place.
+    KALDI_TRACE_SPAN("FusePropagations");
+    FusePropagations(nnet, computation);
+    if (GetVerboseLevel() >= 3)
+      CheckComputation(nnet, *computation, false);
+  }
+
   // The following is not configurable because it is necessary for
   // the computation to run correctly (we do it after compilation too,
   // but the operations may have been put out of order by
@@ -616,8 +654,21 @@ void Optimize(const NnetOptimizeOptions &config,
     FixGotoLabel(computation);
 
 
+  if (config.optimize && config.memory_budget_mb > 0.0 &&
+      !config.optimize_looped_computation) {
+    // This has to come before OptimizeMemoryCompression(), which would
+    // otherwise stop most matrices from being recomputed.
+    KALDI_TRACE_SPAN("OptimizeRecomputation");
+    OptimizeRecomputation(nnet,
+                          static_cast<int64>(config.memory_budget_mb * 1.0e+06),
+                          computation);
+    if (GetVerboseLevel() >= 3)
+      CheckComputation(nnet, *computation, false);
+  }
+
   if (config.memory_compression_level > 0 &&
       !config.optimize_looped_computation) {
+    KALDI_TRACE_SPAN("OptimizeMemoryCompression");
     OptimizeMemoryCompression(nnet, config.memory_compression_level,
                               computation);
     if (GetVerboseLevel() >= 3)
@@ -635,23 +686,30 @@ void Optimize(const NnetOptimizeOptions &config,
 CachingOptimizingCompiler::CachingOptimizingCompiler(
     const Nnet &nnet,
     const CachingOptimizingCompilerOptions config):
-    nnet_(nnet), config_(config),
-    seconds_taken_total_(0.0), seconds_taken_compile_(0.0),
+    nnet_(nnet), config_(config), disk_cache_changed_(false),
+    num_cache_hits_(0), num_cache_misses_(0), seconds_taken_total_(0.0), seconds_taken_compile_(0.0),
     seconds_taken_optimize_(0.0), seconds_taken_expand_(0.0),
     seconds_taken_check_(0.0), seconds_taken_indexes_(0.0),
     seconds_taken_io_(0.0), cache_(config.cache_capacity),
-    nnet_left_context_(-1), nnet_right_context_(-1) { }
+    nnet_left_context_(-1), nnet_right_context_(-1) {
+  if (!config_.cache_dir.empty())
+    InitDiskCache();
+}
 
 CachingOptimizingCompiler::CachingOptimizingCompiler(
     const Nnet &nnet,
     const NnetOptimizeOptions &opt_config,
     const CachingOptimizingCompilerOptions config):
     nnet_(nnet), config_(config), opt_config_(opt_config),
+    disk_cache_changed_(false), num_cache_hits_(0), num_cache_misses_(0),
     seconds_taken_total_(0.0), seconds_taken_compile_(0.0),
     seconds_taken_optimize_(0.0), seconds_taken_expand_(0.0),
     seconds_taken_check_(0.0), seconds_taken_indexes_(0.0),
     seconds_taken_io_(0.0), cache_(config.cache_capacity),
-    nnet_left_context_(-1), nnet_right_context_(-1) { }
+    nnet_left_context_(-1), nnet_right_context_(-1) {
+  if (!config_.cache_dir.empty())
+    InitDiskCache();
+}
 
 void CachingOptimizingCompiler::GetSimpleNnetContext(
     int32 *nnet_left_context, int32 *nnet_right_context) {
@@ -692,7 +750,105 @@ void CachingOptimizingCompiler::WriteCache(std::ostream &os, bool binary) {
   seconds_taken_io_ += timer.Elapsed();
 }
 
+void CachingOptimizingCompiler::InitDiskCache() {
+  // The name of the file is a hash of everything that the compiled
+  // computations depend on: the structure of the network and the optimization
+  // options.  To get the structure we write out a copy of the network with the
+  // parameters zeroed and the learning rates set to zero, so that successive
+  // iterations of training, which differ only in those, share a file.
+  std::ostringstream os;
+  {
+    Nnet nnet_copy(nnet_);
+    ScaleNnet(0.0, &nnet_copy);
+    SetLearningRate(0.0, &nnet_copy);
+    nnet_copy.Write(os, true);
+  }
+  opt_config_.Write(os, true);
+  WriteBasicType(os, true, config_.use_shortcut);
+  std::string str = os.str();
+  // 64-bit FNV-1a hash.
+  uint64 hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < str.size(); i++) {
+    hash ^= static_cast<unsigned char>(str[i]);
+    hash *= 1099511628211ULL;
+  }
+  std::ostringstream filename;
+  filename << config_.cache_dir << "/nnet3-" << std::hex << std::setw(16)
+           << std::setfill('0') << hash << ".cache";
+  disk_cache_filename_ = filename.str();
+
+  std::ifstream is(disk_cache_filename_.c_str(), std::ios::binary);
+  if (!is.is_open()) {
+    KALDI_VLOG(1) << "Computation cache " << disk_cache_filename_
+                  << " does not exist yet.";
+    return;
+  }
+  try {
+    ReadCache(is, true);
+    KALDI_VLOG(1) << "Read computation cache from " << disk_cache_filename_;
+  } catch (...) {
+    // A bad cache file is never fatal; we just compile as normal.
+    KALDI_WARN << "Error reading computation cache from "
+               << disk_cache_filename_ << ", ignoring it.";
+  }
+}
+
+void CachingOptimizingCompiler::WriteDiskCache() {
+  if (disk_cache_filename_.empty() || !disk_cache_changed_)
+    return;
+  disk_cache_changed_ = false;
+  Timer timer;
+  {
+    // Merge in anything that other processes have written since we read the
+    // file; the computations we already have take precedence.
+    std::ifstream is(disk_cache_filename_.c_str(), std::ios::binary);
+    if (is.is_open()) {
+      try {
+        NnetOptimizeOptions opt_config_cached;
+        opt_config_cached.Read(is, true);
+        if (opt_config_ == opt_config_cached)
+          cache_.Read(is, true, true);
+      } catch (...) {
+        KALDI_WARN << "Error reading computation cache from "
+                   << disk_cache_filename_ << ", overwriting it.";
+      }
+    }
+  }
+  std::ostringstream tmp_filename;
+  tmp_filename << disk_cache_filename_ << ".tmp.";
+#ifndef _MSC_VER
+  tmp_filename << getpid();
+#endif
+  tmp_filename << '.' << reinterpret_cast<size_t>(this);
+  bool ok;
+  {
+    std::ofstream os(tmp_filename.str().c_str(), std::ios::binary);
+    ok = os.is_open();
+    if (ok) {
+      opt_config_.Write(os, true);
+      cache_.Write(os, true);
+      os.close();
+      ok = !os.fail();
+    }
+  }
+  // rename() is atomic, so readers see either the old or the new file.
+  if (!ok || std::rename(tmp_filename.str().c_str(),
+                         disk_cache_filename_.c_str()) != 0) {
+    KALDI_WARN << "Failed to write computation cache to "
+               << disk_cache_filename_;
+    std::remove(tmp_filename.str().c_str());
+  } else {
+    KALDI_VLOG(1) << "Wrote computation cache to " << disk_cache_filename_;
+  }
+  seconds_taken_io_ += timer.Elapsed();
+}
+
 CachingOptimizingCompiler::~CachingOptimizingCompiler() {
+  try {
+    WriteDiskCache();
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error writing computation cache: " << e.what();
+  }
   if (seconds_taken_total_ > 0.0 || seconds_taken_io_ > 0.0) {
     std::ostringstream os;
     double seconds_taken_misc = seconds_taken_total_ - seconds_taken_compile_
@@ -725,14 +881,17 @@ std::shared_ptr<const NnetComputation> CachingOptimizingCompiler::CompileInterna
     const ComputationRequest  &request) {
   std::shared_ptr<const NnetComputation> ans = cache_.Find(request);
   if (ans != NULL) {
+    num_cache_hits_++;
     return ans;
   } else {
+    num_cache_misses_++;
     const NnetComputation *computation = NULL;
     if (config_.use_shortcut)
       computation = CompileViaShortcut(request);
     if (computation == NULL)
       computation = CompileNoShortcut(request);
     KALDI_ASSERT(computation != NULL);
+    disk_cache_changed_ = true;
     return cache_.Insert(request, computation);
   }
 }
@@ -831,6 +990,16 @@ const NnetComputation *CachingOptimizingCompiler::CompileViaShortcut(
                       need_debug_info, num_n_values, ans);
     seconds_taken_expand_ += timer.Elapsed();
   }
+  if (opt_config_.optimize && opt_config_.memory_budget_mb > 0.0) {
+    // The memory budget applies to the expanded computation, so we look at it
+    // again here; at this point it can only choose matrices that the memory
+    // compression hasn't touched.
+    Timer timer;
+    OptimizeRecomputation(
+        nnet_, static_cast<int64>(opt_config_.memory_budget_mb * 1.0e+06),
+        ans);
+    seconds_taken_optimize_ += timer.Elapsed();
+  }
   if (GetVerboseLevel() >= 3) {
     CheckComputation(nnet_, *ans, false);
   }
@@ -24,6 +24,7 @@
 #include "nnet3/nnet-compile.h"
 #include "nnet3/nnet-analyze.h"
 #include "nnet3/nnet-optimize-utils.h"
+#include <atomic>
 
 namespace kaldi {
 namespace nnet3 {
@@ -54,6 +55,8 @@ struct NnetOptimizeOptions {
   int32 max_deriv_time_relative;
   bool snip_row_ops;
   int32 memory_compression_level;
+  bool fuse_propagations;
+  BaseFloat memory_budget_mb;
   // optimize_looped_computation is a 'hidden config' not available from
   // the command line; it's set to true to enable the optimization for
   // looped computation that turns a linear computation into a loop.
@@ -79,6 +82,8 @@ struct NnetOptimizeOptions {
       max_deriv_time_relative(std::numeric_limits<int32>::max()),
       snip_row_ops(true),
       memory_compression_level(1),
+      fuse_propagations(true),
+      memory_budget_mb(0.0),
       optimize_looped_computation(false) { }
 
   void Register(OptionsItf *opts) {
@@ -145,6 +150,19 @@ struct NnetOptimizeOptions {
                    "potentially at the expense of speed and the accuracy "
                    "of derivatives.  0 means no compression at all; 1 means "
                    "compression that shouldn't affect results at all.");
+    opts->Register("fuse-propagations", &fuse_propagations, "Set this to "
+                   "false to disable an optimization that, in computations "
+                   "without backprop, fuses affine components with the "
+                   "rectifier (and fixed scale) that follows them, so that "
+                   "the bias and rectifier are done in one kernel.");
+    opts->Register("memory-budget-mb", &memory_budget_mb, "This is only "
+                   "relevant to training, not decoding.  If >0, a budget in "
+                   "megabytes for the matrices of a computation (not counting "
+                   "the model).  If the computation would use more, the "
+                   "outputs of some components are freed after the forward "
+                   "pass and recomputed in the backward pass, trading speed "
+                   "for memory, until it fits the budget or no more can be "
+                   "recomputed.");
 
   }
   void Read(std::istream &is, bool binary);
@@ -192,6 +210,7 @@ void Optimize(const NnetOptimizeOptions &config,
 struct CachingOptimizingCompilerOptions {
   bool use_shortcut;
   int32 cache_capacity;
+  std::string cache_dir;
 
   CachingOptimizingCompilerOptions():
       use_shortcut(true),
@@ -208,6 +227,13 @@ struct CachingOptimizingCompilerOptions {
     opts->Register("cache-capacity", &cache_capacity,
                    "Determines how many computations the computation-cache will "
                    "store (most-recently-used).");
+    opts->Register("cache-dir", &cache_dir,
+                   "If nonempty, a directory in which compiled computations are "
+                   "cached on disk, so that later processes using a network "
+                   "with the same structure (the parameter values do not "
+                   "matter) and the same optimization options can skip the "
+                   "compilation.  The directory may be shared by many "
+                   "processes at once.");
   }
 };
 
@@ -216,6 +242,17 @@ struct CachingOptimizingCompilerOptions {
 /// one, the compilation process is not repeated.
 /// It is safe to call Compile() from multiple parallel threads without additional
 /// synchronization; synchronization is managed internally by class ComputationCache.
+///
+/// If the cache_dir option is set, the cache is also kept on disk, in a file
+/// in that directory whose name is a hash of the structure of the network and
+/// of the optimization options.  The file is read when this object is
+/// constructed, and if any computations were compiled it is rewritten by
+/// WriteDiskCache(), which is called from the destructor.  Readers take no
+/// locks: the file is written under a temporary name and renamed into place,
+/// so that readers see either the old or the new version.  Before writing, the
+/// computations in the file on disk are merged with those in memory; if two
+/// processes write at the same time, the computations added by one of them may
+/// be lost, which only means they will be compiled again.
 class CachingOptimizingCompiler {
  public:
   CachingOptimizingCompiler(const Nnet &nnet,
@@ -242,6 +279,24 @@ class CachingOptimizingCompiler {
   void ReadCache(std::istream &is, bool binary);
   void WriteCache(std::ostream &os, bool binary);
 
+  /// If the cache_dir option was set and any computations have been compiled
+  /// since the disk cache was last read or written, merges the in-memory cache
+  /// with the file on disk and writes it back.  This is called from the
+  /// destructor, but you may call it earlier, e.g. after the first minibatch.
+  void WriteDiskCache();
+
+  /// Returns the name of the file in which computations are cached on disk,
+  /// or the empty string if the cache_dir option was not set.
+  const std::string &DiskCacheFilename() const { return disk_cache_filename_; }
+
+  /// The number of calls to Compile() that found the computation in the cache
+  /// and that had to compile it, respectively; for diagnostics.
+  int64 NumCacheHits() const { return num_cache_hits_; }
+  int64 NumCacheMisses() const { return num_cache_misses_; }
+
+  /// The total time spent in Compile(), in seconds.
+  double SecondsTaken() const { return seconds_taken_total_; }
+
 
   // GetSimpleNnetContext() is equivalent to calling:
   // ComputeSimpleNnetContext(nnet_, &nnet_left_context,
@@ -285,10 +340,22 @@ class CachingOptimizingCompiler {
   // the computation cache).
   const NnetComputation *CompileNoShortcut(const ComputationRequest &request);
 
+  // Works out disk_cache_filename_ and reads the cache from it if it exists;
+  // called from the constructor if config_.cache_dir is set.
+  void InitDiskCache();
+
   const Nnet &nnet_;
   CachingOptimizingCompilerOptions config_;
   NnetOptimizeOptions opt_config_;
 
+  // The file that the computations are cached in if config_.cache_dir is set,
+  // else empty.
+  std::string disk_cache_filename_;
+  // True if computations have been compiled that are not in the disk cache.
+  std::atomic<bool> disk_cache_changed_;
+
+  std::atomic<int64> num_cache_hits_;
+  std::atomic<int64> num_cache_misses_;
 
   // seconds spent in various phases of compilation-- for diagnostic messages
   double seconds_taken_total_;
@@ -0,0 +1,313 @@
+// nnet3/nnet-quantized-component.cc
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sstream>
+#include <set>
+#include "nnet3/nnet-quantized-component.h"
+#include "nnet3/nnet-parse.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+namespace {
+
+// Sets 'out' to the dequantized version of 'params'.
+void DequantizeParams(const QuantizedMatrix &params,
+                      CuMatrix<BaseFloat> *out) {
+  Matrix<BaseFloat> temp(params.NumRows(), params.NumCols(), kUndefined);
+  params.CopyToMat(&temp);
+  out->Swap(&temp);
+}
+
+// Does out = in * params^T.  On the CPU this is done in integer arithmetic;
+// on the GPU the parameters are dequantized.
+void QuantizedMatMul(const CuMatrixBase<BaseFloat> &in,
+                     const QuantizedMatrix &params,
+                     CuMatrixBase<BaseFloat> *out) {
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuMatrix<BaseFloat> params_float;
+    DequantizeParams(params, &params_float);
+    out->AddMatMat(1.0, in, kNoTrans, params_float, kTrans, 0.0);
+    return;
+  }
+#endif
+  AddMatQuantizedMat(1.0, in.Mat(), params, 0.0, &(out->Mat()));
+}
+
+void PrintQuantizedStats(std::ostringstream &os,
+                         const QuantizedMatrix &params) {
+  os << ", quantized-params-bytes=" << params.SizeInBytes();
+}
+
+}  // namespace
+
+
+QuantizedAffineComponent::QuantizedAffineComponent(
+    const AffineComponent &c) {
+  Init(c.LinearParams(), c.BiasParams());
+}
+
+QuantizedAffineComponent::QuantizedAffineComponent(
+    const LinearComponent &c) {
+  Init(c.Params(), CuVector<BaseFloat>());
+}
+
+void QuantizedAffineComponent::Init(
+    const CuMatrixBase<BaseFloat> &linear_params,
+    const CuVectorBase<BaseFloat> &bias_params) {
+  KALDI_ASSERT(bias_params.Dim() == 0 ||
+               bias_params.Dim() == linear_params.NumRows());
+  Matrix<BaseFloat> linear_params_cpu(linear_params);
+  linear_params_.CopyFromMat(linear_params_cpu);
+  bias_params_ = bias_params;
+}
+
+std::string QuantizedAffineComponent::Info() const {
+  std::ostringstream stream;
+  stream << Component::Info();
+  PrintQuantizedStats(stream, linear_params_);
+  if (bias_params_.Dim() != 0)
+    PrintParameterStats(stream, "bias", bias_params_, true);
+  return stream.str();
+}
+
+void QuantizedAffineComponent::InitFromConfig(ConfigLine *cfl) {
+  int32 input_dim = -1, output_dim = -1;
+  bool use_bias = true;
+  cfl->GetValue("use-bias", &use_bias);
+  if (!cfl->GetValue("input-dim", &input_dim) ||
+      !cfl->GetValue("output-dim", &output_dim) || cfl->HasUnusedValues() ||
+      input_dim <= 0 || output_dim <= 0) {
+    KALDI_ERR << "Invalid initializer for layer of type "
+              << Type() << ": \"" << cfl->WholeLine() << "\"";
+  }
+  CuMatrix<BaseFloat> linear_params(output_dim, input_dim);
+  linear_params.SetRandn();
+  linear_params.Scale(1.0 / sqrt(input_dim));
+  CuVector<BaseFloat> bias_params(use_bias ? output_dim : 0);
+  bias_params.SetRandn();
+  Init(linear_params, bias_params);
+}
+
+void* QuantizedAffineComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+  QuantizedMatMul(in, linear_params_, out);
+  if (bias_params_.Dim() != 0)
+    out->AddVecToRows(1.0, bias_params_);
+  return NULL;
+}
+
+void QuantizedAffineComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &, // in_value
+    const CuMatrixBase<BaseFloat> &, // out_value
+    const CuMatrixBase<BaseFloat> &out_deriv,
+    void *memo,
+    Component *, // to_update
+    CuMatrixBase<BaseFloat> *in_deriv) const {
+  // kBackpropAdds is true.
+  if (in_deriv) {
+    CuMatrix<BaseFloat> linear_params;
+    DequantizeParams(linear_params_, &linear_params);
+    in_deriv->AddMatMat(1.0, out_deriv, kNoTrans,
+                        linear_params, kNoTrans, 1.0);
+  }
+}
+
+Component* QuantizedAffineComponent::Copy() const {
+  QuantizedAffineComponent *ans = new QuantizedAffineComponent();
+  ans->linear_params_ = linear_params_;
+  ans->bias_params_ = bias_params_;
+  return ans;
+}
+
+void QuantizedAffineComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<QuantizedAffineComponent>");
+  WriteToken(os, binary, "<LinearParams>");
+  linear_params_.Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</QuantizedAffineComponent>");
+}
+
+void QuantizedAffineComponent::Read(std::istream &is, bool binary) {
+  ExpectOneOrTwoTokens(is, binary, "<QuantizedAffineComponent>",
+                       "<LinearParams>");
+  linear_params_.Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</QuantizedAffineComponent>");
+}
+
+
+QuantizedTdnnComponent::QuantizedTdnnComponent(const TdnnComponent &c) {
+  Init(c.TimeOffsets(), c.LinearParams(), c.BiasParams());
+}
+
+void QuantizedTdnnComponent::Init(
+    const std::vector<int32> &time_offsets,
+    const CuMatrixBase<BaseFloat> &linear_params,
+    const CuVectorBase<BaseFloat> &bias_params) {
+  KALDI_ASSERT(!time_offsets.empty() &&
+               linear_params.NumCols() % time_offsets.size() == 0 &&
+               (bias_params.Dim() == 0 ||
+                bias_params.Dim() == linear_params.NumRows()));
+  time_offsets_ = time_offsets;
+  Matrix<BaseFloat> linear_params_cpu(linear_params);
+  linear_params_.CopyFromMat(linear_params_cpu);
+  bias_params_ = bias_params;
+}
+
+std::string QuantizedTdnnComponent::Info() const {
+  std::ostringstream stream;
+  stream << Component::Info();
+  stream << ", time-offsets=";
+  for (size_t i = 0; i < time_offsets_.size(); i++) {
+    if (i != 0) stream << ',';
+    stream << time_offsets_[i];
+  }
+  PrintQuantizedStats(stream, linear_params_);
+  if (bias_params_.Dim() != 0)
+    PrintParameterStats(stream, "bias", bias_params_, true);
+  return stream.str();
+}
+
+void QuantizedTdnnComponent::InitFromConfig(ConfigLine *cfl) {
+  std::string time_offsets_str;
+  std::vector<int32> time_offsets;
+  int32 input_dim = -1, output_dim = -1;
+  bool use_bias = true;
+  cfl->GetValue("use-bias", &use_bias);
+  bool ok = cfl->GetValue("time-offsets", &time_offsets_str) &&
+      cfl->GetValue("input-dim", &input_dim) &&
+      cfl->GetValue("output-dim", &output_dim);
+  if (!ok || input_dim <= 0 || output_dim <= 0 || cfl->HasUnusedValues() ||
+      !SplitStringToIntegers(time_offsets_str, ",", false, &time_offsets) ||
+      time_offsets.empty() ||
+      std::set<int32>(time_offsets.begin(),
+                      time_offsets.end()).size() != time_offsets.size()) {
+    KALDI_ERR << "Invalid initializer for layer of type "
+              << Type() << ": \"" << cfl->WholeLine() << "\"";
+  }
+  int32 spliced_input_dim = input_dim * time_offsets.size();
+  CuMatrix<BaseFloat> linear_params(output_dim, spliced_input_dim);
+  linear_params.SetRandn();
+  linear_params.Scale(1.0 / sqrt(spliced_input_dim));
+  CuVector<BaseFloat> bias_params(use_bias ? output_dim : 0);
+  bias_params.SetRandn();
+  Init(time_offsets, linear_params, bias_params);
+}
+
+void* QuantizedTdnnComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes_in,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+  const TdnnComponent::PrecomputedIndexes *indexes =
+      dynamic_cast<const TdnnComponent::PrecomputedIndexes*>(indexes_in);
+  KALDI_ASSERT(indexes != NULL &&
+               indexes->row_offsets.size() == time_offsets_.size());
+  int32 num_offsets = time_offsets_.size(),
+      input_dim = InputDim();
+  // Form the spliced input, with the same column layout as the parameters.
+  CuMatrix<BaseFloat> spliced_input(out->NumRows(), input_dim * num_offsets,
+                                    kUndefined);
+  for (int32 i = 0; i < num_offsets; i++) {
+    CuSubMatrix<BaseFloat> in_part = TdnnComponent::GetInputPart(
+        in, out->NumRows(), indexes->row_stride, indexes->row_offsets[i]);
+    spliced_input.ColRange(i * input_dim, input_dim).CopyFromMat(in_part);
+  }
+  QuantizedMatMul(spliced_input, linear_params_, out);
+  if (bias_params_.Dim() != 0)
+    out->AddVecToRows(1.0, bias_params_);
+  return NULL;
+}
+
+void QuantizedTdnnComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes_in,
+    const CuMatrixBase<BaseFloat> &, // in_value
+    const CuMatrixBase<BaseFloat> &, // out_value
+    const CuMatrixBase<BaseFloat> &out_deriv,
+    void *memo,
+    Component *, // to_update
+    CuMatrixBase<BaseFloat> *in_deriv) const {
+  if (in_deriv == NULL)
+    return;
+  const TdnnComponent::PrecomputedIndexes *indexes =
+      dynamic_cast<const TdnnComponent::PrecomputedIndexes*>(indexes_in);
+  KALDI_ASSERT(indexes != NULL &&
+               indexes->row_offsets.size() == time_offsets_.size());
+  int32 num_offsets = time_offsets_.size(),
+      input_dim = InputDim();
+  CuMatrix<BaseFloat> linear_params;
+  DequantizeParams(linear_params_, &linear_params);
+  // kBackpropAdds is true.
+  for (int32 i = 0; i < num_offsets; i++) {
+    CuSubMatrix<BaseFloat> in_deriv_part = TdnnComponent::GetInputPart(
+        *in_deriv, out_deriv.NumRows(), indexes->row_stride,
+        indexes->row_offsets[i]);
+    CuSubMatrix<BaseFloat> linear_params_part(linear_params,
+                                              0, linear_params.NumRows(),
+                                              i * input_dim, input_dim);
+    in_deriv_part.AddMatMat(1.0, out_deriv, kNoTrans,
+                            linear_params_part, kNoTrans, 1.0);
+  }
+}
+
+Component* QuantizedTdnnComponent::Copy() const {
+  QuantizedTdnnComponent *ans = new QuantizedTdnnComponent();
+  ans->time_offsets_ = time_offsets_;
+  ans->linear_params_ = linear_params_;
+  ans->bias_params_ = bias_params_;
+  return ans;
+}
+
+void QuantizedTdnnComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<QuantizedTdnnComponent>");
+  WriteToken(os, binary, "<TimeOffsets>");
+  WriteIntegerVector(os, binary, time_offsets_);
+  WriteToken(os, binary, "<LinearParams>");
+  linear_params_.Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</QuantizedTdnnComponent>");
+}
+
+void QuantizedTdnnComponent::Read(std::istream &is, bool binary) {
+  ExpectOneOrTwoTokens(is, binary, "<QuantizedTdnnComponent>",
+                       "<TimeOffsets>");
+  ReadIntegerVector(is, binary, &time_offsets_);
+  ExpectToken(is, binary, "<LinearParams>");
+  linear_params_.Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</QuantizedTdnnComponent>");
+  if (time_offsets_.empty() ||
+      linear_params_.NumCols() % time_offsets_.size() != 0)
+    KALDI_ERR << "Inconsistent QuantizedTdnnComponent.";
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
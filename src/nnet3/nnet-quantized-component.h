@@ -0,0 +1,202 @@
+// nnet3/nnet-quantized-component.h
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_QUANTIZED_COMPONENT_H_
+#define KALDI_NNET3_NNET_QUANTIZED_COMPONENT_H_
+
+#include "matrix/quantized-matrix.h"
+#include "nnet3/nnet-common.h"
+#include "nnet3/nnet-component-itf.h"
+#include "nnet3/nnet-simple-component.h"
+#include "nnet3/nnet-convolutional-component.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+/// @file  nnet-quantized-component.h
+///
+/// This file contains versions of the affine-type components whose linear
+/// parameters are stored as 8-bit integers (see class QuantizedMatrix).  They
+/// are for test-time use on the CPU: they are created from trained components
+/// by QuantizeNnet() (see nnet-utils.h and the program nnet3-quantize), and the
+/// matrix multiplication is done in 8-bit integer arithmetic, with the input
+/// quantized on the fly, by AddMatQuantizedMat().  They are not updatable.
+/// Backprop is supported only for the input derivative (so that they can be
+/// used in diagnostics), using the dequantized parameters.  When a GPU is in
+/// use, the parameters are dequantized for each Propagate() call, which is
+/// correct but not fast.
+
+
+/**
+   QuantizedAffineComponent is the quantized version of AffineComponent (and
+   its child classes such as NaturalGradientAffineComponent) and of
+   LinearComponent.  The bias, if present, is stored in floating point.
+
+   It is normally created by QuantizeNnet(); for testing purposes it can also
+   be initialized from a config line with random parameters:
+
+     input-dim       The input dimension of the component.
+     output-dim      The output dimension of the component.
+     use-bias=true   If false, there is no bias (as with LinearComponent).
+ */
+class QuantizedAffineComponent: public Component {
+ public:
+  QuantizedAffineComponent() { }
+
+  explicit QuantizedAffineComponent(const AffineComponent &c);
+
+  explicit QuantizedAffineComponent(const LinearComponent &c);
+
+  virtual std::string Type() const { return "QuantizedAffineComponent"; }
+  virtual std::string Info() const;
+  virtual void InitFromConfig(ConfigLine *cfl);
+
+  virtual int32 Properties() const {
+    return kSimpleComponent|kBackpropAdds;
+  }
+  virtual int32 InputDim() const { return linear_params_.NumCols(); }
+  virtual int32 OutputDim() const { return linear_params_.NumRows(); }
+
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                         const CuMatrixBase<BaseFloat> &in,
+                         CuMatrixBase<BaseFloat> *out) const;
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &, // in_value
+                        const CuMatrixBase<BaseFloat> &, // out_value
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        void *memo,
+                        Component *to_update,
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  const QuantizedMatrix &LinearParams() const { return linear_params_; }
+  const CuVector<BaseFloat> &BiasParams() const { return bias_params_; }
+ private:
+  void Init(const CuMatrixBase<BaseFloat> &linear_params,
+            const CuVectorBase<BaseFloat> &bias_params);
+
+  QuantizedMatrix linear_params_;
+  // The bias, or the empty vector if there is no bias.
+  CuVector<BaseFloat> bias_params_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(QuantizedAffineComponent);
+};
+
+
+/**
+   QuantizedTdnnComponent is the quantized version of TdnnComponent.  It uses
+   the same indexes as TdnnComponent (see the static functions of that class).
+   The spliced input is formed as a single matrix so that the quantized
+   multiplication is done in one call, with the same parameter layout as
+   TdnnComponent.
+
+   It is normally created by QuantizeNnet(); for testing purposes it can also
+   be initialized from a config line with random parameters:
+
+     input-dim       The input dimension of the component.
+     output-dim      The output dimension of the component.
+     time-offsets    The time offsets, e.g. time-offsets=-1,0,1.
+     use-bias=true   If false, there is no bias.
+ */
+class QuantizedTdnnComponent: public Component {
+ public:
+  QuantizedTdnnComponent() { }
+
+  explicit QuantizedTdnnComponent(const TdnnComponent &c);
+
+  virtual std::string Type() const { return "QuantizedTdnnComponent"; }
+  virtual std::string Info() const;
+  virtual void InitFromConfig(ConfigLine *cfl);
+
+  virtual int32 Properties() const {
+    return kReordersIndexes|kBackpropAdds;
+  }
+  virtual int32 InputDim() const {
+    return linear_params_.NumCols() / static_cast<int32>(time_offsets_.size());
+  }
+  virtual int32 OutputDim() const { return linear_params_.NumRows(); }
+
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                         const CuMatrixBase<BaseFloat> &in,
+                         CuMatrixBase<BaseFloat> *out) const;
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &, // in_value
+                        const CuMatrixBase<BaseFloat> &, // out_value
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        void *memo,
+                        Component *to_update,
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  virtual void ReorderIndexes(std::vector<Index> *input_indexes,
+                              std::vector<Index> *output_indexes) const {
+    TdnnComponent::ReorderIndexesForOffsets(input_indexes, output_indexes);
+  }
+  virtual void GetInputIndexes(const MiscComputationInfo &misc_info,
+                               const Index &output_index,
+                               std::vector<Index> *desired_indexes) const {
+    TdnnComponent::GetInputIndexesForOffsets(time_offsets_, output_index,
+                                             desired_indexes);
+  }
+  virtual bool IsComputable(const MiscComputationInfo &misc_info,
+                            const Index &output_index,
+                            const IndexSet &input_index_set,
+                            std::vector<Index> *used_inputs) const {
+    return TdnnComponent::IsComputableForOffsets(time_offsets_, output_index,
+                                                 input_index_set,
+                                                 used_inputs);
+  }
+  virtual ComponentPrecomputedIndexes* PrecomputeIndexes(
+      const MiscComputationInfo &misc_info,
+      const std::vector<Index> &input_indexes,
+      const std::vector<Index> &output_indexes,
+      bool need_backprop) const {
+    return TdnnComponent::PrecomputeIndexesForOffsets(
+        time_offsets_, input_indexes, output_indexes);
+  }
+
+ private:
+  void Init(const std::vector<int32> &time_offsets,
+            const CuMatrixBase<BaseFloat> &linear_params,
+            const CuVectorBase<BaseFloat> &bias_params);
+
+  std::vector<int32> time_offsets_;
+  // The linear parameters, with the same layout as in TdnnComponent: the
+  // num-cols is the input dim times time_offsets_.size().
+  QuantizedMatrix linear_params_;
+  // The bias, or the empty vector if there is no bias.
+  CuVector<BaseFloat> bias_params_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(QuantizedTdnnComponent);
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+
+#endif
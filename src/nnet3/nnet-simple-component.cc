@@ -1242,6 +1242,15 @@ void* AffineComponent::Propagate(const ComponentPrecomputedIndexes *indexes,
   return NULL;
 }
 
+void AffineComponent::PropagateRectified(const CuMatrixBase<BaseFloat> &in,
+                                         BaseFloat scale,
+                                         CuMatrixBase<BaseFloat> *out) const {
+  KALDI_ASSERT(scale > 0.0);
+  // scale * max(x, 0) == max(scale * x, 0) as scale > 0.
+  out->AddMatMat(scale, in, kNoTrans, linear_params_, kTrans, 0.0);
+  out->AddVecToRowsAndApplyFloor(scale, bias_params_, 0.0);
+}
+
 void AffineComponent::UpdateSimple(const CuMatrixBase<BaseFloat> &in_value,
                                    const CuMatrixBase<BaseFloat> &out_deriv) {
   bias_params_.AddRowSumMat(learning_rate_, out_deriv, 1.0);
@@ -1736,30 +1745,16 @@ void* BlockAffineComponent::Propagate(const ComponentPrecomputedIndexes *indexes
   // of a block.
   int32 num_rows_in_block = linear_params_.NumRows() / num_blocks_;
   int32 num_cols_in_block = linear_params_.NumCols();
-  std::vector<CuSubMatrix<BaseFloat> *> in_batch, out_batch,
-    linear_params_batch;
-  for(int block_counter = 0; block_counter < num_blocks_; block_counter++) {
-    CuSubMatrix<BaseFloat> *in_block =
-      new CuSubMatrix<BaseFloat>(in.ColRange(block_counter * num_cols_in_block,
-                                   num_cols_in_block));
-    in_batch.push_back(in_block);
-
-    CuSubMatrix<BaseFloat> *out_block =
-      new CuSubMatrix<BaseFloat>(out->ColRange(block_counter * num_rows_in_block,
-                                    num_rows_in_block));
-    out_batch.push_back(out_block);
-
-    CuSubMatrix<BaseFloat> *linear_params_block =
-      new CuSubMatrix<BaseFloat>(linear_params_.RowRange(block_counter * num_rows_in_block,
-                                              num_rows_in_block));
-    linear_params_batch.push_back(linear_params_block);
-  }
-  AddMatMatBatched<BaseFloat>(1.0, out_batch, in_batch, kNoTrans,
-                              linear_params_batch, kTrans, 1.0);
-
-  DeletePointers(&in_batch);
-  DeletePointers(&out_batch);
-  DeletePointers(&linear_params_batch);
+  // The blocks are evenly spaced, so this is one strided-batched product:
+  // column block i of 'out' gets column block i of 'in' times row block i of
+  // linear_params_ (transposed).
+  CuSubMatrix<BaseFloat> out_block(out->ColRange(0, num_rows_in_block));
+  AddMatMatStridedBatched<BaseFloat>(
+      1.0, &out_block, num_rows_in_block,
+      in.ColRange(0, num_cols_in_block), num_cols_in_block, kNoTrans,
+      linear_params_.RowRange(0, num_rows_in_block),
+      num_rows_in_block * linear_params_.Stride(), kTrans,
+      1.0, num_blocks_);
   return NULL;
 }
 
@@ -1781,65 +1776,27 @@ void BlockAffineComponent::Backprop(const std::string &debug_info,
   // If we wanted to add with coefficient 0.0 we'd need to zero the
   // in_deriv, in case of infinities.
   if (in_deriv) {
-    std::vector<CuSubMatrix<BaseFloat> *> in_deriv_batch, out_deriv_batch, linear_params_batch;
-
-    for(int block_counter = 0; block_counter < num_blocks_; block_counter++) {
-      CuSubMatrix<BaseFloat> *in_deriv_block =
-        new CuSubMatrix<BaseFloat>(in_deriv->ColRange(block_counter * num_cols_in_block,
-                                                      num_cols_in_block));
-      in_deriv_batch.push_back(in_deriv_block);
-
-      CuSubMatrix<BaseFloat> *out_deriv_block =
-        new CuSubMatrix<BaseFloat>(out_deriv.ColRange(block_counter * num_rows_in_block,
-                                                       num_rows_in_block));
-      out_deriv_batch.push_back(out_deriv_block);
-
-      CuSubMatrix<BaseFloat> *linear_params_block =
-        new CuSubMatrix<BaseFloat>(linear_params_.RowRange(block_counter * num_rows_in_block,
-                                                          num_rows_in_block));
-      linear_params_batch.push_back(linear_params_block);
-    }
-
-    AddMatMatBatched<BaseFloat>(1.0, in_deriv_batch, out_deriv_batch, kNoTrans,
-                                linear_params_batch, kNoTrans, 1.0);
-
-    DeletePointers(&in_deriv_batch);
-    DeletePointers(&out_deriv_batch);
-    DeletePointers(&linear_params_batch);
+    CuSubMatrix<BaseFloat> in_deriv_block(
+        in_deriv->ColRange(0, num_cols_in_block));
+    AddMatMatStridedBatched<BaseFloat>(
+        1.0, &in_deriv_block, num_cols_in_block,
+        out_deriv.ColRange(0, num_rows_in_block), num_rows_in_block, kNoTrans,
+        linear_params_.RowRange(0, num_rows_in_block),
+        num_rows_in_block * linear_params_.Stride(), kNoTrans,
+        1.0, num_blocks_);
   }
 
   if (to_update != NULL) {
 
     { // linear params update
-
-      std::vector<CuSubMatrix<BaseFloat> *> in_value_batch,
-        out_deriv_batch, linear_params_batch;
-
-      for (int block_counter = 0; block_counter < num_blocks_; block_counter++) {
-        CuSubMatrix<BaseFloat> *in_value_block =
-          new CuSubMatrix<BaseFloat>(in_value.ColRange(block_counter * num_cols_in_block,
-                                                       num_cols_in_block));
-        in_value_batch.push_back(in_value_block);
-
-        CuSubMatrix<BaseFloat> *out_deriv_block =
-          new CuSubMatrix<BaseFloat>(out_deriv.ColRange(block_counter * num_rows_in_block,
-                                                        num_rows_in_block));
-        out_deriv_batch.push_back(out_deriv_block);
-
-        CuSubMatrix<BaseFloat> *linear_params_block =
-          new CuSubMatrix<BaseFloat>(to_update->linear_params_.RowRange(block_counter * num_rows_in_block,
-                                                                        num_rows_in_block));
-        linear_params_batch.push_back(linear_params_block);
-      }
-
-      AddMatMatBatched<BaseFloat>(to_update->learning_rate_,
-                                  linear_params_batch,
-                                  out_deriv_batch, kTrans,
-                                  in_value_batch, kNoTrans, 1.0);
-
-      DeletePointers(&in_value_batch);
-      DeletePointers(&out_deriv_batch);
-      DeletePointers(&linear_params_batch);
+      CuSubMatrix<BaseFloat> linear_params_block(
+          to_update->linear_params_.RowRange(0, num_rows_in_block));
+      AddMatMatStridedBatched<BaseFloat>(
+          to_update->learning_rate_, &linear_params_block,
+          num_rows_in_block * to_update->linear_params_.Stride(),
+          out_deriv.ColRange(0, num_rows_in_block), num_rows_in_block, kTrans,
+          in_value.ColRange(0, num_cols_in_block), num_cols_in_block, kNoTrans,
+          1.0, num_blocks_);
     } // end linear params update
 
     { // bias update
@@ -456,6 +456,13 @@ class AffineComponent: public UpdatableComponent {
   CuVector<BaseFloat> &BiasParams() { return bias_params_; }
   const CuMatrix<BaseFloat> &LinearParams() const { return linear_params_; }
   CuMatrix<BaseFloat> &LinearParams() { return linear_params_; }
+  // Does the same as Propagate() followed by a RectifiedLinearComponent and
+  // by multiplication by 'scale' (which must be positive), but adds the bias
+  // and applies the rectifier in a single kernel after the matrix
+  // multiplication.  It is used where the optimizer fused these operations
+  // (see FusePropagations() in nnet-optimize-utils.h).
+  void PropagateRectified(const CuMatrixBase<BaseFloat> &in, BaseFloat scale,
+                          CuMatrixBase<BaseFloat> *out) const;
   explicit AffineComponent(const AffineComponent &other);
   // The next constructor is used in converting from nnet1.
   AffineComponent(const CuMatrixBase<BaseFloat> &linear_params,
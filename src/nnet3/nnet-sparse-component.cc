@@ -0,0 +1,143 @@
+// nnet3/nnet-sparse-component.cc
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sstream>
+#include "nnet3/nnet-sparse-component.h"
+#include "nnet3/nnet-parse.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+SparseAffineComponent::SparseAffineComponent(
+    const CuMatrixBase<BaseFloat> &linear_params,
+    const CuVectorBase<BaseFloat> &bias_params,
+    BaseFloat prune_threshold):
+    bias_params_(bias_params) {
+  KALDI_ASSERT(bias_params.Dim() == 0 ||
+               bias_params.Dim() == linear_params.NumRows());
+  KALDI_ASSERT(prune_threshold >= 0.0);
+  Matrix<BaseFloat> linear_params_cpu(linear_params);
+  if (prune_threshold > 0.0) {
+    for (MatrixIndexT r = 0; r < linear_params_cpu.NumRows(); r++) {
+      BaseFloat *row_data = linear_params_cpu.RowData(r);
+      for (MatrixIndexT c = 0; c < linear_params_cpu.NumCols(); c++)
+        if (std::abs(row_data[c]) <= prune_threshold)
+          row_data[c] = 0.0;
+    }
+  }
+  // The constructor of SparseMatrix keeps only the nonzero elements.
+  SparseMatrix<BaseFloat> smat(linear_params_cpu);
+  linear_params_.Swap(&smat);
+}
+
+std::string SparseAffineComponent::Info() const {
+  std::ostringstream stream;
+  stream << Component::Info();
+  int64 num_elements = linear_params_.NumElements(),
+      size = static_cast<int64>(InputDim()) * OutputDim();
+  stream << ", linear-params-nonzeros=" << num_elements
+         << ", linear-params-density="
+         << (size == 0 ? 0.0 : num_elements / static_cast<double>(size));
+  if (bias_params_.Dim() != 0)
+    PrintParameterStats(stream, "bias", bias_params_, true);
+  return stream.str();
+}
+
+void SparseAffineComponent::InitFromConfig(ConfigLine *cfl) {
+  int32 input_dim = -1, output_dim = -1;
+  BaseFloat zero_prob = 0.9;
+  bool use_bias = true;
+  cfl->GetValue("zero-prob", &zero_prob);
+  cfl->GetValue("use-bias", &use_bias);
+  if (!cfl->GetValue("input-dim", &input_dim) ||
+      !cfl->GetValue("output-dim", &output_dim) || cfl->HasUnusedValues() ||
+      input_dim <= 0 || output_dim <= 0 ||
+      zero_prob < 0.0 || zero_prob >= 1.0) {
+    KALDI_ERR << "Invalid initializer for layer of type "
+              << Type() << ": \"" << cfl->WholeLine() << "\"";
+  }
+  Matrix<BaseFloat> linear_params(output_dim, input_dim);
+  linear_params.SetRandn();
+  linear_params.Scale(1.0 / sqrt(input_dim * (1.0 - zero_prob)));
+  for (int32 r = 0; r < output_dim; r++)
+    for (int32 c = 0; c < input_dim; c++)
+      if (WithProb(zero_prob))
+        linear_params(r, c) = 0.0;
+  SparseMatrix<BaseFloat> smat(linear_params);
+  linear_params_.Swap(&smat);
+  bias_params_.Resize(use_bias ? output_dim : 0);
+  bias_params_.SetRandn();
+}
+
+void* SparseAffineComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+  if (bias_params_.Dim() != 0) {
+    out->CopyRowsFromVec(bias_params_);
+    out->AddMatSmat(1.0, in, linear_params_, kTrans, 1.0);
+  } else {
+    out->AddMatSmat(1.0, in, linear_params_, kTrans, 0.0);
+  }
+  return NULL;
+}
+
+void SparseAffineComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &, // in_value
+    const CuMatrixBase<BaseFloat> &, // out_value
+    const CuMatrixBase<BaseFloat> &out_deriv,
+    void *memo,
+    Component *, // to_update
+    CuMatrixBase<BaseFloat> *in_deriv) const {
+  // kBackpropAdds is true.
+  if (in_deriv)
+    in_deriv->AddMatSmat(1.0, out_deriv, linear_params_, kNoTrans, 1.0);
+}
+
+Component* SparseAffineComponent::Copy() const {
+  SparseAffineComponent *ans = new SparseAffineComponent();
+  ans->linear_params_ = linear_params_;
+  ans->bias_params_ = bias_params_;
+  return ans;
+}
+
+void SparseAffineComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<SparseAffineComponent>");
+  WriteToken(os, binary, "<LinearParams>");
+  linear_params_.Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</SparseAffineComponent>");
+}
+
+void SparseAffineComponent::Read(std::istream &is, bool binary) {
+  ExpectOneOrTwoTokens(is, binary, "<SparseAffineComponent>",
+                       "<LinearParams>");
+  linear_params_.Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</SparseAffineComponent>");
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
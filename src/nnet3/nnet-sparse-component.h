@@ -0,0 +1,110 @@
+// nnet3/nnet-sparse-component.h
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_SPARSE_COMPONENT_H_
+#define KALDI_NNET3_NNET_SPARSE_COMPONENT_H_
+
+#include "nnet3/nnet-common.h"
+#include "nnet3/nnet-component-itf.h"
+#include "nnet3/nnet-simple-component.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+/// @file  nnet-sparse-component.h
+///
+/// This file contains a version of the affine component whose linear
+/// parameters are stored as a sparse matrix, for use at test time with pruned
+/// models.  It is created from trained components by SparsifyNnet() (see
+/// nnet-utils.h and the program nnet3-sparsify).  The multiplications are
+/// done by CuMatrixBase::AddMatSmat(), which uses cuSPARSE on the GPU and
+/// SparseGemm() (see matrix/sparse-gemm.h) on the CPU.
+
+
+/**
+   SparseAffineComponent is the sparse version of AffineComponent (and its
+   child classes such as NaturalGradientAffineComponent), of LinearComponent
+   and of FixedAffineComponent.  The linear parameters are stored in CSR
+   format; the bias, if present, is stored as a dense vector.  It is not
+   updatable, but Backprop() computes the input derivative.
+
+   It is normally created by SparsifyNnet(); for testing purposes it can also
+   be initialized from a config line with random parameters:
+
+     input-dim       The input dimension of the component.
+     output-dim      The output dimension of the component.
+     zero-prob=0.9   The probability that each linear parameter is zero.
+     use-bias=true   If false, there is no bias (as with LinearComponent).
+ */
+class SparseAffineComponent: public Component {
+ public:
+  SparseAffineComponent() { }
+
+  /// Initializes from the parameters of c, setting to zero the linear
+  /// parameters whose absolute value is <= prune_threshold.  (This
+  /// constructor is used for AffineComponent, LinearComponent and
+  /// FixedAffineComponent; 'bias_params' may be empty).
+  SparseAffineComponent(const CuMatrixBase<BaseFloat> &linear_params,
+                        const CuVectorBase<BaseFloat> &bias_params,
+                        BaseFloat prune_threshold);
+
+  virtual std::string Type() const { return "SparseAffineComponent"; }
+  virtual std::string Info() const;
+  virtual void InitFromConfig(ConfigLine *cfl);
+
+  virtual int32 Properties() const {
+    return kSimpleComponent|kBackpropAdds;
+  }
+  virtual int32 InputDim() const { return linear_params_.NumCols(); }
+  virtual int32 OutputDim() const { return linear_params_.NumRows(); }
+
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                         const CuMatrixBase<BaseFloat> &in,
+                         CuMatrixBase<BaseFloat> *out) const;
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &, // in_value
+                        const CuMatrixBase<BaseFloat> &, // out_value
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        void *memo,
+                        Component *to_update,
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  const CuSparseMatrix<BaseFloat> &LinearParams() const {
+    return linear_params_;
+  }
+  const CuVector<BaseFloat> &BiasParams() const { return bias_params_; }
+ private:
+  CuSparseMatrix<BaseFloat> linear_params_;
+  // The bias, or the empty vector if there is no bias.
+  CuVector<BaseFloat> bias_params_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SparseAffineComponent);
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+
+#endif
@@ -210,6 +210,33 @@ void* TdnnComponent::Propagate(
   return NULL;
 }
 
+void TdnnComponent::PropagateRectified(
+    const ComponentPrecomputedIndexes *indexes_in,
+    const CuMatrixBase<BaseFloat> &in,
+    BaseFloat scale,
+    CuMatrixBase<BaseFloat> *out) const {
+  const PrecomputedIndexes *indexes =
+      dynamic_cast<const PrecomputedIndexes*>(indexes_in);
+  KALDI_ASSERT(indexes != NULL && bias_params_.Dim() != 0 && scale > 0.0);
+  KALDI_ASSERT(indexes->row_offsets.size() == time_offsets_.size());
+
+  int32 num_offsets = time_offsets_.size(),
+      input_dim = InputDim();
+  for (int32 i = 0; i < num_offsets; i++) {
+    CuSubMatrix<BaseFloat> in_part = GetInputPart(in, out->NumRows(),
+                                                  indexes->row_stride,
+                                                  indexes->row_offsets[i]);
+    CuSubMatrix<BaseFloat> linear_params_part(linear_params_,
+                                              0, linear_params_.NumRows(),
+                                              i * input_dim, input_dim);
+    // the first one overwrites 'out', as there is no bias there yet.
+    out->AddMatMat(scale, in_part, kNoTrans, linear_params_part, kTrans,
+                   i == 0 ? 0.0 : 1.0);
+  }
+  // scale * max(x, 0) == max(scale * x, 0) as scale > 0.
+  out->AddVecToRowsAndApplyFloor(scale, bias_params_, 0.0);
+}
+
 void TdnnComponent::Backprop(
     const std::string &debug_info,
     const ComponentPrecomputedIndexes *indexes_in,
@@ -348,6 +375,13 @@ void TdnnComponent::UpdateNaturalGradient(
 void TdnnComponent::ReorderIndexes(
     std::vector<Index> *input_indexes,
     std::vector<Index> *output_indexes) const {
+  ReorderIndexesForOffsets(input_indexes, output_indexes);
+}
+
+// static
+void TdnnComponent::ReorderIndexesForOffsets(
+    std::vector<Index> *input_indexes,
+    std::vector<Index> *output_indexes) {
   using namespace time_height_convolution;
 
   // The following figures out a regular structure for the input and
@@ -455,12 +489,20 @@ void TdnnComponent::GetInputIndexes(
     const MiscComputationInfo &misc_info,
     const Index &output_index,
     std::vector<Index> *desired_indexes) const {
+  GetInputIndexesForOffsets(time_offsets_, output_index, desired_indexes);
+}
+
+// static
+void TdnnComponent::GetInputIndexesForOffsets(
+    const std::vector<int32> &time_offsets,
+    const Index &output_index,
+    std::vector<Index> *desired_indexes) {
   KALDI_ASSERT(output_index.t != kNoTime);
-  size_t size = time_offsets_.size();
+  size_t size = time_offsets.size();
   desired_indexes->resize(size);
   for (size_t i = 0; i < size; i++) {
     (*desired_indexes)[i].n = output_index.n;
-    (*desired_indexes)[i].t = output_index.t + time_offsets_[i];
+    (*desired_indexes)[i].t = output_index.t + time_offsets[i];
     (*desired_indexes)[i].x = output_index.x;
   }
 }
@@ -471,8 +513,18 @@ bool TdnnComponent::IsComputable(
     const Index &output_index,
     const IndexSet &input_index_set,
     std::vector<Index> *used_inputs) const {
+  return IsComputableForOffsets(time_offsets_, output_index, input_index_set,
+                                used_inputs);
+}
+
+// static
+bool TdnnComponent::IsComputableForOffsets(
+    const std::vector<int32> &time_offsets,
+    const Index &output_index,
+    const IndexSet &input_index_set,
+    std::vector<Index> *used_inputs) {
   KALDI_ASSERT(output_index.t != kNoTime);
-  size_t size = time_offsets_.size();
+  size_t size = time_offsets.size();
   Index index(output_index);
 
   if (used_inputs != NULL) {
@@ -480,7 +532,7 @@ bool TdnnComponent::IsComputable(
     used_inputs->reserve(size);
   }
   for (size_t i = 0; i < size; i++) {
-    index.t = output_index.t + time_offsets_[i];
+    index.t = output_index.t + time_offsets[i];
     if (input_index_set(index)) {
       if (used_inputs != NULL) {
         // This input index is available.
@@ -539,6 +591,15 @@ ComponentPrecomputedIndexes* TdnnComponent::PrecomputeIndexes(
       const std::vector<Index> &input_indexes,
       const std::vector<Index> &output_indexes,
       bool need_backprop) const {
+  return PrecomputeIndexesForOffsets(time_offsets_, input_indexes,
+                                     output_indexes);
+}
+
+// static
+TdnnComponent::PrecomputedIndexes* TdnnComponent::PrecomputeIndexesForOffsets(
+      const std::vector<int32> &time_offsets,
+      const std::vector<Index> &input_indexes,
+      const std::vector<Index> &output_indexes) {
   using namespace time_height_convolution;
   // The following figures out a regular structure for the input and
   // output indexes, in case there were gaps (which is unlikely in typical
@@ -563,13 +624,13 @@ ComponentPrecomputedIndexes* TdnnComponent::PrecomputeIndexes(
 
   PrecomputedIndexes *ans = new PrecomputedIndexes();
   ans->row_stride = io.reorder_t_in;
-  int32 num_offsets = time_offsets_.size();
+  int32 num_offsets = time_offsets.size();
   ans->row_offsets.resize(num_offsets);
   for (int32 i = 0; i < num_offsets; i++) {
     // For each offset, work out which row of the input has the same t value as
     // the first t value in the output plus that offset.  That becomes the start
     // row of the corresponding sub-part of the input.
-    int32 time_offset = time_offsets_[i],
+    int32 time_offset = time_offsets[i],
         required_input_t = io.start_t_out + time_offset,
         input_t = (required_input_t - io.start_t_in) / io.t_step_in;
 
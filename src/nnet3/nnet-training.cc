@@ -31,7 +31,8 @@ NnetTrainer::NnetTrainer(const NnetTrainerOptions &config,
     compiler_(*nnet, config_.optimize_config, config_.compiler_config),
     num_minibatches_processed_(0),
     max_change_stats_(*nnet),
-    srand_seed_(RandInt(0, 100000)) {
+    srand_seed_(RandInt(0, 100000)),
+    augmenter_(config.augment_config) {
   if (config.zero_component_stats)
     ZeroComponentStats(nnet);
   KALDI_ASSERT(config.momentum >= 0.0 &&
@@ -96,7 +97,7 @@ void NnetTrainer::TrainInternal(const NnetExample &eg,
   NnetComputer computer(config_.compute_config, computation,
                         nnet_, delta_nnet_);
   // give the inputs to the computer object.
-  computer.AcceptInputs(*nnet_, eg.io);
+  augmenter_.AcceptInputs(*nnet_, eg.io, &computer);
   computer.Run();
 
   this->ProcessOutputs(false, eg, &computer);
@@ -137,7 +138,7 @@ void NnetTrainer::TrainInternalBackstitch(const NnetExample &eg,
   NnetComputer computer(config_.compute_config, computation,
                         nnet_, delta_nnet_);
   // give the inputs to the computer object.
-  computer.AcceptInputs(*nnet_, eg.io);
+  augmenter_.AcceptInputs(*nnet_, eg.io, &computer);
   computer.Run();
 
   bool is_backstitch_step2 = !is_backstitch_step1;
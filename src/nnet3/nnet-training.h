@@ -21,6 +21,7 @@
 #ifndef KALDI_NNET3_NNET_TRAINING_H_
 #define KALDI_NNET3_NNET_TRAINING_H_
 
+#include "nnet3/nnet-augment.h"
 #include "nnet3/nnet-example.h"
 #include "nnet3/nnet-computation.h"
 #include "nnet3/nnet-compute.h"
@@ -48,6 +49,7 @@ struct NnetTrainerOptions {
   NnetOptimizeOptions optimize_config;
   NnetComputeOptions compute_config;
   CachingOptimizingCompilerOptions compiler_config;
+  NnetAugmentOptions augment_config;
   NnetTrainerOptions():
       zero_component_stats(true),
       store_component_stats(true),
@@ -114,6 +116,10 @@ struct NnetTrainerOptions {
     // register the compute options with the prefix "computation".
     ParseOptions compute_opts("computation", opts);
     compute_config.Register(&compute_opts);
+    // register the options for augmenting the input features of each
+    // minibatch on the GPU with the prefix "augment".
+    ParseOptions augment_opts("augment", opts);
+    augment_config.Register(&augment_opts);
   }
 };
 
@@ -225,6 +231,9 @@ class NnetTrainer {
   // consistent dropout masks.  It's set to a value derived from rand()
   // when the class is initialized.
   int32 srand_seed_;
+
+  // Augments the input features of each minibatch, if configured.
+  NnetInputAugmenter augmenter_;
 };
 
 /**
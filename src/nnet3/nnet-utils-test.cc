@@ -21,6 +21,9 @@
 #include "nnet3/nnet-nnet.h"
 #include "nnet3/nnet-simple-component.h"
 #include "nnet3/nnet-test-utils.h"
+#include "nnet3/nnet-utils.h"
+#include "nnet3/nnet-compile.h"
+#include "nnet3/nnet-compute.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -100,6 +103,229 @@ void UnitTestConvertRepeatedToBlockAffineComposite() {
   }
 }
 
+// Computes the output of 'nnet' for 'request' and 'inputs'.
+static void ComputeOutput(const Nnet &nnet,
+                          const ComputationRequest &request,
+                          const std::vector<Matrix<BaseFloat> > &inputs,
+                          Matrix<BaseFloat> *output) {
+  // We only need the output, and we don't give the computer a model to store
+  // stats in.
+  ComputationRequest request_copy(request);
+  request_copy.need_model_derivative = false;
+  request_copy.store_component_stats = false;
+  NnetComputation computation;
+  Compiler compiler(request_copy, nnet);
+  CompilerOptions opts;
+  compiler.CreateComputation(opts, &computation);
+  computation.ComputeCudaIndexes();
+  NnetComputeOptions compute_opts;
+  NnetComputer computer(compute_opts, computation, nnet, NULL);
+  for (size_t i = 0; i < request.inputs.size(); i++) {
+    CuMatrix<BaseFloat> temp(inputs[i]);
+    computer.AcceptInput(request.inputs[i].name, &temp);
+  }
+  computer.Run();
+  const CuMatrixBase<BaseFloat> &cu_output = computer.GetOutput("output");
+  output->Resize(cu_output.NumRows(), cu_output.NumCols());
+  cu_output.CopyToMat(output);
+}
+
+void UnitTestQuantizeNnet() {
+  std::string config =
+    "component name=affine1 type=NaturalGradientAffineComponent "
+    "input-dim=40 output-dim=64\n"
+    "component name=relu1 type=RectifiedLinearComponent dim=64\n"
+    "component name=tdnn1 type=TdnnComponent input-dim=64 output-dim=48 "
+    "time-offsets=-1,0,1\n"
+    "component name=relu2 type=RectifiedLinearComponent dim=48\n"
+    "component name=linear1 type=LinearComponent input-dim=48 output-dim=32\n"
+    "component name=affine2 type=AffineComponent input-dim=32 output-dim=10\n"
+    "\n"
+    "input-node name=input dim=40\n"
+    "component-node name=affine1 component=affine1 input=input\n"
+    "component-node name=relu1 component=relu1 input=affine1\n"
+    "component-node name=tdnn1 component=tdnn1 input=relu1\n"
+    "component-node name=relu2 component=relu2 input=tdnn1\n"
+    "component-node name=linear1 component=linear1 input=relu2\n"
+    "component-node name=affine2 component=affine2 input=linear1\n"
+    "output-node name=output input=affine2\n";
+
+  Nnet nnet;
+  std::istringstream is(config);
+  nnet.ReadConfig(is);
+  Nnet quantized_nnet(nnet);
+  KALDI_ASSERT(QuantizeNnet(&quantized_nnet) == 4);
+  for (int32 i = 0; i < quantized_nnet.NumComponents(); i++) {
+    std::string type = quantized_nnet.GetComponent(i)->Type();
+    KALDI_ASSERT(type == "RectifiedLinearComponent" ||
+                 type.compare(0, 9, "Quantized") == 0);
+  }
+
+  // Test I/O of the quantized model.
+  bool binary = (RandInt(0, 1) == 0);
+  std::ostringstream os;
+  quantized_nnet.Write(os, binary);
+  Nnet quantized_nnet2;
+  std::istringstream is2(os.str());
+  quantized_nnet2.Read(is2, binary);
+
+  ComputationRequest request;
+  std::vector<Matrix<BaseFloat> > inputs;
+  ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+  Matrix<BaseFloat> output, quantized_output;
+  ComputeOutput(nnet, request, inputs, &output);
+  ComputeOutput(quantized_nnet2, request, inputs, &quantized_output);
+  // With 8-bit quantization of the parameters and the inputs of each layer,
+  // the relative error of the output should be a few percent at most.
+  Matrix<BaseFloat> diff(output);
+  diff.AddMat(-1.0, quantized_output);
+  KALDI_LOG << "Relative difference of quantized output is "
+            << (diff.FrobeniusNorm() / output.FrobeniusNorm());
+  KALDI_ASSERT(diff.FrobeniusNorm() <= 0.05 * output.FrobeniusNorm());
+}
+
+void UnitTestSparsifyNnet() {
+  std::string config =
+    "component name=affine1 type=NaturalGradientAffineComponent "
+    "input-dim=40 output-dim=64\n"
+    "component name=relu1 type=RectifiedLinearComponent dim=64\n"
+    "component name=linear1 type=LinearComponent input-dim=64 output-dim=32\n"
+    "component name=affine2 type=AffineComponent input-dim=32 output-dim=10\n"
+    "\n"
+    "input-node name=input dim=40\n"
+    "component-node name=affine1 component=affine1 input=input\n"
+    "component-node name=relu1 component=relu1 input=affine1\n"
+    "component-node name=linear1 component=linear1 input=relu1\n"
+    "component-node name=affine2 component=affine2 input=linear1\n"
+    "output-node name=output input=affine2\n";
+
+  Nnet nnet;
+  std::istringstream is(config);
+  nnet.ReadConfig(is);
+  // Nothing is converted if we require the matrices to be sparse.
+  Nnet sparse_nnet(nnet);
+  KALDI_ASSERT(SparsifyNnet(0.0, 0.5, &sparse_nnet) == 0);
+  // With no pruning the output must be unchanged.
+  KALDI_ASSERT(SparsifyNnet(0.0, 0.0, &sparse_nnet) == 3);
+  for (int32 i = 0; i < sparse_nnet.NumComponents(); i++) {
+    std::string type = sparse_nnet.GetComponent(i)->Type();
+    KALDI_ASSERT(type == "RectifiedLinearComponent" ||
+                 type == "SparseAffineComponent");
+  }
+
+  // Test I/O of the sparse model.
+  bool binary = (RandInt(0, 1) == 0);
+  std::ostringstream os;
+  sparse_nnet.Write(os, binary);
+  Nnet sparse_nnet2;
+  std::istringstream is2(os.str());
+  sparse_nnet2.Read(is2, binary);
+
+  ComputationRequest request;
+  std::vector<Matrix<BaseFloat> > inputs;
+  ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+  Matrix<BaseFloat> output, sparse_output;
+  ComputeOutput(nnet, request, inputs, &output);
+  ComputeOutput(sparse_nnet2, request, inputs, &sparse_output);
+  Matrix<BaseFloat> diff(output);
+  diff.AddMat(-1.0, sparse_output);
+  KALDI_ASSERT(diff.FrobeniusNorm() <= 1.0e-04 * output.FrobeniusNorm());
+
+  // The parameters have standard deviation less than 0.2, so pruning at 0.5
+  // makes all of the matrices sparse.
+  Nnet pruned_nnet(nnet);
+  KALDI_ASSERT(SparsifyNnet(0.5, 0.9, &pruned_nnet) == 3);
+}
+
+void UnitTestAddNnetFromStream() {
+  for (int32 n = 0; n < 5; n++) {
+    struct NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    std::istringstream is(configs[0]);
+    nnet.ReadConfig(is);
+    Nnet src(nnet);
+    PerturbParams(0.1, &src);
+
+    BaseFloat alpha = RandUniform();
+    Nnet dest1(nnet), dest2(nnet);
+    AddNnet(src, alpha, &dest1);
+    bool binary = (RandInt(0, 1) == 0);
+    std::ostringstream os;
+    src.Write(os, binary);
+    std::istringstream is2(os.str());
+    std::vector<std::mutex> component_mutexes(nnet.NumComponents());
+    AddNnetFromStream(is2, binary, alpha, &dest2,
+                      (RandInt(0, 1) == 0 ? &component_mutexes : NULL));
+
+    int32 num_params = NumParameters(nnet);
+    Vector<BaseFloat> params1(num_params), params2(num_params);
+    VectorizeNnet(dest1, &params1);
+    VectorizeNnet(dest2, &params2);
+    // The text format loses some precision.
+    KALDI_ASSERT(params1.ApproxEqual(params2, binary ? 1.0e-06 : 1.0e-03));
+  }
+}
+
+void UnitTestCollapseBatchnorm() {
+  // batchnorm1 should be folded into the preceding affine component, and
+  // batchnorm2 into the following one.
+  std::string config =
+    "component name=affine1 type=NaturalGradientAffineComponent "
+    "input-dim=40 output-dim=64\n"
+    "component name=batchnorm1 type=BatchNormComponent dim=64 block-dim=32\n"
+    "component name=relu1 type=RectifiedLinearComponent dim=64\n"
+    "component name=batchnorm2 type=BatchNormComponent dim=64\n"
+    "component name=tdnn2 type=TdnnComponent input-dim=64 output-dim=10 "
+    "time-offsets=-1,0,1\n"
+    "\n"
+    "input-node name=input dim=40\n"
+    "component-node name=affine1 component=affine1 input=input\n"
+    "component-node name=batchnorm1 component=batchnorm1 input=affine1\n"
+    "component-node name=relu1 component=relu1 input=batchnorm1\n"
+    "component-node name=batchnorm2 component=batchnorm2 input=relu1\n"
+    "component-node name=tdnn2 component=tdnn2 input=batchnorm2\n"
+    "output-node name=output input=tdnn2\n";
+
+  Nnet nnet;
+  std::istringstream is(config);
+  nnet.ReadConfig(is);
+  // Give the batchnorm components some stats.
+  for (int32 c = 0; c < nnet.NumComponents(); c++) {
+    Component *component = nnet.GetComponent(c);
+    if (component->Type() != "BatchNormComponent")
+      continue;
+    CuMatrix<BaseFloat> in(100, component->InputDim()),
+        out(100, component->OutputDim());
+    in.SetRandn();
+    in.Add(RandGauss());
+    void *memo = component->Propagate(NULL, in, &out);
+    component->StoreStats(in, out, memo);
+    component->DeleteMemo(memo);
+  }
+  SetBatchnormTestMode(true, &nnet);
+
+  Nnet collapsed_nnet(nnet);
+  CollapseModelConfig collapse_config;
+  collapse_config.collapse_batchnorm = true;
+  CollapseModel(collapse_config, &collapsed_nnet);
+  KALDI_ASSERT(collapsed_nnet.NumComponents() == 3);
+  for (int32 c = 0; c < collapsed_nnet.NumComponents(); c++)
+    KALDI_ASSERT(collapsed_nnet.GetComponent(c)->Type() !=
+                 "BatchNormComponent");
+
+  ComputationRequest request;
+  std::vector<Matrix<BaseFloat> > inputs;
+  ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+  Matrix<BaseFloat> output, collapsed_output;
+  ComputeOutput(nnet, request, inputs, &output);
+  ComputeOutput(collapsed_nnet, request, inputs, &collapsed_output);
+  Matrix<BaseFloat> diff(output);
+  diff.AddMat(-1.0, collapsed_output);
+  KALDI_ASSERT(diff.FrobeniusNorm() <= 1.0e-04 * output.FrobeniusNorm());
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -111,6 +337,10 @@ int main() {
   UnitTestNnetContext();
   UnitTestConvertRepeatedToBlockAffine();
   UnitTestConvertRepeatedToBlockAffineComposite();
+  UnitTestQuantizeNnet();
+  UnitTestSparsifyNnet();
+  UnitTestCollapseBatchnorm();
+  UnitTestAddNnetFromStream();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
@@ -18,6 +18,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <iomanip>
 #include "nnet3/nnet-utils.h"
 #include "nnet3/nnet-graph.h"
@@ -25,9 +26,12 @@
 #include "nnet3/nnet-normalize-component.h"
 #include "nnet3/nnet-general-component.h"
 #include "nnet3/nnet-convolutional-component.h"
+#include "nnet3/nnet-quantized-component.h"
+#include "nnet3/nnet-sparse-component.h"
 #include "nnet3/nnet-parse.h"
 #include "nnet3/nnet-computation-graph.h"
 #include "nnet3/nnet-diagnostics.h"
+#include "hmm/transition-model.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -356,6 +360,50 @@ void AddNnet(const Nnet &src, BaseFloat alpha, Nnet *dest) {
   }
 }
 
+void AddNnetFromStream(std::istream &is, bool binary, BaseFloat alpha,
+                       Nnet *dest,
+                       std::vector<std::mutex> *component_mutexes) {
+  KALDI_ASSERT(component_mutexes == NULL ||
+               component_mutexes->size() == dest->NumComponents());
+  // This follows the format that Nnet::Read() reads.
+  if (PeekToken(is, binary) == 'T') {
+    // A .mdl file; the Nnet comes after the TransitionModel.
+    TransitionModel temp_trans_model;
+    temp_trans_model.Read(is, binary);
+  }
+  ExpectToken(is, binary, "<Nnet3>");
+  // Skip the config-file part, which is terminated by an empty line.
+  std::string cur_line;
+  getline(is, cur_line);  // Eat up a single newline.
+  while (getline(is, cur_line))
+    if (cur_line == "" || cur_line == "\r")
+      break;
+  ExpectToken(is, binary, "<NumComponents>");
+  int32 num_components;
+  ReadBasicType(is, binary, &num_components);
+  if (num_components != dest->NumComponents())
+    KALDI_ERR << "Trying to add incompatible nnets: " << num_components
+              << " vs. " << dest->NumComponents() << " components.";
+  std::string component_name;
+  for (int32 c = 0; c < num_components; c++) {
+    ExpectToken(is, binary, "<ComponentName>");
+    ReadToken(is, binary, &component_name);
+    if (component_name != dest->GetComponentName(c))
+      KALDI_ERR << "Trying to add incompatible nnets: component " << c
+                << " is named " << component_name << " vs. "
+                << dest->GetComponentName(c);
+    Component *src_comp = Component::ReadNew(is, binary);
+    if (component_mutexes != NULL) {
+      std::lock_guard<std::mutex> lock((*component_mutexes)[c]);
+      dest->GetComponent(c)->Add(alpha, *src_comp);
+    } else {
+      dest->GetComponent(c)->Add(alpha, *src_comp);
+    }
+    delete src_comp;
+  }
+  ExpectToken(is, binary, "</Nnet3>");
+}
+
 int32 NumParameters(const Nnet &src) {
   int32 ans = 0;
   for (int32 c = 0; c < src.NumComponents(); c++) {
@@ -489,6 +537,72 @@ void ConvertRepeatedToBlockAffine(Nnet *nnet) {
   }
 }
 
+int32 QuantizeNnet(Nnet *nnet) {
+  int32 num_quantized = 0;
+  for (int32 i = 0; i < nnet->NumComponents(); i++) {
+    const Component *c = nnet->GetComponent(i);
+    Component *new_c = NULL;
+    if (const AffineComponent *ac =
+        dynamic_cast<const AffineComponent*>(c)) {
+      new_c = new QuantizedAffineComponent(*ac);
+    } else if (const LinearComponent *lc =
+               dynamic_cast<const LinearComponent*>(c)) {
+      new_c = new QuantizedAffineComponent(*lc);
+    } else if (const TdnnComponent *tc =
+               dynamic_cast<const TdnnComponent*>(c)) {
+      new_c = new QuantizedTdnnComponent(*tc);
+    }
+    if (new_c != NULL) {
+      KALDI_VLOG(2) << "Quantizing component " << nnet->GetComponentName(i)
+                    << " of type " << c->Type();
+      // the following call deletes c.
+      nnet->SetComponent(i, new_c);
+      num_quantized++;
+    }
+  }
+  return num_quantized;
+}
+
+int32 SparsifyNnet(BaseFloat prune_threshold, BaseFloat min_sparsity,
+                   Nnet *nnet) {
+  KALDI_ASSERT(prune_threshold >= 0.0 && min_sparsity <= 1.0);
+  int32 num_sparsified = 0;
+  for (int32 i = 0; i < nnet->NumComponents(); i++) {
+    const Component *c = nnet->GetComponent(i);
+    SparseAffineComponent *new_c = NULL;
+    if (const AffineComponent *ac =
+        dynamic_cast<const AffineComponent*>(c)) {
+      new_c = new SparseAffineComponent(ac->LinearParams(), ac->BiasParams(),
+                                        prune_threshold);
+    } else if (const LinearComponent *lc =
+               dynamic_cast<const LinearComponent*>(c)) {
+      new_c = new SparseAffineComponent(lc->Params(), CuVector<BaseFloat>(),
+                                        prune_threshold);
+    } else if (const FixedAffineComponent *fc =
+               dynamic_cast<const FixedAffineComponent*>(c)) {
+      new_c = new SparseAffineComponent(fc->LinearParams(), fc->BiasParams(),
+                                        prune_threshold);
+    }
+    if (new_c == NULL)
+      continue;
+    BaseFloat sparsity = 1.0 - new_c->LinearParams().NumElements() /
+        (static_cast<BaseFloat>(c->InputDim()) * c->OutputDim());
+    if (sparsity < min_sparsity) {
+      KALDI_VLOG(2) << "Not sparsifying component " << nnet->GetComponentName(i)
+                    << " since its sparsity " << sparsity << " is less than "
+                    << min_sparsity;
+      delete new_c;
+      continue;
+    }
+    KALDI_VLOG(2) << "Sparsifying component " << nnet->GetComponentName(i)
+                  << " of type " << c->Type() << ", sparsity is " << sparsity;
+    // the following call deletes c.
+    nnet->SetComponent(i, new_c);
+    num_sparsified++;
+  }
+  return num_sparsified;
+}
+
 std::string NnetInfo(const Nnet &nnet) {
   std::ostringstream ostr;
   if (IsSimpleNnet(nnet)) {
@@ -1474,6 +1588,23 @@ class ModelCollapser {
                 << (num_components2 - num_components3);
   }
  private:
+  // Returns the number of nodes whose Descriptors refer to node 'node_index'
+  // (counting each node once).
+  int32 NumConsumers(int32 node_index) {
+    int32 ans = 0, num_nodes = nnet_->NumNodes();
+    std::vector<int32> dependencies;
+    for (int32 n = 0; n < num_nodes; n++) {
+      const NetworkNode &node = nnet_->GetNode(n);
+      if (node.node_type != kDescriptor)
+        continue;
+      node.descriptor.GetNodeDependencies(&dependencies);
+      if (std::find(dependencies.begin(), dependencies.end(), node_index) !=
+          dependencies.end())
+        ans++;
+    }
+    return ans;
+  }
+
   /**
      This function tries to collapse two successive components, where
      the component 'component_index1' appears as the input of 'component_index2'.
@@ -1486,12 +1617,17 @@ class ModelCollapser {
      So the input-dim of the second component may be a multiple of
      the output-dim of the first component.
 
+     'input_has_one_consumer' is true if the node of 'component_index1' is
+     used only as the input of 'component_index2'; it is required for
+     combinations that modify the first component rather than the second.
+
      The function returns the component-index of a (newly created or existing)
      component that combines both of these components, if it's possible to
      combine them; or it returns -1 if it's not possible.
    */
   int32 CollapseComponents(int32 component_index1,
-                           int32 component_index2) {
+                           int32 component_index2,
+                           bool input_has_one_consumer) {
     int32 ans;
     if (config_.collapse_dropout &&
         (ans = CollapseComponentsDropout(component_index1,
@@ -1501,6 +1637,13 @@ class ModelCollapser {
         (ans = CollapseComponentsBatchnorm(component_index1,
                                            component_index2)) != -1)
       return ans;
+    // Folding batchnorm into the preceding component creates a modified copy
+    // of that component, so we only do it if nothing else uses its output
+    // (otherwise both versions would have to be computed).
+    if (config_.collapse_batchnorm && input_has_one_consumer &&
+        (ans = CollapseComponentsBatchnormPost(component_index1,
+                                               component_index2)) != -1)
+      return ans;
     if (config_.collapse_affine &&
         (ans = CollapseComponentsAffine(component_index1,
                                         component_index2)) != -1)
@@ -1654,8 +1797,9 @@ class ModelCollapser {
     if (input_node.node_type != kComponent)
       return false;
     int32 input_component_index = input_node.u.component_index;
-    int32 combined_component_index = CollapseComponents(input_component_index,
-                                                        component_index);
+    int32 combined_component_index = CollapseComponents(
+        input_component_index, component_index,
+        NumConsumers(input_node_index) == 1);
     if (combined_component_index == -1)
       return false;  // these components were not of types that can be
                      // collapsed.
@@ -1749,6 +1893,39 @@ class ModelCollapser {
                                                   component_index2);
   }
 
+  /**
+     Tries to produce a component that's equivalent to running the component
+     'component_index2' with input given by 'component_index1'.  This handles
+     the case where 'component_index2' is of type BatchnormComponent (in test
+     mode), and 'component_index1' is of type AffineComponent,
+     NaturalGradientAffineComponent, LinearComponent or TdnnComponent with
+     output dimension equal to the batchnorm dimension; the batchnorm scale and
+     offset are then folded into the linear and bias parameters of the first
+     component.
+
+     Returns -1 if this code can't produce a combined component (normally
+     because the components have the wrong types).
+   */
+  int32 CollapseComponentsBatchnormPost(int32 component_index1,
+                                        int32 component_index2) {
+    const BatchNormComponent *batchnorm_component =
+        dynamic_cast<const BatchNormComponent*>(
+            nnet_->GetComponent(component_index2));
+    if (batchnorm_component == NULL ||
+        batchnorm_component->InputDim() !=
+        nnet_->GetComponent(component_index1)->OutputDim())
+      return -1;
+
+    if (batchnorm_component->Offset().Dim() == 0) {
+      KALDI_ERR << "Expected batch-norm components to have test-mode set.";
+    }
+    std::string batchnorm_component_name = nnet_->GetComponentName(
+        component_index2);
+    return GetDiagonallyPostModifiedComponentIndex(
+        batchnorm_component->Offset(), batchnorm_component->Scale(),
+        batchnorm_component_name, component_index1);
+  }
+
   /**
      Tries to produce a component that's equivalent to running the component
      'component_index2' with input given by 'component_index1'.  This handles
@@ -1898,9 +2075,9 @@ class ModelCollapser {
   /**
      This function finds, or creates, a component which is like
      'component_index' but is combined with a diagonal offset-and-scale
-     transform *before* the component.  (We may later create a function called
-     GetDiagonallyPostModifiedComponentIndex if we need to apply the
-     transform *after* the component.
+     transform *before* the component.  (See
+     GetDiagonallyPostModifiedComponentIndex() for the transform *after* the
+     component).
 
      This function doesn't work for convolutional components, because
      due to zero-padding, it's not possible to represent an offset/scale
@@ -1994,6 +2171,106 @@ class ModelCollapser {
     return nnet_->AddComponent(new_component_name, new_component);
   }
 
+  /**
+     This is as GetDiagonallyPreModifiedComponentIndex(), except that the
+     diagonal transform y = a x + b is applied *after* the component.  The
+     dimension of 'offset'/'scale' must divide the component output dimension.
+     The name of the new component is the name of the component followed by
+     '.' and 'src_identifier'.  Returns -1 if the component in
+     'component_index' is not of type AffineComponent,
+     NaturalGradientAffineComponent, LinearComponent or TdnnComponent.
+  */
+  int32 GetDiagonallyPostModifiedComponentIndex(
+      const CuVectorBase<BaseFloat> &offset,
+      const CuVectorBase<BaseFloat> &scale,
+      const std::string &src_identifier,
+      int32 component_index) {
+    KALDI_ASSERT(offset.Dim() > 0 && offset.Dim() == scale.Dim());
+    if (offset.Max() == 0.0 && offset.Min() == 0.0 &&
+        scale.Max() == 1.0 && scale.Min() == 1.0)
+      return component_index;  // identity transform.
+    std::ostringstream new_component_name_os;
+    new_component_name_os << nnet_->GetComponentName(component_index)
+                          << "." << src_identifier;
+    std::string new_component_name = new_component_name_os.str();
+    int32 new_component_index = nnet_->GetComponentIndex(new_component_name);
+    if (new_component_index >= 0)
+      return new_component_index;  // we previously created this.
+
+    const Component *component = nnet_->GetComponent(component_index);
+    const AffineComponent *affine_component =
+        dynamic_cast<const AffineComponent*>(component);
+    const LinearComponent *linear_component =
+        dynamic_cast<const LinearComponent*>(component);
+    const TdnnComponent *tdnn_component =
+        dynamic_cast<const TdnnComponent*>(component);
+
+    Component *new_component = NULL;
+    if (affine_component != NULL) {
+      new_component = component->Copy();
+      AffineComponent *new_affine_component =
+          dynamic_cast<AffineComponent*>(new_component);
+      PostMultiplyAffineParameters(offset, scale,
+                                   &(new_affine_component->BiasParams()),
+                                   &(new_affine_component->LinearParams()));
+    } else if (linear_component != NULL) {
+      CuVector<BaseFloat> bias_params(linear_component->OutputDim());
+      AffineComponent *new_affine_component =
+          new AffineComponent(linear_component->Params(),
+                              bias_params,
+                              linear_component->LearningRate());
+      PostMultiplyAffineParameters(offset, scale,
+                                   &(new_affine_component->BiasParams()),
+                                   &(new_affine_component->LinearParams()));
+      new_component = new_affine_component;
+    } else if (tdnn_component != NULL) {
+      new_component = tdnn_component->Copy();
+      TdnnComponent *new_tdnn_component =
+          dynamic_cast<TdnnComponent*>(new_component);
+      if (new_tdnn_component->BiasParams().Dim() == 0) {
+        // make sure it has a bias even if it had none before.
+        new_tdnn_component->BiasParams().Resize(
+            new_tdnn_component->OutputDim());
+      }
+      PostMultiplyAffineParameters(offset, scale,
+                                   &(new_tdnn_component->BiasParams()),
+                                   &(new_tdnn_component->LinearParams()));
+    } else {
+      return -1;  // we can't do this: this component isn't of the right type.
+    }
+    return nnet_->AddComponent(new_component_name, new_component);
+  }
+
+  /**
+     This helper function, used in GetDiagonallyPostModifiedComponentIndex,
+     modifies the linear and bias parameters of an affine transform to
+     capture the effect of following that affine transform by a diagonal
+     affine transform with parameters 'offset' and 'scale', whose dimension
+     must divide the output dim of the affine transform.
+   */
+  static void PostMultiplyAffineParameters(
+      const CuVectorBase<BaseFloat> &offset,
+      const CuVectorBase<BaseFloat> &scale,
+      CuVectorBase<BaseFloat> *bias_params,
+      CuMatrixBase<BaseFloat> *linear_params) {
+    int32 output_dim = linear_params->NumRows(),
+        transform_dim = offset.Dim();
+    KALDI_ASSERT(bias_params->Dim() == output_dim &&
+                 offset.Dim() == scale.Dim() &&
+                 output_dim % transform_dim == 0);
+    CuVector<BaseFloat> full_offset(output_dim),
+        full_scale(output_dim);
+    for (int32 d = 0; d < output_dim; d += transform_dim) {
+      full_offset.Range(d, transform_dim).CopyFromVec(offset);
+      full_scale.Range(d, transform_dim).CopyFromVec(scale);
+    }
+    // The affine component does y = a x + b, and we follow it by
+    // z = s y + o, so z = (s a) x + (s b + o).
+    linear_params->MulRowsVec(full_scale);
+    bias_params->MulElements(full_scale);
+    bias_params->AddVec(1.0, full_offset);
+  }
+
   /**
      This helper function, used GetDiagonallyPreModifiedComponentIndex,
      modifies the linear and bias parameters of an affine transform to
@@ -20,6 +20,7 @@
 #ifndef KALDI_NNET3_NNET_UTILS_H_
 #define KALDI_NNET3_NNET_UTILS_H_
 
+#include <mutex>
 #include "base/kaldi-common.h"
 #include "util/kaldi-io.h"
 #include "matrix/matrix-lib.h"
@@ -130,6 +131,18 @@ void SetRequireDirectInput(bool b, Nnet *nnet);
 /// stored stats).
 void AddNnet(const Nnet &src, BaseFloat alpha, Nnet *dest);
 
+/// Does the same as AddNnet(), with 'src' being the nnet that Nnet::Read()
+/// would read from 'is' (which may also be a .mdl file), but reads it one
+/// component at a time, so that only one of its components is in memory at
+/// once.  The components must have the same names as those of 'dest'; the
+/// rest of the structure is not checked.  If 'component_mutexes' is non-NULL
+/// (it must have one element per component of 'dest'), each component of
+/// 'dest' is added to with its mutex locked, so that several threads can add
+/// to the same 'dest' (see nnet3-average).
+void AddNnetFromStream(std::istream &is, bool binary, BaseFloat alpha,
+                       Nnet *dest,
+                       std::vector<std::mutex> *component_mutexes = NULL);
+
 /// Does *dest += alpha * src for updatable components (affects nnet parameters),
 /// and *dest += scale * src for other components (affects stored stats).
 /// Here, alphas is a vector of size equal to the number of updatable components
@@ -164,6 +177,27 @@ void FreezeNaturalGradient(bool freeze, Nnet *nnet);
 /// NaturalGradientRepeatedAffineComponent to BlockAffineComponent in nnet.
 void ConvertRepeatedToBlockAffine(Nnet *nnet);
 
+/// Replaces the components of type AffineComponent (and its child classes such
+/// as NaturalGradientAffineComponent), LinearComponent and TdnnComponent by
+/// their versions with 8-bit quantized parameters, QuantizedAffineComponent and
+/// QuantizedTdnnComponent (see nnet-quantized-component.h), which are faster at
+/// test time on the CPU.  The result can no longer be trained.  Components
+/// inside CompositeComponents are not converted.  Returns the number of
+/// components that were converted.
+int32 QuantizeNnet(Nnet *nnet);
+
+/// Replaces the components of type AffineComponent (and its child classes),
+/// LinearComponent and FixedAffineComponent by SparseAffineComponent (see
+/// nnet-sparse-component.h), whose linear parameters are stored as a sparse
+/// matrix.  Linear parameters whose absolute value is <= prune_threshold are
+/// set to zero first; a component is converted only if the proportion of zero
+/// linear parameters is then at least min_sparsity, since for denser matrices
+/// the dense multiplication is faster.  The result can no longer be trained.
+/// Components inside CompositeComponents are not converted.  Returns the
+/// number of components that were converted.
+int32 SparsifyNnet(BaseFloat prune_threshold, BaseFloat min_sparsity,
+                   Nnet *nnet);
+
 /// This function returns various info about the neural net.
 /// If the nnet satisfied IsSimpleNnet(nnet), the info includes "left-context=5\nright-context=3\n...".  The info includes
 /// the output of nnet.Info().
@@ -239,7 +273,7 @@ void FindOrphanNodes(const Nnet &nnet, std::vector<int32> *nodes);
  */
 struct CollapseModelConfig {
   bool collapse_dropout;  // dropout then affine/conv.
-  bool collapse_batchnorm;  // batchnorm then affine.
+  bool collapse_batchnorm;  // batchnorm then affine, or affine then batchnorm.
   bool collapse_affine;  // affine or fixed-affine then affine.
   bool collapse_scale;  // affine then fixed-scale.
   CollapseModelConfig(): collapse_dropout(false),
@@ -0,0 +1,323 @@
+// nnet3bin/nnet3-align-compiled-batch.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <deque>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "hmm/hmm-utils.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/decoder-wrappers.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/training-graph-reader.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-batch-compute.h"
+#include "nnet3/nnet-utils.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Aligns one utterance given its graph and the (scaled, prior-normalized)
+// output of the neural net.  The alignment is done by operator(), possibly in
+// parallel with other utterances; the output is written by the destructor,
+// which TaskSequencer calls in order.
+class AlignUtteranceTask {
+ public:
+  AlignUtteranceTask(const AlignConfig &config,
+                     const TransitionModel &trans_model,
+                     BaseFloat acoustic_scale,
+                     const std::string &utt,
+                     fst::VectorFst<fst::StdArc> *fst,  // takes ownership.
+                     Matrix<BaseFloat> *loglikes,  // is swapped with.
+                     Int32VectorWriter *alignment_writer,
+                     BaseFloatWriter *scores_writer,
+                     BaseFloatVectorWriter *per_frame_acwt_writer,
+                     int32 *num_done, int32 *num_err, int32 *num_retry,
+                     double *tot_like, int64 *frame_count):
+      config_(config), trans_model_(trans_model),
+      acoustic_scale_(acoustic_scale), utt_(utt), fst_(fst),
+      alignment_writer_(alignment_writer), scores_writer_(scores_writer),
+      per_frame_acwt_writer_(per_frame_acwt_writer),
+      num_done_(num_done), num_err_(num_err), num_retry_(num_retry),
+      tot_like_(tot_like), frame_count_(frame_count),
+      success_(false), retried_(false), cost_(0.0) {
+    loglikes_.Swap(loglikes);
+  }
+
+  void operator () () {
+    // The acoustic scale was already applied by NnetBatchInference.
+    DecodableMatrixScaledMapped decodable(trans_model_, loglikes_, 1.0);
+    success_ = AlignUtterance(
+        config_, utt_, fst_, &decodable, &alignment_, &cost_,
+        per_frame_acwt_writer_->IsOpen() ? &per_frame_costs_ : NULL,
+        &retried_);
+  }
+
+  ~AlignUtteranceTask() {
+    delete fst_;
+    if (retried_) (*num_retry_)++;
+    if (!success_) {
+      (*num_err_)++;
+      return;
+    }
+    (*num_done_)++;
+    (*tot_like_) += -cost_ / acoustic_scale_;
+    (*frame_count_) += loglikes_.NumRows();
+    if (alignment_writer_->IsOpen())
+      alignment_writer_->Write(utt_, alignment_);
+    if (scores_writer_->IsOpen())
+      scores_writer_->Write(utt_, -cost_);
+    if (per_frame_acwt_writer_->IsOpen()) {
+      per_frame_costs_.Scale(-1.0 / acoustic_scale_);
+      per_frame_acwt_writer_->Write(utt_, per_frame_costs_);
+    }
+  }
+
+ private:
+  const AlignConfig &config_;
+  const TransitionModel &trans_model_;
+  BaseFloat acoustic_scale_;
+  std::string utt_;
+  fst::VectorFst<fst::StdArc> *fst_;
+  Matrix<BaseFloat> loglikes_;
+  Int32VectorWriter *alignment_writer_;
+  BaseFloatWriter *scores_writer_;
+  BaseFloatVectorWriter *per_frame_acwt_writer_;
+  int32 *num_done_, *num_err_, *num_retry_;
+  double *tot_like_;
+  int64 *frame_count_;
+
+  bool success_;
+  bool retried_;
+  BaseFloat cost_;
+  std::vector<int32> alignment_;
+  Vector<BaseFloat> per_frame_costs_;
+};
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Align features given nnet3 neural net model.  This version computes\n"
+        "the neural net in batches (on the GPU if available) as\n"
+        "nnet3-compute-batch does, and does the Viterbi alignment on the CPU\n"
+        "in several threads (--num-threads).  Its output is the same as\n"
+        "that of nnet3-align-compiled.\n"
+        "Usage:   nnet3-align-compiled-batch [options] <nnet-in> "
+        "<graphs-rspecifier> <features-rspecifier> <alignments-wspecifier> "
+        "[scores-wspecifier]\n"
+        "e.g.: \n"
+        " nnet3-align-compiled-batch --num-threads=8 1.mdl ark:graphs.fsts \\\n"
+        "   scp:train.scp ark:1.ali\n";
+
+    ParseOptions po(usage);
+    Timer timer;
+    AlignConfig align_config;
+    TrainingGraphReaderOptions graph_reader_opts;
+    NnetBatchComputerOptions opts;
+    TaskSequencerConfig sequencer_config;
+    std::string use_gpu = "yes";
+    BaseFloat transition_scale = 1.0;
+    BaseFloat self_loop_scale = 1.0;
+    std::string per_frame_acwt_wspecifier;
+
+    std::string ivector_rspecifier,
+        online_ivector_rspecifier,
+        utt2spk_rspecifier;
+    int32 online_ivector_period = 0;
+    align_config.Register(&po);
+    graph_reader_opts.Register(&po);
+    opts.Register(&po);
+    sequencer_config.Register(&po);
+
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("transition-scale", &transition_scale,
+                "Transition-probability scale [relative to acoustics]");
+    po.Register("self-loop-scale", &self_loop_scale,
+                "Scale of self-loop versus non-self-loop log probs [relative to acoustics]");
+    po.Register("write-per-frame-acoustic-loglikes", &per_frame_acwt_wspecifier,
+                "Wspecifier for table of vectors containing the acoustic log-likelihoods "
+                "per frame for each utterance. E.g. ark:foo/per_frame_logprobs.1.ark");
+    po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
+                "iVectors as vectors (i.e. not estimated online); per utterance "
+                "by default, or per speaker if you provide the --utt2spk option.");
+    po.Register("utt2spk", &utt2spk_rspecifier, "Rspecifier for "
+                "utt2spk option used to get ivectors per speaker");
+    po.Register("online-ivectors", &online_ivector_rspecifier, "Rspecifier for "
+                "iVectors estimated online, as matrices.  If you supply this,"
+                " you must set the --online-ivector-period option.");
+    po.Register("online-ivector-period", &online_ivector_period, "Number of frames "
+                "between iVectors in matrices supplied to the --online-ivectors "
+                "option");
+
+#if HAVE_CUDA==1
+    CuDevice::RegisterDeviceOptions(&po);
+#endif
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 4 || po.NumArgs() > 5) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().AllowMultithreading();
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_rspecifier = po.GetArg(2),
+        feature_rspecifier = po.GetArg(3),
+        alignment_wspecifier = po.GetArg(4),
+        scores_wspecifier = po.GetOptArg(5);
+
+    int32 num_done = 0, num_err = 0, num_retry = 0;
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(model_in_filename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+    }
+    SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+    SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+    CollapseModel(CollapseModelConfig(), &(am_nnet.GetNnet()));
+
+    RandomAccessBaseFloatMatrixReader online_ivector_reader(
+        online_ivector_rspecifier);
+    RandomAccessBaseFloatVectorReaderMapped ivector_reader(
+        ivector_rspecifier, utt2spk_rspecifier);
+
+    SequentialTrainingGraphReader fst_reader(fst_rspecifier, trans_model,
+                                             graph_reader_opts);
+    RandomAccessBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+    BaseFloatWriter scores_writer(scores_wspecifier);
+    BaseFloatVectorWriter per_frame_acwt_writer(per_frame_acwt_wspecifier);
+
+    {
+      NnetBatchInference inference(opts, am_nnet.GetNnet(), am_nnet.Priors());
+      TaskSequencer<AlignUtteranceTask> sequencer(sequencer_config);
+      // The graphs of the utterances given to 'inference' whose output we
+      // have not yet received, in order.
+      std::deque<std::pair<std::string, VectorFst<StdArc>*> > pending;
+
+      // Moves the utterances whose nnet output is ready to the sequencer.
+      auto align_ready = [&]() {
+        std::string utt;
+        Matrix<BaseFloat> loglikes;
+        while (inference.GetOutput(&utt, &loglikes)) {
+          KALDI_ASSERT(!pending.empty() && pending.front().first == utt);
+          VectorFst<StdArc> *fst = pending.front().second;
+          pending.pop_front();
+          sequencer.Run(new AlignUtteranceTask(
+              align_config, trans_model, opts.acoustic_scale, utt, fst,
+              &loglikes, &alignment_writer, &scores_writer,
+              &per_frame_acwt_writer, &num_done, &num_err, &num_retry,
+              &tot_like, &frame_count));
+        }
+      };
+
+      for (; !fst_reader.Done(); fst_reader.Next()) {
+        std::string utt = fst_reader.Key();
+        if (!feature_reader.HasKey(utt)) {
+          KALDI_WARN << "No features for utterance " << utt;
+          num_err++;
+          continue;
+        }
+        const Matrix<BaseFloat> &features = feature_reader.Value(utt);
+        if (features.NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << utt;
+          num_err++;
+          continue;
+        }
+        const Matrix<BaseFloat> *online_ivectors = NULL;
+        const Vector<BaseFloat> *ivector = NULL;
+        if (!ivector_rspecifier.empty()) {
+          if (!ivector_reader.HasKey(utt)) {
+            KALDI_WARN << "No iVector available for utterance " << utt;
+            num_err++;
+            continue;
+          } else {
+            ivector = &ivector_reader.Value(utt);
+          }
+        }
+        if (!online_ivector_rspecifier.empty()) {
+          if (!online_ivector_reader.HasKey(utt)) {
+            KALDI_WARN << "No online iVector available for utterance " << utt;
+            num_err++;
+            continue;
+          } else {
+            online_ivectors = &online_ivector_reader.Value(utt);
+          }
+        }
+
+        VectorFst<StdArc> *decode_fst = new VectorFst<StdArc>(
+            fst_reader.Value());
+        fst_reader.FreeCurrent();  // this stops copy-on-write of the fst
+        // by deleting the fst inside the reader, since we're about to mutate
+        // the fst by adding transition probs.
+        {  // Add transition-probs to the FST.
+          std::vector<int32> disambig_syms;  // empty.
+          AddTransitionProbs(trans_model, disambig_syms,
+                             transition_scale, self_loop_scale,
+                             decode_fst);
+        }
+        pending.push_back(std::make_pair(utt, decode_fst));
+        inference.AcceptInput(utt, features, ivector, online_ivectors,
+                              online_ivector_period);
+        align_ready();
+      }
+      inference.Finished();
+      align_ready();
+      KALDI_ASSERT(pending.empty());
+      sequencer.Wait();
+    }
+
+    KALDI_LOG << "Overall log-likelihood per frame is "
+              << (tot_like/frame_count)
+              << " over " << frame_count<< " frames.";
+    KALDI_LOG << "Retried " << num_retry << " out of "
+              << (num_done + num_err) << " utterances.";
+    KALDI_LOG << "Done " << num_done << ", errors on " << num_err
+              << "; time taken " << timer.Elapsed() << "s";
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
+    return (num_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
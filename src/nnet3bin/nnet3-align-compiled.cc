@@ -28,6 +28,7 @@
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
 #include "decoder/training-graph-compiler.h"
+#include "decoder/training-graph-reader.h"
 #include "nnet3/nnet-am-decodable-simple.h"
 #include "nnet3/nnet-utils.h"
 #include "lat/kaldi-lattice.h"
@@ -49,10 +50,14 @@ int main(int argc, char *argv[]) {
         " nnet3-align-compiled 1.mdl ark:graphs.fsts scp:train.scp ark:1.ali\n"
         "or:\n"
         " compile-train-graphs tree 1.mdl lex.fst 'ark:sym2int.pl -f 2- words.txt text|' \\\n"
-        "   ark:- | nnet3-align-compiled 1.mdl ark:- scp:train.scp t, ark:1.ali\n";
+        "   ark:- | nnet3-align-compiled 1.mdl ark:- scp:train.scp t, ark:1.ali\n"
+        "or, compiling the graphs in-process:\n"
+        " nnet3-align-compiled --compile-graphs.tree=tree --compile-graphs.lexicon=lex.fst \\\n"
+        "   1.mdl 'ark:sym2int.pl -f 2- words.txt text|' scp:train.scp ark:1.ali\n";
 
     ParseOptions po(usage);
     AlignConfig align_config;
+    TrainingGraphReaderOptions graph_reader_opts;
     NnetSimpleComputationOptions decodable_opts;
     std::string use_gpu = "yes";
     BaseFloat transition_scale = 1.0;
@@ -64,6 +69,7 @@ int main(int argc, char *argv[]) {
         utt2spk_rspecifier;
     int32 online_ivector_period = 0;
     align_config.Register(&po);
+    graph_reader_opts.Register(&po);
     decodable_opts.Register(&po);
 
     po.Register("use-gpu", &use_gpu,
@@ -122,7 +128,8 @@ int main(int argc, char *argv[]) {
       // this compiler object allows caching of computations across
       // different utterances.
       CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
-                                         decodable_opts.optimize_config);
+                                         decodable_opts.optimize_config,
+                                         decodable_opts.compiler_config);
 
       RandomAccessBaseFloatMatrixReader online_ivector_reader(
           online_ivector_rspecifier);
@@ -130,7 +137,8 @@ int main(int argc, char *argv[]) {
           ivector_rspecifier, utt2spk_rspecifier);
 
 
-      SequentialTableReader<fst::VectorFstHolder> fst_reader(fst_rspecifier);
+      SequentialTrainingGraphReader fst_reader(fst_rspecifier, trans_model,
+                                               graph_reader_opts);
       RandomAccessBaseFloatMatrixReader feature_reader(feature_rspecifier);
       Int32VectorWriter alignment_writer(alignment_wspecifier);
       BaseFloatWriter scores_writer(scores_wspecifier);
@@ -50,7 +50,8 @@ int main(int argc, char *argv[]) {
     std::string set_raw_nnet = "";
     bool convert_repeated_to_block = false;
     BaseFloat scale = 1.0;
-    bool prepare_for_test = false;
+    bool prepare_for_test = false,
+        fold_batchnorm = false;
     std::string nnet_config, edits_config, edits_str;
 
     ParseOptions po(usage);
@@ -87,6 +88,12 @@ int main(int argc, char *argv[]) {
                 "slightly.  Involves setting test mode in dropout and batch-norm "
                 "components, and calling CollapseModel() which may remove some "
                 "components.");
+    po.Register("fold-batchnorm", &fold_batchnorm,
+                "If true, sets test mode in batch-norm components and folds "
+                "them into the preceding or following affine, linear or TDNN "
+                "components where that is possible (see CollapseModel()), "
+                "which saves a pass over the data per layer at test time.  "
+                "May be combined with --prepare-for-test.");
 
     po.Read(argc, argv);
 
@@ -142,10 +149,17 @@ int main(int argc, char *argv[]) {
     if (scale != 1.0)
       ScaleNnet(scale, &(am_nnet.GetNnet()));
 
-    if (prepare_for_test) {
+    if (prepare_for_test || fold_batchnorm) {
       SetBatchnormTestMode(true, &am_nnet.GetNnet());
-      SetDropoutTestMode(true, &am_nnet.GetNnet());
-      CollapseModel(CollapseModelConfig(), &am_nnet.GetNnet());
+      CollapseModelConfig collapse_config;
+      if (prepare_for_test) {
+        SetDropoutTestMode(true, &am_nnet.GetNnet());
+      } else {
+        collapse_config.collapse_affine = false;
+        collapse_config.collapse_scale = false;
+      }
+      collapse_config.collapse_batchnorm = fold_batchnorm;
+      CollapseModel(collapse_config, &am_nnet.GetNnet());
     }
 
     if (raw) {
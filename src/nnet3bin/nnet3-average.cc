@@ -51,21 +51,22 @@ void GetWeights(const std::string &weights_str,
   }
 }
 
-// This job is run in a spawned thread; it reads a subset of models with
-// specified weights.  Sets *success to 1 for success and 0 for failure.  (We
-// don't use bool because of the weird implementation of std::vector<bool>).
-void ReadModels(std::vector<std::pair<std::string, BaseFloat> > models_and_weights,
-                nnet3::Nnet *output_nnet,
-                int32 *success) {
+// This job is run in a spawned thread; it reads a subset of models one
+// component at a time, and adds them with the specified weights to
+// 'output_nnet', which is shared by all the threads.  Sets *success to 1 for
+// success and 0 for failure.  (We don't use bool because of the weird
+// implementation of std::vector<bool>).
+void AddModels(std::vector<std::pair<std::string, BaseFloat> > models_and_weights,
+               nnet3::Nnet *output_nnet,
+               std::vector<std::mutex> *component_mutexes,
+               int32 *success) {
   using namespace nnet3;
   try {
-    int32 n = models_and_weights.size();
-    ReadKaldiObject(models_and_weights[0].first, output_nnet);
-    ScaleNnet(models_and_weights[0].second, output_nnet);
-    for (int32 i = 1; i < n; i++) {
-      Nnet nnet;
-      ReadKaldiObject(models_and_weights[i].first, &nnet);
-      AddNnet(nnet, models_and_weights[i].second, output_nnet);
+    for (size_t i = 0; i < models_and_weights.size(); i++) {
+      bool binary_in;
+      Input ki(models_and_weights[i].first, &binary_in);
+      AddNnetFromStream(ki.Stream(), binary_in, models_and_weights[i].second,
+                        output_nnet, component_mutexes);
     }
     *success = 1;
   } catch (...) {
@@ -85,6 +86,8 @@ int main(int argc, char *argv[]) {
 
     const char *usage =
         "This program averages the parameters over a number of 'raw' nnet3 neural nets.\n"
+        "Only the first model is held in memory as a whole: the others are read\n"
+        "one component at a time, in --num-threads threads, and added to it.\n"
         "\n"
         "Usage:  nnet3-average [options] <model1> <model2> ... <modelN> <model-out>\n"
         "\n"
@@ -122,26 +125,29 @@ int main(int argc, char *argv[]) {
       else num_threads = 1;
     }
 
-    if (num_threads > 1 && num_threads * 2 > num_inputs) {
-      num_threads = num_inputs / 2;
-    }
+    // The threads read the models other than the first one.
+    num_threads = std::min(num_threads, num_inputs - 1);
 
     std::vector<BaseFloat> model_weights;
     GetWeights(weights_str, num_inputs, &model_weights);
 
-    std::vector<Nnet> nnets(num_threads);
+    Nnet nnet;
+    ReadKaldiObject(first_nnet_rxfilename, &nnet);
+    ScaleNnet(model_weights[0], &nnet);
+
+    std::vector<std::mutex> component_mutexes(nnet.NumComponents());
     std::vector<int32> return_statuses(num_threads);
 
     std::vector<std::thread*> threads(num_threads);
 
     for (int32 thread_id = 0; thread_id < num_threads; thread_id++) {
       std::vector<std::pair<std::string, BaseFloat> > this_models_and_weights;
-      for (int32 j = 1 + thread_id; j < po.NumArgs(); j += num_threads) {
+      for (int32 j = 2 + thread_id; j < po.NumArgs(); j += num_threads) {
         this_models_and_weights.push_back(std::pair<std::string, BaseFloat>(
             po.GetArg(j), model_weights[j - 1]));
       }
-      threads[thread_id] = new std::thread(ReadModels, this_models_and_weights,
-                                           &(nnets[thread_id]),
+      threads[thread_id] = new std::thread(AddModels, this_models_and_weights,
+                                           &nnet, &component_mutexes,
                                            &(return_statuses[thread_id]));
     }
 
@@ -151,15 +157,13 @@ int main(int argc, char *argv[]) {
       delete threads[thread_id];
       if (!return_statuses[thread_id])
         success = false;
-      if (success && thread_id > 0)
-        AddNnet(nnets[thread_id], 1.0, &(nnets[0]));
     }
 
     if (!success) {
       KALDI_ERR << "Error detected in a model-reading thread.";
     }
 
-    WriteKaldiObject(nnets[0], nnet_wxfilename, binary_write);
+    WriteKaldiObject(nnet, nnet_wxfilename, binary_write);
 
     KALDI_LOG << "Averaged parameters of " << num_inputs
               << " neural nets, and wrote to " << nnet_wxfilename;
@@ -0,0 +1,368 @@
+// nnet3bin/nnet3-benchmark.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-batch-compute.h"
+#include "nnet3/nnet-utils.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// An utterance to compute: features and, if the model needs them, an
+// iVector.
+struct BenchUtterance {
+  Matrix<BaseFloat> feats;
+  Vector<BaseFloat> ivector;
+};
+
+// The results for one configuration.
+struct BenchResult {
+  std::vector<double> latencies;  // per utterance, in seconds.
+  double seconds;                 // wall-clock time for all utterances.
+  int64 num_frames;               // input frames.
+  int64 cache_hits;
+  int64 cache_misses;
+  double compile_seconds;
+  BenchResult(): seconds(0.0), num_frames(0), cache_hits(0), cache_misses(0),
+                 compile_seconds(0.0) { }
+};
+
+// Does the computation for the utterances, taking them in turn from 'next',
+// as in nnet3-latgen-faster: each chunk is computed separately, with the
+// computations cached by 'compiler'.
+void ComputeSimple(const NnetSimpleComputationOptions &opts, const Nnet &nnet,
+                   const VectorBase<BaseFloat> &priors,
+                   const std::vector<BenchUtterance> &utts,
+                   std::atomic<size_t> *next,
+                   CachingOptimizingCompiler *compiler,
+                   std::vector<double> *latencies) {
+  size_t i;
+  while ((i = (*next)++) < utts.size()) {
+    Timer timer;
+    const BenchUtterance &utt = utts[i];
+    DecodableNnetSimple decodable(opts, nnet, priors, utt.feats, compiler,
+                                  utt.ivector.Dim() > 0 ? &utt.ivector : NULL);
+    Vector<BaseFloat> output(decodable.OutputDim(), kUndefined);
+    for (int32 t = 0; t < decodable.NumFrames(); t++)
+      decodable.GetOutputForFrame(t, &output);
+    (*latencies)[i] = timer.Elapsed();
+  }
+}
+
+// Does the computation for the utterances, taking them in turn from 'next',
+// with 'computer', which combines the chunks of the utterances being computed
+// by all the threads into minibatches.  Each thread does computation while it
+// waits for the chunks of its own utterance.
+void ComputeBatch(NnetBatchComputer *computer,
+                  const std::vector<BenchUtterance> &utts,
+                  std::atomic<size_t> *next,
+                  std::vector<double> *latencies) {
+  size_t i;
+  while ((i = (*next)++) < utts.size()) {
+    Timer timer;
+    const BenchUtterance &utt = utts[i];
+    std::vector<NnetInferenceTask> tasks;
+    computer->SplitUtteranceIntoTasks(
+        true, utt.feats, utt.ivector.Dim() > 0 ? &utt.ivector : NULL,
+        NULL, 0, &tasks);
+    for (size_t t = 0; t < tasks.size(); t++)
+      computer->AcceptTask(&(tasks[t]));
+    for (size_t t = 0; t < tasks.size(); t++) {
+      while (!tasks[t].semaphore.TryWait()) {
+        // If there is nothing to compute, our remaining chunks are being
+        // computed by another thread.
+        if (!computer->Compute(false) && !computer->Compute(true))
+          std::this_thread::yield();
+      }
+    }
+    Matrix<BaseFloat> output;
+    MergeTaskOutput(tasks, &output);
+    (*latencies)[i] = timer.Elapsed();
+  }
+}
+
+// Runs one configuration with 'num_threads' threads; minibatch_size == 0 means
+// the non-batched computation.
+void RunBenchmark(const NnetBatchComputerOptions &opts, const Nnet &nnet,
+                  const VectorBase<BaseFloat> &priors,
+                  const std::vector<BenchUtterance> &utts,
+                  int32 minibatch_size, int32 num_threads,
+                  BenchResult *result) {
+  result->latencies.resize(utts.size());
+  for (size_t i = 0; i < utts.size(); i++)
+    result->num_frames += utts[i].feats.NumRows();
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  Timer timer;
+  if (minibatch_size == 0) {
+    // As in nnet3-latgen-faster-parallel, each thread has its own compiler.
+    std::vector<CachingOptimizingCompiler*> compilers(num_threads);
+    for (int32 t = 0; t < num_threads; t++) {
+      compilers[t] = new CachingOptimizingCompiler(nnet,
+                                                   opts.optimize_config,
+                                                   opts.compiler_config);
+      threads.push_back(std::thread(ComputeSimple, std::cref(opts),
+                                    std::cref(nnet), std::cref(priors),
+                                    std::cref(utts), &next, compilers[t],
+                                    &(result->latencies)));
+    }
+    for (int32 t = 0; t < num_threads; t++)
+      threads[t].join();
+    result->seconds = timer.Elapsed();
+    for (int32 t = 0; t < num_threads; t++) {
+      result->cache_hits += compilers[t]->NumCacheHits();
+      result->cache_misses += compilers[t]->NumCacheMisses();
+      result->compile_seconds += compilers[t]->SecondsTaken();
+      delete compilers[t];
+    }
+  } else {
+    NnetBatchComputerOptions this_opts(opts);
+    this_opts.minibatch_size = minibatch_size;
+    this_opts.edge_minibatch_size = std::min(opts.edge_minibatch_size,
+                                             minibatch_size);
+    NnetBatchComputer computer(this_opts, nnet, priors);
+    for (int32 t = 0; t < num_threads; t++)
+      threads.push_back(std::thread(ComputeBatch, &computer, std::cref(utts),
+                                    &next, &(result->latencies)));
+    for (int32 t = 0; t < num_threads; t++)
+      threads[t].join();
+    result->seconds = timer.Elapsed();
+    result->cache_hits = computer.GetCompiler().NumCacheHits();
+    result->cache_misses = computer.GetCompiler().NumCacheMisses();
+    result->compile_seconds = computer.GetCompiler().SecondsTaken();
+  }
+}
+
+// Returns the p'th percentile (0 <= p <= 100) of 'v', which must be sorted.
+double Percentile(const std::vector<double> &v, double p) {
+  KALDI_ASSERT(!v.empty());
+  size_t i = std::min(v.size() - 1, static_cast<size_t>(p / 100.0 * v.size()));
+  return v[i];
+}
+
+}  // namespace nnet3
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Benchmarks neural-net inference with an acoustic model for a range\n"
+        "of chunk sizes (--frames-per-chunk-list), minibatch sizes\n"
+        "(--minibatch-sizes, using NnetBatchComputer as in\n"
+        "nnet3-latgen-faster-batch; 0 means computing each chunk separately\n"
+        "as in nnet3-latgen-faster) and numbers of threads\n"
+        "(--num-threads-list), to help choose these options for a model and\n"
+        "machine.  The features (and iVectors if the model takes them) are\n"
+        "random unless --feats-rspecifier is given.  Reports the percentiles\n"
+        "of the per-utterance latency, the throughput, and the hit rate of\n"
+        "the cache of compiled computations (NnetBatchComputer keeps the\n"
+        "computation for each minibatch size itself, so it only asks the\n"
+        "compiler once per size); with --output, writes one JSON object per\n"
+        "line for each configuration.  To compare the CPU and the\n"
+        "GPU, run it with --use-gpu=no and --use-gpu=yes.\n"
+        "\n"
+        "Usage: nnet3-benchmark [options] <model-in>\n"
+        "e.g.: nnet3-benchmark --frames-per-chunk-list=50,150 "
+        "--minibatch-sizes=0,32,128 final.mdl\n";
+
+    ParseOptions po(usage);
+    NnetBatchComputerOptions opts;
+    opts.Register(&po);
+
+    std::string use_gpu = "no", frames_per_chunk_str = "50,100,150",
+        minibatch_sizes_str = "0,16,64", num_threads_str = "1,4",
+        feats_rspecifier, output_wxfilename;
+    int32 seed = 0, num_utts = 50, utt_frames = 1000;
+    bool use_priors = true;
+
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("frames-per-chunk-list", &frames_per_chunk_str,
+                "Comma-separated list of the chunk sizes to benchmark "
+                "(overrides --frames-per-chunk).");
+    po.Register("minibatch-sizes", &minibatch_sizes_str, "Comma-separated "
+                "list of the minibatch sizes to benchmark (overrides "
+                "--minibatch-size); 0 means no batching.");
+    po.Register("num-threads-list", &num_threads_str, "Comma-separated list "
+                "of the numbers of threads to benchmark.");
+    po.Register("feats-rspecifier", &feats_rspecifier, "Features to compute; "
+                "if empty, random ones are made.");
+    po.Register("output", &output_wxfilename, "If set, write the results "
+                "here as JSON lines.");
+    po.Register("seed", &seed, "Seed for the random features.");
+    po.Register("num-utts", &num_utts, "Number of random utterances.");
+    po.Register("utt-frames", &utt_frames, "Number of frames per random "
+                "utterance.");
+    po.Register("use-priors", &use_priors, "If true, subtract the logs of the "
+                "priors stored with the model, as in decoding.");
+
+#if HAVE_CUDA==1
+    CuDevice::RegisterDeviceOptions(&po);
+#endif
+
+    po.Read(argc, argv);
+    if (po.NumArgs() != 1) {
+      po.PrintUsage();
+      return 1;
+    }
+
+    bool gpu = false;
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().AllowMultithreading();
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+    gpu = CuDevice::Instantiate().Enabled();
+#endif
+
+    std::vector<int32> frames_per_chunk_list, minibatch_sizes,
+        num_threads_list;
+    if (!SplitStringToIntegers(frames_per_chunk_str, ",", true,
+                               &frames_per_chunk_list) ||
+        frames_per_chunk_list.empty())
+      KALDI_ERR << "Invalid --frames-per-chunk-list option: "
+                << frames_per_chunk_str;
+    if (!SplitStringToIntegers(minibatch_sizes_str, ",", true,
+                               &minibatch_sizes) || minibatch_sizes.empty())
+      KALDI_ERR << "Invalid --minibatch-sizes option: " << minibatch_sizes_str;
+    if (!SplitStringToIntegers(num_threads_str, ",", true,
+                               &num_threads_list) || num_threads_list.empty())
+      KALDI_ERR << "Invalid --num-threads-list option: " << num_threads_str;
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(po.GetArg(1), &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+    }
+    Nnet &nnet = am_nnet.GetNnet();
+    SetBatchnormTestMode(true, &nnet);
+    SetDropoutTestMode(true, &nnet);
+    CollapseModel(CollapseModelConfig(), &nnet);
+    Vector<BaseFloat> priors;
+    if (use_priors)
+      priors = am_nnet.Priors();
+
+    std::vector<BenchUtterance> utts;
+    int32 ivector_dim = std::max<int32>(0, nnet.InputDim("ivector"));
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> gauss(0.0, 1.0);
+    if (!feats_rspecifier.empty()) {
+      SequentialBaseFloatMatrixReader feature_reader(feats_rspecifier);
+      for (; !feature_reader.Done(); feature_reader.Next()) {
+        utts.resize(utts.size() + 1);
+        utts.back().feats = feature_reader.Value();
+      }
+    } else {
+      utts.resize(num_utts);
+      for (int32 i = 0; i < num_utts; i++) {
+        Matrix<BaseFloat> &feats = utts[i].feats;
+        feats.Resize(utt_frames, nnet.InputDim("input"), kUndefined);
+        for (int32 r = 0; r < feats.NumRows(); r++)
+          for (int32 c = 0; c < feats.NumCols(); c++)
+            feats(r, c) = gauss(rng);
+      }
+    }
+    if (utts.empty())
+      KALDI_ERR << "No utterances to compute.";
+    for (size_t i = 0; i < utts.size(); i++) {
+      utts[i].ivector.Resize(ivector_dim, kUndefined);
+      for (int32 d = 0; d < ivector_dim; d++)
+        utts[i].ivector(d) = gauss(rng);
+    }
+
+    Output *output = NULL;
+    if (!output_wxfilename.empty())
+      output = new Output(output_wxfilename, false);
+
+    for (size_t c = 0; c < frames_per_chunk_list.size(); c++) {
+      for (size_t m = 0; m < minibatch_sizes.size(); m++) {
+        for (size_t n = 0; n < num_threads_list.size(); n++) {
+          NnetBatchComputerOptions this_opts(opts);
+          this_opts.frames_per_chunk = frames_per_chunk_list[c];
+          int32 minibatch_size = minibatch_sizes[m],
+              num_threads = num_threads_list[n];
+          BenchResult result;
+          RunBenchmark(this_opts, nnet, priors, utts, minibatch_size,
+                       num_threads, &result);
+          std::vector<double> &latencies = result.latencies;
+          std::sort(latencies.begin(), latencies.end());
+          double frames_per_second = result.num_frames / result.seconds,
+              hit_rate = result.cache_hits /
+              std::max<double>(1.0, result.cache_hits + result.cache_misses);
+          KALDI_LOG << (gpu ? "GPU" : "CPU") << ", frames-per-chunk="
+                    << this_opts.frames_per_chunk << ", minibatch-size="
+                    << minibatch_size << ", threads=" << num_threads << ": "
+                    << frames_per_second << " frames/sec, latency p50="
+                    << Percentile(latencies, 50) << "s p90="
+                    << Percentile(latencies, 90) << "s p99="
+                    << Percentile(latencies, 99) << "s, compilation cache "
+                    << result.cache_hits << " hits, " << result.cache_misses
+                    << " misses (" << result.compile_seconds << "s)";
+          if (output != NULL) {
+            output->Stream()
+                << "{\"device\": \"" << (gpu ? "gpu" : "cpu")
+                << "\", \"frames_per_chunk\": " << this_opts.frames_per_chunk
+                << ", \"extra_left_context\": "
+                << this_opts.extra_left_context
+                << ", \"extra_right_context\": "
+                << this_opts.extra_right_context
+                << ", \"minibatch_size\": " << minibatch_size
+                << ", \"num_threads\": " << num_threads
+                << ", \"num_utts\": " << utts.size()
+                << ", \"num_frames\": " << result.num_frames
+                << ", \"seconds\": " << result.seconds
+                << ", \"frames_per_second\": " << frames_per_second
+                << ", \"latency_p50\": " << Percentile(latencies, 50)
+                << ", \"latency_p90\": " << Percentile(latencies, 90)
+                << ", \"latency_p99\": " << Percentile(latencies, 99)
+                << ", \"latency_max\": " << latencies.back()
+                << ", \"cache_hits\": " << result.cache_hits
+                << ", \"cache_misses\": " << result.cache_misses
+                << ", \"cache_hit_rate\": " << hit_rate
+                << ", \"compile_seconds\": " << result.compile_seconds
+                << "}\n";
+          }
+        }
+      }
+    }
+    delete output;
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -62,12 +62,15 @@ double ComputeObjf(bool batchnorm_test_mode, bool dropout_test_mode,
 }
 
 // Updates moving average over num_models nnets, given the average over
-// previous (num_models - 1) nnets, and the new nnet.
+// previous (num_models - 1) nnets, and the new nnet.  The new nnet is read
+// one component at a time, so that we don't need another copy of it in memory.
 void UpdateNnetMovingAverage(int32 num_models,
-    const Nnet &nnet, Nnet *moving_average_nnet) {
-  KALDI_ASSERT(NumParameters(nnet) == NumParameters(*moving_average_nnet));
+    const std::string &nnet_rxfilename, Nnet *moving_average_nnet) {
   ScaleNnet((num_models - 1.0) / num_models, moving_average_nnet);
-  AddNnet(nnet, 1.0 / num_models, moving_average_nnet);
+  bool binary_in;
+  Input ki(nnet_rxfilename, &binary_in);
+  AddNnetFromStream(ki.Stream(), binary_in, 1.0 / num_models,
+                    moving_average_nnet);
 }
 
 }
@@ -130,9 +133,9 @@ int main(int argc, char *argv[]) {
         valid_examples_rspecifier = po.GetArg(po.NumArgs() - 1),
         nnet_wxfilename = po.GetArg(po.NumArgs());
 
-    Nnet nnet;
-    ReadKaldiObject(nnet_rxfilename, &nnet);
-    Nnet moving_average_nnet(nnet), best_nnet(nnet);
+    Nnet moving_average_nnet;
+    ReadKaldiObject(nnet_rxfilename, &moving_average_nnet);
+    Nnet best_nnet(moving_average_nnet);
     NnetComputeProbOptions compute_prob_opts;
     NnetComputeProb prob_computer(compute_prob_opts, moving_average_nnet);
 
@@ -163,9 +166,8 @@ int main(int argc, char *argv[]) {
     int32 num_to_add = (num_nnets + max_objective_evaluations - 1) /
                        max_objective_evaluations;
     for (int32 n = 1; n < num_nnets; n++) {
-      ReadKaldiObject(po.GetArg(1 + n), &nnet);
       // updates the moving average
-      UpdateNnetMovingAverage(n + 1, nnet, &moving_average_nnet);
+      UpdateNnetMovingAverage(n + 1, po.GetArg(1 + n), &moving_average_nnet);
       // evaluates the objective everytime after adding num_to_add model or
       // all the models to the moving average.
       if ((n - 1) % num_to_add == num_to_add - 1 || n == num_nnets - 1) {
@@ -184,7 +186,7 @@ int main(int argc, char *argv[]) {
               << " nnets, objective function changed from " << init_objf
               << " to " << best_objf;
 
-    if (HasBatchnorm(nnet))
+    if (HasBatchnorm(best_nnet))
       RecomputeStats(egs, &best_nnet);
 
 #if HAVE_CUDA==1
@@ -0,0 +1,96 @@
+// nnet3bin/nnet3-compile-looped.cc
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/decodable-simple-looped.h"
+#include "base/timer.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Compile the 'looped' computation that is used in decoding with an\n"
+        "nnet3 model (e.g. by nnet3-latgen-faster-looped and the online2\n"
+        "decoders) ahead of time, and write it out, so that decoders can read\n"
+        "it with the --compiled-computation option instead of compiling it\n"
+        "when they start.  The options (e.g. --frames-per-chunk,\n"
+        "--frame-subsampling-factor, --extra-left-context-initial and the\n"
+        "--optimization.* options) must be the same as those of the decoder;\n"
+        "otherwise the decoder will warn and compile the computation itself.\n"
+        "\n"
+        "Usage:  nnet3-compile-looped [options] <model-in> <computation-out>\n"
+        "e.g.:\n"
+        " nnet3-compile-looped --frames-per-chunk=20 final.mdl final.computation\n";
+
+    bool binary_write = true,
+        raw = false;
+    NnetSimpleLoopedComputationOptions opts;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    po.Register("raw", &raw, "If true, the input is a 'raw' neural net, "
+                "without the transition model and priors.");
+    opts.Register(&po);
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string nnet_rxfilename = po.GetArg(1),
+        computation_wxfilename = po.GetArg(2);
+    // Make sure we compile it rather than reading it.
+    opts.compiled_computation = "";
+
+    Timer timer;
+    if (raw) {
+      Nnet nnet;
+      ReadKaldiObject(nnet_rxfilename, &nnet);
+      DecodableNnetSimpleLoopedInfo info(opts, &nnet);
+      Output ko(computation_wxfilename, binary_write);
+      info.WriteComputation(ko.Stream(), binary_write);
+    } else {
+      TransitionModel trans_model;
+      AmNnetSimple am_nnet;
+      {
+        bool binary;
+        Input ki(nnet_rxfilename, &binary);
+        trans_model.Read(ki.Stream(), binary);
+        am_nnet.Read(ki.Stream(), binary);
+      }
+      DecodableNnetSimpleLoopedInfo info(opts, &am_nnet);
+      Output ko(computation_wxfilename, binary_write);
+      info.WriteComputation(ko.Stream(), binary_write);
+    }
+    KALDI_LOG << "Compiled looped computation for " << nnet_rxfilename
+              << " in " << timer.Elapsed() << " seconds, wrote it to "
+              << computation_wxfilename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -191,6 +191,7 @@ int main(int argc, char *argv[]) {
 #if HAVE_CUDA==1
     CuDevice::Instantiate().PrintProfile();
 #endif
+    WriteNnetComputeProfile(opts.compute_config);
     double elapsed = timer.Elapsed();
     KALDI_LOG << "Time taken "<< elapsed << "s";
     KALDI_LOG << "Done " << num_success << " utterances, failed for "
@@ -35,16 +35,20 @@ int main(int argc, char *argv[]) {
         "the given data with an nnet3 neural net.  The input of this is the output of\n"
         "e.g. nnet3-get-egs | nnet3-merge-egs.\n"
         "\n"
+        "With --use-gpu=yes, the input features of each minibatch are copied to\n"
+        "the GPU while the previous one is being computed; reading the examples\n"
+        "with the 'bg' option (e.g. ark,bg:valid.egs) overlaps the reading too.\n"
+        "\n"
         "Usage:  nnet3-compute-prob [options] <raw-model-in> <training-examples-in>\n"
         "e.g.: nnet3-compute-prob 0.raw ark:valid.egs\n";
 
 
     bool batchnorm_test_mode = true, dropout_test_mode = true,
         collapse_model = true;
-
-    // This program doesn't support using a GPU, because these probabilities are
-    // used for diagnostics, and you can just compute them with a small enough
+    // The GPU is off by default because these probabilities are used for
+    // diagnostics, and you can normally compute them with a small enough
     // amount of data that a CPU can do it within reasonable time.
+    std::string use_gpu = "no";
 
     NnetComputeProbOptions opts;
 
@@ -58,6 +62,8 @@ int main(int argc, char *argv[]) {
     po.Register("collapse-model", &collapse_model,
                 "If true, collapse model to the extent possible before "
                 "using it (for efficiency).");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
 
     opts.Register(&po);
 
@@ -68,6 +74,10 @@ int main(int argc, char *argv[]) {
       exit(1);
     }
 
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
     std::string raw_nnet_rxfilename = po.GetArg(1),
         examples_rspecifier = po.GetArg(2);
 
@@ -87,11 +97,33 @@ int main(int argc, char *argv[]) {
 
     SequentialNnetExampleReader example_reader(examples_rspecifier);
 
-    for (; !example_reader.Done(); example_reader.Next())
-      prob_computer.Compute(example_reader.Value());
+    // We keep two minibatches, so that the inputs of the next one can be
+    // copied to the GPU while we compute the current one.
+    NnetExample egs[2];
+    int32 cur = 0;
+    if (!example_reader.Done()) {
+      egs[cur].Swap(&(example_reader.Value()));
+      example_reader.Next();
+      while (true) {
+        bool have_next = !example_reader.Done();
+        if (have_next) {
+          egs[1 - cur].Swap(&(example_reader.Value()));
+          example_reader.Next();
+          prob_computer.Prefetch(egs[1 - cur]);
+        }
+        prob_computer.Compute(egs[cur]);
+        if (!have_next)
+          break;
+        cur = 1 - cur;
+      }
+    }
 
     bool ok = prob_computer.PrintTotalStats();
 
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
+
     return (ok ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what() << '\n';
@@ -44,7 +44,8 @@ int main(int argc, char *argv[]) {
     BaseFloat learning_rate = -1;
     std::string nnet_config, edits_config, edits_str;
     BaseFloat scale = 1.0;
-    bool prepare_for_test = false;
+    bool prepare_for_test = false,
+        fold_batchnorm = false;
 
     ParseOptions po(usage);
     po.Register("binary", &binary_write, "Write output in binary mode");
@@ -70,6 +71,12 @@ int main(int argc, char *argv[]) {
                 "slightly.  Involves setting test mode in dropout and batch-norm "
                 "components, and calling CollapseModel() which may remove some "
                 "components.");
+    po.Register("fold-batchnorm", &fold_batchnorm,
+                "If true, sets test mode in batch-norm components and folds "
+                "them into the preceding or following affine, linear or TDNN "
+                "components where that is possible (see CollapseModel()), "
+                "which saves a pass over the data per layer at test time.  "
+                "May be combined with --prepare-for-test.");
     po.Read(argc, argv);
 
     if (po.NumArgs() != 2) {
@@ -105,10 +112,17 @@ int main(int argc, char *argv[]) {
       std::istringstream is(edits_str);
       ReadEditConfig(is, &nnet);
     }
-    if (prepare_for_test) {
+    if (prepare_for_test || fold_batchnorm) {
       SetBatchnormTestMode(true, &nnet);
-      SetDropoutTestMode(true, &nnet);
-      CollapseModel(CollapseModelConfig(), &nnet);
+      CollapseModelConfig collapse_config;
+      if (prepare_for_test) {
+        SetDropoutTestMode(true, &nnet);
+      } else {
+        collapse_config.collapse_affine = false;
+        collapse_config.collapse_scale = false;
+      }
+      collapse_config.collapse_batchnorm = fold_batchnorm;
+      CollapseModel(collapse_config, &nnet);
     }
     WriteKaldiObject(nnet, raw_nnet_wxfilename, binary_write);
     KALDI_LOG << "Copied raw neural net from " << raw_nnet_rxfilename
@@ -34,7 +34,9 @@ int main(int argc, char *argv[]) {
         "Train nnet3 neural network parameters with discriminative sequence objective \n"
         "gradient descent.  Minibatches are to be created by nnet3-discriminative-merge-egs in\n"
         "the input pipeline.  This training program is single-threaded (best to\n"
-        "use it with a GPU).\n"
+        "use it with a GPU), except that the lattices of the next minibatch are\n"
+        "prepared in a background thread while the current one is computed.\n"
+        "To also read the examples in the background, use e.g. 'ark,bg:-'.\n"
         "\n"
         "Usage:  nnet3-discriminative-train [options] <nnet-in> <discriminative-training-examples-in> <raw-nnet-out>\n"
         "\n"
@@ -87,14 +89,37 @@ int main(int argc, char *argv[]) {
     
     const VectorBase<BaseFloat> &priors = am_nnet.Priors();
 
-    NnetDiscriminativeTrainer trainer(opts, tmodel, priors, &nnet);
-
-    SequentialNnetDiscriminativeExampleReader example_reader(examples_rspecifier);
-
-    for (; !example_reader.Done(); example_reader.Next())
-      trainer.Train(example_reader.Value());
-
-    bool ok = trainer.PrintTotalStats();
+    bool ok;
+    {
+      // The egs are declared before the trainer, as its background thread
+      // may use them until it is destroyed.
+      NnetDiscriminativeExample egs[2];
+      int32 cur = 0;
+      NnetDiscriminativeTrainer trainer(opts, tmodel, priors, &nnet);
+
+      SequentialNnetDiscriminativeExampleReader example_reader(examples_rspecifier);
+
+      // We keep two minibatches in memory, so that the lattices of the next
+      // one can be prepared while we train on the current one.
+      if (!example_reader.Done()) {
+        egs[cur].Swap(&(example_reader.Value()));
+        example_reader.Next();
+        while (true) {
+          bool have_next = !example_reader.Done();
+          if (have_next) {
+            egs[1 - cur].Swap(&(example_reader.Value()));
+            example_reader.Next();
+            trainer.Prefetch(egs[1 - cur]);
+          }
+          trainer.Train(egs[cur]);
+          if (!have_next)
+            break;
+          cur = 1 - cur;
+        }
+      }
+
+      ok = trainer.PrintTotalStats();
+    }
 
 #if HAVE_CUDA==1
     CuDevice::Instantiate().PrintProfile();
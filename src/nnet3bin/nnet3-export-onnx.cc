@@ -0,0 +1,71 @@
+// nnet3bin/nnet3-export-onnx.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-export-onnx.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Export a 'raw' nnet3 neural network to the ONNX format, as a graph\n"
+        "that computes a fixed-size chunk of output frames (see\n"
+        "nnet3/nnet-export-onnx.h for what is supported).  The left and right\n"
+        "context of the model and the chunk size are written to the metadata\n"
+        "of the ONNX model.  To export an acoustic model, extract the raw\n"
+        "nnet with nnet3-am-copy --raw=true.\n"
+        "\n"
+        "Usage:  nnet3-export-onnx [options] <raw-nnet-in> <onnx-out>\n"
+        "e.g.:\n"
+        " nnet3-am-copy --raw=true final.mdl - | \\\n"
+        "   nnet3-export-onnx --frames-per-chunk=50 --frame-subsampling-factor=3 \\\n"
+        "   - final.onnx\n";
+
+    OnnxExportOptions opts;
+
+    ParseOptions po(usage);
+    opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string raw_nnet_rxfilename = po.GetArg(1),
+        onnx_wxfilename = po.GetArg(2);
+
+    Nnet nnet;
+    ReadKaldiObject(raw_nnet_rxfilename, &nnet);
+
+    Output ko(onnx_wxfilename, true, false);  // binary, no Kaldi header.
+    ExportNnetToOnnx(opts, nnet, ko.Stream());
+    ko.Close();
+    KALDI_LOG << "Exported nnet with " << nnet.NumComponents()
+              << " components to " << onnx_wxfilename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
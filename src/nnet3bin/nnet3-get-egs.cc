@@ -18,6 +18,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <memory>
 #include <sstream>
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
@@ -121,15 +122,23 @@ static bool ProcessFile(const GeneralMatrix &feats,
 
     eg.io.push_back(NnetIo("output", num_pdfs, 0, labels, frame_subsampling_factor));
 
-    if (compress)
-      eg.Compress();
-
     std::ostringstream os;
     os << utt_id << "-" << chunk.first_frame;
 
     std::string key = os.str(); // key is <utt_id>-<frame_id>
 
-    example_writer->Write(key, eg);
+    if (compress) {
+      // Compress as part of writing, so that with the "bg" wspecifier option
+      // it happens in the background.
+      std::shared_ptr<NnetExample> eg_ptr = std::make_shared<NnetExample>();
+      eg_ptr->Swap(&eg);
+      example_writer->WriteDeferred(key, [eg_ptr](NnetExample *out) {
+          out->Swap(eg_ptr.get());
+          out->Compress();
+        });
+    } else {
+      example_writer->Write(key, eg);
+    }
   }
   return true;
 }
@@ -222,6 +222,7 @@ int main(int argc, char *argv[]) {
 #if HAVE_CUDA==1
     CuDevice::Instantiate().PrintProfile();
 #endif
+    WriteNnetComputeProfile(compute_opts.compute_config);
 
     return (num_success != 0 ? 0 : 1);
   } catch(const std::exception &e) {
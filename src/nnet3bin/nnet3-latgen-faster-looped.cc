@@ -264,6 +264,8 @@ int main(int argc, char *argv[]) {
               << (tot_like / frame_count) << " over "
               << frame_count <<" frames.";
 
+    WriteNnetComputeProfile(decodable_opts.compute_config);
+
     delete word_syms;
     if (num_success != 0) return 0;
     else return 1;
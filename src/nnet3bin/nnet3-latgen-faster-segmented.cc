@@ -0,0 +1,549 @@
+// nnet3bin/nnet3-latgen-faster-segmented.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/timer.h"
+#include "base/kaldi-common.h"
+#include "decoder/lattice-faster-decoder.h"
+#include "fstext/fstext-lib.h"
+#include "hmm/transition-model.h"
+#include "lat/kaldi-lattice.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-utils.h"
+#include "util/kaldi-thread.h"
+#include "util/common-utils.h"
+
+
+namespace kaldi {
+
+// A piece of a long recording that is decoded on its own.  'begin' and 'end'
+// are the input frames that are decoded; 'own_begin' and 'own_end' are the
+// output frames (i.e. after frame subsampling) for which this segment's
+// best path is used in the stitched output.  The owned frames of consecutive
+// segments are adjacent, and the decoded frames extend beyond them on both
+// sides (except at the ends of the recording) by the overlap.
+struct LongRecordingSegment {
+  int32 begin;
+  int32 end;
+  int32 own_begin;
+  int32 own_end;
+};
+
+// Chooses the frame near 'nominal' (within 'max_shift') at which to split the
+// recording: the middle of the nearest run of non-speech frames according to
+// 'vad' (as output by compute-vad), or 'nominal' if there is none.
+static int32 ChooseCutFrame(const VectorBase<BaseFloat> &vad,
+                            int32 nominal, int32 max_shift) {
+  int32 num_frames = vad.Dim();
+  for (int32 shift = 0; shift <= max_shift; shift++) {
+    for (int32 sign = -1; sign <= 1; sign += 2) {
+      int32 t = nominal + sign * shift;
+      if (t <= 0 || t >= num_frames || vad(t) != 0.0)
+        continue;
+      int32 run_begin = t, run_end = t + 1;
+      while (run_begin > 0 && vad(run_begin - 1) == 0.0 &&
+             run_begin > nominal - max_shift)
+        run_begin--;
+      while (run_end < num_frames && vad(run_end) == 0.0 &&
+             run_end < nominal + max_shift)
+        run_end++;
+      return (run_begin + run_end) / 2;
+    }
+  }
+  return nominal;
+}
+
+// Splits a recording of 'num_frames' input frames into segments of about
+// 'segment_length' frames, which overlap by 'overlap' frames on each side.
+// The cuts are multiples of 'frame_quantum', which must be a multiple of the
+// frame subsampling factor 'subsampling' (and of the online-iVector period,
+// if any).  If 'vad' is non-NULL, the cuts are moved by up to 'max_shift'
+// frames to fall in non-speech.
+static void SplitLongRecording(int32 num_frames, int32 segment_length,
+                               int32 overlap, int32 max_shift,
+                               int32 frame_quantum, int32 subsampling,
+                               const VectorBase<BaseFloat> *vad,
+                               std::vector<LongRecordingSegment> *segments) {
+  KALDI_ASSERT(segment_length > 0 && overlap >= 0 &&
+               frame_quantum % subsampling == 0);
+  if (vad != NULL && vad->Dim() != num_frames)
+    KALDI_WARN << "VAD has " << vad->Dim() << " frames, features have "
+               << num_frames;
+  std::vector<int32> cuts(1, 0);
+  // Don't leave a last segment shorter than a quarter of the others.
+  while (num_frames - cuts.back() > segment_length + segment_length / 4) {
+    int32 cut = cuts.back() + segment_length;
+    if (vad != NULL && vad->Dim() == num_frames)
+      cut = ChooseCutFrame(*vad, cut, max_shift);
+    cut = (cut / frame_quantum) * frame_quantum;
+    if (cut <= cuts.back())
+      cut = cuts.back() + frame_quantum;
+    cuts.push_back(cut);
+  }
+  cuts.push_back(num_frames);
+
+  int32 num_output_frames = (num_frames + subsampling - 1) / subsampling;
+  segments->resize(cuts.size() - 1);
+  for (size_t i = 0; i + 1 < cuts.size(); i++) {
+    LongRecordingSegment &seg = (*segments)[i];
+    seg.begin = std::max<int32>(0, cuts[i] - overlap);
+    seg.begin -= seg.begin % frame_quantum;
+    seg.end = std::min<int32>(num_frames, cuts[i + 1] + overlap);
+    seg.own_begin = cuts[i] / subsampling;
+    seg.own_end = (i + 2 == cuts.size() ? num_output_frames :
+                   cuts[i + 1] / subsampling);
+  }
+}
+
+// Appends to 'out' (a linear lattice) the arcs of the linear lattice
+// 'best_path' of a segment whose first output frame is 'frame_offset' that
+// fall in the frames the segment owns; an arc with a word label but no
+// transition-id belongs to the frame of the next transition-id, so a word
+// goes to the segment in which it starts.  If 'last', the final-prob is
+// included.
+static void AppendOwnedArcs(const Lattice &best_path, int32 frame_offset,
+                            const LongRecordingSegment &seg, bool last,
+                            Lattice *out) {
+  typedef LatticeArc::StateId StateId;
+  if (out->Start() == fst::kNoStateId)
+    out->SetStart(out->AddState());
+  StateId out_state = out->NumStates() - 1;
+  StateId s = best_path.Start();
+  if (s == fst::kNoStateId)
+    return;
+  int32 t = frame_offset;
+  while (true) {
+    fst::ArcIterator<Lattice> aiter(best_path, s);
+    if (aiter.Done())
+      break;
+    const LatticeArc &arc = aiter.Value();
+    if (t >= seg.own_begin && t < seg.own_end) {
+      StateId next = out->AddState();
+      out->AddArc(out_state, LatticeArc(arc.ilabel, arc.olabel,
+                                        arc.weight, next));
+      out_state = next;
+    }
+    if (arc.ilabel != 0)
+      t++;
+    s = arc.nextstate;
+  }
+  if (last) {
+    LatticeWeight final_weight = best_path.Final(s);
+    out->SetFinal(out_state, final_weight == LatticeWeight::Zero() ?
+                  LatticeWeight::One() : final_weight);
+  }
+}
+
+// The data of one recording, shared between the tasks that decode its
+// segments; the task of the last segment stitches the results and writes
+// them out, and then deletes this.
+struct LongRecording {
+  std::string key;
+  Matrix<BaseFloat> features;
+  Vector<BaseFloat> ivector;  // empty if not used.
+  Matrix<BaseFloat> online_ivectors;  // empty if not used.
+  std::vector<LongRecordingSegment> segments;
+  std::vector<Lattice> best_paths;
+  std::vector<bool> reached_final;
+};
+
+// Options and outputs that are the same for all the tasks.
+struct SegmentDecodingInfo {
+  const nnet3::NnetSimpleComputationOptions *decodable_opts;
+  const TransitionModel *trans_model;
+  const nnet3::AmNnetSimple *am_nnet;
+  const fst::Fst<fst::StdArc> *decode_fst;
+  const LatticeFasterDecoderConfig *decoder_opts;
+  int32 online_ivector_period;
+  bool allow_partial;
+  const fst::SymbolTable *word_syms;
+  CompactLatticeWriter *lattice_writer;
+  Int32VectorWriter *words_writer;
+  Int32VectorWriter *alignment_writer;
+  double *tot_like;
+  int64 *frame_count;
+  int32 *num_success;
+  int32 *num_fail;
+};
+
+// Decodes one segment of a LongRecording, for use with TaskSequencer: the
+// decoding is done by operator(), in parallel with the other segments, and
+// the destructor (which TaskSequencer calls in order) of the task of the last
+// segment writes the stitched output.
+class DecodeSegmentTask {
+ public:
+  DecodeSegmentTask(const SegmentDecodingInfo &info, LongRecording *rec,
+                    int32 segment_index):
+      info_(info), rec_(rec), segment_index_(segment_index) { }
+
+  void operator () () {
+    const LongRecordingSegment &seg = rec_->segments[segment_index_];
+    SubMatrix<BaseFloat> feats(rec_->features, seg.begin,
+                               seg.end - seg.begin, 0,
+                               rec_->features.NumCols());
+    const Vector<BaseFloat> *ivector =
+        (rec_->ivector.Dim() != 0 ? &rec_->ivector : NULL);
+    Matrix<BaseFloat> online_ivectors;
+    if (rec_->online_ivectors.NumRows() != 0) {
+      // Segments begin at multiples of the period, see SplitLongRecording().
+      int32 period = info_.online_ivector_period,
+          first_row = std::min<int32>(seg.begin / period,
+                                      rec_->online_ivectors.NumRows() - 1),
+          num_rows = std::min<int32>(
+              (seg.end - seg.begin + period - 1) / period,
+              rec_->online_ivectors.NumRows() - first_row);
+      online_ivectors = rec_->online_ivectors.RowRange(first_row, num_rows);
+    }
+    nnet3::DecodableAmNnetSimpleParallel decodable(
+        *info_.decodable_opts, *info_.trans_model, *info_.am_nnet, feats,
+        ivector, (online_ivectors.NumRows() != 0 ? &online_ivectors : NULL),
+        info_.online_ivector_period);
+    LatticeFasterDecoder decoder(*info_.decode_fst, *info_.decoder_opts);
+    Lattice &best_path = rec_->best_paths[segment_index_];
+    if (decoder.Decode(&decodable)) {
+      rec_->reached_final[segment_index_] = decoder.ReachedFinal();
+      decoder.GetBestPath(&best_path, true);
+    }
+  }
+
+  ~DecodeSegmentTask() {
+    if (segment_index_ + 1 == static_cast<int32>(rec_->segments.size())) {
+      Stitch();
+      delete rec_;
+    }
+  }
+
+ private:
+  void Stitch() {
+    const std::string &key = rec_->key;
+    int32 num_segments = rec_->segments.size(),
+        subsampling = info_.decodable_opts->frame_subsampling_factor;
+    Lattice stitched;
+    for (int32 i = 0; i < num_segments; i++) {
+      if (rec_->best_paths[i].Start() == fst::kNoStateId) {
+        KALDI_WARN << "Failed to decode segment " << i << " of recording "
+                   << key;
+        (*info_.num_fail)++;
+        return;
+      }
+      bool last = (i + 1 == num_segments);
+      if (last && !rec_->reached_final[i]) {
+        if (info_.allow_partial) {
+          KALDI_WARN << "Outputting partial output for recording " << key
+                     << " since no final-state reached";
+        } else {
+          KALDI_WARN << "Not producing output for recording " << key
+                     << " since no final-state reached and "
+                     << "--allow-partial=false";
+          (*info_.num_fail)++;
+          return;
+        }
+      }
+      AppendOwnedArcs(rec_->best_paths[i],
+                      rec_->segments[i].begin / subsampling,
+                      rec_->segments[i], last, &stitched);
+    }
+    std::vector<int32> alignment, words;
+    LatticeWeight weight;
+    GetLinearSymbolSequence(stitched, &alignment, &words, &weight);
+    int32 num_frames = alignment.size();
+    if (info_.words_writer->IsOpen())
+      info_.words_writer->Write(key, words);
+    if (info_.alignment_writer->IsOpen())
+      info_.alignment_writer->Write(key, alignment);
+    if (info_.word_syms != NULL) {
+      std::cerr << key << ' ';
+      for (size_t i = 0; i < words.size(); i++) {
+        std::string s = info_.word_syms->Find(words[i]);
+        if (s == "")
+          KALDI_ERR << "Word-id " << words[i] << " not in symbol table.";
+        std::cerr << s << ' ';
+      }
+      std::cerr << '\n';
+    }
+    BaseFloat acoustic_scale = info_.decodable_opts->acoustic_scale;
+    BaseFloat like = -(weight.Value1() + weight.Value2() / acoustic_scale);
+    // The lattice has acoustic scaling in it; remove it.
+    fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
+                      &stitched);
+    CompactLattice clat;
+    ConvertLattice(stitched, &clat);
+    info_.lattice_writer->Write(key, clat);
+    KALDI_LOG << "Log-like per frame for recording " << key << " is "
+              << (like / num_frames) << " over " << num_frames
+              << " frames, in " << num_segments << " segments.";
+    *info_.tot_like += like;
+    *info_.frame_count += num_frames;
+    (*info_.num_success)++;
+  }
+
+  const SegmentDecodingInfo &info_;
+  LongRecording *rec_;
+  int32 segment_index_;
+};
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    using fst::SymbolTable;
+    using fst::Fst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Decode long recordings (e.g. hours long) using an nnet3 neural net\n"
+        "model, by splitting each one into overlapping segments that are\n"
+        "decoded in parallel threads, and stitching their best paths\n"
+        "together in the middle of the overlaps.  Where a VAD is given (from\n"
+        "compute-vad), the splits are moved into non-speech if possible.\n"
+        "Because lattices cannot in general be cut at a frame, the output\n"
+        "lattice is the stitched best path (a linear lattice).  Memory is\n"
+        "bounded by the segment length instead of the recording length.\n"
+        "\n"
+        "Usage: nnet3-latgen-faster-segmented [options] <nnet-in> <fst-in> "
+        "<features-rspecifier> <lattice-wspecifier> [ <words-wspecifier> "
+        "[<alignments-wspecifier>] ]\n"
+        "See also: nnet3-latgen-faster-parallel\n";
+    ParseOptions po(usage);
+
+    Timer timer;
+    bool allow_partial = false;
+    TaskSequencerConfig sequencer_config; // has --num-threads option
+    LatticeFasterDecoderConfig config;
+    NnetSimpleComputationOptions decodable_opts;
+    BaseFloat segment_length = 60.0, overlap = 5.0, max_boundary_shift = 10.0,
+        frame_shift = 0.01;
+
+    std::string word_syms_filename;
+    std::string ivector_rspecifier,
+        online_ivector_rspecifier,
+        utt2spk_rspecifier,
+        vad_rspecifier;
+    int32 online_ivector_period = 0;
+    sequencer_config.Register(&po);
+    config.Register(&po);
+    decodable_opts.Register(&po);
+    po.Register("word-symbol-table", &word_syms_filename,
+                "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial,
+                "If true, produce output even if end state was not reached.");
+    po.Register("segment-length", &segment_length,
+                "Length in seconds of the segments the recordings are split "
+                "into (not counting the overlaps).");
+    po.Register("overlap", &overlap,
+                "Seconds by which each segment extends into its neighbors; "
+                "the best path is taken from the segment whose own part a "
+                "frame is in, so this gives each decoder the context around "
+                "its own part.");
+    po.Register("max-boundary-shift", &max_boundary_shift,
+                "With --vad, the maximum number of seconds by which a split "
+                "point is moved to fall in non-speech.");
+    po.Register("frame-shift", &frame_shift,
+                "Frame shift of the features in seconds, used to convert the "
+                "options above into frames.");
+    po.Register("vad", &vad_rspecifier, "Rspecifier for per-frame voice "
+                "activity decisions (e.g. from compute-vad); if given, the "
+                "recordings are split in non-speech where possible.");
+    po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
+                "iVectors as vectors (i.e. not estimated online); per utterance "
+                "by default, or per speaker if you provide the --utt2spk option.");
+    po.Register("utt2spk", &utt2spk_rspecifier, "Rspecifier for "
+                "utt2spk option used to get ivectors per speaker");
+    po.Register("online-ivectors", &online_ivector_rspecifier, "Rspecifier for "
+                "iVectors estimated online, as matrices.  If you supply this,"
+                " you must set the --online-ivector-period option.");
+    po.Register("online-ivector-period", &online_ivector_period, "Number of frames "
+                "between iVectors in matrices supplied to the --online-ivectors "
+                "option");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 4 || po.NumArgs() > 6) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_str = po.GetArg(2),
+        feature_rspecifier = po.GetArg(3),
+        lattice_wspecifier = po.GetArg(4),
+        words_wspecifier = po.GetOptArg(5),
+        alignment_wspecifier = po.GetOptArg(6);
+
+    if (ClassifyRspecifier(fst_in_str, NULL, NULL) != kNoRspecifier)
+      KALDI_ERR << "This program needs a single FST, not a table of them.";
+    if (!config.determinize_lattice)
+      KALDI_WARN << "--determinize-lattice=false has no effect: the output "
+                 << "is a best path.";
+    if (segment_length <= 0.0 || overlap < 0.0 || frame_shift <= 0.0)
+      KALDI_ERR << "Invalid --segment-length, --overlap or --frame-shift "
+                << "option.";
+    if (!online_ivector_rspecifier.empty() && online_ivector_period <= 0)
+      KALDI_ERR << "You must set --online-ivector-period with "
+                << "--online-ivectors.";
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(model_in_filename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      CollapseModel(CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    CompactLatticeWriter compact_lattice_writer;
+    if (!compact_lattice_writer.Open(lattice_wspecifier))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    RandomAccessBaseFloatMatrixReader online_ivector_reader(
+        online_ivector_rspecifier);
+    RandomAccessBaseFloatVectorReaderMapped ivector_reader(
+        ivector_rspecifier, utt2spk_rspecifier);
+    RandomAccessBaseFloatVectorReader vad_reader(vad_rspecifier);
+
+    Int32VectorWriter words_writer(words_wspecifier);
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int32 num_success = 0, num_fail = 0;
+
+    // The cuts must be at whole output frames, and at whole online-iVector
+    // periods so the iVectors of a segment are a range of rows.
+    int32 subsampling = decodable_opts.frame_subsampling_factor,
+        frame_quantum = subsampling;
+    if (online_ivector_period > 0)
+      frame_quantum = Lcm(subsampling, online_ivector_period);
+    int32 segment_frames = static_cast<int32>(segment_length / frame_shift),
+        overlap_frames = static_cast<int32>(overlap / frame_shift),
+        max_shift_frames = static_cast<int32>(max_boundary_shift / frame_shift);
+    segment_frames = std::max(segment_frames, frame_quantum);
+
+    Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
+
+    SegmentDecodingInfo info;
+    info.decodable_opts = &decodable_opts;
+    info.trans_model = &trans_model;
+    info.am_nnet = &am_nnet;
+    info.decode_fst = decode_fst;
+    info.decoder_opts = &config;
+    info.online_ivector_period = online_ivector_period;
+    info.allow_partial = allow_partial;
+    info.word_syms = word_syms;
+    info.lattice_writer = &compact_lattice_writer;
+    info.words_writer = &words_writer;
+    info.alignment_writer = &alignment_writer;
+    info.tot_like = &tot_like;
+    info.frame_count = &frame_count;
+    info.num_success = &num_success;
+    info.num_fail = &num_fail;
+
+    timer.Reset();
+    {
+      TaskSequencer<DecodeSegmentTask> sequencer(sequencer_config);
+      SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+      for (; !feature_reader.Done(); feature_reader.Next()) {
+        std::string key = feature_reader.Key();
+        const Matrix<BaseFloat> &features (feature_reader.Value());
+        if (features.NumRows() == 0) {
+          KALDI_WARN << "Zero-length recording: " << key;
+          num_fail++;
+          continue;
+        }
+        LongRecording *rec = new LongRecording();
+        rec->key = key;
+        if (!ivector_rspecifier.empty()) {
+          if (!ivector_reader.HasKey(key)) {
+            KALDI_WARN << "No iVector available for recording " << key;
+            num_fail++;
+            delete rec;
+            continue;
+          }
+          rec->ivector = ivector_reader.Value(key);
+        }
+        if (!online_ivector_rspecifier.empty()) {
+          if (!online_ivector_reader.HasKey(key)) {
+            KALDI_WARN << "No online iVector available for recording " << key;
+            num_fail++;
+            delete rec;
+            continue;
+          }
+          rec->online_ivectors = online_ivector_reader.Value(key);
+        }
+        const Vector<BaseFloat> *vad = NULL;
+        if (!vad_rspecifier.empty()) {
+          if (vad_reader.HasKey(key))
+            vad = &vad_reader.Value(key);
+          else
+            KALDI_WARN << "No VAD available for recording " << key
+                       << ", splitting it without.";
+        }
+        rec->features = features;
+        SplitLongRecording(features.NumRows(), segment_frames, overlap_frames,
+                           max_shift_frames, frame_quantum, subsampling, vad,
+                           &rec->segments);
+        int32 num_segments = rec->segments.size();
+        rec->best_paths.resize(num_segments);
+        rec->reached_final.resize(num_segments, false);
+        KALDI_VLOG(1) << "Decoding recording " << key << " in "
+                      << num_segments << " segments.";
+        // After the last task is run, 'rec' may be deleted.
+        for (int32 i = 0; i < num_segments; i++)
+          sequencer.Run(new DecodeSegmentTask(info, rec, i));
+      }
+      sequencer.Wait(); // Waits for all tasks to be done.
+    }
+    delete decode_fst;
+
+    kaldi::int64 input_frame_count =
+        frame_count * decodable_opts.frame_subsampling_factor;
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken " << elapsed
+              << "s: real-time factor assuming 100 feature frames/sec is "
+              << (sequencer_config.num_threads * elapsed * 100.0 /
+                  input_frame_count);
+    KALDI_LOG << "Done " << num_success << " recordings, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is "
+              << (tot_like / frame_count) << " over "
+              << frame_count << " frames.";
+
+    WriteNnetComputeProfile(decodable_opts.compute_config);
+
+    delete word_syms;
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -26,8 +26,62 @@
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
 #include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/decodable-simple-looped.h"
 #include "nnet3/nnet-utils.h"
 #include "base/timer.h"
+#include "util/memory-budget.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Returns true if the looped computation (see decodable-simple-looped.h) would
+// give the same output as DecodableAmNnetSimple with options 'opts'.  This is
+// the case for non-recurrent models without any extra context, since then the
+// output only depends on the model's own context, which both decodables
+// provide in the same way (repeating the first and last frames at the edges).
+// The looped computation carries the activations of the previous chunk over to
+// the next one, so that the context frames shared by successive chunks are not
+// recomputed for each chunk.  We don't use it with online iVectors, because
+// it picks the iVector for each chunk differently.
+bool LoopedComputationIsEquivalent(const Nnet &nnet,
+                                   const NnetSimpleComputationOptions &opts,
+                                   bool online_ivectors) {
+  return !online_ivectors && opts.extra_left_context == 0 &&
+      opts.extra_right_context == 0 && opts.extra_left_context_initial <= 0 &&
+      opts.extra_right_context_final <= 0 && !NnetIsRecurrent(nnet);
+}
+
+// Returns a newly allocated decodable object for an utterance: a
+// DecodableAmNnetSimpleLooped if 'looped_info' is non-NULL, a
+// DecodableAmNnetSparseOutput if 'sparse_info' is non-NULL, else a
+// DecodableAmNnetSimple.
+DecodableInterface *NewNnetDecodable(
+    const NnetSimpleComputationOptions &opts,
+    const DecodableNnetSimpleLoopedInfo *looped_info,
+    const DecodableNnetSparseOutputInfo *sparse_info,
+    const TransitionModel &trans_model,
+    const AmNnetSimple &am_nnet,
+    const MatrixBase<BaseFloat> &features,
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period,
+    CachingOptimizingCompiler *compiler) {
+  if (looped_info != NULL)
+    return new DecodableAmNnetSimpleLooped(*looped_info, trans_model, features,
+                                           ivector, online_ivectors,
+                                           online_ivector_period);
+  else if (sparse_info != NULL)
+    return new DecodableAmNnetSparseOutput(*sparse_info, trans_model, features,
+                                           ivector, online_ivectors,
+                                           online_ivector_period);
+  else
+    return new DecodableAmNnetSimple(opts, trans_model, am_nnet, features,
+                                     ivector, online_ivectors,
+                                     online_ivector_period, compiler);
+}
+
+}  // namespace nnet3
+}  // namespace kaldi
 
 
 int main(int argc, char *argv[]) {
@@ -46,20 +100,26 @@ int main(int argc, char *argv[]) {
         "Generate lattices using nnet3 neural net model.\n"
         "Usage: nnet3-latgen-faster [options] <nnet-in> <fst-in|fsts-rspecifier> <features-rspecifier>"
         " <lattice-wspecifier> [ <words-wspecifier> [<alignments-wspecifier>] ]\n"
+        "<fst-in> may also be a CsrFst, as written by make-csr-fst.\n"
         "See also: nnet3-latgen-faster-parallel, nnet3-latgen-faster-batch\n";
     ParseOptions po(usage);
     Timer timer;
     bool allow_partial = false;
     LatticeFasterDecoderConfig config;
     NnetSimpleComputationOptions decodable_opts;
+    CpuAllocatorOptions cpu_allocator_opts;
 
     std::string word_syms_filename;
     std::string ivector_rspecifier,
         online_ivector_rspecifier,
         utt2spk_rspecifier;
     int32 online_ivector_period = 0;
+    BaseFloat memory_budget_mb = 0.0;
+    std::string looped = "auto";
+    bool sparse_output = false;
     config.Register(&po);
     decodable_opts.Register(&po);
+    cpu_allocator_opts.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
@@ -75,6 +135,25 @@ int main(int argc, char *argv[]) {
     po.Register("online-ivector-period", &online_ivector_period, "Number of frames "
                 "between iVectors in matrices supplied to the --online-ivectors "
                 "option");
+    po.Register("memory-budget", &memory_budget_mb,
+                "If > 0, the memory budget in megabytes for the decoder's tokens "
+                "and links, lattices being determinized and cached features; "
+                "while it is exceeded, the beam is reduced (see "
+                "--memory-min-beam-scale).");
+    po.Register("looped", &looped, "Whether to use 'looped' computation, "
+                "which carries the neural net's activations over from one "
+                "chunk to the next instead of recomputing the context frames "
+                "of each chunk: \"true\", \"false\" or \"auto\".  With "
+                "\"auto\" it is used when it gives the same output, i.e. for "
+                "non-recurrent models without extra context (or online "
+                "iVectors).  The chunk size is --frames-per-chunk, rounded up "
+                "to a multiple of the model's modulus.");
+    po.Register("sparse-output", &sparse_output, "If true, compute the "
+                "model's output layer only for the pdfs that the decoder "
+                "needs (see DecodableAmNnetSparseOutput).  If the model "
+                "ends in a log-softmax, the likelihoods differ by a constant "
+                "per frame, which does not affect the search or the lattice "
+                "posteriors.  Not compatible with --looped=true.");
 
     po.Read(argc, argv);
 
@@ -82,6 +161,8 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       exit(1);
     }
+    SetCpuAllocatorOptions(cpu_allocator_opts);
+    MemoryBudget::Global().SetLimit(memory_budget_mb * 1.0e+06);
 
     std::string model_in_filename = po.GetArg(1),
         fst_in_str = po.GetArg(2),
@@ -130,17 +211,58 @@ int main(int argc, char *argv[]) {
     // this compiler object allows caching of computations across
     // different utterances.
     CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
-                                       decodable_opts.optimize_config);
+                                       decodable_opts.optimize_config,
+                                       decodable_opts.compiler_config);
+
+    if (looped != "true" && looped != "false" && looped != "auto")
+      KALDI_ERR << "Invalid option --looped=" << looped;
+    if (sparse_output && looped == "true")
+      KALDI_ERR << "--sparse-output=true is not compatible with --looped=true";
+    bool use_looped = (looped == "true" ||
+                       (looped == "auto" && !sparse_output &&
+                        LoopedComputationIsEquivalent(
+                            am_nnet.GetNnet(), decodable_opts,
+                            !online_ivector_rspecifier.empty())));
+    NnetSimpleLoopedComputationOptions looped_opts;
+    DecodableNnetSimpleLoopedInfo *looped_info = NULL;
+    if (use_looped) {
+      looped_opts.extra_left_context_initial =
+          std::max<int32>(0, decodable_opts.extra_left_context_initial);
+      looped_opts.frame_subsampling_factor =
+          decodable_opts.frame_subsampling_factor;
+      looped_opts.frames_per_chunk = decodable_opts.frames_per_chunk;
+      looped_opts.acoustic_scale = decodable_opts.acoustic_scale;
+      looped_opts.debug_computation = decodable_opts.debug_computation;
+      looped_opts.optimize_config = decodable_opts.optimize_config;
+      looped_opts.compute_config = decodable_opts.compute_config;
+      looped_info = new DecodableNnetSimpleLoopedInfo(looped_opts, &am_nnet);
+      KALDI_LOG << "Using looped computation with "
+                << looped_info->frames_per_chunk << " frames per chunk.";
+    }
+    DecodableNnetSparseOutputInfo *sparse_info = NULL;
+    if (sparse_output)
+      sparse_info = new DecodableNnetSparseOutputInfo(decodable_opts, am_nnet);
 
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
       SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
 
-      // Input FST is just one FST, not a table of FSTs.
-      Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
+      // Input FST is just one FST, not a table of FSTs.  If it is a CsrFst
+      // (see make-csr-fst), it will be memory-mapped if possible.
+      Fst<StdArc> *decode_fst = NULL;
+      fst::CsrFst *csr_fst = NULL;
+      LatticeFasterDecoder *decoder = NULL;
+      LatticeFasterDecoderTpl<fst::CsrFst> *csr_decoder = NULL;
+      if (fst::IsCsrFstFile(fst_in_str)) {
+        csr_fst = fst::ReadCsrFstKaldi(fst_in_str);
+        csr_decoder = new LatticeFasterDecoderTpl<fst::CsrFst>(*csr_fst,
+                                                              config);
+      } else {
+        decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
+        decoder = new LatticeFasterDecoder(*decode_fst, config);
+      }
       timer.Reset();
 
       {
-        LatticeFasterDecoder decoder(*decode_fst, config);
 
         for (; !feature_reader.Done(); feature_reader.Next()) {
           std::string utt = feature_reader.Key();
@@ -171,25 +293,36 @@ int main(int argc, char *argv[]) {
             }
           }
 
-          DecodableAmNnetSimple nnet_decodable(
-              decodable_opts, trans_model, am_nnet,
+          DecodableInterface *nnet_decodable = NewNnetDecodable(
+              decodable_opts, looped_info, sparse_info, trans_model, am_nnet,
               features, ivector, online_ivectors,
               online_ivector_period, &compiler);
 
           double like;
-          if (DecodeUtteranceLatticeFaster(
-                  decoder, nnet_decodable, trans_model, word_syms, utt,
-                  decodable_opts.acoustic_scale, determinize, allow_partial,
-                  &alignment_writer, &words_writer, &compact_lattice_writer,
-                  &lattice_writer,
-                  &like)) {
+          bool ans = (csr_decoder != NULL ?
+                      DecodeUtteranceLatticeFaster(
+                          *csr_decoder, *nnet_decodable, trans_model, word_syms,
+                          utt, decodable_opts.acoustic_scale, determinize,
+                          allow_partial, &alignment_writer, &words_writer,
+                          &compact_lattice_writer, &lattice_writer, &like) :
+                      DecodeUtteranceLatticeFaster(
+                          *decoder, *nnet_decodable, trans_model, word_syms,
+                          utt, decodable_opts.acoustic_scale, determinize,
+                          allow_partial, &alignment_writer, &words_writer,
+                          &compact_lattice_writer, &lattice_writer, &like));
+          if (ans) {
             tot_like += like;
-            frame_count += nnet_decodable.NumFramesReady();
+            frame_count += nnet_decodable->NumFramesReady();
             num_success++;
           } else num_fail++;
+          delete nnet_decodable;
         }
       }
-      delete decode_fst; // delete this only after decoder goes out of scope.
+      // delete the FSTs only after the decoders.
+      delete decoder;
+      delete csr_decoder;
+      delete decode_fst;
+      delete csr_fst;
     } else { // We have different FSTs for different utterances.
       SequentialTableReader<fst::VectorFstHolder> fst_reader(fst_in_str);
       RandomAccessBaseFloatMatrixReader feature_reader(feature_rspecifier);
@@ -231,21 +364,22 @@ int main(int argc, char *argv[]) {
           }
         }
 
-        DecodableAmNnetSimple nnet_decodable(
-            decodable_opts, trans_model, am_nnet,
+        DecodableInterface *nnet_decodable = NewNnetDecodable(
+            decodable_opts, looped_info, sparse_info, trans_model, am_nnet,
             features, ivector, online_ivectors,
             online_ivector_period, &compiler);
 
         double like;
         if (DecodeUtteranceLatticeFaster(
-                decoder, nnet_decodable, trans_model, word_syms, utt,
+                decoder, *nnet_decodable, trans_model, word_syms, utt,
                 decodable_opts.acoustic_scale, determinize, allow_partial,
                 &alignment_writer, &words_writer, &compact_lattice_writer,
                 &lattice_writer, &like)) {
           tot_like += like;
-          frame_count += nnet_decodable.NumFramesReady();
+          frame_count += nnet_decodable->NumFramesReady();
           num_success++;
         } else num_fail++;
+        delete nnet_decodable;
       }
     }
 
@@ -261,7 +395,13 @@ int main(int argc, char *argv[]) {
     KALDI_LOG << "Overall log-likelihood per frame is "
               << (tot_like / frame_count) << " over "
               << frame_count << " frames.";
+    if (cpu_allocator_opts.cache_memory)
+      PrintCpuMemoryUsage();
+
+    WriteNnetComputeProfile(decodable_opts.compute_config);
 
+    delete looped_info;
+    delete sparse_info;
     delete word_syms;
     if (num_success != 0) return 0;
     else return 1;
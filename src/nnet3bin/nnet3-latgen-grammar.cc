@@ -55,7 +55,7 @@ int main(int argc, char *argv[]) {
     LatticeFasterDecoderConfig config;
     NnetSimpleComputationOptions decodable_opts;
 
-    std::string word_syms_filename;
+    std::string word_syms_filename, expansions_rxfilename;
     std::string ivector_rspecifier,
         online_ivector_rspecifier,
         utt2spk_rspecifier;
@@ -64,6 +64,10 @@ int main(int argc, char *argv[]) {
     decodable_opts.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
+    po.Register("expansions", &expansions_rxfilename, "File containing "
+                "expanded states of the GrammarFst, as written by "
+                "make-grammar-fst-expansions (optional; saves time when "
+                "decoding the first utterances).");
     po.Register("allow-partial", &allow_partial,
                 "If true, produce output even if end state was not reached.");
     po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
@@ -132,12 +136,18 @@ int main(int argc, char *argv[]) {
     // this compiler object allows caching of computations across
     // different utterances.
     CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
-                                       decodable_opts.optimize_config);
+                                       decodable_opts.optimize_config,
+                                       decodable_opts.compiler_config);
 
     SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
 
     fst::GrammarFst fst;
     ReadKaldiObject(grammar_fst_rxfilename, &fst);
+    if (!expansions_rxfilename.empty()) {
+      bool binary;
+      Input ki(expansions_rxfilename, &binary);
+      fst.ReadExpansions(ki.Stream(), binary);
+    }
     timer.Reset();
 
     {
@@ -0,0 +1,90 @@
+// nnet3bin/nnet3-quantize.cc
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-utils.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Convert the affine, linear and TDNN components of an nnet3 model to\n"
+        "versions with 8-bit quantized parameters, for faster decoding on the\n"
+        "CPU (see QuantizeNnet() in nnet3/nnet-utils.h).  The model should\n"
+        "already be prepared for test (e.g. by nnet3-am-copy\n"
+        "--prepare-for-test=true); the output can no longer be trained.\n"
+        "\n"
+        "Usage:  nnet3-quantize [options] <model-in> <model-out>\n"
+        "e.g.:\n"
+        " nnet3-quantize final.mdl final_int8.mdl\n"
+        " nnet3-quantize --raw=true final.raw final_int8.raw\n";
+
+    bool binary_write = true,
+        raw = false;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    po.Register("raw", &raw, "If true, the input and output are 'raw' neural "
+                "nets, without the transition model and priors.");
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string nnet_rxfilename = po.GetArg(1),
+        nnet_wxfilename = po.GetArg(2);
+
+    int32 num_quantized;
+    if (raw) {
+      Nnet nnet;
+      ReadKaldiObject(nnet_rxfilename, &nnet);
+      num_quantized = QuantizeNnet(&nnet);
+      WriteKaldiObject(nnet, nnet_wxfilename, binary_write);
+    } else {
+      TransitionModel trans_model;
+      AmNnetSimple am_nnet;
+      {
+        bool binary;
+        Input ki(nnet_rxfilename, &binary);
+        trans_model.Read(ki.Stream(), binary);
+        am_nnet.Read(ki.Stream(), binary);
+      }
+      num_quantized = QuantizeNnet(&(am_nnet.GetNnet()));
+      Output ko(nnet_wxfilename, binary_write);
+      trans_model.Write(ko.Stream(), binary_write);
+      am_nnet.Write(ko.Stream(), binary_write);
+    }
+    KALDI_LOG << "Quantized " << num_quantized << " components of "
+              << nnet_rxfilename << ", wrote to " << nnet_wxfilename;
+    if (num_quantized == 0)
+      KALDI_WARN << "No components were quantized.";
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
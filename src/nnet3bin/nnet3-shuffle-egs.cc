@@ -22,6 +22,7 @@
 #include "util/common-utils.h"
 #include "hmm/transition-model.h"
 #include "nnet3/nnet-example.h"
+#include "util/table-shuffle.h"
 
 int main(int argc, char *argv[]) {
   try {
@@ -34,7 +35,8 @@ int main(int argc, char *argv[]) {
         "Copy examples (typically single frames or small groups of frames) for\n"
         "neural network training, from the input to output, but randomly shuffle the order.\n"
         "This program will keep all of the examples in memory at once, unless you\n"
-        "use the --buffer-size option\n"
+        "use the --buffer-size option,\n"
+        "or do full randomization with bounded memory using --shuffle-dir.\n"
         "\n"
         "Usage:  nnet3-shuffle-egs [options] <egs-rspecifier> <egs-wspecifier>\n"
         "\n"
@@ -47,6 +49,8 @@ int main(int argc, char *argv[]) {
     po.Register("buffer-size", &buffer_size, "If >0, size of a buffer we use "
                 "to do limited-memory partial randomization.  Otherwise, do "
                 "full randomization.");
+    TableShuffleOptions shuffle_opts;
+    shuffle_opts.Register(&po);
 
     po.Read(argc, argv);
 
@@ -56,6 +60,8 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       exit(1);
     }
+    if (buffer_size != 0 && !shuffle_opts.dir.empty())
+      KALDI_ERR << "--buffer-size and --shuffle-dir cannot both be set.";
 
     std::string examples_rspecifier = po.GetArg(1),
         examples_wspecifier = po.GetArg(2);
@@ -66,7 +72,13 @@ int main(int argc, char *argv[]) {
 
     SequentialNnetExampleReader example_reader(examples_rspecifier);
     NnetExampleWriter example_writer(examples_wspecifier);
-    if (buffer_size == 0) { // Do full randomization
+    if (!shuffle_opts.dir.empty()) {
+      // Full randomization via temporary files in --shuffle-dir.
+      TableShuffler<KaldiObjectHolder<NnetExample> > shuffler(shuffle_opts);
+      for (; !example_reader.Done(); example_reader.Next())
+        shuffler.Accept(example_reader.Key(), example_reader.Value());
+      num_done = shuffler.Output(&example_writer);
+    } else if (buffer_size == 0) { // Do full randomization
       // Putting in an extra level of indirection here to avoid excessive
       // computation and memory demands when we have to resize the vector.
 
@@ -0,0 +1,101 @@
+// nnet3bin/nnet3-sparsify.cc
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-utils.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Convert the affine and linear components of an nnet3 model whose\n"
+        "parameters are mostly zero (e.g. after pruning) to versions with\n"
+        "sparse parameters, which are faster at test time (see SparsifyNnet()\n"
+        "in nnet3/nnet-utils.h).  Parameters whose absolute value is at most\n"
+        "--prune-threshold are set to zero first.  The output can no longer\n"
+        "be trained.\n"
+        "\n"
+        "Usage:  nnet3-sparsify [options] <model-in> <model-out>\n"
+        "e.g.:\n"
+        " nnet3-sparsify --prune-threshold=0.01 final.mdl final_sparse.mdl\n"
+        " nnet3-sparsify --raw=true final.raw final_sparse.raw\n";
+
+    bool binary_write = true,
+        raw = false;
+    BaseFloat prune_threshold = 0.0,
+        min_sparsity = 0.75;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    po.Register("raw", &raw, "If true, the input and output are 'raw' neural "
+                "nets, without the transition model and priors.");
+    po.Register("prune-threshold", &prune_threshold, "Linear parameters whose "
+                "absolute value is less than or equal to this are set to "
+                "zero.");
+    po.Register("min-sparsity", &min_sparsity, "A component is converted only "
+                "if at least this proportion of its linear parameters is zero "
+                "(after pruning); for denser matrices the dense multiplication "
+                "is faster.");
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string nnet_rxfilename = po.GetArg(1),
+        nnet_wxfilename = po.GetArg(2);
+
+    int32 num_sparsified;
+    if (raw) {
+      Nnet nnet;
+      ReadKaldiObject(nnet_rxfilename, &nnet);
+      num_sparsified = SparsifyNnet(prune_threshold, min_sparsity, &nnet);
+      WriteKaldiObject(nnet, nnet_wxfilename, binary_write);
+    } else {
+      TransitionModel trans_model;
+      AmNnetSimple am_nnet;
+      {
+        bool binary;
+        Input ki(nnet_rxfilename, &binary);
+        trans_model.Read(ki.Stream(), binary);
+        am_nnet.Read(ki.Stream(), binary);
+      }
+      num_sparsified = SparsifyNnet(prune_threshold, min_sparsity,
+                                    &(am_nnet.GetNnet()));
+      Output ko(nnet_wxfilename, binary_write);
+      trans_model.Write(ko.Stream(), binary_write);
+      am_nnet.Write(ko.Stream(), binary_write);
+    }
+    KALDI_LOG << "Sparsified " << num_sparsified << " components of "
+              << nnet_rxfilename << ", wrote to " << nnet_wxfilename;
+    if (num_sparsified == 0)
+      KALDI_WARN << "No components were sparse enough to convert.";
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -54,6 +54,9 @@ int main(int argc, char *argv[]) {
 
     train_config.Register(&po);
     RegisterCuAllocatorOptions(&po);
+#if HAVE_CUDA==1
+    CuDevice::RegisterDeviceOptions(&po);
+#endif
 
     po.Read(argc, argv);
 
@@ -87,6 +90,7 @@ int main(int argc, char *argv[]) {
 #if HAVE_CUDA==1
     CuDevice::Instantiate().PrintProfile();
 #endif
+    WriteNnetComputeProfile(train_config.compute_config);
     WriteKaldiObject(nnet, nnet_wxfilename, binary_write);
     KALDI_LOG << "Wrote model to " << nnet_wxfilename;
     return (ok ? 0 : 1);
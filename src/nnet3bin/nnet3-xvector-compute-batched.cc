@@ -21,6 +21,9 @@
 // limitations under the License.
 
 
+#include <deque>
+#include <iomanip>
+
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "nnet3/nnet-am-decodable-simple.h"
@@ -35,6 +38,9 @@ struct BatchedXvectorComputerOptions {
   int32 chunk_size { 150 };
   int32 batch_size { 32 };
   bool pad_input { true };
+  int32 window_size { 0 };
+  int32 window_shift { 75 };
+  int32 frames_per_chunk { 1000 };
   NnetComputeOptions compute_config;
   NnetOptimizeOptions optimize_config;
   CachingOptimizingCompilerOptions compiler_config;
@@ -50,6 +56,20 @@ struct BatchedXvectorComputerOptions {
     po->Register("pad-input", &pad_input,
                  "If true, for utterances shorter than `chunk-size` frames "
                  "we will pad with repeats of the last frame.");
+    po->Register("window-size", &window_size,
+                 "If >0, extract an xvector for each window of this many "
+                 "frames, shifted by --window-shift, instead of one per "
+                 "utterance (e.g. for diarization).  The frame-level layers "
+                 "are then computed once per utterance and only the layers "
+                 "from the statistics pooling onward are computed per "
+                 "window.  The xvectors are written with keys "
+                 "<utt>-<start-frame>-<end-frame>.");
+    po->Register("window-shift", &window_shift,
+                 "In the --window-size mode, the shift between windows, in "
+                 "frames.");
+    po->Register("frames-per-chunk", &frames_per_chunk,
+                 "In the --window-size mode, the number of frames per chunk "
+                 "with which the frame-level layers are computed.");
     compute_config.Register(po);
     optimize_config.Register(po);
     compiler_config.Register(po);
@@ -518,6 +538,375 @@ void BatchedXvectorComputer::SplitUtteranceIntoChunks(
 }
 
 
+/**
+   Splits an xvector network into the frame-level layers, which are those
+   that come before its StatisticsExtractionComponent, and the rest.
+   'frame_nnet' will have the same input as 'nnet' and an output node
+   "output" that is the input to the statistics extraction; 'segment_nnet'
+   will have an input node "input" that takes that output, and the same
+   output as 'nnet'.
+*/
+void SplitXvectorNnet(const Nnet &nnet, Nnet *frame_nnet, Nnet *segment_nnet) {
+  int32 extraction_node = -1;
+  for (int32 n = 0; n < nnet.NumNodes(); n++) {
+    if (nnet.IsComponentNode(n) &&
+        nnet.GetComponent(nnet.GetNode(n).u.component_index)->Type() ==
+        "StatisticsExtractionComponent") {
+      if (extraction_node != -1)
+        KALDI_ERR << "The --window-size option requires a network with "
+                  << "exactly one StatisticsExtractionComponent.";
+      extraction_node = n;
+    }
+  }
+  if (extraction_node == -1)
+    KALDI_ERR << "The --window-size option requires a network with "
+              << "a StatisticsExtractionComponent.";
+  // The input of a component node is the descriptor node just before it.
+  std::ostringstream extraction_input;
+  nnet.GetNode(extraction_node - 1).descriptor.WriteConfig(
+      extraction_input, nnet.GetNodeNames());
+
+  *frame_nnet = nnet;
+  {
+    std::istringstream config("output-node name=output input=" +
+                              extraction_input.str() + "\n");
+    frame_nnet->ReadConfig(config);
+    std::istringstream edit_config("remove-orphans\n");
+    ReadEditConfig(edit_config, frame_nnet);
+  }
+
+  *segment_nnet = nnet;
+  {
+    std::ostringstream config;
+    config << "input-node name=frame-level dim="
+           << frame_nnet->OutputDim("output") << "\n"
+           << "component-node name=" << nnet.GetNodeName(extraction_node)
+           << " component=" << nnet.GetComponentName(
+               nnet.GetNode(extraction_node).u.component_index)
+           << " input=frame-level\n";
+    std::istringstream is(config.str());
+    segment_nnet->ReadConfig(is);
+    std::istringstream edit_config(
+        "remove-orphans remove-orphan-inputs=true\n"
+        "rename-node old-name=frame-level new-name=input\n");
+    ReadEditConfig(edit_config, segment_nnet);
+  }
+}
+
+
+/**
+   This class does the same job as BatchedXvectorComputer, but in the
+   sliding-window mode (--window-size > 0) where we want an xvector for each of
+   many overlapping windows of each utterance.  The frame-level layers of the
+   network (see SplitXvectorNnet()) are computed once per utterance, in chunks,
+   and the rest of the network is computed for batches of windows of their
+   output.  Since the frame-level outputs are computed over the whole
+   utterance, the windows do not lose any frames to the context of the
+   frame-level layers.
+ */
+class SlidingXvectorComputer {
+ public:
+  /**
+       @param [in]  opts  Options class; warning, it keeps a reference to it.
+       @param [in]  nnet  The neural net we'll be computing with; assumed to have
+                          already been prepared for test.
+   */
+  SlidingXvectorComputer(const BatchedXvectorComputerOptions &opts,
+                         const Nnet &nnet);
+
+  ~SlidingXvectorComputer();
+
+  /**
+     Accepts an utterance, and computes the frame-level outputs for its
+     windows, processing batches of windows as they become full.
+   */
+  void AcceptUtterance(const std::string &utt,
+                       const Matrix<BaseFloat> &input);
+
+  /// Returns true if at least one xvector is pending output.
+  bool XvectorReady() const { return !results_.empty(); }
+
+  /**
+     Outputs the xvector for a window, which must only be called if
+     XvectorReady() has just returned true.  The key is of the form
+     <utt>-<start-frame>-<end-frame>, with the frames zero-padded to seven
+     digits, and the windows are output in order.
+   */
+  void OutputXvector(std::string *key,
+                     Vector<BaseFloat> *xvector);
+
+  /// Computes any partial batch of windows.
+  void Flush();
+
+ private:
+  /// Outputs the start frames of the windows of an utterance with
+  /// 'num_frames' frames: every opts_.window_shift frames, plus one at the
+  /// end of the utterance if needed to cover the last frames.
+  void GetWindowStarts(int32 num_frames, std::vector<int32> *starts) const;
+
+  /// Adds a window to the batch.  'frames' holds the frame-level outputs as
+  /// a circular buffer, i.e. frame t is in row t % frames.NumRows(); the
+  /// window is the frames.NumRows() frames starting at frame 'start'.
+  void AddWindowToBatch(const std::string &key,
+                        const Matrix<BaseFloat> &frames,
+                        int32 start);
+
+  /// Does the computation for the current batch.
+  void ComputeOneBatch();
+
+  /// Compiles the computation for 'num_windows' windows of 'window_size'
+  /// frames, whose input is interleaved as in input_frames_.
+  std::shared_ptr<const NnetComputation> CompileWindows(int32 num_windows,
+                                                        int32 window_size);
+
+  /// Runs 'computation' with input 'input', and adds the xvectors of the
+  /// first keys.size() windows to results_.
+  void RunComputation(const NnetComputation &computation,
+                      const Matrix<BaseFloat> &input,
+                      const std::vector<std::string> &keys);
+
+  const BatchedXvectorComputerOptions &opts_;
+  // The frame-level layers of the network.
+  Nnet frame_nnet_;
+  // The layers from the statistics extraction onward.
+  Nnet segment_nnet_;
+  NnetSimpleComputationOptions frame_opts_;
+  CachingOptimizingCompiler *frame_compiler_;
+  CachingOptimizingCompiler *segment_compiler_;
+  int32 frame_dim_;
+
+  /** The computation for a full batch of windows of opts_.window_size
+      frames.  */
+  std::shared_ptr<const NnetComputation> batch_computation_;
+
+  /** Staging area for the frame-level outputs of a batch of windows;
+      dimension is opts_.window_size * opts_.batch_size by frame_dim_, and the
+      windows are interleaved like the chunks of BatchedXvectorComputer.  */
+  Matrix<BaseFloat> input_frames_;
+  /// The keys of the windows in the current batch.
+  std::vector<std::string> keys_this_batch_;
+
+  /// The computed xvectors that have not been output yet, in order.
+  std::deque<std::pair<std::string, Vector<BaseFloat> > > results_;
+};
+
+
+SlidingXvectorComputer::SlidingXvectorComputer(
+    const BatchedXvectorComputerOptions &opts,
+    const Nnet &nnet):
+    opts_(opts) {
+  KALDI_ASSERT(opts_.window_size > 0 && opts_.window_shift > 0 &&
+               opts_.batch_size > 0);
+  SplitXvectorNnet(nnet, &frame_nnet_, &segment_nnet_);
+  frame_dim_ = frame_nnet_.OutputDim("output");
+  frame_opts_.frames_per_chunk = opts_.frames_per_chunk;
+  frame_opts_.acoustic_scale = 1.0;
+  frame_opts_.optimize_config = opts_.optimize_config;
+  frame_opts_.compute_config = opts_.compute_config;
+  frame_compiler_ = new CachingOptimizingCompiler(
+      frame_nnet_, opts_.optimize_config, opts_.compiler_config);
+  segment_compiler_ = new CachingOptimizingCompiler(
+      segment_nnet_, opts_.optimize_config, opts_.compiler_config);
+  // Zero input_frames_ in case the last batch is partial, to avoid NaN's
+  // being generated due to undefined data.
+  input_frames_.Resize(opts_.window_size * opts_.batch_size, frame_dim_);
+  batch_computation_ = CompileWindows(opts_.batch_size, opts_.window_size);
+}
+
+SlidingXvectorComputer::~SlidingXvectorComputer() {
+  delete frame_compiler_;
+  delete segment_compiler_;
+}
+
+std::shared_ptr<const NnetComputation> SlidingXvectorComputer::CompileWindows(
+    int32 num_windows, int32 window_size) {
+  ComputationRequest request;
+  request.need_model_derivative = false;
+  request.store_component_stats = false;
+  request.inputs.resize(1);
+  IoSpecification &input(request.inputs[0]);
+  input.name = "input";
+  input.has_deriv = false;
+  input.indexes.resize(num_windows * window_size);
+  for (int32 n = 0; n < num_windows; n++) {
+    for (int32 t = 0; t < window_size; t++) {
+      Index index;
+      index.n = n;
+      index.t = t;
+      input.indexes[n + num_windows * t] = index;
+    }
+  }
+  IoSpecification output;
+  output.name = "output";
+  output.has_deriv = false;
+  output.indexes.resize(num_windows);
+  for (int32 n = 0; n < num_windows; n++) {
+    Index index;
+    index.n = n;
+    index.t = 0;
+    output.indexes[n] = index;
+  }
+  request.outputs.push_back(output);
+  return segment_compiler_->Compile(request);
+}
+
+void SlidingXvectorComputer::GetWindowStarts(
+    int32 num_frames, std::vector<int32> *starts) const {
+  starts->clear();
+  int32 window_size = std::min(opts_.window_size, num_frames);
+  int32 start = 0;
+  for (; start + window_size <= num_frames; start += opts_.window_shift)
+    starts->push_back(start);
+  if (starts->back() + window_size < num_frames)
+    starts->push_back(num_frames - window_size);
+}
+
+void SlidingXvectorComputer::AcceptUtterance(
+    const std::string &utt,
+    const Matrix<BaseFloat> &input) {
+  int32 num_frames = input.NumRows(),
+      window_size = std::min(opts_.window_size, num_frames);
+  if (window_size < opts_.window_size && !opts_.pad_input) {
+    KALDI_WARN << "Utterance " << utt << " has " << num_frames
+               << " frames, less than --window-size=" << opts_.window_size
+               << "; not computing xvectors for it.";
+    return;
+  }
+  // Note: at the edges of the utterance, DecodableNnetSimple provides the
+  // context of the frame-level layers by repeating the first or last frame.
+  Vector<BaseFloat> priors;
+  DecodableNnetSimple decodable(frame_opts_, frame_nnet_, priors, input,
+                                frame_compiler_);
+  Matrix<BaseFloat> frames(window_size, frame_dim_, kUndefined);
+  std::vector<int32> starts;
+  GetWindowStarts(num_frames, &starts);
+  // The windows start at increasing frames, so each one only needs frames
+  // that are among the last 'window_size' computed.
+  int32 num_frames_computed = 0;
+  for (size_t i = 0; i < starts.size(); i++) {
+    int32 start = starts[i], end = start + window_size;
+    for (; num_frames_computed < end; num_frames_computed++) {
+      SubVector<BaseFloat> frame(frames, num_frames_computed % window_size);
+      decodable.GetOutputForFrame(num_frames_computed, &frame);
+    }
+    std::ostringstream key;
+    key << utt << '-' << std::setfill('0') << std::setw(7) << start
+        << '-' << std::setw(7) << end;
+    if (window_size == opts_.window_size) {
+      AddWindowToBatch(key.str(), frames, start);
+      if (static_cast<int32>(keys_this_batch_.size()) == opts_.batch_size)
+        ComputeOneBatch();
+    } else {
+      // A single short window, for an utterance shorter than the window
+      // size; compute it by itself, after the windows before it.
+      Flush();
+      std::vector<std::string> keys(1, key.str());
+      RunComputation(*CompileWindows(1, window_size), frames, keys);
+    }
+  }
+}
+
+void SlidingXvectorComputer::AddWindowToBatch(
+    const std::string &key,
+    const Matrix<BaseFloat> &frames,
+    int32 start) {
+  int32 n = keys_this_batch_.size(),
+      window_size = frames.NumRows();
+  KALDI_ASSERT(n < opts_.batch_size && window_size == opts_.window_size);
+  keys_this_batch_.push_back(key);
+  for (int32 t = 0; t < window_size; t++) {
+    SubVector<BaseFloat> dest(input_frames_, t * opts_.batch_size + n);
+    dest.CopyFromVec(frames.Row((start + t) % window_size));
+  }
+}
+
+void SlidingXvectorComputer::RunComputation(
+    const NnetComputation &computation,
+    const Matrix<BaseFloat> &input,
+    const std::vector<std::string> &keys) {
+  CuMatrix<BaseFloat> cu_input(input);
+  Nnet *nnet_to_update = NULL;  // we're not doing any update.
+  NnetComputer computer(opts_.compute_config, computation,
+                        segment_nnet_, nnet_to_update);
+  computer.AcceptInput("input", &cu_input);
+  computer.Run();
+  CuMatrix<BaseFloat> cu_output;
+  computer.GetOutputDestructive("output", &cu_output);
+  Matrix<BaseFloat> output(cu_output);
+  KALDI_ASSERT(output.NumRows() >= static_cast<int32>(keys.size()));
+  for (size_t n = 0; n < keys.size(); n++) {
+    results_.push_back(std::pair<std::string, Vector<BaseFloat> >(
+        keys[n], Vector<BaseFloat>()));
+    results_.back().second = output.Row(n);
+  }
+}
+
+void SlidingXvectorComputer::ComputeOneBatch() {
+  RunComputation(*batch_computation_, input_frames_, keys_this_batch_);
+  keys_this_batch_.clear();
+}
+
+void SlidingXvectorComputer::Flush() {
+  if (!keys_this_batch_.empty())
+    ComputeOneBatch();
+}
+
+void SlidingXvectorComputer::OutputXvector(std::string *key,
+                                           Vector<BaseFloat> *xvector) {
+  KALDI_ASSERT(XvectorReady());
+  key->swap(results_.front().first);
+  xvector->Swap(&(results_.front().second));
+  results_.pop_front();
+}
+
+
+/**
+   Reads the utterances, computes their xvectors with 'computer' (of type
+   BatchedXvectorComputer or SlidingXvectorComputer) and writes them.
+ */
+template <class XvectorComputer>
+void ComputeXvectors(const std::string &feature_rspecifier,
+                     const std::string &vector_wspecifier,
+                     XvectorComputer *computer,
+                     int32 *num_utts_read,
+                     int32 *num_xvectors_written,
+                     int64 *frame_count) {
+  BaseFloatVectorWriter vector_writer(vector_wspecifier);
+  SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+
+  for (; !feature_reader.Done(); feature_reader.Next()) {
+    std::string utt = feature_reader.Key();
+    const Matrix<BaseFloat> &features (feature_reader.Value());
+    if (features.NumRows() == 0) {
+      KALDI_WARN << "Zero-length utterance: " << utt;
+      continue;
+    }
+
+    *frame_count += features.NumRows();
+
+    computer->AcceptUtterance(utt, features);
+    (*num_utts_read)++;
+
+    while (computer->XvectorReady()) {
+      std::string utt;
+      Vector<BaseFloat> xvector;
+      computer->OutputXvector(&utt, &xvector);
+      vector_writer.Write(utt, xvector);
+      (*num_xvectors_written)++;
+    }
+  }
+
+  computer->Flush();
+  while (computer->XvectorReady()) {
+    std::string utt;
+    Vector<BaseFloat> xvector;
+    computer->OutputXvector(&utt, &xvector);
+    vector_writer.Write(utt, xvector);
+    (*num_xvectors_written)++;
+  }
+}
+
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -540,7 +929,9 @@ int main(int argc, char *argv[]) {
         "output layer after the statistics pooling layer.  By default, one\n"
         "xvector is extracted directly from the set of features for each\n"
         "utterance.  Optionally, xvectors are extracted from chunks of input\n"
-        "features and averaged, to produce a single vector.\n"
+        "features and averaged, to produce a single vector.  With\n"
+        "--window-size, an xvector is instead extracted for each of a sequence\n"
+        "of overlapping windows of each utterance, e.g. for diarization.\n"
         "\n"
         "Usage: nnet3-xvector-compute [options] <raw-nnet-in> "
         "<features-rspecifier> <vector-wspecifier>\n"
@@ -600,46 +991,19 @@ int main(int argc, char *argv[]) {
       total_context = left_context + right_context;
     }
 
-    BatchedXvectorComputer computer(opts, nnet, total_context);
-    BaseFloatVectorWriter vector_writer(vector_wspecifier);
-
     int32 num_utts_read = 0, num_xvectors_written = 0;
     int64 frame_count = 0;
 
-    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
-
-    for (; !feature_reader.Done(); feature_reader.Next()) {
-      std::string utt = feature_reader.Key();
-      const Matrix<BaseFloat> &features (feature_reader.Value());
-      if (features.NumRows() == 0) {
-        KALDI_WARN << "Zero-length utterance: " << utt;
-        continue;
-      }
-
-      frame_count += features.NumRows();
-
-      computer.AcceptUtterance(utt, features);
-      num_utts_read++;
-
-      while (computer.XvectorReady()) {
-        std::string utt;
-        Vector<BaseFloat> xvector;
-        computer.OutputXvector(&utt, &xvector);
-        vector_writer.Write(utt, xvector);
-        num_xvectors_written++;
-      }
-    }
-
-    computer.Flush();
-    while (computer.XvectorReady()) {
-      std::string utt;
-      Vector<BaseFloat> xvector;
-      computer.OutputXvector(&utt, &xvector);
-      vector_writer.Write(utt, xvector);
-      num_xvectors_written++;
+    if (opts.window_size > 0) {
+      SlidingXvectorComputer computer(opts, nnet);
+      ComputeXvectors(feature_rspecifier, vector_wspecifier, &computer,
+                      &num_utts_read, &num_xvectors_written, &frame_count);
+    } else {
+      BatchedXvectorComputer computer(opts, nnet, total_context);
+      ComputeXvectors(feature_rspecifier, vector_wspecifier, &computer,
+                      &num_utts_read, &num_xvectors_written, &frame_count);
     }
 
-
 #if HAVE_CUDA==1
     CuDevice::Instantiate().PrintProfile();
 #endif
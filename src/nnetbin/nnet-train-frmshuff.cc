@@ -26,6 +26,236 @@
 #include "base/timer.h"
 #include "cudamatrix/cu-device.h"
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace kaldi {
+namespace nnet1 {
+
+/// An utterance of training data: features, targets and per-frame weights,
+/// which have been checked and have the same length.
+struct TrainingUtterance {
+  std::string utt;
+  Matrix<BaseFloat> mat;
+  Posterior targets;
+  Vector<BaseFloat> weights;
+};
+
+/// Reads the training data of nnet-train-frmshuff.  With 'read_ahead_frames'
+/// > 0, a background thread reads and checks the utterances (up to that many
+/// frames ahead), while the main thread trains on the randomizer buffer, so
+/// that the next buffer is filled from memory.
+class TrainingDataReader {
+ public:
+  TrainingDataReader(const std::string &feature_rspecifier,
+                     const std::string &targets_rspecifier,
+                     const std::string &frame_weights,
+                     const std::string &utt_weights,
+                     int32 max_frames, int32 length_tolerance,
+                     int64 read_ahead_frames):
+      feature_reader_(feature_rspecifier),
+      targets_reader_(targets_rspecifier),
+      max_frames_(max_frames), length_tolerance_(length_tolerance),
+      read_ahead_frames_(read_ahead_frames),
+      num_no_tgt_mat_(0), num_other_error_(0),
+      queued_frames_(0), done_(false), stop_(false) {
+    if (frame_weights != "")
+      weights_reader_.Open(frame_weights);
+    if (utt_weights != "")
+      utt_weights_reader_.Open(utt_weights);
+    if (read_ahead_frames_ > 0)
+      thread_ = std::thread(&TrainingDataReader::ReadAhead, this);
+  }
+
+  ~TrainingDataReader() {
+    if (thread_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      cond_.notify_all();
+      thread_.join();
+    }
+    for (size_t i = 0; i < queue_.size(); i++)
+      delete queue_[i];
+  }
+
+  /// Gets the next utterance; returns false when there are no more.
+  bool Next(TrainingUtterance *utt) {
+    if (read_ahead_frames_ <= 0)
+      return ReadOne(utt);
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return !queue_.empty() || done_; });
+    if (queue_.empty()) {
+      if (error_ != "")
+        KALDI_ERR << "Error reading training data: " << error_;
+      return false;
+    }
+    TrainingUtterance *front = queue_.front();
+    queue_.pop_front();
+    queued_frames_ -= front->mat.NumRows();
+    lock.unlock();
+    cond_.notify_all();
+    std::swap(*utt, *front);
+    delete front;
+    return true;
+  }
+
+  /// The numbers of skipped utterances; only valid once Next() has returned
+  /// false.
+  int32 NumNoTargets() const { return num_no_tgt_mat_; }
+  int32 NumOtherErrors() const { return num_other_error_; }
+
+ private:
+  // Reads the next usable utterance; returns false at the end of the data.
+  bool ReadOne(TrainingUtterance *out);
+
+  // The function of the background thread.
+  void ReadAhead();
+
+  SequentialBaseFloatMatrixReader feature_reader_;
+  RandomAccessPosteriorReader targets_reader_;
+  RandomAccessBaseFloatVectorReader weights_reader_;
+  RandomAccessBaseFloatReader utt_weights_reader_;
+  int32 max_frames_;
+  int32 length_tolerance_;
+  int64 read_ahead_frames_;
+  int32 num_no_tgt_mat_;
+  int32 num_other_error_;
+
+  // The following are used with the background thread.
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<TrainingUtterance*> queue_;
+  int64 queued_frames_;
+  bool done_;
+  bool stop_;
+  std::string error_;
+};
+
+bool TrainingDataReader::ReadOne(TrainingUtterance *out) {
+  for (; !feature_reader_.Done(); feature_reader_.Next()) {
+    std::string utt = feature_reader_.Key();
+    KALDI_VLOG(3) << "Reading " << utt;
+    // check that we have targets,
+    if (!targets_reader_.HasKey(utt)) {
+      KALDI_WARN << utt << ", missing targets";
+      num_no_tgt_mat_++;
+      continue;
+    }
+    // check we have per-frame weights,
+    if (weights_reader_.IsOpen() && !weights_reader_.HasKey(utt)) {
+      KALDI_WARN << utt << ", missing per-frame weights";
+      num_other_error_++;
+      continue;
+    }
+    // check we have per-utterance weights,
+    if (utt_weights_reader_.IsOpen() && !utt_weights_reader_.HasKey(utt)) {
+      KALDI_WARN << utt << ", missing per-utterance weight";
+      num_other_error_++;
+      continue;
+    }
+    // get feature / target pair,
+    Matrix<BaseFloat> mat = feature_reader_.Value();
+    Posterior targets = targets_reader_.Value(utt);
+    // get per-frame weights,
+    Vector<BaseFloat> weights;
+    if (weights_reader_.IsOpen()) {
+      weights = weights_reader_.Value(utt);
+    } else {  // all per-frame weights are 1.0,
+      weights.Resize(mat.NumRows());
+      weights.Set(1.0);
+    }
+    // multiply with per-utterance weight,
+    if (utt_weights_reader_.IsOpen()) {
+      BaseFloat w = utt_weights_reader_.Value(utt);
+      KALDI_ASSERT(w >= 0.0);
+      if (w == 0.0) continue;  // remove sentence from training,
+      weights.Scale(w);
+    }
+
+    // skip too long utterances (or we run out of memory),
+    if (mat.NumRows() > max_frames_) {
+      KALDI_WARN << "Utterance too long, skipping! " << utt
+        << " (length " << mat.NumRows() << ", max_frames "
+        << max_frames_ << ")";
+      num_other_error_++;
+      continue;
+    }
+
+    // correct small length mismatch or drop sentence,
+    {
+      // add lengths to vector,
+      std::vector<int32> length;
+      length.push_back(mat.NumRows());
+      length.push_back(targets.size());
+      length.push_back(weights.Dim());
+      // find min, max,
+      int32 min = *std::min_element(length.begin(), length.end());
+      int32 max = *std::max_element(length.begin(), length.end());
+      // fix or drop ?
+      if (max - min < length_tolerance_) {
+        // we truncate to shortest,
+        if (mat.NumRows() != min) mat.Resize(min, mat.NumCols(), kCopyData);
+        if (targets.size() != min) targets.resize(min);
+        if (weights.Dim() != min) weights.Resize(min, kCopyData);
+      } else {
+        KALDI_WARN << "Length mismatch! Targets " << targets.size()
+                   << ", features " << mat.NumRows() << ", " << utt;
+        num_other_error_++;
+        continue;
+      }
+    }
+    out->utt = utt;
+    out->mat.Swap(&mat);
+    out->targets.swap(targets);
+    out->weights.Swap(&weights);
+    feature_reader_.Next();
+    return true;
+  }
+  return false;
+}
+
+void TrainingDataReader::ReadAhead() {
+  try {
+    while (true) {
+      TrainingUtterance *utt = new TrainingUtterance();
+      if (!ReadOne(utt)) {
+        delete utt;
+        break;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      // Wait while we are a whole buffer ahead; an utterance is always
+      // accepted into an empty queue, however long it is.
+      cond_.wait(lock, [this] {
+          return stop_ || queue_.empty() ||
+              queued_frames_ < read_ahead_frames_; });
+      if (stop_) {
+        delete utt;
+        return;
+      }
+      queued_frames_ += utt->mat.NumRows();
+      queue_.push_back(utt);
+      lock.unlock();
+      cond_.notify_all();
+    }
+  } catch (const std::exception &e) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    error_ = e.what();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+  }
+  cond_.notify_all();
+}
+
+}  // namespace nnet1
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   using namespace kaldi;
   using namespace kaldi::nnet1;
@@ -84,6 +314,11 @@ int main(int argc, char *argv[]) {
     po.Register("utt-weights", &utt_weights,
         "Per-utterance weights, used to re-scale frame-weights.");
 
+    bool read_ahead = true;
+    po.Register("read-ahead", &read_ahead,
+        "If true, a background thread reads the next randomizer buffer "
+        "worth of data while the current one is trained on.");
+
     std::string use_gpu="yes";
     po.Register("use-gpu", &use_gpu,
         "yes|no|optional, only has effect if compiled with CUDA");
@@ -128,16 +363,10 @@ int main(int argc, char *argv[]) {
 
     kaldi::int64 total_frames = 0;
 
-    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
-    RandomAccessPosteriorReader targets_reader(targets_rspecifier);
-    RandomAccessBaseFloatVectorReader weights_reader;
-    if (frame_weights != "") {
-      weights_reader.Open(frame_weights);
-    }
-    RandomAccessBaseFloatReader utt_weights_reader;
-    if (utt_weights != "") {
-      utt_weights_reader.Open(utt_weights);
-    }
+    TrainingDataReader data_reader(feature_rspecifier, targets_rspecifier,
+                                   frame_weights, utt_weights, max_frames,
+                                   length_tolerance,
+                                   read_ahead ? rnd_opts.randomizer_size : 0);
 
     RandomizerMask randomizer_mask(rnd_opts);
     MatrixRandomizer feature_randomizer(rnd_opts);
@@ -163,103 +392,33 @@ int main(int argc, char *argv[]) {
     KALDI_LOG << (crossvalidate ? "CROSS-VALIDATION" : "TRAINING")
               << " STARTED";
 
-    int32 num_done = 0,
-          num_no_tgt_mat = 0,
-          num_other_error = 0;
+    int32 num_done = 0;
 
     double time_io_accu = 0.0;
 
     // main loop,
-    while (!feature_reader.Done()) {
+    TrainingUtterance utt;
+    bool end_of_data = false;
+    while (!end_of_data) {
 #if HAVE_CUDA == 1
       // check that GPU computes accurately,
       CuDevice::Instantiate().CheckGpuHealth();
 #endif
       // fill the randomizer,
-      time_io.Reset();
-      for ( ; !feature_reader.Done(); feature_reader.Next()) {
-        if (feature_randomizer.IsFull()) {
-          // break the loop without calling Next(),
-          // we keep the 'utt' for next round,
-          break;
-        }
-        std::string utt = feature_reader.Key();
-        KALDI_VLOG(3) << "Reading " << utt;
-        // check that we have targets,
-        if (!targets_reader.HasKey(utt)) {
-          KALDI_WARN << utt << ", missing targets";
-          num_no_tgt_mat++;
-          continue;
-        }
-        // check we have per-frame weights,
-        if (frame_weights != "" && !weights_reader.HasKey(utt)) {
-          KALDI_WARN << utt << ", missing per-frame weights";
-          num_other_error++;
-          continue;
-        }
-        // check we have per-utterance weights,
-        if (utt_weights != "" && !utt_weights_reader.HasKey(utt)) {
-          KALDI_WARN << utt << ", missing per-utterance weight";
-          num_other_error++;
-          continue;
-        }
-        // get feature / target pair,
-        Matrix<BaseFloat> mat = feature_reader.Value();
-        Posterior targets = targets_reader.Value(utt);
-        // get per-frame weights,
-        Vector<BaseFloat> weights;
-        if (frame_weights != "") {
-          weights = weights_reader.Value(utt);
-        } else {  // all per-frame weights are 1.0,
-          weights.Resize(mat.NumRows());
-          weights.Set(1.0);
-        }
-        // multiply with per-utterance weight,
-        if (utt_weights != "") {
-          BaseFloat w = utt_weights_reader.Value(utt);
-          KALDI_ASSERT(w >= 0.0);
-          if (w == 0.0) continue;  // remove sentence from training,
-          weights.Scale(w);
-        }
-
-        // accumulate the I/O time,
+      // (the capacity is checked before reading, so no 'utt' is left over),
+      bool added_data = false;
+      while (!feature_randomizer.IsFull()) {
+        time_io.Reset();
+        end_of_data = !data_reader.Next(&utt);
+        // accumulate the I/O time (or the time spent waiting for the
+        // background thread),
         time_io_accu += time_io.Elapsed();
-        time_io.Reset(); // to be sure we don't count 2x,
-
-        // skip too long utterances (or we run out of memory),
-        if (mat.NumRows() > max_frames) {
-          KALDI_WARN << "Utterance too long, skipping! " << utt
-            << " (length " << mat.NumRows() << ", max_frames "
-            << max_frames << ")";
-          num_other_error++;
-          continue;
-        }
+        if (end_of_data) break;
+        Vector<BaseFloat> &weights = utt.weights;
+        Posterior &targets = utt.targets;
 
-        // correct small length mismatch or drop sentence,
-        {
-          // add lengths to vector,
-          std::vector<int32> length;
-          length.push_back(mat.NumRows());
-          length.push_back(targets.size());
-          length.push_back(weights.Dim());
-          // find min, max,
-          int32 min = *std::min_element(length.begin(), length.end());
-          int32 max = *std::max_element(length.begin(), length.end());
-          // fix or drop ?
-          if (max - min < length_tolerance) {
-            // we truncate to shortest,
-            if (mat.NumRows() != min) mat.Resize(min, mat.NumCols(), kCopyData);
-            if (targets.size() != min) targets.resize(min);
-            if (weights.Dim() != min) weights.Resize(min, kCopyData);
-          } else {
-            KALDI_WARN << "Length mismatch! Targets " << targets.size()
-                       << ", features " << mat.NumRows() << ", " << utt;
-            num_other_error++;
-            continue;
-          }
-        }
         // apply feature transform (if empty, input is copied),
-        nnet_transf.Feedforward(CuMatrix<BaseFloat>(mat), &feats_transf);
+        nnet_transf.Feedforward(CuMatrix<BaseFloat>(utt.mat), &feats_transf);
 
         // remove frames with '0' weight from training,
         {
@@ -304,10 +463,11 @@ int main(int argc, char *argv[]) {
         feature_randomizer.AddData(feats_transf);
         targets_randomizer.AddData(targets);
         weights_randomizer.AddData(weights);
+        added_data = true;
         num_done++;
-
-        time_io.Reset(); // reset before reading next feature matrix,
       }
+      // nothing new since the last mini-batches, we are done,
+      if (!added_data) break;
 
       // randomize,
       if (!crossvalidate && randomize) {
@@ -393,8 +553,8 @@ int main(int argc, char *argv[]) {
     }
 
     KALDI_LOG << "Done " << num_done << " files, "
-      << num_no_tgt_mat << " with no tgt_mats, "
-      << num_other_error << " with other errors. "
+      << data_reader.NumNoTargets() << " with no tgt_mats, "
+      << data_reader.NumOtherErrors() << " with other errors. "
       << "[" << (crossvalidate ? "CROSS-VALIDATION" : "TRAINING")
       << ", " << (randomize ? "RANDOMIZED" : "NOT-RANDOMIZED")
       << ", " << time.Elapsed() / 60 << " min, processing "
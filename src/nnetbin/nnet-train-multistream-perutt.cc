@@ -80,6 +80,11 @@ int main(int argc, char *argv[]) {
     po.Register("max-frames", &max_frames,
         "Max number of frames to be processed");
 
+    bool pack_sequences = false;
+    po.Register("pack-sequences", &pack_sequences,
+        "Put several sentences into one stream (separated by 1 padded frame), "
+        "so that short sentences fill the mini-batch up to --max-frames");
+
     bool dummy = false;
     po.Register("randomize", &dummy, "Dummy option.");
 
@@ -158,7 +163,10 @@ int main(int argc, char *argv[]) {
       std::vector<Matrix<BaseFloat> > feats_utt;
       std::vector<Posterior> labels_utt;
       std::vector<Vector<BaseFloat> > weights_utt;
+      // the placement of the sentences, the frames in the streams,
+      std::vector<int32> stream_utt, offset_utt;
       std::vector<int32> frame_num_utt;
+      int32 num_frames = 0;
       {
         matrix_buffer.ResetLength();  ///< reset the 'preferred' length,
         for (matrix_buffer.Next(); !matrix_buffer.Done(); matrix_buffer.Next()) {
@@ -218,16 +226,43 @@ int main(int argc, char *argv[]) {
           nnet_transf.Feedforward(CuMatrix<BaseFloat>(mat), &feats_transf);
 
           // store,
+          int32 num_rows = feats_transf.NumRows();
           feats_utt.push_back(Matrix<BaseFloat>(feats_transf));
           labels_utt.push_back(targets);
           weights_utt.push_back(weights);
-          frame_num_utt.push_back(feats_transf.NumRows());
-
-          if (frame_num_utt.size() == num_streams) break;
+          num_frames += num_rows;
+
+          // choose the stream, with 'pack_sequences' the sentence goes after
+          // the shortest stream if it fits without more padding, or if all
+          // the streams are in use,
+          int32 s = frame_num_utt.size();
+          if (pack_sequences && s > 0) {
+            int32 s_min = std::min_element(frame_num_utt.begin(), frame_num_utt.end())
+                            - frame_num_utt.begin();
+            int32 max = (*std::max_element(frame_num_utt.begin(), frame_num_utt.end()));
+            if (frame_num_utt[s_min] + 1 + num_rows <= max ||
+                frame_num_utt.size() == num_streams) {
+              s = s_min;
+            }
+          }
+          if (s == frame_num_utt.size()) {
+            frame_num_utt.push_back(0);
+          }
+          stream_utt.push_back(s);
+          offset_utt.push_back(frame_num_utt[s] > 0 ? frame_num_utt[s] + 1 : 0);
+          frame_num_utt[s] = offset_utt.back() + num_rows;
 
           // See how many frames we'd have (after padding), if we add one more utterance,
           int32 max = (*std::max_element(frame_num_utt.begin(), frame_num_utt.end()));
-          if (max * (frame_num_utt.size() + 1) > max_frames) break;
+          if (frame_num_utt.size() == num_streams) {
+            if (!pack_sequences) break;
+            // with packing, the streams grow up to 'max_frames / num_streams',
+            // (the next sentence from 'matrix_buffer' has a similar length),
+            int32 min = (*std::min_element(frame_num_utt.begin(), frame_num_utt.end()));
+            if (min + 1 + num_rows > std::max<int32>(max, max_frames / num_streams)) break;
+          } else {
+            if (max * (frame_num_utt.size() + 1) > max_frames) break;
+          }
         }
       }
       // Having no data? Skip the cycle...
@@ -237,6 +272,7 @@ int main(int argc, char *argv[]) {
       Matrix<BaseFloat> feat_mat_host;
       Posterior target_host;
       Vector<BaseFloat> weight_host;
+      Vector<BaseFloat> frame_mask_host;  // 1.0 for sentences, 0.0 for padding,
       {
         // Number of sequences,
         int32 n_streams = frame_num_utt.size();
@@ -249,31 +285,30 @@ int main(int argc, char *argv[]) {
         target_host.resize(n_streams * frame_num_padded);
         weight_host.Resize(n_streams * frame_num_padded, kSetZero);
 
-        for (int32 s = 0; s < n_streams; s++) {
-          const Matrix<BaseFloat>& mat_tmp = feats_utt[s];
-          for (int32 r = 0; r < frame_num_utt[s]; r++) {
-            feat_mat_host.Row(r*n_streams + s).CopyFromVec(mat_tmp.Row(r));
-          }
-        }
-
-        for (int32 s = 0; s < n_streams; s++) {
-          const Posterior& target_tmp = labels_utt[s];
-          for (int32 r = 0; r < frame_num_utt[s]; r++) {
-            target_host[r*n_streams + s] = target_tmp[r];
-          }
-        }
-
-        // padded frames will keep initial zero-weight,
-        for (int32 s = 0; s < n_streams; s++) {
-          const Vector<BaseFloat>& weight_tmp = weights_utt[s];
-          for (int32 r = 0; r < frame_num_utt[s]; r++) {
-            weight_host(r*n_streams + s) = weight_tmp(r);
+        frame_mask_host.Resize(n_streams * frame_num_padded, kSetZero);
+
+        for (int32 u = 0; u < feats_utt.size(); u++) {
+          int32 s = stream_utt[u], offset = offset_utt[u];
+          const Matrix<BaseFloat>& mat_tmp = feats_utt[u];
+          const Posterior& target_tmp = labels_utt[u];
+          const Vector<BaseFloat>& weight_tmp = weights_utt[u];
+          for (int32 r = 0; r < mat_tmp.NumRows(); r++) {
+            int32 row = (offset + r)*n_streams + s;
+            feat_mat_host.Row(row).CopyFromVec(mat_tmp.Row(r));
+            target_host[row] = target_tmp[r];
+            // padded frames will keep initial zero-weight,
+            weight_host(row) = weight_tmp(r);
+            frame_mask_host(row) = 1.0;
           }
         }
       }
 
       // Set the original lengths of utterances before padding,
       nnet.SetSeqLengths(frame_num_utt);
+      // Mark the padded frames between the packed sentences,
+      if (pack_sequences) {
+        nnet.SetFrameMask(CuVector<BaseFloat>(frame_mask_host));
+      }
       // Show the 'utt' lengths in the VLOG[2],
       if (GetVerboseLevel() >= 2) {
         std::ostringstream os;
@@ -311,8 +346,8 @@ int main(int argc, char *argv[]) {
 
       kaldi::int64 tmp_frames = total_frames;
 
-      num_done += frame_num_utt.size();
-      total_frames += std::accumulate(frame_num_utt.begin(), frame_num_utt.end(), 0);
+      num_done += feats_utt.size();
+      total_frames += num_frames;
 
       // monitor the NN training (--verbose=2),
       int32 F = 25000;
@@ -159,6 +159,12 @@ int main(int argc, char *argv[]) {
     po.Register("num-streams", &num_streams,
       "Number of streams in the Multi-stream training");
 
+    bool pack_sequences = false;
+    po.Register("pack-sequences", &pack_sequences,
+      "When an utterance ends inside a mini-batch, continue its stream with "
+      "the next utterance (separated by 1 padded frame) instead of padding "
+      "the rest of the stream.");
+
     bool dummy = false;
     po.Register("randomize", &dummy, "Dummy option.");
 
@@ -234,6 +240,40 @@ int main(int argc, char *argv[]) {
 
     CuMatrix<BaseFloat> feats_transf, nnet_out, obj_diff;
 
+    // Loads the next utterance into stream 's', returns false at the end,
+    auto load_utterance = [&](int32 s) {
+      Matrix<BaseFloat> feats;
+      Posterior targets;
+      Vector<BaseFloat> weights;
+      // get the data from readers,
+      if (!ReadData(feature_reader, target_reader, weights_reader,
+                    length_tolerance,
+                    &feats, &targets, &weights,
+                    &num_no_tgt_mat, &num_other_error)) {
+        return false;
+      }
+
+      // input transform may contain splicing,
+      Timer t;
+      nnet_transf.Feedforward(CuMatrix<BaseFloat>(feats), &feats_transf);
+      time_gpu += t.Elapsed();
+
+      /* Here we could do the 'targets_delay', BUT...
+       * It is better to do it by a <Splice> component!
+       *
+       * The prototype would look like this (6th frame becomes 1st frame, etc.):
+       * '<Splice> <InputDim> dim1 <OutputDim> dim1 <BuildVector> 5 </BuildVector>'
+       */
+
+      // store,
+      feats_utt[s] = Matrix<BaseFloat>(feats_transf);
+      labels_utt[s] = targets;
+      weights_utt[s] = weights;
+      cursor_utt[s] = 0;
+      num_done++;
+      return true;
+    };
+
     // MAIN LOOP,
     while (1) {
 
@@ -242,32 +282,7 @@ int main(int argc, char *argv[]) {
       for (int s = 0; s < num_streams; s++) {
         // Need a new utterance for stream 's'?
         if (cursor_utt[s] >= feats_utt[s].NumRows()) {
-          Matrix<BaseFloat> feats;
-          Posterior targets;
-          Vector<BaseFloat> weights;
-          // get the data from readers,
-          if (ReadData(feature_reader, target_reader, weights_reader,
-                       length_tolerance,
-                       &feats, &targets, &weights,
-                       &num_no_tgt_mat, &num_other_error)) {
-
-            // input transform may contain splicing,
-            Timer t;
-            nnet_transf.Feedforward(CuMatrix<BaseFloat>(feats), &feats_transf);
-            time_gpu += t.Elapsed();
-
-            /* Here we could do the 'targets_delay', BUT...
-             * It is better to do it by a <Splice> component!
-             *
-             * The prototype would look like this (6th frame becomes 1st frame, etc.):
-             * '<Splice> <InputDim> dim1 <OutputDim> dim1 <BuildVector> 5 </BuildVector>'
-             */
-
-            // store,
-            feats_utt[s] = Matrix<BaseFloat>(feats_transf);
-            labels_utt[s] = targets;
-            weights_utt[s] = weights;
-            cursor_utt[s] = 0;
+          if (load_utterance(s)) {
             new_utt_flags[s] = 1;
           }
         }
@@ -287,8 +302,12 @@ int main(int argc, char *argv[]) {
         break;
       }
 
-      // number of frames we'll pack as the streams,
+      // number of frames we'll pack as the streams (incl. the padded frames
+      // between the packed utterances),
       std::vector<int32> frame_num_utt;
+      // 1.0 for the frames of utterances, 0.0 for padding,
+      Vector<BaseFloat> frame_mask_host;
+      int32 num_frames = 0;
 
       // pack the parallel data,
       Matrix<BaseFloat> feat_mat_host;
@@ -302,50 +321,43 @@ int main(int argc, char *argv[]) {
         feat_mat_host.Resize(n_streams * batch_size, nnet.InputDim(), kSetZero);
         target_host.resize(n_streams * batch_size);
         weight_host.Resize(n_streams * batch_size, kSetZero);
+        frame_mask_host.Resize(n_streams * batch_size, kSetZero);
         frame_num_utt.resize(n_streams, 0);
 
         // we slice at the 'cursor' at most 'batch_size' frames,
+        // and with 'pack_sequences' we continue with the next utterances,
         for (int32 s = 0; s < n_streams; s++) {
-          int32 num_rows = std::max(0, feats_utt[s].NumRows() - cursor_utt[s]);
-          frame_num_utt[s] = std::min(batch_size, num_rows);
-        }
-
-        // pack the data,
-        {
-          for (int32 s = 0; s < n_streams; s++) {
-            if (frame_num_utt[s] > 0) {
-              auto mat_tmp = feats_utt[s].RowRange(cursor_utt[s], frame_num_utt[s]);
-              for (int32 r = 0; r < frame_num_utt[s]; r++) {
-                feat_mat_host.Row(r*n_streams + s).CopyFromVec(mat_tmp.Row(r));
-              }
-            }
-          }
-
-          for (int32 s = 0; s < n_streams; s++) {
-            for (int32 r = 0; r < frame_num_utt[s]; r++) {
-              target_host[r*n_streams + s] = labels_utt[s][cursor_utt[s] + r];
-            }
-          }
-
-          // padded frames will keep initial zero-weight,
-          for (int32 s = 0; s < n_streams; s++) {
-            if (frame_num_utt[s] > 0) {
-              auto weight_tmp = weights_utt[s].Range(cursor_utt[s], frame_num_utt[s]);
-              for (int32 r = 0; r < frame_num_utt[s]; r++) {
-                weight_host(r*n_streams + s) = weight_tmp(r);
-              }
+          int32 t = 0;  // frames used in the stream,
+          while (true) {
+            int32 num_rows = std::max(0, feats_utt[s].NumRows() - cursor_utt[s]);
+            int32 n = std::min(batch_size - t, num_rows);
+            for (int32 r = 0; r < n; r++) {
+              int32 row = (t + r)*n_streams + s;
+              feat_mat_host.Row(row).CopyFromVec(
+                  feats_utt[s].Row(cursor_utt[s] + r));
+              target_host[row] = labels_utt[s][cursor_utt[s] + r];
+              // padded frames will keep initial zero-weight,
+              weight_host(row) = weights_utt[s](cursor_utt[s] + r);
+              frame_mask_host(row) = 1.0;
             }
+            // advance the cursor,
+            cursor_utt[s] += n;
+            t += n;
+            frame_num_utt[s] = t;
+            num_frames += n;
+            // we need space for the separating frame and 1 frame of data,
+            if (!pack_sequences || t + 2 > batch_size) break;
+            if (!load_utterance(s)) break;
+            t += 1;  // the padded frame resets the LSTM state,
           }
         }
-
-        // advance the cursors,
-        for (int32 s = 0; s < n_streams; s++) {
-          cursor_utt[s] += frame_num_utt[s];
-        }
       }
 
       // pass the info about padding,
       nnet.SetSeqLengths(frame_num_utt);
+      if (pack_sequences) {
+        nnet.SetFrameMask(CuVector<BaseFloat>(frame_mask_host));
+      }
 
       // Show debug info,
       if (GetVerboseLevel() >= 4) {
@@ -407,8 +419,7 @@ int main(int argc, char *argv[]) {
 
       kaldi::int64 tmp_frames = total_frames;
 
-      num_done += std::accumulate(new_utt_flags.begin(), new_utt_flags.end(), 0);
-      total_frames += std::accumulate(frame_num_utt.begin(), frame_num_utt.end(), 0);
+      total_frames += num_frames;
 
       // monitor the NN training (--verbose=2),
       int32 F = 25000;
@@ -0,0 +1,82 @@
+// online2/online-beam-controller.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <sstream>
+
+#include "online2/online-beam-controller.h"
+
+namespace kaldi {
+
+OnlineBeamController::OnlineBeamController(
+    const OnlineBeamControllerConfig &config):
+    config_(config), beam_scale_(1.0), smoothed_rtf_(-1.0), queue_depth_(0),
+    num_updates_(0), num_reductions_(0), min_beam_scale_seen_(1.0) {
+  config_.Check();
+}
+
+void OnlineBeamController::SetQueueDepth(int32 queue_depth) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  queue_depth_ = queue_depth;
+}
+
+BaseFloat OnlineBeamController::Update(double audio_seconds,
+                                       double seconds_taken) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!Enabled() || audio_seconds <= 0.0)
+    return beam_scale_;
+  double rtf = seconds_taken / audio_seconds;
+  if (smoothed_rtf_ < 0.0)
+    smoothed_rtf_ = rtf;
+  else
+    smoothed_rtf_ = config_.rtf_smoothing * smoothed_rtf_ +
+        (1.0 - config_.rtf_smoothing) * rtf;
+  num_updates_++;
+
+  bool overloaded = smoothed_rtf_ > config_.target_rtf ||
+      (config_.max_queue_depth > 0 && queue_depth_ > config_.max_queue_depth),
+      underloaded = smoothed_rtf_ < 0.8 * config_.target_rtf &&
+      (config_.max_queue_depth == 0 || queue_depth_ <= config_.max_queue_depth / 2);
+  if (overloaded) {
+    BaseFloat new_scale = std::max(config_.min_beam_scale,
+                                   beam_scale_ * (1.0f - config_.step));
+    if (new_scale < beam_scale_) num_reductions_++;
+    beam_scale_ = new_scale;
+  } else if (underloaded) {
+    beam_scale_ = std::min(1.0f, beam_scale_ / (1.0f - config_.step));
+  }
+  min_beam_scale_seen_ = std::min(min_beam_scale_seen_, beam_scale_);
+  return beam_scale_;
+}
+
+BaseFloat OnlineBeamController::BeamScale() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return beam_scale_;
+}
+
+std::string OnlineBeamController::Info() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::ostringstream os;
+  os << "Beam controller: " << num_updates_ << " chunks, beam reduced on "
+     << num_reductions_ << " of them, smallest beam scale "
+     << min_beam_scale_seen_ << ", current beam scale " << beam_scale_
+     << ", smoothed real-time factor " << std::max(smoothed_rtf_, 0.0)
+     << " (target " << config_.target_rtf << ")";
+  return os.str();
+}
+
+}  // namespace kaldi
@@ -0,0 +1,125 @@
+// online2/online-beam-controller.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_ONLINE2_ONLINE_BEAM_CONTROLLER_H_
+#define KALDI_ONLINE2_ONLINE_BEAM_CONTROLLER_H_
+
+#include <mutex>
+#include <string>
+
+#include "base/kaldi-common.h"
+#include "itf/options-itf.h"
+
+namespace kaldi {
+/// @addtogroup  onlinedecoding OnlineDecoding
+/// @{
+
+
+struct OnlineBeamControllerConfig {
+  BaseFloat target_rtf;
+  BaseFloat min_beam_scale;
+  BaseFloat step;
+  BaseFloat rtf_smoothing;
+  int32 max_queue_depth;
+
+  OnlineBeamControllerConfig(): target_rtf(0.0), min_beam_scale(0.5),
+                                step(0.1), rtf_smoothing(0.8),
+                                max_queue_depth(0) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("beam-control.target-rtf", &target_rtf, "If >0, the "
+                   "real-time factor (time taken / audio decoded) we aim for; "
+                   "when decoding is slower than this the beam and max-active "
+                   "are reduced, and when it is faster they are restored.  "
+                   "Zero disables the beam controller.");
+    opts->Register("beam-control.min-beam-scale", &min_beam_scale, "The "
+                   "controller never reduces the beam and max-active below "
+                   "this factor times their configured values.");
+    opts->Register("beam-control.step", &step, "The proportion by which the "
+                   "beam scale is reduced (or increased) on each chunk.");
+    opts->Register("beam-control.rtf-smoothing", &rtf_smoothing, "Constant in "
+                   "[0,1) of the exponential smoothing of the measured "
+                   "real-time factor over chunks; larger means smoother.");
+    opts->Register("beam-control.max-queue-depth", &max_queue_depth, "If >0, "
+                   "the beam is also reduced while more than this many "
+                   "requests are waiting to be decoded (see "
+                   "OnlineBeamController::SetQueueDepth()).");
+  }
+
+  void Check() const {
+    KALDI_ASSERT(target_rtf >= 0.0 && min_beam_scale > 0.0 &&
+                 min_beam_scale <= 1.0 && step > 0.0 && step < 1.0 &&
+                 rtf_smoothing >= 0.0 && rtf_smoothing < 1.0 &&
+                 max_queue_depth >= 0);
+  }
+};
+
+
+/**
+   OnlineBeamController adjusts the decoding beam (and max-active) per chunk
+   so that decoding keeps up with real time under bursty load.  After each
+   chunk the decoder calls Update() with the duration of the audio it decoded
+   and the wall-clock time it took; the controller smooths the ratio of the
+   two and, if it is above config.target_rtf (or if the request queue set by
+   SetQueueDepth() is longer than config.max_queue_depth), multiplies the
+   beam scale by (1 - config.step), never going below config.min_beam_scale.
+   When decoding is comfortably faster than the target (below 0.8 times it)
+   and the queue is short, the scale is raised again towards 1.
+
+   One controller may be shared by all the decoders in a server, in which case
+   the beam reflects the load of the whole process; it is thread-safe.  See
+   SingleUtteranceNnet3DecoderTpl::SetBeamController().
+*/
+class OnlineBeamController {
+ public:
+  explicit OnlineBeamController(const OnlineBeamControllerConfig &config);
+
+  bool Enabled() const { return config_.target_rtf > 0.0; }
+
+  /// Tells the controller how many requests are waiting to be decoded, for
+  /// servers that queue requests; it is taken into account by the next
+  /// Update().
+  void SetQueueDepth(int32 queue_depth);
+
+  /// To be called after decoding a chunk of 'audio_seconds' seconds of audio
+  /// that took 'seconds_taken' seconds; returns the beam scale to use for the
+  /// next chunk, in [config.min_beam_scale, 1].
+  BaseFloat Update(double audio_seconds, double seconds_taken);
+
+  BaseFloat BeamScale() const;
+
+  /// Returns a summary of the controller's activity, for logging.
+  std::string Info() const;
+
+ private:
+  OnlineBeamControllerConfig config_;
+  mutable std::mutex mutex_;
+  BaseFloat beam_scale_;
+  double smoothed_rtf_;  // negative before the first Update().
+  int32 queue_depth_;
+  // Statistics for Info().
+  int64 num_updates_;
+  int64 num_reductions_;
+  BaseFloat min_beam_scale_seen_;
+};
+
+
+/// @} End of "addtogroup onlinedecoding"
+}  // namespace kaldi
+
+#endif  // KALDI_ONLINE2_ONLINE_BEAM_CONTROLLER_H_
@@ -111,7 +111,9 @@ bool EndpointDetected(
     const OnlineEndpointConfig &config,
     const TransitionModel &tmodel,
     BaseFloat frame_shift_in_seconds,
-    const LatticeFasterOnlineDecoderTpl<FST> &decoder) {
+    const LatticeFasterOnlineDecoderTpl<FST> &decoder,
+    int32 lookahead_frames) {
+  KALDI_ASSERT(lookahead_frames >= 0);
   if (decoder.NumFramesDecoded() == 0) return false;
 
   BaseFloat final_relative_cost = decoder.FinalRelativeCost();
@@ -120,6 +122,11 @@ bool EndpointDetected(
       trailing_silence_frames = TrailingSilenceLength(tmodel,
                                                       config.silence_phones,
                                                       decoder);
+  if (trailing_silence_frames > 0) {
+    // Assume the silence goes on through the frames we have not decoded yet.
+    num_frames_decoded += lookahead_frames;
+    trailing_silence_frames += lookahead_frames;
+  }
 
   return EndpointDetected(config, num_frames_decoded, trailing_silence_frames,
                           frame_shift_in_seconds, final_relative_cost);
@@ -133,7 +140,8 @@ bool EndpointDetected<fst::Fst<fst::StdArc> >(
     const OnlineEndpointConfig &config,
     const TransitionModel &tmodel,
     BaseFloat frame_shift_in_seconds,
-    const LatticeFasterOnlineDecoderTpl<fst::Fst<fst::StdArc> > &decoder);
+    const LatticeFasterOnlineDecoderTpl<fst::Fst<fst::StdArc> > &decoder,
+    int32 lookahead_frames);
 
 
 template
@@ -141,7 +149,17 @@ bool EndpointDetected<fst::GrammarFst>(
     const OnlineEndpointConfig &config,
     const TransitionModel &tmodel,
     BaseFloat frame_shift_in_seconds,
-    const LatticeFasterOnlineDecoderTpl<fst::GrammarFst> &decoder);
+    const LatticeFasterOnlineDecoderTpl<fst::GrammarFst> &decoder,
+    int32 lookahead_frames);
+
+
+template
+bool EndpointDetected<fst::CsrFst>(
+    const OnlineEndpointConfig &config,
+    const TransitionModel &tmodel,
+    BaseFloat frame_shift_in_seconds,
+    const LatticeFasterOnlineDecoderTpl<fst::CsrFst> &decoder,
+    int32 lookahead_frames);
 
 
 }  // namespace kaldi
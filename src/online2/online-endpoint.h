@@ -195,12 +195,17 @@ int32 TrailingSilenceLength(const TransitionModel &tmodel,
 
 /// This is a higher-level convenience function that works out the
 /// arguments to the EndpointDetected function above, from the decoder.
+/// If "lookahead_frames" is nonzero, it predicts the endpoint that we would
+/// detect that many frames later if the trailing silence (if any) went on; it
+/// is used for speculative finalization, see
+/// SingleUtteranceNnet3DecoderTpl::SpeculativeEndpointDetected().
 template <typename FST>
 bool EndpointDetected(
     const OnlineEndpointConfig &config,
     const TransitionModel &tmodel,
     BaseFloat frame_shift_in_seconds,
-    const LatticeFasterOnlineDecoderTpl<FST> &decoder);
+    const LatticeFasterOnlineDecoderTpl<FST> &decoder,
+    int32 lookahead_frames = 0);
 
 
 
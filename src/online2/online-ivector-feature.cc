@@ -35,6 +35,8 @@ void OnlineIvectorExtractionInfo::Init(
   posterior_scale = config.posterior_scale;
   max_count = config.max_count;
   num_cg_iters = config.num_cg_iters;
+  cg_tolerance = config.cg_tolerance;
+  num_gselect_preselect = config.num_gselect_preselect;
   use_most_recent_ivector = config.use_most_recent_ivector;
   greedy_ivector_extractor = config.greedy_ivector_extractor;
   if (greedy_ivector_extractor && !use_most_recent_ivector) {
@@ -43,6 +45,7 @@ void OnlineIvectorExtractionInfo::Init(
     use_most_recent_ivector = true;
   }
   max_remembered_frames = config.max_remembered_frames;
+  max_retained_frames = -1;
 
   std::string note = "(note: this may be needed "
       "in the file supplied to --ivector-extractor-config)";
@@ -64,9 +67,27 @@ void OnlineIvectorExtractionInfo::Init(
   if (config.ivector_extractor_rxfilename == "")
     KALDI_ERR << "--ivector-extractor option must be set " << note;
   ReadKaldiObject(config.ivector_extractor_rxfilename, &extractor);
+  if (num_gselect_preselect > 0)
+    InitPreselectUbm(config.gselect_preselect_dim);
   this->Check();
 }
 
+void OnlineIvectorExtractionInfo::InitPreselectUbm(int32 preselect_dim) {
+  KALDI_ASSERT(preselect_dim > 0);
+  int32 num_gauss = diag_ubm.NumGauss();
+  preselect_dim = std::min(preselect_dim, diag_ubm.Dim());
+  // The marginal of a diagonal Gaussian over a subset of the dimensions just
+  // drops the other dimensions.
+  Matrix<BaseFloat> means;
+  diag_ubm.GetMeans(&means);
+  preselect_ubm.Resize(num_gauss, preselect_dim);
+  preselect_ubm.SetWeights(diag_ubm.weights());
+  preselect_ubm.SetInvVarsAndMeans(
+      diag_ubm.inv_vars().ColRange(0, preselect_dim),
+      means.ColRange(0, preselect_dim));
+  preselect_ubm.ComputeGconsts();
+}
+
 
 void OnlineIvectorExtractionInfo::Check() const {
   KALDI_ASSERT(global_cmvn_stats.NumRows() == 2);
@@ -84,13 +105,20 @@ void OnlineIvectorExtractionInfo::Check() const {
   // posterior scale more than one does not really make sense.
   KALDI_ASSERT(posterior_scale > 0.0 && posterior_scale <= 1.0);
   KALDI_ASSERT(max_remembered_frames >= 0);
+  KALDI_ASSERT(max_retained_frames <= 0 ||
+               max_retained_frames > cmvn_opts.cmn_window);
+  KALDI_ASSERT(cg_tolerance >= 0.0);
+  if (num_gselect_preselect > 0) {
+    KALDI_ASSERT(num_gselect_preselect >= num_gselect &&
+                 preselect_ubm.NumGauss() == diag_ubm.NumGauss());
+  }
 }
 
 // The class constructed in this way should never be used.
 OnlineIvectorExtractionInfo::OnlineIvectorExtractionInfo():
     ivector_period(0), num_gselect(0), min_post(0.0), posterior_scale(0.0),
-    use_most_recent_ivector(true), greedy_ivector_extractor(false),
-    max_remembered_frames(0) { }
+    cg_tolerance(0.0), num_gselect_preselect(0), use_most_recent_ivector(true), greedy_ivector_extractor(false),
+    max_remembered_frames(0), max_retained_frames(-1) { }
 
 OnlineIvectorExtractorAdaptationState::OnlineIvectorExtractorAdaptationState(
     const OnlineIvectorExtractorAdaptationState &other):
@@ -189,6 +217,113 @@ BaseFloat OnlineIvectorFeature::GetMinPost(BaseFloat weight) const {
   return min_post;
 }
 
+void OnlineIvectorFeature::PreselectGaussians(
+    const VectorBase<BaseFloat> &feat,
+    const VectorBase<BaseFloat> &approx_log_likes) {
+  int32 num_gauss = approx_log_likes.Dim(),
+      num_preselect = std::min(info_.num_gselect_preselect, num_gauss);
+  std::vector<std::pair<BaseFloat, int32> > &scores = preselect_scores_;
+  scores.resize(num_gauss);
+  for (int32 g = 0; g < num_gauss; g++)
+    scores[g] = std::pair<BaseFloat, int32>(-approx_log_likes(g), g);
+  std::nth_element(scores.begin(), scores.begin() + num_preselect - 1,
+                   scores.end());
+  preselect_.resize(num_preselect);
+  for (int32 i = 0; i < num_preselect; i++)
+    preselect_[i] = scores[i].second;
+  // sorted, so LogLikelihoodsPreselect() can use its faster code if the
+  // indices happen to be contiguous.
+  std::sort(preselect_.begin(), preselect_.end());
+  info_.diag_ubm.LogLikelihoodsPreselect(feat, preselect_,
+                                         &preselect_log_likes_);
+}
+
+void OnlineIvectorFeature::CacheUbmLogLikes(const std::vector<int32> &frames) {
+  if (info_.max_retained_frames > 0) {
+    // Forget the oldest frames.  We do this before adding the new ones, so
+    // that the caller can rely on all of "frames" being in the cache.
+    while (static_cast<int32>(ubm_cache_.size()) > info_.max_retained_frames) {
+      ubm_cache_.pop_front();
+      num_ubm_cache_discarded_++;
+    }
+  }
+  std::vector<int32> new_frames;
+  for (size_t i = 0; i < frames.size(); i++) {
+    int32 t = frames[i];
+    if (t < num_ubm_cache_discarded_)
+      KALDI_ERR << "Frame " << t << " is too far in the past for "
+                << "max-retained-frames = " << info_.max_retained_frames;
+    int32 index = t - num_ubm_cache_discarded_;
+    if (index >= static_cast<int32>(ubm_cache_.size()))
+      ubm_cache_.resize(index + 1);
+    if (ubm_cache_[index].empty())
+      new_frames.push_back(t);
+  }
+  if (new_frames.empty())
+    return;
+
+  int32 num_frames = new_frames.size();
+  Matrix<BaseFloat> feats(num_frames, lda_normalized_->Dim(), kUndefined),
+      log_likes;
+  lda_normalized_->GetFrames(new_frames, &feats);
+
+  bool preselect = (info_.num_gselect_preselect > 0);
+  if (preselect) {
+    // cheap first pass for all the frames at once.
+    int32 preselect_dim = info_.preselect_ubm.Dim();
+    info_.preselect_ubm.LogLikelihoods(feats.ColRange(0, preselect_dim),
+                                       &log_likes);
+  } else {
+    info_.diag_ubm.LogLikelihoods(feats, &log_likes);
+  }
+
+  std::vector<std::pair<int32, BaseFloat> > posterior;
+  for (int32 i = 0; i < num_frames; i++) {
+    if (preselect)
+      PreselectGaussians(feats.Row(i), log_likes.Row(i));
+    SubVector<BaseFloat> frame_log_likes(
+        preselect ? SubVector<BaseFloat>(preselect_log_likes_, 0,
+                                         preselect_log_likes_.Dim()) :
+        log_likes.Row(i));
+    // we keep the Gaussians that survive the pruning at the weakest
+    // --min-post we use, i.e. for a weight of 1.0.
+    VectorToPosteriorEntry(frame_log_likes, info_.num_gselect,
+                           info_.min_post, &posterior);
+    std::vector<std::pair<int32, BaseFloat> > &entry =
+        ubm_cache_[new_frames[i] - num_ubm_cache_discarded_];
+    entry.resize(posterior.size());
+    for (size_t j = 0; j < posterior.size(); j++) {
+      int32 k = posterior[j].first;
+      entry[j].first = (preselect ? preselect_[k] : k);
+      entry[j].second = frame_log_likes(k);
+    }
+  }
+}
+
+BaseFloat OnlineIvectorFeature::GetCachedPosterior(
+    int32 frame, BaseFloat min_post,
+    std::vector<std::pair<int32, BaseFloat> > *posterior) const {
+  int32 index = frame - num_ubm_cache_discarded_;
+  KALDI_ASSERT(index >= 0 && index < static_cast<int32>(ubm_cache_.size()) &&
+               !ubm_cache_[index].empty());
+  const std::vector<std::pair<int32, BaseFloat> > &entry = ubm_cache_[index];
+  Vector<BaseFloat> log_likes(entry.size(), kUndefined);
+  for (size_t j = 0; j < entry.size(); j++)
+    log_likes(j) = entry[j].second;
+  BaseFloat ans = VectorToPosteriorEntry(log_likes, info_.num_gselect,
+                                         min_post, posterior);
+  for (size_t j = 0; j < posterior->size(); j++)
+    (*posterior)[j].first = entry[(*posterior)[j].first].first;
+  return ans;
+}
+
+BaseFloat OnlineIvectorFeature::GetUbmPosterior(
+    int32 frame, std::vector<std::pair<int32, BaseFloat> > *posterior) {
+  KALDI_ASSERT(frame >= 0 && frame < this->NumFramesReady());
+  CacheUbmLogLikes(std::vector<int32>(1, frame));
+  return GetCachedPosterior(frame, info_.min_post, posterior);
+}
+
 void OnlineIvectorFeature::UpdateStatsForFrames(
     const std::vector<std::pair<int32, BaseFloat> > &frame_weights_in) {
 
@@ -201,16 +336,20 @@ void OnlineIvectorFeature::UpdateStatsForFrames(
 
   int32 num_frames = static_cast<int32>(frame_weights.size());
   int32 feat_dim = lda_normalized_->Dim();
-  Matrix<BaseFloat> feats(num_frames, feat_dim, kUndefined),
-      log_likes;
+  Matrix<BaseFloat> feats(num_frames, feat_dim, kUndefined);
 
   std::vector<int32> frames;
   frames.reserve(frame_weights.size());
   for (int32 i = 0; i < num_frames; i++)
     frames.push_back(frame_weights[i].first);
-  lda_normalized_->GetFrames(frames, &feats);
 
-  info_.diag_ubm.LogLikelihoods(feats, &log_likes);
+  // The UBM is evaluated only once per frame, even if the weight of the frame
+  // changes later (silence weighting) or GetUbmPosterior() was called for it.
+  std::vector<int32> weighted_frames;
+  for (int32 i = 0; i < num_frames; i++)
+    if (frame_weights[i].second != 0.0)
+      weighted_frames.push_back(frames[i]);
+  CacheUbmLogLikes(weighted_frames);
 
   // "posteriors" stores, for each frame index in the range of frames, the
   // pruned posteriors for the Gaussians in the UBM.
@@ -220,8 +359,7 @@ void OnlineIvectorFeature::UpdateStatsForFrames(
     BaseFloat weight = frame_weights[i].second;
     if (weight != 0.0) {
       tot_ubm_loglike_ += weight *
-          VectorToPosteriorEntry(log_likes.Row(i), info_.num_gselect,
-                                 GetMinPost(weight), &posterior);
+          GetCachedPosterior(frames[i], GetMinPost(weight), &posterior);
       for (size_t j = 0; j < posterior.size(); j++)
         posterior[j].second *= info_.posterior_scale * weight;
     }
@@ -236,6 +374,21 @@ void OnlineIvectorFeature::UpdateStatsForFrames(
 }
 
 
+void OnlineIvectorFeature::AppendIvectorHistory(int32 t) {
+  int32 ivec_index = t / info_.ivector_period;
+  KALDI_ASSERT(ivec_index == num_ivectors_discarded_ +
+               static_cast<int32>(ivectors_history_.size()));
+  ivectors_history_.push_back(new Vector<BaseFloat>(current_ivector_));
+  if (info_.max_retained_frames > 0) {
+    while (static_cast<int32>(ivectors_history_.size() - 1) *
+           info_.ivector_period > info_.max_retained_frames) {
+      delete ivectors_history_.front();
+      ivectors_history_.pop_front();
+      num_ivectors_discarded_++;
+    }
+  }
+}
+
 void OnlineIvectorFeature::UpdateStatsUntilFrame(int32 frame) {
   KALDI_ASSERT(frame >= 0 && frame < this->NumFramesReady() &&
                !delta_weights_provided_);
@@ -243,6 +396,7 @@ void OnlineIvectorFeature::UpdateStatsUntilFrame(int32 frame) {
 
   int32 ivector_period = info_.ivector_period;
   int32 num_cg_iters = info_.num_cg_iters;
+  BaseFloat cg_tolerance = info_.cg_tolerance;
 
   std::vector<std::pair<int32, BaseFloat> > frame_weights;
 
@@ -257,12 +411,10 @@ void OnlineIvectorFeature::UpdateStatsUntilFrame(int32 frame) {
       //  UpdateStatsForFrame(cur_start_frame + i, frame_weights[i])
       UpdateStatsForFrames(frame_weights);
       frame_weights.clear();
-      ivector_stats_.GetIvector(num_cg_iters, &current_ivector_);
-      if (!info_.use_most_recent_ivector) {  // need to cache iVectors.
-        int32 ivec_index = t / ivector_period;
-        KALDI_ASSERT(ivec_index == static_cast<int32>(ivectors_history_.size()));
-        ivectors_history_.push_back(new Vector<BaseFloat>(current_ivector_));
-      }
+      ivector_stats_.GetIvector(num_cg_iters, &current_ivector_,
+                                cg_tolerance);
+      if (!info_.use_most_recent_ivector)  // need to cache iVectors.
+        AppendIvectorHistory(t);
     }
   }
   if (!frame_weights.empty())
@@ -278,6 +430,7 @@ void OnlineIvectorFeature::UpdateStatsUntilFrameWeighted(int32 frame) {
 
   int32 ivector_period = info_.ivector_period;
   int32 num_cg_iters = info_.num_cg_iters;
+  BaseFloat cg_tolerance = info_.cg_tolerance;
 
   std::vector<std::pair<int32, BaseFloat> > frame_weights;
   frame_weights.reserve(delta_weights_.size());
@@ -302,12 +455,10 @@ void OnlineIvectorFeature::UpdateStatsUntilFrameWeighted(int32 frame) {
         (info_.use_most_recent_ivector && t == frame)) {
       UpdateStatsForFrames(frame_weights);
       frame_weights.clear();
-      ivector_stats_.GetIvector(num_cg_iters, &current_ivector_);
-      if (!info_.use_most_recent_ivector) {  // need to cache iVectors.
-        int32 ivec_index = t / ivector_period;
-        KALDI_ASSERT(ivec_index == static_cast<int32>(ivectors_history_.size()));
-        ivectors_history_.push_back(new Vector<BaseFloat>(current_ivector_));
-      }
+      ivector_stats_.GetIvector(num_cg_iters, &current_ivector_,
+                                cg_tolerance);
+      if (!info_.use_most_recent_ivector)  // need to cache iVectors.
+        AppendIvectorHistory(t);
     }
   }
   if (!frame_weights.empty())
@@ -317,6 +468,7 @@ void OnlineIvectorFeature::UpdateStatsUntilFrameWeighted(int32 frame) {
 
 void OnlineIvectorFeature::GetFrame(int32 frame,
                                     VectorBase<BaseFloat> *feat) {
+  KALDI_TRACE_SPAN("OnlineIvectorFeature::GetFrame");
   int32 frame_to_update_until = (info_.greedy_ivector_extractor ?
                                  lda_->NumFramesReady() - 1 : frame);
   if (!delta_weights_provided_)  // No silence weighting.
@@ -338,6 +490,11 @@ void OnlineIvectorFeature::GetFrame(int32 frame,
     (*feat)(0) -= info_.extractor.PriorOffset();
   } else {
     int32 i = frame / info_.ivector_period;  // rounds down.
+    if (i < num_ivectors_discarded_)
+      KALDI_ERR << "Requested the iVector for frame " << frame << ", which is "
+                << "too far in the past for max-retained-frames = "
+                << info_.max_retained_frames;
+    i -= num_ivectors_discarded_;
     // if the following fails, UpdateStatsUntilFrame would have a bug.
     KALDI_ASSERT(static_cast<size_t>(i) <  ivectors_history_.size());
     feat->CopyFromVec(*(ivectors_history_[i]));
@@ -397,14 +554,16 @@ OnlineIvectorFeature::OnlineIvectorFeature(
                    info_.max_count),
     num_frames_stats_(0), delta_weights_provided_(false),
     updated_with_no_delta_weights_(false),
-    most_recent_frame_with_weight_(-1), tot_ubm_loglike_(0.0) {
+    most_recent_frame_with_weight_(-1), tot_ubm_loglike_(0.0),
+    num_ubm_cache_discarded_(0), num_ivectors_discarded_(0) {
   info.Check();
   KALDI_ASSERT(base_feature != NULL);
   OnlineFeatureInterface *splice_feature = new OnlineSpliceFrames(info_.splice_opts, base_feature);
   to_delete_.push_back(splice_feature);
   OnlineFeatureInterface *lda_feature = new OnlineTransform(info.lda_mat, splice_feature);
   to_delete_.push_back(lda_feature);
-  OnlineFeatureInterface *lda_cache_feature = new OnlineCacheFeature(lda_feature);
+  OnlineFeatureInterface *lda_cache_feature =
+      new OnlineCacheFeature(lda_feature, info.max_retained_frames);
   lda_ = lda_cache_feature;
   to_delete_.push_back(lda_cache_feature);
 
@@ -414,14 +573,17 @@ OnlineIvectorFeature::OnlineIvectorFeature(
   // about the speaker.  If you want to inform this class about more specific
   // adaptation state, call this->SetAdaptationState(), most likely derived
   // from a call to GetAdaptationState() from a previous object of this type.
-  cmvn_ = new OnlineCmvn(info.cmvn_opts, naive_cmvn_state, base_feature);
+  OnlineCmvnOptions cmvn_opts(info.cmvn_opts);
+  cmvn_opts.max_retained_frames = info.max_retained_frames;
+  cmvn_ = new OnlineCmvn(cmvn_opts, naive_cmvn_state, base_feature);
   to_delete_.push_back(cmvn_);
 
   OnlineFeatureInterface *splice_normalized =
       new OnlineSpliceFrames(info_.splice_opts, cmvn_),
       *lda_normalized =
       new OnlineTransform(info.lda_mat, splice_normalized),
-      *cache_normalized = new OnlineCacheFeature(lda_normalized);
+      *cache_normalized = new OnlineCacheFeature(lda_normalized,
+                                                 info.max_retained_frames);
   lda_normalized_ = cache_normalized;
 
   to_delete_.push_back(splice_normalized);
@@ -526,6 +688,9 @@ void OnlineSilenceWeighting::ComputeCurrentTraceback<fst::Fst<fst::StdArc> >(
 template
 void OnlineSilenceWeighting::ComputeCurrentTraceback<fst::GrammarFst>(
     const LatticeFasterOnlineDecoderTpl<fst::GrammarFst> &decoder);
+template
+void OnlineSilenceWeighting::ComputeCurrentTraceback<fst::CsrFst>(
+    const LatticeFasterOnlineDecoderTpl<fst::CsrFst> &decoder);
 
 void OnlineSilenceWeighting::GetDeltaWeights(
     int32 num_frames_ready, int32 first_decoder_frame,
@@ -82,6 +82,19 @@ struct OnlineIvectorExtractionConfig {
   int32 num_cg_iters;  // set to 15.  I don't believe this is very important, so it's
                        // not configurable from the command line for now.
 
+  BaseFloat cg_tolerance;  // If >0, stop the conjugate gradient early once the
+                           // residual is this small relative to the linear
+                           // term; as each solve starts from the previous
+                           // iVector, this usually takes only a few iterations.
+
+  // If num_gselect_preselect > 0, the Gaussian selection for each frame is
+  // done in two passes: a cheap first pass evaluates the UBM on only the first
+  // gselect_preselect_dim dimensions of the features (the LDA puts the most
+  // discriminative directions first), and keeps the best
+  // num_gselect_preselect Gaussians; only those are evaluated exactly.
+  int32 num_gselect_preselect;
+  int32 gselect_preselect_dim;
+
 
   // If use_most_recent_ivector is true, we always return the most recent
   // available iVector rather than the one for the current frame.  This means
@@ -105,6 +118,8 @@ struct OnlineIvectorExtractionConfig {
                                    ivector_period(10), num_gselect(5),
                                    min_post(0.025), posterior_scale(0.1),
                                    max_count(0.0), num_cg_iters(15),
+                                   cg_tolerance(0.0), num_gselect_preselect(0),
+                                   gselect_preselect_dim(10),
                                    use_most_recent_ivector(true),
                                    greedy_ivector_extractor(false),
                                    max_remembered_frames(1000) { }
@@ -147,6 +162,18 @@ struct OnlineIvectorExtractionConfig {
                    "iVectors from long utterances look more typical.  Interpret "
                    "as a frame-count times --posterior-scale, typically 1/10 of "
                    "a number of frames.  Suggest 100.");
+    opts->Register("cg-tolerance", &cg_tolerance, "If >0, stop the conjugate "
+                   "gradient iterations of each iVector estimate once the "
+                   "residual is this small relative to the linear term (e.g. "
+                   "0.01); they start from the previous iVector.");
+    opts->Register("num-gselect-preselect", &num_gselect_preselect, "If >0, "
+                   "number of Gaussians preselected by a cheap first pass over "
+                   "the first --gselect-preselect-dim feature dimensions; only "
+                   "these are evaluated exactly (e.g. 30).  Must be >= "
+                   "--num-gselect.");
+    opts->Register("gselect-preselect-dim", &gselect_preselect_dim, "Number of "
+                   "leading feature dimensions used in the first pass of "
+                   "Gaussian selection (see --num-gselect-preselect).");
     opts->Register("use-most-recent-ivector", &use_most_recent_ivector, "If true, "
                    "always use most recent available iVector, rather than the "
                    "one for the designated frame.");
@@ -177,6 +204,11 @@ struct OnlineIvectorExtractionInfo {
   DiagGmm diag_ubm;
   IvectorExtractor extractor;
 
+  // The marginal of diag_ubm over its first gselect_preselect_dim dimensions,
+  // used for the first pass of Gaussian selection; empty if
+  // num_gselect_preselect == 0.  Shared by all the streams using this object.
+  DiagGmm preselect_ubm;
+
   // the following configuration variables are copied from
   // OnlineIvectorExtractionConfig, see comments there.
   int32 ivector_period;
@@ -185,14 +217,28 @@ struct OnlineIvectorExtractionInfo {
   BaseFloat posterior_scale;
   BaseFloat max_count;
   int32 num_cg_iters;
+  BaseFloat cg_tolerance;
+  int32 num_gselect_preselect;
   bool use_most_recent_ivector;
   bool greedy_ivector_extractor;
   BaseFloat max_remembered_frames;
 
+  // Not from OnlineIvectorExtractionConfig: if > 0, the features, UBM
+  // posteriors and iVectors are only retained for about the most recent
+  // this-many frames, so that the memory used does not grow with the length of
+  // the stream.  Set by OnlineNnet2FeaturePipelineInfo from its
+  // --max-retained-frames option; -1 by default.
+  int32 max_retained_frames;
+
   OnlineIvectorExtractionInfo(const OnlineIvectorExtractionConfig &config);
 
   void Init(const OnlineIvectorExtractionConfig &config);
 
+  // Sets up preselect_ubm from diag_ubm; called from Init(), but if you
+  // set up this object yourself, call it after setting diag_ubm and
+  // num_gselect_preselect.
+  void InitPreselectUbm(int32 preselect_dim);
+
   // This constructor creates a version of this object where everything
   // is empty or zero.
   OnlineIvectorExtractionInfo();
@@ -319,6 +365,15 @@ class OnlineIvectorFeature: public OnlineFeatureInterface {
   void UpdateFrameWeights(
       const std::vector<std::pair<int32, BaseFloat> > &delta_weights);
 
+  /// Outputs the pruned posteriors of the UBM Gaussians for frame "frame" (as
+  /// used for the iVector stats, but before scaling by --posterior-scale) and
+  /// returns the UBM log-likelihood of the frame.  The UBM is evaluated at most
+  /// once per frame and the result is cached, so other consumers of the UBM
+  /// posteriors in the same pipeline (e.g. a GMM-based VAD) can get them here
+  /// instead of evaluating the UBM again.
+  BaseFloat GetUbmPosterior(
+      int32 frame, std::vector<std::pair<int32, BaseFloat> > *posterior);
+
  private:
 
   // This accumulates i-vector stats for a set of frames, specified as pairs
@@ -334,6 +389,25 @@ class OnlineIvectorFeature: public OnlineFeatureInterface {
   // very small counts).
   BaseFloat GetMinPost(BaseFloat weight) const;
 
+  // Sets preselect_ to the best info_.num_gselect_preselect Gaussians
+  // according to "approx_log_likes" (from info_.preselect_ubm), and
+  // preselect_log_likes_ to their exact log-likelihoods for "feat".
+  void PreselectGaussians(const VectorBase<BaseFloat> &feat,
+                          const VectorBase<BaseFloat> &approx_log_likes);
+
+  // Evaluates the UBM on those of "frames" that are not yet in ubm_cache_,
+  // all at once, and adds them to the cache.
+  void CacheUbmLogLikes(const std::vector<int32> &frames);
+
+  // Appends current_ivector_, estimated at frame t, to ivectors_history_.
+  void AppendIvectorHistory(int32 t);
+
+  // Gets the pruned posteriors of a frame that is in ubm_cache_, with the
+  // given pruning threshold; returns the log-likelihood of the frame.
+  BaseFloat GetCachedPosterior(
+      int32 frame, BaseFloat min_post,
+      std::vector<std::pair<int32, BaseFloat> > *posterior) const;
+
   // This is the original UpdateStatsUntilFrame that is called when there is
   // no data-weighting involved.
   void UpdateStatsUntilFrame(int32 frame);
@@ -395,6 +469,19 @@ class OnlineIvectorFeature: public OnlineFeatureInterface {
   /// The following is only needed for diagnostics.
   double tot_ubm_loglike_;
 
+  /// For each frame t on which the UBM was evaluated,
+  /// ubm_cache_[t - num_ubm_cache_discarded_] contains the Gaussians that
+  /// survived the pruning (with --min-post, i.e. at a weight of 1.0) and their
+  /// log-likelihoods; it is empty for frames not evaluated yet.  If
+  /// info_.max_retained_frames > 0, the oldest frames are discarded.
+  std::deque<std::vector<std::pair<int32, BaseFloat> > > ubm_cache_;
+  int32 num_ubm_cache_discarded_;
+
+  /// Temporaries for PreselectGaussians(), kept to avoid reallocation.
+  std::vector<std::pair<BaseFloat, int32> > preselect_scores_;
+  std::vector<int32> preselect_;
+  Vector<BaseFloat> preselect_log_likes_;
+
   /// Most recently estimated iVector, will have been
   /// estimated at the greatest time t where t <= num_frames_stats_ and
   /// t % info_.ivector_period == 0.
@@ -403,9 +490,11 @@ class OnlineIvectorFeature: public OnlineFeatureInterface {
   /// if info_.use_most_recent_ivector == false, we need to store
   /// the iVector we estimated each info_.ivector_period frames so that
   /// GetFrame() can return the iVector that was active on that frame.
-  /// ivectors_history_[i] contains the iVector we estimated on
-  /// frame t = i * info_.ivector_period.
-  std::vector<Vector<BaseFloat>* > ivectors_history_;
+  /// ivectors_history_[i - num_ivectors_discarded_] contains the iVector we
+  /// estimated on frame t = i * info_.ivector_period.  If
+  /// info_.max_retained_frames > 0, the oldest iVectors are discarded.
+  std::deque<Vector<BaseFloat>* > ivectors_history_;
+  int32 num_ivectors_discarded_;
 
 };
 
@@ -477,7 +566,8 @@ class OnlineSilenceWeighting {
   // This should be called before GetDeltaWeights, so this class knows about the
   // traceback info from the decoder.  It records the traceback information from
   // the decoder using its BestPathEnd() and related functions.
-  // It will be instantiated for FST == fst::Fst<fst::StdArc> and fst::GrammarFst.
+  // It will be instantiated for FST == fst::Fst<fst::StdArc>, fst::GrammarFst
+  // and fst::CsrFst.
   template <typename FST>
   void ComputeCurrentTraceback(const LatticeFasterOnlineDecoderTpl<FST> &decoder);
 
@@ -116,8 +116,10 @@ SingleUtteranceNnet2DecoderThreaded::SingleUtteranceNnet2DecoderThreaded(
     const fst::Fst<fst::StdArc> &fst,
     const OnlineNnet2FeaturePipelineInfo &feature_info,
     const OnlineIvectorExtractorAdaptationState &adaptation_state,
-    const OnlineCmvnState &cmvn_state):
-  config_(config), am_nnet_(am_nnet), tmodel_(tmodel), sampling_rate_(0.0),
+    const OnlineCmvnState &cmvn_state,
+    nnet2::NnetOnlineBatchComputer *batch_computer):
+  config_(config), am_nnet_(am_nnet), batch_computer_(batch_computer),
+  tmodel_(tmodel), sampling_rate_(0.0),
   num_samples_received_(0), input_finished_(false),
   feature_pipeline_(feature_info),
   num_samples_discarded_(0),
@@ -549,7 +551,10 @@ bool SingleUtteranceNnet2DecoderThreaded::RunNnetEvaluationInternal() {
                               // this would be a lightweight operation, swapping
                               // pointers.
 
-      computer.Compute(cu_feats, &cu_loglikes);
+      if (batch_computer_ != NULL)
+        batch_computer_->Compute(&computer, cu_feats, &cu_loglikes);
+      else
+        computer.Compute(cu_feats, &cu_loglikes);
       num_frames_consumed += cu_feats.NumRows();
       ProcessLoglikes(log_inv_prior, &cu_loglikes);
     }
@@ -32,6 +32,7 @@
 #include "base/kaldi-error.h"
 #include "decoder/decodable-matrix.h"
 #include "nnet2/am-nnet.h"
+#include "nnet2/nnet-batch-compute-online.h"
 #include "online2/online-nnet2-feature-pipeline.h"
 #include "online2/online-endpoint.h"
 #include "decoder/lattice-faster-online-decoder.h"
@@ -194,6 +195,10 @@ class SingleUtteranceNnet2DecoderThreaded {
   // controlled by a mutex and this class knows how to handle that.  The
   // feature_info and adaptation_state arguments are used to initialize the
   // (locally owned) feature pipeline.
+  // If batch_computer is non-NULL (it must have been constructed with
+  // am_nnet.GetNnet()), the neural net computation is done by its shared
+  // worker thread, batched with that of the other utterances being decoded,
+  // rather than in this object's own nnet-evaluation thread.
   SingleUtteranceNnet2DecoderThreaded(
       const OnlineNnet2DecodingThreadedConfig &config,
       const TransitionModel &tmodel,
@@ -201,7 +206,8 @@ class SingleUtteranceNnet2DecoderThreaded {
       const fst::Fst<fst::StdArc> &fst,
       const OnlineNnet2FeaturePipelineInfo &feature_info,
       const OnlineIvectorExtractorAdaptationState &adaptation_state,
-      const OnlineCmvnState &cmvn_state);
+      const OnlineCmvnState &cmvn_state,
+      nnet2::NnetOnlineBatchComputer *batch_computer = NULL);
 
 
 
@@ -352,6 +358,8 @@ class SingleUtteranceNnet2DecoderThreaded {
 
   const nnet2::AmNnet &am_nnet_;
 
+  nnet2::NnetOnlineBatchComputer *batch_computer_;  // not owned; may be NULL.
+
   const TransitionModel &tmodel_;
 
 
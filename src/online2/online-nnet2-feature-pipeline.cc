@@ -83,6 +83,27 @@ OnlineNnet2FeaturePipelineInfo::OnlineNnet2FeaturePipelineInfo(
   } else {
     use_ivectors = false;
   }
+
+  max_retained_frames = config.max_retained_frames;
+  if (max_retained_frames > 0) {
+    // The CMVN looks back cmn_window frames, and the silence weighting may
+    // revise the weights of the last 100 or so frames, plus we need some
+    // margin for the decoder's chunk size.
+    int32 min_frames = 200 + std::max(
+        use_cmvn ? cmvn_opts.cmn_window : 0,
+        use_ivectors ? ivector_extractor_info.cmvn_opts.cmn_window : 0);
+    if (max_retained_frames < min_frames)
+      KALDI_ERR << "--max-retained-frames=" << max_retained_frames
+                << " is too small; it should be at least " << min_frames;
+    mfcc_opts.frame_opts.max_feature_vectors = max_retained_frames;
+    plp_opts.frame_opts.max_feature_vectors = max_retained_frames;
+    fbank_opts.frame_opts.max_feature_vectors = max_retained_frames;
+    cmvn_opts.max_retained_frames = max_retained_frames;
+    ivector_extractor_info.max_retained_frames = max_retained_frames;
+    if (add_pitch)
+      KALDI_WARN << "--max-retained-frames does not limit the memory used by "
+                 << "the pitch post-processing (a few bytes per frame).";
+  }
 }
 
 
@@ -107,7 +128,25 @@ OnlineNnet2FeaturePipeline::OnlineNnet2FeaturePipeline(
   } else {
     KALDI_ERR << "Code error: invalid feature type " << info_.feature_type;
   }
+  Init();
+}
+
+OnlineNnet2FeaturePipeline::OnlineNnet2FeaturePipeline(
+    const OnlineNnet2FeaturePipelineInfo &info,
+    OnlineBaseFeature *base_feature):
+    info_(info), base_feature_(base_feature),
+    pitch_(NULL), pitch_feature_(NULL),
+    cmvn_feature_(NULL),
+    feature_plus_optional_pitch_(NULL),
+    feature_plus_optional_cmvn_(NULL),
+    ivector_feature_(NULL),
+    nnet3_feature_(NULL),
+    final_feature_(NULL) {
+  KALDI_ASSERT(base_feature != NULL);
+  Init();
+}
 
+void OnlineNnet2FeaturePipeline::Init() {
   if (info_.add_pitch) {
     pitch_ = new OnlinePitchFeature(info_.pitch_opts);
     pitch_feature_ = new OnlineProcessPitch(info_.pitch_process_opts,
@@ -119,8 +158,8 @@ OnlineNnet2FeaturePipeline::OnlineNnet2FeaturePipeline(
   }
 
   if (info_.use_cmvn) {
-    KALDI_ASSERT(info.global_cmvn_stats_rxfilename != "");
-    ReadKaldiObject(info.global_cmvn_stats_rxfilename, &global_cmvn_stats_);
+    KALDI_ASSERT(info_.global_cmvn_stats_rxfilename != "");
+    ReadKaldiObject(info_.global_cmvn_stats_rxfilename, &global_cmvn_stats_);
     OnlineCmvnState initial_state(global_cmvn_stats_);
     cmvn_feature_ = new OnlineCmvn(info_.cmvn_opts, initial_state,
         feature_plus_optional_pitch_);
@@ -94,8 +94,12 @@ struct OnlineNnet2FeaturePipelineConfig {
   // play with it in test time.
   OnlineSilenceWeightingConfig silence_weighting_config;
 
+  // If > 0, bounded-memory mode for very long (e.g. 24/7) streams: each part
+  // of the pipeline only retains about this many of the most recent frames.
+  int32 max_retained_frames;
+
   OnlineNnet2FeaturePipelineConfig():
-      feature_type("mfcc"), add_pitch(false) { }
+      feature_type("mfcc"), add_pitch(false), max_retained_frames(-1) { }
 
 
   void Register(OptionsItf *opts) {
@@ -123,6 +127,13 @@ struct OnlineNnet2FeaturePipelineConfig {
                    "Configuration file for online iVector extraction, "
                    "see class OnlineIvectorExtractionConfig in the code");
     silence_weighting_config.RegisterWithPrefix("ivector-silence-weighting", opts);
+    opts->Register("max-retained-frames", &max_retained_frames, "If >0, the "
+                   "feature pipeline only retains this many of the most recent "
+                   "frames (of features, CMVN stats, iVectors and so on), so "
+                   "its memory use does not grow with the length of the "
+                   "stream; older frames can no longer be requested.  Must "
+                   "exceed the --cmn-window of the CMVN configs by at least "
+                   "200 frames.");
   }
 };
 
@@ -137,7 +148,8 @@ struct OnlineNnet2FeaturePipelineConfig {
 /// command line, as well as for easier multithreaded operation.
 struct OnlineNnet2FeaturePipelineInfo {
   OnlineNnet2FeaturePipelineInfo():
-      feature_type("mfcc"), add_pitch(false), use_cmvn(false) { }
+      feature_type("mfcc"), add_pitch(false), use_cmvn(false),
+      max_retained_frames(-1) { }
 
   OnlineNnet2FeaturePipelineInfo(
       const OnlineNnet2FeaturePipelineConfig &config);
@@ -176,6 +188,10 @@ struct OnlineNnet2FeaturePipelineInfo {
   /// on the command line instead of inside sub-config-files.
   OnlineSilenceWeightingConfig silence_weighting_config;
 
+  /// If > 0, bounded-memory mode; see --max-retained-frames.  This has
+  /// already been applied to the options of the parts of the pipeline.
+  int32 max_retained_frames;
+
   int32 IvectorDim() { return ivector_extractor_info.extractor.IvectorDim(); }
  private:
   KALDI_DISALLOW_COPY_AND_ASSIGN(OnlineNnet2FeaturePipelineInfo);
@@ -203,6 +219,13 @@ class OnlineNnet2FeaturePipeline: public OnlineFeatureInterface {
   explicit OnlineNnet2FeaturePipeline(
       const OnlineNnet2FeaturePipelineInfo &info);
 
+  /// This version uses 'base_feature' in place of the MFCC/PLP/filterbank
+  /// features of info.feature_type, e.g. an OnlineCudaFeatureClient that
+  /// computes them on a GPU (see cudafeat/cuda-feature-server.h).  It takes
+  /// ownership of 'base_feature'.
+  OnlineNnet2FeaturePipeline(const OnlineNnet2FeaturePipelineInfo &info,
+                             OnlineBaseFeature *base_feature);
+
   /// Member functions from OnlineFeatureInterface:
 
   /// Dim() will return the base-feature dimension (e.g. 13 for normal MFCC);
@@ -288,6 +311,10 @@ class OnlineNnet2FeaturePipeline: public OnlineFeatureInterface {
   virtual ~OnlineNnet2FeaturePipeline();
 
  private:
+  // Called from the constructors after base_feature_ is set; creates the
+  // rest of the pipeline.
+  void Init();
+
   const OnlineNnet2FeaturePipelineInfo &info_;
 
   OnlineBaseFeature *base_feature_;    /// MFCC/PLP/filterbank
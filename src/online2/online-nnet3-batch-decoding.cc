@@ -0,0 +1,353 @@
+// online2/online-nnet3-batch-decoding.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+
+#include "online2/online-nnet3-batch-decoding.h"
+#include "lat/determinize-lattice-pruned.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+
+OnlineNnet3BatchDecoder::OnlineNnet3BatchDecoder(
+    const OnlineNnet3BatchDecoderConfig &config,
+    const nnet3::NnetBatchComputerOptions &compute_opts,
+    const LatticeFasterDecoderConfig &decoder_opts,
+    const OnlineNnet2FeaturePipelineInfo &feature_info,
+    const TransitionModel &trans_model,
+    const nnet3::AmNnetSimple &am_nnet,
+    const fst::Fst<fst::StdArc> &fst):
+    config_(config), decoder_opts_(decoder_opts), feature_info_(feature_info),
+    trans_model_(trans_model), fst_(fst),
+    computer_(compute_opts, am_nnet.GetNnet(), am_nnet.Priors()),
+    next_stream_id_(0), num_pending_chunks_(0), num_chunks_total_(0),
+    is_finished_(false), thread_pool_(config.num_decoder_threads) {
+  config.Check();
+  // NnetBatchComputer may have changed frames_per_chunk, so we take the
+  // options from it.
+  const nnet3::NnetBatchComputerOptions &opts = computer_.GetOptions();
+  frames_per_chunk_ = opts.frames_per_chunk;
+  frame_subsampling_factor_ = opts.frame_subsampling_factor;
+  minibatch_size_ = opts.minibatch_size;
+  int32 nnet_left_context, nnet_right_context;
+  nnet3::ComputeSimpleNnetContext(am_nnet.GetNnet(), &nnet_left_context,
+                                  &nnet_right_context);
+  // We use the same context for all chunks, so that they can all go in the
+  // same minibatches; --extra-left-context-initial and
+  // --extra-right-context-final are not used.
+  left_context_ = nnet_left_context + opts.extra_left_context;
+  right_context_ = nnet_right_context + opts.extra_right_context;
+  compute_thread_ = std::thread(&OnlineNnet3BatchDecoder::Compute, this);
+}
+
+int32 OnlineNnet3BatchDecoder::OpenStream() {
+  Stream *stream = new Stream(feature_info_, trans_model_, decoder_opts_,
+                              fst_);
+  std::lock_guard<std::mutex> lock(streams_mutex_);
+  int32 stream_id = next_stream_id_++;
+  streams_[stream_id] = stream;
+  return stream_id;
+}
+
+OnlineNnet3BatchDecoder::Stream *OnlineNnet3BatchDecoder::GetStream(
+    int32 stream_id) {
+  std::lock_guard<std::mutex> lock(streams_mutex_);
+  std::unordered_map<int32, Stream*>::iterator iter = streams_.find(stream_id);
+  if (iter == streams_.end())
+    KALDI_ERR << "No such stream " << stream_id;
+  return iter->second;
+}
+
+void OnlineNnet3BatchDecoder::AcceptWaveform(
+    int32 stream_id, BaseFloat sampling_rate,
+    const VectorBase<BaseFloat> &waveform) {
+  Stream *stream = GetStream(stream_id);
+  std::lock_guard<std::mutex> lock(stream->mutex);
+  if (stream->input_finished)
+    KALDI_ERR << "AcceptWaveform() called after InputFinished()";
+  stream->features.AcceptWaveform(sampling_rate, waveform);
+  CreateChunks(stream);
+}
+
+void OnlineNnet3BatchDecoder::InputFinished(int32 stream_id) {
+  Stream *stream = GetStream(stream_id);
+  std::lock_guard<std::mutex> lock(stream->mutex);
+  if (stream->input_finished)
+    return;
+  stream->features.InputFinished();
+  stream->input_finished = true;
+  CreateChunks(stream);
+  // This makes sure the decoding gets finalized even if there were no
+  // chunks.
+  ScheduleDecode(stream);
+}
+
+void OnlineNnet3BatchDecoder::CreateChunks(Stream *stream) {
+  OnlineFeatureInterface *input_feature = stream->features.InputFeature(),
+      *ivector_feature = stream->features.IvectorFeature();
+  int32 f = frame_subsampling_factor_,
+      num_output_frames_per_chunk = frames_per_chunk_ / f,
+      num_frames_ready = input_feature->NumFramesReady();
+  while (true) {
+    int32 begin_input_t = stream->num_output_frames * f,
+        end_input_t = begin_input_t + frames_per_chunk_,
+        num_used_output_frames;
+    if (num_frames_ready >= end_input_t + right_context_) {
+      num_used_output_frames = num_output_frames_per_chunk;
+    } else if (stream->input_finished && num_frames_ready > begin_input_t) {
+      // The last chunk; as in NnetBatchComputer::SplitUtteranceIntoTasks()
+      // with --ensure-exact-final-context=false, we pad it with the last
+      // frame.
+      num_used_output_frames = std::min(
+          num_output_frames_per_chunk,
+          (num_frames_ready - begin_input_t + f - 1) / f);
+    } else {
+      break;
+    }
+    Chunk *chunk = new Chunk();
+    nnet3::NnetInferenceTask &task = chunk->task;
+    task.first_input_t = -left_context_;
+    task.output_t_stride = f;
+    task.num_output_frames = num_output_frames_per_chunk;
+    task.num_initial_unused_output_frames = 0;
+    task.num_used_output_frames = num_used_output_frames;
+    task.first_used_output_frame_index = stream->num_output_frames;
+    task.is_edge = false;
+    task.is_irregular = false;
+    task.output_to_cpu = true;
+
+    int32 begin_input_t_padded = begin_input_t - left_context_,
+        end_input_t_padded = end_input_t + right_context_;
+    std::vector<int32> frames(end_input_t_padded - begin_input_t_padded);
+    for (size_t i = 0; i < frames.size(); i++)
+      frames[i] = std::max<int32>(0, std::min<int32>(
+          begin_input_t_padded + static_cast<int32>(i),
+          num_frames_ready - 1));
+    Matrix<BaseFloat> input(frames.size(), input_feature->Dim(), kUndefined);
+    input_feature->GetFrames(frames, &input);
+    task.input.Swap(&input);
+    if (ivector_feature != NULL) {
+      // As in DecodableNnetLoopedOnline, use the latest i-vector that the
+      // chunk's input covers.
+      int32 ivector_frame = std::min(end_input_t_padded,
+                                     ivector_feature->NumFramesReady()) - 1;
+      KALDI_ASSERT(ivector_frame >= 0);
+      Vector<BaseFloat> ivector(ivector_feature->Dim());
+      ivector_feature->GetFrame(ivector_frame, &ivector);
+      task.ivector.Resize(ivector.Dim(), kUndefined);
+      task.ivector.CopyFromVec(ivector);
+    }
+
+    stream->num_output_frames += num_used_output_frames;
+    stream->chunks.push_back(chunk);
+    {
+      std::lock_guard<std::mutex> lock(compute_mutex_);
+      // Earlier chunks have higher priority, to bound the latency.
+      task.priority = -static_cast<double>(num_chunks_total_++);
+      num_pending_chunks_++;
+    }
+    computer_.AcceptTask(&task);
+    compute_cond_.notify_one();
+  }
+}
+
+void OnlineNnet3BatchDecoder::ScheduleDecode(Stream *stream) {
+  if (!stream->decode_scheduled) {
+    stream->decode_scheduled = true;
+    thread_pool_.Submit([this, stream]() { DecodeStream(stream); });
+  }
+}
+
+void OnlineNnet3BatchDecoder::DecodeStream(Stream *stream) {
+  std::unique_lock<std::mutex> decoder_lock(stream->decoder_mutex);
+  while (true) {
+    std::vector<Chunk*> done_chunks;
+    {
+      std::lock_guard<std::mutex> lock(stream->mutex);
+      while (!stream->chunks.empty() && stream->chunks.front()->done) {
+        done_chunks.push_back(stream->chunks.front());
+        stream->chunks.pop_front();
+      }
+      if (done_chunks.empty() &&
+          !(stream->input_finished && stream->chunks.empty())) {
+        // Wait for DispatchDoneChunks() to schedule us again.
+        stream->decode_scheduled = false;
+        return;
+      }
+    }
+    if (done_chunks.empty()) {
+      // The whole stream has been decoded.
+      stream->decodable.InputIsFinished();
+      stream->decoder.FinalizeDecoding();
+      // We must not touch 'stream' once 'finished' is set, except for
+      // unlocking stream->mutex, as CloseStream() may delete it.
+      decoder_lock.unlock();
+      std::lock_guard<std::mutex> lock(stream->mutex);
+      stream->finished = true;
+      stream->decode_scheduled = false;
+      stream->finished_cond.notify_all();
+      return;
+    }
+    for (size_t i = 0; i < done_chunks.size(); i++) {
+      const nnet3::NnetInferenceTask &task = done_chunks[i]->task;
+      Matrix<BaseFloat> loglikes(task.output_cpu.RowRange(
+          task.num_initial_unused_output_frames,
+          task.num_used_output_frames));
+      int32 frames_to_discard = stream->decoder.NumFramesDecoded() -
+          stream->decodable.FirstAvailableFrame();
+      stream->decodable.AcceptLoglikes(&loglikes, frames_to_discard);
+      delete done_chunks[i];
+    }
+    stream->decoder.AdvanceDecoding(&stream->decodable);
+  }
+}
+
+void OnlineNnet3BatchDecoder::Compute() {
+  while (true) {
+    bool computed = computer_.Compute(false);
+    if (!computed) {
+      std::unique_lock<std::mutex> lock(compute_mutex_);
+      if (num_pending_chunks_ == 0) {
+        if (is_finished_)
+          return;
+        compute_cond_.wait(lock);
+        continue;
+      }
+      // Wait for a full minibatch, but not for more than max_batch_wait.
+      // All the chunks have the same structure, so they all go in the same
+      // minibatches.
+      compute_cond_.wait_for(
+          lock, std::chrono::duration<double>(config_.max_batch_wait),
+          [this]() { return is_finished_ ||
+                num_pending_chunks_ >= minibatch_size_; });
+      lock.unlock();
+      computed = computer_.Compute(true);
+    }
+    if (computed)
+      DispatchDoneChunks();
+  }
+}
+
+void OnlineNnet3BatchDecoder::DispatchDoneChunks() {
+  int32 num_done = 0;
+  {
+    std::lock_guard<std::mutex> lock(streams_mutex_);
+    std::unordered_map<int32, Stream*>::iterator iter = streams_.begin(),
+        end = streams_.end();
+    for (; iter != end; ++iter) {
+      Stream *stream = iter->second;
+      std::lock_guard<std::mutex> stream_lock(stream->mutex);
+      bool any_done = false;
+      for (size_t i = 0; i < stream->chunks.size(); i++) {
+        Chunk *chunk = stream->chunks[i];
+        if (!chunk->done && chunk->task.semaphore.TryWait()) {
+          chunk->done = true;
+          any_done = true;
+          num_done++;
+        }
+      }
+      if (any_done && stream->chunks.front()->done)
+        ScheduleDecode(stream);
+    }
+  }
+  std::lock_guard<std::mutex> lock(compute_mutex_);
+  num_pending_chunks_ -= num_done;
+}
+
+bool OnlineNnet3BatchDecoder::GetBestPath(int32 stream_id,
+                                          Lattice *best_path) {
+  Stream *stream = GetStream(stream_id);
+  std::lock_guard<std::mutex> decoder_lock(stream->decoder_mutex);
+  if (stream->decoder.NumFramesDecoded() == 0) {
+    best_path->DeleteStates();
+    return false;
+  }
+  bool use_final_probs;
+  {
+    std::lock_guard<std::mutex> lock(stream->mutex);
+    // After FinalizeDecoding() we are not allowed to ask for no final-probs.
+    use_final_probs = stream->finished;
+  }
+  return stream->decoder.GetBestPath(best_path, use_final_probs);
+}
+
+bool OnlineNnet3BatchDecoder::GetLattice(int32 stream_id,
+                                         CompactLattice *clat) {
+  Stream *stream = GetStream(stream_id);
+  {
+    std::unique_lock<std::mutex> lock(stream->mutex);
+    if (!stream->input_finished)
+      KALDI_ERR << "You must call InputFinished() before GetLattice()";
+    while (!stream->finished)
+      stream->finished_cond.wait(lock);
+  }
+  std::lock_guard<std::mutex> decoder_lock(stream->decoder_mutex);
+  clat->DeleteStates();
+  if (stream->decoder.NumFramesDecoded() == 0)
+    return false;
+  if (!decoder_opts_.determinize_lattice)
+    KALDI_ERR << "--determinize-lattice=false option is not supported at the moment";
+  Lattice raw_lat;
+  stream->decoder.GetRawLattice(&raw_lat, true);
+  DeterminizeLatticePhonePrunedWrapper(
+      trans_model_, &raw_lat, decoder_opts_.lattice_beam, clat,
+      decoder_opts_.det_opts);
+  return true;
+}
+
+void OnlineNnet3BatchDecoder::CloseStream(int32 stream_id) {
+  InputFinished(stream_id);
+  Stream *stream = GetStream(stream_id);
+  {
+    std::unique_lock<std::mutex> lock(stream->mutex);
+    while (!stream->finished)
+      stream->finished_cond.wait(lock);
+  }
+  {
+    std::lock_guard<std::mutex> lock(streams_mutex_);
+    streams_.erase(stream_id);
+  }
+  delete stream;
+}
+
+OnlineNnet3BatchDecoder::~OnlineNnet3BatchDecoder() {
+  std::vector<int32> stream_ids;
+  {
+    std::lock_guard<std::mutex> lock(streams_mutex_);
+    std::unordered_map<int32, Stream*>::iterator iter = streams_.begin(),
+        end = streams_.end();
+    for (; iter != end; ++iter)
+      stream_ids.push_back(iter->first);
+  }
+  if (!stream_ids.empty()) {
+    KALDI_WARN << "Closing " << stream_ids.size() << " streams that were "
+               << "still open.";
+    for (size_t i = 0; i < stream_ids.size(); i++)
+      CloseStream(stream_ids[i]);
+  }
+  {
+    std::lock_guard<std::mutex> lock(compute_mutex_);
+    is_finished_ = true;
+  }
+  compute_cond_.notify_all();
+  compute_thread_.join();
+  // thread_pool_'s destructor waits for any decoding still running.
+}
+
+}  // namespace kaldi
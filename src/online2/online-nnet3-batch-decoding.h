@@ -0,0 +1,236 @@
+// online2/online-nnet3-batch-decoding.h
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_ONLINE2_ONLINE_NNET3_BATCH_DECODING_H_
+#define KALDI_ONLINE2_ONLINE_NNET3_BATCH_DECODING_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "decoder/decodable-matrix.h"
+#include "decoder/lattice-faster-online-decoder.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-batch-compute.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+/// @addtogroup  onlinedecoding OnlineDecoding
+/// @{
+
+
+struct OnlineNnet3BatchDecoderConfig {
+  int32 num_decoder_threads;
+  BaseFloat max_batch_wait;
+
+  OnlineNnet3BatchDecoderConfig(): num_decoder_threads(4),
+                                   max_batch_wait(0.05) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("num-decoder-threads", &num_decoder_threads,
+                   "Number of threads that do the graph search for all the "
+                   "streams (the neural net is computed in one more thread).");
+    opts->Register("max-batch-wait", &max_batch_wait,
+                   "Maximum time in seconds that a chunk of a stream waits "
+                   "for a full minibatch (--minibatch-size chunks) before it is "
+                   "computed in a partial minibatch.  This bounds the latency "
+                   "added by batching, at the expense of efficiency.");
+  }
+  void Check() const {
+    KALDI_ASSERT(num_decoder_threads > 0 && max_batch_wait >= 0.0);
+  }
+};
+
+
+/**
+   OnlineNnet3BatchDecoder decodes many audio streams at once on CPU, sharing
+   one acoustic model and one decoding graph between them.  It is intended for
+   servers that handle many concurrent connections (see
+   ../online2bin/online2-tcp-nnet3-decode-faster-batched.cc).
+
+   Each stream has its own feature pipeline and LatticeFasterOnlineDecoder.
+   As audio arrives, the features are cut into chunks of
+   --frames-per-chunk frames (with left and right context, as in
+   nnet3-latgen-faster, not the "looped" computation of
+   SingleUtteranceNnet3Decoder) and given to one NnetBatchComputer, whose
+   thread computes the chunks of all the streams together in minibatches.
+   When a stream's chunks are done, the search for it is run on a ThreadPool.
+
+   The latency of a stream's output, beyond the time for the audio of a chunk
+   plus the right context to arrive, is bounded by --max-batch-wait plus the
+   time to compute a minibatch and decode a chunk, as long as the machine
+   keeps up with the total load.
+
+   Streams are identified by the integer returned by OpenStream().  All the
+   functions may be called from any thread, but calls for the same stream
+   should not be concurrent.
+*/
+class OnlineNnet3BatchDecoder {
+ public:
+  /// The constructor stores references to all its arguments, so they must
+  /// outlive this object.  'am_nnet' should be ready for decoding (e.g. with
+  /// SetBatchnormTestMode() and CollapseModel() done).
+  OnlineNnet3BatchDecoder(
+      const OnlineNnet3BatchDecoderConfig &config,
+      const nnet3::NnetBatchComputerOptions &compute_opts,
+      const LatticeFasterDecoderConfig &decoder_opts,
+      const OnlineNnet2FeaturePipelineInfo &feature_info,
+      const TransitionModel &trans_model,
+      const nnet3::AmNnetSimple &am_nnet,
+      const fst::Fst<fst::StdArc> &fst);
+
+  /// Starts a new stream and returns its id.
+  int32 OpenStream();
+
+  /// Gives more audio to a stream.  It does not wait for it to be decoded.
+  void AcceptWaveform(int32 stream_id, BaseFloat sampling_rate,
+                      const VectorBase<BaseFloat> &waveform);
+
+  /// Says that there is no more audio for the stream.
+  void InputFinished(int32 stream_id);
+
+  /// Outputs the best path through what has been decoded of the stream so far
+  /// (without final-probs).  Returns false if nothing was decoded yet.
+  bool GetBestPath(int32 stream_id, Lattice *best_path);
+
+  /// Waits until the whole stream is decoded and outputs its lattice,
+  /// determinized, with acoustic scaling in it as for
+  /// SingleUtteranceNnet3Decoder::GetLattice().  You must call
+  /// InputFinished() first.  Returns false if no frames were decoded.
+  bool GetLattice(int32 stream_id, CompactLattice *clat);
+
+  /// Frees the stream, first waiting for any computation for it to finish.
+  /// This must be called for all streams before the destructor.
+  void CloseStream(int32 stream_id);
+
+  ~OnlineNnet3BatchDecoder();
+
+ private:
+  struct Chunk {
+    nnet3::NnetInferenceTask task;
+    // Set by the computation thread once task.semaphore has been signaled.
+    bool done;
+    Chunk(): done(false) { }
+  };
+
+  struct Stream {
+    OnlineNnet2FeaturePipeline features;
+    DecodableMatrixMappedOffset decodable;
+    LatticeFasterOnlineDecoder decoder;
+
+    // 'mutex' guards the members below it, up to decoder_mutex.
+    std::mutex mutex;
+    // The chunks given to the NnetBatchComputer whose output has not yet
+    // been given to 'decodable', in order.
+    std::deque<Chunk*> chunks;
+    // The number of subsampled output frames covered by the chunks created
+    // so far.
+    int32 num_output_frames;
+    bool input_finished;
+    // True while DecodeStream() is queued or running for this stream.
+    bool decode_scheduled;
+    // True once decoding is finalized; signaled by 'finished_cond'.
+    bool finished;
+    std::condition_variable finished_cond;
+
+    // Held by DecodeStream() while it uses 'decodable' and 'decoder', and by
+    // GetBestPath() and GetLattice().
+    std::mutex decoder_mutex;
+
+    Stream(const OnlineNnet2FeaturePipelineInfo &feature_info,
+           const TransitionModel &trans_model,
+           const LatticeFasterDecoderConfig &decoder_opts,
+           const fst::Fst<fst::StdArc> &fst):
+        features(feature_info), decodable(trans_model),
+        decoder(fst, decoder_opts), num_output_frames(0),
+        input_finished(false), decode_scheduled(false), finished(false) {
+      decoder.InitDecoding();
+    }
+  };
+
+  Stream *GetStream(int32 stream_id);
+
+  // Creates the chunks of 'stream' for which enough features are ready (or all
+  // the remaining ones, if stream->input_finished) and gives them to
+  // computer_.  Called with stream->mutex held.
+  void CreateChunks(Stream *stream);
+
+  // Makes sure DecodeStream() will run for this stream.  Called with
+  // stream->mutex held.
+  void ScheduleDecode(Stream *stream);
+
+  // Runs on thread_pool_: gives the output of the done chunks of the stream
+  // to its decoder and decodes them, and finalizes the decoding at the end of
+  // the stream.
+  void DecodeStream(Stream *stream);
+
+  // The function run by compute_thread_.
+  void Compute();
+
+  // Called by the computation thread after computing a minibatch; marks the
+  // chunks that were computed as done and schedules decoding for their
+  // streams.
+  void DispatchDoneChunks();
+
+  const OnlineNnet3BatchDecoderConfig &config_;
+  const LatticeFasterDecoderConfig &decoder_opts_;
+  const OnlineNnet2FeaturePipelineInfo &feature_info_;
+  const TransitionModel &trans_model_;
+  const fst::Fst<fst::StdArc> &fst_;
+
+  nnet3::NnetBatchComputer computer_;
+  int32 frames_per_chunk_;  // after NnetBatchComputer has fixed it.
+  int32 frame_subsampling_factor_;
+  int32 left_context_;  // includes --extra-left-context
+  int32 right_context_;  // includes --extra-right-context
+  int32 minibatch_size_;
+
+  // streams_mutex_ guards streams_ and next_stream_id_.  When both are
+  // needed, it is locked before any Stream::mutex.
+  std::mutex streams_mutex_;
+  std::unordered_map<int32, Stream*> streams_;
+  int32 next_stream_id_;
+
+  // compute_mutex_ guards the variables below, up to is_finished_.
+  std::mutex compute_mutex_;
+  std::condition_variable compute_cond_;
+  // The number of chunks given to computer_ and not yet computed.
+  int32 num_pending_chunks_;
+  // The number of chunks created so far; used for their priorities.
+  int64 num_chunks_total_;
+  bool is_finished_;
+
+  ThreadPool thread_pool_;
+  std::thread compute_thread_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(OnlineNnet3BatchDecoder);
+};
+
+
+/// @} End of "addtogroup onlinedecoding"
+
+}  // namespace kaldi
+
+#endif  // KALDI_ONLINE2_ONLINE_NNET3_BATCH_DECODING_H_
@@ -0,0 +1,72 @@
+// online2/online-nnet3-biglm-decoding.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "online2/online-nnet3-biglm-decoding.h"
+#include "lat/lattice-functions.h"
+#include "lat/determinize-lattice-pruned.h"
+
+namespace kaldi {
+
+SingleUtteranceNnet3BiglmDecoder::SingleUtteranceNnet3BiglmDecoder(
+    const LatticeBiglmFasterDecoderConfig &decoder_opts,
+    const TransitionModel &trans_model,
+    const nnet3::DecodableNnetSimpleLoopedInfo &info,
+    const fst::Fst<fst::StdArc> &fst,
+    fst::DeterministicOnDemandFst<fst::StdArc> *lm_diff_fst,
+    OnlineNnet2FeaturePipeline *features):
+    decoder_opts_(decoder_opts),
+    trans_model_(trans_model),
+    decodable_(trans_model_, info,
+               features->InputFeature(), features->IvectorFeature()),
+    decoder_(fst, decoder_opts_, lm_diff_fst) {
+  decoder_.InitDecoding();
+}
+
+void SingleUtteranceNnet3BiglmDecoder::InitDecoding(int32 frame_offset) {
+  decoder_.InitDecoding();
+  decodable_.SetFrameOffset(frame_offset);
+}
+
+void SingleUtteranceNnet3BiglmDecoder::AdvanceDecoding() {
+  decoder_.AdvanceDecoding(&decodable_);
+}
+
+void SingleUtteranceNnet3BiglmDecoder::FinalizeDecoding() {
+  decoder_.FinalizeDecoding();
+}
+
+void SingleUtteranceNnet3BiglmDecoder::GetLattice(bool end_of_utterance,
+                                                  CompactLattice *clat) const {
+  if (NumFramesDecoded() == 0)
+    KALDI_ERR << "You cannot get a lattice if you decoded no frames.";
+  Lattice raw_lat;
+  decoder_.GetRawLattice(&raw_lat, end_of_utterance);
+
+  if (!decoder_opts_.determinize_lattice)
+    KALDI_ERR << "--determinize-lattice=false option is not supported at the moment";
+
+  BaseFloat lat_beam = decoder_opts_.lattice_beam;
+  DeterminizeLatticePhonePrunedWrapper(
+      trans_model_, &raw_lat, lat_beam, clat, decoder_opts_.det_opts);
+}
+
+void SingleUtteranceNnet3BiglmDecoder::GetBestPath(bool end_of_utterance,
+                                                   Lattice *best_path) const {
+  decoder_.GetBestPath(best_path, end_of_utterance);
+}
+
+}  // namespace kaldi
@@ -0,0 +1,98 @@
+// online2/online-nnet3-biglm-decoding.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_ONLINE2_ONLINE_NNET3_BIGLM_DECODING_H_
+#define KALDI_ONLINE2_ONLINE_NNET3_BIGLM_DECODING_H_
+
+#include "nnet3/decodable-online-looped.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "decoder/lattice-biglm-faster-decoder.h"
+#include "hmm/transition-model.h"
+
+namespace kaldi {
+/// @addtogroup  onlinedecoding OnlineDecoding
+/// @{
+
+
+/**
+   This is as SingleUtteranceNnet3Decoder, but it uses LatticeBiglmFasterDecoder
+   to apply the difference between the language model the decoding graph was
+   compiled with and a different (typically larger) language model on the fly.
+   The difference LM 'lm_diff_fst' would typically be a
+   ComposeDeterministicOnDemandFst of the negated old LM (as a
+   BackoffDeterministicOnDemandFst) and the new LM (a
+   BackoffDeterministicOnDemandFst, or a ConstArpaLmDeterministicFst).  It is
+   not owned here, and since DeterministicOnDemandFst objects are not
+   thread-safe, it must not be shared between decoders used in different
+   threads.  Endpointing is not supported.
+*/
+class SingleUtteranceNnet3BiglmDecoder {
+ public:
+  // Constructor. The pointer 'features' is not being given to this class to own
+  // and deallocate, it is owned externally.
+  SingleUtteranceNnet3BiglmDecoder(
+      const LatticeBiglmFasterDecoderConfig &decoder_opts,
+      const TransitionModel &trans_model,
+      const nnet3::DecodableNnetSimpleLoopedInfo &info,
+      const fst::Fst<fst::StdArc> &fst,
+      fst::DeterministicOnDemandFst<fst::StdArc> *lm_diff_fst,
+      OnlineNnet2FeaturePipeline *features);
+
+  /// Initializes the decoding and sets the frame offset of the underlying
+  /// decodable object; see SingleUtteranceNnet3Decoder::InitDecoding().
+  void InitDecoding(int32 frame_offset = 0);
+
+  /// Advances the decoding as far as we can.
+  void AdvanceDecoding();
+
+  /// Finalizes the decoding, pruning the lattice using the final-probs.  It
+  /// must be called, once the input is finished, before getting the lattice
+  /// with end_of_utterance == true.
+  void FinalizeDecoding();
+
+  int32 NumFramesDecoded() const { return decoder_.NumFramesDecoded(); }
+
+  /// Gets the lattice, with acoustic scaling, as
+  /// SingleUtteranceNnet3Decoder::GetLattice() does.  "end_of_utterance" will
+  /// be true if you want the final-probs to be included, which requires that
+  /// FinalizeDecoding() has been called.
+  void GetLattice(bool end_of_utterance,
+                  CompactLattice *clat) const;
+
+  /// Outputs an FST corresponding to the single best path through the current
+  /// lattice.
+  void GetBestPath(bool end_of_utterance,
+                   Lattice *best_path) const;
+
+  const LatticeBiglmFasterDecoder &Decoder() const { return decoder_; }
+
+ private:
+  const LatticeBiglmFasterDecoderConfig &decoder_opts_;
+
+  const TransitionModel &trans_model_;
+
+  nnet3::DecodableAmNnetLoopedOnline decodable_;
+
+  LatticeBiglmFasterDecoder decoder_;
+};
+
+/// @} End of "addtogroup onlinedecoding"
+
+}  // namespace kaldi
+
+#endif  // KALDI_ONLINE2_ONLINE_NNET3_BIGLM_DECODING_H_
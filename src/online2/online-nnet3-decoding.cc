@@ -22,6 +22,7 @@
 #include "lat/lattice-functions.h"
 #include "lat/determinize-lattice-pruned.h"
 #include "decoder/grammar-fst.h"
+#include "fstext/fstext-utils.h"
 
 namespace kaldi {
 
@@ -37,7 +38,14 @@ SingleUtteranceNnet3DecoderTpl<FST>::SingleUtteranceNnet3DecoderTpl(
     trans_model_(trans_model),
     decodable_(trans_model_, info,
                features->InputFeature(), features->IvectorFeature()),
-    decoder_(fst, decoder_opts_) {
+    decoder_(fst, decoder_opts_),
+    beam_controller_(NULL),
+    speculative_lookahead_frames_(
+        (info.frames_right_context + info.frames_per_chunk) /
+        info.opts.frame_subsampling_factor),
+    has_speculation_(false),
+    determinizer_(trans_model_, decoder_opts_.lattice_beam,
+                  decoder_opts_.det_opts) {
   decoder_.InitDecoding();
 }
 
@@ -45,15 +53,44 @@ template <typename FST>
 void SingleUtteranceNnet3DecoderTpl<FST>::InitDecoding(int32 frame_offset) {
   decoder_.InitDecoding();
   decodable_.SetFrameOffset(frame_offset);
+  determinizer_.Reset();
+  has_speculation_ = false;
+}
+
+template <typename FST>
+void SingleUtteranceNnet3DecoderTpl<FST>::Reset(
+    OnlineNnet2FeaturePipeline *features) {
+  input_feature_frame_shift_in_seconds_ = features->FrameShiftInSeconds();
+  decodable_.Reset(features->InputFeature(), features->IvectorFeature());
+  InitDecoding(0);
+  // InitDecoding() resets the beam scale.
+  if (beam_controller_ != NULL && beam_controller_->Enabled())
+    decoder_.SetBeamScale(beam_controller_->BeamScale());
 }
 
 template <typename FST>
 void SingleUtteranceNnet3DecoderTpl<FST>::AdvanceDecoding() {
+  KALDI_TRACE_SPAN("SingleUtteranceNnet3Decoder::AdvanceDecoding");
+  if (beam_controller_ == NULL || !beam_controller_->Enabled()) {
+    decoder_.AdvanceDecoding(&decodable_);
+    return;
+  }
+  Timer timer;
+  int32 num_frames_before = decoder_.NumFramesDecoded();
   decoder_.AdvanceDecoding(&decodable_);
+  int32 num_frames = decoder_.NumFramesDecoded() - num_frames_before;
+  if (num_frames > 0) {
+    // The time includes the neural net computation done by decodable_.
+    double audio_seconds = num_frames * input_feature_frame_shift_in_seconds_ *
+        decodable_.FrameSubsamplingFactor();
+    decoder_.SetBeamScale(beam_controller_->Update(audio_seconds,
+                                                   timer.Elapsed()));
+  }
 }
 
 template <typename FST>
 void SingleUtteranceNnet3DecoderTpl<FST>::FinalizeDecoding() {
+  KALDI_TRACE_SPAN("SingleUtteranceNnet3Decoder::FinalizeDecoding");
   decoder_.FinalizeDecoding();
 }
 
@@ -65,6 +102,7 @@ int32 SingleUtteranceNnet3DecoderTpl<FST>::NumFramesDecoded() const {
 template <typename FST>
 void SingleUtteranceNnet3DecoderTpl<FST>::GetLattice(bool end_of_utterance,
                                              CompactLattice *clat) const {
+  KALDI_TRACE_SPAN("SingleUtteranceNnet3Decoder::GetLattice");
   if (NumFramesDecoded() == 0)
     KALDI_ERR << "You cannot get a lattice if you decoded no frames.";
   Lattice raw_lat;
@@ -73,9 +111,31 @@ void SingleUtteranceNnet3DecoderTpl<FST>::GetLattice(bool end_of_utterance,
   if (!decoder_opts_.determinize_lattice)
     KALDI_ERR << "--determinize-lattice=false option is not supported at the moment";
 
+  if (!end_of_utterance || determinizer_.NumCachedPieces() > 0) {
+    // We are getting partial results, or the final result after partial
+    // results, so reuse as much as we can from the previous call.
+    determinizer_.Determinize(&raw_lat, clat);
+  } else {
+    BaseFloat lat_beam = decoder_opts_.lattice_beam;
+    DeterminizeLatticePhonePrunedWrapper(
+        trans_model_, &raw_lat, lat_beam, clat, decoder_opts_.det_opts);
+  }
+}
+
+template <typename FST>
+bool SingleUtteranceNnet3DecoderTpl<FST>::GetCommittedLattice(
+    CompactLattice *clat) {
+  clat->DeleteStates();
+  Lattice raw_lat;
+  if (!decoder_.CommitRawLattice(&raw_lat))
+    return false;
+  // The pieces cached by determinizer_ refer to the frames we just committed,
+  // which are no longer part of the lattice.
+  determinizer_.Reset();
   BaseFloat lat_beam = decoder_opts_.lattice_beam;
   DeterminizeLatticePhonePrunedWrapper(
       trans_model_, &raw_lat, lat_beam, clat, decoder_opts_.det_opts);
+  return true;
 }
 
 template <typename FST>
@@ -94,9 +154,110 @@ bool SingleUtteranceNnet3DecoderTpl<FST>::EndpointDetected(
                                  output_frame_shift, decoder_);
 }
 
+template <typename FST>
+bool SingleUtteranceNnet3DecoderTpl<FST>::SpeculativeEndpointDetected(
+    const OnlineEndpointConfig &config) {
+  BaseFloat output_frame_shift =
+      input_feature_frame_shift_in_seconds_ *
+      decodable_.FrameSubsamplingFactor();
+  return kaldi::EndpointDetected(config, trans_model_,
+                                 output_frame_shift, decoder_,
+                                 speculative_lookahead_frames_);
+}
+
+template <typename FST>
+bool SingleUtteranceNnet3DecoderTpl<FST>::GetSpeculativeBestPath(
+    const OnlineEndpointConfig &config, Lattice *best_path) {
+  if (has_speculation_ || !SpeculativeEndpointDetected(config))
+    return false;
+  decoder_.GetBestPath(best_path, true);
+  speculative_words_.clear();
+  GetLinearSymbolSequence<LatticeArc, int32>(*best_path, NULL,
+                                             &speculative_words_, NULL);
+  has_speculation_ = true;
+  return true;
+}
+
+template <typename FST>
+bool SingleUtteranceNnet3DecoderTpl<FST>::SpeculationRolledBack() {
+  if (!has_speculation_)
+    return false;
+  Lattice best_path;
+  decoder_.GetBestPath(&best_path, true);
+  std::vector<int32> words;
+  GetLinearSymbolSequence<LatticeArc, int32>(best_path, NULL, &words, NULL);
+  if (words == speculative_words_)
+    return false;
+  has_speculation_ = false;
+  return true;
+}
+
 
 // Instantiate the template for the types needed.
 template class SingleUtteranceNnet3DecoderTpl<fst::Fst<fst::StdArc> >;
 template class SingleUtteranceNnet3DecoderTpl<fst::GrammarFst>;
+template class SingleUtteranceNnet3DecoderTpl<fst::CsrFst>;
+
+
+OnlineNnet3DecoderSession::OnlineNnet3DecoderSession(
+    const OnlineNnet2FeaturePipelineInfo &feature_info,
+    const LatticeFasterDecoderConfig &decoder_opts,
+    const TransitionModel &trans_model,
+    const nnet3::DecodableNnetSimpleLoopedInfo &info,
+    const fst::Fst<fst::StdArc> &fst):
+    feature_info_(feature_info),
+    feature_pipeline_(new OnlineNnet2FeaturePipeline(feature_info)),
+    decoder_(decoder_opts, trans_model, info, fst, feature_pipeline_) { }
+
+void OnlineNnet3DecoderSession::NewUtterance() {
+  OnlineNnet2FeaturePipeline *new_pipeline =
+      new OnlineNnet2FeaturePipeline(feature_info_);
+  decoder_.Reset(new_pipeline);
+  delete feature_pipeline_;
+  feature_pipeline_ = new_pipeline;
+}
+
+
+OnlineNnet3DecoderSessionPool::OnlineNnet3DecoderSessionPool(
+    const OnlineNnet2FeaturePipelineInfo &feature_info,
+    const LatticeFasterDecoderConfig &decoder_opts,
+    const TransitionModel &trans_model,
+    const nnet3::DecodableNnetSimpleLoopedInfo &info,
+    const fst::Fst<fst::StdArc> &fst):
+    feature_info_(feature_info), decoder_opts_(decoder_opts),
+    trans_model_(trans_model), info_(info), fst_(fst), num_in_use_(0) { }
+
+OnlineNnet3DecoderSession *OnlineNnet3DecoderSessionPool::Get() {
+  OnlineNnet3DecoderSession *session = NULL;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_in_use_++;
+    if (!free_sessions_.empty()) {
+      session = free_sessions_.back();
+      free_sessions_.pop_back();
+    }
+  }
+  if (session != NULL) {
+    session->NewUtterance();
+    return session;
+  }
+  return new OnlineNnet3DecoderSession(feature_info_, decoder_opts_,
+                                       trans_model_, info_, fst_);
+}
+
+void OnlineNnet3DecoderSessionPool::Release(
+    OnlineNnet3DecoderSession *session) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  KALDI_ASSERT(num_in_use_ > 0);
+  num_in_use_--;
+  free_sessions_.push_back(session);
+}
+
+OnlineNnet3DecoderSessionPool::~OnlineNnet3DecoderSessionPool() {
+  if (num_in_use_ != 0)
+    KALDI_WARN << num_in_use_ << " decoder sessions were not released.";
+  for (size_t i = 0; i < free_sessions_.size(); i++)
+    delete free_sessions_[i];
+}
 
 }  // namespace kaldi
@@ -22,6 +22,7 @@
 #ifndef KALDI_ONLINE2_ONLINE_NNET3_DECODING_H_
 #define KALDI_ONLINE2_ONLINE_NNET3_DECODING_H_
 
+#include <mutex>
 #include <string>
 #include <vector>
 #include <deque>
@@ -31,6 +32,7 @@
 #include "util/common-utils.h"
 #include "base/kaldi-error.h"
 #include "itf/online-feature-itf.h"
+#include "online2/online-beam-controller.h"
 #include "online2/online-endpoint.h"
 #include "online2/online-nnet2-feature-pipeline.h"
 #include "decoder/lattice-faster-online-decoder.h"
@@ -45,7 +47,8 @@ namespace kaldi {
 /**
    You will instantiate this class when you want to decode a single utterance
    using the online-decoding setup for neural nets.  The template will be
-   instantiated only for FST = fst::Fst<fst::StdArc> and FST = fst::GrammarFst.
+   instantiated only for FST = fst::Fst<fst::StdArc>, FST = fst::GrammarFst and
+   FST = fst::CsrFst.
 */
 
 template <typename FST>
@@ -66,6 +69,14 @@ class SingleUtteranceNnet3DecoderTpl {
   /// keep using the same decodable object, e.g. in case of an endpoint.
   void InitDecoding(int32 frame_offset = 0);
 
+  /// Starts a new utterance whose features are 'features' (which replaces the
+  /// pipeline given to the constructor).  This has the same effect as
+  /// constructing a new object, but the memory of the decoder (tokens, links
+  /// and hash) and of the neural net computation is kept for reuse, which
+  /// matters when decoding many short utterances.  See also class
+  /// OnlineNnet3DecoderSession.
+  void Reset(OnlineNnet2FeaturePipeline *features);
+
   /// Advances the decoding as far as we can.
   void AdvanceDecoding();
 
@@ -81,9 +92,32 @@ class SingleUtteranceNnet3DecoderTpl {
   /// want an un-scaled lattice, scale it using ScaleLattice() with the inverse
   /// of the acoustic weight.  "end_of_utterance" will be true if you want the
   /// final-probs to be included.
+  /// If you call this repeatedly during the utterance (with end_of_utterance
+  /// == false) for partial results, the part of the lattice that has not
+  /// changed since the previous call is not determinized again (see
+  /// fst::CachingLatticeDeterminizer).  Because of this, concurrent calls
+  /// to this function are not allowed.
   void GetLattice(bool end_of_utterance,
                   CompactLattice *clat) const;
 
+  /// This is for decoding long streams (e.g. hour-long calls) as one
+  /// utterance, without memory growing until the endpoint.  If, since the
+  /// last call, there is a frame through which all the paths in the lattice
+  /// go (this typically happens in stretches of silence), it outputs the
+  /// determinized lattice of the frames up to the latest such frame, frees
+  /// the decoder state before it, and returns true; else it returns false.
+  /// See LatticeFasterDecoderTpl::CommitRawLattice() for details.  The
+  /// lattice has acoustic scaling as for GetLattice(), and no final-probs.
+  /// After this, GetLattice() and GetBestPath() only cover the frames after
+  /// NumFramesCommitted(), so the lattices returned by this function followed
+  /// by the final output of GetLattice() make up the lattice of the whole
+  /// stream.
+  bool GetCommittedLattice(CompactLattice *clat);
+
+  /// Returns the frame at which the lattice output by GetLattice() starts,
+  /// i.e. the total number of frames output by GetCommittedLattice().
+  int32 NumFramesCommitted() const { return decoder_.NumFramesCommitted(); }
+
   /// Outputs an FST corresponding to the single best path through the current
   /// lattice. If "use_final_probs" is true AND we reached the final-state of
   /// the graph then it will include those as final-probs, else it will treat
@@ -96,8 +130,73 @@ class SingleUtteranceNnet3DecoderTpl {
   /// with the required arguments.
   bool EndpointDetected(const OnlineEndpointConfig &config);
 
+  /// The following functions are for speculative finalization, which lowers
+  /// the latency of the final result at an endpoint.  EndpointDetected() can
+  /// only see an endpoint once the frames at the end of the trailing silence
+  /// are decoded, which (because of the right context of the model and the
+  /// chunk size) is some time after the audio for them arrived.  This
+  /// function predicts the endpoint instead: it applies the endpointing rules
+  /// as if the trailing silence went on through the frames that are not
+  /// decodable yet, i.e. (frames-right-context + frames-per-chunk) /
+  /// frame-subsampling-factor output frames.
+  bool SpeculativeEndpointDetected(const OnlineEndpointConfig &config);
+
+  /// If SpeculativeEndpointDetected() and there is no pending speculative
+  /// result, outputs the best path with final-probs, as GetBestPath(true, ...)
+  /// would after the endpoint, remembers its words and returns true; the
+  /// caller may then send it as the final result early.  Otherwise returns
+  /// false.  The decoding itself is not finalized, so it can go on if it
+  /// turns out the speaker has not finished.
+  bool GetSpeculativeBestPath(const OnlineEndpointConfig &config,
+                              Lattice *best_path);
+
+  /// To be called after each AdvanceDecoding() (and after FinalizeDecoding())
+  /// while a speculative result is pending.  If the words of the current best
+  /// path (with final-probs) differ from those of the speculative result,
+  /// e.g. because more speech arrived, it discards the speculative result and
+  /// returns true, meaning that the caller should retract it; otherwise
+  /// returns false.
+  bool SpeculationRolledBack();
+
+  /// True if GetSpeculativeBestPath() returned a result that has not been
+  /// rolled back since (InitDecoding() and Reset() discard it).
+  bool HasSpeculation() const { return has_speculation_; }
+
   const LatticeFasterOnlineDecoderTpl<FST> &Decoder() const { return decoder_; }
 
+  /// The following three functions carry the state of the neural net
+  /// computation (e.g. the recurrent state of an LSTM) from one utterance to
+  /// the next one of the same speaker, as the adaptation state of the feature
+  /// pipeline carries the iVector statistics; the first chunk of the next
+  /// utterance then needs no extra left context.  Call SetKeepLoopedState(true)
+  /// before decoding, GetLoopedState() at the end of the utterance, and
+  /// SetLoopedState() on the decoder of the next utterance before decoding it.
+  /// See DecodableNnetLoopedOnlineBase::GetLoopedState() for details.
+  void SetKeepLoopedState(bool keep) { decodable_.SetKeepLoopedState(keep); }
+  bool GetLoopedState(nnet3::DecodableNnetLoopedState *state) const {
+    return decodable_.GetLoopedState(state);
+  }
+  void SetLoopedState(const nnet3::DecodableNnetLoopedState &state) {
+    decodable_.SetLoopedState(state);
+  }
+
+  /// Makes the decoder append per-frame statistics of the search to 'stats'
+  /// (see LatticeFasterDecoderTpl::SetFrameStats()).
+  void SetDecoderFrameStats(std::vector<DecoderFrameStats> *stats) {
+    decoder_.SetFrameStats(stats);
+  }
+
+  /// If 'controller' is non-NULL, AdvanceDecoding() times itself and reports
+  /// the real-time factor to it, and uses the beam scale it returns for the
+  /// following chunk (see OnlineBeamController); decoding starts with the
+  /// controller's current beam scale.  The controller is not owned here and
+  /// may be shared between decoders.
+  void SetBeamController(OnlineBeamController *controller) {
+    beam_controller_ = controller;
+    if (controller != NULL && controller->Enabled())
+      decoder_.SetBeamScale(controller->BeamScale());
+  }
+
   ~SingleUtteranceNnet3DecoderTpl() { }
  private:
 
@@ -115,11 +214,100 @@ class SingleUtteranceNnet3DecoderTpl {
 
   LatticeFasterOnlineDecoderTpl<FST> decoder_;
 
+  // Set by SetBeamController(); NULL by default.
+  OnlineBeamController *beam_controller_;
+
+  // The number of output frames that SpeculativeEndpointDetected() assumes
+  // to be silence beyond the decoded ones.
+  int32 speculative_lookahead_frames_;
+  // True if there is a pending speculative result; speculative_words_ is the
+  // word sequence of it.
+  bool has_speculation_;
+  std::vector<int32> speculative_words_;
+
+  // Used by GetLattice() to avoid determinizing the same part of the lattice
+  // more than once; it is not part of the "real" state of this object, hence
+  // mutable.
+  mutable fst::CachingLatticeDeterminizer determinizer_;
 };
 
 
 typedef SingleUtteranceNnet3DecoderTpl<fst::Fst<fst::StdArc> > SingleUtteranceNnet3Decoder;
 
+
+/**
+   OnlineNnet3DecoderSession is for servers that decode many short utterances
+   one after another: it holds the feature pipeline and the decoder of one
+   utterance at a time, and NewUtterance() starts the next one without
+   constructing the decoder again, so that its buffers are reused (see
+   SingleUtteranceNnet3DecoderTpl::Reset()).  The feature pipeline is created
+   anew for each utterance, because it has no way to be reset; it is cheap
+   compared with the decoder.
+*/
+class OnlineNnet3DecoderSession {
+ public:
+  /// The arguments must all outlive this object.
+  OnlineNnet3DecoderSession(const OnlineNnet2FeaturePipelineInfo &feature_info,
+                            const LatticeFasterDecoderConfig &decoder_opts,
+                            const TransitionModel &trans_model,
+                            const nnet3::DecodableNnetSimpleLoopedInfo &info,
+                            const fst::Fst<fst::StdArc> &fst);
+
+  /// Starts a new utterance, with a new feature pipeline.  The references
+  /// returned by FeaturePipeline() before this call become invalid.
+  void NewUtterance();
+
+  OnlineNnet2FeaturePipeline &FeaturePipeline() { return *feature_pipeline_; }
+
+  SingleUtteranceNnet3Decoder &Decoder() { return decoder_; }
+
+  ~OnlineNnet3DecoderSession() { delete feature_pipeline_; }
+ private:
+  const OnlineNnet2FeaturePipelineInfo &feature_info_;
+  OnlineNnet2FeaturePipeline *feature_pipeline_;
+  SingleUtteranceNnet3Decoder decoder_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(OnlineNnet3DecoderSession);
+};
+
+
+/**
+   A thread-safe pool of OnlineNnet3DecoderSession objects, for servers that
+   decode many utterances concurrently: each request takes a session with
+   Get() and gives it back with Release(), so the number of sessions (and
+   their memory) only grows to the largest number of concurrent requests.
+*/
+class OnlineNnet3DecoderSessionPool {
+ public:
+  /// The arguments must all outlive this object.
+  OnlineNnet3DecoderSessionPool(
+      const OnlineNnet2FeaturePipelineInfo &feature_info,
+      const LatticeFasterDecoderConfig &decoder_opts,
+      const TransitionModel &trans_model,
+      const nnet3::DecodableNnetSimpleLoopedInfo &info,
+      const fst::Fst<fst::StdArc> &fst);
+
+  /// Returns a session that is ready for a new utterance, reusing a released
+  /// one if there is one.
+  OnlineNnet3DecoderSession *Get();
+
+  /// Gives back a session obtained from Get().
+  void Release(OnlineNnet3DecoderSession *session);
+
+  /// All the sessions must have been released.
+  ~OnlineNnet3DecoderSessionPool();
+ private:
+  const OnlineNnet2FeaturePipelineInfo &feature_info_;
+  const LatticeFasterDecoderConfig &decoder_opts_;
+  const TransitionModel &trans_model_;
+  const nnet3::DecodableNnetSimpleLoopedInfo &info_;
+  const fst::Fst<fst::StdArc> &fst_;
+
+  std::mutex mutex_;
+  std::vector<OnlineNnet3DecoderSession*> free_sessions_;
+  int32 num_in_use_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(OnlineNnet3DecoderSessionPool);
+};
+
 /// @} End of "addtogroup onlinedecoding"
 
 }  // namespace kaldi
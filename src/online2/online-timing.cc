@@ -17,13 +17,64 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
 #include "online2/online-timing.h"
 
 namespace kaldi {
 
 OnlineTimingStats::OnlineTimingStats():
     num_utts_(0), total_audio_(0.0), total_time_taken_(0.0),
-    total_time_waited_(0.0), max_delay_(0.0) {
+    total_time_waited_(0.0), max_delay_(0.0), num_decoded_frames_(0),
+    total_active_tokens_(0.0), total_arcs_(0.0), total_tokens_pruned_(0.0),
+    total_emitting_time_(0.0), total_nonemitting_time_(0.0),
+    max_lattice_tokens_(0) {
+}
+
+void OnlineTimingStats::AddToHistogram(double value,
+                                       std::vector<int64> *histogram) {
+  size_t i = 0;
+  while (value + 1.0 >= static_cast<double>(int64(2) << i)) i++;
+  if (histogram->size() <= i)
+    histogram->resize(i + 1, 0);
+  (*histogram)[i]++;
+}
+
+void OnlineTimingStats::PrintHistogram(const std::string &name,
+                                       const std::vector<int64> &histogram) {
+  int64 total = 0;
+  for (size_t i = 0; i < histogram.size(); i++)
+    total += histogram[i];
+  std::ostringstream os;
+  os << "Histogram of " << name << " per frame:";
+  for (size_t i = 0; i < histogram.size(); i++) {
+    if (histogram[i] == 0) continue;
+    os << " [" << ((int64(1) << i) - 1) << ", " << ((int64(2) << i) - 1) << "): "
+       << std::setprecision(3) << (100.0 * histogram[i] / total) << "%";
+  }
+  KALDI_LOG << os.str();
+}
+
+void OnlineTimingStats::AddDecoderStats(
+    const std::vector<DecoderFrameStats> &frame_stats) {
+  for (size_t i = 0; i < frame_stats.size(); i++) {
+    const DecoderFrameStats &stats = frame_stats[i];
+    int32 num_arcs = stats.num_emitting_arcs + stats.num_nonemitting_arcs;
+    num_decoded_frames_++;
+    total_active_tokens_ += stats.num_active_tokens;
+    total_arcs_ += num_arcs;
+    total_tokens_pruned_ += stats.num_tokens_pruned;
+    total_emitting_time_ += stats.emitting_seconds;
+    total_nonemitting_time_ += stats.nonemitting_seconds;
+    max_lattice_tokens_ = std::max(max_lattice_tokens_,
+                                   stats.num_lattice_tokens);
+    AddToHistogram(stats.num_active_tokens, &active_tokens_histogram_);
+    AddToHistogram(num_arcs, &arcs_histogram_);
+    AddToHistogram(1.0e+06 * (stats.emitting_seconds +
+                              stats.nonemitting_seconds),
+                   &frame_time_histogram_);
+  }
 }
 
 void OnlineTimingStats::Print(bool online){
@@ -57,6 +108,23 @@ void OnlineTimingStats::Print(bool online){
               << (total_time_taken_ - total_time_waited_) << " seconds "
               << " / " << total_audio_ << " seconds.";
   }
+  if (num_decoded_frames_ > 0) {
+    KALDI_LOG << "Decoder stats: over " << num_decoded_frames_
+              << " frames, the average number of active tokens was "
+              << (total_active_tokens_ / num_decoded_frames_)
+              << ", of arcs expanded " << (total_arcs_ / num_decoded_frames_)
+              << " and of tokens pruned "
+              << (total_tokens_pruned_ / num_decoded_frames_)
+              << "; the largest lattice had " << max_lattice_tokens_
+              << " tokens.  Time per frame was "
+              << (1.0e+03 * total_emitting_time_ / num_decoded_frames_)
+              << " ms emitting and "
+              << (1.0e+03 * total_nonemitting_time_ / num_decoded_frames_)
+              << " ms nonemitting.";
+    PrintHistogram("active tokens", active_tokens_histogram_);
+    PrintHistogram("arcs expanded", arcs_histogram_);
+    PrintHistogram("decoding time in microseconds", frame_time_histogram_);
+  }
 }
 
 OnlineTimer::OnlineTimer(const std::string &utterance_id):
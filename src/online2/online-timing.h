@@ -27,6 +27,7 @@
 
 #include "base/timer.h"
 #include "base/kaldi-error.h"
+#include "decoder/lattice-faster-decoder.h"
 
 namespace kaldi {
 /// @addtogroup  onlinedecoding OnlineDecoding
@@ -45,8 +46,19 @@ class OnlineTimingStats {
   /// not-really-online mode where the chunk length was the whole file.  We need
   /// to change the way we interpret the stats and print results, in this case.
   void Print(bool online = true);
+
+  /// Adds the per-frame statistics of the search for one utterance, as
+  /// collected by LatticeFasterDecoderTpl::SetFrameStats(), to histograms
+  /// which Print() prints (if this was called at all).
+  void AddDecoderStats(const std::vector<DecoderFrameStats> &frame_stats);
  protected:
   friend class OnlineTimer;
+  // Histograms of per-frame values on a log scale: element i is the number of
+  // frames with a value in [2^i - 1, 2^{i+1} - 1).
+  static void AddToHistogram(double value, std::vector<int64> *histogram);
+  static void PrintHistogram(const std::string &name,
+                             const std::vector<int64> &histogram);
+
   int32 num_utts_;
   // all times are in seconds.
   double total_audio_; // total time of audio.
@@ -56,6 +68,19 @@ class OnlineTimingStats {
                              // called SleepUntil instead of WaitUntil().
   double max_delay_; // maximum delay at utterance end.
   std::string max_delay_utt_;
+
+  // Statistics from AddDecoderStats().
+  int64 num_decoded_frames_;
+  double total_active_tokens_;
+  double total_arcs_;  // emitting plus nonemitting.
+  double total_tokens_pruned_;
+  double total_emitting_time_;
+  double total_nonemitting_time_;
+  int32 max_lattice_tokens_;
+  std::vector<int64> active_tokens_histogram_;
+  std::vector<int64> arcs_histogram_;
+  // of the time per frame in microseconds.
+  std::vector<int64> frame_time_histogram_;
 };
 
 
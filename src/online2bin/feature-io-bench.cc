@@ -0,0 +1,410 @@
+// online2bin/feature-io-bench.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <unistd.h>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/common-utils.h"
+#include "feat/feature-fbank.h"
+#include "feat/wave-reader.h"
+#include "matrix/compressed-matrix.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+
+namespace kaldi {
+
+// Makes a synthetic waveform in the range of 16-bit audio: a few sinusoids
+// with slowly varying frequencies, as in voiced speech, plus noise.
+void MakeSyntheticWave(int32 num_samples, BaseFloat samp_freq,
+                       std::mt19937 *rng, Vector<BaseFloat> *wave) {
+  std::normal_distribution<float> gauss(0.0, 1.0);
+  std::uniform_real_distribution<float> uniform(0.0, 1.0);
+  wave->Resize(num_samples, kUndefined);
+  BaseFloat f0 = 100.0 + 150.0 * uniform(*rng), phase = 0.0;
+  for (int32 i = 0; i < num_samples; i++) {
+    BaseFloat f = f0 * (1.0 + 0.2 * std::sin(2.0 * M_PI * i / samp_freq));
+    phase += 2.0 * M_PI * f / samp_freq;
+    BaseFloat x = 300.0 * gauss(*rng);
+    for (int32 h = 1; h <= 4; h++)
+      x += (4000.0 / h) * std::sin(h * phase);
+    (*wave)(i) = x;
+  }
+}
+
+// The result of one benchmark: 'bytes' is the amount of data processed, which
+// is the size of the 16-bit audio for the feature extraction, and the size of
+// the uncompressed data for the I/O; 'frames' is the number of feature frames
+// (or -1 if not applicable, as for wave files).
+struct BenchResult {
+  std::string benchmark;
+  std::string variant;
+  int64 bytes;
+  int64 frames;
+  int64 stored_bytes;  // size of the archive, or of the compressed data;
+                       // -1 if not applicable.
+  double seconds;
+  BenchResult(const std::string &benchmark, const std::string &variant):
+      benchmark(benchmark), variant(variant), bytes(0), frames(-1),
+      stored_bytes(-1), seconds(0.0) { }
+};
+
+void Report(const BenchResult &result, Output *output) {
+  double mb_per_second = result.bytes / result.seconds * 1.0e-06,
+      frames_per_second = (result.frames < 0 ? -1.0 :
+                           result.frames / result.seconds);
+  std::ostringstream msg;
+  msg << result.benchmark;
+  if (!result.variant.empty())
+    msg << " (" << result.variant << ")";
+  msg << ": " << mb_per_second << " MB/s";
+  if (result.frames >= 0)
+    msg << ", " << frames_per_second << " frames/s";
+  if (result.stored_bytes >= 0 && result.bytes > 0)
+    msg << ", stored size " << (result.stored_bytes * 100.0 / result.bytes)
+        << "%";
+  KALDI_LOG << msg.str();
+  if (output != NULL) {
+    std::ostream &os = output->Stream();
+    os << "{\"benchmark\": \"" << result.benchmark << "\", \"variant\": \""
+       << result.variant << "\", \"bytes\": " << result.bytes
+       << ", \"seconds\": " << result.seconds
+       << ", \"mb_per_second\": " << mb_per_second
+       << ", \"frames\": ";
+    if (result.frames >= 0)
+      os << result.frames << ", \"frames_per_second\": " << frames_per_second;
+    else
+      os << "null, \"frames_per_second\": null";
+    os << ", \"stored_bytes\": ";
+    if (result.stored_bytes >= 0)
+      os << result.stored_bytes;
+    else
+      os << "null";
+    os << "}\n";
+  }
+}
+
+// Returns the size of the file, or -1 if it cannot be opened.
+int64 FileSize(const std::string &filename) {
+  std::ifstream is(filename.c_str(), std::ios::binary | std::ios::ate);
+  return is ? static_cast<int64>(is.tellg()) : -1;
+}
+
+// Feature extraction with OfflineFeatureTpl<FbankComputer>, as in
+// compute-fbank-feats.  The features are output for the I/O benchmarks; the
+// result is only reported if 'report' is true.
+void BenchFbank(const FbankOptions &opts, BaseFloat samp_freq,
+                const std::vector<Vector<BaseFloat> > &waves, bool report,
+                std::vector<Matrix<BaseFloat> > *feats, Output *output) {
+  Fbank fbank(opts);
+  BenchResult result("fbank", "");
+  result.frames = 0;
+  feats->resize(waves.size());
+  Timer timer;
+  for (size_t i = 0; i < waves.size(); i++) {
+    fbank.ComputeFeatures(waves[i], samp_freq, 1.0, &((*feats)[i]));
+    result.bytes += waves[i].Dim() * sizeof(int16);
+    result.frames += (*feats)[i].NumRows();
+  }
+  result.seconds = timer.Elapsed();
+  if (report)
+    Report(result, output);
+}
+
+// Feature extraction with OnlineNnet2FeaturePipeline, giving it the audio in
+// chunks and getting the frames that are ready after each chunk, as in online
+// decoding.
+void BenchOnlinePipeline(const OnlineNnet2FeaturePipelineInfo &info,
+                         BaseFloat samp_freq, BaseFloat chunk_seconds,
+                         const std::vector<Vector<BaseFloat> > &waves,
+                         Output *output) {
+  BenchResult result("online-pipeline", info.feature_type);
+  result.frames = 0;
+  int32 chunk_samples = std::max<int32>(1, samp_freq * chunk_seconds);
+  Timer timer;
+  for (size_t i = 0; i < waves.size(); i++) {
+    OnlineNnet2FeaturePipeline pipeline(info);
+    Vector<BaseFloat> frame(pipeline.Dim());
+    int32 num_samples = waves[i].Dim(), num_frames = 0;
+    for (int32 offset = 0; offset < num_samples; offset += chunk_samples) {
+      int32 this_chunk = std::min(chunk_samples, num_samples - offset);
+      pipeline.AcceptWaveform(samp_freq, waves[i].Range(offset, this_chunk));
+      if (offset + this_chunk == num_samples)
+        pipeline.InputFinished();
+      for (; num_frames < pipeline.NumFramesReady(); num_frames++)
+        pipeline.GetFrame(num_frames, &frame);
+    }
+    result.bytes += num_samples * sizeof(int16);
+    result.frames += num_frames;
+  }
+  result.seconds = timer.Elapsed();
+  Report(result, output);
+}
+
+// Writing and reading the waveforms as an archive of wave files, through
+// TableWriter<WaveHolder> and SequentialTableReader<WaveHolder>.  The archive
+// will normally be in the page cache, so this measures the parsing and
+// copying rather than the disk.
+void BenchWaveArchive(BaseFloat samp_freq,
+                      const std::vector<Vector<BaseFloat> > &waves,
+                      const std::string &scratch, Output *output) {
+  BenchResult write_result("wav-archive", "write"),
+      read_result("wav-archive", "read");
+  std::string wspecifier = "ark:" + scratch;
+  Timer timer;
+  {
+    TableWriter<WaveHolder> writer(wspecifier);
+    for (size_t i = 0; i < waves.size(); i++) {
+      Matrix<BaseFloat> data(1, waves[i].Dim(), kUndefined);
+      data.Row(0).CopyFromVec(waves[i]);
+      writer.Write("utt" + std::to_string(i), WaveData(samp_freq, data));
+      write_result.bytes += waves[i].Dim() * sizeof(int16);
+    }
+  }
+  write_result.seconds = timer.Elapsed();
+  write_result.stored_bytes = FileSize(scratch);
+  Report(write_result, output);
+
+  timer.Reset();
+  SequentialTableReader<WaveHolder> reader("ark:" + scratch);
+  for (; !reader.Done(); reader.Next())
+    read_result.bytes += reader.Value().Data().NumCols() * sizeof(int16);
+  read_result.seconds = timer.Elapsed();
+  read_result.stored_bytes = write_result.stored_bytes;
+  Report(read_result, output);
+}
+
+// Compressing and uncompressing the features with each CompressionMethod.
+// The methods with a fixed range (e.g. kOneByteZeroOne) will clip the
+// features, but the speed is what we are measuring.
+void BenchCompression(const std::vector<Matrix<BaseFloat> > &feats,
+                      Output *output) {
+  const char *names[] = { "auto", "speech-feature", "two-byte-auto",
+                          "two-byte-signed-integer", "one-byte-auto",
+                          "one-byte-unsigned-integer", "one-byte-zero-one" };
+  for (int32 m = kAutomaticMethod; m <= kOneByteZeroOne; m++) {
+    CompressionMethod method = static_cast<CompressionMethod>(m);
+    BenchResult compress_result("compression",
+                                std::string(names[m - 1]) + "-compress"),
+        uncompress_result("compression",
+                          std::string(names[m - 1]) + "-uncompress");
+    std::vector<CompressedMatrix> compressed(feats.size());
+    compress_result.frames = 0;
+    compress_result.stored_bytes = 0;
+    Timer timer;
+    for (size_t i = 0; i < feats.size(); i++) {
+      compressed[i].CopyFromMat(feats[i], method);
+      compress_result.bytes += feats[i].NumRows() * feats[i].NumCols() *
+          sizeof(BaseFloat);
+      compress_result.frames += feats[i].NumRows();
+    }
+    compress_result.seconds = timer.Elapsed();
+    for (size_t i = 0; i < compressed.size(); i++) {
+      std::ostringstream os;
+      compressed[i].Write(os, true);
+      compress_result.stored_bytes += os.str().size();
+    }
+    Report(compress_result, output);
+
+    Matrix<BaseFloat> mat;
+    uncompress_result.frames = 0;
+    uncompress_result.stored_bytes = compress_result.stored_bytes;
+    timer.Reset();
+    for (size_t i = 0; i < compressed.size(); i++) {
+      mat.Resize(compressed[i].NumRows(), compressed[i].NumCols(), kUndefined);
+      compressed[i].CopyToMat(&mat);
+      uncompress_result.bytes += mat.NumRows() * mat.NumCols() *
+          sizeof(BaseFloat);
+      uncompress_result.frames += mat.NumRows();
+    }
+    uncompress_result.seconds = timer.Elapsed();
+    Report(uncompress_result, output);
+  }
+}
+
+// Writing the features as an archive (with an scp file), with and without
+// compression, and reading them back sequentially from the archive and in
+// random order through the scp file, as in copy-feats and nnet3-get-egs.
+void BenchFeatureArchive(const std::vector<Matrix<BaseFloat> > &feats,
+                         const std::string &scratch, std::mt19937 *rng,
+                         Output *output) {
+  std::string scp = scratch + ".scp";
+  int64 total_bytes = 0, total_frames = 0;
+  for (size_t i = 0; i < feats.size(); i++) {
+    total_bytes += feats[i].NumRows() * feats[i].NumCols() * sizeof(BaseFloat);
+    total_frames += feats[i].NumRows();
+  }
+  std::vector<std::string> keys(feats.size());
+  for (size_t i = 0; i < feats.size(); i++)
+    keys[i] = "utt" + std::to_string(i);
+
+  for (int32 compress = 0; compress < 2; compress++) {
+    std::string variant = (compress ? "compressed-" : "");
+    std::string wspecifier = "ark,scp:" + scratch + "," + scp;
+    BenchResult write_result("feature-archive", variant + "write"),
+        read_result("feature-archive", variant + "read"),
+        scp_result("feature-archive", variant + "random-access-read");
+    Timer timer;
+    if (compress) {
+      CompressedMatrixWriter writer(wspecifier);
+      for (size_t i = 0; i < feats.size(); i++)
+        writer.Write(keys[i], CompressedMatrix(feats[i]));
+    } else {
+      BaseFloatMatrixWriter writer(wspecifier);
+      for (size_t i = 0; i < feats.size(); i++)
+        writer.Write(keys[i], feats[i]);
+    }
+    write_result.seconds = timer.Elapsed();
+    int64 stored_bytes = FileSize(scratch);
+    BenchResult *results[] = { &write_result, &read_result, &scp_result };
+    for (int32 r = 0; r < 3; r++) {
+      results[r]->bytes = total_bytes;
+      results[r]->frames = total_frames;
+      results[r]->stored_bytes = stored_bytes;
+    }
+    Report(write_result, output);
+
+    timer.Reset();
+    int64 num_read = 0;
+    SequentialBaseFloatMatrixReader reader("ark:" + scratch);
+    for (; !reader.Done(); reader.Next())
+      num_read += reader.Value().NumRows();
+    read_result.seconds = timer.Elapsed();
+    KALDI_ASSERT(num_read == total_frames);
+    Report(read_result, output);
+
+    std::vector<std::string> shuffled(keys);
+    std::shuffle(shuffled.begin(), shuffled.end(), *rng);
+    timer.Reset();
+    num_read = 0;
+    RandomAccessBaseFloatMatrixReader random_reader("scp:" + scp);
+    for (size_t i = 0; i < shuffled.size(); i++)
+      num_read += random_reader.Value(shuffled[i]).NumRows();
+    scp_result.seconds = timer.Elapsed();
+    KALDI_ASSERT(num_read == total_frames);
+    Report(scp_result, output);
+  }
+  std::remove(scp.c_str());
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Benchmarks feature extraction and I/O on synthetic audio (made\n"
+        "reproducibly from --seed): filterbank extraction with\n"
+        "OfflineFeatureTpl<FbankComputer> and with OnlineNnet2FeaturePipeline\n"
+        "(giving it the audio in chunks as in online decoding); writing and\n"
+        "reading archives of wave files and of features, with and without\n"
+        "compression; and compressing and uncompressing the features with\n"
+        "each CompressionMethod.  Reports MB/s (of 16-bit audio for the\n"
+        "feature extraction, of uncompressed data for the rest) and frames per\n"
+        "second; with --output, writes one JSON object per line for each\n"
+        "benchmark, for tracking regressions.  The archives are written to\n"
+        "--scratch, which will normally stay in the page cache, so this\n"
+        "measures parsing and copying rather than the disk.  'make featbench'\n"
+        "and 'make iobench' in src/ run the feature and I/O benchmarks.\n"
+        "\n"
+        "Usage: feature-io-bench [options]\n"
+        "e.g.: feature-io-bench --benchmarks=fbank,online-pipeline "
+        "--output=bench.jsonl\n";
+
+    ParseOptions po(usage);
+    FbankOptions fbank_opts;
+    fbank_opts.Register(&po);
+    OnlineNnet2FeaturePipelineConfig pipeline_config;
+    pipeline_config.feature_type = "fbank";
+    pipeline_config.Register(&po);
+
+    std::string benchmarks_str = "fbank,online-pipeline,wav-archive,"
+        "compression,feature-archive",
+        output_wxfilename,
+        scratch = "/tmp/feature-io-bench." + std::to_string(getpid()) + ".ark";
+    int32 seed = 0, num_utts = 50;
+    BaseFloat utt_seconds = 10.0, chunk_seconds = 0.1;
+
+    po.Register("benchmarks", &benchmarks_str, "Comma-separated list of the "
+                "benchmarks to run, from fbank, online-pipeline, wav-archive, "
+                "compression, feature-archive.");
+    po.Register("output", &output_wxfilename, "If set, write the results "
+                "here as JSON lines.");
+    po.Register("scratch", &scratch, "File to write the archives to (it is "
+                "deleted afterwards).");
+    po.Register("seed", &seed, "Seed for the synthetic audio.");
+    po.Register("num-utts", &num_utts, "Number of synthetic utterances.");
+    po.Register("utt-seconds", &utt_seconds, "Length of each synthetic "
+                "utterance, in seconds.");
+    po.Register("chunk-seconds", &chunk_seconds, "Length of the chunks of "
+                "audio given to OnlineNnet2FeaturePipeline.");
+
+    po.Read(argc, argv);
+    if (po.NumArgs() != 0) {
+      po.PrintUsage();
+      return 1;
+    }
+
+    std::vector<std::string> benchmarks;
+    SplitStringToVector(benchmarks_str, ",", true, &benchmarks);
+    const char *known[] = { "fbank", "online-pipeline", "wav-archive",
+                            "compression", "feature-archive" };
+    for (size_t i = 0; i < benchmarks.size(); i++)
+      if (std::find(known, known + 5, benchmarks[i]) == known + 5)
+        KALDI_ERR << "Unknown benchmark " << benchmarks[i];
+    std::set<std::string> to_run(benchmarks.begin(), benchmarks.end());
+
+    BaseFloat samp_freq = fbank_opts.frame_opts.samp_freq;
+    std::mt19937 rng(seed);
+    std::vector<Vector<BaseFloat> > waves(num_utts);
+    for (int32 i = 0; i < num_utts; i++)
+      MakeSyntheticWave(static_cast<int32>(utt_seconds * samp_freq), samp_freq,
+                        &rng, &(waves[i]));
+
+    Output *output = NULL;
+    if (!output_wxfilename.empty())
+      output = new Output(output_wxfilename, false);
+
+    // The I/O benchmarks use the filterbank features, so we always compute
+    // them.
+    std::vector<Matrix<BaseFloat> > feats;
+    BenchFbank(fbank_opts, samp_freq, waves, to_run.count("fbank") != 0,
+               &feats, output);
+    if (to_run.count("online-pipeline")) {
+      OnlineNnet2FeaturePipelineInfo info(pipeline_config);
+      BenchOnlinePipeline(info, samp_freq, chunk_seconds, waves, output);
+    }
+    if (to_run.count("wav-archive"))
+      BenchWaveArchive(samp_freq, waves, scratch, output);
+    if (to_run.count("compression"))
+      BenchCompression(feats, output);
+    if (to_run.count("feature-archive"))
+      BenchFeatureArchive(feats, scratch, &rng, output);
+    std::remove(scratch.c_str());
+
+    delete output;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,311 @@
+// online2bin/online2-tcp-nnet3-decode-faster-batched.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "online2/online-nnet3-batch-decoding.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "fstext/fstext-lib.h"
+#include "lat/lattice-functions.h"
+#include "util/kaldi-thread.h"
+#include "nnet3/nnet-utils.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <poll.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+
+namespace kaldi {
+
+std::string LatticeToString(const Lattice &lat,
+                            const fst::SymbolTable &word_syms) {
+  LatticeWeight weight;
+  std::vector<int32> alignment;
+  std::vector<int32> words;
+  GetLinearSymbolSequence(lat, &alignment, &words, &weight);
+
+  std::ostringstream msg;
+  for (size_t i = 0; i < words.size(); i++) {
+    std::string s = word_syms.Find(words[i]);
+    if (s.empty()) {
+      KALDI_WARN << "Word-id " << words[i] << " not in symbol table.";
+      msg << "<#" << std::to_string(i) << "> ";
+    } else
+      msg << s << " ";
+  }
+  return msg.str();
+}
+
+std::string LatticeToString(const CompactLattice &clat,
+                            const fst::SymbolTable &word_syms) {
+  if (clat.NumStates() == 0) {
+    KALDI_WARN << "Empty lattice.";
+    return "";
+  }
+  CompactLattice best_path_clat;
+  CompactLatticeShortestPath(clat, &best_path_clat);
+
+  Lattice best_path_lat;
+  ConvertLattice(best_path_clat, &best_path_lat);
+  return LatticeToString(best_path_lat, word_syms);
+}
+
+// Writes all of 'msg' to the socket; returns false on error.
+bool WriteToSocket(int32 desc, const std::string &msg) {
+  const char *p = msg.c_str();
+  size_t to_write = msg.size();
+  while (to_write > 0) {
+    ssize_t ret = write(desc, p, to_write);
+    if (ret <= 0)
+      return false;
+    to_write -= ret;
+    p += ret;
+  }
+  return true;
+}
+
+struct ClientOptions {
+  BaseFloat samp_freq;
+  BaseFloat chunk_length_secs;
+  BaseFloat output_period;
+  int32 read_timeout;
+};
+
+// Decodes the audio from one client connection (16-bit signed linear PCM),
+// sending it partial results (ending with "\r") every output_period seconds
+// of audio and the final result (ending with "\n") at the end of the stream,
+// and then closes the connection.
+void HandleClient(const ClientOptions &opts,
+                  const fst::SymbolTable &word_syms,
+                  OnlineNnet3BatchDecoder *decoder,
+                  int32 client_desc) {
+  try {
+    int32 stream_id = decoder->OpenStream();
+    size_t chunk_len = static_cast<size_t>(opts.chunk_length_secs *
+                                           opts.samp_freq);
+    int64 check_period = static_cast<int64>(opts.samp_freq *
+                                            opts.output_period),
+        samp_count = 0, check_count = check_period;
+    std::vector<char> buf(chunk_len * sizeof(int16));
+    size_t num_bytes = 0;  // bytes in 'buf'.
+    pollfd client_set[1];
+    client_set[0].fd = client_desc;
+    client_set[0].events = POLLIN;
+    bool connected = true;
+    while (true) {
+      int poll_ret = poll(client_set, 1, 1000 * opts.read_timeout);
+      if (poll_ret <= 0) {
+        KALDI_WARN << (poll_ret == 0 ? "Socket timeout!" : "Socket error!")
+                   << " Disconnecting...";
+        break;
+      }
+      ssize_t ret = read(client_desc, &(buf[num_bytes]),
+                         buf.size() - num_bytes);
+      if (ret <= 0)
+        break;  // the stream is over.
+      num_bytes += ret;
+      // Keep any odd byte for the next read.
+      size_t num_samples = num_bytes / sizeof(int16);
+      Vector<BaseFloat> wave_part(num_samples);
+      const int16 *samples = reinterpret_cast<const int16*>(buf.data());
+      for (size_t i = 0; i < num_samples; i++)
+        wave_part(i) = samples[i];
+      if (num_bytes % sizeof(int16) != 0)
+        buf[0] = buf[num_bytes - 1];
+      num_bytes %= sizeof(int16);
+      decoder->AcceptWaveform(stream_id, opts.samp_freq, wave_part);
+
+      samp_count += num_samples;
+      if (samp_count > check_count) {
+        Lattice lat;
+        if (decoder->GetBestPath(stream_id, &lat)) {
+          std::string msg = LatticeToString(lat, word_syms);
+          KALDI_VLOG(1) << "Temporary transcript: " << msg;
+          connected = WriteToSocket(client_desc, msg + "\r");
+          if (!connected)
+            break;
+        }
+        check_count += check_period;
+      }
+    }
+    decoder->InputFinished(stream_id);
+    CompactLattice clat;
+    if (connected) {
+      std::string msg;
+      if (decoder->GetLattice(stream_id, &clat))
+        msg = LatticeToString(clat, word_syms);
+      KALDI_VLOG(1) << "EndOfAudio, sending message: " << msg;
+      WriteToSocket(client_desc, msg + "\n");
+    }
+    decoder->CloseStream(stream_id);
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error decoding stream: " << e.what();
+  }
+  close(client_desc);
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Reads in audio from many network connections at once and performs\n"
+        "online decoding with neural nets (nnet3 setup), with iVector-based\n"
+        "speaker adaptation.  The neural net computation for all the\n"
+        "connections is done in minibatches (see --minibatch-size and\n"
+        "--max-batch-wait), and the search on --num-decoder-threads threads.\n"
+        "Each connection is decoded as one stream until it is closed (there\n"
+        "is no endpointing), with partial results sent every --output-period\n"
+        "seconds.  Unlike online2-tcp-nnet3-decode-faster, the neural net is\n"
+        "evaluated in chunks with left and right context (as in\n"
+        "nnet3-latgen-faster), so choose --frames-per-chunk and the\n"
+        "context options accordingly.\n"
+        "Note: some configuration values and inputs are set via config\n"
+        "files whose filenames are passed as options\n"
+        "\n"
+        "Usage: online2-tcp-nnet3-decode-faster-batched [options] <nnet3-in> "
+        "<fst-in> <word-symbol-table>\n";
+
+    ParseOptions po(usage);
+
+    OnlineNnet2FeaturePipelineConfig feature_opts;
+    nnet3::NnetBatchComputerOptions compute_opts;
+    LatticeFasterDecoderConfig decoder_opts;
+    OnlineNnet3BatchDecoderConfig batch_opts;
+
+    ClientOptions client_opts;
+    client_opts.samp_freq = 16000.0;
+    client_opts.chunk_length_secs = 0.18;
+    client_opts.output_period = 1;
+    client_opts.read_timeout = 3;
+    int port_num = 5050;
+
+    // The defaults for minibatch size suit GPUs; on CPU, and for latency,
+    // smaller ones are better.
+    compute_opts.minibatch_size = 16;
+    compute_opts.frames_per_chunk = 51;
+
+    po.Register("samp-freq", &client_opts.samp_freq,
+                "Sampling frequency of the input signal (coded as 16-bit slinear).");
+    po.Register("chunk-length", &client_opts.chunk_length_secs,
+                "Length of chunk size in seconds, that we read at a time.");
+    po.Register("output-period", &client_opts.output_period,
+                "How often in seconds, do we send partial results.");
+    po.Register("num-threads-startup", &g_num_threads,
+                "Number of threads used when initializing iVector extractor.");
+    po.Register("read-timeout", &client_opts.read_timeout,
+                "Number of seconds of timout for TCP audio data to appear on the stream.");
+    po.Register("port-num", &port_num,
+                "Port number the server will listen on.");
+
+    feature_opts.Register(&po);
+    compute_opts.Register(&po);
+    decoder_opts.Register(&po);
+    batch_opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      return 1;
+    }
+
+    std::string nnet3_rxfilename = po.GetArg(1),
+        fst_rxfilename = po.GetArg(2),
+        word_syms_filename = po.GetArg(3);
+
+    OnlineNnet2FeaturePipelineInfo feature_info(feature_opts);
+
+    KALDI_VLOG(1) << "Loading AM...";
+
+    TransitionModel trans_model;
+    nnet3::AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(nnet3_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      nnet3::CollapseModel(nnet3::CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    KALDI_VLOG(1) << "Loading FST...";
+
+    fst::Fst<fst::StdArc> *decode_fst = ReadFstKaldiGeneric(fst_rxfilename);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+      KALDI_ERR << "Could not read symbol table from file "
+                << word_syms_filename;
+
+    OnlineNnet3BatchDecoder decoder(batch_opts, compute_opts, decoder_opts,
+                                    feature_info, trans_model, am_nnet,
+                                    *decode_fst);
+
+    signal(SIGPIPE, SIG_IGN); // ignore SIGPIPE to avoid crashing when socket forcefully disconnected
+
+    struct ::sockaddr_in h_addr;
+    h_addr.sin_addr.s_addr = INADDR_ANY;
+    h_addr.sin_port = htons(port_num);
+    h_addr.sin_family = AF_INET;
+    int32 server_desc = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_desc == -1)
+      KALDI_ERR << "Cannot create TCP socket!";
+    int32 flag = 1;
+    if (setsockopt(server_desc, SOL_SOCKET, SO_REUSEADDR, &flag,
+                   sizeof(flag)) == -1)
+      KALDI_ERR << "Cannot set socket options!";
+    if (bind(server_desc, (struct sockaddr *) &h_addr, sizeof(h_addr)) == -1)
+      KALDI_ERR << "Cannot bind to port: " << port_num << " (is it taken?)";
+    if (listen(server_desc, SOMAXCONN) == -1)
+      KALDI_ERR << "Cannot listen on port!";
+    KALDI_LOG << "Listening on port: " << port_num;
+
+    while (true) {
+      struct sockaddr_in client_addr;
+      socklen_t len = sizeof(client_addr);
+      int32 client_desc = accept(server_desc,
+                                 (struct sockaddr *) &client_addr, &len);
+      if (client_desc == -1) {
+        KALDI_WARN << "Error accepting connection";
+        continue;
+      }
+      char ipstr[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, &client_addr.sin_addr, ipstr, sizeof(ipstr));
+      KALDI_LOG << "Accepted connection from: " << ipstr;
+      // Reading from the client is cheap, so we use one thread per
+      // connection for it; the real work is done by 'decoder's threads.
+      std::thread(HandleClient, client_opts, std::cref(*word_syms), &decoder,
+                  client_desc).detach();
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+} // main()
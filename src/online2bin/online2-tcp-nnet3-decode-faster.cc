@@ -28,6 +28,7 @@
 #include "fstext/fstext-lib.h"
 #include "lat/lattice-functions.h"
 #include "util/kaldi-thread.h"
+#include "util/kaldi-metrics.h"
 #include "nnet3/nnet-utils.h"
 
 #include <netinet/in.h>
@@ -127,6 +128,10 @@ int main(int argc, char *argv[]) {
         "speaker adaptation and endpointing.\n"
         "Note: some configuration values and inputs are set via config\n"
         "files whose filenames are passed as options\n"
+        "With --speculative-endpoint=true, when an endpoint is predicted, the\n"
+        "result is sent at once as a line 'SPECULATIVE <text>'; if more speech\n"
+        "arrives and changes it, a line 'ROLLBACK' is sent.  The final result\n"
+        "at the endpoint follows as usual in either case.\n"
         "\n"
         "Usage: online2-tcp-nnet3-decode-faster [options] <nnet3-in> "
         "<fst-in> <word-symbol-table>\n";
@@ -147,6 +152,9 @@ int main(int argc, char *argv[]) {
     int port_num = 5050;
     int read_timeout = 3;
     bool produce_time = false;
+    bool speculative_endpoint = false;
+    int metrics_port = 0;
+    std::string metrics_bind_address = "127.0.0.1";
 
     po.Register("samp-freq", &samp_freq,
                 "Sampling frequency of the input signal (coded as 16-bit slinear).");
@@ -162,6 +170,18 @@ int main(int argc, char *argv[]) {
                 "Port number the server will listen on.");
     po.Register("produce-time", &produce_time,
                 "Prepend begin/end times between endpoints (e.g. '5.46 6.81 <text_output>', in seconds)");
+    po.Register("speculative-endpoint", &speculative_endpoint,
+                "If true, send the result as soon as the endpointing rules "
+                "predict an endpoint, before the frames at the end of the "
+                "silence are decoded (see usage message).");
+    po.Register("metrics-port", &metrics_port,
+                "If nonzero, serve runtime metrics (real-time factor, "
+                "latency, etc.) in the Prometheus format over HTTP on this "
+                "port, at /metrics.");
+    po.Register("metrics-bind-address", &metrics_bind_address,
+                "IPv4 address the metrics server listens on; the default only "
+                "accepts local connections.  Use 0.0.0.0 to allow scraping "
+                "from other hosts (the endpoint has no authentication).");
 
     feature_opts.Register(&po);
     decodable_opts.Register(&po);
@@ -216,13 +236,47 @@ int main(int argc, char *argv[]) {
 
     signal(SIGPIPE, SIG_IGN); // ignore SIGPIPE to avoid crashing when socket forcefully disconnected
 
+    MetricsRegistry &metrics = MetricsRegistry::Global();
+    MetricCounter *audio_seconds = metrics.GetCounter(
+        "kaldi_audio_seconds_total", "Seconds of audio received."),
+        *decode_seconds = metrics.GetCounter(
+            "kaldi_decode_seconds_total", "Seconds spent computing features "
+            "and decoding; divided by kaldi_audio_seconds_total, this is the "
+            "real-time factor."),
+        *num_segments = metrics.GetCounter(
+            "kaldi_segments_total", "Segments (between endpoints) decoded.");
+    MetricGauge *real_time_factor = metrics.GetGauge(
+        "kaldi_real_time_factor", "Real-time factor of the current "
+        "connection."),
+        *feature_lag = metrics.GetGauge(
+            "kaldi_feature_pipeline_lag_frames", "Feature frames ready but "
+            "not yet decoded."),
+        *connections = metrics.GetGauge(
+            "kaldi_active_connections", "Number of clients connected.");
+    MetricHistogram *endpoint_latency = metrics.GetHistogram(
+        "kaldi_endpoint_latency_seconds", "Time from receiving the audio "
+        "chunk in which an endpoint (or the end of the audio) was found to "
+        "sending the final transcript.", MetricHistogram::LatencyBuckets());
+    MetricsHttpServer metrics_server;
+    if (metrics_port != 0 &&
+        !metrics_server.Start(metrics_port, metrics_bind_address))
+      KALDI_ERR << "Could not serve metrics on port " << metrics_port;
+
     TcpServer server(read_timeout);
 
     server.Listen(port_num);
 
+    // The decoder is kept from one connection to the next, so that its
+    // memory is reused.
+    OnlineNnet3DecoderSession session(feature_info, decoder_opts,
+                                      trans_model, decodable_info,
+                                      *decode_fst);
+
     while (true) {
 
       server.Accept();
+      connections->Set(1);
+      double connection_audio = 0.0, connection_time = 0.0;
 
       int32 samp_count = 0;// this is used for output refresh rate
       size_t chunk_len = static_cast<size_t>(chunk_length_secs * samp_freq);
@@ -233,10 +287,9 @@ int main(int argc, char *argv[]) {
 
       bool eos = false;
 
-      OnlineNnet2FeaturePipeline feature_pipeline(feature_info);
-      SingleUtteranceNnet3Decoder decoder(decoder_opts, trans_model,
-                                          decodable_info,
-                                          *decode_fst, &feature_pipeline);
+      session.NewUtterance();
+      OnlineNnet2FeaturePipeline &feature_pipeline = session.FeaturePipeline();
+      SingleUtteranceNnet3Decoder &decoder = session.Decoder();
 
       while (!eos) {
 
@@ -249,6 +302,7 @@ int main(int argc, char *argv[]) {
 
         while (true) {
           eos = !server.ReadChunk(chunk_len);
+          Timer chunk_timer;
 
           if (eos) {
             feature_pipeline.InputFinished();
@@ -269,9 +323,14 @@ int main(int argc, char *argv[]) {
 
               KALDI_VLOG(1) << "EndOfAudio, sending message: " << msg;
               server.WriteLn(msg);
+              num_segments->Increment();
             } else
               server.Write("\n");
+            endpoint_latency->Observe(chunk_timer.Elapsed());
+            decode_seconds->Increment(chunk_timer.Elapsed());
             server.Disconnect();
+            connections->Set(0);
+            feature_lag->Set(0);
             break;
           }
 
@@ -290,6 +349,17 @@ int main(int argc, char *argv[]) {
 
           decoder.AdvanceDecoding();
 
+          double chunk_seconds = wave_part.Dim() / samp_freq,
+              elapsed = chunk_timer.Elapsed();
+          audio_seconds->Increment(chunk_seconds);
+          decode_seconds->Increment(elapsed);
+          connection_audio += chunk_seconds;
+          connection_time += elapsed;
+          real_time_factor->Set(connection_time / connection_audio);
+          feature_lag->Set(feature_pipeline.NumFramesReady() -
+                           (frame_offset + decoder.NumFramesDecoded()) *
+                           frame_subsampling);
+
           if (samp_count > check_count) {
             if (decoder.NumFramesDecoded() > 0) {
               Lattice lat;
@@ -310,6 +380,18 @@ int main(int argc, char *argv[]) {
             check_count += check_period;
           }
 
+          if (speculative_endpoint) {
+            Lattice lat;
+            if (decoder.SpeculationRolledBack()) {
+              KALDI_VLOG(1) << "Speculative result rolled back";
+              server.WriteLn("ROLLBACK");
+            } else if (decoder.GetSpeculativeBestPath(endpoint_opts, &lat)) {
+              std::string msg = LatticeToString(lat, *word_syms);
+              KALDI_VLOG(1) << "Predicted endpoint, sending message: " << msg;
+              server.WriteLn("SPECULATIVE " + msg);
+            }
+          }
+
           if (decoder.EndpointDetected(endpoint_opts)) {
             decoder.FinalizeDecoding();
             frame_offset += decoder.NumFramesDecoded();
@@ -326,6 +408,8 @@ int main(int argc, char *argv[]) {
 
             KALDI_VLOG(1) << "Endpoint, sending message: " << msg;
             server.WriteLn(msg);
+            num_segments->Increment();
+            endpoint_latency->Observe(chunk_timer.Elapsed());
             break; // while (true)
           }
         }
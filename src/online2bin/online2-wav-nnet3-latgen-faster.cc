@@ -27,6 +27,7 @@
 #include "fstext/fstext-lib.h"
 #include "lat/lattice-functions.h"
 #include "util/kaldi-thread.h"
+#include "util/memory-budget.h"
 #include "nnet3/nnet-utils.h"
 
 namespace kaldi {
@@ -72,6 +73,93 @@ void GetDiagnosticsAndPrintOutput(const std::string &utt,
   }
 }
 
+
+// Decodes the utterance 'utt' with the graph 'decode_fst', simulating online
+// decoding as described in the usage message, and outputs the lattice to
+// *clat.  FST may be fst::Fst<fst::StdArc> or fst::CsrFst (see make-csr-fst).
+// 'frame_stats' may be NULL.  If carry_nnet_state is true, *nnet_state is used
+// to start the nnet computation and is updated at the end.
+template <typename FST>
+void DecodeUtterance(const std::string &utt,
+                     const SubVector<BaseFloat> &data,
+                     BaseFloat samp_freq,
+                     const FST &decode_fst,
+                     const TransitionModel &trans_model,
+                     const LatticeFasterDecoderConfig &decoder_opts,
+                     const nnet3::DecodableNnetSimpleLoopedInfo &decodable_info,
+                     const OnlineEndpointConfig &endpoint_opts,
+                     bool do_endpointing,
+                     BaseFloat chunk_length_secs,
+                     bool carry_nnet_state,
+                     OnlineNnet2FeaturePipeline *feature_pipeline,
+                     OnlineSilenceWeighting *silence_weighting,
+                     OnlineBeamController *beam_controller,
+                     std::vector<DecoderFrameStats> *frame_stats,
+                     nnet3::DecodableNnetLoopedState *nnet_state,
+                     OnlineTimingStats *timing_stats,
+                     CompactLattice *clat) {
+  SingleUtteranceNnet3DecoderTpl<FST> decoder(decoder_opts, trans_model,
+                                              decodable_info, decode_fst,
+                                              feature_pipeline);
+  if (frame_stats != NULL)
+    decoder.SetDecoderFrameStats(frame_stats);
+  decoder.SetBeamController(beam_controller);
+  if (carry_nnet_state) {
+    decoder.SetKeepLoopedState(true);
+    if (nnet_state->num_chunks_computed > 0)
+      decoder.SetLoopedState(*nnet_state);
+  }
+  OnlineTimer decoding_timer(utt);
+
+  int32 chunk_length;
+  if (chunk_length_secs > 0) {
+    chunk_length = int32(samp_freq * chunk_length_secs);
+    if (chunk_length == 0) chunk_length = 1;
+  } else {
+    chunk_length = std::numeric_limits<int32>::max();
+  }
+
+  int32 samp_offset = 0;
+  std::vector<std::pair<int32, BaseFloat> > delta_weights;
+
+  while (samp_offset < data.Dim()) {
+    int32 samp_remaining = data.Dim() - samp_offset;
+    int32 num_samp = chunk_length < samp_remaining ? chunk_length
+                                                   : samp_remaining;
+
+    SubVector<BaseFloat> wave_part(data, samp_offset, num_samp);
+    feature_pipeline->AcceptWaveform(samp_freq, wave_part);
+
+    samp_offset += num_samp;
+    decoding_timer.WaitUntil(samp_offset / samp_freq);
+    if (samp_offset == data.Dim()) {
+      // no more input. flush out last frames
+      feature_pipeline->InputFinished();
+    }
+
+    if (silence_weighting->Active() &&
+        feature_pipeline->IvectorFeature() != NULL) {
+      silence_weighting->ComputeCurrentTraceback(decoder.Decoder());
+      silence_weighting->GetDeltaWeights(feature_pipeline->NumFramesReady(),
+                                         &delta_weights);
+      feature_pipeline->IvectorFeature()->UpdateFrameWeights(delta_weights);
+    }
+
+    decoder.AdvanceDecoding();
+
+    if (do_endpointing && decoder.EndpointDetected(endpoint_opts)) {
+      break;
+    }
+  }
+  decoder.FinalizeDecoding();
+
+  bool end_of_utterance = true;
+  decoder.GetLattice(end_of_utterance, clat);
+  decoding_timer.OutputStats(timing_stats);
+  if (carry_nnet_state && !decoder.GetLoopedState(nnet_state))
+    nnet_state->num_chunks_computed = 0;
+}
+
 }
 
 int main(int argc, char *argv[]) {
@@ -91,7 +179,8 @@ int main(int argc, char *argv[]) {
         "Usage: online2-wav-nnet3-latgen-faster [options] <nnet3-in> <fst-in> "
         "<spk2utt-rspecifier> <wav-rspecifier> <lattice-wspecifier>\n"
         "The spk2utt-rspecifier can just be <utterance-id> <utterance-id> if\n"
-        "you want to decode utterance by utterance.\n";
+        "you want to decode utterance by utterance.\n"
+        "<fst-in> may also be a CsrFst, as written by make-csr-fst.\n";
 
     ParseOptions po(usage);
 
@@ -103,10 +192,15 @@ int main(int argc, char *argv[]) {
     nnet3::NnetSimpleLoopedComputationOptions decodable_opts;
     LatticeFasterDecoderConfig decoder_opts;
     OnlineEndpointConfig endpoint_opts;
+    OnlineBeamControllerConfig beam_control_opts;
 
     BaseFloat chunk_length_secs = 0.18;
     bool do_endpointing = false;
     bool online = true;
+    bool decoder_stats = false;
+    bool carry_nnet_state = false;
+    std::string trace_wxfilename;
+    BaseFloat memory_budget_mb = 0.0;
 
     po.Register("chunk-length", &chunk_length_secs,
                 "Length of chunk size in seconds, that we process.  Set to <= 0 "
@@ -124,6 +218,27 @@ int main(int argc, char *argv[]) {
                 "--use-most-recent-ivector=true and --greedy-ivector-extractor=true "
                 "in the file given to --ivector-extraction-config, and "
                 "--chunk-length=-1.");
+    po.Register("decoder-stats", &decoder_stats,
+                "If true, collect statistics of the search on each frame "
+                "(active tokens, arcs expanded, time taken) and print "
+                "histograms of them at the end; useful for tuning --beam, "
+                "--max-active and --lattice-beam.");
+    po.Register("carry-nnet-state", &carry_nnet_state,
+                "If true, start each utterance of a speaker with the state of "
+                "the looped neural net computation (e.g. the recurrent state) "
+                "from the end of the previous one, instead of with the extra "
+                "left context, as if the utterances were consecutive; this "
+                "reduces the work for the first chunk of each utterance.");
+    po.Register("trace-file", &trace_wxfilename,
+                "If set, record the time spent in each stage of the pipeline "
+                "(feature extraction, iVectors, CMVN, nnet computation and "
+                "decoding) and write it to this file in the Chrome trace "
+                "format, for viewing in chrome://tracing or Perfetto.");
+    po.Register("memory-budget", &memory_budget_mb,
+                "If > 0, the memory budget in megabytes for the decoder's tokens "
+                "and links, lattices being determinized and cached features; "
+                "while it is exceeded, the beam is reduced (see "
+                "--memory-min-beam-scale).");
     po.Register("num-threads-startup", &g_num_threads,
                 "Number of threads used when initializing iVector extractor.");
 
@@ -131,6 +246,7 @@ int main(int argc, char *argv[]) {
     decodable_opts.Register(&po);
     decoder_opts.Register(&po);
     endpoint_opts.Register(&po);
+    beam_control_opts.Register(&po);
 
 
     po.Read(argc, argv);
@@ -139,6 +255,9 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       return 1;
     }
+    MemoryBudget::Global().SetLimit(memory_budget_mb * 1.0e+06);
+    // The beam scale carries over from one utterance to the next.
+    OnlineBeamController beam_controller(beam_control_opts);
 
     std::string nnet3_rxfilename = po.GetArg(1),
         fst_rxfilename = po.GetArg(2),
@@ -177,7 +296,14 @@ int main(int argc, char *argv[]) {
                                                         &am_nnet);
 
 
-    fst::Fst<fst::StdArc> *decode_fst = ReadFstKaldiGeneric(fst_rxfilename);
+    // If the graph is a CsrFst (see make-csr-fst), it will be memory-mapped if
+    // possible.
+    fst::Fst<fst::StdArc> *decode_fst = NULL;
+    fst::CsrFst *csr_fst = NULL;
+    if (fst::IsCsrFstFile(fst_rxfilename))
+      csr_fst = ReadCsrFstKaldi(fst_rxfilename);
+    else
+      decode_fst = ReadFstKaldiGeneric(fst_rxfilename);
 
     fst::SymbolTable *word_syms = NULL;
     if (word_syms_rxfilename != "")
@@ -194,6 +320,8 @@ int main(int argc, char *argv[]) {
     CompactLatticeWriter clat_writer(clat_wspecifier);
 
     OnlineTimingStats timing_stats;
+    if (!trace_wxfilename.empty())
+      SetTracingEnabled(true);
 
     for (; !spk2utt_reader.Done(); spk2utt_reader.Next()) {
       std::string spk = spk2utt_reader.Key();
@@ -202,6 +330,7 @@ int main(int argc, char *argv[]) {
       OnlineIvectorExtractorAdaptationState adaptation_state(
           feature_info.ivector_extractor_info);
       OnlineCmvnState cmvn_state(global_cmvn_stats);
+      nnet3::DecodableNnetLoopedState nnet_state;
 
       for (size_t i = 0; i < uttlist.size(); i++) {
         std::string utt = uttlist[i];
@@ -224,62 +353,29 @@ int main(int argc, char *argv[]) {
             feature_info.silence_weighting_config,
             decodable_opts.frame_subsampling_factor);
 
-        SingleUtteranceNnet3Decoder decoder(decoder_opts, trans_model,
-                                            decodable_info,
-                                            *decode_fst, &feature_pipeline);
-        OnlineTimer decoding_timer(utt);
-
-        BaseFloat samp_freq = wave_data.SampFreq();
-        int32 chunk_length;
-        if (chunk_length_secs > 0) {
-          chunk_length = int32(samp_freq * chunk_length_secs);
-          if (chunk_length == 0) chunk_length = 1;
-        } else {
-          chunk_length = std::numeric_limits<int32>::max();
-        }
-
-        int32 samp_offset = 0;
-        std::vector<std::pair<int32, BaseFloat> > delta_weights;
-
-        while (samp_offset < data.Dim()) {
-          int32 samp_remaining = data.Dim() - samp_offset;
-          int32 num_samp = chunk_length < samp_remaining ? chunk_length
-                                                         : samp_remaining;
-
-          SubVector<BaseFloat> wave_part(data, samp_offset, num_samp);
-          feature_pipeline.AcceptWaveform(samp_freq, wave_part);
-
-          samp_offset += num_samp;
-          decoding_timer.WaitUntil(samp_offset / samp_freq);
-          if (samp_offset == data.Dim()) {
-            // no more input. flush out last frames
-            feature_pipeline.InputFinished();
-          }
-
-          if (silence_weighting.Active() &&
-              feature_pipeline.IvectorFeature() != NULL) {
-            silence_weighting.ComputeCurrentTraceback(decoder.Decoder());
-            silence_weighting.GetDeltaWeights(feature_pipeline.NumFramesReady(),
-                                              &delta_weights);
-            feature_pipeline.IvectorFeature()->UpdateFrameWeights(delta_weights);
-          }
-
-          decoder.AdvanceDecoding();
-
-          if (do_endpointing && decoder.EndpointDetected(endpoint_opts)) {
-            break;
-          }
-        }
-        decoder.FinalizeDecoding();
-
+        std::vector<DecoderFrameStats> frame_stats;
         CompactLattice clat;
-        bool end_of_utterance = true;
-        decoder.GetLattice(end_of_utterance, &clat);
+        if (csr_fst != NULL)
+          DecodeUtterance(utt, data, wave_data.SampFreq(), *csr_fst,
+                          trans_model, decoder_opts, decodable_info,
+                          endpoint_opts, do_endpointing, chunk_length_secs,
+                          carry_nnet_state, &feature_pipeline,
+                          &silence_weighting, &beam_controller,
+                          (decoder_stats ? &frame_stats : NULL), &nnet_state,
+                          &timing_stats, &clat);
+        else
+          DecodeUtterance(utt, data, wave_data.SampFreq(), *decode_fst,
+                          trans_model, decoder_opts, decodable_info,
+                          endpoint_opts, do_endpointing, chunk_length_secs,
+                          carry_nnet_state, &feature_pipeline,
+                          &silence_weighting, &beam_controller,
+                          (decoder_stats ? &frame_stats : NULL), &nnet_state,
+                          &timing_stats, &clat);
 
         GetDiagnosticsAndPrintOutput(utt, word_syms, clat,
                                      &num_frames, &tot_like);
 
-        decoding_timer.OutputStats(&timing_stats);
+        timing_stats.AddDecoderStats(frame_stats);
 
         // In an application you might avoid updating the adaptation state if
         // you felt the utterance had low confidence.  See lat/confidence.h
@@ -297,12 +393,19 @@ int main(int argc, char *argv[]) {
       }
     }
     timing_stats.Print(online);
+    if (beam_controller.Enabled())
+      KALDI_LOG << beam_controller.Info();
+    if (!trace_wxfilename.empty()) {
+      Output ko(trace_wxfilename, false);
+      WriteChromeTrace(ko.Stream());
+    }
 
     KALDI_LOG << "Decoded " << num_done << " utterances, "
               << num_err << " with errors.";
     KALDI_LOG << "Overall likelihood per frame was " << (tot_like / num_frames)
               << " per frame over " << num_frames << " frames.";
     delete decode_fst;
+    delete csr_fst;
     delete word_syms; // will delete if non-NULL.
     return (num_done != 0 ? 0 : 1);
   } catch(const std::exception& e) {
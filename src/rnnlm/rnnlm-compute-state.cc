@@ -19,6 +19,8 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+
 #include "rnnlm/rnnlm-compute-state.h"
 #include "nnet3/nnet-utils.h"
 #include "nnet3/nnet-compile-looped.h"
@@ -26,11 +28,14 @@
 namespace kaldi {
 namespace rnnlm {
 
-RnnlmComputeStateInfo::RnnlmComputeStateInfo(
+// Checks the RNNLM and the options, and compiles the looped computation for
+// 'num_sequences' sequences, with one word per chunk.
+static void CompileRnnlmComputation(
     const RnnlmComputeStateComputationOptions &opts,
     const kaldi::nnet3::Nnet &rnnlm,
-    const CuMatrix<BaseFloat> &word_embedding_mat):
-    opts(opts), rnnlm(rnnlm), word_embedding_mat(word_embedding_mat) {
+    const CuMatrix<BaseFloat> &word_embedding_mat,
+    int32 num_sequences,
+    nnet3::NnetComputation *computation) {
   KALDI_ASSERT(IsSimpleNnet(rnnlm));
   int32 left_context, right_context;
   ComputeSimpleNnetContext(rnnlm, &left_context, &right_context);
@@ -58,18 +63,88 @@ RnnlmComputeStateInfo::RnnlmComputeStateInfo(
                                        1, // ivector_period = 1
                                        0, // extra_left_context_initial == 0
                                        0, // extra_right_context == 0
-                                       1, // num_sequnces == 1
+                                       num_sequences,
                                        &request1, &request2, &request3);
 
   CompileLooped(rnnlm, opts.optimize_config, request1, request2,
-                request3, &computation);
-  computation.ComputeCudaIndexes();
+                request3, computation);
+  computation->ComputeCudaIndexes();
   if (GetVerboseLevel() >= 3) {
     KALDI_VLOG(3) << "Computation is:";
-    computation.Print(std::cerr, rnnlm);
+    computation->Print(std::cerr, rnnlm);
   }
 }
 
+RnnlmNormalizer::RnnlmNormalizer(
+    const RnnlmComputeStateComputationOptions &opts,
+    const CuMatrix<BaseFloat> &word_embedding_mat):
+    word_embedding_mat_(word_embedding_mat) {
+  int32 num_words = word_embedding_mat.NumRows(),
+      shortlist = opts.normalization_shortlist,
+      num_samples = opts.normalization_samples;
+  KALDI_ASSERT(shortlist >= 0 && num_samples >= 0);
+  if (shortlist == 0 || shortlist + num_samples >= num_words - 1)
+    return;  // We compute the exact normalizer.
+
+  // The words outside the shortlist (other than <eps>); we choose a sample of
+  // them by partial Fisher-Yates shuffling, with a fixed seed so that the
+  // results are reproducible.
+  std::vector<int32> words;
+  for (int32 w = shortlist + 1; w < num_words; w++)
+    words.push_back(w);
+  RandomState rand_state;
+  rand_state.seed = 27437;
+  for (int32 i = 0; i < num_samples; i++)
+    std::swap(words[i], words[RandInt(i, words.size() - 1, &rand_state)]);
+  BaseFloat sample_weight = words.size() / static_cast<BaseFloat>(num_samples);
+  words.resize(num_samples);
+  for (int32 w = shortlist; w >= 1; w--)
+    words.insert(words.begin(), w);
+
+  CuArray<int32> words_cu(words);
+  embeddings_.Resize(words.size(), word_embedding_mat.NumCols(), kUndefined);
+  embeddings_.CopyRows(word_embedding_mat, words_cu);
+  Vector<BaseFloat> weights(words.size());
+  weights.Range(0, shortlist).Set(1.0);
+  weights.Range(shortlist, num_samples).Set(sample_weight);
+  weights_ = weights;
+}
+
+void RnnlmNormalizer::Compute(
+    const CuMatrixBase<BaseFloat> &predicted_word_embeddings,
+    CuVectorBase<BaseFloat> *normalizers) const {
+  int32 num_rows = predicted_word_embeddings.NumRows();
+  KALDI_ASSERT(normalizers->Dim() == num_rows);
+  if (weights_.Dim() == 0) {
+    // We exclude the <eps> symbol, which is always 0.
+    int32 num_words = word_embedding_mat_.NumRows();
+    CuMatrix<BaseFloat> probs(num_rows, num_words - 1, kUndefined);
+    probs.AddMatMat(1.0, predicted_word_embeddings, kNoTrans,
+                    word_embedding_mat_.RowRange(1, num_words - 1), kTrans,
+                    0.0);
+    probs.ApplyExp();
+    normalizers->AddColSumMat(1.0, probs, 0.0);
+  } else {
+    CuMatrix<BaseFloat> probs(num_rows, embeddings_.NumRows(), kUndefined);
+    probs.AddMatMat(1.0, predicted_word_embeddings, kNoTrans,
+                    embeddings_, kTrans, 0.0);
+    probs.ApplyExp();
+    normalizers->AddMatVec(1.0, probs, kNoTrans, weights_, 0.0);
+  }
+  normalizers->ApplyLog();
+}
+
+RnnlmComputeStateInfo::RnnlmComputeStateInfo(
+    const RnnlmComputeStateComputationOptions &opts,
+    const kaldi::nnet3::Nnet &rnnlm,
+    const CuMatrix<BaseFloat> &word_embedding_mat):
+    opts(opts), rnnlm(rnnlm), word_embedding_mat(word_embedding_mat),
+    normalizer(opts, word_embedding_mat) {
+  CompileRnnlmComputation(opts, rnnlm, word_embedding_mat,
+                          1, // num_sequences == 1
+                          &computation);
+}
+
 RnnlmComputeState::RnnlmComputeState(const RnnlmComputeStateInfo &info,
                                      int32 bos_index) :
     info_(info),
@@ -97,16 +172,10 @@ void RnnlmComputeState::AddWord(int32 word_index) {
   previous_word_ = word_index;
   AdvanceChunk();
 
-  const CuMatrix<BaseFloat> &word_embedding_mat = info_.word_embedding_mat;
   if (info_.opts.normalize_probs) {
-    CuVector<BaseFloat> log_probs(info_.word_embedding_mat.NumRows());
-
-    log_probs.AddMatVec(1.0, word_embedding_mat, kNoTrans,
-                        predicted_word_embedding_->Row(0), 0.0);
-    log_probs.ApplyExp();
-
-    // We excluding the <eps> symbol which is always 0.
-    normalization_factor_ = log(log_probs.Range(1, log_probs.Dim() - 1).Sum());
+    CuVector<BaseFloat> normalizer(1);
+    info_.normalizer.Compute(*predicted_word_embedding_, &normalizer);
+    normalization_factor_ = normalizer(0);
   }
 }
 
@@ -157,5 +226,240 @@ void RnnlmComputeState::AdvanceChunk() {
   }
 }
 
+RnnlmBatchComputer::RnnlmBatchComputer(
+    const RnnlmComputeStateComputationOptions &opts,
+    const kaldi::nnet3::Nnet &rnnlm,
+    const CuMatrix<BaseFloat> &word_embedding_mat,
+    int32 batch_size):
+    opts_(opts), rnnlm_(rnnlm), word_embedding_mat_(word_embedding_mat),
+    batch_size_(batch_size), word_embedding_(NULL),
+    normalizer_(opts, word_embedding_mat) {
+  KALDI_ASSERT(batch_size > 0);
+  CompileRnnlmComputation(opts, rnnlm, word_embedding_mat, batch_size,
+                          &computation_);
+  if (computation_.matrix_debug_info.size() != computation_.matrices.size())
+    KALDI_ERR << "Expected the looped computation to have debug info.";
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    word_embedding_cpu_.Resize(word_embedding_mat.NumRows(),
+                               word_embedding_mat.NumCols(), kUndefined);
+    word_embedding_mat.CopyToMat(&word_embedding_cpu_);
+    word_embedding_ = &word_embedding_cpu_;
+  }
+#endif
+  if (word_embedding_ == NULL)
+    word_embedding_ = &(word_embedding_mat.Mat());
+
+  Position *start = new Position();
+  start->program_counter = 0;
+  start->computer = new nnet3::NnetComputer(opts_.compute_config, computation_,
+                                            rnnlm_, NULL);
+  positions_.push_back(start);
+  int32 bos_state = AddState(-1, opts_.bos_index);
+  ComputeBatch(bos_state);
+  KALDI_ASSERT(bos_state == 0 && states_[0].block == 0);
+}
+
+RnnlmBatchComputer::~RnnlmBatchComputer() {
+  for (size_t p = 0; p < positions_.size(); p++) {
+    delete positions_[p]->computer;
+    delete positions_[p];
+  }
+}
+
+int32 RnnlmBatchComputer::AddState(int32 state, int32 word) {
+  KALDI_ASSERT(state >= -1 && state < static_cast<int32>(states_.size()));
+  KALDI_ASSERT(word > 0 && word < word_embedding_mat_.NumRows());
+  if (state >= 0 && states_[state].position < 0)
+    ComputeBatch(state);
+  StateInfo info;
+  info.prev_state = state;
+  info.word = word;
+  info.position = -1;
+  info.block = -1;
+  int32 ans = states_.size();
+  states_.push_back(info);
+  int32 prev_position = (state < 0 ? 0 : states_[state].position);
+  positions_[prev_position]->pending.push_back(ans);
+  return ans;
+}
+
+BaseFloat RnnlmBatchComputer::LogProbOfWord(int32 state, int32 word) {
+  KALDI_ASSERT(static_cast<size_t>(state) < states_.size() &&
+               word >= 0 && word < word_embedding_->NumRows());
+  if (states_[state].position < 0)
+    ComputeBatch(state);
+  BaseFloat log_prob = VecVec(predicted_word_embeddings_.Row(state),
+                              word_embedding_->Row(word));
+  if (opts_.normalize_probs)
+    log_prob -= normalization_factors_(state);
+  return log_prob;
+}
+
+void RnnlmBatchComputer::Clear() {
+  states_.resize(1);
+  for (size_t p = 0; p < positions_.size(); p++) {
+    positions_[p]->num_blocks = 0;
+    positions_[p]->pending.clear();
+  }
+  positions_[states_[0].position]->num_blocks = 1;
+}
+
+int32 RnnlmBatchComputer::GetPosition(nnet3::NnetComputer *computer,
+                                      bool *took_ownership) {
+  int32 program_counter = computer->ProgramCounter();
+  for (size_t p = 0; p < positions_.size(); p++) {
+    if (positions_[p]->program_counter == program_counter) {
+      *took_ownership = false;
+      return p;
+    }
+  }
+  Position *pos = new Position();
+  pos->program_counter = program_counter;
+  pos->computer = computer;
+  *took_ownership = true;
+  int32 num_matrices = computation_.matrices.size();
+  for (int32 m = 0; m < num_matrices; m++) {
+    const CuMatrix<BaseFloat> &mat = computer->GetMatrix(m);
+    if (mat.NumRows() == 0)
+      continue;
+    const std::vector<nnet3::Cindex> &cindexes =
+        computation_.matrix_debug_info[m].cindexes;
+    KALDI_ASSERT(cindexes.size() == static_cast<size_t>(mat.NumRows()));
+    std::vector<std::vector<int32> > rows(batch_size_);
+    for (int32 r = 0; r < mat.NumRows(); r++) {
+      int32 n = cindexes[r].second.n;
+      KALDI_ASSERT(n >= 0 && n < batch_size_);
+      rows[n].push_back(r);
+    }
+    int32 rows_per_seq = mat.NumRows() / batch_size_;
+    std::vector<int32> seq_rows;
+    for (int32 n = 0; n < batch_size_; n++) {
+      if (rows[n].size() != static_cast<size_t>(rows_per_seq))
+        KALDI_ERR << "Matrix " << m << " of the computation does not have "
+                  << "the same number of rows for each sequence; cannot "
+                  << "batch this RNNLM.";
+      seq_rows.insert(seq_rows.end(), rows[n].begin(), rows[n].end());
+    }
+    pos->matrices.push_back(m);
+    pos->rows_per_seq.push_back(rows_per_seq);
+    pos->seq_rows.push_back(seq_rows);
+    pos->seq_rows_cu.resize(pos->seq_rows_cu.size() + 1);
+    pos->seq_rows_cu.back().CopyFromVec(seq_rows);
+    pos->data.resize(pos->data.size() + 1);
+    pos->data.back().Resize(batch_size_ * rows_per_seq, mat.NumCols(),
+                            kUndefined);
+  }
+  positions_.push_back(pos);
+  return positions_.size() - 1;
+}
+
+void RnnlmBatchComputer::ComputeBatch(int32 state) {
+  KALDI_ASSERT(states_[state].position < 0);
+  int32 prev_state = states_[state].prev_state,
+      p = (prev_state < 0 ? 0 : states_[prev_state].position);
+  Position &pos = *(positions_[p]);
+
+  // The batch is 'state' and the most recently added other states that
+  // continue from the same position.
+  std::vector<int32> batch(1, state);
+  std::vector<int32>::iterator iter = std::find(pos.pending.begin(),
+                                                pos.pending.end(), state);
+  KALDI_ASSERT(iter != pos.pending.end());
+  pos.pending.erase(iter);
+  while (static_cast<int32>(batch.size()) < batch_size_ &&
+         !pos.pending.empty()) {
+    batch.push_back(pos.pending.back());
+    pos.pending.pop_back();
+  }
+  int32 num_used = batch.size();
+  // The unused sequences repeat the first state.
+  batch.resize(batch_size_, state);
+
+  // Positions that are followed by themselves (the steady state of the
+  // computation) are computed in place; others, with a copy of the computer.
+  bool copy_computer = (pos.next_position != p);
+  nnet3::NnetComputer *computer = (copy_computer ?
+                                   new nnet3::NnetComputer(*pos.computer) :
+                                   pos.computer);
+
+  for (size_t i = 0; i < pos.matrices.size(); i++) {
+    int32 k = pos.rows_per_seq[i];
+    CuMatrix<BaseFloat> &mat = computer->GetMatrix(pos.matrices[i]);
+    std::vector<int32> indexes(mat.NumRows());
+    for (int32 n = 0; n < batch_size_; n++) {
+      int32 prev_block = states_[states_[batch[n]].prev_state].block;
+      for (int32 j = 0; j < k; j++)
+        indexes[pos.seq_rows[i][n * k + j]] = prev_block * k + j;
+    }
+    CuArray<int32> cu_indexes(indexes);
+    mat.CopyRows(pos.data[i], cu_indexes);
+  }
+
+  std::vector<int32> words(batch_size_);
+  for (int32 n = 0; n < batch_size_; n++)
+    words[n] = states_[batch[n]].word;
+  CuArray<int32> cu_words(words);
+  CuMatrix<BaseFloat> input(batch_size_, word_embedding_mat_.NumCols(),
+                            kUndefined);
+  input.CopyRows(word_embedding_mat_, cu_words);
+  computer->AcceptInput("input", &input);
+  computer->Run();
+  // Note: as in RnnlmComputeState, we must not use GetOutputDestructive().
+  const CuMatrixBase<BaseFloat> &output = computer->GetOutput("output");
+
+  bool took_ownership = false;
+  int32 q = GetPosition(computer, &took_ownership);
+  KALDI_ASSERT(copy_computer || q == p);
+  pos.next_position = q;
+  Position &next_pos = *(positions_[q]);
+
+  // Store the recurrent state of the new states.
+  int32 base = next_pos.num_blocks;
+  for (size_t i = 0; i < next_pos.matrices.size(); i++) {
+    int32 k = next_pos.rows_per_seq[i];
+    CuMatrix<BaseFloat> &data = next_pos.data[i];
+    if ((base + num_used) * k > data.NumRows()) {
+      CuMatrix<BaseFloat> new_data(std::max(2 * data.NumRows(),
+                                            (base + num_used) * k),
+                                   data.NumCols(), kUndefined);
+      if (base > 0)
+        new_data.RowRange(0, base * k).CopyFromMat(data.RowRange(0, base * k));
+      data.Swap(&new_data);
+    }
+    CuSubArray<int32> indexes(next_pos.seq_rows_cu[i], 0, num_used * k);
+    data.RowRange(base * k, num_used * k).CopyRows(
+        computer->GetMatrix(next_pos.matrices[i]), indexes);
+  }
+  next_pos.num_blocks += num_used;
+
+  int32 num_states = states_.size();
+  if (predicted_word_embeddings_.NumRows() < num_states) {
+    int32 new_num_rows = std::max(2 * predicted_word_embeddings_.NumRows(),
+                                  num_states);
+    predicted_word_embeddings_.Resize(new_num_rows, output.NumCols(),
+                                      kCopyData);
+    normalization_factors_.Resize(new_num_rows, kCopyData);
+  }
+  CuSubMatrix<BaseFloat> used_output(output, 0, num_used, 0,
+                                     output.NumCols());
+  Matrix<BaseFloat> output_cpu(used_output);
+  for (int32 n = 0; n < num_used; n++) {
+    int32 s = batch[n];
+    predicted_word_embeddings_.Row(s).CopyFromVec(output_cpu.Row(n));
+    states_[s].position = q;
+    states_[s].block = base + n;
+  }
+  if (opts_.normalize_probs) {
+    CuVector<BaseFloat> sums(num_used);
+    normalizer_.Compute(used_output, &sums);
+    Vector<BaseFloat> sums_cpu(sums);
+    for (int32 n = 0; n < num_used; n++)
+      normalization_factors_(batch[n]) = sums_cpu(n);
+  }
+  if (copy_computer && !took_ownership)
+    delete computer;
+}
+
 } // namespace rnnlm
 } // namespace kaldi
@@ -35,6 +35,10 @@ namespace rnnlm {
 struct RnnlmComputeStateComputationOptions {
   bool debug_computation;
   bool normalize_probs;
+  // If >0, the normalizer is approximated using only this many of the most
+  // frequent words, plus a sample of the others; see RnnlmNormalizer.
+  int32 normalization_shortlist;
+  int32 normalization_samples;
   // We need this when we initialize the RnnlmComputeState and pass the BOS history.
   int32 bos_index;
   // We need this to compute the Final() cost of a state.
@@ -46,6 +50,8 @@ struct RnnlmComputeStateComputationOptions {
   RnnlmComputeStateComputationOptions():
       debug_computation(false),
       normalize_probs(false),
+      normalization_shortlist(0),
+      normalization_samples(100),
       bos_index(-1),
       eos_index(-1),
       brk_index(-1)
@@ -57,6 +63,17 @@ struct RnnlmComputeStateComputationOptions {
     opts->Register("normalize-probs", &normalize_probs, "If true, word "
        "probabilities will be correctly normalized (otherwise the sum-to-one "
        "normalization is approximate)");
+    opts->Register("normalization-shortlist", &normalization_shortlist,
+                   "If >0 and --normalize-probs=true, the normalizer is "
+                   "computed exactly only over this many words with the "
+                   "lowest indexes (the most frequent words, as the vocabulary "
+                   "is sorted by count), and the contribution of the other "
+                   "words is estimated from --normalization-samples of them. "
+                   "This makes the cost independent of the vocabulary size.");
+    opts->Register("normalization-samples", &normalization_samples,
+                   "Number of words outside the shortlist that are used to "
+                   "estimate their contribution to the normalizer; only "
+                   "relevant if --normalization-shortlist > 0.");
     opts->Register("bos-symbol", &bos_index, "Index in wordlist representing "
                    "the begin-of-sentence symbol");
     opts->Register("eos-symbol", &eos_index, "Index in wordlist representing "
@@ -75,6 +92,36 @@ struct RnnlmComputeStateComputationOptions {
   }
 };
 
+/*
+  This class computes the normalizer of the word probabilities, i.e. the log of
+  the sum over all words (except <eps>) of the exp'ed unnormalized log-probs,
+  for a set of predicted word embeddings.
+
+  If opts.normalization_shortlist is zero this is exact, and it needs a product
+  with the whole word-embedding matrix.  Otherwise the sum is computed exactly
+  over the words 1 ... normalization_shortlist, and the sum over the rest is
+  estimated from a fixed random sample of opts.normalization_samples of them,
+  scaled up by the inverse of the sampling rate.  Since the vocabulary is
+  sorted by count, the shortlist will cover most of the probability mass.
+*/
+class RnnlmNormalizer {
+ public:
+  RnnlmNormalizer(const RnnlmComputeStateComputationOptions &opts,
+                  const CuMatrix<BaseFloat> &word_embedding_mat);
+
+  /// Sets (*normalizers)(i) to the log-normalizer for row i of
+  /// 'predicted_word_embeddings'.
+  void Compute(const CuMatrixBase<BaseFloat> &predicted_word_embeddings,
+               CuVectorBase<BaseFloat> *normalizers) const;
+
+ private:
+  const CuMatrix<BaseFloat> &word_embedding_mat_;
+  // If we are approximating, the embeddings of the words in the shortlist and
+  // the sample, and the weight of each; empty if we are exact.
+  CuMatrix<BaseFloat> embeddings_;
+  CuVector<BaseFloat> weights_;
+};
+
 /*
   This class const references to the word-embedding, nnet3 part of rnnlm and
 the RnnlmComputeStateComputationOptions. It handles the computation of the nnet3
@@ -93,6 +140,9 @@ class RnnlmComputeStateInfo  {
 
   // The compiled, 'looped' computation.
   nnet3::NnetComputation computation;
+
+  // Only used if opts.normalize_probs is true.
+  RnnlmNormalizer normalizer;
 };
 
 /*
@@ -143,6 +193,136 @@ class RnnlmComputeState {
 };
 
 
+/*
+  This class computes the RNNLM for many histories at once, which is much
+  faster than RnnlmComputeState on a GPU, where the computation for a single
+  word is dominated by the overhead of launching kernels.  It runs a looped
+  computation with 'batch_size' sequences, and before each chunk it loads the
+  recurrent state of a different history into each sequence, so that one
+  NnetComputer::Run() advances up to 'batch_size' histories by one word.
+
+  Histories (states) are identified by integers.  AddState() does not compute
+  anything: the computation for a state is deferred until its log-probs are
+  needed, and is then done together with that of other pending states, most
+  recently added first.  So when this is used from an on-demand FST in a
+  best-first search such as ComposeCompactLatticePruned(), the batches are
+  formed from the frontier of the search (at the cost of some computation for
+  states that are never expanded).
+
+  The recurrent state of each computed history is kept on the GPU, and its
+  predicted word embedding in CPU memory, so that LogProbOfWord() is a dot
+  product on the CPU; for this, when a GPU is used, a CPU copy of the word
+  embedding matrix is kept.
+
+  This class is not thread-safe.
+*/
+class RnnlmBatchComputer {
+ public:
+  /// Compiles the computation and computes the state after the BOS history,
+  /// which will have state-id 0.  The arguments must outlive this object.
+  RnnlmBatchComputer(const RnnlmComputeStateComputationOptions &opts,
+                     const kaldi::nnet3::Nnet &rnnlm,
+                     const CuMatrix<BaseFloat> &word_embedding_mat,
+                     int32 batch_size);
+
+  ~RnnlmBatchComputer();
+
+  const RnnlmComputeStateComputationOptions &Options() const { return opts_; }
+
+  /// Returns the id of a new state, whose history is that of 'state' followed
+  /// by 'word'.  It will be computed when it is first needed.
+  int32 AddState(int32 state, int32 word);
+
+  /// Returns the log-prob that the model predicts for 'word' after the history
+  /// of 'state'.  This may do the computation for a batch of states.
+  BaseFloat LogProbOfWord(int32 state, int32 word);
+
+  /// Forgets all states except the BOS state (state 0); call this between
+  /// lattices to free memory.
+  void Clear();
+
+ private:
+  // A point between chunks in the looped computation, with the recurrent state
+  // that the computed histories have at that point.  There are only a few of
+  // these: one for each of the first few words, and one for all the rest.
+  struct Position {
+    // NnetComputer::ProgramCounter() after GetOutput() at this point.
+    int32 program_counter;
+    // A computer that is paused at this point; owned here.
+    nnet3::NnetComputer *computer;
+    // If known, the index of the position after the next chunk; or -1.
+    int32 next_position;
+    // The matrices that are allocated at this point (the recurrent state).
+    std::vector<int32> matrices;
+    // For each matrix in 'matrices', the number of rows per sequence.
+    std::vector<int32> rows_per_seq;
+    // For each matrix in 'matrices', its row for each (sequence n, row j of
+    // that sequence), at index n * rows_per_seq[i] + j.
+    std::vector<std::vector<int32> > seq_rows;
+    // The same as 'seq_rows', on the GPU.
+    std::vector<CuArray<int32> > seq_rows_cu;
+    // For each matrix in 'matrices', the recurrent state of the histories
+    // stored here: history with block-index b owns rows
+    // b * rows_per_seq[i] ... (b + 1) * rows_per_seq[i] - 1.
+    std::vector<CuMatrix<BaseFloat> > data;
+    // The number of blocks in use in 'data'.
+    int32 num_blocks;
+    // The states waiting to be computed whose previous state is stored here,
+    // in the order in which they were added.
+    std::vector<int32> pending;
+    Position(): program_counter(-1), computer(NULL), next_position(-1),
+                num_blocks(0) { }
+  };
+
+  struct StateInfo {
+    // The previous state (-1 for the BOS state) and the word that was added.
+    int32 prev_state;
+    int32 word;
+    // The index of the Position that holds the recurrent state, or -1 if this
+    // state has not been computed yet.
+    int32 position;
+    // The block-index within that Position.
+    int32 block;
+  };
+
+  // Computes 'state', which must be pending, together with up to
+  // batch_size_ - 1 other pending states.
+  void ComputeBatch(int32 state);
+
+  // Returns the index of the Position for 'computer', which has just produced
+  // its output, creating it (and taking ownership of 'computer') if it does
+  // not exist yet; sets *took_ownership accordingly.
+  int32 GetPosition(nnet3::NnetComputer *computer, bool *took_ownership);
+
+  const RnnlmComputeStateComputationOptions &opts_;
+  const kaldi::nnet3::Nnet &rnnlm_;
+  const CuMatrix<BaseFloat> &word_embedding_mat_;
+  int32 batch_size_;
+  // The looped computation for batch_size_ sequences.
+  nnet3::NnetComputation computation_;
+
+  // A CPU copy of word_embedding_mat_; only used if we are using a GPU.
+  Matrix<BaseFloat> word_embedding_cpu_;
+  // word_embedding_mat_ as a CPU matrix (either word_embedding_cpu_, or
+  // word_embedding_mat_ itself if we are not using a GPU).
+  const MatrixBase<BaseFloat> *word_embedding_;
+
+  std::vector<StateInfo> states_;
+  // positions_[0] is the start of the computation.
+  std::vector<Position*> positions_;
+
+  // Row s is the predicted word embedding of state s, if it has been
+  // computed; it has spare rows, to allow for adding more states.
+  Matrix<BaseFloat> predicted_word_embeddings_;
+  // The log of the sum of the exp'ed log-probs, for each computed state;
+  // only used if opts_.normalize_probs is true.
+  Vector<BaseFloat> normalization_factors_;
+  RnnlmNormalizer normalizer_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(RnnlmBatchComputer);
+};
+
+
 } // namespace rnnlm
 } // namespace kaldi
 
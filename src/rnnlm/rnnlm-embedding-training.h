@@ -51,6 +51,10 @@ struct RnnlmEmbeddingTrainerOptions {
                             // write the embedding matrix).
   BaseFloat backstitch_training_scale;
   int32 backstitch_training_interval;
+  // If true, then when training on sampled egs with a feature representation
+  // of words, only the rows of the feature-embedding matrix for features of
+  // the words in the minibatch are updated.
+  bool sparse_feature_update;
 
   // Natural-gradient related options
   bool use_natural_gradient;
@@ -67,6 +71,7 @@ struct RnnlmEmbeddingTrainerOptions {
       learning_rate(0.01),
       backstitch_training_scale(0.0),
       backstitch_training_interval(1),
+      sparse_feature_update(true),
       use_natural_gradient(true),
       natural_gradient_alpha(4.0),
       natural_gradient_rank(80),
@@ -98,6 +103,14 @@ struct RnnlmEmbeddingTrainerOptions {
                    &backstitch_training_interval,
                    "do backstitch training with the specified interval of "
                    "minibatches. It is referred to as 'n' in our publications.");
+    opts->Register("sparse-feature-update", &sparse_feature_update,
+                   "If true, when training on sampled egs with sparse word "
+                   "features, compute the derivative for and update just the "
+                   "rows of the feature-embedding matrix for features active "
+                   "in the minibatch (as is always done for the word-embedding "
+                   "matrix when there are no features).  This saves a lot of "
+                   "memory bandwidth with large feature sets; it only affects "
+                   "the result via l2 regularization and natural gradient.");
     opts->Register("use-natural-gradient", &use_natural_gradient,
                    "True if you want to use natural gradient to update the "
                    "embedding matrix");
@@ -312,7 +312,11 @@ class RnnlmExampleSampler {
   // Does the sampling for 'minibatch'.  'minibatch' is expected to already
   // have all fields populated except for 'sampled_words' and 'sample_probs'.
   // This function does the sampling and sets those fields.
-  void SampleForMinibatch(RnnlmExample *minibatch) const;
+  // If 'rand_state' is non-NULL it is used as the random number generator,
+  // instead of the global one; this lets several threads sample at once
+  // without contending for the lock inside the global generator.
+  void SampleForMinibatch(RnnlmExample *minibatch,
+                          RandomState *rand_state = NULL) const;
 
   ~RnnlmExampleSampler() { delete sampler_; }
 
@@ -324,7 +328,8 @@ class RnnlmExampleSampler {
   // same as the position 0 <= t < chunk_length in the sequence if
   // config_.sample_group_size == 1, and otherwise, each group
   // encompasses several successive 't' values.
-  void SampleForGroup(int32 g, RnnlmExample *minibatch) const;
+  void SampleForGroup(int32 g, RnnlmExample *minibatch,
+                      RandomState *rand_state) const;
 
 
   // This function gets the combination of histories to be sampled from for the g'th
@@ -555,6 +560,9 @@ class RnnlmExampleCreator {
   // This class is a wrapper class that, when provided to class TaskSequencer, allows us to
   // run the call 'sampler.SampleForMinibatch(minibatch)' in multiple threads, followed by
   // sequentially calling writer->Write(key, *minibatch) and deleting minibatch.
+  // Each task has its own random number generator, seeded from the global one
+  // when the task is created (in the main thread), so the output does not
+  // depend on the number of threads or on the order in which they run.
   class SamplerTask {
    public:
     SamplerTask(const RnnlmExampleSampler &sampler,
@@ -564,7 +572,7 @@ class RnnlmExampleCreator {
         sampler_(sampler), key_(key), writer_(writer), minibatch_(minibatch) { }
 
     void operator () () {
-      sampler_.SampleForMinibatch(minibatch_);
+      sampler_.SampleForMinibatch(minibatch_, &rand_state_);
     }
     ~SamplerTask() {
       writer_->Write(key_, *minibatch_);
@@ -575,6 +583,7 @@ class RnnlmExampleCreator {
     std::string key_;
     TableWriter<KaldiObjectHolder<RnnlmExample> > *writer_;
     RnnlmExample *minibatch_; // owned here.
+    RandomState rand_state_;
   };
 
 
@@ -29,10 +29,6 @@ namespace kaldi {
 namespace rnnlm {
 
 KaldiRnnlmDeterministicFst::~KaldiRnnlmDeterministicFst() {
-  int32 size = state_to_rnnlm_state_.size();
-  for (int32 i = 0; i < size; i++)
-    delete state_to_rnnlm_state_[i];
-  
   state_to_rnnlm_state_.resize(0);
   state_to_wseq_.resize(0);
   wseq_to_state_.clear();
@@ -41,10 +37,6 @@ KaldiRnnlmDeterministicFst::~KaldiRnnlmDeterministicFst() {
 void KaldiRnnlmDeterministicFst::Clear() {
   // This function is similar to the destructor but we retain the 0-th entries
   // in each map which corresponds to the <bos> state.
-  int32 size = state_to_rnnlm_state_.size();
-  for (int32 i = 1; i < size; i++)
-    delete state_to_rnnlm_state_[i];
-  
   state_to_rnnlm_state_.resize(1);
   state_to_wseq_.resize(1);
   wseq_to_state_.clear();
@@ -52,7 +44,8 @@ void KaldiRnnlmDeterministicFst::Clear() {
 }
 
 KaldiRnnlmDeterministicFst::KaldiRnnlmDeterministicFst(int32 max_ngram_order,
-    const RnnlmComputeStateInfo &info) {
+    const RnnlmComputeStateInfo &info, KaldiRnnlmStateCache *cache):
+    cache_(cache) {
   max_ngram_order_ = max_ngram_order;
   bos_index_ = info.opts.bos_index;
   eos_index_ = info.opts.eos_index;
@@ -60,7 +53,12 @@ KaldiRnnlmDeterministicFst::KaldiRnnlmDeterministicFst(int32 max_ngram_order,
   std::vector<Label> bos_seq;
   bos_seq.push_back(bos_index_);
   state_to_wseq_.push_back(bos_seq);
-  RnnlmComputeState *decodable_rnnlm = new RnnlmComputeState(info, bos_index_);
+  std::shared_ptr<const RnnlmComputeState> decodable_rnnlm;
+  if (cache_ == NULL || !cache_->Find(bos_seq, &decodable_rnnlm)) {
+    decodable_rnnlm.reset(new RnnlmComputeState(info, bos_index_));
+    if (cache_ != NULL)
+      cache_->Insert(bos_seq, decodable_rnnlm);
+  }
   wseq_to_state_[bos_seq] = 0;
   start_state_ = 0;
 
@@ -71,7 +69,7 @@ fst::StdArc::Weight KaldiRnnlmDeterministicFst::Final(StateId s) {
   /// At this point, we have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
 
-  RnnlmComputeState* rnn = state_to_rnnlm_state_[s];
+  const RnnlmComputeState* rnn = state_to_rnnlm_state_[s].get();
   return Weight(-rnn->LogProbOfWord(eos_index_));
 }
 
@@ -81,7 +79,7 @@ bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
 
   std::vector<Label> word_seq = state_to_wseq_[s];
-  const RnnlmComputeState* rnnlm = state_to_rnnlm_state_[s];
+  const RnnlmComputeState* rnnlm = state_to_rnnlm_state_[s].get();
 
   BaseFloat logprob = rnnlm->LogProbOfWord(ilabel);
 
@@ -103,7 +101,12 @@ bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
 
   // If the pair was just inserted, then also add it to state_to_* structures.
   if (result.second == true) {
-    RnnlmComputeState *rnnlm2 = rnnlm->GetSuccessorState(ilabel);
+    std::shared_ptr<const RnnlmComputeState> rnnlm2;
+    if (cache_ == NULL || !cache_->Find(word_seq, &rnnlm2)) {
+      rnnlm2.reset(rnnlm->GetSuccessorState(ilabel));
+      if (cache_ != NULL)
+        cache_->Insert(word_seq, rnnlm2);
+    }
     state_to_wseq_.push_back(word_seq);
     state_to_rnnlm_state_.push_back(rnnlm2);
   }
@@ -116,5 +119,64 @@ bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
   return true;
 }
 
+KaldiRnnlmBatchDeterministicFst::KaldiRnnlmBatchDeterministicFst(
+    int32 max_ngram_order, RnnlmBatchComputer *computer):
+    max_ngram_order_(max_ngram_order),
+    eos_index_(computer->Options().eos_index),
+    computer_(computer) {
+  computer_->Clear();
+  std::vector<Label> bos_seq(1, computer->Options().bos_index);
+  state_to_wseq_.push_back(bos_seq);
+  state_to_rnnlm_state_.push_back(0);  // The BOS state of <computer>.
+  wseq_to_state_[bos_seq] = 0;
+}
+
+void KaldiRnnlmBatchDeterministicFst::Clear() {
+  state_to_rnnlm_state_.resize(1);
+  state_to_wseq_.resize(1);
+  wseq_to_state_.clear();
+  wseq_to_state_[state_to_wseq_[0]] = 0;
+  computer_->Clear();
+}
+
+fst::StdArc::Weight KaldiRnnlmBatchDeterministicFst::Final(StateId s) {
+  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
+  return Weight(-computer_->LogProbOfWord(state_to_rnnlm_state_[s],
+                                          eos_index_));
+}
+
+bool KaldiRnnlmBatchDeterministicFst::GetArc(StateId s, Label ilabel,
+                                             fst::StdArc *oarc) {
+  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
+
+  int32 rnnlm_state = state_to_rnnlm_state_[s];
+  BaseFloat logprob = computer_->LogProbOfWord(rnnlm_state, ilabel);
+
+  std::vector<Label> word_seq = state_to_wseq_[s];
+  word_seq.push_back(ilabel);
+  if (max_ngram_order_ > 0) {
+    while (word_seq.size() >= max_ngram_order_) {
+      /// History state has at most <max_ngram_order_> - 1 words in the state.
+      word_seq.erase(word_seq.begin(), word_seq.begin() + 1);
+    }
+  }
+
+  std::pair<const std::vector<Label>, StateId> wseq_state_pair(
+      word_seq, static_cast<Label>(state_to_wseq_.size()));
+  typedef MapType::iterator IterType;
+  std::pair<IterType, bool> result = wseq_to_state_.insert(wseq_state_pair);
+  if (result.second) {
+    // The new RNNLM state is only computed when it is first needed.
+    state_to_wseq_.push_back(word_seq);
+    state_to_rnnlm_state_.push_back(computer_->AddState(rnnlm_state, ilabel));
+  }
+
+  oarc->ilabel = ilabel;
+  oarc->olabel = ilabel;
+  oarc->nextstate = result.first->second;
+  oarc->weight = Weight(-logprob);
+  return true;
+}
+
 }  // namespace rnnlm
 }  // namespace kaldi
@@ -22,6 +22,7 @@
 #ifndef KALDI_RNNLM_RNNLM_LATTICE_RESCORING_H_
 #define KALDI_RNNLM_RNNLM_LATTICE_RESCORING_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -29,10 +30,21 @@
 #include "fstext/deterministic-fst.h"
 #include "rnnlm/rnnlm-compute-state.h"
 #include "util/common-utils.h"
+#include "util/lru-cache.h"
 
 namespace kaldi {
 namespace rnnlm {
 
+// A cache from history (as the word sequence that identifies a state of
+// KaldiRnnlmDeterministicFst, starting with BOS) to the RNNLM state after
+// that history. It may be shared by the KaldiRnnlmDeterministicFst objects for
+// many lattices, in different threads (the states are only accessed through
+// const methods), so that the RNNLM is not re-run on common histories for
+// every lattice. The size should be chosen bearing in mind that each
+// RnnlmComputeState holds the recurrent state of the network.
+typedef LruCache<std::vector<int32>, std::shared_ptr<const RnnlmComputeState>,
+                 VectorHasher<int32> > KaldiRnnlmStateCache;
+
 class KaldiRnnlmDeterministicFst
     : public fst::DeterministicOnDemandFst<fst::StdArc> {
  public:
@@ -40,9 +52,15 @@ class KaldiRnnlmDeterministicFst
   typedef fst::StdArc::StateId StateId;
   typedef fst::StdArc::Label Label;
 
-  // Does not take ownership.
+  // Does not take ownership. If <cache> is not NULL (it must have been used
+  // only with this RNNLM and the same <max_ngram_order>), the RNNLM states are
+  // looked up there before being computed. Note that if max_ngram_order > 0,
+  // the state for a history is then the one computed for whichever longer
+  // history led to it first in any lattice, rather than in this lattice, so
+  // the results may depend slightly on the order of processing.
   KaldiRnnlmDeterministicFst(int32 max_ngram_order,
-      const RnnlmComputeStateInfo &info);
+      const RnnlmComputeStateInfo &info,
+      KaldiRnnlmStateCache *cache = NULL);
   ~KaldiRnnlmDeterministicFst();
 
   void Clear();
@@ -70,10 +88,52 @@ class KaldiRnnlmDeterministicFst
   // Mapping from state-id to history sequence>
   std::vector<std::vector<Label> > state_to_wseq_;
 
-  // Mapping from state-id to RNNLM states.
-  // The pointers are owned in this class
-  std::vector<RnnlmComputeState*> state_to_rnnlm_state_;
+  // Mapping from state-id to RNNLM states; they may be shared with <cache_>.
+  std::vector<std::shared_ptr<const RnnlmComputeState> > state_to_rnnlm_state_;
+
+  // Not owned here; may be NULL.
+  KaldiRnnlmStateCache *cache_;
+
+};
+
+// This is like KaldiRnnlmDeterministicFst, but it uses an RnnlmBatchComputer,
+// so the RNNLM states that it creates are computed in batches when they are
+// first needed (which is much faster on a GPU).
+class KaldiRnnlmBatchDeterministicFst
+    : public fst::DeterministicOnDemandFst<fst::StdArc> {
+ public:
+  typedef fst::StdArc::Weight Weight;
+  typedef fst::StdArc::StateId StateId;
+  typedef fst::StdArc::Label Label;
+
+  // Does not take ownership of <computer>, which must not be used by anything
+  // else while this object exists.
+  KaldiRnnlmBatchDeterministicFst(int32 max_ngram_order,
+                                  RnnlmBatchComputer *computer);
+
+  // Forgets all states but the start state, and clears <computer>.
+  void Clear();
+
+  virtual StateId Start() { return 0; }
+
+  virtual Weight Final(StateId s);
+
+  virtual bool GetArc(StateId s, Label ilabel, fst::StdArc* oarc);
+
+ private:
+  typedef unordered_map
+      <std::vector<Label>, StateId, VectorHasher<Label> > MapType;
+  int32 max_ngram_order_;
+  int32 eos_index_;
+  RnnlmBatchComputer *computer_;
+
+  MapType wseq_to_state_;
+
+  // Mapping from state-id to history sequence.
+  std::vector<std::vector<Label> > state_to_wseq_;
 
+  // Mapping from state-id to the state-id in <computer_>.
+  std::vector<int32> state_to_rnnlm_state_;
 };
 
 }  // namespace rnnlm
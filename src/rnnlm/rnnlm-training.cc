@@ -75,6 +75,21 @@ RnnlmTrainer::RnnlmTrainer(bool train_embedding,
 }
 
 
+// Outputs to 'active_features' the sorted, unique list of the features (column
+// indexes) that have a nonzero value for any row of 'word_features'.
+static void GetActiveFeatures(const CuSparseMatrix<BaseFloat> &word_features,
+                              std::vector<int32> *active_features) {
+  SparseMatrix<BaseFloat> word_features_cpu;
+  word_features.CopyToSmat(&word_features_cpu);
+  active_features->clear();
+  for (int32 r = 0; r < word_features_cpu.NumRows(); r++) {
+    const SparseVector<BaseFloat> &row = word_features_cpu.Row(r);
+    for (int32 i = 0; i < row.NumElements(); i++)
+      active_features->push_back(row.GetElement(i).first);
+  }
+  SortAndUniq(active_features);
+}
+
 void RnnlmTrainer::Train(RnnlmExample *minibatch) {
   // check the minibatch for sanity.
   if (minibatch->vocab_size != VocabSize())
@@ -88,6 +103,7 @@ void RnnlmTrainer::Train(RnnlmExample *minibatch) {
   CuArray<int32> active_words_cuda;
   CuSparseMatrix<BaseFloat> active_word_features;
   CuSparseMatrix<BaseFloat> active_word_features_trans;
+  CuArray<int32> active_features_cuda;
 
   if (!current_minibatch_.sampled_words.empty()) {
     std::vector<int32> active_words;
@@ -99,6 +115,15 @@ void RnnlmTrainer::Train(RnnlmExample *minibatch) {
                                       *word_feature_mat_);
       active_word_features_trans.CopyFromSmat(active_word_features,
                                               kTrans);
+      if (train_embedding_ && embedding_config_.sparse_feature_update) {
+        std::vector<int32> active_features;
+        GetActiveFeatures(active_word_features, &active_features);
+        active_features_cuda.CopyFromVec(active_features);
+        CuSparseMatrix<BaseFloat> active_features_trans;
+        active_features_trans.SelectRows(active_features_cuda,
+                                         active_word_features_trans);
+        active_word_features_trans.Swap(&active_features_trans);
+      }
     }
   }
   GetRnnlmExampleDerived(current_minibatch_, train_embedding_,
@@ -108,6 +133,7 @@ void RnnlmTrainer::Train(RnnlmExample *minibatch) {
   active_words_.Swap(&active_words_cuda);
   active_word_features_.Swap(&active_word_features);
   active_word_features_trans_.Swap(&active_word_features_trans);
+  active_features_.Swap(&active_features_cuda);
 
   TrainInternal();
 
@@ -174,8 +200,12 @@ void RnnlmTrainer::TrainWordEmbedding(
     if (!sampling && word_feature_mat_transpose_.NumRows() == 0)
       word_feature_mat_transpose_.CopyFromSmat(*word_feature_mat_, kTrans);
 
-    CuMatrix<BaseFloat> feature_embedding_deriv(embedding_mat_->NumRows(),
-                                                embedding_mat_->NumCols());
+    // If active_features_ is nonempty, the derivative is only computed for
+    // those rows of the feature-embedding matrix.
+    bool sparse = (sampling && active_features_.Dim() != 0);
+    CuMatrix<BaseFloat> feature_embedding_deriv(
+        sparse ? active_features_.Dim() : embedding_mat_->NumRows(),
+        embedding_mat_->NumCols());
     const CuSparseMatrix<BaseFloat> &word_features_trans =
         (sampling ? active_word_features_trans_ : word_feature_mat_transpose_);
 
@@ -187,7 +217,10 @@ void RnnlmTrainer::TrainWordEmbedding(
                   << ", word-embedding-deriv-sum is " << word_embedding_deriv->Sum()
                   << ", feature-embedding-deriv-sum is " << feature_embedding_deriv.Sum();
 
-    embedding_trainer_->Train(&feature_embedding_deriv);
+    if (sparse)
+      embedding_trainer_->Train(active_features_, &feature_embedding_deriv);
+    else
+      embedding_trainer_->Train(&feature_embedding_deriv);
   }
 }
 
@@ -213,8 +246,12 @@ void RnnlmTrainer::TrainBackstitchWordEmbedding(
     if (!sampling && word_feature_mat_transpose_.NumRows() == 0)
       word_feature_mat_transpose_.CopyFromSmat(*word_feature_mat_, kTrans);
 
-    CuMatrix<BaseFloat> feature_embedding_deriv(embedding_mat_->NumRows(),
-                                                embedding_mat_->NumCols());
+    // If active_features_ is nonempty, the derivative is only computed for
+    // those rows of the feature-embedding matrix.
+    bool sparse = (sampling && active_features_.Dim() != 0);
+    CuMatrix<BaseFloat> feature_embedding_deriv(
+        sparse ? active_features_.Dim() : embedding_mat_->NumRows(),
+        embedding_mat_->NumCols());
     const CuSparseMatrix<BaseFloat> &word_features_trans =
         (sampling ? active_word_features_trans_ : word_feature_mat_transpose_);
 
@@ -226,8 +263,12 @@ void RnnlmTrainer::TrainBackstitchWordEmbedding(
                   << ", word-embedding-deriv-sum is " << word_embedding_deriv->Sum()
                   << ", feature-embedding-deriv-sum is " << feature_embedding_deriv.Sum();
 
-    embedding_trainer_->TrainBackstitch(is_backstitch_step1,
-                                        &feature_embedding_deriv);
+    if (sparse)
+      embedding_trainer_->TrainBackstitch(is_backstitch_step1, active_features_,
+                                          &feature_embedding_deriv);
+    else
+      embedding_trainer_->TrainBackstitch(is_backstitch_step1,
+                                          &feature_embedding_deriv);
   }
 }
 
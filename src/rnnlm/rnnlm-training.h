@@ -178,7 +178,14 @@ class RnnlmTrainer {
   // Only if we are doing subsampling AND we have sparse word features,
   // active_word_features_trans_ is the transpose of active_word_features_;
   // This is a derived quantity computed by the background thread.
+  // If active_features_ is nonempty, it is limited to those rows.
   CuSparseMatrix<BaseFloat> active_word_features_trans_;
+  // Only if we are doing subsampling AND we have sparse word features AND
+  // embedding_config_.sparse_feature_update is true (and we are training the
+  // embedding), the sorted list of features that are active for any word in
+  // active_words_; only these rows of the feature-embedding matrix will be
+  // updated.  Otherwise it is empty.
+  CuArray<int32> active_features_;
 
   // This value is used in backstitch training when we need to ensure
   // consistent dropout masks.  It's set to a value derived from rand()
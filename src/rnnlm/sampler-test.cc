@@ -271,6 +271,21 @@ void UnitTestSampleWords() {
       }
       l++;  // for debugging purposes, in case it fails.
     }
+
+    // Check that sampling with our own random number generator gives
+    // reproducible results.
+    RandomState rand_state1, rand_state2;
+    rand_state2.seed = rand_state1.seed;
+    for (int32 j = 0; j < 5; j++) {
+      std::vector<std::pair<int32, BaseFloat> > sample1, sample2;
+      sampler.SampleWords(num_words_to_sample, unigram_weight,
+                          higher_order_probs, words_we_must_sample,
+                          &sample1, &rand_state1);
+      sampler.SampleWords(num_words_to_sample, unigram_weight,
+                          higher_order_probs, words_we_must_sample,
+                          &sample2, &rand_state2);
+      KALDI_ASSERT(sample1 == sample2);
+    }
   }
 }
 
@@ -41,9 +41,13 @@ namespace rnnlm {
    @params [out] sample  The vector 'sample' will be set to an unsorted list
                         of 'k' distinct samples with first order inclusion
                         probabilities given by 'probs'.
+   @params [in,out] rand_state  If non-NULL, the state of the random number
+                        generator to use; this avoids the locking inside the
+                        global generator when called from multiple threads.
  */
 void SampleWithoutReplacement(const std::vector<double> &probs,
-                              std::vector<int32> *sample);
+                              std::vector<int32> *sample,
+                              RandomState *rand_state = NULL);
 
 
 
@@ -70,11 +74,14 @@ void SampleWithoutReplacement(const std::vector<double> &probs,
                             example, so we'd return 'cdf_start' with proability 0.25,
                             'cdf_start + 1' with probability 0.5, and
                             'cdf_start + 2' with probability 0.25.
+     @param [in,out] rand_state  If non-NULL, the state of the random number
+                            generator to use.
      @return                Returns a pointer cdf_start <= p < cdf_end, with probability
                             proportional to p[1] - p[0].
 */
 const double* SampleFromCdf(const double *cdf_start,
-                            const double *cdf_end);
+                            const double *cdf_end,
+                            RandomState *rand_state = NULL);
 
 
 /**
@@ -130,10 +137,15 @@ class Sampler {
   ///                            with which that word was included in the set.
   ///                            The list will not be sorted, but it will be unique
   ///                            on the int.  Its size will equal num_words_to_sample.
+  ///   @param [in,out] rand_state  If non-NULL, the state of the random number
+  ///                            generator to use.  Supplying a separate one in
+  ///                            each thread avoids the locking inside the
+  ///                            global generator.
   void SampleWords(int32 num_words_to_sample,
                    BaseFloat unigram_weight,
                    const std::vector<std::pair<int32, BaseFloat> > &higher_order_probs,
-                   std::vector<std::pair<int32, BaseFloat> > *sample) const;
+                   std::vector<std::pair<int32, BaseFloat> > *sample,
+                   RandomState *rand_state = NULL) const;
 
   /// This is an alternative version of SampleWords() which allows you to
   /// specify a list of words that must be sampled (i.e. after scaling, they
@@ -150,7 +162,8 @@ class Sampler {
                    BaseFloat unigram_weight,
                    const std::vector<std::pair<int32, BaseFloat> > &higher_order_probs,
                    const std::vector<int32> &words_we_must_sample,
-                   std::vector<std::pair<int32, BaseFloat> > *sample) const;
+                   std::vector<std::pair<int32, BaseFloat> > *sample,
+                   RandomState *rand_state = NULL) const;
 
 
  private:
@@ -212,8 +225,11 @@ class Sampler {
   ///                    to here.  The size of this vector will equal
   ///                    'num_words_to_sample' at exit.  This vector will not
   ///                    be sorted.
+  ///  @param [in,out] rand_state  If non-NULL, the random number generator
+  ///                    state to use.
   void SampleFromIntervals(const std::vector<Interval> &intervals,
-                           std::vector<std::pair<int32, BaseFloat> > *sample) const;
+                           std::vector<std::pair<int32, BaseFloat> > *sample,
+                           RandomState *rand_state) const;
 
   // This helper function, used inside SampleWords(), combines the unigram and
   // higher-order portions of the distribution into a single unified format
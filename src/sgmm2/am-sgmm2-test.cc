@@ -258,6 +258,48 @@ void TestSgmm2PreXform(const AmSgmm2 &sgmm) {
   KALDI_ASSERT(res_vec.IsZero(1.0e-5));
 }
 
+// Tests that the multi-frame versions of GaussianSelection(),
+// ComputePerFrameVars() and LogLikelihoods() agree with the per-frame ones.
+void TestSgmm2Batched(const AmSgmm2 &sgmm) {
+  using namespace kaldi;
+  int32 dim = sgmm.FeatureDim(), num_frames = 1 + RandInt(0, 19);
+  kaldi::Sgmm2GselectConfig config;
+  config.full_gmm_nbest = 1 + sgmm.NumGauss() / 3;
+  config.diag_gmm_nbest = config.full_gmm_nbest + 1;
+
+  Matrix<BaseFloat> feats(num_frames, dim);
+  feats.SetRandn();
+  std::vector<std::vector<int32> > gselect;
+  BaseFloat tot_like = sgmm.GaussianSelection(config, feats, &gselect);
+  KALDI_ASSERT(static_cast<int32>(gselect.size()) == num_frames);
+
+  Sgmm2PerSpkDerivedVars empty;
+  std::vector<Sgmm2PerFrameDerivedVars> per_frame_vars;
+  sgmm.ComputePerFrameVars(feats, gselect, empty, &per_frame_vars);
+  std::vector<int32> pdfs;
+  for (int32 j2 = sgmm.NumPdfs() - 1; j2 >= 0; j2--)
+    pdfs.push_back(j2);
+  Matrix<BaseFloat> loglikes;
+  sgmm.LogLikelihoods(per_frame_vars, pdfs, &empty, &loglikes);
+
+  BaseFloat tot_like2 = 0.0;
+  Sgmm2LikelihoodCache sgmm_cache(sgmm.NumGroups(), sgmm.NumPdfs());
+  for (int32 t = 0; t < num_frames; t++) {
+    std::vector<int32> frame_gselect;
+    tot_like2 += sgmm.GaussianSelection(config, feats.Row(t), &frame_gselect);
+    KALDI_ASSERT(frame_gselect == gselect[t]);
+    Sgmm2PerFrameDerivedVars frame_vars;
+    sgmm.ComputePerFrameVars(feats.Row(t), frame_gselect, empty, &frame_vars);
+    AssertEqual(frame_vars.zti, per_frame_vars[t].zti, 1e-4);
+    AssertEqual(frame_vars.nti, per_frame_vars[t].nti, 1e-4);
+    sgmm_cache.NextFrame();
+    for (size_t k = 0; k < pdfs.size(); k++)
+      AssertEqual(sgmm.LogLikelihood(frame_vars, pdfs[k], &sgmm_cache, &empty),
+                  loglikes(t, k), 1e-4);
+  }
+  AssertEqual(tot_like, tot_like2, 1e-4);
+}
+
 void UnitTestSgmm2() {
   size_t dim = 1 + kaldi::RandInt(0, 9);  // random dimension of the gmm
   size_t num_comp = 1 + kaldi::RandInt(0, 9);  // random number of mixtures
@@ -275,6 +317,7 @@ void UnitTestSgmm2() {
   TestSgmm2Substates(sgmm);
   TestSgmm2IncreaseDim(sgmm);
   TestSgmm2PreXform(sgmm);
+  TestSgmm2Batched(sgmm);
 }
 
 int main() {
@@ -472,6 +472,62 @@ void AmSgmm2::ComputePerFrameVars(const VectorBase<BaseFloat> &data,
   }
 }
 
+void AmSgmm2::ComputePerFrameVars(
+    const MatrixBase<BaseFloat> &data,
+    const std::vector<std::vector<int32> > &gselect,
+    const Sgmm2PerSpkDerivedVars &spk_vars,
+    std::vector<Sgmm2PerFrameDerivedVars> *per_frame_vars) const {
+  KALDI_ASSERT(!n_.empty() && "ComputeNormalizers() must be called.");
+  int32 num_frames = data.NumRows(), feat_dim = FeatureDim(),
+      phn_dim = PhoneSpaceDim();
+  KALDI_ASSERT(static_cast<int32>(gselect.size()) == num_frames &&
+               data.NumCols() == feat_dim);
+  per_frame_vars->resize(num_frames);
+
+  // For each Gaussian i, the (t, ki) pairs of the frames that selected it.
+  std::vector<std::vector<std::pair<int32, int32> > > occurrences(NumGauss());
+  for (int32 t = 0; t < num_frames; t++) {
+    Sgmm2PerFrameDerivedVars &vars = (*per_frame_vars)[t];
+    vars.Resize(gselect[t].size(), feat_dim, phn_dim);
+    vars.gselect = gselect[t];
+    vars.xt.CopyFromVec(data.Row(t));
+    for (int32 ki = 0, last = gselect[t].size(); ki < last; ki++)
+      occurrences[gselect[t][ki]].push_back(std::make_pair(t, ki));
+  }
+
+  bool speaker_dep_weights =
+      (spk_vars.v_s.Dim() != 0 && HasSpeakerDependentWeights());
+  Matrix<BaseFloat> SigmaInv(feat_dim, feat_dim), xti, SigmaInv_xti, zti;
+  Vector<BaseFloat> nti;
+  for (int32 i = 0; i < NumGauss(); i++) {
+    const std::vector<std::pair<int32, int32> > &occ = occurrences[i];
+    int32 num_occ = occ.size();
+    if (num_occ == 0) continue;
+    xti.Resize(num_occ, feat_dim, kUndefined);
+    for (int32 k = 0; k < num_occ; k++)
+      xti.Row(k).CopyFromVec(data.Row(occ[k].first));
+    if (spk_vars.v_s.Dim() != 0)
+      xti.AddVecToRows(-1.0, spk_vars.o_s.Row(i));
+    SigmaInv.CopyFromSp(SigmaInv_[i]);
+    SigmaInv_xti.Resize(num_occ, feat_dim, kUndefined);
+    SigmaInv_xti.AddMatMat(1.0, xti, kNoTrans, SigmaInv, kNoTrans, 0.0);
+    // Eq (35): z_{i}(t) = M_{i}^{T} \Sigma_{i}^{-1} x_{i}(t)
+    zti.Resize(num_occ, phn_dim, kUndefined);
+    zti.AddMatMat(1.0, SigmaInv_xti, kNoTrans, M_[i], kNoTrans, 0.0);
+    // Eq.(36): n_{i}(t) = -0.5 x_{i}^{T} \Sigma_{i}^{-1} x_{i}(t)
+    nti.Resize(num_occ, kUndefined);
+    nti.AddDiagMatMat(-0.5, xti, kNoTrans, SigmaInv_xti, kTrans, 0.0);
+    BaseFloat ssgmm_term = (speaker_dep_weights ? spk_vars.log_b_is(i) : 0.0);
+    for (int32 k = 0; k < num_occ; k++) {
+      Sgmm2PerFrameDerivedVars &vars = (*per_frame_vars)[occ[k].first];
+      int32 ki = occ[k].second;
+      vars.xti.Row(ki).CopyFromVec(xti.Row(k));
+      vars.zti.Row(ki).CopyFromVec(zti.Row(k));
+      vars.nti(ki) = nti(k) + ssgmm_term;
+    }
+  }
+}
+
 // inline
 void AmSgmm2::ComponentLogLikes(const Sgmm2PerFrameDerivedVars &per_frame_vars,
                                int32 j1,
@@ -501,15 +557,98 @@ void AmSgmm2::ComponentLogLikes(const Sgmm2PerFrameDerivedVars &per_frame_vars,
     logp_xi.Add(per_frame_vars.nti(ki));  // for all substates, add n_{i}(t)
   }
   if (speaker_dep_weights) { // [SSGMM]
-    Vector<BaseFloat> &log_d = spk_vars->log_d_jms[j1];
-    if (log_d.Dim() == 0) { // have not yet cached this quantity.
-      log_d.Resize(num_substates);
-      log_d.AddMatVec(1.0, w_jmi_[j1], kNoTrans, spk_vars->b_is, 0.0);
-      log_d.ApplyLog();
+    loglikes->AddVecToRows(-1.0, SpeakerLogNormalizers(j1, spk_vars));
+    // [SSGMM] this is the term - log d_{jm}^{(s)} in the likelihood function
+    // [eq. 25 in the techreport]
+  }
+}
+
+const Vector<BaseFloat> &AmSgmm2::SpeakerLogNormalizers(
+    int32 j1, Sgmm2PerSpkDerivedVars *spk_vars) const {
+  Vector<BaseFloat> &log_d = spk_vars->log_d_jms[j1];
+  if (log_d.Dim() == 0) { // have not yet cached this quantity.
+    log_d.Resize(v_[j1].NumRows());
+    log_d.AddMatVec(1.0, w_jmi_[j1], kNoTrans, spk_vars->b_is, 0.0);
+    log_d.ApplyLog();
+  }
+  return log_d;
+}
+
+void AmSgmm2::LogLikelihoods(
+    const std::vector<Sgmm2PerFrameDerivedVars> &per_frame_vars,
+    const std::vector<int32> &pdfs,
+    Sgmm2PerSpkDerivedVars *spk_vars,
+    Matrix<BaseFloat> *loglikes) const {
+  int32 num_frames = per_frame_vars.size(), num_pdfs = pdfs.size();
+  loglikes->Resize(num_frames, num_pdfs);
+  if (num_frames == 0 || num_pdfs == 0) return;
+  bool speaker_dep_weights =
+      (spk_vars->v_s.Dim() != 0 && HasSpeakerDependentWeights());
+  if (speaker_dep_weights) {
+    KALDI_ASSERT(static_cast<int32>(spk_vars->log_d_jms.size()) == NumGroups());
+    KALDI_ASSERT(static_cast<int32>(w_jmi_.size()) == NumGroups() ||
+                 "You need to call ComputeWeights().");
+  }
+
+  // Stack the z_{i}(t) and n_{i}(t) of all the frames, so that row
+  // frame_offset[t] + ki corresponds to frame t and Gaussian gselect[ki].
+  std::vector<int32> frame_offset(num_frames + 1, 0);
+  for (int32 t = 0; t < num_frames; t++)
+    frame_offset[t + 1] = frame_offset[t] + per_frame_vars[t].gselect.size();
+  int32 num_rows = frame_offset[num_frames];
+  Matrix<BaseFloat> zti(num_rows, PhoneSpaceDim(), kUndefined);
+  Vector<BaseFloat> nti(num_rows, kUndefined);
+  std::vector<int32> gauss_of_row(num_rows);
+  for (int32 t = 0; t < num_frames; t++) {
+    const Sgmm2PerFrameDerivedVars &vars = per_frame_vars[t];
+    int32 offset = frame_offset[t], num_gselect = vars.gselect.size();
+    if (num_gselect == 0)
+      KALDI_ERR << "Empty Gaussian selection for frame " << t;
+    zti.RowRange(offset, num_gselect).CopyFromMat(vars.zti);
+    nti.Range(offset, num_gselect).CopyFromVec(vars.nti);
+    std::copy(vars.gselect.begin(), vars.gselect.end(),
+              gauss_of_row.begin() + offset);
+  }
+
+  // Sort the pdfs by group, so that we do each group once.
+  std::vector<std::pair<int32, int32> > group_and_index(num_pdfs);
+  for (int32 k = 0; k < num_pdfs; k++) {
+    KALDI_ASSERT(pdfs[k] >= 0 && pdfs[k] < NumPdfs());
+    group_and_index[k] = std::make_pair(pdf2group_[pdfs[k]], k);
+  }
+  std::sort(group_and_index.begin(), group_and_index.end());
+
+  Matrix<BaseFloat> substate_loglikes, substate_likes;
+  Vector<BaseFloat> frame_max(num_frames), pdf_likes(num_frames);
+  for (int32 k = 0; k < num_pdfs; ) {
+    int32 j1 = group_and_index[k].first, num_substates = v_[j1].NumRows();
+    // Eq.(37) for all the frames, Gaussians and substates at once:
+    // log p(x(t), m, i|j) = z_{i}(t)^T v_{jm} + n_{jim} + n_{i}(t).
+    substate_loglikes.Resize(num_rows, num_substates, kUndefined);
+    substate_loglikes.AddMatMat(1.0, zti, kNoTrans, v_[j1], kTrans, 0.0);
+    for (int32 r = 0; r < num_rows; r++)
+      substate_loglikes.Row(r).AddVec(1.0, n_[j1].Row(gauss_of_row[r]));
+    substate_loglikes.AddVecToCols(1.0, nti);
+    if (speaker_dep_weights)
+      substate_loglikes.AddVecToRows(-1.0, SpeakerLogNormalizers(j1, spk_vars));
+    // Sum over the Gaussians of each frame; as in LogLikelihood(), the
+    // likelihoods of frame t are stored relative to frame_max(t).
+    substate_likes.Resize(num_frames, num_substates, kUndefined);
+    for (int32 t = 0; t < num_frames; t++) {
+      SubMatrix<BaseFloat> frame_loglikes(substate_loglikes.RowRange(
+          frame_offset[t], frame_offset[t + 1] - frame_offset[t]));
+      BaseFloat max = frame_loglikes.Max();
+      frame_loglikes.Add(-max);
+      frame_loglikes.ApplyExp();
+      frame_max(t) = max;
+      substate_likes.Row(t).AddRowSumMat(1.0, frame_loglikes, 0.0);
+    }
+    for (; k < num_pdfs && group_and_index[k].first == j1; k++) {
+      int32 index = group_and_index[k].second, j2 = pdfs[index];
+      pdf_likes.AddMatVec(1.0, substate_likes, kNoTrans, c_[j2], 0.0);
+      for (int32 t = 0; t < num_frames; t++)
+        (*loglikes)(t, index) = frame_max(t) + Log(pdf_likes(t));
     }
-    loglikes->AddVecToRows(-1.0, log_d); // [SSGMM] this is the term
-    // - log d_{jm}^{(s)} in the likelihood function [eq. 25 in
-    // the techreport]
   }
 }
 
@@ -1403,6 +1542,33 @@ void AmSgmm2::ComputePerSpkDerivedVars(Sgmm2PerSpkDerivedVars *vars) const {
   }
 }
 
+// Called from GaussianSelection(): keeps the "nbest" best of the
+// (log-likelihood, Gaussian-index) pairs, puts their indices in "gselect"
+// from best to worst, and returns the total log-likelihood of the kept ones.
+static BaseFloat SelectBestGaussians(
+    int32 nbest,
+    std::vector<std::pair<BaseFloat, int32> > *pruned_pairs,
+    std::vector<int32> *gselect) {
+  KALDI_ASSERT(!pruned_pairs->empty());
+  if (pruned_pairs->size() > static_cast<size_t>(nbest)) {
+    std::nth_element(pruned_pairs->begin(),
+                     pruned_pairs->end() - nbest,
+                     pruned_pairs->end());
+    pruned_pairs->erase(pruned_pairs->begin(),
+                        pruned_pairs->end() - nbest);
+  }
+  Vector<BaseFloat> loglikes_tmp(pruned_pairs->size());  // for return value.
+  gselect->resize(pruned_pairs->size());
+  // Make sure pruned Gaussians appear from best to worst.
+  std::sort(pruned_pairs->begin(), pruned_pairs->end(),
+            std::greater< std::pair<BaseFloat, int32> >());
+  for (size_t i = 0; i < pruned_pairs->size(); i++) {
+    loglikes_tmp(i) = (*pruned_pairs)[i].first;
+    (*gselect)[i] = (*pruned_pairs)[i].second;
+  }
+  return loglikes_tmp.LogSumExp();
+}
+
 BaseFloat AmSgmm2::GaussianSelection(const Sgmm2GselectConfig &config,
                                     const VectorBase<BaseFloat> &data,
                                     std::vector<int32> *gselect) const {
@@ -1430,25 +1596,77 @@ BaseFloat AmSgmm2::GaussianSelection(const Sgmm2GselectConfig &config,
     for (int32 g = 0; g < num_gauss; g++)
       pruned_pairs.push_back(std::make_pair(loglikes(g), g));
   }
-  KALDI_ASSERT(!pruned_pairs.empty());
-  if (pruned_pairs.size() > static_cast<size_t>(config.full_gmm_nbest)) {
-    std::nth_element(pruned_pairs.begin(),
-                     pruned_pairs.end() - config.full_gmm_nbest,
-                     pruned_pairs.end());
-    pruned_pairs.erase(pruned_pairs.begin(),
-                       pruned_pairs.end() - config.full_gmm_nbest);
-  }
-  Vector<BaseFloat> loglikes_tmp(pruned_pairs.size());  // for return value.
   KALDI_ASSERT(gselect != NULL);
-  gselect->resize(pruned_pairs.size());
-  // Make sure pruned Gaussians appear from best to worst.
-  std::sort(pruned_pairs.begin(), pruned_pairs.end(),
-            std::greater< std::pair<BaseFloat, int32> >());
-  for (size_t i = 0; i < pruned_pairs.size(); i++) {
-    loglikes_tmp(i) = pruned_pairs[i].first;
-    (*gselect)[i] = pruned_pairs[i].second;
-  }
-  return loglikes_tmp.LogSumExp();
+  return SelectBestGaussians(config.full_gmm_nbest, &pruned_pairs, gselect);
+}
+
+BaseFloat AmSgmm2::GaussianSelection(
+    const Sgmm2GselectConfig &config,
+    const MatrixBase<BaseFloat> &data,
+    std::vector<std::vector<int32> > *gselect) const {
+  KALDI_ASSERT(diag_ubm_.NumGauss() != 0 &&
+               diag_ubm_.NumGauss() == full_ubm_.NumGauss() &&
+               diag_ubm_.Dim() == data.NumCols());
+  KALDI_ASSERT(config.diag_gmm_nbest > 0 && config.full_gmm_nbest > 0 &&
+               config.full_gmm_nbest < config.diag_gmm_nbest);
+  KALDI_ASSERT(gselect != NULL);
+  int32 num_frames = data.NumRows(), num_gauss = diag_ubm_.NumGauss(),
+      dim = data.NumCols();
+
+  // The frames for which each Gaussian survives the diagonal stage.
+  std::vector<std::vector<int32> > frames_of_gauss(num_gauss);
+  if (config.diag_gmm_nbest < num_gauss) {
+    Matrix<BaseFloat> loglikes;
+    diag_ubm_.LogLikelihoods(data, &loglikes);
+    Vector<BaseFloat> loglikes_copy(num_gauss);
+    BaseFloat *ptr = loglikes_copy.Data();
+    for (int32 t = 0; t < num_frames; t++) {
+      loglikes_copy.CopyFromVec(loglikes.Row(t));
+      std::nth_element(ptr, ptr+num_gauss-config.diag_gmm_nbest,
+                       ptr+num_gauss);
+      BaseFloat thresh = ptr[num_gauss-config.diag_gmm_nbest];
+      for (int32 g = 0; g < num_gauss; g++)
+        if (loglikes(t, g) >= thresh)  // met threshold for diagonal phase.
+          frames_of_gauss[g].push_back(t);
+    }
+  } else {
+    for (int32 g = 0; g < num_gauss; g++)
+      for (int32 t = 0; t < num_frames; t++)
+        frames_of_gauss[g].push_back(t);
+  }
+
+  // The full-covariance stage, done for each Gaussian over all the frames
+  // that selected it.
+  std::vector<std::vector<std::pair<BaseFloat, int32> > > pruned_pairs(
+      num_frames);
+  Matrix<BaseFloat> inv_covar(dim, dim), x, inv_covar_x;
+  Vector<BaseFloat> loglikes;
+  for (int32 g = 0; g < num_gauss; g++) {
+    const std::vector<int32> &frames = frames_of_gauss[g];
+    int32 n = frames.size();
+    if (n == 0) continue;
+    x.Resize(n, dim, kUndefined);
+    for (int32 k = 0; k < n; k++)
+      x.Row(k).CopyFromVec(data.Row(frames[k]));
+    inv_covar.CopyFromSp(full_ubm_.inv_covars()[g]);
+    inv_covar_x.Resize(n, dim, kUndefined);
+    inv_covar_x.AddMatMat(1.0, x, kNoTrans, inv_covar, kNoTrans, 0.0);
+    // loglike = gconst + mean^T inv(covar) x - 0.5 x^T inv(covar) x.
+    loglikes.Resize(n, kUndefined);
+    loglikes.AddMatVec(1.0, x, kNoTrans, full_ubm_.means_invcovars().Row(g),
+                       0.0);
+    loglikes.AddDiagMatMat(-0.5, x, kNoTrans, inv_covar_x, kTrans, 1.0);
+    loglikes.Add(full_ubm_.gconsts()(g));
+    for (int32 k = 0; k < n; k++)
+      pruned_pairs[frames[k]].push_back(std::make_pair(loglikes(k), g));
+  }
+
+  gselect->resize(num_frames);
+  double tot_loglike = 0.0;
+  for (int32 t = 0; t < num_frames; t++)
+    tot_loglike += SelectBestGaussians(config.full_gmm_nbest,
+                                       &(pruned_pairs[t]), &((*gselect)[t]));
+  return tot_loglike;
 }
 
 void Sgmm2GauPost::Write(std::ostream &os, bool binary) const {
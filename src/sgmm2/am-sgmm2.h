@@ -272,6 +272,16 @@ class AmSgmm2 {
   BaseFloat GaussianSelection(const Sgmm2GselectConfig &config,
                               const VectorBase<BaseFloat> &data,
                               std::vector<int32> *gselect) const;
+
+  /// This version of GaussianSelection() does the selection for all the rows
+  /// of "data" at once; it gives the same results as calling the version
+  /// above for each frame, but the diagonal-covariance stage is done with a
+  /// single matrix multiplication and the full-covariance stage with one per
+  /// Gaussian (over the frames that selected it).  Returns the sum of the
+  /// per-frame log-likelihoods.
+  BaseFloat GaussianSelection(const Sgmm2GselectConfig &config,
+                              const MatrixBase<BaseFloat> &data,
+                              std::vector<std::vector<int32> > *gselect) const;
   
   /// This needs to be called with each new frame of data, prior to accumulation
   /// or likelihood evaluation: it computes various pre-computed quantities.
@@ -280,6 +290,15 @@ class AmSgmm2 {
                            const Sgmm2PerSpkDerivedVars &spk_vars,
                            Sgmm2PerFrameDerivedVars *per_frame_vars) const;
 
+  /// This version of ComputePerFrameVars() computes the per-frame quantities
+  /// for a block of frames (the rows of "data", with gselect indexed by the
+  /// row); the projections are done with one matrix multiplication per
+  /// selected Gaussian rather than per frame and Gaussian.
+  void ComputePerFrameVars(const MatrixBase<BaseFloat> &data,
+                           const std::vector<std::vector<int32> > &gselect,
+                           const Sgmm2PerSpkDerivedVars &spk_vars,
+                           std::vector<Sgmm2PerFrameDerivedVars> *per_frame_vars) const;
+
 
   /// Computes the per-speaker derived vars; assumes vars->v_s is already
   /// set up.
@@ -296,6 +315,17 @@ class AmSgmm2 {
                           Sgmm2LikelihoodCache *cache, // be careful to call NextFrame() when needed!
                           Sgmm2PerSpkDerivedVars *spk_vars,
                           BaseFloat log_prune = 0.0) const;
+
+  /// Computes the log-likelihoods of a block of frames for a set of pdfs:
+  /// on exit (*loglikes)(t, k) is the log-likelihood of frame t given
+  /// pdf pdfs[k].  The sub-state log-likelihoods of each group of pdfs are
+  /// computed for all the frames with a single matrix multiplication, so
+  /// this is much faster than calling LogLikelihood() when most of the pdfs
+  /// are needed on most of the frames (e.g. in lattice rescoring).
+  void LogLikelihoods(const std::vector<Sgmm2PerFrameDerivedVars> &per_frame_vars,
+                      const std::vector<int32> &pdfs,
+                      Sgmm2PerSpkDerivedVars *spk_vars,
+                      Matrix<BaseFloat> *loglikes) const;
   
   /// Similar to LogLikelihood() function above, but also computes the posterior
   /// probabilities for the pre-selected Gaussian components and all substates.
@@ -475,6 +505,11 @@ class AmSgmm2 {
                                 Sgmm2PerSpkDerivedVars *spk_vars,
                                 Matrix<BaseFloat> *loglikes) const;
 
+  /// [SSGMM] Returns the log normalizers log d_{jm}^{(s)} of group j1,
+  /// computing and caching them in spk_vars if needed.
+  const Vector<BaseFloat> &SpeakerLogNormalizers(
+      int32 j1, Sgmm2PerSpkDerivedVars *spk_vars) const;
+
   
   /// Initializes the matrices M_ and w_.
   void InitializeMw(int32 phn_subspace_dim,
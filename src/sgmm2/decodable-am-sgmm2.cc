@@ -40,14 +40,20 @@ BaseFloat DecodableAmSgmm2::LogLikelihoodForPdf(int32 frame, int32 pdf_id) {
     sgmm_cache_.NextFrame(); // it has a frame-index internally but it doesn't
     // have to match up with our index here, it just needs to be unique.
 
-
-    SubVector<BaseFloat> data(*feature_matrix_, frame);
-    
-    sgmm_.ComputePerFrameVars(data, (*gselect_)[frame], *spk_,
-                              &per_frame_vars_);
+    if (frame < block_start_ ||
+        frame >= block_start_ + static_cast<int32>(block_vars_.size())) {
+      block_start_ = frame;
+      int32 num_frames = NumFramesReady() - frame;
+      if (num_frames > kFrameBlockSize)
+        num_frames = kFrameBlockSize;
+      SubMatrix<BaseFloat> data(feature_matrix_->RowRange(frame, num_frames));
+      std::vector<std::vector<int32> > gselect(
+          gselect_->begin() + frame, gselect_->begin() + frame + num_frames);
+      sgmm_.ComputePerFrameVars(data, gselect, *spk_, &block_vars_);
+    }
   }
-  return sgmm_.LogLikelihood(per_frame_vars_, pdf_id, &sgmm_cache_, spk_,
-                             log_prune_);  
+  return sgmm_.LogLikelihood(block_vars_[frame - block_start_], pdf_id,
+                             &sgmm_cache_, spk_, log_prune_);
 }
 
 
@@ -41,7 +41,8 @@ class DecodableAmSgmm2 : public DecodableInterface {
       sgmm_(sgmm), spk_(spk),
       trans_model_(tm), feature_matrix_(&feats),
       gselect_(&gselect), log_prune_(log_prune), cur_frame_(-1),
-      sgmm_cache_(sgmm.NumGroups(), sgmm.NumPdfs()), delete_vars_(false) {
+      block_start_(0), sgmm_cache_(sgmm.NumGroups(), sgmm.NumPdfs()),
+      delete_vars_(false) {
     KALDI_ASSERT(gselect.size() == static_cast<size_t>(feats.NumRows()));
   }
 
@@ -56,7 +57,8 @@ class DecodableAmSgmm2 : public DecodableInterface {
       sgmm_(sgmm), spk_(spk),
       trans_model_(tm), feature_matrix_(feats),
       gselect_(gselect), log_prune_(log_prune), cur_frame_(-1),
-      sgmm_cache_(sgmm.NumGroups(), sgmm.NumPdfs()), delete_vars_(true) {
+      block_start_(0), sgmm_cache_(sgmm.NumGroups(), sgmm.NumPdfs()),
+      delete_vars_(true) {
     KALDI_ASSERT(gselect->size() == static_cast<size_t>(feats->NumRows()));
   }
 
@@ -86,7 +88,11 @@ class DecodableAmSgmm2 : public DecodableInterface {
   BaseFloat log_prune_;
 
   int32 cur_frame_;
-  Sgmm2PerFrameDerivedVars per_frame_vars_;
+  /// The per-frame quantities are computed for blocks of kFrameBlockSize
+  /// frames at a time; block_vars_[t - block_start_] is for frame t.
+  static const int32 kFrameBlockSize = 32;
+  int32 block_start_;
+  std::vector<Sgmm2PerFrameDerivedVars> block_vars_;
   Sgmm2LikelihoodCache sgmm_cache_;
 
   bool delete_vars_; // If true, we will delete feature_matrix_, gselect_, and
@@ -18,6 +18,7 @@
 // limitations under the License.
 
 
+#include <algorithm>
 #include <utility>
 #include <fstream>
 
@@ -61,6 +62,50 @@ void SetUnkPenalties(const string &filename,
   }
 }
 
+// The state tensors of the TF graph have shape [num-layers, (2,) batch, size]
+// and the cells have shape [batch, size], i.e. the batch dimension is the
+// second-to-last one.  This stacks tensors[begin] ... tensors[end - 1], which
+// have a batch dimension of 1, along it.
+static Tensor StackBatch(const std::vector<const Tensor*> &tensors,
+                         size_t begin, size_t end) {
+  const Tensor &first = *tensors[begin];
+  int32 batch_dim = first.dims() - 2;
+  KALDI_ASSERT(batch_dim >= 0 && first.dim_size(batch_dim) == 1);
+  int64 n = end - begin, inner = first.dim_size(first.dims() - 1),
+      outer = first.NumElements() / inner;
+  tensorflow::TensorShape shape(first.shape());
+  shape.set_dim(batch_dim, n);
+  Tensor ans(tensorflow::DT_FLOAT, shape);
+  float *dest = ans.flat<float>().data();
+  for (int64 b = 0; b < n; b++) {
+    const float *src = tensors[begin + b]->flat<float>().data();
+    for (int64 o = 0; o < outer; o++)
+      std::copy(src + o * inner, src + (o + 1) * inner,
+                dest + (o * n + b) * inner);
+  }
+  return ans;
+}
+
+// The inverse of StackBatch(): sets (*out)[offset + b] to element b of the
+// batch in 't'.
+static void UnstackBatch(const Tensor &t, size_t offset,
+                         std::vector<Tensor> *out) {
+  int32 batch_dim = t.dims() - 2;
+  int64 n = t.dim_size(batch_dim), inner = t.dim_size(t.dims() - 1),
+      outer = t.NumElements() / (n * inner);
+  tensorflow::TensorShape shape(t.shape());
+  shape.set_dim(batch_dim, 1);
+  const float *src = t.flat<float>().data();
+  for (int64 b = 0; b < n; b++) {
+    Tensor this_tensor(tensorflow::DT_FLOAT, shape);
+    float *dest = this_tensor.flat<float>().data();
+    for (int64 o = 0; o < outer; o++)
+      std::copy(src + (o * n + b) * inner, src + (o * n + b + 1) * inner,
+                dest + o * inner);
+    (*out)[offset + b] = this_tensor;
+  }
+}
+
 // Read tensorflow checkpoint files
 void KaldiTfRnnlmWrapper::ReadTfModel(const std::string &tf_model_path,
                                       int32 num_threads) {
@@ -84,6 +129,21 @@ void KaldiTfRnnlmWrapper::ReadTfModel(const std::string &tf_model_path,
     KALDI_ERR << status.ToString();
   }
 
+  // Graphs written by older versions of steps/tfrnnlm/*.py have a batch
+  // dimension of 1 in their test-time placeholders.
+  supports_batch_ = false;
+  for (int32 i = 0; i < graph_def.graph_def().node_size(); i++) {
+    const tensorflow::NodeDef &node = graph_def.graph_def().node(i);
+    if (node.name() != "Train/Model/test_word_in")
+      continue;
+    auto iter = node.attr().find("shape");
+    if (iter != node.attr().end() && iter->second.shape().dim_size() > 0)
+      supports_batch_ = (iter->second.shape().dim(0).size() == -1);
+  }
+  if (!supports_batch_)
+    KALDI_LOG << "The TF graph in " << graph_path << " does not accept "
+              << "batches of histories; they will be evaluated one by one.";
+
   // Add the graph to the session
   status = session_->Create(graph_def.graph_def());
   if (!status.ok()) {
@@ -108,7 +168,7 @@ KaldiTfRnnlmWrapper::KaldiTfRnnlmWrapper(
     const std::string &rnn_wordlist,
     const std::string &word_symbol_table_rxfilename,
     const std::string &unk_prob_file,
-    const std::string &tf_model_path): opts_(opts) {
+    const std::string &tf_model_path): opts_(opts), supports_batch_(false) {
   ReadTfModel(tf_model_path, opts.num_threads);
 
   fst::SymbolTable *fst_word_symbols = NULL;
@@ -214,7 +274,7 @@ BaseFloat KaldiTfRnnlmWrapper::GetLogProb(int32 word,
                                           const Tensor &context_in,
                                           const Tensor &cell_in,
                                           Tensor *context_out,
-                                          Tensor *new_cell) {
+                                          Tensor *new_cell) const {
   std::vector<std::pair<string, Tensor> > inputs;
 
   Tensor thisword(tensorflow::DT_INT32, {1, 1});
@@ -256,18 +316,86 @@ BaseFloat KaldiTfRnnlmWrapper::GetLogProb(int32 word,
     }
   }
 
-  float ans;
-  if (word != oos_) {
-    ans = outputs[0].scalar<float>()();
-  } else {
-    if (unk_costs_.size() == 0) {
-      ans = outputs[0].scalar<float>()() - log(num_total_words - num_rnn_words);
-    } else {
-      ans = outputs[0].scalar<float>()() + unk_costs_[fst_word];
+  // test_out is a scalar in older graphs and has one element per history in
+  // the current ones.
+  return AddOosCost(word, fst_word, outputs[0].flat<float>()(0));
+}
+
+BaseFloat KaldiTfRnnlmWrapper::AddOosCost(int32 word, int32 fst_word,
+                                          BaseFloat logprob) const {
+  if (word != oos_)
+    return logprob;
+  if (unk_costs_.size() == 0)
+    return logprob - log(num_total_words - num_rnn_words);
+  return logprob + unk_costs_[fst_word];
+}
+
+void KaldiTfRnnlmWrapper::ComputeStates(
+    const std::vector<int32> &words,
+    const std::vector<const Tensor*> &contexts_in,
+    std::vector<Tensor> *contexts_out,
+    std::vector<Tensor> *cells_out) const {
+  KALDI_ASSERT(words.size() == contexts_in.size());
+  size_t num_states = words.size(),
+      batch_size = (supports_batch_ ? std::max(opts_.max_batch_size, 1) : 1);
+  contexts_out->resize(num_states);
+  cells_out->resize(num_states);
+  for (size_t begin = 0; begin < num_states; begin += batch_size) {
+    size_t end = std::min(num_states, begin + batch_size);
+    Tensor words_in(tensorflow::DT_INT32,
+                    tensorflow::TensorShape({static_cast<int64>(end - begin),
+                                             1}));
+    for (size_t i = begin; i < end; i++)
+      words_in.flat<int32>()(i - begin) = words[i];
+
+    std::vector<std::pair<string, Tensor> > inputs = {
+      {"Train/Model/test_word_in", words_in},
+      {"Train/Model/test_state_in", StackBatch(contexts_in, begin, end)},
+    };
+    std::vector<Tensor> outputs;
+    Status status = session_->Run(inputs,
+        {"Train/Model/test_state_out",
+         "Train/Model/test_cell_out"}, {}, &outputs);
+    if (!status.ok()) {
+      KALDI_ERR << status.ToString();
     }
+    UnstackBatch(outputs[0], begin, contexts_out);
+    UnstackBatch(outputs[1], begin, cells_out);
   }
+}
 
-  return ans;
+void KaldiTfRnnlmWrapper::GetLogProbs(
+    const std::vector<int32> &words,
+    const std::vector<int32> &fst_words,
+    const std::vector<const Tensor*> &cells_in,
+    std::vector<BaseFloat> *logprobs) const {
+  KALDI_ASSERT(words.size() == fst_words.size() &&
+               words.size() == cells_in.size());
+  size_t num_words = words.size(),
+      batch_size = (supports_batch_ ? std::max(opts_.max_batch_size, 1) : 1);
+  logprobs->resize(num_words);
+  for (size_t begin = 0; begin < num_words; begin += batch_size) {
+    size_t end = std::min(num_words, begin + batch_size);
+    Tensor words_out(tensorflow::DT_INT32,
+                     tensorflow::TensorShape({static_cast<int64>(end - begin),
+                                              1}));
+    for (size_t i = begin; i < end; i++)
+      words_out.flat<int32>()(i - begin) = words[i];
+
+    std::vector<std::pair<string, Tensor> > inputs = {
+      {"Train/Model/test_word_out", words_out},
+      {"Train/Model/test_cell_in", StackBatch(cells_in, begin, end)},
+    };
+    std::vector<Tensor> outputs;
+    Status status = session_->Run(inputs,
+        {"Train/Model/test_out"}, {}, &outputs);
+    if (!status.ok()) {
+      KALDI_ERR << status.ToString();
+    }
+    for (size_t i = begin; i < end; i++)
+      (*logprobs)[i] = AddOosCost(words[i], fst_words[i],
+                                  outputs[0].flat<float>()(i - begin));
+  }
 }
 
 const Tensor& KaldiTfRnnlmWrapper::GetInitialContext() const {
@@ -283,8 +411,8 @@ int KaldiTfRnnlmWrapper::FstLabelToRnnLabel(int i) const {
   return fst_label_to_rnn_label_[i];
 }
 
-TfRnnlmDeterministicFst::TfRnnlmDeterministicFst(int32 max_ngram_order,
-                                             KaldiTfRnnlmWrapper *rnnlm) {
+TfRnnlmDeterministicFst::TfRnnlmDeterministicFst(
+    int32 max_ngram_order, const KaldiTfRnnlmWrapper *rnnlm) {
   KALDI_ASSERT(rnnlm != NULL);
   max_ngram_order_ = max_ngram_order;
   rnnlm_ = rnnlm;
@@ -296,6 +424,9 @@ TfRnnlmDeterministicFst::TfRnnlmDeterministicFst(int32 max_ngram_order,
   state_to_wseq_.push_back(bos);
   state_to_context_.push_back(new Tensor(initial_context));
   state_to_cell_.push_back(new Tensor(initial_cell));
+  state_to_parent_.push_back(fst::kNoStateId);
+  state_to_word_.push_back(-1);
+  state_to_logprobs_.resize(1);
   wseq_to_state_[bos] = 0;
   start_state_ = 0;
 }
@@ -322,20 +453,122 @@ void TfRnnlmDeterministicFst::Clear() {
   state_to_context_.resize(1);
   state_to_cell_.resize(1);
   state_to_wseq_.resize(1);
+  state_to_parent_.resize(1);
+  state_to_word_.resize(1);
+  state_to_logprobs_.resize(1);
+  pending_states_.clear();
+  unscored_states_.clear();
+  if (!rnn_words_to_score_.empty() && state_to_logprobs_[0].empty())
+    unscored_states_.push_back(0);
   wseq_to_state_.clear();
   wseq_to_state_[state_to_wseq_[0]] = 0;
 }
 
+void TfRnnlmDeterministicFst::SetWordsToScore(
+    const std::vector<Label> &fst_words) {
+  fst_words_to_score_.clear();
+  rnn_words_to_score_.clear();
+  word_to_score_index_.clear();
+  for (size_t i = 0; i < fst_words.size(); i++) {
+    std::pair<Label, int32> word_index(fst_words[i],
+                                       fst_words_to_score_.size());
+    if (word_to_score_index_.insert(word_index).second) {
+      fst_words_to_score_.push_back(fst_words[i]);
+      rnn_words_to_score_.push_back(rnnlm_->FstLabelToRnnLabel(fst_words[i]));
+    }
+  }
+  // </s>, for Final().
+  fst_words_to_score_.push_back(-1);
+  rnn_words_to_score_.push_back(rnnlm_->GetEos());
+
+  unscored_states_.clear();
+  for (size_t s = 0; s < state_to_logprobs_.size(); s++) {
+    state_to_logprobs_[s].clear();
+    if (state_to_cell_[s] != NULL)
+      unscored_states_.push_back(s);
+  }
+}
+
+void TfRnnlmDeterministicFst::ComputePendingStates() {
+  size_t num_states = pending_states_.size();
+  std::vector<int32> words(num_states);
+  std::vector<const Tensor*> contexts(num_states);
+  for (size_t i = 0; i < num_states; i++) {
+    StateId s = pending_states_[i];
+    words[i] = state_to_word_[s];
+    // The parent was computed before this state was created.
+    contexts[i] = state_to_context_[state_to_parent_[s]];
+    KALDI_ASSERT(contexts[i] != NULL);
+  }
+  std::vector<Tensor> new_contexts, new_cells;
+  rnnlm_->ComputeStates(words, contexts, &new_contexts, &new_cells);
+  for (size_t i = 0; i < num_states; i++) {
+    StateId s = pending_states_[i];
+    state_to_context_[s] = new Tensor(new_contexts[i]);
+    state_to_cell_[s] = new Tensor(new_cells[i]);
+    if (!rnn_words_to_score_.empty())
+      unscored_states_.push_back(s);
+  }
+  pending_states_.clear();
+}
+
+void TfRnnlmDeterministicFst::ScoreStates() {
+  size_t num_words = rnn_words_to_score_.size(),
+      num_states = unscored_states_.size();
+  std::vector<int32> words, fst_words;
+  std::vector<const Tensor*> cells;
+  words.reserve(num_states * num_words);
+  fst_words.reserve(num_states * num_words);
+  cells.reserve(num_states * num_words);
+  for (size_t i = 0; i < num_states; i++) {
+    const Tensor *cell = state_to_cell_[unscored_states_[i]];
+    words.insert(words.end(), rnn_words_to_score_.begin(),
+                 rnn_words_to_score_.end());
+    fst_words.insert(fst_words.end(), fst_words_to_score_.begin(),
+                     fst_words_to_score_.end());
+    cells.insert(cells.end(), num_words, cell);
+  }
+  std::vector<BaseFloat> logprobs;
+  rnnlm_->GetLogProbs(words, fst_words, cells, &logprobs);
+  for (size_t i = 0; i < num_states; i++)
+    state_to_logprobs_[unscored_states_[i]].assign(
+        logprobs.begin() + i * num_words,
+        logprobs.begin() + (i + 1) * num_words);
+  unscored_states_.clear();
+}
+
+BaseFloat TfRnnlmDeterministicFst::GetLogProb(StateId s, int32 rnn_word,
+                                              Label fst_word) {
+  if (state_to_cell_[s] == NULL)
+    ComputePendingStates();
+
+  if (!rnn_words_to_score_.empty()) {
+    int32 index = -1;
+    if (fst_word == -1) {
+      index = rnn_words_to_score_.size() - 1;
+    } else {
+      unordered_map<Label, int32>::const_iterator iter =
+          word_to_score_index_.find(fst_word);
+      if (iter != word_to_score_index_.end())
+        index = iter->second;
+    }
+    if (index != -1) {
+      if (state_to_logprobs_[s].empty())
+        ScoreStates();
+      KALDI_ASSERT(!state_to_logprobs_[s].empty());
+      return state_to_logprobs_[s][index];
+    }
+  }
+  return rnnlm_->GetLogProb(rnn_word, fst_word, *state_to_context_[s],
+                            *state_to_cell_[s], NULL, NULL);
+}
 
 fst::StdArc::Weight TfRnnlmDeterministicFst::Final(StateId s) {
   // At this point, we should have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
 
-  std::vector<Label> wseq = state_to_wseq_[s];
-  BaseFloat logprob = rnnlm_->GetLogProb(rnnlm_->GetEos(),
-                         -1,  // only need type; this param will not be used
-                         *state_to_context_[s],
-                         *state_to_cell_[s], NULL, NULL);
+  BaseFloat logprob = GetLogProb(s, rnnlm_->GetEos(),
+                                 -1);  // -1 means </s>; it is never OOS.
   return Weight(-logprob);
 }
 
@@ -343,19 +576,11 @@ bool TfRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
                                      fst::StdArc *oarc) {
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
 
-  std::vector<Label> wseq = state_to_wseq_[s];
-  Tensor *new_context = new Tensor();
-  Tensor *new_cell = new Tensor();
-
   // look-up the rnn label from the FST label
   int32 rnn_word = rnnlm_->FstLabelToRnnLabel(ilabel);
-  BaseFloat logprob = rnnlm_->GetLogProb(rnn_word,
-                                         ilabel,
-                                         *state_to_context_[s],
-                                         *state_to_cell_[s],
-                                         new_context,
-                                         new_cell);
+  BaseFloat logprob = GetLogProb(s, rnn_word, ilabel);
 
+  std::vector<Label> wseq = state_to_wseq_[s];
   wseq.push_back(rnn_word);
   if (max_ngram_order_ > 0) {
     while (wseq.size() >= max_ngram_order_) {
@@ -372,15 +597,17 @@ bool TfRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
   typedef MapType::iterator IterType;
   std::pair<IterType, bool> result = wseq_to_state_.insert(wseq_state_pair);
 
-  // If the pair was just inserted, then also add it to <state_to_wseq_> and
-  // <state_to_context_>.
+  // If the pair was just inserted, then also add it to <state_to_wseq_>.  Its
+  // context and cell are computed, together with those of the other states
+  // created in the meantime, when they are first needed.
   if (result.second == true) {
+    pending_states_.push_back(state_to_wseq_.size());
     state_to_wseq_.push_back(wseq);
-    state_to_context_.push_back(new_context);
-    state_to_cell_.push_back(new_cell);
-  } else {
-    delete new_context;
-    delete new_cell;
+    state_to_context_.push_back(NULL);
+    state_to_cell_.push_back(NULL);
+    state_to_parent_.push_back(s);
+    state_to_word_.push_back(rnn_word);
+    state_to_logprobs_.push_back(std::vector<BaseFloat>());
   }
 
   // Creates the arc.
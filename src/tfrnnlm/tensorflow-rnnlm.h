@@ -64,20 +64,31 @@ namespace tf_rnnlm {
 struct KaldiTfRnnlmWrapperOpts {
   std::string unk_symbol;
   int32 num_threads;  // 0 means unlimited
+  int32 max_batch_size;
 
-  KaldiTfRnnlmWrapperOpts() : unk_symbol("<oos>"), num_threads(1) {}
+  KaldiTfRnnlmWrapperOpts() : unk_symbol("<oos>"), num_threads(1),
+                              max_batch_size(1024) {}
 
   void Register(OptionsItf *opts) {
     opts->Register("unk-symbol", &unk_symbol, "Symbol for out-of-vocabulary "
                    "words in rnnlm.");
     opts->Register("num-threads", &num_threads, "Number of threads for TF computation; "
                    "0 means unlimited.");
+    opts->Register("max-batch-size", &max_batch_size, "Maximum number of "
+                   "histories (or of history/word pairs) evaluated in one "
+                   "TF Session::Run() call.  Only matters for models whose "
+                   "graph accepts batches (see SupportsBatch()).");
   }
 };
 
 /**
 This class wraps the TensorFlow based RNNLM, and provides a set of interfaces
-to be used for class TfRnnlmDeterministicFst, implemented later in this file
+to be used for class TfRnnlmDeterministicFst, implemented later in this file.
+
+The functions that do computation are const and only call Session::Run(),
+which TensorFlow allows from several threads at once, so one object of this
+class can be shared by several rescoring threads, each with its own
+TfRnnlmDeterministicFst.
 */
 class KaldiTfRnnlmWrapper {
  public:
@@ -127,7 +138,30 @@ class KaldiTfRnnlmWrapper {
                        const Tensor &context_in,
                        const Tensor &cell_in,
                        Tensor *context_out,
-                       Tensor *cell_out);
+                       Tensor *cell_out) const;
+
+  /// returns true if the batch dimension of the test-time inputs of the TF
+  /// graph is not fixed to 1, as in the graphs written by the current
+  /// steps/tfrnnlm/*.py; the batched functions below then need only one
+  /// Session::Run() per --max-batch-size items.  Otherwise they still work,
+  /// but with one Session::Run() per item.
+  bool SupportsBatch() const { return supports_batch_; }
+
+  /// batched version of the state update in GetLogProb(): for each i, passes
+  /// (*contexts_in[i], words[i]) into the RNN and outputs the new context
+  /// and cell in (*contexts_out)[i] and (*cells_out)[i]
+  void ComputeStates(const std::vector<int32> &words,
+                     const std::vector<const Tensor*> &contexts_in,
+                     std::vector<Tensor> *contexts_out,
+                     std::vector<Tensor> *cells_out) const;
+
+  /// batched version of GetLogProb() with NULL context_out and cell_out:
+  /// sets (*logprobs)[i] to the log of p(words[i] | history), where
+  /// *cells_in[i] is the cell of the history
+  void GetLogProbs(const std::vector<int32> &words,
+                   const std::vector<int32> &fst_words,
+                   const std::vector<const Tensor*> &cells_in,
+                   std::vector<BaseFloat> *logprobs) const;
 
   /// takes in a word-id for FST and return the word-id for RNNLM
   /// return the word-id for <oos> if not found
@@ -141,6 +175,9 @@ class KaldiTfRnnlmWrapper {
   /// do queries on the session to get the initial tensors (cell + context)
   void AcquireInitialTensors();
 
+  /// adds the cost of the OOS symbol to the log-prob of 'word' if it is <oos>
+  BaseFloat AddOosCost(int32 word, int32 fst_word, BaseFloat logprob) const;
+
   /// since usually we have a smaller vocab in RNN than the whole vocab,
   /// we use this mapping during rescoring
   std::vector<int> fst_label_to_rnn_label_;
@@ -157,6 +194,7 @@ class KaldiTfRnnlmWrapper {
   int32 num_rnn_words;
 
   Session* session_;  // for TF computation; pointer owned here
+  bool supports_batch_;
   int32 eos_;
   int32 oos_;
 
@@ -173,10 +211,20 @@ class TfRnnlmDeterministicFst:
   typedef fst::StdArc::Label Label;
 
   // Does not take ownership.
-  TfRnnlmDeterministicFst(int32 max_ngram_order, KaldiTfRnnlmWrapper *rnnlm);
+  TfRnnlmDeterministicFst(int32 max_ngram_order,
+                          const KaldiTfRnnlmWrapper *rnnlm);
   ~TfRnnlmDeterministicFst();
   void Clear();
 
+  // If this is called (e.g. with the words of the lattice about to be
+  // rescored), then the first time a log-prob is needed from a state, the
+  // log-probs of all of these words and of </s> are computed for that state
+  // and for all the other states whose log-probs have not been computed yet,
+  // in batches.  Log-probs of other words are computed one at a time.  This
+  // only makes sense if rnnlm->SupportsBatch().  Clears the log-probs already
+  // computed.
+  void SetWordsToScore(const std::vector<Label> &fst_words);
+
   // We cannot use "const" because the pure virtual function in the interface is
   // not const.
   virtual StateId Start() { return start_state_; }
@@ -190,14 +238,45 @@ class TfRnnlmDeterministicFst:
  private:
   typedef unordered_map<std::vector<Label>,
                         StateId, VectorHasher<Label> > MapType;
+
+  // Computes the context and cell of all the states in pending_states_, with
+  // one call to KaldiTfRnnlmWrapper::ComputeStates().
+  void ComputePendingStates();
+
+  // Computes the log-probs of the words in words_to_score_ for all the states
+  // in unscored_states_, with one call to KaldiTfRnnlmWrapper::GetLogProbs().
+  void ScoreStates();
+
+  // Returns the log-prob of rnn_word (which corresponds to FST label
+  // fst_word, or is </s> if fst_word is -1) in state s.
+  BaseFloat GetLogProb(StateId s, int32 rnn_word, Label fst_word);
+
   StateId start_state_;
   MapType wseq_to_state_;
   std::vector<std::vector<Label> > state_to_wseq_;
 
-  KaldiTfRnnlmWrapper *rnnlm_;
+  const KaldiTfRnnlmWrapper *rnnlm_;
   int32 max_ngram_order_;
+  // The context and cell of a state are NULL until it has been computed; it
+  // is computed from the context of state_to_parent_[s] and the RNN word
+  // state_to_word_[s].
   std::vector<Tensor*> state_to_context_;
   std::vector<Tensor*> state_to_cell_;
+  std::vector<StateId> state_to_parent_;
+  std::vector<int32> state_to_word_;
+  std::vector<StateId> pending_states_;
+
+  // Set by SetWordsToScore(): the FST labels and the RNN words to score (the
+  // last one is </s>, with FST label -1), and the map from FST label to
+  // index in them.
+  std::vector<Label> fst_words_to_score_;
+  std::vector<int32> rnn_words_to_score_;
+  unordered_map<Label, int32> word_to_score_index_;
+  // The log-probs of the words in rnn_words_to_score_ for each state (empty
+  // until computed), and the computed states whose log-probs are not
+  // computed yet.
+  std::vector<std::vector<BaseFloat> > state_to_logprobs_;
+  std::vector<StateId> unscored_states_;
 };
 
 }  // namespace tf_rnnlm
@@ -60,6 +60,7 @@ int main(int argc, char *argv[]) {
     BaseFloat lm_scale = 0.5;
     BaseFloat acoustic_scale = 0.1;
     bool use_carpa = false;
+    bool batch_lattice_words = true;
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -72,6 +73,11 @@ int main(int argc, char *argv[]) {
         "saves time and reduces output lattice size).");
     po.Register("use-const-arpa", &use_carpa, "If true, read the old-LM file "
                 "as a const-arpa file as opposed to an FST file");
+    po.Register("batch-lattice-words", &batch_lattice_words,
+        "If true, compute the log-probs of all the words in the lattice for "
+        "each new RNNLM history, for batches of histories at a time, which "
+        "needs far fewer TF Session::Run() calls.  Ignored if the TF graph "
+        "does not accept batches (see steps/tfrnnlm/lstm.py).");
 
     KaldiTfRnnlmWrapperOpts opts;
     ComposeLatticePrunedOptions compose_opts;
@@ -134,6 +140,8 @@ int main(int argc, char *argv[]) {
     // Reads the TF language model.
     KaldiTfRnnlmWrapper rnnlm(opts, rnn_word_list, word_symbols_rxfilename,
                                 unk_prob_file, rnnlm_rxfilename);
+    if (batch_lattice_words && !rnnlm.SupportsBatch())
+      batch_lattice_words = false;
 
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
@@ -162,6 +170,19 @@ int main(int argc, char *argv[]) {
       }
       TopSortCompactLatticeIfNeeded(&clat);
 
+      if (batch_lattice_words) {
+        std::vector<int32> words;
+        for (int32 s = 0; s < clat.NumStates(); s++) {
+          for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+               aiter.Next()) {
+            if (aiter.Value().olabel != 0)
+              words.push_back(aiter.Value().olabel);
+          }
+        }
+        SortAndUniq(&words);
+        lm_to_add_orig->SetWordsToScore(words);
+      }
+
       fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
           lm_to_subtract_det_scale, lm_to_add);
 
@@ -23,10 +23,103 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "util/common-utils.h"
+#include "util/kaldi-thread.h"
 
 // This should come after any OpenFst includes to avoid using the wrong macros.
 #include "tfrnnlm/tensorflow-rnnlm.h"
 
+namespace kaldi {
+
+// Outputs the (sorted, unique) words on the arcs of 'clat'.
+static void GetLatticeWords(const CompactLattice &clat,
+                            std::vector<int32> *words) {
+  words->clear();
+  for (int32 s = 0; s < clat.NumStates(); s++) {
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      if (aiter.Value().olabel != 0)
+        words->push_back(aiter.Value().olabel);
+    }
+  }
+  SortAndUniq(words);
+}
+
+// Rescores one lattice.  The KaldiTfRnnlmWrapper is shared by all the tasks;
+// each task has its own TfRnnlmDeterministicFst.
+class RescoreLatticeTask {
+ public:
+  RescoreLatticeTask(int32 max_ngram_order,
+                     BaseFloat lm_scale,
+                     bool batch_lattice_words,
+                     const tf_rnnlm::KaldiTfRnnlmWrapper &rnnlm,
+                     const std::string &key,
+                     const CompactLattice &clat,
+                     CompactLatticeWriter *clat_writer,
+                     int32 *num_done,
+                     int32 *num_fail):
+      max_ngram_order_(max_ngram_order), lm_scale_(lm_scale),
+      batch_lattice_words_(batch_lattice_words), rnnlm_(rnnlm), key_(key),
+      clat_(clat), clat_writer_(clat_writer), num_done_(num_done),
+      num_fail_(num_fail) { }
+
+  void operator () () {
+    // Before composing with the LM FST, we scale the lattice weights
+    // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+    // We do it this way so we can determinize and it will give the
+    // right effect (taking the "best path" through the LM) regardless
+    // of the sign of lm_scale.
+    fst::ScaleLattice(fst::GraphLatticeScale(1.0 / lm_scale_), &clat_);
+    ArcSort(&clat_, fst::OLabelCompare<CompactLatticeArc>());
+
+    // Wraps the rnnlm into FST. We re-create it for each lattice to prevent
+    // memory usage increasing with time.
+    tf_rnnlm::TfRnnlmDeterministicFst rnnlm_fst(max_ngram_order_, &rnnlm_);
+    if (batch_lattice_words_) {
+      std::vector<int32> words;
+      GetLatticeWords(clat_, &words);
+      rnnlm_fst.SetWordsToScore(words);
+    }
+
+    // Composes lattice with language model.
+    CompactLattice composed_clat;
+    ComposeCompactLatticeDeterministic(clat_, &rnnlm_fst, &composed_clat);
+    clat_.DeleteStates();
+
+    // Determinizes the composed lattice.
+    Lattice composed_lat;
+    ConvertLattice(composed_clat, &composed_lat);
+    composed_clat.DeleteStates();
+    Invert(&composed_lat);
+    DeterminizeLattice(composed_lat, &determinized_clat_);
+    fst::ScaleLattice(fst::GraphLatticeScale(lm_scale_), &determinized_clat_);
+  }
+
+  ~RescoreLatticeTask() {
+    if (determinized_clat_.Start() == fst::kNoStateId) {
+      KALDI_WARN << "Empty lattice for utterance " << key_
+                 << " (incompatible LM?)";
+      (*num_fail_)++;
+    } else {
+      clat_writer_->Write(key_, determinized_clat_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  int32 max_ngram_order_;
+  BaseFloat lm_scale_;
+  bool batch_lattice_words_;
+  const tf_rnnlm::KaldiTfRnnlmWrapper &rnnlm_;
+  std::string key_;
+  CompactLattice clat_;
+  CompactLattice determinized_clat_;
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_fail_;
+};
+
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
@@ -49,6 +142,8 @@ int main(int argc, char *argv[]) {
     ParseOptions po(usage);
     int32 max_ngram_order = 3;
     BaseFloat lm_scale = 0.5;
+    bool batch_lattice_words = true;
+    TaskSequencerConfig sequencer_config;
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
                 "costs");
@@ -56,6 +151,14 @@ int main(int argc, char *argv[]) {
         "If positive, allow RNNLM histories longer than this to be identified "
         "with each other for rescoring purposes (an approximation that "
         "saves time and reduces output lattice size).");
+    po.Register("batch-lattice-words", &batch_lattice_words,
+        "If true, compute the log-probs of all the words in the lattice for "
+        "each new RNNLM history, for batches of histories at a time, which "
+        "needs far fewer TF Session::Run() calls.  Ignored if the TF graph "
+        "does not accept batches (see steps/tfrnnlm/lstm.py).");
+    // --num-threads is the number of threads of the TF computation.
+    po.Register("num-rescoring-threads", &sequencer_config.num_threads,
+        "Number of lattices rescored in parallel; they share the TF session.");
     KaldiTfRnnlmWrapperOpts opts;
     opts.Register(&po);
 
@@ -86,53 +189,31 @@ int main(int argc, char *argv[]) {
     // Reads the TF language model.
     KaldiTfRnnlmWrapper rnnlm(opts, rnn_word_list, word_symbols_rxfilename,
                                 unk_prob_file, rnnlm_rxfilename);
+    if (batch_lattice_words && !rnnlm.SupportsBatch())
+      batch_lattice_words = false;
 
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
     int32 n_done = 0, n_fail = 0;
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice &clat = compact_lattice_reader.Value();
-
-      if (lm_scale != 0.0) {
-        // Before composing with the LM FST, we scale the lattice weights
-        // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-        // We do it this way so we can determinize and it will give the
-        // right effect (taking the "best path" through the LM) regardless
-        // of the sign of lm_scale.
-        fst::ScaleLattice(fst::GraphLatticeScale(1.0 / lm_scale), &clat);
-        ArcSort(&clat, fst::OLabelCompare<CompactLatticeArc>());
-
-        // Wraps the rnnlm into FST. We re-create it for each lattice to prevent
-        // memory usage increasing with time.
-        TfRnnlmDeterministicFst rnnlm_fst(max_ngram_order, &rnnlm);
-
-        // Composes lattice with language model.
-        CompactLattice composed_clat;
-        ComposeCompactLatticeDeterministic(clat, &rnnlm_fst, &composed_clat);
-
-        // Determinizes the composed lattice.
-        Lattice composed_lat;
-        ConvertLattice(composed_clat, &composed_lat);
-        Invert(&composed_lat);
-        CompactLattice determinized_clat;
-        DeterminizeLattice(composed_lat, &determinized_clat);
-        fst::ScaleLattice(fst::GraphLatticeScale(lm_scale), &determinized_clat);
-        if (determinized_clat.Start() == fst::kNoStateId) {
-          KALDI_WARN << "Empty lattice for utterance " << key
-              << " (incompatible LM?)";
-          n_fail++;
+    {
+      TaskSequencer<RescoreLatticeTask> sequencer(sequencer_config);
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        std::string key = compact_lattice_reader.Key();
+        const CompactLattice &clat = compact_lattice_reader.Value();
+
+        if (lm_scale != 0.0) {
+          sequencer.Run(new RescoreLatticeTask(
+              max_ngram_order, lm_scale, batch_lattice_words, rnnlm, key, clat,
+              &compact_lattice_writer, &n_done, &n_fail));
         } else {
-          compact_lattice_writer.Write(key, determinized_clat);
+          // Zero scale so nothing to do.
           n_done++;
+          compact_lattice_writer.Write(key, clat);
         }
-      } else {
-        // Zero scale so nothing to do.
-        n_done++;
-        compact_lattice_writer.Write(key, clat);
       }
+      sequencer.Wait();
     }
 
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
@@ -222,6 +222,54 @@ void UnitTestFmllrDiagGmmOffset() {
   // mean that something is wrong.
 }
 
+// Tests that AccumulateForPdfs() gives the same stats as AccumulateForGmm().
+void UnitTestFmllrDiagGmmAccumulateForPdfs() {
+  DiagGmm gmm;
+  InitRandomGmm(&gmm);
+  int32 dim = gmm.Dim(), num_pdfs = 1 + Rand() % 3, num_frames = 100;
+  AmDiagGmm am_gmm;
+  for (int32 p = 0; p < num_pdfs; p++) {
+    Matrix<BaseFloat> means(gmm.NumGauss(), dim);
+    means.SetRandn();
+    gmm.SetMeans(means);
+    gmm.ComputeGconsts();
+    am_gmm.AddPdf(gmm);
+  }
+  Matrix<BaseFloat> data(num_frames, dim);
+  data.SetRandn();
+  std::vector<std::vector<std::pair<int32, BaseFloat> > > pdf_post(num_frames);
+  for (int32 t = 0; t < num_frames; t++) {
+    int32 num_pdfs_active = Rand() % 3;
+    for (int32 j = 0; j < num_pdfs_active; j++)
+      pdf_post[t].push_back(std::pair<int32, BaseFloat>(Rand() % num_pdfs,
+                                                        RandUniform()));
+  }
+  for (int32 i = 0; i < 2; i++) {
+    FmllrOptions opts;
+    opts.min_count = 10.0;
+    opts.update_type = (i == 0 ? "full" : "diag");
+    FmllrDiagGmmAccs stats(dim, opts), batch_stats(dim, opts);
+    BaseFloat loglike = 0.0;
+    for (int32 t = 0; t < num_frames; t++)
+      for (size_t j = 0; j < pdf_post[t].size(); j++)
+        loglike += pdf_post[t][j].second *
+            stats.AccumulateForGmm(am_gmm.GetPdf(pdf_post[t][j].first),
+                                   data.Row(t), pdf_post[t][j].second);
+    BaseFloat batch_loglike = batch_stats.AccumulateForPdfs(am_gmm, data,
+                                                             pdf_post);
+    KALDI_ASSERT(ApproxEqual(loglike, batch_loglike, 0.001));
+    Matrix<BaseFloat> xform(dim, dim + 1), batch_xform(dim, dim + 1);
+    xform.SetUnit();
+    batch_xform.SetUnit();
+    BaseFloat impr, batch_impr, count, batch_count;
+    stats.Update(opts, &xform, &impr, &count);
+    batch_stats.Update(opts, &batch_xform, &batch_impr, &batch_count);
+    KALDI_ASSERT(ApproxEqual(count, batch_count, 0.001));
+    KALDI_ASSERT(ApproxEqual(impr, batch_impr, 0.01));
+    AssertEqual(xform, batch_xform, 0.01);
+  }
+}
+
 }  // namespace kaldi ends here
 
 int main() {
@@ -229,6 +277,7 @@ int main() {
     kaldi::UnitTestFmllrDiagGmmOffset();
     kaldi::UnitTestFmllrDiagGmmDiagonal();
     kaldi::UnitTestFmllrDiagGmm();
+    kaldi::UnitTestFmllrDiagGmmAccumulateForPdfs();
   }
   std::cout << "Test OK.\n";
 }
@@ -126,6 +126,59 @@ BaseFloat FmllrDiagGmmAccs::AccumulateForGmmPreselect(
   return loglike;
 }
 
+BaseFloat FmllrDiagGmmAccs::AccumulateForPdfs(
+    const AmDiagGmm &am_gmm,
+    const MatrixBase<BaseFloat> &data,
+    const std::vector<std::vector<std::pair<int32, BaseFloat> > > &pdf_post) {
+  int32 dim = Dim(), num_frames = data.NumRows();
+  KALDI_ASSERT(data.NumCols() == dim &&
+               static_cast<int32>(pdf_post.size()) == num_frames);
+  // Group the (frame, weight) pairs by pdf.
+  std::vector<std::vector<std::pair<int32, BaseFloat> > > frames_of_pdf(
+      am_gmm.NumPdfs());
+  for (int32 t = 0; t < num_frames; t++) {
+    for (size_t j = 0; j < pdf_post[t].size(); j++) {
+      int32 pdf_id = pdf_post[t][j].first;
+      KALDI_ASSERT(pdf_id >= 0 && pdf_id < am_gmm.NumPdfs());
+      frames_of_pdf[pdf_id].push_back(
+          std::pair<int32, BaseFloat>(t, pdf_post[t][j].second));
+    }
+  }
+  // a, b and counts are as in SingleFrameStats, for each frame.
+  Matrix<BaseFloat> a(num_frames, dim), b(num_frames, dim);
+  Vector<BaseFloat> counts(num_frames);
+  double tot_loglike = 0.0;
+  for (int32 pdf_id = 0; pdf_id < am_gmm.NumPdfs(); pdf_id++) {
+    const std::vector<std::pair<int32, BaseFloat> > &frames =
+        frames_of_pdf[pdf_id];
+    if (frames.empty()) continue;
+    const DiagGmm &pdf = am_gmm.GetPdf(pdf_id);
+    int32 num_rows = frames.size();
+    Matrix<BaseFloat> pdf_data(num_rows, dim, kUndefined);
+    for (int32 i = 0; i < num_rows; i++)
+      pdf_data.Row(i).CopyFromVec(data.Row(frames[i].first));
+    Matrix<BaseFloat> post;
+    pdf.LogLikelihoods(pdf_data, &post);
+    for (int32 i = 0; i < num_rows; i++) {
+      BaseFloat weight = frames[i].second;
+      SubVector<BaseFloat> post_row(post, i);
+      tot_loglike += weight * post_row.ApplySoftMax();
+      post_row.Scale(weight);
+      counts(frames[i].first) += weight;
+    }
+    Matrix<BaseFloat> pdf_a(num_rows, dim), pdf_b(num_rows, dim);
+    pdf_a.AddMatMat(1.0, post, kNoTrans, pdf.means_invvars(), kNoTrans, 0.0);
+    pdf_b.AddMatMat(1.0, post, kNoTrans, pdf.inv_vars(), kNoTrans, 0.0);
+    for (int32 i = 0; i < num_rows; i++) {
+      a.Row(frames[i].first).AddVec(1.0, pdf_a.Row(i));
+      b.Row(frames[i].first).AddVec(1.0, pdf_b.Row(i));
+    }
+  }
+  CommitMultiFrameStats(data, a, b, counts);
+  return tot_loglike;
+}
+
+
 
 
 void FmllrDiagGmmAccs::Update(const FmllrOptions &opts,
@@ -594,6 +647,50 @@ void FmllrDiagGmmAccs::CommitSingleFrameStats() {
   stats.a.SetZero();
   stats.b.SetZero();
 }
+
+void FmllrDiagGmmAccs::CommitMultiFrameStats(
+    const MatrixBase<BaseFloat> &data,
+    const MatrixBase<BaseFloat> &a,
+    const MatrixBase<BaseFloat> &b,
+    const VectorBase<BaseFloat> &counts) {
+  int32 dim = Dim(), num_frames = data.NumRows();
+  KALDI_ASSERT(data.NumCols() == dim && SameDim(data, a) && SameDim(data, b)
+               && counts.Dim() == num_frames);
+  if (num_frames == 0) return;
+  // The frames with the extra 1 appended, as in CommitSingleFrameStats().
+  Matrix<double> xplus(num_frames, dim + 1);
+  xplus.Range(0, num_frames, 0, dim).CopyFromMat(data);
+  xplus.Range(0, num_frames, dim, 1).Set(1.0);
+
+  this->beta_ += counts.Sum();
+  this->K_.AddMatMat(1.0, Matrix<double>(a), kTrans, xplus, kNoTrans, 1.0);
+
+  Matrix<double> b_dbl(b, kTrans);  // row i is the i'th dimension of b.
+  if (opts_.update_type == "full") {
+    KALDI_ASSERT(static_cast<size_t>(dim) == this->G_.size());
+    // G_[i] += sum_t b_t(i) xplus_t xplus_t^T, done as a matrix product.
+    Matrix<double> scaled_xplus(num_frames, dim + 1, kUndefined),
+        scatter(dim + 1, dim + 1, kUndefined);
+    for (int32 i = 0; i < dim; i++) {
+      scaled_xplus.CopyFromMat(xplus);
+      scaled_xplus.MulRowsVec(b_dbl.Row(i));
+      scatter.AddMatMat(1.0, scaled_xplus, kTrans, xplus, kNoTrans, 0.0);
+      this->G_[i].AddSp(1.0, SpMatrix<double>(scatter, kTakeLower));
+    }
+  } else {
+    // We only need some elements of these stats, so just update those elements.
+    Matrix<double> x_dbl(data, kTrans);  // row i is the i'th dimension.
+    Vector<double> tmp(num_frames);
+    for (int32 i = 0; i < dim; i++) {
+      SubVector<double> scale(b_dbl, i), x_i(x_dbl, i);
+      tmp.CopyFromVec(scale);
+      tmp.MulElements(x_i);  // b_t(i) x_t(i)
+      this->G_[i](i, i) += VecVec(tmp, x_i);
+      this->G_[i](dim, i) += tmp.Sum();
+      this->G_[i](dim, dim) += scale.Sum();
+    }
+  }
+}
     
 
 
@@ -110,6 +110,19 @@ class FmllrDiagGmmAccs: public AffineXformStats {
       const VectorBase<BaseFloat> &data,
       const VectorBase<BaseFloat> &posteriors);
 
+  /// Accumulates stats for a sequence of frames (the rows of "data"), given
+  /// for each frame a list of (pdf-id, weight) pairs, e.g. as output by
+  /// ConvertPosteriorToPdfs().  This is equivalent to calling
+  /// AccumulateForGmm() for each pair, but much faster: the Gaussian
+  /// posteriors are computed per pdf for all its frames at once, and the
+  /// outer products of the data are accumulated with matrix multiplications
+  /// rather than one frame at a time.  Returns the total log-likelihood
+  /// (weighted by the supplied weights).
+  BaseFloat AccumulateForPdfs(
+      const AmDiagGmm &am_gmm,
+      const MatrixBase<BaseFloat> &data,
+      const std::vector<std::vector<std::pair<int32, BaseFloat> > > &pdf_post);
+
   
   /// Update
   void Update(const FmllrOptions &opts,
@@ -143,6 +156,14 @@ class FmllrDiagGmmAccs: public AffineXformStats {
 
   void CommitSingleFrameStats();
 
+  // Adds the stats for a sequence of frames: row t of "a" and "b" and
+  // element t of "counts" correspond to SingleFrameStats::a, b and count of
+  // the frame in row t of "data".
+  void CommitMultiFrameStats(const MatrixBase<BaseFloat> &data,
+                             const MatrixBase<BaseFloat> &a,
+                             const MatrixBase<BaseFloat> &b,
+                             const VectorBase<BaseFloat> &counts);
+
   void InitSingleFrameStats(const VectorBase<BaseFloat> &data);
   
   bool DataHasChanged(const VectorBase<BaseFloat> &data) const; // compares it to the
@@ -198,6 +198,45 @@ UnitTestEstimateLda() {
     KALDI_ASSERT(tmp_mat(i - 1, i - 1) >= tmp_mat(i, i));
   }
 
+  // The batched Accumulate() should give the same stats; we accumulate in
+  // chunks of rows, with random weights, some of them split between two
+  // classes.
+  {
+    LdaEstimate lda_est1, lda_est2;
+    lda_est1.Init(num_class, dim);
+    lda_est2.Init(num_class, dim);
+    for (size_t start = 0; start < counter; ) {
+      size_t end = std::min(counter, start + RandInt(1, 300));
+      std::vector<std::vector<std::pair<int32, BaseFloat> > > post(end - start);
+      for (size_t i = start; i < end; i++) {
+        BaseFloat weight = RandUniform();
+        post[i - start].push_back(std::make_pair(feats_class[i], weight));
+        lda_est1.Accumulate(feats.Row(i), feats_class[i], weight);
+        if (RandInt(0, 1) == 0) {
+          int32 c = RandInt(0, num_class - 1);
+          post[i - start].push_back(std::make_pair(c, 0.5 * weight));
+          lda_est1.Accumulate(feats.Row(i), c, 0.5 * weight);
+        }
+      }
+      lda_est2.Accumulate(feats.RowRange(start, end - start), post);
+      start = end;
+    }
+    std::ostringstream os1, os2;
+    lda_est1.Write(os1, false);
+    lda_est2.Write(os2, false);
+    std::istringstream is1(os1.str()), is2(os2.str());
+    std::string tok1, tok2;
+    while (is1 >> tok1) {
+      KALDI_ASSERT(is2 >> tok2);
+      double d1, d2;
+      if (ConvertStringToReal(tok1, &d1) && ConvertStringToReal(tok2, &d2))
+        KALDI_ASSERT(std::abs(d1 - d2) <= 1.0e-04 * (1.0 + std::abs(d1)));
+      else
+        KALDI_ASSERT(tok1 == tok2);
+    }
+    KALDI_ASSERT(!(is2 >> tok2));
+  }
+
   // test I/O
   test_io(lda_est, false);
   test_io(lda_est, true);
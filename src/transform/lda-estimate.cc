@@ -54,6 +54,47 @@ void LdaEstimate::Accumulate(const VectorBase<BaseFloat> &data,
   total_second_acc_.AddVec2(weight, data_d);
 }
 
+void LdaEstimate::Accumulate(
+    const MatrixBase<BaseFloat> &data,
+    const std::vector<std::vector<std::pair<int32, BaseFloat> > > &post) {
+  int32 num_frames = data.NumRows();
+  KALDI_ASSERT(static_cast<int32>(post.size()) == num_frames &&
+               data.NumCols() == Dim());
+  Matrix<double> data_d(data);
+  Vector<double> frame_weights(num_frames);
+  int32 num_negative = 0;
+  for (int32 t = 0; t < num_frames; t++) {
+    SubVector<double> frame(data_d, t);
+    for (size_t i = 0; i < post[t].size(); i++) {
+      int32 class_id = post[t][i].first;
+      BaseFloat weight = post[t][i].second;
+      KALDI_ASSERT(class_id >= 0 && class_id < NumClasses());
+      zero_acc_(class_id) += weight;
+      first_acc_.Row(class_id).AddVec(weight, frame);
+      frame_weights(t) += weight;
+    }
+    if (frame_weights(t) < 0.0)
+      num_negative++;
+  }
+  // total_second_acc_ += data_d^T diag(frame_weights) data_d, done as a
+  // rank-k update on the rows scaled by the square roots of the weights,
+  // separately for any negative weights.
+  for (int32 sign = 1; sign >= -1; sign -= 2) {
+    int32 num_rows = (sign == 1 ? num_frames - num_negative : num_negative);
+    if (num_rows == 0) continue;
+    Matrix<double> scaled(num_rows, Dim(), kUndefined);
+    for (int32 t = 0, r = 0; t < num_frames; t++) {
+      double w = frame_weights(t);
+      if ((w < 0.0) == (sign == -1)) {
+        scaled.Row(r).CopyFromVec(data_d.Row(t));
+        scaled.Row(r).Scale(std::sqrt(std::abs(w)));
+        r++;
+      }
+    }
+    total_second_acc_.AddMat2(sign, scaled, kTrans, 1.0);
+  }
+}
+
 void LdaEstimate::GetStats(SpMatrix<double> *total_covar,
                            SpMatrix<double> *between_covar,
                            Vector<double> *total_mean,
@@ -116,11 +157,12 @@ void LdaEstimate::Estimate(const LdaEstimateOptions &opts,
 
   SpMatrix<double> tmp_sp(dim);
   tmp_sp.AddMat2Sp(1.0, wc_covar_sqrt_mat, kNoTrans, bc_covar, 0.0);
-  Matrix<double> tmp_mat(tmp_sp);
 
-  Matrix<double> svd_u(dim, dim), svd_vt(dim, dim);
+  // tmp_sp is symmetric positive semidefinite, so its SVD is the same as its
+  // eigendecomposition, which is cheaper.
+  Matrix<double> svd_u(dim, dim);
   Vector<double> svd_d(dim);
-  tmp_mat.Svd(&svd_d, &svd_u, &svd_vt);
+  tmp_sp.Eig(&svd_d, &svd_u);
   SortSvd(&svd_d, &svd_u);
 
   KALDI_LOG << "Data count is " << count;
@@ -74,6 +74,13 @@ class LdaEstimate {
   /// Accumulates data
   void Accumulate(const VectorBase<BaseFloat> &data, int32 class_id, BaseFloat weight = 1.0);
 
+  /// Accumulates a matrix of data (e.g. an utterance); post[t] is a list of
+  /// (class-id, weight) pairs for row t of "data", as in a Posterior.  This
+  /// gives the same result as calling the version above for each pair, but
+  /// the second-order stats are accumulated with one matrix multiplication.
+  void Accumulate(const MatrixBase<BaseFloat> &data,
+                  const std::vector<std::vector<std::pair<int32, BaseFloat> > > &post);
+
   /// Estimates the LDA transform matrix m.  If Mfull != NULL, it also outputs
   /// the full matrix (without dimensionality reduction), which is useful for
   /// some purposes.  If opts.remove_offset == true, it will output both matrices
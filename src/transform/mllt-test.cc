@@ -0,0 +1,73 @@
+// transform/mllt-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gmm/diag-gmm.h"
+#include "transform/mllt.h"
+
+namespace kaldi {
+
+void InitRandDiagGmm(int32 dim, int32 num_gauss, DiagGmm *gmm) {
+  Vector<BaseFloat> weights(num_gauss);
+  Matrix<BaseFloat> means(num_gauss, dim), inv_vars(num_gauss, dim);
+  for (int32 i = 0; i < num_gauss; i++) {
+    weights(i) = 0.5 + RandUniform();
+    for (int32 d = 0; d < dim; d++) {
+      means(i, d) = RandGauss();
+      inv_vars(i, d) = 1.0 / (0.5 + RandUniform());
+    }
+  }
+  weights.Scale(1.0 / weights.Sum());
+  gmm->Resize(num_gauss, dim);
+  gmm->SetWeights(weights);
+  gmm->SetInvVarsAndMeans(inv_vars, means);
+  gmm->ComputeGconsts();
+}
+
+// Checks that the batched AccumulateFromGmm() gives the same stats as calling
+// the per-frame version on each frame.
+void UnitTestMlltAccumulateBatched() {
+  int32 dim = RandInt(2, 15), num_gauss = RandInt(1, 10),
+      num_frames = RandInt(1, 50);
+  DiagGmm gmm;
+  InitRandDiagGmm(dim, num_gauss, &gmm);
+  Matrix<BaseFloat> data(num_frames, dim);
+  data.SetRandn();
+  Vector<BaseFloat> weights(num_frames);
+  weights.SetRandUniform();
+
+  // No randomized pruning, so the results are deterministic.
+  MlltAccs accs1(dim, 0.0), accs2(dim, 0.0);
+  BaseFloat like1 = 0.0;
+  for (int32 t = 0; t < num_frames; t++)
+    like1 += weights(t) * accs1.AccumulateFromGmm(gmm, data.Row(t),
+                                                  weights(t));
+  BaseFloat like2 = accs2.AccumulateFromGmm(gmm, data, weights);
+  AssertEqual(like1, like2, 1.0e-03);
+  AssertEqual(accs1.beta_, accs2.beta_, 1.0e-04);
+  for (int32 d = 0; d < dim; d++)
+    KALDI_ASSERT(ApproxEqual(accs1.G_[d], accs2.G_[d], 1.0e-04));
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    UnitTestMlltAccumulateBatched();
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -159,6 +159,99 @@ void MlltAccs::AccumulateFromPosteriors(const DiagGmm &gmm,
   Vector<double> data_dbl(data);
 }
 
+void MlltAccs::AccumulateFromPosteriors(
+    const DiagGmm &gmm,
+    const MatrixBase<BaseFloat> &data,
+    const MatrixBase<BaseFloat> &posteriors) {
+  int32 dim = data.NumCols(), num_frames = data.NumRows(),
+      num_gauss = gmm.NumGauss(), packed_dim = (dim * (dim + 1)) / 2;
+  KALDI_ASSERT(dim == gmm.Dim() && dim == Dim());
+  KALDI_ASSERT(posteriors.NumRows() == num_frames &&
+               posteriors.NumCols() == num_gauss);
+  KALDI_ASSERT(rand_prune_ >= 0.0);
+  const Matrix<BaseFloat> &means_invvars = gmm.means_invvars();
+  const Matrix<BaseFloat> &inv_vars = gmm.inv_vars();
+
+  // pruned(i, t) is the pruned posterior of Gaussian i on frame t.
+  Matrix<BaseFloat> pruned(num_gauss, num_frames);
+  std::vector<int32> active_gauss;
+  for (int32 i = 0; i < num_gauss; i++) {
+    bool active = false;
+    for (int32 t = 0; t < num_frames; t++) {
+      BaseFloat p = RandPrune(posteriors(t, i), rand_prune_);
+      pruned(i, t) = p;
+      if (p != 0.0) active = true;
+    }
+    if (active) active_gauss.push_back(i);
+  }
+  int32 num_active = active_gauss.size();
+  if (num_active == 0)
+    return;
+
+  // Row k of "scatters" is the packed scatter of the offsets from the mean of
+  // Gaussian active_gauss[k], weighted by its posteriors; row k of
+  // "active_inv_vars" is its inverse variance.
+  Matrix<double> scatters(num_active, packed_dim, kUndefined),
+      active_inv_vars(num_active, dim, kUndefined);
+  Vector<BaseFloat> mean(dim);
+  Vector<double> mean_dbl(dim);
+  SpMatrix<double> scatter(dim);
+  for (int32 k = 0; k < num_active; k++) {
+    int32 i = active_gauss[k];
+    SubVector<BaseFloat> mean_invvar(means_invvars, i), inv_var(inv_vars, i),
+        post(pruned, i);
+    mean.AddVecDivVec(1.0, mean_invvar, inv_var, 0.0);  // get mean.
+    mean_dbl.CopyFromVec(mean);
+    int32 num_negative = 0, num_positive = 0;
+    for (int32 t = 0; t < num_frames; t++) {
+      if (post(t) > 0.0) num_positive++;
+      else if (post(t) < 0.0) num_negative++;
+    }
+    scatter.SetZero();
+    // Do a rank-k update with the offsets scaled by the square roots of the
+    // posteriors, separately for any negative posteriors.
+    for (int32 sign = 1; sign >= -1; sign -= 2) {
+      int32 num_rows = (sign == 1 ? num_positive : num_negative);
+      if (num_rows == 0) continue;
+      Matrix<double> offsets(num_rows, dim, kUndefined);
+      for (int32 t = 0, r = 0; t < num_frames; t++) {
+        if (post(t) * sign > 0.0) {
+          SubVector<double> offset(offsets, r);
+          offset.CopyFromVec(data.Row(t));
+          offset.AddVec(-1.0, mean_dbl);
+          offset.Scale(std::sqrt(std::abs(post(t))));
+          r++;
+        }
+      }
+      scatter.AddMat2(sign, offsets, kTrans, 1.0);
+    }
+    scatters.Row(k).CopyFromPacked(scatter);
+    active_inv_vars.Row(k).CopyFromVec(inv_var);
+    beta_ += post.Sum();
+  }
+  // G_[j] += \sum_k active_inv_vars(k, j) * scatter_k.
+  Matrix<double> G_update(dim, packed_dim);
+  G_update.AddMatMat(1.0, active_inv_vars, kTrans, scatters, kNoTrans, 0.0);
+  for (int32 j = 0; j < dim; j++) {
+    SubVector<double> G_packed(G_[j].Data(), packed_dim);
+    G_packed.AddVec(1.0, G_update.Row(j));
+  }
+}
+
+BaseFloat MlltAccs::AccumulateFromGmm(const DiagGmm &gmm,
+                                      const MatrixBase<BaseFloat> &data,
+                                      const VectorBase<BaseFloat> &weights) {
+  KALDI_ASSERT(weights.Dim() == data.NumRows());
+  Matrix<BaseFloat> posteriors;
+  gmm.LogLikelihoods(data, &posteriors);  // batched over the frames.
+  Vector<BaseFloat> loglikes(data.NumRows());
+  for (int32 t = 0; t < data.NumRows(); t++)
+    loglikes(t) = posteriors.Row(t).ApplySoftMax();
+  posteriors.MulRowsVec(weights);
+  AccumulateFromPosteriors(gmm, data, posteriors);
+  return VecVec(loglikes, weights);
+}
+
 BaseFloat MlltAccs::AccumulateFromGmm(const DiagGmm &gmm,
                                       const VectorBase<BaseFloat> &data,
                                       BaseFloat weight) {  // e.g. weight = 1.0
@@ -90,6 +90,23 @@ class MlltAccs {
                               const VectorBase<BaseFloat> &data,
                               BaseFloat weight);  // e.g. weight = 1.0
 
+  /// This is a batched version of AccumulateFromPosteriors(), for frames that
+  /// are all aligned to the same GMM: "posteriors" is of dimension
+  /// data.NumRows() by gmm.NumGauss().  The scatter of each Gaussian over the
+  /// frames is computed with a rank-k update, and these are added to the G
+  /// matrices with a single matrix multiplication, instead of one update of
+  /// each G matrix per frame and Gaussian.
+  void AccumulateFromPosteriors(const DiagGmm &gmm,
+                                const MatrixBase<BaseFloat> &data,
+                                const MatrixBase<BaseFloat> &posteriors);
+
+  /// Batched version of AccumulateFromGmm(), for frames that are all aligned
+  /// to the same GMM, with weights "weights".  Returns the sum over frames of
+  /// the GMM log-likelihood times the weight.
+  BaseFloat AccumulateFromGmm(const DiagGmm &gmm,
+                              const MatrixBase<BaseFloat> &data,
+                              const VectorBase<BaseFloat> &weights);
+
   BaseFloat AccumulateFromGmmPreselect(const DiagGmm &gmm,
                                        const std::vector<int32> &gselect,
                                        const VectorBase<BaseFloat> &data,
@@ -20,6 +20,7 @@
 #include <set>
 #include <queue>
 #include "util/stl-utils.h"
+#include "util/kaldi-thread.h"
 #include "tree/build-tree-utils.h"
 
 
@@ -423,7 +424,14 @@ BaseFloat FindBestSplitForKey(const BuildTreeStatsType &stats,
 
 
 /*
-  DecisionTreeBuilder is a class used in SplitDecisionTree
+  DecisionTreeBuilder is a class used in SplitDecisionTree.
+
+  If it is given a ThreadPool, the search for the best split of each key is
+  done in a separate task.  In that case the constructor only submits the
+  tasks; the caller must call pool->Wait() and then ChooseBestSplit() before
+  using the object.  (This is so that the splits of many leaves can be
+  evaluated at once.)  The best split is chosen in the same way regardless of
+  the number of threads, so the tree does not depend on it.
 */
 
 class DecisionTreeSplitter {
@@ -445,9 +453,28 @@ class DecisionTreeSplitter {
     }
   }
   DecisionTreeSplitter(EventAnswerType leaf, const BuildTreeStatsType &stats,
-                      const Questions &q_opts): q_opts_(q_opts), yes_(NULL), no_(NULL), leaf_(leaf), stats_(stats) {
+                       const Questions &q_opts, ThreadPool *pool = NULL):
+      q_opts_(q_opts), pool_(pool), yes_(NULL), no_(NULL), leaf_(leaf),
+      stats_(stats) {
     // not, this must work when stats is empty too. [just gives zero improvement, non-splittable].
-    FindBestSplit();
+    EvaluateSplits();
+    if (pool_ == NULL)
+      ChooseBestSplit();
+  }
+  // This sets best_split_impr_, key_ and yes_set_ from the results of
+  // EvaluateSplits().  Of keys with equally good splits, the first is chosen.
+  void ChooseBestSplit() {
+    best_split_impr_ = 0;
+    for (size_t i = 0; i < keys_.size(); i++) {
+      if (key_impr_[i] > best_split_impr_) {
+        best_split_impr_ = key_impr_[i];
+        yes_set_ = key_yes_sets_[i];
+        key_ = keys_[i];
+      }
+    }
+    keys_.clear();
+    key_impr_.clear();
+    key_yes_sets_.clear();
   }
   ~DecisionTreeSplitter() {
     delete yes_;
@@ -481,38 +508,46 @@ class DecisionTreeSplitter {
       delete yes_clust; delete no_clust;
     }
 #endif
-    yes_ = new DecisionTreeSplitter(yes_leaf, yes_stats, q_opts_);
-    no_ = new DecisionTreeSplitter(no_leaf, no_stats, q_opts_);
+    yes_ = new DecisionTreeSplitter(yes_leaf, yes_stats, q_opts_, pool_);
+    no_ = new DecisionTreeSplitter(no_leaf, no_stats, q_opts_, pool_);
+    if (pool_ != NULL) {
+      pool_->Wait();
+      yes_->ChooseBestSplit();
+      no_->ChooseBestSplit();
+    }
     best_split_impr_ = std::max(yes_->BestSplit(), no_->BestSplit());
     stats_.clear();  // note: pointers in stats_ were not owned here.
   }
-  void FindBestSplit() {
-    // This sets best_split_impr_, key_ and yes_set_.
+  void EvaluateSplits() {
+    // This finds the best split for each key, setting keys_, key_impr_ and
+    // key_yes_sets_; it is done in tasks of pool_ if it is non-NULL.
     // May just pick best question, or may iterate a bit (depends on
     // q_opts; see FindBestSplitForKey for details)
-    std::vector<EventKeyType> all_keys;
-    q_opts_.GetKeysWithQuestions(&all_keys);
-    if (all_keys.size() == 0) {
-      KALDI_WARN << "DecisionTreeSplitter::FindBestSplit(), no keys available to split on (maybe no key covered all of your events, or there was a problem with your questions configuration?)";
+    q_opts_.GetKeysWithQuestions(&keys_);
+    if (keys_.size() == 0) {
+      KALDI_WARN << "DecisionTreeSplitter::EvaluateSplits(), no keys available to split on (maybe no key covered all of your events, or there was a problem with your questions configuration?)";
     }
-    best_split_impr_ = 0;
-    for (size_t i = 0; i < all_keys.size(); i++) {
-      if (q_opts_.HasQuestionsForKey(all_keys[i])) {
-        std::vector<EventValueType> temp_yes_set;
-        BaseFloat split_improvement = FindBestSplitForKey(stats_, q_opts_, all_keys[i], &temp_yes_set);
-        if (split_improvement > best_split_impr_) {
-          best_split_impr_ = split_improvement;
-          yes_set_ = temp_yes_set;
-          key_ = all_keys[i];
-        }
+    key_impr_.resize(keys_.size(), 0.0);
+    key_yes_sets_.resize(keys_.size());
+    for (size_t i = 0; i < keys_.size(); i++) {
+      if (q_opts_.HasQuestionsForKey(keys_[i])) {
+        if (pool_ == NULL)
+          EvaluateSplit(i);
+        else
+          pool_->Submit([this, i]() { EvaluateSplit(i); });
       }
     }
   }
+  void EvaluateSplit(size_t i) {
+    key_impr_[i] = FindBestSplitForKey(stats_, q_opts_, keys_[i],
+                                       &(key_yes_sets_[i]));
+  }
 
 
 
   // Data members... Always used:
   const Questions &q_opts_;
+  ThreadPool *pool_;  // not owned; may be NULL.
   BaseFloat best_split_impr_;
 
   // If already split:
@@ -527,6 +562,11 @@ class DecisionTreeSplitter {
   EventKeyType key_;
   std::vector<EventValueType> yes_set_;
 
+  // The results of EvaluateSplits(), for each key; cleared by
+  // ChooseBestSplit().
+  std::vector<EventKeyType> keys_;
+  std::vector<BaseFloat> key_impr_;
+  std::vector<std::vector<EventValueType> > key_yes_sets_;
 };
 
 EventMap *SplitDecisionTree(const EventMap &input_map,
@@ -536,8 +576,10 @@ EventMap *SplitDecisionTree(const EventMap &input_map,
                             int32 max_leaves,  // max_leaves<=0 -> no maximum.
                             int32 *num_leaves,
                             BaseFloat *obj_impr_out,
-                            BaseFloat *smallest_split_change_out) {
+                            BaseFloat *smallest_split_change_out,
+                            int32 num_threads) {
   KALDI_ASSERT(num_leaves != NULL && *num_leaves > 0);  // can't be 0 or input_map would be empty.
+  ThreadPool *pool = (num_threads > 1 ? new ThreadPool(num_threads) : NULL);
   int32 num_empty_leaves = 0;
   BaseFloat like_impr = 0.0;
   BaseFloat smallest_split_change = 1.0e+20;
@@ -551,7 +593,13 @@ EventMap *SplitDecisionTree(const EventMap &input_map,
     for (size_t i = 0;i < split_stats.size();i++) {
       EventAnswerType leaf = static_cast<EventAnswerType>(i);
       if (split_stats[i].size() == 0) num_empty_leaves++;
-      builders[i] = new DecisionTreeSplitter(leaf, split_stats[i], q_opts);
+      builders[i] = new DecisionTreeSplitter(leaf, split_stats[i], q_opts,
+                                             pool);
+    }
+    if (pool != NULL) {  // the splits of all the leaves were being evaluated.
+      pool->Wait();
+      for (size_t i = 0; i < builders.size(); i++)
+        builders[i]->ChooseBestSplit();
     }
   }
 
@@ -590,6 +638,7 @@ EventMap *SplitDecisionTree(const EventMap &input_map,
   }
   // Free up memory.
   for (size_t i = 0;i < builders.size();i++) delete builders[i];
+  delete pool;
 
   if (obj_impr_out != NULL) *obj_impr_out = like_impr;
   return answer;
@@ -114,6 +114,31 @@ static void TestObjfMinus() {
   AssertEqual(a.ObjfMinus(b), -0.5 * (1.0-2.5)*(1.0-2.5));
 }
 
+// Checks GaussClusterable::ObjfPlus() and ObjfMinus(), which are computed
+// directly from the stats, against the default implementation.
+static void TestGaussObjfPlusMinus() {
+  for (int32 n = 0; n < 10; n++) {
+    int32 dim = RandInt(1, 40);
+    BaseFloat var_floor = (n % 2 == 0 ? 0.01 : 0.5);
+    GaussClusterable a(dim, var_floor), b(dim, var_floor);
+    Vector<BaseFloat> vec(dim);
+    int32 na = RandInt(1, 10), nb = RandInt(1, 10);
+    for (int32 i = 0; i < na; i++) {
+      vec.SetRandn();
+      a.AddStats(vec, RandUniform());
+    }
+    for (int32 i = 0; i < nb; i++) {
+      vec.SetRandn();
+      b.AddStats(vec, RandUniform());
+    }
+    Clusterable *sum = a.Copy();
+    sum->Add(b);
+    AssertEqual(a.ObjfPlus(b), sum->Objf(), 1.0e-04);
+    AssertEqual(sum->ObjfMinus(b), a.Objf(), 1.0e-04);
+    delete sum;
+  }
+}
+
 static void TestDistance() {
   ScalarClusterable a(1.0), b(2.5);
   AssertEqual(a.Objf(), 0.0);
@@ -326,6 +351,50 @@ static void TestRefineClusters() {
   }
 }
 
+// Checks that RefineClusters() gives the same result with several threads as
+// with one, using GaussClusterable points (which take the fast path).
+static void TestRefineClustersThreaded() {
+  for (int32 n = 0; n < 4; n++) {
+    int32 dim = RandInt(1, 20), n_clust = RandInt(2, 40),
+        n_points = RandInt(300, 600);
+    Matrix<BaseFloat> centers(n_clust, dim);
+    centers.SetRandn();
+    centers.Scale(3.0);
+    std::vector<Clusterable*> points(n_points);
+    std::vector<int32> assignments1(n_points);
+    Vector<BaseFloat> vec(dim);
+    for (int32 i = 0; i < n_points; i++) {
+      vec.SetRandn();
+      vec.AddVec(1.0, centers.Row(Rand() % n_clust));
+      GaussClusterable *gc = new GaussClusterable(dim, 0.01);
+      gc->AddStats(vec);
+      points[i] = gc;
+      assignments1[i] = Rand() % n_clust;
+    }
+    std::vector<int32> assignments2(assignments1);
+    std::vector<Clusterable*> clusters1(n_clust), clusters2(n_clust);
+    for (int32 c = 0; c < n_clust; c++) {
+      clusters1[c] = new GaussClusterable(dim, 0.01);
+      clusters2[c] = new GaussClusterable(dim, 0.01);
+    }
+    for (int32 i = 0; i < n_points; i++) {
+      clusters1[assignments1[i]]->Add(*(points[i]));
+      clusters2[assignments2[i]]->Add(*(points[i]));
+    }
+    RefineClustersOptions cfg;
+    cfg.top_n = RandInt(2, 10);
+    BaseFloat impr1 = RefineClusters(points, &clusters1, &assignments1, cfg);
+    cfg.num_threads = 4;
+    BaseFloat impr2 = RefineClusters(points, &clusters2, &assignments2, cfg);
+    KALDI_ASSERT(assignments1 == assignments2);
+    AssertEqual(impr1, impr2);
+    KALDI_ASSERT(impr1 >= 0.0);
+    DeletePointers(&clusters1);
+    DeletePointers(&clusters2);
+    DeletePointers(&points);
+  }
+}
+
 static void TestClusterKMeans() {
   size_t n_points_tot = 0, n_wrong_tot = 0;
   for (size_t n = 0;n < 3;n++) {
@@ -562,6 +631,7 @@ int main() {
   TestAddToClustersOptimized();
   TestObjfPlus();
   TestObjfMinus();
+  TestGaussObjfPlusMinus();
   TestDistance();
   TestSumObjfAndSumNormalizer();
   TestSum();
@@ -573,4 +643,5 @@ int main() {
   TestClusterKMeansVector();
   TestClusterBottomUp();
   TestRefineClusters();
+  TestRefineClustersThreaded();
 }
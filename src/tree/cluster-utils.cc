@@ -24,8 +24,10 @@
 using std::vector;
 
 #include "base/kaldi-math.h"
+#include "util/kaldi-thread.h"
 #include "util/stl-utils.h"
 #include "tree/cluster-utils.h"
+#include "tree/clusterable-classes.h"
 
 namespace kaldi {
 
@@ -725,6 +727,67 @@ class RefineClusterer {
   }
   // at some point check cfg_.top_n > 1 after maxing to num_clust_.
  private:
+  // This class calls InitPoint() for a subset of the points, from
+  // RunMultiThreaded().
+  class InitPointsClass: public MultiThreadable {
+   public:
+    explicit InitPointsClass(RefineClusterer *clusterer):
+        clusterer_(clusterer) { }
+    void operator () () {
+      for (int32 p = thread_id_; p < clusterer_->num_points_;
+           p += num_threads_)
+        clusterer_->InitPoint(p);
+    }
+   private:
+    RefineClusterer *clusterer_;
+  };
+
+  // If all the points and clusters are GaussClusterable with the same
+  // dimension, copies the stats of the clusters to gauss_clust_stats_ etc.
+  // (for use in InitPoints()) and returns true; else returns false.
+  bool InitGaussStats() {
+    gauss_points_.resize(num_points_);
+    for (int32 p = 0; p < num_points_; p++) {
+      if (points_[p]->Type() != "gauss") return false;
+      gauss_points_[p] = static_cast<const GaussClusterable*>(points_[p]);
+    }
+    int32 dim = -1;
+    for (int32 c = 0; c < num_clust_; c++) {
+      if ((*clusters_)[c]->Type() != "gauss") return false;
+      const GaussClusterable *gc =
+          static_cast<const GaussClusterable*>((*clusters_)[c]);
+      if (c == 0) {
+        dim = gc->x_stats().Dim();
+        gauss_clust_stats_.Resize(num_clust_, 2 * dim, kUndefined);
+        gauss_clust_counts_.resize(num_clust_);
+        gauss_clust_var_floors_.resize(num_clust_);
+      } else if (gc->x_stats().Dim() != dim) {
+        return false;
+      }
+      gauss_clust_stats_.Row(c).Range(0, dim).CopyFromVec(gc->x_stats());
+      gauss_clust_stats_.Row(c).Range(dim, dim).CopyFromVec(gc->x2_stats());
+      gauss_clust_counts_[c] = gc->count();
+      gauss_clust_var_floors_[c] = gc->var_floor();
+    }
+    for (int32 p = 0; p < num_points_; p++)
+      if (gauss_points_[p]->x_stats().Dim() != dim) return false;
+    return true;
+  }
+
+  // Returns the objective function of cluster "clust" plus point "point";
+  // the same as (*clusters_)[clust]->ObjfPlus(*(points_[point])).
+  BaseFloat ObjfPlus(int32 clust, int32 point) const {
+    if (gauss_points_.empty())
+      return (*clusters_)[clust]->ObjfPlus(*(points_[point]));
+    const GaussClusterable *point_gc = gauss_points_[point];
+    int32 dim = gauss_clust_stats_.NumCols() / 2;
+    const double *clust_stats = gauss_clust_stats_.RowData(clust);
+    return GaussClusterable::ObjfOfSum(
+        dim, gauss_clust_var_floors_[clust], gauss_clust_counts_[clust],
+        clust_stats, clust_stats + dim, 1.0, point_gc->count(),
+        point_gc->x_stats().Data(), point_gc->x2_stats().Data());
+  }
+
   void InitPoint(int32 point) {
     // Find closest clusters to this point.
     // distances are really negated objf changes, ignoring terms that don't vary with the "other" cluster.
@@ -732,18 +795,14 @@ class RefineClusterer {
     std::vector<std::pair<BaseFloat, LocalInt> > distances;
     distances.reserve(num_clust_-1);
     int32 my_clust = (*assignments_)[point];
-    Clusterable *point_cl = points_[point];
 
     for (int32 clust = 0;clust < num_clust_;clust++) {
       if (clust != my_clust) {
-        Clusterable *tmp = (*clusters_)[clust]->Copy();
-        tmp->Add(*point_cl);
         BaseFloat other_clust_objf = clust_objf_[clust];
-        BaseFloat other_clust_plus_me_objf = (*clusters_)[clust]->ObjfPlus(* (points_[point]));
+        BaseFloat other_clust_plus_me_objf = ObjfPlus(clust, point);
 
         BaseFloat distance = other_clust_objf-other_clust_plus_me_objf;  // negated delta-objf, with only "varying" terms.
         distances.push_back(std::make_pair(distance, (LocalInt)clust));
-        delete tmp;
       }
     }
     if ((cfg_.top_n-1-1) >= 0) {
@@ -772,7 +831,18 @@ class RefineClusterer {
   void InitPoints() {
     // finds, for each point, the closest cfg_.top_n clusters (including its own cluster).
     // this may be the most time-consuming step of the algorithm.
-    for (int32 p = 0;p < num_points_;p++) InitPoint(p);
+    if (!InitGaussStats())
+      gauss_points_.clear();
+    // Only use threads if there is enough work to be worth starting them.
+    int64 work = static_cast<int64>(num_points_) * num_clust_;
+    if (cfg_.num_threads > 1 && work >= 10000) {
+      InitPointsClass c(this);
+      MultiThreader<InitPointsClass> m(cfg_.num_threads, c);
+    } else {
+      for (int32 p = 0;p < num_points_;p++) InitPoint(p);
+    }
+    gauss_points_.clear();
+    gauss_clust_stats_.Resize(0, 0);
   }
   void Iterate() {
     int32 iter, num_iters = cfg_.num_iters;
@@ -847,15 +917,12 @@ class RefineClusterer {
   void UpdateInfo(int32 point, int32 idx) {
     point_info &pinfo = GetInfo(point, idx);
     if (pinfo.time < clust_time_[pinfo.clust]) {  // it's not up-to-date...
-      Clusterable *tmp_cl = (*clusters_)[pinfo.clust]->Copy();
-      if (idx == my_clust_index_[point]) {
-        tmp_cl->Sub( *(points_[point]) );
-      } else{
-        tmp_cl->Add( *(points_[point]) );
-      }
+      const Clusterable *clust_cl = (*clusters_)[pinfo.clust];
       pinfo.time = t_;
-      pinfo.objf = tmp_cl->Objf();
-      delete tmp_cl;
+      if (idx == my_clust_index_[point])
+        pinfo.objf = clust_cl->ObjfMinus(*(points_[point]));
+      else
+        pinfo.objf = clust_cl->ObjfPlus(*(points_[point]));
     }
   }
 
@@ -883,6 +950,14 @@ class RefineClusterer {
   std::vector<LocalInt> clust_time_;  // Modification time of cluster.
   std::vector<BaseFloat> clust_objf_;  // [clust], objf for cluster.
 
+  // The following are only set during InitPoints(), if all the points and
+  // clusters are GaussClusterable: the points, and the clusters' stats (x
+  // stats then x2 stats in each row), counts and variance floors.
+  std::vector<const GaussClusterable*> gauss_points_;
+  Matrix<double> gauss_clust_stats_;
+  std::vector<double> gauss_clust_counts_;
+  std::vector<double> gauss_clust_var_floors_;
+
   BaseFloat ans_;  // objf improvement.
 
   int32 num_clust_;
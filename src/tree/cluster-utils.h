@@ -129,9 +129,13 @@ BaseFloat ClusterBottomUpCompartmentalized(
 struct RefineClustersOptions {
   int32 num_iters;  // must be >= 0.  If zero, does nothing.
   int32 top_n;  // must be >= 2.
-  RefineClustersOptions() : num_iters(100), top_n(5) {}
+  // Number of threads used to find the closest clusters to each point at the
+  // start (the rest of the algorithm is sequential).  Not written or read by
+  // Write() and Read().
+  int32 num_threads;
+  RefineClustersOptions() : num_iters(100), top_n(5), num_threads(1) {}
   RefineClustersOptions(int32 num_iters_in, int32 top_n_in)
-      : num_iters(num_iters_in), top_n(top_n_in) {}
+      : num_iters(num_iters_in), top_n(top_n_in), num_threads(1) {}
   // include Write and Read functions because this object gets written/read as
   // part of the QuestionsForKeyOptions class.
   void Write(std::ostream &os, bool binary) const;
@@ -152,6 +156,11 @@ struct RefineClustersOptions {
  *  and from that point only consider move to those "top_n" clusters. Since
  *  RefineClusters is called multiple times from ClusterKMeans (for instance),
  *  this is not really a limitation.
+ *
+ *  Finding the "top_n" closest clusters is done from cfg.num_threads threads,
+ *  and if all the points and clusters are of type GaussClusterable it is done
+ *  directly on their stats, without virtual function calls.  Neither of these
+ *  changes the result.
  */
 BaseFloat RefineClusters(const std::vector<Clusterable*> &points,
                          std::vector<Clusterable*> *clusters /*non-NULL*/,
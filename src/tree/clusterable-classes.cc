@@ -157,6 +157,71 @@ void GaussClusterable::Sub(const Clusterable &other_in) {
   stats_.AddMat(-1.0, other->stats_);
 }
 
+BaseFloat GaussClusterable::ObjfPlus(const Clusterable &other_in) const {
+  KALDI_ASSERT(other_in.Type() == "gauss");
+  const GaussClusterable *other =
+      static_cast<const GaussClusterable*>(&other_in);
+  KALDI_ASSERT(other->stats_.NumCols() == stats_.NumCols());
+  return ObjfOfSum(stats_.NumCols(), var_floor_, count_, stats_.RowData(0),
+                   stats_.RowData(1), 1.0, other->count_,
+                   other->stats_.RowData(0), other->stats_.RowData(1));
+}
+
+BaseFloat GaussClusterable::ObjfMinus(const Clusterable &other_in) const {
+  KALDI_ASSERT(other_in.Type() == "gauss");
+  const GaussClusterable *other =
+      static_cast<const GaussClusterable*>(&other_in);
+  KALDI_ASSERT(other->stats_.NumCols() == stats_.NumCols());
+  return ObjfOfSum(stats_.NumCols(), var_floor_, count_, stats_.RowData(0),
+                   stats_.RowData(1), -1.0, other->count_,
+                   other->stats_.RowData(0), other->stats_.RowData(1));
+}
+
+BaseFloat GaussClusterable::ObjfOfSum(int32 dim, double var_floor,
+                                      double count1, const double *x_stats1,
+                                      const double *x2_stats1, double alpha,
+                                      double count2, const double *x_stats2,
+                                      const double *x2_stats2) {
+  double count = count1 + alpha * count2;
+  if (count <= 0.0) {
+    if (count < -0.1) {
+      KALDI_WARN << "GaussClusterable::Objf(), count is negative " << count;
+    }
+    return 0.0;
+  }
+  // This is the same computation as in Objf().  We work on blocks of
+  // dimensions so the inner loop is simple enough for the compiler to
+  // vectorize, and take the log of products of a few variances at a time
+  // rather than of each one.
+  const int32 kBlockSize = 16;
+  double floored_vars[kBlockSize];
+  double inv_count = 1.0 / count, var_ratio_sum = 0.0, log_det = 0.0;
+  for (int32 d0 = 0; d0 < dim; d0 += kBlockSize) {
+    int32 block_size = std::min(kBlockSize, dim - d0);
+    const double *x1 = x_stats1 + d0, *xx1 = x2_stats1 + d0,
+        *x2 = x_stats2 + d0, *xx2 = x2_stats2 + d0;
+    for (int32 i = 0; i < block_size; i++) {
+      double mean = (x1[i] + alpha * x2[i]) * inv_count,
+          var = (xx1[i] + alpha * xx2[i]) * inv_count - mean * mean,
+          floored_var = std::max(var, var_floor);
+      floored_vars[i] = floored_var;
+      var_ratio_sum += var / floored_var;
+    }
+    for (int32 i = 0; i < block_size; i += 4) {
+      double prod = floored_vars[i];
+      for (int32 j = i + 1; j < std::min(i + 4, block_size); j++)
+        prod *= floored_vars[j];
+      log_det += Log(prod);
+    }
+  }
+  double objf_per_frame = -0.5 * (var_ratio_sum + log_det + M_LOG_2PI * dim);
+  if (KALDI_ISNAN(objf_per_frame)) {
+    KALDI_WARN << "GaussClusterable::Objf(), objf is NaN";
+    return 0.0;
+  }
+  return objf_per_frame * count;
+}
+
 Clusterable* GaussClusterable::Copy() const {
   KALDI_ASSERT(stats_.NumRows() == 2);
   GaussClusterable *ans = new GaussClusterable(stats_.NumCols(), var_floor_);
@@ -78,6 +78,10 @@ class GaussClusterable: public Clusterable {
   virtual void SetZero();
   virtual void Add(const Clusterable &other_in);
   virtual void Sub(const Clusterable &other_in);
+  // ObjfPlus() and ObjfMinus() are overridden so that they don't need to
+  // allocate a copy of the stats.
+  virtual BaseFloat ObjfPlus(const Clusterable &other_in) const;
+  virtual BaseFloat ObjfMinus(const Clusterable &other_in) const;
   virtual BaseFloat Normalizer() const { return count_; }
   virtual Clusterable *Copy() const;
   virtual void Scale(BaseFloat f);
@@ -86,9 +90,22 @@ class GaussClusterable: public Clusterable {
   virtual ~GaussClusterable() {}
 
   BaseFloat count() const { return count_; }
+  BaseFloat var_floor() const { return var_floor_; }
   // The next two functions are not const-correct, because of SubVector.
   SubVector<double> x_stats() const { return stats_.Row(0); }
   SubVector<double> x2_stats() const { return stats_.Row(1); }
+
+  /// Returns what Objf() would return for stats equal to (count1, x_stats1,
+  /// x2_stats1) plus alpha times (count2, x_stats2, x2_stats2), with the
+  /// variance floor var_floor; the stats are arrays of dimension "dim".  This
+  /// works on raw arrays so that clustering code can keep the stats of many
+  /// clusters contiguous in memory and evaluate them without virtual calls
+  /// or copies.
+  static BaseFloat ObjfOfSum(int32 dim, double var_floor,
+                             double count1, const double *x_stats1,
+                             const double *x2_stats1, double alpha,
+                             double count2, const double *x_stats2,
+                             const double *x2_stats2);
  private:
   double count_;
   Matrix<double> stats_; // two rows: sum, then sum-squared.
@@ -127,6 +127,47 @@ void TestGenRandContextDependency() {
   std::cout << "Note: any \"serious error\" warnings preceding this line are OK.\n";
 }
 
+// Checks that lookups in CompiledEventMap (as used by
+// ContextDependency::Compute()) agree with EventMap::Map().
+void TestCompiledEventMap() {
+  size_t num_phones = 1 + Rand() % 10;
+  std::set<int32> phones_set;
+  while (phones_set.size() < num_phones) phones_set.insert(1 + Rand() % (num_phones + 5));
+  std::vector<int32> phones;
+  CopySetToVector(phones_set, &phones);
+  std::vector<int32> phone2num_pdf_classes;
+  ContextDependency *dep = GenRandContextDependency(phones, (Rand() % 2 == 0),
+                                                    &phone2num_pdf_classes);
+  int32 N = dep->ContextWidth(), num_events = 100;
+  CompiledEventMap compiled;
+  KALDI_ASSERT(compiled.Init(dep->ToPdfMap(), kPdfClass, N + 1));
+  std::vector<EventValueType> values(num_events * (N + 1));
+  std::vector<EventAnswerType> answers(num_events);
+  for (int32 n = 0; n < num_events; n++) {
+    std::vector<int32> phoneseq(N);
+    for (int32 i = 0; i < N; i++)  // includes some values not in the tree.
+      phoneseq[i] = Rand() % (phones.back() + 3);
+    int32 pdf_class = Rand() % 4;
+    EventType event;
+    event.push_back(MakeEventPair(kPdfClass, pdf_class));
+    values[n * (N + 1)] = pdf_class;
+    for (int32 i = 0; i < N; i++) {
+      event.push_back(MakeEventPair(i, phoneseq[i]));
+      values[n * (N + 1) + i + 1] = phoneseq[i];
+    }
+    EventAnswerType ans1 = -1, ans2 = -1;
+    bool ok1 = dep->ToPdfMap().Map(event, &ans1),
+        ok2 = dep->Compute(phoneseq, pdf_class, &ans2);
+    KALDI_ASSERT(ok1 == ok2 && (!ok1 || ans1 == ans2));
+    if (!ok1) ans1 = -1;
+    answers[n] = ans1;
+  }
+  std::vector<EventAnswerType> batch_answers(num_events);
+  compiled.MapBatch(&(values[0]), num_events, &(batch_answers[0]));
+  KALDI_ASSERT(batch_answers == answers);
+  delete dep;
+}
+
 } // end namespace kaldi
 
 int main() {
@@ -134,5 +175,6 @@ int main() {
     kaldi::TestContextDep();
     kaldi::TestGenRandContextDependency();  // Also tests I/O of ContextDependency
     kaldi::TestMonophoneContextDependency();
+    kaldi::TestCompiledEventMap();
   }
 }
@@ -23,10 +23,32 @@
 
 namespace kaldi {
 
+// Compute() uses compiled_to_pdf_ only for context widths less than this, so
+// that it can put the event on the stack.
+static const int32 kMaxCompiledContextWidth = 16;
+
+void ContextDependency::Compile() {
+  if (to_pdf_ == NULL ||
+      !compiled_to_pdf_.Init(*to_pdf_, static_cast<EventKeyType>(kPdfClass),
+                             N_ + 1))
+    KALDI_VLOG(2) << "Could not compile the tree; lookups will be slower.";
+}
+
 bool ContextDependency::Compute(const std::vector<int32> &phoneseq,
                                  int32 pdf_class,
                                  int32 *pdf_id) const {
   KALDI_ASSERT(static_cast<int32>(phoneseq.size()) == N_);
+  if (!compiled_to_pdf_.IsEmpty() && N_ < kMaxCompiledContextWidth) {
+    // The keys are kPdfClass (== -1), then the positions 0 ... N_-1.
+    EventValueType values[kMaxCompiledContextWidth + 1];
+    values[0] = pdf_class;
+    for (int32 i = 0; i < N_; i++) {
+      KALDI_ASSERT(phoneseq[i] >= 0);
+      values[i + 1] = phoneseq[i];
+    }
+    KALDI_ASSERT(pdf_id != NULL);
+    return compiled_to_pdf_.Map(values, pdf_id);
+  }
   EventType  event_vec;
   event_vec.reserve(N_+1);
   event_vec.push_back(std::make_pair
@@ -176,6 +198,7 @@ void ContextDependency::Read (std::istream &is, bool binary) {
   }
   ExpectToken(is, binary, "EndContextDependency");
   to_pdf_ = to_pdf;
+  Compile();
 }
 
 void ContextDependency::EnumeratePairs(
@@ -90,7 +90,7 @@ class ContextDependency: public ContextDependencyInterface {
   // Constructor takes ownership of pointers.
   ContextDependency(int32 N, int32 P,
                     EventMap *to_pdf):
-      N_(N), P_(P), to_pdf_(to_pdf) { }
+      N_(N), P_(P), to_pdf_(to_pdf) { Compile(); }
   void Write (std::ostream &os, bool binary) const;
 
   ~ContextDependency() { delete to_pdf_; }
@@ -138,6 +138,12 @@ class ContextDependency: public ContextDependencyInterface {
   int32 N_;  //
   int32 P_;
   EventMap *to_pdf_;  // owned here.
+  // A copy of to_pdf_ that is faster to look up, used in Compute(); it is
+  // empty if to_pdf_ could not be compiled, in which case to_pdf_ is used.
+  CompiledEventMap compiled_to_pdf_;
+
+  // Sets up compiled_to_pdf_ from to_pdf_.
+  void Compile();
 
   // 'context' is the context-window of phones, of
   // length N, with -1 for those positions where phones
@@ -489,4 +489,90 @@ bool GetTreeStructure(const EventMap &map,
 
 
 
+
+bool CompiledEventMap::Init(const EventMap &map, EventKeyType min_key,
+                            int32 num_keys) {
+  KALDI_ASSERT(num_keys > 0);
+  min_key_ = min_key;
+  num_keys_ = num_keys;
+  nodes_.clear();
+  table_.clear();
+  bits_.clear();
+  if (AddNode(map) == -1) {
+    nodes_.clear();
+    table_.clear();
+    bits_.clear();
+    return false;
+  }
+  return true;
+}
+
+int32 CompiledEventMap::AddNode(const EventMap &map) {
+  int32 index = nodes_.size();
+  nodes_.resize(index + 1);
+  Node node;
+  node.yes = node.no = -1;
+  node.key = 0;
+  node.size = 0;
+  if (const ConstantEventMap *c =
+      dynamic_cast<const ConstantEventMap*>(&map)) {
+    node.type = kConstant;
+    node.offset = c->answer_;
+  } else if (const TableEventMap *t =
+             dynamic_cast<const TableEventMap*>(&map)) {
+    node.type = kTable;
+    node.key = t->key_ - min_key_;
+    if (node.key < 0 || node.key >= num_keys_)
+      return -1;
+    node.size = t->table_.size();
+    node.offset = table_.size();
+    table_.resize(table_.size() + node.size, -1);
+    for (int32 i = 0; i < node.size; i++) {
+      if (t->table_[i] != NULL) {
+        int32 child = AddNode(*(t->table_[i]));
+        if (child == -1)
+          return -1;
+        table_[node.offset + i] = child;
+      }
+    }
+  } else if (const SplitEventMap *s =
+             dynamic_cast<const SplitEventMap*>(&map)) {
+    node.type = kSplit;
+    node.key = s->key_ - min_key_;
+    if (node.key < 0 || node.key >= num_keys_)
+      return -1;
+    EventValueType max_value = -1;
+    for (ConstIntegerSet<EventValueType>::iterator iter = s->yes_set_.begin();
+         iter != s->yes_set_.end(); ++iter) {
+      if (*iter < 0)
+        return -1;
+      max_value = std::max(max_value, *iter);
+    }
+    node.size = max_value + 1;
+    node.offset = bits_.size();
+    bits_.resize(bits_.size() + (node.size + 31) / 32, 0);
+    for (ConstIntegerSet<EventValueType>::iterator iter = s->yes_set_.begin();
+         iter != s->yes_set_.end(); ++iter)
+      bits_[node.offset + (*iter >> 5)] |= (1u << (*iter & 31));
+    node.yes = AddNode(*(s->yes_));
+    if (node.yes == -1)
+      return -1;
+    node.no = AddNode(*(s->no_));
+    if (node.no == -1)
+      return -1;
+  } else {
+    return -1;
+  }
+  nodes_[index] = node;
+  return index;
+}
+
+void CompiledEventMap::MapBatch(const EventValueType *values,
+                                int32 num_events,
+                                EventAnswerType *ans) const {
+  KALDI_ASSERT(!IsEmpty());
+  for (int32 n = 0; n < num_events; n++)
+    Map(values + n * num_keys_, ans + n);
+}
+
 } // end namespace kaldi
@@ -199,6 +199,7 @@ class ConstantEventMap: public EventMap {
   virtual void Write(std::ostream &os, bool binary);
   static ConstantEventMap *Read(std::istream &is, bool binary);
  private:
+  friend class CompiledEventMap;
   EventAnswerType answer_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(ConstantEventMap);
 };
@@ -258,6 +259,7 @@ class TableEventMap: public EventMap {
     DeletePointers(&table_);
   }
  private:
+  friend class CompiledEventMap;
   EventKeyType key_;
   std::vector<EventMap*> table_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(TableEventMap);
@@ -332,6 +334,7 @@ class SplitEventMap: public EventMap {  // A decision tree [non-leaf] node.
   void Destroy() {
     delete yes_; delete no_;
   }
+  friend class CompiledEventMap;
   EventKeyType key_;
   //  std::vector<EventValueType> yes_set_;
   ConstIntegerSet<EventValueType> yes_set_;  // more efficient Map function.
@@ -358,6 +361,96 @@ bool GetTreeStructure(const EventMap &map,
                       std::vector<int32> *parents);
 
 
+/**
+   CompiledEventMap is a read-only copy of an EventMap made of
+   ConstantEventMap, TableEventMap and SplitEventMap nodes, stored in flat
+   arrays, for fast lookup (this is what ContextDependency::Compute() uses).
+   Instead of an EventType, the event is given as an array of values indexed
+   by key, which means that all the keys in a range [min_key, min_key +
+   num_keys) must be present in the events looked up; this is true for the
+   events ContextDependency creates.  The "yes" sets of the SplitEventMap
+   nodes are stored as bitmaps, so lookups do no allocation and little
+   branching.
+*/
+class CompiledEventMap {
+ public:
+  CompiledEventMap(): min_key_(0), num_keys_(0) { }
+
+  /// Compiles 'map'.  Returns false (and leaves this object empty) if the map
+  /// cannot be compiled, i.e. if it uses a key outside the range
+  /// [min_key, min_key + num_keys), a negative value in a "yes" set, or a
+  /// type of EventMap other than those in this file.
+  bool Init(const EventMap &map, EventKeyType min_key, int32 num_keys);
+
+  bool IsEmpty() const { return nodes_.empty(); }
+
+  int32 NumKeys() const { return num_keys_; }
+
+  /// Does the same as EventMap::Map() would do for the event with key
+  /// min_key + i having value values[i], for 0 <= i < NumKeys().
+  inline bool Map(const EventValueType *values, EventAnswerType *ans) const;
+
+  /// Does Map() for 'num_events' events, where the values of event n are
+  /// values[n * NumKeys()] ... values[n * NumKeys() + NumKeys() - 1].  The
+  /// answers are put in ans[n], with -1 for events that have no answer.
+  void MapBatch(const EventValueType *values, int32 num_events,
+                EventAnswerType *ans) const;
+
+ private:
+  enum NodeType { kConstant = 0, kTable = 1, kSplit = 2 };
+  // For kConstant nodes only 'offset' is used: it is the answer.  For kTable
+  // nodes, the children of values 0 ... size - 1 are table_[offset] ...
+  // table_[offset + size - 1] (-1 for no child).  For kSplit nodes, value v
+  // is in the "yes" set if 0 <= v < size and bit v of the bitmap starting at
+  // bits_[offset] is set.
+  struct Node {
+    int32 type;
+    int32 key;  // Index into the values, i.e. key minus min_key_.
+    int32 offset;
+    int32 size;
+    int32 yes;
+    int32 no;
+  };
+
+  // Adds the nodes of 'map' and returns the index of its root, or -1 if it
+  // cannot be compiled.
+  int32 AddNode(const EventMap &map);
+
+  EventKeyType min_key_;
+  int32 num_keys_;
+  std::vector<Node> nodes_;  // The root is nodes_[0].
+  std::vector<int32> table_;
+  std::vector<uint32> bits_;
+};
+
+inline bool CompiledEventMap::Map(const EventValueType *values,
+                                  EventAnswerType *ans) const {
+  const Node *nodes = &(nodes_[0]);
+  int32 n = 0;
+  while (true) {
+    const Node &node = nodes[n];
+    if (node.type == kConstant) {
+      *ans = node.offset;
+      return true;
+    }
+    EventValueType value = values[node.key];
+    bool in_range = (static_cast<uint32>(value) <
+                     static_cast<uint32>(node.size));
+    if (node.type == kSplit) {
+      bool yes = in_range &&
+          ((bits_[node.offset + (value >> 5)] >> (value & 31)) & 1);
+      n = (yes ? node.yes : node.no);
+    } else {
+      n = (in_range ? table_[node.offset + value] : -1);
+      if (n == -1) {
+        *ans = -1;
+        return false;
+      }
+    }
+  }
+}
+
+
 /// @} end "addtogroup event_map_group"
 
 }
@@ -20,6 +20,8 @@
 #ifndef KALDI_UTIL_EDIT_DISTANCE_INL_H_
 #define KALDI_UTIL_EDIT_DISTANCE_INL_H_
 #include <algorithm>
+#include <cstdlib>
+#include <limits>
 #include <utility>
 #include <vector>
 #include "util/stl-utils.h"
@@ -76,54 +78,96 @@ struct error_stats {
 // the following implementation.
 
 template<class T>
-int32 LevenshteinEditDistance(const std::vector<T> &ref,
-                              const std::vector<T> &hyp,
-                              int32 *ins, int32 *del, int32 *sub) {
+int32 LevenshteinEditDistanceBanded(const std::vector<T> &ref,
+                                    const std::vector<T> &hyp,
+                                    int32 band,
+                                    int32 *ins, int32 *del, int32 *sub) {
+  // Cells with |hyp_index - ref_index| > band are treated as unreachable by
+  // giving them this cost; it is small enough that adding one won't overflow.
+  const int32 kUnreachable = std::numeric_limits<int32>::max() / 2;
+  int32 ref_size = ref.size(), hyp_size = hyp.size();
+  KALDI_ASSERT(band >= 0);
+  if (std::abs(ref_size - hyp_size) > band)
+    return band + 1;  // the final cell is outside the band.
   // temp sequence to remember error type and stats.
-  std::vector<error_stats> e(ref.size()+1);
-  std::vector<error_stats> cur_e(ref.size()+1);
+  std::vector<error_stats> e(ref_size + 1);
+  std::vector<error_stats> cur_e(ref_size + 1);
   // initialize the first hypothesis aligned to the reference at each
   // position:[hyp_index =0][ref_index]
-  for (size_t i =0; i < e.size(); i ++) {
+  for (int32 i = 0; i <= ref_size; i++) {
     e[i].ins_num = 0;
     e[i].sub_num = 0;
     e[i].del_num = i;
-    e[i].total_cost = i;
+    e[i].total_cost = (i <= band ? i : kUnreachable);
   }
 
   // for other alignments
-  for (size_t hyp_index = 1; hyp_index <= hyp.size(); hyp_index ++) {
-    cur_e[0] = e[0];
-    cur_e[0].ins_num++;
-    cur_e[0].total_cost++;
-    for (size_t ref_index = 1; ref_index <= ref.size(); ref_index ++) {
-     int32 ins_err = e[ref_index].total_cost + 1;
-     int32 del_err = cur_e[ref_index-1].total_cost + 1;
-     int32 sub_err = e[ref_index-1].total_cost;
+  for (int32 hyp_index = 1; hyp_index <= hyp_size; hyp_index++) {
+    int32 begin = std::max(hyp_index - band, 1),
+        end = std::min(hyp_index + band, ref_size);
+    if (hyp_index <= band) {
+      cur_e[0] = e[0];
+      cur_e[0].ins_num++;
+      cur_e[0].total_cost++;
+    } else {
+      cur_e[begin - 1].total_cost = kUnreachable;
+    }
+    for (int32 ref_index = begin; ref_index <= end; ref_index++) {
+      int32 ins_err = e[ref_index].total_cost + 1;
+      int32 del_err = cur_e[ref_index-1].total_cost + 1;
+      int32 sub_err = e[ref_index-1].total_cost;
       if (hyp[hyp_index-1] != ref[ref_index-1])
-       sub_err++;
+        sub_err++;
 
-     if (sub_err < ins_err && sub_err < del_err) {
-        cur_e[ref_index] =e[ref_index-1];
+      if (sub_err < ins_err && sub_err < del_err) {
+        cur_e[ref_index] = e[ref_index-1];
         if (hyp[hyp_index-1] != ref[ref_index-1])
           cur_e[ref_index].sub_num++;  // substitution error should be increased
         cur_e[ref_index].total_cost = sub_err;
-     } else if (del_err < ins_err) {
+      } else if (del_err < ins_err) {
         cur_e[ref_index] = cur_e[ref_index-1];
         cur_e[ref_index].total_cost = del_err;
         cur_e[ref_index].del_num++;    // deletion number is increased.
-     } else {
+      } else {
         cur_e[ref_index] = e[ref_index];
         cur_e[ref_index].total_cost = ins_err;
         cur_e[ref_index].ins_num++;    // insertion number is increased.
-     }
+      }
+    }
+    // The cell just right of the band is out of the next row's band too.
+    if (end < ref_size)
+      cur_e[end + 1].total_cost = kUnreachable;
+    std::swap(e, cur_e);  // alternate for the next recursion.
   }
-  e = cur_e;  // alternate for the next recursion.
+  const error_stats &final = e[ref_size];
+  if (final.total_cost > band)
+    return std::min(final.total_cost, band + 1);
+  *ins = final.ins_num;
+  *del = final.del_num;
+  *sub = final.sub_num;
+  return final.total_cost;
+}
+
+template<class T>
+int32 LevenshteinEditDistance(const std::vector<T> &ref,
+                              const std::vector<T> &hyp,
+                              int32 *ins, int32 *del, int32 *sub) {
+  // We start with a narrow band and double it until the edit distance fits
+  // in it; this takes time O((|ref| + |hyp|) * distance), which for long,
+  // similar sequences is much less than O(|ref| * |hyp|).  Any alignment that
+  // leaves a band of width k costs more than k, so the result (including the
+  // ins/del/sub counts) is the same as with the full table.
+  int32 ref_size = ref.size(), hyp_size = hyp.size(),
+      max_size = std::max(ref_size, hyp_size),
+      band = std::max(std::abs(ref_size - hyp_size), 16);
+  while (true) {
+    if (band >= max_size)
+      band = max_size;  // the whole table.
+    int32 cost = LevenshteinEditDistanceBanded(ref, hyp, band, ins, del, sub);
+    if (cost <= band)
+      return cost;
+    band *= 2;
   }
-  size_t ref_index = e.size()-1;
-  *ins = e[ref_index].ins_num, *del =
-    e[ref_index].del_num, *sub = e[ref_index].sub_num;
-  return e[ref_index].total_cost;
 }
 
 template<class T>
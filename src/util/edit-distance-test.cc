@@ -228,6 +228,37 @@ void TestEditDistance2String() {
 }
 
 
+// Tests the banded edit distance on long sequences with few errors, against
+// the full table.
+void TestEditDistanceBanded() {
+  for (int32 i = 0; i < 20; i++) {
+    std::vector<int32> ref, hyp;
+    int32 ref_size = Rand() % 2000;
+    for (int32 j = 0; j < ref_size; j++)
+      ref.push_back(Rand() % 10);
+    for (int32 j = 0; j < ref_size; j++) {
+      int32 r = Rand() % 100;
+      if (r == 0) continue;  // deletion
+      if (r == 1) hyp.push_back(Rand() % 10);  // insertion
+      hyp.push_back(r == 2 ? Rand() % 10 : ref[j]);  // maybe substitution
+    }
+    int32 ins, del, sub, full_ins, full_del, full_sub,
+        max_size = std::max(ref.size(), hyp.size());
+    int32 cost = LevenshteinEditDistance(ref, hyp, &ins, &del, &sub),
+        full_cost = LevenshteinEditDistanceBanded(ref, hyp, max_size,
+                                                  &full_ins, &full_del,
+                                                  &full_sub);
+    KALDI_ASSERT(cost == full_cost && cost == LevenshteinEditDistance(ref, hyp));
+    KALDI_ASSERT(ins == full_ins && del == full_del && sub == full_sub);
+    KALDI_ASSERT(ins + del + sub == cost);
+    if (cost > 0) {
+      int32 tmp;
+      KALDI_ASSERT(LevenshteinEditDistanceBanded(ref, hyp, cost - 1, &tmp,
+                                                 &tmp, &tmp) == cost);
+    }
+  }
+}
+
 void TestLevenshteinAlignment() {
   for (size_t i = 0; i < 100; i++) {
     size_t a_sz = Rand() % 5, b_sz = Rand() % 5;
@@ -257,6 +288,7 @@ int main() {
   using namespace kaldi;
   TestEditDistance();
   TestEditDistanceString();
+  TestEditDistanceBanded();
   TestEditDistance2();
   TestEditDistance2String();
   TestLevenshteinAlignment();
@@ -46,6 +46,18 @@ int32 LevenshteinEditDistance(const std::vector<T> &ref,
                               const std::vector<T> &hyp,
                               int32 *ins, int32 *del, int32 *sub);
 
+// This version only considers alignments that stay within "band" positions of
+// the diagonal (|hyp_index - ref_index| <= band), which takes time
+// O((|ref| + |hyp|) * band).  If the edit distance is at most "band" it is
+// returned, with the same ins/del/sub counts as above; otherwise it returns
+// band + 1 and does not set them.  The function above calls this with a band
+// that it doubles as needed, so you won't normally need to call it yourself.
+template<class T>
+int32 LevenshteinEditDistanceBanded(const std::vector<T> &ref,
+                                    const std::vector<T> &hyp,
+                                    int32 band,
+                                    int32 *ins, int32 *del, int32 *sub);
+
 // This version of the edit-distance computation outputs the alignment
 // between the two.  This is a vector of pairs of (symbol a, symbol b).
 // The epsilon symbol (eps_symbol) must not occur in sequences a or b.
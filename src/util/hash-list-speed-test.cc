@@ -0,0 +1,95 @@
+// util/hash-list-speed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/hash-list.h"
+#include "util/open-hash-list.h"
+
+namespace kaldi {
+
+// Simulates the way the decoders use the hash: on each frame, the tokens of
+// the previous frame are taken from the hash with Clear(), and for each of
+// them we look up a few successor states with Insert() (like FindOrAddToken()
+// does) and then a few more with Find(), before deleting the Elem.  The states
+// are drawn from a large graph, so the tokens are scattered in memory the way
+// they are in a real decoder.  Prints the number of millions of
+// Find()/Insert() calls per second.
+template<template<class, class> class HashType>
+static void HashListSpeed(const std::string &name, int32 num_active,
+                          int32 num_states) {
+  typedef typename HashType<int32, int32>::Elem Elem;
+  int32 arcs_per_token = 4, finds_per_token = 2;
+  // Precompute the random successor states so the timing is of the hash.
+  std::vector<int32> successors(1 << 20);
+  for (size_t i = 0; i < successors.size(); i++)
+    successors[i] = RandInt(0, num_states - 1);
+  size_t mask = successors.size() - 1, pos = 0;
+
+  HashType<int32, int32> hash;
+  // Each frame has up to num_active * arcs_per_token tokens; like the
+  // decoders, we make the hash twice that size.
+  hash.SetSize(num_active * arcs_per_token * 2);
+  for (int32 i = 0; i < num_active; i++)
+    hash.Insert(successors[pos++ & mask], 0);
+
+  double time_in_secs = 0.2;
+  int64 num_ops = 0;
+  Timer t;
+  while (t.Elapsed() < time_in_secs) {
+    for (int32 frame = 0; frame < 10; frame++) {
+      Elem *list = hash.Clear(), *tmp;
+      int32 num_toks = 0;
+      for (Elem *e = list; e != NULL; e = tmp, num_toks++) {
+        if (num_toks < num_active) {
+          for (int32 a = 0; a < arcs_per_token; a++)
+            hash.Insert(successors[pos++ & mask], e->val + 1)->val++;
+          for (int32 f = 0; f < finds_per_token; f++) {
+            Elem *found = hash.Find(successors[pos++ & mask]);
+            if (found != NULL) found->val++;
+          }
+          num_ops += arcs_per_token + finds_per_token;
+        }
+        tmp = e->tail;
+        hash.Delete(e);
+      }
+    }
+  }
+  std::cout << name << ", num-active = " << num_active << ", num-states = "
+            << num_states << ": " << (num_ops / (t.Elapsed() * 1.0e+06))
+            << " Mops/sec\n";
+  Elem *list = hash.Clear(), *tmp;
+  for (Elem *e = list; e != NULL; e = tmp) {
+    tmp = e->tail;
+    hash.Delete(e);
+  }
+}
+
+}  // end namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  int32 num_active[] = { 1000, 7000, 50000 };
+  for (int32 i = 0; i < 3; i++) {
+    HashListSpeed<HashList>("HashList", num_active[i], 5000000);
+    HashListSpeed<OpenHashList>("OpenHashList", num_active[i], 5000000);
+  }
+  std::cout << "Test OK.\n";
+}
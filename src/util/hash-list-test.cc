@@ -20,16 +20,19 @@
 
 
 #include "util/hash-list.h"
+#include "util/open-hash-list.h"
 #include <map>  // for baseline.
 #include <cstdlib>
 #include <iostream>
 
 namespace kaldi {
 
-template<class Int, class T> void TestHashList() {
-  typedef typename HashList<Int, T>::Elem Elem;
+// HashType is HashList or OpenHashList.
+template<template<class, class> class HashType, class Int, class T>
+void TestHashList() {
+  typedef typename HashType<Int, T>::Elem Elem;
 
-  HashList<Int, T> hash;
+  HashType<Int, T> hash;
   hash.SetSize(200);  // must be called before use.
   std::map<Int, T> m1;
   for (size_t j = 0; j < 50; j++) {
@@ -84,6 +87,53 @@ template<class Int, class T> void TestHashList() {
 
     KALDI_ASSERT(m1.size() == count);
   }
+  Elem *h = hash.Clear(), *tmp;
+  for (; h != NULL; h = tmp) {
+    tmp = h->tail;
+    hash.Delete(h);
+  }
+}
+
+// Tests InsertMore(): elements with the same key must follow each other in
+// the list, and Find() must return the first of them.
+template<template<class, class> class HashType>
+void TestHashListInsertMore() {
+  typedef typename HashType<int32, int32>::Elem Elem;
+  HashType<int32, int32> hash;
+  hash.SetSize(50);
+  std::map<int32, std::vector<int32> > m;
+  for (int32 i = 0; i < 200; i++) {
+    int32 key = Rand() % 100, val = Rand() % 1000;
+    if (hash.Find(key) == NULL)
+      hash.Insert(key, val);
+    else
+      hash.InsertMore(key, val);
+    m[key].push_back(val);
+  }
+  for (std::map<int32, std::vector<int32> >::iterator iter = m.begin();
+       iter != m.end(); ++iter) {
+    const Elem *e = hash.Find(iter->first);
+    KALDI_ASSERT(e != NULL);
+    // The first value inserted is found first; the others follow, in some
+    // order.
+    KALDI_ASSERT(e->val == iter->second[0]);
+    std::vector<int32> vals;
+    for (; e != NULL && e->key == iter->first; e = e->tail)
+      vals.push_back(e->val);
+    std::vector<int32> ref_vals(iter->second);
+    std::sort(vals.begin(), vals.end());
+    std::sort(ref_vals.begin(), ref_vals.end());
+    KALDI_ASSERT(vals == ref_vals);
+  }
+  size_t count = 0;
+  for (const Elem *e = hash.GetList(); e != NULL; e = e->tail)
+    count++;
+  KALDI_ASSERT(count == 200);
+  Elem *h = hash.Clear(), *tmp;
+  for (; h != NULL; h = tmp) {
+    tmp = h->tail;
+    hash.Delete(h);
+  }
 }
 
 
@@ -96,12 +146,20 @@ template<class Int, class T> void TestHashList() {
 int main() {
   using namespace kaldi;
   for (size_t i = 0;i < 3;i++) {
-    TestHashList<int, unsigned int>();
-    TestHashList<unsigned int, int>();
-    TestHashList<int16, int32>();
-    TestHashList<int16, int32>();
-    TestHashList<char, unsigned char>();
-    TestHashList<unsigned char, int>();
+    TestHashList<HashList, int, unsigned int>();
+    TestHashList<HashList, unsigned int, int>();
+    TestHashList<HashList, int16, int32>();
+    TestHashList<HashList, int16, int32>();
+    TestHashList<HashList, char, unsigned char>();
+    TestHashList<HashList, unsigned char, int>();
+    TestHashList<OpenHashList, int, unsigned int>();
+    TestHashList<OpenHashList, unsigned int, int>();
+    TestHashList<OpenHashList, int16, int32>();
+    TestHashList<OpenHashList, uint64, int32>();
+    TestHashList<OpenHashList, char, unsigned char>();
+    TestHashList<OpenHashList, unsigned char, int>();
+    TestHashListInsertMore<HashList>();
+    TestHashListInsertMore<OpenHashList>();
   }
   std::cout << "Test OK.\n";
 }
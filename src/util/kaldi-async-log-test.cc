@@ -0,0 +1,129 @@
+// util/kaldi-async-log-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <mutex>
+#include <thread>
+
+#include "util/kaldi-async-log.h"
+
+namespace kaldi {
+
+static std::mutex g_mutex;
+static std::vector<std::pair<int, std::string> > g_messages;
+
+// Stands in for stderr; the asynchronous handler passes the messages on to the
+// handler that was installed before it.
+void RecordingHandler(const LogMessageEnvelope &envelope, const char *message) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  g_messages.push_back(std::make_pair(envelope.severity,
+                                      std::string(message)));
+}
+
+void LogFromThread(int32 thread, int32 num_messages) {
+  for (int32 i = 0; i < num_messages; i++)
+    KALDI_VLOG(1) << thread << " " << i;
+}
+
+void TestAsyncLogOrder() {
+  g_messages.clear();
+  SetLogHandler(RecordingHandler);
+  AsyncLogOptions opts;
+  opts.queue_size = 16;  // small, so that the loggers have to wait.
+  StartAsyncLogging(opts);
+  KALDI_ASSERT(AsyncLoggingActive());
+  int32 num_threads = 4, num_messages = 1000;
+  std::vector<std::thread> threads;
+  for (int32 t = 0; t < num_threads; t++)
+    threads.push_back(std::thread(LogFromThread, t, num_messages));
+  for (int32 t = 0; t < num_threads; t++)
+    threads[t].join();
+  try {
+    KALDI_ERR << "error";
+  } catch (const KaldiFatalError &e) {
+    // The error is written after all the messages before it.
+    KALDI_ASSERT(g_messages.size() == num_threads * num_messages + 1 &&
+                 g_messages.back().second == "error");
+  }
+  StopAsyncLogging();
+  KALDI_ASSERT(!AsyncLoggingActive());
+  KALDI_ASSERT(SetLogHandler(NULL) == RecordingHandler);
+
+  // Each thread's messages are in order.
+  std::vector<int32> next(num_threads, 0);
+  for (size_t i = 0; i + 1 < g_messages.size(); i++) {
+    std::istringstream is(g_messages[i].second);
+    int32 t, n;
+    is >> t >> n;
+    KALDI_ASSERT(t >= 0 && t < num_threads && n == next[t]);
+    next[t]++;
+  }
+}
+
+void TestAsyncLogRateLimit() {
+  g_messages.clear();
+  SetLogHandler(RecordingHandler);
+  AsyncLogOptions opts;
+  opts.rate_limit = 10;
+  StartAsyncLogging(opts);
+  for (int32 i = 0; i < 100; i++)
+    KALDI_VLOG(1) << "limited";
+  for (int32 i = 0; i < 20; i++)
+    KALDI_WARN << "warning";
+  StopAsyncLogging();
+  SetLogHandler(NULL);
+  int32 num_limited = 0, num_warnings = 0, num_reports = 0;
+  for (size_t i = 0; i < g_messages.size(); i++) {
+    if (g_messages[i].second == "limited") num_limited++;
+    else if (g_messages[i].second == "warning") num_warnings++;
+    else if (g_messages[i].second.find("90 more messages") !=
+             std::string::npos) num_reports++;
+  }
+  // This loop takes much less than a second, so the rate limit applies.
+  KALDI_ASSERT(num_limited == 10 && num_warnings == 20 && num_reports == 1);
+}
+
+// Stops asynchronous logging while other threads are logging; no message may
+// be lost.
+void TestAsyncLogStopWhileLogging() {
+  g_messages.clear();
+  SetLogHandler(RecordingHandler);
+  AsyncLogOptions opts;
+  opts.queue_size = 16;
+  StartAsyncLogging(opts);
+  int32 num_threads = 4, num_messages = 2000;
+  std::vector<std::thread> threads;
+  for (int32 t = 0; t < num_threads; t++)
+    threads.push_back(std::thread(LogFromThread, t, num_messages));
+  FlushAsyncLog();
+  StopAsyncLogging();
+  for (int32 t = 0; t < num_threads; t++)
+    threads[t].join();
+  KALDI_ASSERT(SetLogHandler(NULL) == RecordingHandler);
+  KALDI_ASSERT(g_messages.size() == num_threads * num_messages);
+}
+
+}  // namespace kaldi
+
+int main() {
+  kaldi::SetVerboseLevel(1);
+  kaldi::TestAsyncLogOrder();
+  kaldi::TestAsyncLogRateLimit();
+  for (int32 i = 0; i < 10; i++)
+    kaldi::TestAsyncLogStopWhileLogging();
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -0,0 +1,343 @@
+// util/kaldi-async-log.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "util/kaldi-async-log.h"
+
+namespace kaldi {
+
+namespace {
+
+// The queue is a bounded multi-producer, single-consumer ring buffer.  Each
+// slot has a sequence number: a producer may fill the slot for position 'pos'
+// when its sequence number equals 'pos', and sets it to pos + 1 when it has
+// written the message; the writer thread may then take the message, and sets
+// the sequence number to pos + capacity, which hands the slot to the
+// producer of the next round.  Producers claim positions with a
+// compare-and-swap on enqueue_pos_, so no lock is taken.
+class AsyncLogSink {
+ public:
+  AsyncLogSink(const AsyncLogOptions &opts, LogHandler previous_handler);
+
+  // Called by the threads that log.
+  void Enqueue(const LogMessageEnvelope &envelope, const char *message);
+
+  // Waits until everything enqueued before the call has been written.
+  void Flush();
+
+  // Flushes, and stops the writer thread.
+  void Stop();
+
+  // Writes a message synchronously, the way the writer thread would.
+  void Write(const LogMessageEnvelope &envelope, const char *message) {
+    WriteSynchronously(previous_handler_, envelope, message);
+  }
+
+  LogHandler PreviousHandler() const { return previous_handler_; }
+
+  // Passes the message to 'handler', or writes it to stderr if that is NULL.
+  static void WriteSynchronously(LogHandler handler,
+                                 const LogMessageEnvelope &envelope,
+                                 const char *message);
+
+ private:
+  struct Slot {
+    std::atomic<uint64> seq;
+    LogMessageEnvelope envelope;
+    std::string message;
+  };
+
+  // Rate-limiting state of one logging statement.
+  struct SiteState {
+    double window_start;
+    int32 count;       // messages written in the current window.
+    int32 suppressed;  // messages dropped since the last report.
+    LogMessageEnvelope envelope;
+    SiteState(): window_start(-1.0), count(0), suppressed(0) { }
+  };
+
+  void WriterThread();
+
+  // Returns true if the message should be written, and may append a report
+  // of the messages suppressed from the same statement to 'out'.
+  bool RateLimit(const LogMessageEnvelope &envelope, std::string *out);
+
+  void ReportSuppressed(const SiteState &site, std::string *out);
+
+  // Writes the text accumulated by the writer thread to stderr.
+  static void WriteText(const std::string &text);
+
+  LogHandler previous_handler_;
+  int32 rate_limit_;
+  std::vector<Slot> slots_;
+  uint64 mask_;
+
+  std::atomic<uint64> enqueue_pos_;
+  uint64 dequeue_pos_;  // only accessed by the writer thread.
+  std::atomic<uint64> written_pos_;  // positions before this have been written.
+
+  std::map<std::pair<const char*, int32>, SiteState> sites_;
+  std::chrono::steady_clock::time_point start_time_;
+
+  std::mutex mutex_;  // only used to wait on the condition variables.
+  std::condition_variable cond_;  // wakes up the writer thread.
+  std::condition_variable written_cond_;  // signaled when written_pos_ grows.
+  std::atomic<bool> stop_;
+  std::thread thread_;
+};
+
+AsyncLogSink::AsyncLogSink(const AsyncLogOptions &opts,
+                           LogHandler previous_handler):
+    previous_handler_(previous_handler), rate_limit_(opts.rate_limit),
+    enqueue_pos_(0), dequeue_pos_(0), written_pos_(0),
+    start_time_(std::chrono::steady_clock::now()), stop_(false) {
+  KALDI_ASSERT(opts.queue_size > 0);
+  uint64 capacity = 1;
+  while (capacity < static_cast<uint64>(opts.queue_size))
+    capacity *= 2;
+  std::vector<Slot> slots(capacity);
+  slots_.swap(slots);
+  for (uint64 i = 0; i < capacity; i++)
+    slots_[i].seq.store(i, std::memory_order_relaxed);
+  mask_ = capacity - 1;
+  thread_ = std::thread(&AsyncLogSink::WriterThread, this);
+}
+
+void AsyncLogSink::Enqueue(const LogMessageEnvelope &envelope,
+                           const char *message) {
+  uint64 pos = enqueue_pos_.load(std::memory_order_relaxed);
+  Slot *slot;
+  while (true) {
+    slot = &(slots_[pos & mask_]);
+    uint64 seq = slot->seq.load(std::memory_order_acquire);
+    int64 diff = static_cast<int64>(seq) - static_cast<int64>(pos);
+    if (diff == 0) {
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      // The queue is full: wait for the writer thread.
+      cond_.notify_one();
+      std::this_thread::yield();
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+    } else {
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+  slot->envelope = envelope;
+  slot->message.assign(message);
+  slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+void AsyncLogSink::Flush() {
+  uint64 target = enqueue_pos_.load(std::memory_order_acquire);
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.notify_one();
+  while (written_pos_.load(std::memory_order_acquire) < target)
+    written_cond_.wait(lock);
+}
+
+void AsyncLogSink::Stop() {
+  Flush();
+  stop_ = true;
+  cond_.notify_one();
+  thread_.join();
+  std::string text;
+  for (std::map<std::pair<const char*, int32>, SiteState>::const_iterator
+           iter = sites_.begin(); iter != sites_.end(); ++iter)
+    if (iter->second.suppressed > 0)
+      ReportSuppressed(iter->second, &text);
+  if (previous_handler_ == NULL)
+    WriteText(text);
+}
+
+void AsyncLogSink::WriteSynchronously(LogHandler handler,
+                                      const LogMessageEnvelope &envelope,
+                                      const char *message) {
+  if (handler != NULL)
+    handler(envelope, message);
+  else
+    WriteText(FormatLogMessage(envelope, message));
+}
+
+void AsyncLogSink::WriteText(const std::string &text) {
+  if (!text.empty()) {
+    std::cerr.write(text.data(), text.size());
+    std::cerr.flush();
+  }
+}
+
+void AsyncLogSink::ReportSuppressed(const SiteState &site, std::string *out) {
+  std::ostringstream os;
+  os << "[" << site.suppressed << " more messages from this statement were "
+     << "not logged because of --log-rate-limit]";
+  if (previous_handler_ != NULL)
+    previous_handler_(site.envelope, os.str().c_str());
+  else
+    out->append(FormatLogMessage(site.envelope, os.str().c_str()));
+}
+
+bool AsyncLogSink::RateLimit(const LogMessageEnvelope &envelope,
+                             std::string *out) {
+  if (rate_limit_ <= 0 || envelope.severity < LogMessageEnvelope::kInfo)
+    return true;
+  // The file names are string literals, so their addresses identify them.
+  SiteState &site = sites_[std::make_pair(envelope.file, envelope.line)];
+  double now = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time_).count();
+  if (now - site.window_start >= 1.0) {
+    if (site.suppressed > 0)
+      ReportSuppressed(site, out);
+    site.window_start = now;
+    site.count = 0;
+    site.suppressed = 0;
+  }
+  if (site.count < rate_limit_) {
+    site.count++;
+    return true;
+  } else {
+    site.envelope = envelope;
+    site.suppressed++;
+    return false;
+  }
+}
+
+void AsyncLogSink::WriterThread() {
+  std::string text;
+  while (true) {
+    // Take all the messages that are ready, and write them in one go.
+    text.clear();
+    uint64 pos = dequeue_pos_;
+    while (true) {
+      Slot &slot = slots_[pos & mask_];
+      if (slot.seq.load(std::memory_order_acquire) != pos + 1)
+        break;
+      if (RateLimit(slot.envelope, &text)) {
+        if (previous_handler_ != NULL)
+          previous_handler_(slot.envelope, slot.message.c_str());
+        else
+          text.append(FormatLogMessage(slot.envelope, slot.message.c_str()));
+      }
+      slot.seq.store(pos + mask_ + 1, std::memory_order_release);
+      pos++;
+    }
+    WriteText(text);
+    if (pos != dequeue_pos_) {
+      dequeue_pos_ = pos;
+      {
+        // Taking the lock ensures that a thread in Flush() is either
+        // waiting, or has not yet checked written_pos_.
+        std::lock_guard<std::mutex> lock(mutex_);
+        written_pos_.store(pos, std::memory_order_release);
+      }
+      written_cond_.notify_all();
+      continue;
+    }
+    if (stop_)
+      break;
+    // The loggers don't notify us, to keep them free of locks, so we poll.
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait_for(lock, std::chrono::milliseconds(5));
+  }
+}
+
+std::atomic<AsyncLogSink*> g_async_log_sink(NULL);
+// The handler that was installed before StartAsyncLogging().
+std::atomic<LogHandler> g_previous_log_handler(NULL);
+// The number of threads inside AsyncLogHandler(); StopAsyncLogging() waits for
+// it to reach zero before deleting the sink.
+std::atomic<int32> g_num_async_log_callers(0);
+
+// Counts the thread as inside AsyncLogHandler() for its lifetime.
+class AsyncLogCaller {
+ public:
+  AsyncLogCaller() { g_num_async_log_callers.fetch_add(1); }
+  ~AsyncLogCaller() { g_num_async_log_callers.fetch_sub(1); }
+};
+
+void AsyncLogHandler(const LogMessageEnvelope &envelope, const char *message) {
+  AsyncLogCaller caller;
+  AsyncLogSink *sink = g_async_log_sink.load();
+  if (sink == NULL) {
+    // StopAsyncLogging() is running; the messages already queued will still
+    // be written, possibly after this one.
+    AsyncLogSink::WriteSynchronously(g_previous_log_handler.load(), envelope,
+                                     message);
+  } else if (envelope.severity < LogMessageEnvelope::kWarning) {
+    // Errors and failed assertions are written synchronously, after the
+    // messages before them.
+    sink->Flush();
+    sink->Write(envelope, message);
+  } else {
+    sink->Enqueue(envelope, message);
+  }
+}
+
+}  // namespace
+
+void StartAsyncLogging(const AsyncLogOptions &opts) {
+  if (g_async_log_sink.load() != NULL)
+    StopAsyncLogging();
+  static bool registered_at_exit = false;
+  if (!registered_at_exit) {
+    std::atexit(StopAsyncLogging);
+    registered_at_exit = true;
+  }
+  LogHandler previous_handler = SetLogHandler(NULL);
+  g_previous_log_handler.store(previous_handler);
+  g_async_log_sink.store(new AsyncLogSink(opts, previous_handler));
+  SetLogHandler(AsyncLogHandler);
+}
+
+void StopAsyncLogging() {
+  AsyncLogSink *sink = g_async_log_sink.load();
+  if (sink == NULL)
+    return;
+  // New messages go straight to the previous handler, and those from threads
+  // that are already in AsyncLogHandler() but have not yet loaded the sink
+  // are written synchronously.
+  SetLogHandler(sink->PreviousHandler());
+  g_async_log_sink.store(NULL);
+  // Wait for the threads that did load it, which may be waiting for space in
+  // the queue; the writer thread is still running, so they will finish.
+  while (g_num_async_log_callers.load() != 0)
+    std::this_thread::yield();
+  sink->Stop();
+  delete sink;
+}
+
+void FlushAsyncLog() {
+  // Calling this concurrently with StopAsyncLogging() is not supported.
+  AsyncLogSink *sink = g_async_log_sink.load();
+  if (sink != NULL)
+    sink->Flush();
+}
+
+bool AsyncLoggingActive() {
+  return (g_async_log_sink.load() != NULL);
+}
+
+}  // namespace kaldi
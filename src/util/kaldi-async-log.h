@@ -0,0 +1,71 @@
+// util/kaldi-async-log.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_KALDI_ASYNC_LOG_H_
+#define KALDI_UTIL_KALDI_ASYNC_LOG_H_
+
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/**
+   This file provides an asynchronous log handler.  With it, KALDI_LOG,
+   KALDI_VLOG and KALDI_WARN only put the message into a lock-free queue, and
+   a background thread formats it and writes it to stderr (or passes it to the
+   log handler that was installed before, if any).  This takes the cost of
+   writing, and the contention on stderr, out of the threads doing the work,
+   which matters for e.g. the decoders at --verbose=2.
+
+   KALDI_ERR and failed KALDI_ASSERTs are still logged synchronously, after the
+   queued messages have been written, so that the error is the last thing
+   printed before the exception is thrown or the program aborts.
+
+   Command-line programs enable this with the standard options --async-log
+   and --log-rate-limit (see ParseOptions).
+*/
+
+struct AsyncLogOptions {
+  int32 queue_size;  // Number of messages the queue can hold; rounded up to a
+                     // power of two.  Loggers wait while the queue is full.
+  int32 rate_limit;  // If >0, at most this many messages per second are
+                     // written from any one KALDI_LOG or KALDI_VLOG
+                     // statement; the rest are counted and reported.
+                     // Warnings are never dropped.
+  AsyncLogOptions(): queue_size(4096), rate_limit(0) { }
+};
+
+/// Installs the asynchronous log handler (using SetLogHandler()) and starts
+/// its writer thread.  Like SetLogHandler(), this is not thread safe; call it
+/// at the start of the program.  Logging is stopped automatically at exit.
+void StartAsyncLogging(const AsyncLogOptions &opts);
+
+/// Reinstates the previous log handler, waits until the messages logged so far
+/// have been written, then stops the writer thread.  Other threads may still be
+/// logging (this is also called at exit); their messages are then written
+/// synchronously.  Does nothing if asynchronous logging is not running.
+void StopAsyncLogging();
+
+/// Waits until the messages logged so far have been written.  Does nothing if
+/// asynchronous logging is not running.
+void FlushAsyncLog();
+
+/// Returns true if asynchronous logging is running.
+bool AsyncLoggingActive();
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_KALDI_ASYNC_LOG_H_
@@ -0,0 +1,98 @@
+// util/kaldi-compression-test.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sstream>
+#include "util/kaldi-compression.h"
+
+namespace kaldi {
+
+// Returns random data of a random kind: incompressible, runs of one byte, or
+// repeats of short random strings (which tests the overlapping matches).
+std::string RandomData() {
+  int32 size = (RandInt(0, 3) == 0 ? RandInt(0, 20) : RandInt(0, 100000));
+  std::string ans;
+  switch (RandInt(0, 2)) {
+    case 0:
+      for (int32 i = 0; i < size; i++)
+        ans.push_back(static_cast<char>(RandInt(0, 255)));
+      break;
+    case 1:
+      ans.assign(size, static_cast<char>(RandInt(0, 255)));
+      break;
+    default: {
+      std::vector<std::string> pieces(RandInt(1, 10));
+      for (size_t i = 0; i < pieces.size(); i++)
+        for (int32 j = RandInt(1, 300); j > 0; j--)
+          pieces[i].push_back(static_cast<char>(RandInt(0, 3)));
+      while (static_cast<int32>(ans.size()) < size)
+        ans += pieces[RandInt(0, pieces.size() - 1)];
+    }
+  }
+  return ans;
+}
+
+void UnitTestLz4() {
+  std::string data = RandomData(), compressed;
+  Lz4Compress(data.data(), data.size(), &compressed);
+  std::string output(data.size(), '\0');
+  KALDI_ASSERT(Lz4Decompress(compressed.data(), compressed.size(),
+                             data.empty() ? NULL : &(output[0]),
+                             data.size()));
+  KALDI_ASSERT(output == data);
+  // The wrong output size, or truncated data, must be detected.
+  std::string longer(data.size() + 1, '\0');
+  KALDI_ASSERT(!Lz4Decompress(compressed.data(), compressed.size(),
+                              &(longer[0]), longer.size()));
+  KALDI_ASSERT(!Lz4Decompress(compressed.data(), compressed.size() - 1,
+                              &(longer[0]), data.size()));
+}
+
+void UnitTestCompressedObject() {
+  // Real objects start with "\0B" in binary mode, so they cannot be mistaken
+  // for compressed frames; make sure 'a' cannot either.
+  std::string a = "x" + RandomData(), b = std::string("\0B", 2) + RandomData();
+  std::ostringstream os;
+  KALDI_ASSERT(WriteCompressedObject(os, a));
+  os.write(b.data(), b.size());
+  std::istringstream is(os.str());
+  std::string a2;
+  if (PeekCompressedObject(is)) {
+    KALDI_ASSERT(ReadCompressedObject(is, &a2));
+  } else {  // 'a' did not compress, so was written as it is.
+    a2.resize(a.size());
+    if (!a.empty()) is.read(&(a2[0]), a.size());
+  }
+  KALDI_ASSERT(a2 == a);
+  KALDI_ASSERT(!PeekCompressedObject(is));
+  std::string b2(b.size(), '\0');
+  is.read(&(b2[0]), b.size());
+  KALDI_ASSERT(is.good() && b2 == b);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 100; i++) {
+    UnitTestLz4();
+    UnitTestCompressedObject();
+  }
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -0,0 +1,237 @@
+// util/kaldi-compression.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <vector>
+
+#include "util/kaldi-compression.h"
+
+namespace kaldi {
+
+namespace {
+
+// Constants of the LZ4 block format: matches are at least kMinMatch bytes
+// long, the last kLastLiterals bytes of the input are always literals, and
+// the last match must start at least kMatchLimit bytes before the end.
+const size_t kMinMatch = 4;
+const size_t kLastLiterals = 5;
+const size_t kMatchLimit = 12;
+const size_t kMaxOffset = 65535;
+
+inline uint32 ReadUint32(const unsigned char *p) {
+  uint32 ans;
+  memcpy(&ans, p, sizeof(ans));
+  return ans;
+}
+
+// Appends a length in the LZ4 format for the part of it that did not fit in
+// the 4 bits of the token, i.e. 'length' is the original length minus 15.
+inline void AppendLength(size_t length, std::string *output) {
+  for (; length >= 255; length -= 255)
+    output->push_back(static_cast<char>(255));
+  output->push_back(static_cast<char>(length));
+}
+
+// Appends a sequence: 'num_literals' literal bytes, then (if match_length is
+// nonzero) a match of 'match_length' bytes at distance 'offset' back.
+void AppendSequence(const unsigned char *literals, size_t num_literals,
+                    size_t offset, size_t match_length, std::string *output) {
+  unsigned char token = (num_literals >= 15 ? 15 : num_literals) << 4;
+  if (match_length != 0) {
+    size_t m = match_length - kMinMatch;
+    token |= (m >= 15 ? 15 : m);
+  }
+  output->push_back(static_cast<char>(token));
+  if (num_literals >= 15)
+    AppendLength(num_literals - 15, output);
+  output->append(reinterpret_cast<const char*>(literals), num_literals);
+  if (match_length != 0) {
+    output->push_back(static_cast<char>(offset & 255));
+    output->push_back(static_cast<char>(offset >> 8));
+    if (match_length - kMinMatch >= 15)
+      AppendLength(match_length - kMinMatch - 15, output);
+  }
+}
+
+// Reads a length continuation (see AppendLength()) and adds it to *length.
+inline bool ReadLength(const unsigned char **p, const unsigned char *end,
+                       size_t *length) {
+  unsigned char b;
+  do {
+    if (*p == end) return false;
+    b = *((*p)++);
+    *length += b;
+  } while (b == 255);
+  return true;
+}
+
+}  // namespace
+
+
+void Lz4Compress(const char *data, size_t size, std::string *output) {
+  output->clear();
+  output->reserve(size + size / 255 + 16);
+  const unsigned char *in = reinterpret_cast<const unsigned char*>(data);
+  size_t anchor = 0;  // start of the literals not yet output.
+  if (size > kMatchLimit) {
+    // Hash table from 4-byte sequences to (one plus) the position at which
+    // they were last seen; zero means none.  Its size grows with the input,
+    // since clearing a large table would dominate for small objects.
+    int32 hash_bits = 10;
+    while (hash_bits < 16 && (static_cast<size_t>(1) << hash_bits) < size)
+      hash_bits++;
+    std::vector<size_t> table(static_cast<size_t>(1) << hash_bits, 0);
+    size_t match_start_limit = size - kMatchLimit,
+        match_end_limit = size - kLastLiterals, pos = 0;
+    while (pos < match_start_limit) {
+      uint32 seq = ReadUint32(in + pos),
+          hash = (seq * 2654435761U) >> (32 - hash_bits);
+      size_t candidate = table[hash];
+      table[hash] = pos + 1;
+      if (candidate == 0 || pos + 1 - candidate > kMaxOffset ||
+          ReadUint32(in + candidate - 1) != seq) {
+        pos++;
+        continue;
+      }
+      size_t match = candidate - 1, end = pos + kMinMatch;
+      while (end < match_end_limit && in[end] == in[match + end - pos])
+        end++;
+      // Extend the match backwards into the pending literals.
+      while (pos > anchor && match > 0 && in[pos - 1] == in[match - 1]) {
+        pos--;
+        match--;
+      }
+      AppendSequence(in + anchor, pos - anchor, pos - match, end - pos,
+                     output);
+      pos = anchor = end;
+    }
+  }
+  AppendSequence(in + anchor, size - anchor, 0, 0, output);
+}
+
+
+bool Lz4Decompress(const char *data, size_t size,
+                   char *output, size_t output_size) {
+  const unsigned char *ip = reinterpret_cast<const unsigned char*>(data),
+      *in_end = ip + size;
+  char *op = output, *out_end = output + output_size;
+  while (true) {
+    if (ip == in_end) return false;
+    unsigned char token = *(ip++);
+    size_t num_literals = token >> 4;
+    if (num_literals == 15 && !ReadLength(&ip, in_end, &num_literals))
+      return false;
+    if (num_literals > static_cast<size_t>(in_end - ip) ||
+        num_literals > static_cast<size_t>(out_end - op))
+      return false;
+    memcpy(op, ip, num_literals);
+    ip += num_literals;
+    op += num_literals;
+    if (ip == in_end)  // The last sequence has no match.
+      return op == out_end;
+    if (in_end - ip < 2) return false;
+    size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+    ip += 2;
+    if (offset == 0 || offset > static_cast<size_t>(op - output))
+      return false;
+    size_t match_length = token & 15;
+    if (match_length == 15 && !ReadLength(&ip, in_end, &match_length))
+      return false;
+    match_length += kMinMatch;
+    if (match_length > static_cast<size_t>(out_end - op))
+      return false;
+    const char *match = op - offset;
+    if (offset >= match_length) {
+      memcpy(op, match, match_length);
+    } else {  // Overlapping copy, e.g. a run of repeated bytes.
+      for (size_t i = 0; i < match_length; i++)
+        op[i] = match[i];
+    }
+    op += match_length;
+  }
+}
+
+
+bool WriteCompressedObject(std::ostream &os, const std::string &object) {
+  std::string compressed;
+  Lz4Compress(object.data(), object.size(), &compressed);
+  // The frame header is 2 + 4 + 8 + 8 bytes.
+  if (compressed.size() + 22 >= object.size()) {
+    os.write(object.data(), object.size());
+  } else {
+    os.write("\0Z", 2);
+    WriteToken(os, true, "LZ4");
+    WriteBasicType(os, true, static_cast<int64>(object.size()));
+    WriteBasicType(os, true, static_cast<int64>(compressed.size()));
+    os.write(compressed.data(), compressed.size());
+  }
+  return os.good();
+}
+
+
+bool PeekCompressedObject(std::istream &is) {
+  if (is.peek() != '\0') return false;
+  is.get();
+  if (is.peek() == 'Z') {
+    is.get();
+    return true;
+  }
+  // Probably the "\0B" binary-mode header of an uncompressed object.
+  is.unget();
+  return false;
+}
+
+
+bool ReadCompressedObject(std::istream &is, std::string *object) {
+  try {
+    std::string codec;
+    ReadToken(is, true, &codec);
+    if (codec != "LZ4") {
+      KALDI_WARN << "Unsupported compression type " << codec;
+      return false;
+    }
+    int64 size, compressed_size;
+    ReadBasicType(is, true, &size);
+    ReadBasicType(is, true, &compressed_size);
+    if (size < 0 || compressed_size < 0) {
+      KALDI_WARN << "Invalid sizes in compressed object header";
+      return false;
+    }
+    std::vector<char> compressed(compressed_size);
+    if (compressed_size != 0)
+      is.read(&(compressed[0]), compressed_size);
+    if (!is.good()) {
+      KALDI_WARN << "Failed to read compressed object (truncated file?)";
+      return false;
+    }
+    object->resize(size);
+    if (!Lz4Decompress(compressed_size == 0 ? NULL : &(compressed[0]),
+                       compressed_size,
+                       size == 0 ? NULL : &((*object)[0]), size)) {
+      KALDI_WARN << "Corrupt compressed object";
+      return false;
+    }
+    return true;
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error reading compressed object: " << e.what();
+    return false;
+  }
+}
+
+}  // namespace kaldi
@@ -0,0 +1,75 @@
+// util/kaldi-compression.h
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_KALDI_COMPRESSION_H_
+#define KALDI_UTIL_KALDI_COMPRESSION_H_
+
+#include <istream>
+#include <ostream>
+#include <string>
+
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/// \addtogroup io_group
+/// @{
+
+/// Lossless compression of table objects, used when the "lz4" wspecifier
+/// option is given (e.g. "ark,scp,lz4:foo.ark,foo.scp").  Each object in the
+/// archive is compressed on its own, as a frame that takes the place of the
+/// object's normal binary form:
+///   "\0Z" <codec-token> <uncompressed-size> <compressed-size> <data>
+/// where the codec token is currently always "LZ4", the sizes are written as
+/// binary int64 (see WriteBasicType()) and the data is in the LZ4 block
+/// format.  Since the frame starts where the object would have started, the
+/// byte offsets in scp files (and the binary indexes of kaldi-table-index.h)
+/// still locate objects, so random access works as for uncompressed
+/// archives.  The table readers detect frames automatically, so no rspecifier
+/// option is needed; archives may mix compressed and uncompressed objects.
+
+/// Compresses 'size' bytes at 'data' in the LZ4 block format, to *output.
+void Lz4Compress(const char *data, size_t size, std::string *output);
+
+/// Decompresses the LZ4 block of 'size' bytes at 'data', which must
+/// decompress to exactly 'output_size' bytes, to 'output'.  Returns false if
+/// the data is corrupt.
+bool Lz4Decompress(const char *data, size_t size,
+                   char *output, size_t output_size);
+
+/// Writes the serialized (binary-mode) object 'object' to 'os' as a
+/// compressed frame, or just as it is if it does not compress.  Returns
+/// false on stream error.
+bool WriteCompressedObject(std::ostream &os, const std::string &object);
+
+/// Returns true, after consuming the "\0Z" that starts it, if the next thing
+/// in the stream is a compressed frame; otherwise leaves the stream
+/// unchanged and returns false.
+bool PeekCompressedObject(std::istream &is);
+
+/// Reads the rest of a compressed frame, after PeekCompressedObject() has
+/// returned true, and outputs the decompressed object.  Returns false, after
+/// printing a warning, on error.
+bool ReadCompressedObject(std::istream &is, std::string *object);
+
+/// @} end "addtogroup io_group"
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_KALDI_COMPRESSION_H_
@@ -23,9 +23,11 @@
 #define KALDI_UTIL_KALDI_HOLDER_INL_H_
 
 #include <algorithm>
+#include <cstring>
 #include <vector>
 #include <utility>
 #include <string>
+#include <type_traits>
 
 #include "base/kaldi-utils.h"
 #include "util/kaldi-io.h"
@@ -216,6 +218,74 @@ template<class BasicType> class BasicHolder {
 };
 
 
+// BasicVectorBinaryIo writes and reads the binary form of BasicVectorHolder:
+// the size, then the elements as written by WriteBasicType.  For integer types,
+// whose elements all have the same size, this is done in one write() or read()
+// rather than element by element; and the reading also accepts the compressed
+// form of WriteIntegerVectorCompressed().
+template<class BasicType, bool IsInteger> struct BasicVectorBinaryIo {
+  static void Write(std::ostream &os, const std::vector<BasicType> &t) {
+    WriteBasicType(os, true, static_cast<int32>(t.size()));
+    for (typename std::vector<BasicType>::const_iterator iter = t.begin();
+         iter != t.end(); ++iter)
+      WriteBasicType(os, true, *iter);
+  }
+  static void Read(std::istream &is, std::vector<BasicType> *t) {
+    int32 size;
+    ReadBasicType(is, true, &size);
+    t->resize(size);
+    for (typename std::vector<BasicType>::iterator iter = t->begin();
+         iter != t->end(); ++iter)
+      ReadBasicType(is, true, &(*iter));
+  }
+};
+
+template<class BasicType> struct BasicVectorBinaryIo<BasicType, true> {
+  // The byte that WriteBasicType writes before an integer of this type.
+  static char TypeCode() {
+    return (std::numeric_limits<BasicType>::is_signed ? 1 : -1) *
+        static_cast<char>(sizeof(BasicType));
+  }
+  static void Write(std::ostream &os, const std::vector<BasicType> &t) {
+    WriteBasicType(os, true, static_cast<int32>(t.size()));
+    const size_t elem_size = 1 + sizeof(BasicType);
+    std::vector<char> buf(t.size() * elem_size);
+    char code = TypeCode(), *p = (buf.empty() ? NULL : &(buf[0]));
+    for (size_t i = 0; i < t.size(); i++, p += elem_size) {
+      p[0] = code;
+      memcpy(p + 1, &(t[i]), sizeof(BasicType));
+    }
+    if (!buf.empty())
+      os.write(&(buf[0]), buf.size());
+  }
+  static void Read(std::istream &is, std::vector<BasicType> *t) {
+    if (is.peek() == 'C') {
+      ReadIntegerVector(is, true, t);
+      return;
+    }
+    int32 size;
+    ReadBasicType(is, true, &size);
+    if (size < 0)
+      KALDI_ERR << "Negative size " << size;
+    const size_t elem_size = 1 + sizeof(BasicType);
+    std::vector<char> buf(size * elem_size);
+    if (size > 0)
+      is.read(&(buf[0]), buf.size());
+    if (is.fail())
+      KALDI_ERR << "Read failure (truncated data?)";
+    t->resize(size);
+    char code = TypeCode();
+    const char *p = (buf.empty() ? NULL : &(buf[0]));
+    for (int32 i = 0; i < size; i++, p += elem_size) {
+      if (p[0] != code)
+        KALDI_ERR << "Expected integer type " << static_cast<int32>(code)
+                  << ", got " << static_cast<int32>(p[0]);
+      memcpy(&((*t)[i]), p + 1, sizeof(BasicType));
+    }
+  }
+};
+
+
 /// A Holder for a vector of basic types, e.g.
 /// std::vector<int32>, std::vector<float>, and so on.
 /// Note: a basic type is defined as a type for which ReadBasicType
@@ -236,11 +306,7 @@ template<class BasicType> class BasicVectorHolder {
         // Or this Write routine cannot handle such a large vector.
         // use int32 because it's fixed size regardless of compilation.
         // change to int64 (plus in Read function) if this becomes a problem.
-        WriteBasicType(os, binary, static_cast<int32>(t.size()));
-        for (typename std::vector<BasicType>::const_iterator iter = t.begin();
-             iter != t.end(); ++iter)
-          WriteBasicType(os, binary, *iter);
-
+        BinaryIo::Write(os, t);
       } else {
         for (typename std::vector<BasicType>::const_iterator iter = t.begin();
              iter != t.end(); ++iter)
@@ -295,14 +361,7 @@ template<class BasicType> class BasicVectorHolder {
     } else {  // binary mode.
       size_t filepos = is.tellg();
       try {
-        int32 size;
-        ReadBasicType(is, true, &size);
-        t_.resize(size);
-        for (typename std::vector<BasicType>::iterator iter = t_.begin();
-             iter != t_.end();
-             ++iter) {
-          ReadBasicType(is, true, &(*iter));
-        }
+        BinaryIo::Read(is, &t_);
         return true;
       } catch(...) {
         KALDI_WARN << "BasicVectorHolder::Read, read error or unexpected data"
@@ -330,11 +389,46 @@ template<class BasicType> class BasicVectorHolder {
 
   ~BasicVectorHolder() { }
  private:
+  typedef BasicVectorBinaryIo<BasicType,
+      std::numeric_limits<BasicType>::is_integer &&
+      !std::is_same<BasicType, bool>::value> BinaryIo;
+
   KALDI_DISALLOW_COPY_AND_ASSIGN(BasicVectorHolder);
   T t_;
 };
 
 
+/// CompressedIntVectorHolder is as BasicVectorHolder, for integer types,
+/// except that in binary mode it writes the vectors in the compressed form of
+/// WriteIntegerVectorCompressed(), which is typically 4 to 5 times smaller for
+/// alignments.  BasicVectorHolder reads both forms, so only the program that
+/// writes the archive needs to use this.
+template<class IntType>
+class CompressedIntVectorHolder: public BasicVectorHolder<IntType> {
+ public:
+  typedef std::vector<IntType> T;
+
+  CompressedIntVectorHolder() { }
+
+  static bool Write(std::ostream &os, bool binary, const T &t) {
+    if (!binary)
+      return BasicVectorHolder<IntType>::Write(os, binary, t);
+    InitKaldiOutputStream(os, binary);
+    try {
+      WriteIntegerVectorCompressed(os, binary, t);
+      return os.good();
+    } catch(const std::exception &e) {
+      KALDI_WARN << "Exception caught writing Table object (compressed "
+                 << "integer vector). " << e.what();
+      return false;  // Write failure.
+    }
+  }
+
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CompressedIntVectorHolder);
+};
+
+
 /// BasicVectorVectorHolder is a Holder for a vector of vector of
 /// a basic type, e.g. std::vector<std::vector<int32> >.
 /// Note: a basic type is defined as a type for which ReadBasicType
@@ -187,6 +187,12 @@ template<class BasicType> class BasicHolder;
 template<class BasicType> class BasicVectorHolder;
 
 
+// As BasicVectorHolder, for integer types, but in binary mode it writes
+// the vectors in a compressed (delta-coded) form, which BasicVectorHolder
+// can read.
+template<class IntType> class CompressedIntVectorHolder;
+
+
 // A holder for vectors of vectors of basic types, e.g.
 // std::vector<std::vector<int32> >, and so on.
 // Note: a basic type is defined as a type for which ReadBasicType
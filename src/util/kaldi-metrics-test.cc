@@ -0,0 +1,138 @@
+// util/kaldi-metrics-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifndef _MSC_VER
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "util/kaldi-metrics.h"
+
+namespace kaldi {
+
+bool Contains(const std::string &text, const std::string &line) {
+  return text.find(line + "\n") != std::string::npos;
+}
+
+void TestMetricsText() {
+  MetricsRegistry registry;
+  MetricCounter *counter = registry.GetCounter("test_utterances_total",
+                                               "Utterances.");
+  KALDI_ASSERT(registry.GetCounter("test_utterances_total", "") == counter);
+  counter->Increment();
+  counter->Increment(2.5);
+  registry.GetGauge("test_queue_length", "Queue length.",
+                    "worker=\"0\"")->Set(3);
+  registry.GetGauge("test_queue_length", "Queue length.",
+                    "worker=\"1\"")->Add(-2);
+  std::vector<double> buckets;
+  buckets.push_back(0.1);
+  buckets.push_back(1.0);
+  MetricHistogram *histogram = registry.GetHistogram("test_latency_seconds",
+                                                     "Latency.", buckets);
+  histogram->Observe(0.05);
+  histogram->Observe(0.1);
+  histogram->Observe(0.5);
+  histogram->Observe(20.0);
+
+  std::string text = registry.Text();
+  KALDI_LOG << text;
+  KALDI_ASSERT(Contains(text, "# TYPE test_utterances_total counter"));
+  KALDI_ASSERT(Contains(text, "test_utterances_total 3.5"));
+  KALDI_ASSERT(Contains(text, "# HELP test_queue_length Queue length."));
+  KALDI_ASSERT(Contains(text, "test_queue_length{worker=\"0\"} 3"));
+  KALDI_ASSERT(Contains(text, "test_queue_length{worker=\"1\"} -2"));
+  KALDI_ASSERT(Contains(text, "test_latency_seconds_bucket{le=\"0.1\"} 2"));
+  KALDI_ASSERT(Contains(text, "test_latency_seconds_bucket{le=\"1\"} 3"));
+  KALDI_ASSERT(Contains(text, "test_latency_seconds_bucket{le=\"+Inf\"} 4"));
+  KALDI_ASSERT(Contains(text, "test_latency_seconds_sum 20.65"));
+  KALDI_ASSERT(Contains(text, "test_latency_seconds_count 4"));
+}
+
+void TestMetricsThreads() {
+  MetricsRegistry registry;
+  MetricCounter *counter = registry.GetCounter("test_total", "");
+  std::vector<std::thread> threads;
+  for (int32 t = 0; t < 4; t++)
+    threads.push_back(std::thread([counter]() {
+      for (int32 i = 0; i < 10000; i++)
+        counter->Increment();
+    }));
+  for (size_t t = 0; t < threads.size(); t++)
+    threads[t].join();
+  KALDI_ASSERT(counter->Value() == 40000);
+}
+
+void TestMetricsHttpServer() {
+#ifndef _MSC_VER
+  MetricsRegistry registry;
+  registry.GetCounter("test_requests_total", "Requests.")->Increment(7);
+  MetricsHttpServer bad_server(&registry);
+  KALDI_ASSERT(!bad_server.Start(0, "not-an-address"));
+  MetricsHttpServer server(&registry);
+  if (!server.Start(0)) {
+    KALDI_WARN << "Could not start server, skipping test.";
+    return;
+  }
+  for (int32 i = 0; i < 2; i++) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    KALDI_ASSERT(sock >= 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(server.Port());
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    KALDI_ASSERT(connect(sock, reinterpret_cast<struct sockaddr*>(&addr),
+                         sizeof(addr)) == 0);
+    std::string request = (i == 0 ? "GET /metrics HTTP/1.1\r\n" :
+                           "GET /other HTTP/1.1\r\n");
+    request += "Host: localhost\r\n\r\n";
+    KALDI_ASSERT(write(sock, request.data(), request.size()) ==
+                 static_cast<ssize_t>(request.size()));
+    std::string response;
+    char buf[1024];
+    ssize_t n;
+    while ((n = read(sock, buf, sizeof(buf))) > 0)
+      response.append(buf, n);
+    close(sock);
+    if (i == 0) {
+      KALDI_ASSERT(response.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+      KALDI_ASSERT(Contains(response, "test_requests_total 7"));
+    } else {
+      KALDI_ASSERT(response.compare(0, 12, "HTTP/1.1 404") == 0);
+    }
+  }
+  server.Stop();
+  KALDI_ASSERT(server.Port() == -1);
+#endif
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  TestMetricsText();
+  TestMetricsThreads();
+  TestMetricsHttpServer();
+  std::cout << "Test OK.\n";
+}
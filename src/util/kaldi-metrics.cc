@@ -0,0 +1,358 @@
+// util/kaldi-metrics.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#ifndef _MSC_VER
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // e.g. on macOS, which has SO_NOSIGPIPE instead.
+#endif
+#endif
+
+#include "util/kaldi-metrics.h"
+
+namespace kaldi {
+
+namespace {
+
+// std::atomic<double> has no fetch_add() before C++20.
+void AtomicAdd(std::atomic<double> *a, double value) {
+  double old_value = a->load();
+  while (!a->compare_exchange_weak(old_value, old_value + value)) { }
+}
+
+// Writes a number in the format Prometheus expects.
+std::string FormatValue(double value) {
+  if (value == std::numeric_limits<double>::infinity())
+    return "+Inf";
+  std::ostringstream os;
+  os.precision(15);
+  os << value;
+  return os.str();
+}
+
+// Returns "{labels}", or "" if 'labels' is empty; 'extra' is appended to the
+// labels, e.g. le="0.5".
+std::string LabelString(const std::string &labels, const std::string &extra) {
+  if (labels.empty() && extra.empty())
+    return "";
+  if (labels.empty()) return "{" + extra + "}";
+  if (extra.empty()) return "{" + labels + "}";
+  return "{" + labels + "," + extra + "}";
+}
+
+// Returns the resident memory of the process in bytes, or -1 if unknown.
+double ResidentMemoryBytes() {
+#ifdef __linux__
+  std::ifstream is("/proc/self/statm");
+  long long size, resident;
+  if (is >> size >> resident)
+    return static_cast<double>(resident) * sysconf(_SC_PAGESIZE);
+#endif
+  return -1.0;
+}
+
+}  // namespace
+
+
+void MetricCounter::Increment(double value) {
+  KALDI_ASSERT(value >= 0.0);
+  AtomicAdd(&value_, value);
+}
+
+void MetricGauge::Add(double value) {
+  AtomicAdd(&value_, value);
+}
+
+MetricHistogram::MetricHistogram(const std::vector<double> &buckets):
+    buckets_(buckets), counts_(new std::atomic<int64>[buckets.size() + 1]),
+    sum_(0.0) {
+  for (size_t i = 0; i + 1 < buckets_.size(); i++)
+    KALDI_ASSERT(buckets_[i] < buckets_[i + 1]);
+  for (size_t i = 0; i <= buckets_.size(); i++)
+    counts_[i] = 0;
+}
+
+void MetricHistogram::Observe(double value) {
+  size_t i = std::lower_bound(buckets_.begin(), buckets_.end(), value) -
+      buckets_.begin();
+  counts_[i]++;
+  AtomicAdd(&sum_, value);
+}
+
+std::vector<double> MetricHistogram::LatencyBuckets() {
+  double buckets[] = { 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5,
+                       5.0, 10.0 };
+  return std::vector<double>(buckets, buckets + sizeof(buckets) /
+                             sizeof(buckets[0]));
+}
+
+
+MetricsRegistry &MetricsRegistry::Global() {
+  static MetricsRegistry registry;
+  return registry;
+}
+
+MetricsRegistry::~MetricsRegistry() {
+  for (std::map<std::string, Family>::iterator iter = families_.begin();
+       iter != families_.end(); ++iter) {
+    std::map<std::string, void*> &metrics = iter->second.metrics;
+    for (std::map<std::string, void*>::iterator m = metrics.begin();
+         m != metrics.end(); ++m) {
+      switch (iter->second.type) {
+        case kCounter: delete static_cast<MetricCounter*>(m->second); break;
+        case kGauge: delete static_cast<MetricGauge*>(m->second); break;
+        case kHistogram: delete static_cast<MetricHistogram*>(m->second);
+      }
+    }
+  }
+}
+
+void *MetricsRegistry::GetMetric(const std::string &name,
+                                 const std::string &help,
+                                 const std::string &labels, MetricType type,
+                                 const std::vector<double> *buckets) {
+  if (name.empty() || !(isalpha(name[0]) || name[0] == '_' || name[0] == ':'))
+    KALDI_ERR << "Invalid metric name '" << name << "'";
+  for (size_t i = 0; i < name.size(); i++)
+    if (!(isalnum(name[i]) || name[i] == '_' || name[i] == ':'))
+      KALDI_ERR << "Invalid metric name '" << name << "'";
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<std::string, Family>::iterator iter = families_.find(name);
+  if (iter == families_.end()) {
+    Family family;
+    family.type = type;
+    family.help = help;
+    iter = families_.insert(std::make_pair(name, family)).first;
+  } else if (iter->second.type != type) {
+    KALDI_ERR << "Metric " << name << " is used with different types.";
+  }
+  void *&metric = iter->second.metrics[labels];
+  if (metric == NULL) {
+    switch (type) {
+      case kCounter: metric = new MetricCounter(); break;
+      case kGauge: metric = new MetricGauge(); break;
+      case kHistogram: metric = new MetricHistogram(*buckets);
+    }
+  } else if (type == kHistogram &&
+             static_cast<MetricHistogram*>(metric)->buckets_ != *buckets) {
+    KALDI_ERR << "Histogram " << name << " is used with different buckets.";
+  }
+  return metric;
+}
+
+MetricCounter *MetricsRegistry::GetCounter(const std::string &name,
+                                           const std::string &help,
+                                           const std::string &labels) {
+  return static_cast<MetricCounter*>(
+      GetMetric(name, help, labels, kCounter, NULL));
+}
+
+MetricGauge *MetricsRegistry::GetGauge(const std::string &name,
+                                       const std::string &help,
+                                       const std::string &labels) {
+  return static_cast<MetricGauge*>(
+      GetMetric(name, help, labels, kGauge, NULL));
+}
+
+MetricHistogram *MetricsRegistry::GetHistogram(
+    const std::string &name, const std::string &help,
+    const std::vector<double> &buckets, const std::string &labels) {
+  return static_cast<MetricHistogram*>(
+      GetMetric(name, help, labels, kHistogram, &buckets));
+}
+
+std::string MetricsRegistry::Text() const {
+  std::ostringstream os;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (std::map<std::string, Family>::const_iterator iter = families_.begin();
+       iter != families_.end(); ++iter) {
+    const std::string &name = iter->first;
+    const Family &family = iter->second;
+    const char *type_names[] = { "counter", "gauge", "histogram" };
+    os << "# HELP " << name << ' ' << family.help << '\n'
+       << "# TYPE " << name << ' ' << type_names[family.type] << '\n';
+    for (std::map<std::string, void*>::const_iterator m =
+             family.metrics.begin(); m != family.metrics.end(); ++m) {
+      const std::string &labels = m->first;
+      if (family.type == kCounter) {
+        os << name << LabelString(labels, "") << ' ' << FormatValue(
+            static_cast<const MetricCounter*>(m->second)->Value()) << '\n';
+      } else if (family.type == kGauge) {
+        os << name << LabelString(labels, "") << ' ' << FormatValue(
+            static_cast<const MetricGauge*>(m->second)->Value()) << '\n';
+      } else {
+        const MetricHistogram *h =
+            static_cast<const MetricHistogram*>(m->second);
+        int64 count = 0;
+        for (size_t i = 0; i <= h->buckets_.size(); i++) {
+          count += h->counts_[i].load();
+          double le = (i < h->buckets_.size() ? h->buckets_[i] :
+                       std::numeric_limits<double>::infinity());
+          os << name << "_bucket"
+             << LabelString(labels, "le=\"" + FormatValue(le) + "\"") << ' '
+             << count << '\n';
+        }
+        os << name << "_sum" << LabelString(labels, "") << ' '
+           << FormatValue(h->sum_.load()) << '\n'
+           << name << "_count" << LabelString(labels, "") << ' ' << count
+           << '\n';
+      }
+    }
+  }
+  double resident = ResidentMemoryBytes();
+  if (resident >= 0.0)
+    os << "# HELP process_resident_memory_bytes Resident memory size in "
+       << "bytes.\n# TYPE process_resident_memory_bytes gauge\n"
+       << "process_resident_memory_bytes " << FormatValue(resident) << '\n';
+  return os.str();
+}
+
+
+#ifndef _MSC_VER
+
+bool MetricsHttpServer::Start(int32 port, const std::string &bind_address) {
+  KALDI_ASSERT(socket_ < 0 && "Start() called twice.");
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  if (inet_pton(AF_INET, bind_address.c_str(), &addr.sin_addr) != 1) {
+    KALDI_WARN << "Invalid IPv4 address for metrics: " << bind_address;
+    return false;
+  }
+  addr.sin_port = htons(port);
+  socket_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (socket_ < 0) {
+    KALDI_WARN << "Could not create socket for metrics: " << strerror(errno);
+    return false;
+  }
+  int32 flag = 1;
+  setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+  socklen_t len = sizeof(addr);
+  if (bind(socket_, reinterpret_cast<struct sockaddr*>(&addr), len) < 0 ||
+      listen(socket_, 16) < 0 ||
+      getsockname(socket_, reinterpret_cast<struct sockaddr*>(&addr),
+                  &len) < 0) {
+    KALDI_WARN << "Could not serve metrics on " << bind_address << ':'
+               << port << ": " << strerror(errno);
+    close(socket_);
+    socket_ = -1;
+    return false;
+  }
+  port_ = ntohs(addr.sin_port);
+  stop_ = false;
+  thread_ = std::thread(&MetricsHttpServer::Serve, this);
+  KALDI_LOG << "Serving metrics on " << bind_address << ':' << port_;
+  return true;
+}
+
+void MetricsHttpServer::Stop() {
+  if (socket_ < 0)
+    return;
+  stop_ = true;
+  thread_.join();
+  close(socket_);
+  socket_ = -1;
+  port_ = -1;
+}
+
+void MetricsHttpServer::Serve() {
+  while (!stop_) {
+    // We poll with a timeout so that we notice when Stop() is called.
+    struct pollfd pfd;
+    pfd.fd = socket_;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 200) <= 0)
+      continue;
+    int client = accept(socket_, NULL, NULL);
+    if (client < 0)
+      continue;
+    HandleConnection(client);
+    close(client);
+  }
+}
+
+void MetricsHttpServer::HandleConnection(int client) {
+  // Read the request line and headers, up to the blank line; we don't wait
+  // more than a second for slow clients, as we serve one at a time.
+  std::string request;
+  char buf[1024];
+  while (request.find("\r\n\r\n") == std::string::npos &&
+         request.size() < 8192) {
+    struct pollfd pfd;
+    pfd.fd = client;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 1000) <= 0)
+      return;
+    ssize_t n = read(client, buf, sizeof(buf));
+    if (n <= 0)
+      return;
+    request.append(buf, n);
+  }
+  std::string status, body;
+  if (request.compare(0, 13, "GET /metrics ") == 0 ||
+      request.compare(0, 6, "GET / ") == 0) {
+    status = "200 OK";
+    body = registry_->Text();
+  } else {
+    status = "404 Not Found";
+    body = "Not found; metrics are at /metrics\n";
+  }
+  std::ostringstream os;
+  os << "HTTP/1.1 " << status << "\r\n"
+     << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+     << "Content-Length: " << body.size() << "\r\n"
+     << "Connection: close\r\n\r\n" << body;
+  std::string response = os.str();
+  size_t written = 0;
+  while (written < response.size()) {
+    // MSG_NOSIGNAL: don't get SIGPIPE if the client has gone away.
+    ssize_t n = send(client, response.data() + written,
+                     response.size() - written, MSG_NOSIGNAL);
+    if (n <= 0)
+      return;
+    written += n;
+  }
+}
+
+#else  // _MSC_VER
+
+bool MetricsHttpServer::Start(int32 port) {
+  KALDI_WARN << "Serving metrics over HTTP is not supported on Windows.";
+  return false;
+}
+
+void MetricsHttpServer::Stop() { }
+
+void MetricsHttpServer::Serve() { }
+
+void MetricsHttpServer::HandleConnection(int client) { }
+
+#endif  // _MSC_VER
+
+}  // namespace kaldi
@@ -0,0 +1,185 @@
+// util/kaldi-metrics.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_KALDI_METRICS_H_
+#define KALDI_UTIL_KALDI_METRICS_H_
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/**
+   This file contains a small registry of runtime metrics (counters, gauges
+   and histograms) for long-running programs such as decoding servers, and an
+   HTTP server that makes them available in the Prometheus text format
+   (which OpenMetrics scrapers also accept), so they can be monitored and used
+   for autoscaling.
+
+   The metrics are created once, normally at startup, with
+   MetricsRegistry::Global().GetCounter() etc., which return pointers that stay
+   valid for the life of the program; updating them is lock-free, so they may
+   be updated from any thread, e.g.:
+   \code
+     MetricCounter *audio = MetricsRegistry::Global().GetCounter(
+         "kaldi_decoded_audio_seconds_total", "Seconds of audio decoded.");
+     ...
+     audio->Increment(num_samples / samp_freq);
+   \endcode
+   A metric may have labels, given as a string such as "worker=\"0\"";
+   metrics with the same name and different labels are written together.
+*/
+
+/// A value that only goes up, e.g. the number of utterances decoded.
+class MetricCounter {
+ public:
+  MetricCounter(): value_(0.0) { }
+  void Increment(double value = 1.0);
+  double Value() const { return value_.load(); }
+ private:
+  std::atomic<double> value_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MetricCounter);
+};
+
+/// A value that may go up or down, e.g. the length of a queue.
+class MetricGauge {
+ public:
+  MetricGauge(): value_(0.0) { }
+  void Set(double value) { value_.store(value); }
+  void Add(double value);
+  double Value() const { return value_.load(); }
+ private:
+  std::atomic<double> value_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MetricGauge);
+};
+
+/// The distribution of a value, e.g. a latency, as the number of observations
+/// less than or equal to each of a fixed set of bucket boundaries, plus their
+/// sum and count.
+class MetricHistogram {
+ public:
+  /// 'buckets' are the upper bounds of the buckets, in increasing order; a
+  /// bucket for +infinity is implicit.
+  explicit MetricHistogram(const std::vector<double> &buckets);
+  void Observe(double value);
+
+  /// Bucket boundaries suitable for latencies in seconds, from 5ms to 10s.
+  static std::vector<double> LatencyBuckets();
+
+ private:
+  friend class MetricsRegistry;
+  std::vector<double> buckets_;
+  // counts_[i] is the number of observations in bucket i (not cumulative);
+  // the last element is for +infinity.
+  std::unique_ptr<std::atomic<int64>[]> counts_;
+  std::atomic<double> sum_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MetricHistogram);
+};
+
+
+class MetricsRegistry {
+ public:
+  /// The registry that programs normally use, and that MetricsHttpServer
+  /// serves by default.
+  static MetricsRegistry &Global();
+
+  MetricsRegistry() { }
+  ~MetricsRegistry();
+
+  /// These functions return the metric with this name and labels, creating it
+  /// if it did not exist.  It is an error to use the same name for metrics of
+  /// different types, or for histograms with different buckets.  'name'
+  /// should match [a-zA-Z_:][a-zA-Z0-9_:]*, and by convention the names of
+  /// counters end in "_total".
+  MetricCounter *GetCounter(const std::string &name, const std::string &help,
+                            const std::string &labels = "");
+  MetricGauge *GetGauge(const std::string &name, const std::string &help,
+                        const std::string &labels = "");
+  MetricHistogram *GetHistogram(const std::string &name,
+                                const std::string &help,
+                                const std::vector<double> &buckets,
+                                const std::string &labels = "");
+
+  /// Returns all the metrics in the Prometheus text exposition format
+  /// (version 0.0.4).  On Linux this includes the standard metric
+  /// process_resident_memory_bytes.
+  std::string Text() const;
+
+ private:
+  enum MetricType { kCounter, kGauge, kHistogram };
+  struct Family {
+    MetricType type;
+    std::string help;
+    // indexed by the labels.
+    std::map<std::string, void*> metrics;
+  };
+  void *GetMetric(const std::string &name, const std::string &help,
+                  const std::string &labels, MetricType type,
+                  const std::vector<double> *buckets);
+
+  mutable std::mutex mutex_;
+  std::map<std::string, Family> families_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MetricsRegistry);
+};
+
+
+/// MetricsHttpServer answers HTTP requests for /metrics (or /) with
+/// MetricsRegistry::Text(), from a thread of its own, so Prometheus can scrape
+/// them.  It is only supported on POSIX systems.
+class MetricsHttpServer {
+ public:
+  explicit MetricsHttpServer(
+      const MetricsRegistry *registry = &MetricsRegistry::Global()):
+      registry_(registry), socket_(-1), port_(-1), stop_(false) { }
+
+  /// Starts listening on 'port' of the IPv4 address 'bind_address'; if
+  /// port == 0, the system chooses a free port, which Port() returns.  The
+  /// endpoint has no authentication, so by default it is only reachable from
+  /// this host; use "0.0.0.0" to listen on all interfaces.  Returns false
+  /// (with a warning) if the port could not be opened.
+  bool Start(int32 port, const std::string &bind_address = "127.0.0.1");
+
+  /// Returns the port we are listening on, or -1 if not started.
+  int32 Port() const { return port_; }
+
+  /// Stops the server; this is also done by the destructor.
+  void Stop();
+
+  ~MetricsHttpServer() { Stop(); }
+
+ private:
+  void Serve();
+  void HandleConnection(int client);
+
+  const MetricsRegistry *registry_;
+  int socket_;
+  int32 port_;
+  std::atomic<bool> stop_;
+  std::thread thread_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MetricsHttpServer);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_KALDI_METRICS_H_
@@ -0,0 +1,53 @@
+// util/kaldi-mmap-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/kaldi-mmap.h"
+
+namespace kaldi {
+
+void TestMappedArena(const std::string &dir) {
+  // Use a small chunk size so we get many chunks, and some allocations
+  // larger than a chunk.
+  MappedArena arena(dir, 1000);
+  KALDI_ASSERT(arena.IsFileBacked() == !dir.empty());
+  std::vector<std::pair<int32*, int32> > allocs;
+  for (int32 i = 0; i < 500; i++) {
+    int32 size = RandInt(0, 2000);
+    int32 *data = static_cast<int32*>(arena.Allocate(size * sizeof(int32)));
+    KALDI_ASSERT(reinterpret_cast<size_t>(data) % 16 == 0);
+    for (int32 j = 0; j < size; j++)
+      data[j] = i + j;
+    allocs.push_back(std::pair<int32*, int32>(data, size));
+  }
+  // Check that nothing was overwritten by later allocations.
+  for (size_t i = 0; i < allocs.size(); i++)
+    for (int32 j = 0; j < allocs[i].second; j++)
+      KALDI_ASSERT(allocs[i].first[j] == static_cast<int32>(i) + j);
+  KALDI_ASSERT(arena.BytesAllocated() >= 500 * sizeof(int32));
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  TestMappedArena("");
+#ifndef _MSC_VER
+  TestMappedArena(".");
+#endif
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -0,0 +1,215 @@
+// util/kaldi-mmap.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include "util/kaldi-mmap.h"
+
+namespace kaldi {
+
+bool MappedFile::Open(const std::string &filename) {
+  Close();
+#ifdef _MSC_VER
+  KALDI_WARN << "Memory-mapping files is not supported on this platform: "
+             << "cannot map " << filename;
+  return false;
+#else
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    KALDI_WARN << "Failed to open " << filename << " for memory-mapping: "
+               << strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    KALDI_WARN << "Cannot memory-map " << filename
+               << ": not a regular file, or stat failed.";
+    close(fd);
+    return false;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  if (size == 0) {
+    // mmap() of zero bytes is an error; we represent an empty file as
+    // data_ == NULL with filename_ set.
+    close(fd);
+    filename_ = filename;
+    return true;
+  }
+  void *addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping stays valid after the file descriptor is closed.
+  close(fd);
+  if (addr == MAP_FAILED) {
+    KALDI_WARN << "mmap() failed for " << filename << ": " << strerror(errno);
+    return false;
+  }
+  data_ = static_cast<const char*>(addr);
+  size_ = size;
+  filename_ = filename;
+  return true;
+#endif
+}
+
+void MappedFile::Close() {
+#ifndef _MSC_VER
+  if (data_ != NULL) {
+    if (munmap(const_cast<char*>(data_), size_) != 0)
+      KALDI_WARN << "munmap() failed for " << filename_ << ": "
+                 << strerror(errno);
+  }
+#endif
+  data_ = NULL;
+  size_ = 0;
+  filename_ = "";
+}
+
+
+MemoryStreambuf::MemoryStreambuf(const char *begin, size_t size):
+    begin_(const_cast<char*>(begin)), end_(const_cast<char*>(begin) + size) {
+  // std::streambuf requires non-const pointers, but since we never implement
+  // any of the "put" functions the memory is never written to.
+  setg(begin_, begin_, end_);
+}
+
+MemoryStreambuf::pos_type MemoryStreambuf::seekoff(
+    off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+  if (!(which & std::ios_base::in))
+    return pos_type(off_type(-1));
+  char *base;
+  if (dir == std::ios_base::beg) base = begin_;
+  else if (dir == std::ios_base::cur) base = gptr();
+  else base = end_;
+  if (off < begin_ - base || off > end_ - base)
+    return pos_type(off_type(-1));
+  setg(begin_, base + off, end_);
+  return pos_type(gptr() - begin_);
+}
+
+MemoryStreambuf::pos_type MemoryStreambuf::seekpos(
+    pos_type pos, std::ios_base::openmode which) {
+  return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+std::streamsize MemoryStreambuf::showmanyc() {
+  std::streamsize ans = egptr() - gptr();
+  return (ans == 0 ? -1 : ans);
+}
+
+MappedArena::MappedArena(const std::string &dir, size_t chunk_bytes):
+    chunk_bytes_(chunk_bytes), fd_(-1), file_size_(0), cur_(NULL),
+    cur_left_(0), bytes_allocated_(0) {
+  KALDI_ASSERT(chunk_bytes > 0);
+  if (dir.empty())
+    return;
+#ifdef _MSC_VER
+  KALDI_WARN << "Memory-mapped arenas are not supported on this platform; "
+             << "using memory instead of a file in " << dir;
+#else
+  std::string pattern = dir + "/kaldi-arena-XXXXXX";
+  std::vector<char> buf(pattern.begin(), pattern.end());
+  buf.push_back('\0');
+  fd_ = mkstemp(&(buf[0]));
+  if (fd_ < 0)
+    KALDI_ERR << "Failed to create a temporary file in " << dir << ": "
+              << strerror(errno);
+  filename_ = &(buf[0]);
+  // The mapping stays valid after the file is unlinked; the disk space is
+  // released when the file descriptor is closed and the chunks are unmapped.
+  unlink(filename_.c_str());
+  // mmap() offsets must be multiples of the page size, and so must the chunk
+  // sizes, since chunks are placed one after another in the file.
+  size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  chunk_bytes_ = ((chunk_bytes_ + page_size - 1) / page_size) * page_size;
+#endif
+}
+
+void *MappedArena::Allocate(size_t bytes) {
+  bytes = (bytes + 15) & ~static_cast<size_t>(15);
+  if (bytes > cur_left_)
+    NewChunk(bytes);
+  void *ans = cur_;
+  cur_ += bytes;
+  cur_left_ -= bytes;
+  bytes_allocated_ += bytes;
+  return ans;
+}
+
+void MappedArena::NewChunk(size_t min_bytes) {
+  size_t size = chunk_bytes_;
+  if (min_bytes > size)  // a multiple of chunk_bytes_, so of the page size.
+    size = ((min_bytes + chunk_bytes_ - 1) / chunk_bytes_) * chunk_bytes_;
+  Chunk chunk;
+  chunk.size = size;
+#ifndef _MSC_VER
+  if (fd_ >= 0) {
+    off_t offset = static_cast<off_t>(file_size_);
+#ifdef __linux__
+    // Reserve the disk space now, since running out of it when the pages are
+    // written back would kill the process with SIGBUS.
+    int ret = posix_fallocate(fd_, offset, static_cast<off_t>(size));
+    if (ret != 0)
+      KALDI_ERR << "Failed to extend " << filename_ << " to "
+                << (file_size_ + size) << " bytes: " << strerror(ret);
+#else
+    if (ftruncate(fd_, offset + static_cast<off_t>(size)) != 0)
+      KALDI_ERR << "Failed to extend " << filename_ << " to "
+                << (file_size_ + size) << " bytes: " << strerror(errno);
+#endif
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd_, offset);
+    if (addr == MAP_FAILED)
+      KALDI_ERR << "mmap() failed for " << filename_ << ": "
+                << strerror(errno);
+    chunk.data = static_cast<char*>(addr);
+    file_size_ += size;
+  } else {
+    chunk.data = new char[size];
+  }
+#else
+  chunk.data = new char[size];
+#endif
+  chunks_.push_back(chunk);
+  cur_ = chunk.data;
+  cur_left_ = size;
+}
+
+MappedArena::~MappedArena() {
+  for (size_t i = 0; i < chunks_.size(); i++) {
+#ifndef _MSC_VER
+    if (fd_ >= 0) {
+      munmap(chunks_[i].data, chunks_[i].size);
+      continue;
+    }
+#endif
+    delete [] chunks_[i].data;
+  }
+#ifndef _MSC_VER
+  if (fd_ >= 0)
+    close(fd_);
+#endif
+}
+
+
+}  // namespace kaldi
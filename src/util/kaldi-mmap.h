@@ -0,0 +1,140 @@
+// util/kaldi-mmap.h
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_KALDI_MMAP_H_
+#define KALDI_UTIL_KALDI_MMAP_H_
+
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/// MappedFile maps a regular file read-only into memory (with MAP_SHARED, so
+/// several processes reading the same file share the same physical pages via
+/// the page cache).  It is used by the "mmap" rspecifier option; see
+/// RandomAccessTableReaderMmapArchiveImpl in kaldi-table-inl.h.
+/// On platforms without mmap(), Open() always returns false.
+class MappedFile {
+ public:
+  MappedFile(): data_(NULL), size_(0) { }
+
+  /// Maps the file 'filename' (which must be an actual filename, not a pipe or
+  /// an offset into a file).  Returns true on success; on failure it prints a
+  /// warning and returns false.  Closes any previously mapped file.
+  bool Open(const std::string &filename);
+
+  /// Unmaps the file, if one was mapped.  Does not throw.
+  void Close();
+
+  bool IsOpen() const { return data_ != NULL || size_ != 0; }
+
+  /// Returns a pointer to the start of the mapped data (NULL if the file
+  /// was empty).
+  const char *Data() const { return data_; }
+
+  /// Returns the size of the mapped file in bytes.
+  size_t Size() const { return size_; }
+
+  const std::string &Filename() const { return filename_; }
+
+  ~MappedFile() { Close(); }
+ private:
+  const char *data_;
+  size_t size_;
+  std::string filename_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MappedFile);
+};
+
+
+/// MemoryStreambuf is a read-only std::streambuf that reads directly from a
+/// region of memory that it does not own (e.g. a region of a MappedFile), so
+/// that an std::istream constructed from it can be passed to the Read()
+/// functions of Holders and Kaldi objects without copying the data into a
+/// separate buffer.  It supports seeking (within the region).
+class MemoryStreambuf: public std::streambuf {
+ public:
+  MemoryStreambuf(const char *begin, size_t size);
+ protected:
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which = std::ios_base::in);
+  virtual pos_type seekpos(pos_type pos,
+                           std::ios_base::openmode which = std::ios_base::in);
+  virtual std::streamsize showmanyc();
+ private:
+  char *begin_;
+  char *end_;
+};
+
+/// MappedArena is an append-only allocator for large data structures that are
+/// written once and afterwards accessed only occasionally, such as the subsets
+/// of states kept by DeterminizeStar() when determinizing very large graphs.
+/// If it is given a directory, the memory comes from a temporary file in that
+/// directory mapped with MAP_SHARED, so under memory pressure the kernel can
+/// write the pages to disk and drop them instead of the process running out of
+/// memory.  The file is unlinked as soon as it is created, so it disappears when
+/// the arena is destroyed (or the process dies).  With an empty directory, or
+/// on platforms without mmap(), the memory comes from the heap (still in large
+/// chunks, which saves the per-allocation overhead of malloc).
+/// Memory cannot be freed individually; the destructor frees all of it, and
+/// does not call any destructors, so only use it for trivially destructible
+/// types.
+class MappedArena {
+ public:
+  /// 'chunk_bytes' is the size in which memory is requested from the system.
+  /// Throws if 'dir' is nonempty and we cannot create a file in it.
+  explicit MappedArena(const std::string &dir = "",
+                       size_t chunk_bytes = 64 << 20);
+
+  /// Returns 'bytes' bytes of uninitialized memory, aligned to 16 bytes.  The
+  /// memory stays valid until the arena is destroyed.  Throws on failure.
+  void *Allocate(size_t bytes);
+
+  /// Returns the total number of bytes returned by Allocate().
+  size_t BytesAllocated() const { return bytes_allocated_; }
+
+  /// Returns true if the memory is backed by a file.
+  bool IsFileBacked() const { return fd_ >= 0; }
+
+  ~MappedArena();
+
+ private:
+  // Adds a chunk of at least 'min_bytes' bytes and makes it the current chunk.
+  void NewChunk(size_t min_bytes);
+
+  struct Chunk {
+    char *data;
+    size_t size;
+  };
+  std::string filename_;  // for error messages only; the file is unlinked.
+  size_t chunk_bytes_;
+  int fd_;  // -1 if not file-backed.
+  size_t file_size_;
+  std::vector<Chunk> chunks_;
+  char *cur_;  // next free byte in the last chunk.
+  size_t cur_left_;  // bytes left in the last chunk.
+  size_t bytes_allocated_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MappedArena);
+};
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_KALDI_MMAP_H_
@@ -0,0 +1,280 @@
+// util/kaldi-table-index.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include "util/kaldi-table-index.h"
+#include "util/kaldi-io.h"
+#include "util/text-utils.h"
+
+namespace kaldi {
+
+int32 TableIndex::AddFile(const std::string &filename) {
+  if (!IsToken(filename))
+    KALDI_ERR << "Filenames in table indexes may not contain whitespace: '"
+              << filename << "'";
+  unordered_map<std::string, int32, StringHasher>::const_iterator iter =
+      file_map_.find(filename);
+  if (iter != file_map_.end())
+    return iter->second;
+  int32 ans = files_.size();
+  files_.push_back(filename);
+  file_map_[filename] = ans;
+  return ans;
+}
+
+void TableIndex::AddEntry(const std::string &key, int32 file_id,
+                          int64 offset) {
+  KALDI_ASSERT(file_id >= 0 && file_id < static_cast<int32>(files_.size()) &&
+               offset >= -1 && !key.empty());
+  key_data_.insert(key_data_.end(), key.begin(), key.end());
+  key_begin_.push_back(key_data_.size());
+  file_id_.push_back(file_id);
+  offset_.push_back(offset);
+  sorted_ = false;
+}
+
+int32 TableIndex::CompareKey(int32 i, const std::string &key) const {
+  size_t len = key_begin_[i + 1] - key_begin_[i],
+      min_len = std::min(len, key.size());
+  int32 c = (min_len == 0 ? 0 :
+             memcmp(&(key_data_[key_begin_[i]]), key.data(), min_len));
+  if (c != 0) return c;
+  return (len < key.size() ? -1 : (len > key.size() ? 1 : 0));
+}
+
+namespace {
+// Used in TableIndex::Finalize() to sort entry indexes on their keys without
+// materializing the keys as std::string.
+struct TableIndexKeyLess {
+  TableIndexKeyLess(const std::vector<char> &data,
+                    const std::vector<int64> &begin):
+      data_(data), begin_(begin) { }
+  bool operator () (int32 a, int32 b) const {
+    const char *pa = &(data_[0]) + begin_[a], *pb = &(data_[0]) + begin_[b];
+    size_t la = begin_[a + 1] - begin_[a], lb = begin_[b + 1] - begin_[b];
+    int c = memcmp(pa, pb, std::min(la, lb));
+    return (c < 0 || (c == 0 && la < lb));
+  }
+  const std::vector<char> &data_;
+  const std::vector<int64> &begin_;
+};
+}
+
+bool TableIndex::Finalize() {
+  int32 n = NumEntries();
+  std::vector<int32> order(n);
+  for (int32 i = 0; i < n; i++)
+    order[i] = i;
+  if (n > 0)
+    std::stable_sort(order.begin(), order.end(),
+                     TableIndexKeyLess(key_data_, key_begin_));
+
+  std::vector<char> key_data;
+  std::vector<int64> key_begin;
+  std::vector<int32> file_id(n);
+  std::vector<int64> offset(n);
+  key_data.reserve(key_data_.size());
+  key_begin.reserve(n + 1);
+  key_begin.push_back(0);
+  for (int32 i = 0; i < n; i++) {
+    int32 j = order[i];
+    key_data.insert(key_data.end(), key_data_.begin() + key_begin_[j],
+                    key_data_.begin() + key_begin_[j + 1]);
+    key_begin.push_back(key_data.size());
+    file_id[i] = file_id_[j];
+    offset[i] = offset_[j];
+  }
+  key_data_.swap(key_data);
+  key_begin_.swap(key_begin);
+  file_id_.swap(file_id);
+  offset_.swap(offset);
+  sorted_ = true;
+  for (int32 i = 0; i + 1 < n; i++) {
+    if (CompareKey(i, Key(i + 1)) == 0) {
+      KALDI_WARN << "Duplicate key " << Key(i) << " in table index.";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TableIndex::Lookup(const std::string &key, int32 *file_id,
+                        int64 *offset) const {
+  KALDI_ASSERT(sorted_ && "You must call Finalize() before Lookup().");
+  int32 lo = 0, hi = NumEntries();
+  while (lo < hi) {  // find first entry whose key is >= 'key'.
+    int32 mid = lo + (hi - lo) / 2;
+    if (CompareKey(mid, key) < 0) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo < NumEntries() && CompareKey(lo, key) == 0) {
+    *file_id = file_id_[lo];
+    *offset = offset_[lo];
+    return true;
+  }
+  return false;
+}
+
+void TableIndex::Clear() {
+  files_.clear();
+  file_map_.clear();
+  key_data_.clear();
+  key_begin_.clear();
+  key_begin_.push_back(0);
+  file_id_.clear();
+  offset_.clear();
+  sorted_ = true;
+}
+
+void TableIndex::Write(std::ostream &os, bool binary) const {
+  KALDI_ASSERT(sorted_ && "You must call Finalize() before Write().");
+  WriteToken(os, binary, "<TableIndex>");
+  WriteToken(os, binary, "<Files>");
+  int32 num_files = files_.size();
+  WriteBasicType(os, binary, num_files);
+  for (int32 i = 0; i < num_files; i++)
+    WriteToken(os, binary, files_[i]);
+  WriteToken(os, binary, "<KeyData>");
+  WriteIntegerVector(os, binary, key_data_);
+  WriteToken(os, binary, "<KeyBegin>");
+  WriteIntegerVector(os, binary, key_begin_);
+  WriteToken(os, binary, "<FileId>");
+  WriteIntegerVector(os, binary, file_id_);
+  WriteToken(os, binary, "<Offset>");
+  WriteIntegerVector(os, binary, offset_);
+  WriteToken(os, binary, "</TableIndex>");
+}
+
+void TableIndex::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<TableIndex>");
+  ExpectToken(is, binary, "<Files>");
+  int32 num_files;
+  ReadBasicType(is, binary, &num_files);
+  if (num_files < 0)
+    KALDI_ERR << "Invalid table index (number of files is " << num_files << ")";
+  files_.resize(num_files);
+  file_map_.clear();
+  for (int32 i = 0; i < num_files; i++) {
+    ReadToken(is, binary, &(files_[i]));
+    file_map_[files_[i]] = i;
+  }
+  ExpectToken(is, binary, "<KeyData>");
+  ReadIntegerVector(is, binary, &key_data_);
+  ExpectToken(is, binary, "<KeyBegin>");
+  ReadIntegerVector(is, binary, &key_begin_);
+  ExpectToken(is, binary, "<FileId>");
+  ReadIntegerVector(is, binary, &file_id_);
+  ExpectToken(is, binary, "<Offset>");
+  ReadIntegerVector(is, binary, &offset_);
+  ExpectToken(is, binary, "</TableIndex>");
+  size_t n = file_id_.size();
+  if (offset_.size() != n || key_begin_.size() != n + 1 ||
+      key_begin_[0] != 0 ||
+      key_begin_.back() != static_cast<int64>(key_data_.size()))
+    KALDI_ERR << "Invalid table index: sizes do not match.";
+  for (size_t i = 0; i < n; i++) {
+    if (file_id_[i] < 0 || file_id_[i] >= num_files ||
+        key_begin_[i + 1] <= key_begin_[i] ||
+        (i > 0 && CompareKey(i - 1, Key(i)) >= 0))
+      KALDI_ERR << "Invalid table index: bad or unsorted entry " << i;
+  }
+  sorted_ = true;
+}
+
+
+void SplitScriptEntry(const std::string &rxfilename,
+                      std::string *file, int64 *offset) {
+  std::string prefix(rxfilename), suffix;
+  if (!rxfilename.empty() && rxfilename[rxfilename.size() - 1] == ']') {
+    // a range specifier such as "[0:9]"; keep it with the filename.
+    size_t pos = rxfilename.rfind('[');
+    if (pos != std::string::npos) {
+      prefix = rxfilename.substr(0, pos);
+      suffix = rxfilename.substr(pos);
+    }
+  }
+  *offset = -1;
+  if (ClassifyRxfilename(prefix) == kOffsetFileInput) {
+    size_t pos = prefix.rfind(':');
+    int64 o;
+    if (pos != std::string::npos &&
+        ConvertStringToInteger(prefix.substr(pos + 1), &o) && o >= 0) {
+      *offset = o;
+      prefix.resize(pos);
+    }
+  }
+  *file = prefix + suffix;
+}
+
+std::string JoinScriptEntry(const std::string &file, int64 offset) {
+  if (offset < 0)
+    return file;
+  std::ostringstream os;
+  size_t pos;
+  if (!file.empty() && file[file.size() - 1] == ']' &&
+      (pos = file.rfind('[')) != std::string::npos)
+    os << file.substr(0, pos) << ':' << offset << file.substr(pos);
+  else
+    os << file << ':' << offset;
+  return os.str();
+}
+
+std::string TableIndexFilename(const std::string &filename) {
+  return filename + ".idx";
+}
+
+// Returns true if the modification time in 'a' is later than that in 'b'.
+static bool StatIsNewer(const struct stat &a, const struct stat &b) {
+#if defined(__linux__)
+  if (a.st_mtim.tv_sec != b.st_mtim.tv_sec)
+    return a.st_mtim.tv_sec > b.st_mtim.tv_sec;
+  return a.st_mtim.tv_nsec > b.st_mtim.tv_nsec;
+#else
+  return a.st_mtime > b.st_mtime;
+#endif
+}
+
+bool ReadTableIndexSidecar(const std::string &filename, TableIndex *index) {
+  std::string index_filename = TableIndexFilename(filename);
+  struct stat index_stat, file_stat;
+  if (stat(index_filename.c_str(), &index_stat) != 0)
+    return false;  // No sidecar; this is the normal case.
+  if (stat(filename.c_str(), &file_stat) == 0 &&
+      StatIsNewer(file_stat, index_stat)) {
+    KALDI_WARN << "Ignoring table index " << index_filename << " as it is "
+               << "older than " << filename;
+    return false;
+  }
+  try {
+    bool binary;
+    Input ki(index_filename, &binary);
+    index->Read(ki.Stream(), binary);
+    return true;
+  } catch (const std::exception &) {
+    KALDI_WARN << "Failed to read table index " << index_filename
+               << ", ignoring it.";
+    index->Clear();
+    return false;
+  }
+}
+
+}  // namespace kaldi
@@ -0,0 +1,121 @@
+// util/kaldi-table-index.h
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_KALDI_TABLE_INDEX_H_
+#define KALDI_UTIL_KALDI_TABLE_INDEX_H_
+
+#include <string>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "util/stl-utils.h"
+
+namespace kaldi {
+
+/// TableIndex is a compact, sorted index from keys to (file-id, byte-offset)
+/// pairs, where file-id indexes a list of archive filenames.  It is what we
+/// store in the ".idx" sidecar files that are read by the "mmap" rspecifier
+/// option (see RandomAccessTableReaderMmapArchiveImpl) and by random-access
+/// readers of scp files (see RandomAccessTableReaderScriptImpl, and
+/// SplitScriptEntry() below for how scp entries are stored).  Sidecar files
+/// are created by the program build-table-index.  The keys are stored
+/// concatenated in a single array, so reading or writing an index of millions
+/// of entries is a handful of large reads or writes, and lookup is a binary
+/// search.
+class TableIndex {
+ public:
+  TableIndex(): sorted_(true) { key_begin_.push_back(0); }
+
+  /// Adds a filename and returns its file-id.  If the filename is already
+  /// present it returns the existing id.  Filenames may not contain
+  /// whitespace.
+  int32 AddFile(const std::string &filename);
+
+  /// Adds an entry.  You must call Finalize() after adding entries and before
+  /// calling Lookup() or Write().  'offset' may be -1, meaning "no offset"
+  /// (used for scp entries that are not offsets into a file).
+  void AddEntry(const std::string &key, int32 file_id, int64 offset);
+
+  /// Sorts the entries on key.  Returns false (and prints a warning) if
+  /// there were duplicate keys.
+  bool Finalize();
+
+  /// Looks up 'key' by binary search.  If found, outputs the file-id
+  /// and byte offset and returns true.
+  bool Lookup(const std::string &key, int32 *file_id, int64 *offset) const;
+
+  int32 NumEntries() const { return file_id_.size(); }
+  int32 NumFiles() const { return files_.size(); }
+  const std::string &File(int32 file_id) const { return files_[file_id]; }
+  /// Returns the i'th key in sorted order (0 <= i < NumEntries()).
+  std::string Key(int32 i) const {
+    return std::string(&(key_data_[key_begin_[i]]),
+                       key_begin_[i + 1] - key_begin_[i]);
+  }
+  int32 FileId(int32 i) const { return file_id_[i]; }
+  int64 Offset(int32 i) const { return offset_[i]; }
+
+  void Clear();
+
+  void Write(std::ostream &os, bool binary) const;
+  void Read(std::istream &is, bool binary);
+
+ private:
+  // Compares key 'i' with 'key' as for std::string::compare.
+  int32 CompareKey(int32 i, const std::string &key) const;
+
+  std::vector<std::string> files_;
+  unordered_map<std::string, int32, StringHasher> file_map_;  // inverse of
+                                                              // files_.
+  // All keys, concatenated without separators; key i is the range
+  // [key_begin_[i], key_begin_[i+1]) of key_data_.
+  std::vector<char> key_data_;
+  std::vector<int64> key_begin_;
+  std::vector<int32> file_id_;
+  std::vector<int64> offset_;
+  bool sorted_;
+};
+
+
+/// In indexes of scp files, the "file" of an entry is the entry's rxfilename
+/// with any byte offset removed, and the offset is stored separately, so that
+/// e.g. all entries "foo.ark:1234" of an scp written by "ark,scp:" share a
+/// single file.  SplitScriptEntry() splits e.g. "foo.ark:1234" into "foo.ark"
+/// and 1234, and "foo.ark:1234[0:9]" into "foo.ark[0:9]" and 1234; entries
+/// that are not offsets into files (e.g. "foo.mat") get offset -1.
+void SplitScriptEntry(const std::string &rxfilename,
+                      std::string *file, int64 *offset);
+
+/// The inverse of SplitScriptEntry().
+std::string JoinScriptEntry(const std::string &file, int64 offset);
+
+/// Returns the filename of the index sidecar for an archive or script file,
+/// i.e. filename + ".idx".
+std::string TableIndexFilename(const std::string &filename);
+
+/// Reads the index in the sidecar file for 'filename' (see
+/// TableIndexFilename()), if it exists and is not older than 'filename'
+/// itself.  Returns true if it was read; returns false if there was no
+/// usable index (printing a warning if it existed but was stale or could not
+/// be read).
+bool ReadTableIndexSidecar(const std::string &filename, TableIndex *index);
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_KALDI_TABLE_INDEX_H_
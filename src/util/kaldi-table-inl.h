@@ -24,8 +24,14 @@
 #define KALDI_UTIL_KALDI_TABLE_INL_H_
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <utility>
 #include <vector>
 #include <errno.h>
@@ -34,6 +40,9 @@
 #include "util/text-utils.h"
 #include "util/stl-utils.h"  // for StringHasher.
 #include "util/kaldi-semaphore.h"
+#include "util/kaldi-mmap.h"
+#include "util/kaldi-table-index.h"
+#include "util/kaldi-compression.h"
 
 
 namespace kaldi {
@@ -41,6 +50,47 @@ namespace kaldi {
 /// \addtogroup table_impl_types
 /// @{
 
+// ReadTableObject reads an object with holder->Read(is), first decompressing
+// it if it was written with the "lz4" wspecifier option (see
+// kaldi-compression.h).  All the table readers read objects through this.
+template<class Holder>
+bool ReadTableObject(std::istream &is, Holder *holder) {
+  if (!PeekCompressedObject(is))
+    return holder->Read(is);
+  std::string object;
+  if (!ReadCompressedObject(is, &object))
+    return false;
+  MemoryStreambuf buf(object.data(), object.size());
+  std::istream object_is(&buf);
+  return holder->Read(object_is);
+}
+
+// TableObjectWriter<Holder>::Write() writes an object with Holder::Write(), or
+// HolderPackedWriter<Holder>::Write() if the "packed" wspecifier option was
+// given, compressing it if the "lz4" option was given (in binary mode).  All
+// the table writers write objects through this.  It is specialized below for
+// TableWriterSerializedHolder, whose objects are already serialized.
+template<class Holder>
+struct TableObjectWriter {
+  static bool Write(std::ostream &os, const WspecifierOptions &opts,
+                    const typename Holder::T &value) {
+    if (!opts.compress || !opts.binary)
+      return WriteUncompressed(os, opts, value);
+    std::ostringstream object_os;
+    return WriteUncompressed(object_os, opts, value) &&
+        WriteCompressedObject(os, object_os.str());
+  }
+ private:
+  static bool WriteUncompressed(std::ostream &os,
+                                const WspecifierOptions &opts,
+                                const typename Holder::T &value) {
+    if (opts.packed && opts.binary)
+      return HolderPackedWriter<Holder>::Write(os, value);
+    else
+      return Holder::Write(os, opts.binary, value);
+  }
+};
+
 template<class Holder> class SequentialTableReaderImplBase {
  public:
   typedef typename Holder::T T;
@@ -311,7 +361,7 @@ template<class Holder>  class SequentialTableReaderScriptImpl:
                    << PrintableRxfilename(data_rxfilename_);
         return false;
       } else {
-        if (holder_.Read(data_input_.Stream())) {
+        if (ReadTableObject(data_input_.Stream(), &holder_)) {
           state_ = kHaveObject;
         } else {  // holder_ will not contain data.
           KALDI_WARN << "Failed to load object from "
@@ -567,7 +617,7 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
       return;
     }
     if (c != '\n') is.get();  // Consume the space or tab.
-    if (holder_.Read(is)) {
+    if (ReadTableObject(is, &holder_)) {
       state_ = kHaveObject;
       return;
     } else {
@@ -853,6 +903,276 @@ class SequentialTableReaderBackgroundImpl:
 
 };
 
+// SequentialTableReaderParallelScriptImpl is used for script files when the
+// "bgN" option is given with N > 1 (e.g. "bg4,scp:feats.scp").  N worker
+// threads each take the next line of the scp file and read the corresponding
+// object (with their own Input object, so offsets into the same archive are
+// handled by seeking), so that the Holder::Read() calls, which for compressed
+// matrices is where the decompression happens, run in parallel.  The objects
+// are delivered to the caller in the order of the scp file.  At most
+// 2 * N objects are held in memory at any time (apart from the current one).
+// For archives, "bgN" behaves like "bg" because objects in archives have to
+// be parsed one after another.
+template<class Holder>
+class SequentialTableReaderParallelScriptImpl:
+      public SequentialTableReaderImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  SequentialTableReaderParallelScriptImpl(): is_open_(false) { }
+
+  virtual bool Open(const std::string &rspecifier) {
+    KALDI_ASSERT(!is_open_);
+    rspecifier_ = rspecifier;
+    RspecifierType rs = ClassifyRspecifier(rspecifier, &script_rxfilename_,
+                                           &opts_);
+    KALDI_ASSERT(rs == kScriptRspecifier && opts_.background_threads > 1);
+    bool binary;
+    if (!script_input_.Open(script_rxfilename_, &binary)) {
+      KALDI_WARN << "Failed to open script file "
+                 << PrintableRxfilename(script_rxfilename_);
+      return false;
+    }
+    if (binary) {
+      KALDI_WARN << "Script file should not be binary file.";
+      script_input_.Close();
+      return false;
+    }
+    int32 num_threads = opts_.background_threads;
+    slots_.resize(2 * num_threads);
+    next_line_ = 0;
+    next_output_ = 0;
+    scp_done_ = false;
+    scp_error_ = false;
+    script_status_ = 0;
+    closing_ = false;
+    have_object_ = false;
+    is_open_ = true;
+    for (int32 i = 0; i < num_threads; i++)
+      threads_.push_back(std::thread(
+          SequentialTableReaderParallelScriptImpl<Holder>::run, this));
+    Next();
+    return true;
+  }
+
+  virtual bool IsOpen() const { return is_open_; }
+
+  virtual bool Done() const {
+    KALDI_ASSERT(is_open_);
+    return !have_object_;
+  }
+
+  virtual std::string Key() {
+    if (!have_object_)
+      KALDI_ERR << "Calling Key() at the wrong time.";
+    return key_;
+  }
+
+  virtual T &Value() {
+    if (!have_object_)
+      KALDI_ERR << "Calling Value() at the wrong time.";
+    if (!object_ok_)
+      KALDI_ERR << "Failed to load object from "
+                << PrintableRxfilename(entry_)
+                << " (to suppress this error, add the permissive "
+                << "(p, ) option to the rspecifier.";
+    return holder_.Value();
+  }
+
+  virtual void FreeCurrent() {
+    if (!have_object_)
+      KALDI_ERR << "Calling FreeCurrent() at the wrong time.";
+    holder_.Clear();
+  }
+
+  virtual void SwapHolder(Holder *other_holder) {
+    (void) Value();
+    holder_.Swap(other_holder);
+  }
+
+  virtual void Next() {
+    KALDI_ASSERT(is_open_);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      Slot &slot = slots_[next_output_ % slots_.size()];
+      while (true) {
+        if (slot.state == kSlotDone) break;
+        if (scp_done_ && next_output_ == next_line_) {
+          // There are no more lines, and nothing is being read.
+          have_object_ = false;
+          holder_.Clear();
+          return;
+        }
+        output_cond_.wait(lock);
+      }
+      next_output_++;
+      slot.state = kSlotFree;
+      input_cond_.notify_all();
+      if (slot.ok || !opts_.permissive) {
+        key_.swap(slot.key);
+        entry_.swap(slot.entry);
+        holder_.Swap(&slot.holder);
+        slot.holder.Clear();
+        object_ok_ = slot.ok;
+        have_object_ = true;
+        return;
+      }
+      // else in permissive mode we skip objects that could not be read.
+      slot.holder.Clear();
+    }
+  }
+
+  virtual bool Close() {
+    KALDI_ASSERT(is_open_);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      closing_ = true;
+      input_cond_.notify_all();
+    }
+    for (size_t i = 0; i < threads_.size(); i++)
+      threads_[i].join();
+    threads_.clear();
+    if (script_input_.IsOpen())
+      script_status_ = script_input_.Close();
+    for (size_t i = 0; i < slots_.size(); i++)
+      slots_[i].holder.Clear();
+    slots_.clear();
+    holder_.Clear();
+    is_open_ = false;
+    have_object_ = false;
+    if (scp_error_ || script_status_ != 0) {
+      if (opts_.permissive) {
+        KALDI_WARN << "Close() called on scp file with read error, ignoring the"
+            " error because permissive mode specified.";
+        return true;
+      }
+      return false;
+    }
+    return true;
+  }
+
+  virtual ~SequentialTableReaderParallelScriptImpl() {
+    if (is_open_ && !Close())
+      KALDI_ERR << "TableReader: reading script file failed: from scp "
+                << PrintableRxfilename(script_rxfilename_);
+  }
+
+ private:
+  static void run(SequentialTableReaderParallelScriptImpl<Holder> *object) {
+    object->RunWorker();
+  }
+
+  // This is the function that each of the worker threads runs.
+  void RunWorker() {
+    Input data_input;  // kept open between objects so that offsets into the
+                       // same archive just need a seek.
+    Holder full_holder;  // used when the scp line has a range.
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      while (!closing_ && !scp_done_ &&
+             next_line_ >= next_output_ + slots_.size())
+        input_cond_.wait(lock);
+      if (closing_ || scp_done_)
+        break;
+      Slot &slot = slots_[next_line_ % slots_.size()];
+      KALDI_ASSERT(slot.state == kSlotFree);
+      // Reading the scp line is done while holding the lock, to keep the
+      // lines in order; it's cheap compared to reading the object.
+      std::string line, rest;
+      if (!std::getline(script_input_.Stream(), line)) {
+        scp_done_ = true;
+        script_status_ = script_input_.Close();
+        output_cond_.notify_all();
+        break;
+      }
+      SplitStringOnFirstSpace(line, &slot.key, &rest);
+      std::string data_rxfilename, range;
+      if (slot.key.empty() || rest.empty() ||
+          (rest[rest.size() - 1] == ']' &&
+           !ExtractRangeSpecifier(rest, &data_rxfilename, &range))) {
+        KALDI_WARN << "We got an invalid line in the scp file. "
+                   << "It should look like: some_key 1.ark:10, got: "
+                   << line;
+        scp_done_ = true;
+        scp_error_ = true;
+        output_cond_.notify_all();
+        break;
+      }
+      if (range.empty())
+        data_rxfilename = rest;
+      slot.entry = rest;
+      slot.state = kSlotReading;
+      next_line_++;
+      lock.unlock();
+
+      bool ok;
+      if (Holder::IsReadInBinary())
+        ok = data_input.Open(data_rxfilename, NULL);
+      else
+        ok = data_input.OpenTextMode(data_rxfilename);
+      if (!ok) {
+        KALDI_WARN << "Failed to open file "
+                   << PrintableRxfilename(data_rxfilename);
+      } else if (range.empty()) {
+        ok = ReadTableObject(data_input.Stream(), &slot.holder);
+      } else {
+        ok = ReadTableObject(data_input.Stream(), &full_holder) &&
+            slot.holder.ExtractRange(full_holder, range);
+        full_holder.Clear();
+      }
+      if (!ok)
+        KALDI_WARN << "Failed to load object from "
+                   << PrintableRxfilename(rest);
+
+      lock.lock();
+      slot.ok = ok;
+      slot.state = kSlotDone;
+      output_cond_.notify_all();
+    }
+    // Wake up any other workers so they can see scp_done_.
+    input_cond_.notify_all();
+  }
+
+  enum SlotState { kSlotFree, kSlotReading, kSlotDone };
+  struct Slot {
+    std::string key;
+    std::string entry;  // the scp entry, e.g. "foo.ark:1234"
+    Holder holder;
+    bool ok;
+    SlotState state;
+    Slot(): ok(false), state(kSlotFree) { }
+    Slot(const Slot &other): ok(false), state(kSlotFree) { }  // for resize().
+  };
+
+  std::string rspecifier_;
+  RspecifierOptions opts_;
+  std::string script_rxfilename_;
+  Input script_input_;  // read by the worker threads, under mutex_.
+
+  // Slots form a circular buffer: line n of the scp file goes into
+  // slots_[n % slots_.size()].  The members below are protected by mutex_.
+  std::vector<Slot> slots_;
+  size_t next_line_;    // index of the next scp line to be read.
+  size_t next_output_;  // index of the next line to be given to the caller.
+  bool scp_done_;       // true if we reached the end of the scp file (or an
+                        // invalid line).
+  bool scp_error_;      // true if we encountered an invalid scp line.
+  int32 script_status_;  // exit status of script_input_ (for pipes).
+  bool closing_;        // set by Close() to tell the workers to exit.
+  std::mutex mutex_;
+  std::condition_variable input_cond_;   // workers wait on this.
+  std::condition_variable output_cond_;  // Next() waits on this.
+  std::vector<std::thread> threads_;
+
+  // The current object, owned by the calling thread.
+  bool is_open_;
+  bool have_object_;
+  bool object_ok_;
+  std::string key_;
+  std::string entry_;
+  Holder holder_;
+};
+
 template<class Holder>
 SequentialTableReader<Holder>::SequentialTableReader(const std::string
                                                      &rspecifier): impl_(NULL) {
@@ -871,9 +1191,24 @@ bool SequentialTableReader<Holder>::Open(const std::string &rspecifier) {
   RspecifierType wt = ClassifyRspecifier(rspecifier, NULL, &opts);
   switch (wt) {
     case kArchiveRspecifier:
+      if (opts.background && opts.background_threads > 1)
+        KALDI_WARN << "The 'bg" << opts.background_threads << "' option "
+                   << "reads archives with only one background thread, like "
+                   << "'bg', because their objects have to be parsed one "
+                   << "after another; to read in parallel, use an scp file: "
+                   << rspecifier;
       impl_ = new SequentialTableReaderArchiveImpl<Holder>();
       break;
     case kScriptRspecifier:
+      if (opts.background && opts.background_threads > 1) {
+        impl_ = new SequentialTableReaderParallelScriptImpl<Holder>();
+        if (!impl_->Open(rspecifier)) {
+          delete impl_;
+          impl_ = NULL;
+          return false;
+        }
+        return true;
+      }
       impl_ = new SequentialTableReaderScriptImpl<Holder>();
       break;
     case kNoRspecifier: default:
@@ -973,6 +1308,16 @@ template<class Holder> class TableWriterImplBase {
   // TableWriter::Write returned an exit status.
   virtual bool Write(const std::string &key, const T &value) = 0;
 
+  // Like Write(), but the object is the one that 'make_value' puts in a
+  // default-constructed T.  Implementations that write in the background call
+  // make_value in a background thread; this default version calls it at once.
+  virtual bool WriteDeferred(const std::string &key,
+                             const std::function<void(T*)> &make_value) {
+    T value;
+    make_value(&value);
+    return Write(key, value);
+  }
+
   // Flush will flush any archive; it does not return error status,
   //  any errors will be reported on the next Write or Close.
   virtual void Flush() = 0;
@@ -1053,7 +1398,7 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
     if (!IsToken(key))  // e.g. empty string or has spaces...
       KALDI_ERR << "Using invalid key " << key;
     output_.Stream() << key << ' ';
-    if (!Holder::Write(output_.Stream(), opts_.binary, value)) {
+    if (!TableObjectWriter<Holder>::Write(output_.Stream(), opts_, value)) {
       KALDI_WARN << "Write failure to "
                  << PrintableWxfilename(archive_wxfilename_);
       state_ = kWriteError;
@@ -1216,7 +1561,7 @@ class TableWriterScriptImpl: public TableWriterImplBase<Holder> {
                  << PrintableWxfilename(wxfilename);
       return false;
     }
-    if (!Holder::Write(output.Stream(), opts_.binary, value)
+    if (!TableObjectWriter<Holder>::Write(output.Stream(), opts_, value)
         || !output.Close()) {
       KALDI_WARN << "Failed to write data to "
                  << PrintableWxfilename(wxfilename);
@@ -1381,7 +1726,8 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
     std::ostream &script_os = script_output_.Stream();
     script_output_.Stream() << key << ' ' << offset_rxfilename << '\n';
 
-    if (!Holder::Write(archive_output_.Stream(), opts_.binary, value)) {
+    if (!TableObjectWriter<Holder>::Write(archive_output_.Stream(), opts_,
+                                           value)) {
       KALDI_WARN << "Write failure to"
                  << PrintableWxfilename(archive_wxfilename_);
       state_ = kWriteError;
@@ -1463,6 +1809,286 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
 };
 
 
+// TableWriterSerializedHolder is used by TableWriterBackgroundImpl.  Its
+// type T is the already-serialized form of an object of type Holder::T (the
+// output of Holder::Write() for the archive's binary/text mode), which its
+// Write() function just copies to the stream.  This lets us reuse the regular
+// TableWriter implementations for the actual writing, while the serialization
+// happens in background threads.
+template<class Holder>
+class TableWriterSerializedHolder {
+ public:
+  typedef std::string T;
+  static bool Write(std::ostream &os, bool binary, const T &t) {
+    os.write(t.data(), t.size());
+    return os.good();
+  }
+};
+
+// The serialized objects are compressed, if requested, when they are
+// serialized, so they are just copied here.
+template<class Holder>
+struct TableObjectWriter<TableWriterSerializedHolder<Holder> > {
+  static bool Write(std::ostream &os, const WspecifierOptions &opts,
+                    const std::string &value) {
+    return TableWriterSerializedHolder<Holder>::Write(os, opts.binary, value);
+  }
+};
+
+// TableWriterBackgroundImpl is the implementation of TableWriter that is used
+// when the "bg" or "bgN" wspecifier option is given (e.g. "ark,bg4:foo.ark").
+// Write() copies the object and returns immediately; N background threads
+// (N = 1 for "bg") call Holder::Write() to serialize objects in parallel (and,
+// for WriteDeferred(), first call make_value to produce them), and
+// the serialized objects are written, in the order in which Write() was
+// called, by a regular TableWriter implementation templated on
+// TableWriterSerializedHolder<Holder>.  So the archive (and scp) are exactly
+// as they would be without the option.  At most 4N objects may be waiting
+// to be written; Write() blocks when that limit is reached.  Errors in
+// writing are reported by a later call to Write(), or by Flush() or Close().
+// This requires Holder::T to be copy-constructible; see
+// TableWriterBackgroundFactory.
+template<class Holder>
+class TableWriterBackgroundImpl: public TableWriterImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  TableWriterBackgroundImpl(): base_writer_(NULL) { }
+
+  virtual bool Open(const std::string &wspecifier) {
+    KALDI_ASSERT(base_writer_ == NULL);
+    WspecifierType wtype = ClassifyWspecifier(wspecifier, NULL, NULL, &opts_);
+    typedef TableWriterSerializedHolder<Holder> SHolder;
+    switch (wtype) {
+      case kBothWspecifier:
+        base_writer_ = new TableWriterBothImpl<SHolder>();
+        break;
+      case kArchiveWspecifier:
+        base_writer_ = new TableWriterArchiveImpl<SHolder>();
+        break;
+      case kScriptWspecifier:
+        base_writer_ = new TableWriterScriptImpl<SHolder>();
+        break;
+      case kNoWspecifier: default:
+        KALDI_ERR << "Invalid wspecifier " << wspecifier;  // code error.
+    }
+    if (!base_writer_->Open(wspecifier)) {
+      delete base_writer_;
+      base_writer_ = NULL;
+      return false;
+    }
+    max_in_flight_ = 4 * opts_.background_threads;
+    num_submitted_ = 0;
+    num_written_ = 0;
+    writing_ = false;
+    closing_ = false;
+    write_error_ = false;
+    for (int32 i = 0; i < opts_.background_threads; i++)
+      threads_.push_back(std::thread(TableWriterBackgroundImpl<Holder>::run,
+                                     this));
+    return true;
+  }
+
+  virtual bool IsOpen() const { return base_writer_ != NULL; }
+
+  virtual bool Write(const std::string &key, const T &value) {
+    if (base_writer_ == NULL)
+      KALDI_ERR << "Write called on invalid stream";
+    if (!IsToken(key))  // e.g. empty string or has spaces...
+      KALDI_ERR << "Using invalid key " << key;
+    // Copy the object before taking the lock.
+    return Submit(new Job(key, new T(value)));
+  }
+
+  virtual bool WriteDeferred(const std::string &key,
+                             const std::function<void(T*)> &make_value) {
+    if (base_writer_ == NULL)
+      KALDI_ERR << "Write called on invalid stream";
+    if (!IsToken(key))  // e.g. empty string or has spaces...
+      KALDI_ERR << "Using invalid key " << key;
+    Job *job = new Job(key, NULL);
+    job->make_value = make_value;
+    return Submit(job);
+  }
+
+  virtual void Flush() {
+    if (base_writer_ == NULL) {
+      KALDI_WARN << "Flush called on not-open writer.";
+      return;
+    }
+    WaitForAll();
+    base_writer_->Flush();
+  }
+
+  virtual bool Close() {
+    if (base_writer_ == NULL)
+      KALDI_ERR << "Close called on a stream that was not open.";
+    WaitForAll();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      closing_ = true;
+      work_cond_.notify_all();
+    }
+    for (size_t i = 0; i < threads_.size(); i++)
+      threads_[i].join();
+    threads_.clear();
+    // If there was a write error, the jobs that were not written remain.
+    for (size_t i = 0; i < in_flight_.size(); i++)
+      delete in_flight_[i];
+    in_flight_.clear();
+    pending_.clear();
+    bool ans = base_writer_->Close() && !write_error_;
+    delete base_writer_;
+    base_writer_ = NULL;
+    return ans;
+  }
+
+  virtual ~TableWriterBackgroundImpl() {
+    if (base_writer_ != NULL && !Close())
+      KALDI_ERR << "At TableWriter destructor: Write failed or stream close "
+                << "failed (relates to ',bg' option)";
+  }
+
+ private:
+  struct Job {
+    std::string key;
+    T *value;  // owned here; deleted once serialized.
+    // If set (for WriteDeferred()), 'value' is NULL until a worker thread
+    // creates it with this.
+    std::function<void(T*)> make_value;
+    std::string serialized;
+    size_t index;
+    bool done;
+    Job(const std::string &k, T *v): key(k), value(v), index(0),
+                                     done(false) { }
+    ~Job() { delete value; }
+  };
+
+  // Queues 'job' (which it takes ownership of) for the worker threads, first
+  // waiting while the maximum number of objects are in flight.
+  bool Submit(Job *job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (num_submitted_ - num_written_ >= max_in_flight_ && !write_error_)
+      done_cond_.wait(lock);
+    if (write_error_) {
+      delete job;
+      return false;
+    }
+    job->index = num_submitted_++;
+    pending_.push_back(job);
+    in_flight_.push_back(job);
+    work_cond_.notify_one();
+    return true;
+  }
+
+  static void run(TableWriterBackgroundImpl<Holder> *object) {
+    object->RunWorker();
+  }
+
+  // Waits until all objects passed to Write() have been written (or there was
+  // an error).
+  void WaitForAll() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (num_written_ != num_submitted_ && !write_error_)
+      done_cond_.wait(lock);
+  }
+
+  void RunWorker() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      while (pending_.empty() && !closing_)
+        work_cond_.wait(lock);
+      if (pending_.empty())
+        break;  // closing_ is true.
+      Job *job = pending_.front();
+      pending_.pop_front();
+      lock.unlock();
+
+      bool ok = true;
+      if (job->make_value) {
+        job->value = new T();
+        try {
+          job->make_value(job->value);
+        } catch (const std::exception &e) {
+          // Report it as a write error; an exception must not escape the
+          // thread.
+          KALDI_WARN << "Error creating object with key " << job->key
+                     << ": " << e.what();
+          ok = false;
+        }
+        job->make_value = nullptr;  // free what it captured.
+      }
+      std::ostringstream os;
+      if (ok)
+        ok = TableObjectWriter<Holder>::Write(os, opts_, *(job->value));
+      job->serialized = os.str();
+      delete job->value;  // free memory as early as possible.
+      job->value = NULL;
+
+      lock.lock();
+      if (!ok) {
+        KALDI_WARN << "Error serializing object with key " << job->key;
+        write_error_ = true;
+        done_cond_.notify_all();
+      }
+      job->done = true;
+      // Whichever thread finishes the job at the head of the queue writes all
+      // the completed jobs that follow it, so the output order is the order
+      // of Write() calls.
+      if (writing_)
+        continue;
+      writing_ = true;
+      while (!write_error_ && !in_flight_.empty() && in_flight_.front()->done) {
+        Job *next = in_flight_.front();
+        in_flight_.pop_front();
+        lock.unlock();
+        bool write_ok = base_writer_->Write(next->key, next->serialized);
+        delete next;
+        lock.lock();
+        if (!write_ok)
+          write_error_ = true;
+        num_written_++;
+        done_cond_.notify_all();
+      }
+      writing_ = false;
+    }
+  }
+
+  typedef TableWriterSerializedHolder<Holder> SHolder;
+  TableWriterImplBase<SHolder> *base_writer_;
+  WspecifierOptions opts_;
+
+  // The members below are protected by mutex_.
+  std::deque<Job*> pending_;    // Jobs not yet taken by a worker thread.
+  std::deque<Job*> in_flight_;  // All jobs not yet written, in order.
+  size_t max_in_flight_;
+  size_t num_submitted_;
+  size_t num_written_;
+  bool writing_;  // true if some thread is currently writing to base_writer_.
+  bool closing_;
+  bool write_error_;
+  std::mutex mutex_;
+  std::condition_variable work_cond_;  // worker threads wait on this.
+  std::condition_variable done_cond_;  // Write(), Flush() and Close() wait on
+                                       // this.
+  std::vector<std::thread> threads_;
+};
+
+// TableWriterBackgroundFactory::New() returns a new TableWriterBackgroundImpl
+// if Holder::T is copy-constructible, and otherwise NULL, meaning the "bg"
+// option is not supported for this type.
+template<class Holder,
+         bool copyable = std::is_copy_constructible<typename Holder::T>::value>
+struct TableWriterBackgroundFactory {
+  static TableWriterImplBase<Holder> *New() {
+    return new TableWriterBackgroundImpl<Holder>();
+  }
+};
+template<class Holder>
+struct TableWriterBackgroundFactory<Holder, false> {
+  static TableWriterImplBase<Holder> *New() { return NULL; }
+};
+
 template<class Holder>
 TableWriter<Holder>::TableWriter(const std::string &wspecifier): impl_(NULL) {
   if (wspecifier != "" && !Open(wspecifier))
@@ -1483,8 +2109,15 @@ bool TableWriter<Holder>::Open(const std::string &wspecifier) {
       KALDI_ERR << "Failed to close previously open writer.";
   }
   KALDI_ASSERT(impl_ == NULL);
-  WspecifierType wtype = ClassifyWspecifier(wspecifier, NULL, NULL, NULL);
-  switch (wtype) {
+  WspecifierOptions opts;
+  WspecifierType wtype = ClassifyWspecifier(wspecifier, NULL, NULL, &opts);
+  if (opts.background && wtype != kNoWspecifier) {
+    impl_ = TableWriterBackgroundFactory<Holder>::New();
+    if (impl_ == NULL)
+      KALDI_WARN << "The bg option is not supported when writing this type "
+                 << "of object; ignoring it.";
+  }
+  if (impl_ == NULL) switch (wtype) {
     case kBothWspecifier:
       impl_ = new TableWriterBothImpl<Holder>();
       break;
@@ -1517,6 +2150,15 @@ void TableWriter<Holder>::Write(const std::string &key,
   // been printed in the Write function.
 }
 
+template<class Holder>
+void TableWriter<Holder>::WriteDeferred(
+    const std::string &key,
+    const std::function<void(T*)> &make_value) const {
+  CheckImpl();
+  if (!impl_->WriteDeferred(key, make_value))
+    KALDI_ERR << "Error in TableWriter::WriteDeferred";
+}
+
 template<class Holder>
 void TableWriter<Holder>::Flush() {
   CheckImpl();
@@ -1586,6 +2228,10 @@ template<class Holder> class RandomAccessTableReaderImplBase {
 // we just read it in all in one go, as it's unlikely someone would generate
 // this from a pipe.  In principle we could read it on-demand as for the
 // archives, but this would probably be overkill.
+// If the script file is an actual file and has an up-to-date binary index
+// (see TableIndex and ReadTableIndexSidecar(), and the program
+// build-table-index), we read the index instead of parsing and sorting the
+// text of the scp file, which is much faster for very large scp files.
 
 // Note: the code for this this class is similar to TableWriterScriptImpl:
 // try to keep them in sync.
@@ -1595,7 +2241,8 @@ class RandomAccessTableReaderScriptImpl:
  public:
   typedef typename Holder::T T;
 
-  RandomAccessTableReaderScriptImpl(): last_found_(0), state_(kUninitialized) {}
+  RandomAccessTableReaderScriptImpl(): last_found_(0), use_index_(false),
+                                       state_(kUninitialized) {}
 
   virtual bool Open(const std::string &rspecifier) {
     switch (state_) {
@@ -1612,6 +2259,15 @@ class RandomAccessTableReaderScriptImpl:
     KALDI_ASSERT(rs == kScriptRspecifier);  // or wrongly called.
     KALDI_ASSERT(script_.empty());  // no way it could be nonempty at this point
 
+    if (ClassifyRxfilename(script_rxfilename_) == kFileInput &&
+        ReadTableIndexSidecar(script_rxfilename_, &index_)) {
+      // The index is already sorted and checked for duplicates.
+      use_index_ = true;
+      state_ = kNotHaveObject;
+      key_ = "";
+      return true;
+    }
+    use_index_ = false;
     if (!ReadScriptFile(script_rxfilename_,
                         true,  // print any warnings
                         &script_)) {  // error reading script file or invalid
@@ -1658,6 +2314,8 @@ class RandomAccessTableReaderScriptImpl:
     state_ = kUninitialized;
     last_found_ = 0;
     script_.clear();
+    index_.Clear();
+    use_index_ = false;
     key_ = "";
     range_ = "";
     data_rxfilename_ = "";
@@ -1716,8 +2374,8 @@ class RandomAccessTableReaderScriptImpl:
       case kNotHaveObject: default: break;
     }
     KALDI_ASSERT(IsToken(key));
-    size_t key_pos = 0;
-    if (!LookupKey(key, &key_pos)) {
+    std::string entry;  // e.g. "1.ark:100[0:2]"
+    if (!LookupKey(key, &entry)) {
       return false;
     } else {
       if (!preload) {
@@ -1726,17 +2384,17 @@ class RandomAccessTableReaderScriptImpl:
       } else {  // preload specified, so we have to attempt to pre-load the
                 // object before returning.
         std::string data_rxfilename, range; // We will split
-        // script_[key_pos].second (e.g. "1.ark:100[0:2]" into data_rxfilename
+        // entry (e.g. "1.ark:100[0:2]" into data_rxfilename
         // (e.g. "1.ark:100") and range (if any), e.g. "0:2".
-        if (script_[key_pos].second[script_[key_pos].second.size()-1] == ']') {
-          if(!ExtractRangeSpecifier(script_[key_pos].second,
+        if (entry[entry.size()-1] == ']') {
+          if(!ExtractRangeSpecifier(entry,
                                     &data_rxfilename,
                                     &range)) {
             KALDI_ERR << "TableReader: failed to parse range in '"
-                      << script_[key_pos].second << "'";
+                      << entry << "'";
           }
         } else {
-          data_rxfilename = script_[key_pos].second;
+          data_rxfilename = entry;
         }
         if (state_ == kHaveRange) {
           if (data_rxfilename_ == data_rxfilename && range_ == range) {
@@ -1770,7 +2428,7 @@ class RandomAccessTableReaderScriptImpl:
                        << PrintableRxfilename(data_rxfilename);
             return false;
           } else {
-            if (holder_.Read(input_.Stream())) {
+            if (ReadTableObject(input_.Stream(), &holder_)) {
               state_ = kHaveObject;
             } else {
               KALDI_WARN << "Error reading object from "
@@ -1797,20 +2455,29 @@ class RandomAccessTableReaderScriptImpl:
   }
 
   // This function attempts to look up the key "key" in the sorted array
-  // script_.  If it was found it returns true and puts the array offset into
-  // 'script_offset'; otherwise it returns false.
-  bool LookupKey(const std::string &key, size_t *script_offset) {
+  // script_ (or in index_, if use_index_ is true).  If it was found it returns
+  // true and puts the scp entry (the rxfilename, possibly with a range) into
+  // 'entry'; otherwise it returns false.
+  bool LookupKey(const std::string &key, std::string *entry) {
+    if (use_index_) {
+      int32 file_id;
+      int64 offset;
+      if (!index_.Lookup(key, &file_id, &offset))
+        return false;
+      *entry = JoinScriptEntry(index_.File(file_id), offset);
+      return true;
+    }
     // First, an optimization: if we're going consecutively, this will
     // make the lookup very fast.  Since we may call HasKey and then
     // Value(), which both may look up the key, we test if either the
     // current or next position are correct.
     if (last_found_ < script_.size() && script_[last_found_].first == key) {
-      *script_offset = last_found_;
+      *entry = script_[last_found_].second;
       return true;
     }
     last_found_++;
     if (last_found_ < script_.size() && script_[last_found_].first == key) {
-      *script_offset = last_found_;
+      *entry = script_[last_found_].second;
       return true;
     }
     std::pair<std::string, std::string> pr(key, "");  // Important that ""
@@ -1820,7 +2487,8 @@ class RandomAccessTableReaderScriptImpl:
                      ::const_iterator IterType;
     IterType iter = std::lower_bound(script_.begin(), script_.end(), pr);
     if (iter != script_.end() && iter->first == key) {
-      last_found_ = *script_offset = iter - script_.begin();
+      last_found_ = iter - script_.begin();
+      *entry = iter->second;
       return true;
     } else {
       return false;
@@ -1860,6 +2528,11 @@ class RandomAccessTableReaderScriptImpl:
   std::vector<std::pair<std::string, std::string> > script_;
   size_t last_found_;  // This is for an optimization used in FindFilename.
 
+  // If use_index_ is true, script_ is empty and we look keys up in index_,
+  // which was read from the sidecar index of the script file.
+  bool use_index_;
+  TableIndex index_;
+
   enum {
     //                   (*) is script_ set up?
     //                          (*) does holder_ contain an object?
@@ -1966,7 +2639,7 @@ class RandomAccessTableReaderArchiveImplBase:
     }
     if (c != '\n') is.get();  // Consume the space or tab.
     holder_ = new Holder;
-    if (holder_->Read(is)) {
+    if (ReadTableObject(is, holder_)) {
       state_ = kHaveObject;
       return;
     } else {
@@ -2501,6 +3174,302 @@ class RandomAccessTableReaderUnsortedArchiveImpl:
 };
 
 
+// RandomAccessTableReaderMmapArchiveImpl is the implementation of
+// RandomAccessTableReader used when the "mmap" option is given, e.g.
+// "mmap:foo.ark".  The archive (which must be an actual file) is
+// memory-mapped, and we keep a TableIndex from keys to byte offsets, which
+// either comes from the sidecar file foo.ark.idx (see ReadTableIndexSidecar())
+// or is built by scanning the whole archive once in Open().  Value() reads the
+// object directly from the mapped memory.  The advantage over the other
+// archive implementations is that many processes on the same machine that read
+// the same archive share one copy of it (in the page cache), and no process
+// has to hold the objects in memory apart from the one that was most recently
+// asked for.  It does not depend on the "s", "cs" or "o" options.
+template<class Holder>
+class RandomAccessTableReaderMmapArchiveImpl:
+      public RandomAccessTableReaderImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  RandomAccessTableReaderMmapArchiveImpl(): state_(kUninitialized) { }
+
+  virtual bool Open(const std::string &rspecifier) {
+    if (state_ != kUninitialized)
+      KALDI_ERR << "Opening already open RandomAccessTableReader:"
+          " call Close first.";
+    rspecifier_ = rspecifier;
+    RspecifierType rs = ClassifyRspecifier(rspecifier, &archive_rxfilename_,
+                                           &opts_);
+    KALDI_ASSERT(rs == kArchiveRspecifier && opts_.mmap);
+    if (ClassifyRxfilename(archive_rxfilename_) != kFileInput) {
+      KALDI_WARN << "The mmap option requires the archive to be a file, "
+                 << "got " << PrintableRxfilename(archive_rxfilename_);
+      return false;
+    }
+    if (!file_.Open(archive_rxfilename_))
+      return false;  // MappedFile::Open() will have printed a warning.
+    if (ReadTableIndexSidecar(archive_rxfilename_, &index_)) {
+      for (int32 i = 0; i < index_.NumEntries(); i++) {
+        if (index_.FileId(i) != 0 ||
+            index_.Offset(i) >= static_cast<int64>(file_.Size())) {
+          KALDI_WARN << "Table index " << TableIndexFilename(archive_rxfilename_)
+                     << " does not match archive " << archive_rxfilename_
+                     << "; ignoring it.";
+          index_.Clear();
+          break;
+        }
+      }
+    }
+    if (index_.NumEntries() == 0 && !BuildIndex()) {
+      file_.Close();
+      index_.Clear();
+      return false;
+    }
+    state_ = kNoObject;
+    return true;
+  }
+
+  virtual bool HasKey(const std::string &key) {
+    if (!IsOpen())
+      KALDI_ERR << "HasKey() called on RandomAccessTableReader that is not "
+          "open.";
+    if (!opts_.permissive) {
+      if (state_ == kHaveObject && key == cur_key_)
+        return true;
+      int32 file_id;
+      int64 offset;
+      return index_.Lookup(key, &file_id, &offset);
+    }
+    // In permissive mode we only say we have the key if we can read the
+    // object.
+    return LoadObject(key);
+  }
+
+  virtual const T &Value(const std::string &key) {
+    if (!IsOpen())
+      KALDI_ERR << "Value() called on RandomAccessTableReader that is not "
+          "open.";
+    if (!LoadObject(key))
+      KALDI_ERR << "Value() called but no such key " << key
+                << " in archive " << PrintableRxfilename(archive_rxfilename_)
+                << " (or it could not be read)";
+    return holder_.Value();
+  }
+
+  virtual bool Close() {
+    if (!IsOpen())
+      KALDI_ERR << "Close() called on RandomAccessTableReader that was not"
+          " open.";
+    holder_.Clear();
+    file_.Close();
+    index_.Clear();
+    cur_key_ = "";
+    state_ = kUninitialized;
+    return true;
+  }
+
+  virtual ~RandomAccessTableReaderMmapArchiveImpl() {
+    if (IsOpen())
+      Close();
+  }
+
+ private:
+  bool IsOpen() const { return state_ != kUninitialized; }
+
+  // Makes sure holder_ contains the object for 'key'; returns false if the key
+  // is not in the index or the object could not be read.
+  bool LoadObject(const std::string &key) {
+    if (state_ == kHaveObject && key == cur_key_)
+      return true;
+    int32 file_id;
+    int64 offset;
+    if (!index_.Lookup(key, &file_id, &offset))
+      return false;
+    holder_.Clear();
+    state_ = kNoObject;
+    MemoryStreambuf buf(file_.Data() + offset, file_.Size() - offset);
+    std::istream is(&buf);
+    if (!ReadTableObject(is, &holder_)) {
+      KALDI_WARN << "Failed to read object for key " << key << " at offset "
+                 << offset << " in archive "
+                 << PrintableRxfilename(archive_rxfilename_);
+      return false;
+    }
+    cur_key_ = key;
+    state_ = kHaveObject;
+    return true;
+  }
+
+  // Scans the mapped archive and builds index_ mapping each key to the byte
+  // offset just after "key ".  This requires reading each object, since
+  // archive entries carry no length information.  Returns false on error.
+  bool BuildIndex() {
+    index_.Clear();
+    index_.AddFile(archive_rxfilename_);
+    MemoryStreambuf buf(file_.Data(), file_.Size());
+    std::istream is(&buf);
+    Holder holder;
+    std::string key;
+    while (true) {
+      is >> key;
+      if (is.eof()) break;
+      int c;
+      if (is.fail() || ((c = is.peek()) != ' ' && c != '\t' && c != '\n')) {
+        KALDI_WARN << "Invalid archive file format reading "
+                   << PrintableRxfilename(archive_rxfilename_);
+        if (opts_.permissive) break;
+        return false;
+      }
+      if (c != '\n') is.get();  // Consume the space or tab.
+      int64 offset = is.tellg();
+      if (!ReadTableObject(is, &holder)) {
+        KALDI_WARN << "Object read failed, reading archive "
+                   << PrintableRxfilename(archive_rxfilename_);
+        if (opts_.permissive) break;
+        return false;
+      }
+      holder.Clear();
+      index_.AddEntry(key, 0, offset);
+    }
+    if (!index_.Finalize()) {
+      KALDI_WARN << "Duplicate keys in archive "
+                 << PrintableRxfilename(archive_rxfilename_);
+      return false;
+    }
+    return true;
+  }
+
+  RspecifierOptions opts_;
+  std::string rspecifier_;
+  std::string archive_rxfilename_;
+  MappedFile file_;
+  TableIndex index_;
+  std::string cur_key_;  // key of the object in holder_, if kHaveObject.
+  Holder holder_;
+
+  enum {
+    kUninitialized,  // not open.
+    kNoObject,       // open; holder_ does not contain an object.
+    kHaveObject      // open; holder_ contains the object for cur_key_.
+  } state_;
+};
+
+
+// This wraps one of the implementations above, for the "cacheN" option.  It
+// keeps copies of the objects returned by Value() in a least-recently-used
+// cache, so asking again for a recently used key costs a hash lookup rather
+// than a seek and a parse.  The size of the cache is limited to about N
+// megabytes, measured as the size of the objects in binary form (but the most
+// recent object is always kept, however large).  Holders have no copy
+// operation, so objects are copied into the cache by writing them to memory and
+// reading them back; this happens once per cache miss, and costs much less
+// than reading the object from the table did.
+template<class Holder>
+class RandomAccessTableReaderCachedImpl:
+      public RandomAccessTableReaderImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  // Takes ownership of 'base_impl', which must not be open yet.
+  RandomAccessTableReaderCachedImpl(
+      RandomAccessTableReaderImplBase<Holder> *base_impl, int32 cache_mb):
+      base_impl_(base_impl),
+      max_bytes_(static_cast<int64>(cache_mb) * 1024 * 1024),
+      cur_bytes_(0), num_hits_(0), num_misses_(0) { }
+
+  virtual bool Open(const std::string &rspecifier) {
+    rspecifier_ = rspecifier;
+    return base_impl_->Open(rspecifier);
+  }
+
+  virtual bool HasKey(const std::string &key) {
+    if (map_.find(key) != map_.end())
+      return true;
+    return base_impl_->HasKey(key);
+  }
+
+  virtual const T &Value(const std::string &key) {
+    typename MapType::iterator iter = map_.find(key);
+    if (iter != map_.end()) {
+      // Move it to the front of the list, as the most recently used.
+      list_.splice(list_.begin(), list_, iter->second);
+      num_hits_++;
+      return iter->second->holder->Value();
+    }
+    num_misses_++;
+    const T &value = base_impl_->Value(key);
+    // The object is written to and read back from the same stream, so that
+    // the serialized data is not copied.
+    std::stringstream ss;
+    if (!Holder::Write(ss, true, value))
+      KALDI_ERR << "Error copying object with key " << key
+                << " into the cache, reading " << rspecifier_;
+    int64 num_bytes = ss.tellp();
+    Holder *holder = new Holder;
+    if (!holder->Read(ss)) {
+      delete holder;
+      KALDI_ERR << "Error copying object with key " << key
+                << " into the cache, reading " << rspecifier_;
+    }
+    CacheEntry entry;
+    entry.key = key;
+    entry.holder = holder;
+    entry.num_bytes = num_bytes;
+    list_.push_front(entry);
+    map_[key] = list_.begin();
+    cur_bytes_ += entry.num_bytes;
+    while (cur_bytes_ > max_bytes_ && list_.size() > 1) {
+      CacheEntry &oldest = list_.back();
+      cur_bytes_ -= oldest.num_bytes;
+      map_.erase(oldest.key);
+      delete oldest.holder;
+      list_.pop_back();
+    }
+    return holder->Value();
+  }
+
+  virtual bool Close() {
+    KALDI_VLOG(1) << "Cache of objects read from " << rspecifier_ << ": "
+                  << num_hits_ << " hits and " << num_misses_ << " misses.";
+    ClearCache();
+    return base_impl_->Close();
+  }
+
+  virtual ~RandomAccessTableReaderCachedImpl() {
+    ClearCache();
+    delete base_impl_;
+  }
+
+ private:
+  void ClearCache() {
+    for (typename ListType::iterator iter = list_.begin();
+         iter != list_.end(); ++iter)
+      delete iter->holder;
+    list_.clear();
+    map_.clear();
+    cur_bytes_ = 0;
+  }
+
+  struct CacheEntry {
+    std::string key;
+    Holder *holder;
+    int64 num_bytes;  // Size of the object in binary form.
+  };
+  typedef std::list<CacheEntry> ListType;
+  typedef unordered_map<std::string, typename ListType::iterator,
+                        StringHasher> MapType;
+
+  RandomAccessTableReaderImplBase<Holder> *base_impl_;
+  std::string rspecifier_;
+  ListType list_;  // The most recently used object is at the front.
+  MapType map_;  // Maps each key in list_ to its position there.
+  int64 max_bytes_;
+  int64 cur_bytes_;  // Total of num_bytes in list_.
+  int64 num_hits_;
+  int64 num_misses_;
+};
+
+
 
 
 
@@ -2524,7 +3493,9 @@ bool RandomAccessTableReader<Holder>::Open(const std::string &rspecifier) {
       impl_ = new RandomAccessTableReaderScriptImpl<Holder>();
       break;
     case kArchiveRspecifier:
-      if (opts.sorted) {
+      if (opts.mmap) {
+        impl_ = new RandomAccessTableReaderMmapArchiveImpl<Holder>();
+      } else if (opts.sorted) {
         if (opts.called_sorted)  // "doubly" sorted case.
           impl_ = new RandomAccessTableReaderDSortedArchiveImpl<Holder>();
         else
@@ -2538,6 +3509,9 @@ bool RandomAccessTableReader<Holder>::Open(const std::string &rspecifier) {
                  << rspecifier;
       return false;
   }
+  if (opts.cache_mb > 0)
+    impl_ = new RandomAccessTableReaderCachedImpl<Holder>(impl_,
+                                                          opts.cache_mb);
   if (!impl_->Open(rspecifier)) {
     // A warning will already have been printed.
     delete impl_;
@@ -22,6 +22,7 @@
 #include "util/kaldi-table.h"
 #include "util/kaldi-holder.h"
 #include "util/table-types.h"
+#include "util/kaldi-table-index.h"
 
 namespace kaldi {
 
@@ -89,6 +90,32 @@ void UnitTestReadScriptFile() {
 
 
 void UnitTestClassifyWspecifier() {
+  {
+    std::string a = "ark,bg4,scp:foo.ark,foo.scp";
+    std::string ark, scp;
+    WspecifierOptions opts;
+    WspecifierType ans = ClassifyWspecifier(a, &ark, &scp, &opts);
+    KALDI_ASSERT(ans == kBothWspecifier && ark == "foo.ark" &&
+                 scp == "foo.scp" && opts.background &&
+                 opts.background_threads == 4);
+  }
+  {
+    std::string a = "ark,scp,lz4:foo.ark,foo.scp";
+    WspecifierOptions opts;
+    WspecifierType ans = ClassifyWspecifier(a, NULL, NULL, &opts);
+    KALDI_ASSERT(ans == kBothWspecifier && opts.compress && opts.binary);
+  }
+  {
+    std::string a = "ark,packed:foo.ark";
+    WspecifierOptions opts;
+    WspecifierType ans = ClassifyWspecifier(a, NULL, NULL, &opts);
+    KALDI_ASSERT(ans == kArchiveWspecifier && opts.packed && !opts.compress);
+  }
+  {
+    std::string a = "ark,bgx:foo.ark";  // invalid option.
+    WspecifierType ans = ClassifyWspecifier(a, NULL, NULL, NULL);
+    KALDI_ASSERT(ans == kNoWspecifier);
+  }
   {
     std::string a = "b,ark:|foo";
     std::string ark = "x", scp = "y";
@@ -297,6 +324,58 @@ void UnitTestClassifyRspecifier() {
     KALDI_ASSERT(ans == kNoRspecifier);
   }
 
+  {
+    std::string a = "mmap:foo.ark", b;  // mmap implies ark.
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &b, &opts);
+    KALDI_ASSERT(ans == kArchiveRspecifier && b == "foo.ark" && opts.mmap);
+  }
+  {
+    std::string a = "ark,mmap,p:foo.ark", b;
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &b, &opts);
+    KALDI_ASSERT(ans == kArchiveRspecifier && b == "foo.ark" && opts.mmap &&
+                 opts.permissive);
+  }
+  {
+    std::string a = "scp,mmap:foo.scp";  // mmap is not valid with scp.
+    RspecifierType ans = ClassifyRspecifier(a, NULL, NULL);
+    KALDI_ASSERT(ans == kNoRspecifier);
+  }
+
+  {
+    std::string a = "cache,scp:foo.scp", b;
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &b, &opts);
+    KALDI_ASSERT(ans == kScriptRspecifier && b == "foo.scp" &&
+                 opts.cache_mb == kDefaultTableCacheMb);
+  }
+  {
+    std::string a = "ark,cache20:foo.ark", b;
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &b, &opts);
+    KALDI_ASSERT(ans == kArchiveRspecifier && b == "foo.ark" &&
+                 opts.cache_mb == 20);
+  }
+  {
+    std::string a = "ark,cache0:foo.ark";
+    RspecifierType ans = ClassifyRspecifier(a, NULL, NULL);
+    KALDI_ASSERT(ans == kNoRspecifier);
+  }
+
+  {
+    std::string a = "bg4,scp:foo.scp", b;
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &b, &opts);
+    KALDI_ASSERT(ans == kScriptRspecifier && b == "foo.scp" &&
+                 opts.background && opts.background_threads == 4);
+  }
+  {
+    std::string a = "bg0,scp:foo.scp";  // need at least one thread.
+    RspecifierType ans = ClassifyRspecifier(a, NULL, NULL);
+    KALDI_ASSERT(ans == kNoRspecifier);
+  }
+
   // Testing it accepts the meaningless t, and b, prefixes.
   {
     std::string a = "b,scp:a", b;
@@ -320,6 +399,21 @@ void UnitTestClassifyRspecifier() {
   }
 }
 
+void UnitTestSplitScriptEntry() {
+  std::string file;
+  int64 offset;
+  SplitScriptEntry("foo.ark:1234", &file, &offset);
+  KALDI_ASSERT(file == "foo.ark" && offset == 1234);
+  SplitScriptEntry("foo.ark:1234[0:9]", &file, &offset);
+  KALDI_ASSERT(file == "foo.ark[0:9]" && offset == 1234);
+  KALDI_ASSERT(JoinScriptEntry(file, offset) == "foo.ark:1234[0:9]");
+  SplitScriptEntry("foo.mat", &file, &offset);
+  KALDI_ASSERT(file == "foo.mat" && offset == -1);
+  KALDI_ASSERT(JoinScriptEntry(file, offset) == "foo.mat");
+  SplitScriptEntry("foo.mat[3:4]", &file, &offset);
+  KALDI_ASSERT(file == "foo.mat[3:4]" && offset == -1);
+}
+
 void UnitTestTableSequentialInt32(bool binary) {
   int32 sz = Rand() % 10;
   std::vector<std::string> k;
@@ -401,7 +495,7 @@ void UnitTestTableSequentialDouble(bool binary) {
   }
 
   bool ans;
-  DoubleWriter bw(binary ? "b,ark:tmpf" : "t,ark:tmpf");
+  DoubleWriter bw(binary ? "b,ark,bg:tmpf" : "t,ark:tmpf");
   for (int32 i = 0; i < sz; i++)  {
     bw.Write(k[i], v[i]);
   }
@@ -513,6 +607,31 @@ void UnitTestTableSequentialInt32VectorBoth(bool binary, bool read_scp) {
   KALDI_ASSERT(v2 == v);
 }
 
+void UnitTestTableCompressedInt32Vector() {
+  std::vector<std::vector<int32> > v(RandInt(1, 5));
+  for (size_t i = 0; i < v.size(); i++) {
+    int32 sz = RandInt(0, 100), cur = RandInt(-1000, 1000);
+    for (int32 j = 0; j < sz; j++) {
+      if (RandInt(0, 3) == 0) cur = RandInt(-1000, 1000);
+      v[i].push_back(cur);
+    }
+  }
+  v[0].push_back(std::numeric_limits<int32>::min());
+  v[0].push_back(std::numeric_limits<int32>::max());
+  {
+    CompressedInt32VectorWriter writer("ark:tmpf");
+    for (size_t i = 0; i < v.size(); i++)
+      writer.Write(std::string(1, 'a' + i), v[i]);
+  }
+  SequentialInt32VectorReader reader("ark:tmpf");
+  std::vector<std::vector<int32> > v2;
+  for (; !reader.Done(); reader.Next())
+    v2.push_back(reader.Value());
+  KALDI_ASSERT(v2 == v);
+  RandomAccessInt32VectorReader random_reader("ark:tmpf");
+  KALDI_ASSERT(random_reader.Value("a") == v[0]);
+}
+
 
 // Writing as both and reading as archive.
 void UnitTestTableSequentialInt32PairVectorBoth(bool binary, bool read_scp) {
@@ -623,15 +742,17 @@ void UnitTestTableSequentialInt32Script(bool binary) {
   }
 
   bool ans;
-  Int32Writer bw(binary ? "b,scp:tmp.scp" : "t,scp:tmp.scp");
+  Int32Writer bw(std::string(RandInt(0, 1) == 0 ? "" : "bg2,") +
+                 (binary ? "b,scp:tmp.scp" : "t,scp:tmp.scp"));
   for (int32 i = 0; i < sz; i++)  {
     bw.Write(k[i], v[i]);
   }
   ans = bw.Close();
   KALDI_ASSERT(ans);
 
-  SequentialInt32Reader sbr(RandInt(0, 1) == 0 ?
-                            "scp:tmp.scp" : "scp,bg:tmp.scp");
+  const char *rspecifiers[] = { "scp:tmp.scp", "scp,bg:tmp.scp",
+                                "scp,bg2:tmp.scp", "bg5,scp:tmp.scp" };
+  SequentialInt32Reader sbr(rspecifiers[RandInt(0, 3)]);
   std::vector<std::string> k2;
   std::vector<int32> v2;
   for (; !sbr.Done(); sbr.Next()) {
@@ -666,15 +787,21 @@ void UnitTestTableSequentialDoubleMatrixBoth(bool binary, bool read_scp) {
   }
 
   bool ans;
-  DoubleMatrixWriter bw(binary ? "b,ark,scp:tmpf,tmpf.scp" :
-                        "t,ark,scp:tmpf,tmpf.scp");
+  const char *writer_bg_opts[] = { "", "bg,", "bg3," };
+  DoubleMatrixWriter bw(std::string(writer_bg_opts[RandInt(0, 2)]) +
+                        (binary ? "b,ark,scp:tmpf,tmpf.scp" :
+                         "t,ark,scp:tmpf,tmpf.scp"));
   for (int32 i = 0; i < sz; i++)  {
     bw.Write(k[i], *(v[i]));
   }
   ans = bw.Close();
   KALDI_ASSERT(ans);
 
-  SequentialDoubleMatrixReader sbr(read_scp ? "scp:tmpf.scp" : "ark:tmpf");
+  // "bg3" reads scp files with 3 threads; for archives it's the same as "bg",
+  // with a warning.
+  const char *bg_opts[] = { "", "bg,", "bg3," };
+  SequentialDoubleMatrixReader sbr(std::string(bg_opts[RandInt(0, 2)]) +
+                                   (read_scp ? "scp:tmpf.scp" : "ark:tmpf"));
   std::vector<std::string> k2;
   std::vector<Matrix<double>* > v2;
   for (; !sbr.Done(); sbr.Next()) {
@@ -802,6 +929,48 @@ void UnitTestTableRandomBothDouble(bool binary, bool read_scp,
   else if (Rand()%2 == 0) name += "ncs,";
   if (once) name += "o,";
   else if (Rand()%2 == 0) name += "no,";
+  if (!read_scp && Rand() % 2 == 0) {
+    name = "mmap,";  // "mmap" ignores the other options.
+    if (Rand() % 2 == 0) {  // Test reading the index from the sidecar file.
+      TableIndex index;
+      index.AddFile("tmpf");
+      std::vector<std::pair<std::string, std::string> > script;
+      KALDI_ASSERT(ReadScriptFile("tmpf.scp", true, &script));
+      for (size_t i = 0; i < script.size(); i++) {
+        size_t pos = script[i].second.rfind(':');
+        int64 offset;
+        KALDI_ASSERT(ConvertStringToInteger(script[i].second.substr(pos + 1),
+                                            &offset));
+        index.AddEntry(script[i].first, 0, offset);
+      }
+      KALDI_ASSERT(index.Finalize());
+      bool index_binary = (Rand() % 2 == 0);
+      Output ko(TableIndexFilename("tmpf"), index_binary);
+      index.Write(ko.Stream(), index_binary);
+    } else {
+      std::remove(TableIndexFilename("tmpf").c_str());
+    }
+  }
+  if (read_scp) {
+    if (Rand() % 2 == 0) {  // Test reading the scp via its sidecar index.
+      std::vector<std::pair<std::string, std::string> > script;
+      KALDI_ASSERT(ReadScriptFile("tmpf.scp", true, &script));
+      TableIndex index;
+      for (size_t i = 0; i < script.size(); i++) {
+        std::string file;
+        int64 offset;
+        SplitScriptEntry(script[i].second, &file, &offset);
+        KALDI_ASSERT(JoinScriptEntry(file, offset) == script[i].second);
+        index.AddEntry(script[i].first, index.AddFile(file), offset);
+      }
+      KALDI_ASSERT(index.Finalize());
+      Output ko(TableIndexFilename("tmpf.scp"), binary);
+      index.Write(ko.Stream(), binary);
+    } else {
+      std::remove(TableIndexFilename("tmpf.scp").c_str());
+    }
+  }
+  if (Rand() % 3 == 0) name += "cache,";
   name += std::string(read_scp ? "scp:tmpf.scp" : "ark:tmpf");
 
   RandomAccessDoubleReader sbr(name);
@@ -835,6 +1004,9 @@ void UnitTestTableRandomBothDouble(bool binary, bool read_scp,
       }
     }
   }
+  // Don't leave index files around that later tests might pick up.
+  std::remove(TableIndexFilename("tmpf").c_str());
+  std::remove(TableIndexFilename("tmpf.scp").c_str());
 }
 
 
@@ -1010,6 +1182,7 @@ void UnitTestTableRandomBothDoubleMatrix(bool binary, bool read_scp,
   else if (Rand()%2 == 0) name += "ncs,";
   if (once) name += "o,";
   else if (Rand()%2 == 0) name += "no,";
+  if (Rand() % 3 == 0) name += "cache,";
   name += std::string(read_scp ? "scp:tmpf.scp" : "ark:tmpf");
   RandomAccessDoubleMatrixReader sbr(name);
 
@@ -1045,6 +1218,146 @@ void UnitTestTableRandomBothDoubleMatrix(bool binary, bool read_scp,
 }
 
 
+// Tests TableWriter::WriteDeferred(): with the "bg" option the matrices are
+// compressed in the background threads, and the archive should be the same as
+// when compressing them before calling Write().
+void UnitTestTableWriteDeferred() {
+  int32 sz = RandInt(0, 20);
+  std::vector<Matrix<BaseFloat> > v(sz);
+  {
+    CompressedMatrixWriter writer1(RandInt(0, 1) == 0 ? "ark,bg:tmpf" :
+                                   "ark,bg3:tmpf"),
+        writer2("ark:tmpf2");
+    for (int32 i = 0; i < sz; i++) {
+      std::string key = "key" + std::to_string(i);
+      v[i].Resize(RandInt(1, 50), RandInt(1, 20));
+      v[i].SetRandn();
+      Matrix<BaseFloat> mat(v[i]);
+      writer1.WriteDeferred(key, [mat](CompressedMatrix *cmat) {
+          cmat->CopyFromMat(mat);
+        });
+      writer2.Write(key, CompressedMatrix(v[i]));
+    }
+  }
+  std::string data1, data2;
+  {
+    std::ifstream is1("tmpf", std::ios::binary), is2("tmpf2", std::ios::binary);
+    std::ostringstream os1, os2;
+    os1 << is1.rdbuf();
+    os2 << is2.rdbuf();
+    data1 = os1.str();
+    data2 = os2.str();
+  }
+  KALDI_ASSERT(data1 == data2);
+  // A writer without "bg" calls make_value at once.
+  {
+    BaseFloatMatrixWriter writer("ark:tmpf");
+    for (int32 i = 0; i < sz; i++) {
+      const Matrix<BaseFloat> &mat = v[i];
+      writer.WriteDeferred("key" + std::to_string(i),
+                           [&mat](Matrix<BaseFloat> *out) { *out = mat; });
+    }
+  }
+  SequentialBaseFloatMatrixReader reader("ark:tmpf");
+  for (int32 i = 0; i < sz; i++, reader.Next())
+    KALDI_ASSERT(!reader.Done() && reader.Value().ApproxEqual(v[i], 0.0));
+  KALDI_ASSERT(reader.Done());
+  unlink("tmpf");
+  unlink("tmpf2");
+}
+
+
+// Tests the "cacheN" rspecifier option through RandomAccessTableReaderMapped,
+// with per-speaker matrices that are asked for in random order via an utt2spk
+// map.  The cache of 1MB is smaller than the archive, so objects get evicted.
+void UnitTestTableRandomCache(bool read_scp) {
+  int32 num_spk = 10, num_utt = 100;
+  std::vector<Matrix<double> > v(num_spk);
+  {
+    DoubleMatrixWriter writer("ark,scp:tmpf,tmpf.scp");
+    for (int32 i = 0; i < num_spk; i++) {
+      v[i].Resize(100, 200);
+      v[i].SetRandn();
+      writer.Write("spk" + std::to_string(i), v[i]);
+    }
+  }
+  {
+    Output ko("tmpf.utt2spk", false);
+    for (int32 i = 0; i < num_utt; i++)
+      ko.Stream() << "utt" << i << " spk" << (i % num_spk) << "\n";
+  }
+  std::vector<int32> utts;
+  for (int32 n = 0; n < 3; n++)
+    for (int32 i = 0; i < num_utt; i++)
+      utts.push_back(i);
+  RandomizeVector(&utts);
+
+  RandomAccessTableReaderMapped<KaldiObjectHolder<Matrix<double> > > reader(
+      read_scp ? "cache1,scp:tmpf.scp" : "cache1,ark:tmpf",
+      "ark:tmpf.utt2spk");
+  for (size_t i = 0; i < utts.size(); i++) {
+    std::string utt = "utt" + std::to_string(utts[i]);
+    KALDI_ASSERT(reader.HasKey(utt));
+    KALDI_ASSERT(reader.Value(utt).ApproxEqual(v[utts[i] % num_spk], 0.0));
+  }
+  unlink("tmpf");
+  unlink("tmpf.scp");
+  unlink("tmpf.utt2spk");
+}
+
+
+// Tests the "lz4" wspecifier option: the archive should be smaller, and all
+// kinds of reader should read it.
+void UnitTestTableCompressed() {
+  int32 sz = RandInt(1, 10);
+  std::vector<std::string> k;
+  std::vector<Matrix<double> > v(sz);
+  for (int32 i = 0; i < sz; i++) {
+    k.push_back("key" + std::to_string(i));
+    // Small integers compress well.
+    v[i].Resize(RandInt(0, 50), RandInt(1, 20));
+    for (int32 r = 0; r < v[i].NumRows(); r++)
+      for (int32 c = 0; c < v[i].NumCols(); c++)
+        v[i](r, c) = RandInt(0, 3);
+  }
+  const char *writer_opts[] = { "", "bg,", "bg3," };
+  for (int32 compress = 0; compress < 2; compress++) {
+    DoubleMatrixWriter writer(std::string(writer_opts[RandInt(0, 2)]) +
+                              (compress ? "ark,scp,lz4:tmpf.lz4,tmpf.scp" :
+                               "ark:tmpf"));
+    for (int32 i = 0; i < sz; i++)
+      writer.Write(k[i], v[i]);
+    KALDI_ASSERT(writer.Close());
+  }
+  std::ifstream compressed_is("tmpf.lz4"), uncompressed_is("tmpf");
+  compressed_is.seekg(0, std::ios::end);
+  uncompressed_is.seekg(0, std::ios::end);
+  KALDI_ASSERT(compressed_is.tellg() < uncompressed_is.tellg());
+
+  const char *seq_rspecifiers[] = { "ark:tmpf.lz4", "scp:tmpf.scp",
+                                    "scp,bg2:tmpf.scp" };
+  for (size_t j = 0; j < 3; j++) {
+    SequentialDoubleMatrixReader reader(seq_rspecifiers[j]);
+    int32 i = 0;
+    for (; !reader.Done(); reader.Next(), i++) {
+      KALDI_ASSERT(reader.Key() == k[i]);
+      KALDI_ASSERT(reader.Value().ApproxEqual(v[i], 0.0));
+    }
+    KALDI_ASSERT(i == sz && reader.Close());
+  }
+  const char *rand_rspecifiers[] = { "ark:tmpf.lz4", "scp:tmpf.scp",
+                                     "mmap:tmpf.lz4" };
+  for (size_t j = 0; j < 3; j++) {
+    RandomAccessDoubleMatrixReader reader(rand_rspecifiers[j]);
+    for (int32 n = 0; n < 5; n++) {
+      int32 i = RandInt(0, sz - 1);
+      KALDI_ASSERT(reader.Value(k[i]).ApproxEqual(v[i], 0.0));
+    }
+  }
+  unlink("tmpf");
+  unlink("tmpf.lz4");
+  unlink("tmpf.scp");
+}
 
 }  // end namespace kaldi.
 
@@ -1053,6 +1366,15 @@ int main() {
   UnitTestReadScriptFile();
   UnitTestClassifyWspecifier();
   UnitTestClassifyRspecifier();
+  UnitTestSplitScriptEntry();
+  for (int i = 0; i < 10; i++)
+    UnitTestTableCompressed();
+  for (int i = 0; i < 10; i++)
+    UnitTestTableCompressedInt32Vector();
+  for (int i = 0; i < 5; i++)
+    UnitTestTableWriteDeferred();
+  UnitTestTableRandomCache(true);
+  UnitTestTableRandomCache(false);
   for (int i = 0; i < 10; i++) {
     bool b = (i == 0);
     UnitTestTableSequentialBool(b);
@@ -183,6 +183,21 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
       if (opts) opts->binary = false;
     } else if (!strcmp(c, "p")) {
       if (opts) opts->permissive = true;
+    } else if (!strcmp(c, "bg")) {
+      if (opts) opts->background = true;
+    } else if (!strncmp(c, "bg", 2) && isdigit(c[2])) {  // e.g. "bg4"
+      int32 num_threads;
+      if (!ConvertStringToInteger(str.substr(2), &num_threads) ||
+          num_threads < 1)
+        return kNoWspecifier;
+      if (opts) {
+        opts->background = true;
+        opts->background_threads = num_threads;
+      }
+    } else if (!strcmp(c, "lz4")) {
+      if (opts) opts->compress = true;
+    } else if (!strcmp(c, "packed")) {
+      if (opts) opts->packed = true;
     } else if (!strcmp(c, "ark")) {
       if (ws == kNoWspecifier) ws = kArchiveWspecifier;
       else
@@ -267,6 +282,7 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
   // don't omit empty strings between commas.
 
   RspecifierType rs = kNoRspecifier;
+  bool mmap = false;
 
   for (size_t i = 0; i < split_first_part.size(); i++) {
     const std::string &str = split_first_part[i];  // e.g. "b", "t", "f", "ark",
@@ -293,6 +309,25 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
       if (opts) opts->called_sorted = false;
     } else if (!strcmp(c, "bg")) {
       if (opts) opts->background = true;
+    } else if (!strncmp(c, "bg", 2) && isdigit(c[2])) {  // e.g. "bg4"
+      int32 num_threads;
+      if (!ConvertStringToInteger(str.substr(2), &num_threads) ||
+          num_threads < 1)
+        return kNoRspecifier;
+      if (opts) {
+        opts->background = true;
+        opts->background_threads = num_threads;
+      }
+    } else if (!strcmp(c, "cache")) {
+      if (opts) opts->cache_mb = kDefaultTableCacheMb;
+    } else if (!strncmp(c, "cache", 5) && isdigit(c[5])) {  // e.g. "cache200"
+      int32 cache_mb;
+      if (!ConvertStringToInteger(str.substr(5), &cache_mb) || cache_mb < 1)
+        return kNoRspecifier;
+      if (opts) opts->cache_mb = cache_mb;
+    } else if (!strcmp(c, "mmap")) {
+      if (opts) opts->mmap = true;
+      mmap = true;
     } else if (!strcmp(c, "ark")) {
       if (rs == kNoRspecifier) rs = kArchiveRspecifier;
       else
@@ -307,6 +342,11 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
       return kNoRspecifier;  // Could not interpret this option.
     }
   }
+  if (mmap) {
+    // "mmap" implies "ark"; it is not valid with "scp".
+    if (rs == kNoRspecifier) rs = kArchiveRspecifier;
+    else if (rs == kScriptRspecifier) return kNoRspecifier;
+  }
   if ((rs == kArchiveRspecifier || rs == kScriptRspecifier)
      && rxfilename != NULL)
     *rxfilename = after_colon;
@@ -21,6 +21,7 @@
 #ifndef KALDI_UTIL_KALDI_TABLE_H_
 #define KALDI_UTIL_KALDI_TABLE_H_
 
+#include <functional>
 #include <string>
 #include <vector>
 #include <utility>
@@ -71,6 +72,22 @@ typedef std::vector<std::string> KeyList;
 //  p means permissive mode, when writing to an "scp" file only: will ignore
 //     missing scp entries, i.e. won't write anything for those files but will
 //     return success status).
+//  bg means "background": Write() returns as soon as it has copied the
+//     object, and the serialization and writing are done in a background
+//     thread.  bgN (e.g. bg4) uses N threads to serialize objects in parallel;
+//     the output is the same as without the option (objects are written in
+//     the order of the Write() calls).  Write errors are reported by a later
+//     Write(), Flush() or Close().  Programs that compress what they write
+//     should use TableWriter::WriteDeferred() so that the compression is
+//     also done in the background.
+//  lz4 means each object is compressed losslessly (binary mode only; see
+//     kaldi-compression.h).  Random access still works via the scp offsets,
+//     and the readers decompress automatically, with no rspecifier option.
+//  packed means objects are written in their type's packed binary format, if
+//     it has one (binary mode only; see HolderPackedWriter).  Currently only
+//     CompactLattice has one.  Kaldi's readers detect it automatically, but
+//     other programs, e.g. OpenFst's, and older versions of Kaldi cannot read
+//     it.
 //
 //  So the following are valid wspecifiers:
 //  ark,b,f:foo
@@ -114,7 +131,25 @@ struct WspecifierOptions {
   bool binary;
   bool flush;
   bool permissive;  // will ignore absent scp entries.
-  WspecifierOptions(): binary(true), flush(false), permissive(false) { }
+  bool background;  // write in background thread(s) ("bg" or "bgN" option).
+  int32 background_threads;  // N in the "bgN" option; 1 for "bg".
+  bool compress;  // compress objects ("lz4" option).
+  bool packed;  // use the holder's packed binary format ("packed" option).
+  WspecifierOptions(): binary(true), flush(false), permissive(false),
+                       background(false), background_threads(1),
+                       compress(false), packed(false) { }
+};
+
+// HolderPackedWriter<Holder>::Write() writes an object with the "packed"
+// wspecifier option, in binary mode.  Holders that have a more compact binary
+// format than their default one, which their Read() also accepts, specialize
+// it (see CompactLatticeHolder in lat/kaldi-lattice.h); for the others, the
+// option has no effect.
+template<class Holder>
+struct HolderPackedWriter {
+  static bool Write(std::ostream &os, const typename Holder::T &value) {
+    return Holder::Write(os, true, value);
+  }
 };
 
 // ClassifyWspecifier returns the type of the wspecifier string,
@@ -189,6 +224,35 @@ bool WriteScriptFile(std::ostream &os,
 //       value, in a background thread.  Recommended when reading larger objects
 //       such as neural-net training examples, especially when you want to
 //       maximize GPU usage.
+//   bgN  (e.g. bg4) is like bg, but for sequential readers of script files
+//       it reads the objects in N background threads in parallel, while
+//       still giving them to the program in the order of the scp file.  This
+//       helps when reading the objects is CPU-bound, e.g. decompressing
+//       compressed matrices.  Archives (including "ark:-") can't be read in
+//       parallel, because an object's extent is only known once it has been
+//       parsed, so for them bgN is the same as bg (one read-ahead thread),
+//       and a warning is printed.  To read an archive in parallel, read it
+//       through its scp file (e.g. "bg4,scp:feats.scp").
+//   mmap means "memory-mapped".  It only makes a difference for random-access
+//       readers of archives that are actual files (not pipes): the archive is
+//       memory-mapped (shared between processes via the page cache) and an
+//       index from key to byte offset is either read from the sidecar file
+//       <archive>.idx (if it exists and is not older than the archive), or
+//       built by scanning the archive once when it is opened.  Value() then
+//       reads objects directly from the mapped memory.  The other options (s,
+//       cs, o) make no difference in this case.  Because it only makes sense
+//       for archives, "mmap" implies "ark", so e.g. "mmap:foo.ark" and
+//       "ark,mmap:foo.ark" are equivalent.
+//   cacheN (e.g. cache200) means that a random-access reader keeps the
+//       objects it has returned in a least-recently-used cache of about N
+//       megabytes, so that asking again for a key that is in the cache does
+//       not re-read it.  This helps when the same keys are asked for many
+//       times in no particular order, e.g. per-speaker objects (CMVN stats,
+//       transforms) read via an utt2spk map with RandomAccessTableReaderMapped,
+//       where otherwise each change of speaker re-reads and re-parses the
+//       object.  "cache" without a number means a cache of
+//       kDefaultTableCacheMb megabytes.  It has no effect for sequential
+//       readers.
 //
 //   b   is ignored [for scripting convenience]
 //   t   is ignored [for scripting convenience]
@@ -198,6 +262,10 @@ bool WriteScriptFile(std::ostream &os,
 //
 //   "o, s, p, ark:gunzip -c foo.gz|"
 
+/// The cache size in megabytes of the "cache" rspecifier option when no size is
+/// given.
+const int32 kDefaultTableCacheMb = 256;
+
 struct  RspecifierOptions {
   // These options only make a difference for the RandomAccessTableReader class.
   bool once;   // we assert that the program will only ask for each key once.
@@ -211,9 +279,17 @@ struct  RspecifierOptions {
   bool background;  // For sequential readers, if the background option ("bg")
                     // is provided, it will read ahead to the next object in a
                     // background thread.
+  int32 background_threads;  // The number of background threads, N in the
+                             // "bgN" option; 1 for "bg".  Only relevant if
+                             // background == true.
+  bool mmap;  // For random-access readers of archives, if the "mmap" option
+              // is provided the archive is memory-mapped and indexed.
+  int32 cache_mb;  // For random-access readers, the size in megabytes of the
+                   // cache of objects ("cacheN" option), or 0 for no cache.
   RspecifierOptions(): once(false), sorted(false),
                        called_sorted(false), permissive(false),
-                       background(false) { }
+                       background(false), background_threads(1),
+                       mmap(false), cache_mb(0) { }
 };
 
 enum RspecifierType  {
@@ -386,6 +462,16 @@ class TableWriter {
   // Write the object. Throws KaldiFatalError on error via the KALDI_ERR macro.
   inline void Write(const std::string &key, const T &value) const;
 
+  // Writes the object that 'make_value' puts in a default-constructed T.
+  // With the "bg" wspecifier option, make_value is called by a background
+  // thread, so work needed to produce the object that is written, such as
+  // compressing a matrix or an example, is also taken off the calling thread;
+  // otherwise it is called at once.  make_value must not refer to anything
+  // that may change or be destroyed before the object is written (e.g. copy
+  // what it needs into the lambda).
+  inline void WriteDeferred(const std::string &key,
+                            const std::function<void(T*)> &make_value) const;
+
 
   // Flush will flush any archive; it does not return error status
   // or throw, any errors will be reported on the next Write or Close.
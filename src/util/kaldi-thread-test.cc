@@ -20,6 +20,7 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <atomic>
 #include "base/kaldi-common.h"
 #include "util/kaldi-thread.h"
 
@@ -123,11 +124,47 @@ void TestTaskSequencer() {
 }
 
 
+// Adds up the numbers from 0 to n-1 using tasks that split their range in two
+// parts and submit one of them as a new task, to test tasks submitting tasks.
+void SumRange(ThreadPool *pool, int32 begin, int32 end,
+              std::atomic<int64> *sum) {
+  while (end - begin > 10) {
+    int32 middle = (begin + end) / 2;
+    pool->Submit([=] () { SumRange(pool, middle, end, sum); });
+    end = middle;
+  }
+  for (int32 i = begin; i < end; i++)
+    *sum += i;
+}
+
+void TestThreadPool() {
+  ThreadPool pool(1 + Rand() % 10);
+  for (int32 n = 0; n < 3; n++) {
+    std::atomic<int64> sum(0);
+    int32 num_tasks = Rand() % 1000;
+    for (int32 i = 0; i < num_tasks; i++)
+      pool.Submit([i, &sum] () { sum += i; });
+    pool.Wait();
+    KALDI_ASSERT(sum == (static_cast<int64>(num_tasks) * (num_tasks - 1)) / 2);
+
+    sum = 0;
+    int32 m = Rand() % 100000;
+    pool.Submit([&pool, m, &sum] () { SumRange(&pool, 0, m, &sum); });
+    pool.Wait();
+    KALDI_ASSERT(sum == (static_cast<int64>(m) * (m - 1)) / 2);
+  }
+  // Let the destructor wait for these.
+  for (int32 i = 0; i < 10; i++)
+    pool.Submit([] () { });
+}
+
 }  // end namespace kaldi.
 
 int main() {
   using namespace kaldi;
   TestThreads();
+  for (int32 i = 0; i < 10; i++)
+    TestThreadPool();
   for (int32 i = 0; i < 10; i++)
     TestTaskSequencer();
 }
@@ -29,5 +29,111 @@ MultiThreadable::~MultiThreadable() {
 }
 
 
+// The pool whose thread we are in, if any, and the index of that thread; used
+// by ThreadPool::Submit().
+static thread_local ThreadPool *current_pool = NULL;
+static thread_local int32 current_thread_index = -1;
+
+ThreadPool::ThreadPool(int32 num_threads):
+    num_unclaimed_(0), num_pending_(0), next_queue_(0), stop_(false) {
+  KALDI_ASSERT(num_threads > 0);
+  for (int32 i = 0; i < num_threads; i++)
+    queues_.push_back(new TaskQueue());
+  for (int32 i = 0; i < num_threads; i++)
+    threads_.push_back(std::thread(&ThreadPool::RunThread, this, i));
+}
+
+void ThreadPool::Submit(const std::function<void()> &task) {
+  int32 q;
+  if (current_pool == this) {
+    // Submitted by one of our own tasks: put it in this thread's queue, where
+    // this thread will find it first.
+    q = current_thread_index;
+  } else {
+    std::lock_guard<std::mutex> lock(mutex_);
+    q = next_queue_;
+    next_queue_ = (next_queue_ + 1) % queues_.size();
+  }
+  {
+    std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+    queues_[q]->tasks.push_back(task);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_unclaimed_++;
+    num_pending_++;
+  }
+  task_cond_.notify_one();
+}
+
+bool ThreadPool::GetTask(int32 thread_index, std::function<void()> *task) {
+  {
+    TaskQueue *queue = queues_[thread_index];
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (!queue->tasks.empty()) {
+      std::swap(*task, queue->tasks.back());
+      queue->tasks.pop_back();
+      return true;
+    }
+  }
+  int32 num_queues = queues_.size();
+  for (int32 i = 1; i < num_queues; i++) {
+    TaskQueue *queue = queues_[(thread_index + i) % num_queues];
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (!queue->tasks.empty()) {
+      std::swap(*task, queue->tasks.front());
+      queue->tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::RunThread(int32 thread_index) {
+  current_pool = this;
+  current_thread_index = thread_index;
+  std::function<void()> task;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_cond_.wait(lock, [this] { return stop_ || num_unclaimed_ > 0; });
+      if (num_unclaimed_ == 0)
+        return;  // stop_ is set.
+      num_unclaimed_--;
+    }
+    // Because we claimed a task above, there is at least one task in the
+    // queues for us; but another thread may get to the one we see first, so
+    // we may have to look more than once.
+    while (!GetTask(thread_index, &task))
+      std::this_thread::yield();
+    task();
+    task = nullptr;  // Free anything it holds before we wait again.
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--num_pending_ == 0)
+      done_cond_.notify_all();
+  }
+}
+
+void ThreadPool::Wait() {
+  KALDI_ASSERT(current_pool != this &&
+               "ThreadPool::Wait() called from within a task.");
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cond_.wait(lock, [this] { return num_pending_ == 0; });
+}
+
+ThreadPool::~ThreadPool() {
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  task_cond_.notify_all();
+  for (size_t i = 0; i < threads_.size(); i++)
+    threads_[i].join();
+  for (size_t i = 0; i < queues_.size(); i++)
+    delete queues_[i];
+}
+
+
 
 }  // end namespace kaldi
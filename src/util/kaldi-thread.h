@@ -22,7 +22,12 @@
 #ifndef KALDI_THREAD_KALDI_THREAD_H_
 #define KALDI_THREAD_KALDI_THREAD_H_ 1
 
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <thread>
+#include <vector>
 #include "itf/options-itf.h"
 #include "util/kaldi-semaphore.h"
 
@@ -34,6 +39,11 @@
 // base class MultiThreadable. C needs to define the operator () that takes
 // no arguments. See ExampleClass below.
 //
+// The class ThreadPool runs tasks (any std::function<void()>) on a fixed set
+// of threads that it creates once.  Each thread has its own queue of tasks;
+// a thread that runs out of tasks takes (steals) them from the other threads'
+// queues, so the threads stay busy when the tasks are of very different sizes.
+//
 // The class TaskSequencer addresses a different problem typically encountered
 // in Kaldi command-line programs that process a sequence of items. The items
 // to be processed are coming in. They are all of different sizes, e.g.
@@ -42,14 +52,14 @@
 // must be output in the same order they came in. Here, we again accept objects
 // of some class C with an operator () that takes no arguments. C may also have
 // a destructor with side effects (typically some kind of output).
-// TaskSequencer is responsible for running the jobs in parallel. It has a
-// function Run() that will accept a new object of class C; this will block
-// until a thread is free, at which time it will spawn a thread that starts
-// running the operator () of the object. When threads are finished running,
-// the objects will be deleted. TaskSequencer guarantees that the destructors
-// will be called sequentially (not in parallel) and in the same order the
-// objects were given to the Run() function, so that it is safe for the
-// destructor to have side effects such as outputting data.
+// TaskSequencer is responsible for running the jobs in parallel, which it
+// does on a ThreadPool. It has a function Run() that will accept a new object
+// of class C and will queue it to have its operator () run; it blocks only if
+// too many objects are already waiting to be run or output. When the objects
+// are finished running, they will be deleted. TaskSequencer guarantees that
+// the destructors will be called sequentially (not in parallel) and in the
+// same order the objects were given to the Run() function, so that it is safe
+// for the destructor to have side effects such as outputting data.
 // Note: the destructor of TaskSequencer will wait for any remaining jobs that
 // are still running and will call the destructors.
 
@@ -152,6 +162,62 @@ template<class C> void RunMultiThreaded(const C &c_in) {
 }
 
 
+/// ThreadPool runs tasks on a fixed number of threads, with a queue of tasks
+/// per thread and work stealing; see the comment at the top of this file.
+/// Tasks may themselves submit tasks, which go to the queue of the thread
+/// that submitted them.  Tasks may not throw (as for any std::thread, an
+/// uncaught exception terminates the program).
+class ThreadPool {
+ public:
+  /// Creates the threads; requires num_threads > 0.
+  explicit ThreadPool(int32 num_threads);
+
+  /// Queues 'task' to be run by one of the threads.  Does not block.
+  void Submit(const std::function<void()> &task);
+
+  /// Waits until all the tasks that have been submitted (including any that
+  /// they submit) have finished.  Must not be called from within a task.
+  void Wait();
+
+  int32 NumThreads() const { return threads_.size(); }
+
+  /// Waits for all tasks to finish, then stops the threads.
+  ~ThreadPool();
+
+ private:
+  struct TaskQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()> > tasks;
+  };
+
+  // This is the function that the threads run.
+  void RunThread(int32 thread_index);
+
+  // Gets a task for thread 'thread_index' to run: the most recently added
+  // one from its own queue if there is one, otherwise the oldest one from
+  // another thread's queue.  Returns false if all the queues were empty.
+  bool GetTask(int32 thread_index, std::function<void()> *task);
+
+  std::vector<TaskQueue*> queues_;  // One per thread.
+  std::vector<std::thread> threads_;
+
+  // The following are protected by mutex_.
+  std::mutex mutex_;
+  std::condition_variable task_cond_;  // Notified when tasks are submitted.
+  std::condition_variable done_cond_;  // Notified when num_pending_ gets to 0.
+  // The number of tasks in the queues that no thread has yet claimed; a
+  // thread decrements this before taking a task from the queues, so the
+  // queues always contain at least this many tasks.
+  int64 num_unclaimed_;
+  int64 num_pending_;  // The number of tasks submitted and not yet finished.
+  // Used to distribute tasks submitted from outside the pool over the queues.
+  int32 next_queue_;
+  bool stop_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+
 struct TaskSequencerConfig {
   int32 num_threads;
   int32 num_threads_total;
@@ -159,8 +225,8 @@ struct TaskSequencerConfig {
   void Register(OptionsItf *opts) {
     opts->Register("num-threads", &num_threads, "Number of actively processing "
                    "threads to run in parallel");
-    opts->Register("num-threads-total", &num_threads_total, "Total number of "
-                   "threads, including those that are waiting on other threads "
+    opts->Register("num-threads-total", &num_threads_total, "Maximum number "
+                   "of tasks being processed or waiting to be processed or "
                    "to produce their output.  Controls memory use.  If <= 0, "
                    "defaults to --num-threads plus 20.  Otherwise, must "
                    "be >= num-threads.");
@@ -175,13 +241,14 @@ class TaskSequencer {
  public:
   TaskSequencer(const TaskSequencerConfig &config):
       num_threads_(config.num_threads),
-      threads_avail_(config.num_threads),
-      tot_threads_avail_(config.num_threads_total > 0 ? config.num_threads_total :
-                         config.num_threads + 20),
-      thread_list_(NULL) {
+      max_tasks_(config.num_threads_total > 0 ? config.num_threads_total :
+                 config.num_threads + 20),
+      pool_(NULL), num_tasks_(0), outputting_(false) {
     KALDI_ASSERT((config.num_threads_total <= 0 ||
                   config.num_threads_total >= config.num_threads) &&
                  "num-threads-total, if specified, must be >= num-threads");
+    if (num_threads_ > 0)
+      pool_ = new ThreadPool(num_threads_);
   }
 
   /// This function takes ownership of the pointer "c", and will delete it
@@ -193,90 +260,82 @@ class TaskSequencer {
       delete c;
       return;
     }
-
-    threads_avail_.Wait(); // wait till we have a thread for computation free.
-    tot_threads_avail_.Wait(); // this ensures we don't have too many threads
-    // waiting on I/O, and consume too much memory.
-
-    // put the new RunTaskArgsList object at head of the singly
-    // linked list thread_list_.
-    thread_list_ = new RunTaskArgsList(this, c, thread_list_);
-    thread_list_->thread = std::thread(TaskSequencer<C>::RunTask,
-                                       thread_list_);
+    Task *task = new Task(c);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      // this ensures we don't have too many tasks waiting to run or to be
+      // output, and consume too much memory.
+      task_done_cond_.wait(lock, [this] { return num_tasks_ < max_tasks_; });
+      num_tasks_++;
+      tasks_.push_back(task);
+    }
+    pool_->Submit([this, task] () {
+        (*(task->c))();  // call operator () on task->c, which does the
+                         // computation.
+        this->TaskDone(task);
+      });
   }
 
   void Wait() { // You call this at the end if it's more convenient
     // than waiting for the destructor.  It waits for all tasks to finish.
-    if (thread_list_ != NULL) {
-      thread_list_->thread.join();
-      KALDI_ASSERT(thread_list_->tail == NULL); // thread would not
-      // have exited without setting tail to NULL.
-      delete thread_list_;
-      thread_list_ = NULL;
-    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_done_cond_.wait(lock, [this] { return num_tasks_ == 0; });
   }
 
-  /// The destructor waits for the last thread to exit.
+  /// The destructor waits for the last task to finish.
   ~TaskSequencer() {
     Wait();
+    delete pool_;
   }
  private:
-  struct RunTaskArgsList {
-    TaskSequencer *me; // Think of this as a "this" pointer.
-    C *c; // Clist element of the task we're expected
-    std::thread thread;
-    RunTaskArgsList *tail;
-    RunTaskArgsList(TaskSequencer *me, C *c, RunTaskArgsList *tail):
-        me(me), c(c), tail(tail) {}
+  struct Task {
+    C *c;
+    bool done;  // true once c's operator () has returned.
+    explicit Task(C *c): c(c), done(false) { }
   };
-  // This static function gets run in the threads that we create.
-  static void RunTask(RunTaskArgsList *args) {
-    // (1) run the job.
-    (*(args->c))(); // call operator () on args->c, which does the computation.
-    args->me->threads_avail_.Signal(); // Signal that the compute-intensive
-    // part of the thread is done (we want to run no more than
-    // config_.num_threads of these.)
-
-    // (2) we want to destroy the object "c" now, by deleting it.  But for
-    //     correct sequencing (this is the whole point of this class, it
-    //     is intended to ensure the output of the program is in correct order),
-    //     we first wait till the previous thread, whose details will be in "tail",
-    //     is finished.
-    if (args->tail != NULL) {
-      args->tail->thread.join();
-    }
 
-    delete args->c; // delete the object "c".  This may cause some output,
-    // e.g. to a stream.  We don't need to worry about concurrent access to
-    // the output stream, because each thread waits for the previous thread
-    // to be done, before doing this.  So there is no risk of concurrent
-    // access.
-    args->c = NULL;
-
-    if (args->tail != NULL) {
-      KALDI_ASSERT(args->tail->tail == NULL); // Because we already
-      // did join on args->tail->thread, which means that
-      // thread was done, and before it exited, it would have
-      // deleted and set to NULL its tail (which is the next line of code).
-      delete args->tail;
-      args->tail = NULL;
+  // This is called in the thread that ran the task.
+  void TaskDone(Task *task) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    task->done = true;
+    // We want to delete the object "c" now.  But for correct sequencing (this
+    // is the whole point of this class, it is intended to ensure the output
+    // of the program is in correct order) we can only do so once all the
+    // earlier objects have been deleted; and only one thread at a time may
+    // delete objects.  If another thread is already deleting objects, it will
+    // delete this one when it gets to it.
+    if (outputting_) return;
+    outputting_ = true;
+    while (!tasks_.empty() && tasks_.front()->done) {
+      Task *front = tasks_.front();
+      tasks_.pop_front();
+      lock.unlock();
+      delete front->c;  // delete the object "c".  This may cause some
+      // output, e.g. to a stream.  We don't need to worry about concurrent
+      // access to the output stream, because only the thread that set
+      // outputting_ does this.
+      delete front;
+      lock.lock();
+      num_tasks_--;
+      task_done_cond_.notify_all();
     }
-    // At this point we are exiting from the thread.  Signal the
-    // "tot_threads_avail_" semaphore which is used to limit the total number of threads that are alive, including
-    // not onlhy those that are in active computation in c->operator (), but those
-    // that are waiting on I/O or other threads.
-    args->me->tot_threads_avail_.Signal();
+    outputting_ = false;
   }
 
-  int32 num_threads_; // copy of config.num_threads (since Semaphore doesn't store original count)
-
-  Semaphore threads_avail_; // Initialized to the number of threads we are
-  // supposed to run with; the function Run() waits on this.
-
-  Semaphore tot_threads_avail_; // We use this semaphore to ensure we don't
-  // consume too much memory...
-  RunTaskArgsList *thread_list_;
-
+  int32 num_threads_;  // copy of config.num_threads
+  int32 max_tasks_;  // The maximum number of tasks in tasks_.
+  ThreadPool *pool_;  // NULL if num_threads_ == 0.
+
+  // The following are protected by mutex_.
+  std::mutex mutex_;
+  // Notified whenever a task has been deleted.
+  std::condition_variable task_done_cond_;
+  // The tasks that have not been deleted yet, in the order Run() was called.
+  std::deque<Task*> tasks_;
+  // The number of tasks not yet deleted: tasks_.size(), plus one while a
+  // task that has been removed from tasks_ is being deleted.
+  int32 num_tasks_;
+  bool outputting_;  // True while a thread is deleting objects.
 };
 
 } // namespace kaldi
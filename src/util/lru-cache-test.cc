@@ -0,0 +1,97 @@
+// util/lru-cache-test.cc
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <map>
+#include <thread>
+
+#include "util/lru-cache.h"
+
+namespace kaldi {
+
+void TestLruCacheBasic() {
+  // With one shard the eviction order is exactly LRU.
+  LruCache<int32, int32, std::hash<int32> > cache(3, 1);
+  int32 value;
+  KALDI_ASSERT(!cache.Find(1, &value));
+  cache.Insert(1, 10);
+  cache.Insert(2, 20);
+  cache.Insert(3, 30);
+  KALDI_ASSERT(cache.Find(1, &value) && value == 10);
+  cache.Insert(4, 40);  // Evicts 2, which is now the least recently used.
+  KALDI_ASSERT(!cache.Find(2, &value));
+  KALDI_ASSERT(cache.Find(3, &value) && value == 30);
+  KALDI_ASSERT(cache.Find(4, &value) && value == 40);
+  cache.Insert(1, 11);  // Replaces the value.
+  KALDI_ASSERT(cache.Find(1, &value) && value == 11);
+  KALDI_ASSERT(cache.Size() == 3);
+}
+
+void TestLruCacheRandom() {
+  // Any value we find must be the last one inserted for its key, and the
+  // size must stay bounded.
+  int32 capacity = 50 + Rand() % 100;
+  LruCache<std::vector<int32>, int32, VectorHasher<int32> > cache(capacity);
+  std::map<std::vector<int32>, int32> reference;
+  for (int32 i = 0; i < 5000; i++) {
+    std::vector<int32> key(1 + Rand() % 3);
+    for (size_t j = 0; j < key.size(); j++)
+      key[j] = Rand() % 6;
+    int32 value;
+    if (Rand() % 2 == 0) {
+      value = Rand();
+      cache.Insert(key, value);
+      reference[key] = value;
+    } else if (cache.Find(key, &value)) {
+      KALDI_ASSERT(reference.count(key) != 0 && reference[key] == value);
+    }
+    KALDI_ASSERT(cache.Size() <= capacity + 16);
+  }
+}
+
+void TestLruCacheThreads() {
+  // Each key's value is a function of the key, so whatever the interleaving,
+  // any value found must equal that function.
+  LruCache<int32, int32, std::hash<int32> > cache(100);
+  std::vector<std::thread> threads;
+  for (int32 t = 0; t < 4; t++) {
+    threads.push_back(std::thread([&cache, t]() {
+      for (int32 i = 0; i < 20000; i++) {
+        int32 key = (i * 7 + t * 13) % 500, value;
+        if (cache.Find(key, &value))
+          KALDI_ASSERT(value == key * 3);
+        else
+          cache.Insert(key, key * 3);
+      }
+    }));
+  }
+  for (size_t t = 0; t < threads.size(); t++)
+    threads[t].join();
+  KALDI_ASSERT(cache.Size() <= 100 + 16);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  TestLruCacheBasic();
+  for (int32 i = 0; i < 5; i++)
+    TestLruCacheRandom();
+  TestLruCacheThreads();
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,146 @@
+// util/lru-cache.h
+
+// Copyright 2026  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_LRU_CACHE_H_
+#define KALDI_UTIL_LRU_CACHE_H_
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "util/stl-utils.h"
+
+namespace kaldi {
+
+/**
+   LruCache is a thread-safe cache from Key to Value, holding at most a
+   specified number of entries and evicting the least recently used ones.  It
+   is intended for caching the results of expensive computations (e.g. of
+   language-model states) across utterances, possibly in multiple threads.
+
+   To reduce lock contention it is split into shards, according to the hash of
+   the key, each of which has its own mutex and its own LRU list; so the
+   eviction order is only approximately LRU overall.  Values are copied in and
+   out, so Value should be cheap to copy; for large objects use something like
+   std::shared_ptr<const T>, which also keeps a value alive while a user holds
+   it even if it has been evicted.
+ */
+template<class Key, class Value, class Hasher>
+class LruCache {
+ public:
+  /// 'capacity' is the maximum number of entries in the cache (it is rounded
+  /// up to a multiple of the number of shards); it must be positive.
+  explicit LruCache(size_t capacity, int32 num_shards = 16):
+      shards_(num_shards) {
+    KALDI_ASSERT(capacity > 0 && num_shards > 0);
+    shard_capacity_ = (capacity + num_shards - 1) / num_shards;
+  }
+
+  /// If 'key' is in the cache, copies its value to '*value', marks it as the
+  /// most recently used and returns true; otherwise returns false.
+  bool Find(const Key &key, Value *value) {
+    Shard &shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    typename MapType::iterator iter = shard.map.find(key);
+    if (iter == shard.map.end()) {
+      shard.num_misses++;
+      return false;
+    }
+    shard.list.splice(shard.list.begin(), shard.list, iter->second);
+    *value = iter->second->second;
+    shard.num_hits++;
+    return true;
+  }
+
+  /// Adds 'key' with value 'value' to the cache (replacing the value if the
+  /// key was already present), evicting the least recently used entry of its
+  /// shard if the shard is full.
+  void Insert(const Key &key, const Value &value) {
+    Shard &shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    typename MapType::iterator iter = shard.map.find(key);
+    if (iter != shard.map.end()) {
+      iter->second->second = value;
+      shard.list.splice(shard.list.begin(), shard.list, iter->second);
+      return;
+    }
+    shard.list.push_front(std::make_pair(key, value));
+    shard.map[key] = shard.list.begin();
+    if (shard.list.size() > shard_capacity_) {
+      shard.map.erase(shard.list.back().first);
+      shard.list.pop_back();
+    }
+  }
+
+  /// Returns the number of entries currently in the cache.
+  size_t Size() {
+    size_t ans = 0;
+    for (size_t i = 0; i < shards_.size(); i++) {
+      std::lock_guard<std::mutex> lock(shards_[i].mutex);
+      ans += shards_[i].list.size();
+    }
+    return ans;
+  }
+
+  /// Prints the hit rate of Find() to the log, with 'name' describing the
+  /// cache.
+  void PrintStats(const std::string &name) {
+    int64 num_hits = 0, num_misses = 0;
+    for (size_t i = 0; i < shards_.size(); i++) {
+      std::lock_guard<std::mutex> lock(shards_[i].mutex);
+      num_hits += shards_[i].num_hits;
+      num_misses += shards_[i].num_misses;
+    }
+    KALDI_LOG << name << ": " << num_hits << " hits and " << num_misses
+              << " misses (hit rate "
+              << (num_hits / (num_hits + num_misses + 1.0e-10)) << ")";
+  }
+
+ private:
+  typedef std::list<std::pair<Key, Value> > ListType;
+  typedef unordered_map<Key, typename ListType::iterator, Hasher> MapType;
+
+  struct Shard {
+    std::mutex mutex;
+    ListType list;  // The most recently used entry is at the front.
+    MapType map;
+    int64 num_hits;
+    int64 num_misses;
+    Shard(): num_hits(0), num_misses(0) { }
+  };
+
+  Shard &GetShard(const Key &key) {
+    // We use the high bits of a multiplicative hash, since the map in the
+    // shard will mostly use the low bits of the hash.
+    uint64 h = static_cast<uint64>(hasher_(key)) * 0x9e3779b97f4a7c15ULL;
+    return shards_[(h >> 40) % shards_.size()];
+  }
+
+  std::vector<Shard> shards_;
+  size_t shard_capacity_;
+  Hasher hasher_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LruCache);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_LRU_CACHE_H_
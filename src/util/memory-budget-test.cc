@@ -0,0 +1,58 @@
+// util/memory-budget-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/memory-budget.h"
+
+namespace kaldi {
+
+void TestMemoryBudget() {
+  MemoryBudget &budget = MemoryBudget::Global();
+  KALDI_ASSERT(budget.TotalBytes() == 0 && budget.Usage() == 0.0);
+  {
+    MemoryAccount tokens(kMemoryDecoderTokens), links(kMemoryDecoderLinks),
+        gpu(kMemoryGpuAllocator);
+    tokens.Set(1000);
+    links.Set(3000);
+    links.Add(-1000);
+    gpu.Set(5000);
+    KALDI_ASSERT(budget.Bytes(kMemoryDecoderTokens) == 1000 &&
+                 budget.Bytes(kMemoryDecoderLinks) == 2000 &&
+                 budget.Bytes(kMemoryGpuAllocator) == 5000);
+    // the GPU memory is not counted in the total.
+    KALDI_ASSERT(budget.TotalBytes() == 3000);
+    {
+      MemoryAccount more_tokens(kMemoryDecoderTokens);
+      more_tokens.Set(500);
+      KALDI_ASSERT(budget.Bytes(kMemoryDecoderTokens) == 1500);
+    }
+    KALDI_ASSERT(budget.Bytes(kMemoryDecoderTokens) == 1000);
+    budget.SetLimit(2000);
+    KALDI_ASSERT(budget.Usage() == 1.5);
+    KALDI_LOG << budget.Summary();
+  }
+  KALDI_ASSERT(budget.TotalBytes() == 0 &&
+               budget.Bytes(kMemoryGpuAllocator) == 0);
+  budget.SetLimit(0);
+}
+
+}  // namespace kaldi
+
+int main() {
+  kaldi::TestMemoryBudget();
+  std::cout << "Test OK.\n";
+  return 0;
+}
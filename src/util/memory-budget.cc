@@ -0,0 +1,75 @@
+// util/memory-budget.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sstream>
+
+#include "util/memory-budget.h"
+
+namespace kaldi {
+
+MemoryBudget &MemoryBudget::Global() {
+  static MemoryBudget budget;
+  return budget;
+}
+
+MemoryBudget::MemoryBudget(): limit_(0) {
+  for (int32 i = 0; i < kNumMemoryCategories; i++)
+    bytes_[i] = 0;
+}
+
+int64 MemoryBudget::TotalBytes() const {
+  int64 ans = 0;
+  for (int32 i = 0; i < kNumMemoryCategories; i++)
+    if (i != kMemoryGpuAllocator)
+      ans += Bytes(static_cast<MemoryCategory>(i));
+  return ans;
+}
+
+double MemoryBudget::Usage() const {
+  int64 limit = limit_;
+  return (limit > 0 ? TotalBytes() / static_cast<double>(limit) : 0.0);
+}
+
+std::string MemoryBudget::Summary() const {
+  std::ostringstream os;
+  os << "Memory used: total " << (TotalBytes() / 1.0e+06) << " MB";
+  if (limit_ > 0)
+    os << " of budget " << (limit_ / 1.0e+06) << " MB";
+  os << " (";
+  for (int32 i = 0; i < kNumMemoryCategories; i++) {
+    MemoryCategory category = static_cast<MemoryCategory>(i);
+    os << (i > 0 ? ", " : "") << CategoryName(category) << " "
+       << (Bytes(category) / 1.0e+06) << " MB";
+  }
+  os << ")";
+  return os.str();
+}
+
+const char *MemoryBudget::CategoryName(MemoryCategory category) {
+  switch (category) {
+    case kMemoryDecoderTokens: return "decoder-tokens";
+    case kMemoryDecoderLinks: return "decoder-links";
+    case kMemoryRawLattice: return "raw-lattice";
+    case kMemoryDeterminization: return "determinization";
+    case kMemoryFeatureCache: return "feature-cache";
+    case kMemoryGpuAllocator: return "gpu-allocator";
+    default: KALDI_ERR << "Invalid memory category " << category;
+  }
+  return NULL;  // Suppress compiler warning.
+}
+
+}  // namespace kaldi
@@ -0,0 +1,117 @@
+// util/memory-budget.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_MEMORY_BUDGET_H_
+#define KALDI_UTIL_MEMORY_BUDGET_H_
+
+#include <atomic>
+#include <string>
+
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/**
+   This file contains the accounting of the memory used by the large data
+   structures of decoding (decoder tokens and links, lattices being
+   determinized, cached features and the GPU memory allocator), so that when
+   decoding long utterances we can tell where the memory goes, and so that the
+   decoders can tighten their beams when the process approaches a memory
+   budget, rather than being killed for running out of memory.
+
+   The code that owns the memory holds a MemoryAccount for its category and
+   calls Set() with the number of bytes it currently uses; the totals over all
+   accounts (e.g. over all the decoders in a multi-threaded program) are kept
+   by MemoryBudget::Global().
+*/
+
+enum MemoryCategory {
+  kMemoryDecoderTokens = 0,
+  kMemoryDecoderLinks,
+  kMemoryRawLattice,       // lattices being determinized.
+  kMemoryDeterminization,  // the determinizer's own data.
+  kMemoryFeatureCache,
+  kMemoryGpuAllocator,     // device memory; not counted in TotalBytes().
+  kNumMemoryCategories
+};
+
+class MemoryBudget {
+ public:
+  static MemoryBudget &Global();
+
+  MemoryBudget();
+
+  /// Adds 'bytes' (which may be negative) to the bytes used in 'category'.
+  void Add(MemoryCategory category, int64 bytes) {
+    bytes_[category].fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  int64 Bytes(MemoryCategory category) const {
+    return bytes_[category].load(std::memory_order_relaxed);
+  }
+
+  /// Returns the bytes used in the categories of host memory, i.e. all except
+  /// kMemoryGpuAllocator.
+  int64 TotalBytes() const;
+
+  /// Sets the budget for TotalBytes(); zero (the default) means no limit.
+  void SetLimit(int64 bytes) { limit_ = bytes; }
+  int64 Limit() const { return limit_; }
+
+  /// Returns TotalBytes() / Limit(), or zero if there is no limit; a value
+  /// greater than one means we are over budget.
+  double Usage() const;
+
+  /// Returns a one-line summary of the bytes used in each category, for
+  /// logging.
+  std::string Summary() const;
+
+  static const char *CategoryName(MemoryCategory category);
+
+ private:
+  std::atomic<int64> bytes_[kNumMemoryCategories];
+  std::atomic<int64> limit_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MemoryBudget);
+};
+
+/// The bytes used by one object in one category of MemoryBudget::Global().
+/// The destructor sets them to zero.
+class MemoryAccount {
+ public:
+  explicit MemoryAccount(MemoryCategory category):
+      category_(category), bytes_(0) { }
+
+  void Set(int64 bytes) {
+    if (bytes != bytes_) {
+      MemoryBudget::Global().Add(category_, bytes - bytes_);
+      bytes_ = bytes;
+    }
+  }
+  void Add(int64 bytes) { Set(bytes_ + bytes); }
+  int64 Bytes() const { return bytes_; }
+
+  ~MemoryAccount() { Set(0); }
+
+ private:
+  MemoryCategory category_;
+  int64 bytes_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MemoryAccount);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_MEMORY_BUDGET_H_
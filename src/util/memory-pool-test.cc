@@ -0,0 +1,80 @@
+// util/memory-pool-test.cc
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/memory-pool.h"
+#include <new>
+#include <set>
+
+namespace kaldi {
+
+struct TestObject {
+  int32 a;
+  double b;
+  TestObject *next;
+  TestObject(int32 a, double b, TestObject *next): a(a), b(b), next(next) { }
+};
+
+void TestMemoryPool() {
+  MemoryPool<TestObject> pool(RandInt(1, 20));
+  for (int32 utt = 0; utt < 5; utt++) {
+    std::vector<TestObject*> live;
+    int32 n = RandInt(0, 500);
+    for (int32 i = 0; i < n; i++) {
+      if (!live.empty() && RandInt(0, 2) == 0) {
+        size_t j = RandInt(0, live.size() - 1);
+        std::swap(live[j], live.back());
+        pool.Delete(live.back());
+        live.pop_back();
+      } else {
+        TestObject *next = (live.empty() ? NULL : live.back());
+        TestObject *t = new (pool.Allocate()) TestObject(i, i * 0.5, next);
+        KALDI_ASSERT(t->a == i && t->b == i * 0.5 && t->next == next);
+        KALDI_ASSERT(reinterpret_cast<size_t>(t) % alignof(TestObject) == 0);
+        live.push_back(t);
+      }
+    }
+    // Live objects must all be distinct and intact.
+    std::set<TestObject*> live_set(live.begin(), live.end());
+    KALDI_ASSERT(live_set.size() == live.size());
+    for (size_t i = 0; i < live.size(); i++)
+      KALDI_ASSERT(live[i]->b == live[i]->a * 0.5);
+    size_t capacity = pool.Capacity();
+    KALDI_ASSERT(capacity >= live.size() &&
+                 pool.NumAllocated() == live.size());
+    pool.Reset();
+    // After a Reset(), the same number of objects must not allocate again.
+    for (size_t i = 0; i < live.size(); i++)
+      new (pool.Allocate()) TestObject(0, 0.0, NULL);
+    KALDI_ASSERT(pool.Capacity() == capacity &&
+                 pool.NumAllocated() == live.size());
+    pool.Reset();
+  }
+}
+
+}  // end namespace kaldi
+
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++)
+    TestMemoryPool();
+  std::cout << "Test OK.\n";
+  return 0;
+}
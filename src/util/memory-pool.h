@@ -0,0 +1,125 @@
+// util/memory-pool.h
+
+// Copyright 2026  Kaldi contributors
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_MEMORY_POOL_H_
+#define KALDI_UTIL_MEMORY_POOL_H_
+#include <type_traits>
+#include <vector>
+#include "base/kaldi-common.h"
+
+
+/* This header provides a memory pool for the many small, short-lived objects
+   of a single type that are created by the decoders (tokens and forward
+   links).  Objects are allocated in blocks, and freed objects go on a free
+   list for reuse, like the Elems of HashList (see hash-list.h).  In addition,
+   Reset() frees all the objects at once, without visiting them, and keeps the
+   blocks for reuse; a decoder that calls it between utterances does no memory
+   allocation once it has seen its largest utterance.  Memory is only returned
+   to the system when the pool is destroyed.
+
+   Because Reset() does not call destructors, the type must be trivially
+   destructible.
+
+   See memory-pool-test.cc for an example of how to use this object.
+*/
+
+
+namespace kaldi {
+
+template<class T> class MemoryPool {
+  static_assert(std::is_trivially_destructible<T>::value,
+                "MemoryPool requires a trivially destructible type.");
+ public:
+  /// 'block_size' is the number of objects allocated at a time.
+  explicit MemoryPool(size_t block_size = 1024):
+      block_size_(block_size), next_block_(0), cur_(NULL), cur_end_(NULL),
+      free_head_(NULL), num_allocated_(0) { KALDI_ASSERT(block_size > 0); }
+
+  /// Returns memory for one object, to be used with placement new, e.g.
+  ///  T *t = new (pool.Allocate()) T(args);
+  inline void *Allocate() {
+    Slot *slot;
+    if (free_head_ != NULL) {
+      slot = free_head_;
+      free_head_ = free_head_->next;
+    } else {
+      if (cur_ == cur_end_) NextBlock();
+      slot = cur_++;
+    }
+    num_allocated_++;
+    return slot;
+  }
+
+  /// Think of this like delete t; 't' must have been constructed in memory
+  /// returned by Allocate() (since the last Reset()).
+  inline void Delete(T *t) {
+    Slot *slot = reinterpret_cast<Slot*>(t);
+    slot->next = free_head_;
+    free_head_ = slot;
+    num_allocated_--;
+  }
+
+  /// Frees all the objects allocated so far, so all pointers to them
+  /// become invalid.  The memory is kept for reuse.
+  void Reset() {
+    next_block_ = 0;
+    cur_ = cur_end_ = NULL;
+    free_head_ = NULL;
+    num_allocated_ = 0;
+  }
+
+  /// Returns the number of objects the pool has memory for.
+  size_t Capacity() const { return blocks_.size() * block_size_; }
+
+  /// Returns the number of objects currently allocated (i.e. not deleted).
+  size_t NumAllocated() const { return num_allocated_; }
+
+  ~MemoryPool() {
+    for (size_t i = 0; i < blocks_.size(); i++)
+      delete [] blocks_[i];
+  }
+
+ private:
+  union Slot {
+    Slot *next;  // if on the free list.
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type object;
+  };
+
+  void NextBlock() {
+    if (next_block_ == blocks_.size())
+      blocks_.push_back(new Slot[block_size_]);
+    cur_ = blocks_[next_block_++];
+    cur_end_ = cur_ + block_size_;
+  }
+
+  size_t block_size_;
+  std::vector<Slot*> blocks_;  // the allocated blocks.
+  size_t next_block_;  // index into blocks_ of the next block to use.
+  Slot *cur_;  // next unused slot in the current block.
+  Slot *cur_end_;  // end of the current block.
+  Slot *free_head_;  // head of the list of freed objects.
+  size_t num_allocated_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MemoryPool);
+};
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_MEMORY_POOL_H_
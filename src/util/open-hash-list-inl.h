@@ -0,0 +1,197 @@
+// util/open-hash-list-inl.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_OPEN_HASH_LIST_INL_H_
+#define KALDI_UTIL_OPEN_HASH_LIST_INL_H_
+
+// Do not include this file directly.  It is included by open-hash-list.h
+
+
+namespace kaldi {
+
+template<class I, class T> OpenHashList<I, T>::OpenHashList():
+    list_head_(NULL), list_tail_(NULL), slots_(NULL), capacity_(0),
+    allocated_capacity_(0), shift_(64), freed_head_(NULL) {
+  SetSize(16);
+}
+
+template<class I, class T>
+void OpenHashList<I, T>::AllocateSlots(size_t capacity) {
+  if (slots_ != NULL)
+    KALDI_MEMALIGN_FREE(slots_);
+  void *data;
+  if (KALDI_MEMALIGN(kCacheLineSize, capacity * sizeof(Slot), &data) == NULL)
+    KALDI_ERR << "Failed to allocate hash table of " << capacity
+              << " slots.";
+  slots_ = static_cast<Slot*>(data);
+  for (size_t i = 0; i < capacity; i++)
+    slots_[i].elem = NULL;
+  allocated_capacity_ = capacity;
+}
+
+template<class I, class T> void OpenHashList<I, T>::SetSize(size_t size) {
+  KALDI_ASSERT(list_head_ == NULL && used_slots_.empty());  // must be empty.
+  size_t capacity = 16;
+  int32 shift = 60;
+  while (capacity < size) {
+    capacity *= 2;
+    shift--;
+  }
+  if (capacity > allocated_capacity_)
+    AllocateSlots(capacity);
+  // If the table was bigger than we need, we use the start of it; the rest of
+  // it is empty.
+  capacity_ = capacity;
+  shift_ = shift;
+}
+
+template<class I, class T>
+inline size_t OpenHashList<I, T>::FirstSlot(I key) const {
+  // Fibonacci hashing: the top bits of the product depend on all the bits of
+  // the key.  We round down to the start of a cache line.
+  uint64 h = static_cast<uint64>(key) * UINT64_C(0x9E3779B97F4A7C15);
+  return static_cast<size_t>(h >> shift_) & ~(kSlotsPerLine - 1);
+}
+
+template<class I, class T>
+typename OpenHashList<I, T>::Elem* OpenHashList<I, T>::Clear() {
+  for (std::vector<size_t>::const_iterator iter = used_slots_.begin();
+       iter != used_slots_.end(); ++iter)
+    slots_[*iter].elem = NULL;
+  used_slots_.clear();
+  Elem *ans = list_head_;
+  list_head_ = NULL;
+  list_tail_ = NULL;
+  return ans;
+}
+
+template<class I, class T>
+inline void OpenHashList<I, T>::Delete(Elem *e) {
+  e->tail = freed_head_;
+  freed_head_ = e;
+}
+
+template<class I, class T>
+inline typename OpenHashList<I, T>::Elem* OpenHashList<I, T>::New() {
+  if (freed_head_) {
+    Elem *ans = freed_head_;
+    freed_head_ = freed_head_->tail;
+    return ans;
+  } else {
+    Elem *tmp = new Elem[allocate_block_size_];
+    for (size_t i = 0; i+1 < allocate_block_size_; i++)
+      tmp[i].tail = tmp+i+1;
+    tmp[allocate_block_size_-1].tail = NULL;
+    freed_head_ = tmp;
+    allocated_.push_back(tmp);
+    return this->New();
+  }
+}
+
+template<class I, class T>
+inline typename OpenHashList<I, T>::Elem* OpenHashList<I, T>::Find(I key) {
+  size_t mask = capacity_ - 1;
+  for (size_t i = FirstSlot(key); ; i = (i + 1) & mask) {
+    const Slot &slot = slots_[i];
+    if (slot.elem == NULL) return NULL;
+    if (slot.key == key) return slot.elem;
+  }
+}
+
+template<class I, class T>
+inline typename OpenHashList<I, T>::Elem* OpenHashList<I, T>::Insert(I key,
+                                                                      T val) {
+  size_t mask = capacity_ - 1, i = FirstSlot(key);
+  for (; slots_[i].elem != NULL; i = (i + 1) & mask)
+    if (slots_[i].key == key) return slots_[i].elem;
+
+  // This is a new element.  Insert it at the end of the list.
+  Elem *elem = New();
+  elem->key = key;
+  elem->val = val;
+  elem->tail = NULL;
+  if (list_tail_ == NULL) list_head_ = elem;
+  else list_tail_->tail = elem;
+  list_tail_ = elem;
+  slots_[i].key = key;
+  slots_[i].elem = elem;
+  used_slots_.push_back(i);
+  if (used_slots_.size() * 2 > capacity_)
+    Grow();
+  return elem;
+}
+
+template<class I, class T>
+void OpenHashList<I, T>::InsertMore(I key, T val) {
+  Elem *e = Find(key);
+  KALDI_ASSERT(e != NULL);  // assume one element is already here
+  while (e->tail != NULL && e->tail->key == key)
+    e = e->tail;
+  Elem *elem = New();
+  elem->key = key;
+  elem->val = val;
+  elem->tail = e->tail;
+  e->tail = elem;
+  if (list_tail_ == e)
+    list_tail_ = elem;
+}
+
+template<class I, class T> void OpenHashList<I, T>::Grow() {
+  Slot *old_slots = slots_;
+  slots_ = NULL;
+  AllocateSlots(capacity_ * 2);
+  capacity_ *= 2;
+  shift_--;
+  size_t mask = capacity_ - 1;
+  for (std::vector<size_t>::iterator iter = used_slots_.begin();
+       iter != used_slots_.end(); ++iter) {
+    const Slot &old_slot = old_slots[*iter];
+    size_t i = FirstSlot(old_slot.key);
+    while (slots_[i].elem != NULL)
+      i = (i + 1) & mask;
+    slots_[i] = old_slot;
+    *iter = i;
+  }
+  KALDI_MEMALIGN_FREE(old_slots);
+}
+
+template<class I, class T>
+OpenHashList<I, T>::~OpenHashList() {
+  // First test whether we had any memory leak, i.e. things for which the user
+  // did not call Delete().
+  size_t num_in_list = 0, num_allocated = 0;
+  for (Elem *e = freed_head_; e != NULL; e = e->tail)
+    num_in_list++;
+  for (size_t i = 0; i < allocated_.size(); i++) {
+    num_allocated += allocate_block_size_;
+    delete[] allocated_[i];
+  }
+  if (num_in_list != num_allocated) {
+    KALDI_WARN << "Possible memory leak: " << num_in_list
+               << " != " << num_allocated
+               << ": you might have forgotten to call Delete on "
+               << "some Elems";
+  }
+  if (slots_ != NULL)
+    KALDI_MEMALIGN_FREE(slots_);
+}
+
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_OPEN_HASH_LIST_INL_H_
@@ -0,0 +1,158 @@
+// util/open-hash-list.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_OPEN_HASH_LIST_H_
+#define KALDI_UTIL_OPEN_HASH_LIST_H_
+#include <vector>
+#include "base/kaldi-common.h"
+
+
+/* OpenHashList has exactly the same interface as HashList (see hash-list.h):
+   a singly-linked list of Elems, owned by this object, plus a hash that
+   indexes the list of the current frame and can be cleared without touching
+   the list.  It can be used wherever HashList is used, e.g. in
+   LatticeFasterDecoderTpl, which takes the hash type as a template argument.
+
+   The difference is in how the hash is stored.  HashList's buckets point into
+   the list, so Find() has to follow the list's pointers from one Elem to the
+   next, which for a decoder's large and scattered token lists mostly means
+   cache misses.  Here the hash is an open-addressing table (with linear
+   probing) of (key, Elem*) pairs, so the keys are compared without touching
+   the Elems at all.  The table is allocated aligned to cache lines and a key
+   hashes to the start of a cache line, so Find() usually needs to read just
+   one cache line.  The table is kept at most half full, and grows if
+   necessary, so SetSize() is only a hint.  Clear() only empties the slots that
+   were used since the last Clear(), so its cost does not depend on the size of
+   the table.
+
+   The order of the Elems in the list is the order in which they were
+   inserted (except that elements added by InsertMore() follow the other
+   elements with the same key), unlike HashList where they are grouped by
+   hash bucket.
+
+   See hash-list-test.cc for an example of how to use this object, and
+   hash-list-speed-test.cc for a comparison with HashList.
+*/
+
+
+namespace kaldi {
+
+template<class I, class T> class OpenHashList {
+ public:
+  struct Elem {
+    I key;
+    T val;
+    Elem *tail;
+  };
+
+  /// Constructor takes no arguments.
+  /// Call SetSize to inform it of the likely size.
+  OpenHashList();
+
+  /// Clears the hash and gives the head of the current list to the user;
+  /// ownership is transferred to the user (the user must call Delete()
+  /// for each element in the list, at his/her leisure).
+  Elem *Clear();
+
+  /// Gives the head of the current list to the user.  Ownership retained in
+  /// the class.
+  const Elem *GetList() const { return list_head_; }
+
+  /// Think of this like delete().  It is to be called for each Elem in turn
+  /// after you "obtained ownership" by doing Clear().
+  inline void Delete(Elem *e);
+
+  /// Think of this like new(); it should not normally need to be called by
+  /// the user.
+  inline Elem *New();
+
+  /// Find tries to find this element in the current list using the hashtable.
+  /// It returns NULL if not present.  The user is free to modify the "val"
+  /// element of the Elem it returns.  If there are several elements with this
+  /// key (see InsertMore()), it returns the first one.
+  inline Elem *Find(I key);
+
+  /// If an element with this key is present, returns it; otherwise inserts a
+  /// new element at the end of the list and returns it.
+  inline Elem *Insert(I key, T val);
+
+  /// Inserts another element with the same key as an element that is already
+  /// present (the user asserts that there is one), after the other elements
+  /// with that key.
+  inline void InsertMore(I key, T val);
+
+  /// SetSize tells the object how many hash slots to allocate (should
+  /// typically be at least twice the number of objects we expect to go in the
+  /// structure); it is rounded up to a power of two.  It must be called while
+  /// the hash is empty.  Unlike for HashList it is only a hint: the table
+  /// grows if it becomes more than half full.
+  void SetSize(size_t sz);
+
+  /// Returns current number of hash slots.
+  inline size_t Size() const { return capacity_; }
+
+  ~OpenHashList();
+
+ private:
+  struct Slot {
+    I key;
+    Elem *elem;  // NULL if this slot is empty.
+  };
+
+  // Number of slots per cache line; buckets of this many slots start at the
+  // start of a cache line.
+  static const size_t kCacheLineSize = 64;
+  static const size_t kSlotsPerLine =
+      (sizeof(Slot) <= 16 ? 4 : (sizeof(Slot) <= 32 ? 2 : 1));
+
+  // Returns the index of the first slot to look at for this key.
+  inline size_t FirstSlot(I key) const;
+
+  // Allocates the table with "capacity" slots (a power of two), all empty.
+  void AllocateSlots(size_t capacity);
+
+  // Doubles the size of the table, re-inserting the keys that are present.
+  void Grow();
+
+  Elem *list_head_;  // head of currently stored list.
+  Elem *list_tail_;  // tail of currently stored list.
+
+  Slot *slots_;  // The table, of size allocated_capacity_ of which only the
+                 // first capacity_ slots are used.
+  size_t capacity_;  // A power of two.
+  size_t allocated_capacity_;
+  int32 shift_;  // 64 - log2(capacity_).
+  std::vector<size_t> used_slots_;  // Indexes of the non-empty slots.
+
+  Elem *freed_head_;  // head of list of currently freed elements. [ready for
+  // allocation]
+
+  std::vector<Elem*> allocated_;  // list of allocated blocks.
+
+  static const size_t allocate_block_size_ = 1024;  // Number of Elements to
+  // allocate in one block.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(OpenHashList);
+};
+
+
+}  // end namespace kaldi
+
+#include "util/open-hash-list-inl.h"
+
+#endif  // KALDI_UTIL_OPEN_HASH_LIST_H_
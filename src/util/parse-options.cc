@@ -30,6 +30,7 @@
 #include <cstring>
 
 #include "util/parse-options.h"
+#include "util/kaldi-async-log.h"
 #include "util/text-utils.h"
 #include "base/kaldi-common.h"
 
@@ -38,7 +39,8 @@ namespace kaldi {
 
 ParseOptions::ParseOptions(const std::string &prefix,
                            OptionsItf *other):
-    print_args_(false), help_(false), usage_(""), argc_(0), argv_(NULL) {
+    print_args_(false), help_(false), async_log_(false), log_rate_limit_(0),
+    usage_(""), argc_(0), argv_(NULL) {
   ParseOptions *po = dynamic_cast<ParseOptions*>(other);
   if (po != NULL && po->other_parser_ != NULL) {
     // we get here if this constructor is used twice, recursively.
@@ -386,6 +388,11 @@ int ParseOptions::Read(int argc, const char *const argv[]) {
     strm << '\n';
     std::cerr << strm.str() << std::flush;
   }
+  if (async_log_) {
+    AsyncLogOptions async_log_opts;
+    async_log_opts.rate_limit = log_rate_limit_;
+    StartAsyncLogging(async_log_opts);
+  }
   return i;
 }
 
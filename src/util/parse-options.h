@@ -36,8 +36,8 @@ namespace kaldi {
 class ParseOptions : public OptionsItf {
  public:
   explicit ParseOptions(const char *usage) :
-    print_args_(true), help_(false), usage_(usage), argc_(0), argv_(NULL),
-    prefix_(""), other_parser_(NULL) {
+    print_args_(true), help_(false), async_log_(false), log_rate_limit_(0),
+    usage_(usage), argc_(0), argv_(NULL), prefix_(""), other_parser_(NULL) {
 #if !defined(_MSC_VER) && !defined(__CYGWIN__) // This is just a convenient place to set the stderr to line
     setlinebuf(stderr);  // buffering mode, since it's called at program start.
 #endif  // This helps ensure different programs' output is not mixed up.
@@ -48,6 +48,13 @@ class ParseOptions : public OptionsItf {
     RegisterStandard("help", &help_, "Print out usage message");
     RegisterStandard("verbose", &g_kaldi_verbose_level,
                      "Verbose level (higher->more logging)");
+    RegisterStandard("async-log", &async_log_,
+                     "If true, log messages are written by a background "
+                     "thread (errors are still written immediately)");
+    RegisterStandard("log-rate-limit", &log_rate_limit_,
+                     "With --async-log: if >0, the maximum number of "
+                     "messages per second written from any one KALDI_LOG "
+                     "or KALDI_VLOG statement");
   }
 
   /**
@@ -208,6 +215,8 @@ class ParseOptions : public OptionsItf {
 
   bool print_args_;     ///< variable for the implicit --print-args parameter
   bool help_;           ///< variable for the implicit --help parameter
+  bool async_log_;      ///< variable for the implicit --async-log parameter
+  int32 log_rate_limit_;  ///< variable for the implicit --log-rate-limit
   std::string config_;  ///< variable for the implicit --config parameter
   std::vector<std::string> positional_args_;
   const char *usage_;
@@ -0,0 +1,84 @@
+// util/table-map-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+
+#include "util/table-map.h"
+#include "util/table-types.h"
+
+namespace kaldi {
+
+void TestMapTable(int32 num_threads, int32 batch_size) {
+  int32 num_entries = 1000;
+  {
+    Int32VectorWriter writer("ark:tmpf.in");
+    for (int32 i = 0; i < num_entries; i++) {
+      std::vector<int32> vec(RandInt(0, 20));
+      for (size_t j = 0; j < vec.size(); j++)
+        vec[j] = RandInt(0, 1000);
+      writer.Write("utt" + std::to_string(i), vec);
+    }
+  }
+  TableMapOptions opts;
+  opts.num_threads = num_threads;
+  opts.batch_size = batch_size;
+  // Doubles each element, and fails for the empty vectors.
+  int64 num_fail;
+  int64 num_done = MapTable<BasicVectorHolder<int32>,
+                            BasicVectorHolder<int32> >(
+      "ark:tmpf.in", "ark:tmpf.out", opts,
+      [](const std::string &key, const std::vector<int32> &in,
+         std::vector<int32> *out) {
+        if (in.empty()) return false;
+        *out = in;
+        for (size_t j = 0; j < out->size(); j++)
+          (*out)[j] *= 2;
+        return true;
+      }, &num_fail);
+  KALDI_ASSERT(num_done + num_fail == num_entries);
+
+  SequentialInt32VectorReader in_reader("ark:tmpf.in"),
+      out_reader("ark:tmpf.out");
+  int64 num_read = 0;
+  for (; !in_reader.Done(); in_reader.Next()) {
+    const std::vector<int32> &in = in_reader.Value();
+    if (in.empty()) continue;
+    // The outputs are in the same order as the inputs.
+    KALDI_ASSERT(!out_reader.Done() && out_reader.Key() == in_reader.Key());
+    const std::vector<int32> &out = out_reader.Value();
+    KALDI_ASSERT(out.size() == in.size());
+    for (size_t j = 0; j < in.size(); j++)
+      KALDI_ASSERT(out[j] == 2 * in[j]);
+    out_reader.Next();
+    num_read++;
+  }
+  KALDI_ASSERT(out_reader.Done() && num_read == num_done);
+  std::remove("tmpf.in");
+  std::remove("tmpf.out");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  TestMapTable(1, 100);
+  TestMapTable(4, 1);
+  TestMapTable(4, 7);
+  TestMapTable(8, 100);
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -0,0 +1,168 @@
+// util/table-map.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_TABLE_MAP_H_
+#define KALDI_UTIL_TABLE_MAP_H_
+
+#include <string>
+#include <vector>
+
+#include "itf/options-itf.h"
+#include "util/kaldi-table.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+/// Options for MapTable().
+struct TableMapOptions {
+  int32 num_threads;
+  int32 batch_size;
+
+  TableMapOptions(): num_threads(1), batch_size(100) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("num-threads", &num_threads, "Number of threads used to "
+                   "process the table (reading and writing are done by one "
+                   "thread, and the output is in the same order as the "
+                   "input).");
+    opts->Register("map-batch-size", &batch_size, "Number of table entries "
+                   "given to a thread at a time, with --num-threads > 1.");
+  }
+};
+
+
+namespace table_map_internal {
+
+// The task that TaskSequencer runs for a batch of entries: operator() calls
+// the function, and the destructor (which TaskSequencer calls in order)
+// writes the outputs.
+template <class InHolder, class OutHolder, class Fn>
+class MapBatchTask {
+ public:
+  typedef typename InHolder::T InT;
+  typedef typename OutHolder::T OutT;
+
+  MapBatchTask(const Fn &fn, TableWriter<OutHolder> *writer,
+               int64 *num_done, int64 *num_fail):
+      fn_(fn), writer_(writer), num_done_(num_done), num_fail_(num_fail) { }
+
+  void Add(const std::string &key, const InT &input) {
+    keys_.push_back(key);
+    inputs_.push_back(input);
+  }
+
+  size_t Size() const { return keys_.size(); }
+
+  void operator () () {
+    outputs_.resize(keys_.size());
+    ok_.resize(keys_.size());
+    for (size_t i = 0; i < keys_.size(); i++)
+      ok_[i] = fn_(keys_[i], inputs_[i], &(outputs_[i]));
+  }
+
+  ~MapBatchTask() {
+    for (size_t i = 0; i < keys_.size(); i++) {
+      if (ok_[i]) {
+        writer_->Write(keys_[i], outputs_[i]);
+        (*num_done_)++;
+      } else {
+        (*num_fail_)++;
+      }
+    }
+  }
+
+ private:
+  const Fn &fn_;
+  TableWriter<OutHolder> *writer_;
+  int64 *num_done_;
+  int64 *num_fail_;
+  std::vector<std::string> keys_;
+  std::vector<InT> inputs_;
+  std::vector<OutT> outputs_;
+  std::vector<bool> ok_;
+};
+
+}  // namespace table_map_internal
+
+
+/**
+   MapTable() is for the many programs that read a table, transform each entry
+   independently and write the results to another table (e.g. ali-to-pdf,
+   ali-to-post, convert-ali).  It reads the table 'rspecifier' and for each
+   entry calls
+   \code
+     bool fn(const std::string &key, const InHolder::T &input,
+             OutHolder::T *output);
+   \endcode
+   writing 'output' under 'key' to 'wspecifier' if it returns true.  With
+   opts.num_threads > 1, the calls are made from that many threads, in batches
+   of opts.batch_size entries, so 'fn' must be safe to call concurrently (it
+   normally only reads shared data such as a TransitionModel); the output is
+   still written in the same order as the input.  Returns the number of entries
+   for which 'fn' returned true, and if 'num_fail' is non-NULL, sets it to the
+   number for which it returned false.  E.g.:
+   \code
+     int64 num_done = MapTable<BasicVectorHolder<int32>,
+                               BasicVectorHolder<int32> >(
+         alignments_rspecifier, pdfs_wspecifier, map_opts,
+         [&trans_model](const std::string &key,
+                        const std::vector<int32> &ali,
+                        std::vector<int32> *pdfs) {
+           ...
+           return true;
+         });
+   \endcode
+*/
+template <class InHolder, class OutHolder, class Fn>
+int64 MapTable(const std::string &rspecifier,
+               const std::string &wspecifier,
+               const TableMapOptions &opts,
+               const Fn &fn,
+               int64 *num_fail = NULL) {
+  typedef table_map_internal::MapBatchTask<InHolder, OutHolder, Fn> Task;
+  KALDI_ASSERT(opts.batch_size > 0);
+  SequentialTableReader<InHolder> reader(rspecifier);
+  TableWriter<OutHolder> writer(wspecifier);
+  int64 num_done = 0, num_failed = 0;
+  {
+    TaskSequencerConfig sequencer_config;
+    // With zero threads TaskSequencer runs the tasks in this thread.
+    sequencer_config.num_threads = (opts.num_threads > 1 ?
+                                    opts.num_threads : 0);
+    TaskSequencer<Task> sequencer(sequencer_config);
+    int32 batch_size = (opts.num_threads > 1 ? opts.batch_size : 1);
+    Task *task = NULL;
+    for (; !reader.Done(); reader.Next()) {
+      if (task == NULL)
+        task = new Task(fn, &writer, &num_done, &num_failed);
+      task->Add(reader.Key(), reader.Value());
+      if (static_cast<int32>(task->Size()) >= batch_size) {
+        sequencer.Run(task);
+        task = NULL;
+      }
+    }
+    if (task != NULL)
+      sequencer.Run(task);
+  }
+  if (num_fail != NULL)
+    *num_fail = num_failed;
+  return num_done;
+}
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_TABLE_MAP_H_
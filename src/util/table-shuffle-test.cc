@@ -0,0 +1,77 @@
+// util/table-shuffle-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+#include <cstdio>
+#include <map>
+
+#include "util/table-shuffle.h"
+#include "util/table-types.h"
+
+namespace kaldi {
+
+// Shuffles 'num_entries' random vectors with a memory limit of 'memory_mb'
+// and checks that the output has the same entries in a different order.  With
+// a small limit, the buckets are too big and are split again.
+void TestTableShuffler(int32 num_entries, BaseFloat memory_mb,
+                       int32 num_buckets) {
+  TableShuffleOptions opts;
+  opts.dir = ".";
+  opts.memory_mb = memory_mb;
+  opts.num_buckets = num_buckets;
+  std::map<std::string, std::vector<int32> > entries;
+  int64 num_done;
+  {
+    TableShuffler<BasicVectorHolder<int32> > shuffler(opts);
+    for (int32 i = 0; i < num_entries; i++) {
+      std::string key = "utt" + std::to_string(i);
+      std::vector<int32> &vec = entries[key];
+      vec.resize(RandInt(0, 20));
+      for (size_t j = 0; j < vec.size(); j++)
+        vec[j] = RandInt(0, 1000);
+      shuffler.Accept(key, vec);
+    }
+    Int32VectorWriter writer("ark:tmpf.shuffled");
+    num_done = shuffler.Output(&writer);
+  }
+  KALDI_ASSERT(num_done == num_entries);
+
+  SequentialInt32VectorReader reader("ark:tmpf.shuffled");
+  int32 num_read = 0, num_in_place = 0;
+  for (; !reader.Done(); reader.Next(), num_read++) {
+    std::map<std::string, std::vector<int32> >::iterator iter =
+        entries.find(reader.Key());
+    KALDI_ASSERT(iter != entries.end() && iter->second == reader.Value());
+    entries.erase(iter);
+    if (reader.Key() == "utt" + std::to_string(num_read))
+      num_in_place++;
+  }
+  KALDI_ASSERT(num_read == num_entries && entries.empty());
+  KALDI_ASSERT(num_in_place < num_entries / 10 + 2);
+  std::remove("tmpf.shuffled");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  TestTableShuffler(0, 1.0, 4);
+  TestTableShuffler(1000, 1.0, 4);
+  TestTableShuffler(5000, 100.0, 16);
+  // 0.02 MB: the buckets are larger than the limit and are split again.
+  TestTableShuffler(5000, 0.02, 4);
+  std::cout << "Test OK.\n";
+  return 0;
+}
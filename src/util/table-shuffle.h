@@ -0,0 +1,363 @@
+// util/table-shuffle.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_TABLE_SHUFFLE_H_
+#define KALDI_UTIL_TABLE_SHUFFLE_H_
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "itf/options-itf.h"
+#include "util/kaldi-table.h"
+
+namespace kaldi {
+
+/// Options for TableShuffler.
+struct TableShuffleOptions {
+  std::string dir;
+  BaseFloat memory_mb;
+  int32 num_buckets;
+
+  TableShuffleOptions(): memory_mb(2000.0), num_buckets(64) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("shuffle-dir", &dir, "If set, do a full randomization "
+                   "with bounded memory, using temporary files in this "
+                   "directory (which should be on local disk, with room for a "
+                   "copy of the data): the entries are first written to "
+                   "--shuffle-buckets files in random order, and then each "
+                   "file is read back, shuffled in memory and output, in "
+                   "random order of the files.");
+    opts->Register("shuffle-memory-mb", &memory_mb, "With --shuffle-dir, "
+                   "approximate limit on the memory used for the data, in "
+                   "megabytes.");
+    opts->Register("shuffle-buckets", &num_buckets, "With --shuffle-dir, the "
+                   "number of temporary files; files too large to shuffle "
+                   "within --shuffle-memory-mb are split again.");
+  }
+};
+
+
+/**
+   TableShuffler outputs the entries of a table in a uniformly random order,
+   like reading them all into memory and shuffling them, but for tables too
+   large for that (e.g. the egs of a large training set).  It is a two-pass
+   external shuffle.  Accept() appends each entry, in archive format, to the
+   in-memory buffer of a randomly chosen bucket; full buffers are handed to a
+   background thread that appends them to the bucket's file in opts.dir, so
+   the writes are large and sequential and overlap with the reading of the
+   input.  Output() then goes through the buckets in random order; each one is
+   read back in one pass (the next one being read by a background thread in
+   the meantime), shuffled in memory and written out.  Since each entry goes
+   to an independently chosen random bucket, the resulting order is a uniformly
+   random permutation.  A bucket that turns out to be too large for the memory
+   limit is shuffled recursively by another TableShuffler.
+
+   The data in memory is bounded by about opts.memory_mb: half of it for the
+   buffers of the first pass and a quarter for the writes in flight, and a
+   quarter for each of the two buckets in memory in the second pass.  E.g.:
+   \code
+     TableShuffler<NnetExampleHolder> shuffler(shuffle_opts);
+     for (; !example_reader.Done(); example_reader.Next())
+       shuffler.Accept(example_reader.Key(), example_reader.Value());
+     int64 num_done = shuffler.Output(&example_writer);
+   \endcode
+   Random numbers come from Rand() (see --srand), in the calling thread only.
+*/
+template <class Holder>
+class TableShuffler {
+ public:
+  typedef typename Holder::T T;
+
+  explicit TableShuffler(const TableShuffleOptions &opts);
+
+  /// Adds an entry.  Must not be called after Output().
+  void Accept(const std::string &key, const T &value);
+
+  /// Writes all the entries to 'writer' in random order, and returns their
+  /// number.  May be called only once.
+  int64 Output(TableWriter<Holder> *writer);
+
+  /// Removes the temporary files.
+  ~TableShuffler();
+
+ private:
+  typedef std::vector<std::pair<std::string, T> > EntryList;
+
+  // Hands the buffer of bucket 'b' to the writing thread, waiting if too much
+  // data is in flight.
+  void FlushBucket(int32 b);
+
+  // The writing thread of the first pass.
+  void WriteFiles();
+
+  // Waits for the writing thread to finish its queue and exit.
+  void StopWriting();
+
+  // Reads the entries of a bucket file; sets '*ok' to false (and does not
+  // throw, as it may run in a separate thread) on error.
+  static void ReadBucket(const std::string &filename, EntryList *entries,
+                         bool *ok);
+
+  // Shuffles 'entries' and writes them.
+  static void WriteShuffled(EntryList *entries, TableWriter<Holder> *writer);
+
+  TableShuffleOptions opts_;
+  std::string prefix_;  // The bucket files are prefix_ + b + ".ark".
+  size_t block_bytes_;  // A buffer is flushed when it gets this large.
+  size_t max_queued_bytes_;
+  size_t max_bucket_bytes_;  // Larger buckets are shuffled recursively.
+  std::vector<std::string> buffers_;
+  std::vector<size_t> bucket_bytes_;  // Bytes in each bucket so far.
+  bool output_done_;
+
+  std::thread writer_thread_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::pair<int32, std::string> > queue_;  // guarded by mutex_.
+  size_t queued_bytes_;  // guarded by mutex_.
+  bool writing_done_;  // guarded by mutex_.
+  bool write_error_;  // set by the writing thread.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(TableShuffler);
+};
+
+
+template <class Holder>
+TableShuffler<Holder>::TableShuffler(const TableShuffleOptions &opts):
+    opts_(opts), output_done_(false), queued_bytes_(0), writing_done_(false),
+    write_error_(false) {
+  if (opts_.dir.empty())
+    KALDI_ERR << "TableShuffler needs a directory for its temporary files.";
+  if (opts_.memory_mb <= 0.0 || opts_.num_buckets < 2)
+    KALDI_ERR << "Invalid options: --shuffle-memory-mb=" << opts_.memory_mb
+              << ", --shuffle-buckets=" << opts_.num_buckets;
+  size_t memory_bytes = static_cast<size_t>(opts_.memory_mb * 1048576.0);
+  block_bytes_ = memory_bytes / (2 * opts_.num_buckets);
+  max_queued_bytes_ = memory_bytes / 4;
+  max_bucket_bytes_ = memory_bytes / 4;
+  std::ostringstream prefix;
+  prefix << opts_.dir << "/shuffle.";
+#ifndef _MSC_VER
+  prefix << getpid() << '.';
+#endif
+  // Distinguishes the TableShufflers of a process (including the recursive
+  // ones).
+  prefix << static_cast<const void*>(this) << '.';
+  prefix_ = prefix.str();
+  buffers_.resize(opts_.num_buckets);
+  bucket_bytes_.resize(opts_.num_buckets, 0);
+  writer_thread_ = std::thread(&TableShuffler<Holder>::WriteFiles, this);
+}
+
+template <class Holder>
+void TableShuffler<Holder>::Accept(const std::string &key, const T &value) {
+  KALDI_ASSERT(!output_done_);
+  int32 b = RandInt(0, opts_.num_buckets - 1);
+  std::ostringstream os;
+  os << key << ' ';
+  if (!Holder::Write(os, true, value))
+    KALDI_ERR << "Error writing entry for key " << key;
+  buffers_[b] += os.str();
+  if (buffers_[b].size() >= block_bytes_)
+    FlushBucket(b);
+}
+
+template <class Holder>
+void TableShuffler<Holder>::FlushBucket(int32 b) {
+  bucket_bytes_[b] += buffers_[b].size();
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (queued_bytes_ > max_queued_bytes_ && !write_error_)
+    cond_.wait(lock);
+  if (write_error_)
+    KALDI_ERR << "Error writing temporary files " << prefix_ << "*.ark";
+  queued_bytes_ += buffers_[b].size();
+  queue_.push_back(std::make_pair(b, std::string()));
+  queue_.back().second.swap(buffers_[b]);
+  cond_.notify_all();
+}
+
+template <class Holder>
+void TableShuffler<Holder>::WriteFiles() {
+  std::vector<std::ofstream*> files(opts_.num_buckets, NULL);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    while (queue_.empty() && !writing_done_)
+      cond_.wait(lock);
+    if (queue_.empty())
+      break;
+    std::pair<int32, std::string> block;
+    block.first = queue_.front().first;
+    block.second.swap(queue_.front().second);
+    queue_.pop_front();
+    lock.unlock();
+    std::ofstream *&file = files[block.first];
+    if (file == NULL) {
+      std::ostringstream filename;
+      filename << prefix_ << block.first << ".ark";
+      file = new std::ofstream(filename.str().c_str(),
+                               std::ios::out | std::ios::binary);
+    }
+    file->write(block.second.data(), block.second.size());
+    bool ok = file->good();
+    lock.lock();
+    if (!ok)
+      write_error_ = true;
+    queued_bytes_ -= block.second.size();
+    cond_.notify_all();
+  }
+  lock.unlock();
+  for (size_t b = 0; b < files.size(); b++) {
+    if (files[b] != NULL) {
+      files[b]->close();
+      if (files[b]->fail())
+        write_error_ = true;
+      delete files[b];
+    }
+  }
+}
+
+template <class Holder>
+void TableShuffler<Holder>::StopWriting() {
+  if (!writer_thread_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    writing_done_ = true;
+    cond_.notify_all();
+  }
+  writer_thread_.join();
+}
+
+template <class Holder>
+void TableShuffler<Holder>::ReadBucket(const std::string &filename,
+                                       EntryList *entries, bool *ok) {
+  entries->clear();
+  try {
+    SequentialTableReader<Holder> reader("ark:" + filename);
+    for (; !reader.Done(); reader.Next())
+      entries->push_back(std::make_pair(reader.Key(), reader.Value()));
+    *ok = reader.Close();
+  } catch (const std::exception &e) {
+    *ok = false;
+  }
+}
+
+template <class Holder>
+void TableShuffler<Holder>::WriteShuffled(EntryList *entries,
+                                          TableWriter<Holder> *writer) {
+  for (size_t i = entries->size(); i > 1; i--)
+    std::swap((*entries)[i - 1], (*entries)[RandInt(0, i - 1)]);
+  for (size_t i = 0; i < entries->size(); i++)
+    writer->Write((*entries)[i].first, (*entries)[i].second);
+}
+
+template <class Holder>
+int64 TableShuffler<Holder>::Output(TableWriter<Holder> *writer) {
+  KALDI_ASSERT(!output_done_);
+  output_done_ = true;
+  for (int32 b = 0; b < opts_.num_buckets; b++)
+    if (!buffers_[b].empty())
+      FlushBucket(b);
+  StopWriting();
+  if (write_error_)
+    KALDI_ERR << "Error writing temporary files " << prefix_ << "*.ark";
+
+  std::vector<int32> order;
+  for (int32 b = 0; b < opts_.num_buckets; b++)
+    if (bucket_bytes_[b] != 0)
+      order.push_back(b);
+  for (size_t i = order.size(); i > 1; i--)
+    std::swap(order[i - 1], order[RandInt(0, i - 1)]);
+
+  int64 num_done = 0;
+  EntryList cur, next;
+  std::thread reader_thread;
+  bool next_ready = false,  // true if 'next' has (or is getting) order[i].
+      next_ok = true;
+  try {
+    for (size_t i = 0; i < order.size(); i++) {
+      std::ostringstream filename;
+      filename << prefix_ << order[i] << ".ark";
+      if (bucket_bytes_[order[i]] > max_bucket_bytes_) {
+        // Too large to shuffle in memory: split it again.
+        KALDI_ASSERT(!next_ready);
+        TableShuffler<Holder> shuffler(opts_);
+        SequentialTableReader<Holder> reader("ark:" + filename.str());
+        for (; !reader.Done(); reader.Next())
+          shuffler.Accept(reader.Key(), reader.Value());
+        num_done += shuffler.Output(writer);
+        continue;
+      }
+      bool ok;
+      if (next_ready) {
+        reader_thread.join();
+        cur.swap(next);
+        ok = next_ok;
+        next_ready = false;
+      } else {
+        ReadBucket(filename.str(), &cur, &ok);
+      }
+      if (!ok)
+        KALDI_ERR << "Error reading temporary file " << filename.str();
+      if (i + 1 < order.size() &&
+          bucket_bytes_[order[i + 1]] <= max_bucket_bytes_) {
+        std::ostringstream next_filename;
+        next_filename << prefix_ << order[i + 1] << ".ark";
+        reader_thread = std::thread(&TableShuffler<Holder>::ReadBucket,
+                                    next_filename.str(), &next, &next_ok);
+        next_ready = true;
+      }
+      WriteShuffled(&cur, writer);
+      num_done += cur.size();
+      cur.clear();
+    }
+  } catch (...) {
+    if (reader_thread.joinable())
+      reader_thread.join();
+    throw;
+  }
+  return num_done;
+}
+
+template <class Holder>
+TableShuffler<Holder>::~TableShuffler() {
+  StopWriting();
+  for (int32 b = 0; b < opts_.num_buckets; b++) {
+    if (bucket_bytes_[b] != 0) {
+      std::ostringstream filename;
+      filename << prefix_ << b << ".ark";
+      std::remove(filename.str().c_str());
+    }
+  }
+}
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_TABLE_SHUFFLE_H_
@@ -110,6 +110,9 @@ typedef SequentialTableReader<BasicHolder<int32> >  SequentialInt32Reader;
 typedef RandomAccessTableReader<BasicHolder<int32> >  RandomAccessInt32Reader;
 
 typedef TableWriter<BasicVectorHolder<int32> >  Int32VectorWriter;
+// Writes in compressed form; read with the Int32Vector readers.
+typedef TableWriter<CompressedIntVectorHolder<int32> >
+                              CompressedInt32VectorWriter;
 typedef SequentialTableReader<BasicVectorHolder<int32> >
                               SequentialInt32VectorReader;
 typedef RandomAccessTableReader<BasicVectorHolder<int32> >
@@ -81,21 +81,13 @@ bool SplitStringToIntegers(const std::string &full,
   SplitStringToVector(full, delim, omit_empty_strings, &split);
   out->resize(split.size());
   for (size_t i = 0; i < split.size(); i++) {
-    const char *this_str = split[i].c_str();
-    char *end = NULL;
-    int64 j = 0;
-    j = KALDI_STRTOLL(this_str, &end);
-    if (end == this_str || *end != '\0') {
+    const char *this_str = split[i].c_str(),
+        *this_end = this_str + split[i].size();
+    while (this_str != this_end && isspace(*this_str)) this_str++;
+    // fails also if the output type cannot fit this integer.
+    if (ParseInteger(this_str, this_end, &((*out)[i])) != this_end) {
       out->clear();
       return false;
-    } else {
-      I jI = static_cast<I>(j);
-      if (static_cast<int64>(jI) != j) {
-        // output type cannot fit this integer.
-        out->clear();
-        return false;
-      }
-      (*out)[i] = jI;
     }
   }
   return true;
@@ -109,29 +101,25 @@ bool SplitStringToFloats(const std::string &full,
                          std::vector<F> *out);
 
 
-/// Converts a string into an integer via strtoll and returns false if there was
-/// any kind of problem (i.e. the string was not an integer or contained extra
-/// non-whitespace junk, or the integer was too large to fit into the type it is
-/// being converted into).  Only sets *out if everything was OK and it returns
-/// true.
+/// Converts a string into an integer via ParseInteger() and returns false if
+/// there was any kind of problem (i.e. the string was not an integer or
+/// contained extra non-whitespace junk, or the integer was too large to fit
+/// into the type it is being converted into).  Only sets *out if everything
+/// was OK and it returns true.
 template<class Int>
 bool ConvertStringToInteger(const std::string &str,
                             Int *out) {
   KALDI_ASSERT_IS_INTEGER_TYPE(Int);
-  const char *this_str = str.c_str();
-  char *end = NULL;
-  errno = 0;
-  int64 i = KALDI_STRTOLL(this_str, &end);
-  if (end != this_str)
-    while (isspace(*end)) end++;
-  if (end == this_str || *end != '\0' || errno != 0)
+  const char *begin = str.c_str(), *end = begin + str.size();
+  while (begin != end && isspace(*begin)) begin++;
+  Int i;
+  const char *p = ParseInteger(begin, end, &i);
+  if (p == NULL)
     return false;
-  Int iInt = static_cast<Int>(i);
-  if (static_cast<int64>(iInt) != i ||
-      (i < 0 && !std::numeric_limits<Int>::is_signed)) {
+  while (p != end && isspace(*p)) p++;
+  if (p != end)
     return false;
-  }
-  *out = iInt;
+  *out = i;
   return true;
 }
 